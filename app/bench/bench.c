@@ -0,0 +1,881 @@
+/*
+ * Microbenchmarks of the hot path of the video frames on the client: the
+ * preprocessing effects, the frame outputs (saved images, pipe), the
+ * handoffs between the threads (frame buffer, delay buffer) and the precision
+ * of the timed waits pacing the frames.
+ *
+ * Usage: scrcpy-bench [--frames=N] [--size=WxH] [--input=frames.yuv]
+ *                     [--map=stereo_rectification_maps.xml] [--dir=DIR]
+ *
+ * The input frames are either synthetic, or read from a file of consecutive
+ * raw YUV420P frames of the given size (as written by
+ * --save-frames-format=yuv). For each benchmark, the time, the number of heap
+ * allocations (glibc only) and the bandwidth per frame are reported.
+ */
+
+#include "common.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <libavutil/frame.h>
+
+#include "delay_buffer.h"
+#include "frame_buffer.h"
+#include "frame_pipe.h"
+#include "frame_pool.h"
+#include "frame_writer.h"
+#include "rgb_converter.h"
+#include "video_preprocess.h"
+#include "util/log.h"
+#include "util/thread.h"
+#include "util/tick.h"
+
+#define BENCH_DEFAULT_FRAMES 200
+#define BENCH_MAX_INPUT_FRAMES 16
+// Number of distinct files written by the save benchmarks (overwritten)
+#define BENCH_SAVE_FILES 8
+
+// Quest 3 stereo frames (both eyes side by side): as captured with
+// --max-size=1920, and at the full resolution of the display
+static const struct {
+    int width;
+    int height;
+} default_sizes[] = {
+    {1920, 1024},
+    {4128, 2208},
+};
+
+#ifdef __GLIBC__
+// Count the heap allocations of the whole process (including FFmpeg and
+// OpenCV) by interposing the allocator
+
+# define BENCH_HAS_ALLOC_COUNT
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static atomic_uint_fast64_t alloc_count;
+
+void *
+malloc(size_t size) {
+    atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t n, size_t size) {
+    atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+
+void *
+realloc(void *ptr, size_t size) {
+    atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+int
+posix_memalign(void **ptr, size_t alignment, size_t size) {
+    atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+    void *p = __libc_memalign(alignment, size);
+    if (!p) {
+        return ENOMEM;
+    }
+    *ptr = p;
+    return 0;
+}
+
+void *
+aligned_alloc(size_t alignment, size_t size) {
+    atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+static uint64_t
+get_alloc_count(void) {
+    return atomic_load_explicit(&alloc_count, memory_order_relaxed);
+}
+#else
+static uint64_t
+get_alloc_count(void) {
+    return 0;
+}
+#endif
+
+struct bench_input {
+    AVFrame *frames[BENCH_MAX_INPUT_FRAMES];
+    unsigned count;
+    int width;
+    int height;
+};
+
+struct bench_measure {
+    sc_tick duration;
+    uint64_t allocs;
+    uint64_t bytes;
+    unsigned frames;
+};
+
+static unsigned iterations = BENCH_DEFAULT_FRAMES;
+static const char *map_path;
+static struct sc_video_preprocess *maps; // loaded from map_path
+static const char *save_dir;
+
+static inline void
+measure_begin(sc_tick *start, uint64_t *allocs) {
+    *allocs = get_alloc_count();
+    *start = sc_tick_now();
+}
+
+static inline void
+measure_end(struct bench_measure *m, sc_tick start, uint64_t allocs,
+            uint64_t bytes) {
+    m->duration += sc_tick_now() - start;
+    m->allocs += get_alloc_count() - allocs;
+    m->bytes += bytes;
+    ++m->frames;
+}
+
+static void
+print_measure(const char *name, const struct bench_input *input,
+              const struct bench_measure *m) {
+    assert(m->frames);
+    double ns = (double) SC_TICK_TO_NS(m->duration) / m->frames;
+    // 1 byte per ns is 1000 MB/s
+    double mbps = m->duration ? (double) m->bytes * 1000
+                              / SC_TICK_TO_NS(m->duration)
+                              : 0;
+    char size[32];
+    snprintf(size, sizeof(size), "%dx%d", input->width, input->height);
+#ifdef BENCH_HAS_ALLOC_COUNT
+    printf("%-24s %-10s %12.0f ns/frame %8.2f allocs/frame %9.1f MB/s\n",
+           name, size, ns, (double) m->allocs / m->frames, mbps);
+#else
+    printf("%-24s %-10s %12.0f ns/frame %8s allocs/frame %9.1f MB/s\n",
+           name, size, ns, "?", mbps);
+#endif
+}
+
+static size_t
+get_frame_size(const AVFrame *frame) {
+    return (size_t) frame->width * frame->height * 3 / 2;
+}
+
+static AVFrame *
+alloc_frame(int width, int height) {
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    if (av_frame_get_buffer(frame, 0)) {
+        LOG_OOM();
+        av_frame_free(&frame);
+        return NULL;
+    }
+
+    return frame;
+}
+
+static void
+fill_synthetic(AVFrame *frame, unsigned index) {
+    // Gradients with some noise, so that the lossless codecs do not compress
+    // unrealistically well
+    uint32_t seed = 0x12345678 + index;
+    for (int y = 0; y < frame->height; ++y) {
+        uint8_t *row = frame->data[0] + (size_t) y * frame->linesize[0];
+        for (int x = 0; x < frame->width; ++x) {
+            seed = seed * 1103515245 + 12345;
+            row[x] = (uint8_t) (x + y + index + ((seed >> 16) & 0xF));
+        }
+    }
+    for (int p = 1; p < 3; ++p) {
+        for (int y = 0; y < frame->height / 2; ++y) {
+            uint8_t *row = frame->data[p] + (size_t) y * frame->linesize[p];
+            int value = 128 + (p == 1 ? y % 32 : -(y % 32));
+            memset(row, value, frame->width / 2);
+        }
+    }
+}
+
+static bool
+read_plane(FILE *file, uint8_t *data, int linesize, int width, int height) {
+    for (int y = 0; y < height; ++y) {
+        if (fread(data + (size_t) y * linesize, 1, width, file)
+                != (size_t) width) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void
+input_destroy(struct bench_input *input) {
+    for (unsigned i = 0; i < input->count; ++i) {
+        av_frame_free(&input->frames[i]);
+    }
+    input->count = 0;
+}
+
+static bool
+input_init(struct bench_input *input, int width, int height,
+           const char *path) {
+    input->count = 0;
+    input->width = width;
+    input->height = height;
+
+    FILE *file = NULL;
+    if (path) {
+        file = fopen(path, "rb");
+        if (!file) {
+            LOGE("Could not open input file: %s", path);
+            return false;
+        }
+    }
+
+    for (unsigned i = 0; i < BENCH_MAX_INPUT_FRAMES; ++i) {
+        AVFrame *frame = alloc_frame(width, height);
+        if (!frame) {
+            goto error;
+        }
+
+        if (file) {
+            bool ok = read_plane(file, frame->data[0], frame->linesize[0],
+                                 width, height)
+                   && read_plane(file, frame->data[1], frame->linesize[1],
+                                 width / 2, height / 2)
+                   && read_plane(file, frame->data[2], frame->linesize[2],
+                                 width / 2, height / 2);
+            if (!ok) {
+                av_frame_free(&frame);
+                // End of file
+                break;
+            }
+        } else {
+            fill_synthetic(frame, i);
+        }
+
+        frame->pts = i;
+        input->frames[input->count++] = frame;
+    }
+
+    if (file) {
+        fclose(file);
+    }
+
+    if (!input->count) {
+        LOGE("No %dx%d YUV420P frame in the input file", width, height);
+        return false;
+    }
+
+    return true;
+
+error:
+    if (file) {
+        fclose(file);
+    }
+    input_destroy(input);
+    return false;
+}
+
+enum bench_effects_mode {
+    BENCH_EFFECTS_TEXT,
+    BENCH_EFFECTS_REMAP,
+    BENCH_EFFECTS_REMAP_TEXT,
+    BENCH_EFFECTS_REMAP_LUMA, // --output-planes=y
+    BENCH_EFFECTS_PREVIEW,
+};
+
+static void
+bench_effects(const struct bench_input *input, enum bench_effects_mode mode,
+              const char *name) {
+    bool remap = mode == BENCH_EFFECTS_REMAP
+              || mode == BENCH_EFFECTS_REMAP_TEXT
+              || mode == BENCH_EFFECTS_REMAP_LUMA
+              || (mode == BENCH_EFFECTS_PREVIEW && maps);
+    const struct sc_video_preprocess *vpp = remap ? maps : NULL;
+    const char *text = mode == BENCH_EFFECTS_TEXT
+                    || mode == BENCH_EFFECTS_REMAP_TEXT
+                     ? "2024-01-01 00:00:00.000" : NULL;
+
+    struct sc_frame_pool pool;
+    sc_frame_pool_init(&pool);
+
+    AVFrame *preview = av_frame_alloc();
+    if (!preview) {
+        LOG_OOM();
+        goto end;
+    }
+
+    struct bench_measure m = {0};
+    for (unsigned i = 0; i < iterations; ++i) {
+        const AVFrame *src = input->frames[i % input->count];
+        // The effects replace the buffers of the frame
+        AVFrame *frame = av_frame_clone(src);
+        if (!frame) {
+            LOG_OOM();
+            goto end;
+        }
+
+        sc_tick start;
+        uint64_t allocs;
+        measure_begin(&start, &allocs);
+        if (mode == BENCH_EFFECTS_PREVIEW) {
+            if (!apply_video_effects_preview(frame, preview, 2, vpp, text,
+                                             &pool)) {
+                LOGE("Could not produce the preview");
+                av_frame_free(&frame);
+                goto end;
+            }
+            av_frame_unref(preview);
+        } else {
+            apply_video_effects(frame, vpp, text,
+                                mode == BENCH_EFFECTS_REMAP_LUMA, &pool);
+        }
+        measure_end(&m, start, allocs, get_frame_size(src));
+
+        av_frame_free(&frame);
+    }
+
+    print_measure(name, input, &m);
+
+end:
+    av_frame_free(&preview);
+    sc_frame_pool_destroy(&pool);
+}
+
+static void
+bench_rgb(const struct bench_input *input,
+          enum sc_rgb_converter_method method, const char *name) {
+    struct sc_rgb_converter conv;
+    sc_rgb_converter_init(&conv, method);
+
+    struct sc_frame_pool pool;
+    sc_frame_pool_init(&pool);
+
+    AVFrame *rgb = av_frame_alloc();
+    if (!rgb) {
+        LOG_OOM();
+        goto end;
+    }
+
+    struct bench_measure m = {0};
+    for (unsigned i = 0; i < iterations; ++i) {
+        const AVFrame *frame = input->frames[i % input->count];
+
+        sc_tick start;
+        uint64_t allocs;
+        measure_begin(&start, &allocs);
+        bool ok = sc_frame_pool_get(&pool, rgb, AV_PIX_FMT_RGB24, frame->width,
+                                    frame->height)
+               && sc_rgb_converter_convert(&conv, frame, rgb);
+        av_frame_unref(rgb);
+        measure_end(&m, start, allocs, get_frame_size(frame));
+        if (!ok) {
+            LOGE("Could not convert frame to RGB");
+            goto end;
+        }
+    }
+
+    print_measure(name, input, &m);
+
+end:
+    av_frame_free(&rgb);
+    sc_frame_pool_destroy(&pool);
+    sc_rgb_converter_destroy(&conv);
+}
+
+// Rectify and convert to RGB in a single pass, to compare with "effects
+// remap" followed by "rgb integer"
+static void
+bench_remap_rgb(const struct bench_input *input) {
+    struct sc_frame_pool pool;
+    sc_frame_pool_init(&pool);
+
+    AVFrame *rgb = av_frame_alloc();
+    if (!rgb) {
+        LOG_OOM();
+        goto end;
+    }
+
+    struct bench_measure m = {0};
+    for (unsigned i = 0; i < iterations; ++i) {
+        const AVFrame *frame = input->frames[i % input->count];
+
+        sc_tick start;
+        uint64_t allocs;
+        measure_begin(&start, &allocs);
+        bool ok = sc_video_preprocess_remap_rgb(maps, frame, AV_PIX_FMT_RGB24,
+                                                rgb, &pool);
+        av_frame_unref(rgb);
+        measure_end(&m, start, allocs, get_frame_size(frame));
+        if (!ok) {
+            LOGE("Could not remap frame to RGB");
+            goto end;
+        }
+    }
+
+    print_measure("remap rgb fused", input, &m);
+
+end:
+    av_frame_free(&rgb);
+    sc_frame_pool_destroy(&pool);
+}
+
+static void
+remove_saved_files(enum sc_save_frames_format format) {
+    static const char *const exts[] = {
+        [SC_SAVE_FRAMES_FORMAT_PPM] = "ppm",
+        [SC_SAVE_FRAMES_FORMAT_YUV] = "yuv",
+        [SC_SAVE_FRAMES_FORMAT_PNG] = "png",
+        [SC_SAVE_FRAMES_FORMAT_QOI] = "qoi",
+    };
+
+    for (unsigned i = 0; i < BENCH_SAVE_FILES; ++i) {
+        char filename[256];
+        snprintf(filename, sizeof(filename), "%s/frame_%06u.%s", save_dir, i,
+                 exts[format]);
+        remove(filename);
+    }
+}
+
+static void
+bench_save(const struct bench_input *input, enum sc_save_frames_format format,
+           const char *name) {
+    struct sc_frame_writer_params params = {
+        .directory = save_dir,
+        .format = format,
+        .thread_count = 1,
+    };
+
+    struct sc_frame_writer fw;
+    if (!sc_frame_writer_init(&fw, &params)) {
+        // Error already logged (e.g. PNG encoder not available)
+        return;
+    }
+
+    struct bench_measure m = {0};
+    for (unsigned i = 0; i < iterations; ++i) {
+        const AVFrame *frame = input->frames[i % input->count];
+
+        sc_tick start;
+        uint64_t allocs;
+        measure_begin(&start, &allocs);
+        // Without timestamp, to overwrite the same files
+        sc_frame_writer_write(&fw, frame, i % BENCH_SAVE_FILES, -1);
+        measure_end(&m, start, allocs, get_frame_size(frame));
+    }
+
+    sc_frame_writer_destroy(&fw);
+    remove_saved_files(format);
+
+    print_measure(name, input, &m);
+}
+
+static void
+bench_pipe(const struct bench_input *input) {
+    // The frames are written to the stdout file descriptor
+    fflush(stdout);
+    int stdout_fd = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (stdout_fd < 0 || null_fd < 0 || dup2(null_fd, STDOUT_FILENO) < 0) {
+        LOGE("Could not redirect stdout to /dev/null");
+        goto end;
+    }
+
+    struct bench_measure m = {0};
+    for (unsigned i = 0; i < iterations; ++i) {
+        const AVFrame *frame = input->frames[i % input->count];
+
+        sc_tick start;
+        uint64_t allocs;
+        measure_begin(&start, &allocs);
+        bool ok = sc_frame_pipe_write(frame, i, -1);
+        measure_end(&m, start, allocs, get_frame_size(frame));
+        if (!ok) {
+            LOGE("Could not write frame to /dev/null");
+            break;
+        }
+    }
+
+    dup2(stdout_fd, STDOUT_FILENO);
+
+    print_measure("pipe_frame", input, &m);
+
+end:
+    if (null_fd >= 0) {
+        close(null_fd);
+    }
+    if (stdout_fd >= 0) {
+        close(stdout_fd);
+    }
+}
+
+static void
+bench_frame_buffer(const struct bench_input *input) {
+    struct sc_frame_buffer fb;
+    if (!sc_frame_buffer_init(&fb)) {
+        return;
+    }
+
+    AVFrame *dst = av_frame_alloc();
+    if (!dst) {
+        LOG_OOM();
+        goto end;
+    }
+
+    struct bench_measure m = {0};
+    for (unsigned i = 0; i < iterations; ++i) {
+        const AVFrame *frame = input->frames[i % input->count];
+
+        sc_tick start;
+        uint64_t allocs;
+        measure_begin(&start, &allocs);
+        bool skipped;
+        bool ok = sc_frame_buffer_push(&fb, frame, &skipped);
+        if (ok) {
+            sc_frame_buffer_consume(&fb, dst);
+        }
+        // Only references are exchanged, the frame data are not copied
+        measure_end(&m, start, allocs, 0);
+        av_frame_unref(dst);
+        if (!ok) {
+            LOGE("Could not push frame to the frame buffer");
+            break;
+        }
+    }
+
+    print_measure("frame_buffer handoff", input, &m);
+
+end:
+    av_frame_free(&dst);
+    sc_frame_buffer_destroy(&fb);
+}
+
+struct bench_delay_sink {
+    struct sc_frame_sink frame_sink;
+    sc_mutex mutex;
+    sc_cond cond;
+    unsigned received;
+};
+
+#define DOWNCAST_DELAY_SINK(SINK) \
+    container_of(SINK, struct bench_delay_sink, frame_sink)
+
+static bool
+bench_delay_sink_open(struct sc_frame_sink *sink, const AVCodecContext *ctx) {
+    (void) sink;
+    (void) ctx;
+    return true;
+}
+
+static void
+bench_delay_sink_close(struct sc_frame_sink *sink) {
+    (void) sink;
+}
+
+static bool
+bench_delay_sink_push(struct sc_frame_sink *sink, const AVFrame *frame) {
+    (void) frame;
+    struct bench_delay_sink *ds = DOWNCAST_DELAY_SINK(sink);
+
+    sc_mutex_lock(&ds->mutex);
+    ++ds->received;
+    sc_cond_signal(&ds->cond);
+    sc_mutex_unlock(&ds->mutex);
+
+    return true;
+}
+
+static void
+bench_delay_buffer(const struct bench_input *input) {
+    struct bench_delay_sink ds;
+    if (!sc_mutex_init(&ds.mutex)) {
+        return;
+    }
+    if (!sc_cond_init(&ds.cond)) {
+        sc_mutex_destroy(&ds.mutex);
+        return;
+    }
+    ds.received = 0;
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = bench_delay_sink_open,
+        .close = bench_delay_sink_close,
+        .push = bench_delay_sink_push,
+    };
+    ds.frame_sink.ops = &ops;
+
+    // Minimal delay, to measure the handoff to the buffering thread
+    struct sc_delay_buffer db;
+    sc_delay_buffer_init(&db, 1, true);
+    sc_frame_source_add_sink(&db.frame_source, &ds.frame_sink);
+
+    if (!db.frame_sink.ops->open(&db.frame_sink, NULL)) {
+        goto end;
+    }
+
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) {
+        LOG_OOM();
+        goto close;
+    }
+
+    struct bench_measure m = {0};
+    for (unsigned i = 0; i < iterations; ++i) {
+        if (av_frame_ref(frame, input->frames[i % input->count])) {
+            LOG_OOM();
+            break;
+        }
+        // The PTS are in the time base of sc_tick
+        frame->pts = SC_TICK_TO_US(sc_tick_now());
+
+        sc_tick start;
+        uint64_t allocs;
+        measure_begin(&start, &allocs);
+        bool ok = db.frame_sink.ops->push(&db.frame_sink, frame);
+        if (ok) {
+            // Wait for the frame to be pushed by the buffering thread
+            sc_mutex_lock(&ds.mutex);
+            while (ds.received <= i) {
+                sc_cond_wait(&ds.cond, &ds.mutex);
+            }
+            sc_mutex_unlock(&ds.mutex);
+        }
+        measure_end(&m, start, allocs, 0);
+        av_frame_unref(frame);
+        if (!ok) {
+            LOGE("Could not push frame to the delay buffer");
+            break;
+        }
+    }
+
+    print_measure("delay_buffer handoff", input, &m);
+
+    av_frame_free(&frame);
+close:
+    db.frame_sink.ops->close(&db.frame_sink);
+end:
+    sc_cond_destroy(&ds.cond);
+    sc_mutex_destroy(&ds.mutex);
+}
+
+static int
+compare_ticks(const void *a, const void *b) {
+    sc_tick ta = *(const sc_tick *) a;
+    sc_tick tb = *(const sc_tick *) b;
+    return (ta > tb) - (ta < tb);
+}
+
+// Measure how late the timed waits expire, for a deadline of one frame period
+// at 72 fps (as when pacing the frames of --video-buffer)
+static void
+bench_timedwait(void) {
+    sc_mutex mutex;
+    sc_cond cond;
+    if (!sc_mutex_init(&mutex)) {
+        return;
+    }
+    if (!sc_cond_init(&cond)) {
+        sc_mutex_destroy(&mutex);
+        return;
+    }
+
+    // Each iteration lasts a frame period
+    unsigned count = iterations < 100 ? iterations : 100;
+    sc_tick *late = malloc(count * sizeof(*late));
+    if (!late) {
+        LOG_OOM();
+        goto end;
+    }
+
+    sc_tick period = SC_TICK_FROM_US(1000000 / 72);
+    sc_mutex_lock(&mutex);
+    for (unsigned i = 0; i < count; ++i) {
+        sc_tick deadline = sc_tick_now() + period;
+        // Never signaled
+        while (sc_cond_timedwait(&cond, &mutex, deadline)) {
+            // spurious wakeup
+        }
+        late[i] = sc_tick_now() - deadline;
+    }
+    sc_mutex_unlock(&mutex);
+
+    qsort(late, count, sizeof(*late), compare_ticks);
+    sc_tick sum = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        sum += late[i];
+    }
+    printf("%-24s %-10s %8.1f us late (median %" PRItick ", p99 %" PRItick
+           ", max %" PRItick ")\n", "timedwait 72 fps", "-",
+           (double) SC_TICK_TO_US(sum) / count,
+           SC_TICK_TO_US(late[count / 2]),
+           SC_TICK_TO_US(late[count * 99 / 100]),
+           SC_TICK_TO_US(late[count - 1]));
+
+    free(late);
+end:
+    sc_cond_destroy(&cond);
+    sc_mutex_destroy(&mutex);
+}
+
+static void
+run_benchmarks(const struct bench_input *input) {
+    bench_effects(input, BENCH_EFFECTS_TEXT, "effects text");
+    if (maps) {
+        if (sc_video_preprocess_check_size(maps, input->width,
+                                           input->height)) {
+            bench_effects(input, BENCH_EFFECTS_REMAP, "effects remap");
+            // The same remap by cv::remap() rather than the vectorized kernel
+            sc_video_preprocess_set_simd_remap(false);
+            bench_effects(input, BENCH_EFFECTS_REMAP, "effects remap opencv");
+            sc_video_preprocess_set_simd_remap(true);
+            bench_effects(input, BENCH_EFFECTS_REMAP_TEXT,
+                          "effects remap+text");
+            bench_effects(input, BENCH_EFFECTS_REMAP_LUMA,
+                          "effects remap luma");
+            bench_remap_rgb(input);
+        } else {
+            LOGW("The maps do not match %dx%d, remap skipped", input->width,
+                 input->height);
+        }
+    }
+    bench_effects(input, BENCH_EFFECTS_PREVIEW, "effects preview x2");
+
+    // The conversion used by the image formats (SC_RGB_CONVERTER_DEFAULT)
+    bench_rgb(input, SC_RGB_CONVERTER_SWSCALE, "rgb swscale");
+    bench_rgb(input, SC_RGB_CONVERTER_INTEGER, "rgb integer");
+
+    bench_save(input, SC_SAVE_FRAMES_FORMAT_YUV, "save yuv");
+    bench_save(input, SC_SAVE_FRAMES_FORMAT_PPM, "save ppm");
+    bench_save(input, SC_SAVE_FRAMES_FORMAT_QOI, "save qoi");
+    bench_save(input, SC_SAVE_FRAMES_FORMAT_PNG, "save png");
+
+    bench_pipe(input);
+    bench_frame_buffer(input);
+    bench_delay_buffer(input);
+}
+
+static bool
+parse_size(const char *s, int *width, int *height) {
+    char *end;
+    long w = strtol(s, &end, 10);
+    if (*end != 'x') {
+        return false;
+    }
+    long h = strtol(end + 1, &end, 10);
+    if (*end || w <= 0 || h <= 0 || w % 2 || h % 2 || w > 16384
+            || h > 16384) {
+        return false;
+    }
+    *width = w;
+    *height = h;
+    return true;
+}
+
+int
+main(int argc, char *argv[]) {
+    int width = 0;
+    int height = 0;
+    const char *input_path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (!strncmp(arg, "--frames=", 9)) {
+            long n = strtol(arg + 9, NULL, 10);
+            if (n <= 0) {
+                fprintf(stderr, "Invalid frame count: %s\n", arg + 9);
+                return 1;
+            }
+            iterations = n;
+        } else if (!strncmp(arg, "--size=", 7)) {
+            if (!parse_size(arg + 7, &width, &height)) {
+                fprintf(stderr, "Invalid size (even WxH): %s\n", arg + 7);
+                return 1;
+            }
+        } else if (!strncmp(arg, "--input=", 8)) {
+            input_path = arg + 8;
+        } else if (!strncmp(arg, "--map=", 6)) {
+            map_path = arg + 6;
+        } else if (!strncmp(arg, "--dir=", 6)) {
+            save_dir = arg + 6;
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", arg);
+            return 1;
+        }
+    }
+
+    if (input_path && !width) {
+        fprintf(stderr, "--input requires --size\n");
+        return 1;
+    }
+
+    char tmp_dir[] = "/tmp/scrcpy-bench-XXXXXX";
+    bool tmp_dir_created = false;
+    if (!save_dir) {
+        if (!mkdtemp(tmp_dir)) {
+            fprintf(stderr, "Could not create a temporary directory\n");
+            return 1;
+        }
+        save_dir = tmp_dir;
+        tmp_dir_created = true;
+    }
+
+    // The preview benchmark remaps directly to the preview resolution
+    if (map_path) {
+        maps = sc_video_preprocess_new(map_path, SC_OPENCV_BACKEND_CPU, 2);
+        if (!maps) {
+            fprintf(stderr, "Could not load the maps: %s\n", map_path);
+            return 1;
+        }
+    }
+
+    // The pipe benchmark reserves stdout, the results are printed after
+    // restoring it
+    sc_frame_pipe_init();
+
+    int ret = 0;
+    unsigned size_count = width ? 1 : ARRAY_LEN(default_sizes);
+    for (unsigned i = 0; i < size_count; ++i) {
+        int w = width ? width : default_sizes[i].width;
+        int h = width ? height : default_sizes[i].height;
+
+        struct bench_input input;
+        if (!input_init(&input, w, h, input_path)) {
+            ret = 1;
+            break;
+        }
+
+        run_benchmarks(&input);
+        input_destroy(&input);
+    }
+
+    // Independent of the frame size
+    if (!ret) {
+        bench_timedwait();
+    }
+
+    if (tmp_dir_created) {
+        rmdir(tmp_dir);
+    }
+
+    if (maps) {
+        sc_video_preprocess_destroy(maps);
+    }
+
+    return ret;
+}
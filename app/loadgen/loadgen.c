@@ -0,0 +1,544 @@
+/*
+ * Synthetic server for the load tests of the client, without any device: it
+ * serves a pre-encoded video stream over the scrcpy socket protocol (the
+ * device meta, the codec id, the video size, then the packets with their
+ * 12-byte meta headers, as parsed by sc_demuxer), to any number of concurrent
+ * clients.
+ *
+ * Usage: scrcpy-loadgen [--port=N] [--fps=N] [--bit-rate=N] [--sessions=N]
+ *                       [--duration=SEC] [--capture-timestamp] clip.dump
+ *
+ * The clip is a stream dump recorded from a device (--dump-stream), so its
+ * codec (H.264, H.265 or AV1) and its resolution are the ones of the
+ * recording. It is looped for each session, at the pace of its PTS, or at
+ * --fps frames per second. With --bit-rate (H.264 and H.265 only), the
+ * packets smaller than the frame budget are padded with filler data NAL
+ * units (ignored by the decoders) to reach the bit rate.
+ *
+ * Each client connects with:
+ *
+ *     scrcpy --server-address=127.0.0.1:27183 --no-audio --no-control ...
+ *
+ * Every connection is a separate session (up to --sessions at once), until
+ * the client disconnects or for --duration seconds. If the client saves,
+ * pipes, shares or publishes the frames, it expects the capture timestamps in
+ * the packet headers: start the load generator with --capture-timestamp.
+ */
+
+#include "common.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stream_dump.h"
+#include "util/binary.h"
+#include "util/net.h"
+#include "util/thread.h"
+#include "util/tick.h"
+#include "util/vector.h"
+
+#define LOADGEN_DEFAULT_PORT 27183
+#define LOADGEN_DEFAULT_SESSIONS 8
+#define LOADGEN_MAX_SESSIONS 64
+
+// Same values as the client (see demuxer.c)
+#define LOADGEN_HEADER_SIZE 12
+#define LOADGEN_HEADER_EXT_SIZE (LOADGEN_HEADER_SIZE + 9)
+// With the capture exposure (ignored)
+#define LOADGEN_HEADER_EXPOSURE_SIZE (LOADGEN_HEADER_EXT_SIZE + 8)
+#define LOADGEN_FLAG_CONFIG (UINT64_C(1) << 63)
+#define LOADGEN_FLAG_KEY_FRAME (UINT64_C(1) << 62)
+#define LOADGEN_FLAG_REPEATED (UINT64_C(1) << 61)
+#define LOADGEN_PTS_MASK (LOADGEN_FLAG_REPEATED - 1)
+#define LOADGEN_CODEC_ID_H264 UINT32_C(0x68323634)
+#define LOADGEN_CODEC_ID_H265 UINT32_C(0x68323635)
+#define LOADGEN_DEVICE_NAME_LENGTH 64
+
+// Frame period if the clip has a single frame
+#define LOADGEN_DEFAULT_PERIOD_US (1000000 / 72)
+
+struct loadgen_packet {
+    uint64_t pts_flags;
+    uint8_t *data;
+    uint32_t size;
+};
+
+struct loadgen_packets SC_VECTOR(struct loadgen_packet);
+
+struct loadgen_clip {
+    uint32_t codec_id;
+    uint32_t width;
+    uint32_t height;
+    struct loadgen_packets packets;
+    unsigned frame_count; // media packets
+    int64_t first_pts;
+    int64_t duration_us; // of a loop
+    uint32_t max_size;
+};
+
+struct loadgen_session {
+    sc_socket socket;
+    unsigned number;
+    sc_thread thread;
+    bool running;
+    atomic_bool done;
+};
+
+static const struct loadgen_clip *clip;
+static unsigned fps;
+static uint32_t bit_rate;
+static unsigned duration_sec;
+static bool capture_timestamp;
+
+static bool
+read_all(FILE *file, void *buf, size_t len) {
+    return fread(buf, 1, len, file) == len;
+}
+
+static bool
+clip_load(struct loadgen_clip *c, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return false;
+    }
+
+    sc_vector_init(&c->packets);
+    c->frame_count = 0;
+    c->first_pts = -1;
+    c->max_size = 0;
+
+    uint8_t header[SC_STREAM_DUMP_HEADER_SIZE];
+    if (!read_all(file, header, sizeof(header))
+            || memcmp(header, SC_STREAM_DUMP_MAGIC, 4)
+            || header[4] != SC_STREAM_DUMP_VERSION) {
+        fprintf(stderr, "Not a stream dump (see --dump-stream): %s\n", path);
+        goto error;
+    }
+    size_t header_size = LOADGEN_HEADER_SIZE;
+    if (header[5] & SC_STREAM_DUMP_FLAG_CAPTURE_EXPOSURE) {
+        header_size = LOADGEN_HEADER_EXPOSURE_SIZE;
+    } else if (header[5] & SC_STREAM_DUMP_FLAG_CAPTURE_TIMESTAMP) {
+        header_size = LOADGEN_HEADER_EXT_SIZE;
+    }
+
+    uint8_t meta[12];
+    if (!read_all(file, meta, sizeof(meta))) {
+        fprintf(stderr, "Truncated stream dump: %s\n", path);
+        goto error;
+    }
+    c->codec_id = sc_read32be(meta);
+    c->width = sc_read32be(meta + 4);
+    c->height = sc_read32be(meta + 8);
+
+    int64_t last_pts = -1;
+    for (;;) {
+        uint8_t h[LOADGEN_HEADER_EXPOSURE_SIZE];
+        size_t r = fread(h, 1, header_size, file);
+        if (!r) {
+            break;
+        }
+        if (r != header_size) {
+            fprintf(stderr, "Truncated packet, ignored\n");
+            break;
+        }
+
+        struct loadgen_packet packet = {
+            .pts_flags = sc_read64be(h),
+            .size = sc_read32be(h + 8),
+        };
+        packet.data = malloc(packet.size);
+        if (!packet.data) {
+            fprintf(stderr, "Out of memory\n");
+            goto error;
+        }
+        if (!read_all(file, packet.data, packet.size)) {
+            fprintf(stderr, "Truncated packet, ignored\n");
+            free(packet.data);
+            break;
+        }
+        if (!sc_vector_push(&c->packets, packet)) {
+            fprintf(stderr, "Out of memory\n");
+            free(packet.data);
+            goto error;
+        }
+
+        if (!(packet.pts_flags & LOADGEN_FLAG_CONFIG)) {
+            int64_t pts = packet.pts_flags & LOADGEN_PTS_MASK;
+            if (c->first_pts < 0) {
+                c->first_pts = pts;
+            }
+            last_pts = pts;
+            ++c->frame_count;
+        }
+        c->max_size = MAX(c->max_size, packet.size);
+    }
+
+    fclose(file);
+
+    if (!c->frame_count) {
+        fprintf(stderr, "No video frame in %s\n", path);
+        sc_vector_destroy(&c->packets);
+        return false;
+    }
+
+    // The last frame lasts as long as the average frame
+    int64_t span = last_pts - c->first_pts;
+    c->duration_us = c->frame_count > 1
+                   ? span + span / (c->frame_count - 1)
+                   : LOADGEN_DEFAULT_PERIOD_US;
+    return true;
+
+error:
+    for (size_t i = 0; i < c->packets.size; ++i) {
+        free(c->packets.data[i].data);
+    }
+    sc_vector_destroy(&c->packets);
+    fclose(file);
+    return false;
+}
+
+static void
+clip_destroy(struct loadgen_clip *c) {
+    for (size_t i = 0; i < c->packets.size; ++i) {
+        free(c->packets.data[i].data);
+    }
+    sc_vector_destroy(&c->packets);
+}
+
+static void
+sleep_until(sc_tick deadline) {
+    sc_tick now = sc_tick_now();
+    if (deadline <= now) {
+        return;
+    }
+    sc_tick us = SC_TICK_TO_US(deadline - now);
+    struct timespec ts = {
+        .tv_sec = us / 1000000,
+        .tv_nsec = (us % 1000000) * 1000,
+    };
+    nanosleep(&ts, NULL);
+}
+
+// Size of the filler data NAL unit appended to reach `target` bytes, 0 if none
+static size_t
+get_filler_size(uint32_t size, uint32_t target) {
+    // Start code, NAL header (2 bytes for H.265), at least one 0xFF, and the
+    // trailing bits
+    size_t min = clip->codec_id == LOADGEN_CODEC_ID_H265 ? 8 : 7;
+    if (!bit_rate || size + min > target) {
+        return 0;
+    }
+    return target - size;
+}
+
+static void
+write_filler(uint8_t *dst, size_t len) {
+    static const uint8_t start_code[] = {0, 0, 0, 1};
+    memcpy(dst, start_code, sizeof(start_code));
+    size_t i = sizeof(start_code);
+    if (clip->codec_id == LOADGEN_CODEC_ID_H265) {
+        // FD_NUT (38)
+        dst[i++] = 38 << 1;
+        dst[i++] = 1;
+    } else {
+        // Filler data (12)
+        dst[i++] = 12;
+    }
+    memset(dst + i, 0xFF, len - i - 1);
+    // rbsp_trailing_bits
+    dst[len - 1] = 0x80;
+}
+
+static bool
+send_handshake(sc_socket socket, unsigned number) {
+    // The dummy byte read by the client to detect a working connection (as
+    // through an adb forward tunnel)
+    uint8_t dummy = 0;
+    if (net_send_all(socket, &dummy, 1) != 1) {
+        return false;
+    }
+
+    char name[LOADGEN_DEVICE_NAME_LENGTH] = {0};
+    snprintf(name, sizeof(name), "scrcpy-loadgen #%u", number);
+    if (net_send_all(socket, name, sizeof(name)) != sizeof(name)) {
+        return false;
+    }
+
+    uint8_t meta[12];
+    sc_write32be(meta, clip->codec_id);
+    sc_write32be(meta + 4, clip->width);
+    sc_write32be(meta + 8, clip->height);
+    return net_send_all(socket, meta, sizeof(meta)) == sizeof(meta);
+}
+
+static int
+run_session(void *data) {
+    struct loadgen_session *session = data;
+    sc_socket socket = session->socket;
+
+    int64_t period_us = fps ? 1000000 / fps
+                            : clip->duration_us / clip->frame_count;
+    uint32_t budget = bit_rate ? (uint64_t) bit_rate * period_us / 8000000
+                               : 0;
+    uint8_t *filler = NULL;
+    if (budget) {
+        filler = malloc(budget);
+        if (!filler) {
+            fprintf(stderr, "Out of memory\n");
+            goto end;
+        }
+    }
+
+    if (!send_handshake(socket, session->number)) {
+        goto end;
+    }
+
+    sc_tick start = sc_tick_now();
+    sc_tick end_time = duration_sec ? start + SC_TICK_FROM_SEC(duration_sec)
+                                    : 0;
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    bool stopped = false;
+    for (unsigned loop = 0; !stopped; ++loop) {
+        for (size_t i = 0; i < clip->packets.size; ++i) {
+            const struct loadgen_packet *packet = &clip->packets.data[i];
+            bool config = packet->pts_flags & LOADGEN_FLAG_CONFIG;
+            if (config && loop) {
+                // The decoder is already configured
+                continue;
+            }
+
+            int64_t pts = 0;
+            uint64_t flags = packet->pts_flags & ~LOADGEN_PTS_MASK;
+            if (!config) {
+                if (fps) {
+                    pts = frames * period_us;
+                } else {
+                    int64_t clip_pts = packet->pts_flags & LOADGEN_PTS_MASK;
+                    pts = loop * clip->duration_us
+                        + (clip_pts - clip->first_pts);
+                }
+                sc_tick deadline = start + SC_TICK_FROM_US(pts);
+                if (end_time && deadline >= end_time) {
+                    stopped = true;
+                    break;
+                }
+                sleep_until(deadline);
+            }
+
+            size_t filler_size = config ? 0
+                               : get_filler_size(packet->size, budget);
+            uint32_t size = packet->size + filler_size;
+
+            uint8_t header[LOADGEN_HEADER_EXT_SIZE];
+            size_t header_size = LOADGEN_HEADER_SIZE;
+            sc_write64be(header, flags | (config ? 0 : (uint64_t) pts));
+            sc_write32be(header + 8, size);
+            if (capture_timestamp) {
+                // SC_CLOCK_DOMAIN_MONOTONIC, on the clock of this computer
+                header[LOADGEN_HEADER_SIZE] = 0;
+                sc_write64be(header + LOADGEN_HEADER_SIZE + 1,
+                             SC_TICK_TO_NS(sc_tick_now()));
+                header_size = LOADGEN_HEADER_EXT_SIZE;
+            }
+
+            if (net_send_all(socket, header, header_size)
+                        != (ssize_t) header_size
+                    || net_send_all(socket, packet->data, packet->size)
+                        != (ssize_t) packet->size) {
+                stopped = true;
+                break;
+            }
+            if (filler_size) {
+                write_filler(filler, filler_size);
+                if (net_send_all(socket, filler, filler_size)
+                        != (ssize_t) filler_size) {
+                    stopped = true;
+                    break;
+                }
+            }
+
+            if (!config) {
+                ++frames;
+            }
+            bytes += header_size + size;
+        }
+    }
+
+    double elapsed = SC_TICK_TO_US(sc_tick_now() - start) / 1e6;
+    if (elapsed > 0) {
+        printf("Session #%u ended: %" PRIu64 " frames in %.1f s (%.1f fps, "
+               "%.2f Mbps)\n", session->number, frames, elapsed,
+               frames / elapsed, bytes * 8 / elapsed / 1e6);
+    }
+
+end:
+    free(filler);
+    net_close(socket);
+    atomic_store(&session->done, true);
+    return 0;
+}
+
+// Join the sessions which have ended, and return a free slot (or NULL)
+static struct loadgen_session *
+reap_sessions(struct loadgen_session sessions[], unsigned count) {
+    struct loadgen_session *free_slot = NULL;
+    for (unsigned i = 0; i < count; ++i) {
+        struct loadgen_session *s = &sessions[i];
+        if (s->running && atomic_load(&s->done)) {
+            sc_thread_join(&s->thread, NULL);
+            s->running = false;
+        }
+        if (!s->running && !free_slot) {
+            free_slot = s;
+        }
+    }
+    return free_slot;
+}
+
+static bool
+parse_unsigned(const char *s, unsigned long max, unsigned long *value) {
+    char *end;
+    errno = 0;
+    unsigned long v = strtoul(s, &end, 10);
+    if (errno || !*s || *end || v > max) {
+        return false;
+    }
+    *value = v;
+    return true;
+}
+
+int
+main(int argc, char *argv[]) {
+    unsigned long port = LOADGEN_DEFAULT_PORT;
+    unsigned long max_sessions = LOADGEN_DEFAULT_SESSIONS;
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        unsigned long v;
+        if (!strncmp(arg, "--port=", 7)) {
+            if (!parse_unsigned(arg + 7, 0xFFFF, &port) || !port) {
+                fprintf(stderr, "Invalid port: %s\n", arg + 7);
+                return 1;
+            }
+        } else if (!strncmp(arg, "--fps=", 6)) {
+            if (!parse_unsigned(arg + 6, 1000, &v) || !v) {
+                fprintf(stderr, "Invalid fps (1 to 1000): %s\n", arg + 6);
+                return 1;
+            }
+            fps = v;
+        } else if (!strncmp(arg, "--bit-rate=", 11)) {
+            if (!parse_unsigned(arg + 11, UINT32_MAX, &v)) {
+                fprintf(stderr, "Invalid bit rate: %s\n", arg + 11);
+                return 1;
+            }
+            bit_rate = v;
+        } else if (!strncmp(arg, "--sessions=", 11)) {
+            if (!parse_unsigned(arg + 11, LOADGEN_MAX_SESSIONS, &max_sessions)
+                    || !max_sessions) {
+                fprintf(stderr, "Invalid session count (1 to %d): %s\n",
+                        LOADGEN_MAX_SESSIONS, arg + 11);
+                return 1;
+            }
+        } else if (!strncmp(arg, "--duration=", 11)) {
+            if (!parse_unsigned(arg + 11, 86400, &v)) {
+                fprintf(stderr, "Invalid duration: %s\n", arg + 11);
+                return 1;
+            }
+            duration_sec = v;
+        } else if (!strcmp(arg, "--capture-timestamp")) {
+            capture_timestamp = true;
+        } else if (arg[0] == '-' || path) {
+            fprintf(stderr, "Unknown argument: %s\n", arg);
+            return 1;
+        } else {
+            path = arg;
+        }
+    }
+
+    if (!path) {
+        fprintf(stderr, "Usage: %s [--port=N] [--fps=N] [--bit-rate=N] "
+                "[--sessions=N] [--duration=SEC] [--capture-timestamp] "
+                "clip.dump\n", argv[0]);
+        return 1;
+    }
+
+    struct loadgen_clip c;
+    if (!clip_load(&c, path)) {
+        return 1;
+    }
+    clip = &c;
+
+    if (bit_rate && c.codec_id != LOADGEN_CODEC_ID_H264
+            && c.codec_id != LOADGEN_CODEC_ID_H265) {
+        fprintf(stderr, "--bit-rate is only supported for H.264 and H.265, "
+                "ignored\n");
+        bit_rate = 0;
+    }
+
+    int ret = 1;
+    if (!net_init()) {
+        goto end_clip;
+    }
+
+    sc_socket server_socket = net_socket();
+    if (server_socket == SC_SOCKET_NONE) {
+        goto end_net;
+    }
+    if (!net_listen(server_socket, IPV4_LOCALHOST, port, max_sessions)) {
+        fprintf(stderr, "Could not listen on port %lu\n", port);
+        net_close(server_socket);
+        goto end_net;
+    }
+
+    printf("Serving %s (%" PRIu32 "x%" PRIu32 ", %u frames, %.1f s) on port "
+           "%lu, up to %lu sessions\n", path, c.width, c.height,
+           c.frame_count, c.duration_us / 1e6, port, max_sessions);
+
+    struct loadgen_session sessions[LOADGEN_MAX_SESSIONS] = {0};
+    for (unsigned number = 1;; ++number) {
+        sc_socket socket = net_accept(server_socket);
+        if (socket == SC_SOCKET_NONE) {
+            break;
+        }
+
+        struct loadgen_session *s = reap_sessions(sessions, max_sessions);
+        if (!s) {
+            fprintf(stderr, "Too many sessions, connection closed\n");
+            net_close(socket);
+            continue;
+        }
+
+        s->socket = socket;
+        s->number = number;
+        atomic_init(&s->done, false);
+        if (!sc_thread_create(&s->thread, run_session, "loadgen-session",
+                              s)) {
+            net_close(socket);
+            continue;
+        }
+        s->running = true;
+        printf("Session #%u started\n", number);
+    }
+
+    for (unsigned i = 0; i < max_sessions; ++i) {
+        if (sessions[i].running) {
+            sc_thread_join(&sessions[i].thread, NULL);
+        }
+    }
+    net_close(server_socket);
+    ret = 0;
+
+end_net:
+    net_cleanup();
+end_clip:
+    clip_destroy(&c);
+    return ret;
+}
@@ -6,6 +6,7 @@
 #include <string.h>
 
 #include "adb_device.h"
+#include "adb_host.h"
 #include "adb_parser.h"
 #include "util/file.h"
 #include "util/log.h"
@@ -36,6 +37,12 @@ sc_adb_get_executable(void) {
     return adb_executable;
 }
 
+void
+sc_adb_set_executable(const char *executable) {
+    assert(executable);
+    adb_executable = executable;
+}
+
 // serialize argv to string "[arg1], [arg2], [arg3]"
 static size_t
 argv_to_string(const char *const *argv, char *buf, size_t bufsize) {
@@ -230,6 +237,10 @@ sc_adb_forward(struct sc_intr *intr, const char *serial, uint16_t local_port,
     }
 
     assert(serial);
+    if (sc_adb_host_forward(intr, serial, local, remote)) {
+        return true;
+    }
+
     const char *const argv[] =
         SC_ADB_COMMAND("-s", serial, "forward", local, remote);
 
@@ -246,6 +257,10 @@ sc_adb_forward_remove(struct sc_intr *intr, const char *serial,
     (void) r;
 
     assert(serial);
+    if (sc_adb_host_forward_remove(intr, serial, local)) {
+        return true;
+    }
+
     const char *const argv[] =
         SC_ADB_COMMAND("-s", serial, "forward", "--remove", local);
 
@@ -270,6 +285,10 @@ sc_adb_reverse(struct sc_intr *intr, const char *serial,
     }
 
     assert(serial);
+    if (sc_adb_host_reverse(intr, serial, remote, local)) {
+        return true;
+    }
+
     const char *const argv[] =
         SC_ADB_COMMAND("-s", serial, "reverse", remote, local);
 
@@ -289,6 +308,10 @@ sc_adb_reverse_remove(struct sc_intr *intr, const char *serial,
     }
 
     assert(serial);
+    if (sc_adb_host_reverse_remove(intr, serial, remote)) {
+        return true;
+    }
+
     const char *const argv[] =
         SC_ADB_COMMAND("-s", serial, "reverse", "--remove", remote);
 
@@ -298,7 +321,13 @@ sc_adb_reverse_remove(struct sc_intr *intr, const char *serial,
 
 bool
 sc_adb_push(struct sc_intr *intr, const char *serial, const char *local,
-            const char *remote, unsigned flags) {
+            const char *remote, const struct sc_adb_push_progress *progress,
+            unsigned flags) {
+    assert(serial);
+    if (sc_adb_host_push(intr, serial, local, remote, progress)) {
+        return true;
+    }
+
 #ifdef __WINDOWS__
     // Windows will parse the string, so the paths must be quoted
     // (see sys/win/command.c)
@@ -313,7 +342,6 @@ sc_adb_push(struct sc_intr *intr, const char *serial, const char *local,
     }
 #endif
 
-    assert(serial);
     const char *const argv[] =
         SC_ADB_COMMAND("-s", serial, "push", local, remote);
 
@@ -418,6 +446,8 @@ sc_adb_disconnect(struct sc_intr *intr, const char *ip_port, unsigned flags) {
     return process_check_success_intr(intr, pid, "adb disconnect", flags);
 }
 
+#define SC_ADB_DEVICES_HEADER "List of devices attached\n"
+
 static bool
 sc_adb_list_devices(struct sc_intr *intr, unsigned flags,
                     struct sc_vec_adb_devices *out_vec) {
@@ -430,6 +460,21 @@ sc_adb_list_devices(struct sc_intr *intr, unsigned flags,
         return false;
     }
 
+    // Query the adb server directly, which is far cheaper than executing
+    // "adb devices -l" (the reply has the same format, without the header)
+#define HEADER_LEN (sizeof(SC_ADB_DEVICES_HEADER) - 1)
+    memcpy(buf, SC_ADB_DEVICES_HEADER, HEADER_LEN);
+    ssize_t r = sc_adb_host_query(intr, "host:devices-l", buf + HEADER_LEN,
+                                  BUFSIZE - HEADER_LEN);
+#undef HEADER_LEN
+    if (r != -1) {
+        bool ok = sc_adb_parse_devices(buf, out_vec);
+        free(buf);
+        return ok;
+    }
+
+    LOGD("Could not query the adb server, executing \"adb devices -l\"");
+
     sc_pipe pout;
     sc_pid pid = sc_adb_execute_p(argv, flags, &pout);
     if (pid == SC_PROCESS_NONE) {
@@ -438,7 +483,7 @@ sc_adb_list_devices(struct sc_intr *intr, unsigned flags,
         return false;
     }
 
-    ssize_t r = sc_pipe_read_all_intr(intr, pid, pout, buf, BUFSIZE - 1);
+    r = sc_pipe_read_all_intr(intr, pid, pout, buf, BUFSIZE - 1);
     sc_pipe_close(pout);
 
     bool ok = process_check_success_intr(intr, pid, "adb devices -l", flags);
@@ -670,24 +715,35 @@ sc_adb_getprop(struct sc_intr *intr, const char *serial, const char *prop,
     const char *const argv[] =
         SC_ADB_COMMAND("-s", serial, "shell", "getprop", prop);
 
-    sc_pipe pout;
-    sc_pid pid = sc_adb_execute_p(argv, flags, &pout);
-    if (pid == SC_PROCESS_NONE) {
-        LOGE("Could not execute \"adb getprop\"");
-        return NULL;
-    }
-
     char buf[128];
-    ssize_t r = sc_pipe_read_all_intr(intr, pid, pout, buf, sizeof(buf) - 1);
-    sc_pipe_close(pout);
 
-    bool ok = process_check_success_intr(intr, pid, "adb getprop", flags);
-    if (!ok) {
+    char *command;
+    if (asprintf(&command, "getprop %s", prop) == -1) {
+        LOG_OOM();
         return NULL;
     }
+    ssize_t r = sc_adb_host_shell(intr, serial, command, buf, sizeof(buf));
+    free(command);
 
     if (r == -1) {
-        return NULL;
+        sc_pipe pout;
+        sc_pid pid = sc_adb_execute_p(argv, flags, &pout);
+        if (pid == SC_PROCESS_NONE) {
+            LOGE("Could not execute \"adb getprop\"");
+            return NULL;
+        }
+
+        r = sc_pipe_read_all_intr(intr, pid, pout, buf, sizeof(buf) - 1);
+        sc_pipe_close(pout);
+
+        bool ok = process_check_success_intr(intr, pid, "adb getprop", flags);
+        if (!ok) {
+            return NULL;
+        }
+
+        if (r == -1) {
+            return NULL;
+        }
     }
 
     assert((size_t) r < sizeof(buf));
@@ -704,25 +760,29 @@ sc_adb_get_device_ip(struct sc_intr *intr, const char *serial, unsigned flags) {
     const char *const argv[] =
         SC_ADB_COMMAND("-s", serial, "shell", "ip", "route");
 
-    sc_pipe pout;
-    sc_pid pid = sc_adb_execute_p(argv, flags, &pout);
-    if (pid == SC_PROCESS_NONE) {
-        LOGD("Could not execute \"ip route\"");
-        return NULL;
-    }
-
     // "adb shell ip route" output should contain only a few lines
     char buf[1024];
-    ssize_t r = sc_pipe_read_all_intr(intr, pid, pout, buf, sizeof(buf) - 1);
-    sc_pipe_close(pout);
-
-    bool ok = process_check_success_intr(intr, pid, "ip route", flags);
-    if (!ok) {
-        return NULL;
-    }
 
+    ssize_t r = sc_adb_host_shell(intr, serial, "ip route", buf, sizeof(buf));
     if (r == -1) {
-        return NULL;
+        sc_pipe pout;
+        sc_pid pid = sc_adb_execute_p(argv, flags, &pout);
+        if (pid == SC_PROCESS_NONE) {
+            LOGD("Could not execute \"ip route\"");
+            return NULL;
+        }
+
+        r = sc_pipe_read_all_intr(intr, pid, pout, buf, sizeof(buf) - 1);
+        sc_pipe_close(pout);
+
+        bool ok = process_check_success_intr(intr, pid, "ip route", flags);
+        if (!ok) {
+            return NULL;
+        }
+
+        if (r == -1) {
+            return NULL;
+        }
     }
 
     assert((size_t) r < sizeof(buf));
@@ -739,3 +799,45 @@ sc_adb_get_device_ip(struct sc_intr *intr, const char *serial, unsigned flags) {
 
     return sc_adb_parse_device_ip(buf);
 }
+
+bool
+sc_adb_get_boot_time(struct sc_intr *intr, const char *serial, unsigned flags,
+                     int64_t *boot_time_ms) {
+    assert(serial);
+    // Both values are read by the same shell on the device, so that the
+    // difference does not depend on the adb round-trip time
+    const char *const argv[] =
+        SC_ADB_COMMAND("-s", serial, "shell", "date", "+%s%3N;", "cat",
+                       "/proc/uptime");
+
+    char buf[128];
+
+    ssize_t r = sc_adb_host_shell(intr, serial, "date +%s%3N; cat /proc/uptime",
+                                  buf, sizeof(buf));
+    if (r == -1) {
+        sc_pipe pout;
+        sc_pid pid = sc_adb_execute_p(argv, flags, &pout);
+        if (pid == SC_PROCESS_NONE) {
+            LOGE("Could not execute \"adb shell date\"");
+            return false;
+        }
+
+        r = sc_pipe_read_all_intr(intr, pid, pout, buf, sizeof(buf) - 1);
+        sc_pipe_close(pout);
+
+        bool ok = process_check_success_intr(intr, pid, "adb shell date",
+                                             flags);
+        if (!ok) {
+            return false;
+        }
+
+        if (r == -1) {
+            return false;
+        }
+    }
+
+    assert((size_t) r < sizeof(buf));
+    buf[r] = '\0';
+
+    return sc_adb_parse_boot_time(buf, boot_time_ms);
+}
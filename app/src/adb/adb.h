@@ -9,6 +9,9 @@
 #include "adb_device.h"
 #include "util/intr.h"
 
+// forward declarations
+struct sc_adb_push_progress;
+
 #define SC_ADB_NO_STDOUT (1 << 0)
 #define SC_ADB_NO_STDERR (1 << 1)
 #define SC_ADB_NO_LOGERR (1 << 2)
@@ -18,6 +21,14 @@
 const char *
 sc_adb_get_executable(void);
 
+/**
+ * Override the adb executable (by default, $ADB or "adb")
+ *
+ * This must be called before any adb command is executed.
+ */
+void
+sc_adb_set_executable(const char *executable);
+
 enum sc_adb_device_selector_type {
     SC_ADB_DEVICE_SELECT_ALL,
     SC_ADB_DEVICE_SELECT_SERIAL,
@@ -56,9 +67,12 @@ bool
 sc_adb_reverse_remove(struct sc_intr *intr, const char *serial,
                       const char *device_socket_name, unsigned flags);
 
+// The progress (which may be NULL) is only notified if the file is pushed via
+// the adb server sync service, not via the adb executable (the fallback)
 bool
 sc_adb_push(struct sc_intr *intr, const char *serial, const char *local,
-            const char *remote, unsigned flags);
+            const char *remote, const struct sc_adb_push_progress *progress,
+            unsigned flags);
 
 bool
 sc_adb_install(struct sc_intr *intr, const char *serial, const char *local,
@@ -114,4 +128,14 @@ sc_adb_getprop(struct sc_intr *intr, const char *serial, const char *prop,
 char *
 sc_adb_get_device_ip(struct sc_intr *intr, const char *serial, unsigned flags);
 
+/**
+ * Retrieve the device boot time, in milliseconds since the Unix epoch (in the
+ * device wall clock)
+ *
+ * The device time and uptime are read by a single adb command.
+ */
+bool
+sc_adb_get_boot_time(struct sc_intr *intr, const char *serial, unsigned flags,
+                     int64_t *boot_time_ms);
+
 #endif
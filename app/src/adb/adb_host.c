@@ -0,0 +1,484 @@
+#include "adb_host.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "util/binary.h"
+#include "util/file.h"
+#include "util/log.h"
+#include "util/net_intr.h"
+#include "util/str.h"
+
+#define SC_ADB_HOST_DEFAULT_PORT 5037
+
+static bool
+sc_adb_host_get_port(uint16_t *port) {
+    if (getenv("ADB_SERVER_SOCKET")) {
+        // A custom server socket (e.g. on another host) is not supported, let
+        // the adb executable handle it
+        return false;
+    }
+
+    const char *env_port = getenv("ANDROID_ADB_SERVER_PORT");
+    if (!env_port) {
+        *port = SC_ADB_HOST_DEFAULT_PORT;
+        return true;
+    }
+
+    long value;
+    if (!sc_str_parse_integer(env_port, &value) || value <= 0
+            || value > 0xFFFF) {
+        return false;
+    }
+
+    *port = value;
+    return true;
+}
+
+static bool
+sc_adb_host_read_length(struct sc_intr *intr, sc_socket socket,
+                        size_t *length) {
+    char hex[5];
+    ssize_t r = net_recv_all_intr(intr, socket, hex, 4);
+    if (r != 4) {
+        return false;
+    }
+    hex[4] = '\0';
+
+    char *end;
+    unsigned long value = strtoul(hex, &end, 16);
+    if (end != &hex[4]) {
+        return false;
+    }
+
+    *length = value;
+    return true;
+}
+
+static bool
+sc_adb_host_read_status(struct sc_intr *intr, sc_socket socket,
+                        const char *request) {
+    char status[4];
+    ssize_t r = net_recv_all_intr(intr, socket, status, sizeof(status));
+    if (r != sizeof(status)) {
+        return false;
+    }
+
+    if (!memcmp(status, "OKAY", 4)) {
+        return true;
+    }
+
+    if (!memcmp(status, "FAIL", 4)) {
+        char msg[256];
+        size_t len;
+        if (sc_adb_host_read_length(intr, socket, &len)) {
+            len = MIN(len, sizeof(msg) - 1);
+            r = net_recv_all_intr(intr, socket, msg, len);
+            msg[r > 0 ? (size_t) r : 0] = '\0';
+            LOGD("adb server: \"%s\" failed: %s", request, msg);
+        }
+    }
+
+    return false;
+}
+
+static bool
+sc_adb_host_request(struct sc_intr *intr, sc_socket socket,
+                    const char *request) {
+    size_t len = strlen(request);
+    if (len > 0xFFFF) {
+        return false;
+    }
+
+    char header[5];
+    snprintf(header, sizeof(header), "%04x", (unsigned) len);
+    ssize_t w = net_send_all_intr(intr, socket, header, 4);
+    if (w != 4) {
+        return false;
+    }
+
+    w = net_send_all_intr(intr, socket, request, len);
+    if (w != (ssize_t) len) {
+        return false;
+    }
+
+    return sc_adb_host_read_status(intr, socket, request);
+}
+
+static sc_socket
+sc_adb_host_connect(struct sc_intr *intr) {
+    uint16_t port;
+    if (!sc_adb_host_get_port(&port)) {
+        return SC_SOCKET_NONE;
+    }
+
+    sc_socket socket = net_socket();
+    if (socket == SC_SOCKET_NONE) {
+        return SC_SOCKET_NONE;
+    }
+
+    if (!net_connect_intr(intr, socket, IPV4_LOCALHOST, port)) {
+        LOGD("Could not connect to the adb server on port %" PRIu16, port);
+        net_close(socket);
+        return SC_SOCKET_NONE;
+    }
+
+    return socket;
+}
+
+static bool
+sc_adb_host_request_fmt(struct sc_intr *intr, sc_socket socket,
+                        const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    char *request;
+    int r = vasprintf(&request, fmt, ap);
+    va_end(ap);
+    if (r == -1) {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = sc_adb_host_request(intr, socket, request);
+    free(request);
+    return ok;
+}
+
+// Connect to the adb server, and switch the connection to the device
+// transport (the next requests are handled by the device)
+static sc_socket
+sc_adb_host_connect_transport(struct sc_intr *intr, const char *serial) {
+    assert(serial);
+
+    sc_socket socket = sc_adb_host_connect(intr);
+    if (socket == SC_SOCKET_NONE) {
+        return SC_SOCKET_NONE;
+    }
+
+    if (!sc_adb_host_request_fmt(intr, socket, "host:transport:%s", serial)) {
+        net_close(socket);
+        return SC_SOCKET_NONE;
+    }
+
+    return socket;
+}
+
+ssize_t
+sc_adb_host_query(struct sc_intr *intr, const char *service, char *buf,
+                  size_t len) {
+    assert(len);
+
+    sc_socket socket = sc_adb_host_connect(intr);
+    if (socket == SC_SOCKET_NONE) {
+        return -1;
+    }
+
+    ssize_t ret = -1;
+
+    if (!sc_adb_host_request(intr, socket, service)) {
+        goto end;
+    }
+
+    size_t reply_len;
+    if (!sc_adb_host_read_length(intr, socket, &reply_len)) {
+        goto end;
+    }
+
+    if (reply_len >= len) {
+        LOGW("Reply of \"%s\" does not fit in %" SC_PRIsizet " bytes",
+             service, len);
+        goto end;
+    }
+
+    ssize_t r = net_recv_all_intr(intr, socket, buf, reply_len);
+    if (r != (ssize_t) reply_len) {
+        goto end;
+    }
+
+    buf[reply_len] = '\0';
+    ret = reply_len;
+
+end:
+    net_close(socket);
+    return ret;
+}
+
+ssize_t
+sc_adb_host_shell(struct sc_intr *intr, const char *serial,
+                  const char *command, char *buf, size_t len) {
+    assert(len);
+
+    sc_socket socket = sc_adb_host_connect_transport(intr, serial);
+    if (socket == SC_SOCKET_NONE) {
+        return -1;
+    }
+
+    ssize_t ret = -1;
+
+    if (!sc_adb_host_request_fmt(intr, socket, "shell:%s", command)) {
+        goto end;
+    }
+
+    // The output is streamed until the command exits
+    size_t total = 0;
+    for (;;) {
+        char *p = &buf[total];
+        size_t remaining = len - 1 - total;
+        if (!remaining) {
+            // Truncated, discard the remaining output
+            break;
+        }
+        ssize_t r = net_recv_intr(intr, socket, p, remaining);
+        if (r < 0) {
+            goto end;
+        }
+        if (!r) {
+            break;
+        }
+        total += r;
+    }
+
+    buf[total] = '\0';
+    ret = total;
+
+end:
+    net_close(socket);
+    return ret;
+}
+
+bool
+sc_adb_host_forward(struct sc_intr *intr, const char *serial,
+                    const char *local, const char *remote) {
+    assert(serial);
+
+    sc_socket socket = sc_adb_host_connect(intr);
+    if (socket == SC_SOCKET_NONE) {
+        return false;
+    }
+
+    // For forward requests, the server replies a first OKAY once connected to
+    // the transport, then a second one for the result
+    bool ok = sc_adb_host_request_fmt(intr, socket,
+                                      "host-serial:%s:forward:%s;%s", serial,
+                                      local, remote)
+           && sc_adb_host_read_status(intr, socket, "forward");
+
+    net_close(socket);
+    return ok;
+}
+
+bool
+sc_adb_host_forward_remove(struct sc_intr *intr, const char *serial,
+                           const char *local) {
+    assert(serial);
+
+    sc_socket socket = sc_adb_host_connect(intr);
+    if (socket == SC_SOCKET_NONE) {
+        return false;
+    }
+
+    bool ok = sc_adb_host_request_fmt(intr, socket,
+                                      "host-serial:%s:killforward:%s", serial,
+                                      local)
+           && sc_adb_host_read_status(intr, socket, "killforward");
+
+    net_close(socket);
+    return ok;
+}
+
+bool
+sc_adb_host_reverse(struct sc_intr *intr, const char *serial,
+                    const char *remote, const char *local) {
+    sc_socket socket = sc_adb_host_connect_transport(intr, serial);
+    if (socket == SC_SOCKET_NONE) {
+        return false;
+    }
+
+    // The reverse service (on the device) replies the result once opened
+    bool ok = sc_adb_host_request_fmt(intr, socket, "reverse:forward:%s;%s",
+                                      remote, local)
+           && sc_adb_host_read_status(intr, socket, "reverse");
+
+    net_close(socket);
+    return ok;
+}
+
+bool
+sc_adb_host_reverse_remove(struct sc_intr *intr, const char *serial,
+                           const char *remote) {
+    sc_socket socket = sc_adb_host_connect_transport(intr, serial);
+    if (socket == SC_SOCKET_NONE) {
+        return false;
+    }
+
+    bool ok = sc_adb_host_request_fmt(intr, socket, "reverse:killforward:%s",
+                                      remote)
+           && sc_adb_host_read_status(intr, socket, "reverse --remove");
+
+    net_close(socket);
+    return ok;
+}
+
+// Maximum size of a sync DATA chunk
+#define SC_ADB_SYNC_DATA_MAX (64 * 1024)
+
+static bool
+sc_adb_host_sync_send(struct sc_intr *intr, sc_socket socket, const char *id,
+                      const void *data, uint32_t len) {
+    uint8_t header[8];
+    memcpy(header, id, 4);
+    sc_write32le(&header[4], len);
+
+    ssize_t w = net_send_all_intr(intr, socket, header, sizeof(header));
+    if (w != sizeof(header)) {
+        return false;
+    }
+
+    if (len) {
+        w = net_send_all_intr(intr, socket, data, len);
+        if (w != (ssize_t) len) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+sc_adb_host_sync_read_status(struct sc_intr *intr, sc_socket socket,
+                             const char *remote) {
+    uint8_t status[8];
+    ssize_t r = net_recv_all_intr(intr, socket, status, sizeof(status));
+    if (r != sizeof(status)) {
+        return false;
+    }
+
+    if (!memcmp(status, "OKAY", 4)) {
+        return true;
+    }
+
+    if (!memcmp(status, "FAIL", 4)) {
+        char msg[256];
+        // The length is little-endian
+        uint32_t len = status[4] | status[5] << 8 | status[6] << 16
+                     | (uint32_t) status[7] << 24;
+        len = MIN(len, sizeof(msg) - 1);
+        r = net_recv_all_intr(intr, socket, msg, len);
+        msg[r > 0 ? (size_t) r : 0] = '\0';
+        LOGD("adb server: push to %s failed: %s", remote, msg);
+    }
+
+    return false;
+}
+
+static char *
+sc_adb_host_push_target(const char *local, const char *remote) {
+    size_t len = strlen(remote);
+    if (!len || remote[len - 1] != '/') {
+        return strdup(remote);
+    }
+
+    // Push into the directory, with the local file name
+    const char *name = local;
+    for (const char *c = local; *c; ++c) {
+#ifdef _WIN32
+        if (*c == '/' || *c == '\\') {
+#else
+        if (*c == '/') {
+#endif
+            name = c + 1;
+        }
+    }
+
+    char *target;
+    if (asprintf(&target, "%s%s", remote, name) == -1) {
+        return NULL;
+    }
+    return target;
+}
+
+bool
+sc_adb_host_push(struct sc_intr *intr, const char *serial, const char *local,
+                 const char *remote,
+                 const struct sc_adb_push_progress *progress) {
+    struct sc_file_mapping file;
+    if (!sc_file_map(local, &file)) {
+        return false;
+    }
+
+    char *target = sc_adb_host_push_target(local, remote);
+    if (!target) {
+        LOG_OOM();
+        sc_file_unmap(&file);
+        return false;
+    }
+
+    bool ok = false;
+    char *send = NULL;
+
+    sc_socket socket = sc_adb_host_connect_transport(intr, serial);
+    if (socket == SC_SOCKET_NONE) {
+        goto end;
+    }
+
+    if (!sc_adb_host_request(intr, socket, "sync:")) {
+        goto end;
+    }
+
+    // "<remote path>,<mode>"
+    int len = asprintf(&send, "%s,%d", target, 0100644);
+    if (len == -1) {
+        LOG_OOM();
+        send = NULL;
+        goto end;
+    }
+
+    if (!sc_adb_host_sync_send(intr, socket, "SEND", send, len)) {
+        goto end;
+    }
+
+    const uint8_t *data = file.data;
+    size_t remaining = file.size;
+    while (remaining) {
+        uint32_t chunk = MIN(remaining, SC_ADB_SYNC_DATA_MAX);
+        if (!sc_adb_host_sync_send(intr, socket, "DATA", data, chunk)) {
+            goto end;
+        }
+        data += chunk;
+        remaining -= chunk;
+
+        if (progress) {
+            progress->on_progress(file.size - remaining, file.size,
+                                  progress->userdata);
+        }
+    }
+
+    // The DONE length field is the modification time
+    uint8_t done[8];
+    memcpy(done, "DONE", 4);
+    sc_write32le(&done[4], (uint32_t) time(NULL));
+    ssize_t w = net_send_all_intr(intr, socket, done, sizeof(done));
+    if (w != sizeof(done)) {
+        goto end;
+    }
+
+    ok = sc_adb_host_sync_read_status(intr, socket, target);
+    if (ok) {
+        // Best effort
+        sc_adb_host_sync_send(intr, socket, "QUIT", NULL, 0);
+    }
+
+end:
+    if (socket != SC_SOCKET_NONE) {
+        net_close(socket);
+    }
+    free(send);
+    free(target);
+    sc_file_unmap(&file);
+    return ok;
+}
@@ -0,0 +1,99 @@
+#ifndef SC_ADB_HOST_H
+#define SC_ADB_HOST_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "util/intr.h"
+
+/**
+ * Client of the adb server socket protocol (the protocol used by the adb
+ * executable to talk to the adb server), to run queries without spawning an
+ * adb process:
+ * <https://android.googlesource.com/platform/packages/modules/adb/+/refs/heads/main/SERVICES.TXT>
+ *
+ * The adb server is expected to be already started (by "adb start-server").
+ *
+ * All these functions fail without logging an error (except in debug), so that
+ * the caller may fall back to executing adb (which reports the error).
+ */
+
+/**
+ * Execute a host service (e.g. "host:devices-l") and read its reply (without
+ * its length prefix) into `buf`
+ *
+ * The reply is NUL-terminated, so it may contain at most `len - 1` bytes.
+ *
+ * Return the length of the reply, or -1 on error.
+ */
+ssize_t
+sc_adb_host_query(struct sc_intr *intr, const char *service, char *buf,
+                  size_t len);
+
+/**
+ * Execute a shell command on the device `serial` and read its whole output
+ * into `buf`
+ *
+ * The output is NUL-terminated, so it may contain at most `len - 1` bytes (it
+ * is truncated beyond).
+ *
+ * Return the length of the output, or -1 on error.
+ */
+ssize_t
+sc_adb_host_shell(struct sc_intr *intr, const char *serial,
+                  const char *command, char *buf, size_t len);
+
+/**
+ * Equivalent to `adb -s SERIAL forward LOCAL REMOTE`
+ *
+ * Return false on error (including if the adb server could not be queried).
+ */
+bool
+sc_adb_host_forward(struct sc_intr *intr, const char *serial,
+                    const char *local, const char *remote);
+
+/**
+ * Equivalent to `adb -s SERIAL forward --remove LOCAL`
+ */
+bool
+sc_adb_host_forward_remove(struct sc_intr *intr, const char *serial,
+                           const char *local);
+
+/**
+ * Equivalent to `adb -s SERIAL reverse REMOTE LOCAL`
+ */
+bool
+sc_adb_host_reverse(struct sc_intr *intr, const char *serial,
+                    const char *remote, const char *local);
+
+/**
+ * Equivalent to `adb -s SERIAL reverse --remove REMOTE`
+ */
+bool
+sc_adb_host_reverse_remove(struct sc_intr *intr, const char *serial,
+                           const char *remote);
+
+// Progress of a push, notified after each chunk sent (in bytes)
+struct sc_adb_push_progress {
+    void (*on_progress)(uint64_t sent, uint64_t total, void *userdata);
+    void *userdata;
+};
+
+/**
+ * Equivalent to `adb -s SERIAL push LOCAL REMOTE`, via the sync service
+ *
+ * If `remote` ends with a '/', the file is pushed into this directory (with
+ * the same name as the local file).
+ *
+ * The progress may be NULL.
+ */
+bool
+sc_adb_host_push(struct sc_intr *intr, const char *serial, const char *local,
+                 const char *remote,
+                 const struct sc_adb_push_progress *progress);
+
+#endif
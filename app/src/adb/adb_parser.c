@@ -226,3 +226,37 @@ sc_adb_parse_device_ip(char *str) {
 
     return NULL;
 }
+
+bool
+sc_adb_parse_boot_time(const char *str, int64_t *boot_time_ms) {
+    // The wall clock time in milliseconds, e.g. "1700000000123"
+    char *end;
+    long long now_ms = strtoll(str, &end, 10);
+    if (end == str || now_ms <= 0 || (*end != '\r' && *end != '\n')) {
+        LOGE("Could not parse device time: %s", str);
+        return false;
+    }
+
+    const char *uptime = end + strspn(end, "\r\n");
+
+    // The uptime in seconds, e.g. "12345.67 23456.78", parsed without strtod()
+    // which depends on the locale
+    long long uptime_s = strtoll(uptime, &end, 10);
+    if (end == uptime || uptime_s < 0) {
+        LOGE("Could not parse device uptime: %s", uptime);
+        return false;
+    }
+
+    int64_t uptime_ms = uptime_s * 1000;
+    if (*end == '.') {
+        // Only the first 3 decimals are significant
+        int64_t scale = 100;
+        for (const char *c = end + 1; *c >= '0' && *c <= '9' && scale; ++c) {
+            uptime_ms += (*c - '0') * scale;
+            scale /= 10;
+        }
+    }
+
+    *boot_time_ms = now_ms - uptime_ms;
+    return true;
+}
@@ -3,7 +3,9 @@
 
 #include "common.h"
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "adb_device.h"
 
@@ -27,4 +29,17 @@ sc_adb_parse_devices(char *str, struct sc_vec_adb_devices *out_vec);
 char *
 sc_adb_parse_device_ip(char *str);
 
+/**
+ * Parse the device boot time from the output of
+ * `adb shell date +%s%3N; cat /proc/uptime`
+ *
+ * The first line is the device wall clock time in milliseconds, the second
+ * line starts with the uptime in seconds (with a decimal part).
+ *
+ * Return the boot time, in milliseconds since the Unix epoch, into
+ * `boot_time_ms`.
+ */
+bool
+sc_adb_parse_boot_time(const char *str, int64_t *boot_time_ms);
+
 #endif
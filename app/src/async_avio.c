@@ -0,0 +1,324 @@
+#include "async_avio.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+
+#include "compat.h"
+#include "util/file.h"
+#include "util/log.h"
+#include "util/thread.h"
+
+struct sc_async_avio_chunk {
+    uint8_t *data; // allocated on first use
+    size_t size;
+    int64_t offset;
+};
+
+struct sc_async_avio {
+    AVIOContext *avio;
+    int fd;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond queued_cond; // a chunk is queued, or stopped
+    sc_cond free_cond; // a chunk has been written
+
+    // Ring of chunks: the chunks [head, head + queued) are queued for the
+    // writer thread, the next one is filled by the muxer thread (if
+    // queued < SC_ASYNC_AVIO_CHUNKS)
+    struct sc_async_avio_chunk chunks[SC_ASYNC_AVIO_CHUNKS];
+    unsigned head;
+    unsigned queued;
+    bool stopped;
+    atomic_bool failed;
+
+    // Only accessed from the muxer thread
+    int64_t pos; // position of the next write
+    int64_t size; // size of the file once all the chunks are written
+    uint64_t stalls; // the muxer had to wait for a free chunk
+
+    // Only accessed from the writer thread
+    int64_t allocated;
+    bool prealloc;
+};
+
+static struct sc_async_avio_chunk *
+sc_async_avio_current(struct sc_async_avio *aa) {
+    assert(aa->queued < SC_ASYNC_AVIO_CHUNKS);
+    unsigned index = (aa->head + aa->queued) % SC_ASYNC_AVIO_CHUNKS;
+    return &aa->chunks[index];
+}
+
+// Queue the current chunk (if not empty), and wait for the next one to be free
+static bool
+sc_async_avio_queue(struct sc_async_avio *aa) {
+    sc_mutex_lock(&aa->mutex);
+    struct sc_async_avio_chunk *chunk = sc_async_avio_current(aa);
+    if (chunk->size) {
+        ++aa->queued;
+        sc_cond_signal(&aa->queued_cond);
+
+        if (aa->queued == SC_ASYNC_AVIO_CHUNKS) {
+            // The disk is late by SC_ASYNC_AVIO_CHUNKS chunks
+            ++aa->stalls;
+            do {
+                sc_cond_wait(&aa->free_cond, &aa->mutex);
+            } while (aa->queued == SC_ASYNC_AVIO_CHUNKS);
+        }
+
+        chunk = sc_async_avio_current(aa);
+        chunk->size = 0;
+    }
+    chunk->offset = aa->pos;
+    sc_mutex_unlock(&aa->mutex);
+
+    return !atomic_load_explicit(&aa->failed, memory_order_relaxed);
+}
+
+static int
+sc_async_avio_write_packet(void *opaque, SC_AVIO_WRITE_BUFFER *buf,
+                           int buf_size) {
+    struct sc_async_avio *aa = opaque;
+
+    if (atomic_load_explicit(&aa->failed, memory_order_relaxed)) {
+        return AVERROR(EIO);
+    }
+
+    // The current chunk is only accessed by the muxer thread
+    struct sc_async_avio_chunk *chunk = sc_async_avio_current(aa);
+    size_t remaining = buf_size;
+    while (remaining) {
+        if (!chunk->data) {
+            chunk->data = malloc(SC_ASYNC_AVIO_CHUNK_SIZE);
+            if (!chunk->data) {
+                LOG_OOM();
+                return AVERROR(ENOMEM);
+            }
+        }
+
+        size_t len = MIN(remaining, SC_ASYNC_AVIO_CHUNK_SIZE - chunk->size);
+        memcpy(chunk->data + chunk->size, buf, len);
+        chunk->size += len;
+        buf += len;
+        remaining -= len;
+        aa->pos += len;
+
+        if (chunk->size == SC_ASYNC_AVIO_CHUNK_SIZE) {
+            if (!sc_async_avio_queue(aa)) {
+                return AVERROR(EIO);
+            }
+            chunk = sc_async_avio_current(aa);
+        }
+    }
+
+    aa->size = MAX(aa->size, aa->pos);
+    return buf_size;
+}
+
+static int64_t
+sc_async_avio_seek(void *opaque, int64_t offset, int whence) {
+    struct sc_async_avio *aa = opaque;
+
+    whence &= ~AVSEEK_FORCE;
+
+    int64_t pos;
+    switch (whence) {
+        case AVSEEK_SIZE:
+            return aa->size;
+        case SEEK_SET:
+            pos = offset;
+            break;
+        case SEEK_CUR:
+            pos = aa->pos + offset;
+            break;
+        case SEEK_END:
+            pos = aa->size + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+
+    if (pos < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    if (pos != aa->pos) {
+        // Start a new chunk at the new position: the chunks are written in
+        // order, so the data written after the seek overwrites the previous
+        // data at the same offsets
+        aa->pos = pos;
+        if (!sc_async_avio_queue(aa)) {
+            return AVERROR(EIO);
+        }
+    }
+
+    return pos;
+}
+
+static bool
+sc_async_avio_write_chunk(struct sc_async_avio *aa,
+                          const struct sc_async_avio_chunk *chunk) {
+    int64_t end = chunk->offset + chunk->size;
+    if (aa->prealloc && end > aa->allocated) {
+        int64_t size = end + SC_ASYNC_AVIO_PREALLOC_SIZE;
+        if (sc_file_preallocate(aa->fd, size)) {
+            aa->allocated = size;
+        } else {
+            LOGD("Recording: disk space preallocation not supported");
+            aa->prealloc = false;
+        }
+    }
+
+    return sc_file_write_at(aa->fd, chunk->data, chunk->size, chunk->offset);
+}
+
+static int
+run_async_avio(void *data) {
+    struct sc_async_avio *aa = data;
+
+    for (;;) {
+        sc_mutex_lock(&aa->mutex);
+        while (!aa->queued && !aa->stopped) {
+            sc_cond_wait(&aa->queued_cond, &aa->mutex);
+        }
+        if (!aa->queued) {
+            // Stopped, and all the chunks are written
+            sc_mutex_unlock(&aa->mutex);
+            break;
+        }
+        // The chunk is not reused until it is released
+        struct sc_async_avio_chunk *chunk = &aa->chunks[aa->head];
+        sc_mutex_unlock(&aa->mutex);
+
+        if (!atomic_load_explicit(&aa->failed, memory_order_relaxed)
+                && !sc_async_avio_write_chunk(aa, chunk)) {
+            // Discard the next chunks, the muxer fails on its next write
+            atomic_store_explicit(&aa->failed, true, memory_order_relaxed);
+        }
+
+        sc_mutex_lock(&aa->mutex);
+        aa->head = (aa->head + 1) % SC_ASYNC_AVIO_CHUNKS;
+        --aa->queued;
+        sc_cond_signal(&aa->free_cond);
+        sc_mutex_unlock(&aa->mutex);
+    }
+
+    return 0;
+}
+
+AVIOContext *
+sc_async_avio_open(const char *filename) {
+    struct sc_async_avio *aa = calloc(1, sizeof(*aa));
+    if (!aa) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    aa->fd = sc_file_open_write(filename);
+    if (aa->fd == -1) {
+        goto error_free;
+    }
+
+    atomic_init(&aa->failed, false);
+    aa->prealloc = true;
+
+    uint8_t *buffer = av_malloc(SC_ASYNC_AVIO_BUFFER_SIZE);
+    if (!buffer) {
+        LOG_OOM();
+        goto error_close;
+    }
+
+    aa->avio = avio_alloc_context(buffer, SC_ASYNC_AVIO_BUFFER_SIZE, 1, aa,
+                                  NULL, sc_async_avio_write_packet,
+                                  sc_async_avio_seek);
+    if (!aa->avio) {
+        LOG_OOM();
+        av_free(buffer);
+        goto error_close;
+    }
+
+    if (!sc_mutex_init(&aa->mutex)) {
+        goto error_free_avio;
+    }
+
+    if (!sc_cond_init(&aa->queued_cond)) {
+        goto error_destroy_mutex;
+    }
+
+    if (!sc_cond_init(&aa->free_cond)) {
+        goto error_destroy_queued_cond;
+    }
+
+    bool ok = sc_thread_create(&aa->thread, run_async_avio, "scrcpy-recwrite",
+                               aa);
+    if (!ok) {
+        LOGE("Could not start file writer thread");
+        goto error_destroy_free_cond;
+    }
+
+    return aa->avio;
+
+error_destroy_free_cond:
+    sc_cond_destroy(&aa->free_cond);
+error_destroy_queued_cond:
+    sc_cond_destroy(&aa->queued_cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&aa->mutex);
+error_free_avio:
+    av_freep(&aa->avio->buffer);
+    avio_context_free(&aa->avio);
+error_close:
+    sc_file_close(aa->fd);
+error_free:
+    free(aa);
+    return NULL;
+}
+
+bool
+sc_async_avio_close(AVIOContext *avio) {
+    struct sc_async_avio *aa = avio->opaque;
+    assert(aa->avio == avio);
+
+    avio_flush(avio);
+    bool ok = avio->error >= 0;
+
+    // Queue the last chunk
+    ok &= sc_async_avio_queue(aa);
+
+    sc_mutex_lock(&aa->mutex);
+    aa->stopped = true;
+    sc_cond_signal(&aa->queued_cond);
+    sc_mutex_unlock(&aa->mutex);
+
+    sc_thread_join(&aa->thread, NULL);
+
+    ok &= !atomic_load_explicit(&aa->failed, memory_order_relaxed);
+
+    if (aa->stalls) {
+        LOGW("Recording: the disk was too slow, the muxer waited %" PRIu64
+             " times", aa->stalls);
+    }
+
+    if (aa->allocated > aa->size) {
+        // Release the disk space reserved beyond the end of the file
+        sc_file_truncate(aa->fd, aa->size);
+    }
+    sc_file_close(aa->fd);
+
+    for (unsigned i = 0; i < SC_ASYNC_AVIO_CHUNKS; ++i) {
+        free(aa->chunks[i].data);
+    }
+    sc_cond_destroy(&aa->free_cond);
+    sc_cond_destroy(&aa->queued_cond);
+    sc_mutex_destroy(&aa->mutex);
+    av_freep(&aa->avio->buffer);
+    avio_context_free(&aa->avio);
+    free(aa);
+
+    return ok;
+}
@@ -0,0 +1,54 @@
+#ifndef SC_ASYNC_AVIO_H
+#define SC_ASYNC_AVIO_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <libavformat/avio.h>
+
+// Size of the chunks written to the file at once
+#define SC_ASYNC_AVIO_CHUNK_SIZE (4 << 20) // 4 MiB
+// Maximum number of chunks filled or waiting to be written (the muxer blocks
+// if the file is late by more than this)
+#define SC_ASYNC_AVIO_CHUNKS 8
+// Disk space reserved ahead of the written data
+#define SC_ASYNC_AVIO_PREALLOC_SIZE (256 << 20) // 256 MiB
+// Size of the AVIOContext buffer
+#define SC_ASYNC_AVIO_BUFFER_SIZE (256 << 10) // 256 KiB
+
+/**
+ * Output file for a muxer, written from a background thread
+ *
+ * With avio_open(), every flush of the (small) AVIOContext buffer is a
+ * blocking write on the muxer thread: on a slow or network disk, a single
+ * write may stall for tens of milliseconds.
+ *
+ * Instead, the data is copied into large chunks, written in order by a
+ * dedicated thread, each at its own offset (so that the muxer may seek back
+ * to rewrite a header, e.g. the MP4 moov and mdat sizes on trailer). The disk
+ * space is preallocated ahead of the written data when the file system
+ * supports it, to avoid the fragmentation and the metadata updates of a file
+ * growing by small increments (the space left is released on close).
+ *
+ * A write error is reported to the muxer on its next write (or on close).
+ */
+
+/**
+ * Open a file for writing and return its AVIOContext (to assign to
+ * AVFormatContext.pb, with AVFMT_FLAG_CUSTOM_IO)
+ *
+ * Return NULL on error.
+ */
+AVIOContext *
+sc_async_avio_open(const char *filename);
+
+/**
+ * Flush the buffered data, wait for it to be written, close the file and free
+ * the AVIOContext
+ *
+ * Return false if any write failed.
+ */
+bool
+sc_async_avio_close(AVIOContext *avio);
+
+#endif
@@ -0,0 +1,208 @@
+#include "audio_pipe.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+
+#include "frame_pipe.h"
+#include "util/log.h"
+
+/** Downcast frame_sink to sc_audio_pipe */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_audio_pipe, frame_sink)
+
+#define SC_AUDIO_PIPE_SAMPLE_FMT AV_SAMPLE_FMT_FLT
+
+static bool
+sc_audio_pipe_reserve(struct sc_audio_pipe *pipe, uint32_t samples) {
+    uint32_t min_alloc = pipe->pending + samples;
+    if (min_alloc <= pipe->block_alloc) {
+        return true;
+    }
+
+    uint32_t new_alloc = min_alloc + pipe->block_samples;
+    uint8_t *block = realloc(pipe->block, (size_t) new_alloc
+                                          * pipe->sample_size);
+    if (!block) {
+        LOG_OOM();
+        return false;
+    }
+
+    pipe->block = block;
+    pipe->block_alloc = new_alloc;
+    return true;
+}
+
+static bool
+sc_audio_pipe_write_block(struct sc_audio_pipe *pipe) {
+    if (pipe->pipe_mutex) {
+        sc_mutex_lock(pipe->pipe_mutex);
+    }
+    bool ok = sc_frame_pipe_write_audio(pipe->block, pipe->block_samples,
+                                        pipe->sample_rate, pipe->nb_channels,
+                                        pipe->block_timestamp_ms);
+    if (pipe->pipe_mutex) {
+        sc_mutex_unlock(pipe->pipe_mutex);
+    }
+    return ok;
+}
+
+static bool
+sc_audio_pipe_frame_sink_open(struct sc_frame_sink *sink,
+                              const AVCodecContext *ctx) {
+    struct sc_audio_pipe *pipe = DOWNCAST(sink);
+
+#ifdef SCRCPY_LAVU_HAS_CHLAYOUT
+    assert(ctx->ch_layout.nb_channels > 0);
+    unsigned nb_channels = ctx->ch_layout.nb_channels;
+#else
+    int tmp = av_get_channel_layout_nb_channels(ctx->channel_layout);
+    assert(tmp > 0);
+    unsigned nb_channels = tmp;
+#endif
+
+    assert(ctx->sample_rate > 0);
+    pipe->sample_rate = ctx->sample_rate;
+    pipe->nb_channels = nb_channels;
+    pipe->sample_size = nb_channels * sizeof(float);
+    pipe->block_samples = pipe->sample_rate * SC_AUDIO_PIPE_BLOCK_MS / 1000;
+    assert(pipe->block_samples);
+
+    // Same sample rate and channels, only the sample format is converted
+    SwrContext *swr_ctx = swr_alloc();
+    if (!swr_ctx) {
+        LOG_OOM();
+        return false;
+    }
+    pipe->swr_ctx = swr_ctx;
+
+#ifdef SCRCPY_LAVU_HAS_CHLAYOUT
+    av_opt_set_chlayout(swr_ctx, "in_chlayout", &ctx->ch_layout, 0);
+    av_opt_set_chlayout(swr_ctx, "out_chlayout", &ctx->ch_layout, 0);
+#else
+    av_opt_set_channel_layout(swr_ctx, "in_channel_layout",
+                              ctx->channel_layout, 0);
+    av_opt_set_channel_layout(swr_ctx, "out_channel_layout",
+                              ctx->channel_layout, 0);
+#endif
+
+    av_opt_set_int(swr_ctx, "in_sample_rate", ctx->sample_rate, 0);
+    av_opt_set_int(swr_ctx, "out_sample_rate", ctx->sample_rate, 0);
+
+    av_opt_set_sample_fmt(swr_ctx, "in_sample_fmt", ctx->sample_fmt, 0);
+    av_opt_set_sample_fmt(swr_ctx, "out_sample_fmt", SC_AUDIO_PIPE_SAMPLE_FMT,
+                          0);
+
+    int ret = swr_init(swr_ctx);
+    if (ret) {
+        LOGE("Failed to initialize the audio pipe resampling context");
+        goto error_free_swr_ctx;
+    }
+
+    pipe->block = NULL;
+    pipe->block_alloc = 0;
+    pipe->pending = 0;
+    pipe->block_timestamp_ms = -1;
+    pipe->disabled = false;
+
+    // Two blocks are enough for the typical decoded frames (20 ms)
+    if (!sc_audio_pipe_reserve(pipe, 2 * pipe->block_samples)) {
+        goto error_free_swr_ctx;
+    }
+
+    // The boot time (without clock synchronization) is retrieved before the
+    // first frame
+    sc_frame_clock_prepare(&pipe->clock);
+
+    return true;
+
+error_free_swr_ctx:
+    swr_free(&pipe->swr_ctx);
+
+    return false;
+}
+
+static void
+sc_audio_pipe_frame_sink_close(struct sc_frame_sink *sink) {
+    struct sc_audio_pipe *pipe = DOWNCAST(sink);
+
+    // The last incomplete block, if any, is dropped
+    free(pipe->block);
+    swr_free(&pipe->swr_ctx);
+}
+
+static bool
+sc_audio_pipe_frame_sink_push(struct sc_frame_sink *sink,
+                              const AVFrame *frame) {
+    struct sc_audio_pipe *pipe = DOWNCAST(sink);
+
+    if (pipe->disabled) {
+        // The pipe is not required for the other outputs
+        return true;
+    }
+
+    int64_t swr_delay = swr_get_delay(pipe->swr_ctx, pipe->sample_rate);
+    uint32_t max_samples = swr_delay + frame->nb_samples;
+    if (!sc_audio_pipe_reserve(pipe, max_samples)) {
+        return false;
+    }
+
+    // Resynchronize the block timestamp on every frame, so that it does not
+    // drift from the device clock
+    int64_t timestamp_ms = sc_frame_clock_get_timestamp(&pipe->clock,
+                                                        frame->metadata,
+                                                        frame->pts);
+    if (timestamp_ms >= 0) {
+        int64_t pending_ms = (int64_t) pipe->pending * 1000
+                           / pipe->sample_rate;
+        pipe->block_timestamp_ms = timestamp_ms - pending_ms;
+    }
+
+    uint8_t *out = pipe->block + pipe->pending * pipe->sample_size;
+    int ret = swr_convert(pipe->swr_ctx, &out, max_samples,
+                          (const uint8_t **) frame->data, frame->nb_samples);
+    if (ret < 0) {
+        LOGE("Audio pipe resampling failed: %d", ret);
+        return false;
+    }
+    pipe->pending += ret;
+
+    size_t block_size = pipe->block_samples * pipe->sample_size;
+    while (pipe->pending >= pipe->block_samples) {
+        if (!sc_audio_pipe_write_block(pipe)) {
+            // Typically, the consumer closed the pipe
+            LOGE("Could not write audio to stdout, disabling audio pipe");
+            pipe->disabled = true;
+            return true;
+        }
+
+        pipe->pending -= pipe->block_samples;
+        memmove(pipe->block, pipe->block + block_size,
+                pipe->pending * pipe->sample_size);
+        if (pipe->block_timestamp_ms >= 0) {
+            pipe->block_timestamp_ms += SC_AUDIO_PIPE_BLOCK_MS;
+        }
+    }
+
+    return true;
+}
+
+void
+sc_audio_pipe_init(struct sc_audio_pipe *pipe, sc_mutex *pipe_mutex,
+                   struct sc_clock_sync *clock_sync, const char *serial,
+                   int64_t device_boot_time) {
+    pipe->pipe_mutex = pipe_mutex;
+    sc_frame_clock_init(&pipe->clock, clock_sync, serial);
+    sc_frame_clock_set_boot_time(&pipe->clock, device_boot_time);
+
+    sc_frame_pipe_init();
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = sc_audio_pipe_frame_sink_open,
+        .close = sc_audio_pipe_frame_sink_close,
+        .push = sc_audio_pipe_frame_sink_push,
+    };
+
+    pipe->frame_sink.ops = &ops;
+}
@@ -0,0 +1,57 @@
+#ifndef SC_AUDIO_PIPE_H
+#define SC_AUDIO_PIPE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libswresample/swresample.h>
+
+#include "clock_sync.h"
+#include "frame_clock.h"
+#include "trait/frame_sink.h"
+#include "util/thread.h"
+
+// Duration of the audio blocks written to the pipe, in milliseconds
+#define SC_AUDIO_PIPE_BLOCK_MS 20
+
+/**
+ * Audio output to the pipe (--pipe-audio), multiplexed with the video frames
+ * written by the video processor.
+ *
+ * It receives the decoded frames directly from the audio decoder (it does not
+ * depend on the audio player), converts them to interleaved 32-bit float, and
+ * writes them in blocks of SC_AUDIO_PIPE_BLOCK_MS, each one with the capture
+ * time of its first sample (see frame_header.h).
+ *
+ * The blocks are written from the audio decoder thread.
+ */
+struct sc_audio_pipe {
+    struct sc_frame_sink frame_sink; // frame sink trait
+
+    // Serialize the writes with the video frames (may be NULL if the audio is
+    // the only output)
+    sc_mutex *pipe_mutex;
+
+    // Only accessed from the decoder thread
+    struct sc_frame_clock clock;
+    struct SwrContext *swr_ctx;
+    unsigned sample_rate;
+    unsigned nb_channels;
+    size_t sample_size; // all channels
+
+    uint8_t *block; // pending samples, at least one block
+    uint32_t block_alloc; // in samples
+    uint32_t block_samples; // samples per block
+    uint32_t pending; // samples in block
+    int64_t block_timestamp_ms; // capture time of the first pending sample
+    bool disabled; // on pipe error
+};
+
+void
+sc_audio_pipe_init(struct sc_audio_pipe *pipe, sc_mutex *pipe_mutex,
+                   struct sc_clock_sync *clock_sync, const char *serial,
+                   int64_t device_boot_time);
+
+#endif
@@ -3,6 +3,7 @@
 #include <libavcodec/avcodec.h>
 #include <libavutil/opt.h>
 
+#include "metrics.h"
 #include "util/log.h"
 
 //#define SC_AUDIO_PLAYER_DEBUG // uncomment to debug
@@ -117,22 +118,38 @@ sc_audio_player_sdl_callback(void *userdata, uint8_t *stream, int len_int) {
     atomic_store_explicit(&ap->played, true, memory_order_relaxed);
 }
 
-static uint8_t *
-sc_audio_player_get_swr_buf(struct sc_audio_player *ap, uint32_t min_samples) {
-    size_t min_buf_size = TO_BYTES(min_samples);
-    if (min_buf_size > ap->swr_buf_alloc_size) {
-        size_t new_size = min_buf_size + 4096;
-        uint8_t *buf = realloc(ap->swr_buf, new_size);
-        if (!buf) {
-            LOG_OOM();
-            // Could not realloc to the requested size
-            return NULL;
-        }
-        ap->swr_buf = buf;
-        ap->swr_buf_alloc_size = new_size;
+static void
+sc_audio_player_measure_latency(struct sc_audio_player *ap,
+                                const AVFrame *frame, uint32_t buffered) {
+    if (!ap->clock_sync || frame->pts == AV_NOPTS_VALUE) {
+        return;
     }
 
-    return ap->swr_buf;
+    struct sc_clock_estimate estimate;
+    if (!sc_clock_sync_get_estimate(ap->clock_sync, &estimate)) {
+        // Not synchronized yet
+        return;
+    }
+
+    // The PTS is the device capture time of the first sample of the frame,
+    // and the last sample will be played once the buffered samples and the
+    // SDL output buffer are consumed
+    sc_tick captured = frame->pts + (sc_tick) frame->nb_samples * SC_TICK_FREQ
+                                  / ap->sample_rate;
+    sc_tick played = sc_tick_now()
+                   + (sc_tick) (buffered + ap->output_buffer) * SC_TICK_FREQ
+                                                              / ap->sample_rate;
+    sc_tick latency = played - sc_clock_estimate_to_local(&estimate, captured);
+
+    ++ap->latency_count;
+    ap->latency_total += latency;
+    if (latency > ap->latency_max) {
+        ap->latency_max = latency;
+    }
+
+    sc_metrics_set(SC_METRIC_AUDIO_LATENCY_US, SC_TICK_TO_US(latency));
+    LOGV("[Audio] End-to-end latency: %" PRItick " ms",
+         SC_TICK_TO_MS(latency));
 }
 
 static bool
@@ -145,68 +162,65 @@ sc_audio_player_frame_sink_push(struct sc_frame_sink *sink,
     int64_t swr_delay = swr_get_delay(swr_ctx, ap->sample_rate);
     // No need to av_rescale_rnd(), input and output sample rates are the same.
     // Add more space (256) for clock compensation.
-    int dst_nb_samples = swr_delay + frame->nb_samples + 256;
-
-    uint8_t *swr_buf = sc_audio_player_get_swr_buf(ap, dst_nb_samples);
-    if (!swr_buf) {
-        return false;
-    }
-
-    int ret = swr_convert(swr_ctx, &swr_buf, dst_nb_samples,
-                          (const uint8_t **) frame->data, frame->nb_samples);
-    if (ret < 0) {
-        LOGE("Resampling failed: %d", ret);
-        return false;
-    }
-
-    // swr_convert() returns the number of samples which would have been
-    // written if the buffer was big enough.
-    uint32_t samples = MIN(ret, dst_nb_samples);
-#ifdef SC_AUDIO_PLAYER_DEBUG
-    LOGD("[Audio] %" PRIu32 " samples written to buffer", samples);
-#endif
+    uint32_t max_samples = swr_delay + frame->nb_samples + 256;
 
     uint32_t cap = sc_audiobuf_capacity(&ap->buf);
-    if (samples > cap) {
-        // Very very unlikely: a single resampled frame should never
-        // exceed the audio buffer size (or something is very wrong).
-        // Ignore the first bytes in swr_buf to avoid memory corruption anyway.
-        swr_buf += TO_BYTES(samples - cap);
-        samples = cap;
+    if (max_samples > cap) {
+        // Very very unlikely: a single resampled frame should never exceed
+        // the audio buffer size (or something is very wrong). The remaining
+        // samples stay buffered in the resampler.
+        max_samples = cap;
     }
 
     uint32_t skipped_samples = 0;
 
-    uint32_t written = sc_audiobuf_write(&ap->buf, swr_buf, samples);
-    if (written < samples) {
-        uint32_t remaining = samples - written;
-
-        // All samples that could be written without locking have been written,
-        // now we need to lock to drop/consume old samples
+    // The reader only increases the free space, so if there is enough space
+    // now, there will still be enough space while resampling
+    uint32_t can_write = cap - sc_audiobuf_can_read(&ap->buf);
+    if (can_write < max_samples) {
+        // Lock to drop old samples to make space
         SDL_LockAudioDevice(ap->device);
-
-        // Retry with the lock
-        written += sc_audiobuf_write(&ap->buf,
-                                     swr_buf + TO_BYTES(written),
-                                     remaining);
-        if (written < samples) {
-            remaining = samples - written;
-            // Still insufficient, drop old samples to make space
+        can_write = cap - sc_audiobuf_can_read(&ap->buf);
+        if (can_write < max_samples) {
+            uint32_t remaining = max_samples - can_write;
             skipped_samples = sc_audiobuf_read(&ap->buf, NULL, remaining);
             assert(skipped_samples == remaining);
         }
-
         SDL_UnlockAudioDevice(ap->device);
+    }
+
+    // Resample directly into the audio buffer: the free space is split in two
+    // contiguous parts if it wraps around the end of the buffer
+    const uint8_t **in = (const uint8_t **) frame->data;
+    int in_count = frame->nb_samples;
+    uint32_t written = 0;
+    while (written < max_samples) {
+        uint8_t *out;
+        uint32_t out_count = sc_audiobuf_reserve(&ap->buf, &out);
+        out_count = MIN(out_count, max_samples - written);
+        assert(out_count);
+
+        int ret = swr_convert(swr_ctx, &out, out_count, in, in_count);
+        if (ret < 0) {
+            LOGE("Resampling failed: %d", ret);
+            return false;
+        }
+
+        sc_audiobuf_commit(&ap->buf, ret);
+        written += ret;
 
-        if (written < samples) {
-            // Now there is enough space
-            uint32_t w = sc_audiobuf_write(&ap->buf,
-                                           swr_buf + TO_BYTES(written),
-                                           remaining);
-            assert(w == remaining);
-            (void) w;
+        if ((uint32_t) ret < out_count) {
+            // Everything has been converted
+            break;
         }
+
+        // Retrieve the samples buffered by the resampler (the input is not
+        // NULL, to not flush the resampler)
+        in_count = 0;
     }
+#ifdef SC_AUDIO_PLAYER_DEBUG
+    LOGD("[Audio] %" PRIu32 " samples written to buffer", written);
+#endif
 
     uint32_t underflow = 0;
     uint32_t max_buffered_samples;
@@ -288,8 +302,9 @@ sc_audio_player_frame_sink_push(struct sc_frame_sink *sink,
 #endif
 
     ap->samples_since_resync += written;
-    if (ap->samples_since_resync >= ap->sample_rate) {
-        // Recompute compensation every second
+    if (ap->samples_since_resync >= ap->resync_period) {
+        // Recompute compensation every second (every 500ms in low latency
+        // mode)
         ap->samples_since_resync = 0;
 
         float avg = sc_average_get(&ap->avg_buffering);
@@ -297,9 +312,14 @@ sc_audio_player_frame_sink_push(struct sc_frame_sink *sink,
 
         // Enable compensation when the difference exceeds +/- 4ms.
         // Disable compensation when the difference is lower than +/- 1ms.
+        // In low latency mode, the buffers are smaller, so these thresholds
+        // are halved.
         int threshold = ap->compensation != 0
                       ? ap->sample_rate     / 1000  /* 1ms */
                       : ap->sample_rate * 4 / 1000; /* 4ms */
+        if (ap->low_latency) {
+            threshold /= 2;
+        }
 
         if (abs(diff) < threshold) {
             // Do not compensate for small values, the error is just noise
@@ -309,9 +329,9 @@ sc_audio_player_frame_sink_push(struct sc_frame_sink *sink,
             // target, this would increase underflow
             diff = 0;
         }
-        // Compensate the diff over 4 seconds (but will be recomputed after 1
-        // second)
-        int distance = 4 * ap->sample_rate;
+        // Compensate the diff over 4 seconds (2 seconds in low latency mode),
+        // but it will be recomputed before
+        int distance = (ap->low_latency ? 2 : 4) * ap->sample_rate;
         // Limit compensation rate to 2%
         int abs_max_diff = distance / 50;
         diff = CLAMP(diff, -abs_max_diff, abs_max_diff);
@@ -327,6 +347,8 @@ sc_audio_player_frame_sink_push(struct sc_frame_sink *sink,
                 ap->compensation = diff;
             }
         }
+
+        sc_audio_player_measure_latency(ap, frame, can_read);
     }
 
     return true;
@@ -419,18 +441,16 @@ sc_audio_player_frame_sink_open(struct sc_frame_sink *sink,
         goto error_free_swr_ctx;
     }
 
-    size_t initial_swr_buf_size = TO_BYTES(4096);
-    ap->swr_buf = malloc(initial_swr_buf_size);
-    if (!ap->swr_buf) {
-        LOG_OOM();
-        goto error_destroy_audiobuf;
-    }
-    ap->swr_buf_alloc_size = initial_swr_buf_size;
-
     // Samples are produced and consumed by blocks, so the buffering must be
     // smoothed to get a relatively stable value.
-    sc_average_init(&ap->avg_buffering, 128);
+    sc_average_init(&ap->avg_buffering, ap->low_latency ? 64 : 128);
     ap->samples_since_resync = 0;
+    ap->resync_period = ap->low_latency ? ap->sample_rate / 2
+                                        : ap->sample_rate;
+
+    ap->latency_count = 0;
+    ap->latency_total = 0;
+    ap->latency_max = 0;
 
     ap->received = false;
     atomic_init(&ap->played, false);
@@ -450,8 +470,6 @@ sc_audio_player_frame_sink_open(struct sc_frame_sink *sink,
 
     return true;
 
-error_destroy_audiobuf:
-    sc_audiobuf_destroy(&ap->buf);
 error_free_swr_ctx:
     swr_free(&ap->swr_ctx);
 error_close_audio_device:
@@ -468,16 +486,24 @@ sc_audio_player_frame_sink_close(struct sc_frame_sink *sink) {
     SDL_PauseAudioDevice(ap->device, 1);
     SDL_CloseAudioDevice(ap->device);
 
-    free(ap->swr_buf);
     sc_audiobuf_destroy(&ap->buf);
     swr_free(&ap->swr_ctx);
+
+    if (ap->latency_count) {
+        sc_tick avg = ap->latency_total / (sc_tick) ap->latency_count;
+        LOGI("Audio end-to-end latency: avg %" PRItick " ms, max %" PRItick
+             " ms", SC_TICK_TO_MS(avg), SC_TICK_TO_MS(ap->latency_max));
+    }
 }
 
 void
 sc_audio_player_init(struct sc_audio_player *ap, sc_tick target_buffering,
-                     sc_tick output_buffer_duration) {
+                     sc_tick output_buffer_duration, bool low_latency,
+                     struct sc_clock_sync *clock_sync) {
     ap->target_buffering_delay = target_buffering;
     ap->output_buffer_duration = output_buffer_duration;
+    ap->low_latency = low_latency;
+    ap->clock_sync = clock_sync;
 
     static const struct sc_frame_sink_ops ops = {
         .open = sc_audio_player_frame_sink_open,
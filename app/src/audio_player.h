@@ -9,6 +9,7 @@
 #include <libswresample/swresample.h>
 #include <SDL2/SDL.h>
 
+#include "clock_sync.h"
 #include "trait/frame_sink.h"
 #include "util/audiobuf.h"
 #include "util/average.h"
@@ -46,10 +47,6 @@ struct sc_audio_player {
     // The number of bytes per sample for a single channel
     size_t out_bytes_per_sample;
 
-    // Target buffer for resampling (only used by the receiver thread)
-    uint8_t *swr_buf;
-    size_t swr_buf_alloc_size;
-
     // Number of buffered samples (may be negative on underflow) (only used by
     // the receiver thread)
     struct sc_average avg_buffering;
@@ -57,6 +54,19 @@ struct sc_audio_player {
     // (only used by the receiver thread)
     uint32_t samples_since_resync;
 
+    // Smaller buffers, compensated more reactively
+    bool low_latency;
+    // Interval between compensation updates, in samples
+    uint32_t resync_period;
+
+    // To measure the end-to-end latency (capture on the device to playback),
+    // may be NULL
+    struct sc_clock_sync *clock_sync;
+    // End-to-end latency statistics (only used by the receiver thread)
+    uint64_t latency_count;
+    sc_tick latency_total;
+    sc_tick latency_max;
+
     // Number of silence samples inserted since the last received packet
     atomic_uint_least32_t underflow;
 
@@ -77,8 +87,15 @@ struct sc_audio_player_callbacks {
     void (*on_ended)(struct sc_audio_player *ap, bool success, void *userdata);
 };
 
+/**
+ * Initialize the audio player
+ *
+ * If clock_sync is not NULL, the end-to-end latency is measured (from the
+ * capture of the samples on the device to their playback).
+ */
 void
 sc_audio_player_init(struct sc_audio_player *ap, sc_tick target_buffering,
-                     sc_tick audio_output_buffer);
+                     sc_tick audio_output_buffer, bool low_latency,
+                     struct sc_clock_sync *clock_sync);
 
 #endif
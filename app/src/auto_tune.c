@@ -0,0 +1,312 @@
+#include "auto_tune.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <SDL2/SDL_cpuinfo.h>
+
+#include "frame_writer.h"
+#include "metrics.h"
+#include "video_preprocess.h"
+#include "util/log.h"
+#include "util/thread.h"
+
+// Maximum number of decoder threads (see --decoder-threads)
+#define SC_AUTO_TUNE_MAX_DECODER_THREADS 16
+
+// The counters read on each adjustment
+struct sc_auto_tune_sample {
+    int64_t decoded_frames;
+    int64_t decode_us;
+    int64_t processed_frames;
+    int64_t preprocess_us;
+    int64_t processor_dropped;
+    int64_t write_us;
+    int64_t writer_dropped;
+};
+
+static struct {
+    bool enabled;
+    float target_fps;
+    unsigned cpu_count;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped; // protected by the mutex
+    struct sc_frame_writer *writer; // protected by the mutex
+
+    // Only accessed from the tuner thread (then on destroy)
+    unsigned preprocess_threads;
+    // Lowest count not found too low (it is never decreased below)
+    unsigned preprocess_floor;
+    bool preprocess_measured;
+    unsigned writer_threads;
+    bool writer_measured;
+    unsigned decoder_threads; // as configured (0 for one per CPU core)
+    unsigned decoder_needed; // the highest estimate, 0 if not measured
+} tune;
+
+// Number of preprocessing threads to apply, 0 if unchanged
+static atomic_uint preprocess_request;
+
+static void
+sc_auto_tune_read(struct sc_auto_tune_sample *sample) {
+    sample->decoded_frames = sc_metrics_get(SC_METRIC_DECODED_FRAMES);
+    sample->decode_us = sc_metrics_get(SC_METRIC_DECODE_US);
+    sample->processed_frames = sc_metrics_get(SC_METRIC_PROCESSED_FRAMES);
+    sample->preprocess_us = sc_metrics_get(SC_METRIC_PREPROCESS_US);
+    sample->processor_dropped =
+        sc_metrics_get(SC_METRIC_PROCESSOR_DROPPED_FRAMES);
+    sample->write_us = sc_metrics_get(SC_METRIC_WRITE_US);
+    sample->writer_dropped = sc_metrics_get(SC_METRIC_WRITER_DROPPED_FRAMES);
+}
+
+static void
+sc_auto_tune_effects(double load, bool dropped) {
+    unsigned n = tune.preprocess_threads;
+    if ((dropped || load > SC_AUTO_TUNE_HIGH_LOAD) && n < tune.cpu_count) {
+        tune.preprocess_floor = n + 1;
+        tune.preprocess_threads = n + 1;
+    } else if (load < SC_AUTO_TUNE_LOW_LOAD && n > tune.preprocess_floor) {
+        tune.preprocess_threads = n - 1;
+    } else {
+        return;
+    }
+
+    LOGI("Auto-tune: %u preprocessing threads (effects at %d%% of the frame "
+         "period%s)", tune.preprocess_threads, (int) (load * 100),
+         dropped ? ", frames dropped" : "");
+    atomic_store_explicit(&preprocess_request, tune.preprocess_threads,
+                          memory_order_relaxed);
+}
+
+static void
+sc_auto_tune_writer(struct sc_frame_writer *fw, double busy, bool dropped) {
+    // The average number of I/O threads busy writing, with some margin
+    unsigned needed = ceil(busy / SC_AUTO_TUNE_HIGH_LOAD);
+    if (dropped && needed <= tune.writer_threads) {
+        needed = tune.writer_threads + 1;
+    }
+    if (!needed) {
+        needed = 1;
+    }
+    if (needed == tune.writer_threads) {
+        return;
+    }
+
+    unsigned count = sc_frame_writer_set_active_threads(fw, needed);
+    if (count != tune.writer_threads) {
+        tune.writer_threads = count;
+        LOGI("Auto-tune: %u frame writer threads (%.1f threads busy%s)",
+             count, busy, dropped ? ", frames dropped" : "");
+    }
+}
+
+static void
+sc_auto_tune_decoder(double load) {
+    unsigned threads = tune.decoder_threads ? tune.decoder_threads
+                                            : tune.cpu_count;
+    // With slice threading, the duration of the decoding calls decreases
+    // roughly with the number of threads
+    unsigned needed = ceil(threads * load / SC_AUTO_TUNE_HIGH_LOAD);
+    if (!needed) {
+        needed = 1;
+    }
+    if (needed > SC_AUTO_TUNE_MAX_DECODER_THREADS) {
+        needed = SC_AUTO_TUNE_MAX_DECODER_THREADS;
+    }
+
+    if (needed > tune.decoder_needed) {
+        if (needed > threads) {
+            LOGW("Auto-tune: the decoding takes %d%% of the frame period, "
+                 "%u decoder threads needed (see --decoder-threads)",
+                 (int) (load * 100), needed);
+        }
+        tune.decoder_needed = needed;
+    }
+}
+
+static void
+sc_auto_tune_step(const struct sc_auto_tune_sample *prev,
+                  const struct sc_auto_tune_sample *cur, sc_tick elapsed) {
+    int64_t decoded = cur->decoded_frames - prev->decoded_frames;
+    int64_t elapsed_us = SC_TICK_TO_US(elapsed);
+    if (decoded <= 0 || elapsed_us <= 0) {
+        // No frames (e.g. the device screen is off)
+        return;
+    }
+
+    double fps = tune.target_fps ? tune.target_fps
+                                 : decoded * 1e6 / elapsed_us;
+    double period_us = 1e6 / fps;
+
+    int64_t processed = cur->processed_frames - prev->processed_frames;
+    int64_t preprocess_us = cur->preprocess_us - prev->preprocess_us;
+    if (processed > 0 && preprocess_us > 0) {
+        double load = (double) preprocess_us / processed / period_us;
+        bool dropped = cur->processor_dropped > prev->processor_dropped;
+        tune.preprocess_measured = true;
+        sc_auto_tune_effects(load, dropped);
+    }
+
+    sc_mutex_lock(&tune.mutex);
+    if (tune.writer) {
+        double busy = (double) (cur->write_us - prev->write_us) / elapsed_us;
+        bool dropped = cur->writer_dropped > prev->writer_dropped;
+        tune.writer_measured = true;
+        sc_auto_tune_writer(tune.writer, busy, dropped);
+    }
+    sc_mutex_unlock(&tune.mutex);
+
+    int64_t decode_us = cur->decode_us - prev->decode_us;
+    if (decode_us > 0) {
+        sc_auto_tune_decoder((double) decode_us / decoded / period_us);
+    }
+}
+
+static int
+run_auto_tune(void *data) {
+    (void) data;
+
+    struct sc_auto_tune_sample prev;
+    sc_auto_tune_read(&prev);
+    sc_tick prev_time = sc_tick_now();
+    sc_tick deadline = prev_time + SC_AUTO_TUNE_INTERVAL;
+
+    sc_mutex_lock(&tune.mutex);
+    for (;;) {
+        while (!tune.stopped
+                && sc_cond_timedwait(&tune.cond, &tune.mutex, deadline)) {
+            // spurious wake-up
+        }
+
+        if (tune.stopped) {
+            break;
+        }
+
+        sc_mutex_unlock(&tune.mutex);
+
+        struct sc_auto_tune_sample cur;
+        sc_auto_tune_read(&cur);
+        sc_tick now = sc_tick_now();
+        sc_auto_tune_step(&prev, &cur, now - prev_time);
+        prev = cur;
+        prev_time = now;
+        deadline += SC_AUTO_TUNE_INTERVAL;
+
+        sc_mutex_lock(&tune.mutex);
+    }
+    sc_mutex_unlock(&tune.mutex);
+
+    return 0;
+}
+
+bool
+sc_auto_tune_init(const struct sc_auto_tune_params *params) {
+    assert(!tune.enabled);
+    assert(params->writer_threads);
+
+    int cpu_count = SDL_GetCPUCount();
+    tune.cpu_count = cpu_count > 0 ? cpu_count : 1;
+    tune.target_fps = params->target_fps;
+    tune.preprocess_threads = params->preprocess_threads
+                            ? params->preprocess_threads : tune.cpu_count;
+    tune.preprocess_floor = 1;
+    tune.preprocess_measured = false;
+    tune.writer_threads = params->writer_threads;
+    tune.writer_measured = false;
+    tune.decoder_threads = params->decoder_threads;
+    tune.decoder_needed = 0;
+    tune.writer = NULL;
+    atomic_store_explicit(&preprocess_request, 0, memory_order_relaxed);
+
+    bool ok = sc_mutex_init(&tune.mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&tune.cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    tune.stopped = false;
+
+    ok = sc_thread_create(&tune.thread, run_auto_tune, "scrcpy-tune", NULL);
+    if (!ok) {
+        LOGE("Could not start auto-tune thread");
+        goto error_destroy_cond;
+    }
+
+    tune.enabled = true;
+    return true;
+
+error_destroy_cond:
+    sc_cond_destroy(&tune.cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&tune.mutex);
+
+    return false;
+}
+
+void
+sc_auto_tune_destroy(void) {
+    if (!tune.enabled) {
+        return;
+    }
+
+    sc_mutex_lock(&tune.mutex);
+    tune.stopped = true;
+    sc_cond_signal(&tune.cond);
+    sc_mutex_unlock(&tune.mutex);
+
+    sc_thread_join(&tune.thread, NULL);
+
+    // The configuration reached, for the next captures on this machine
+    char options[128] = "";
+    int len = 0;
+    if (tune.preprocess_measured) {
+        len += snprintf(options + len, sizeof(options) - len,
+                        " --preprocess-threads=%u", tune.preprocess_threads);
+    }
+    if (tune.writer_measured) {
+        len += snprintf(options + len, sizeof(options) - len,
+                        " --save-frames-threads=%u", tune.writer_threads);
+    }
+    if (tune.decoder_needed) {
+        snprintf(options + len, sizeof(options) - len,
+                 " --decoder-threads=%u", tune.decoder_needed);
+    }
+    if (options[0]) {
+        LOGI("Auto-tune: configuration reached:%s", options);
+    }
+
+    sc_cond_destroy(&tune.cond);
+    sc_mutex_destroy(&tune.mutex);
+    tune.enabled = false;
+}
+
+void
+sc_auto_tune_set_frame_writer(struct sc_frame_writer *fw) {
+    if (!tune.enabled) {
+        return;
+    }
+
+    sc_mutex_lock(&tune.mutex);
+    if (!fw || !tune.writer) {
+        tune.writer = fw;
+    }
+    sc_mutex_unlock(&tune.mutex);
+}
+
+void
+sc_auto_tune_apply(void) {
+    unsigned count = atomic_exchange_explicit(&preprocess_request, 0,
+                                              memory_order_relaxed);
+    if (count) {
+        sc_video_preprocess_set_threads(count);
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef SC_AUTO_TUNE_H
+#define SC_AUTO_TUNE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#include "util/tick.h"
+
+// forward declarations
+struct sc_frame_writer;
+
+// Interval between the adjustments (each one from the costs measured over the
+// previous interval)
+#define SC_AUTO_TUNE_INTERVAL SC_TICK_FROM_SEC(2)
+
+// Fraction of the frame period a stage may use before it is given more
+// threads, and below which it is given fewer
+#define SC_AUTO_TUNE_HIGH_LOAD 0.8
+#define SC_AUTO_TUNE_LOW_LOAD 0.4
+
+struct sc_auto_tune_params {
+    float target_fps; // 0 to keep up with the decoded frame rate
+    unsigned preprocess_threads; // initial count, 0 for one per CPU core
+    // Fixed once the decoder is opened, 0 for one thread per CPU core
+    unsigned decoder_threads;
+    unsigned writer_threads; // I/O threads initially active
+};
+
+/**
+ * Adjust the thread pools of the pipeline to the measured costs of its stages
+ * (--auto-tune)
+ *
+ * Every SC_AUTO_TUNE_INTERVAL, a thread reads the time spent in each stage
+ * from the metrics (see metrics.h), relative to the frame period of the
+ * target rate, and:
+ *  - resizes the OpenCV pool running the effects (applied by the processor
+ *    thread, see sc_auto_tune_apply()), one thread at a time: up when the
+ *    effects exceed SC_AUTO_TUNE_HIGH_LOAD of the period or frames are
+ *    dropped, down when they stay below SC_AUTO_TUNE_LOW_LOAD (never below a
+ *    count which was found too low);
+ *  - sets the number of active I/O threads of the frame writer to the
+ *    measured writing load (see sc_frame_writer_set_active_threads()), plus
+ *    one while frames are dropped;
+ *  - estimates the decoder threads needed (the codec context can not be
+ *    resized once opened).
+ *
+ * The changes are logged, and the configuration reached is logged on exit as
+ * command line options, to be reused for the next captures on this machine.
+ *
+ * The tuner is global (a single device).
+ */
+
+/**
+ * Start the tuner thread
+ *
+ * Must be called from the main thread, before the pipeline is started.
+ */
+bool
+sc_auto_tune_init(const struct sc_auto_tune_params *params);
+
+/**
+ * Stop the tuner, and log the configuration reached
+ */
+void
+sc_auto_tune_destroy(void);
+
+/**
+ * Register the frame writer to resize, or NULL to unregister it
+ *
+ * The writer must be unregistered before it is stopped. Only the first writer
+ * registered is tuned.
+ */
+void
+sc_auto_tune_set_frame_writer(struct sc_frame_writer *fw);
+
+/**
+ * Apply the number of preprocessing threads last decided, if it changed
+ *
+ * Called from the thread running the effects, between two frames, so that the
+ * OpenCV pool is never resized while it runs. It does nothing if the tuner is
+ * not enabled.
+ */
+void
+sc_auto_tune_apply(void);
+
+#endif
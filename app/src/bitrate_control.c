@@ -0,0 +1,159 @@
+#include "bitrate_control.h"
+
+#include <inttypes.h>
+
+#include "control_msg.h"
+#include "controller.h"
+#include "util/log.h"
+
+bool
+sc_bitrate_control_init(struct sc_bitrate_control *bc,
+                        struct sc_controller *controller, sc_socket socket,
+                        uint32_t min_bit_rate, uint32_t max_bit_rate) {
+    bool ok = sc_mutex_init(&bc->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&bc->cond);
+    if (!ok) {
+        sc_mutex_destroy(&bc->mutex);
+        return false;
+    }
+
+    bc->controller = controller;
+    bc->socket = socket;
+    bc->stopped = false;
+    sc_bitrate_estimator_init(&bc->estimator, min_bit_rate, max_bit_rate);
+
+    atomic_init(&bc->received_bytes, 0);
+    atomic_init(&bc->frames, 0);
+    atomic_init(&bc->skipped, 0);
+    atomic_init(&bc->lost, 0);
+
+    return true;
+}
+
+void
+sc_bitrate_control_destroy(struct sc_bitrate_control *bc) {
+    sc_cond_destroy(&bc->cond);
+    sc_mutex_destroy(&bc->mutex);
+}
+
+static void
+sc_bitrate_control_send(struct sc_bitrate_control *bc, uint32_t bit_rate) {
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_SET_VIDEO_BIT_RATE;
+    msg.set_video_bit_rate.bit_rate = bit_rate;
+
+    if (!sc_controller_push_msg(bc->controller, &msg)) {
+        LOGW("Could not request video bit rate");
+    }
+}
+
+static void
+sc_bitrate_control_tick(struct sc_bitrate_control *bc, sc_tick interval) {
+    struct sc_bitrate_stats stats = {
+        .received_bytes = atomic_exchange_explicit(&bc->received_bytes, 0,
+                                                   memory_order_relaxed),
+        .frames = atomic_exchange_explicit(&bc->frames, 0,
+                                           memory_order_relaxed),
+        .skipped = atomic_exchange_explicit(&bc->skipped, 0,
+                                            memory_order_relaxed),
+        .backlog = 0,
+        .lost = atomic_exchange_explicit(&bc->lost, 0, memory_order_relaxed),
+    };
+
+    if (bc->socket != SC_SOCKET_NONE
+            && !net_get_pending_size(bc->socket, &stats.backlog)) {
+        // Error already logged, control from the other measures only
+        stats.backlog = 0;
+    }
+
+    struct sc_bitrate_estimator *estimator = &bc->estimator;
+    uint32_t previous = estimator->bit_rate;
+    if (sc_bitrate_estimator_update(estimator, &stats, interval)) {
+        LOGD("Video bit rate: %" PRIu32 " -> %" PRIu32 " (received %" PRIu64
+             " bytes, backlog %" SC_PRIsizet " bytes, %u/%u frames skipped, "
+             "%u lost)", previous, estimator->bit_rate, stats.received_bytes,
+             stats.backlog, stats.skipped, stats.frames, stats.lost);
+        sc_bitrate_control_send(bc, estimator->bit_rate);
+    }
+}
+
+static int
+run_bitrate_control(void *data) {
+    struct sc_bitrate_control *bc = data;
+
+    sc_tick last = sc_tick_now();
+
+    sc_mutex_lock(&bc->mutex);
+    while (!bc->stopped) {
+        sc_tick deadline = last + SC_BITRATE_CONTROL_INTERVAL;
+        bool timed_out = false;
+        while (!bc->stopped && !timed_out) {
+            timed_out = !sc_cond_timedwait(&bc->cond, &bc->mutex, deadline);
+        }
+        if (bc->stopped) {
+            break;
+        }
+        sc_mutex_unlock(&bc->mutex);
+
+        sc_tick now = sc_tick_now();
+        sc_bitrate_control_tick(bc, now - last);
+        last = now;
+
+        sc_mutex_lock(&bc->mutex);
+    }
+    sc_mutex_unlock(&bc->mutex);
+
+    LOGD("Bit rate control stopped");
+
+    return 0;
+}
+
+bool
+sc_bitrate_control_start(struct sc_bitrate_control *bc) {
+    LOGD("Starting bit rate control thread");
+
+    bool ok = sc_thread_create(&bc->thread, run_bitrate_control,
+                               "scrcpy-bitrate", bc);
+    if (!ok) {
+        LOGE("Could not start bit rate control thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_bitrate_control_stop(struct sc_bitrate_control *bc) {
+    sc_mutex_lock(&bc->mutex);
+    bc->stopped = true;
+    sc_cond_signal(&bc->cond);
+    sc_mutex_unlock(&bc->mutex);
+}
+
+void
+sc_bitrate_control_join(struct sc_bitrate_control *bc) {
+    sc_thread_join(&bc->thread, NULL);
+}
+
+void
+sc_bitrate_control_add_packet(struct sc_bitrate_control *bc, size_t size) {
+    atomic_fetch_add_explicit(&bc->received_bytes, size, memory_order_relaxed);
+}
+
+void
+sc_bitrate_control_add_lost_frames(struct sc_bitrate_control *bc,
+                                   unsigned count) {
+    atomic_fetch_add_explicit(&bc->lost, count, memory_order_relaxed);
+}
+
+void
+sc_bitrate_control_add_frame(struct sc_bitrate_control *bc, bool skipped) {
+    atomic_fetch_add_explicit(&bc->frames, 1, memory_order_relaxed);
+    if (skipped) {
+        atomic_fetch_add_explicit(&bc->skipped, 1, memory_order_relaxed);
+    }
+}
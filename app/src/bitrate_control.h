@@ -0,0 +1,77 @@
+#ifndef SC_BITRATE_CONTROL_H
+#define SC_BITRATE_CONTROL_H
+
+#include "common.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitrate_estimator.h"
+#include "util/net.h"
+#include "util/thread.h"
+#include "util/tick.h"
+
+#define SC_BITRATE_CONTROL_INTERVAL SC_TICK_FROM_SEC(1)
+
+struct sc_controller;
+
+/**
+ * Closed-loop control of the video bit rate of the device encoder.
+ *
+ * Every second, it reads the telemetry reported by the demuxer and the screen
+ * (and the backlog of the video socket) and sends the new bit rate to the
+ * device over the control socket if it changed.
+ */
+struct sc_bitrate_control {
+    struct sc_controller *controller;
+    // Video socket, to measure the backlog (SC_SOCKET_NONE over UDP, the
+    // pending size of a datagram socket being the size of the next datagram)
+    sc_socket socket;
+
+    struct sc_bitrate_estimator estimator; // only accessed from the thread
+
+    // reported from the demuxer and screen threads
+    atomic_uint_least64_t received_bytes;
+    atomic_uint frames;
+    atomic_uint skipped;
+    atomic_uint lost;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped;
+};
+
+bool
+sc_bitrate_control_init(struct sc_bitrate_control *bc,
+                        struct sc_controller *controller, sc_socket socket,
+                        uint32_t min_bit_rate, uint32_t max_bit_rate);
+
+void
+sc_bitrate_control_destroy(struct sc_bitrate_control *bc);
+
+bool
+sc_bitrate_control_start(struct sc_bitrate_control *bc);
+
+void
+sc_bitrate_control_stop(struct sc_bitrate_control *bc);
+
+void
+sc_bitrate_control_join(struct sc_bitrate_control *bc);
+
+// Called from the demuxer thread for every video packet
+void
+sc_bitrate_control_add_packet(struct sc_bitrate_control *bc, size_t size);
+
+// Called from the demuxer thread when frames are lost (over UDP)
+void
+sc_bitrate_control_add_lost_frames(struct sc_bitrate_control *bc,
+                                   unsigned count);
+
+// Called from the screen for every video frame, skipped or not
+void
+sc_bitrate_control_add_frame(struct sc_bitrate_control *bc, bool skipped);
+
+#endif
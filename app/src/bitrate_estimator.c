@@ -0,0 +1,70 @@
+#include "bitrate_estimator.h"
+
+#include <assert.h>
+
+// The link is congested if the socket backlog exceeds this duration of video
+#define SC_BITRATE_CONTROL_MAX_BACKLOG_MS 100
+// The link is congested if more than this percentage of frames are skipped
+#define SC_BITRATE_CONTROL_MAX_SKIPPED_PERCENT 10
+// Number of intervals without congestion before increasing the bit rate
+#define SC_BITRATE_CONTROL_STABLE_INTERVALS 3
+
+void
+sc_bitrate_estimator_init(struct sc_bitrate_estimator *estimator,
+                          uint32_t min_bit_rate, uint32_t max_bit_rate) {
+    assert(min_bit_rate && min_bit_rate <= max_bit_rate);
+    estimator->min_bit_rate = min_bit_rate;
+    estimator->max_bit_rate = max_bit_rate;
+    // The device starts at the maximum bit rate
+    estimator->bit_rate = max_bit_rate;
+    estimator->stable = 0;
+}
+
+bool
+sc_bitrate_estimator_update(struct sc_bitrate_estimator *estimator,
+                            const struct sc_bitrate_stats *stats,
+                            sc_tick interval) {
+    uint32_t previous = estimator->bit_rate;
+
+    uint64_t max_backlog = (uint64_t) previous / 8
+                         * SC_BITRATE_CONTROL_MAX_BACKLOG_MS / 1000;
+    bool backlogged = stats->backlog > max_backlog;
+    bool skipping = stats->skipped * 100
+                  > stats->frames * SC_BITRATE_CONTROL_MAX_SKIPPED_PERCENT;
+
+    if (backlogged || skipping || stats->lost) {
+        estimator->stable = 0;
+
+        uint64_t base = previous;
+        if (backlogged && interval > 0) {
+            // The receive rate is the throughput actually available (the
+            // encoder may produce less than the target bit rate on static
+            // content, so it is only meaningful when the socket is backlogged)
+            uint64_t rate = stats->received_bytes * 8 * SC_TICK_FREQ
+                          / interval;
+            if (rate < base) {
+                base = rate;
+            }
+        }
+
+        uint64_t target = base * 3 / 4;
+        // Never drop by more than half at once (the measure may be noisy)
+        if (target < previous / 2) {
+            target = previous / 2;
+        }
+        if (target < estimator->min_bit_rate) {
+            target = estimator->min_bit_rate;
+        }
+        estimator->bit_rate = target;
+    } else if (++estimator->stable >= SC_BITRATE_CONTROL_STABLE_INTERVALS) {
+        estimator->stable = 0;
+
+        uint64_t target = (uint64_t) previous + estimator->max_bit_rate / 20;
+        if (target > estimator->max_bit_rate) {
+            target = estimator->max_bit_rate;
+        }
+        estimator->bit_rate = target;
+    }
+
+    return estimator->bit_rate != previous;
+}
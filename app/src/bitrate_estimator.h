@@ -0,0 +1,53 @@
+#ifndef SC_BITRATE_ESTIMATOR_H
+#define SC_BITRATE_ESTIMATOR_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/tick.h"
+
+// Telemetry collected over one interval
+struct sc_bitrate_stats {
+    uint64_t received_bytes; // video packets received by the demuxer
+    unsigned frames; // video frames received by the screen
+    unsigned skipped; // frames skipped by the screen (never rendered)
+    size_t backlog; // bytes received by the socket but not read yet
+    unsigned lost; // frames lost (over UDP)
+};
+
+/**
+ * Estimation of the video bit rate to request (pure logic, no thread)
+ *
+ * The link is considered congested if the socket backlog exceeds 100 ms of
+ * the current bit rate (the device sends faster than the network or the
+ * client can receive), if frames are lost (over UDP), or if more than 10% of
+ * the frames are skipped (the client cannot decode and render them in time).
+ * On congestion, the bit rate is decreased multiplicatively (from the measured
+ * receive rate, if lower). Otherwise, it is increased additively (by 5% of the
+ * maximum) every 3 stable intervals, until the maximum.
+ */
+struct sc_bitrate_estimator {
+    uint32_t min_bit_rate;
+    uint32_t max_bit_rate;
+    uint32_t bit_rate; // current
+    unsigned stable; // consecutive intervals without congestion
+};
+
+void
+sc_bitrate_estimator_init(struct sc_bitrate_estimator *estimator,
+                          uint32_t min_bit_rate, uint32_t max_bit_rate);
+
+/**
+ * Update the estimation from the stats of the last interval
+ *
+ * Return true if the bit rate changed.
+ */
+bool
+sc_bitrate_estimator_update(struct sc_bitrate_estimator *estimator,
+                            const struct sc_bitrate_stats *stats,
+                            sc_tick interval);
+
+#endif
@@ -0,0 +1,57 @@
+#include "capture_trigger.h"
+
+#include <stdatomic.h>
+#ifndef _WIN32
+# include <signal.h>
+# include <string.h>
+#endif
+
+#include "util/log.h"
+
+static atomic_uint sc_capture_trigger_requests;
+
+#ifndef _WIN32
+static void
+sc_capture_trigger_on_signal(int sig) {
+    (void) sig;
+    sc_capture_trigger_request();
+}
+#endif
+
+void
+sc_capture_trigger_install(void) {
+#ifndef _WIN32
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sc_capture_trigger_on_signal;
+    sigemptyset(&sa.sa_mask);
+    // Do not interrupt the blocking system calls of the other threads
+    sa.sa_flags = SA_RESTART;
+    if (sigaction(SIGUSR1, &sa, NULL)) {
+        LOGW("Could not handle SIGUSR1, only MOD+t triggers the capture");
+    }
+#endif
+}
+
+void
+sc_capture_trigger_request(void) {
+    atomic_fetch_add_explicit(&sc_capture_trigger_requests, 1,
+                              memory_order_relaxed);
+}
+
+unsigned
+sc_capture_trigger_count(void) {
+    return atomic_load_explicit(&sc_capture_trigger_requests,
+                                memory_order_relaxed);
+}
+
+bool
+sc_capture_trigger_poll(unsigned *seen) {
+    unsigned count = sc_capture_trigger_count();
+    if (count == *seen) {
+        return false;
+    }
+
+    *seen = count;
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef SC_CAPTURE_TRIGGER_H
+#define SC_CAPTURE_TRIGGER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+/**
+ * Requests to write the pre-trigger capture ring (--save-frames-pre-trigger)
+ *
+ * A trigger is requested by the shortcut MOD+t, or by another process sending
+ * SIGUSR1 (not on Windows), e.g. `pkill -USR1 scrcpy` from an event detector.
+ *
+ * The requests are counted globally: each video processor polls the counter
+ * from its own thread (so that all the devices are triggered at once).
+ */
+
+/**
+ * Handle SIGUSR1 as a trigger request (does nothing on Windows)
+ */
+void
+sc_capture_trigger_install(void);
+
+/**
+ * Request a trigger (async-signal-safe)
+ */
+void
+sc_capture_trigger_request(void);
+
+/**
+ * Return the number of requests so far, to initialize the `seen` counter of
+ * sc_capture_trigger_poll()
+ */
+unsigned
+sc_capture_trigger_count(void);
+
+/**
+ * Indicate if a trigger has been requested since the previous call with the
+ * same `seen` counter (several requests meanwhile are merged)
+ */
+bool
+sc_capture_trigger_poll(unsigned *seen);
+
+#endif
@@ -1,13 +1,18 @@
 #include "cli.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <getopt.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "file_pusher.h"
+#include "frame_pyramid.h"
+#include "latency_probe.h"
 #include "options.h"
+#include "uploader.h"
 #include "util/log.h"
 #include "util/net.h"
 #include "util/str.h"
@@ -21,6 +26,7 @@ enum {
     OPT_BIT_RATE = 1000,
     OPT_WINDOW_TITLE,
     OPT_PUSH_TARGET,
+    OPT_PUSH_WORKERS,
     OPT_ALWAYS_ON_TOP,
     OPT_CROP,
     OPT_RECORD_FORMAT,
@@ -73,6 +79,8 @@ enum {
     OPT_REQUIRE_AUDIO,
     OPT_AUDIO_BUFFER,
     OPT_AUDIO_OUTPUT_BUFFER,
+    OPT_AUDIO_READ_SIZE,
+    OPT_AUDIO_LATENCY,
     OPT_NO_DISPLAY,
     OPT_NO_VIDEO,
     OPT_NO_AUDIO_PLAYBACK,
@@ -90,6 +98,7 @@ enum {
     OPT_CAMERA_AR,
     OPT_CAMERA_FPS,
     OPT_CAMERA_HIGH_SPEED,
+    OPT_CAPTURE_EXPOSURE,
     OPT_DISPLAY_ORIENTATION,
     OPT_RECORD_ORIENTATION,
     OPT_ORIENTATION,
@@ -106,9 +115,106 @@ enum {
     OPT_SAVE_FRAMES,
     OPT_FRAME_DIR,
     OPT_OPENCV_MAP,
+    OPT_OPENCV_CALIB,
     OPT_PIPE_OUTPUT,
+    OPT_PIPE_TARGET,
     OPT_ADB_PATH,
     OPT_SHOW_TIMESTAMPS,
+    OPT_SAVE_FRAMES_THREADS,
+    OPT_SAVE_FRAMES_FORMAT,
+    OPT_OUTPUT_PLANES,
+    OPT_SAVE_FRAMES_FPS,
+    OPT_PIPE_OUTPUT_FPS,
+    OPT_PIPE_FORMAT,
+    OPT_PIPE_PAYLOAD_CRC,
+    OPT_PUBLISH,
+    OPT_PUBLISH_QUEUE,
+    OPT_PUBLISH_DROP,
+    OPT_SAVE_FRAMES_ARCHIVE,
+    OPT_SHM_OUTPUT,
+    OPT_GPU_REMAP,
+    OPT_OPENCV_BACKEND,
+    OPT_PREVIEW_DOWNSCALE,
+    OPT_HW_DECODER,
+    OPT_DECODER_THREADS,
+    OPT_DECODER_MODE,
+    OPT_DIRECT_TCP_PORT,
+    OPT_VIDEO_TRANSPORT,
+    OPT_VIDEO_FEC,
+    OPT_ADAPTIVE_BIT_RATE,
+    OPT_MULTI_DEVICE,
+    OPT_MULTI_DEVICE_SYNC,
+    OPT_RECORD_RECTIFIED,
+    OPT_RECORD_TIMESTAMPS,
+    OPT_RECORD_SEGMENT,
+    OPT_RECORD_FRAGMENTED,
+    OPT_V4L2_SINK_LEFT,
+    OPT_V4L2_SINK_RIGHT,
+    OPT_PIPE_DEPTH,
+    OPT_PIPE_AUDIO,
+    OPT_PRINT_ENCODER_LATENCY,
+    OPT_PRINT_LATENCY,
+    OPT_LATENCY_TRACE,
+    OPT_DUMP_STREAM,
+    OPT_REPLAY,
+    OPT_REPLAY_MAX_SPEED,
+    OPT_METRICS,
+    OPT_PREPROCESS_THREADS,
+    OPT_PREPROCESS_CPUS,
+    OPT_THREAD_AFFINITY,
+    OPT_REALTIME_THREADS,
+    OPT_LATENCY_BUDGET,
+    OPT_DEVICE_REMAP,
+    OPT_DEVICE_REMAP_CROP,
+    OPT_SPLIT_EYES,
+    OPT_LATENCY_PROFILE,
+    OPT_ENCODER_ASYNC,
+    OPT_REPEAT_FRAME_DELAY,
+    OPT_SKIP_REPEATED_FRAMES,
+    OPT_SERVER_DAEMON,
+    OPT_MOUSE_MOTION_RATE,
+    OPT_POSE_RATE,
+    OPT_NO_PBO_UPLOAD,
+    OPT_RENDER_THREAD,
+    OPT_ASYNC_SINKS,
+    OPT_STEREO_VIEW,
+    OPT_RECONNECT_TIMEOUT,
+    OPT_LATENCY_PROBE,
+    OPT_SERVER_ADDRESS,
+    OPT_CUDA_IPC_OUTPUT,
+    OPT_PIPE_BUFFER_SIZE,
+    OPT_SAVE_FRAMES_IO,
+    OPT_SAVE_FRAMES_DIRECT,
+    OPT_SAVE_FRAMES_PRE_TRIGGER,
+    OPT_SAVE_FRAMES_POST_TRIGGER,
+    OPT_MOTION_THRESHOLD,
+    OPT_OUTPUT_PYRAMID,
+    OPT_SAVE_FRAMES_QUALITY,
+    OPT_SAVE_FRAMES_ZSTD,
+    OPT_SAVE_FRAMES_ZSTD_DICT,
+    OPT_UPLOAD_DIR,
+    OPT_UPLOAD_THREADS,
+    OPT_UPLOAD_MAX_RATE,
+    OPT_UPLOAD_DELETE,
+    OPT_PROBE_ENCODERS,
+    OPT_VIDEO_PRESETS,
+    OPT_VIDEO_SEND_BUFFER,
+    OPT_CATCH_UP,
+    OPT_HUD,
+    OPT_HUGE_PAGES,
+    OPT_NUMA,
+    OPT_MEMORY_BUDGET,
+    OPT_CAMERA_RECORD,
+    OPT_TIMESTAMP_SEI,
+    OPT_AGGREGATOR,
+    OPT_AGGREGATOR_NODE,
+    OPT_PIPE_FEEDBACK,
+    OPT_PIPE_BACKPRESSURE,
+    OPT_AUTO_TUNE,
+    OPT_GPU_READBACK,
+    OPT_LOW_LATENCY_PRESENT,
+    OPT_SAVE_FRAMES_TILE_DELTA,
+    OPT_SAVE_FRAMES_KEY_INTERVAL,
 };
 
 struct sc_option {
@@ -214,6 +320,19 @@ static const struct sc_option options[] = {
                 "The \"mic\" source captures the microphone.\n"
                 "Default is output.",
     },
+    {
+        .longopt_id = OPT_AUDIO_LATENCY,
+        .longopt = "audio-latency",
+        .argdesc = "value",
+        .text = "Select the audio latency mode: default or low.\n"
+                "With low, the device audio encoder runs with a realtime "
+                "priority (raw audio is captured by blocks of 10 ms), the "
+                "audio buffer defaults to 30 ms (20 ms for raw) and the audio "
+                "output buffer to 3 ms, and the clock drift is compensated "
+                "more reactively. If the control is enabled, the end-to-end "
+                "audio latency is measured.\n"
+                "Default is default.",
+    },
     {
         .longopt_id = OPT_AUDIO_OUTPUT_BUFFER,
         .longopt = "audio-output-buffer",
@@ -222,7 +341,19 @@ static const struct sc_option options[] = {
                 "milliseconds).\n"
                 "If you get \"robotic\" audio playback, you should test with "
                 "a higher value (10). Do not change this setting otherwise.\n"
-                "Default is 5.",
+                "Default is 5 (3 with --audio-latency=low).",
+    },
+    {
+        .longopt_id = OPT_AUDIO_READ_SIZE,
+        .longopt = "audio-read-size",
+        .argdesc = "samples",
+        .text = "Set the number of samples (per channel) read at once from "
+                "the audio capture on the device, rounded up to a multiple of "
+                "the encoder frame size (960 for opus, 1024 for aac).\n"
+                "Larger reads decrease the CPU usage of the device, but "
+                "increase the audio latency.\n"
+                "Default is 0 (one encoder frame, or 1024 samples for flac "
+                "and raw).",
     },
     {
         .shortopt = 'b',
@@ -269,6 +400,18 @@ static const struct sc_option options[] = {
                 "This mode is restricted to specific resolutions and frame "
                 "rates, listed by --list-camera-sizes.",
     },
+    {
+        .longopt_id = OPT_CAPTURE_EXPOSURE,
+        .longopt = "capture-exposure",
+        .text = "Send the exposure time and the rolling shutter readout "
+                "time of each camera frame, to timestamp the frames at "
+                "mid-exposure (and each row at its own exposure) rather "
+                "than at the start of exposure.\n"
+                "The values are written to the v2 frame headers of "
+                "--pipe-output and --shm-output.\n"
+                "It requires --video-source=camera and a frame output, and "
+                "is not supported with --video-transport=udp.",
+    },
     {
         .longopt_id = OPT_CAMERA_SIZE,
         .longopt = "camera-size",
@@ -469,6 +612,19 @@ static const struct sc_option options[] = {
         .longopt = "list-encoders",
         .text = "List video and audio encoders available on the device.",
     },
+    {
+        .longopt_id = OPT_PROBE_ENCODERS,
+        .longopt = "probe-encoders",
+        .text = "Run a short synthetic encode benchmark of each video encoder "
+                "of the device, at 1280x720, 1920x1080 and 2560x1440 (or at "
+                "16:9 within --max-size if set), with the --video-bit-rate, "
+                "--latency-profile and --video-codec-options, and report the "
+                "achieved frame rate, the encode latency and the bit rate "
+                "accuracy.\n"
+                "The results are saved on the device: the next sessions "
+                "without --video-encoder use the fastest encoder of their "
+                "codec.",
+    },
     {
         .longopt_id = OPT_LOCK_VIDEO_ORIENTATION,
         .longopt = "lock-video-orientation",
@@ -714,6 +870,14 @@ static const struct sc_option options[] = {
                 "drag & drop. It is passed as is to \"adb push\".\n"
                 "Default is \"/sdcard/Download/\".",
     },
+    {
+        .longopt_id = OPT_PUSH_WORKERS,
+        .longopt = "push-workers",
+        .argdesc = "value",
+        .text = "Set the number of files pushed or installed concurrently "
+                "(dropped on the window), between 1 and 8.\n"
+                "Default is 2.",
+    },
     {
         .shortopt = 'r',
         .longopt = "record",
@@ -877,7 +1041,11 @@ static const struct sc_option options[] = {
         .longopt_id = OPT_VIDEO_CODEC,
         .longopt = "video-codec",
         .argdesc = "name",
-        .text = "Select a video codec (h264, h265 or av1).\n"
+        .text = "Select a video codec (h264, h265, av1 or auto).\n"
+                "With 'auto', the client benchmarks its decoders at startup "
+                "(at the size of --max-size), and the device uses the most "
+                "efficient codec it can encode among those the client decodes "
+                "fast enough, H.264 otherwise.\n"
                 "Default is h264.",
     },
     {
@@ -900,6 +1068,98 @@ static const struct sc_option options[] = {
                 "codec provided by --video-codec).\n"
                 "The available encoders can be listed by --list-encoders.",
     },
+    {
+        .longopt_id = OPT_VIDEO_PRESETS,
+        .longopt = "video-presets",
+        .argdesc = "list",
+        .text = "Define capture sizes and frame rates to switch to during the "
+                "session, without restarting it (MOD+j for the next one, "
+                "MOD+Shift+j for the previous one).\n"
+                "The presets are separated by commas, each one is "
+                "<max-size>:<max-fps> (0 for unlimited), for example: "
+                "1920:72,1440:90,1024:120.\n"
+                "The initial configuration is set by --max-size and "
+                "--max-fps.\n"
+                "With --device-remap, only the frame rate is changed.",
+    },
+    {
+        .longopt_id = OPT_LATENCY_PROFILE,
+        .longopt = "latency-profile",
+        .argdesc = "value",
+        .text = "Select the latency profile of the video encoder and decoder: "
+                "default or ultra-low.\n"
+                "With ultra-low, the device encoder runs with a realtime "
+                "priority, in low latency mode, without B-frames, and "
+                "refreshes the picture progressively (intra refresh) instead "
+                "of sending periodic key frames, if supported. The client "
+                "decoder enables the fast (not spec compliant) decoding "
+                "shortcuts. The options set by --video-codec-options take "
+                "precedence.\n"
+                "Default is default.",
+    },
+    {
+        .longopt_id = OPT_ENCODER_ASYNC,
+        .longopt = "encoder-async",
+        .text = "Receive the output of the device video encoder through the "
+                "MediaCodec asynchronous callbacks, and write it to the socket "
+                "directly from the encoder buffers, through a bounded queue. "
+                "When the queue is full (the link does not keep up), the "
+                "non-reference frames are dropped, so that the encoder is "
+                "never blocked (Android 6+).",
+    },
+    {
+        .longopt_id = OPT_REPEAT_FRAME_DELAY,
+        .longopt = "repeat-frame-delay",
+        .argdesc = "ms",
+        .text = "Set the delay after which the device encoder repeats the "
+                "previous frame when the captured content does not change "
+                "(to refine its quality), or 0 to never repeat it.\n"
+                "The repeated frames are flagged in the frame meta (see "
+                "--skip-repeated-frames).\n"
+                "Default is 100.",
+    },
+    {
+        .longopt_id = OPT_SKIP_REPEATED_FRAMES,
+        .longopt = "skip-repeated-frames",
+        .text = "Do not process, save, pipe or publish the frames repeated "
+                "by the device encoder (flagged in the frame meta): only "
+                "their record is written to the pipe and to the frame archive "
+                "index, as for the dropped frames.",
+    },
+    {
+        .longopt_id = OPT_MOUSE_MOTION_RATE,
+        .longopt = "mouse-motion-rate",
+        .argdesc = "hz",
+        .text = "Merge the mouse motion events so that at most this number of "
+                "motion events per second are sent to the device (typically "
+                "the device display refresh rate). The first motion after a "
+                "pause is sent immediately, and the pending motion is always "
+                "sent before any other input event.\n"
+                "Default is 0 (every motion event is sent).",
+    },
+    {
+        .longopt_id = OPT_POSE_RATE,
+        .longopt = "pose-rate",
+        .argdesc = "hz",
+        .text = "Sample the headset pose (orientation, and position if the "
+                "device exposes a 6DoF pose sensor) at this rate on the "
+                "device, and write the samples, timestamped on the same clock "
+                "as the frames, to the pipe (--pipe-output) and to the frame "
+                "archive (--save-frames-archive). Requires the device "
+                "control.\n"
+                "Default is 0 (disabled).",
+    },
+    {
+        .longopt_id = OPT_SERVER_DAEMON,
+        .longopt = "server-daemon",
+        .text = "Keep the server running on the device after the session, and "
+                "start the next sessions on it: the server is pushed and "
+                "started only if it is not running yet, or if it is another "
+                "server version.\n"
+                "The device settings changed on start are never restored "
+                "(implies --no-cleanup), and the server logs are only "
+                "available in logcat.",
+    },
     {
         .longopt_id = OPT_VIDEO_SOURCE,
         .longopt = "video-source",
@@ -975,22 +1235,974 @@ static const struct sc_option options[] = {
         .argdesc = "path",
         .text = "Path to the NPZ file containing stereo rectification maps",
     },
+    {
+        .longopt_id = OPT_OPENCV_CALIB,
+        .longopt = "opencv-calib",
+        .argdesc = "path",
+        .text = "Path to the YAML (or XML) file containing the stereo "
+                "fisheye calibration (image_width, image_height, K1, D1, K2, "
+                "D2, R and T), to compute the stereo rectification maps at "
+                "startup instead of loading them (--opencv-map).\n"
+                "The maps are computed for the video size, whatever the "
+                "calibration resolution (with the same aspect ratio).",
+    },
+    {
+        .longopt_id = OPT_GPU_REMAP,
+        .longopt = "gpu-remap",
+        .text = "Apply the stereo rectification maps (--opencv-map) on the "
+                "GPU, with an OpenGL shader, while rendering.\n"
+                "The frames are still remapped on the CPU if they are also "
+                "saved, piped or published in shared memory (unless "
+                "--gpu-readback), or if the OpenGL renderer does not support "
+                "it.",
+    },
+    {
+        .longopt_id = OPT_GPU_READBACK,
+        .longopt = "gpu-readback",
+        .text = "Apply the stereo rectification maps (--opencv-map) on the "
+                "GPU to the saved, piped and published frames: they are "
+                "remapped in a separate OpenGL context, and read back "
+                "asynchronously (a few frames are in flight), so that the "
+                "CPU never runs the remap.\n"
+                "The displayed frames are remapped while rendering, as with "
+                "--gpu-remap (if the renderer does not support it, all the "
+                "frames are remapped on the CPU).\n"
+                "It is ignored if the rectified frames are also needed by "
+                "--record-rectified, --v4l2-sink, --pipe-depth or "
+                "--pipe-features, or if OpenGL 3.2 is not available.",
+    },
+    {
+        .longopt_id = OPT_NO_PBO_UPLOAD,
+        .longopt = "no-pbo-upload",
+        .text = "If the renderer is OpenGL 4.4+, the frames are copied into "
+                "persistently mapped pixel buffer objects, and the texture "
+                "is updated asynchronously from them. This option disables "
+                "these pixel buffer uploads (the frames are uploaded by "
+                "SDL).",
+    },
+    {
+        .longopt_id = OPT_RENDER_THREAD,
+        .longopt = "render-thread",
+        .text = "Upload and render the frames from a dedicated thread, which "
+                "presents them with vsync, instead of the main thread (which "
+                "then only handles the events).\n"
+                "Not supported on macOS.",
+    },
+    {
+        .longopt_id = OPT_LOW_LATENCY_PRESENT,
+        .longopt = "low-latency-present",
+        .text = "Synchronize the CPU with the GPU after each present, so "
+                "that the driver never queues frames rendered ahead (each "
+                "one adds a refresh period of latency): with an OpenGL "
+                "renderer, a fence is waited for after each present; with "
+                "the direct3d11 renderer (a DXGI flip-model swap chain), the "
+                "maximum frame latency is set to 1.\n"
+                "On Windows, the direct3d11 renderer is selected, unless "
+                "--render-driver, --gpu-remap or --gpu-readback is set.\n"
+                "The present latency is reported by --print-latency, "
+                "--latency-trace and --hud.",
+    },
+    {
+        .longopt_id = OPT_ASYNC_SINKS,
+        .longopt = "async-sinks",
+        .text = "Push the received packets (to the decoders, the recorder "
+                "and the packet pipe) and the decoded frames (to the screen, "
+                "V4L2 devices, processing, audio playback...) to each of "
+                "their consumers from a dedicated thread, so that a slow "
+                "consumer never delays the socket reads, the decoding nor "
+                "the other consumers.\n"
+                "The screen and the V4L2 devices only receive the last "
+                "frame (the frames they are too slow to consume are "
+                "dropped). If the disk or the pipe is too slow, the recorder "
+                "and the packet pipe drop the packets until the next key "
+                "frame. The other consumers receive everything.",
+    },
+    {
+        .longopt_id = OPT_STEREO_VIEW,
+        .longopt = "stereo-view",
+        .argdesc = "value",
+        .text = "Select how the stereo frames (both eyes side by side) are "
+                "displayed: side-by-side, left, right, top-bottom or "
+                "anaglyph (red-cyan).\n"
+                "The layout is applied while rendering, it does not change "
+                "the frames which are recorded, saved or piped. It can be "
+                "switched with MOD+e (and MOD+Shift+e).\n"
+                "Default is side-by-side.",
+    },
+    {
+        .longopt_id = OPT_DEVICE_REMAP,
+        .longopt = "device-remap",
+        .text = "Apply the stereo rectification maps (--opencv-map) on the "
+                "device, with an OpenGL ES shader, before encoding.\n"
+                "The client receives the rectified frames and never remaps "
+                "them. The maps must match the captured video size.",
+    },
+    {
+        .longopt_id = OPT_DEVICE_REMAP_CROP,
+        .longopt = "device-remap-crop",
+        .text = "With --device-remap, encode only the valid region of the "
+                "rectified eyes (the same region in both eyes), without the "
+                "black borders.",
+    },
+    {
+        .longopt_id = OPT_SPLIT_EYES,
+        .longopt = "split-eyes",
+        .text = "Encode the left and right halves of the frames (the eyes) "
+                "separately on the device, on two encoder instances, and "
+                "stream them on two sockets. The client decodes them on two "
+                "threads in parallel, and merges them side by side.\n"
+                "The video bit rate is shared equally between the eyes.",
+    },
+    {
+        .longopt_id = OPT_CAMERA_RECORD,
+        .longopt = "camera-record",
+        .argdesc = "file.mp4",
+        .text = "Also capture the camera, in the same session as the "
+                "display, and record it to a file (its format is determined "
+                "from its extension).\n"
+                "The camera is encoded by its own encoder instance and "
+                "streamed on its own socket, with the --camera-* options. "
+                "With --record-timestamps, the capture time of its frames is "
+                "indexed by the same clock as the display recording.",
+    },
+    {
+        .longopt_id = OPT_OPENCV_BACKEND,
+        .longopt = "opencv-backend",
+        .argdesc = "value",
+        .text = "Select the device running the OpenCV remap: cpu, opencl "
+                "(OpenCV transparent API) or cuda (requires an OpenCV build "
+                "with CUDA support).\n"
+                "The maps stay resident on the device, and each frame is "
+                "uploaded and downloaded once.\n"
+                "Default is cpu.",
+    },
+    {
+        .longopt_id = OPT_PREPROCESS_THREADS,
+        .longopt = "preprocess-threads",
+        .argdesc = "value",
+        .text = "Number of threads running the OpenCV effects (between 0 and "
+                "64, 0 meaning one thread per CPU core), to leave some cores "
+                "to the decoder and the rendering.\n"
+                "Default is 0.",
+    },
+    {
+        .longopt_id = OPT_PREPROCESS_CPUS,
+        .longopt = "preprocess-cpus",
+        .argdesc = "list",
+        .text = "Pin the video processing threads (and the OpenCV threads "
+                "they start) to a list of CPU cores, for example \"2-7\" "
+                "or \"0,2,4,6\" (Linux and Windows).",
+    },
+    {
+        .longopt_id = OPT_THREAD_AFFINITY,
+        .longopt = "thread-affinity",
+        .argdesc = "name:list",
+        .text = "Pin the threads of a given name (without the \"scrcpy-\" "
+                "prefix, for example \"demuxer\", \"vproc\", \"fwriter\" "
+                "or \"render\") to a list of CPU cores, for example "
+                "\"demuxer:0-1\" (Linux and Windows).\n"
+                "This option may be repeated for several threads.",
+    },
+    {
+        .longopt_id = OPT_REALTIME_THREADS,
+        .longopt = "realtime-threads",
+        .argdesc = "names",
+        .text = "Run the threads of the given names (separated by commas, "
+                "without the \"scrcpy-\" prefix, for example "
+                "\"demuxer,vproc,render\") with a real-time scheduling "
+                "class: SCHED_FIFO on Linux (which requires CAP_SYS_NICE or "
+                "an rtprio limit), MMCSS on Windows, or the highest thread "
+                "priority otherwise.",
+    },
+    {
+        .longopt_id = OPT_HUGE_PAGES,
+        .longopt = "huge-pages",
+        .text = "Allocate the frame and packet pool buffers in pages locked in "
+                "memory, using huge pages (2 MB) for the buffers of at least "
+                "1 MB, to avoid the page faults and TLB misses in the frame "
+                "processing loops.\n"
+                "On Linux, the huge pages must be reserved (sysctl "
+                "vm.nr_hugepages) and the locked memory limit raised (ulimit "
+                "-l). On Windows, the SeLockMemoryPrivilege is required. "
+                "Otherwise, regular pages are used (a warning is logged).",
+    },
+    {
+        .longopt_id = OPT_MEMORY_BUDGET,
+        .longopt = "memory-budget",
+        .argdesc = "MiB",
+        .text = "Bound the memory held by the queues of the pipeline (the "
+                "display buffer, the frame publisher, the recorder and "
+                "packet pipe queues, and the saved frames queue and "
+                "pre-trigger ring), in MiB, for all of them.\n"
+                "As the total grows, the lower priority queues are refused "
+                "first: the preview beyond 50% of the budget, the published "
+                "frames beyond 70%, the recorded packets beyond 85%, and the "
+                "saved frames last.\n"
+                "Default is 0 (each queue is only bounded by its own limit).",
+    },
+    {
+        .longopt_id = OPT_PREVIEW_DOWNSCALE,
+        .longopt = "preview-downscale",
+        .argdesc = "factor",
+        .text = "Divide the resolution of the displayed frames by the given "
+                "factor (between 1 and 8).\n"
+                "With --opencv-map, the frames are remapped directly to the "
+                "preview resolution, from dedicated maps. The frames saved, "
+                "piped or published in shared memory keep the full "
+                "resolution.\n"
+                "Default is 1 (disabled).",
+    },
+    {
+        .longopt_id = OPT_LATENCY_BUDGET,
+        .longopt = "latency-budget",
+        .argdesc = "ms",
+        .text = "Do not display the frames older than the given delay (since "
+                "the reception of their packet) when their processing "
+                "starts, so that the preview never lags behind the device.\n"
+                "The frames saved, piped or published in shared memory are "
+                "not affected.\n"
+                "Default is 0 (disabled).",
+    },
+    {
+        .longopt_id = OPT_CATCH_UP,
+        .longopt = "catch-up",
+        .argdesc = "ms",
+        .text = "Catch up with the live stream when the video packets are "
+                "received more than the given delay late (for example after "
+                "a network stall), instead of decoding the whole backlog: "
+                "the packets are skipped until a key frame received in time, "
+                "and a key frame is requested (if control is enabled).\n"
+                "The lag is measured relative to the smallest transit time "
+                "of the packets observed recently. The recording receives "
+                "all the packets, but the skipped frames are neither "
+                "displayed, nor saved, piped or published.\n"
+                "Default is 0 (disabled).",
+    },
+    {
+        .longopt_id = OPT_HW_DECODER,
+        .longopt = "hw-decoder",
+        .argdesc = "value",
+        .text = "Decode the video with the GPU: none, auto, d3d11va, vaapi, "
+                "videotoolbox or cuda.\n"
+                "The decoded frames are downloaded once to the system memory "
+                "(for rendering and processing). If the hardware decoder is "
+                "not available, the video is decoded in software.\n"
+                "Default is none.",
+    },
+    {
+        .longopt_id = OPT_DECODER_THREADS,
+        .longopt = "decoder-threads",
+        .argdesc = "value",
+        .text = "Number of threads decoding the video (between 0 and 16, 0 "
+                "meaning one thread per CPU core).\n"
+                "Default is 1.",
+    },
+    {
+        .longopt_id = OPT_DECODER_MODE,
+        .longopt = "decoder-mode",
+        .argdesc = "value",
+        .text = "Select how the decoder threads share the work: low-latency "
+                "(each frame is split into slices decoded in parallel, "
+                "without delay, only effective if the encoder produces "
+                "several slices) or throughput (several frames are decoded in "
+                "parallel, each thread adding one frame of latency).\n"
+                "Default is low-latency.",
+    },
+    {
+        .longopt_id = OPT_DIRECT_TCP_PORT,
+        .longopt = "direct-tcp-port",
+        .argdesc = "port",
+        .text = "Make the server listen on this TCP port of the device, and "
+                "connect the video, audio and control sockets directly to the "
+                "device IP address instead of through an adb tunnel (adb is "
+                "still used to start the server and to exchange a session "
+                "token). The device must be reachable from the computer (for "
+                "example on the same Wi-Fi network).\n"
+                "Default is 0 (disabled).",
+    },
+    {
+        .longopt_id = OPT_RECONNECT_TIMEOUT,
+        .longopt = "reconnect-timeout",
+        .argdesc = "ms",
+        .text = "With --direct-tcp-port, resume the video stream if its "
+                "connection is lost (for example on a transient Wi-Fi drop), "
+                "instead of ending the session: the client reconnects to the "
+                "server still running on the device, and the stream resumes "
+                "on the next key frame (the gap is recorded in the frame "
+                "index). The session ends if the connection is not resumed "
+                "within this delay (in milliseconds, up to 60000). The device "
+                "also considers the connection lost if the video cannot be "
+                "sent for this delay.\n"
+                "Only the (TCP) video stream is resumed: if the audio "
+                "connection is lost, the session continues without audio.\n"
+                "Default is 0 (disabled).",
+    },
+    {
+        .longopt_id = OPT_SERVER_ADDRESS,
+        .longopt = "server-address",
+        .argdesc = "ip:port",
+        .text = "Connect to a server already running at this address (for "
+                "example the load generator scrcpy-loadgen), without adb: no "
+                "device is selected, and no server is started. The server "
+                "streams the video on a single connection, so the audio and "
+                "the control must be disabled (--no-audio --no-control).\n"
+                "The device clock cannot be synchronized: the frame "
+                "timestamps are unknown.",
+    },
+    {
+        .longopt_id = OPT_AGGREGATOR,
+        .longopt = "aggregator",
+        .argdesc = "ip:port",
+        .text = "Forward the encoded video (and camera) packets, the audio "
+                "packets and the pose samples (--pose-rate), with their "
+                "capture timestamps, to a central aggregator (for example "
+                "scrcpy-aggregator) over a single TCP connection, in addition "
+                "to the local outputs.\n"
+                "The aggregator acknowledges the received data: if it (or the "
+                "network) is too slow, the data are dropped (the video packets "
+                "until the next key frame), the local outputs are never "
+                "blocked.",
+    },
+    {
+        .longopt_id = OPT_AGGREGATOR_NODE,
+        .longopt = "aggregator-node",
+        .argdesc = "name",
+        .text = "Name identifying this capture node on the aggregator (at most "
+                "32 characters).\n"
+                "Default is the device serial.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_TRANSPORT,
+        .longopt = "video-transport",
+        .argdesc = "value",
+        .text = "Select how the video packets are received: tcp (on the video "
+                "socket) or udp (split into RTP datagrams, requires "
+                "--direct-tcp-port). Over UDP, a lost datagram never stalls "
+                "the stream: the frames which cannot be recovered are "
+                "dropped, and a key frame is requested (if control is "
+                "enabled).\n"
+                "Default is tcp.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_FEC,
+        .longopt = "video-fec",
+        .argdesc = "value",
+        .text = "With --video-transport=udp, send a parity datagram for "
+                "every group of this number of datagrams (between 0 and 255), "
+                "so that one lost datagram per group can be recovered.\n"
+                "Default is 0 (disabled).",
+    },
+    {
+        .longopt_id = OPT_VIDEO_SEND_BUFFER,
+        .longopt = "video-send-buffer",
+        .argdesc = "size",
+        .text = "Bound the bytes queued in the device video socket to this "
+                "size (in bytes, between 4K and 16M, the suffixes K and M are "
+                "accepted), instead of letting the kernel buffer up to "
+                "several seconds of video when the link slows down. Over a "
+                "direct TCP connection, TCP_NOTSENT_LOWAT is also set to half "
+                "this size.\n"
+                "While the socket is not writable, the frames not referenced "
+                "by other frames are skipped instead of being queued (the "
+                "stream is not corrupted). Combine with --adaptive-bit-rate "
+                "to also lower the bit rate.\n"
+                "Default is 0 (the system default).",
+    },
+    {
+        .longopt_id = OPT_ADAPTIVE_BIT_RATE,
+        .longopt = "adaptive-bit-rate",
+        .text = "Adapt the video bit rate continuously to the throughput of "
+                "the link, between 1/8 of --video-bit-rate and "
+                "--video-bit-rate (decreased when the video socket is "
+                "backlogged, frames are lost or skipped, and increased "
+                "progressively otherwise). Requires control.",
+    },
+    {
+        .longopt_id = OPT_MULTI_DEVICE,
+        .longopt = "multi-device",
+        .argdesc = "serial1,serial2,...",
+        .text = "Capture the video of several devices (at most 8) in "
+                "parallel, in a single process, and multiplex their frames "
+                "on stdout. Each frame is preceded by a device tag (see "
+                "frame_header.h) containing the index of its device in the "
+                "list.\n"
+                "There is no window, no control and no audio in this mode. "
+                "Requires --pipe-output.",
+    },
+    {
+        .longopt_id = OPT_MULTI_DEVICE_SYNC,
+        .longopt = "multi-device-sync",
+        .argdesc = "ms",
+        .text = "With --multi-device, group the frames of all the devices by "
+                "capture time: the frames are piped as tuples (one frame per "
+                "device, in the --multi-device order) captured within this "
+                "tolerance, and the frames which cannot be matched are "
+                "dropped.\n"
+                "Default is 0 (disabled).",
+    },
+    {
+        .longopt_id = OPT_NUMA,
+        .longopt = "numa",
+        .text = "With --multi-device, on a NUMA system, bind the pipeline of "
+                "each device (demuxer, decoder and video processing threads) "
+                "to a NUMA node, assigned in round-robin in the "
+                "--multi-device order, so that its threads run on the "
+                "processors of the node and its frame and packet pools are "
+                "allocated in the memory of the node.\n"
+                "On close, the share of the frames found off their node is "
+                "reported for each device.",
+    },
+    {
+        .longopt_id = OPT_RECORD_RECTIFIED,
+        .longopt = "record-rectified",
+        .text = "With --record, record the processed frames (rectified, with "
+                "the timestamps if --show-timestamps is set) instead of the "
+                "stream of the device. The frames are re-encoded in H.264 "
+                "(with a hardware encoder if available) at the "
+                "--video-bit-rate.\n"
+                "Requires video playback.",
+    },
+    {
+        .longopt_id = OPT_RECORD_TIMESTAMPS,
+        .longopt = "record-timestamps",
+        .text = "With --record, also write the capture time (in milliseconds "
+                "since the Unix epoch) of every recorded video frame to a "
+                "timestamp index \"<file>.ts.idx\" (see frame_header.h), "
+                "indexed by the position of the frame in the recording.",
+    },
+    {
+        .longopt_id = OPT_TIMESTAMP_SEI,
+        .longopt = "timestamp-sei",
+        .text = "Embed the capture timestamp and a sequence number of each "
+                "video frame in the H.264 or H.265 bitstream, as a \"user "
+                "data unregistered\" SEI NAL unit, instead of the packet "
+                "headers.\n"
+                "The timestamps are then kept in the recordings, the raw "
+                "streams and the packets of --pipe-output=packets, for any "
+                "tool reading the bitstream (see app/src/timestamp_sei.h).\n"
+                "It requires --video-codec=h264 or --video-codec=h265.",
+    },
+    {
+        .longopt_id = OPT_RECORD_SEGMENT,
+        .longopt = "record-segment",
+        .argdesc = "seconds",
+        .text = "Split the recording into files of (at least) this duration, "
+                "each one starting on a video key frame, named "
+                "\"<file>-000.<ext>\", \"<file>-001.<ext>\", etc.\n"
+                "Default is 0 (disabled).",
+    },
+    {
+        .longopt_id = OPT_RECORD_FRAGMENTED,
+        .longopt = "record-fragmented",
+        .text = "Record fragmented MP4 (a fragment per video key frame), so "
+                "that the file remains playable if the recording is "
+                "interrupted.",
+    },
+    {
+        .longopt_id = OPT_V4L2_SINK_LEFT,
+        .longopt = "v4l2-sink-left",
+        .argdesc = "/dev/videoN",
+        .text = "Output the left half of the rectified frames (left eye) to "
+                "a v4l2loopback device.\n"
+                "It requires --opencv and --opencv-map.\n"
+                "This feature is only available on Linux.",
+    },
+    {
+        .longopt_id = OPT_V4L2_SINK_RIGHT,
+        .longopt = "v4l2-sink-right",
+        .argdesc = "/dev/videoN",
+        .text = "Output the right half of the rectified frames (right eye) to "
+                "a v4l2loopback device.\n"
+                "It requires --opencv and --opencv-map.\n"
+                "This feature is only available on Linux.",
+    },
+    {
+        .longopt_id = OPT_PIPE_DEPTH,
+        .longopt = "pipe-depth",
+        .text = "Compute the disparity map of each rectified frame (on the "
+                "luma downscaled by 4) and pipe it after the frame, preceded "
+                "by a depth tag (see frame_header.h).\n"
+                "It requires --pipe-output, --opencv and --opencv-map.",
+    },
+    {
+        .longopt_id = OPT_PIPE_AUDIO,
+        .longopt = "pipe-audio",
+        .text = "Also pipe the decoded audio, in blocks of 20 ms of "
+                "interleaved 32-bit float samples, each one with the capture "
+                "time of its first sample (see frame_header.h).\n"
+                "It requires --pipe-output.",
+    },
+    {
+        .longopt_id = OPT_PRINT_ENCODER_LATENCY,
+        .longopt = "print-encoder-latency",
+        .text = "Print the encoder latency measured on the device every "
+                "second: the percentiles of the durations from the capture "
+                "to the encoder output, and to write the encoded packets.\n"
+                "It requires the device control.",
+    },
+    {
+        .longopt_id = OPT_PRINT_LATENCY,
+        .longopt = "print-latency",
+        .text = "Print the latency of the video frames through the client "
+                "pipeline every second: for each stage (decode, preprocess, "
+                "display and output), the percentiles of the durations since "
+                "the reception of the packet.",
+    },
+    {
+        .longopt_id = OPT_LATENCY_TRACE,
+        .longopt = "latency-trace",
+        .argdesc = "file.json",
+        .text = "Write the duration of every stage of every video frame in "
+                "the client pipeline to a Chrome trace file (to be loaded in "
+                "chrome://tracing or Perfetto).",
+    },
+    {
+        .longopt_id = OPT_LATENCY_PROBE,
+        .longopt = "latency-probe",
+        .argdesc = "width:height:x:y",
+        .text = "Measure the glass-to-glass latency: the window draws a "
+                "time-coded pattern of black and white cells in its "
+                "bottom-left corner, and the pattern is decoded from the "
+                "captured frames, in the given region (in pixels of the "
+                "frames). The window must be visible to the headset (through "
+                "its cameras, or mirrored in the headset). The percentiles of "
+                "the latency, from the presentation of the pattern to the "
+                "decoding of the frame capturing it, are printed every second, "
+                "and their histogram on exit.",
+    },
+    {
+        .longopt_id = OPT_DUMP_STREAM,
+        .longopt = "dump-stream",
+        .argdesc = "file",
+        .text = "Dump the raw video stream received from the device (codec "
+                "id, video size, and the packets with their headers), to be "
+                "replayed by --replay.",
+    },
+    {
+        .longopt_id = OPT_REPLAY,
+        .longopt = "replay",
+        .argdesc = "file",
+        .text = "Replay a stream dumped by --dump-stream instead of "
+                "connecting to a device, without window: the packets are "
+                "decoded and the frames processed, saved, piped or published "
+                "as during the capture, at the pace of the recorded PTS.\n"
+                "The frame timestamps are in the device monotonic clock.",
+    },
+    {
+        .longopt_id = OPT_REPLAY_MAX_SPEED,
+        .longopt = "replay-max-speed",
+        .text = "Replay the stream (--replay) as fast as possible instead of "
+                "at the pace of the recorded PTS.\n"
+                "The frames the video processor cannot keep up with are "
+                "dropped, as during a live capture.",
+    },
+    {
+        .longopt_id = OPT_METRICS,
+        .longopt = "metrics",
+        .argdesc = "file.jsonl",
+        .text = "Append the metrics of the capture pipeline (received bytes, "
+                "decoded, skipped, processed, piped, saved and dropped "
+                "frames, preprocessing time, queue depths, clock offset and "
+                "round-trip time) to a file as a JSON line every second.",
+    },
+    {
+        .longopt_id = OPT_AUTO_TUNE,
+        .longopt = "auto-tune",
+        .text = "Resize the thread pools of the pipeline at runtime, from the "
+                "measured cost of each stage, to keep up with the frame rate "
+                "(--max-fps if set, else the decoded rate) with the fewest "
+                "threads: the preprocessing threads (see "
+                "--preprocess-threads) and the frame writer threads (up to "
+                "8, starting from --save-frames-threads).\n"
+                "The decoder threads can not be changed once the decoder is "
+                "opened: the number needed is only estimated.\n"
+                "The configuration reached is logged on exit as command line "
+                "options, to be reused for the next captures.",
+    },
+    {
+        .longopt_id = OPT_HUD,
+        .longopt = "hud",
+        .text = "Draw a performance HUD over the video in the window, updated "
+                "4 times per second: decoding and rendering frame rates, "
+                "network throughput, latency of the last frame at each stage "
+                "of the pipeline (since the reception of its packet), "
+                "dropped frames, queue depths and clock sync offset.",
+    },
     {
         .longopt_id = OPT_PIPE_OUTPUT,
         .longopt = "pipe-output",
-        .text = "Pipe output to a pipe",
+        .argdesc = "mode",
+        .optional_arg = true,
+        .text = "Pipe output to a pipe. Possible values are \"frames\" (the "
+                "decoded frames), \"packets\" (the encoded video packets, "
+                "forwarded without decoding, each one with its capture time, "
+                "see frame_header.h) and \"features\" (the ORB keypoints and "
+                "descriptors of the rectified eyes, in place of each frame, "
+                "see frame_header.h).\n"
+                "Passing the option without argument is equivalent to passing "
+                "\"frames\".",
+    },
+    {
+        .longopt_id = OPT_PIPE_TARGET,
+        .longopt = "pipe-target",
+        .argdesc = "target",
+        .text = "Write the pipe output (--pipe-output) to a path (a file, a "
+                "FIFO, or on Windows a named pipe \\\\.\\pipe\\name, "
+                "created by scrcpy) or to an inherited file descriptor "
+                "(\"fd:N\") instead of stdout, so that stdout is left to "
+                "the logs.\n"
+                "The kernel buffer of a pipe is enlarged, up to 8 MiB (on "
+                "Linux, up to /proc/sys/fs/pipe-max-size without privileges, "
+                "see --pipe-buffer-size).\n"
+                "On Windows, the named pipe is written asynchronously, with "
+                "up to 4 records in flight.",
+    },
+    {
+        .longopt_id = OPT_PIPE_BUFFER_SIZE,
+        .longopt = "pipe-buffer-size",
+        .argdesc = "bytes",
+        .text = "Set the size of the kernel buffer of the pipe target "
+                "(--pipe-target), between 64K and 1000M (the suffixes K and "
+                "M are supported).\n"
+                "A larger buffer absorbs longer reader hiccups without "
+                "dropping frames.\n"
+                "Default is 8388608 (8 MiB).",
+    },
+    {
+        .longopt_id = OPT_PIPE_FORMAT,
+        .longopt = "pipe-format",
+        .argdesc = "format",
+        .text = "Set the format of the frames written to the pipe "
+                "(--pipe-output): v1 (packed 32-byte header followed by the "
+                "contiguous YUV420P planes) or v2 (versioned 128-byte header "
+                "with the pixel format, the eye layout, the frame number, "
+                "flags and a timestamp in nanoseconds, followed by planes "
+                "aligned on 64 bytes, see frame_header.h).\n"
+                "Default is v1.",
+    },
+    {
+        .longopt_id = OPT_PIPE_PAYLOAD_CRC,
+        .longopt = "pipe-payload-crc",
+        .text = "Also store the CRC-32C of the data of each piped frame in "
+                "its header, so that the consumer can detect corrupted or "
+                "truncated frames. Requires --pipe-format=v2.",
+    },
+    {
+        .longopt_id = OPT_PUBLISH,
+        .longopt = "publish",
+        .argdesc = "[ip:]port",
+        .text = "Serve the frames over TCP, in the --pipe-output format "
+                "(see --pipe-format), to any number of subscribers connecting "
+                "to this port.\n"
+                "Each subscriber has its own bounded queue (see "
+                "--publish-queue and --publish-drop), so that a slow "
+                "subscriber never blocks the others or the capture.\n"
+                "By default, it listens on localhost only.",
+    },
+    {
+        .longopt_id = OPT_PUBLISH_QUEUE,
+        .longopt = "publish-queue",
+        .argdesc = "n",
+        .text = "Set the number of frames which may be queued for each "
+                "subscriber of --publish (between 1 and 64).\n"
+                "Default is 4.",
+    },
+    {
+        .longopt_id = OPT_PUBLISH_DROP,
+        .longopt = "publish-drop",
+        .argdesc = "policy",
+        .text = "Select the frames dropped when the queue of a subscriber of "
+                "--publish is full: oldest (the subscriber always receives "
+                "the most recent frames) or newest (the queued frames are "
+                "kept, the new ones are dropped).\n"
+                "Default is oldest.",
+    },
+    {
+        .longopt_id = OPT_PIPE_FEEDBACK,
+        .longopt = "pipe-feedback",
+        .argdesc = "[ip:]port",
+        .text = "Listen on this port for the consumer of --pipe-output to "
+                "acknowledge the frames it has processed and report its "
+                "capacity (see struct pipe_feedback_record).\n"
+                "Once the frames in flight reach its capacity, the next ones "
+                "are reduced or dropped before being piped (see "
+                "--pipe-backpressure), instead of blocking on a full pipe.\n"
+                "By default, it listens on localhost only. Requires "
+                "--pipe-format=v2.",
+    },
+    {
+        .longopt_id = OPT_PIPE_BACKPRESSURE,
+        .longopt = "pipe-backpressure",
+        .argdesc = "policy",
+        .text = "Select what is piped in place of a frame when the consumer "
+                "of --pipe-feedback is late: drop (a drop record) or luma "
+                "(only the Y plane, up to twice its capacity, then a drop "
+                "record).\n"
+                "Default is drop.",
     },
     {
         .longopt_id = OPT_ADB_PATH,
         .longopt = "adb-path",
         .argdesc = "path",
-        .text = "Path to adb executable",
+        .text = "Path to adb executable (instead of $ADB or the adb found "
+                "in the PATH).",
     },
     {
         .longopt_id = OPT_SHOW_TIMESTAMPS,
         .longopt = "show-timestamps",
         .text = "Render timestamps on screen",
     },
+    {
+        .longopt_id = OPT_SAVE_FRAMES_THREADS,
+        .longopt = "save-frames-threads",
+        .argdesc = "value",
+        .text = "Set the number of I/O threads writing the saved frames "
+                "(between 1 and 8).\n"
+                "If the frames are produced faster than they can be written, "
+                "they are dropped rather than delaying the capture.\n"
+                "Default is 2.",
+    },
+    {
+        .longopt_id = OPT_SAVE_FRAMES_FORMAT,
+        .longopt = "save-frames-format",
+        .argdesc = "format",
+        .text = "Set the format of the saved frames: ppm (RGB24), yuv (raw "
+                "YUV420P planes, without conversion), png or qoi (lossless, "
+                "compressed), or jpeg (lossy, encoded from the YUV420P "
+                "planes, see --save-frames-quality).\n"
+                "Default is ppm.",
+    },
+    {
+        .longopt_id = OPT_SAVE_FRAMES_QUALITY,
+        .longopt = "save-frames-quality",
+        .argdesc = "value",
+        .text = "Set the quality of the frames saved with "
+                "--save-frames-format=jpeg, from 1 (smallest) to 100 (best).\n"
+                "Default is 90.",
+    },
+    {
+        .longopt_id = OPT_SAVE_FRAMES_IO,
+        .longopt = "save-frames-io",
+        .argdesc = "mode",
+        .text = "Select how the frames are written to the archive "
+                "(--save-frames-archive): sync (blocking writes) or io_uring "
+                "(Linux only: each I/O thread copies the frames into "
+                "registered buffers and submits their writes in batches, "
+                "with up to 8 writes in flight).\n"
+                "With io_uring, a single I/O thread (--save-frames-threads=1) "
+                "is usually enough.\n"
+                "Default is sync.",
+    },
+    {
+        .longopt_id = OPT_SAVE_FRAMES_DIRECT,
+        .longopt = "save-frames-direct",
+        .text = "Write the archive (--save-frames-archive) bypassing the "
+                "page cache (O_DIRECT on Linux, FILE_FLAG_NO_BUFFERING on "
+                "Windows), so that long raw captures do not evict the memory "
+                "of the other processes. The frame records are padded to "
+                "4096-byte boundaries.\n"
+                "The disk space is preallocated ahead of the frames, for the "
+                "whole --time-limit if set (at the data rate measured over "
+                "the first second), and released on close if unused.",
+    },
+    {
+        .longopt_id = OPT_SAVE_FRAMES_ZSTD,
+        .longopt = "save-frames-zstd",
+        .argdesc = "level",
+        .text = "Compress each frame of the archive (--save-frames-archive) "
+                "with zstd, at the given level (1 to 19, the lower the "
+                "faster). The frames are compressed independently, in "
+                "parallel by the I/O threads (--save-frames-threads), so "
+                "they can still be read in any order from the index.\n"
+                "Requires --save-frames-format=yuv or ppm (the other formats "
+                "are already compressed).",
+    },
+    {
+        .longopt_id = OPT_SAVE_FRAMES_ZSTD_DICT,
+        .longopt = "save-frames-zstd-dict",
+        .argdesc = "file",
+        .text = "Compress the frames (--save-frames-zstd) with a zstd "
+                "dictionary (e.g. trained by 'zstd --train' on frames of "
+                "similar scenes). It is stored in the archive, for the "
+                "readers.",
+    },
+    {
+        .longopt_id = OPT_SAVE_FRAMES_TILE_DELTA,
+        .longopt = "save-frames-tile-delta",
+        .argdesc = "threshold",
+        .text = "Store the frames of the archive (--save-frames-archive) "
+                "as tile deltas, for near-static scenes: a key frame is "
+                "stored in full periodically (see "
+                "--save-frames-key-interval), and the other frames only "
+                "store the 64x64 tiles whose mean absolute difference (0 to "
+                "255, of the luma or of a chroma plane) against the previous "
+                "frame stored is at least <threshold> (0 to store exactly the "
+                "tiles which changed).\n"
+                "The readers reconstruct any frame from its key frame, "
+                "through the index of the deltas stored in the archive.\n"
+                "Requires --save-frames-format=yuv, and is incompatible "
+                "with --save-frames-pre-trigger.",
+    },
+    {
+        .longopt_id = OPT_SAVE_FRAMES_KEY_INTERVAL,
+        .longopt = "save-frames-key-interval",
+        .argdesc = "n",
+        .text = "Store a key frame every <n> frames stored "
+                "(--save-frames-tile-delta), and after any frame which could "
+                "not be stored. The longer the interval, the smaller the "
+                "archive, and the more deltas to apply to reconstruct a "
+                "frame.\n"
+                "Default is 60.",
+    },
+    {
+        .longopt_id = OPT_UPLOAD_DIR,
+        .longopt = "upload-dir",
+        .argdesc = "path",
+        .text = "Upload the finished capture files to a directory, typically "
+                "a network storage mount (SMB, NFS, or an object storage "
+                "mounted by s3fs or rclone), while the capture continues: "
+                "each recording segment (--record-segment) and its "
+                "timestamp index, each saved frame (--save-frames), or "
+                "the archive once closed (--save-frames-archive).\n"
+                "The large files are split into 64 MiB parts, written "
+                "concurrently. Each file is written as \"<name>.part\", and "
+                "renamed once complete. On exit, the files already queued "
+                "are still uploaded.",
+    },
+    {
+        .longopt_id = OPT_UPLOAD_THREADS,
+        .longopt = "upload-threads",
+        .argdesc = "value",
+        .text = "Set the number of threads uploading the files "
+                "(--upload-dir), from 1 to 8.\n"
+                "Default is 4.",
+    },
+    {
+        .longopt_id = OPT_UPLOAD_MAX_RATE,
+        .longopt = "upload-max-rate",
+        .argdesc = "value",
+        .text = "Limit the upload rate (--upload-dir), in bytes per second, "
+                "so that it does not saturate the network. Supports 'K' and "
+                "'M' suffixes (e.g. 20M).\n"
+                "Default is 0 (unlimited).",
+    },
+    {
+        .longopt_id = OPT_UPLOAD_DELETE,
+        .longopt = "upload-delete",
+        .text = "Delete each local file once uploaded (--upload-dir).",
+    },
+    {
+        .longopt_id = OPT_SAVE_FRAMES_PRE_TRIGGER,
+        .longopt = "save-frames-pre-trigger",
+        .argdesc = "seconds",
+        .text = "Do not save the frames continuously: hold the frames of the "
+                "last <seconds> in memory (as references to the decoded "
+                "frames, up to 2 GiB), and only save them on a trigger "
+                "(MOD+t, or SIGUSR1 on Linux and macOS), along with the "
+                "frames of the next --save-frames-post-trigger seconds.\n"
+                "Requires --save-frames or --save-frames-archive.",
+    },
+    {
+        .longopt_id = OPT_SAVE_FRAMES_POST_TRIGGER,
+        .longopt = "save-frames-post-trigger",
+        .argdesc = "seconds",
+        .text = "Set the duration of the capture after a trigger (see "
+                "--save-frames-pre-trigger). A trigger during this capture "
+                "extends it.\n"
+                "Default is 10.",
+    },
+    {
+        .longopt_id = OPT_OUTPUT_PLANES,
+        .longopt = "output-planes",
+        .argdesc = "planes",
+        .text = "Select the planes of the saved, piped, shared and published "
+                "frames: yuv (YUV420P) or y (the luma plane only, GRAY8, for "
+                "the vision algorithms which do not use the colors).\n"
+                "With y, the chroma planes are neither remapped nor converted "
+                "(unless they are displayed), and the frames are saved as "
+                "PGM, grayscale PNG or raw Y planes (qoi and jpeg are not "
+                "supported).\n"
+                "Default is yuv.",
+    },
+    {
+        .longopt_id = OPT_OUTPUT_PYRAMID,
+        .longopt = "output-pyramid",
+        .argdesc = "levels",
+        .text = "Build a Gaussian pyramid of the Y plane of each piped and "
+                "shared frame (once for all the consumers), and output the "
+                "selected levels, a comma-separated list from 1 (half "
+                "resolution) to 4 (1/16), e.g. \"1,2\".\n"
+                "The levels are piped after the frame (as GRAY8 records "
+                "preceded by a pyramid tag, requires --pipe-format=v2), and "
+                "written after the frame in the --shm-output slots. The eyes "
+                "are reduced separately.",
+    },
+    {
+        .longopt_id = OPT_SAVE_FRAMES_FPS,
+        .longopt = "save-frames-fps",
+        .argdesc = "value",
+        .text = "Save only a subset of the frames: at most <value> frames "
+                "per second (from the frame timestamps), or only the key "
+                "frames if <value> is \"key\".\n"
+                "The frames not saved are neither processed nor converted "
+                "for saving (they are not recorded as dropped).\n"
+                "By default, all the frames are saved.",
+    },
+    {
+        .longopt_id = OPT_MOTION_THRESHOLD,
+        .longopt = "motion-threshold",
+        .argdesc = "value",
+        .text = "Save, pipe, share and publish a frame only if it differs "
+                "enough from the last one saved or output: <value> is the "
+                "minimal mean absolute difference of the luma (0 to 255), "
+                "compared at 1/4 of the resolution (e.g. 1.5 to ignore the "
+                "encoding noise of a static scene).\n"
+                "The frames below the threshold are recorded as repeated "
+                "frames in the pipe and in the frame archive index (with "
+                "their timestamp), so that the timeline stays complete.\n"
+                "By default, all the frames are output.",
+    },
+    {
+        .longopt_id = OPT_PIPE_OUTPUT_FPS,
+        .longopt = "pipe-output-fps",
+        .argdesc = "value",
+        .text = "Output only a subset of the piped, shared and published "
+                "frames: at most <value> frames per second (from the frame "
+                "timestamps), or only the key frames if <value> is \"key\".\n"
+                "The frames skipped on purpose are not flagged as "
+                "discontinuities.\n"
+                "By default, all the frames are output.",
+    },
+    {
+        .longopt_id = OPT_SAVE_FRAMES_ARCHIVE,
+        .longopt = "save-frames-archive",
+        .argdesc = "file",
+        .text = "Save video frames into a single indexed archive file, "
+                "instead of one file per frame in --frame-dir.\n"
+                "Implies --save-frames.",
+    },
+    {
+        .longopt_id = OPT_SHM_OUTPUT,
+        .longopt = "shm-output",
+        .argdesc = "name",
+        .text = "Publish the frames (YUV420P) in a named shared memory ring, "
+                "so that local programs can read them without copy.\n"
+                "The layout is described in app/src/shm_ring.h, and a "
+                "consumer library is provided in tools/shm_consumer.",
+    },
+    {
+        .longopt_id = OPT_CUDA_IPC_OUTPUT,
+        .longopt = "cuda-ipc-output",
+        .argdesc = "name",
+        .text = "Export the rectified frames (YUV420P) to local programs "
+                "running on the same GPU, without leaving the GPU: the "
+                "frames are remapped into a ring of CUDA device memory "
+                "exported as CUDA IPC handles, and their metadata is "
+                "published in the named shared memory.\n"
+                "The layout is described in app/src/cuda_ipc_ring.h.\n"
+                "Requires --opencv-backend=cuda (and a build with the CUDA "
+                "runtime).",
+    },
 };
 
 static const struct sc_shortcut shortcuts[] = {
@@ -1022,6 +2234,14 @@ static const struct sc_shortcut shortcuts[] = {
         .shortcuts = { "MOD+Shift+z" },
         .text = "Unpause display",
     },
+    {
+        .shortcuts = { "MOD+e" },
+        .text = "Switch to the next stereo view (see --stereo-view)",
+    },
+    {
+        .shortcuts = { "MOD+Shift+e" },
+        .text = "Switch to the previous stereo view",
+    },
     {
         .shortcuts = { "MOD+g" },
         .text = "Resize window to 1:1 (pixel-perfect)",
@@ -1111,6 +2331,20 @@ static const struct sc_shortcut shortcuts[] = {
         .shortcuts = { "MOD+i" },
         .text = "Enable/disable FPS counter (print frames/second in logs)",
     },
+    {
+        .shortcuts = { "MOD+l" },
+        .text = "Reload the calibration (remap maps) without restarting",
+    },
+    {
+        .shortcuts = { "MOD+j", "MOD+Shift+j" },
+        .text = "Switch to the next/previous capture size and frame rate "
+                "(--video-presets)",
+    },
+    {
+        .shortcuts = { "MOD+t" },
+        .text = "Write the pre-trigger capture ring and the next seconds to "
+                "the saved frames (--save-frames-pre-trigger)",
+    },
     {
         .shortcuts = { "Ctrl+click-and-move" },
         .text = "Pinch-to-zoom and rotate from the center of the screen",
@@ -1566,6 +2800,32 @@ parse_audio_output_buffer(const char *s, sc_tick *tick) {
     return true;
 }
 
+static bool
+parse_audio_latency(const char *optarg, enum sc_audio_latency *latency) {
+    if (!strcmp(optarg, "default")) {
+        *latency = SC_AUDIO_LATENCY_DEFAULT;
+        return true;
+    }
+    if (!strcmp(optarg, "low")) {
+        *latency = SC_AUDIO_LATENCY_LOW;
+        return true;
+    }
+    LOGE("Unsupported audio latency: %s (expected default or low)", optarg);
+    return false;
+}
+
+static bool
+parse_audio_read_size(const char *s, uint16_t *samples) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 8192, "audio read size");
+    if (!ok) {
+        return false;
+    }
+
+    *samples = (uint16_t) value;
+    return true;
+}
+
 static bool
 parse_lock_video_orientation(const char *s,
                              enum sc_lock_video_orientation *lock_mode) {
@@ -1712,1454 +2972,3802 @@ parse_window_dimension(const char *s, uint16_t *dimension) {
 }
 
 static bool
-parse_port_range(const char *s, struct sc_port_range *port_range) {
-    long values[2];
-    size_t count = parse_integers_arg(s, ':', 2, values, 0, 0xFFFF, "port");
-    if (!count) {
+parse_save_frames_threads(const char *s, unsigned *threads) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 8, "save frames threads");
+    if (!ok) {
         return false;
     }
 
-    uint16_t v0 = (uint16_t) values[0];
-    if (count == 1) {
-        port_range->first = v0;
-        port_range->last = v0;
-        return true;
+    *threads = (unsigned) value;
+    return true;
+}
+
+static bool
+parse_upload_threads(const char *s, unsigned *threads) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, SC_UPLOADER_MAX_THREADS,
+                                "upload threads");
+    if (!ok) {
+        return false;
     }
 
-    assert(count == 2);
-    uint16_t v1 = (uint16_t) values[1];
-    if (v0 < v1) {
-        port_range->first = v0;
-        port_range->last = v1;
-    } else {
-        port_range->first = v1;
-        port_range->last = v0;
+    *threads = (unsigned) value;
+    return true;
+}
+
+static bool
+parse_upload_max_rate(const char *s, uint32_t *rate) {
+    long value;
+    // long may be 32 bits, do not use more than 31 bits
+    bool ok = parse_integer_arg(s, &value, true, 0, 0x7FFFFFFF,
+                                "upload max rate");
+    if (!ok) {
+        return false;
     }
 
+    *rate = (uint32_t) value;
     return true;
 }
 
 static bool
-parse_display_id(const char *s, uint32_t *display_id) {
+parse_preview_downscale(const char *s, unsigned *factor) {
     long value;
-    bool ok = parse_integer_arg(s, &value, false, 0, 0x7FFFFFFF, "display id");
+    bool ok = parse_integer_arg(s, &value, false, 1, 8, "preview downscale");
     if (!ok) {
         return false;
     }
 
-    *display_id = (uint32_t) value;
+    *factor = (unsigned) value;
     return true;
 }
 
 static bool
-parse_log_level(const char *s, enum sc_log_level *log_level) {
-    if (!strcmp(s, "verbose")) {
-        *log_level = SC_LOG_LEVEL_VERBOSE;
-        return true;
+parse_latency_budget(const char *s, sc_tick *budget) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 10000, "latency budget");
+    if (!ok) {
+        return false;
     }
 
-    if (!strcmp(s, "debug")) {
-        *log_level = SC_LOG_LEVEL_DEBUG;
-        return true;
+    *budget = SC_TICK_FROM_MS(value);
+    return true;
+}
+
+static bool
+parse_memory_budget(const char *s, uint32_t *budget) {
+    long value;
+    // Up to 1 TiB, so that it fits in 31 bits
+    bool ok = parse_integer_arg(s, &value, false, 0, 1 << 20,
+                                "memory budget");
+    if (!ok) {
+        return false;
     }
 
-    if (!strcmp(s, "info")) {
-        *log_level = SC_LOG_LEVEL_INFO;
-        return true;
+    *budget = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_catch_up(const char *s, sc_tick *max_lag) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 60000, "catch-up lag");
+    if (!ok) {
+        return false;
     }
 
-    if (!strcmp(s, "warn")) {
-        *log_level = SC_LOG_LEVEL_WARN;
-        return true;
+    *max_lag = SC_TICK_FROM_MS(value);
+    return true;
+}
+
+static bool
+parse_reconnect_timeout(const char *s, uint16_t *timeout) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 60000,
+                                "reconnect timeout");
+    if (!ok) {
+        return false;
     }
 
-    if (!strcmp(s, "error")) {
-        *log_level = SC_LOG_LEVEL_ERROR;
-        return true;
+    *timeout = (uint16_t) value;
+    return true;
+}
+
+static bool
+parse_repeat_frame_delay(const char *s, uint16_t *delay) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 10000,
+                                "repeat frame delay");
+    if (!ok) {
+        return false;
     }
 
-    LOGE("Could not parse log level: %s", s);
-    return false;
+    *delay = (uint16_t) value;
+    return true;
 }
 
-static enum sc_shortcut_mod
-parse_shortcut_mods_item(const char *item, size_t len) {
-#define STREQ(literal, s, len) \
-    ((sizeof(literal)-1 == len) && !memcmp(literal, s, len))
+static bool
+parse_mouse_motion_rate(const char *s, uint16_t *rate) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 1000,
+                                "mouse motion rate");
+    if (!ok) {
+        return false;
+    }
 
-    if (STREQ("lctrl", item, len)) {
-        return SC_SHORTCUT_MOD_LCTRL;
-    }
-    if (STREQ("rctrl", item, len)) {
-        return SC_SHORTCUT_MOD_RCTRL;
-    }
-    if (STREQ("lalt", item, len)) {
-        return SC_SHORTCUT_MOD_LALT;
-    }
-    if (STREQ("ralt", item, len)) {
-        return SC_SHORTCUT_MOD_RALT;
-    }
-    if (STREQ("lsuper", item, len)) {
-        return SC_SHORTCUT_MOD_LSUPER;
-    }
-    if (STREQ("rsuper", item, len)) {
-        return SC_SHORTCUT_MOD_RSUPER;
-    }
-#undef STREQ
+    *rate = (uint16_t) value;
+    return true;
+}
 
-    bool has_plus = strchr(item, '+');
-    if (has_plus) {
-        LOGE("Shortcut mod combination with '+' is not supported anymore: "
-             "'%.*s' (see #4741)", (int) len, item);
-        return 0;
+static bool
+parse_pose_rate(const char *s, uint16_t *rate) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 1000, "pose rate");
+    if (!ok) {
+        return false;
     }
 
-    LOGE("Unknown modifier key: %.*s "
-         "(must be one of: lctrl, rctrl, lalt, ralt, lsuper, rsuper)",
-         (int) len, item);
-
-    return 0;
+    *rate = (uint16_t) value;
+    return true;
 }
 
 static bool
-parse_shortcut_mods(const char *s, uint8_t *shortcut_mods) {
-    uint8_t mods = 0;
-
-    // A list of shortcut modifiers, for example "lctrl,rctrl,rsuper"
-
-    for (;;) {
-        char *comma = strchr(s, ',');
-        assert(!comma || comma > s);
-        size_t limit = comma ? (size_t) (comma - s) : strlen(s);
+parse_save_frames_quality(const char *s, unsigned *quality) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 100,
+                                "save frames quality");
+    if (!ok) {
+        return false;
+    }
 
-        enum sc_shortcut_mod mod = parse_shortcut_mods_item(s, limit);
-        if (!mod) {
-            return false;
-        }
+    *quality = (unsigned) value;
+    return true;
+}
 
-        mods |= mod;
+static bool
+parse_save_frames_zstd(const char *s, int *level) {
+#ifdef HAVE_ZSTD
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 19,
+                                "zstd compression level");
+    if (!ok) {
+        return false;
+    }
 
-        if (!comma) {
-            break;
-        }
+    *level = (int) value;
+    return true;
+#else
+    (void) s;
+    (void) level;
+    LOGE("zstd compression (--save-frames-zstd) is disabled (libzstd not "
+         "found on build).");
+    return false;
+#endif
+}
 
-        s = comma + 1;
+static bool
+parse_tile_threshold(const char *s, float *threshold) {
+    char *endptr;
+    errno = 0;
+    float value = strtof(s, &endptr);
+    if (*s == '\0' || *endptr != '\0' || errno == ERANGE) {
+        LOGE("Could not parse tile delta threshold: %s", s);
+        return false;
     }
 
-    *shortcut_mods = mods;
+    if (!(value >= 0 && value <= 255)) {
+        LOGE("Could not parse tile delta threshold: value (%s) out-of-range "
+             "[0; 255]", s);
+        return false;
+    }
 
+    *threshold = value;
     return true;
 }
 
-#ifdef SC_TEST
-// expose the function to unit-tests
-bool
-sc_parse_shortcut_mods(const char *s, uint8_t *mods) {
-    return parse_shortcut_mods(s, mods);
+static bool
+parse_key_interval(const char *s, unsigned *interval) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 100000,
+                                "key frame interval");
+    if (!ok) {
+        return false;
+    }
+
+    *interval = (unsigned) value;
+    return true;
 }
-#endif
 
-static enum sc_record_format
-get_record_format(const char *name) {
-    if (!strcmp(name, "mp4")) {
-        return SC_RECORD_FORMAT_MP4;
+static bool
+parse_save_frames_format(const char *optarg,
+                         enum sc_save_frames_format *format) {
+    if (!strcmp(optarg, "ppm")) {
+        *format = SC_SAVE_FRAMES_FORMAT_PPM;
+        return true;
     }
-    if (!strcmp(name, "mkv")) {
-        return SC_RECORD_FORMAT_MKV;
+    if (!strcmp(optarg, "yuv")) {
+        *format = SC_SAVE_FRAMES_FORMAT_YUV;
+        return true;
     }
-    if (!strcmp(name, "m4a")) {
-        return SC_RECORD_FORMAT_M4A;
+    if (!strcmp(optarg, "png")) {
+        *format = SC_SAVE_FRAMES_FORMAT_PNG;
+        return true;
     }
-    if (!strcmp(name, "mka")) {
-        return SC_RECORD_FORMAT_MKA;
+    if (!strcmp(optarg, "qoi")) {
+        *format = SC_SAVE_FRAMES_FORMAT_QOI;
+        return true;
     }
-    if (!strcmp(name, "opus")) {
-        return SC_RECORD_FORMAT_OPUS;
+    if (!strcmp(optarg, "jpeg")) {
+        *format = SC_SAVE_FRAMES_FORMAT_JPEG;
+        return true;
     }
-    if (!strcmp(name, "aac")) {
-        return SC_RECORD_FORMAT_AAC;
+    LOGE("Unsupported save frames format: %s (expected ppm, yuv, png, qoi or "
+         "jpeg)", optarg);
+    return false;
+}
+
+static bool
+parse_save_frames_io(const char *optarg, enum sc_save_frames_io *io) {
+    if (!strcmp(optarg, "sync")) {
+        *io = SC_SAVE_FRAMES_IO_SYNC;
+        return true;
     }
-    if (!strcmp(name, "flac")) {
-        return SC_RECORD_FORMAT_FLAC;
+    if (!strcmp(optarg, "io_uring")) {
+#ifdef HAVE_IO_URING
+        *io = SC_SAVE_FRAMES_IO_URING;
+        return true;
+#else
+        LOGE("io_uring (--save-frames-io) is disabled (or unsupported on "
+             "this platform).");
+        return false;
+#endif
     }
-    if (!strcmp(name, "wav")) {
-        return SC_RECORD_FORMAT_WAV;
+    LOGE("Unsupported save frames io: %s (expected sync or io_uring)",
+         optarg);
+    return false;
+}
+
+static bool
+parse_output_planes(const char *optarg, enum sc_output_planes *planes) {
+    if (!strcmp(optarg, "yuv")) {
+        *planes = SC_OUTPUT_PLANES_YUV;
+        return true;
     }
-    return 0;
+    if (!strcmp(optarg, "y")) {
+        *planes = SC_OUTPUT_PLANES_Y;
+        return true;
+    }
+    LOGE("Unsupported output planes: %s (expected yuv or y)", optarg);
+    return false;
 }
 
 static bool
-parse_record_format(const char *optarg, enum sc_record_format *format) {
-    enum sc_record_format fmt = get_record_format(optarg);
-    if (!fmt) {
-        LOGE("Unsupported record format: %s (expected mp4, mkv, m4a, mka, "
-             "opus, aac, flac or wav)", optarg);
+parse_output_rate(const char *s, struct sc_output_rate *rate,
+                  const char *name) {
+    if (!strcmp(s, "key")) {
+        rate->fps = 0;
+        rate->key_frames = true;
+        return true;
+    }
+
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 1000, name);
+    if (!ok) {
         return false;
     }
 
-    *format = fmt;
+    rate->fps = (unsigned) value;
+    rate->key_frames = false;
     return true;
 }
 
 static bool
-parse_ip(const char *optarg, uint32_t *ipv4) {
-    return net_parse_ipv4(optarg, ipv4);
-}
+parse_motion_threshold(const char *s, float *threshold) {
+    char *endptr;
+    errno = 0;
+    float value = strtof(s, &endptr);
+    if (*s == '\0' || *endptr != '\0' || errno == ERANGE) {
+        LOGE("Could not parse motion threshold: %s", s);
+        return false;
+    }
 
-static bool
-parse_port(const char *optarg, uint16_t *port) {
-    long value;
-    if (!parse_integer_arg(optarg, &value, false, 0, 0xFFFF, "port")) {
+    if (!(value > 0 && value <= 255)) {
+        LOGE("Could not parse motion threshold: value (%s) out-of-range "
+             "(0; 255]", s);
         return false;
     }
-    *port = (uint16_t) value;
+
+    *threshold = value;
     return true;
 }
 
-static enum sc_record_format
-guess_record_format(const char *filename) {
-    const char *dot = strrchr(filename, '.');
-    if (!dot) {
-        return 0;
+static bool
+parse_output_pyramid(const char *s, uint8_t *levels) {
+    long values[SC_FRAME_PYRAMID_MAX_LEVEL];
+    size_t count = parse_integers_arg(s, ',', SC_FRAME_PYRAMID_MAX_LEVEL,
+                                      values, 1, SC_FRAME_PYRAMID_MAX_LEVEL,
+                                      "output pyramid levels");
+    if (!count) {
+        return false;
     }
 
-    const char *ext = dot + 1;
-    return get_record_format(ext);
+    uint8_t mask = 0;
+    for (size_t i = 0; i < count; ++i) {
+        mask |= 1 << values[i];
+    }
+
+    *levels = mask;
+    return true;
 }
 
 static bool
-parse_video_codec(const char *optarg, enum sc_codec *codec) {
-    if (!strcmp(optarg, "h264")) {
-        *codec = SC_CODEC_H264;
-        return true;
-    }
-    if (!strcmp(optarg, "h265")) {
-        *codec = SC_CODEC_H265;
+parse_pipe_format(const char *optarg, enum sc_pipe_format *format) {
+    if (!strcmp(optarg, "v1")) {
+        *format = SC_PIPE_FORMAT_V1;
         return true;
     }
-    if (!strcmp(optarg, "av1")) {
-        *codec = SC_CODEC_AV1;
+    if (!strcmp(optarg, "v2")) {
+        *format = SC_PIPE_FORMAT_V2;
         return true;
     }
-    LOGE("Unsupported video codec: %s (expected h264, h265 or av1)", optarg);
+    LOGE("Unsupported pipe format: %s (expected v1 or v2)", optarg);
     return false;
 }
 
 static bool
-parse_audio_codec(const char *optarg, enum sc_codec *codec) {
-    if (!strcmp(optarg, "opus")) {
-        *codec = SC_CODEC_OPUS;
-        return true;
-    }
-    if (!strcmp(optarg, "aac")) {
-        *codec = SC_CODEC_AAC;
+parse_pipe_output(const char *s, struct scrcpy_options *opts) {
+    if (!s || !strcmp(s, "frames")) {
+        opts->pipe_output = true;
+        opts->pipe_packets = false;
+        opts->pipe_features = false;
         return true;
     }
-    if (!strcmp(optarg, "flac")) {
-        *codec = SC_CODEC_FLAC;
+    if (!strcmp(s, "packets")) {
+        opts->pipe_output = false;
+        opts->pipe_packets = true;
+        opts->pipe_features = false;
         return true;
     }
-    if (!strcmp(optarg, "raw")) {
-        *codec = SC_CODEC_RAW;
+    if (!strcmp(s, "features")) {
+#ifdef HAVE_OPENCV
+        opts->pipe_output = true;
+        opts->pipe_packets = false;
+        opts->pipe_features = true;
         return true;
+#else
+        LOGE("OpenCV (--pipe-output=features) is disabled.");
+        return false;
+#endif
     }
-    LOGE("Unsupported audio codec: %s (expected opus, aac, flac or raw)",
-         optarg);
+    LOGE("Unsupported pipe output mode: %s (expected frames, packets or "
+         "features)", s);
     return false;
 }
 
 static bool
-parse_video_source(const char *optarg, enum sc_video_source *source) {
-    if (!strcmp(optarg, "display")) {
-        *source = SC_VIDEO_SOURCE_DISPLAY;
-        return true;
+parse_push_workers(const char *s, unsigned *workers) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1,
+                                SC_FILE_PUSHER_MAX_WORKERS, "push workers");
+    if (!ok) {
+        return false;
     }
 
-    if (!strcmp(optarg, "camera")) {
-        *source = SC_VIDEO_SOURCE_CAMERA;
-        return true;
+    *workers = (unsigned) value;
+    return true;
+}
+
+static bool
+parse_pipe_buffer_size(const char *s, uint32_t *size) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, true, 0x10000, 1000000000,
+                                "pipe buffer size");
+    if (!ok) {
+        return false;
     }
 
-    LOGE("Unsupported video source: %s (expected display or camera)", optarg);
-    return false;
+    *size = (uint32_t) value;
+    return true;
 }
 
 static bool
-parse_audio_source(const char *optarg, enum sc_audio_source *source) {
-    if (!strcmp(optarg, "mic")) {
-        *source = SC_AUDIO_SOURCE_MIC;
-        return true;
+parse_publish_queue(const char *s, unsigned *queue) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 64, "publish queue");
+    if (!ok) {
+        return false;
     }
 
-    if (!strcmp(optarg, "output")) {
-        *source = SC_AUDIO_SOURCE_OUTPUT;
+    *queue = (unsigned) value;
+    return true;
+}
+
+static bool
+parse_publish_drop(const char *optarg, enum sc_publish_drop *drop) {
+    if (!strcmp(optarg, "oldest")) {
+        *drop = SC_PUBLISH_DROP_OLDEST;
         return true;
     }
-
-    if (!strcmp(optarg, "playback")) {
-        *source = SC_AUDIO_SOURCE_PLAYBACK;
+    if (!strcmp(optarg, "newest")) {
+        *drop = SC_PUBLISH_DROP_NEWEST;
         return true;
     }
-
-    LOGE("Unsupported audio source: %s (expected output, mic or playback)",
+    LOGE("Unsupported publish drop policy: %s (expected oldest or newest)",
          optarg);
     return false;
 }
 
 static bool
-parse_camera_facing(const char *optarg, enum sc_camera_facing *facing) {
-    if (!strcmp(optarg, "front")) {
-        *facing = SC_CAMERA_FACING_FRONT;
+parse_pipe_backpressure(const char *optarg,
+                        enum sc_pipe_backpressure *policy) {
+    if (!strcmp(optarg, "drop")) {
+        *policy = SC_PIPE_BACKPRESSURE_DROP;
         return true;
     }
-
-    if (!strcmp(optarg, "back")) {
-        *facing = SC_CAMERA_FACING_BACK;
+    if (!strcmp(optarg, "luma")) {
+        *policy = SC_PIPE_BACKPRESSURE_LUMA;
         return true;
     }
+    LOGE("Unsupported pipe backpressure policy: %s (expected drop or luma)",
+         optarg);
+    return false;
+}
 
-    if (!strcmp(optarg, "external")) {
-        *facing = SC_CAMERA_FACING_EXTERNAL;
+static bool
+parse_opencv_backend(const char *optarg, enum sc_opencv_backend *backend) {
+    if (!strcmp(optarg, "cpu")) {
+        *backend = SC_OPENCV_BACKEND_CPU;
         return true;
     }
-
-    if (*optarg == '\0') {
-        // Empty string is a valid value (equivalent to not passing the option)
-        *facing = SC_CAMERA_FACING_ANY;
+    if (!strcmp(optarg, "opencl")) {
+        *backend = SC_OPENCV_BACKEND_OPENCL;
         return true;
     }
-
-    LOGE("Unsupported camera facing: %s (expected front, back or external)",
+    if (!strcmp(optarg, "cuda")) {
+        *backend = SC_OPENCV_BACKEND_CUDA;
+        return true;
+    }
+    LOGE("Unsupported OpenCV backend: %s (expected cpu, opencl or cuda)",
          optarg);
     return false;
 }
 
 static bool
-parse_camera_fps(const char *s, uint16_t *camera_fps) {
+parse_preprocess_threads(const char *s, unsigned *threads) {
     long value;
-    bool ok = parse_integer_arg(s, &value, false, 0, 0xFFFF, "camera fps");
+    bool ok = parse_integer_arg(s, &value, false, 0, 64, "preprocess threads");
     if (!ok) {
         return false;
     }
 
-    *camera_fps = (uint16_t) value;
+    *threads = (unsigned) value;
     return true;
 }
 
 static bool
-parse_keyboard(const char *optarg, enum sc_keyboard_input_mode *mode) {
-    if (!strcmp(optarg, "disabled")) {
-        *mode = SC_KEYBOARD_INPUT_MODE_DISABLED;
-        return true;
+parse_cpu_index(const char *s, char **endptr, long *cpu) {
+    errno = 0;
+    long value = strtol(s, endptr, 10);
+    if (*endptr == s || errno == ERANGE || value < 0 || value > 63) {
+        return false;
     }
 
-    if (!strcmp(optarg, "sdk")) {
-        *mode = SC_KEYBOARD_INPUT_MODE_SDK;
-        return true;
-    }
+    *cpu = value;
+    return true;
+}
 
-    if (!strcmp(optarg, "uhid")) {
-        *mode = SC_KEYBOARD_INPUT_MODE_UHID;
-        return true;
-    }
+static bool
+parse_cpu_list(const char *s, uint64_t *cpus) {
+    // List of cores or ranges of cores, separated by commas: "0,2,4-7"
+    uint64_t mask = 0;
+    const char *c = s;
+    for (;;) {
+        char *end;
+        long first;
+        if (!parse_cpu_index(c, &end, &first)) {
+            goto error;
+        }
 
-    if (!strcmp(optarg, "aoa")) {
-#ifdef HAVE_USB
-        *mode = SC_KEYBOARD_INPUT_MODE_AOA;
-        return true;
-#else
-        LOGE("--keyboard=aoa is disabled.");
-        return false;
-#endif
+        long last = first;
+        if (*end == '-') {
+            if (!parse_cpu_index(end + 1, &end, &last) || last < first) {
+                goto error;
+            }
+        }
+
+        for (long cpu = first; cpu <= last; ++cpu) {
+            mask |= UINT64_C(1) << cpu;
+        }
+
+        if (*end == '\0') {
+            break;
+        }
+        if (*end != ',') {
+            goto error;
+        }
+        c = end + 1;
     }
 
-    LOGE("Unsupported keyboard: %s (expected disabled, sdk, uhid and aoa)",
-         optarg);
+    *cpus = mask;
+    return true;
+
+error:
+    LOGE("Could not parse CPU list (cores between 0 and 63): %s", s);
     return false;
 }
 
-static bool
-parse_mouse(const char *optarg, enum sc_mouse_input_mode *mode) {
-    if (!strcmp(optarg, "disabled")) {
-        *mode = SC_MOUSE_INPUT_MODE_DISABLED;
-        return true;
-    }
-
-    if (!strcmp(optarg, "sdk")) {
-        *mode = SC_MOUSE_INPUT_MODE_SDK;
-        return true;
+// Get the policy of the thread `name` (of `len` characters), added if needed
+static struct sc_thread_policy *
+get_thread_policy(struct scrcpy_options *opts, const char *name, size_t len) {
+    size_t max_len = sizeof(opts->thread_policies[0].name) - 1;
+    if (!len || len > max_len) {
+        LOGE("Invalid thread name (1 to %zu characters, without the \""
+             SC_THREAD_NAME_PREFIX "\" prefix): %.*s", max_len, (int) len,
+             name);
+        return NULL;
     }
 
-    if (!strcmp(optarg, "uhid")) {
-        *mode = SC_MOUSE_INPUT_MODE_UHID;
-        return true;
+    for (unsigned i = 0; i < opts->thread_policy_count; ++i) {
+        struct sc_thread_policy *policy = &opts->thread_policies[i];
+        if (!strncmp(policy->name, name, len) && !policy->name[len]) {
+            return policy;
+        }
     }
 
-    if (!strcmp(optarg, "aoa")) {
-#ifdef HAVE_USB
-        *mode = SC_MOUSE_INPUT_MODE_AOA;
-        return true;
-#else
-        LOGE("--mouse=aoa is disabled.");
-        return false;
-#endif
+    if (opts->thread_policy_count == SC_MAX_THREAD_POLICIES) {
+        LOGE("Too many thread policies (at most %d)", SC_MAX_THREAD_POLICIES);
+        return NULL;
     }
 
-    LOGE("Unsupported mouse: %s (expected disabled, sdk, uhid or aoa)", optarg);
-    return false;
+    struct sc_thread_policy *policy =
+        &opts->thread_policies[opts->thread_policy_count++];
+    memcpy(policy->name, name, len);
+    policy->name[len] = '\0';
+    policy->cpus = 0;
+    policy->realtime = false;
+    return policy;
 }
 
 static bool
-parse_gamepad(const char *optarg, enum sc_gamepad_input_mode *mode) {
-    if (!strcmp(optarg, "disabled")) {
-        *mode = SC_GAMEPAD_INPUT_MODE_DISABLED;
-        return true;
+parse_thread_affinity(const char *s, struct scrcpy_options *opts) {
+    // A thread name and a list of cores: "demuxer:0-1"
+    const char *sep = strchr(s, ':');
+    if (!sep) {
+        LOGE("Invalid thread affinity (expected name:list, for example "
+             "demuxer:0-1): %s", s);
+        return false;
     }
 
-    if (!strcmp(optarg, "uhid")) {
-        *mode = SC_GAMEPAD_INPUT_MODE_UHID;
-        return true;
+    uint64_t cpus;
+    if (!parse_cpu_list(sep + 1, &cpus)) {
+        return false;
     }
 
-    if (!strcmp(optarg, "aoa")) {
-#ifdef HAVE_USB
-        *mode = SC_GAMEPAD_INPUT_MODE_AOA;
-        return true;
-#else
-        LOGE("--gamepad=aoa is disabled.");
+    struct sc_thread_policy *policy = get_thread_policy(opts, s, sep - s);
+    if (!policy) {
         return false;
-#endif
     }
 
-    LOGE("Unsupported gamepad: %s (expected disabled or aoa)", optarg);
-    return false;
+    policy->cpus = cpus;
+    return true;
 }
 
 static bool
-parse_time_limit(const char *s, sc_tick *tick) {
+parse_realtime_threads(const char *s, struct scrcpy_options *opts) {
+    // Thread names, separated by commas: "demuxer,vproc"
+    for (;;) {
+        size_t len = strcspn(s, ",");
+        struct sc_thread_policy *policy = get_thread_policy(opts, s, len);
+        if (!policy) {
+            return false;
+        }
+        policy->realtime = true;
+
+        if (s[len] == '\0') {
+            return true;
+        }
+        s += len + 1;
+    }
+}
+
+static bool
+parse_decoder_threads(const char *s, unsigned *threads) {
     long value;
-    bool ok = parse_integer_arg(s, &value, false, 0, 0x7FFFFFFF, "time limit");
+    bool ok = parse_integer_arg(s, &value, false, 0, 16, "decoder threads");
     if (!ok) {
         return false;
     }
 
-    *tick = SC_TICK_FROM_SEC(value);
+    *threads = (unsigned) value;
     return true;
 }
 
 static bool
-parse_pause_on_exit(const char *s, enum sc_pause_on_exit *pause_on_exit) {
-    if (!s || !strcmp(s, "true")) {
-        *pause_on_exit = SC_PAUSE_ON_EXIT_TRUE;
+parse_decoder_mode(const char *optarg, enum sc_decoder_mode *mode) {
+    if (!strcmp(optarg, "low-latency")) {
+        *mode = SC_DECODER_MODE_LOW_LATENCY;
         return true;
     }
-
-    if (!strcmp(s, "false")) {
-        *pause_on_exit = SC_PAUSE_ON_EXIT_FALSE;
+    if (!strcmp(optarg, "throughput")) {
+        *mode = SC_DECODER_MODE_THROUGHPUT;
         return true;
     }
+    LOGE("Unsupported decoder mode: %s (expected low-latency or throughput)",
+         optarg);
+    return false;
+}
 
-    if (!strcmp(s, "if-error")) {
-        *pause_on_exit = SC_PAUSE_ON_EXIT_IF_ERROR;
+static bool
+parse_latency_profile(const char *optarg,
+                      enum sc_latency_profile *profile) {
+    if (!strcmp(optarg, "default")) {
+        *profile = SC_LATENCY_PROFILE_DEFAULT;
         return true;
     }
-
-    LOGE("Unsupported pause on exit mode: %s "
-         "(expected true, false or if-error)", s);
+    if (!strcmp(optarg, "ultra-low")) {
+        *profile = SC_LATENCY_PROFILE_ULTRA_LOW;
+        return true;
+    }
+    LOGE("Unsupported latency profile: %s (expected default or ultra-low)",
+         optarg);
     return false;
+}
 
+static bool
+parse_video_transport(const char *optarg,
+                      enum sc_video_transport *transport) {
+    if (!strcmp(optarg, "tcp")) {
+        *transport = SC_VIDEO_TRANSPORT_TCP;
+        return true;
+    }
+    if (!strcmp(optarg, "udp")) {
+        *transport = SC_VIDEO_TRANSPORT_UDP;
+        return true;
+    }
+    LOGE("Unsupported video transport: %s (expected tcp or udp)", optarg);
+    return false;
 }
 
 static bool
-parse_mouse_binding(char c, enum sc_mouse_binding *b) {
-    switch (c) {
-        case '+':
-            *b = SC_MOUSE_BINDING_CLICK;
-            return true;
-        case '-':
-            *b = SC_MOUSE_BINDING_DISABLED;
+parse_stereo_view(const char *optarg, enum sc_stereo_view *view) {
+    for (unsigned i = 0; i < SC_STEREO_VIEW_COUNT; ++i) {
+        if (!strcmp(optarg, sc_stereo_view_get_name(i))) {
+            *view = i;
             return true;
-        case 'b':
-            *b = SC_MOUSE_BINDING_BACK;
-            return true;
-        case 'h':
-            *b = SC_MOUSE_BINDING_HOME;
-            return true;
-        case 's':
-            *b = SC_MOUSE_BINDING_APP_SWITCH;
-            return true;
-        case 'n':
-            *b = SC_MOUSE_BINDING_EXPAND_NOTIFICATION_PANEL;
-            return true;
-        default:
-            LOGE("Invalid mouse binding: '%c' "
-                 "(expected '+', '-', 'b', 'h', 's' or 'n')", c);
-            return false;
+        }
     }
+    LOGE("Unsupported stereo view: %s (expected side-by-side, left, right, "
+         "top-bottom or anaglyph)", optarg);
+    return false;
 }
 
 static bool
-parse_mouse_binding_set(const char *s, struct sc_mouse_binding_set *mbs) {
-    assert(strlen(s) >= 4);
+parse_video_fec(const char *s, uint8_t *fec) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 0xFF, "video FEC");
+    if (!ok) {
+        return false;
+    }
 
-    if (!parse_mouse_binding(s[0], &mbs->right_click)) {
+    *fec = (uint8_t) value;
+    return true;
+}
+
+static bool
+parse_video_send_buffer(const char *s, uint32_t *size) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, true, 0, 0x1000000,
+                                "video send buffer");
+    if (!ok) {
         return false;
     }
-    if (!parse_mouse_binding(s[1], &mbs->middle_click)) {
+
+    if (value && value < 0x1000) {
+        LOGE("Video send buffer too small (at least 4K): %s", s);
         return false;
     }
-    if (!parse_mouse_binding(s[2], &mbs->click4)) {
+
+    *size = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_multi_device(const char *s, const char **multi_device) {
+    unsigned count = 1;
+    const char *item = s;
+    for (const char *c = s;; ++c) {
+        if (*c == ',' || *c == '\0') {
+            if (c == item) {
+                LOGE("Invalid device list (empty serial): %s", s);
+                return false;
+            }
+            if (*c == '\0') {
+                break;
+            }
+            ++count;
+            item = c + 1;
+        }
+    }
+
+    if (count > SC_MAX_MULTI_DEVICES) {
+        LOGE("Too many devices (%u), at most %u may be captured at once",
+             count, SC_MAX_MULTI_DEVICES);
         return false;
     }
-    if (!parse_mouse_binding(s[3], &mbs->click5)) {
+
+    *multi_device = s;
+    return true;
+}
+
+static bool
+parse_multi_device_sync(const char *s, sc_tick *tolerance) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 1000,
+                                "multi-device sync tolerance");
+    if (!ok) {
         return false;
     }
 
+    *tolerance = SC_TICK_FROM_MS(value);
     return true;
 }
 
 static bool
-parse_mouse_bindings(const char *s, struct sc_mouse_bindings *mb) {
-    size_t len = strlen(s);
-    // either "xxxx" or "xxxx:xxxx"
-    if (len != 4 && (len != 9 || s[4] != ':')) {
-        LOGE("Invalid mouse bindings: '%s' (expected 'xxxx' or 'xxxx:xxxx', "
-             "with each 'x' being in {'+', '-', 'b', 'h', 's', 'n'})", s);
+parse_record_segment(const char *s, sc_tick *duration) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 24 * 60 * 60,
+                                "record segment duration");
+    if (!ok) {
         return false;
     }
 
-    if (!parse_mouse_binding_set(s, &mb->pri)) {
+    *duration = SC_TICK_FROM_SEC(value);
+    return true;
+}
+
+static bool
+parse_trigger_duration(const char *s, sc_tick *duration, const char *name) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 600, name);
+    if (!ok) {
         return false;
     }
 
-    if (len == 9) {
-        if (!parse_mouse_binding_set(s + 5, &mb->sec)) {
-            return false;
-        }
+    *duration = SC_TICK_FROM_SEC(value);
+    return true;
+}
+
+static bool
+parse_hw_decoder(const char *optarg, enum sc_hw_decoder *hw_decoder) {
+    if (!strcmp(optarg, "none")) {
+        *hw_decoder = SC_HW_DECODER_NONE;
+        return true;
+    }
+    if (!strcmp(optarg, "auto")) {
+        *hw_decoder = SC_HW_DECODER_AUTO;
+        return true;
+    }
+    if (!strcmp(optarg, "d3d11va")) {
+        *hw_decoder = SC_HW_DECODER_D3D11VA;
+        return true;
+    }
+    if (!strcmp(optarg, "vaapi")) {
+        *hw_decoder = SC_HW_DECODER_VAAPI;
+        return true;
+    }
+    if (!strcmp(optarg, "videotoolbox")) {
+        *hw_decoder = SC_HW_DECODER_VIDEOTOOLBOX;
+        return true;
+    }
+    if (!strcmp(optarg, "cuda")) {
+        *hw_decoder = SC_HW_DECODER_CUDA;
+        return true;
+    }
+    LOGE("Unsupported hardware decoder: %s (expected none, auto, d3d11va, "
+         "vaapi, videotoolbox or cuda)", optarg);
+    return false;
+}
+
+static bool
+parse_port_range(const char *s, struct sc_port_range *port_range) {
+    long values[2];
+    size_t count = parse_integers_arg(s, ':', 2, values, 0, 0xFFFF, "port");
+    if (!count) {
+        return false;
+    }
+
+    uint16_t v0 = (uint16_t) values[0];
+    if (count == 1) {
+        port_range->first = v0;
+        port_range->last = v0;
+        return true;
+    }
+
+    assert(count == 2);
+    uint16_t v1 = (uint16_t) values[1];
+    if (v0 < v1) {
+        port_range->first = v0;
+        port_range->last = v1;
     } else {
-        // use the same bindings for Shift+click
-        mb->sec = mb->pri;
+        port_range->first = v1;
+        port_range->last = v0;
     }
 
     return true;
 }
 
 static bool
-parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
-                       const char *optstring, const struct option *longopts) {
-    struct scrcpy_options *opts = &args->opts;
+parse_ip_port(const char *s, const char *name, uint32_t *host,
+              uint16_t *port) {
+    const char *sep = strrchr(s, ':');
+    if (!sep) {
+        LOGE("Invalid %s address (expected ip:port): %s", name, s);
+        return false;
+    }
 
-    optind = 0; // reset to start from the first argument in tests
+    char ip[16];
+    size_t len = sep - s;
+    if (len >= sizeof(ip)) {
+        LOGE("Invalid %s address (expected ip:port): %s", name, s);
+        return false;
+    }
+    memcpy(ip, s, len);
+    ip[len] = '\0';
 
-    int c;
-    while ((c = getopt_long(argc, argv, optstring, longopts, NULL)) != -1) {
-        switch (c) {
+    long value;
+    if (!parse_integer_arg(sep + 1, &value, false, 1, 0xFFFF, "port")) {
+        return false;
+    }
+
+    if (!net_parse_ipv4(ip, host)) {
+        LOGE("Invalid %s IP address: %s", name, ip);
+        return false;
+    }
+
+    *port = (uint16_t) value;
+    return true;
+}
+
+static bool
+parse_latency_probe(const char *s, struct sc_latency_probe_region *region) {
+    long values[4];
+    size_t count = parse_integers_arg(s, ':', 4, values, 0, 0xFFFF,
+                                      "latency probe region");
+    if (!count) {
+        return false;
+    }
+
+    if (count != 4) {
+        LOGE("Invalid latency probe region (expected width:height:x:y): %s",
+             s);
+        return false;
+    }
+
+    if (values[0] < SC_LATENCY_PROBE_CELLS || !values[1]) {
+        LOGE("Latency probe region too small (at least %d pixels wide): %s",
+             SC_LATENCY_PROBE_CELLS, s);
+        return false;
+    }
+
+    region->width = (uint16_t) values[0];
+    region->height = (uint16_t) values[1];
+    region->x = (uint16_t) values[2];
+    region->y = (uint16_t) values[3];
+    return true;
+}
+
+static bool
+parse_video_presets(const char *s, struct scrcpy_options *opts) {
+    // Presets separated by commas: "1920:72,1440:90"
+    unsigned count = 0;
+    for (;;) {
+        if (count == SC_MAX_VIDEO_PRESETS) {
+            LOGE("Too many video presets (max %d): %s", SC_MAX_VIDEO_PRESETS,
+                 s);
+            return false;
+        }
+
+        size_t len = strcspn(s, ",");
+        char item[32];
+        if (len >= sizeof(item)) {
+            LOGE("Invalid video preset: %.*s", (int) len, s);
+            return false;
+        }
+        memcpy(item, s, len);
+        item[len] = '\0';
+
+        long values[2];
+        size_t n = parse_integers_arg(item, ':', 2, values, 0, 0xFFFF,
+                                      "video preset");
+        if (!n) {
+            return false;
+        }
+        if (n != 2) {
+            LOGE("Invalid video preset (expected max-size:max-fps): %s",
+                 item);
+            return false;
+        }
+
+        struct sc_video_preset *preset = &opts->video_presets[count++];
+        // The server captures sizes multiple of 8
+        preset->max_size = (uint16_t) (values[0] & ~7);
+        preset->max_fps = (uint16_t) values[1];
+
+        if (s[len] == '\0') {
+            break;
+        }
+        s += len + 1;
+    }
+
+    opts->video_preset_count = count;
+    return true;
+}
+
+static bool
+parse_display_id(const char *s, uint32_t *display_id) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 0x7FFFFFFF, "display id");
+    if (!ok) {
+        return false;
+    }
+
+    *display_id = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_log_level(const char *s, enum sc_log_level *log_level) {
+    if (!strcmp(s, "verbose")) {
+        *log_level = SC_LOG_LEVEL_VERBOSE;
+        return true;
+    }
+
+    if (!strcmp(s, "debug")) {
+        *log_level = SC_LOG_LEVEL_DEBUG;
+        return true;
+    }
+
+    if (!strcmp(s, "info")) {
+        *log_level = SC_LOG_LEVEL_INFO;
+        return true;
+    }
+
+    if (!strcmp(s, "warn")) {
+        *log_level = SC_LOG_LEVEL_WARN;
+        return true;
+    }
+
+    if (!strcmp(s, "error")) {
+        *log_level = SC_LOG_LEVEL_ERROR;
+        return true;
+    }
+
+    LOGE("Could not parse log level: %s", s);
+    return false;
+}
+
+static enum sc_shortcut_mod
+parse_shortcut_mods_item(const char *item, size_t len) {
+#define STREQ(literal, s, len) \
+    ((sizeof(literal)-1 == len) && !memcmp(literal, s, len))
+
+    if (STREQ("lctrl", item, len)) {
+        return SC_SHORTCUT_MOD_LCTRL;
+    }
+    if (STREQ("rctrl", item, len)) {
+        return SC_SHORTCUT_MOD_RCTRL;
+    }
+    if (STREQ("lalt", item, len)) {
+        return SC_SHORTCUT_MOD_LALT;
+    }
+    if (STREQ("ralt", item, len)) {
+        return SC_SHORTCUT_MOD_RALT;
+    }
+    if (STREQ("lsuper", item, len)) {
+        return SC_SHORTCUT_MOD_LSUPER;
+    }
+    if (STREQ("rsuper", item, len)) {
+        return SC_SHORTCUT_MOD_RSUPER;
+    }
+#undef STREQ
+
+    bool has_plus = strchr(item, '+');
+    if (has_plus) {
+        LOGE("Shortcut mod combination with '+' is not supported anymore: "
+             "'%.*s' (see #4741)", (int) len, item);
+        return 0;
+    }
+
+    LOGE("Unknown modifier key: %.*s "
+         "(must be one of: lctrl, rctrl, lalt, ralt, lsuper, rsuper)",
+         (int) len, item);
+
+    return 0;
+}
+
+static bool
+parse_shortcut_mods(const char *s, uint8_t *shortcut_mods) {
+    uint8_t mods = 0;
+
+    // A list of shortcut modifiers, for example "lctrl,rctrl,rsuper"
+
+    for (;;) {
+        char *comma = strchr(s, ',');
+        assert(!comma || comma > s);
+        size_t limit = comma ? (size_t) (comma - s) : strlen(s);
+
+        enum sc_shortcut_mod mod = parse_shortcut_mods_item(s, limit);
+        if (!mod) {
+            return false;
+        }
+
+        mods |= mod;
+
+        if (!comma) {
+            break;
+        }
+
+        s = comma + 1;
+    }
+
+    *shortcut_mods = mods;
+
+    return true;
+}
+
+#ifdef SC_TEST
+// expose the function to unit-tests
+bool
+sc_parse_shortcut_mods(const char *s, uint8_t *mods) {
+    return parse_shortcut_mods(s, mods);
+}
+#endif
+
+static enum sc_record_format
+get_record_format(const char *name) {
+    if (!strcmp(name, "mp4")) {
+        return SC_RECORD_FORMAT_MP4;
+    }
+    if (!strcmp(name, "mkv")) {
+        return SC_RECORD_FORMAT_MKV;
+    }
+    if (!strcmp(name, "m4a")) {
+        return SC_RECORD_FORMAT_M4A;
+    }
+    if (!strcmp(name, "mka")) {
+        return SC_RECORD_FORMAT_MKA;
+    }
+    if (!strcmp(name, "opus")) {
+        return SC_RECORD_FORMAT_OPUS;
+    }
+    if (!strcmp(name, "aac")) {
+        return SC_RECORD_FORMAT_AAC;
+    }
+    if (!strcmp(name, "flac")) {
+        return SC_RECORD_FORMAT_FLAC;
+    }
+    if (!strcmp(name, "wav")) {
+        return SC_RECORD_FORMAT_WAV;
+    }
+    return 0;
+}
+
+static bool
+parse_record_format(const char *optarg, enum sc_record_format *format) {
+    enum sc_record_format fmt = get_record_format(optarg);
+    if (!fmt) {
+        LOGE("Unsupported record format: %s (expected mp4, mkv, m4a, mka, "
+             "opus, aac, flac or wav)", optarg);
+        return false;
+    }
+
+    *format = fmt;
+    return true;
+}
+
+static bool
+parse_ip(const char *optarg, uint32_t *ipv4) {
+    return net_parse_ipv4(optarg, ipv4);
+}
+
+static bool
+parse_port(const char *optarg, uint16_t *port) {
+    long value;
+    if (!parse_integer_arg(optarg, &value, false, 0, 0xFFFF, "port")) {
+        return false;
+    }
+    *port = (uint16_t) value;
+    return true;
+}
+
+static bool
+parse_listen_address(const char *optarg, const char *name, uint32_t *host,
+                     uint16_t *port) {
+    const char *colon = strchr(optarg, ':');
+    if (colon) {
+        char ip[sizeof("255.255.255.255")];
+        size_t len = colon - optarg;
+        if (len >= sizeof(ip)) {
+            LOGE("Invalid IPv4 address: %s", optarg);
+            return false;
+        }
+        memcpy(ip, optarg, len);
+        ip[len] = '\0';
+        if (!parse_ip(ip, host)) {
+            return false;
+        }
+        optarg = colon + 1;
+    }
+
+    if (!parse_port(optarg, port)) {
+        return false;
+    }
+    if (!*port) {
+        LOGE("The %s port must not be 0", name);
+        return false;
+    }
+    return true;
+}
+
+static enum sc_record_format
+guess_record_format(const char *filename) {
+    const char *dot = strrchr(filename, '.');
+    if (!dot) {
+        return 0;
+    }
+
+    const char *ext = dot + 1;
+    return get_record_format(ext);
+}
+
+static bool
+parse_video_codec(const char *optarg, enum sc_codec *codec, bool *codec_auto) {
+    *codec_auto = false;
+    if (!strcmp(optarg, "auto")) {
+        // Negotiated at startup (see codec_probe.h)
+        *codec = SC_CODEC_H264;
+        *codec_auto = true;
+        return true;
+    }
+    if (!strcmp(optarg, "h264")) {
+        *codec = SC_CODEC_H264;
+        return true;
+    }
+    if (!strcmp(optarg, "h265")) {
+        *codec = SC_CODEC_H265;
+        return true;
+    }
+    if (!strcmp(optarg, "av1")) {
+        *codec = SC_CODEC_AV1;
+        return true;
+    }
+    LOGE("Unsupported video codec: %s (expected h264, h265, av1 or auto)",
+         optarg);
+    return false;
+}
+
+static bool
+parse_audio_codec(const char *optarg, enum sc_codec *codec) {
+    if (!strcmp(optarg, "opus")) {
+        *codec = SC_CODEC_OPUS;
+        return true;
+    }
+    if (!strcmp(optarg, "aac")) {
+        *codec = SC_CODEC_AAC;
+        return true;
+    }
+    if (!strcmp(optarg, "flac")) {
+        *codec = SC_CODEC_FLAC;
+        return true;
+    }
+    if (!strcmp(optarg, "raw")) {
+        *codec = SC_CODEC_RAW;
+        return true;
+    }
+    LOGE("Unsupported audio codec: %s (expected opus, aac, flac or raw)",
+         optarg);
+    return false;
+}
+
+static bool
+parse_video_source(const char *optarg, enum sc_video_source *source) {
+    if (!strcmp(optarg, "display")) {
+        *source = SC_VIDEO_SOURCE_DISPLAY;
+        return true;
+    }
+
+    if (!strcmp(optarg, "camera")) {
+        *source = SC_VIDEO_SOURCE_CAMERA;
+        return true;
+    }
+
+    LOGE("Unsupported video source: %s (expected display or camera)", optarg);
+    return false;
+}
+
+static bool
+parse_audio_source(const char *optarg, enum sc_audio_source *source) {
+    if (!strcmp(optarg, "mic")) {
+        *source = SC_AUDIO_SOURCE_MIC;
+        return true;
+    }
+
+    if (!strcmp(optarg, "output")) {
+        *source = SC_AUDIO_SOURCE_OUTPUT;
+        return true;
+    }
+
+    if (!strcmp(optarg, "playback")) {
+        *source = SC_AUDIO_SOURCE_PLAYBACK;
+        return true;
+    }
+
+    LOGE("Unsupported audio source: %s (expected output, mic or playback)",
+         optarg);
+    return false;
+}
+
+static bool
+parse_camera_facing(const char *optarg, enum sc_camera_facing *facing) {
+    if (!strcmp(optarg, "front")) {
+        *facing = SC_CAMERA_FACING_FRONT;
+        return true;
+    }
+
+    if (!strcmp(optarg, "back")) {
+        *facing = SC_CAMERA_FACING_BACK;
+        return true;
+    }
+
+    if (!strcmp(optarg, "external")) {
+        *facing = SC_CAMERA_FACING_EXTERNAL;
+        return true;
+    }
+
+    if (*optarg == '\0') {
+        // Empty string is a valid value (equivalent to not passing the option)
+        *facing = SC_CAMERA_FACING_ANY;
+        return true;
+    }
+
+    LOGE("Unsupported camera facing: %s (expected front, back or external)",
+         optarg);
+    return false;
+}
+
+static bool
+parse_camera_fps(const char *s, uint16_t *camera_fps) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 0xFFFF, "camera fps");
+    if (!ok) {
+        return false;
+    }
+
+    *camera_fps = (uint16_t) value;
+    return true;
+}
+
+static bool
+parse_keyboard(const char *optarg, enum sc_keyboard_input_mode *mode) {
+    if (!strcmp(optarg, "disabled")) {
+        *mode = SC_KEYBOARD_INPUT_MODE_DISABLED;
+        return true;
+    }
+
+    if (!strcmp(optarg, "sdk")) {
+        *mode = SC_KEYBOARD_INPUT_MODE_SDK;
+        return true;
+    }
+
+    if (!strcmp(optarg, "uhid")) {
+        *mode = SC_KEYBOARD_INPUT_MODE_UHID;
+        return true;
+    }
+
+    if (!strcmp(optarg, "aoa")) {
+#ifdef HAVE_USB
+        *mode = SC_KEYBOARD_INPUT_MODE_AOA;
+        return true;
+#else
+        LOGE("--keyboard=aoa is disabled.");
+        return false;
+#endif
+    }
+
+    LOGE("Unsupported keyboard: %s (expected disabled, sdk, uhid and aoa)",
+         optarg);
+    return false;
+}
+
+static bool
+parse_mouse(const char *optarg, enum sc_mouse_input_mode *mode) {
+    if (!strcmp(optarg, "disabled")) {
+        *mode = SC_MOUSE_INPUT_MODE_DISABLED;
+        return true;
+    }
+
+    if (!strcmp(optarg, "sdk")) {
+        *mode = SC_MOUSE_INPUT_MODE_SDK;
+        return true;
+    }
+
+    if (!strcmp(optarg, "uhid")) {
+        *mode = SC_MOUSE_INPUT_MODE_UHID;
+        return true;
+    }
+
+    if (!strcmp(optarg, "aoa")) {
+#ifdef HAVE_USB
+        *mode = SC_MOUSE_INPUT_MODE_AOA;
+        return true;
+#else
+        LOGE("--mouse=aoa is disabled.");
+        return false;
+#endif
+    }
+
+    LOGE("Unsupported mouse: %s (expected disabled, sdk, uhid or aoa)", optarg);
+    return false;
+}
+
+static bool
+parse_gamepad(const char *optarg, enum sc_gamepad_input_mode *mode) {
+    if (!strcmp(optarg, "disabled")) {
+        *mode = SC_GAMEPAD_INPUT_MODE_DISABLED;
+        return true;
+    }
+
+    if (!strcmp(optarg, "uhid")) {
+        *mode = SC_GAMEPAD_INPUT_MODE_UHID;
+        return true;
+    }
+
+    if (!strcmp(optarg, "aoa")) {
+#ifdef HAVE_USB
+        *mode = SC_GAMEPAD_INPUT_MODE_AOA;
+        return true;
+#else
+        LOGE("--gamepad=aoa is disabled.");
+        return false;
+#endif
+    }
+
+    LOGE("Unsupported gamepad: %s (expected disabled or aoa)", optarg);
+    return false;
+}
+
+static bool
+parse_time_limit(const char *s, sc_tick *tick) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 0x7FFFFFFF, "time limit");
+    if (!ok) {
+        return false;
+    }
+
+    *tick = SC_TICK_FROM_SEC(value);
+    return true;
+}
+
+static bool
+parse_pause_on_exit(const char *s, enum sc_pause_on_exit *pause_on_exit) {
+    if (!s || !strcmp(s, "true")) {
+        *pause_on_exit = SC_PAUSE_ON_EXIT_TRUE;
+        return true;
+    }
+
+    if (!strcmp(s, "false")) {
+        *pause_on_exit = SC_PAUSE_ON_EXIT_FALSE;
+        return true;
+    }
+
+    if (!strcmp(s, "if-error")) {
+        *pause_on_exit = SC_PAUSE_ON_EXIT_IF_ERROR;
+        return true;
+    }
+
+    LOGE("Unsupported pause on exit mode: %s "
+         "(expected true, false or if-error)", s);
+    return false;
+
+}
+
+static bool
+parse_mouse_binding(char c, enum sc_mouse_binding *b) {
+    switch (c) {
+        case '+':
+            *b = SC_MOUSE_BINDING_CLICK;
+            return true;
+        case '-':
+            *b = SC_MOUSE_BINDING_DISABLED;
+            return true;
+        case 'b':
+            *b = SC_MOUSE_BINDING_BACK;
+            return true;
+        case 'h':
+            *b = SC_MOUSE_BINDING_HOME;
+            return true;
+        case 's':
+            *b = SC_MOUSE_BINDING_APP_SWITCH;
+            return true;
+        case 'n':
+            *b = SC_MOUSE_BINDING_EXPAND_NOTIFICATION_PANEL;
+            return true;
+        default:
+            LOGE("Invalid mouse binding: '%c' "
+                 "(expected '+', '-', 'b', 'h', 's' or 'n')", c);
+            return false;
+    }
+}
+
+static bool
+parse_mouse_binding_set(const char *s, struct sc_mouse_binding_set *mbs) {
+    assert(strlen(s) >= 4);
+
+    if (!parse_mouse_binding(s[0], &mbs->right_click)) {
+        return false;
+    }
+    if (!parse_mouse_binding(s[1], &mbs->middle_click)) {
+        return false;
+    }
+    if (!parse_mouse_binding(s[2], &mbs->click4)) {
+        return false;
+    }
+    if (!parse_mouse_binding(s[3], &mbs->click5)) {
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+parse_mouse_bindings(const char *s, struct sc_mouse_bindings *mb) {
+    size_t len = strlen(s);
+    // either "xxxx" or "xxxx:xxxx"
+    if (len != 4 && (len != 9 || s[4] != ':')) {
+        LOGE("Invalid mouse bindings: '%s' (expected 'xxxx' or 'xxxx:xxxx', "
+             "with each 'x' being in {'+', '-', 'b', 'h', 's', 'n'})", s);
+        return false;
+    }
+
+    if (!parse_mouse_binding_set(s, &mb->pri)) {
+        return false;
+    }
+
+    if (len == 9) {
+        if (!parse_mouse_binding_set(s + 5, &mb->sec)) {
+            return false;
+        }
+    } else {
+        // use the same bindings for Shift+click
+        mb->sec = mb->pri;
+    }
+
+    return true;
+}
+
+// Check the options of the camera capture (--video-source=camera or
+// --camera-record)
+static bool
+check_camera_options(const struct scrcpy_options *opts) {
+    if (opts->camera_id && opts->camera_facing != SC_CAMERA_FACING_ANY) {
+        LOGE("Cannot specify both --camera-id and --camera-facing");
+        return false;
+    }
+
+    if (opts->camera_size && opts->camera_ar) {
+        LOGE("Cannot specify both --camera-size and --camera-ar");
+        return false;
+    }
+
+    if (opts->camera_high_speed && !opts->camera_fps) {
+        LOGE("--camera-high-speed requires an explicit --camera-fps value");
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
+                       const char *optstring, const struct option *longopts) {
+    struct scrcpy_options *opts = &args->opts;
+
+    optind = 0; // reset to start from the first argument in tests
+
+    int c;
+    while ((c = getopt_long(argc, argv, optstring, longopts, NULL)) != -1) {
+        switch (c) {
             case OPT_BIT_RATE:
                 LOGE("--bit-rate has been removed, "
                      "use --video-bit-rate or --audio-bit-rate.");
                 return false;
-            case 'b':
-                if (!parse_bit_rate(optarg, &opts->video_bit_rate)) {
+            case 'b':
+                if (!parse_bit_rate(optarg, &opts->video_bit_rate)) {
+                    return false;
+                }
+                break;
+            case OPT_AUDIO_BIT_RATE:
+                if (!parse_bit_rate(optarg, &opts->audio_bit_rate)) {
+                    return false;
+                }
+                break;
+            case OPT_CROP:
+                opts->crop = optarg;
+                break;
+            case OPT_DISPLAY:
+                LOGW("--display is deprecated, use --display-id instead.");
+                // fall through
+            case OPT_DISPLAY_ID:
+                if (!parse_display_id(optarg, &opts->display_id)) {
+                    return false;
+                }
+                break;
+            case 'd':
+                opts->select_usb = true;
+                break;
+            case 'e':
+                opts->select_tcpip = true;
+                break;
+            case 'f':
+                opts->fullscreen = true;
+                break;
+            case OPT_RECORD_FORMAT:
+                if (!parse_record_format(optarg, &opts->record_format)) {
+                    return false;
+                }
+                break;
+            case 'h':
+                args->help = true;
+                break;
+            case 'K':
+                opts->keyboard_input_mode = SC_KEYBOARD_INPUT_MODE_UHID_OR_AOA;
+                break;
+            case OPT_KEYBOARD:
+                if (!parse_keyboard(optarg, &opts->keyboard_input_mode)) {
+                    return false;
+                }
+                break;
+            case OPT_HID_KEYBOARD_DEPRECATED:
+                LOGE("--hid-keyboard has been removed, use --keyboard=aoa or "
+                     "--keyboard=uhid instead.");
+                return false;
+            case OPT_MAX_FPS:
+                opts->max_fps = optarg;
+                break;
+            case OPT_VIDEO_PRESETS:
+                if (!parse_video_presets(optarg, opts)) {
+                    return false;
+                }
+                break;
+            case 'm':
+                if (!parse_max_size(optarg, &opts->max_size)) {
+                    return false;
+                }
+                break;
+            case 'M':
+                opts->mouse_input_mode = SC_MOUSE_INPUT_MODE_UHID_OR_AOA;
+                break;
+            case OPT_MOUSE:
+                if (!parse_mouse(optarg, &opts->mouse_input_mode)) {
+                    return false;
+                }
+                break;
+            case OPT_MOUSE_BIND:
+                if (!parse_mouse_bindings(optarg, &opts->mouse_bindings)) {
+                    return false;
+                }
+                break;
+            case OPT_NO_MOUSE_HOVER:
+                opts->mouse_hover = false;
+                break;
+            case OPT_HID_MOUSE_DEPRECATED:
+                LOGE("--hid-mouse has been removed, use --mouse=aoa or "
+                     "--mouse=uhid instead.");
+                return false;
+            case OPT_LOCK_VIDEO_ORIENTATION:
+                if (!parse_lock_video_orientation(optarg,
+                        &opts->lock_video_orientation)) {
+                    return false;
+                }
+                break;
+            case OPT_TUNNEL_HOST:
+                if (!parse_ip(optarg, &opts->tunnel_host)) {
+                    return false;
+                }
+                break;
+            case OPT_TUNNEL_PORT:
+                if (!parse_port(optarg, &opts->tunnel_port)) {
+                    return false;
+                }
+                break;
+            case 'n':
+                opts->control = false;
+                break;
+            case OPT_NO_DISPLAY:
+                LOGW("--no-display is deprecated, use --no-playback instead.");
+                // fall through
+            case 'N':
+                opts->video_playback = false;
+                opts->audio_playback = false;
+                break;
+            case OPT_NO_VIDEO_PLAYBACK:
+                opts->video_playback = false;
+                break;
+            case OPT_NO_AUDIO_PLAYBACK:
+                opts->audio_playback = false;
+                break;
+            case 'p':
+                if (!parse_port_range(optarg, &opts->port_range)) {
+                    return false;
+                }
+                break;
+            case 'r':
+                opts->record_filename = optarg;
+                break;
+            case 's':
+                opts->serial = optarg;
+                break;
+            case 'S':
+                opts->turn_screen_off = true;
+                break;
+            case 't':
+                opts->show_touches = true;
+                break;
+            case OPT_ALWAYS_ON_TOP:
+                opts->always_on_top = true;
+                break;
+            case 'v':
+                args->version = true;
+                break;
+            case 'V':
+                if (!parse_log_level(optarg, &opts->log_level)) {
+                    return false;
+                }
+                break;
+            case 'w':
+                opts->stay_awake = true;
+                break;
+            case OPT_WINDOW_TITLE:
+                opts->window_title = optarg;
+                break;
+            case OPT_WINDOW_X:
+                if (!parse_window_position(optarg, &opts->window_x)) {
+                    return false;
+                }
+                break;
+            case OPT_WINDOW_Y:
+                if (!parse_window_position(optarg, &opts->window_y)) {
+                    return false;
+                }
+                break;
+            case OPT_WINDOW_WIDTH:
+                if (!parse_window_dimension(optarg, &opts->window_width)) {
+                    return false;
+                }
+                break;
+            case OPT_WINDOW_HEIGHT:
+                if (!parse_window_dimension(optarg, &opts->window_height)) {
+                    return false;
+                }
+                break;
+            case OPT_WINDOW_BORDERLESS:
+                opts->window_borderless = true;
+                break;
+            case OPT_PUSH_TARGET:
+                opts->push_target = optarg;
+                break;
+            case OPT_PUSH_WORKERS:
+                if (!parse_push_workers(optarg, &opts->push_workers)) {
+                    return false;
+                }
+                break;
+            case OPT_PREFER_TEXT:
+                if (opts->key_inject_mode != SC_KEY_INJECT_MODE_MIXED) {
+                    LOGE("--prefer-text is incompatible with --raw-key-events");
+                    return false;
+                }
+                opts->key_inject_mode = SC_KEY_INJECT_MODE_TEXT;
+                break;
+            case OPT_RAW_KEY_EVENTS:
+                if (opts->key_inject_mode != SC_KEY_INJECT_MODE_MIXED) {
+                    LOGE("--prefer-text is incompatible with --raw-key-events");
+                    return false;
+                }
+                opts->key_inject_mode = SC_KEY_INJECT_MODE_RAW;
+                break;
+            case OPT_ROTATION:
+                LOGW("--rotation is deprecated, use --display-orientation "
+                     "instead.");
+                uint8_t rotation;
+                if (!parse_rotation(optarg, &rotation)) {
+                    return false;
+                }
+                assert(rotation <= 3);
+                switch (rotation) {
+                    case 0:
+                        opts->display_orientation = SC_ORIENTATION_0;
+                        break;
+                    case 1:
+                        // rotation 1 was 90° counterclockwise, but orientation
+                        // is expressed clockwise
+                        opts->display_orientation = SC_ORIENTATION_270;
+                        break;
+                    case 2:
+                        opts->display_orientation = SC_ORIENTATION_180;
+                        break;
+                    case 3:
+                        // rotation 3 was 270° counterclockwise, but orientation
+                        // is expressed clockwise
+                        opts->display_orientation = SC_ORIENTATION_90;
+                        break;
+                }
+                break;
+            case OPT_DISPLAY_ORIENTATION:
+                if (!parse_orientation(optarg, &opts->display_orientation)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_ORIENTATION:
+                if (!parse_orientation(optarg, &opts->record_orientation)) {
+                    return false;
+                }
+                break;
+            case OPT_ORIENTATION: {
+                enum sc_orientation orientation;
+                if (!parse_orientation(optarg, &orientation)) {
+                    return false;
+                }
+                opts->display_orientation = orientation;
+                opts->record_orientation = orientation;
+                break;
+            }
+            case OPT_RENDER_DRIVER:
+                opts->render_driver = optarg;
+                break;
+            case OPT_NO_MIPMAPS:
+                opts->mipmaps = false;
+                break;
+            case OPT_NO_KEY_REPEAT:
+                opts->forward_key_repeat = false;
+                break;
+            case OPT_CODEC_OPTIONS:
+                LOGE("--codec-options has been removed, "
+                     "use --video-codec-options or --audio-codec-options.");
+                return false;
+            case OPT_VIDEO_CODEC_OPTIONS:
+                opts->video_codec_options = optarg;
+                break;
+            case OPT_AUDIO_CODEC_OPTIONS:
+                opts->audio_codec_options = optarg;
+                break;
+            case OPT_ENCODER:
+                LOGE("--encoder has been removed, "
+                     "use --video-encoder or --audio-encoder.");
+                return false;
+            case OPT_VIDEO_ENCODER:
+                opts->video_encoder = optarg;
+                break;
+            case OPT_AUDIO_ENCODER:
+                opts->audio_encoder = optarg;
+                break;
+            case OPT_FORCE_ADB_FORWARD:
+                opts->force_adb_forward = true;
+                break;
+            case OPT_DISABLE_SCREENSAVER:
+                opts->disable_screensaver = true;
+                break;
+            case OPT_SHORTCUT_MOD:
+                if (!parse_shortcut_mods(optarg, &opts->shortcut_mods)) {
+                    return false;
+                }
+                break;
+            case OPT_FORWARD_ALL_CLICKS:
+                LOGW("--forward-all-clicks is deprecated, "
+                     "use --mouse-bind=++++ instead.");
+                opts->mouse_bindings = (struct sc_mouse_bindings) {
+                    .pri = {
+                        .right_click = SC_MOUSE_BINDING_CLICK,
+                        .middle_click = SC_MOUSE_BINDING_CLICK,
+                        .click4 = SC_MOUSE_BINDING_CLICK,
+                        .click5 = SC_MOUSE_BINDING_CLICK,
+                    },
+                    .sec = {
+                        .right_click = SC_MOUSE_BINDING_CLICK,
+                        .middle_click = SC_MOUSE_BINDING_CLICK,
+                        .click4 = SC_MOUSE_BINDING_CLICK,
+                        .click5 = SC_MOUSE_BINDING_CLICK,
+                    },
+                };
+                break;
+            case OPT_LEGACY_PASTE:
+                opts->legacy_paste = true;
+                break;
+            case OPT_POWER_OFF_ON_CLOSE:
+                opts->power_off_on_close = true;
+                break;
+            case OPT_DISPLAY_BUFFER:
+                if (!parse_buffering_time(optarg, &opts->display_buffer)) {
+                    return false;
+                }
+                break;
+            case OPT_NO_CLIPBOARD_AUTOSYNC:
+                opts->clipboard_autosync = false;
+                break;
+            case OPT_TCPIP:
+                opts->tcpip = true;
+                opts->tcpip_dst = optarg;
+                break;
+            case OPT_NO_DOWNSIZE_ON_ERROR:
+                opts->downsize_on_error = false;
+                break;
+            case OPT_NO_VIDEO:
+                opts->video = false;
+                break;
+            case OPT_NO_AUDIO:
+                opts->audio = false;
+                break;
+            case OPT_NO_CLEANUP:
+                opts->cleanup = false;
+                break;
+            case OPT_NO_POWER_ON:
+                opts->power_on = false;
+                break;
+            case OPT_PRINT_FPS:
+                opts->start_fps_counter = true;
+                break;
+            case OPT_CODEC:
+                LOGE("--codec has been removed, "
+                     "use --video-codec or --audio-codec.");
+                return false;
+            case OPT_VIDEO_CODEC:
+                if (!parse_video_codec(optarg, &opts->video_codec,
+                                       &opts->video_codec_auto)) {
+                    return false;
+                }
+                break;
+            case OPT_AUDIO_CODEC:
+                if (!parse_audio_codec(optarg, &opts->audio_codec)) {
+                    return false;
+                }
+                break;
+            case OPT_OTG:
+#ifdef HAVE_USB
+                opts->otg = true;
+                break;
+#else
+                LOGE("OTG mode (--otg) is disabled.");
+                return false;
+#endif
+            case OPT_V4L2_SINK:
+#ifdef HAVE_V4L2
+                opts->v4l2_device = optarg;
+                break;
+#else
+                LOGE("V4L2 (--v4l2-sink) is disabled (or unsupported on this "
+                     "platform).");
+                return false;
+#endif
+            case OPT_V4L2_BUFFER:
+#ifdef HAVE_V4L2
+                if (!parse_buffering_time(optarg, &opts->v4l2_buffer)) {
+                    return false;
+                }
+                break;
+#else
+                LOGE("V4L2 (--v4l2-buffer) is disabled (or unsupported on this "
+                     "platform).");
+                return false;
+#endif
+            case OPT_LIST_ENCODERS:
+                opts->list |= SC_OPTION_LIST_ENCODERS;
+                break;
+            case OPT_LIST_DISPLAYS:
+                opts->list |= SC_OPTION_LIST_DISPLAYS;
+                break;
+            case OPT_LIST_CAMERAS:
+                opts->list |= SC_OPTION_LIST_CAMERAS;
+                break;
+            case OPT_LIST_CAMERA_SIZES:
+                opts->list |= SC_OPTION_LIST_CAMERA_SIZES;
+                break;
+            case OPT_PROBE_ENCODERS:
+                opts->list |= SC_OPTION_PROBE_ENCODERS;
+                break;
+            case OPT_REQUIRE_AUDIO:
+                opts->require_audio = true;
+                break;
+            case OPT_AUDIO_BUFFER:
+                if (!parse_buffering_time(optarg, &opts->audio_buffer)) {
+                    return false;
+                }
+                break;
+            case OPT_AUDIO_LATENCY:
+                if (!parse_audio_latency(optarg, &opts->audio_latency)) {
                     return false;
                 }
                 break;
-            case OPT_AUDIO_BIT_RATE:
-                if (!parse_bit_rate(optarg, &opts->audio_bit_rate)) {
+            case OPT_AUDIO_READ_SIZE:
+                if (!parse_audio_read_size(optarg, &opts->audio_read_size)) {
                     return false;
                 }
                 break;
-            case OPT_CROP:
-                opts->crop = optarg;
+            case OPT_AUDIO_OUTPUT_BUFFER:
+                if (!parse_audio_output_buffer(optarg,
+                                               &opts->audio_output_buffer)) {
+                    return false;
+                }
                 break;
-            case OPT_DISPLAY:
-                LOGW("--display is deprecated, use --display-id instead.");
-                // fall through
-            case OPT_DISPLAY_ID:
-                if (!parse_display_id(optarg, &opts->display_id)) {
+            case OPT_VIDEO_SOURCE:
+                if (!parse_video_source(optarg, &opts->video_source)) {
                     return false;
                 }
                 break;
-            case 'd':
-                opts->select_usb = true;
+            case OPT_AUDIO_SOURCE:
+                if (!parse_audio_source(optarg, &opts->audio_source)) {
+                    return false;
+                }
                 break;
-            case 'e':
-                opts->select_tcpip = true;
+            case OPT_KILL_ADB_ON_CLOSE:
+                opts->kill_adb_on_close = true;
                 break;
-            case 'f':
-                opts->fullscreen = true;
+            case OPT_TIME_LIMIT:
+                if (!parse_time_limit(optarg, &opts->time_limit)) {
+                    return false;
+                }
                 break;
-            case OPT_RECORD_FORMAT:
-                if (!parse_record_format(optarg, &opts->record_format)) {
+            case OPT_PAUSE_ON_EXIT:
+                if (!parse_pause_on_exit(optarg, &args->pause_on_exit)) {
                     return false;
                 }
                 break;
-            case 'h':
-                args->help = true;
+            case OPT_CAMERA_AR:
+                opts->camera_ar = optarg;
                 break;
-            case 'K':
-                opts->keyboard_input_mode = SC_KEYBOARD_INPUT_MODE_UHID_OR_AOA;
+            case OPT_CAMERA_ID:
+                opts->camera_id = optarg;
                 break;
-            case OPT_KEYBOARD:
-                if (!parse_keyboard(optarg, &opts->keyboard_input_mode)) {
+            case OPT_CAMERA_SIZE:
+                opts->camera_size = optarg;
+                break;
+            case OPT_CAMERA_FACING:
+                if (!parse_camera_facing(optarg, &opts->camera_facing)) {
                     return false;
                 }
                 break;
-            case OPT_HID_KEYBOARD_DEPRECATED:
-                LOGE("--hid-keyboard has been removed, use --keyboard=aoa or "
-                     "--keyboard=uhid instead.");
-                return false;
-            case OPT_MAX_FPS:
-                opts->max_fps = optarg;
+            case OPT_CAMERA_FPS:
+                if (!parse_camera_fps(optarg, &opts->camera_fps)) {
+                    return false;
+                }
                 break;
-            case 'm':
-                if (!parse_max_size(optarg, &opts->max_size)) {
+            case OPT_CAMERA_HIGH_SPEED:
+                opts->camera_high_speed = true;
+                break;
+            case OPT_CAPTURE_EXPOSURE:
+                opts->capture_exposure = true;
+                break;
+            case OPT_NO_WINDOW:
+                opts->window = false;
+                break;
+            case OPT_AUDIO_DUP:
+                opts->audio_dup = true;
+                break;
+            case 'G':
+                opts->gamepad_input_mode = SC_GAMEPAD_INPUT_MODE_UHID_OR_AOA;
+                break;
+            case OPT_GAMEPAD:
+                if (!parse_gamepad(optarg, &opts->gamepad_input_mode)) {
                     return false;
                 }
                 break;
-            case 'M':
-                opts->mouse_input_mode = SC_MOUSE_INPUT_MODE_UHID_OR_AOA;
+            case OPT_SAVE_FRAMES:
+                opts->save_frames = true;
                 break;
-            case OPT_MOUSE:
-                if (!parse_mouse(optarg, &opts->mouse_input_mode)) {
+            case OPT_FRAME_DIR:
+                opts->frame_dir = optarg;
+                break;
+            case OPT_OPENCV:
+                opts->opencv_enabled = true;
+                break;
+            case OPT_OPENCV_MAP:
+            case OPT_OPENCV_CALIB:
+                // The format is detected when the file is loaded
+                if (opts->opencv_map_path) {
+                    LOGE("--opencv-map and --opencv-calib may only be set "
+                         "once");
                     return false;
                 }
+                opts->opencv_map_path = optarg;
                 break;
-            case OPT_MOUSE_BIND:
-                if (!parse_mouse_bindings(optarg, &opts->mouse_bindings)) {
+            case OPT_PIPE_TARGET:
+                opts->pipe_target = optarg;
+                break;
+            case OPT_PIPE_BUFFER_SIZE:
+                if (!parse_pipe_buffer_size(optarg,
+                                            &opts->pipe_buffer_size)) {
                     return false;
                 }
                 break;
-            case OPT_NO_MOUSE_HOVER:
-                opts->mouse_hover = false;
+            case OPT_PIPE_OUTPUT:
+                if (!parse_pipe_output(optarg, opts)) {
+                    return false;
+                }
                 break;
-            case OPT_HID_MOUSE_DEPRECATED:
-                LOGE("--hid-mouse has been removed, use --mouse=aoa or "
-                     "--mouse=uhid instead.");
+            case OPT_PIPE_FORMAT:
+                if (!parse_pipe_format(optarg, &opts->pipe_format)) {
+                    return false;
+                }
+                break;
+            case OPT_PIPE_PAYLOAD_CRC:
+                opts->pipe_payload_crc = true;
+                break;
+            case OPT_PUBLISH:
+                if (!parse_listen_address(optarg, "publish",
+                                          &opts->publish_host,
+                                          &opts->publish_port)) {
+                    return false;
+                }
+                break;
+            case OPT_PUBLISH_QUEUE:
+                if (!parse_publish_queue(optarg, &opts->publish_queue)) {
+                    return false;
+                }
+                break;
+            case OPT_PUBLISH_DROP:
+                if (!parse_publish_drop(optarg, &opts->publish_drop)) {
+                    return false;
+                }
+                break;
+            case OPT_PIPE_FEEDBACK:
+                if (!parse_listen_address(optarg, "pipe feedback",
+                                          &opts->pipe_feedback_host,
+                                          &opts->pipe_feedback_port)) {
+                    return false;
+                }
+                break;
+            case OPT_PIPE_BACKPRESSURE:
+                if (!parse_pipe_backpressure(optarg,
+                                             &opts->pipe_backpressure)) {
+                    return false;
+                }
+                break;
+            case OPT_ADB_PATH:
+                opts->adb_path = optarg;
+                break;
+            case OPT_SHOW_TIMESTAMPS:
+                opts->show_timestamps = true;
+                break;
+            case OPT_SAVE_FRAMES_FORMAT:
+                if (!parse_save_frames_format(optarg,
+                                              &opts->save_frames_format)) {
+                    return false;
+                }
+                break;
+            case OPT_SAVE_FRAMES_QUALITY:
+                if (!parse_save_frames_quality(optarg,
+                                               &opts->save_frames_quality)) {
+                    return false;
+                }
+                break;
+            case OPT_SAVE_FRAMES_IO:
+                if (!parse_save_frames_io(optarg, &opts->save_frames_io)) {
+                    return false;
+                }
+                break;
+            case OPT_SAVE_FRAMES_DIRECT:
+                opts->save_frames_direct = true;
+                break;
+            case OPT_SAVE_FRAMES_ZSTD:
+                if (!parse_save_frames_zstd(optarg,
+                                            &opts->save_frames_zstd)) {
+                    return false;
+                }
+                break;
+            case OPT_SAVE_FRAMES_ZSTD_DICT:
+                opts->save_frames_zstd_dict = optarg;
+                break;
+            case OPT_SAVE_FRAMES_TILE_DELTA:
+                if (!parse_tile_threshold(optarg,
+                                          &opts->save_frames_tile_threshold)) {
+                    return false;
+                }
+                opts->save_frames_tile_delta = true;
+                break;
+            case OPT_SAVE_FRAMES_KEY_INTERVAL:
+                if (!parse_key_interval(optarg,
+                                        &opts->save_frames_key_interval)) {
+                    return false;
+                }
+                break;
+            case OPT_UPLOAD_DIR:
+                opts->upload_dir = optarg;
+                break;
+            case OPT_UPLOAD_THREADS:
+                if (!parse_upload_threads(optarg, &opts->upload_threads)) {
+                    return false;
+                }
+                break;
+            case OPT_UPLOAD_MAX_RATE:
+                if (!parse_upload_max_rate(optarg, &opts->upload_max_rate)) {
+                    return false;
+                }
+                break;
+            case OPT_UPLOAD_DELETE:
+                opts->upload_delete = true;
+                break;
+            case OPT_SAVE_FRAMES_PRE_TRIGGER:
+                if (!parse_trigger_duration(optarg,
+                                            &opts->save_frames_pre_trigger,
+                                            "pre-trigger duration")) {
+                    return false;
+                }
+                break;
+            case OPT_SAVE_FRAMES_POST_TRIGGER:
+                if (!parse_trigger_duration(optarg,
+                                            &opts->save_frames_post_trigger,
+                                            "post-trigger duration")) {
+                    return false;
+                }
+                break;
+            case OPT_OUTPUT_PLANES:
+                if (!parse_output_planes(optarg, &opts->output_planes)) {
+                    return false;
+                }
+                break;
+            case OPT_SAVE_FRAMES_FPS:
+                if (!parse_output_rate(optarg, &opts->save_frames_rate,
+                                       "save frames fps")) {
+                    return false;
+                }
+                break;
+            case OPT_PIPE_OUTPUT_FPS:
+                if (!parse_output_rate(optarg, &opts->pipe_output_rate,
+                                       "pipe output fps")) {
+                    return false;
+                }
+                break;
+            case OPT_MOTION_THRESHOLD:
+                if (!parse_motion_threshold(optarg, &opts->motion_threshold)) {
+                    return false;
+                }
+                break;
+            case OPT_OUTPUT_PYRAMID:
+                if (!parse_output_pyramid(optarg, &opts->output_pyramid)) {
+                    return false;
+                }
+                break;
+            case OPT_SAVE_FRAMES_ARCHIVE:
+                opts->save_frames = true;
+                opts->frame_archive = optarg;
+                break;
+            case OPT_SHM_OUTPUT:
+                opts->shm_output = optarg;
+                break;
+            case OPT_CUDA_IPC_OUTPUT:
+                opts->cuda_ipc_output = optarg;
+                break;
+            case OPT_GPU_REMAP:
+                opts->gpu_remap = true;
+                break;
+            case OPT_GPU_READBACK:
+                opts->gpu_readback = true;
+                break;
+            case OPT_NO_PBO_UPLOAD:
+                opts->pbo_upload = false;
+                break;
+            case OPT_RENDER_THREAD:
+#ifdef __APPLE__
+                // Cocoa requires the OpenGL context to be used from the main
+                // thread
+                LOGE("--render-thread is not supported on macOS");
                 return false;
-            case OPT_LOCK_VIDEO_ORIENTATION:
-                if (!parse_lock_video_orientation(optarg,
-                        &opts->lock_video_orientation)) {
+#else
+                opts->render_thread = true;
+                break;
+#endif
+            case OPT_LOW_LATENCY_PRESENT:
+                opts->low_latency_present = true;
+                break;
+            case OPT_ASYNC_SINKS:
+                opts->async_sinks = true;
+                break;
+            case OPT_STEREO_VIEW:
+                if (!parse_stereo_view(optarg, &opts->stereo_view)) {
                     return false;
                 }
                 break;
-            case OPT_TUNNEL_HOST:
-                if (!parse_ip(optarg, &opts->tunnel_host)) {
+            case OPT_DEVICE_REMAP:
+                opts->device_remap = true;
+                break;
+            case OPT_DEVICE_REMAP_CROP:
+                opts->device_remap_crop = true;
+                break;
+            case OPT_SPLIT_EYES:
+                opts->split_eyes = true;
+                break;
+            case OPT_CAMERA_RECORD:
+                opts->camera_record_filename = optarg;
+                break;
+            case OPT_LATENCY_PROFILE:
+                if (!parse_latency_profile(optarg, &opts->latency_profile)) {
                     return false;
                 }
                 break;
-            case OPT_TUNNEL_PORT:
-                if (!parse_port(optarg, &opts->tunnel_port)) {
+            case OPT_ENCODER_ASYNC:
+                opts->encoder_async = true;
+                break;
+            case OPT_REPEAT_FRAME_DELAY:
+                if (!parse_repeat_frame_delay(optarg,
+                                              &opts->repeat_frame_delay)) {
                     return false;
                 }
                 break;
-            case 'n':
-                opts->control = false;
+            case OPT_SKIP_REPEATED_FRAMES:
+                opts->skip_repeated_frames = true;
                 break;
-            case OPT_NO_DISPLAY:
-                LOGW("--no-display is deprecated, use --no-playback instead.");
-                // fall through
-            case 'N':
-                opts->video_playback = false;
-                opts->audio_playback = false;
+            case OPT_SERVER_DAEMON:
+                opts->server_daemon = true;
                 break;
-            case OPT_NO_VIDEO_PLAYBACK:
-                opts->video_playback = false;
+            case OPT_MOUSE_MOTION_RATE:
+                if (!parse_mouse_motion_rate(optarg,
+                                             &opts->mouse_motion_rate)) {
+                    return false;
+                }
                 break;
-            case OPT_NO_AUDIO_PLAYBACK:
-                opts->audio_playback = false;
+            case OPT_POSE_RATE:
+                if (!parse_pose_rate(optarg, &opts->pose_rate)) {
+                    return false;
+                }
                 break;
-            case 'p':
-                if (!parse_port_range(optarg, &opts->port_range)) {
+            case OPT_OPENCV_BACKEND:
+                if (!parse_opencv_backend(optarg, &opts->opencv_backend)) {
+                    return false;
+                }
+#ifndef HAVE_OPENCV
+                if (opts->opencv_backend != SC_OPENCV_BACKEND_CPU) {
+                    LOGE("OpenCV (--opencv-backend=%s) is disabled, only the "
+                         "cpu backend is available.", optarg);
                     return false;
                 }
+#endif
                 break;
-            case 'r':
-                opts->record_filename = optarg;
+            case OPT_PREPROCESS_THREADS:
+                if (!parse_preprocess_threads(optarg,
+                                              &opts->preprocess_threads)) {
+                    return false;
+                }
                 break;
-            case 's':
-                opts->serial = optarg;
+            case OPT_PREPROCESS_CPUS:
+                if (!parse_cpu_list(optarg, &opts->preprocess_cpus)) {
+                    return false;
+                }
                 break;
-            case 'S':
-                opts->turn_screen_off = true;
+            case OPT_THREAD_AFFINITY:
+                if (!parse_thread_affinity(optarg, opts)) {
+                    return false;
+                }
                 break;
-            case 't':
-                opts->show_touches = true;
+            case OPT_REALTIME_THREADS:
+                if (!parse_realtime_threads(optarg, opts)) {
+                    return false;
+                }
                 break;
-            case OPT_ALWAYS_ON_TOP:
-                opts->always_on_top = true;
+            case OPT_HUGE_PAGES:
+                opts->huge_pages = true;
                 break;
-            case 'v':
-                args->version = true;
+            case OPT_MEMORY_BUDGET:
+                if (!parse_memory_budget(optarg, &opts->memory_budget)) {
+                    return false;
+                }
+                break;
+            case OPT_CATCH_UP:
+                if (!parse_catch_up(optarg, &opts->catch_up)) {
+                    return false;
+                }
+                break;
+            case OPT_LATENCY_BUDGET:
+                if (!parse_latency_budget(optarg, &opts->latency_budget)) {
+                    return false;
+                }
+                break;
+            case OPT_DECODER_THREADS:
+                if (!parse_decoder_threads(optarg, &opts->decoder_threads)) {
+                    return false;
+                }
+                break;
+            case OPT_DECODER_MODE:
+                if (!parse_decoder_mode(optarg, &opts->decoder_mode)) {
+                    return false;
+                }
                 break;
-            case 'V':
-                if (!parse_log_level(optarg, &opts->log_level)) {
+            case OPT_DIRECT_TCP_PORT:
+                if (!parse_port(optarg, &opts->direct_tcp_port)) {
                     return false;
                 }
                 break;
-            case 'w':
-                opts->stay_awake = true;
+            case OPT_RECONNECT_TIMEOUT:
+                if (!parse_reconnect_timeout(optarg,
+                                             &opts->reconnect_timeout)) {
+                    return false;
+                }
                 break;
-            case OPT_WINDOW_TITLE:
-                opts->window_title = optarg;
+            case OPT_SERVER_ADDRESS:
+                if (!parse_ip_port(optarg, "server", &opts->server_host,
+                                   &opts->server_port)) {
+                    return false;
+                }
                 break;
-            case OPT_WINDOW_X:
-                if (!parse_window_position(optarg, &opts->window_x)) {
+            case OPT_AGGREGATOR:
+                if (!parse_ip_port(optarg, "aggregator",
+                                   &opts->aggregator_host,
+                                   &opts->aggregator_port)) {
                     return false;
                 }
                 break;
-            case OPT_WINDOW_Y:
-                if (!parse_window_position(optarg, &opts->window_y)) {
+            case OPT_AGGREGATOR_NODE:
+                if (!*optarg || strlen(optarg) > 32) {
+                    LOGE("Invalid aggregator node name (1 to 32 "
+                         "characters): %s", optarg);
                     return false;
                 }
+                opts->aggregator_node = optarg;
                 break;
-            case OPT_WINDOW_WIDTH:
-                if (!parse_window_dimension(optarg, &opts->window_width)) {
+            case OPT_VIDEO_TRANSPORT:
+                if (!parse_video_transport(optarg, &opts->video_transport)) {
                     return false;
                 }
                 break;
-            case OPT_WINDOW_HEIGHT:
-                if (!parse_window_dimension(optarg, &opts->window_height)) {
+            case OPT_VIDEO_FEC:
+                if (!parse_video_fec(optarg, &opts->video_fec)) {
                     return false;
                 }
                 break;
-            case OPT_WINDOW_BORDERLESS:
-                opts->window_borderless = true;
+            case OPT_VIDEO_SEND_BUFFER:
+                if (!parse_video_send_buffer(optarg,
+                                             &opts->video_send_buffer)) {
+                    return false;
+                }
                 break;
-            case OPT_PUSH_TARGET:
-                opts->push_target = optarg;
+            case OPT_ADAPTIVE_BIT_RATE:
+                opts->adaptive_bit_rate = true;
                 break;
-            case OPT_PREFER_TEXT:
-                if (opts->key_inject_mode != SC_KEY_INJECT_MODE_MIXED) {
-                    LOGE("--prefer-text is incompatible with --raw-key-events");
+            case OPT_MULTI_DEVICE:
+                if (!parse_multi_device(optarg, &opts->multi_device)) {
                     return false;
                 }
-                opts->key_inject_mode = SC_KEY_INJECT_MODE_TEXT;
                 break;
-            case OPT_RAW_KEY_EVENTS:
-                if (opts->key_inject_mode != SC_KEY_INJECT_MODE_MIXED) {
-                    LOGE("--prefer-text is incompatible with --raw-key-events");
+            case OPT_MULTI_DEVICE_SYNC:
+                if (!parse_multi_device_sync(optarg,
+                                             &opts->multi_device_sync)) {
                     return false;
                 }
-                opts->key_inject_mode = SC_KEY_INJECT_MODE_RAW;
                 break;
-            case OPT_ROTATION:
-                LOGW("--rotation is deprecated, use --display-orientation "
-                     "instead.");
-                uint8_t rotation;
-                if (!parse_rotation(optarg, &rotation)) {
+            case OPT_NUMA:
+                opts->numa = true;
+                break;
+            case OPT_RECORD_RECTIFIED:
+                opts->record_rectified = true;
+                break;
+            case OPT_RECORD_TIMESTAMPS:
+                opts->record_timestamps = true;
+                break;
+            case OPT_TIMESTAMP_SEI:
+                opts->timestamp_sei = true;
+                break;
+            case OPT_RECORD_SEGMENT:
+                if (!parse_record_segment(optarg, &opts->record_segment)) {
                     return false;
                 }
-                assert(rotation <= 3);
-                switch (rotation) {
-                    case 0:
-                        opts->display_orientation = SC_ORIENTATION_0;
-                        break;
-                    case 1:
-                        // rotation 1 was 90° counterclockwise, but orientation
-                        // is expressed clockwise
-                        opts->display_orientation = SC_ORIENTATION_270;
-                        break;
-                    case 2:
-                        opts->display_orientation = SC_ORIENTATION_180;
-                        break;
-                    case 3:
-                        // rotation 3 was 270° counterclockwise, but orientation
-                        // is expressed clockwise
-                        opts->display_orientation = SC_ORIENTATION_90;
-                        break;
+                break;
+            case OPT_RECORD_FRAGMENTED:
+                opts->record_fragmented = true;
+                break;
+            case OPT_V4L2_SINK_LEFT:
+#ifdef HAVE_V4L2
+                opts->v4l2_device_left = optarg;
+                break;
+#else
+                LOGE("V4L2 (--v4l2-sink-left) is disabled (or unsupported on "
+                     "this platform).");
+                return false;
+#endif
+            case OPT_V4L2_SINK_RIGHT:
+#ifdef HAVE_V4L2
+                opts->v4l2_device_right = optarg;
+                break;
+#else
+                LOGE("V4L2 (--v4l2-sink-right) is disabled (or unsupported on "
+                     "this platform).");
+                return false;
+#endif
+            case OPT_PIPE_DEPTH:
+#ifdef HAVE_OPENCV
+                opts->pipe_depth = true;
+                break;
+#else
+                LOGE("OpenCV (--pipe-depth) is disabled.");
+                return false;
+#endif
+            case OPT_PIPE_AUDIO:
+                opts->pipe_audio = true;
+                break;
+            case OPT_PRINT_ENCODER_LATENCY:
+                opts->print_encoder_latency = true;
+                break;
+            case OPT_PRINT_LATENCY:
+                opts->print_latency = true;
+                break;
+            case OPT_LATENCY_TRACE:
+                opts->latency_trace_filename = optarg;
+                break;
+            case OPT_LATENCY_PROBE:
+                if (!parse_latency_probe(optarg, &opts->latency_probe)) {
+                    return false;
                 }
                 break;
-            case OPT_DISPLAY_ORIENTATION:
-                if (!parse_orientation(optarg, &opts->display_orientation)) {
+            case OPT_DUMP_STREAM:
+                opts->dump_stream_filename = optarg;
+                break;
+            case OPT_REPLAY:
+                opts->replay_filename = optarg;
+                break;
+            case OPT_REPLAY_MAX_SPEED:
+                opts->replay_max_speed = true;
+                break;
+            case OPT_METRICS:
+                opts->metrics_filename = optarg;
+                break;
+            case OPT_AUTO_TUNE:
+                opts->auto_tune = true;
+                break;
+            case OPT_HUD:
+                opts->hud = true;
+                break;
+            case OPT_HW_DECODER:
+                if (!parse_hw_decoder(optarg, &opts->hw_decoder)) {
                     return false;
                 }
                 break;
-            case OPT_RECORD_ORIENTATION:
-                if (!parse_orientation(optarg, &opts->record_orientation)) {
+            case OPT_PREVIEW_DOWNSCALE:
+                if (!parse_preview_downscale(optarg,
+                                             &opts->preview_downscale)) {
                     return false;
                 }
                 break;
-            case OPT_ORIENTATION: {
-                enum sc_orientation orientation;
-                if (!parse_orientation(optarg, &orientation)) {
+            case OPT_SAVE_FRAMES_THREADS:
+                if (!parse_save_frames_threads(optarg,
+                                               &opts->save_frames_threads)) {
                     return false;
                 }
-                opts->display_orientation = orientation;
-                opts->record_orientation = orientation;
                 break;
+            default:
+                // getopt prints the error message on stderr
+                return false;
+        }
+    }
+
+    int index = optind;
+    if (index < argc) {
+        LOGE("Unexpected additional argument: %s", argv[index]);
+        return false;
+    }
+
+    // If a TCP/IP address is provided, then tcpip must be enabled
+    assert(opts->tcpip || !opts->tcpip_dst);
+
+    unsigned selectors = !!opts->serial
+                       + !!opts->tcpip_dst
+                       + opts->select_tcpip
+                       + opts->select_usb;
+    if (selectors > 1) {
+        LOGE("At most one device selector option may be passed, among:\n"
+             "  --serial (-s)\n"
+             "  --select-usb (-d)\n"
+             "  --select-tcpip (-e)\n"
+             "  --tcpip=<addr> (with an argument)");
+        return false;
+    }
+
+    bool otg = false;
+    bool v4l2 = false;
+    bool v4l2_stereo = false;
+#ifdef HAVE_USB
+    otg = opts->otg;
+#endif
+#ifdef HAVE_V4L2
+    v4l2_stereo = opts->v4l2_device_left || opts->v4l2_device_right;
+    v4l2 = opts->v4l2_device || v4l2_stereo;
+#endif
+
+    if (opts->multi_device_sync && !opts->multi_device) {
+        LOGE("--multi-device-sync requires --multi-device");
+        return false;
+    }
+
+    if (opts->numa && !opts->multi_device) {
+        LOGE("--numa requires --multi-device");
+        return false;
+    }
+
+    if (opts->multi_device) {
+        // Each device is selected by its serial, and they all share the same
+        // adb server and the same stdout
+        if (selectors) {
+            LOGE("--multi-device selects the devices by serial, it is "
+                 "incompatible with any other device selector");
+            return false;
+        }
+        if (opts->pipe_packets) {
+            LOGE("--multi-device is incompatible with --pipe-output=packets");
+            return false;
+        }
+        if (!opts->pipe_output) {
+            LOGE("--multi-device requires --pipe-output");
+            return false;
+        }
+        if (otg || v4l2 || opts->record_filename || opts->save_frames
+                || opts->shm_output || opts->cuda_ipc_output
+                || opts->publish_port) {
+            LOGE("--multi-device only supports --pipe-output (no OTG, no "
+                 "recording, no V4L2 sink, no frame saving, no shared "
+                 "memory or CUDA IPC output, no publisher)");
+            return false;
+        }
+        if (opts->tunnel_host || opts->tunnel_port) {
+            LOGE("--multi-device is incompatible with --tunnel-host and "
+                 "--tunnel-port");
+            return false;
+        }
+        if (opts->kill_adb_on_close) {
+            LOGE("--multi-device is incompatible with --kill-adb-on-close");
+            return false;
+        }
+        if (opts->gpu_remap || opts->preview_downscale > 1) {
+            LOGE("--multi-device has no window, --gpu-remap and "
+                 "--preview-downscale are not supported");
+            return false;
+        }
+
+        // Headless video capture only
+        opts->window = false;
+        opts->audio = false;
+    }
+
+    if (opts->replay_filename) {
+        // Headless, the video is read from the dump
+        opts->window = false;
+        opts->audio = false;
+    }
+
+    if (!opts->window) {
+        // Without window, there cannot be any video playback or control
+        opts->video_playback = false;
+        opts->control = false;
+    }
+
+    if (!opts->video) {
+        opts->video_playback = false;
+        // Do not power on the device on start if video capture is disabled
+        opts->power_on = false;
+    }
+
+    if (!opts->audio) {
+        opts->audio_playback = false;
+    }
+
+    // The decoded frames may be saved, piped or published without window
+    bool frame_outputs = opts->save_frames || opts->pipe_output
+                      || opts->pipe_packets || opts->shm_output
+                      || opts->cuda_ipc_output || opts->publish_port;
+    if (opts->video && !opts->video_playback && !opts->record_filename
+            && !opts->camera_record_filename && !v4l2 && !frame_outputs
+            && !opts->multi_device && !opts->replay_filename
+            && !opts->aggregator_port) {
+        LOGI("No video playback, no recording, no V4L2 sink, no frame "
+             "output: video disabled");
+        opts->video = false;
+    }
+
+    if (opts->audio && !opts->audio_playback && !opts->record_filename
+            && !opts->pipe_audio && !opts->aggregator_port) {
+        LOGI("No audio playback, no recording, no audio pipe: audio disabled");
+        opts->audio = false;
+    }
+
+    if (!opts->video && !opts->audio && !opts->control && !otg) {
+        LOGE("No video, no audio, no control, no OTG: nothing to do");
+        return false;
+    }
+
+    if (!opts->video && !otg) {
+        // If video is disabled, then scrcpy must exit on audio failure.
+        opts->require_audio = true;
+    }
+
+    if (opts->audio_latency == SC_AUDIO_LATENCY_LOW
+            && opts->audio_codec == SC_CODEC_FLAC) {
+        LOGW("--audio-latency=low is ignored for FLAC audio codec, which is "
+             "not low latency");
+        opts->audio_latency = SC_AUDIO_LATENCY_DEFAULT;
+    }
+    bool audio_low_latency = opts->audio_latency == SC_AUDIO_LATENCY_LOW;
+
+    if (opts->audio_output_buffer == -1) {
+        opts->audio_output_buffer = audio_low_latency ? SC_TICK_FROM_MS(3)
+                                                      : SC_TICK_FROM_MS(5);
+    }
+
+    if (opts->audio_playback && opts->audio_buffer == -1) {
+        if (audio_low_latency) {
+            // The encoders produce blocks of 20 ms (960 or 1024 samples), the
+            // raw audio is read by blocks of 10 ms
+            opts->audio_buffer = opts->audio_codec == SC_CODEC_RAW
+                               ? SC_TICK_FROM_MS(20) : SC_TICK_FROM_MS(30);
+        } else if (opts->audio_codec == SC_CODEC_FLAC) {
+            // Use 50 ms audio buffer by default, but use a higher value for
+            // FLAC, which is not low latency (the default encoder produces
+            // blocks of 4096 samples, which represent ~85.333ms).
+            LOGI("FLAC audio: audio buffer increased to 120 ms (use "
+                 "--audio-buffer to set a custom value)");
+            opts->audio_buffer = SC_TICK_FROM_MS(120);
+        } else {
+            opts->audio_buffer = SC_TICK_FROM_MS(50);
+        }
+    }
+
+#ifdef HAVE_V4L2
+    if (v4l2) {
+        if (!opts->video) {
+            LOGE("V4L2 sink requires video capture, but --no-video was set.");
+            return false;
+        }
+
+        if (opts->lock_video_orientation ==
+                SC_LOCK_VIDEO_ORIENTATION_UNLOCKED) {
+            LOGI("Video orientation is locked for v4l2 sink. "
+                 "See --lock-video-orientation.");
+            opts->lock_video_orientation = SC_LOCK_VIDEO_ORIENTATION_INITIAL;
+        }
+
+        // V4L2 could not handle size change.
+        // Do not log because downsizing on error is the default behavior,
+        // not an explicit request from the user.
+        opts->downsize_on_error = false;
+    }
+
+    if (opts->v4l2_buffer && !opts->v4l2_device) {
+        LOGE("V4L2 buffer value without V4L2 sink\n");
+        return false;
+    }
+#endif
+
+    if (v4l2_stereo) {
+        // The halves are taken from the frames processed for the display
+        if (!opts->opencv_enabled || !opts->opencv_map_path) {
+            LOGE("--v4l2-sink-left and --v4l2-sink-right require the "
+                 "rectified frames (--opencv and --opencv-map)");
+            return false;
+        }
+
+        if (opts->preview_downscale > 1) {
+            LOGE("--v4l2-sink-left and --v4l2-sink-right are incompatible "
+                 "with --preview-downscale");
+            return false;
+        }
+    }
+
+    if (opts->control) {
+        if (opts->keyboard_input_mode == SC_KEYBOARD_INPUT_MODE_AUTO) {
+            opts->keyboard_input_mode = otg ? SC_KEYBOARD_INPUT_MODE_AOA
+                                            : SC_KEYBOARD_INPUT_MODE_SDK;
+        } else if (opts->keyboard_input_mode
+                == SC_KEYBOARD_INPUT_MODE_UHID_OR_AOA) {
+            opts->keyboard_input_mode = otg ? SC_KEYBOARD_INPUT_MODE_AOA
+                                            : SC_KEYBOARD_INPUT_MODE_UHID;
+        }
+
+        if (opts->mouse_input_mode == SC_MOUSE_INPUT_MODE_AUTO) {
+            if (otg) {
+                opts->mouse_input_mode = SC_MOUSE_INPUT_MODE_AOA;
+            } else if (!opts->video_playback) {
+                LOGI("No video mirroring, mouse mode switched to UHID");
+                opts->mouse_input_mode = SC_MOUSE_INPUT_MODE_UHID;
+            } else {
+                opts->mouse_input_mode = SC_MOUSE_INPUT_MODE_SDK;
             }
-            case OPT_RENDER_DRIVER:
-                opts->render_driver = optarg;
-                break;
-            case OPT_NO_MIPMAPS:
-                opts->mipmaps = false;
-                break;
-            case OPT_NO_KEY_REPEAT:
-                opts->forward_key_repeat = false;
-                break;
-            case OPT_CODEC_OPTIONS:
-                LOGE("--codec-options has been removed, "
-                     "use --video-codec-options or --audio-codec-options.");
-                return false;
-            case OPT_VIDEO_CODEC_OPTIONS:
-                opts->video_codec_options = optarg;
-                break;
-            case OPT_AUDIO_CODEC_OPTIONS:
-                opts->audio_codec_options = optarg;
-                break;
-            case OPT_ENCODER:
-                LOGE("--encoder has been removed, "
-                     "use --video-encoder or --audio-encoder.");
-                return false;
-            case OPT_VIDEO_ENCODER:
-                opts->video_encoder = optarg;
-                break;
-            case OPT_AUDIO_ENCODER:
-                opts->audio_encoder = optarg;
-                break;
-            case OPT_FORCE_ADB_FORWARD:
-                opts->force_adb_forward = true;
-                break;
-            case OPT_DISABLE_SCREENSAVER:
-                opts->disable_screensaver = true;
-                break;
-            case OPT_SHORTCUT_MOD:
-                if (!parse_shortcut_mods(optarg, &opts->shortcut_mods)) {
-                    return false;
-                }
-                break;
-            case OPT_FORWARD_ALL_CLICKS:
-                LOGW("--forward-all-clicks is deprecated, "
-                     "use --mouse-bind=++++ instead.");
-                opts->mouse_bindings = (struct sc_mouse_bindings) {
-                    .pri = {
-                        .right_click = SC_MOUSE_BINDING_CLICK,
-                        .middle_click = SC_MOUSE_BINDING_CLICK,
-                        .click4 = SC_MOUSE_BINDING_CLICK,
-                        .click5 = SC_MOUSE_BINDING_CLICK,
-                    },
-                    .sec = {
-                        .right_click = SC_MOUSE_BINDING_CLICK,
-                        .middle_click = SC_MOUSE_BINDING_CLICK,
-                        .click4 = SC_MOUSE_BINDING_CLICK,
-                        .click5 = SC_MOUSE_BINDING_CLICK,
-                    },
-                };
-                break;
-            case OPT_LEGACY_PASTE:
-                opts->legacy_paste = true;
-                break;
-            case OPT_POWER_OFF_ON_CLOSE:
-                opts->power_off_on_close = true;
-                break;
-            case OPT_DISPLAY_BUFFER:
-                if (!parse_buffering_time(optarg, &opts->display_buffer)) {
-                    return false;
-                }
-                break;
-            case OPT_NO_CLIPBOARD_AUTOSYNC:
-                opts->clipboard_autosync = false;
-                break;
-            case OPT_TCPIP:
-                opts->tcpip = true;
-                opts->tcpip_dst = optarg;
-                break;
-            case OPT_NO_DOWNSIZE_ON_ERROR:
-                opts->downsize_on_error = false;
-                break;
-            case OPT_NO_VIDEO:
-                opts->video = false;
-                break;
-            case OPT_NO_AUDIO:
-                opts->audio = false;
-                break;
-            case OPT_NO_CLEANUP:
-                opts->cleanup = false;
-                break;
-            case OPT_NO_POWER_ON:
-                opts->power_on = false;
-                break;
-            case OPT_PRINT_FPS:
-                opts->start_fps_counter = true;
-                break;
-            case OPT_CODEC:
-                LOGE("--codec has been removed, "
-                     "use --video-codec or --audio-codec.");
-                return false;
-            case OPT_VIDEO_CODEC:
-                if (!parse_video_codec(optarg, &opts->video_codec)) {
-                    return false;
-                }
-                break;
-            case OPT_AUDIO_CODEC:
-                if (!parse_audio_codec(optarg, &opts->audio_codec)) {
-                    return false;
-                }
-                break;
-            case OPT_OTG:
-#ifdef HAVE_USB
-                opts->otg = true;
-                break;
-#else
-                LOGE("OTG mode (--otg) is disabled.");
+        } else if (opts->mouse_input_mode == SC_MOUSE_INPUT_MODE_UHID_OR_AOA) {
+            opts->mouse_input_mode = otg ? SC_MOUSE_INPUT_MODE_AOA
+                                         : SC_MOUSE_INPUT_MODE_UHID;
+        } else if (opts->mouse_input_mode == SC_MOUSE_INPUT_MODE_SDK
+                    && !opts->video_playback) {
+            LOGE("SDK mouse mode requires video playback. Try --mouse=uhid.");
+            return false;
+        }
+        if (opts->gamepad_input_mode == SC_GAMEPAD_INPUT_MODE_UHID_OR_AOA) {
+            opts->gamepad_input_mode = otg ? SC_GAMEPAD_INPUT_MODE_AOA
+                                           : SC_GAMEPAD_INPUT_MODE_UHID;
+        }
+    }
+
+    // If mouse bindings are not explicitly set, configure default bindings
+    if (opts->mouse_bindings.pri.right_click == SC_MOUSE_BINDING_AUTO) {
+        assert(opts->mouse_bindings.pri.middle_click == SC_MOUSE_BINDING_AUTO);
+        assert(opts->mouse_bindings.pri.click4 == SC_MOUSE_BINDING_AUTO);
+        assert(opts->mouse_bindings.pri.click5 == SC_MOUSE_BINDING_AUTO);
+        assert(opts->mouse_bindings.sec.right_click == SC_MOUSE_BINDING_AUTO);
+        assert(opts->mouse_bindings.sec.middle_click == SC_MOUSE_BINDING_AUTO);
+        assert(opts->mouse_bindings.sec.click4 == SC_MOUSE_BINDING_AUTO);
+        assert(opts->mouse_bindings.sec.click5 == SC_MOUSE_BINDING_AUTO);
+
+        static struct sc_mouse_binding_set default_shortcuts = {
+            .right_click = SC_MOUSE_BINDING_BACK,
+            .middle_click = SC_MOUSE_BINDING_HOME,
+            .click4 = SC_MOUSE_BINDING_APP_SWITCH,
+            .click5 = SC_MOUSE_BINDING_EXPAND_NOTIFICATION_PANEL,
+        };
+
+        static struct sc_mouse_binding_set forward = {
+            .right_click = SC_MOUSE_BINDING_CLICK,
+            .middle_click = SC_MOUSE_BINDING_CLICK,
+            .click4 = SC_MOUSE_BINDING_CLICK,
+            .click5 = SC_MOUSE_BINDING_CLICK,
+        };
+
+        // By default, forward all clicks only for UHID and AOA
+        if (opts->mouse_input_mode == SC_MOUSE_INPUT_MODE_SDK) {
+            opts->mouse_bindings.pri = default_shortcuts;
+            opts->mouse_bindings.sec = forward;
+        } else {
+            opts->mouse_bindings.pri = forward;
+            opts->mouse_bindings.sec = default_shortcuts;
+        }
+    }
+
+    if (otg) {
+        if (!opts->control) {
+            LOGE("--no-control is not allowed in OTG mode");
+            return false;
+        }
+
+        enum sc_keyboard_input_mode kmode = opts->keyboard_input_mode;
+        if (kmode != SC_KEYBOARD_INPUT_MODE_AOA
+                && kmode != SC_KEYBOARD_INPUT_MODE_DISABLED) {
+            LOGE("In OTG mode, --keyboard only supports aoa or disabled.");
+            return false;
+        }
+
+        enum sc_mouse_input_mode mmode = opts->mouse_input_mode;
+        if (mmode != SC_MOUSE_INPUT_MODE_AOA
+                && mmode != SC_MOUSE_INPUT_MODE_DISABLED) {
+            LOGE("In OTG mode, --mouse only supports aoa or disabled.");
+            return false;
+        }
+
+        enum sc_gamepad_input_mode gmode = opts->gamepad_input_mode;
+        if (gmode != SC_GAMEPAD_INPUT_MODE_AOA
+                && gmode != SC_GAMEPAD_INPUT_MODE_DISABLED) {
+            LOGE("In OTG mode, --gamepad only supports aoa or disabled.");
+            return false;
+        }
+
+        if (kmode == SC_KEYBOARD_INPUT_MODE_DISABLED
+                && mmode == SC_MOUSE_INPUT_MODE_DISABLED
+                && gmode == SC_GAMEPAD_INPUT_MODE_DISABLED) {
+            LOGE("Cannot not disable all inputs in OTG mode.");
+            return false;
+        }
+    }
+
+    if (opts->keyboard_input_mode != SC_KEYBOARD_INPUT_MODE_SDK) {
+        if (opts->key_inject_mode == SC_KEY_INJECT_MODE_TEXT) {
+            LOGE("--prefer-text is specific to --keyboard=sdk");
+            return false;
+        }
+
+        if (opts->key_inject_mode == SC_KEY_INJECT_MODE_RAW) {
+            LOGE("--raw-key-events is specific to --keyboard=sdk");
+            return false;
+        }
+
+        if (!opts->forward_key_repeat) {
+            LOGE("--no-key-repeat is specific to --keyboard=sdk");
+            return false;
+        }
+    }
+
+    if (opts->mouse_input_mode != SC_MOUSE_INPUT_MODE_SDK
+            && !opts->mouse_hover) {
+        LOGE("--no-mouse-over is specific to --mouse=sdk");
+        return false;
+    }
+
+    if (opts->direct_tcp_port && (opts->tunnel_host || opts->tunnel_port
+                                  || opts->force_adb_forward)) {
+        LOGE("--direct-tcp-port is incompatible with --tunnel-host, "
+             "--tunnel-port and --force-adb-forward");
+        return false;
+    }
+
+    if (opts->video_transport == SC_VIDEO_TRANSPORT_UDP) {
+        if (!opts->direct_tcp_port) {
+            LOGE("--video-transport=udp requires --direct-tcp-port");
+            return false;
+        }
+        if (!opts->control) {
+            LOGW("Without control, the frames lost over UDP are only "
+                 "recovered on the next periodic key frame");
+        }
+    } else if (opts->video_fec) {
+        LOGE("--video-fec is specific to --video-transport=udp");
+        return false;
+    }
+
+    if (opts->video_send_buffer) {
+        if (opts->video_transport == SC_VIDEO_TRANSPORT_UDP) {
+            LOGE("--video-send-buffer is specific to --video-transport=tcp");
+            return false;
+        }
+        if (!opts->video) {
+            LOGE("--video-send-buffer requires video");
+            return false;
+        }
+    }
+
+    if (opts->reconnect_timeout) {
+        if (!opts->direct_tcp_port) {
+            LOGE("--reconnect-timeout requires --direct-tcp-port");
+            return false;
+        }
+        if (opts->video_transport == SC_VIDEO_TRANSPORT_UDP) {
+            LOGE("--reconnect-timeout is specific to --video-transport=tcp");
+            return false;
+        }
+        if (opts->split_eyes) {
+            LOGE("--reconnect-timeout is incompatible with --split-eyes");
+            return false;
+        }
+        if (!opts->video) {
+            LOGE("--reconnect-timeout requires video");
+            return false;
+        }
+    }
+
+    if (opts->server_port) {
+        if (!opts->video || opts->audio || opts->control) {
+            LOGE("--server-address requires video, without audio nor "
+                 "control (--no-audio --no-control)");
+            return false;
+        }
+        if (opts->split_eyes || opts->multi_device || opts->replay_filename) {
+            LOGE("--server-address is incompatible with --split-eyes, "
+                 "--multi-device and --replay");
+            return false;
+        }
+        if (opts->direct_tcp_port || opts->tunnel_host || opts->tunnel_port
+                || opts->force_adb_forward || opts->serial || opts->tcpip
+                || opts->select_usb || opts->select_tcpip
+                || opts->server_daemon || opts->kill_adb_on_close) {
+            LOGE("--server-address does not use adb (no device selection, "
+                 "no tunnel, no server daemon)");
+            return false;
+        }
+    }
+
+    if (opts->video_codec_auto) {
+        if (opts->video_encoder) {
+            LOGE("--video-codec=auto is incompatible with --video-encoder "
+                 "(an encoder supports a single codec)");
+            return false;
+        }
+        if (opts->server_port) {
+            LOGE("--video-codec=auto is incompatible with --server-address "
+                 "(the parameters are not sent to the server)");
+            return false;
+        }
+    }
+
+    if ((opts->tunnel_host || opts->tunnel_port) && !opts->force_adb_forward) {
+        LOGI("Tunnel host/port is set, "
+             "--force-adb-forward automatically enabled.");
+        opts->force_adb_forward = true;
+    }
+
+    if (opts->video_source == SC_VIDEO_SOURCE_CAMERA) {
+        if (opts->display_id) {
+            LOGE("--display-id is only available with --video-source=display");
+            return false;
+        }
+
+        if (!check_camera_options(opts)) {
+            return false;
+        }
+
+        if (opts->camera_size && opts->max_size) {
+            LOGE("Cannot specify both --camera-size and -m/--max-size");
+            return false;
+        }
+
+        if (opts->capture_exposure) {
+            // The exposure follows the capture timestamp, which is only sent
+            // for the frame outputs
+            if (!opts->show_timestamps && !frame_outputs) {
+                LOGE("--capture-exposure requires a frame output "
+                     "(--show-timestamps, --save-frames, --pipe-output, "
+                     "--shm-output, --cuda-ipc-output or --publish)");
                 return false;
-#endif
-            case OPT_V4L2_SINK:
-#ifdef HAVE_V4L2
-                opts->v4l2_device = optarg;
-                break;
-#else
-                LOGE("V4L2 (--v4l2-sink) is disabled (or unsupported on this "
-                     "platform).");
+            }
+            if (opts->video_transport == SC_VIDEO_TRANSPORT_UDP) {
+                // Not carried by the RTP packets
+                LOGE("--capture-exposure is specific to "
+                     "--video-transport=tcp");
                 return false;
-#endif
-            case OPT_V4L2_BUFFER:
-#ifdef HAVE_V4L2
-                if (!parse_buffering_time(optarg, &opts->v4l2_buffer)) {
-                    return false;
-                }
-                break;
-#else
-                LOGE("V4L2 (--v4l2-buffer) is disabled (or unsupported on this "
-                     "platform).");
+            }
+        }
+
+        if (opts->control) {
+            LOGI("Camera video source: control disabled");
+            opts->control = false;
+        }
+    } else if (opts->camera_record_filename) {
+        // The camera options apply to the camera stream (-m/--max-size
+        // applies to both streams, unless --camera-size is set)
+        if (!check_camera_options(opts)) {
+            return false;
+        }
+
+        if (opts->capture_exposure) {
+            LOGE("--capture-exposure is only available with "
+                 "--video-source=camera");
+            return false;
+        }
+    } else if (opts->camera_id
+            || opts->camera_ar
+            || opts->camera_facing != SC_CAMERA_FACING_ANY
+            || opts->camera_fps
+            || opts->camera_high_speed
+            || opts->camera_size
+            || opts->capture_exposure) {
+        LOGE("Camera options are only available with --video-source=camera");
+        return false;
+    }
+
+    if (opts->audio && opts->audio_source == SC_AUDIO_SOURCE_AUTO) {
+        // Select the audio source according to the video source
+        if (opts->video_source == SC_VIDEO_SOURCE_DISPLAY) {
+            if (opts->audio_dup) {
+                LOGI("Audio duplication enabled: audio source switched to "
+                     "\"playback\"");
+                opts->audio_source = SC_AUDIO_SOURCE_PLAYBACK;
+            } else {
+                opts->audio_source = SC_AUDIO_SOURCE_OUTPUT;
+            }
+        } else {
+            opts->audio_source = SC_AUDIO_SOURCE_MIC;
+            LOGI("Camera video source: microphone audio source selected");
+        }
+    }
+
+    if (opts->audio_dup) {
+        if (!opts->audio) {
+            LOGE("--audio-dup not supported if audio is disabled");
+            return false;
+        }
+
+        if (opts->audio_source != SC_AUDIO_SOURCE_PLAYBACK) {
+            LOGE("--audio-dup is specific to --audio-source=playback");
+            return false;
+        }
+    }
+
+    if (opts->record_format && !opts->record_filename) {
+        LOGE("Record format specified without recording");
+        return false;
+    }
+
+    if (opts->record_filename) {
+        if (!opts->video && !opts->audio) {
+            LOGE("Video and audio disabled, nothing to record");
+            return false;
+        }
+
+        if (!opts->record_format) {
+            opts->record_format = guess_record_format(opts->record_filename);
+            if (!opts->record_format) {
+                LOGE("No format specified for \"%s\" "
+                     "(try with --record-format=mkv)",
+                     opts->record_filename);
                 return false;
-#endif
-            case OPT_LIST_ENCODERS:
-                opts->list |= SC_OPTION_LIST_ENCODERS;
-                break;
-            case OPT_LIST_DISPLAYS:
-                opts->list |= SC_OPTION_LIST_DISPLAYS;
-                break;
-            case OPT_LIST_CAMERAS:
-                opts->list |= SC_OPTION_LIST_CAMERAS;
-                break;
-            case OPT_LIST_CAMERA_SIZES:
-                opts->list |= SC_OPTION_LIST_CAMERA_SIZES;
-                break;
-            case OPT_REQUIRE_AUDIO:
-                opts->require_audio = true;
-                break;
-            case OPT_AUDIO_BUFFER:
-                if (!parse_buffering_time(optarg, &opts->audio_buffer)) {
-                    return false;
-                }
-                break;
-            case OPT_AUDIO_OUTPUT_BUFFER:
-                if (!parse_audio_output_buffer(optarg,
-                                               &opts->audio_output_buffer)) {
-                    return false;
-                }
-                break;
-            case OPT_VIDEO_SOURCE:
-                if (!parse_video_source(optarg, &opts->video_source)) {
-                    return false;
-                }
-                break;
-            case OPT_AUDIO_SOURCE:
-                if (!parse_audio_source(optarg, &opts->audio_source)) {
-                    return false;
-                }
-                break;
-            case OPT_KILL_ADB_ON_CLOSE:
-                opts->kill_adb_on_close = true;
-                break;
-            case OPT_TIME_LIMIT:
-                if (!parse_time_limit(optarg, &opts->time_limit)) {
-                    return false;
-                }
-                break;
-            case OPT_PAUSE_ON_EXIT:
-                if (!parse_pause_on_exit(optarg, &args->pause_on_exit)) {
-                    return false;
-                }
-                break;
-            case OPT_CAMERA_AR:
-                opts->camera_ar = optarg;
-                break;
-            case OPT_CAMERA_ID:
-                opts->camera_id = optarg;
-                break;
-            case OPT_CAMERA_SIZE:
-                opts->camera_size = optarg;
-                break;
-            case OPT_CAMERA_FACING:
-                if (!parse_camera_facing(optarg, &opts->camera_facing)) {
-                    return false;
-                }
-                break;
-            case OPT_CAMERA_FPS:
-                if (!parse_camera_fps(optarg, &opts->camera_fps)) {
-                    return false;
-                }
-                break;
-            case OPT_CAMERA_HIGH_SPEED:
-                opts->camera_high_speed = true;
-                break;
-            case OPT_NO_WINDOW:
-                opts->window = false;
-                break;
-            case OPT_AUDIO_DUP:
-                opts->audio_dup = true;
-                break;
-            case 'G':
-                opts->gamepad_input_mode = SC_GAMEPAD_INPUT_MODE_UHID_OR_AOA;
-                break;
-            case OPT_GAMEPAD:
-                if (!parse_gamepad(optarg, &opts->gamepad_input_mode)) {
-                    return false;
-                }
-                break;
-            case OPT_SAVE_FRAMES:
-                opts->save_frames = true;
-                break;
-            case OPT_FRAME_DIR:
-                opts->frame_dir = optarg;
-                break;
-            case OPT_OPENCV:
-                opts->opencv_enabled = true;
-                break;
-            case OPT_OPENCV_MAP:
-                opts->opencv_map_path = optarg;
-                break;
-            case OPT_PIPE_OUTPUT:
-                opts->pipe_output = true;
-                break;
-            case OPT_ADB_PATH:
-                opts->adb_path = optarg;
-                break;
-            case OPT_SHOW_TIMESTAMPS:
-                opts->show_timestamps = true;
-                break;
-            default:
-                // getopt prints the error message on stderr
+            }
+        }
+
+        if (opts->record_orientation != SC_ORIENTATION_0) {
+            if (sc_orientation_is_mirror(opts->record_orientation)) {
+                LOGE("Record orientation only supports rotation, not "
+                     "flipping: %s",
+                     sc_orientation_get_name(opts->record_orientation));
                 return false;
+            }
+        }
+
+        if (opts->video
+                && sc_record_format_is_audio_only(opts->record_format)) {
+            LOGE("Audio container does not support video stream");
+            return false;
+        }
+
+        if (opts->record_format == SC_RECORD_FORMAT_OPUS
+                && opts->audio_codec != SC_CODEC_OPUS) {
+            LOGE("Recording to OPUS file requires an OPUS audio stream "
+                 "(try with --audio-codec=opus)");
+            return false;
+        }
+
+        if (opts->record_format == SC_RECORD_FORMAT_AAC
+                && opts->audio_codec != SC_CODEC_AAC) {
+            LOGE("Recording to AAC file requires an AAC audio stream "
+                 "(try with --audio-codec=aac)");
+            return false;
+        }
+        if (opts->record_format == SC_RECORD_FORMAT_FLAC
+                && opts->audio_codec != SC_CODEC_FLAC) {
+            LOGE("Recording to FLAC file requires a FLAC audio stream "
+                 "(try with --audio-codec=flac)");
+            return false;
+        }
+
+        if (opts->record_format == SC_RECORD_FORMAT_WAV
+                && opts->audio_codec != SC_CODEC_RAW) {
+            LOGE("Recording to WAV file requires a RAW audio stream "
+                 "(try with --audio-codec=raw)");
+            return false;
+        }
+
+        if ((opts->record_format == SC_RECORD_FORMAT_MP4 ||
+             opts->record_format == SC_RECORD_FORMAT_M4A)
+                && opts->audio_codec == SC_CODEC_RAW) {
+            LOGE("Recording to MP4 container does not support RAW audio");
+            return false;
+        }
+
+        if (opts->record_fragmented
+                && (opts->record_format != SC_RECORD_FORMAT_MP4
+                    || !opts->video)) {
+            LOGE("--record-fragmented requires a video recording to MP4");
+            return false;
         }
     }
 
-    int index = optind;
-    if (index < argc) {
-        LOGE("Unexpected additional argument: %s", argv[index]);
+    if (opts->audio_codec == SC_CODEC_FLAC && opts->audio_bit_rate) {
+        LOGW("--audio-bit-rate is ignored for FLAC audio codec");
+    }
+
+    if (opts->audio_codec == SC_CODEC_RAW) {
+        if (opts->audio_bit_rate) {
+            LOGW("--audio-bit-rate is ignored for raw audio codec");
+        }
+        if (opts->audio_codec_options) {
+            LOGW("--audio-codec-options is ignored for raw audio codec");
+        }
+        if (opts->audio_encoder) {
+            LOGW("--audio-encoder is ignored for raw audio codec");
+        }
+    }
+
+    if (!opts->control) {
+        if (opts->turn_screen_off) {
+            LOGE("Cannot request to turn screen off if control is disabled");
+            return false;
+        }
+        if (opts->stay_awake) {
+            LOGE("Cannot request to stay awake if control is disabled");
+            return false;
+        }
+        if (opts->show_touches) {
+            LOGE("Cannot request to show touches if control is disabled");
+            return false;
+        }
+        if (opts->power_off_on_close) {
+            LOGE("Cannot request power off on close if control is disabled");
+            return false;
+        }
+    }
+
+# ifdef _WIN32
+    if (!otg && (opts->keyboard_input_mode == SC_KEYBOARD_INPUT_MODE_AOA
+                || opts->mouse_input_mode == SC_MOUSE_INPUT_MODE_AOA)) {
+        LOGE("On Windows, it is not possible to open a USB device already open "
+             "by another process (like adb).");
+        LOGE("Therefore, --keyboard=aoa and --mouse=aoa may only work in OTG"
+             "mode (--otg).");
         return false;
     }
+# endif
 
-    // If a TCP/IP address is provided, then tcpip must be enabled
-    assert(opts->tcpip || !opts->tcpip_dst);
+    if (opts->gpu_remap && !(opts->opencv_enabled && opts->opencv_map_path)) {
+        LOGE("--gpu-remap requires --opencv and --opencv-map");
+        return false;
+    }
 
-    unsigned selectors = !!opts->serial
-                       + !!opts->tcpip_dst
-                       + opts->select_tcpip
-                       + opts->select_usb;
-    if (selectors > 1) {
-        LOGE("At most one device selector option may be passed, among:\n"
-             "  --serial (-s)\n"
-             "  --select-usb (-d)\n"
-             "  --select-tcpip (-e)\n"
-             "  --tcpip=<addr> (with an argument)");
+    if (opts->gpu_readback) {
+        if (!opts->opencv_enabled || !opts->opencv_map_path) {
+            LOGE("--gpu-readback requires --opencv and --opencv-map");
+            return false;
+        }
+
+        if (opts->cuda_ipc_output || opts->device_remap) {
+            LOGE("--gpu-readback is incompatible with --cuda-ipc-output and "
+                 "--device-remap");
+            return false;
+        }
+
+        if (opts->multi_device || opts->replay_filename) {
+            LOGE("--gpu-readback requires the video of a single device");
+            return false;
+        }
+    }
+
+    if (opts->cuda_ipc_output) {
+        // The frames are exported by the cuda backend of the client remap
+        if (!opts->opencv_enabled || !opts->opencv_map_path
+                || opts->opencv_backend != SC_OPENCV_BACKEND_CUDA) {
+            LOGE("--cuda-ipc-output requires --opencv, --opencv-map and "
+                 "--opencv-backend=cuda");
+            return false;
+        }
+
+        if (opts->gpu_remap || opts->device_remap) {
+            LOGE("--cuda-ipc-output is incompatible with --gpu-remap and "
+                 "--device-remap");
+            return false;
+        }
+    }
+
+    if (opts->device_remap_crop && !opts->device_remap) {
+        LOGE("--device-remap-crop requires --device-remap");
         return false;
     }
 
-    bool otg = false;
-    bool v4l2 = false;
-#ifdef HAVE_USB
-    otg = opts->otg;
-#endif
+    if (opts->device_remap) {
+        if (!opts->opencv_enabled || !opts->opencv_map_path) {
+            LOGE("--device-remap requires --opencv and --opencv-map");
+            return false;
+        }
+
+        if (!opts->video || opts->multi_device || opts->replay_filename) {
+            LOGE("--device-remap requires the video of a single device");
+            return false;
+        }
+
+        if (opts->gpu_remap) {
+            LOGE("--device-remap is incompatible with --gpu-remap");
+            return false;
+        }
+
+        // The video processor only computes the disparities of the frames it
+        // remaps itself
+        if (opts->pipe_depth) {
+            LOGE("--device-remap is incompatible with --pipe-depth");
+            return false;
+        }
+    }
+
+    if (opts->split_eyes) {
+        if (!opts->video || !opts->video_playback || opts->multi_device
+                || opts->replay_filename) {
+            LOGE("--split-eyes requires the video playback of a single "
+                 "device");
+            return false;
+        }
+
+        // The recorder, the dump and the V4L2 sink receive the stream of a
+        // single encoder
+        if (opts->record_filename && !opts->record_rectified) {
+            LOGE("--split-eyes requires --record-rectified to record");
+            return false;
+        }
+
+        if (opts->dump_stream_filename) {
+            LOGE("--split-eyes is incompatible with --dump-stream");
+            return false;
+        }
+
+        if (opts->pipe_packets) {
+            LOGE("--split-eyes is incompatible with --pipe-output=packets");
+            return false;
+        }
+
 #ifdef HAVE_V4L2
-    v4l2 = !!opts->v4l2_device;
+        if (opts->v4l2_device) {
+            LOGE("--split-eyes is incompatible with --v4l2-sink (use "
+                 "--v4l2-sink-left and --v4l2-sink-right)");
+            return false;
+        }
 #endif
 
-    if (!opts->window) {
-        // Without window, there cannot be any video playback or control
-        opts->video_playback = false;
-        opts->control = false;
+        if (opts->video_transport == SC_VIDEO_TRANSPORT_UDP) {
+            LOGE("--split-eyes is incompatible with --video-transport=udp");
+            return false;
+        }
+
+        // The bit rate control only measures the stream of the left eye
+        if (opts->adaptive_bit_rate) {
+            LOGE("--split-eyes is incompatible with --adaptive-bit-rate");
+            return false;
+        }
     }
 
-    if (!opts->video) {
-        opts->video_playback = false;
-        // Do not power on the device on start if video capture is disabled
-        opts->power_on = false;
+    if (opts->camera_record_filename) {
+        if (!opts->video || opts->video_source != SC_VIDEO_SOURCE_DISPLAY) {
+            LOGE("--camera-record requires the display video source");
+            return false;
+        }
+
+        // The camera is streamed on an additional socket of a single session
+        if (opts->split_eyes || opts->multi_device || opts->replay_filename
+                || opts->server_port || opts->reconnect_timeout
+                || opts->dump_stream_filename
+                || opts->video_transport == SC_VIDEO_TRANSPORT_UDP) {
+            LOGE("--camera-record is incompatible with --split-eyes, "
+                 "--multi-device, --replay, --server-address, "
+                 "--reconnect-timeout, --dump-stream and "
+                 "--video-transport=udp");
+            return false;
+        }
+
+        opts->camera_record_format =
+            guess_record_format(opts->camera_record_filename);
+        if (!opts->camera_record_format
+                || sc_record_format_is_audio_only(opts->camera_record_format)) {
+            LOGE("No video format for \"%s\" (try with a .mp4 or .mkv "
+                 "extension)", opts->camera_record_filename);
+            return false;
+        }
     }
 
-    if (!opts->audio) {
-        opts->audio_playback = false;
+    if (opts->gpu_remap && opts->preview_downscale > 1) {
+        LOGE("--gpu-remap is incompatible with --preview-downscale");
+        return false;
     }
 
-    if (opts->video && !opts->video_playback && !opts->record_filename
-            && !v4l2) {
-        LOGI("No video playback, no recording, no V4L2 sink: video disabled");
-        opts->video = false;
+    if (opts->latency_profile == SC_LATENCY_PROFILE_ULTRA_LOW
+            && opts->decoder_mode == SC_DECODER_MODE_THROUGHPUT) {
+        LOGE("--latency-profile=ultra-low is incompatible with "
+             "--decoder-mode=throughput (each decoder thread adds one frame "
+             "of latency)");
+        return false;
     }
 
-    if (opts->audio && !opts->audio_playback && !opts->record_filename) {
-        LOGI("No audio playback, no recording: audio disabled");
-        opts->audio = false;
+    if (opts->decoder_mode == SC_DECODER_MODE_THROUGHPUT
+            && opts->decoder_threads == 1) {
+        LOGW("--decoder-mode=throughput has no effect with a single decoder "
+             "thread (see --decoder-threads)");
     }
 
-    if (!opts->video && !opts->audio && !opts->control && !otg) {
-        LOGE("No video, no audio, no control, no OTG: nothing to do");
+    if (opts->adaptive_bit_rate && (!opts->video || !opts->control)) {
+        LOGE("--adaptive-bit-rate requires video and control");
         return false;
     }
 
-    if (!opts->video && !otg) {
-        // If video is disabled, then scrcpy must exit on audio failure.
-        opts->require_audio = true;
+    if (opts->video_preset_count
+            && (!opts->video || !opts->control || !opts->window)) {
+        // The presets are switched by a shortcut
+        LOGE("--video-presets requires video, control and a window");
+        return false;
     }
 
-    if (opts->audio_playback && opts->audio_buffer == -1) {
-        if (opts->audio_codec == SC_CODEC_FLAC) {
-            // Use 50 ms audio buffer by default, but use a higher value for
-            // FLAC, which is not low latency (the default encoder produces
-            // blocks of 4096 samples, which represent ~85.333ms).
-            LOGI("FLAC audio: audio buffer increased to 120 ms (use "
-                 "--audio-buffer to set a custom value)");
-            opts->audio_buffer = SC_TICK_FROM_MS(120);
-        } else {
-            opts->audio_buffer = SC_TICK_FROM_MS(50);
+    if (opts->record_rectified) {
+        if (!opts->record_filename || !opts->video) {
+            LOGE("--record-rectified requires video recording (--record)");
+            return false;
+        }
+
+        if (opts->preview_downscale > 1) {
+            LOGE("--record-rectified is incompatible with "
+                 "--preview-downscale");
+            return false;
         }
     }
 
-#ifdef HAVE_V4L2
-    if (v4l2) {
+    if (opts->latency_budget) {
         if (!opts->video) {
-            LOGE("V4L2 sink requires video capture, but --no-video was set.");
+            LOGE("--latency-budget requires video");
             return false;
         }
 
-        if (opts->lock_video_orientation ==
-                SC_LOCK_VIDEO_ORIENTATION_UNLOCKED) {
-            LOGI("Video orientation is locked for v4l2 sink. "
-                 "See --lock-video-orientation.");
-            opts->lock_video_orientation = SC_LOCK_VIDEO_ORIENTATION_INITIAL;
+        // The stale frames are not forwarded to any sink of the processor
+        if (opts->record_rectified || v4l2_stereo) {
+            LOGE("--latency-budget is incompatible with --record-rectified, "
+                 "--v4l2-sink-left and --v4l2-sink-right");
+            return false;
         }
-
-        // V4L2 could not handle size change.
-        // Do not log because downsizing on error is the default behavior,
-        // not an explicit request from the user.
-        opts->downsize_on_error = false;
     }
 
-    if (opts->v4l2_buffer && !opts->v4l2_device) {
-        LOGE("V4L2 buffer value without V4L2 sink\n");
-        return false;
-    }
-#endif
-
-    if (opts->control) {
-        if (opts->keyboard_input_mode == SC_KEYBOARD_INPUT_MODE_AUTO) {
-            opts->keyboard_input_mode = otg ? SC_KEYBOARD_INPUT_MODE_AOA
-                                            : SC_KEYBOARD_INPUT_MODE_SDK;
-        } else if (opts->keyboard_input_mode
-                == SC_KEYBOARD_INPUT_MODE_UHID_OR_AOA) {
-            opts->keyboard_input_mode = otg ? SC_KEYBOARD_INPUT_MODE_AOA
-                                            : SC_KEYBOARD_INPUT_MODE_UHID;
+    if (opts->catch_up) {
+        if (!opts->video) {
+            LOGE("--catch-up requires video");
+            return false;
         }
 
-        if (opts->mouse_input_mode == SC_MOUSE_INPUT_MODE_AUTO) {
-            if (otg) {
-                opts->mouse_input_mode = SC_MOUSE_INPUT_MODE_AOA;
-            } else if (!opts->video_playback) {
-                LOGI("No video mirroring, mouse mode switched to UHID");
-                opts->mouse_input_mode = SC_MOUSE_INPUT_MODE_UHID;
-            } else {
-                opts->mouse_input_mode = SC_MOUSE_INPUT_MODE_SDK;
-            }
-        } else if (opts->mouse_input_mode == SC_MOUSE_INPUT_MODE_UHID_OR_AOA) {
-            opts->mouse_input_mode = otg ? SC_MOUSE_INPUT_MODE_AOA
-                                         : SC_MOUSE_INPUT_MODE_UHID;
-        } else if (opts->mouse_input_mode == SC_MOUSE_INPUT_MODE_SDK
-                    && !opts->video_playback) {
-            LOGE("SDK mouse mode requires video playback. Try --mouse=uhid.");
+        // The lag of the replayed packets is set by the pacing
+        if (opts->replay_filename || opts->split_eyes || opts->multi_device) {
+            LOGE("--catch-up is incompatible with --replay, --split-eyes and "
+                 "--multi-device");
             return false;
         }
-        if (opts->gamepad_input_mode == SC_GAMEPAD_INPUT_MODE_UHID_OR_AOA) {
-            opts->gamepad_input_mode = otg ? SC_GAMEPAD_INPUT_MODE_AOA
-                                           : SC_GAMEPAD_INPUT_MODE_UHID;
+
+        if (!opts->control) {
+            LOGW("Without control, --catch-up waits for the next periodic key "
+                 "frame");
         }
     }
 
-    // If mouse bindings are not explicitly set, configure default bindings
-    if (opts->mouse_bindings.pri.right_click == SC_MOUSE_BINDING_AUTO) {
-        assert(opts->mouse_bindings.pri.middle_click == SC_MOUSE_BINDING_AUTO);
-        assert(opts->mouse_bindings.pri.click4 == SC_MOUSE_BINDING_AUTO);
-        assert(opts->mouse_bindings.pri.click5 == SC_MOUSE_BINDING_AUTO);
-        assert(opts->mouse_bindings.sec.right_click == SC_MOUSE_BINDING_AUTO);
-        assert(opts->mouse_bindings.sec.middle_click == SC_MOUSE_BINDING_AUTO);
-        assert(opts->mouse_bindings.sec.click4 == SC_MOUSE_BINDING_AUTO);
-        assert(opts->mouse_bindings.sec.click5 == SC_MOUSE_BINDING_AUTO);
-
-        static struct sc_mouse_binding_set default_shortcuts = {
-            .right_click = SC_MOUSE_BINDING_BACK,
-            .middle_click = SC_MOUSE_BINDING_HOME,
-            .click4 = SC_MOUSE_BINDING_APP_SWITCH,
-            .click5 = SC_MOUSE_BINDING_EXPAND_NOTIFICATION_PANEL,
-        };
+    if (opts->pipe_format != SC_PIPE_FORMAT_V1 && !opts->pipe_output
+            && !opts->publish_port) {
+        LOGE("--pipe-format requires --pipe-output or --publish");
+        return false;
+    }
 
-        static struct sc_mouse_binding_set forward = {
-            .right_click = SC_MOUSE_BINDING_CLICK,
-            .middle_click = SC_MOUSE_BINDING_CLICK,
-            .click4 = SC_MOUSE_BINDING_CLICK,
-            .click5 = SC_MOUSE_BINDING_CLICK,
-        };
+    if (opts->pipe_payload_crc && opts->pipe_format != SC_PIPE_FORMAT_V2) {
+        LOGE("--pipe-payload-crc requires --pipe-format=v2");
+        return false;
+    }
 
-        // By default, forward all clicks only for UHID and AOA
-        if (opts->mouse_input_mode == SC_MOUSE_INPUT_MODE_SDK) {
-            opts->mouse_bindings.pri = default_shortcuts;
-            opts->mouse_bindings.sec = forward;
-        } else {
-            opts->mouse_bindings.pri = forward;
-            opts->mouse_bindings.sec = default_shortcuts;
+    if (opts->pipe_feedback_port) {
+        if (!opts->pipe_output) {
+            LOGE("--pipe-feedback requires --pipe-output");
+            return false;
+        }
+        // The acknowledgements refer to the sequence numbers of the frames
+        if (opts->pipe_format != SC_PIPE_FORMAT_V2) {
+            LOGE("--pipe-feedback requires --pipe-format=v2");
+            return false;
         }
+        if (opts->multi_device) {
+            LOGE("--pipe-feedback is not supported with --multi-device");
+            return false;
+        }
+        if (opts->publish_port
+                && opts->publish_port == opts->pipe_feedback_port) {
+            LOGE("--pipe-feedback and --publish must use different ports");
+            return false;
+        }
+    } else if (opts->pipe_backpressure != SC_PIPE_BACKPRESSURE_DROP) {
+        LOGE("--pipe-backpressure requires --pipe-feedback");
+        return false;
     }
 
-    if (otg) {
-        if (!opts->control) {
-            LOGE("--no-control is not allowed in OTG mode");
+    if (opts->pipe_depth) {
+        if (!opts->pipe_output) {
+            LOGE("--pipe-depth requires --pipe-output");
             return false;
         }
 
-        enum sc_keyboard_input_mode kmode = opts->keyboard_input_mode;
-        if (kmode != SC_KEYBOARD_INPUT_MODE_AOA
-                && kmode != SC_KEYBOARD_INPUT_MODE_DISABLED) {
-            LOGE("In OTG mode, --keyboard only supports aoa or disabled.");
+        // The disparities are computed between the rectified eyes
+        if (!opts->opencv_enabled || !opts->opencv_map_path) {
+            LOGE("--pipe-depth requires the rectified frames (--opencv and "
+                 "--opencv-map)");
             return false;
         }
 
-        enum sc_mouse_input_mode mmode = opts->mouse_input_mode;
-        if (mmode != SC_MOUSE_INPUT_MODE_AOA
-                && mmode != SC_MOUSE_INPUT_MODE_DISABLED) {
-            LOGE("In OTG mode, --mouse only supports aoa or disabled.");
+        if (opts->multi_device_sync) {
+            // The synchronized frames are piped by the synchronizer
+            LOGE("--pipe-depth is incompatible with --multi-device-sync");
             return false;
         }
+    }
 
-        enum sc_gamepad_input_mode gmode = opts->gamepad_input_mode;
-        if (gmode != SC_GAMEPAD_INPUT_MODE_AOA
-                && gmode != SC_GAMEPAD_INPUT_MODE_DISABLED) {
-            LOGE("In OTG mode, --gamepad only supports aoa or disabled.");
+    if (opts->pipe_features) {
+        // The features are extracted from the rectified eyes
+        if (!opts->opencv_enabled || !opts->opencv_map_path) {
+            LOGE("--pipe-output=features requires the rectified frames "
+                 "(--opencv and --opencv-map)");
             return false;
         }
 
-        if (kmode == SC_KEYBOARD_INPUT_MODE_DISABLED
-                && mmode == SC_MOUSE_INPUT_MODE_DISABLED
-                && gmode == SC_GAMEPAD_INPUT_MODE_DISABLED) {
-            LOGE("Cannot not disable all inputs in OTG mode.");
+        if (opts->pipe_depth) {
+            LOGE("--pipe-output=features is incompatible with --pipe-depth");
+            return false;
+        }
+
+        if (opts->multi_device_sync) {
+            // The synchronized frames are piped by the synchronizer
+            LOGE("--pipe-output=features is incompatible with "
+                 "--multi-device-sync");
             return false;
         }
     }
 
-    if (opts->keyboard_input_mode != SC_KEYBOARD_INPUT_MODE_SDK) {
-        if (opts->key_inject_mode == SC_KEY_INJECT_MODE_TEXT) {
-            LOGE("--prefer-text is specific to --keyboard=sdk");
+    if (opts->output_planes == SC_OUTPUT_PLANES_Y) {
+        if (!opts->save_frames && !opts->pipe_output && !opts->shm_output
+                && !opts->publish_port) {
+            LOGE("--output-planes requires --save-frames, --pipe-output, "
+                 "--shm-output or --publish");
             return false;
         }
 
-        if (opts->key_inject_mode == SC_KEY_INJECT_MODE_RAW) {
-            LOGE("--raw-key-events is specific to --keyboard=sdk");
+        if (opts->save_frames
+                && opts->save_frames_format == SC_SAVE_FRAMES_FORMAT_QOI) {
+            LOGE("--output-planes=y is incompatible with "
+                 "--save-frames-format=qoi (no grayscale)");
             return false;
         }
 
-        if (!opts->forward_key_repeat) {
-            LOGE("--no-key-repeat is specific to --keyboard=sdk");
+        if (opts->save_frames
+                && opts->save_frames_format == SC_SAVE_FRAMES_FORMAT_JPEG) {
+            LOGE("--output-planes=y is incompatible with "
+                 "--save-frames-format=jpeg (use png for grayscale)");
             return false;
         }
     }
 
-    if (opts->mouse_input_mode != SC_MOUSE_INPUT_MODE_SDK
-            && !opts->mouse_hover) {
-        LOGE("--no-mouse-over is specific to --mouse=sdk");
+    if (opts->save_frames_quality
+            && opts->save_frames_format != SC_SAVE_FRAMES_FORMAT_JPEG) {
+        LOGE("--save-frames-quality requires --save-frames-format=jpeg");
         return false;
     }
 
-    if ((opts->tunnel_host || opts->tunnel_port) && !opts->force_adb_forward) {
-        LOGI("Tunnel host/port is set, "
-             "--force-adb-forward automatically enabled.");
-        opts->force_adb_forward = true;
-    }
-
-    if (opts->video_source == SC_VIDEO_SOURCE_CAMERA) {
-        if (opts->display_id) {
-            LOGE("--display-id is only available with --video-source=display");
+    if (opts->output_pyramid) {
+        if (!opts->pipe_output && !opts->shm_output) {
+            LOGE("--output-pyramid requires --pipe-output or --shm-output");
             return false;
         }
 
-        if (opts->camera_id && opts->camera_facing != SC_CAMERA_FACING_ANY) {
-            LOGE("Cannot specify both --camera-id and --camera-facing");
-            return false;
-        }
+        if (opts->pipe_output) {
+            if (opts->pipe_format != SC_PIPE_FORMAT_V2) {
+                // The levels are piped as v2 records
+                LOGE("--output-pyramid requires --pipe-format=v2 with "
+                     "--pipe-output");
+                return false;
+            }
 
-        if (opts->camera_size) {
-            if (opts->max_size) {
-                LOGE("Cannot specify both --camera-size and -m/--max-size");
+            if (opts->pipe_features) {
+                LOGE("--output-pyramid is incompatible with "
+                     "--pipe-output=features");
                 return false;
             }
 
-            if (opts->camera_ar) {
-                LOGE("Cannot specify both --camera-size and --camera-ar");
+            if (opts->multi_device_sync) {
+                // The synchronized frames are piped by the synchronizer
+                LOGE("--output-pyramid is incompatible with "
+                     "--multi-device-sync");
                 return false;
             }
         }
+    }
+
+    bool save_rate = opts->save_frames_rate.fps
+                  || opts->save_frames_rate.key_frames;
+    if (save_rate && !opts->save_frames) {
+        LOGE("--save-frames-fps requires --save-frames");
+        return false;
+    }
+
+    if (opts->save_frames_pre_trigger && !opts->save_frames) {
+        LOGE("--save-frames-pre-trigger requires --save-frames or "
+             "--save-frames-archive");
+        return false;
+    }
 
-        if (opts->camera_high_speed && !opts->camera_fps) {
-            LOGE("--camera-high-speed requires an explicit --camera-fps value");
+    bool output_rate = opts->pipe_output_rate.fps
+                    || opts->pipe_output_rate.key_frames;
+    if (output_rate) {
+        if (!opts->pipe_output && !opts->shm_output && !opts->publish_port) {
+            LOGE("--pipe-output-fps requires --pipe-output, --shm-output or "
+                 "--publish");
             return false;
         }
 
-        if (opts->control) {
-            LOGI("Camera video source: control disabled");
-            opts->control = false;
+        if (opts->multi_device_sync) {
+            // The synchronizer needs a frame of every device
+            LOGE("--pipe-output-fps is incompatible with --multi-device-sync");
+            return false;
         }
-    } else if (opts->camera_id
-            || opts->camera_ar
-            || opts->camera_facing != SC_CAMERA_FACING_ANY
-            || opts->camera_fps
-            || opts->camera_high_speed
-            || opts->camera_size) {
-        LOGE("Camera options are only available with --video-source=camera");
+    }
+
+    if (opts->motion_threshold) {
+        if (!opts->save_frames && !opts->pipe_output && !opts->shm_output
+                && !opts->publish_port) {
+            LOGE("--motion-threshold requires --save-frames, --pipe-output, "
+                 "--shm-output or --publish");
+            return false;
+        }
+
+        if (opts->multi_device_sync) {
+            // The synchronizer needs a frame of every device
+            LOGE("--motion-threshold is incompatible with "
+                 "--multi-device-sync");
+            return false;
+        }
+    }
+
+    if (opts->skip_repeated_frames && opts->multi_device_sync) {
+        // The synchronizer waits for a frame of every device
+        LOGE("--skip-repeated-frames is incompatible with --multi-device-sync");
         return false;
     }
 
-    if (opts->audio && opts->audio_source == SC_AUDIO_SOURCE_AUTO) {
-        // Select the audio source according to the video source
-        if (opts->video_source == SC_VIDEO_SOURCE_DISPLAY) {
-            if (opts->audio_dup) {
-                LOGI("Audio duplication enabled: audio source switched to "
-                     "\"playback\"");
-                opts->audio_source = SC_AUDIO_SOURCE_PLAYBACK;
-            } else {
-                opts->audio_source = SC_AUDIO_SOURCE_OUTPUT;
-            }
-        } else {
-            opts->audio_source = SC_AUDIO_SOURCE_MIC;
-            LOGI("Camera video source: microphone audio source selected");
+    if (opts->server_daemon) {
+        // The server daemon does not spawn the cleanup process (which restores
+        // the device settings when the server process dies)
+        if (opts->stay_awake) {
+            LOGE("--stay-awake is incompatible with --server-daemon");
+            return false;
+        }
+        if (opts->show_touches) {
+            LOGE("--show-touches is incompatible with --server-daemon");
+            return false;
+        }
+        if (opts->power_off_on_close) {
+            LOGE("--power-off-on-close is incompatible with --server-daemon");
+            return false;
         }
+        opts->cleanup = false;
     }
 
-    if (opts->audio_dup) {
-        if (!opts->audio) {
-            LOGE("--audio-dup not supported if audio is disabled");
+    if (opts->pipe_target && !opts->pipe_output && !opts->pipe_packets) {
+        LOGE("--pipe-target requires --pipe-output");
+        return false;
+    }
+
+    if (opts->pipe_buffer_size && !opts->pipe_target) {
+        LOGE("--pipe-buffer-size requires --pipe-target");
+        return false;
+    }
+
+    if (opts->save_frames_io != SC_SAVE_FRAMES_IO_SYNC
+            && !opts->frame_archive) {
+        LOGE("--save-frames-io requires --save-frames-archive");
+        return false;
+    }
+
+    if (opts->save_frames_direct && !opts->frame_archive) {
+        LOGE("--save-frames-direct requires --save-frames-archive");
+        return false;
+    }
+
+    if (opts->save_frames_zstd) {
+        if (!opts->frame_archive) {
+            LOGE("--save-frames-zstd requires --save-frames-archive");
             return false;
         }
 
-        if (opts->audio_source != SC_AUDIO_SOURCE_PLAYBACK) {
-            LOGE("--audio-dup is specific to --audio-source=playback");
+        if (opts->save_frames_format != SC_SAVE_FRAMES_FORMAT_YUV
+                && opts->save_frames_format != SC_SAVE_FRAMES_FORMAT_PPM) {
+            LOGE("--save-frames-zstd requires --save-frames-format=yuv or "
+                 "ppm");
             return false;
         }
     }
 
-    if (opts->record_format && !opts->record_filename) {
-        LOGE("Record format specified without recording");
+    if (opts->save_frames_zstd_dict && !opts->save_frames_zstd) {
+        LOGE("--save-frames-zstd-dict requires --save-frames-zstd");
         return false;
     }
 
-    if (opts->record_filename) {
-        if (!opts->video && !opts->audio) {
-            LOGE("Video and audio disabled, nothing to record");
+    if (opts->save_frames_tile_delta) {
+        if (!opts->frame_archive) {
+            LOGE("--save-frames-tile-delta requires --save-frames-archive");
             return false;
         }
 
-        if (!opts->record_format) {
-            opts->record_format = guess_record_format(opts->record_filename);
-            if (!opts->record_format) {
-                LOGE("No format specified for \"%s\" "
-                     "(try with --record-format=mkv)",
-                     opts->record_filename);
-                return false;
-            }
+        if (opts->save_frames_format != SC_SAVE_FRAMES_FORMAT_YUV) {
+            LOGE("--save-frames-tile-delta requires "
+                 "--save-frames-format=yuv");
+            return false;
         }
 
-        if (opts->record_orientation != SC_ORIENTATION_0) {
-            if (sc_orientation_is_mirror(opts->record_orientation)) {
-                LOGE("Record orientation only supports rotation, not "
-                     "flipping: %s",
-                     sc_orientation_get_name(opts->record_orientation));
-                return false;
-            }
+        if (opts->save_frames_pre_trigger) {
+            // The frames evicted from the ring would break the chains of
+            // deltas
+            LOGE("--save-frames-tile-delta is incompatible with "
+                 "--save-frames-pre-trigger");
+            return false;
         }
+    }
 
-        if (opts->video
-                && sc_record_format_is_audio_only(opts->record_format)) {
-            LOGE("Audio container does not support video stream");
+    if (opts->save_frames_key_interval && !opts->save_frames_tile_delta) {
+        LOGE("--save-frames-key-interval requires --save-frames-tile-delta");
+        return false;
+    }
+
+    if (opts->upload_dir) {
+        if (!opts->record_filename && !opts->save_frames) {
+            LOGE("--upload-dir requires --record or --save-frames");
             return false;
         }
 
-        if (opts->record_format == SC_RECORD_FORMAT_OPUS
-                && opts->audio_codec != SC_CODEC_OPUS) {
-            LOGE("Recording to OPUS file requires an OPUS audio stream "
-                 "(try with --audio-codec=opus)");
+        if (opts->replay_filename) {
+            LOGE("--upload-dir is incompatible with --replay");
             return false;
         }
+    } else if (opts->upload_max_rate || opts->upload_delete) {
+        LOGE("--upload-max-rate and --upload-delete require --upload-dir");
+        return false;
+    }
 
-        if (opts->record_format == SC_RECORD_FORMAT_AAC
-                && opts->audio_codec != SC_CODEC_AAC) {
-            LOGE("Recording to AAC file requires an AAC audio stream "
-                 "(try with --audio-codec=aac)");
+    if (opts->pipe_audio) {
+        if (!opts->pipe_output && !opts->pipe_packets) {
+            LOGE("--pipe-audio requires --pipe-output");
             return false;
         }
-        if (opts->record_format == SC_RECORD_FORMAT_FLAC
-                && opts->audio_codec != SC_CODEC_FLAC) {
-            LOGE("Recording to FLAC file requires a FLAC audio stream "
-                 "(try with --audio-codec=flac)");
+
+        if (opts->multi_device) {
+            LOGE("--pipe-audio is incompatible with --multi-device (no audio)");
             return false;
         }
 
-        if (opts->record_format == SC_RECORD_FORMAT_WAV
-                && opts->audio_codec != SC_CODEC_RAW) {
-            LOGE("Recording to WAV file requires a RAW audio stream "
-                 "(try with --audio-codec=raw)");
+        if (!opts->audio) {
+            LOGE("--pipe-audio requires audio capture, but --no-audio was "
+                 "set");
             return false;
         }
+    }
 
-        if ((opts->record_format == SC_RECORD_FORMAT_MP4 ||
-             opts->record_format == SC_RECORD_FORMAT_M4A)
-                && opts->audio_codec == SC_CODEC_RAW) {
-            LOGE("Recording to MP4 container does not support RAW audio");
+    if (opts->print_encoder_latency) {
+        if (!opts->video) {
+            LOGE("--print-encoder-latency requires video capture");
+            return false;
+        }
+
+        if (!opts->control) {
+            // The measures are sent on the control socket
+            LOGE("--print-encoder-latency requires the device control, but "
+                 "--no-control was set");
             return false;
         }
     }
 
-    if (opts->audio_codec == SC_CODEC_FLAC && opts->audio_bit_rate) {
-        LOGW("--audio-bit-rate is ignored for FLAC audio codec");
+    if (opts->pose_rate) {
+        if (!opts->control) {
+            // The samples are sent on the control socket
+            LOGE("--pose-rate requires the device control, but --no-control "
+                 "was set");
+            return false;
+        }
+
+        if (!opts->aggregator_port && (!opts->video
+                || (!opts->pipe_output && !opts->frame_archive))) {
+            // The samples are written along the frames, or forwarded
+            LOGE("--pose-rate requires --pipe-output, --save-frames-archive "
+                 "or --aggregator");
+            return false;
+        }
+
+        if (opts->multi_device) {
+            LOGE("--pose-rate is not supported with --multi-device");
+            return false;
+        }
     }
 
-    if (opts->audio_codec == SC_CODEC_RAW) {
-        if (opts->audio_bit_rate) {
-            LOGW("--audio-bit-rate is ignored for raw audio codec");
+    if (opts->aggregator_node && !opts->aggregator_port) {
+        LOGE("--aggregator-node requires --aggregator");
+        return false;
+    }
+
+    if (opts->aggregator_port) {
+        if (opts->multi_device) {
+            // A single node per connection
+            LOGE("--aggregator is not supported with --multi-device");
+            return false;
         }
-        if (opts->audio_codec_options) {
-            LOGW("--audio-codec-options is ignored for raw audio codec");
+
+        if (opts->replay_filename) {
+            LOGE("--aggregator is not supported with --replay");
+            return false;
         }
-        if (opts->audio_encoder) {
-            LOGW("--audio-encoder is ignored for raw audio codec");
+    }
+
+    if (opts->print_latency || opts->latency_trace_filename) {
+        if (!opts->video) {
+            LOGE("--print-latency and --latency-trace require video capture");
+            return false;
+        }
+
+        if (opts->multi_device) {
+            // The frames are identified by their PTS
+            LOGE("--print-latency and --latency-trace are incompatible with "
+                 "--multi-device");
+            return false;
         }
     }
 
-    if (!opts->control) {
-        if (opts->turn_screen_off) {
-            LOGE("Cannot request to turn screen off if control is disabled");
+    if (opts->latency_probe.width) {
+        if (!opts->video_playback) {
+            // The pattern is drawn in the window
+            LOGE("--latency-probe requires video playback");
             return false;
         }
-        if (opts->stay_awake) {
-            LOGE("Cannot request to stay awake if control is disabled");
+
+        if (opts->multi_device || opts->replay_filename) {
+            LOGE("--latency-probe is incompatible with --multi-device and "
+                 "--replay");
             return false;
         }
-        if (opts->show_touches) {
-            LOGE("Cannot request to show touches if control is disabled");
+    }
+
+    if (opts->hud && !opts->video_playback) {
+        // Drawn in the window
+        LOGE("--hud requires video playback");
+        return false;
+    }
+
+    if (opts->metrics_filename && opts->multi_device) {
+        // The metrics are global
+        LOGE("--metrics is incompatible with --multi-device");
+        return false;
+    }
+
+    if (opts->auto_tune && opts->multi_device) {
+        // The tuner is global
+        LOGE("--auto-tune is incompatible with --multi-device");
+        return false;
+    }
+
+    if (opts->dump_stream_filename && !opts->video) {
+        LOGE("--dump-stream requires video capture");
+        return false;
+    }
+
+    if (opts->replay_max_speed && !opts->replay_filename) {
+        LOGE("--replay-max-speed requires --replay");
+        return false;
+    }
+
+    if (opts->replay_filename) {
+        if (opts->multi_device || opts->dump_stream_filename
+                || opts->record_filename || opts->pipe_packets) {
+            LOGE("--replay is incompatible with --multi-device, "
+                 "--dump-stream, --record and --pipe-output=packets");
             return false;
         }
-        if (opts->power_off_on_close) {
-            LOGE("Cannot request power off on close if control is disabled");
+
+        if (!opts->show_timestamps && !opts->save_frames && !opts->pipe_output
+                && !opts->shm_output && !opts->cuda_ipc_output
+                && !opts->publish_port && !opts->print_latency
+                && !opts->latency_trace_filename && !opts->metrics_filename) {
+            LOGE("--replay requires an output (--show-timestamps, "
+                 "--save-frames, --pipe-output, --shm-output, "
+                 "--cuda-ipc-output, --publish, --print-latency, "
+                 "--latency-trace or --metrics)");
             return false;
         }
     }
 
-# ifdef _WIN32
-    if (!otg && (opts->keyboard_input_mode == SC_KEYBOARD_INPUT_MODE_AOA
-                || opts->mouse_input_mode == SC_MOUSE_INPUT_MODE_AOA)) {
-        LOGE("On Windows, it is not possible to open a USB device already open "
-             "by another process (like adb).");
-        LOGE("Therefore, --keyboard=aoa and --mouse=aoa may only work in OTG"
-             "mode (--otg).");
+    if (opts->record_timestamps && (!opts->record_filename || !opts->video)
+            && !opts->camera_record_filename) {
+        LOGE("--record-timestamps requires video recording (--record or "
+             "--camera-record)");
+        return false;
+    }
+
+    if (opts->timestamp_sei) {
+        if (!opts->video) {
+            LOGE("--timestamp-sei requires video");
+            return false;
+        }
+        if (opts->video_codec_auto || opts->video_codec == SC_CODEC_AV1) {
+            // A SEI is specific to H.264 and H.265
+            LOGE("--timestamp-sei requires --video-codec=h264 or "
+                 "--video-codec=h265");
+            return false;
+        }
+        if (opts->capture_exposure) {
+            // The exposure follows the capture timestamp in the packet
+            // headers
+            LOGE("--timestamp-sei is incompatible with --capture-exposure");
+            return false;
+        }
+    }
+
+    if (opts->record_segment && (!opts->record_filename || !opts->video)) {
+        // The segments start on a video key frame
+        LOGE("--record-segment requires video recording (--record)");
+        return false;
+    }
+
+    if (opts->record_fragmented && !opts->record_filename) {
+        LOGE("--record-fragmented requires recording (--record)");
         return false;
     }
-# endif
 
     if (opts->start_fps_counter && !opts->video_playback) {
         LOGW("--print-fps has no effect without video playback");
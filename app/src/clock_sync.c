@@ -0,0 +1,363 @@
+#include "clock_sync.h"
+
+#include <assert.h>
+#include <inttypes.h>
+
+#include "control_msg.h"
+#include "controller.h"
+#include "metrics.h"
+#include "util/log.h"
+
+// The first pings are sent in a burst to get a first estimation quickly
+#define SC_CLOCK_SYNC_BURST 8
+#define SC_CLOCK_SYNC_BURST_INTERVAL SC_TICK_FROM_MS(20)
+#define SC_CLOCK_SYNC_INTERVAL SC_TICK_FROM_MS(500)
+// A time ping is sent after the burst, then every N pings
+#define SC_CLOCK_SYNC_TIME_PING_PERIOD 20
+
+// The samples having a round-trip time greater than
+// min_rtt + max(min_rtt / 4, SC_CLOCK_SYNC_MIN_TOLERANCE) are ignored
+#define SC_CLOCK_SYNC_MIN_TOLERANCE SC_TICK_FROM_US(200)
+
+// The drift is estimated only if enough selected samples cover this period
+#define SC_CLOCK_SYNC_DRIFT_MIN_SPAN SC_TICK_FROM_SEC(10)
+#define SC_CLOCK_SYNC_DRIFT_MIN_SAMPLES 8
+// Any larger estimated drift is an estimation error (1000 ppm)
+#define SC_CLOCK_SYNC_MAX_DRIFT 0.001
+
+bool
+sc_clock_sync_init(struct sc_clock_sync *cs,
+                   struct sc_controller *controller) {
+    bool ok = sc_mutex_init(&cs->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&cs->cond);
+    if (!ok) {
+        sc_mutex_destroy(&cs->mutex);
+        return false;
+    }
+
+    cs->controller = controller;
+    cs->stopped = false;
+    cs->count = 0;
+    cs->head = 0;
+    cs->pings = 0;
+    cs->synced = false;
+    cs->ref_local = 0;
+    cs->ref_offset = 0;
+    cs->drift = 0;
+    cs->precision = 0;
+    cs->realtime_offset = 0;
+    cs->time_synced = false;
+    cs->time_rtt = 0;
+    cs->boot_time_offset = 0;
+    cs->wall_offset = 0;
+
+    return true;
+}
+
+void
+sc_clock_sync_destroy(struct sc_clock_sync *cs) {
+    sc_cond_destroy(&cs->cond);
+    sc_mutex_destroy(&cs->mutex);
+}
+
+static void
+sc_clock_sync_estimate(struct sc_clock_sync *cs) {
+    sc_mutex_assert(&cs->mutex);
+    assert(cs->count);
+
+    sc_tick min_rtt = cs->samples[0].rtt;
+    for (unsigned i = 1; i < cs->count; ++i) {
+        if (cs->samples[i].rtt < min_rtt) {
+            min_rtt = cs->samples[i].rtt;
+        }
+    }
+
+    sc_tick tolerance = min_rtt / 4;
+    if (tolerance < SC_CLOCK_SYNC_MIN_TOLERANCE) {
+        tolerance = SC_CLOCK_SYNC_MIN_TOLERANCE;
+    }
+    sc_tick max_rtt = min_rtt + tolerance;
+
+    // Least squares fit of offset(local), relative to an arbitrary selected
+    // sample to keep the values small
+    sc_tick base_local = 0;
+    sc_tick base_offset = 0;
+    sc_tick min_local = 0;
+    sc_tick max_local = 0;
+    unsigned n = 0;
+    double sum_x = 0;
+    double sum_y = 0;
+    for (unsigned i = 0; i < cs->count; ++i) {
+        const struct sc_clock_sync_sample *s = &cs->samples[i];
+        if (s->rtt > max_rtt) {
+            continue;
+        }
+        if (!n) {
+            base_local = s->local;
+            base_offset = s->offset;
+            min_local = s->local;
+            max_local = s->local;
+        } else if (s->local < min_local) {
+            min_local = s->local;
+        } else if (s->local > max_local) {
+            max_local = s->local;
+        }
+        sum_x += s->local - base_local;
+        sum_y += s->offset - base_offset;
+        ++n;
+    }
+
+    assert(n); // at least the sample having the minimal rtt
+    double mean_x = sum_x / n;
+    double mean_y = sum_y / n;
+
+    double drift = 0;
+    if (n >= SC_CLOCK_SYNC_DRIFT_MIN_SAMPLES
+            && max_local - min_local >= SC_CLOCK_SYNC_DRIFT_MIN_SPAN) {
+        double sxx = 0;
+        double sxy = 0;
+        for (unsigned i = 0; i < cs->count; ++i) {
+            const struct sc_clock_sync_sample *s = &cs->samples[i];
+            if (s->rtt > max_rtt) {
+                continue;
+            }
+            double dx = (s->local - base_local) - mean_x;
+            double dy = (s->offset - base_offset) - mean_y;
+            sxx += dx * dx;
+            sxy += dx * dy;
+        }
+        if (sxx > 0) {
+            drift = sxy / sxx;
+            if (drift > SC_CLOCK_SYNC_MAX_DRIFT) {
+                drift = SC_CLOCK_SYNC_MAX_DRIFT;
+            } else if (drift < -SC_CLOCK_SYNC_MAX_DRIFT) {
+                drift = -SC_CLOCK_SYNC_MAX_DRIFT;
+            }
+        }
+    }
+
+    cs->ref_local = base_local + (sc_tick) mean_x;
+    cs->ref_offset = base_offset + (sc_tick) mean_y;
+    cs->drift = drift;
+    cs->precision = min_rtt / 2;
+}
+
+void
+sc_clock_sync_on_pong(struct sc_clock_sync *cs, sc_tick client_time,
+                      sc_tick receive_time, sc_tick send_time) {
+    sc_tick now = sc_tick_now();
+    sc_tick realtime_offset = sc_tick_now_realtime() - now;
+
+    sc_tick rtt = (now - client_time) - (send_time - receive_time);
+    if (client_time > now || send_time < receive_time || rtt < 0) {
+        LOGW("Invalid clock sync sample, ignored");
+        return;
+    }
+
+    struct sc_clock_sync_sample sample = {
+        .local = client_time + (now - client_time) / 2,
+        .offset = ((receive_time - client_time) + (send_time - now)) / 2,
+        .rtt = rtt,
+    };
+
+    sc_mutex_lock(&cs->mutex);
+
+    cs->samples[cs->head] = sample;
+    cs->head = (cs->head + 1) % SC_CLOCK_SYNC_SAMPLES;
+    if (cs->count < SC_CLOCK_SYNC_SAMPLES) {
+        ++cs->count;
+    }
+
+    cs->realtime_offset = realtime_offset;
+    sc_clock_sync_estimate(cs);
+
+    sc_metrics_set(SC_METRIC_CLOCK_OFFSET_US, SC_TICK_TO_US(cs->ref_offset));
+    sc_metrics_set(SC_METRIC_RTT_US, SC_TICK_TO_US(sample.rtt));
+
+    if (!cs->synced) {
+        cs->synced = true;
+        LOGI("Device clock synchronized (precision: %" PRItick " us)",
+             cs->precision);
+        // Wake up sc_clock_sync_wait()
+        sc_cond_broadcast(&cs->cond);
+    } else {
+        LOGV("Clock sync: rtt=%" PRItick " us, offset=%" PRItick
+             " us, drift=%.2f ppm", sample.rtt, sample.offset,
+             cs->drift * 1e6);
+    }
+
+    sc_mutex_unlock(&cs->mutex);
+}
+
+void
+sc_clock_sync_on_time_pong(struct sc_clock_sync *cs, sc_tick client_time,
+                           sc_tick receive_time, sc_tick send_time,
+                           sc_tick receive_wall_time, sc_tick send_wall_time) {
+    sc_tick now = sc_tick_now();
+    sc_tick now_realtime = sc_tick_now_realtime();
+
+    sc_tick rtt = (now - client_time) - (send_time - receive_time);
+    if (client_time > now || send_time < receive_time || rtt < 0) {
+        LOGW("Invalid time sync sample, ignored");
+        return;
+    }
+
+    // The client time is in the local monotonic time base
+    sc_tick client_realtime = client_time + (now_realtime - now);
+    sc_tick boot_time_offset =
+        ((receive_time - client_time) + (send_time - now)) / 2;
+    sc_tick wall_offset = ((receive_wall_time - client_realtime)
+                         + (send_wall_time - now_realtime)) / 2;
+
+    sc_mutex_lock(&cs->mutex);
+
+    bool first = !cs->time_synced;
+    cs->time_synced = true;
+    cs->time_rtt = rtt;
+    cs->boot_time_offset = boot_time_offset;
+    cs->wall_offset = wall_offset;
+
+    // The device sleep time, if the device monotonic offset is known
+    sc_tick sleep_time = cs->synced ? boot_time_offset - cs->ref_offset : 0;
+
+    sc_mutex_unlock(&cs->mutex);
+
+    if (first) {
+        // The device wall clock has a millisecond resolution
+        LOGD("Device wall clock offset: %" PRItick " ms (rtt: %" PRItick
+             " us, sleep time: %" PRItick " ms)", wall_offset / 1000, rtt,
+             sleep_time / 1000);
+    } else {
+        LOGV("Time sync: rtt=%" PRItick " us, boot_time_offset=%" PRItick
+             " us, wall_offset=%" PRItick " us", rtt, boot_time_offset,
+             wall_offset);
+    }
+}
+
+static void
+sc_clock_sync_send_time_ping(struct sc_clock_sync *cs) {
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_TIME_PING;
+    msg.time_ping.client_time = sc_tick_now();
+
+    if (!sc_controller_push_msg(cs->controller, &msg)) {
+        LOGW("Could not request time sync");
+    }
+}
+
+static void
+sc_clock_sync_send_ping(struct sc_clock_sync *cs) {
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_CLOCK_SYNC;
+    msg.clock_sync.client_time = sc_tick_now();
+
+    if (!sc_controller_push_msg(cs->controller, &msg)) {
+        LOGW("Could not request clock sync");
+    }
+}
+
+static int
+run_clock_sync(void *data) {
+    struct sc_clock_sync *cs = data;
+
+    sc_mutex_lock(&cs->mutex);
+    while (!cs->stopped) {
+        unsigned pings = cs->pings++;
+        sc_mutex_unlock(&cs->mutex);
+
+        sc_clock_sync_send_ping(cs);
+        if (pings >= SC_CLOCK_SYNC_BURST
+                && !((pings - SC_CLOCK_SYNC_BURST)
+                        % SC_CLOCK_SYNC_TIME_PING_PERIOD)) {
+            sc_clock_sync_send_time_ping(cs);
+        }
+
+        sc_tick interval = pings < SC_CLOCK_SYNC_BURST
+                         ? SC_CLOCK_SYNC_BURST_INTERVAL
+                         : SC_CLOCK_SYNC_INTERVAL;
+        sc_tick deadline = sc_tick_now() + interval;
+
+        sc_mutex_lock(&cs->mutex);
+        bool timed_out = false;
+        while (!cs->stopped && !timed_out) {
+            timed_out = !sc_cond_timedwait(&cs->cond, &cs->mutex, deadline);
+        }
+    }
+    sc_mutex_unlock(&cs->mutex);
+
+    LOGD("Clock sync stopped");
+
+    return 0;
+}
+
+bool
+sc_clock_sync_start(struct sc_clock_sync *cs) {
+    LOGD("Starting clock sync thread");
+
+    bool ok = sc_thread_create(&cs->thread, run_clock_sync,
+                               "scrcpy-clocksync", cs);
+    if (!ok) {
+        LOGE("Could not start clock sync thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_clock_sync_stop(struct sc_clock_sync *cs) {
+    sc_mutex_lock(&cs->mutex);
+    cs->stopped = true;
+    sc_cond_broadcast(&cs->cond);
+    sc_mutex_unlock(&cs->mutex);
+}
+
+void
+sc_clock_sync_join(struct sc_clock_sync *cs) {
+    sc_thread_join(&cs->thread, NULL);
+}
+
+bool
+sc_clock_sync_wait(struct sc_clock_sync *cs, sc_tick deadline) {
+    sc_mutex_lock(&cs->mutex);
+    bool timed_out = false;
+    while (!cs->stopped && !cs->synced && !timed_out) {
+        timed_out = !sc_cond_timedwait(&cs->cond, &cs->mutex, deadline);
+    }
+    bool synced = cs->synced;
+    sc_mutex_unlock(&cs->mutex);
+
+    return synced;
+}
+
+bool
+sc_clock_sync_get_estimate(struct sc_clock_sync *cs,
+                           struct sc_clock_estimate *estimate) {
+    sc_mutex_lock(&cs->mutex);
+    bool synced = cs->synced;
+    if (synced) {
+        estimate->ref_local = cs->ref_local;
+        estimate->ref_offset = cs->ref_offset;
+        estimate->drift = cs->drift;
+        estimate->realtime_offset = cs->realtime_offset;
+    }
+    sc_mutex_unlock(&cs->mutex);
+
+    return synced;
+}
+
+bool
+sc_clock_sync_to_realtime(struct sc_clock_sync *cs, sc_tick device_time,
+                          sc_tick *realtime) {
+    struct sc_clock_estimate estimate;
+    if (!sc_clock_sync_get_estimate(cs, &estimate)) {
+        return false;
+    }
+
+    *realtime = sc_clock_estimate_to_realtime(&estimate, device_time);
+    return true;
+}
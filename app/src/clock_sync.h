@@ -0,0 +1,173 @@
+#ifndef SC_CLOCK_SYNC_H
+#define SC_CLOCK_SYNC_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/thread.h"
+#include "util/tick.h"
+
+// Number of ping/pong samples kept for the estimation
+#define SC_CLOCK_SYNC_SAMPLES 64
+
+struct sc_controller;
+
+struct sc_clock_sync_sample {
+    sc_tick local; // local time at the middle of the round trip
+    sc_tick offset; // device time - local time
+    sc_tick rtt; // round-trip time, excluding the device processing time
+};
+
+/**
+ * Continuous synchronization of the device monotonic clock (the clock of the
+ * video PTS) with the local monotonic clock.
+ *
+ * A ping (a control message containing the local time) is sent periodically.
+ * The device replies with its own receive and send times, so that, NTP-style:
+ *
+ *     offset = ((t1 - t0) + (t2 - t3)) / 2
+ *     rtt = (t3 - t0) - (t2 - t1)
+ *
+ * The network delays are not symmetric, so the error of a sample is bounded
+ * by rtt / 2. Therefore, only the samples having a round-trip time close to
+ * the minimum are kept, and the estimated relation is:
+ *
+ *     offset(local) = ref_offset + drift * (local - ref_local)
+ *
+ * The drift is only estimated once the samples cover a long enough period.
+ */
+struct sc_clock_sync {
+    struct sc_controller *controller;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped;
+
+    // protected by the mutex
+    struct sc_clock_sync_sample samples[SC_CLOCK_SYNC_SAMPLES];
+    unsigned count;
+    unsigned head; // index of the next sample to write
+    unsigned pings; // number of pings sent
+
+    bool synced;
+    sc_tick ref_local;
+    sc_tick ref_offset;
+    double drift;
+    sc_tick precision; // half the round-trip time of the best sample
+    sc_tick realtime_offset; // local wall clock - local monotonic clock
+
+    // Estimated from the time pings (less frequent, to not disturb the
+    // monotonic clock estimation)
+    bool time_synced;
+    sc_tick time_rtt; // round-trip time of the last time sample
+    sc_tick boot_time_offset; // device boot time - local monotonic clock
+    sc_tick wall_offset; // device wall clock - local wall clock
+};
+
+bool
+sc_clock_sync_init(struct sc_clock_sync *cs,
+                   struct sc_controller *controller);
+
+void
+sc_clock_sync_destroy(struct sc_clock_sync *cs);
+
+bool
+sc_clock_sync_start(struct sc_clock_sync *cs);
+
+void
+sc_clock_sync_stop(struct sc_clock_sync *cs);
+
+void
+sc_clock_sync_join(struct sc_clock_sync *cs);
+
+/**
+ * Handle a pong received from the device (called from the receiver thread)
+ */
+void
+sc_clock_sync_on_pong(struct sc_clock_sync *cs, sc_tick client_time,
+                      sc_tick receive_time, sc_tick send_time);
+
+/**
+ * Handle a time pong received from the device (called from the receiver
+ * thread)
+ *
+ * The device times are its boot time (including deep sleep) and its wall
+ * clock time, in microseconds.
+ */
+void
+sc_clock_sync_on_time_pong(struct sc_clock_sync *cs, sc_tick client_time,
+                           sc_tick receive_time, sc_tick send_time,
+                           sc_tick receive_wall_time, sc_tick send_wall_time);
+
+/**
+ * Wait for the first estimation, until the deadline
+ *
+ * Return true if the clock is synchronized.
+ */
+bool
+sc_clock_sync_wait(struct sc_clock_sync *cs, sc_tick deadline);
+
+/**
+ * Convert a device monotonic time (in microseconds) to the local wall clock
+ * time (in microseconds since the Unix epoch)
+ *
+ * Return false if no estimation is available yet.
+ */
+bool
+sc_clock_sync_to_realtime(struct sc_clock_sync *cs, sc_tick device_time,
+                          sc_tick *realtime);
+
+/**
+ * Snapshot of the estimated relation between the device monotonic clock and
+ * the local clocks
+ *
+ * The conversions from a snapshot are pure computations, without lock, so a
+ * thread converting the time of every frame may refresh its snapshot only
+ * periodically (the estimation changes slowly, see SC_CLOCK_SYNC_INTERVAL).
+ */
+struct sc_clock_estimate {
+    sc_tick ref_local;
+    sc_tick ref_offset;
+    double drift;
+    sc_tick realtime_offset; // local wall clock - local monotonic clock
+};
+
+/**
+ * Copy the current estimation
+ *
+ * Return false if no estimation is available yet.
+ */
+bool
+sc_clock_sync_get_estimate(struct sc_clock_sync *cs,
+                           struct sc_clock_estimate *estimate);
+
+// Convert a local monotonic time (sc_tick_now()) to the device monotonic clock
+static inline sc_tick
+sc_clock_estimate_to_device(const struct sc_clock_estimate *estimate,
+                            sc_tick local) {
+    // device_time = local + ref_offset + drift * (local - ref_local)
+    return local + estimate->ref_offset
+         + (sc_tick) (estimate->drift * (local - estimate->ref_local));
+}
+
+// Convert a device monotonic time to the local monotonic clock
+static inline sc_tick
+sc_clock_estimate_to_local(const struct sc_clock_estimate *estimate,
+                           sc_tick device_time) {
+    sc_tick delta = device_time - estimate->ref_local - estimate->ref_offset;
+    return estimate->ref_local + (sc_tick) (delta / (1 + estimate->drift));
+}
+
+// Convert a device monotonic time to the local wall clock (since the Unix
+// epoch)
+static inline sc_tick
+sc_clock_estimate_to_realtime(const struct sc_clock_estimate *estimate,
+                              sc_tick device_time) {
+    return sc_clock_estimate_to_local(estimate, device_time)
+         + estimate->realtime_offset;
+}
+
+#endif
@@ -0,0 +1,405 @@
+#include "codec_probe.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+
+#include "util/log.h"
+
+// Bit rate of the synthetic clip (the default --video-bit-rate)
+#define SC_CODEC_PROBE_BIT_RATE 8000000
+// Expected video size and frame rate if not limited by the options
+#define SC_CODEC_PROBE_DEFAULT_WIDTH 1920
+#define SC_CODEC_PROBE_DEFAULT_HEIGHT 1080
+#define SC_CODEC_PROBE_DEFAULT_FPS 60
+
+struct sc_codec_probe_clip {
+    AVPacket *packets[SC_CODEC_PROBE_FRAMES];
+    unsigned count;
+};
+
+struct sc_codec_probe_result {
+    bool decodable; // a decoder is available
+    bool measured; // the clip could be encoded and decoded
+    bool hardware; // decoded by hardware
+    float fps; // if measured
+};
+
+static const char *
+sc_codec_probe_get_name(enum sc_codec codec) {
+    switch (codec) {
+        case SC_CODEC_H264:
+            return "h264";
+        case SC_CODEC_H265:
+            return "h265";
+        case SC_CODEC_AV1:
+            return "av1";
+        default:
+            assert(!"unexpected codec");
+            return NULL;
+    }
+}
+
+static enum AVCodecID
+sc_codec_probe_to_avcodec_id(enum sc_codec codec) {
+    switch (codec) {
+        case SC_CODEC_H264:
+            return AV_CODEC_ID_H264;
+        case SC_CODEC_H265:
+            return AV_CODEC_ID_HEVC;
+        case SC_CODEC_AV1:
+            return AV_CODEC_ID_AV1;
+        default:
+            assert(!"unexpected codec");
+            return AV_CODEC_ID_NONE;
+    }
+}
+
+static void
+sc_codec_probe_clip_destroy(struct sc_codec_probe_clip *clip) {
+    for (unsigned i = 0; i < clip->count; ++i) {
+        av_packet_free(&clip->packets[i]);
+    }
+    clip->count = 0;
+}
+
+// Draw a moving pattern with some texture, so that the P-frames are not empty
+static void
+sc_codec_probe_draw(AVFrame *frame, unsigned index) {
+    for (int y = 0; y < frame->height; ++y) {
+        uint8_t *row = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < frame->width; ++x) {
+            unsigned v = (x + 2 * y + 8 * index) ^ ((x * y) >> 5);
+            row[x] = v & 0xFF;
+        }
+    }
+    for (int p = 1; p < 3; ++p) {
+        for (int y = 0; y < frame->height / 2; ++y) {
+            uint8_t *row = frame->data[p] + y * frame->linesize[p];
+            for (int x = 0; x < frame->width / 2; ++x) {
+                row[x] = (p * 64 + x / 4 + y / 4 + 2 * index) & 0xFF;
+            }
+        }
+    }
+}
+
+static bool
+sc_codec_probe_receive_packets(AVCodecContext *ctx,
+                               struct sc_codec_probe_clip *clip) {
+    for (;;) {
+        AVPacket *packet = av_packet_alloc();
+        if (!packet) {
+            LOG_OOM();
+            return false;
+        }
+        int r = avcodec_receive_packet(ctx, packet);
+        if (r) {
+            av_packet_free(&packet);
+            return r == AVERROR(EAGAIN) || r == AVERROR_EOF;
+        }
+        if (clip->count == SC_CODEC_PROBE_FRAMES) {
+            // Should not happen (one packet per frame)
+            av_packet_free(&packet);
+            continue;
+        }
+        clip->packets[clip->count++] = packet;
+    }
+}
+
+// Encode the synthetic clip with the libavcodec encoder of the codec
+static bool
+sc_codec_probe_encode(enum AVCodecID codec_id, unsigned width,
+                      unsigned height, struct sc_codec_probe_clip *clip) {
+    clip->count = 0;
+
+    const AVCodec *codec = avcodec_find_encoder(codec_id);
+    if (!codec) {
+        return false;
+    }
+
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    if (!ctx) {
+        LOG_OOM();
+        return false;
+    }
+
+    ctx->width = width;
+    ctx->height = height;
+    ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    ctx->time_base = (AVRational) {1, 60};
+    ctx->framerate = (AVRational) {60, 1};
+    ctx->bit_rate = SC_CODEC_PROBE_BIT_RATE;
+    ctx->gop_size = SC_CODEC_PROBE_FRAMES;
+    ctx->max_b_frames = 0; // as the device encoders
+
+    // The fastest settings of the common encoders (the options unknown to
+    // the selected encoder are ignored)
+    av_opt_set(ctx->priv_data, "preset", "ultrafast", 0); // x264, x265
+    av_opt_set(ctx->priv_data, "tune", "zerolatency", 0); // x264, x265
+    av_opt_set(ctx->priv_data, "x265-params", "log-level=none", 0);
+    av_opt_set(ctx->priv_data, "usage", "realtime", 0); // libaom
+    av_opt_set(ctx->priv_data, "cpu-used", "8", 0); // libaom
+    av_opt_set(ctx->priv_data, "speed", "10", 0); // rav1e
+    av_opt_set_int(ctx->priv_data, "preset", 12, 0); // SVT-AV1
+
+    AVFrame *frame = NULL;
+    bool ok = false;
+
+    if (avcodec_open2(ctx, codec, NULL) < 0) {
+        // e.g. a hardware encoder, which requires hardware frames
+        LOGD("Codec probe: could not open the encoder %s", codec->name);
+        goto end;
+    }
+
+    frame = av_frame_alloc();
+    if (!frame) {
+        LOG_OOM();
+        goto end;
+    }
+    frame->format = ctx->pix_fmt;
+    frame->width = width;
+    frame->height = height;
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        LOG_OOM();
+        goto end;
+    }
+
+    for (unsigned i = 0; i < SC_CODEC_PROBE_FRAMES; ++i) {
+        if (av_frame_make_writable(frame) < 0) {
+            goto end;
+        }
+        sc_codec_probe_draw(frame, i);
+        frame->pts = i;
+        if (avcodec_send_frame(ctx, frame) < 0
+                || !sc_codec_probe_receive_packets(ctx, clip)) {
+            goto end;
+        }
+    }
+
+    // Drain the encoder
+    if (avcodec_send_frame(ctx, NULL) < 0
+            || !sc_codec_probe_receive_packets(ctx, clip)) {
+        goto end;
+    }
+
+    ok = clip->count > 0;
+
+end:
+    if (!ok) {
+        sc_codec_probe_clip_destroy(clip);
+    }
+    av_frame_free(&frame);
+    avcodec_free_context(&ctx);
+    return ok;
+}
+
+// Return the number of frames received, or -1 on error
+static int
+sc_codec_probe_receive_frames(AVCodecContext *ctx, AVFrame *frame) {
+    int count = 0;
+    for (;;) {
+        int r = avcodec_receive_frame(ctx, frame);
+        if (r == AVERROR(EAGAIN) || r == AVERROR_EOF) {
+            return count;
+        }
+        if (r < 0) {
+            return -1;
+        }
+        av_frame_unref(frame);
+        ++count;
+    }
+}
+
+// Decode the clip (repeatedly, for at least SC_CODEC_PROBE_MIN_DURATION)
+static bool
+sc_codec_probe_decode(enum AVCodecID codec_id, unsigned width,
+                      unsigned height, const struct sc_decoder_config *config,
+                      const struct sc_codec_probe_clip *clip,
+                      struct sc_codec_probe_result *result) {
+    const AVCodec *codec = avcodec_find_decoder(codec_id);
+    if (!codec) {
+        return false;
+    }
+    result->decodable = true;
+
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    if (!ctx) {
+        LOG_OOM();
+        return false;
+    }
+
+    ctx->width = width;
+    ctx->height = height;
+    ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    if (config) {
+        sc_decoder_configure(ctx, config);
+    }
+
+    AVFrame *frame = NULL;
+    bool ok = false;
+
+    if (avcodec_open2(ctx, codec, NULL) < 0) {
+        LOGD("Codec probe: could not open the decoder %s", codec->name);
+        goto end;
+    }
+    result->hardware = !!ctx->hw_device_ctx;
+
+    if (!clip) {
+        // Nothing to measure
+        ok = true;
+        goto end;
+    }
+
+    frame = av_frame_alloc();
+    if (!frame) {
+        LOG_OOM();
+        goto end;
+    }
+
+    unsigned frames = 0;
+    sc_tick start = sc_tick_now();
+    sc_tick elapsed;
+    do {
+        for (unsigned i = 0; i < clip->count; ++i) {
+            if (avcodec_send_packet(ctx, clip->packets[i]) < 0) {
+                goto end;
+            }
+            int n = sc_codec_probe_receive_frames(ctx, frame);
+            if (n < 0) {
+                goto end;
+            }
+            frames += n;
+        }
+        elapsed = sc_tick_now() - start;
+    } while (elapsed < SC_CODEC_PROBE_MIN_DURATION);
+
+    // Drain the frames delayed by the frame threading
+    if (avcodec_send_packet(ctx, NULL) < 0) {
+        goto end;
+    }
+    int n = sc_codec_probe_receive_frames(ctx, frame);
+    if (n < 0) {
+        goto end;
+    }
+    frames += n;
+    elapsed = sc_tick_now() - start;
+
+    result->measured = true;
+    result->fps = frames * (float) SC_TICK_FREQ / elapsed;
+    ok = true;
+
+end:
+    av_frame_free(&frame);
+    avcodec_free_context(&ctx);
+    return ok;
+}
+
+static void
+sc_codec_probe_run(enum sc_codec codec, unsigned width, unsigned height,
+                   const struct sc_decoder_config *config,
+                   struct sc_codec_probe_result *result) {
+    result->decodable = false;
+    result->measured = false;
+    result->hardware = false;
+    result->fps = 0;
+
+    enum AVCodecID codec_id = sc_codec_probe_to_avcodec_id(codec);
+
+    struct sc_codec_probe_clip clip;
+    bool encoded = sc_codec_probe_encode(codec_id, width, height, &clip);
+    if (!encoded) {
+        LOGD("Codec probe: %s cannot be encoded by libavcodec",
+             sc_codec_probe_get_name(codec));
+    }
+
+    sc_codec_probe_decode(codec_id, width, height, config,
+                          encoded ? &clip : NULL, result);
+
+    if (encoded) {
+        sc_codec_probe_clip_destroy(&clip);
+    }
+}
+
+unsigned
+sc_codec_probe_select(unsigned width, unsigned height, float fps,
+                      const struct sc_decoder_config *config,
+                      enum sc_codec codecs[SC_VIDEO_CODEC_COUNT]) {
+    assert(width && height && fps > 0);
+
+    // H.264 is the fallback, it is not measured
+    static const enum sc_codec candidates[] = {
+        SC_CODEC_AV1,
+        SC_CODEC_H265,
+    };
+    static_assert(ARRAY_LEN(candidates) < SC_VIDEO_CODEC_COUNT,
+                  "no room for the fallback");
+
+    float required = fps * SC_CODEC_PROBE_HEADROOM;
+    unsigned count = 0;
+
+    for (size_t i = 0; i < ARRAY_LEN(candidates); ++i) {
+        enum sc_codec codec = candidates[i];
+        const char *name = sc_codec_probe_get_name(codec);
+
+        struct sc_codec_probe_result result;
+        sc_codec_probe_run(codec, width, height, config, &result);
+
+        const char *hw = result.hardware ? "hardware" : "software";
+        bool accepted;
+        if (!result.decodable) {
+            LOGI("Codec probe: %s: no decoder", name);
+            accepted = false;
+        } else if (result.measured) {
+            accepted = result.fps >= required;
+            LOGI("Codec probe: %s %ux%u: %.1f fps (%s), %s", name, width,
+                 height, result.fps, hw, accepted ? "accepted" : "too slow");
+        } else {
+            // Not measurable, trust the hardware decoders only
+            accepted = result.hardware;
+            LOGI("Codec probe: %s: not measured (%s), %s", name, hw,
+                 accepted ? "accepted" : "rejected");
+        }
+
+        if (accepted) {
+            codecs[count++] = codec;
+        }
+    }
+
+    codecs[count++] = SC_CODEC_H264;
+    return count;
+}
+
+unsigned
+sc_codec_probe_select_for_options(const struct scrcpy_options *options,
+                                  unsigned streams,
+                                  enum sc_codec codecs[SC_VIDEO_CODEC_COUNT]) {
+    assert(streams);
+
+    unsigned width = SC_CODEC_PROBE_DEFAULT_WIDTH;
+    unsigned height = SC_CODEC_PROBE_DEFAULT_HEIGHT;
+    if (options->max_size) {
+        // 16:9, multiple of 16 (as the encoder probe of the server)
+        width = options->max_size & ~15;
+        height = (options->max_size * 9 / 16) & ~15;
+        if (!width || !height) {
+            width = 16;
+            height = 16;
+        }
+    }
+
+    float fps = options->max_fps ? strtof(options->max_fps, NULL) : 0;
+    if (!(fps > 0)) {
+        fps = SC_CODEC_PROBE_DEFAULT_FPS;
+    }
+
+    struct sc_decoder_config config = {
+        .hw_decoder = options->hw_decoder,
+        .threads = options->decoder_threads,
+        .mode = options->decoder_mode,
+        .latency_profile = options->latency_profile,
+    };
+
+    return sc_codec_probe_select(width, height, fps * streams, &config,
+                                 codecs);
+}
@@ -0,0 +1,61 @@
+#ifndef SC_CODEC_PROBE_H
+#define SC_CODEC_PROBE_H
+
+#include "common.h"
+
+#include "decoder.h"
+#include "options.h"
+#include "util/tick.h"
+
+// Frames of the synthetic clip (a single key frame, then P-frames)
+#define SC_CODEC_PROBE_FRAMES 16
+// The clip is decoded again until this duration is reached
+#define SC_CODEC_PROBE_MIN_DURATION SC_TICK_FROM_MS(200)
+// The decoding rate must exceed the required frame rate by this factor, to
+// leave time for the rest of the pipeline
+#define SC_CODEC_PROBE_HEADROOM 2
+
+/**
+ * Startup benchmark of the video decoders of the client (--video-codec=auto)
+ *
+ * For each video codec, a short synthetic clip is encoded at the expected
+ * video size (by the encoder of libavcodec, with its fastest settings), then
+ * decoded as fast as possible by a decoder configured as for the session
+ * (same hardware decoder, threads and mode).
+ *
+ * The codecs decoded with SC_CODEC_PROBE_HEADROOM are accepted, the most
+ * efficient first (AV1, then H.265): they reduce the bandwidth needed for the
+ * same quality. A codec which libavcodec cannot encode is only accepted if it
+ * is decoded by hardware. H.264 is always accepted last, as the fallback.
+ *
+ * The server selects the first accepted codec it can encode (see
+ * VideoCodecSelector.java).
+ */
+
+/**
+ * Select the video codecs to propose to the server, most preferred first
+ *
+ * `width` x `height` is the expected video size, `fps` the frame rate to
+ * decode (of all the streams decoded in parallel). `config` is the decoder
+ * configuration of the session (NULL for the defaults).
+ *
+ * Return the number of codecs written to `codecs` (at least 1).
+ */
+unsigned
+sc_codec_probe_select(unsigned width, unsigned height, float fps,
+                      const struct sc_decoder_config *config,
+                      enum sc_codec codecs[SC_VIDEO_CODEC_COUNT]);
+
+/**
+ * Select the video codecs for a session with these options
+ *
+ * The expected video size is 16:9 within --max-size (1920x1080 if unset), the
+ * frame rate --max-fps (60 if unset) for each of the `streams` decoded in
+ * parallel.
+ */
+unsigned
+sc_codec_probe_select_for_options(const struct scrcpy_options *options,
+                                  unsigned streams,
+                                  enum sc_codec codecs[SC_VIDEO_CODEC_COUNT]);
+
+#endif
@@ -52,6 +52,16 @@
 # define SCRCPY_LAVU_HAS_CHLAYOUT
 #endif
 
+// In ffmpeg/doc/APIchanges:
+// 2023-05-04 - 0fc9c1f6828 - lavu 58.7.100 - frame.h
+//   Deprecate AVFrame.interlaced_frame, AVFrame.top_field_first, and
+//   AVFrame.key_frame.
+//   Add AV_FRAME_FLAG_INTERLACED, AV_FRAME_FLAG_TOP_FIELD_FIRST, and
+//   AV_FRAME_FLAG_KEY flags as replacement.
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(58, 7, 100)
+# define SCRCPY_LAVU_HAS_FRAME_FLAG_KEY
+#endif
+
 // In ffmpeg/doc/APIchanges:
 // 2023-10-06 - 5432d2aacad - lavc 60.15.100 - avformat.h
 //   Deprecate AVFormatContext.{nb_,}side_data, av_stream_add_side_data(),
@@ -61,6 +71,38 @@
 # define SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
 #endif
 
+// The size parameters of the buffer API (including the alloc callback of
+// av_buffer_pool_init2()) have been changed from int to size_t by the lavu 57
+// major bump.
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+# define SC_AV_BUFFER_SIZE size_t
+#else
+# define SC_AV_BUFFER_SIZE int
+#endif
+
+// The size parameters of the packet side data API (av_packet_get_side_data()
+// and av_packet_unpack_dictionary()) have been changed from int to size_t by
+// the lavc 59 major bump.
+#if LIBAVCODEC_VERSION_MAJOR >= 59
+# define SC_AV_PACKET_SIDE_DATA_SIZE size_t
+#else
+# define SC_AV_PACKET_SIDE_DATA_SIZE int
+#endif
+
+// The buffer of the write_packet callback of avio_alloc_context() is const
+// since the lavf 61 major bump.
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+# define SC_AVIO_WRITE_BUFFER const uint8_t
+#else
+# define SC_AVIO_WRITE_BUFFER uint8_t
+#endif
+
+// avcodec_get_hw_config() (and the AV_CODEC_HW_CONFIG_* API) has been added
+// in FFmpeg 4.0.
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 18, 100)
+# define SCRCPY_LAVC_HAS_HW_CONFIG
+#endif
+
 #if SDL_VERSION_ATLEAST(2, 0, 6)
 // <https://github.com/libsdl-org/SDL/commit/d7a318de563125e5bb465b1000d6bc9576fbc6fc>
 # define SCRCPY_SDL_HAS_HINT_TOUCH_MOUSE_EVENTS
@@ -73,6 +115,8 @@
 
 #if SDL_VERSION_ATLEAST(2, 0, 16)
 # define SCRCPY_SDL_HAS_THREAD_PRIORITY_TIME_CRITICAL
+// SDL_UpdateNVTexture()
+# define SCRCPY_SDL_HAS_UPDATE_NV_TEXTURE
 #endif
 
 #ifndef HAVE_STRDUP
@@ -183,11 +183,33 @@ sc_control_msg_serialize(const struct sc_control_msg *msg, uint8_t *buf) {
         case SC_CONTROL_MSG_TYPE_UHID_DESTROY:
             sc_write16be(&buf[1], msg->uhid_destroy.id);
             return 3;
+        case SC_CONTROL_MSG_TYPE_CLOCK_SYNC:
+            sc_write64be(&buf[1], msg->clock_sync.client_time);
+            return 9;
+        case SC_CONTROL_MSG_TYPE_SET_VIDEO_BIT_RATE:
+            sc_write32be(&buf[1], msg->set_video_bit_rate.bit_rate);
+            return 5;
+        case SC_CONTROL_MSG_TYPE_TIME_PING:
+            sc_write64be(&buf[1], msg->time_ping.client_time);
+            return 9;
+        case SC_CONTROL_MSG_TYPE_SET_CLIPBOARD_CHUNK:
+            // Raw bytes: the chunks may split a UTF-8 sequence
+            assert(msg->set_clipboard_chunk.len
+                    <= SC_CONTROL_MSG_CLIPBOARD_CHUNK_SIZE);
+            sc_write32be(&buf[1], msg->set_clipboard_chunk.len);
+            memcpy(&buf[5], msg->set_clipboard_chunk.data,
+                   msg->set_clipboard_chunk.len);
+            return 5 + msg->set_clipboard_chunk.len;
+        case SC_CONTROL_MSG_TYPE_RECONFIGURE_VIDEO:
+            sc_write16be(&buf[1], msg->reconfigure_video.max_size);
+            sc_write16be(&buf[3], msg->reconfigure_video.max_fps);
+            return 5;
         case SC_CONTROL_MSG_TYPE_EXPAND_NOTIFICATION_PANEL:
         case SC_CONTROL_MSG_TYPE_EXPAND_SETTINGS_PANEL:
         case SC_CONTROL_MSG_TYPE_COLLAPSE_PANELS:
         case SC_CONTROL_MSG_TYPE_ROTATE_DEVICE:
         case SC_CONTROL_MSG_TYPE_OPEN_HARD_KEYBOARD_SETTINGS:
+        case SC_CONTROL_MSG_TYPE_REQUEST_KEY_FRAME:
             // no additional data
             return 1;
         default:
@@ -308,6 +330,30 @@ sc_control_msg_log(const struct sc_control_msg *msg) {
         case SC_CONTROL_MSG_TYPE_OPEN_HARD_KEYBOARD_SETTINGS:
             LOG_CMSG("open hard keyboard settings");
             break;
+        case SC_CONTROL_MSG_TYPE_CLOCK_SYNC:
+            LOG_CMSG("clock sync client_time=%" PRIu64_,
+                     msg->clock_sync.client_time);
+            break;
+        case SC_CONTROL_MSG_TYPE_REQUEST_KEY_FRAME:
+            LOG_CMSG("request key frame");
+            break;
+        case SC_CONTROL_MSG_TYPE_SET_VIDEO_BIT_RATE:
+            LOG_CMSG("set video bit rate %" PRIu32,
+                     msg->set_video_bit_rate.bit_rate);
+            break;
+        case SC_CONTROL_MSG_TYPE_TIME_PING:
+            LOG_CMSG("time ping client_time=%" PRIu64_,
+                     msg->time_ping.client_time);
+            break;
+        case SC_CONTROL_MSG_TYPE_SET_CLIPBOARD_CHUNK:
+            LOG_CMSG("clipboard chunk len=%" PRIu32,
+                     msg->set_clipboard_chunk.len);
+            break;
+        case SC_CONTROL_MSG_TYPE_RECONFIGURE_VIDEO:
+            LOG_CMSG("reconfigure video max_size=%" PRIu16 " max_fps=%" PRIu16,
+                     msg->reconfigure_video.max_size,
+                     msg->reconfigure_video.max_fps);
+            break;
         default:
             LOG_CMSG("unknown type: %u", (unsigned) msg->type);
             break;
@@ -320,8 +366,48 @@ sc_control_msg_is_droppable(const struct sc_control_msg *msg) {
     // UHID_INPUT messages for this device to be invalid.
     // Cannot drop UHID_DESTROY messages either, because a further UHID_CREATE
     // with the same id may fail.
+    // Cannot drop RECONFIGURE_VIDEO messages, the client would assume the
+    // wrong video preset.
     return msg->type != SC_CONTROL_MSG_TYPE_UHID_CREATE
-        && msg->type != SC_CONTROL_MSG_TYPE_UHID_DESTROY;
+        && msg->type != SC_CONTROL_MSG_TYPE_UHID_DESTROY
+        && msg->type != SC_CONTROL_MSG_TYPE_RECONFIGURE_VIDEO;
+}
+
+bool
+sc_control_msg_is_superseded_by(const struct sc_control_msg *msg,
+                                const struct sc_control_msg *next) {
+    if (!sc_control_msg_is_droppable(msg) || msg->type != next->type) {
+        return false;
+    }
+
+    if (msg->type == SC_CONTROL_MSG_TYPE_UHID_INPUT) {
+        return msg->uhid_input.coalescable
+            && next->uhid_input.coalescable
+            && next->uhid_input.id == msg->uhid_input.id;
+    }
+
+    if (msg->type != SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT) {
+        return false;
+    }
+
+    enum android_motionevent_action action = msg->inject_touch_event.action;
+    if (action != AMOTION_EVENT_ACTION_MOVE
+            && action != AMOTION_EVENT_ACTION_HOVER_MOVE) {
+        return false;
+    }
+
+    // Same pointer and buttons state, and the same screen size (the position
+    // is scaled accordingly by the device)
+    const struct sc_position *pos = &msg->inject_touch_event.position;
+    const struct sc_position *next_pos = &next->inject_touch_event.position;
+    return next->inject_touch_event.action == action
+        && next->inject_touch_event.pointer_id
+                == msg->inject_touch_event.pointer_id
+        && next->inject_touch_event.action_button
+                == msg->inject_touch_event.action_button
+        && next->inject_touch_event.buttons == msg->inject_touch_event.buttons
+        && next_pos->screen_size.width == pos->screen_size.width
+        && next_pos->screen_size.height == pos->screen_size.height;
 }
 
 void
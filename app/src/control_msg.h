@@ -17,6 +17,12 @@
 #define SC_CONTROL_MSG_INJECT_TEXT_MAX_LENGTH 300
 // type: 1 byte; sequence: 8 bytes; paste flag: 1 byte; length: 4 bytes
 #define SC_CONTROL_MSG_CLIPBOARD_TEXT_MAX_LENGTH (SC_CONTROL_MSG_MAX_SIZE - 14)
+// A longer clipboard text is sent as SET_CLIPBOARD_CHUNK messages of this size
+// (the device concatenates them), followed by a SET_CLIPBOARD message with the
+// end of the text
+#define SC_CONTROL_MSG_CLIPBOARD_CHUNK_SIZE (1 << 14) // 16k
+// Maximum total length of a clipboard text (the device rejects a longer one)
+#define SC_CONTROL_MSG_CLIPBOARD_TOTAL_MAX_LENGTH (1 << 24) // 16M
 
 #define SC_POINTER_ID_MOUSE UINT64_C(-1)
 #define SC_POINTER_ID_GENERIC_FINGER UINT64_C(-2)
@@ -41,6 +47,12 @@ enum sc_control_msg_type {
     SC_CONTROL_MSG_TYPE_UHID_INPUT,
     SC_CONTROL_MSG_TYPE_UHID_DESTROY,
     SC_CONTROL_MSG_TYPE_OPEN_HARD_KEYBOARD_SETTINGS,
+    SC_CONTROL_MSG_TYPE_CLOCK_SYNC,
+    SC_CONTROL_MSG_TYPE_REQUEST_KEY_FRAME,
+    SC_CONTROL_MSG_TYPE_SET_VIDEO_BIT_RATE,
+    SC_CONTROL_MSG_TYPE_TIME_PING,
+    SC_CONTROL_MSG_TYPE_SET_CLIPBOARD_CHUNK,
+    SC_CONTROL_MSG_TYPE_RECONFIGURE_VIDEO,
 };
 
 enum sc_screen_power_mode {
@@ -106,10 +118,28 @@ struct sc_control_msg {
             uint16_t id;
             uint16_t size;
             uint8_t data[SC_HID_MAX_SIZE];
+            bool coalescable; // not serialized, see sc_hid_input
         } uhid_input;
         struct {
             uint16_t id;
         } uhid_destroy;
+        struct {
+            uint64_t client_time; // sc_tick, echoed back by the device
+        } clock_sync;
+        struct {
+            uint32_t bit_rate; // in bits per second
+        } set_video_bit_rate;
+        struct {
+            uint64_t client_time; // sc_tick, echoed back by the device
+        } time_ping;
+        struct {
+            const char *data; // not owned (part of a set_clipboard text)
+            uint32_t len;
+        } set_clipboard_chunk;
+        struct {
+            uint16_t max_size; // 0 for unlimited
+            uint16_t max_fps; // 0 for unlimited
+        } reconfigure_video;
     };
 };
 
@@ -126,6 +156,14 @@ sc_control_msg_log(const struct sc_control_msg *msg);
 bool
 sc_control_msg_is_droppable(const struct sc_control_msg *msg);
 
+// Indicate if a (droppable) message may be dropped because the next message
+// replaces it: both are moves of the same pointer, or both are UHID inputs
+// changing only absolute values (e.g. gamepad axes) of the same device, so
+// only the last one matters.
+bool
+sc_control_msg_is_superseded_by(const struct sc_control_msg *msg,
+                                const struct sc_control_msg *next);
+
 void
 sc_control_msg_destroy(struct sc_control_msg *msg);
 
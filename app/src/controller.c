@@ -1,11 +1,13 @@
 #include "controller.h"
 
 #include <assert.h>
+#include <string.h>
 
 #include "util/log.h"
+#include "util/str.h"
 
-// Drop droppable events above this limit
-#define SC_CONTROL_MSG_QUEUE_LIMIT 60
+// Maximum number of messages sent at once
+#define SC_CONTROL_MSG_BATCH_SIZE (SC_CONTROL_MSG_QUEUE_LIMIT + 4)
 
 static void
 sc_controller_receiver_on_ended(struct sc_receiver *receiver, bool error,
@@ -21,23 +23,20 @@ bool
 sc_controller_init(struct sc_controller *controller, sc_socket control_socket,
                    const struct sc_controller_callbacks *cbs,
                    void *cbs_userdata) {
-    sc_vecdeque_init(&controller->queue);
-
-    // Add 4 to support 4 non-droppable events without re-allocation
-    bool ok = sc_vecdeque_reserve(&controller->queue,
-                                  SC_CONTROL_MSG_QUEUE_LIMIT + 4);
-    if (!ok) {
-        return false;
-    }
+    // The queue is stored inline, it never allocates unless more than 4
+    // non-droppable events are queued beyond the limit
+    sc_vecdeque_init_inline(&controller->queue);
+    sc_vecdeque_init(&controller->bulk_queue);
 
     static const struct sc_receiver_callbacks receiver_cbs = {
         .on_ended = sc_controller_receiver_on_ended,
     };
 
-    ok = sc_receiver_init(&controller->receiver, control_socket, &receiver_cbs,
-                          controller);
+    bool ok = sc_receiver_init(&controller->receiver, control_socket,
+                               &receiver_cbs, controller);
     if (!ok) {
         sc_vecdeque_destroy(&controller->queue);
+        sc_vecdeque_destroy(&controller->bulk_queue);
         return false;
     }
 
@@ -45,6 +44,7 @@ sc_controller_init(struct sc_controller *controller, sc_socket control_socket,
     if (!ok) {
         sc_receiver_destroy(&controller->receiver);
         sc_vecdeque_destroy(&controller->queue);
+        sc_vecdeque_destroy(&controller->bulk_queue);
         return false;
     }
 
@@ -53,6 +53,7 @@ sc_controller_init(struct sc_controller *controller, sc_socket control_socket,
         sc_receiver_destroy(&controller->receiver);
         sc_mutex_destroy(&controller->mutex);
         sc_vecdeque_destroy(&controller->queue);
+        sc_vecdeque_destroy(&controller->bulk_queue);
         return false;
     }
 
@@ -69,9 +70,13 @@ sc_controller_init(struct sc_controller *controller, sc_socket control_socket,
 void
 sc_controller_configure(struct sc_controller *controller,
                         struct sc_acksync *acksync,
-                        struct sc_uhid_devices *uhid_devices) {
+                        struct sc_uhid_devices *uhid_devices,
+                        struct sc_clock_sync *clock_sync,
+                        struct sc_pose_buffer *pose_buffer) {
     controller->receiver.acksync = acksync;
     controller->receiver.uhid_devices = uhid_devices;
+    controller->receiver.clock_sync = clock_sync;
+    controller->receiver.pose_buffer = pose_buffer;
 }
 
 void
@@ -86,9 +91,22 @@ sc_controller_destroy(struct sc_controller *controller) {
     }
     sc_vecdeque_destroy(&controller->queue);
 
+    while (!sc_vecdeque_is_empty(&controller->bulk_queue)) {
+        struct sc_control_msg *msg =
+            sc_vecdeque_popref(&controller->bulk_queue);
+        assert(msg);
+        sc_control_msg_destroy(msg);
+    }
+    sc_vecdeque_destroy(&controller->bulk_queue);
+
     sc_receiver_destroy(&controller->receiver);
 }
 
+static bool
+sc_control_msg_is_bulk(const struct sc_control_msg *msg) {
+    return msg->type == SC_CONTROL_MSG_TYPE_SET_CLIPBOARD;
+}
+
 bool
 sc_controller_push_msg(struct sc_controller *controller,
                        const struct sc_control_msg *msg) {
@@ -100,7 +118,15 @@ sc_controller_push_msg(struct sc_controller *controller,
 
     sc_mutex_lock(&controller->mutex);
     size_t size = sc_vecdeque_size(&controller->queue);
-    if (size < SC_CONTROL_MSG_QUEUE_LIMIT) {
+    if (sc_control_msg_is_bulk(msg)) {
+        pushed = sc_vecdeque_push(&controller->bulk_queue, *msg);
+        if (pushed) {
+            // The controller thread may be waiting if the other lane is empty
+            sc_cond_signal(&controller->msg_cond);
+        } else {
+            LOG_OOM();
+        }
+    } else if (size < SC_CONTROL_MSG_QUEUE_LIMIT) {
         bool was_empty = sc_vecdeque_is_empty(&controller->queue);
         sc_vecdeque_push_noresize(&controller->queue, *msg);
         pushed = true;
@@ -124,22 +150,111 @@ sc_controller_push_msg(struct sc_controller *controller,
 }
 
 static bool
-process_msg(struct sc_controller *controller,
-            const struct sc_control_msg *msg, bool *eos) {
-    static uint8_t serialized_msg[SC_CONTROL_MSG_MAX_SIZE];
-    size_t length = sc_control_msg_serialize(msg, serialized_msg);
-    if (!length) {
-        *eos = false;
+send_all(struct sc_controller *controller, const uint8_t *buf, size_t len) {
+    ssize_t w = net_send_all(controller->control_socket, buf, len);
+    return (size_t) w == len;
+}
+
+// Serialize the messages into a contiguous buffer, to send them at once (in a
+// single system call and as few TCP segments as possible)
+static bool
+process_msgs(struct sc_controller *controller,
+             const struct sc_control_msg *msgs, size_t count, bool *eos) {
+    // Any message fits after less than SC_CONTROL_MSG_MAX_SIZE bytes
+    static uint8_t buf[2 * SC_CONTROL_MSG_MAX_SIZE];
+    size_t len = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        if (i + 1 < count
+                && sc_control_msg_is_superseded_by(&msgs[i], &msgs[i + 1])) {
+            // Coalesce the consecutive moves: only the last one is sent
+            continue;
+        }
+
+        if (len >= SC_CONTROL_MSG_MAX_SIZE) {
+            if (!send_all(controller, buf, len)) {
+                *eos = true;
+                return false;
+            }
+            len = 0;
+        }
+
+        size_t length = sc_control_msg_serialize(&msgs[i], &buf[len]);
+        if (!length) {
+            *eos = false;
+            return false;
+        }
+        len += length;
+    }
+
+    if (len && !send_all(controller, buf, len)) {
+        *eos = true;
         return false;
     }
 
-    ssize_t w =
-        net_send_all(controller->control_socket, serialized_msg, length);
-    if ((size_t) w != length) {
+    return true;
+}
+
+// A bulk message being sent by chunks
+struct sc_controller_bulk {
+    struct sc_control_msg msg; // SET_CLIPBOARD
+    size_t len; // length of the text
+    size_t offset; // bytes already sent
+};
+
+static void
+sc_controller_bulk_init(struct sc_controller_bulk *bulk,
+                        struct sc_control_msg *msg) {
+    assert(msg->type == SC_CONTROL_MSG_TYPE_SET_CLIPBOARD);
+    bulk->msg = *msg;
+    bulk->offset = 0;
+
+    const char *text = msg->set_clipboard.text;
+    size_t len = text ? strlen(text) : 0;
+    if (len > SC_CONTROL_MSG_CLIPBOARD_TOTAL_MAX_LENGTH) {
+        LOGW("Clipboard text too long (%zu bytes), truncated to %d bytes",
+             len, SC_CONTROL_MSG_CLIPBOARD_TOTAL_MAX_LENGTH);
+        len = sc_str_utf8_truncation_index(text,
+                                    SC_CONTROL_MSG_CLIPBOARD_TOTAL_MAX_LENGTH);
+        // The text is owned by the message
+        msg->set_clipboard.text[len] = '\0';
+    }
+    bulk->len = len;
+}
+
+// Send the next chunk of the bulk message, or its end (the SET_CLIPBOARD
+// message itself). Return true and set *done once the message is sent.
+static bool
+sc_controller_bulk_send(struct sc_controller *controller,
+                        struct sc_controller_bulk *bulk, bool *done,
+                        bool *eos) {
+    static uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+
+    size_t remaining = bulk->len - bulk->offset;
+    const char *text = bulk->msg.set_clipboard.text;
+
+    struct sc_control_msg msg;
+    if (remaining > SC_CONTROL_MSG_CLIPBOARD_CHUNK_SIZE) {
+        msg.type = SC_CONTROL_MSG_TYPE_SET_CLIPBOARD_CHUNK;
+        msg.set_clipboard_chunk.data = text + bulk->offset;
+        msg.set_clipboard_chunk.len = SC_CONTROL_MSG_CLIPBOARD_CHUNK_SIZE;
+        *done = false;
+    } else {
+        // The end of the text, which is not owned by this copy
+        msg = bulk->msg;
+        if (text) {
+            msg.set_clipboard.text = (char *) text + bulk->offset;
+        }
+        *done = true;
+    }
+
+    size_t length = sc_control_msg_serialize(&msg, buf);
+    if (!send_all(controller, buf, length)) {
         *eos = true;
         return false;
     }
 
+    bulk->offset += SC_CONTROL_MSG_CLIPBOARD_CHUNK_SIZE;
     return true;
 }
 
@@ -149,10 +264,17 @@ run_controller(void *data) {
 
     bool error = false;
 
+    struct sc_control_msg msgs[SC_CONTROL_MSG_BATCH_SIZE];
+
+    struct sc_controller_bulk bulk;
+    bool has_bulk = false;
+
     for (;;) {
         sc_mutex_lock(&controller->mutex);
         while (!controller->stopped
-                && sc_vecdeque_is_empty(&controller->queue)) {
+                && sc_vecdeque_is_empty(&controller->queue)
+                && !has_bulk
+                && sc_vecdeque_is_empty(&controller->bulk_queue)) {
             sc_cond_wait(&controller->msg_cond, &controller->mutex);
         }
         if (controller->stopped) {
@@ -162,13 +284,40 @@ run_controller(void *data) {
             break;
         }
 
-        assert(!sc_vecdeque_is_empty(&controller->queue));
-        struct sc_control_msg msg = sc_vecdeque_pop(&controller->queue);
+        // Drain all the pending interactive messages at once
+        size_t count = 0;
+        while (count < SC_CONTROL_MSG_BATCH_SIZE
+                && !sc_vecdeque_is_empty(&controller->queue)) {
+            msgs[count++] = sc_vecdeque_pop(&controller->queue);
+        }
+
+        if (!has_bulk && !sc_vecdeque_is_empty(&controller->bulk_queue)) {
+            struct sc_control_msg *msg =
+                sc_vecdeque_popref(&controller->bulk_queue);
+            sc_controller_bulk_init(&bulk, msg);
+            has_bulk = true;
+        }
         sc_mutex_unlock(&controller->mutex);
 
         bool eos;
-        bool ok = process_msg(controller, &msg, &eos);
-        sc_control_msg_destroy(&msg);
+        bool ok = true;
+        if (count) {
+            ok = process_msgs(controller, msgs, count, &eos);
+            for (size_t i = 0; i < count; ++i) {
+                sc_control_msg_destroy(&msgs[i]);
+            }
+        }
+
+        if (ok && has_bulk) {
+            // One chunk at most, then the interactive messages again
+            bool done;
+            ok = sc_controller_bulk_send(controller, &bulk, &done, &eos);
+            if (!ok || done) {
+                sc_control_msg_destroy(&bulk.msg);
+                has_bulk = false;
+            }
+        }
+
         if (!ok) {
             if (eos) {
                 LOGD("Controller stopped (socket closed)");
@@ -178,6 +327,10 @@ run_controller(void *data) {
         }
     }
 
+    if (has_bulk) {
+        sc_control_msg_destroy(&bulk.msg);
+    }
+
     controller->cbs->on_ended(controller, error, controller->cbs_userdata);
 
     return 0;
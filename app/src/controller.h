@@ -12,8 +12,25 @@
 #include "util/thread.h"
 #include "util/vecdeque.h"
 
-struct sc_control_msg_queue SC_VECDEQUE(struct sc_control_msg);
+// Drop droppable events above this limit
+#define SC_CONTROL_MSG_QUEUE_LIMIT 60
 
+// Add 4 to support 4 non-droppable events without re-allocation
+struct sc_control_msg_queue
+    SC_VECDEQUE_INLINE(struct sc_control_msg, SC_CONTROL_MSG_QUEUE_LIMIT + 4);
+
+// Bulk messages (clipboard texts), never dropped
+struct sc_control_msg_bulk_queue SC_VECDEQUE(struct sc_control_msg);
+
+/**
+ * Send the control messages to the device
+ *
+ * The messages are sent in two lanes: the interactive messages (input events,
+ * clock sync, etc.) are always sent first, and the bulk messages (clipboard
+ * texts) are sent by chunks of SC_CONTROL_MSG_CLIPBOARD_CHUNK_SIZE bytes in
+ * between, so that a large transfer delays an interactive message by one
+ * chunk at most.
+ */
 struct sc_controller {
     sc_socket control_socket;
     sc_thread thread;
@@ -21,6 +38,7 @@ struct sc_controller {
     sc_cond msg_cond;
     bool stopped;
     struct sc_control_msg_queue queue;
+    struct sc_control_msg_bulk_queue bulk_queue;
     struct sc_receiver receiver;
 
     const struct sc_controller_callbacks *cbs;
@@ -40,7 +58,9 @@ sc_controller_init(struct sc_controller *controller, sc_socket control_socket,
 void
 sc_controller_configure(struct sc_controller *controller,
                         struct sc_acksync *acksync,
-                        struct sc_uhid_devices *uhid_devices);
+                        struct sc_uhid_devices *uhid_devices,
+                        struct sc_clock_sync *clock_sync,
+                        struct sc_pose_buffer *pose_buffer);
 
 void
 sc_controller_destroy(struct sc_controller *controller);
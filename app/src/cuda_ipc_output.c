@@ -0,0 +1,307 @@
+#include "cuda_ipc_output.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cuda_runtime_api.h>
+
+#include "cuda_ipc_ring.h"
+#include "util/log.h"
+#include "util/shm.h"
+#include "util/thread.h"
+
+// Pitch alignment of the planes (the texture alignment of all the devices)
+#define SC_CUDA_IPC_PITCH_ALIGN 512
+
+#define SC_ALIGN(x, a) (((x) + (a) - 1) / (a) * (a))
+
+static_assert(sizeof(cudaIpcMemHandle_t) == SC_CUDA_IPC_RING_HANDLE_SIZE,
+              "unexpected CUDA IPC handle size");
+
+enum sc_cuda_ipc_slot_state {
+    SC_CUDA_IPC_SLOT_FREE, // published, or without content
+    SC_CUDA_IPC_SLOT_WRITING,
+    SC_CUDA_IPC_SLOT_FILLED, // written, waiting to be published
+};
+
+struct sc_cuda_ipc_output_slot {
+    void *data; // device memory
+    size_t size;
+    enum sc_cuda_ipc_slot_state state;
+    int64_t pts; // if FILLED
+    uint64_t last_use; // to reuse the least recently acquired slot
+};
+
+struct sc_cuda_ipc_output {
+    struct sc_shm shm;
+    int device;
+
+    sc_mutex mutex;
+    struct sc_cuda_ipc_output_slot slots[SC_CUDA_IPC_RING_SLOT_COUNT];
+    uint64_t acquire_count;
+    uint64_t write_count;
+    bool busy_logged;
+};
+
+// The counters are plain integers in the (self-contained) layout, but they are
+// shared with other processes, so they are always accessed atomically
+static inline atomic_uint_least64_t *
+sc_cuda_ipc_counter(uint64_t *counter) {
+    return (atomic_uint_least64_t *) counter;
+}
+
+static inline struct sc_cuda_ipc_ring_header *
+sc_cuda_ipc_output_header(struct sc_cuda_ipc_output *out) {
+    return out->shm.data;
+}
+
+static void
+sc_cuda_ipc_log_error(const char *what, cudaError_t err) {
+    LOGE("CUDA IPC output: %s: %s", what, cudaGetErrorString(err));
+}
+
+struct sc_cuda_ipc_output *
+sc_cuda_ipc_output_new(const char *name) {
+    struct sc_cuda_ipc_output *out = calloc(1, sizeof(*out));
+    if (!out) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    cudaError_t err = cudaGetDevice(&out->device);
+    if (err != cudaSuccess) {
+        sc_cuda_ipc_log_error("no CUDA device", err);
+        goto error_free;
+    }
+
+    char pci_bus_id[16];
+    err = cudaDeviceGetPCIBusId(pci_bus_id, sizeof(pci_bus_id), out->device);
+    if (err != cudaSuccess) {
+        sc_cuda_ipc_log_error("could not get the device PCI bus id", err);
+        goto error_free;
+    }
+
+    if (!sc_mutex_init(&out->mutex)) {
+        goto error_free;
+    }
+
+    if (!sc_shm_create(&out->shm, name,
+                       sizeof(struct sc_cuda_ipc_ring_header))) {
+        LOGE("Could not create shared memory: %s", name);
+        goto error_destroy_mutex;
+    }
+
+    struct sc_cuda_ipc_ring_header *header = sc_cuda_ipc_output_header(out);
+    header->version = SC_CUDA_IPC_RING_VERSION;
+    header->slot_count = SC_CUDA_IPC_RING_SLOT_COUNT;
+    memcpy(header->pci_bus_id, pci_bus_id, sizeof(header->pci_bus_id));
+    atomic_init(sc_cuda_ipc_counter(&header->write_count), 0);
+    for (unsigned i = 0; i < SC_CUDA_IPC_RING_SLOT_COUNT; ++i) {
+        // No content yet
+        atomic_init(sc_cuda_ipc_counter(&header->slots[i].sequence), 1);
+    }
+
+    // Publish the header only once it is fully initialized
+    atomic_thread_fence(memory_order_release);
+    memcpy(header->magic, SC_CUDA_IPC_RING_MAGIC, sizeof(header->magic));
+
+    LOGI("CUDA IPC output: %s (%d slots on device %s)", name,
+         SC_CUDA_IPC_RING_SLOT_COUNT, pci_bus_id);
+    return out;
+
+error_destroy_mutex:
+    sc_mutex_destroy(&out->mutex);
+error_free:
+    free(out);
+    return NULL;
+}
+
+void
+sc_cuda_ipc_output_destroy(struct sc_cuda_ipc_output *out) {
+    for (unsigned i = 0; i < SC_CUDA_IPC_RING_SLOT_COUNT; ++i) {
+        assert(out->slots[i].state != SC_CUDA_IPC_SLOT_WRITING);
+        if (out->slots[i].data) {
+            cudaFree(out->slots[i].data);
+        }
+    }
+    sc_shm_destroy(&out->shm);
+    sc_mutex_destroy(&out->mutex);
+    free(out);
+}
+
+// Allocate (and export) the device memory of the slot if it is too small
+static bool
+sc_cuda_ipc_output_reserve(struct sc_cuda_ipc_output *out, unsigned index,
+                           size_t size) {
+    struct sc_cuda_ipc_output_slot *s = &out->slots[index];
+    if (s->size >= size) {
+        return true;
+    }
+
+    // The processing threads may not have selected the device
+    cudaError_t err = cudaSetDevice(out->device);
+    if (err != cudaSuccess) {
+        sc_cuda_ipc_log_error("could not select the device", err);
+        return false;
+    }
+
+    if (s->data) {
+        cudaFree(s->data);
+        s->data = NULL;
+        s->size = 0;
+    }
+
+    void *data;
+    err = cudaMalloc(&data, size);
+    if (err != cudaSuccess) {
+        sc_cuda_ipc_log_error("could not allocate device memory", err);
+        return false;
+    }
+
+    cudaIpcMemHandle_t handle;
+    err = cudaIpcGetMemHandle(&handle, data);
+    if (err != cudaSuccess) {
+        sc_cuda_ipc_log_error("could not export device memory", err);
+        cudaFree(data);
+        return false;
+    }
+
+    s->data = data;
+    s->size = size;
+
+    // The slot is being written (its sequence is odd)
+    struct sc_cuda_ipc_ring_slot *rs =
+        &sc_cuda_ipc_output_header(out)->slots[index];
+    memcpy(rs->handle, &handle, sizeof(handle));
+    ++rs->generation;
+    return true;
+}
+
+bool
+sc_cuda_ipc_output_acquire(struct sc_cuda_ipc_output *out, int width,
+                           int height, unsigned plane_count,
+                           struct sc_cuda_ipc_slot *slot) {
+    assert(plane_count == 1 || plane_count == 3);
+    assert(!(width % 2) && !(height % 2));
+
+    struct sc_cuda_ipc_ring_header *header = sc_cuda_ipc_output_header(out);
+
+    sc_mutex_lock(&out->mutex);
+
+    // The least recently acquired slot which is not being written (a filled
+    // slot which has not been published yet is for a frame dropped by the
+    // output)
+    int index = -1;
+    for (unsigned i = 0; i < SC_CUDA_IPC_RING_SLOT_COUNT; ++i) {
+        struct sc_cuda_ipc_output_slot *s = &out->slots[i];
+        if (s->state != SC_CUDA_IPC_SLOT_WRITING
+                && (index == -1 || s->last_use < out->slots[index].last_use)) {
+            index = i;
+        }
+    }
+
+    if (index == -1) {
+        bool log = !out->busy_logged;
+        out->busy_logged = true;
+        sc_mutex_unlock(&out->mutex);
+        if (log) {
+            LOGW("CUDA IPC output: all the slots are being written, some "
+                 "frames are not exported");
+        }
+        return false;
+    }
+
+    struct sc_cuda_ipc_output_slot *s = &out->slots[index];
+    s->state = SC_CUDA_IPC_SLOT_WRITING;
+    s->last_use = ++out->acquire_count;
+
+    // Mark the slot as being written before modifying the device memory
+    struct sc_cuda_ipc_ring_slot *rs = &header->slots[index];
+    atomic_uint_least64_t *sequence = sc_cuda_ipc_counter(&rs->sequence);
+    uint64_t seq = atomic_load_explicit(sequence, memory_order_relaxed);
+    if (!(seq & 1)) {
+        atomic_store_explicit(sequence, seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+    }
+
+    sc_mutex_unlock(&out->mutex);
+
+    // The slot is owned by the calling thread until it is filled
+    size_t pitch_y = SC_ALIGN((size_t) width, SC_CUDA_IPC_PITCH_ALIGN);
+    size_t pitch_c = SC_ALIGN((size_t) width / 2, SC_CUDA_IPC_PITCH_ALIGN);
+    size_t size_y = pitch_y * height;
+    size_t size_c = pitch_c * (height / 2);
+    size_t size = plane_count == 3 ? size_y + 2 * size_c : size_y;
+
+    if (!sc_cuda_ipc_output_reserve(out, index, size)) {
+        sc_mutex_lock(&out->mutex);
+        s->state = SC_CUDA_IPC_SLOT_FREE;
+        sc_mutex_unlock(&out->mutex);
+        return false;
+    }
+
+    rs->width = width;
+    rs->height = height;
+    rs->plane_count = plane_count;
+    rs->offset[0] = 0;
+    rs->pitch[0] = pitch_y;
+    rs->offset[1] = plane_count == 3 ? size_y : 0;
+    rs->pitch[1] = plane_count == 3 ? pitch_c : 0;
+    rs->offset[2] = plane_count == 3 ? size_y + size_c : 0;
+    rs->pitch[2] = plane_count == 3 ? pitch_c : 0;
+
+    slot->index = index;
+    slot->plane_count = plane_count;
+    for (unsigned i = 0; i < plane_count; ++i) {
+        slot->planes[i].data = (uint8_t *) s->data + rs->offset[i];
+        slot->planes[i].pitch = rs->pitch[i];
+    }
+    return true;
+}
+
+void
+sc_cuda_ipc_output_fill(struct sc_cuda_ipc_output *out,
+                        const struct sc_cuda_ipc_slot *slot, int64_t pts,
+                        bool ok) {
+    sc_mutex_lock(&out->mutex);
+    struct sc_cuda_ipc_output_slot *s = &out->slots[slot->index];
+    assert(s->state == SC_CUDA_IPC_SLOT_WRITING);
+    // Without content, the sequence of the slot remains odd
+    s->state = ok ? SC_CUDA_IPC_SLOT_FILLED : SC_CUDA_IPC_SLOT_FREE;
+    s->pts = pts;
+    sc_mutex_unlock(&out->mutex);
+}
+
+void
+sc_cuda_ipc_output_publish(struct sc_cuda_ipc_output *out, int64_t pts,
+                           uint64_t frame_number, int64_t timestamp_us) {
+    struct sc_cuda_ipc_ring_header *header = sc_cuda_ipc_output_header(out);
+
+    sc_mutex_lock(&out->mutex);
+
+    for (unsigned i = 0; i < SC_CUDA_IPC_RING_SLOT_COUNT; ++i) {
+        struct sc_cuda_ipc_output_slot *s = &out->slots[i];
+        if (s->state != SC_CUDA_IPC_SLOT_FILLED || s->pts != pts) {
+            continue;
+        }
+
+        struct sc_cuda_ipc_ring_slot *rs = &header->slots[i];
+        rs->frame_number = frame_number;
+        rs->timestamp_us = timestamp_us;
+
+        atomic_uint_least64_t *sequence = sc_cuda_ipc_counter(&rs->sequence);
+        uint64_t seq = atomic_load_explicit(sequence, memory_order_relaxed);
+        assert(seq & 1);
+        atomic_store_explicit(sequence, seq + 1, memory_order_release);
+        s->state = SC_CUDA_IPC_SLOT_FREE;
+
+        ++out->write_count;
+        atomic_store_explicit(sc_cuda_ipc_counter(&header->write_count),
+                              out->write_count, memory_order_release);
+        break;
+    }
+
+    sc_mutex_unlock(&out->mutex);
+}
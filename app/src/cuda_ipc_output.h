@@ -0,0 +1,79 @@
+#ifndef SC_CUDA_IPC_OUTPUT_H
+#define SC_CUDA_IPC_OUTPUT_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Ring of rectified frames in CUDA device memory, for the local consumers
+ * running on the same GPU (--cuda-ipc-output)
+ *
+ * See cuda_ipc_ring.h for the layout and the synchronization protocol.
+ *
+ * The frames are remapped by the cuda backend directly into a slot, acquired
+ * by the thread processing the frame. Once the frame is output (in order, by
+ * the output thread of the video processor, which knows its frame number and
+ * its timestamp), the slot is published.
+ *
+ * This is only available if scrcpy is built with the CUDA runtime
+ * (HAVE_CUDA_IPC).
+ */
+struct sc_cuda_ipc_output;
+
+struct sc_cuda_ipc_plane {
+    void *data; // device memory
+    size_t pitch;
+};
+
+struct sc_cuda_ipc_slot {
+    unsigned index;
+    unsigned plane_count;
+    struct sc_cuda_ipc_plane planes[3];
+};
+
+/**
+ * Create the ring (the metadata shared memory is named `name`), for the
+ * current CUDA device
+ *
+ * Return NULL on error.
+ */
+struct sc_cuda_ipc_output *
+sc_cuda_ipc_output_new(const char *name);
+
+void
+sc_cuda_ipc_output_destroy(struct sc_cuda_ipc_output *out);
+
+/**
+ * Acquire a slot to write a frame of width x height (YUV420P, or only the Y
+ * plane if plane_count is 1)
+ *
+ * Return false if no slot is available (all of them are being written by
+ * other threads) or on error: the frame is not exported.
+ */
+bool
+sc_cuda_ipc_output_acquire(struct sc_cuda_ipc_output *out, int width,
+                           int height, unsigned plane_count,
+                           struct sc_cuda_ipc_slot *slot);
+
+/**
+ * Mark the slot as written (the device work is complete) with the frame `pts`
+ *
+ * If `ok` is false, the slot is released without content.
+ */
+void
+sc_cuda_ipc_output_fill(struct sc_cuda_ipc_output *out,
+                        const struct sc_cuda_ipc_slot *slot, int64_t pts,
+                        bool ok);
+
+/**
+ * Publish the slot filled with the frame `pts`, if any (it may have been
+ * reused meanwhile, or the frame may not have been exported)
+ */
+void
+sc_cuda_ipc_output_publish(struct sc_cuda_ipc_output *out, int64_t pts,
+                           uint64_t frame_number, int64_t timestamp_us);
+
+#endif
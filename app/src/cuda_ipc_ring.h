@@ -0,0 +1,74 @@
+#ifndef SC_CUDA_IPC_RING_H
+#define SC_CUDA_IPC_RING_H
+
+// This header is self-contained (it does not include common.h), because it
+// describes the shared memory layout used by external consumers
+#include <stdint.h>
+
+/**
+ * Layout of the ring of rectified frames on the GPU (--cuda-ipc-output)
+ *
+ * The frames stay in CUDA device memory: each slot is a device allocation,
+ * exported as a CUDA IPC memory handle. Only the metadata is in a named shared
+ * memory (see util/shm.h), which starts with a `struct sc_cuda_ipc_ring_header`
+ * (the magic is written last on initialization).
+ *
+ * A consumer opens the device memory of a slot with cudaIpcOpenMemHandle()
+ * (on the device identified by `pci_bus_id`), once per `generation` of the
+ * slot: the memory of a slot is reallocated (and exported again) only when
+ * the frames get larger.
+ *
+ * A slot contains a YUV420P frame (or only its Y plane if `plane_count` is 1),
+ * each plane at `offset[i]` in the device memory, with a pitch of `pitch[i]`
+ * bytes. Only the video content is exported, without the timestamps bar
+ * (--show-timestamps).
+ *
+ * Each slot is protected by a sequence lock: `sequence` is odd while the slot
+ * is being written (or if it does not contain a published frame). To read a
+ * slot, a consumer must:
+ *  1. load `sequence` (acquire), and skip the slot if it is odd;
+ *  2. read the metadata, and process the frame on the device;
+ *  3. wait for the completion of its device work (e.g.
+ *     cudaStreamSynchronize()), then load `sequence` again (after an acquire
+ *     fence): if it changed, the slot has been overwritten meanwhile, and the
+ *     result must be discarded.
+ *
+ * The frames are not necessarily written in the slots in order: the last
+ * frame is in the published slot with the highest `frame_number`.
+ * `write_count` is incremented for each published frame, so that a consumer
+ * may poll it to detect a new frame.
+ *
+ * All the fields are in host byte order. The 64-bit counters must be accessed
+ * atomically.
+ */
+
+#define SC_CUDA_IPC_RING_MAGIC "SCCUDARN"
+#define SC_CUDA_IPC_RING_VERSION 1
+#define SC_CUDA_IPC_RING_SLOT_COUNT 4
+// sizeof(cudaIpcMemHandle_t)
+#define SC_CUDA_IPC_RING_HANDLE_SIZE 64
+
+struct sc_cuda_ipc_ring_slot {
+    uint64_t sequence; // odd while the slot is being written
+    uint64_t generation; // incremented when the device memory is reallocated
+    uint8_t handle[SC_CUDA_IPC_RING_HANDLE_SIZE]; // cudaIpcMemHandle_t
+    uint64_t frame_number;
+    int64_t timestamp_us; // same as the timestamps of the other outputs
+    uint32_t width;
+    uint32_t height;
+    uint32_t plane_count; // 3 (YUV420P) or 1 (Y only)
+    uint32_t reserved;
+    uint64_t offset[3]; // of each plane in the device memory
+    uint64_t pitch[3]; // in bytes
+};
+
+struct sc_cuda_ipc_ring_header {
+    char magic[8]; // SC_CUDA_IPC_RING_MAGIC, written last on initialization
+    uint32_t version;
+    uint32_t slot_count;
+    char pci_bus_id[16]; // of the CUDA device, e.g. "0000:01:00.0"
+    uint64_t write_count; // number of frames published so far
+    struct sc_cuda_ipc_ring_slot slots[SC_CUDA_IPC_RING_SLOT_COUNT];
+};
+
+#endif
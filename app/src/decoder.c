@@ -1,16 +1,197 @@
 #include "decoder.h"
 
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/channel_layout.h>
+#include <libavutil/dict.h>
+#include <libswscale/swscale.h>
+#ifdef SCRCPY_LAVC_HAS_HW_CONFIG
+# include <libavutil/hwcontext.h>
+#endif
 
 #include "events.h"
+#include "latency_trace.h"
+#include "metrics.h"
+#include "hw_decoder.h"
 #include "trait/frame_sink.h"
+#include "util/alloc_stats.h"
 #include "util/log.h"
 
 /** Downcast packet_sink to decoder */
 #define DOWNCAST(SINK) container_of(SINK, struct sc_decoder, packet_sink)
 
+void
+sc_decoder_configure(AVCodecContext *ctx,
+                     const struct sc_decoder_config *config) {
+    assert(ctx->codec_type == AVMEDIA_TYPE_VIDEO);
+
+    ctx->thread_count = config->threads;
+    if (config->mode == SC_DECODER_MODE_THROUGHPUT) {
+        // FFmpeg disables frame threading on low delay
+        ctx->flags &= ~AV_CODEC_FLAG_LOW_DELAY;
+        ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    } else {
+        ctx->thread_type = FF_THREAD_SLICE;
+    }
+
+    if (config->latency_profile == SC_LATENCY_PROFILE_ULTRA_LOW) {
+        // Allow the speedups which are not spec compliant (e.g. skipping the
+        // bitstream checks)
+        ctx->flags2 |= AV_CODEC_FLAG2_FAST;
+    }
+
+    if (config->hw_decoder != SC_HW_DECODER_NONE) {
+        // On failure, the video is decoded in software (already logged)
+        sc_hw_decoder_configure(ctx, config->hw_decoder);
+    }
+}
+
+bool
+sc_decoder_pool_init(struct sc_decoder_pool *pool) {
+    if (!sc_mutex_init(&pool->mutex)) {
+        return false;
+    }
+
+    sc_frame_pool_init(&pool->pool);
+    pool->requested = 0;
+    pool->fallbacks = 0;
+    return true;
+}
+
+void
+sc_decoder_pool_destroy(struct sc_decoder_pool *pool) {
+    if (pool->requested || pool->fallbacks) {
+        LOGD("Decoder pool: %" PRIu64 " frames pooled, %" PRIu64 " allocated "
+             "by libavcodec", pool->requested, pool->fallbacks);
+    }
+    // The frames still referenced are released to the system
+    sc_frame_pool_destroy(&pool->pool);
+    sc_mutex_destroy(&pool->mutex);
+}
+
+// The size of the buffers of the decoded frames, padded as required by the
+// decoder (e.g. the H.264 motion compensation reads past the last rows)
+static bool
+sc_decoder_pool_align(AVCodecContext *ctx, int *width, int *height) {
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(ctx, width, height, linesize_align);
+
+    for (int i = 0; i < 4; ++i) {
+        // The rows of the pool are aligned on 64 bytes
+        if (linesize_align[i] > 64 || 64 % linesize_align[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int
+sc_decoder_pool_get_buffer(AVCodecContext *ctx, AVFrame *frame, int flags) {
+    struct sc_decoder_pool *pool = ctx->opaque;
+
+    // The codecs without direct rendering must use the default allocator, and
+    // the frame pools only hold YUV420P frames
+    int width = frame->width;
+    int height = frame->height;
+    int w = width;
+    int h = height;
+    if (!(ctx->codec->capabilities & AV_CODEC_CAP_DR1)
+            || frame->format != AV_PIX_FMT_YUV420P
+            || !sc_decoder_pool_align(ctx, &w, &h)) {
+        sc_mutex_lock(&pool->mutex);
+        ++pool->fallbacks;
+        sc_mutex_unlock(&pool->mutex);
+        return avcodec_default_get_buffer2(ctx, frame, flags);
+    }
+
+    sc_mutex_lock(&pool->mutex);
+    bool ok = sc_frame_pool_get(&pool->pool, frame, AV_PIX_FMT_YUV420P, w, h);
+    if (ok) {
+        ++pool->requested;
+    }
+    sc_mutex_unlock(&pool->mutex);
+    if (!ok) {
+        return AVERROR(ENOMEM);
+    }
+
+    // The padding rows and columns are not part of the picture
+    frame->width = width;
+    frame->height = height;
+    return 0;
+}
+
+bool
+sc_decoder_use_pool(AVCodecContext *ctx, struct sc_decoder_pool *pool) {
+    assert(ctx->codec_type == AVMEDIA_TYPE_VIDEO);
+
+    if (ctx->hw_device_ctx) {
+        return false;
+    }
+
+    assert(!ctx->opaque);
+    ctx->opaque = pool;
+    ctx->get_buffer2 = sc_decoder_pool_get_buffer;
+    return true;
+}
+
+void
+sc_decoder_pool_prepare(struct sc_decoder_pool *pool, AVCodecContext *ctx) {
+    int w = ctx->width;
+    int h = ctx->height;
+    if (!w || !h || ctx->pix_fmt != AV_PIX_FMT_YUV420P
+            || !sc_decoder_pool_align(ctx, &w, &h)) {
+        return;
+    }
+
+    // The decoding threads each hold a frame being decoded
+    unsigned count = SC_DECODER_POOL_PREPARE + (unsigned) ctx->thread_count;
+    if (count > SC_FRAME_POOL_PREPARE_MAX) {
+        count = SC_FRAME_POOL_PREPARE_MAX;
+    }
+
+    sc_mutex_lock(&pool->mutex);
+    // On failure, the frames are just allocated on demand
+    (void) sc_frame_pool_prepare(&pool->pool, AV_PIX_FMT_YUV420P, w, h,
+                                 count);
+    sc_mutex_unlock(&pool->mutex);
+}
+
+// Return the submission of the packet of this pts, or NULL if unknown
+static struct sc_decoder_submission *
+sc_decoder_find_submission(struct sc_decoder *decoder, int64_t pts) {
+    if (pts == AV_NOPTS_VALUE) {
+        return NULL;
+    }
+
+    for (unsigned i = 0; i < SC_DECODER_LATENCY_SLOTS; ++i) {
+        if (decoder->submitted[i].pts == pts) {
+            return &decoder->submitted[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void
+sc_decoder_set_metadata(AVFrame *frame, struct sc_decoder_submission *sub,
+                        sc_tick now) {
+    sc_tick latency = now - sub->time;
+
+    char value[32];
+    snprintf(value, sizeof(value), "%" PRId64,
+             (int64_t) SC_TICK_TO_US(latency));
+    // On allocation failure, the latency is just not reported
+    av_dict_set(&frame->metadata, SC_DECODER_METADATA_LATENCY_US, value, 0);
+
+    if (sub->skipped) {
+        snprintf(value, sizeof(value), "%" PRIu64, sub->skipped);
+        av_dict_set(&frame->metadata, SC_DECODER_METADATA_SKIPPED, value, 0);
+    }
+}
+
 static bool
 sc_decoder_open(struct sc_decoder *decoder, AVCodecContext *ctx) {
     decoder->frame = av_frame_alloc();
@@ -19,22 +200,156 @@ sc_decoder_open(struct sc_decoder *decoder, AVCodecContext *ctx) {
         return false;
     }
 
+    for (unsigned i = 0; i < SC_DECODER_LATENCY_SLOTS; ++i) {
+        decoder->submitted[i].pts = AV_NOPTS_VALUE;
+    }
+    decoder->submitted_index = 0;
+    decoder->skipped = 0;
+    decoder->discarded = 0;
+
+    decoder->wait_key_frame = false;
+    decoder->key_frame_request_time = 0;
+    decoder->recovered_errors = 0;
+
+    if (ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        LOGD("Decoder '%s': %d threads (%s threading)", decoder->name,
+             ctx->thread_count,
+             ctx->active_thread_type == FF_THREAD_FRAME ? "frame"
+           : ctx->active_thread_type == FF_THREAD_SLICE ? "slice" : "no");
+    }
+
+    decoder->hw_download = NULL;
+    decoder->sw_frame = NULL;
+    decoder->sws = NULL;
+    sc_frame_pool_init(&decoder->frame_pool);
+
+    if (ctx->hw_device_ctx) {
+        decoder->hw_download = av_frame_alloc();
+        if (!decoder->hw_download) {
+            LOG_OOM();
+            goto error;
+        }
+
+        decoder->sw_frame = av_frame_alloc();
+        if (!decoder->sw_frame) {
+            LOG_OOM();
+            goto error;
+        }
+    }
+
     if (!sc_frame_source_sinks_open(&decoder->frame_source, ctx)) {
-        av_frame_free(&decoder->frame);
-        return false;
+        goto error;
     }
 
     decoder->ctx = ctx;
 
     return true;
+
+error:
+    av_frame_free(&decoder->sw_frame);
+    av_frame_free(&decoder->hw_download);
+    sc_frame_pool_destroy(&decoder->frame_pool);
+    av_frame_free(&decoder->frame);
+    return false;
 }
 
 static void
 sc_decoder_close(struct sc_decoder *decoder) {
+    if (decoder->recovered_errors) {
+        LOGI("Decoder '%s': recovered from %" PRIu64 " decoding error(s)",
+             decoder->name, decoder->recovered_errors);
+    }
+    if (decoder->discarded) {
+        LOGD("Decoder '%s': %" PRIu64 " decoded reference frames not output",
+             decoder->name, decoder->discarded);
+    }
+    sc_frame_drops_log(&decoder->drops);
     sc_frame_source_sinks_close(&decoder->frame_source);
+    sws_freeContext(decoder->sws);
+    av_frame_free(&decoder->sw_frame);
+    av_frame_free(&decoder->hw_download);
+    sc_frame_pool_destroy(&decoder->frame_pool);
     av_frame_free(&decoder->frame);
 }
 
+#ifdef SCRCPY_LAVC_HAS_HW_CONFIG
+// Download the hardware frame decoder->frame into decoder->sw_frame, in
+// YUV420P (or NV12 if allowed)
+static bool
+sc_decoder_download(struct sc_decoder *decoder) {
+    AVFrame *hw_frame = decoder->frame;
+    AVFrame *downloaded = decoder->hw_download;
+    AVFrame *out = decoder->sw_frame;
+
+    // The format is selected by FFmpeg (typically NV12)
+    int ret = av_hwframe_transfer_data(downloaded, hw_frame, 0);
+    if (ret < 0) {
+        LOGE("Decoder '%s': could not download hardware frame: %d",
+             decoder->name, ret);
+        return false;
+    }
+
+    if (downloaded->format == AV_PIX_FMT_YUV420P
+            || (decoder->allow_nv12 && downloaded->format == AV_PIX_FMT_NV12)) {
+        av_frame_move_ref(out, downloaded);
+    } else {
+        int w = downloaded->width;
+        int h = downloaded->height;
+        decoder->sws = sws_getCachedContext(decoder->sws, w, h,
+                                            downloaded->format, w, h,
+                                            AV_PIX_FMT_YUV420P, SWS_POINT,
+                                            NULL, NULL, NULL);
+        if (!decoder->sws) {
+            LOGE("Decoder '%s': could not convert hardware frames from %s",
+                 decoder->name, av_get_pix_fmt_name(downloaded->format));
+            av_frame_unref(downloaded);
+            return false;
+        }
+
+        if (!sc_frame_pool_get(&decoder->frame_pool, out, AV_PIX_FMT_YUV420P,
+                               w, h)) {
+            av_frame_unref(downloaded);
+            return false;
+        }
+
+        sws_scale(decoder->sws, (const uint8_t *const *) downloaded->data,
+                  downloaded->linesize, 0, h, out->data, out->linesize);
+        av_frame_unref(downloaded);
+    }
+
+    // Keep the pts and the metadata (capture timestamps)
+    ret = av_frame_copy_props(out, hw_frame);
+    if (ret < 0) {
+        LOG_OOM();
+        av_frame_unref(out);
+        return false;
+    }
+
+    return true;
+}
+#endif
+
+static void
+sc_decoder_request_key_frame(struct sc_decoder *decoder) {
+    decoder->key_frame_request_time = sc_tick_now();
+    if (decoder->cbs && decoder->cbs->on_key_frame_needed) {
+        decoder->cbs->on_key_frame_needed(decoder, decoder->cbs_userdata);
+    }
+}
+
+// Recover from corrupted video data: the frames decoded until the next key
+// frame would reference missing or corrupted frames
+static void
+sc_decoder_reset(struct sc_decoder *decoder) {
+    LOGW("Decoder '%s': corrupted stream, waiting for a key frame",
+         decoder->name);
+    avcodec_flush_buffers(decoder->ctx);
+    decoder->wait_key_frame = true;
+    ++decoder->recovered_errors;
+    sc_frame_drops_add(&decoder->drops, SC_FRAME_DROP_DECODE_ERROR);
+    sc_decoder_request_key_frame(decoder);
+}
+
 static bool
 sc_decoder_push(struct sc_decoder *decoder, const AVPacket *packet) {
     bool is_config = packet->pts == AV_NOPTS_VALUE;
@@ -43,29 +358,121 @@ sc_decoder_push(struct sc_decoder *decoder, const AVPacket *packet) {
         return true;
     }
 
+    bool video = decoder->ctx->codec_type == AVMEDIA_TYPE_VIDEO;
+    if (video && decoder->wait_key_frame) {
+        if (!(packet->flags & AV_PKT_FLAG_KEY)) {
+            // The requested key frame may have been lost
+            sc_tick now = sc_tick_now();
+            if (now - decoder->key_frame_request_time
+                    >= SC_DECODER_KEY_FRAME_REQUEST_INTERVAL) {
+                sc_decoder_request_key_frame(decoder);
+            }
+            sc_frame_drops_add(&decoder->drops, SC_FRAME_DROP_DECODE_ERROR);
+            return true;
+        }
+        decoder->wait_key_frame = false;
+    }
+
+    if (video) {
+        bool output = true;
+        if (decoder->decimate) {
+            bool key_frame = packet->flags & AV_PKT_FLAG_KEY;
+            output = sc_frame_decimator_accept(&decoder->decimator,
+                                               packet->pts, key_frame);
+            // Read by the codec on each packet (also by the frame threads)
+            decoder->ctx->skip_frame = output ? AVDISCARD_DEFAULT
+                                     : decoder->decimator.key_frames
+                                     ? AVDISCARD_NONKEY
+                                     : AVDISCARD_NONREF;
+        }
+
+        unsigned i = decoder->submitted_index;
+        decoder->submitted[i].pts = packet->pts;
+        decoder->submitted[i].time = sc_tick_now();
+        decoder->submitted[i].output = output;
+        decoder->submitted[i].skipped = output ? decoder->skipped : 0;
+        decoder->skipped = output ? 0 : decoder->skipped + 1;
+        decoder->submitted_index = (i + 1) % SC_DECODER_LATENCY_SLOTS;
+    }
+
+    sc_tick start = sc_tick_now();
     int ret = avcodec_send_packet(decoder->ctx, packet);
+    if (video) {
+        sc_metrics_add(SC_METRIC_DECODE_US,
+                       SC_TICK_TO_US(sc_tick_now() - start));
+    }
     if (ret < 0 && ret != AVERROR(EAGAIN)) {
+        if (video && ret == AVERROR_INVALIDDATA) {
+            sc_decoder_reset(decoder);
+            return true;
+        }
         LOGE("Decoder '%s': could not send video packet: %d",
              decoder->name, ret);
         return false;
     }
 
     for (;;) {
+        start = sc_tick_now();
         ret = avcodec_receive_frame(decoder->ctx, decoder->frame);
+        if (video) {
+            sc_metrics_add(SC_METRIC_DECODE_US,
+                           SC_TICK_TO_US(sc_tick_now() - start));
+        }
         if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
             break;
         }
 
         if (ret) {
+            if (video && ret == AVERROR_INVALIDDATA) {
+                sc_decoder_reset(decoder);
+                return true;
+            }
             LOGE("Decoder '%s', could not receive video frame: %d",
                  decoder->name, ret);
             return false;
         }
 
         // a frame was received
-        bool ok = sc_frame_source_sinks_push(&decoder->frame_source,
-                                             decoder->frame);
-        av_frame_unref(decoder->frame);
+        AVFrame *frame = decoder->frame;
+
+        struct sc_decoder_submission *sub = NULL;
+        if (video) {
+            sc_metrics_add(SC_METRIC_DECODED_FRAMES, 1);
+
+            sub = sc_decoder_find_submission(decoder, frame->pts);
+            if (sub) {
+                sub->pts = AV_NOPTS_VALUE;
+                if (!sub->output) {
+                    // Only decoded as a reference of the next frames
+                    ++decoder->discarded;
+                    av_frame_unref(frame);
+                    continue;
+                }
+            }
+        }
+
+#ifdef SCRCPY_LAVC_HAS_HW_CONFIG
+        if (frame->hw_frames_ctx) {
+            // The frame sinks access the frames from the CPU
+            if (!sc_decoder_download(decoder)) {
+                av_frame_unref(frame);
+                return false;
+            }
+            av_frame_unref(frame);
+            frame = decoder->sw_frame;
+        }
+#endif
+
+        if (video) {
+            if (sub) {
+                // The download (if any) is part of the decoding latency
+                sc_decoder_set_metadata(frame, sub, sc_tick_now());
+            }
+            sc_latency_trace_stamp(SC_LATENCY_STAGE_DECODE, frame->pts);
+        }
+
+        bool ok = sc_frame_source_sinks_push(&decoder->frame_source, frame);
+        av_frame_unref(frame);
         if (!ok) {
             // Error already logged
             return false;
@@ -91,12 +498,24 @@ static bool
 sc_decoder_packet_sink_push(struct sc_packet_sink *sink,
                             const AVPacket *packet) {
     struct sc_decoder *decoder = DOWNCAST(sink);
-    return sc_decoder_push(decoder, packet);
+
+    // Called from the demuxer thread
+    enum sc_alloc_subsystem previous = sc_alloc_stats_enter(SC_ALLOC_DECODER);
+    bool ok = sc_decoder_push(decoder, packet);
+    sc_alloc_stats_leave(previous);
+
+    return ok;
 }
 
 void
-sc_decoder_init(struct sc_decoder *decoder, const char *name) {
+sc_decoder_init(struct sc_decoder *decoder, const char *name,
+                const struct sc_decoder_callbacks *cbs, void *cbs_userdata) {
     decoder->name = name; // statically allocated
+    sc_frame_drops_init(&decoder->drops, name);
+    decoder->cbs = cbs;
+    decoder->cbs_userdata = cbs_userdata;
+    decoder->allow_nv12 = false;
+    decoder->decimate = false;
     sc_frame_source_init(&decoder->frame_source);
 
     static const struct sc_packet_sink_ops ops = {
@@ -107,3 +526,16 @@ sc_decoder_init(struct sc_decoder *decoder, const char *name) {
 
     decoder->packet_sink.ops = &ops;
 }
+
+void
+sc_decoder_allow_nv12(struct sc_decoder *decoder) {
+    decoder->allow_nv12 = true;
+}
+
+void
+sc_decoder_set_output_rate(struct sc_decoder *decoder,
+                           const struct sc_output_rate *rate) {
+    assert(rate->fps || rate->key_frames);
+    decoder->decimate = true;
+    sc_frame_decimator_init(&decoder->decimator, rate);
+}
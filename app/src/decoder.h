@@ -3,13 +3,71 @@
 
 #include "common.h"
 
+#include "frame_decimator.h"
+#include "frame_drops.h"
+#include "frame_pool.h"
+#include "options.h"
 #include "trait/frame_source.h"
 #include "trait/packet_sink.h"
+#include "util/thread.h"
+#include "util/tick.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 
+// forward declarations
+struct SwsContext;
+
+// Key of the frame metadata containing the decoding latency (between the
+// packet submission and the frame output) of video frames, in microseconds
+#define SC_DECODER_METADATA_LATENCY_US "scrcpy_decode_latency_us"
+
+// Key of the frame metadata containing the number of video frames not output
+// just before this one (see sc_decoder_set_output_rate()), if any
+#define SC_DECODER_METADATA_SKIPPED "scrcpy_decoder_skipped"
+
+// Number of packets whose submission time is remembered, to compute the
+// decoding latency (must exceed the frame delay of the frame threading)
+#define SC_DECODER_LATENCY_SLOTS 32
+
+// Delay before requesting a key frame again, if the stream is still corrupted
+#define SC_DECODER_KEY_FRAME_REQUEST_INTERVAL SC_TICK_FROM_MS(500)
+
+struct sc_decoder_config {
+    enum sc_hw_decoder hw_decoder;
+    unsigned threads; // 0 for one thread per CPU core
+    enum sc_decoder_mode mode;
+    enum sc_latency_profile latency_profile;
+};
+
+// Number of decoded frames preallocated by sc_decoder_pool_prepare(), beyond
+// the frames held by the decoding threads
+#define SC_DECODER_POOL_PREPARE 4
+
+/**
+ * Pool of the frames decoded in software (see sc_decoder_use_pool())
+ *
+ * The frames are allocated by the codec context from a frame pool (see
+ * frame_pool.h) rather than from the internal pools of libavcodec: their
+ * planes are 64-byte aligned, their rows are not padded beyond the 64-byte
+ * alignment (the row stride is the width if it is a multiple of 64), and they
+ * are backed by the pool memory (locked and huge pages with --huge-pages).
+ * The decoded frames are thus forwarded as is to the pipe, the shared memory
+ * and the texture uploads, without any realignment copy.
+ *
+ * With frame threading, the frames are requested from the decoding threads,
+ * hence the mutex. The pool must outlive the codec context; the frames still
+ * referenced afterwards are released as usual.
+ */
+struct sc_decoder_pool {
+    sc_mutex mutex;
+    struct sc_frame_pool pool;
+    uint64_t requested; // frames allocated from the pool
+    uint64_t fallbacks; // frames allocated by libavcodec
+};
+
 struct sc_decoder {
     struct sc_packet_sink packet_sink; // packet sink trait
     struct sc_frame_source frame_source; // frame source trait
@@ -18,10 +76,115 @@ struct sc_decoder {
 
     AVCodecContext *ctx;
     AVFrame *frame;
+
+    // With hardware decoding (see hw_decoder.h), the frames are downloaded
+    // and converted to YUV420P (the format expected by the frame sinks),
+    // unless they are NV12 and allow_nv12 is set
+    bool allow_nv12;
+    AVFrame *hw_download;
+    AVFrame *sw_frame;
+    struct SwsContext *sws;
+    struct sc_frame_pool frame_pool; // converted frames
+
+    // Submission time of the last packets, by pts
+    struct sc_decoder_submission {
+        int64_t pts;
+        sc_tick time;
+        bool output; // false if not selected by the decimator
+        uint64_t skipped; // packets not selected just before, if output
+    } submitted[SC_DECODER_LATENCY_SLOTS];
+    unsigned submitted_index;
+
+    // If set, only the frames selected by the decimator are output (see
+    // sc_decoder_set_output_rate())
+    bool decimate;
+    struct sc_frame_decimator decimator;
+    uint64_t skipped; // packets not selected since the last selected one
+    uint64_t discarded; // decoded frames not output
+
+    // After a video decoding error, the packets are dropped until the next
+    // key frame (instead of stopping the stream)
+    bool wait_key_frame;
+    sc_tick key_frame_request_time;
+    uint64_t recovered_errors;
+    struct sc_frame_drops drops; // packets not decoded because of the errors
+
+    const struct sc_decoder_callbacks *cbs;
+    void *cbs_userdata;
 };
 
+struct sc_decoder_callbacks {
+    // Called from the demuxer thread when a key frame is needed to recover
+    // from a decoding error (optional)
+    void (*on_key_frame_needed)(struct sc_decoder *decoder, void *userdata);
+};
+
+/**
+ * Configure the (not opened yet) video codec context
+ *
+ * This must be called by the owner of the codec context (the demuxer), before
+ * avcodec_open2().
+ */
+void
+sc_decoder_configure(AVCodecContext *ctx,
+                     const struct sc_decoder_config *config);
+
+bool
+sc_decoder_pool_init(struct sc_decoder_pool *pool);
+
+void
+sc_decoder_pool_destroy(struct sc_decoder_pool *pool);
+
+/**
+ * Allocate the decoded frames of the (not opened yet) video codec context from
+ * the pool
+ *
+ * This must be called after sc_decoder_configure(). With hardware decoding,
+ * the frames are on the device and the pool is not used (ctx->opaque belongs
+ * to the hardware decoder), so it returns false.
+ */
+bool
+sc_decoder_use_pool(AVCodecContext *ctx, struct sc_decoder_pool *pool);
+
+/**
+ * Preallocate the frames for the size of the (opened) codec context, so that
+ * the first frames are not delayed by the allocations
+ */
+void
+sc_decoder_pool_prepare(struct sc_decoder_pool *pool, AVCodecContext *ctx);
+
 // The name must be statically allocated (e.g. a string literal)
+// The callbacks may be NULL
+void
+sc_decoder_init(struct sc_decoder *decoder, const char *name,
+                const struct sc_decoder_callbacks *cbs, void *cbs_userdata);
+
+/**
+ * Forward the NV12 frames downloaded from the hardware decoder as is, instead
+ * of converting them to YUV420P
+ *
+ * All the frame sinks must support NV12 frames. This must be called before
+ * the decoder is opened.
+ */
+void
+sc_decoder_allow_nv12(struct sc_decoder *decoder);
+
+/**
+ * Only output the video frames of a subsampled rate, selected from their PTS
+ * like the video processor does (see sc_frame_decimator)
+ *
+ * The other packets are decoded with AVDISCARD_NONREF (AVDISCARD_NONKEY if
+ * only the key frames are selected), so that the frames which no other frame
+ * references are not decoded at all. The reference frames are still decoded,
+ * but not downloaded (with hardware decoding), converted nor forwarded. Each
+ * output frame carries the number of frames skipped just before it
+ * (SC_DECODER_METADATA_SKIPPED), to preserve the frame numbers.
+ *
+ * The frame sinks must not need the other frames. This must be called before
+ * the decoder is opened.
+ */
 void
-sc_decoder_init(struct sc_decoder *decoder, const char *name);
+sc_decoder_set_output_rate(struct sc_decoder *decoder,
+                           const struct sc_output_rate *rate);
 
 #endif
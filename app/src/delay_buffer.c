@@ -1,37 +1,63 @@
 #include "delay_buffer.h"
 
 #include <assert.h>
+#include <inttypes.h>
 #include <stdlib.h>
 
 #include <libavutil/avutil.h>
 #include <libavformat/avformat.h>
 
+#include "memory_budget.h"
 #include "util/log.h"
+#include "util/memory.h"
 
 /** Downcast frame_sink to sc_delay_buffer */
 #define DOWNCAST(SINK) container_of(SINK, struct sc_delay_buffer, frame_sink)
 
+static void
+sc_delay_buffer_free_slots(struct sc_delay_buffer *db, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        // Release the references still held, if any
+        av_frame_free(&db->slots[i].frame);
+    }
+    free(db->slots);
+}
+
 static bool
-sc_delayed_frame_init(struct sc_delayed_frame *dframe, const AVFrame *frame) {
-    dframe->frame = av_frame_alloc();
-    if (!dframe->frame) {
+sc_delay_buffer_alloc_slots(struct sc_delay_buffer *db) {
+    // Enough frames for the delay at the maximum frame rate (plus the frame
+    // being waited for)
+    uint64_t capacity = db->delay * SC_DELAY_BUFFER_MAX_FPS / SC_TICK_FREQ + 1;
+    db->capacity = MAX(capacity, SC_DELAY_BUFFER_MIN_CAPACITY);
+
+    db->slots = sc_allocarray(db->capacity, sizeof(*db->slots));
+    if (!db->slots) {
         LOG_OOM();
         return false;
     }
 
-    if (av_frame_ref(dframe->frame, frame)) {
-        LOG_OOM();
-        av_frame_free(&dframe->frame);
-        return false;
+    for (size_t i = 0; i < db->capacity; ++i) {
+        db->slots[i].frame = av_frame_alloc();
+        db->slots[i].budget = 0;
+        if (!db->slots[i].frame) {
+            LOG_OOM();
+            sc_delay_buffer_free_slots(db, i);
+            return false;
+        }
     }
 
+    db->head = 0;
+    db->count = 0;
+    sc_frame_drops_init(&db->drops, "Buffering");
     return true;
 }
 
 static void
-sc_delayed_frame_destroy(struct sc_delayed_frame *dframe) {
+sc_delay_buffer_unref_slot(struct sc_delay_buffer *db, size_t index) {
+    struct sc_delayed_frame *dframe = &db->slots[index];
     av_frame_unref(dframe->frame);
-    av_frame_free(&dframe->frame);
+    sc_memory_budget_release(SC_MEMORY_PREVIEW, dframe->budget);
+    dframe->budget = 0;
 }
 
 static int
@@ -43,7 +69,7 @@ run_buffering(void *data) {
     for (;;) {
         sc_mutex_lock(&db->mutex);
 
-        while (!db->stopped && sc_vecdeque_is_empty(&db->queue)) {
+        while (!db->stopped && !db->count) {
             sc_cond_wait(&db->queue_cond, &db->mutex);
         }
 
@@ -52,11 +78,21 @@ run_buffering(void *data) {
             goto stopped;
         }
 
-        struct sc_delayed_frame dframe = sc_vecdeque_pop(&db->queue);
+        // Take the oldest frame out of the ring, so that its slot may be
+        // reused while waiting
+        struct sc_delayed_frame *dframe = &db->slots[db->head];
+        av_frame_move_ref(db->out, dframe->frame);
+        uint64_t budget = dframe->budget;
+        dframe->budget = 0;
+#ifdef SC_BUFFERING_DEBUG
+        sc_tick push_date = dframe->push_date;
+#endif
+        db->head = (db->head + 1) % db->capacity;
+        --db->count;
 
         sc_tick max_deadline = sc_tick_now() + db->delay;
         // PTS (written by the server) are expressed in microseconds
-        sc_tick pts = SC_TICK_FROM_US(dframe.frame->pts);
+        sc_tick pts = SC_TICK_FROM_US(db->out->pts);
 
         bool timed_out = false;
         while (!db->stopped && !timed_out) {
@@ -74,17 +110,19 @@ run_buffering(void *data) {
         sc_mutex_unlock(&db->mutex);
 
         if (stopped) {
-            sc_delayed_frame_destroy(&dframe);
+            av_frame_unref(db->out);
+            sc_memory_budget_release(SC_MEMORY_PREVIEW, budget);
             goto stopped;
         }
 
 #ifdef SC_BUFFERING_DEBUG
         LOGD("Buffering: %" PRItick ";%" PRItick ";%" PRItick,
-             pts, dframe.push_date, sc_tick_now());
+             pts, push_date, sc_tick_now());
 #endif
 
-        bool ok = sc_frame_source_sinks_push(&db->frame_source, dframe.frame);
-        sc_delayed_frame_destroy(&dframe);
+        bool ok = sc_frame_source_sinks_push(&db->frame_source, db->out);
+        av_frame_unref(db->out);
+        sc_memory_budget_release(SC_MEMORY_PREVIEW, budget);
         if (!ok) {
             LOGE("Delayed frame could not be pushed, stopping");
             sc_mutex_lock(&db->mutex);
@@ -98,12 +136,15 @@ run_buffering(void *data) {
 stopped:
     assert(db->stopped);
 
-    // Flush queue
-    while (!sc_vecdeque_is_empty(&db->queue)) {
-        struct sc_delayed_frame *dframe = sc_vecdeque_popref(&db->queue);
-        sc_delayed_frame_destroy(dframe);
+    // Flush the ring (the frames are freed on close)
+    while (db->count) {
+        sc_delay_buffer_unref_slot(db, db->head);
+        db->head = (db->head + 1) % db->capacity;
+        --db->count;
     }
 
+    sc_frame_drops_log(&db->drops);
+
     LOGD("Buffering thread ended");
 
     return 0;
@@ -131,13 +172,23 @@ sc_delay_buffer_frame_sink_open(struct sc_frame_sink *sink,
     }
 
     sc_clock_init(&db->clock);
-    sc_vecdeque_init(&db->queue);
     db->stopped = false;
 
-    if (!sc_frame_source_sinks_open(&db->frame_source, ctx)) {
+    ok = sc_delay_buffer_alloc_slots(db);
+    if (!ok) {
         goto error_destroy_wait_cond;
     }
 
+    db->out = av_frame_alloc();
+    if (!db->out) {
+        LOG_OOM();
+        goto error_free_slots;
+    }
+
+    if (!sc_frame_source_sinks_open(&db->frame_source, ctx)) {
+        goto error_free_out;
+    }
+
     ok = sc_thread_create(&db->thread, run_buffering, "scrcpy-dbuf", db);
     if (!ok) {
         LOGE("Could not start buffering thread");
@@ -148,6 +199,10 @@ sc_delay_buffer_frame_sink_open(struct sc_frame_sink *sink,
 
 error_close_sinks:
     sc_frame_source_sinks_close(&db->frame_source);
+error_free_out:
+    av_frame_free(&db->out);
+error_free_slots:
+    sc_delay_buffer_free_slots(db, db->capacity);
 error_destroy_wait_cond:
     sc_cond_destroy(&db->wait_cond);
 error_destroy_queue_cond:
@@ -172,6 +227,8 @@ sc_delay_buffer_frame_sink_close(struct sc_frame_sink *sink) {
 
     sc_frame_source_sinks_close(&db->frame_source);
 
+    av_frame_free(&db->out);
+    sc_delay_buffer_free_slots(db, db->capacity);
     sc_cond_destroy(&db->wait_cond);
     sc_cond_destroy(&db->queue_cond);
     sc_mutex_destroy(&db->mutex);
@@ -198,23 +255,40 @@ sc_delay_buffer_frame_sink_push(struct sc_frame_sink *sink,
         return sc_frame_source_sinks_push(&db->frame_source, frame);
     }
 
-    struct sc_delayed_frame dframe;
-    bool ok = sc_delayed_frame_init(&dframe, frame);
-    if (!ok) {
-        sc_mutex_unlock(&db->mutex);
-        return false;
+    if (db->count == db->capacity) {
+        // The frames arrive faster than expected, drop the oldest one
+        sc_delay_buffer_unref_slot(db, db->head);
+        db->head = (db->head + 1) % db->capacity;
+        --db->count;
+        sc_frame_drops_add(&db->drops, SC_FRAME_DROP_QUEUE_FULL);
     }
 
-#ifdef SC_BUFFERING_DEBUG
-    dframe.push_date = sc_tick_now();
-#endif
+    // Enforced before the frame is referenced (the reference would prevent its
+    // buffers from being reused): the preview is degraded first
+    uint64_t size = sc_memory_budget_frame_size(frame);
+    if (!sc_memory_budget_acquire(SC_MEMORY_PREVIEW, size)) {
+        sc_frame_drops_add(&db->drops, SC_FRAME_DROP_QUEUE_FULL);
+        sc_mutex_unlock(&db->mutex);
+        return true;
+    }
 
-    ok = sc_vecdeque_push(&db->queue, dframe);
-    if (!ok) {
+    // Reuse the preallocated frame of the slot, only the buffer references
+    // are taken
+    struct sc_delayed_frame *dframe =
+        &db->slots[(db->head + db->count) % db->capacity];
+    if (av_frame_ref(dframe->frame, frame)) {
+        sc_memory_budget_release(SC_MEMORY_PREVIEW, size);
         sc_mutex_unlock(&db->mutex);
         LOG_OOM();
         return false;
     }
+    dframe->budget = size;
+
+#ifdef SC_BUFFERING_DEBUG
+    dframe->push_date = sc_tick_now();
+#endif
+
+    ++db->count;
 
     sc_cond_signal(&db->queue_cond);
 
@@ -4,28 +4,43 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #include "clock.h"
+#include "frame_drops.h"
 #include "trait/frame_source.h"
 #include "trait/frame_sink.h"
 #include "util/thread.h"
 #include "util/tick.h"
-#include "util/vecdeque.h"
 
 //#define SC_BUFFERING_DEBUG // uncomment to debug
 
+// Maximum frame rate of the stream, to size the ring of delayed frames (if
+// the frames arrive faster, the oldest ones are dropped)
+#define SC_DELAY_BUFFER_MAX_FPS 120
+#define SC_DELAY_BUFFER_MIN_CAPACITY 4
+
 // forward declarations
 typedef struct AVFrame AVFrame;
 
 struct sc_delayed_frame {
     AVFrame *frame;
+    uint64_t budget; // bytes acquired from the memory budget
 #ifdef SC_BUFFERING_DEBUG
     sc_tick push_date;
 #endif
 };
 
-struct sc_delayed_frame_queue SC_VECDEQUE(struct sc_delayed_frame);
-
+/**
+ * Delay the frames by a fixed duration, from their PTS.
+ *
+ * The delayed frames are stored in a fixed-capacity ring of frames allocated
+ * once on open (sized from the delay and SC_DELAY_BUFFER_MAX_FPS): each frame
+ * only references the buffers of the pushed frame, so buffering allocates no
+ * frame at runtime. The frames are pushed in PTS order (there are no
+ * B-frames), so the ring is ordered by timestamp.
+ */
 struct sc_delay_buffer {
     struct sc_frame_source frame_source; // frame source trait
     struct sc_frame_sink frame_sink; // frame sink trait
@@ -39,7 +54,16 @@ struct sc_delay_buffer {
     sc_cond wait_cond;
 
     struct sc_clock clock;
-    struct sc_delayed_frame_queue queue;
+
+    // Ring of preallocated frames
+    struct sc_delayed_frame *slots;
+    size_t capacity;
+    size_t head; // index of the oldest frame
+    size_t count;
+    struct sc_frame_drops drops;
+
+    AVFrame *out; // frame being pushed to the sinks (by the thread)
+
     bool stopped;
 };
 
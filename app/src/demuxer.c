@@ -1,23 +1,59 @@
 #include "demuxer.h"
 
 #include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
 #include <libavutil/channel_layout.h>
 #include <libavutil/time.h>
 #include <unistd.h>
 
 #include "decoder.h"
 #include "events.h"
+#include "latency_trace.h"
+#include "metrics.h"
 #include "packet_merger.h"
 #include "recorder.h"
+#include "timestamp_sei.h"
+#include "util/alloc_stats.h"
 #include "util/binary.h"
 #include "util/log.h"
+#include "util/numa.h"
 
 #define SC_PACKET_HEADER_SIZE 12
+// With the capture timestamp: clock domain (1 byte) and timestamp (8 bytes)
+#define SC_PACKET_HEADER_EXT_SIZE (SC_PACKET_HEADER_SIZE + 9)
+// With the exposure: exposure time (4 bytes) and readout time (4 bytes)
+#define SC_PACKET_HEADER_EXPOSURE_SIZE (SC_PACKET_HEADER_EXT_SIZE + 8)
 
 #define SC_PACKET_FLAG_CONFIG    (UINT64_C(1) << 63)
 #define SC_PACKET_FLAG_KEY_FRAME (UINT64_C(1) << 62)
-
-#define SC_PACKET_PTS_MASK (SC_PACKET_FLAG_KEY_FRAME - 1)
+#define SC_PACKET_FLAG_REPEATED  (UINT64_C(1) << 61)
+
+#define SC_PACKET_PTS_MASK (SC_PACKET_FLAG_REPEATED - 1)
+
+// Size of the buffer of the socket reads (larger payload parts are received
+// directly into the packets)
+#define SC_DEMUXER_READ_BUFFER_SIZE (64 * 1024)
+
+// Larger than the datagrams sent by the device (larger ones are truncated,
+// then ignored)
+#define SC_DEMUXER_RTP_DATAGRAM_MAX_SIZE 2048
+// Delay before requesting a key frame again, if the requested one is lost
+#define SC_DEMUXER_KEY_FRAME_REQUEST_INTERVAL SC_TICK_FROM_MS(500)
+// Duration of the windows of the minimum transit time (the baseline of the
+// catch-up lag follows the clock drift within two windows)
+#define SC_DEMUXER_TRANSIT_WINDOW SC_TICK_FROM_SEC(30)
+
+// Capture metadata of a packet, from the extended header (or the timestamp
+// SEI)
+struct sc_packet_capture {
+    bool sei; // the capture timestamp has been read from the timestamp SEI
+    uint8_t clock_domain;
+    uint64_t capture_ns;
+    uint32_t exposure_ns; // 0 if unknown
+    uint32_t readout_ns;
+};
 
 static enum AVCodecID
 sc_demuxer_to_avcodec_id(uint32_t codec_id) {
@@ -54,14 +90,26 @@ sc_demuxer_to_avcodec_id(uint32_t codec_id) {
     }
 }
 
+static ssize_t
+sc_demuxer_read(struct sc_demuxer *demuxer, void *dst, size_t len) {
+    if (demuxer->replay) {
+        return sc_stream_replay_read(demuxer->replay, dst, len);
+    }
+    return sc_net_reader_read_all(&demuxer->reader, dst, len);
+}
+
 static bool
 sc_demuxer_recv_codec_id(struct sc_demuxer *demuxer, uint32_t *codec_id) {
     uint8_t data[4];
-    ssize_t r = net_recv_all(demuxer->socket, data, 4);
+    ssize_t r = sc_demuxer_read(demuxer, data, 4);
     if (r < 4) {
         return false;
     }
 
+    if (demuxer->dump) {
+        sc_stream_dump_write(demuxer->dump, data, 4);
+    }
+
     *codec_id = sc_read32be(data);
     return true;
 }
@@ -70,16 +118,175 @@ static bool
 sc_demuxer_recv_video_size(struct sc_demuxer *demuxer, uint32_t *width,
                            uint32_t *height) {
     uint8_t data[8];
-    ssize_t r = net_recv_all(demuxer->socket, data, 8);
+    ssize_t r = sc_demuxer_read(demuxer, data, 8);
     if (r < 8) {
         return false;
     }
 
+    if (demuxer->dump) {
+        sc_stream_dump_write(demuxer->dump, data, 8);
+    }
+
     *width = sc_read32be(data);
     *height = sc_read32be(data + 4);
     return true;
 }
 
+// Append "key\0value\0" (the packed dictionary format) to the buffer
+static size_t
+sc_demuxer_pack_entry(char *buf, size_t offset, size_t size, const char *key,
+                      const char *value) {
+    int len = snprintf(buf + offset, size - offset, "%s%c%s", key, '\0',
+                       value);
+    assert(len > 0 && offset + len < size);
+    // Include the terminating '\0' written by snprintf()
+    return offset + len + 1;
+}
+
+static bool
+sc_demuxer_set_frame_metadata(AVPacket *packet, bool capture_timestamp,
+                              const struct sc_packet_capture *capture,
+                              bool repeated, const char *resumed_gap_ms) {
+    char buf[192];
+    size_t size = 0;
+    if (capture_timestamp) {
+        char ns[24];
+        char domain[4];
+        snprintf(ns, sizeof(ns), "%" PRIu64, capture->capture_ns);
+        snprintf(domain, sizeof(domain), "%u",
+                 (unsigned) capture->clock_domain);
+        size = sc_demuxer_pack_entry(buf, size, sizeof(buf),
+                                     SC_DEMUXER_METADATA_CAPTURE_NS, ns);
+        size = sc_demuxer_pack_entry(buf, size, sizeof(buf),
+                                     SC_DEMUXER_METADATA_CLOCK_DOMAIN, domain);
+    }
+    if (capture->exposure_ns) {
+        char exposure[12];
+        char readout[12];
+        snprintf(exposure, sizeof(exposure), "%" PRIu32, capture->exposure_ns);
+        snprintf(readout, sizeof(readout), "%" PRIu32, capture->readout_ns);
+        size = sc_demuxer_pack_entry(buf, size, sizeof(buf),
+                                     SC_DEMUXER_METADATA_EXPOSURE_NS, exposure);
+        size = sc_demuxer_pack_entry(buf, size, sizeof(buf),
+                                     SC_DEMUXER_METADATA_READOUT_NS, readout);
+    }
+    if (repeated) {
+        size = sc_demuxer_pack_entry(buf, size, sizeof(buf),
+                                     SC_DEMUXER_METADATA_REPEATED, "1");
+    }
+    if (resumed_gap_ms) {
+        size = sc_demuxer_pack_entry(buf, size, sizeof(buf),
+                                     SC_DEMUXER_METADATA_RESUMED,
+                                     resumed_gap_ms);
+    }
+    assert(size);
+
+    uint8_t *data = av_malloc(size);
+    if (!data) {
+        LOG_OOM();
+        return false;
+    }
+    memcpy(data, buf, size);
+
+    // On success, the packet takes ownership of the data
+    if (av_packet_add_side_data(packet, AV_PKT_DATA_STRINGS_METADATA, data,
+                                size) < 0) {
+        LOG_OOM();
+        av_free(data);
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+sc_demuxer_set_packet_meta(struct sc_demuxer *demuxer, AVPacket *packet,
+                           uint64_t pts_flags,
+                           const struct sc_packet_capture *capture) {
+    if (pts_flags & SC_PACKET_FLAG_CONFIG) {
+        packet->pts = AV_NOPTS_VALUE;
+    } else {
+        packet->pts = pts_flags & SC_PACKET_PTS_MASK;
+    }
+
+    if (pts_flags & SC_PACKET_FLAG_KEY_FRAME) {
+        packet->flags |= AV_PKT_FLAG_KEY;
+    }
+
+    bool repeated = pts_flags & SC_PACKET_FLAG_REPEATED;
+    bool config = pts_flags & SC_PACKET_FLAG_CONFIG;
+    bool capture_timestamp = demuxer->capture_timestamp || capture->sei;
+
+    // The first frame after a reconnection carries the duration of the
+    // interruption
+    char gap[24];
+    const char *resumed_gap_ms = NULL;
+    if (demuxer->resuming && !config) {
+        sc_tick elapsed = sc_tick_now() - demuxer->disconnection_time;
+        snprintf(gap, sizeof(gap), "%" PRItick, SC_TICK_TO_MS(elapsed));
+        resumed_gap_ms = gap;
+        demuxer->resuming = false;
+        LOGI("Demuxer '%s': stream resumed after %s ms", demuxer->name, gap);
+    }
+
+    if ((capture_timestamp || repeated || resumed_gap_ms) && !config) {
+        if (!sc_demuxer_set_frame_metadata(packet, capture_timestamp,
+                                           capture, repeated,
+                                           resumed_gap_ms)) {
+            return false;
+        }
+    }
+
+    packet->dts = packet->pts;
+    return true;
+}
+
+// Read the capture timestamp from the timestamp SEI of the packet, if any
+static void
+sc_demuxer_read_timestamp_sei(struct sc_demuxer *demuxer,
+                              const AVPacket *packet, uint64_t pts_flags,
+                              struct sc_packet_capture *capture) {
+    if (!demuxer->timestamp_sei || (pts_flags & SC_PACKET_FLAG_CONFIG)) {
+        return;
+    }
+
+    struct sc_timestamp_sei sei;
+    if (sc_timestamp_sei_find(packet->data, packet->size,
+                              demuxer->timestamp_sei_hevc, &sei)) {
+        capture->sei = true;
+        capture->clock_domain = sei.clock_domain;
+        capture->capture_ns = sei.capture_ns;
+    }
+}
+
+// Write the packet with its TCP "meta" header (see sc_demuxer_recv_packet()),
+// whatever the transport
+static void
+sc_demuxer_dump_packet(struct sc_demuxer *demuxer, uint64_t pts_flags,
+                       const uint8_t *data, uint32_t len,
+                       const struct sc_packet_capture *capture) {
+    assert(demuxer->dump);
+
+    uint8_t header[SC_PACKET_HEADER_EXPOSURE_SIZE];
+    size_t header_size = SC_PACKET_HEADER_SIZE;
+    sc_write64be(header, pts_flags);
+    sc_write32be(&header[8], len);
+    if (demuxer->capture_timestamp) {
+        header[SC_PACKET_HEADER_SIZE] = capture->clock_domain;
+        sc_write64be(&header[SC_PACKET_HEADER_SIZE + 1], capture->capture_ns);
+        header_size = SC_PACKET_HEADER_EXT_SIZE;
+    }
+    if (demuxer->capture_exposure) {
+        sc_write32be(&header[SC_PACKET_HEADER_EXT_SIZE], capture->exposure_ns);
+        sc_write32be(&header[SC_PACKET_HEADER_EXT_SIZE + 4],
+                     capture->readout_ns);
+        header_size = SC_PACKET_HEADER_EXPOSURE_SIZE;
+    }
+
+    sc_stream_dump_write(demuxer->dump, header, header_size);
+    sc_stream_dump_write(demuxer->dump, data, len);
+}
+
 static bool
 sc_demuxer_recv_packet(struct sc_demuxer *demuxer, AVPacket *packet) {
     // The video and audio streams contain a sequence of raw packets (as
@@ -101,55 +308,309 @@ sc_demuxer_recv_packet(struct sc_demuxer *demuxer, AVPacket *packet) {
     // ||                                PTS
     // | `- key frame
     //  `-- config packet
+    //
+    // If the capture timestamp is enabled, the header is extended to 21 bytes:
+    // [. . . . . . . .|. . . .|.|. . . . . . . .]. . . . . . . . . . . ...
+    //  <-------------> <-----> - <------------->
+    //        PTS        packet |     capture
+    //                    size  |  timestamp (ns)
+    //                          |
+    //                     clock domain
+    //
+    // The capture timestamp is the absolute time of the capture in the clock
+    // domain (unlike the PTS, which are intended only for playback).
+    //
+    // If the capture exposure is also enabled, the header is extended to 29
+    // bytes:
+    // [ . . . 21 bytes . . . |. . . .|. . . .]. . . . . . . . . . . ...
+    //                         <-----> <----->
+    //                         exposure readout
+    //                           (ns)    (ns)
+    //
+    // The exposure time is the exposure of each row, the readout time the
+    // delay between the start of exposure of the first and the last rows (the
+    // rolling shutter skew). The exposure time is 0 if unknown.
+
+    uint8_t header[SC_PACKET_HEADER_EXPOSURE_SIZE];
+    ssize_t header_size =
+        demuxer->capture_exposure ? SC_PACKET_HEADER_EXPOSURE_SIZE
+      : demuxer->capture_timestamp ? SC_PACKET_HEADER_EXT_SIZE
+      : SC_PACKET_HEADER_SIZE;
+    for (;;) {
+        ssize_t r = sc_demuxer_read(demuxer, header, header_size);
+        if (r < header_size) {
+            return false;
+        }
+
+        uint64_t pts_flags = sc_read64be(header);
+        uint32_t len = sc_read32be(&header[8]);
+        assert(len);
+
+        if (!sc_packet_pool_get(&demuxer->packet_pool, packet, len)) {
+            return false;
+        }
+
+        r = sc_demuxer_read(demuxer, packet->data, len);
+        if (r < 0 || ((uint32_t) r) < len) {
+            av_packet_unref(packet);
+            return false;
+        }
+
+        if (demuxer->wait_key_frame && !(pts_flags & SC_PACKET_FLAG_CONFIG)) {
+            if (!(pts_flags & SC_PACKET_FLAG_KEY_FRAME)) {
+                // After a reconnection, it may reference frames which have
+                // not been received
+                ++demuxer->skipped_frames;
+                sc_metrics_add(SC_METRIC_SKIPPED_FRAMES, 1);
+                av_packet_unref(packet);
+                continue;
+            }
+            demuxer->wait_key_frame = false;
+        }
 
-    uint8_t header[SC_PACKET_HEADER_SIZE];
-    ssize_t r = net_recv_all(demuxer->socket, header, SC_PACKET_HEADER_SIZE);
-    if (r < SC_PACKET_HEADER_SIZE) {
+        struct sc_packet_capture capture = {0};
+        if (demuxer->capture_timestamp) {
+            capture.clock_domain = header[SC_PACKET_HEADER_SIZE];
+            capture.capture_ns =
+                sc_read64be(&header[SC_PACKET_HEADER_SIZE + 1]);
+        }
+        if (demuxer->capture_exposure) {
+            capture.exposure_ns =
+                sc_read32be(&header[SC_PACKET_HEADER_EXT_SIZE]);
+            capture.readout_ns =
+                sc_read32be(&header[SC_PACKET_HEADER_EXT_SIZE + 4]);
+        }
+        sc_demuxer_read_timestamp_sei(demuxer, packet, pts_flags, &capture);
+
+        if (demuxer->dump) {
+            sc_demuxer_dump_packet(demuxer, pts_flags, packet->data, len,
+                                   &capture);
+        }
+
+        if (!sc_demuxer_set_packet_meta(demuxer, packet, pts_flags,
+                                        &capture)) {
+            av_packet_unref(packet);
+            return false;
+        }
+
+        return true;
+    }
+}
+
+static bool
+sc_demuxer_reconnect(struct sc_demuxer *demuxer) {
+    if (!demuxer->cbs->on_reconnect || demuxer->replay) {
         return false;
     }
 
-    uint64_t pts_flags = sc_read64be(header);
-    uint32_t len = sc_read32be(&header[8]);
-    assert(len);
+    LOGW("Demuxer '%s': connection lost, reconnecting...", demuxer->name);
 
-    if (av_new_packet(packet, len)) {
-        LOG_OOM();
+    sc_tick now = sc_tick_now();
+    sc_socket socket = demuxer->cbs->on_reconnect(demuxer,
+                                                  demuxer->cbs_userdata);
+    if (socket == SC_SOCKET_NONE) {
+        LOGE("Demuxer '%s': could not reconnect", demuxer->name);
         return false;
     }
 
-    r = net_recv_all(demuxer->socket, packet->data, len);
-    if (r < 0 || ((uint32_t) r) < len) {
-        av_packet_unref(packet);
+    demuxer->socket = socket;
+    // The bytes of a partially received packet are discarded
+    sc_net_reader_reset(&demuxer->reader, socket);
+    // The device resumes the stream on a key frame (it requests one on
+    // reconnection), but the packets already in flight may be received first
+    demuxer->wait_key_frame = true;
+    if (!demuxer->resuming) {
+        // Keep the time of the first disconnection if it failed again before
+        // a key frame has been received
+        demuxer->resuming = true;
+        demuxer->disconnection_time = now;
+    }
+    ++demuxer->reconnections;
+
+    LOGI("Demuxer '%s': reconnected in %" PRItick " ms", demuxer->name,
+         SC_TICK_TO_MS(sc_tick_now() - now));
+    return true;
+}
+
+static void
+sc_demuxer_request_key_frame(struct sc_demuxer *demuxer) {
+    demuxer->key_frame_request_time = sc_tick_now();
+    if (demuxer->cbs->on_key_frame_needed) {
+        demuxer->cbs->on_key_frame_needed(demuxer, demuxer->cbs_userdata);
+    }
+}
+
+// Return the lag of a media packet received now (see
+// sc_demuxer_configure_catch_up())
+static sc_tick
+sc_demuxer_get_lag(struct sc_demuxer *demuxer, int64_t pts, sc_tick now) {
+    sc_tick *min_transit = demuxer->catch_up.min_transit;
+    sc_tick transit = now - SC_TICK_FROM_US(pts);
+
+    if (now - demuxer->catch_up.window_start >= SC_DEMUXER_TRANSIT_WINDOW) {
+        min_transit[1] = min_transit[0];
+        min_transit[0] = transit;
+        demuxer->catch_up.window_start = now;
+    } else if (transit < min_transit[0]) {
+        min_transit[0] = transit;
+    }
+
+    return transit - MIN(min_transit[0], min_transit[1]);
+}
+
+// Indicate if the packet must be skipped (only pushed to the lossless sinks)
+// to catch up with the live stream
+static bool
+sc_demuxer_catch_up(struct sc_demuxer *demuxer, const AVPacket *packet) {
+    if (packet->pts == AV_NOPTS_VALUE) {
+        // Config packets are never skipped
         return false;
     }
 
-    if (pts_flags & SC_PACKET_FLAG_CONFIG) {
-        packet->pts = AV_NOPTS_VALUE;
-    } else {
-        packet->pts = pts_flags & SC_PACKET_PTS_MASK;
+    sc_tick now = sc_tick_now();
+    sc_tick lag = sc_demuxer_get_lag(demuxer, packet->pts, now);
+    bool late = lag > demuxer->catch_up.max_lag;
+
+    if (!demuxer->catch_up.active) {
+        if (!late) {
+            return false;
+        }
+
+        LOGW("Demuxer '%s': %" PRItick " ms behind, skipping to the next key "
+             "frame", demuxer->name, SC_TICK_TO_MS(lag));
+        demuxer->catch_up.active = true;
+        ++demuxer->catch_up.count;
+        sc_demuxer_request_key_frame(demuxer);
     }
 
-    if (pts_flags & SC_PACKET_FLAG_KEY_FRAME) {
-        packet->flags |= AV_PKT_FLAG_KEY;
+    // A packet carrying a new config (merged) must be decoded
+    bool new_config =
+        av_packet_get_side_data(packet, AV_PKT_DATA_NEW_EXTRADATA, NULL);
+    if (((packet->flags & AV_PKT_FLAG_KEY) && !late) || new_config) {
+        LOGI("Demuxer '%s': caught up with the live stream", demuxer->name);
+        demuxer->catch_up.active = false;
+        return false;
     }
 
-    packet->dts = packet->pts;
+    ++demuxer->catch_up.skipped_frames;
+    sc_metrics_add(SC_METRIC_SKIPPED_FRAMES, 1);
+    if (now - demuxer->key_frame_request_time
+            >= SC_DEMUXER_KEY_FRAME_REQUEST_INTERVAL) {
+        // The requested key frame may have been received late too
+        sc_demuxer_request_key_frame(demuxer);
+    }
     return true;
 }
 
+static bool
+sc_demuxer_recv_rtp_packet(struct sc_demuxer *demuxer, AVPacket *packet) {
+    // See rtp_receiver.h for the datagram format. The packets are delivered
+    // in order, the incomplete ones being dropped instead of stalling the
+    // stream.
+    uint8_t datagram[SC_DEMUXER_RTP_DATAGRAM_MAX_SIZE];
+
+    for (;;) {
+        ssize_t r = net_recv(demuxer->rtp_socket, datagram, sizeof(datagram));
+        if (r <= 0) {
+            // The socket is interrupted on stop
+            return false;
+        }
+
+        struct sc_rtp_frame frame;
+        if (!sc_rtp_receiver_push(&demuxer->rtp_receiver, datagram, r,
+                                  &frame)) {
+            continue;
+        }
+
+        bool config = frame.pts_flags & SC_PACKET_FLAG_CONFIG;
+        bool key_frame = frame.pts_flags & SC_PACKET_FLAG_KEY_FRAME;
+
+        if (frame.lost) {
+            if (demuxer->bitrate_control) {
+                sc_bitrate_control_add_lost_frames(demuxer->bitrate_control,
+                                                   frame.lost);
+            }
+            LOGD("Demuxer '%s': %" PRIu32 " frame(s) lost", demuxer->name,
+                 frame.lost);
+            // Even if this frame is a key frame, a config packet may have
+            // been lost
+            demuxer->wait_key_frame = !key_frame;
+            sc_demuxer_request_key_frame(demuxer);
+        }
+
+        if (demuxer->wait_key_frame && !config) {
+            if (!key_frame) {
+                // It references lost frames, it would be decoded corrupted
+                ++demuxer->skipped_frames;
+                sc_metrics_add(SC_METRIC_SKIPPED_FRAMES, 1);
+                sc_tick now = sc_tick_now();
+                if (now - demuxer->key_frame_request_time
+                        >= SC_DEMUXER_KEY_FRAME_REQUEST_INTERVAL) {
+                    sc_demuxer_request_key_frame(demuxer);
+                }
+                continue;
+            }
+            demuxer->wait_key_frame = false;
+        }
+
+        if (!sc_packet_pool_get(&demuxer->packet_pool, packet, frame.size)) {
+            return false;
+        }
+
+        memcpy(packet->data, frame.data, frame.size);
+
+        // The exposure is not carried over RTP
+        struct sc_packet_capture capture = {
+            .clock_domain = frame.clock_domain,
+            .capture_ns = frame.capture_ns,
+        };
+        sc_demuxer_read_timestamp_sei(demuxer, packet, frame.pts_flags,
+                                      &capture);
+
+        if (demuxer->dump) {
+            sc_demuxer_dump_packet(demuxer, frame.pts_flags, frame.data,
+                                   frame.size, &capture);
+        }
+
+        if (!sc_demuxer_set_packet_meta(demuxer, packet, frame.pts_flags,
+                                        &capture)) {
+            av_packet_unref(packet);
+            return false;
+        }
+
+        return true;
+    }
+}
+
 static int
 run_demuxer(void *data) {
     struct sc_demuxer *demuxer = data;
 
+    (void) sc_alloc_stats_enter(SC_ALLOC_DEMUXER);
+
+    if (demuxer->numa_node >= 0) {
+        // Before any allocation, so that the pools are local to the node
+        if (sc_numa_bind_thread(demuxer->numa_node)) {
+            LOGD("Demuxer '%s': bound to NUMA node %d", demuxer->name,
+                 demuxer->numa_node);
+        }
+    }
+
     // Flag to report end-of-stream (i.e. device disconnected)
     enum sc_demuxer_status status = SC_DEMUXER_STATUS_ERROR;
 
+    if (!demuxer->replay && !sc_net_reader_init(&demuxer->reader,
+                                                demuxer->socket,
+                                                SC_DEMUXER_READ_BUFFER_SIZE)) {
+        goto end;
+    }
+
     uint32_t raw_codec_id;
     bool ok = sc_demuxer_recv_codec_id(demuxer, &raw_codec_id);
     if (!ok) {
         LOGE("Demuxer '%s': stream disabled due to connection error",
              demuxer->name);
-        goto end;
+        goto finally_destroy_reader;
     }
 
     if (raw_codec_id == 0) {
@@ -157,13 +618,13 @@ run_demuxer(void *data) {
              demuxer->name);
         sc_packet_source_sinks_disable(&demuxer->packet_source);
         status = SC_DEMUXER_STATUS_DISABLED;
-        goto end;
+        goto finally_destroy_reader;
     }
 
     if (raw_codec_id == 1) {
         LOGE("Demuxer '%s': stream configuration error on the device",
              demuxer->name);
-        goto end;
+        goto finally_destroy_reader;
     }
 
     enum AVCodecID codec_id = sc_demuxer_to_avcodec_id(raw_codec_id);
@@ -171,7 +632,7 @@ run_demuxer(void *data) {
         LOGE("Demuxer '%s': stream disabled due to unsupported codec",
              demuxer->name);
         sc_packet_source_sinks_disable(&demuxer->packet_source);
-        goto end;
+        goto finally_destroy_reader;
     }
 
     const AVCodec *codec = avcodec_find_decoder(codec_id);
@@ -179,13 +640,19 @@ run_demuxer(void *data) {
         LOGE("Demuxer '%s': stream disabled due to missing decoder",
              demuxer->name);
         sc_packet_source_sinks_disable(&demuxer->packet_source);
-        goto end;
+        goto finally_destroy_reader;
+    }
+
+    bool use_decoder_pool = codec->type == AVMEDIA_TYPE_VIDEO
+                         && demuxer->configure_decoder;
+    if (use_decoder_pool && !sc_decoder_pool_init(&demuxer->decoder_pool)) {
+        goto finally_destroy_reader;
     }
 
     AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
     if (!codec_ctx) {
         LOG_OOM();
-        goto end;
+        goto finally_destroy_decoder_pool;
     }
 
     codec_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
@@ -201,6 +668,15 @@ run_demuxer(void *data) {
         codec_ctx->width = width;
         codec_ctx->height = height;
         codec_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+
+        if (demuxer->configure_decoder) {
+            sc_decoder_configure(codec_ctx, &demuxer->decoder_config);
+            // Without hardware decoding, the frames are decoded directly into
+            // the aligned pool buffers
+            if (!sc_decoder_use_pool(codec_ctx, &demuxer->decoder_pool)) {
+                use_decoder_pool = false;
+            }
+        }
     } else {
         // Hardcoded audio properties
 #ifdef SCRCPY_LAVU_HAS_CHLAYOUT
@@ -222,6 +698,10 @@ run_demuxer(void *data) {
         goto finally_free_context;
     }
 
+    if (use_decoder_pool) {
+        sc_decoder_pool_prepare(&demuxer->decoder_pool, codec_ctx);
+    }
+
     if (!sc_packet_source_sinks_open(&demuxer->packet_source, codec_ctx)) {
         goto finally_free_context;
     }
@@ -231,6 +711,13 @@ run_demuxer(void *data) {
     bool must_merge_config_packet = raw_codec_id == SC_CODEC_ID_H264
                                  || raw_codec_id == SC_CODEC_ID_H265;
 
+    if (demuxer->timestamp_sei && !must_merge_config_packet) {
+        LOGW("Demuxer '%s': no timestamp SEI in the %s stream",
+             demuxer->name, codec->name);
+        demuxer->timestamp_sei = false;
+    }
+    demuxer->timestamp_sei_hevc = raw_codec_id == SC_CODEC_ID_H265;
+
     struct sc_packet_merger merger;
 
     if (must_merge_config_packet) {
@@ -243,14 +730,58 @@ run_demuxer(void *data) {
         goto finally_close_sinks;
     }
 
+    sc_packet_pool_init(&demuxer->packet_pool);
+
+    demuxer->wait_key_frame = false;
+    demuxer->key_frame_request_time = 0;
+    demuxer->skipped_frames = 0;
+    demuxer->resuming = false;
+    demuxer->disconnection_time = 0;
+    demuxer->reconnections = 0;
+    demuxer->catch_up.min_transit[0] = INT64_MAX;
+    demuxer->catch_up.min_transit[1] = INT64_MAX;
+    demuxer->catch_up.window_start = sc_tick_now();
+    demuxer->catch_up.active = false;
+    demuxer->catch_up.count = 0;
+    demuxer->catch_up.skipped_frames = 0;
+
+    bool rtp = demuxer->rtp_socket != SC_SOCKET_NONE;
+    if (rtp) {
+        sc_rtp_receiver_init(&demuxer->rtp_receiver, demuxer->rtp_ssrc);
+    }
+
     for (;;) {
-        bool ok = sc_demuxer_recv_packet(demuxer, packet);
+        bool ok = rtp ? sc_demuxer_recv_rtp_packet(demuxer, packet)
+                      : sc_demuxer_recv_packet(demuxer, packet);
+        if (!ok && !rtp && sc_demuxer_reconnect(demuxer)) {
+            // A config packet pending in the merger is still valid: the
+            // device encoder has not been reset
+            continue;
+        }
         if (!ok) {
             // end of stream
             status = SC_DEMUXER_STATUS_EOS;
             break;
         }
 
+        if (demuxer->replay
+                && !sc_stream_replay_wait(demuxer->replay, packet->pts)) {
+            // Interrupted
+            av_packet_unref(packet);
+            status = SC_DEMUXER_STATUS_EOS;
+            break;
+        }
+
+        if (codec->type == AVMEDIA_TYPE_VIDEO) {
+            sc_latency_trace_stamp(SC_LATENCY_STAGE_RECV, packet->pts);
+            sc_metrics_add(SC_METRIC_RECV_BYTES, packet->size);
+        }
+
+        if (demuxer->bitrate_control) {
+            sc_bitrate_control_add_packet(demuxer->bitrate_control,
+                                          packet->size);
+        }
+
         if (must_merge_config_packet) {
             // Prepend any config packet to the next media packet
             ok = sc_packet_merger_merge(&merger, packet);
@@ -260,7 +791,12 @@ run_demuxer(void *data) {
             }
         }
 
-        ok = sc_packet_source_sinks_push(&demuxer->packet_source, packet);
+        if (demuxer->catch_up.max_lag && sc_demuxer_catch_up(demuxer, packet)) {
+            ok = sc_packet_source_sinks_push_lossless(&demuxer->packet_source,
+                                                      packet);
+        } else {
+            ok = sc_packet_source_sinks_push(&demuxer->packet_source, packet);
+        }
         av_packet_unref(packet);
         if (!ok) {
             // The sink already logged its concrete error
@@ -270,15 +806,48 @@ run_demuxer(void *data) {
 
     LOGD("Demuxer '%s': end of frames", demuxer->name);
 
+    if (rtp) {
+        struct sc_rtp_receiver *rx = &demuxer->rtp_receiver;
+        LOGI("Demuxer '%s': RTP: %" PRIu64 " frames received, %" PRIu64
+             " lost, %" PRIu64 " skipped until a key frame, %" PRIu64
+             " datagrams recovered by FEC", demuxer->name, rx->frames,
+             rx->lost, demuxer->skipped_frames, rx->recovered);
+        sc_rtp_receiver_destroy(rx);
+    } else if (demuxer->reconnections) {
+        LOGI("Demuxer '%s': %u reconnection(s), %" PRIu64 " frames skipped "
+             "until a key frame", demuxer->name, demuxer->reconnections,
+             demuxer->skipped_frames);
+    }
+
+    if (demuxer->catch_up.count) {
+        LOGI("Demuxer '%s': %u catch-up(s), %" PRIu64 " frames skipped",
+             demuxer->name, demuxer->catch_up.count,
+             demuxer->catch_up.skipped_frames);
+    }
+
     if (must_merge_config_packet) {
         sc_packet_merger_destroy(&merger);
     }
 
     av_packet_free(&packet);
+
+    struct sc_packet_pool *pp = &demuxer->packet_pool;
+    LOGD("Demuxer '%s': packet pool: %" PRIu64 " hits, %" PRIu64 " misses",
+         demuxer->name, pp->requested - pp->allocated, pp->allocated);
+    sc_packet_pool_destroy(pp);
 finally_close_sinks:
     sc_packet_source_sinks_close(&demuxer->packet_source);
 finally_free_context:
     avcodec_free_context(&codec_ctx);
+finally_destroy_decoder_pool:
+    if (codec->type == AVMEDIA_TYPE_VIDEO && demuxer->configure_decoder) {
+        // The frames still referenced by the sinks outlive the pool
+        sc_decoder_pool_destroy(&demuxer->decoder_pool);
+    }
+finally_destroy_reader:
+    if (!demuxer->replay) {
+        sc_net_reader_destroy(&demuxer->reader);
+    }
 end:
     demuxer->cbs->on_ended(demuxer, status, demuxer->cbs_userdata);
 
@@ -287,11 +856,27 @@ end:
 
 void
 sc_demuxer_init(struct sc_demuxer *demuxer, const char *name, sc_socket socket,
+                bool capture_timestamp,
+                const struct sc_decoder_config *decoder_config,
                 const struct sc_demuxer_callbacks *cbs, void *cbs_userdata) {
-    assert(socket != SC_SOCKET_NONE);
-
     demuxer->name = name; // statically allocated
     demuxer->socket = socket;
+    demuxer->rtp_socket = SC_SOCKET_NONE;
+    demuxer->rtp_ssrc = 0;
+    demuxer->bitrate_control = NULL;
+    demuxer->replay = NULL;
+    demuxer->dump = NULL;
+    demuxer->catch_up.max_lag = 0;
+    demuxer->numa_node = -1;
+    demuxer->capture_timestamp = capture_timestamp;
+    demuxer->capture_exposure = false;
+    demuxer->timestamp_sei = false;
+    demuxer->timestamp_sei_hevc = false;
+    // The config may be NULL (not decoded, or audio)
+    demuxer->configure_decoder = !!decoder_config;
+    if (decoder_config) {
+        demuxer->decoder_config = *decoder_config;
+    }
     sc_packet_source_init(&demuxer->packet_source);
 
     assert(cbs && cbs->on_ended);
@@ -300,8 +885,66 @@ sc_demuxer_init(struct sc_demuxer *demuxer, const char *name, sc_socket socket,
     demuxer->cbs_userdata = cbs_userdata;
 }
 
+void
+sc_demuxer_configure_rtp(struct sc_demuxer *demuxer, sc_socket socket,
+                         uint32_t ssrc) {
+    assert(socket != SC_SOCKET_NONE);
+    demuxer->rtp_socket = socket;
+    demuxer->rtp_ssrc = ssrc;
+}
+
+void
+sc_demuxer_configure_bitrate_control(struct sc_demuxer *demuxer,
+                                     struct sc_bitrate_control *bc) {
+    demuxer->bitrate_control = bc;
+}
+
+void
+sc_demuxer_configure_catch_up(struct sc_demuxer *demuxer, sc_tick max_lag) {
+    assert(max_lag > 0);
+    demuxer->catch_up.max_lag = max_lag;
+}
+
+void
+sc_demuxer_configure_capture_exposure(struct sc_demuxer *demuxer) {
+    assert(demuxer->capture_timestamp);
+    demuxer->capture_exposure = true;
+}
+
+void
+sc_demuxer_configure_timestamp_sei(struct sc_demuxer *demuxer) {
+    demuxer->timestamp_sei = true;
+}
+
+void
+sc_demuxer_configure_numa_node(struct sc_demuxer *demuxer, unsigned node) {
+    assert(node < sc_numa_get_node_count());
+    demuxer->numa_node = node;
+}
+
+void
+sc_demuxer_configure_replay(struct sc_demuxer *demuxer,
+                            struct sc_stream_replay *replay) {
+    assert(demuxer->socket == SC_SOCKET_NONE);
+    demuxer->replay = replay;
+    demuxer->capture_timestamp = replay->capture_timestamp;
+    demuxer->capture_exposure = replay->capture_exposure;
+}
+
+void
+sc_demuxer_configure_dump(struct sc_demuxer *demuxer,
+                          struct sc_stream_dump *dump) {
+    assert(dump->capture_timestamp == demuxer->capture_timestamp);
+    assert(dump->capture_exposure == demuxer->capture_exposure);
+    demuxer->dump = dump;
+}
+
 bool
 sc_demuxer_start(struct sc_demuxer *demuxer) {
+    // Either a socket or a dump
+    assert((demuxer->socket != SC_SOCKET_NONE) != !!demuxer->replay);
+    assert(!demuxer->replay || demuxer->rtp_socket == SC_SOCKET_NONE);
+
     LOGD("Demuxer '%s': starting thread", demuxer->name);
 
     bool ok = sc_thread_create(&demuxer->thread, run_demuxer, "scrcpy-demuxer",
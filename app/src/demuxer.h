@@ -8,19 +8,98 @@
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 
+#include "bitrate_control.h"
+#include "decoder.h"
+#include "packet_pool.h"
+#include "rtp_receiver.h"
+#include "stream_dump.h"
 #include "trait/packet_source.h"
 #include "trait/packet_sink.h"
 #include "util/net.h"
+#include "util/net_reader.h"
 #include "util/thread.h"
+#include "util/tick.h"
+
+// Keys of the packet side data (AV_PKT_DATA_STRINGS_METADATA) containing the
+// capture timestamp, exported by FFmpeg to the metadata of the decoded frames
+#define SC_DEMUXER_METADATA_CAPTURE_NS "scrcpy_capture_ns"
+#define SC_DEMUXER_METADATA_CLOCK_DOMAIN "scrcpy_clock_domain"
+// Exposure time and readout time (rolling shutter skew) of the frame, in
+// nanoseconds, present only if known (see
+// sc_demuxer_configure_capture_exposure())
+#define SC_DEMUXER_METADATA_EXPOSURE_NS "scrcpy_exposure_ns"
+#define SC_DEMUXER_METADATA_READOUT_NS "scrcpy_readout_ns"
+// Present (with the value "1") if the device encoder repeated the previous
+// frame, because the captured content did not change
+#define SC_DEMUXER_METADATA_REPEATED "scrcpy_repeated"
+// Present on the first frame received after the connection has been resumed,
+// with the duration of the interruption in milliseconds as value
+#define SC_DEMUXER_METADATA_RESUMED "scrcpy_resumed"
+
+// Clock domains of the capture timestamps
+#define SC_CLOCK_DOMAIN_MONOTONIC 0 // System.nanoTime() on the device
 
 struct sc_demuxer {
     struct sc_packet_source packet_source; // packet source trait
 
     const char *name; // must be statically allocated (e.g. a string literal)
+    // Whether the packet headers contain the capture timestamp
+    bool capture_timestamp;
+    // Whether it is followed by the exposure of the frame
+    bool capture_exposure;
+    // Whether the capture timestamps are read from the timestamp SEI
+    bool timestamp_sei;
+    bool timestamp_sei_hevc; // set once the codec is known
+    // Configuration of the video codec context, if decoded
+    bool configure_decoder;
+    struct sc_decoder_config decoder_config;
+    // The frames decoded in software, if configure_decoder (only accessed
+    // from the demuxer thread and the decoding threads)
+    struct sc_decoder_pool decoder_pool;
 
-    sc_socket socket;
+    sc_socket socket; // SC_SOCKET_NONE if replayed
+    // If set, the packets are received as RTP datagrams on this socket (the
+    // stream header is still received on the stream socket)
+    sc_socket rtp_socket;
+    uint32_t rtp_ssrc;
     sc_thread thread;
 
+    // Only accessed from the demuxer thread
+    struct sc_net_reader reader; // buffered reads of the socket
+    struct sc_packet_pool packet_pool; // payloads of the received packets
+    struct sc_rtp_receiver rtp_receiver; // if rtp_socket is set
+    // After a frame loss or a reconnection, the next frames are dropped until
+    // a key frame
+    bool wait_key_frame;
+    sc_tick key_frame_request_time;
+    uint64_t skipped_frames; // dropped while waiting for a key frame
+    // Set from a reconnection until the next frame
+    bool resuming;
+    sc_tick disconnection_time;
+    unsigned reconnections;
+
+    // Catch-up (see sc_demuxer_configure_catch_up()), max_lag 0 if disabled
+    struct {
+        sc_tick max_lag;
+        // Minimum transit time (reception time minus PTS, which includes the
+        // offset between the clocks) of the packets of the current and the
+        // previous windows, the baseline of the lag
+        sc_tick min_transit[2];
+        sc_tick window_start;
+        bool active; // the packets are skipped until a key frame
+        unsigned count; // number of catch-ups
+        uint64_t skipped_frames;
+    } catch_up;
+
+    struct sc_bitrate_control *bitrate_control; // may be NULL
+    // NUMA node to bind the demuxer thread to, or -1
+    int numa_node;
+    // If set, the stream is read from a dump instead of the socket
+    struct sc_stream_replay *replay;
+    // If set, the received stream is dumped (only accessed from the demuxer
+    // thread)
+    struct sc_stream_dump *dump;
+
     const struct sc_demuxer_callbacks *cbs;
     void *cbs_userdata;
 };
@@ -34,13 +113,115 @@ enum sc_demuxer_status {
 struct sc_demuxer_callbacks {
     void (*on_ended)(struct sc_demuxer *demuxer, enum sc_demuxer_status,
                      void *userdata);
+
+    // Called from the demuxer thread when a key frame is needed to recover
+    // from lost packets (optional)
+    void (*on_key_frame_needed)(struct sc_demuxer *demuxer, void *userdata);
+
+    // Called from the demuxer thread when the stream connection is lost, to
+    // resume the stream on a new connection (optional)
+    //
+    // Return the new socket, or SC_SOCKET_NONE to end the stream.
+    sc_socket (*on_reconnect)(struct sc_demuxer *demuxer, void *userdata);
 };
 
 // The name must be statically allocated (e.g. a string literal)
 void
 sc_demuxer_init(struct sc_demuxer *demuxer, const char *name, sc_socket socket,
+                bool capture_timestamp,
+                const struct sc_decoder_config *decoder_config,
                 const struct sc_demuxer_callbacks *cbs, void *cbs_userdata);
 
+/**
+ * Receive the packets over RTP from `socket`, the datagrams from another
+ * session than `ssrc` being ignored
+ *
+ * Must be called before sc_demuxer_start().
+ */
+void
+sc_demuxer_configure_rtp(struct sc_demuxer *demuxer, sc_socket socket,
+                         uint32_t ssrc);
+
+/**
+ * Report the received packets to the bit rate control
+ *
+ * Must be called before sc_demuxer_start().
+ */
+void
+sc_demuxer_configure_bitrate_control(struct sc_demuxer *demuxer,
+                                     struct sc_bitrate_control *bc);
+
+/**
+ * Catch up with the live stream when the packets are received late
+ *
+ * After a stall, the packets accumulated in the socket would be decoded
+ * sequentially, and the display would run behind until the backlog is
+ * drained. Instead, when the lag of the received packets exceeds `max_lag`,
+ * the packets are skipped until a key frame received within `max_lag`, and a
+ * key frame is requested. The packets are still pushed to the lossless sinks
+ * (see sc_packet_source_set_lossless()), for example the recorder.
+ *
+ * The lag of a packet is its transit time (reception time minus PTS) minus
+ * the minimum transit time observed recently, so that it does not depend on
+ * the clock offset with the device. Must be called before sc_demuxer_start().
+ */
+void
+sc_demuxer_configure_catch_up(struct sc_demuxer *demuxer, sc_tick max_lag);
+
+/**
+ * Receive the exposure of the camera frames (--capture-exposure)
+ *
+ * The packet headers contain the exposure time and the readout time of the
+ * frame after the capture timestamp (which must be enabled). They are
+ * exported in the frame metadata if known. Must be called before
+ * sc_demuxer_start().
+ */
+void
+sc_demuxer_configure_capture_exposure(struct sc_demuxer *demuxer);
+
+/**
+ * Read the capture timestamps from the bitstream (--timestamp-sei)
+ *
+ * The device embeds the capture timestamp of each frame in a SEI NAL unit
+ * (see timestamp_sei.h), read from the packet data. It is exported in the
+ * frame metadata, like the capture timestamp of the packet headers (which it
+ * replaces). Must be called before sc_demuxer_start().
+ */
+void
+sc_demuxer_configure_timestamp_sei(struct sc_demuxer *demuxer);
+
+/**
+ * Bind the demuxer thread to a NUMA node (--numa)
+ *
+ * The threads created from the demuxer thread (the decoder and the video
+ * processing threads, opened by the sinks) inherit the binding, and the pools
+ * (packets, frames) are first touched from these threads, so the whole
+ * pipeline of the stream runs on the node and uses its local memory. Must be
+ * called before sc_demuxer_start().
+ */
+void
+sc_demuxer_configure_numa_node(struct sc_demuxer *demuxer, unsigned node);
+
+/**
+ * Read the stream from a dump (--replay) instead of the socket
+ *
+ * The demuxer must have been initialized with SC_SOCKET_NONE. The capture
+ * timestamp and exposure options are replaced by the ones of the dump. Must
+ * be called before sc_demuxer_start().
+ */
+void
+sc_demuxer_configure_replay(struct sc_demuxer *demuxer,
+                            struct sc_stream_replay *replay);
+
+/**
+ * Dump the received stream (--dump-stream)
+ *
+ * Must be called before sc_demuxer_start().
+ */
+void
+sc_demuxer_configure_dump(struct sc_demuxer *demuxer,
+                          struct sc_stream_dump *dump);
+
 bool
 sc_demuxer_start(struct sc_demuxer *demuxer);
 
@@ -7,6 +7,14 @@
 #include "util/binary.h"
 #include "util/log.h"
 
+static void
+read_latency(const uint8_t *buf, struct sc_device_msg_latency *latency) {
+    latency->p50 = sc_read32be(&buf[0]);
+    latency->p95 = sc_read32be(&buf[4]);
+    latency->p99 = sc_read32be(&buf[8]);
+    latency->max = sc_read32be(&buf[12]);
+}
+
 ssize_t
 sc_device_msg_deserialize(const uint8_t *buf, size_t len,
                           struct sc_device_msg *msg) {
@@ -71,6 +79,49 @@ sc_device_msg_deserialize(const uint8_t *buf, size_t len,
 
             return 5 + size;
         }
+        case DEVICE_MSG_TYPE_CLOCK_SYNC: {
+            if (len < 25) {
+                return 0; // no complete message
+            }
+            msg->clock_sync.client_time = sc_read64be(&buf[1]);
+            msg->clock_sync.receive_time = sc_read64be(&buf[9]);
+            msg->clock_sync.send_time = sc_read64be(&buf[17]);
+            return 25;
+        }
+        case DEVICE_MSG_TYPE_ENCODER_LATENCY: {
+            if (len < 37) {
+                return 0; // no complete message
+            }
+            msg->encoder_latency.frame_count = sc_read32be(&buf[1]);
+            read_latency(&buf[5], &msg->encoder_latency.capture_to_dequeue);
+            read_latency(&buf[21], &msg->encoder_latency.dequeue_to_write);
+            return 37;
+        }
+        case DEVICE_MSG_TYPE_TIME_PONG: {
+            if (len < 41) {
+                return 0; // no complete message
+            }
+            msg->time_pong.client_time = sc_read64be(&buf[1]);
+            msg->time_pong.receive_time = sc_read64be(&buf[9]);
+            msg->time_pong.send_time = sc_read64be(&buf[17]);
+            msg->time_pong.receive_wall_time = sc_read64be(&buf[25]);
+            msg->time_pong.send_wall_time = sc_read64be(&buf[33]);
+            return 41;
+        }
+        case DEVICE_MSG_TYPE_POSE: {
+            if (len < 38) {
+                return 0; // no complete message
+            }
+            msg->pose.pts = sc_read64be(&buf[1]);
+            msg->pose.has_position = buf[9];
+            for (unsigned i = 0; i < 4; ++i) {
+                msg->pose.rotation[i] = sc_readfloatbe(&buf[10 + 4 * i]);
+            }
+            for (unsigned i = 0; i < 3; ++i) {
+                msg->pose.translation[i] = sc_readfloatbe(&buf[26 + 4 * i]);
+            }
+            return 38;
+        }
         default:
             LOGW("Unknown device message type: %d", (int) msg->type);
             return -1; // error, we cannot recover
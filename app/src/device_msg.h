@@ -15,6 +15,18 @@ enum sc_device_msg_type {
     DEVICE_MSG_TYPE_CLIPBOARD,
     DEVICE_MSG_TYPE_ACK_CLIPBOARD,
     DEVICE_MSG_TYPE_UHID_OUTPUT,
+    DEVICE_MSG_TYPE_CLOCK_SYNC,
+    DEVICE_MSG_TYPE_ENCODER_LATENCY,
+    DEVICE_MSG_TYPE_TIME_PONG,
+    DEVICE_MSG_TYPE_POSE,
+};
+
+// Summary of the latency measures over a period, in microseconds
+struct sc_device_msg_latency {
+    uint32_t p50;
+    uint32_t p95;
+    uint32_t p99;
+    uint32_t max;
 };
 
 struct sc_device_msg {
@@ -31,6 +43,33 @@ struct sc_device_msg {
             uint16_t size;
             uint8_t *data; // owned, to be freed by free()
         } uhid_output;
+        struct {
+            uint64_t client_time; // echoed from the request
+            uint64_t receive_time; // device monotonic time, in microseconds
+            uint64_t send_time; // device monotonic time, in microseconds
+        } clock_sync;
+        struct {
+            uint32_t frame_count;
+            // from the capture to the encoder output
+            struct sc_device_msg_latency capture_to_dequeue;
+            // to write the encoded packet to the socket
+            struct sc_device_msg_latency dequeue_to_write;
+        } encoder_latency;
+        struct {
+            uint64_t client_time; // echoed from the request
+            // device boot time (including deep sleep), in microseconds
+            uint64_t receive_time;
+            uint64_t send_time;
+            // device wall clock time, in microseconds since the Unix epoch
+            uint64_t receive_wall_time;
+            uint64_t send_wall_time;
+        } time_pong;
+        struct {
+            uint64_t pts; // capture time, in the time base of the video PTS
+            bool has_position; // false if only the orientation is known
+            float rotation[4]; // quaternion {x, y, z, w}
+            float translation[3]; // in meters
+        } pose;
     };
 };
 
@@ -0,0 +1,246 @@
+#include "device_remap.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "video_preprocess.h"
+#include "util/binary.h"
+#include "util/file.h"
+#include "util/log.h"
+
+// Like cv::remap(), a map value x refers to the center of the source pixel x
+static inline bool
+sc_device_remap_is_valid(const float *map, int width, int height, bool right,
+                         int x, int y) {
+    int half_width = width / 2;
+    float left = right ? half_width : 0;
+    const float *p = map + 2 * ((size_t) y * width + x + (right ? half_width
+                                                                : 0));
+    return p[0] >= left - 0.5f && p[0] <= left + half_width - 0.5f
+        && p[1] >= -0.5f && p[1] <= height - 0.5f;
+}
+
+static int
+sc_device_remap_count_invalid_row(const float *map, int width, int height,
+                                  bool right,
+                                  const struct sc_device_remap_rect *rect,
+                                  int y) {
+    int count = 0;
+    for (int x = rect->x; x < rect->x + rect->width; ++x) {
+        count += !sc_device_remap_is_valid(map, width, height, right, x, y);
+    }
+    return count;
+}
+
+static int
+sc_device_remap_count_invalid_col(const float *map, int width, int height,
+                                  bool right,
+                                  const struct sc_device_remap_rect *rect,
+                                  int x) {
+    int count = 0;
+    for (int y = rect->y; y < rect->y + rect->height; ++y) {
+        count += !sc_device_remap_is_valid(map, width, height, right, x, y);
+    }
+    return count;
+}
+
+void
+sc_device_remap_compute_valid_rect(const float *map, int width, int height,
+                                   bool right,
+                                   struct sc_device_remap_rect *rect) {
+    rect->x = 0;
+    rect->y = 0;
+    rect->width = width / 2;
+    rect->height = height;
+
+    while (rect->width > 0 && rect->height > 0) {
+        int top = sc_device_remap_count_invalid_row(map, width, height, right,
+                                                    rect, rect->y);
+        int bottom = sc_device_remap_count_invalid_row(map, width, height,
+                                                       right, rect,
+                                                       rect->y + rect->height
+                                                           - 1);
+        int left = sc_device_remap_count_invalid_col(map, width, height, right,
+                                                     rect, rect->x);
+        int right_col = sc_device_remap_count_invalid_col(map, width, height,
+                                                          right, rect,
+                                                          rect->x + rect->width
+                                                              - 1);
+        if (!top && !bottom && !left && !right_col) {
+            return;
+        }
+
+        // Remove the border with the highest proportion of invalid pixels
+        // (compared by cross-multiplication, a row has rect->width pixels and
+        // a column rect->height pixels)
+        int row_max = top > bottom ? top : bottom;
+        int col_max = left > right_col ? left : right_col;
+        if ((int64_t) row_max * rect->height
+                >= (int64_t) col_max * rect->width) {
+            if (top >= bottom) {
+                ++rect->y;
+            }
+            --rect->height;
+        } else {
+            if (left >= right_col) {
+                ++rect->x;
+            }
+            --rect->width;
+        }
+    }
+}
+
+// Compute the region kept in both eyes, or return false if there is none
+static bool
+sc_device_remap_compute_crop(const float *map, int width, int height,
+                             struct sc_device_remap_rect *crop) {
+    struct sc_device_remap_rect l;
+    struct sc_device_remap_rect r;
+    sc_device_remap_compute_valid_rect(map, width, height, false, &l);
+    sc_device_remap_compute_valid_rect(map, width, height, true, &r);
+
+    int x0 = l.x > r.x ? l.x : r.x;
+    int y0 = l.y > r.y ? l.y : r.y;
+    int x1 = l.x + l.width < r.x + r.width ? l.x + l.width : r.x + r.width;
+    int y1 = l.y + l.height < r.y + r.height ? l.y + l.height
+                                             : r.y + r.height;
+
+    // Shrink symmetrically to the alignment
+    int w = x1 - x0;
+    int h = y1 - y0;
+    int aligned_w = w / SC_DEVICE_REMAP_CROP_ALIGN * SC_DEVICE_REMAP_CROP_ALIGN;
+    int aligned_h = h / SC_DEVICE_REMAP_CROP_ALIGN * SC_DEVICE_REMAP_CROP_ALIGN;
+    if (aligned_w <= 0 || aligned_h <= 0) {
+        return false;
+    }
+
+    crop->x = x0 + (w - aligned_w) / 2;
+    crop->y = y0 + (h - aligned_h) / 2;
+    crop->width = aligned_w;
+    crop->height = aligned_h;
+    return true;
+}
+
+static bool
+sc_device_remap_write(FILE *file, const float *map, int width, int height,
+                      const struct sc_device_remap_rect *crop) {
+    int out_width = 2 * crop->width;
+    int out_height = crop->height;
+
+    uint8_t header[20];
+    memcpy(header, SC_DEVICE_REMAP_MAGIC, 4);
+    sc_write32be(&header[4], out_width);
+    sc_write32be(&header[8], out_height);
+    sc_write32be(&header[12], width);
+    sc_write32be(&header[16], height);
+    if (fwrite(header, sizeof(header), 1, file) != 1) {
+        return false;
+    }
+
+    size_t row_floats = (size_t) out_width * 2;
+    uint8_t *row = malloc(row_floats * 4);
+    if (!row) {
+        LOG_OOM();
+        return false;
+    }
+
+    int half_width = width / 2;
+    size_t eye_floats = (size_t) crop->width * 2;
+    bool ok = true;
+    for (int y = 0; y < out_height && ok; ++y) {
+        const float *src = map + 2 * ((size_t) (crop->y + y) * width + crop->x);
+        // Both eyes, the right one starting at the half width of the source
+        const float *eyes[2] = {src, src + 2 * half_width};
+        for (unsigned e = 0; e < 2; ++e) {
+            uint8_t *dst = row + 4 * e * eye_floats;
+            for (size_t i = 0; i < eye_floats; ++i) {
+                uint32_t bits;
+                memcpy(&bits, &eyes[e][i], 4);
+                sc_write32le(&dst[4 * i], bits);
+            }
+        }
+        ok = fwrite(row, row_floats * 4, 1, file) == 1;
+    }
+
+    free(row);
+    return ok;
+}
+
+char *
+sc_device_remap_write_map(const struct sc_video_preprocess *vpp, uint32_t scid,
+                          bool crop) {
+    struct sc_remap_layout layout = sc_video_preprocess_get_layout(vpp);
+    if (!sc_remap_layout_is_side_by_side(&layout)) {
+        LOGE("--device-remap requires the remap maps of a stereo pair side by "
+             "side");
+        return NULL;
+    }
+
+    // The device captures at the size of the calibration
+    unsigned map_width;
+    unsigned map_height;
+    sc_video_preprocess_get_size(vpp, &map_width, &map_height);
+    int width = map_width;
+    int height = map_height;
+    float *map = sc_video_preprocess_get_gpu_map(vpp, width, height);
+    if (!map) {
+        return NULL;
+    }
+
+    struct sc_device_remap_rect rect = {
+        .x = 0,
+        .y = 0,
+        .width = width / 2,
+        .height = height,
+    };
+    if (crop) {
+        if (!sc_device_remap_compute_crop(map, width, height, &rect)) {
+            LOGE("The remap maps have no valid region");
+            free(map);
+            return NULL;
+        }
+        LOGI("Remap crop: %dx%d per eye at (%d, %d), %dx%d encoded",
+             rect.width, rect.height, rect.x, rect.y, 2 * rect.width,
+             rect.height);
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "scrcpy-remap-%08" PRIx32 ".bin", scid);
+    char *path = sc_file_get_temp_path(name);
+    if (!path) {
+        LOGE("Could not get a temporary file path for the remap map");
+        free(map);
+        return NULL;
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        LOGE("Could not create the remap map file: %s", path);
+        free(path);
+        free(map);
+        return NULL;
+    }
+
+    bool ok = sc_device_remap_write(file, map, width, height, &rect);
+    ok &= !fclose(file);
+    free(map);
+    if (!ok) {
+        LOGE("Could not write the remap map file: %s", path);
+        remove(path);
+        free(path);
+        return NULL;
+    }
+
+    LOGD("Remap map written for the device (%dx%d): %s", 2 * rect.width,
+         rect.height, path);
+    return path;
+}
+
+void
+sc_device_remap_remove_map(const char *path) {
+    if (remove(path)) {
+        LOGW("Could not remove the remap map file: %s", path);
+    }
+}
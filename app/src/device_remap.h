@@ -0,0 +1,73 @@
+#ifndef SC_DEVICE_REMAP_H
+#define SC_DEVICE_REMAP_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// forward declarations
+struct sc_video_preprocess;
+
+/**
+ * Stereo remap on the device (--device-remap)
+ *
+ * The map of the whole frame (as built for the GPU remap, see
+ * sc_video_preprocess_get_gpu_map()) is written to a temporary file, pushed to
+ * the device with the server. The device renders each captured frame through
+ * the map with OpenGL ES before encoding it, so the client receives rectified
+ * frames and never remaps them.
+ *
+ * If crop is enabled, the map only covers the valid region of the rectified
+ * eyes (the pixels mapped from inside the source eye), so that the black
+ * borders are neither encoded nor transmitted. The same region is kept in
+ * both eyes, so that the rows stay aligned and the disparities unchanged.
+ *
+ * File format:
+ *  - the magic "SCRM"
+ *  - the map width and height, then the source (captured) frame width and
+ *    height (32-bit big-endian)
+ *  - for each destination pixel, row by row from the top, the source
+ *    coordinates x and y in the whole frame (32-bit little-endian floats)
+ */
+
+#define SC_DEVICE_REMAP_MAGIC "SCRM"
+
+// Alignment of the width of each eye and of the height of the cropped map
+// (many hardware encoders require a multiple of 16 for the whole frame)
+#define SC_DEVICE_REMAP_CROP_ALIGN 8
+
+// Region of each eye, in the coordinates of the eye
+struct sc_device_remap_rect {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+/**
+ * Write the map of `vpp` to a temporary file
+ *
+ * Return the path of the file (to be removed by sc_device_remap_remove_map()
+ * and freed by the caller), or NULL on error.
+ */
+char *
+sc_device_remap_write_map(const struct sc_video_preprocess *vpp, uint32_t scid,
+                          bool crop);
+
+/**
+ * Compute the region of an eye of the map (of the whole frame) whose pixels
+ * are all mapped from inside the source eye
+ *
+ * The region is shrunk greedily from the full eye, removing the border with
+ * the most invalid pixels first.
+ */
+void
+sc_device_remap_compute_valid_rect(const float *map, int width, int height,
+                                   bool right,
+                                   struct sc_device_remap_rect *rect);
+
+void
+sc_device_remap_remove_map(const char *path);
+
+#endif
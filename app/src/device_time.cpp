@@ -1,84 +1,79 @@
 #include <cstdio>
-#include <memory>
-#include <string>
-#include <chrono>
-#include <array>
-#include <iostream>
 #include <ctime>
-#include <iomanip>
-#include <sstream>
+#include <cstring>
 
-#include "util/log.h"
 #include "device_time.h"
 
 namespace {
-    // Helper function to execute command and get output
-    std::string exec_command(const char* cmd) {
-        std::array<char, 128> buffer;
-        std::string result;
-        std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(cmd, "r"), pclose);
-        if (!pipe) {
-            LOGE("popen() failed!");
-            return "";
-        }
-        while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
-            result += buffer.data();
-        }
-        return result;
-    }
-}
+    // Last second formatted by the current thread
+    struct timestamp_cache {
+        bool valid;
+        time_t seconds;
+        char prefix[SC_TIMESTAMP_STR_SIZE]; // "YYYY-MM-DD HH:MM:SS"
+        size_t prefix_len;
+    };
 
-int64_t get_device_boot_time(const char* ip_port, const char* adb_path) {
-    // Get current time in milliseconds
-    std::string cmd = "\"" + std::string(adb_path) + "\" -s " + std::string(ip_port) + " shell date +%s%3N";
-    std::string now_str = exec_command(cmd.c_str());
-    if (now_str.empty()) {
-        LOGE("Failed to get device time");
-        return 0;
-    }
-    int64_t now_ms = std::stoll(now_str);
+    thread_local timestamp_cache cache;
 
-    // Get device uptime using adb with IP address and port
-    cmd = "\"" + std::string(adb_path) + "\" -s " + std::string(ip_port) + " shell cat /proc/uptime";
-    std::string uptime_str = exec_command(cmd.c_str());
-    if (uptime_str.empty()) {
-        LOGE("Failed to get device uptime");
-        return 0;
+    bool local_time(time_t seconds, std::tm* tm) {
+#ifdef _WIN32
+        return !localtime_s(tm, &seconds);
+#else
+        return localtime_r(&seconds, tm);
+#endif
     }
-
-    // Parse uptime (first number before space, in seconds)
-    double uptime_s = std::stod(uptime_str);
-    int64_t uptime_ms = static_cast<int64_t>(uptime_s * 1000);
-
-    // Calculate boot time
-    return now_ms - uptime_ms;
 }
 
-const char* fromTimestamp(int64_t timestamp) {
-    // Static buffer to store the result string
-    static char buffer[64];
+const char* fromTimestamp(int64_t timestamp, char* buffer, size_t size) {
+    // Extract seconds and milliseconds (rounded down, even before the epoch)
+    int64_t seconds = timestamp / 1000;
+    int milliseconds = static_cast<int>(timestamp % 1000);
+    if (milliseconds < 0) {
+        --seconds;
+        milliseconds += 1000;
+    }
 
-    // Extract seconds and milliseconds
-    time_t seconds = static_cast<time_t>(timestamp / 1000); // Seconds part
-    int milliseconds = timestamp % 1000;                   // Milliseconds part
+    // The timezone lookup is done only when the second changes
+    if (!cache.valid || cache.seconds != static_cast<time_t>(seconds)) {
+        std::tm tmTime;
+        if (!local_time(static_cast<time_t>(seconds), &tmTime)) {
+            cache.valid = false;
+            std::snprintf(buffer, size, "Invalid timestamp");
+            return buffer;
+        }
 
-    // Convert seconds to tm structure
-    std::tm* tmTime = std::localtime(&seconds);
+        int len = std::snprintf(cache.prefix, sizeof(cache.prefix),
+                                "%04d-%02d-%02d %02d:%02d:%02d",
+                                tmTime.tm_year + 1900,  // Year
+                                tmTime.tm_mon + 1,     // Month (0-11, so add 1)
+                                tmTime.tm_mday,        // Day
+                                tmTime.tm_hour,        // Hour
+                                tmTime.tm_min,         // Minute
+                                tmTime.tm_sec);        // Second
+        if (len < 0 || static_cast<size_t>(len) >= sizeof(cache.prefix)) {
+            cache.valid = false;
+            std::snprintf(buffer, size, "Invalid timestamp");
+            return buffer;
+        }
+        cache.prefix_len = len;
+        cache.seconds = static_cast<time_t>(seconds);
+        cache.valid = true;
+    }
 
-    // Format the date and time into the buffer
-    if (tmTime) {
-        std::snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d %02d:%02d:%02d.%03d",
-                        tmTime->tm_year + 1900,  // Year
-                        tmTime->tm_mon + 1,     // Month (0-11, so add 1)
-                        tmTime->tm_mday,        // Day
-                        tmTime->tm_hour,        // Hour
-                        tmTime->tm_min,         // Minute
-                        tmTime->tm_sec,         // Second
-                        milliseconds);          // Milliseconds
-    } else {
-        std::snprintf(buffer, sizeof(buffer), "Invalid timestamp");
+    // Append ".mmm" to the cached prefix
+    if (size < cache.prefix_len + 5) {
+        if (size) {
+            buffer[0] = '\0';
+        }
+        return buffer;
     }
+    std::memcpy(buffer, cache.prefix, cache.prefix_len);
+    char* p = buffer + cache.prefix_len;
+    p[0] = '.';
+    p[1] = static_cast<char>('0' + milliseconds / 100);
+    p[2] = static_cast<char>('0' + milliseconds / 10 % 10);
+    p[3] = static_cast<char>('0' + milliseconds % 10);
+    p[4] = '\0';
 
-    // Return the static buffer
     return buffer;
-}
\ No newline at end of file
+}
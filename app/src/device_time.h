@@ -5,13 +5,19 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
-// Get device boot time in milliseconds
-int64_t get_device_boot_time(const char* ip_port, const char* adb_path);
+// Size of a buffer holding "YYYY-MM-DD HH:MM:SS.mmm"
+#define SC_TIMESTAMP_STR_SIZE 32
 
-// Convert timestamp to human readable format
-const char* fromTimestamp(int64_t timestamp);
+// Convert timestamp (in milliseconds since the Unix epoch) to human readable
+// format (local time) into buffer, and return buffer
+//
+// This is reentrant: it may be called concurrently from any thread. The date
+// and time are computed once per second (and per thread), only the
+// milliseconds are formatted on every call.
+const char* fromTimestamp(int64_t timestamp, char* buffer, size_t size);
 
 #ifdef __cplusplus
 }
@@ -3,6 +3,8 @@
 #include <assert.h>
 #include <libavutil/pixfmt.h>
 
+#include "latency_probe.h"
+#include "latency_trace.h"
 #include "util/log.h"
 
 static bool
@@ -28,9 +30,15 @@ sc_display_init_novideo_icon(struct sc_display *display,
 
 bool
 sc_display_init(struct sc_display *display, SDL_Window *window,
-                SDL_Surface *icon_novideo, bool mipmaps) {
-    display->renderer =
-        SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+                SDL_Surface *icon_novideo, bool mipmaps,
+                const struct sc_video_preprocess *gpu_remap,
+                int gpu_remap_offset, bool pbo_upload, bool vsync,
+                bool hud, bool low_latency) {
+    uint32_t renderer_flags = SDL_RENDERER_ACCELERATED;
+    if (vsync) {
+        renderer_flags |= SDL_RENDERER_PRESENTVSYNC;
+    }
+    display->renderer = SDL_CreateRenderer(window, -1, renderer_flags);
     if (!display->renderer) {
         LOGE("Could not create renderer: %s", SDL_GetError());
         return false;
@@ -42,6 +50,10 @@ sc_display_init(struct sc_display *display, SDL_Window *window,
     LOGI("Renderer: %s", renderer_name ? renderer_name : "(unknown)");
 
     display->mipmaps = false;
+    display->mipmap_level = 0;
+    display->mipmaps_dirty = false;
+    display->gpu_remap = false;
+    display->pbo_upload = false;
 
 #ifdef SC_DISPLAY_FORCE_OPENGL_CORE_PROFILE
     display->gl_context = NULL;
@@ -85,19 +97,89 @@ sc_display_init(struct sc_display *display, SDL_Window *window,
         } else {
             LOGI("Trilinear filtering disabled");
         }
-    } else if (mipmaps) {
-        LOGD("Trilinear filtering disabled (not an OpenGL renderer)");
+
+        if (gpu_remap) {
+#ifndef SC_DISPLAY_FORCE_OPENGL_CORE_PROFILE
+            // The shaders require the compatibility profile of the SDL
+            // "opengl" renderer, and float textures
+            bool supports_gpu_remap = !gl->is_opengles
+                && sc_opengl_version_at_least(gl, 3, 0, 0, 0);
+#else
+            bool supports_gpu_remap = false;
+#endif
+            if (supports_gpu_remap) {
+                display->gpu_remap =
+                    sc_gl_remap_init(&display->gl_remap, gpu_remap,
+                                     gpu_remap_offset);
+                if (!display->gpu_remap) {
+                    LOGW("Could not initialize GPU remap, "
+                         "the frames are remapped on the CPU");
+                }
+            } else {
+                LOGW("GPU remap disabled (OpenGL 3.0+ required), "
+                     "the frames are remapped on the CPU");
+            }
+        }
+
+        if (pbo_upload) {
+#ifndef SC_DISPLAY_FORCE_OPENGL_CORE_PROFILE
+            // Persistent mapping (OpenGL 4.4 or GL_ARB_buffer_storage) and
+            // fences (OpenGL 3.2)
+            bool supports_pbo_upload = !gl->is_opengles
+                && (sc_opengl_version_at_least(gl, 4, 4, 0, 0)
+                 || (sc_opengl_version_at_least(gl, 3, 2, 0, 0)
+                  && SDL_GL_ExtensionSupported("GL_ARB_buffer_storage")));
+#else
+            bool supports_pbo_upload = false;
+#endif
+            if (supports_pbo_upload) {
+                display->pbo_upload = sc_gl_pbo_init(&display->gl_pbo);
+                if (display->pbo_upload) {
+                    LOGI("Texture upload through pixel buffer objects");
+                } else {
+                    LOGW("Could not initialize pixel buffer uploads");
+                }
+            } else {
+                LOGD("Pixel buffer uploads disabled (OpenGL 4.4+ required)");
+            }
+        }
+    } else {
+        if (mipmaps) {
+            LOGD("Trilinear filtering disabled (not an OpenGL renderer)");
+        }
+        if (gpu_remap) {
+            LOGW("GPU remap disabled (not an OpenGL renderer), "
+                 "the frames are remapped on the CPU");
+        }
+    }
+
+    display->present_sync_enabled = false;
+    if (low_latency) {
+        // Not fatal, the frames are presented as usual
+        display->present_sync_enabled =
+            sc_present_sync_init(&display->present_sync, display->renderer,
+                                 use_opengl ? &display->gl : NULL);
     }
 
     display->texture = NULL;
+    display->texture_format = SDL_PIXELFORMAT_YV12;
     display->pending.flags = 0;
     display->pending.frame = NULL;
     display->has_frame = false;
+    display->color_range = AVCOL_RANGE_UNSPECIFIED;
+    display->frame_pts = AV_NOPTS_VALUE;
+    display->frame_presented = true;
 
     if (icon_novideo) {
         // Without video, set a static scrcpy icon as window content
         bool ok = sc_display_init_novideo_icon(display, icon_novideo);
         if (!ok) {
+            if (display->pbo_upload) {
+                sc_gl_pbo_destroy(&display->gl_pbo);
+            }
+            if (display->gpu_remap) {
+                sc_gl_remap_destroy(&display->gl_remap);
+            }
 #ifdef SC_DISPLAY_FORCE_OPENGL_CORE_PROFILE
             SDL_GL_DeleteContext(display->gl_context);
 #endif
@@ -106,6 +188,12 @@ sc_display_init(struct sc_display *display, SDL_Window *window,
         }
     }
 
+    display->hud_enabled = false;
+    if (hud) {
+        // Not fatal, the frames are displayed without HUD
+        display->hud_enabled = sc_hud_init(&display->hud, display->renderer);
+    }
+
     return true;
 }
 
@@ -114,6 +202,15 @@ sc_display_destroy(struct sc_display *display) {
     if (display->pending.frame) {
         av_frame_free(&display->pending.frame);
     }
+    if (display->hud_enabled) {
+        sc_hud_destroy(&display->hud);
+    }
+    if (display->pbo_upload) {
+        sc_gl_pbo_destroy(&display->gl_pbo);
+    }
+    if (display->gpu_remap) {
+        sc_gl_remap_destroy(&display->gl_remap);
+    }
 #ifdef SC_DISPLAY_FORCE_OPENGL_CORE_PROFILE
     SDL_GL_DeleteContext(display->gl_context);
 #endif
@@ -127,7 +224,7 @@ static SDL_Texture *
 sc_display_create_texture(struct sc_display *display,
                           struct sc_size size) {
     SDL_Renderer *renderer = display->renderer;
-    SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_YV12,
+    SDL_Texture *texture = SDL_CreateTexture(renderer, display->texture_format,
                                              SDL_TEXTUREACCESS_STREAMING,
                                              size.width, size.height);
     if (!texture) {
@@ -140,12 +237,14 @@ sc_display_create_texture(struct sc_display *display,
 
         SDL_GL_BindTexture(texture, NULL, NULL);
 
-        // Enable trilinear filtering for downscaling
-        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                          GL_LINEAR_MIPMAP_LINEAR);
+        // Trilinear filtering is enabled on render, only if the texture is
+        // downscaled (see sc_display_prepare_mipmaps())
         gl->TexParameterf(GL_TEXTURE_2D, GL_TEXTURE_LOD_BIAS, -1.f);
 
         SDL_GL_UnbindTexture(texture);
+
+        display->mipmap_level = 0;
+        display->mipmaps_dirty = false;
     }
 
     return texture;
@@ -242,12 +341,37 @@ sc_display_to_sdl_color_range(enum AVColorRange color_range) {
                                            : SDL_YUV_CONVERSION_AUTOMATIC;
 }
 
+static Uint32
+sc_display_get_texture_format(const AVFrame *frame) {
+#ifdef SCRCPY_SDL_HAS_UPDATE_NV_TEXTURE
+    if (frame->format == AV_PIX_FMT_NV12) {
+        // Hardware decoded frames, not converted
+        return SDL_PIXELFORMAT_NV12;
+    }
+#endif
+    assert(frame->format == AV_PIX_FMT_YUV420P);
+    return SDL_PIXELFORMAT_YV12;
+}
+
 static bool
 sc_display_update_texture_internal(struct sc_display *display,
                                    const AVFrame *frame) {
+    Uint32 format = sc_display_get_texture_format(frame);
+    if (format != display->texture_format) {
+        // Recreate the texture (with the same size) in the new format
+        struct sc_size size = {frame->width, frame->height};
+        display->texture_format = format;
+        LOGD("Texture format: %s", SDL_GetPixelFormatName(format));
+        if (!sc_display_set_texture_size_internal(display, size)) {
+            sc_display_set_pending_size(display, size);
+            return false;
+        }
+    }
+
     if (!display->has_frame) {
         // First frame
         display->has_frame = true;
+        display->color_range = frame->color_range;
 
         // Configure YUV color range conversion
         SDL_YUV_CONVERSION_MODE sdl_color_range =
@@ -255,21 +379,45 @@ sc_display_update_texture_internal(struct sc_display *display,
         SDL_SetYUVConversionMode(sdl_color_range);
     }
 
-    int ret = SDL_UpdateYUVTexture(display->texture, NULL,
-                                   frame->data[0], frame->linesize[0],
-                                   frame->data[1], frame->linesize[1],
-                                   frame->data[2], frame->linesize[2]);
-    if (ret) {
-        LOGD("Could not update texture: %s", SDL_GetError());
-        return false;
+    bool uploaded = false;
+    if (display->pbo_upload) {
+        uploaded = sc_gl_pbo_upload(&display->gl_pbo, display->texture, frame);
+        if (!uploaded) {
+            LOGW("Pixel buffer uploads disabled");
+            sc_gl_pbo_destroy(&display->gl_pbo);
+            display->pbo_upload = false;
+        }
+    }
+
+    if (!uploaded) {
+        int ret;
+#ifdef SCRCPY_SDL_HAS_UPDATE_NV_TEXTURE
+        if (format == SDL_PIXELFORMAT_NV12) {
+            ret = SDL_UpdateNVTexture(display->texture, NULL,
+                                      frame->data[0], frame->linesize[0],
+                                      frame->data[1], frame->linesize[1]);
+        } else
+#endif
+        {
+            ret = SDL_UpdateYUVTexture(display->texture, NULL,
+                                       frame->data[0], frame->linesize[0],
+                                       frame->data[1], frame->linesize[1],
+                                       frame->data[2], frame->linesize[2]);
+        }
+        if (ret) {
+            LOGD("Could not update texture: %s", SDL_GetError());
+            return false;
+        }
     }
 
     if (display->mipmaps) {
-        SDL_GL_BindTexture(display->texture, NULL, NULL);
-        display->gl.GenerateMipmap(GL_TEXTURE_2D);
-        SDL_GL_UnbindTexture(display->texture);
+        // Generated lazily on render, only if the texture is downscaled
+        display->mipmaps_dirty = true;
     }
 
+    display->frame_pts = frame->pts;
+    display->frame_presented = false;
+
     return true;
 }
 
@@ -289,23 +437,84 @@ sc_display_update_texture(struct sc_display *display, const AVFrame *frame) {
     return SC_DISPLAY_RESULT_OK;
 }
 
-enum sc_display_result
-sc_display_render(struct sc_display *display, const SDL_Rect *geometry,
-                  enum sc_orientation orientation) {
-    SDL_RenderClear(display->renderer);
-
-    if (display->pending.flags) {
-        bool ok = sc_display_apply_pending(display);
-        if (!ok) {
-            return SC_DISPLAY_RESULT_PENDING;
-        }
+// A part of the texture drawn into a part of the content
+struct sc_display_pass {
+    // 0 for the whole texture, 1 for its left half, 2 for its right half
+    unsigned eye;
+    // vertical part of the content (before orientation), in 1/2 units
+    unsigned top;
+    unsigned bottom;
+    // if not NULL, only the non-zero channels are written
+    const SDL_Color *color_mod;
+};
+
+static unsigned
+sc_display_get_passes(enum sc_stereo_view view,
+                      struct sc_display_pass passes[2]) {
+    static const SDL_Color red = {0xFF, 0, 0, 0xFF};
+    static const SDL_Color cyan = {0, 0xFF, 0xFF, 0xFF};
+
+    switch (view) {
+        case SC_STEREO_VIEW_LEFT:
+            passes[0] = (struct sc_display_pass) {1, 0, 2, NULL};
+            return 1;
+        case SC_STEREO_VIEW_RIGHT:
+            passes[0] = (struct sc_display_pass) {2, 0, 2, NULL};
+            return 1;
+        case SC_STEREO_VIEW_TOP_BOTTOM:
+            passes[0] = (struct sc_display_pass) {1, 0, 1, NULL};
+            passes[1] = (struct sc_display_pass) {2, 1, 2, NULL};
+            return 2;
+        case SC_STEREO_VIEW_ANAGLYPH:
+            passes[0] = (struct sc_display_pass) {1, 0, 2, &red};
+            passes[1] = (struct sc_display_pass) {2, 0, 2, &cyan};
+            return 2;
+        default:
+            assert(view == SC_STEREO_VIEW_SIDE_BY_SIDE);
+            passes[0] = (struct sc_display_pass) {0, 0, 2, NULL};
+            return 1;
     }
+}
 
-    SDL_Renderer *renderer = display->renderer;
-    SDL_Texture *texture = display->texture;
+// Compute the part of the geometry (already oriented) where the pass is drawn
+static SDL_Rect
+sc_display_get_pass_geometry(const SDL_Rect *geometry,
+                             enum sc_orientation orientation,
+                             const struct sc_display_pass *pass) {
+    // The pass covers the whole width of the content, so the horizontal flip
+    // does not move it, only the rotation does
+    int top = pass->top;
+    int bottom = pass->bottom;
+    SDL_Rect rect = *geometry;
+    switch (sc_orientation_get_rotation(orientation)) {
+        case SC_ORIENTATION_0:
+            rect.y += geometry->h * top / 2;
+            rect.h = geometry->h * (bottom - top) / 2;
+            break;
+        case SC_ORIENTATION_90:
+            rect.x += geometry->w * (2 - bottom) / 2;
+            rect.w = geometry->w * (bottom - top) / 2;
+            break;
+        case SC_ORIENTATION_180:
+            rect.y += geometry->h * (2 - bottom) / 2;
+            rect.h = geometry->h * (bottom - top) / 2;
+            break;
+        default:
+            assert(sc_orientation_get_rotation(orientation)
+                    == SC_ORIENTATION_270);
+            rect.x += geometry->w * top / 2;
+            rect.w = geometry->w * (bottom - top) / 2;
+            break;
+    }
+    return rect;
+}
 
+static enum sc_display_result
+sc_display_copy(SDL_Renderer *renderer, SDL_Texture *texture,
+                const SDL_Rect *src, const SDL_Rect *geometry,
+                enum sc_orientation orientation) {
     if (orientation == SC_ORIENTATION_0) {
-        int ret = SDL_RenderCopy(renderer, texture, NULL, geometry);
+        int ret = SDL_RenderCopy(renderer, texture, src, geometry);
         if (ret) {
             LOGE("Could not render texture: %s", SDL_GetError());
             return SC_DISPLAY_RESULT_ERROR;
@@ -329,7 +538,7 @@ sc_display_render(struct sc_display *display, const SDL_Rect *geometry,
         SDL_RendererFlip flip = sc_orientation_is_mirror(orientation)
                               ? SDL_FLIP_HORIZONTAL : 0;
 
-        int ret = SDL_RenderCopyEx(renderer, texture, NULL, dstrect, angle,
+        int ret = SDL_RenderCopyEx(renderer, texture, src, dstrect, angle,
                                    NULL, flip);
         if (ret) {
             LOGE("Could not render texture: %s", SDL_GetError());
@@ -337,6 +546,227 @@ sc_display_render(struct sc_display *display, const SDL_Rect *geometry,
         }
     }
 
-    SDL_RenderPresent(display->renderer);
+    return SC_DISPLAY_RESULT_OK;
+}
+
+// Return the highest mipmap level sampled to draw `src_w`x`src_h` texels into
+// `dst_w`x`dst_h` pixels
+static unsigned
+sc_display_get_mipmap_level(int src_w, int src_h, int dst_w, int dst_h) {
+    if (dst_w <= 0 || dst_h <= 0) {
+        return 0;
+    }
+
+    // With the LOD bias of -1, the level sampled is log2(scale) - 1, so the
+    // base level is sufficient up to a downscale by 2
+    unsigned level = 0;
+    while ((int64_t) dst_w << (level + 1) < src_w
+            || (int64_t) dst_h << (level + 1) < src_h) {
+        ++level;
+    }
+    return level;
+}
+
+static void
+sc_display_prepare_mipmaps(struct sc_display *display, unsigned level) {
+    assert(display->mipmaps);
+
+    struct sc_opengl *gl = &display->gl;
+
+    if (level != display->mipmap_level) {
+        SDL_GL_BindTexture(display->texture, NULL, NULL);
+        if (level) {
+            gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                              GL_LINEAR_MIPMAP_LINEAR);
+            if (sc_opengl_version_at_least(gl, 3, 0, 3, 0)) {
+                // Only generate and sample the levels actually needed
+                gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level);
+            }
+        } else {
+            // Not minified, the mipmaps are not sampled anymore
+            gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        }
+        SDL_GL_UnbindTexture(display->texture);
+
+        if (level > display->mipmap_level) {
+            // The new levels are not generated yet
+            display->mipmaps_dirty = true;
+        }
+        LOGD("Mipmap levels: %u", level);
+        display->mipmap_level = level;
+    }
+
+    if (level && display->mipmaps_dirty) {
+        SDL_GL_BindTexture(display->texture, NULL, NULL);
+        gl->GenerateMipmap(GL_TEXTURE_2D);
+        SDL_GL_UnbindTexture(display->texture);
+        display->mipmaps_dirty = false;
+    }
+}
+
+// Draw the time-coded pattern of the latency probe in the bottom-left corner,
+// over the frame
+static void
+sc_display_draw_latency_probe(SDL_Renderer *renderer) {
+    int w;
+    int h;
+    if (SDL_GetRendererOutputSize(renderer, &w, &h)) {
+        return;
+    }
+
+    int cell = MIN(SC_LATENCY_PROBE_CELL_SIZE, w / SC_LATENCY_PROBE_CELLS);
+    if (!cell) {
+        return;
+    }
+
+    // As close as possible to the presentation
+    uint16_t code = sc_latency_probe_encode(sc_tick_now());
+
+    for (unsigned i = 0; i < SC_LATENCY_PROBE_CELLS; ++i) {
+        bool white;
+        if (!i) {
+            white = true;
+        } else if (i == SC_LATENCY_PROBE_CELLS - 1) {
+            white = false;
+        } else {
+            white = code & (1 << (SC_LATENCY_PROBE_BITS - i));
+        }
+        Uint8 v = white ? 0xFF : 0;
+        SDL_SetRenderDrawColor(renderer, v, v, v, 0xFF);
+        SDL_Rect rect = {
+            .x = i * cell,
+            .y = h - cell,
+            .w = cell,
+            .h = cell,
+        };
+        SDL_RenderFillRect(renderer, &rect);
+    }
+
+    // Restore the clear color
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0xFF);
+}
+
+enum sc_display_result
+sc_display_render(struct sc_display *display, const SDL_Rect *geometry,
+                  enum sc_orientation orientation,
+                  enum sc_stereo_view view) {
+    SDL_RenderClear(display->renderer);
+
+    if (display->pending.flags) {
+        bool ok = sc_display_apply_pending(display);
+        if (!ok) {
+            return SC_DISPLAY_RESULT_PENDING;
+        }
+    }
+
+    SDL_Renderer *renderer = display->renderer;
+    SDL_Texture *texture = display->texture;
+
+    if (!geometry) {
+        // The no-video icon
+        enum sc_display_result res =
+            sc_display_copy(renderer, texture, NULL, NULL, SC_ORIENTATION_0);
+        if (res == SC_DISPLAY_RESULT_OK) {
+            SDL_RenderPresent(renderer);
+        }
+        return res;
+    }
+
+    // The views are only texture coordinates (and channel) selections, the
+    // frames are never composited on the CPU
+    struct sc_display_pass passes[2];
+    unsigned pass_count = sc_display_get_passes(view, passes);
+
+    int width;
+    int height;
+    if (SDL_QueryTexture(texture, NULL, NULL, &width, &height)) {
+        LOGE("Could not query texture: %s", SDL_GetError());
+        return SC_DISPLAY_RESULT_ERROR;
+    }
+
+    if (display->mipmaps) {
+        // Every pass draws the same part of the texture size into the same
+        // part of the geometry size
+        const struct sc_display_pass *pass = &passes[0];
+        int src_w = pass->eye ? width / 2 : width;
+        SDL_Rect pass_geometry =
+            sc_display_get_pass_geometry(geometry, orientation, pass);
+        bool swap = sc_orientation_is_swap(orientation);
+        int dst_w = swap ? pass_geometry.h : pass_geometry.w;
+        int dst_h = swap ? pass_geometry.w : pass_geometry.h;
+        unsigned level =
+            sc_display_get_mipmap_level(src_w, height, dst_w, dst_h);
+        sc_display_prepare_mipmaps(display, level);
+    }
+
+    bool remap = display->gpu_remap && display->has_frame;
+    for (unsigned i = 0; i < pass_count; ++i) {
+        const struct sc_display_pass *pass = &passes[i];
+
+        const SDL_Rect *src = NULL;
+        SDL_Rect eye_rect;
+        if (pass->eye) {
+            eye_rect.x = pass->eye == 1 ? 0 : width / 2;
+            eye_rect.y = 0;
+            eye_rect.w = width / 2;
+            eye_rect.h = height;
+            src = &eye_rect;
+        }
+
+        SDL_Rect pass_geometry =
+            sc_display_get_pass_geometry(geometry, orientation, pass);
+
+        if (remap) {
+            remap = sc_gl_remap_render(&display->gl_remap, renderer, texture,
+                                       src, &pass_geometry, orientation,
+                                       display->color_range, pass->color_mod);
+            if (remap) {
+                continue;
+            }
+            // Otherwise, render the frame without remap
+        }
+
+        if (pass->color_mod) {
+            // The first pass overwrites the cleared target, the second one
+            // adds its channels
+            const SDL_Color *mod = pass->color_mod;
+            SDL_SetTextureColorMod(texture, mod->r, mod->g, mod->b);
+            SDL_SetTextureBlendMode(texture, i ? SDL_BLENDMODE_ADD
+                                               : SDL_BLENDMODE_NONE);
+        }
+
+        enum sc_display_result res =
+            sc_display_copy(renderer, texture, src, &pass_geometry,
+                            orientation);
+
+        if (pass->color_mod) {
+            SDL_SetTextureColorMod(texture, 0xFF, 0xFF, 0xFF);
+            SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_NONE);
+        }
+
+        if (res != SC_DISPLAY_RESULT_OK) {
+            return res;
+        }
+    }
+
+    if (display->hud_enabled) {
+        sc_hud_render(&display->hud, renderer);
+    }
+
+    if (sc_latency_probe_is_enabled()) {
+        sc_display_draw_latency_probe(renderer);
+    }
+
+    SDL_RenderPresent(renderer);
+    if (display->present_sync_enabled) {
+        sc_present_sync_wait(&display->present_sync);
+    }
+
+    if (!display->frame_presented) {
+        // Only the first present of each frame (the next ones only redraw it)
+        display->frame_presented = true;
+        sc_latency_trace_stamp(SC_LATENCY_STAGE_PRESENT, display->frame_pts);
+    }
+
     return SC_DISPLAY_RESULT_OK;
 }
@@ -8,8 +8,12 @@
 #include <SDL2/SDL.h>
 
 #include "coords.h"
+#include "gl_pbo.h"
+#include "gl_remap.h"
+#include "hud.h"
 #include "opengl.h"
 #include "options.h"
+#include "present_sync.h"
 
 #ifdef __APPLE__
 # define SC_DISPLAY_FORCE_OPENGL_CORE_PROFILE
@@ -18,6 +22,8 @@
 struct sc_display {
     SDL_Renderer *renderer;
     SDL_Texture *texture;
+    // SDL_PIXELFORMAT_YV12, or SDL_PIXELFORMAT_NV12 for NV12 frames
+    Uint32 texture_format;
 
     struct sc_opengl gl;
 #ifdef SC_DISPLAY_FORCE_OPENGL_CORE_PROFILE
@@ -25,6 +31,26 @@ struct sc_display {
 #endif
 
     bool mipmaps;
+    // Highest mipmap level enabled on the texture (0 while the texture is not
+    // minified), and whether the levels must be regenerated before rendering
+    unsigned mipmap_level;
+    bool mipmaps_dirty;
+
+    // If set, the stereo remap is applied while rendering
+    bool gpu_remap;
+    struct sc_gl_remap gl_remap;
+
+    // If set, the frames are uploaded through pixel buffer objects
+    bool pbo_upload;
+    struct sc_gl_pbo gl_pbo;
+
+    // If set, the performance HUD is drawn over the frames
+    bool hud_enabled;
+    struct sc_hud hud;
+
+    // If set, each present is synchronized explicitly (--low-latency-present)
+    bool present_sync_enabled;
+    struct sc_present_sync present_sync;
 
     struct {
 #define SC_DISPLAY_PENDING_FLAG_SIZE 1
@@ -35,6 +61,9 @@ struct sc_display {
     } pending;
 
     bool has_frame;
+    enum AVColorRange color_range; // of the first frame
+    int64_t frame_pts; // of the frame in the texture
+    bool frame_presented; // stamped at SC_LATENCY_STAGE_PRESENT
 };
 
 enum sc_display_result {
@@ -43,9 +72,28 @@ enum sc_display_result {
     SC_DISPLAY_RESULT_ERROR,
 };
 
+/**
+ * If `gpu_remap` is not NULL, try to apply its stereo remap on the GPU (see
+ * gl_remap.h), the first `gpu_remap_offset` rows not being remapped.
+ * On failure, the display works normally (check `display->gpu_remap`).
+ *
+ * If `pbo_upload` is set, try to upload the frames through pixel buffer
+ * objects (see gl_pbo.h), otherwise with SDL_UpdateYUVTexture().
+ *
+ * If `vsync` is set, sc_display_render() waits for the vertical blank to
+ * present (it must not be called from the main thread).
+ *
+ * If `hud` is set, the performance HUD (see hud.h) is drawn over the frames.
+ *
+ * If `low_latency` is set, try to synchronize each present explicitly (see
+ * present_sync.h).
+ */
 bool
 sc_display_init(struct sc_display *display, SDL_Window *window,
-                SDL_Surface *icon_novideo, bool mipmaps);
+                SDL_Surface *icon_novideo, bool mipmaps,
+                const struct sc_video_preprocess *gpu_remap,
+                int gpu_remap_offset, bool pbo_upload, bool vsync, bool hud,
+                bool low_latency);
 
 void
 sc_display_destroy(struct sc_display *display);
@@ -56,8 +104,12 @@ sc_display_set_texture_size(struct sc_display *display, struct sc_size size);
 enum sc_display_result
 sc_display_update_texture(struct sc_display *display, const AVFrame *frame);
 
+/**
+ * Render the texture into the geometry (or the no-video icon if `geometry` is
+ * NULL), with the stereo `view` layout
+ */
 enum sc_display_result
 sc_display_render(struct sc_display *display, const SDL_Rect *geometry,
-                  enum sc_orientation orientation);
+                  enum sc_orientation orientation, enum sc_stereo_view view);
 
 #endif
@@ -20,6 +20,8 @@ enum {
     SC_EVENT_TIME_LIMIT_REACHED,
     SC_EVENT_CONTROLLER_ERROR,
     SC_EVENT_AOA_OPEN_ERROR,
+    SC_EVENT_SCREEN_FRAME_SIZE,
+    SC_EVENT_SCREEN_RENDER_ERROR,
 };
 
 bool
@@ -0,0 +1,261 @@
+#include "eye_merger.h"
+
+#include <assert.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+
+#include "util/log.h"
+
+/** Downcast frame_sink to sc_eye_merger_input */
+#define DOWNCAST(SINK) \
+    container_of(SINK, struct sc_eye_merger_input, frame_sink)
+
+static bool
+sc_eye_merger_frame_sink_open(struct sc_frame_sink *sink,
+                              const AVCodecContext *ctx) {
+    struct sc_eye_merger_input *input = DOWNCAST(sink);
+    struct sc_eye_merger *merger = input->merger;
+
+    if (ctx->pix_fmt != AV_PIX_FMT_YUV420P || ctx->width % 2) {
+        LOGE("Unsupported eye video (%dx%d, %s)", ctx->width, ctx->height,
+             av_get_pix_fmt_name(ctx->pix_fmt));
+        return false;
+    }
+
+    if (input->eye != SC_EYE_LEFT) {
+        // The sinks are opened from the left eye only
+        return true;
+    }
+
+    AVCodecContext *merged = avcodec_alloc_context3(NULL);
+    if (!merged) {
+        LOG_OOM();
+        return false;
+    }
+
+    // Both eyes have the same size (they are split from the same frame)
+    merged->width = ctx->width * 2;
+    merged->height = ctx->height;
+    merged->pix_fmt = ctx->pix_fmt;
+
+    // Before the first frames, so that they are not delayed by the allocations
+    // (on failure, they are allocated on the first frames)
+    sc_mutex_lock(&merger->mutex);
+    (void) sc_frame_pool_prepare(&merger->pool, merged->pix_fmt,
+                                 merged->width, merged->height,
+                                 SC_EYE_MERGER_PREPARED_FRAMES);
+    sc_mutex_unlock(&merger->mutex);
+
+    if (!sc_frame_source_sinks_open(&merger->frame_source, merged)) {
+        avcodec_free_context(&merged);
+        return false;
+    }
+
+    sc_mutex_lock(&merger->mutex);
+    merger->ctx = merged;
+    merger->opened = true;
+    sc_mutex_unlock(&merger->mutex);
+
+    return true;
+}
+
+static void
+sc_eye_merger_frame_sink_close(struct sc_frame_sink *sink) {
+    struct sc_eye_merger_input *input = DOWNCAST(sink);
+    struct sc_eye_merger *merger = input->merger;
+
+    sc_mutex_lock(&merger->mutex);
+    if (input->has_pending) {
+        av_frame_unref(input->pending);
+        input->has_pending = false;
+    }
+    bool close_sinks = input->eye == SC_EYE_LEFT && merger->opened;
+    if (close_sinks) {
+        // No frame may be pushed to the sinks anymore
+        merger->opened = false;
+    }
+    sc_mutex_unlock(&merger->mutex);
+
+    if (close_sinks) {
+        sc_frame_source_sinks_close(&merger->frame_source);
+        avcodec_free_context(&merger->ctx);
+        sc_frame_drops_log(&merger->drops);
+    }
+}
+
+// Copy the frames of both eyes side by side into merger->out
+static bool
+sc_eye_merger_merge(struct sc_eye_merger *merger, const AVFrame *left,
+                    const AVFrame *right) {
+    AVFrame *out = merger->out;
+    if (!sc_frame_pool_get(&merger->pool, out, left->format, left->width * 2,
+                           left->height)) {
+        return false;
+    }
+
+    if (av_frame_copy_props(out, left) < 0) {
+        LOG_OOM();
+        av_frame_unref(out);
+        return false;
+    }
+
+    // YUV 4:2:0, the width of an eye is even
+    for (int i = 0; i < 3; ++i) {
+        int shift = i ? 1 : 0;
+        int bytes = left->width >> shift;
+        int rows = (left->height + shift) >> shift;
+        av_image_copy_plane(out->data[i], out->linesize[i], left->data[i],
+                            left->linesize[i], bytes, rows);
+        av_image_copy_plane(out->data[i] + bytes, out->linesize[i],
+                            right->data[i], right->linesize[i], bytes, rows);
+    }
+
+    return true;
+}
+
+// Called with the mutex locked, once both eyes have a pending frame
+static bool
+sc_eye_merger_match(struct sc_eye_merger *merger) {
+    struct sc_eye_merger_input *l = &merger->inputs[SC_EYE_LEFT];
+    struct sc_eye_merger_input *r = &merger->inputs[SC_EYE_RIGHT];
+    assert(l->has_pending && r->has_pending);
+
+    if (l->pending->pts != r->pending->pts) {
+        // The frames of each eye arrive in PTS order: the oldest one can never
+        // be matched
+        struct sc_eye_merger_input *oldest =
+            l->pending->pts < r->pending->pts ? l : r;
+        av_frame_unref(oldest->pending);
+        oldest->has_pending = false;
+        sc_frame_drops_add(&merger->drops, SC_FRAME_DROP_OVERWRITTEN);
+        return true;
+    }
+
+    bool ok = true;
+    if (l->pending->width == r->pending->width
+            && l->pending->height == r->pending->height) {
+        ok = sc_eye_merger_merge(merger, l->pending, r->pending);
+        if (ok) {
+            ok = sc_frame_source_sinks_push(&merger->frame_source,
+                                            merger->out);
+            av_frame_unref(merger->out);
+        }
+    } else {
+        // Transient, while the decoders are reconfigured (e.g. on rotation)
+        sc_frame_drops_add(&merger->drops, SC_FRAME_DROP_OVERWRITTEN);
+    }
+
+    av_frame_unref(l->pending);
+    l->has_pending = false;
+    av_frame_unref(r->pending);
+    r->has_pending = false;
+    return ok;
+}
+
+static bool
+sc_eye_merger_frame_sink_push(struct sc_frame_sink *sink,
+                              const AVFrame *frame) {
+    struct sc_eye_merger_input *input = DOWNCAST(sink);
+    struct sc_eye_merger *merger = input->merger;
+
+    sc_mutex_lock(&merger->mutex);
+
+    if (!merger->opened) {
+        // The left eye is not opened yet
+        sc_mutex_unlock(&merger->mutex);
+        return true;
+    }
+
+    if (input->has_pending) {
+        // The other eye lost the mate of the pending frame
+        av_frame_unref(input->pending);
+        sc_frame_drops_add(&merger->drops, SC_FRAME_DROP_OVERWRITTEN);
+    }
+
+    if (av_frame_ref(input->pending, frame)) {
+        input->has_pending = false;
+        sc_mutex_unlock(&merger->mutex);
+        LOG_OOM();
+        return false;
+    }
+    input->has_pending = true;
+
+    bool ok = true;
+    // The merged frames are pushed with the mutex locked, so that they are
+    // pushed in order whatever the thread
+    while (ok && merger->inputs[SC_EYE_LEFT].has_pending
+              && merger->inputs[SC_EYE_RIGHT].has_pending) {
+        ok = sc_eye_merger_match(merger);
+    }
+
+    sc_mutex_unlock(&merger->mutex);
+
+    if (!ok) {
+        LOGE("Could not push the merged eye frame");
+    }
+    return ok;
+}
+
+bool
+sc_eye_merger_init(struct sc_eye_merger *merger) {
+    bool ok = sc_mutex_init(&merger->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    merger->out = av_frame_alloc();
+    if (!merger->out) {
+        LOG_OOM();
+        goto error_destroy_mutex;
+    }
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = sc_eye_merger_frame_sink_open,
+        .close = sc_eye_merger_frame_sink_close,
+        .push = sc_eye_merger_frame_sink_push,
+    };
+
+    unsigned i;
+    for (i = 0; i < SC_EYE_COUNT; ++i) {
+        struct sc_eye_merger_input *input = &merger->inputs[i];
+        input->pending = av_frame_alloc();
+        if (!input->pending) {
+            LOG_OOM();
+            goto error_free_inputs;
+        }
+        input->has_pending = false;
+        input->merger = merger;
+        input->eye = i;
+        input->frame_sink.ops = &ops;
+    }
+
+    merger->opened = false;
+    merger->ctx = NULL;
+    sc_frame_pool_init(&merger->pool);
+    sc_frame_drops_init(&merger->drops, "Eye merger");
+    sc_frame_source_init(&merger->frame_source);
+
+    return true;
+
+error_free_inputs:
+    while (i--) {
+        av_frame_free(&merger->inputs[i].pending);
+    }
+    av_frame_free(&merger->out);
+error_destroy_mutex:
+    sc_mutex_destroy(&merger->mutex);
+
+    return false;
+}
+
+void
+sc_eye_merger_destroy(struct sc_eye_merger *merger) {
+    for (unsigned i = 0; i < SC_EYE_COUNT; ++i) {
+        av_frame_free(&merger->inputs[i].pending);
+    }
+    av_frame_free(&merger->out);
+    sc_frame_pool_destroy(&merger->pool);
+    sc_mutex_destroy(&merger->mutex);
+}
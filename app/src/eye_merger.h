@@ -0,0 +1,71 @@
+#ifndef SC_EYE_MERGER_H
+#define SC_EYE_MERGER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#include "frame_drops.h"
+#include "frame_pool.h"
+#include "trait/frame_source.h"
+#include "trait/frame_sink.h"
+#include "util/thread.h"
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+typedef struct AVCodecContext AVCodecContext;
+
+enum sc_eye {
+    SC_EYE_LEFT,
+    SC_EYE_RIGHT,
+    SC_EYE_COUNT,
+};
+
+// Number of merged frames preallocated when the inputs are opened, for the
+// frames referenced by the sinks
+#define SC_EYE_MERGER_PREPARED_FRAMES 4
+
+struct sc_eye_merger;
+
+struct sc_eye_merger_input {
+    struct sc_frame_sink frame_sink; // frame sink trait
+    struct sc_eye_merger *merger;
+    enum sc_eye eye;
+    AVFrame *pending; // waiting for the frame of the other eye
+    bool has_pending;
+};
+
+/**
+ * Merge the frames of the two eyes, encoded and decoded separately (see
+ * --split-eyes), into side-by-side frames.
+ *
+ * Each input is a frame sink, fed by the decoder of one eye (from its own
+ * thread). The device renders both eyes from the same captured frame, with the
+ * same PTS: as soon as the frames of both eyes with the same PTS are received,
+ * they are copied side by side into a pooled frame, pushed to the sinks from
+ * the thread which received the last one. A frame whose mate was lost is
+ * dropped.
+ *
+ * The sinks are opened when the left input is opened, with the size of the
+ * merged frames.
+ */
+struct sc_eye_merger {
+    struct sc_frame_source frame_source; // frame source trait
+    struct sc_eye_merger_input inputs[SC_EYE_COUNT];
+
+    sc_mutex mutex;
+    bool opened; // the sinks are open
+    AVCodecContext *ctx; // description of the merged frames, for the sinks
+
+    struct sc_frame_pool pool;
+    AVFrame *out;
+    struct sc_frame_drops drops;
+};
+
+bool
+sc_eye_merger_init(struct sc_eye_merger *merger);
+
+void
+sc_eye_merger_destroy(struct sc_eye_merger *merger);
+
+#endif
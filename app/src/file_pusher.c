@@ -1,14 +1,20 @@
 #include "file_pusher.h"
 
 #include <assert.h>
+#include <inttypes.h>
 #include <string.h>
 
 #include "adb/adb.h"
+#include "adb/adb_host.h"
 #include "util/log.h"
 #include "util/process_intr.h"
+#include "util/tick.h"
 
 #define DEFAULT_PUSH_TARGET "/sdcard/Download/"
 
+// Minimum delay between two progress logs of a transfer
+#define SC_FILE_PUSHER_PROGRESS_PERIOD SC_TICK_FROM_SEC(1)
+
 static void
 sc_file_pusher_request_destroy(struct sc_file_pusher_request *req) {
     free(req->file);
@@ -16,8 +22,9 @@ sc_file_pusher_request_destroy(struct sc_file_pusher_request *req) {
 
 bool
 sc_file_pusher_init(struct sc_file_pusher *fp, const char *serial,
-                    const char *push_target) {
+                    const char *push_target, unsigned workers) {
     assert(serial);
+    assert(workers && workers <= SC_FILE_PUSHER_MAX_WORKERS);
 
     sc_vecdeque_init(&fp->queue);
 
@@ -32,37 +39,50 @@ sc_file_pusher_init(struct sc_file_pusher *fp, const char *serial,
         return false;
     }
 
-    ok = sc_intr_init(&fp->intr);
-    if (!ok) {
-        sc_cond_destroy(&fp->event_cond);
-        sc_mutex_destroy(&fp->mutex);
-        return false;
+    unsigned i;
+    for (i = 0; i < workers; ++i) {
+        if (!sc_intr_init(&fp->workers[i].intr)) {
+            goto error_destroy_intrs;
+        }
+        fp->workers[i].fp = fp;
     }
 
     fp->serial = strdup(serial);
     if (!fp->serial) {
         LOG_OOM();
-        sc_intr_destroy(&fp->intr);
-        sc_cond_destroy(&fp->event_cond);
-        sc_mutex_destroy(&fp->mutex);
-        return false;
+        goto error_destroy_intrs;
     }
 
     // lazy initialization
     fp->initialized = false;
 
     fp->stopped = false;
+    fp->worker_count = workers;
+    fp->workers_started = 0;
+    fp->requested = 0;
+    fp->completed = 0;
 
     fp->push_target = push_target ? push_target : DEFAULT_PUSH_TARGET;
 
     return true;
+
+error_destroy_intrs:
+    while (i--) {
+        sc_intr_destroy(&fp->workers[i].intr);
+    }
+    sc_cond_destroy(&fp->event_cond);
+    sc_mutex_destroy(&fp->mutex);
+
+    return false;
 }
 
 void
 sc_file_pusher_destroy(struct sc_file_pusher *fp) {
     sc_cond_destroy(&fp->event_cond);
     sc_mutex_destroy(&fp->mutex);
-    sc_intr_destroy(&fp->intr);
+    for (unsigned i = 0; i < fp->worker_count; ++i) {
+        sc_intr_destroy(&fp->workers[i].intr);
+    }
     free(fp->serial);
 
     while (!sc_vecdeque_is_empty(&fp->queue)) {
@@ -92,26 +112,50 @@ sc_file_pusher_request(struct sc_file_pusher *fp,
     };
 
     sc_mutex_lock(&fp->mutex);
-    bool was_empty = sc_vecdeque_is_empty(&fp->queue);
     bool res = sc_vecdeque_push(&fp->queue, req);
     if (!res) {
         LOG_OOM();
         sc_mutex_unlock(&fp->mutex);
         return false;
     }
+    ++fp->requested;
 
-    if (was_empty) {
-        sc_cond_signal(&fp->event_cond);
-    }
+    // Wake up one idle worker, if any
+    sc_cond_signal(&fp->event_cond);
     sc_mutex_unlock(&fp->mutex);
 
     return true;
 }
 
+struct sc_file_pusher_transfer {
+    const char *file;
+    sc_tick start;
+    sc_tick last_log;
+};
+
+static void
+sc_file_pusher_on_progress(uint64_t sent, uint64_t total, void *userdata) {
+    struct sc_file_pusher_transfer *transfer = userdata;
+
+    sc_tick now = sc_tick_now();
+    if (sent == total
+            || now - transfer->last_log < SC_FILE_PUSHER_PROGRESS_PERIOD) {
+        return;
+    }
+    transfer->last_log = now;
+
+    sc_tick elapsed = now - transfer->start;
+    uint64_t rate = elapsed ? sent * SC_TICK_FREQ / elapsed : 0;
+    LOGI("Pushing %s: %u%% (%" PRIu64 "/%" PRIu64 " MiB, %" PRIu64 " MiB/s)",
+         transfer->file, (unsigned) (sent * 100 / total), sent >> 20,
+         total >> 20, rate >> 20);
+}
+
 static int
-run_file_pusher(void *data) {
-    struct sc_file_pusher *fp = data;
-    struct sc_intr *intr = &fp->intr;
+run_file_pusher_worker(void *data) {
+    struct sc_file_pusher_worker *worker = data;
+    struct sc_file_pusher *fp = worker->fp;
+    struct sc_intr *intr = &worker->intr;
 
     const char *serial = fp->serial;
     assert(serial);
@@ -134,9 +178,10 @@ run_file_pusher(void *data) {
         struct sc_file_pusher_request req = sc_vecdeque_pop(&fp->queue);
         sc_mutex_unlock(&fp->mutex);
 
+        bool ok;
         if (req.action == SC_FILE_PUSHER_ACTION_INSTALL_APK) {
             LOGI("Installing %s...", req.file);
-            bool ok = sc_adb_install(intr, serial, req.file, 0);
+            ok = sc_adb_install(intr, serial, req.file, 0);
             if (ok) {
                 LOGI("%s successfully installed", req.file);
             } else {
@@ -144,14 +189,41 @@ run_file_pusher(void *data) {
             }
         } else {
             LOGI("Pushing %s...", req.file);
-            bool ok = sc_adb_push(intr, serial, req.file, push_target, 0);
+            sc_tick start = sc_tick_now();
+            struct sc_file_pusher_transfer transfer = {
+                .file = req.file,
+                .start = start,
+                .last_log = start,
+            };
+            struct sc_adb_push_progress progress = {
+                .on_progress = sc_file_pusher_on_progress,
+                .userdata = &transfer,
+            };
+            ok = sc_adb_push(intr, serial, req.file, push_target, &progress,
+                             0);
             if (ok) {
-                LOGI("%s successfully pushed to %s", req.file, push_target);
+                LOGI("%s successfully pushed to %s in %" PRItick " ms",
+                     req.file, push_target,
+                     SC_TICK_TO_MS(sc_tick_now() - start));
             } else {
                 LOGE("Failed to push %s to %s", req.file, push_target);
             }
         }
 
+        sc_mutex_lock(&fp->mutex);
+        unsigned completed = ++fp->completed;
+        unsigned requested = fp->requested;
+        if (completed == requested) {
+            // The batch is complete
+            fp->completed = 0;
+            fp->requested = 0;
+        }
+        sc_mutex_unlock(&fp->mutex);
+
+        if (requested > 1) {
+            LOGI("File transfers: %u/%u completed", completed, requested);
+        }
+
         sc_file_pusher_request_destroy(&req);
     }
     return 0;
@@ -159,15 +231,21 @@ run_file_pusher(void *data) {
 
 bool
 sc_file_pusher_start(struct sc_file_pusher *fp) {
-    LOGD("Starting file_pusher thread");
-
-    bool ok = sc_thread_create(&fp->thread, run_file_pusher, "scrcpy-file", fp);
-    if (!ok) {
-        LOGE("Could not start file_pusher thread");
-        return false;
+    LOGD("Starting file_pusher threads");
+
+    for (unsigned i = 0; i < fp->worker_count; ++i) {
+        struct sc_file_pusher_worker *worker = &fp->workers[i];
+        bool ok = sc_thread_create(&worker->thread, run_file_pusher_worker,
+                                   "scrcpy-file", worker);
+        if (!ok) {
+            LOGE("Could not start file_pusher thread");
+            break;
+        }
+        ++fp->workers_started;
     }
 
-    return true;
+    // The workers already started are stopped and joined as usual
+    return fp->workers_started > 0;
 }
 
 void
@@ -175,8 +253,10 @@ sc_file_pusher_stop(struct sc_file_pusher *fp) {
     if (fp->initialized) {
         sc_mutex_lock(&fp->mutex);
         fp->stopped = true;
-        sc_cond_signal(&fp->event_cond);
-        sc_intr_interrupt(&fp->intr);
+        sc_cond_broadcast(&fp->event_cond);
+        for (unsigned i = 0; i < fp->workers_started; ++i) {
+            sc_intr_interrupt(&fp->workers[i].intr);
+        }
         sc_mutex_unlock(&fp->mutex);
     }
 }
@@ -184,6 +264,8 @@ sc_file_pusher_stop(struct sc_file_pusher *fp) {
 void
 sc_file_pusher_join(struct sc_file_pusher *fp) {
     if (fp->initialized) {
-        sc_thread_join(&fp->thread, NULL);
+        for (unsigned i = 0; i < fp->workers_started; ++i) {
+            sc_thread_join(&fp->workers[i].thread, NULL);
+        }
     }
 }
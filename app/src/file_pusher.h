@@ -21,22 +21,45 @@ struct sc_file_pusher_request {
 
 struct sc_file_pusher_request_queue SC_VECDEQUE(struct sc_file_pusher_request);
 
+// Maximum number of concurrent transfers
+#define SC_FILE_PUSHER_MAX_WORKERS 8
+
+struct sc_file_pusher;
+
+struct sc_file_pusher_worker {
+    struct sc_file_pusher *fp;
+    sc_thread thread;
+    // Each worker interrupts its own adb process or socket
+    struct sc_intr intr;
+};
+
+/**
+ * Push or install the files requested (dropped on the window), by several
+ * workers concurrently, so that a small file is not delayed by a large one
+ */
 struct sc_file_pusher {
     char *serial;
     const char *push_target;
-    sc_thread thread;
     sc_mutex mutex;
     sc_cond event_cond;
     bool stopped;
     bool initialized;
     struct sc_file_pusher_request_queue queue;
 
-    struct sc_intr intr;
+    unsigned worker_count;
+    unsigned workers_started;
+    struct sc_file_pusher_worker workers[SC_FILE_PUSHER_MAX_WORKERS];
+
+    // Number of requests received and completed, to report the progress of a
+    // batch (reset once all the requests are completed)
+    unsigned requested;
+    unsigned completed;
 };
 
+// The number of workers must be in [1, SC_FILE_PUSHER_MAX_WORKERS]
 bool
 sc_file_pusher_init(struct sc_file_pusher *fp, const char *serial,
-                    const char *push_target);
+                    const char *push_target, unsigned workers);
 
 void
 sc_file_pusher_destroy(struct sc_file_pusher *fp);
@@ -47,6 +47,20 @@ static void
 display_fps(struct sc_fps_counter *counter) {
     unsigned rendered_per_second =
         counter->nr_rendered * SC_TICK_FREQ / SC_FPS_COUNTER_INTERVAL;
+
+    if (counter->nr_decoded) {
+        // average decoding latency
+        double latency_ms = (double) counter->decode_latency_sum * 1000
+                          / SC_TICK_FREQ / counter->nr_decoded;
+        if (counter->nr_skipped) {
+            LOGI("%u fps (+%u frames skipped), decoding %.1f ms",
+                 rendered_per_second, counter->nr_skipped, latency_ms);
+        } else {
+            LOGI("%u fps, decoding %.1f ms", rendered_per_second, latency_ms);
+        }
+        return;
+    }
+
     if (counter->nr_skipped) {
         LOGI("%u fps (+%u frames skipped)", rendered_per_second,
                                             counter->nr_skipped);
@@ -65,6 +79,8 @@ check_interval_expired(struct sc_fps_counter *counter, sc_tick now) {
     display_fps(counter);
     counter->nr_rendered = 0;
     counter->nr_skipped = 0;
+    counter->nr_decoded = 0;
+    counter->decode_latency_sum = 0;
     // add a multiple of the interval
     uint32_t elapsed_slices =
         (now - counter->next_timestamp) / SC_FPS_COUNTER_INTERVAL + 1;
@@ -100,6 +116,8 @@ sc_fps_counter_start(struct sc_fps_counter *counter) {
     counter->next_timestamp = sc_tick_now() + SC_FPS_COUNTER_INTERVAL;
     counter->nr_rendered = 0;
     counter->nr_skipped = 0;
+    counter->nr_decoded = 0;
+    counter->decode_latency_sum = 0;
     sc_mutex_unlock(&counter->mutex);
 
     set_started(counter, true);
@@ -183,3 +201,18 @@ sc_fps_counter_add_skipped_frame(struct sc_fps_counter *counter) {
     ++counter->nr_skipped;
     sc_mutex_unlock(&counter->mutex);
 }
+
+void
+sc_fps_counter_add_decode_latency(struct sc_fps_counter *counter,
+                                  sc_tick latency) {
+    if (!is_started(counter)) {
+        return;
+    }
+
+    sc_mutex_lock(&counter->mutex);
+    sc_tick now = sc_tick_now();
+    check_interval_expired(counter, now);
+    ++counter->nr_decoded;
+    counter->decode_latency_sum += latency;
+    sc_mutex_unlock(&counter->mutex);
+}
@@ -24,6 +24,8 @@ struct sc_fps_counter {
     bool interrupted;
     unsigned nr_rendered;
     unsigned nr_skipped;
+    unsigned nr_decoded; // frames with a known decoding latency
+    sc_tick decode_latency_sum;
     sc_tick next_timestamp;
 };
 
@@ -56,4 +58,9 @@ sc_fps_counter_add_rendered_frame(struct sc_fps_counter *counter);
 void
 sc_fps_counter_add_skipped_frame(struct sc_fps_counter *counter);
 
+// report the decoding latency of a frame (displayed as an average)
+void
+sc_fps_counter_add_decode_latency(struct sc_fps_counter *counter,
+                                  sc_tick latency);
+
 #endif
@@ -0,0 +1,616 @@
+#include "frame_archive.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame_header.h"
+#include "util/file.h"
+#include "util/log.h"
+
+bool
+sc_frame_archive_open(struct sc_frame_archive *archive, const char *path,
+                      bool direct, sc_tick expected_duration) {
+    bool ok = sc_mutex_init(&archive->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    archive->file = fopen(path, "wb");
+    if (!archive->file) {
+        LOGE("Could not open frame archive: %s", path);
+        sc_mutex_destroy(&archive->mutex);
+        return false;
+    }
+
+    archive->fd = fileno(archive->file);
+    archive->direct = false;
+    if (direct) {
+        // The index is still written via the stream, on close
+        int fd = sc_file_open_direct(path);
+        if (fd != -1) {
+            archive->fd = fd;
+            archive->direct = true;
+        } else {
+            LOGW("Frame archive written through the page cache");
+        }
+    }
+
+    archive->prealloc = archive->direct;
+    archive->allocated = 0;
+    archive->expected_duration = expected_duration;
+    archive->start = 0;
+
+    archive->offset = 0;
+    archive->failed = false;
+    archive->reserved = false;
+    archive->dropped = 0;
+    archive->repeated = 0;
+    archive->gaps = 0;
+    sc_vector_init(&archive->index);
+    sc_vector_init(&archive->poses);
+    sc_vector_init(&archive->timestamps);
+    sc_vector_init(&archive->deltas);
+    archive->zstd = false;
+    archive->zstd_dictionary = NULL;
+    archive->zstd_dictionary_size = 0;
+
+    return true;
+}
+
+void
+sc_frame_archive_set_zstd(struct sc_frame_archive *archive,
+                          const void *dictionary, size_t size) {
+    assert(!archive->index.size);
+    assert(dictionary || !size);
+    archive->zstd = true;
+    archive->zstd_dictionary = dictionary;
+    archive->zstd_dictionary_size = size;
+}
+
+static bool
+sc_frame_archive_write_zstd(struct sc_frame_archive *archive) {
+    size_t size = archive->zstd_dictionary_size;
+    if (size && fwrite(archive->zstd_dictionary, size, 1,
+                       archive->file) != 1) {
+        return false;
+    }
+
+    struct sc_frame_archive_zstd_footer footer = {
+        .dictionary_size = size,
+        .dictionary_offset = archive->offset,
+    };
+    memcpy(footer.magic, SC_FRAME_ARCHIVE_ZSTD_MAGIC, sizeof(footer.magic));
+
+    if (fwrite(&footer, sizeof(footer), 1, archive->file) != 1) {
+        return false;
+    }
+
+    archive->offset += size + sizeof(footer);
+    return true;
+}
+
+// Position of an index entry or of a delta entry, sorted by frame number
+struct sc_frame_archive_ref {
+    uint64_t frame_number;
+    size_t pos;
+};
+
+static int
+sc_frame_archive_ref_cmp(const void *a, const void *b) {
+    const struct sc_frame_archive_ref *ra = a;
+    const struct sc_frame_archive_ref *rb = b;
+    return ra->frame_number < rb->frame_number ? -1
+         : ra->frame_number > rb->frame_number;
+}
+
+static const struct sc_frame_archive_ref *
+sc_frame_archive_ref_find(const struct sc_frame_archive_ref *refs, size_t count,
+                          uint64_t frame_number) {
+    struct sc_frame_archive_ref key = {.frame_number = frame_number};
+    return bsearch(&key, refs, count, sizeof(*refs), sc_frame_archive_ref_cmp);
+}
+
+// Mark as dropped the delta frames whose base (or a base of their base) was
+// not saved: a save may fail after a next frame of the chain, encoded against
+// it, was written by another thread
+static void
+sc_frame_archive_check_deltas(struct sc_frame_archive *archive) {
+    size_t index_count = archive->index.size;
+    size_t delta_count = archive->deltas.size;
+
+    struct sc_frame_archive_ref *saved =
+        malloc(index_count * sizeof(*saved));
+    struct sc_frame_archive_ref *deltas =
+        malloc(delta_count * sizeof(*deltas));
+    bool *valid = malloc(delta_count * sizeof(*valid));
+    if (!saved || !deltas || !valid) {
+        LOG_OOM();
+        goto end;
+    }
+
+    size_t saved_count = 0;
+    for (size_t i = 0; i < index_count; ++i) {
+        const struct sc_frame_archive_entry *entry = &archive->index.data[i];
+        if (entry->offset < SC_FRAME_ARCHIVE_GAP) {
+            saved[saved_count++] = (struct sc_frame_archive_ref) {
+                .frame_number = entry->frame_number,
+                .pos = i,
+            };
+        }
+    }
+    for (size_t i = 0; i < delta_count; ++i) {
+        deltas[i] = (struct sc_frame_archive_ref) {
+            .frame_number = archive->deltas.data[i].frame_number,
+            .pos = i,
+        };
+    }
+    qsort(saved, saved_count, sizeof(*saved), sc_frame_archive_ref_cmp);
+    qsort(deltas, delta_count, sizeof(*deltas), sc_frame_archive_ref_cmp);
+
+    // The bases precede the frames, they are checked first
+    size_t invalid_count = 0;
+    for (size_t i = 0; i < delta_count; ++i) {
+        size_t pos = deltas[i].pos;
+        uint64_t base = archive->deltas.data[pos].base_frame_number;
+        const struct sc_frame_archive_ref *ref =
+            sc_frame_archive_ref_find(deltas, i, base);
+        valid[pos] = ref ? valid[ref->pos]
+                         : !!sc_frame_archive_ref_find(saved, saved_count,
+                                                       base);
+        if (!valid[pos]) {
+            ref = sc_frame_archive_ref_find(saved, saved_count,
+                                            deltas[i].frame_number);
+            if (ref) {
+                archive->index.data[ref->pos].offset =
+                    SC_FRAME_ARCHIVE_DROPPED;
+                ++archive->dropped;
+            }
+            ++invalid_count;
+        }
+    }
+
+    if (invalid_count) {
+        LOGW("%" PRIu64 " delta frames depend on a frame which could not be "
+             "saved, marked as dropped", (uint64_t) invalid_count);
+
+        // Keep the order of the valid entries
+        size_t count = 0;
+        for (size_t i = 0; i < delta_count; ++i) {
+            if (valid[i]) {
+                archive->deltas.data[count++] = archive->deltas.data[i];
+            }
+        }
+        archive->deltas.size = count;
+    }
+
+end:
+    free(saved);
+    free(deltas);
+    free(valid);
+}
+
+static bool
+sc_frame_archive_write_deltas(struct sc_frame_archive *archive) {
+    size_t count = archive->deltas.size;
+    if (fwrite(archive->deltas.data, sizeof(*archive->deltas.data), count,
+               archive->file) != count) {
+        return false;
+    }
+
+    struct sc_frame_archive_delta_footer footer = {
+        .delta_count = count,
+        .deltas_offset = archive->offset,
+    };
+    memcpy(footer.magic, SC_FRAME_ARCHIVE_DELTA_MAGIC, sizeof(footer.magic));
+
+    if (fwrite(&footer, sizeof(footer), 1, archive->file) != 1) {
+        return false;
+    }
+
+    archive->offset += count * sizeof(*archive->deltas.data) + sizeof(footer);
+    return true;
+}
+
+static bool
+sc_frame_archive_write_poses(struct sc_frame_archive *archive) {
+    size_t count = archive->poses.size;
+    if (fwrite(archive->poses.data, sizeof(*archive->poses.data), count,
+               archive->file) != count) {
+        return false;
+    }
+
+    struct sc_frame_archive_pose_footer footer = {
+        .sample_count = count,
+        .samples_offset = archive->offset,
+    };
+    memcpy(footer.magic, SC_FRAME_ARCHIVE_POSE_MAGIC, sizeof(footer.magic));
+
+    if (fwrite(&footer, sizeof(footer), 1, archive->file) != 1) {
+        return false;
+    }
+
+    archive->offset += count * sizeof(*archive->poses.data) + sizeof(footer);
+    return true;
+}
+
+static bool
+sc_frame_archive_write_timestamps(struct sc_frame_archive *archive) {
+    size_t count = archive->timestamps.size;
+    if (fwrite(archive->timestamps.data, sizeof(*archive->timestamps.data),
+               count, archive->file) != count) {
+        return false;
+    }
+
+    struct sc_frame_archive_timestamp_footer footer = {
+        .record_count = count,
+        .records_offset = archive->offset,
+    };
+    memcpy(footer.magic, SC_FRAME_ARCHIVE_TIMESTAMP_MAGIC,
+           sizeof(footer.magic));
+
+    if (fwrite(&footer, sizeof(footer), 1, archive->file) != 1) {
+        return false;
+    }
+
+    archive->offset += count * sizeof(*archive->timestamps.data)
+                     + sizeof(footer);
+    return true;
+}
+
+static bool
+sc_frame_archive_write_index(struct sc_frame_archive *archive) {
+    // The reserved records are written directly to the file descriptor, the
+    // stream position does not follow them
+    if (archive->reserved
+            && fseeko(archive->file, archive->offset, SEEK_SET)) {
+        return false;
+    }
+
+    if (archive->deltas.size) {
+        sc_frame_archive_check_deltas(archive);
+    }
+
+    if (archive->deltas.size && !sc_frame_archive_write_deltas(archive)) {
+        return false;
+    }
+
+    if (archive->zstd && !sc_frame_archive_write_zstd(archive)) {
+        return false;
+    }
+
+    if (archive->timestamps.size
+            && !sc_frame_archive_write_timestamps(archive)) {
+        return false;
+    }
+
+    if (archive->poses.size && !sc_frame_archive_write_poses(archive)) {
+        return false;
+    }
+
+    size_t count = archive->index.size;
+    if (count && fwrite(archive->index.data, sizeof(*archive->index.data),
+                        count, archive->file) != count) {
+        return false;
+    }
+
+    struct sc_frame_archive_footer footer = {
+        .entry_count = count,
+        .index_offset = archive->offset,
+    };
+    memcpy(footer.magic, SC_FRAME_ARCHIVE_INDEX_MAGIC, sizeof(footer.magic));
+
+    if (fwrite(&footer, sizeof(footer), 1, archive->file) != 1) {
+        return false;
+    }
+
+    archive->offset += count * sizeof(*archive->index.data) + sizeof(footer);
+    return true;
+}
+
+void
+sc_frame_archive_close(struct sc_frame_archive *archive) {
+    if (archive->direct) {
+        // All the records have been written
+        sc_file_close(archive->fd);
+    }
+
+    bool ok = !archive->failed && sc_frame_archive_write_index(archive);
+
+    if (archive->allocated) {
+        // Release the disk space preallocated beyond the end (on Windows, the
+        // file may even have been extended)
+        if (fflush(archive->file)
+                || !sc_file_truncate(fileno(archive->file), archive->offset)) {
+            ok = false;
+        }
+    }
+
+    if (fclose(archive->file)) {
+        ok = false;
+    }
+
+    if (!ok) {
+        LOGE("Could not write frame archive index");
+    } else {
+        LOGI("Frame archive closed (%" PRIu64 " frames, %" PRIu64 " dropped, "
+             "%" PRIu64 " repeated, %" PRIu64 " gaps, %" PRIu64 " pose "
+             "samples, %" PRIu64 " filtered timestamps, %" PRIu64 " tile "
+             "deltas)",
+             (uint64_t) archive->index.size - archive->dropped
+                - archive->repeated - archive->gaps,
+             archive->dropped, archive->repeated, archive->gaps,
+             (uint64_t) archive->poses.size,
+             (uint64_t) archive->timestamps.size,
+             (uint64_t) archive->deltas.size);
+    }
+
+    sc_vector_destroy(&archive->index);
+    sc_vector_destroy(&archive->poses);
+    sc_vector_destroy(&archive->timestamps);
+    sc_vector_destroy(&archive->deltas);
+    sc_mutex_destroy(&archive->mutex);
+}
+
+bool
+sc_frame_archive_write_chunks(FILE *file,
+                              const struct sc_frame_archive_chunk *chunks,
+                              unsigned chunk_count) {
+    for (unsigned i = 0; i < chunk_count; ++i) {
+        const struct sc_frame_archive_chunk *chunk = &chunks[i];
+        for (int row = 0; row < chunk->rows; ++row) {
+            const uint8_t *data = chunk->data + (size_t) row * chunk->linesize;
+            if (fwrite(data, chunk->row_size, 1, file) != 1) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool
+sc_frame_archive_init_header(struct frame_header *header,
+                             int64_t timestamp_ms, int width, int height,
+                             const struct sc_frame_archive_chunk *chunks,
+                             unsigned chunk_count) {
+    uint64_t payload_size = 0;
+    for (unsigned i = 0; i < chunk_count; ++i) {
+        payload_size += (uint64_t) chunks[i].row_size * chunks[i].rows;
+    }
+
+    if (payload_size > UINT32_MAX) {
+        LOGE("Frame too large for the archive");
+        return false;
+    }
+
+    *header = (struct frame_header) {
+        .timestamp_ms = timestamp_ms,
+        .width = width,
+        .height = height,
+        .frame_size = payload_size,
+    };
+    memcpy(header->delimiter, FRAME_DELIMITER, sizeof(FRAME_DELIMITER));
+    header->checksum = calculate_header_checksum(header);
+    return true;
+}
+
+bool
+sc_frame_archive_append(struct sc_frame_archive *archive,
+                        uint64_t frame_number, int64_t timestamp_ms,
+                        int width, int height,
+                        const struct sc_frame_archive_chunk *chunks,
+                        unsigned chunk_count) {
+    struct frame_header header;
+    if (!sc_frame_archive_init_header(&header, timestamp_ms, width, height,
+                                      chunks, chunk_count)) {
+        return false;
+    }
+    uint64_t payload_size = header.frame_size;
+
+    // The records of a direct archive must be aligned
+    assert(!archive->direct);
+
+    sc_mutex_lock(&archive->mutex);
+
+    if (archive->failed) {
+        sc_mutex_unlock(&archive->mutex);
+        return false;
+    }
+
+    struct sc_frame_archive_entry entry = {
+        .frame_number = frame_number,
+        .timestamp_ms = timestamp_ms,
+        .offset = archive->offset,
+    };
+
+    bool ok = sc_vector_push(&archive->index, entry);
+    if (!ok) {
+        LOG_OOM();
+        sc_mutex_unlock(&archive->mutex);
+        return false;
+    }
+
+    ok = fwrite(&header, sizeof(header), 1, archive->file) == 1
+      && sc_frame_archive_write_chunks(archive->file, chunks, chunk_count);
+    if (!ok) {
+        // The file content is now inconsistent with the offset
+        LOGE("Could not write to frame archive, stopping");
+        archive->failed = true;
+        sc_mutex_unlock(&archive->mutex);
+        return false;
+    }
+
+    archive->offset += sizeof(header) + payload_size;
+
+    sc_mutex_unlock(&archive->mutex);
+
+    return true;
+}
+
+// Reserve the disk space up to at least `end`, ahead of the records
+static void
+sc_frame_archive_preallocate(struct sc_frame_archive *archive, uint64_t end) {
+    sc_tick now = sc_tick_now();
+    if (!archive->start) {
+        archive->start = now;
+    }
+
+    if (!archive->prealloc || end <= archive->allocated) {
+        return;
+    }
+
+    uint64_t size = end + SC_FRAME_ARCHIVE_PREALLOC_MIN;
+
+    sc_tick elapsed = now - archive->start;
+    if (elapsed >= SC_TICK_FROM_SEC(1)) {
+        // Data rate so far, in bytes per second
+        uint64_t rate = archive->offset * 1000 / SC_TICK_TO_MS(elapsed);
+        sc_tick remaining = archive->expected_duration - elapsed;
+        if (remaining < SC_FRAME_ARCHIVE_PREALLOC_AHEAD) {
+            remaining = SC_FRAME_ARCHIVE_PREALLOC_AHEAD;
+        }
+        uint64_t ahead = rate * SC_TICK_TO_SEC(remaining);
+        if (end + ahead > size) {
+            size = end + ahead;
+        }
+    }
+
+    // Typically a metadata update, even for gigabytes (the extents are
+    // allocated but not written)
+    if (!sc_file_preallocate(archive->fd, size)) {
+        LOGW("Frame archive: disk space preallocation not supported");
+        archive->prealloc = false;
+        return;
+    }
+
+    // On Windows, avoid the zero-filling of the gaps between the records
+    // written out of order by the I/O threads (if the privilege is held)
+    sc_file_extend_uninitialized(archive->fd, size);
+
+    LOGD("Frame archive: %" PRIu64 " MiB preallocated", size >> 20);
+    archive->allocated = size;
+}
+
+bool
+sc_frame_archive_reserve(struct sc_frame_archive *archive,
+                         uint64_t frame_number, int64_t timestamp_ms,
+                         uint64_t size, uint64_t *offset) {
+    assert(!archive->direct || !(size % SC_FILE_DIRECT_ALIGNMENT));
+
+    sc_mutex_lock(&archive->mutex);
+
+    if (archive->failed) {
+        sc_mutex_unlock(&archive->mutex);
+        return false;
+    }
+
+    struct sc_frame_archive_entry entry = {
+        .frame_number = frame_number,
+        .timestamp_ms = timestamp_ms,
+        .offset = archive->offset,
+    };
+
+    bool ok = sc_vector_push(&archive->index, entry);
+    if (!ok) {
+        LOG_OOM();
+        sc_mutex_unlock(&archive->mutex);
+        return false;
+    }
+
+    sc_frame_archive_preallocate(archive, archive->offset + size);
+
+    *offset = archive->offset;
+    archive->offset += size;
+    archive->reserved = true;
+
+    sc_mutex_unlock(&archive->mutex);
+
+    return true;
+}
+
+void
+sc_frame_archive_fail(struct sc_frame_archive *archive) {
+    sc_mutex_lock(&archive->mutex);
+    if (!archive->failed) {
+        LOGE("Could not write to frame archive, stopping");
+        archive->failed = true;
+    }
+    sc_mutex_unlock(&archive->mutex);
+}
+
+// Append an index entry without data, and count it
+static void
+sc_frame_archive_add_entry(struct sc_frame_archive *archive,
+                           uint64_t frame_number, int64_t timestamp_ms,
+                           uint64_t offset, uint64_t *count) {
+    struct sc_frame_archive_entry entry = {
+        .frame_number = frame_number,
+        .timestamp_ms = timestamp_ms,
+        .offset = offset,
+    };
+
+    sc_mutex_lock(&archive->mutex);
+    if (!archive->failed) {
+        if (sc_vector_push(&archive->index, entry)) {
+            ++*count;
+        } else {
+            LOG_OOM();
+        }
+    }
+    sc_mutex_unlock(&archive->mutex);
+}
+
+void
+sc_frame_archive_add_dropped(struct sc_frame_archive *archive,
+                             uint64_t frame_number, int64_t timestamp_ms) {
+    sc_frame_archive_add_entry(archive, frame_number, timestamp_ms,
+                               SC_FRAME_ARCHIVE_DROPPED, &archive->dropped);
+}
+
+void
+sc_frame_archive_add_repeated(struct sc_frame_archive *archive,
+                              uint64_t frame_number, int64_t timestamp_ms) {
+    sc_frame_archive_add_entry(archive, frame_number, timestamp_ms,
+                               SC_FRAME_ARCHIVE_REPEATED, &archive->repeated);
+}
+
+void
+sc_frame_archive_add_gap(struct sc_frame_archive *archive,
+                         uint64_t frame_number, int64_t duration_ms) {
+    sc_frame_archive_add_entry(archive, frame_number, duration_ms,
+                               SC_FRAME_ARCHIVE_GAP, &archive->gaps);
+}
+
+void
+sc_frame_archive_add_poses(struct sc_frame_archive *archive,
+                           const struct pose_sample_record *samples,
+                           unsigned count) {
+    sc_mutex_lock(&archive->mutex);
+    if (!archive->failed && !sc_vector_push_all(&archive->poses, samples,
+                                                count)) {
+        LOG_OOM();
+    }
+    sc_mutex_unlock(&archive->mutex);
+}
+
+void
+sc_frame_archive_add_timestamp(struct sc_frame_archive *archive,
+                               const struct sc_frame_archive_timestamp *ts) {
+    sc_mutex_lock(&archive->mutex);
+    if (!archive->failed && !sc_vector_push(&archive->timestamps, *ts)) {
+        LOG_OOM();
+    }
+    sc_mutex_unlock(&archive->mutex);
+}
+
+void
+sc_frame_archive_add_delta(struct sc_frame_archive *archive,
+                           const struct sc_frame_archive_delta *delta) {
+    sc_mutex_lock(&archive->mutex);
+    if (!archive->failed && !sc_vector_push(&archive->deltas, *delta)) {
+        LOG_OOM();
+    }
+    sc_mutex_unlock(&archive->mutex);
+}
@@ -0,0 +1,350 @@
+#ifndef SC_FRAME_ARCHIVE_H
+#define SC_FRAME_ARCHIVE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "frame_header.h"
+#include "util/thread.h"
+#include "util/tick.h"
+#include "util/vector.h"
+
+/**
+ * Append-only archive of saved frames, in a single file
+ *
+ * The file is a sequence of frames, each one made of a `struct frame_header`
+ * (see frame_header.h) followed by `frame_size` bytes of image data, in the
+ * format selected by --save-frames-format.
+ *
+ * On close, an index of all the frames is appended, followed by a footer:
+ *
+ *     [frame header][image data] ... [index entries][footer]
+ *
+ * The footer is at the end of the file, so the index can be found without
+ * scanning the frames. If the capture is interrupted before the index is
+ * written, the frames can still be recovered by scanning for the headers.
+ *
+ * If headset pose samples are recorded (--pose-rate), they are kept in memory
+ * and written on close before the index, followed by their own footer:
+ *
+ *     ... [pose samples][pose footer][index entries][footer]
+ *
+ * so that the pose footer, if any, immediately precedes the first index entry
+ * (the readers unaware of the pose samples are not affected). The samples are
+ * `struct pose_sample_record` (see frame_header.h), in the order received.
+ *
+ * Likewise, the raw and filtered capture timestamps of the saved frames (see
+ * timestamp_filter.h) are written before the pose samples, followed by their
+ * own footer:
+ *
+ *     ... [timestamps][timestamps footer][pose samples][pose footer]...
+ *
+ * The records are `struct sc_frame_archive_timestamp`, in the order of the
+ * frames.
+ *
+ * If the frames are compressed (--save-frames-zstd), the image data of each
+ * record is a single zstd frame (with its content size and checksum), which
+ * decompresses to the image data in the --save-frames-format format. The
+ * header keeps the width and height of the image, but its frame_size is the
+ * compressed size. Each frame is compressed independently, so that the frames
+ * can still be read in any order (and in parallel) from the offsets of the
+ * index. This is marked by a last section, written before the timestamps, made
+ * of the dictionary the frames are compressed with (possibly empty) and its
+ * footer:
+ *
+ *     ... [dictionary][zstd footer][timestamps][timestamps footer]...
+ *
+ * If the frames are stored as tile deltas (--save-frames-tile-delta, see
+ * tile_delta.h), the records of the delta frames hold only the 64x64 tiles
+ * which changed since the previous frame stored (its base): their image data
+ * (decompressed, with zstd) is a `struct sc_frame_archive_tiles_header`,
+ * followed by the `tile_count` indices of the tiles (uint32, in increasing
+ * order, the tiles being numbered row by row), then the pixels of each tile:
+ * its rows of the Y plane, then its rows of the U and V planes (32x32), all
+ * clipped to the edges of the planes. The other records (the key frames) are
+ * stored in full. The delta frames are listed in a section written first:
+ *
+ *     ... [deltas][deltas footer][dictionary][zstd footer]...
+ *
+ * The entries are `struct sc_frame_archive_delta`, in the order the records
+ * were written, so that a reader finds the chain of any frame from its key
+ * frame without reading the records of the other frames. On close, the delta
+ * frames whose chain is broken (a base could not be saved) are marked as
+ * dropped in the index, and are not listed.
+ *
+ * The index entries and the footers are written in host byte order.
+ *
+ * In direct mode (see sc_frame_archive_open()), each frame record is padded
+ * with zeros to a multiple of SC_FILE_DIRECT_ALIGNMENT bytes, so that the
+ * records start at aligned offsets. The readers must use the offsets of the
+ * index (a recovery scan skips the padding while searching for the next
+ * header).
+ */
+
+#define SC_FRAME_ARCHIVE_INDEX_MAGIC "SCFAIDX\0"
+#define SC_FRAME_ARCHIVE_POSE_MAGIC "SCFAPOS\0"
+#define SC_FRAME_ARCHIVE_TIMESTAMP_MAGIC "SCFATSF\0"
+#define SC_FRAME_ARCHIVE_ZSTD_MAGIC "SCFAZST\0"
+#define SC_FRAME_ARCHIVE_DELTA_MAGIC "SCFADLT\0"
+// Start of the image data of the delta frames
+#define SC_FRAME_ARCHIVE_TILES_MAGIC "SCFATIL\0"
+
+// In direct mode, minimum disk space preallocated ahead of the records
+#define SC_FRAME_ARCHIVE_PREALLOC_MIN (256 << 20) // 256 MiB
+// In direct mode, once the data rate is known, duration of capture
+// preallocated ahead of the records when the expected duration is unknown or
+// exceeded
+#define SC_FRAME_ARCHIVE_PREALLOC_AHEAD SC_TICK_FROM_SEC(60)
+
+// Offset of the index entries of the dropped frames, which have no data
+#define SC_FRAME_ARCHIVE_DROPPED UINT64_MAX
+// Offset of the index entries of the frames repeated by the device (the
+// captured content did not change), not saved (--skip-repeated-frames), or
+// too close to the previous saved frame (--motion-threshold): the image is
+// (almost) the one of the previous saved frame
+#define SC_FRAME_ARCHIVE_REPEATED (UINT64_MAX - 1)
+// Offset of the index entries of the interruptions of the stream (the video
+// connection was lost, then resumed on a key frame, see --reconnect-timeout):
+// the frame number is the one of the first frame received after the gap, and
+// the timestamp is replaced by the duration of the interruption (in ms)
+#define SC_FRAME_ARCHIVE_GAP (UINT64_MAX - 2)
+
+#pragma pack(push, 1)
+struct sc_frame_archive_entry {
+    uint64_t frame_number;
+    int64_t timestamp_ms; // device timestamp, -1 if unknown
+    // offset of the frame header in the file, SC_FRAME_ARCHIVE_DROPPED if the
+    // frame was dropped before being saved, SC_FRAME_ARCHIVE_REPEATED if it
+    // was a repetition of the previous frame, SC_FRAME_ARCHIVE_GAP for an
+    // interruption of the stream (not a frame)
+    uint64_t offset;
+};
+
+struct sc_frame_archive_footer {
+    uint8_t magic[8]; // SC_FRAME_ARCHIVE_INDEX_MAGIC
+    uint64_t entry_count;
+    uint64_t index_offset; // offset of the first index entry in the file
+};
+
+struct sc_frame_archive_pose_footer {
+    uint8_t magic[8]; // SC_FRAME_ARCHIVE_POSE_MAGIC
+    uint64_t sample_count;
+    uint64_t samples_offset; // offset of the first pose sample in the file
+};
+
+struct sc_frame_archive_timestamp {
+    uint64_t frame_number;
+    int64_t raw_timestamp_us; // capture time derived from the PTS
+    int64_t filtered_timestamp_us;
+    uint32_t flags; // FRAME_FLAG_TIMESTAMP_OUTLIER
+};
+
+struct sc_frame_archive_timestamp_footer {
+    uint8_t magic[8]; // SC_FRAME_ARCHIVE_TIMESTAMP_MAGIC
+    uint64_t record_count;
+    uint64_t records_offset; // offset of the first record in the file
+};
+
+struct sc_frame_archive_zstd_footer {
+    uint8_t magic[8]; // SC_FRAME_ARCHIVE_ZSTD_MAGIC
+    uint64_t dictionary_size; // 0 without dictionary
+    uint64_t dictionary_offset; // offset of the dictionary in the file
+};
+
+struct sc_frame_archive_tiles_header {
+    uint8_t magic[8]; // SC_FRAME_ARCHIVE_TILES_MAGIC
+    uint64_t base_frame_number; // frame the tiles are applied to
+    uint64_t key_frame_number; // first frame of the chain, stored in full
+    uint32_t tile_size; // of the Y plane, in pixels
+    uint32_t tile_count;
+};
+
+struct sc_frame_archive_delta {
+    uint64_t frame_number;
+    uint64_t base_frame_number;
+    uint64_t key_frame_number;
+};
+
+struct sc_frame_archive_delta_footer {
+    uint8_t magic[8]; // SC_FRAME_ARCHIVE_DELTA_MAGIC
+    uint64_t delta_count;
+    uint64_t deltas_offset; // offset of the first entry in the file
+};
+#pragma pack(pop)
+
+struct sc_frame_archive_index SC_VECTOR(struct sc_frame_archive_entry);
+struct sc_frame_archive_poses SC_VECTOR(struct pose_sample_record);
+struct sc_frame_archive_timestamps SC_VECTOR(struct sc_frame_archive_timestamp);
+struct sc_frame_archive_deltas SC_VECTOR(struct sc_frame_archive_delta);
+
+// A contiguous part of a frame payload, made of `rows` rows of `row_size`
+// bytes, separated by `linesize` bytes
+struct sc_frame_archive_chunk {
+    const uint8_t *data;
+    int linesize;
+    int row_size;
+    int rows;
+};
+
+/**
+ * The archive may be appended to from several threads.
+ */
+struct sc_frame_archive {
+    FILE *file;
+    // File descriptor to write the reserved records to: fileno(file), or a
+    // descriptor bypassing the page cache in direct mode
+    int fd;
+    bool direct;
+    uint64_t offset; // current end of the file
+    bool failed; // a write failed, the archive is not appended anymore
+    bool reserved; // records were reserved (sc_frame_archive_reserve())
+
+    // Disk space preallocation (direct mode)
+    bool prealloc;
+    uint64_t allocated; // size of the disk space preallocated so far
+    sc_tick expected_duration; // 0 if unknown
+    sc_tick start; // time of the first record reserved
+
+    sc_mutex mutex;
+    struct sc_frame_archive_index index;
+    uint64_t dropped; // number of entries of dropped frames
+    uint64_t repeated; // number of entries of repeated frames
+    uint64_t gaps; // number of entries of interruptions
+    struct sc_frame_archive_poses poses;
+    struct sc_frame_archive_timestamps timestamps;
+    struct sc_frame_archive_deltas deltas;
+
+    // The frames are compressed with zstd (see sc_frame_archive_set_zstd())
+    bool zstd;
+    const void *zstd_dictionary;
+    size_t zstd_dictionary_size;
+};
+
+// Write the chunks consecutively to a file (not necessarily an archive)
+bool
+sc_frame_archive_write_chunks(FILE *file,
+                              const struct sc_frame_archive_chunk *chunks,
+                              unsigned chunk_count);
+
+/**
+ * Open the archive file
+ *
+ * In direct mode, the records are written bypassing the page cache (see
+ * sc_file_open_direct()): they must be reserved (sc_frame_archive_reserve()),
+ * padded to a multiple of SC_FILE_DIRECT_ALIGNMENT and written from aligned
+ * buffers (sc_frame_archive_append() is not supported). The disk space is
+ * preallocated ahead of the records, for the rest of the `expected_duration`
+ * of the capture (0 if unknown) at the data rate measured over the first
+ * second, and released on close if unused.
+ *
+ * If the file system does not support direct I/O, the archive is opened in
+ * normal mode (check `archive->direct`).
+ */
+bool
+sc_frame_archive_open(struct sc_frame_archive *archive, const char *path,
+                      bool direct, sc_tick expected_duration);
+
+/**
+ * Mark the frames as compressed with zstd, with a dictionary (NULL if none)
+ *
+ * The dictionary is written on close, it must remain valid until then.
+ */
+void
+sc_frame_archive_set_zstd(struct sc_frame_archive *archive,
+                          const void *dictionary, size_t size);
+
+// Write the index and close the file
+void
+sc_frame_archive_close(struct sc_frame_archive *archive);
+
+bool
+sc_frame_archive_append(struct sc_frame_archive *archive,
+                        uint64_t frame_number, int64_t timestamp_ms,
+                        int width, int height,
+                        const struct sc_frame_archive_chunk *chunks,
+                        unsigned chunk_count);
+
+/**
+ * Initialize the header of a frame record, for the payload made of the chunks
+ *
+ * Return false if the payload is too large.
+ */
+bool
+sc_frame_archive_init_header(struct frame_header *header,
+                             int64_t timestamp_ms, int width, int height,
+                             const struct sc_frame_archive_chunk *chunks,
+                             unsigned chunk_count);
+
+/**
+ * Reserve `size` bytes at the end of the archive for a frame record (its
+ * header and its payload), and append its index entry
+ *
+ * The caller writes the record itself at `offset`, to `archive->fd` (e.g.
+ * asynchronously), and must call sc_frame_archive_fail() if the write fails.
+ * The reserved records must be written before sc_frame_archive_close().
+ *
+ * In direct mode, `size` must be a multiple of SC_FILE_DIRECT_ALIGNMENT.
+ */
+bool
+sc_frame_archive_reserve(struct sc_frame_archive *archive,
+                         uint64_t frame_number, int64_t timestamp_ms,
+                         uint64_t size, uint64_t *offset);
+
+/**
+ * Stop appending to the archive, after a failed write of a reserved record
+ */
+void
+sc_frame_archive_fail(struct sc_frame_archive *archive);
+
+/**
+ * Append the index entry of a frame dropped before being saved, so that the
+ * readers know which frames are missing
+ */
+void
+sc_frame_archive_add_dropped(struct sc_frame_archive *archive,
+                             uint64_t frame_number, int64_t timestamp_ms);
+
+/**
+ * Append the index entry of a frame repeated by the device, not saved, so that
+ * the readers know that its image is the one of the previous frame
+ */
+void
+sc_frame_archive_add_repeated(struct sc_frame_archive *archive,
+                              uint64_t frame_number, int64_t timestamp_ms);
+
+/**
+ * Append the index entry of an interruption of the stream, just before the
+ * first frame received after it
+ */
+void
+sc_frame_archive_add_gap(struct sc_frame_archive *archive,
+                         uint64_t frame_number, int64_t duration_ms);
+
+/**
+ * Append headset pose samples, written with the index on close
+ */
+void
+sc_frame_archive_add_poses(struct sc_frame_archive *archive,
+                           const struct pose_sample_record *samples,
+                           unsigned count);
+
+/**
+ * Append the raw and filtered timestamps of a frame, written with the index on
+ * close
+ */
+void
+sc_frame_archive_add_timestamp(struct sc_frame_archive *archive,
+                               const struct sc_frame_archive_timestamp *ts);
+
+/**
+ * Append the entry of a delta frame, once its record is written, so that it
+ * is listed with the index on close
+ */
+void
+sc_frame_archive_add_delta(struct sc_frame_archive *archive,
+                           const struct sc_frame_archive_delta *delta);
+
+#endif
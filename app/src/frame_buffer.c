@@ -8,83 +8,70 @@
 
 bool
 sc_frame_buffer_init(struct sc_frame_buffer *fb) {
-    fb->pending_frame = av_frame_alloc();
-    if (!fb->pending_frame) {
-        LOG_OOM();
-        return false;
-    }
-
-    fb->tmp_frame = av_frame_alloc();
-    if (!fb->tmp_frame) {
-        LOG_OOM();
-        av_frame_free(&fb->pending_frame);
-        return false;
-    }
-
-    bool ok = sc_mutex_init(&fb->mutex);
-    if (!ok) {
-        av_frame_free(&fb->pending_frame);
-        av_frame_free(&fb->tmp_frame);
-        return false;
+    for (unsigned i = 0; i < 3; ++i) {
+        fb->frames[i] = av_frame_alloc();
+        if (!fb->frames[i]) {
+            LOG_OOM();
+            while (i--) {
+                av_frame_free(&fb->frames[i]);
+            }
+            return false;
+        }
     }
 
+    fb->back = 0;
+    fb->front = 1;
     // there is initially no frame, so consider it has already been consumed
-    fb->pending_frame_consumed = true;
+    atomic_init(&fb->state, 2);
 
     return true;
 }
 
 void
 sc_frame_buffer_destroy(struct sc_frame_buffer *fb) {
-    sc_mutex_destroy(&fb->mutex);
-    av_frame_free(&fb->pending_frame);
-    av_frame_free(&fb->tmp_frame);
-}
-
-static inline void
-swap_frames(AVFrame **lhs, AVFrame **rhs) {
-    AVFrame *tmp = *lhs;
-    *lhs = *rhs;
-    *rhs = tmp;
+    for (unsigned i = 0; i < 3; ++i) {
+        av_frame_free(&fb->frames[i]);
+    }
 }
 
 bool
 sc_frame_buffer_push(struct sc_frame_buffer *fb, const AVFrame *frame,
                      bool *previous_frame_skipped) {
-    // Use a temporary frame to preserve pending_frame in case of error.
-    // tmp_frame is an empty frame, no need to call av_frame_unref() beforehand.
-    int r = av_frame_ref(fb->tmp_frame, frame);
+    // The back frame is empty, so the pending frame is preserved on error
+    AVFrame *back = fb->frames[fb->back];
+    int r = av_frame_ref(back, frame);
     if (r) {
         LOGE("Could not ref frame: %d", r);
         return false;
     }
 
-    sc_mutex_lock(&fb->mutex);
+    // Publish the back frame as the new pending frame, and take the previous
+    // middle frame as the new back frame
+    unsigned previous =
+        atomic_exchange_explicit(&fb->state, fb->back | SC_FRAME_BUFFER_FRESH,
+                                 memory_order_acq_rel);
+    fb->back = previous & SC_FRAME_BUFFER_INDEX_MASK;
 
-    // Now that av_frame_ref() succeeded, we can replace the previous
-    // pending_frame
-    swap_frames(&fb->pending_frame, &fb->tmp_frame);
-    av_frame_unref(fb->tmp_frame);
+    // If it has not been consumed, the previous pending frame is lost;
+    // otherwise, it is already empty (it has been moved by the consumer)
+    av_frame_unref(fb->frames[fb->back]);
 
     if (previous_frame_skipped) {
-        *previous_frame_skipped = !fb->pending_frame_consumed;
+        *previous_frame_skipped = previous & SC_FRAME_BUFFER_FRESH;
     }
-    fb->pending_frame_consumed = false;
-
-    sc_mutex_unlock(&fb->mutex);
 
     return true;
 }
 
 void
 sc_frame_buffer_consume(struct sc_frame_buffer *fb, AVFrame *dst) {
-    sc_mutex_lock(&fb->mutex);
-    assert(!fb->pending_frame_consumed);
-    fb->pending_frame_consumed = true;
-
-    av_frame_move_ref(dst, fb->pending_frame);
-    // av_frame_move_ref() resets its source frame, so no need to call
-    // av_frame_unref()
-
-    sc_mutex_unlock(&fb->mutex);
+    // Give back the (empty) front frame, and take the pending frame
+    unsigned previous =
+        atomic_exchange_explicit(&fb->state, fb->front, memory_order_acq_rel);
+    assert(previous & SC_FRAME_BUFFER_FRESH);
+    fb->front = previous & SC_FRAME_BUFFER_INDEX_MASK;
+
+    av_frame_move_ref(dst, fb->frames[fb->front]);
+    // av_frame_move_ref() resets its source frame, so the front frame is empty
+    // when it is given back
 }
@@ -3,10 +3,9 @@
 
 #include "common.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
 
-#include "util/thread.h"
-
 // forward declarations
 typedef struct AVFrame AVFrame;
 
@@ -17,15 +16,25 @@ typedef struct AVFrame AVFrame;
  * If a pending frame has not been consumed when the producer pushes a new
  * frame, then it is lost. The intent is to always provide access to the very
  * last frame to minimize latency.
+ *
+ * It is a lock-free triple buffer, for a single producer and a single
+ * consumer: the producer writes into the back frame, the consumer reads the
+ * front frame, and they exchange their frame with the middle (pending) one
+ * atomically, so that the consumer never waits for the producer (and
+ * conversely).
  */
 
-struct sc_frame_buffer {
-    AVFrame *pending_frame;
-    AVFrame *tmp_frame; // To preserve the pending frame on error
+// Set in the state if the middle frame has not been consumed yet
+#define SC_FRAME_BUFFER_FRESH 0x4
+#define SC_FRAME_BUFFER_INDEX_MASK 0x3
 
-    sc_mutex mutex;
+struct sc_frame_buffer {
+    AVFrame *frames[3];
 
-    bool pending_frame_consumed;
+    unsigned back; // only accessed by the producer
+    unsigned front; // only accessed by the consumer
+    // Index of the middle frame, possibly with SC_FRAME_BUFFER_FRESH
+    atomic_uint state;
 };
 
 bool
@@ -0,0 +1,147 @@
+#include "frame_cache.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+
+#include "util/log.h"
+#include "util/thread.h"
+
+struct sc_frame_cache {
+    sc_mutex mutex;
+    // The data of the frame the cache was attached to, to ignore a cache
+    // copied to another frame (av_frame_copy_props() references opaque_ref)
+    const uint8_t *data;
+    AVFrame *frames[SC_FRAME_CACHE_FORMAT_COUNT]; // NULL until requested
+};
+
+static void
+sc_frame_cache_free(void *opaque, uint8_t *data) {
+    (void) opaque;
+    struct sc_frame_cache *cache = (struct sc_frame_cache *) data;
+
+    for (unsigned i = 0; i < SC_FRAME_CACHE_FORMAT_COUNT; ++i) {
+        av_frame_free(&cache->frames[i]);
+    }
+    sc_mutex_destroy(&cache->mutex);
+    free(cache);
+}
+
+bool
+sc_frame_cache_attach(AVFrame *frame) {
+    assert(frame->format == AV_PIX_FMT_YUV420P);
+
+    struct sc_frame_cache *cache = malloc(sizeof(*cache));
+    if (!cache) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (!sc_mutex_init(&cache->mutex)) {
+        free(cache);
+        return false;
+    }
+
+    cache->data = frame->data[0];
+    for (unsigned i = 0; i < SC_FRAME_CACHE_FORMAT_COUNT; ++i) {
+        cache->frames[i] = NULL;
+    }
+
+    AVBufferRef *ref = av_buffer_create((uint8_t *) cache, sizeof(*cache),
+                                        sc_frame_cache_free, NULL, 0);
+    if (!ref) {
+        LOG_OOM();
+        sc_mutex_destroy(&cache->mutex);
+        free(cache);
+        return false;
+    }
+
+    // Replace any cache copied from another frame
+    av_buffer_unref(&frame->opaque_ref);
+    frame->opaque_ref = ref;
+    return true;
+}
+
+static struct sc_frame_cache *
+sc_frame_cache_find(const AVFrame *frame) {
+    AVBufferRef *ref = frame->opaque_ref;
+    if (!ref || ref->size != sizeof(struct sc_frame_cache)) {
+        return NULL;
+    }
+
+    struct sc_frame_cache *cache = (struct sc_frame_cache *) ref->data;
+    return cache->data == frame->data[0] ? cache : NULL;
+}
+
+static bool
+sc_frame_cache_compute(const AVFrame *frame,
+                       enum sc_frame_cache_format format,
+                       const struct sc_frame_cache_ctx *ctx, AVFrame *out) {
+    switch (format) {
+        case SC_FRAME_CACHE_LUMA:
+            if (av_frame_ref(out, frame)) {
+                LOG_OOM();
+                return false;
+            }
+            sc_frame_keep_luma(out);
+            break;
+        default:
+            assert(format == SC_FRAME_CACHE_RGB24);
+            assert(ctx && ctx->rgb_converter && ctx->pool);
+            if (!sc_frame_pool_get(ctx->pool, out, AV_PIX_FMT_RGB24,
+                                   frame->width, frame->height)) {
+                return false;
+            }
+            if (!sc_rgb_converter_convert(ctx->rgb_converter, frame, out)) {
+                av_frame_unref(out);
+                return false;
+            }
+            break;
+    }
+
+    // A cached frame must not reference the cache, which would never be
+    // released
+    av_buffer_unref(&out->opaque_ref);
+    return true;
+}
+
+bool
+sc_frame_cache_get(const AVFrame *frame, enum sc_frame_cache_format format,
+                   const struct sc_frame_cache_ctx *ctx, AVFrame *out) {
+    assert(frame->format == AV_PIX_FMT_YUV420P);
+    assert(format < SC_FRAME_CACHE_FORMAT_COUNT);
+
+    struct sc_frame_cache *cache = sc_frame_cache_find(frame);
+    if (!cache) {
+        return sc_frame_cache_compute(frame, format, ctx, out);
+    }
+
+    sc_mutex_lock(&cache->mutex);
+
+    AVFrame *cached = cache->frames[format];
+    if (!cached) {
+        cached = av_frame_alloc();
+        if (!cached) {
+            LOG_OOM();
+            sc_mutex_unlock(&cache->mutex);
+            return false;
+        }
+
+        if (!sc_frame_cache_compute(frame, format, ctx, cached)) {
+            av_frame_free(&cached);
+            sc_mutex_unlock(&cache->mutex);
+            return false;
+        }
+        cache->frames[format] = cached;
+    }
+
+    bool ok = !av_frame_ref(out, cached);
+
+    sc_mutex_unlock(&cache->mutex);
+
+    if (!ok) {
+        LOG_OOM();
+    }
+    return ok;
+}
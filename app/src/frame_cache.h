@@ -0,0 +1,69 @@
+#ifndef SC_FRAME_CACHE_H
+#define SC_FRAME_CACHE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#include "frame_pool.h"
+#include "rgb_converter.h"
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+
+/**
+ * Cache of the representations derived from a frame, shared by all its
+ * consumers
+ *
+ * The cache is attached to the frame (its opaque_ref), so that all the
+ * references to the frame (av_frame_ref()) share it, and it is released along
+ * with the last one. The first consumer requesting a representation computes
+ * it, the next ones just reference it: each conversion happens at most once per
+ * frame, whatever the number of sinks and outputs needing it.
+ *
+ * The representations are computed lazily, under the lock of the cache (a
+ * consumer requesting a representation being computed waits for it, rather
+ * than computing it again).
+ */
+
+enum sc_frame_cache_format {
+    // The Y plane only (GRAY8), not copied (see sc_frame_keep_luma())
+    SC_FRAME_CACHE_LUMA,
+    // RGB24, of the same size (see rgb_converter.h)
+    SC_FRAME_CACHE_RGB24,
+};
+
+#define SC_FRAME_CACHE_FORMAT_COUNT 2
+
+// The state of a consumer, to compute the representations it requests (not
+// thread-safe, like a frame pool: each thread has its own), NULL to only
+// request SC_FRAME_CACHE_LUMA
+struct sc_frame_cache_ctx {
+    struct sc_rgb_converter *rgb_converter; // for SC_FRAME_CACHE_RGB24
+    struct sc_frame_pool *pool; // for the computed frames
+};
+
+/**
+ * Attach an empty cache to a YUV420P frame, before it is shared
+ *
+ * The content of the frame must not change afterwards. Return false on
+ * allocation failure (the representations are then computed by each
+ * consumer).
+ */
+bool
+sc_frame_cache_attach(AVFrame *frame);
+
+/**
+ * Reference the representation `format` of a YUV420P frame into `out` (an
+ * empty frame)
+ *
+ * It is computed with `ctx` if the frame has no cache (or a cache copied from
+ * another frame, by av_frame_copy_props()), or if it is not in the cache yet.
+ *
+ * Return false on error.
+ */
+bool
+sc_frame_cache_get(const AVFrame *frame, enum sc_frame_cache_format format,
+                   const struct sc_frame_cache_ctx *ctx, AVFrame *out);
+
+#endif
@@ -0,0 +1,174 @@
+#include "frame_clock.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include <libavutil/avutil.h>
+
+#include "adb/adb.h"
+#include "demuxer.h"
+#include "util/log.h"
+
+// Maximum delay to wait for the clock synchronization on the first frame
+#define SC_FRAME_CLOCK_SYNC_TIMEOUT SC_TICK_FROM_MS(500)
+// Period of refresh of the clock sync estimation
+#define SC_FRAME_CLOCK_ESTIMATE_PERIOD SC_TICK_FROM_MS(500)
+
+void
+sc_frame_clock_init(struct sc_frame_clock *fc,
+                    struct sc_clock_sync *clock_sync, const char *serial) {
+    fc->clock_sync = clock_sync;
+    fc->clock_sync_waited = false;
+    fc->has_estimate = false;
+    fc->unknown_clock_domain = false;
+    fc->serial = serial;
+    // Without device (--replay), the timestamps are left in the device
+    // monotonic clock
+    fc->boot_time_retrieved = !clock_sync && !serial;
+    fc->device_boot_time = 0;
+}
+
+void
+sc_frame_clock_set_boot_time(struct sc_frame_clock *fc, int64_t boot_time_ms) {
+    if (boot_time_ms && !fc->clock_sync) {
+        fc->device_boot_time = boot_time_ms;
+        fc->boot_time_retrieved = true;
+    }
+}
+
+void
+sc_frame_clock_prepare(struct sc_frame_clock *fc) {
+    if (fc->clock_sync || fc->boot_time_retrieved) {
+        return;
+    }
+
+    assert(fc->serial);
+    if (!sc_adb_get_boot_time(NULL, fc->serial, 0, &fc->device_boot_time)) {
+        LOGE("Failed to get device boot time");
+    }
+    // Do not retry on failure
+    fc->boot_time_retrieved = true;
+}
+
+// Read the capture timestamp exported by the demuxer, in the device monotonic
+// clock
+static bool
+sc_frame_clock_get_capture_time(struct sc_frame_clock *fc,
+                                const AVDictionary *metadata, sc_tick *time) {
+    AVDictionaryEntry *ns =
+        av_dict_get(metadata, SC_DEMUXER_METADATA_CAPTURE_NS, NULL, 0);
+    AVDictionaryEntry *domain =
+        av_dict_get(metadata, SC_DEMUXER_METADATA_CLOCK_DOMAIN, NULL, 0);
+    if (!ns || !domain) {
+        return false;
+    }
+
+    if (strtol(domain->value, NULL, 10) != SC_CLOCK_DOMAIN_MONOTONIC) {
+        if (!fc->unknown_clock_domain) {
+            LOGW("Unsupported capture clock domain: %s", domain->value);
+            fc->unknown_clock_domain = true;
+        }
+        return false;
+    }
+
+    char *end;
+    long long value = strtoll(ns->value, &end, 10);
+    if (*end != '\0' || value < 0) {
+        return false;
+    }
+
+    *time = SC_TICK_FROM_NS((sc_tick) value);
+    return true;
+}
+
+int64_t
+sc_frame_clock_get_timestamp_us(struct sc_frame_clock *fc,
+                                const AVDictionary *metadata, int64_t pts) {
+    sc_tick device_time;
+    if (!sc_frame_clock_get_capture_time(fc, metadata, &device_time)) {
+        if (pts == AV_NOPTS_VALUE) {
+            return -1;
+        }
+        // PTS are in microseconds
+        device_time = SC_TICK_FROM_US(pts);
+    }
+
+    if (!fc->clock_sync) {
+        return SC_TICK_TO_US(SC_TICK_FROM_MS(fc->device_boot_time)
+                             + device_time);
+    }
+
+    if (!fc->clock_sync_waited) {
+        // The first pong is expected in one round-trip, wait for it only once
+        sc_tick deadline = sc_tick_now() + SC_FRAME_CLOCK_SYNC_TIMEOUT;
+        if (!sc_clock_sync_wait(fc->clock_sync, deadline)) {
+            LOGW("Device clock not synchronized yet");
+        }
+        fc->clock_sync_waited = true;
+    }
+
+    sc_tick now = sc_tick_now();
+    if (!fc->has_estimate
+            || now - fc->estimate_time >= SC_FRAME_CLOCK_ESTIMATE_PERIOD) {
+        if (!sc_clock_sync_get_estimate(fc->clock_sync, &fc->estimate)) {
+            return -1;
+        }
+        fc->has_estimate = true;
+        fc->estimate_time = now;
+    }
+
+    sc_tick realtime = sc_clock_estimate_to_realtime(&fc->estimate,
+                                                     device_time);
+    return SC_TICK_TO_US(realtime);
+}
+
+// Read an unsigned 32-bit value of the metadata
+static bool
+sc_frame_clock_get_u32(const AVDictionary *metadata, const char *key,
+                       uint32_t *value) {
+    AVDictionaryEntry *entry = av_dict_get(metadata, key, NULL, 0);
+    if (!entry) {
+        return false;
+    }
+
+    char *end;
+    unsigned long v = strtoul(entry->value, &end, 10);
+    if (*end != '\0' || v > UINT32_MAX) {
+        return false;
+    }
+
+    *value = v;
+    return true;
+}
+
+void
+sc_frame_clock_get_times(struct sc_frame_clock *fc,
+                         const AVDictionary *metadata, int64_t pts,
+                         struct sc_frame_times *times) {
+    times->start_us = sc_frame_clock_get_timestamp_us(fc, metadata, pts);
+    times->mid_us = times->start_us;
+
+    if (!sc_frame_clock_get_u32(metadata, SC_DEMUXER_METADATA_EXPOSURE_NS,
+                                &times->exposure_ns)
+            || !sc_frame_clock_get_u32(metadata,
+                                       SC_DEMUXER_METADATA_READOUT_NS,
+                                       &times->readout_ns)) {
+        times->exposure_ns = 0;
+        times->readout_ns = 0;
+        return;
+    }
+
+    if (times->start_us >= 0) {
+        // The middle row starts its exposure after half the readout time
+        uint64_t offset_ns = ((uint64_t) times->exposure_ns
+                            + times->readout_ns) / 2;
+        times->mid_us += offset_ns / 1000;
+    }
+}
+
+int64_t
+sc_frame_clock_get_timestamp(struct sc_frame_clock *fc,
+                             const AVDictionary *metadata, int64_t pts) {
+    int64_t timestamp_us = sc_frame_clock_get_timestamp_us(fc, metadata, pts);
+    return sc_frame_clock_us_to_ms(timestamp_us);
+}
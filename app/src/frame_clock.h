@@ -0,0 +1,124 @@
+#ifndef SC_FRAME_CLOCK_H
+#define SC_FRAME_CLOCK_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavutil/dict.h>
+
+#include "clock_sync.h"
+
+/**
+ * Conversion of the capture time of the video frames to the wall clock.
+ *
+ * The capture timestamp exported by the demuxer (or the PTS if there is
+ * none), in the device monotonic clock, is converted to milliseconds since the
+ * Unix epoch, from the synchronized device clock if available, otherwise from
+ * the device boot time retrieved once via adb.
+ *
+ * It is not thread-safe: it must be used from a single thread (the thread of
+ * the video processor or of the recorder).
+ */
+struct sc_frame_clock {
+    // If set, the timestamps are computed from the synchronized device clock,
+    // otherwise from the device boot time
+    struct sc_clock_sync *clock_sync;
+    bool clock_sync_waited;
+    // Estimation of the clock sync, refreshed periodically, so that the
+    // timestamp of each frame is computed without locking the clock sync
+    bool has_estimate;
+    struct sc_clock_estimate estimate;
+    sc_tick estimate_time;
+    bool unknown_clock_domain; // to log the warning only once
+    // To retrieve the boot time without clock_sync, NULL if there is no
+    // device (the timestamps are then in the device monotonic clock)
+    const char *serial;
+    bool boot_time_retrieved;
+    int64_t device_boot_time; // in milliseconds
+};
+
+void
+sc_frame_clock_init(struct sc_frame_clock *fc,
+                    struct sc_clock_sync *clock_sync, const char *serial);
+
+// Use the device boot time retrieved beforehand (during the server startup),
+// so that sc_frame_clock_prepare() does not execute adb
+//
+// It must be called before the clock is used. A boot time of 0 (unknown) is
+// ignored.
+void
+sc_frame_clock_set_boot_time(struct sc_frame_clock *fc, int64_t boot_time_ms);
+
+// Retrieve the device boot time via adb if the device clock is not
+// synchronized (it does nothing on subsequent calls)
+//
+// It blocks for the duration of an adb command, so it must be called from the
+// thread using the clock, not from the main thread.
+void
+sc_frame_clock_prepare(struct sc_frame_clock *fc);
+
+// Return the capture time, in milliseconds since the Unix epoch, or -1 if
+// unknown
+//
+// The metadata are the frame metadata or the unpacked packet side data
+// (containing the capture timestamp exported by the demuxer, if any). The PTS
+// are in microseconds.
+int64_t
+sc_frame_clock_get_timestamp(struct sc_frame_clock *fc,
+                             const AVDictionary *metadata, int64_t pts);
+
+// Same as sc_frame_clock_get_timestamp(), in microseconds
+int64_t
+sc_frame_clock_get_timestamp_us(struct sc_frame_clock *fc,
+                                const AVDictionary *metadata, int64_t pts);
+
+// Capture times of a frame (see sc_frame_clock_get_times())
+struct sc_frame_times {
+    // Capture time, in microseconds since the Unix epoch, -1 if unknown: for
+    // a camera frame, the start of the exposure of its first row
+    int64_t start_us;
+    // Middle of the exposure of the middle row, start_us if the exposure is
+    // unknown
+    int64_t mid_us;
+    // Exposure time of each row, 0 if unknown
+    uint32_t exposure_ns;
+    // Readout time: the delay between the start of the exposure of the first
+    // and the last rows (the rolling shutter skew, 0 for a global shutter)
+    uint32_t readout_ns;
+};
+
+// Compute the capture times of a frame, once per frame
+//
+// Same as sc_frame_clock_get_timestamp_us(), with the exposure exported by
+// the demuxer (--capture-exposure), if any.
+void
+sc_frame_clock_get_times(struct sc_frame_clock *fc,
+                         const AVDictionary *metadata, int64_t pts,
+                         struct sc_frame_times *times);
+
+// Return the middle of the exposure of a row of the captured image, in
+// nanoseconds since the Unix epoch, or -1 if unknown
+//
+// With a rolling shutter, the rows are exposed one after the other: row `row`
+// of `rows` starts its exposure readout_ns * row / (rows - 1) after the first.
+static inline int64_t
+sc_frame_times_get_row_ns(const struct sc_frame_times *times, unsigned row,
+                          unsigned rows) {
+    if (times->start_us < 0) {
+        return -1;
+    }
+    int64_t ns = times->start_us * 1000 + times->exposure_ns / 2;
+    if (rows > 1) {
+        ns += (int64_t) times->readout_ns * row / (rows - 1);
+    }
+    return ns;
+}
+
+// Convert a capture time in microseconds to milliseconds (-1 if unknown)
+static inline int64_t
+sc_frame_clock_us_to_ms(int64_t timestamp_us) {
+    return timestamp_us < 0 ? -1 : timestamp_us / 1000;
+}
+
+#endif
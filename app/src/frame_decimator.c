@@ -0,0 +1,46 @@
+#include "frame_decimator.h"
+
+void
+sc_frame_decimator_init(struct sc_frame_decimator *fd,
+                        const struct sc_output_rate *rate) {
+    fd->interval_us = rate->fps ? 1000000 / rate->fps : 0;
+    fd->key_frames = rate->key_frames;
+    fd->started = false;
+    fd->next_pts = 0;
+    fd->last_pts = 0;
+}
+
+bool
+sc_frame_decimator_accept(struct sc_frame_decimator *fd, int64_t pts,
+                          bool key_frame) {
+    if (fd->key_frames && !key_frame) {
+        return false;
+    }
+
+    int64_t interval = fd->interval_us;
+    if (!interval) {
+        return true;
+    }
+
+    if (fd->started) {
+        int64_t jitter = MIN(SC_FRAME_DECIMATOR_JITTER_US, interval / 4);
+        int64_t earliest = fd->next_pts - jitter;
+        if (pts >= earliest && pts < fd->next_pts + interval) {
+            // In the next slot of the grid
+            fd->next_pts += interval;
+            fd->last_pts = pts;
+            return true;
+        }
+
+        if (pts < earliest && pts > fd->last_pts) {
+            // Too early
+            return false;
+        }
+    }
+
+    // First frame, or discontinuity of the PTS: restart the grid
+    fd->started = true;
+    fd->next_pts = pts + interval;
+    fd->last_pts = pts;
+    return true;
+}
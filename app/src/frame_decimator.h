@@ -0,0 +1,42 @@
+#ifndef SC_FRAME_DECIMATOR_H
+#define SC_FRAME_DECIMATOR_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "options.h"
+
+#define SC_FRAME_DECIMATOR_JITTER_US 2000
+
+/**
+ * Frame decimator, selecting the frames of an output subsampled to a maximum
+ * rate (--save-frames-fps and --pipe-output-fps), from their PTS
+ *
+ * The accepted frames are aligned on a regular grid of 1/fps, so that the
+ * average rate is exact even if it does not divide the capture rate. A frame
+ * slightly early (SC_FRAME_DECIMATOR_JITTER_US, at most a quarter of the
+ * interval) is accepted, for the PTS jitter.
+ *
+ * After a gap in the PTS (e.g. the device paused the capture) or if they go
+ * backwards, the grid is restarted from the next frame.
+ */
+struct sc_frame_decimator {
+    int64_t interval_us; // 0 to accept all the frames
+    bool key_frames; // only accept the key frames
+    bool started;
+    int64_t next_pts; // the next slot of the grid, if started
+    int64_t last_pts; // the last accepted frame, if started
+};
+
+void
+sc_frame_decimator_init(struct sc_frame_decimator *fd,
+                        const struct sc_output_rate *rate);
+
+// Return true if the frame (with its PTS in microseconds) must be output
+bool
+sc_frame_decimator_accept(struct sc_frame_decimator *fd, int64_t pts,
+                          bool key_frame);
+
+#endif
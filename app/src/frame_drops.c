@@ -0,0 +1,80 @@
+#include "frame_drops.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "util/log.h"
+
+static const char *const reason_names[] = {
+    [SC_FRAME_DROP_OVERWRITTEN] = "overwritten",
+    [SC_FRAME_DROP_SINK_BUSY] = "sink busy",
+    [SC_FRAME_DROP_WRITE_FAILED] = "write failed",
+    [SC_FRAME_DROP_QUEUE_FULL] = "queue full",
+    [SC_FRAME_DROP_DECODE_ERROR] = "decode error",
+};
+
+static_assert(ARRAY_LEN(reason_names) == SC_FRAME_DROP_REASON_COUNT,
+              "missing reason names");
+
+void
+sc_frame_drops_init(struct sc_frame_drops *drops, const char *name) {
+    drops->name = name; // statically allocated
+    for (unsigned i = 0; i < SC_FRAME_DROP_REASON_COUNT; ++i) {
+        atomic_init(&drops->counts[i], 0);
+    }
+}
+
+void
+sc_frame_drops_add(struct sc_frame_drops *drops,
+                   enum sc_frame_drop_reason reason) {
+    assert(reason < SC_FRAME_DROP_REASON_COUNT);
+    atomic_fetch_add_explicit(&drops->counts[reason], 1, memory_order_relaxed);
+}
+
+uint64_t
+sc_frame_drops_get(struct sc_frame_drops *drops,
+                   enum sc_frame_drop_reason reason) {
+    assert(reason < SC_FRAME_DROP_REASON_COUNT);
+    return atomic_load_explicit(&drops->counts[reason], memory_order_relaxed);
+}
+
+uint64_t
+sc_frame_drops_total(struct sc_frame_drops *drops) {
+    uint64_t total = 0;
+    for (unsigned i = 0; i < SC_FRAME_DROP_REASON_COUNT; ++i) {
+        total += sc_frame_drops_get(drops, i);
+    }
+    return total;
+}
+
+void
+sc_frame_drops_log(struct sc_frame_drops *drops) {
+    uint64_t total = sc_frame_drops_total(drops);
+    if (!total) {
+        return;
+    }
+
+    char buf[256];
+    size_t len = 0;
+    for (unsigned i = 0; i < SC_FRAME_DROP_REASON_COUNT; ++i) {
+        uint64_t count = sc_frame_drops_get(drops, i);
+        if (!count) {
+            continue;
+        }
+        int r = snprintf(buf + len, sizeof(buf) - len, "%s%s: %" PRIu64,
+                         len ? ", " : "", reason_names[i], count);
+        if (r < 0 || (size_t) r >= sizeof(buf) - len) {
+            break;
+        }
+        len += r;
+    }
+
+    LOGI("%s: %" PRIu64 " frames dropped (%s)", drops->name, total, buf);
+}
+
+const char *
+sc_frame_drop_reason_name(enum sc_frame_drop_reason reason) {
+    assert(reason < SC_FRAME_DROP_REASON_COUNT);
+    return reason_names[reason];
+}
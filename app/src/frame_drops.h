@@ -0,0 +1,54 @@
+#ifndef SC_FRAME_DROPS_H
+#define SC_FRAME_DROPS_H
+
+#include "common.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "frame_header.h"
+
+// The values are written to the pipe (see frame_header.h)
+enum sc_frame_drop_reason {
+    SC_FRAME_DROP_OVERWRITTEN = FRAME_DROP_REASON_OVERWRITTEN,
+    SC_FRAME_DROP_SINK_BUSY = FRAME_DROP_REASON_SINK_BUSY,
+    SC_FRAME_DROP_WRITE_FAILED = FRAME_DROP_REASON_WRITE_FAILED,
+    SC_FRAME_DROP_QUEUE_FULL = FRAME_DROP_REASON_QUEUE_FULL,
+    SC_FRAME_DROP_DECODE_ERROR = FRAME_DROP_REASON_DECODE_ERROR,
+    SC_FRAME_DROP_REASON_COUNT,
+};
+
+/**
+ * Counters of the frames dropped by a sink, per reason
+ *
+ * The counters may be incremented from any thread, without lock. The counts
+ * are logged when the sink is closed.
+ */
+struct sc_frame_drops {
+    const char *name; // must be statically allocated (e.g. a string literal)
+    atomic_uint_least64_t counts[SC_FRAME_DROP_REASON_COUNT];
+};
+
+void
+sc_frame_drops_init(struct sc_frame_drops *drops, const char *name);
+
+void
+sc_frame_drops_add(struct sc_frame_drops *drops,
+                   enum sc_frame_drop_reason reason);
+
+uint64_t
+sc_frame_drops_get(struct sc_frame_drops *drops,
+                   enum sc_frame_drop_reason reason);
+
+// Return the total number of dropped frames, for all the reasons
+uint64_t
+sc_frame_drops_total(struct sc_frame_drops *drops);
+
+// Log the counts, if any frame was dropped
+void
+sc_frame_drops_log(struct sc_frame_drops *drops);
+
+const char *
+sc_frame_drop_reason_name(enum sc_frame_drop_reason reason);
+
+#endif
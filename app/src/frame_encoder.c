@@ -0,0 +1,403 @@
+#include "frame_encoder.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include <libavutil/frame.h>
+
+#include "util/log.h"
+
+/** Downcast frame_sink to sc_frame_encoder */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_frame_encoder, frame_sink)
+
+static const AVRational SCRCPY_TIME_BASE = {1, 1000000}; // timestamps in us
+
+// Preferred encoders, the hardware encoders first (they fail to open if the
+// hardware is not available)
+static const char *const sc_frame_encoder_names[] = {
+    "h264_nvenc",
+    "h264_qsv",
+    "h264_amf",
+    "h264_videotoolbox",
+    "h264_mf",
+    "libx264",
+};
+
+static bool
+sc_frame_encoder_supports_format(const AVCodec *codec,
+                                 enum AVPixelFormat format) {
+    const enum AVPixelFormat *fmt = codec->pix_fmts;
+    if (!fmt) {
+        // Unknown, try to open it anyway
+        return true;
+    }
+
+    for (; *fmt != AV_PIX_FMT_NONE; ++fmt) {
+        if (*fmt == format) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static AVCodecContext *
+sc_frame_encoder_open_codec(const AVCodec *codec, const AVFrame *frame,
+                            uint32_t bit_rate) {
+    if (!sc_frame_encoder_supports_format(codec, frame->format)) {
+        return NULL;
+    }
+
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    if (!ctx) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    ctx->width = frame->width;
+    ctx->height = frame->height;
+    ctx->pix_fmt = frame->format;
+    ctx->time_base = SCRCPY_TIME_BASE;
+    // Nominal frame rate, for the rate control only (the PTS are preserved)
+    ctx->framerate = (AVRational) {60, 1};
+    ctx->bit_rate = bit_rate;
+    // The recorder writes the packets with DTS = PTS
+    ctx->max_b_frames = 0;
+    // The extradata are forwarded as the config packet
+    ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    if (avcodec_open2(ctx, codec, NULL) < 0) {
+        LOGD("Could not open encoder %s", codec->name);
+        avcodec_free_context(&ctx);
+        return NULL;
+    }
+
+    if (!ctx->extradata_size) {
+        LOGD("Encoder %s does not provide global headers", codec->name);
+        avcodec_free_context(&ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+static AVCodecContext *
+sc_frame_encoder_open_best_codec(const AVFrame *frame, uint32_t bit_rate) {
+    for (size_t i = 0; i < ARRAY_LEN(sc_frame_encoder_names); ++i) {
+        const AVCodec *codec =
+            avcodec_find_encoder_by_name(sc_frame_encoder_names[i]);
+        if (codec) {
+            AVCodecContext *ctx =
+                sc_frame_encoder_open_codec(codec, frame, bit_rate);
+            if (ctx) {
+                return ctx;
+            }
+        }
+    }
+
+    // Any other H.264 encoder
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    if (codec) {
+        return sc_frame_encoder_open_codec(codec, frame, bit_rate);
+    }
+
+    return NULL;
+}
+
+static bool
+sc_frame_encoder_push_config_packet(struct sc_frame_encoder *fe) {
+    AVPacket *packet = fe->packet;
+    if (av_new_packet(packet, fe->ctx->extradata_size)) {
+        LOG_OOM();
+        return false;
+    }
+
+    memcpy(packet->data, fe->ctx->extradata, fe->ctx->extradata_size);
+    packet->pts = AV_NOPTS_VALUE;
+    packet->dts = AV_NOPTS_VALUE;
+
+    bool ok = sc_packet_source_sinks_push(&fe->packet_source, packet);
+    av_packet_unref(packet);
+    return ok;
+}
+
+// Open the encoder for the format of the first frame, then the packet sinks
+static bool
+sc_frame_encoder_open(struct sc_frame_encoder *fe, const AVFrame *frame) {
+    assert(!fe->ctx);
+
+    fe->ctx = sc_frame_encoder_open_best_codec(frame, fe->bit_rate);
+    if (!fe->ctx) {
+        LOGE("Could not open any H.264 encoder for %dx%d frames (format %d)",
+             frame->width, frame->height, frame->format);
+        return false;
+    }
+
+    LOGI("Rectified recording: %s encoder, %dx%d", fe->ctx->codec->name,
+         fe->ctx->width, fe->ctx->height);
+
+    if (!sc_packet_source_sinks_open(&fe->packet_source, fe->ctx)) {
+        goto error_free_context;
+    }
+
+    // The recorder expects a config packet first
+    if (!sc_frame_encoder_push_config_packet(fe)) {
+        goto error_close_sinks;
+    }
+
+    return true;
+
+error_close_sinks:
+    sc_packet_source_sinks_close(&fe->packet_source);
+error_free_context:
+    avcodec_free_context(&fe->ctx);
+
+    return false;
+}
+
+// Send a frame (or NULL to drain the encoder), and forward the packets
+static bool
+sc_frame_encoder_encode(struct sc_frame_encoder *fe, AVFrame *frame) {
+    if (frame) {
+        if (!fe->ctx && !sc_frame_encoder_open(fe, frame)) {
+            return false;
+        }
+
+        if (frame->width != fe->ctx->width || frame->height != fe->ctx->height
+                || frame->format != fe->ctx->pix_fmt) {
+            // The encoder could not be reconfigured (e.g. on rotation)
+            if (!fe->unsupported_frame) {
+                LOGW("Rectified recording: frame size changed (%dx%d), "
+                     "frames ignored", frame->width, frame->height);
+                fe->unsupported_frame = true;
+            }
+            return true;
+        }
+
+        // Let the encoder choose the key frames
+        frame->pict_type = AV_PICTURE_TYPE_NONE;
+    }
+
+    int ret = avcodec_send_frame(fe->ctx, frame);
+    if (ret < 0 && ret != AVERROR_EOF) {
+        LOGE("Could not send frame to the encoder: %d", ret);
+        return false;
+    }
+
+    for (;;) {
+        ret = avcodec_receive_packet(fe->ctx, fe->packet);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            return true;
+        }
+        if (ret < 0) {
+            LOGE("Could not receive encoded packet: %d", ret);
+            return false;
+        }
+
+        // The packet PTS are expressed in the encoder time base (us)
+        bool ok = sc_packet_source_sinks_push(&fe->packet_source, fe->packet);
+        av_packet_unref(fe->packet);
+        if (!ok) {
+            LOGE("Encoded packet could not be pushed");
+            return false;
+        }
+    }
+}
+
+static int
+run_frame_encoder(void *data) {
+    struct sc_frame_encoder *fe = data;
+
+    bool error = false;
+
+    for (;;) {
+        sc_mutex_lock(&fe->mutex);
+
+        while (!fe->stopped && sc_vecdeque_is_empty(&fe->queue)) {
+            sc_cond_wait(&fe->queue_cond, &fe->mutex);
+        }
+
+        if (sc_vecdeque_is_empty(&fe->queue)) {
+            // Stopped, all the pending frames have been encoded
+            assert(fe->stopped);
+            sc_mutex_unlock(&fe->mutex);
+            break;
+        }
+
+        AVFrame *frame = sc_vecdeque_pop(&fe->queue);
+        sc_mutex_unlock(&fe->mutex);
+
+        bool ok = sc_frame_encoder_encode(fe, frame);
+        av_frame_free(&frame);
+        if (!ok) {
+            error = true;
+            break;
+        }
+    }
+
+    if (error) {
+        sc_mutex_lock(&fe->mutex);
+        // Prevent to push any new frame
+        fe->stopped = true;
+        while (!sc_vecdeque_is_empty(&fe->queue)) {
+            AVFrame *frame = sc_vecdeque_pop(&fe->queue);
+            av_frame_free(&frame);
+        }
+        sc_mutex_unlock(&fe->mutex);
+
+        fe->cbs->on_error(fe, fe->cbs_userdata);
+    } else if (fe->ctx) {
+        // Write the delayed packets
+        sc_frame_encoder_encode(fe, NULL);
+    }
+
+    LOGD("Frame encoder thread ended");
+
+    return 0;
+}
+
+static bool
+sc_frame_encoder_frame_sink_open(struct sc_frame_sink *sink,
+                                 const AVCodecContext *ctx) {
+    struct sc_frame_encoder *fe = DOWNCAST(sink);
+
+    (void) ctx;
+
+    fe->ctx = NULL;
+
+    fe->packet = av_packet_alloc();
+    if (!fe->packet) {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = sc_mutex_init(&fe->mutex);
+    if (!ok) {
+        goto error_free_packet;
+    }
+
+    ok = sc_cond_init(&fe->queue_cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    sc_vecdeque_init(&fe->queue);
+    ok = sc_vecdeque_reserve(&fe->queue, SC_FRAME_ENCODER_QUEUE_SIZE);
+    if (!ok) {
+        LOG_OOM();
+        goto error_destroy_queue_cond;
+    }
+
+    fe->unsupported_frame = false;
+    sc_frame_drops_init(&fe->drops, "Rectified recording");
+    fe->stopped = false;
+
+    ok = sc_thread_create(&fe->thread, run_frame_encoder, "scrcpy-fenc", fe);
+    if (!ok) {
+        LOGE("Could not start frame encoder thread");
+        goto error_destroy_queue;
+    }
+
+    return true;
+
+error_destroy_queue:
+    sc_vecdeque_destroy(&fe->queue);
+error_destroy_queue_cond:
+    sc_cond_destroy(&fe->queue_cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&fe->mutex);
+error_free_packet:
+    av_packet_free(&fe->packet);
+
+    return false;
+}
+
+static void
+sc_frame_encoder_frame_sink_close(struct sc_frame_sink *sink) {
+    struct sc_frame_encoder *fe = DOWNCAST(sink);
+
+    sc_mutex_lock(&fe->mutex);
+    // The pending frames are encoded before the thread terminates
+    fe->stopped = true;
+    sc_cond_signal(&fe->queue_cond);
+    sc_mutex_unlock(&fe->mutex);
+
+    sc_thread_join(&fe->thread, NULL);
+
+    sc_frame_drops_log(&fe->drops);
+
+    if (fe->ctx) {
+        sc_packet_source_sinks_close(&fe->packet_source);
+        avcodec_free_context(&fe->ctx);
+    }
+
+    assert(sc_vecdeque_is_empty(&fe->queue));
+    sc_vecdeque_destroy(&fe->queue);
+    sc_cond_destroy(&fe->queue_cond);
+    sc_mutex_destroy(&fe->mutex);
+    av_packet_free(&fe->packet);
+}
+
+static bool
+sc_frame_encoder_frame_sink_push(struct sc_frame_sink *sink,
+                                 const AVFrame *frame) {
+    struct sc_frame_encoder *fe = DOWNCAST(sink);
+
+    AVFrame *ref = av_frame_alloc();
+    if (!ref) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (av_frame_ref(ref, frame)) {
+        LOG_OOM();
+        av_frame_free(&ref);
+        return false;
+    }
+
+    sc_mutex_lock(&fe->mutex);
+
+    if (fe->stopped) {
+        sc_mutex_unlock(&fe->mutex);
+        av_frame_free(&ref);
+        return false;
+    }
+
+    // The capacity reserved on open may be larger than the queue size, so
+    // compare the size explicitly
+    if (sc_vecdeque_size(&fe->queue) >= SC_FRAME_ENCODER_QUEUE_SIZE) {
+        // The encoding is too slow, drop the oldest pending frame
+        AVFrame *old = sc_vecdeque_pop(&fe->queue);
+        av_frame_free(&old);
+        sc_frame_drops_add(&fe->drops, SC_FRAME_DROP_QUEUE_FULL);
+    }
+
+    sc_vecdeque_push_noresize(&fe->queue, ref);
+    sc_cond_signal(&fe->queue_cond);
+
+    sc_mutex_unlock(&fe->mutex);
+
+    return true;
+}
+
+void
+sc_frame_encoder_init(struct sc_frame_encoder *fe, uint32_t bit_rate,
+                      const struct sc_frame_encoder_callbacks *cbs,
+                      void *cbs_userdata) {
+    fe->bit_rate = bit_rate ? bit_rate : SC_FRAME_ENCODER_DEFAULT_BIT_RATE;
+
+    assert(cbs && cbs->on_error);
+    fe->cbs = cbs;
+    fe->cbs_userdata = cbs_userdata;
+
+    sc_packet_source_init(&fe->packet_source);
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = sc_frame_encoder_frame_sink_open,
+        .close = sc_frame_encoder_frame_sink_close,
+        .push = sc_frame_encoder_frame_sink_push,
+    };
+
+    fe->frame_sink.ops = &ops;
+}
@@ -0,0 +1,74 @@
+#ifndef SC_FRAME_ENCODER_H
+#define SC_FRAME_ENCODER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+#include "frame_drops.h"
+#include "trait/frame_sink.h"
+#include "trait/packet_source.h"
+#include "util/thread.h"
+#include "util/vecdeque.h"
+
+// Number of frames which may wait for encoding. If the encoder is too slow,
+// the oldest pending frames are dropped.
+#define SC_FRAME_ENCODER_QUEUE_SIZE 16
+
+// Bit rate if none is specified (the default bit rate of the device encoder)
+#define SC_FRAME_ENCODER_DEFAULT_BIT_RATE 8000000
+
+struct sc_frame_encoder_queue SC_VECDEQUE(AVFrame *);
+
+/**
+ * H.264 encoder of the processed frames, to record the rectified stream
+ * (--record-rectified).
+ *
+ * It receives the frames from the video processor, encodes them from its own
+ * thread (with a hardware encoder if available), and forwards the packets to
+ * its packet sinks (typically the recorder), as the demuxer does for the
+ * device stream: a config packet first, then the packets with their PTS in
+ * microseconds.
+ *
+ * The encoder is configured from the first frame (the processed frames may be
+ * larger than the decoded frames, for example with --show-timestamps), so the
+ * packet sinks are opened from the encoder thread on the first frame.
+ */
+struct sc_frame_encoder {
+    struct sc_frame_sink frame_sink; // frame sink trait
+    struct sc_packet_source packet_source; // packet source trait
+
+    uint32_t bit_rate;
+
+    const struct sc_frame_encoder_callbacks *cbs;
+    void *cbs_userdata;
+
+    // Only accessed from the encoder thread once started
+    AVCodecContext *ctx; // NULL until the first frame
+    AVPacket *packet;
+    bool unsupported_frame; // to log the warning only once
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond queue_cond;
+
+    struct sc_frame_encoder_queue queue;
+    struct sc_frame_drops drops;
+    bool stopped;
+};
+
+struct sc_frame_encoder_callbacks {
+    // Called from the encoder thread if the frames could not be encoded or
+    // the packets could not be pushed (the following frames are rejected)
+    void (*on_error)(struct sc_frame_encoder *fe, void *userdata);
+};
+
+// If bit_rate is 0, SC_FRAME_ENCODER_DEFAULT_BIT_RATE is used
+void
+sc_frame_encoder_init(struct sc_frame_encoder *fe, uint32_t bit_rate,
+                      const struct sc_frame_encoder_callbacks *cbs,
+                      void *cbs_userdata);
+
+#endif
@@ -0,0 +1,561 @@
+#ifndef SC_FRAME_HEADER_H
+#define SC_FRAME_HEADER_H
+
+// This header is self-contained (it does not include common.h), because it
+// describes a binary format which is also used by external consumers
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Header preceding each frame written to the output pipe (--pipe-output), to
+ * the frame archive (--save-frames-archive) and to the shared memory ring
+ * (--shm-output)
+ *
+ * The fields are written in host byte order.
+ *
+ * The header is followed by frame_size bytes: the YUV420P planes, or only the
+ * Y plane (width x height bytes) with --output-planes=y.
+ */
+
+// Define frame header structure
+#pragma pack(push, 1)  // Ensure struct is packed without padding
+struct frame_header {
+    uint8_t delimiter[8];  // unlikely to appear in YUV data
+    int64_t timestamp_ms;  // 8-byte timestamp
+    int32_t width;        // 4-byte width
+    int32_t height;       // 4-byte height
+    uint32_t frame_size;  // 4-byte frame size
+    uint32_t checksum;    // 4-byte checksum for header validation
+};
+#pragma pack(pop)
+
+/**
+ * Header preceding each frame written to the output pipe with
+ * --pipe-format=v2, in place of struct frame_header
+ *
+ * The header (FRAME_HEADER_V2_SIZE bytes) is followed by data_size bytes
+ * containing the planes. Each plane starts at plane_offsets[i] bytes from the
+ * start of the header, and its rows are plane_strides[i] bytes apart. The
+ * offsets and the strides are multiples of FRAME_HEADER_V2_ALIGN, so that a
+ * consumer reading the header and its data into a buffer aligned on
+ * FRAME_HEADER_V2_ALIGN bytes can process the planes in place, with aligned
+ * SIMD loads. The padding bytes are unspecified.
+ *
+ * The timestamp is the capture time, in nanoseconds since the Unix epoch (with
+ * a precision of one microsecond), or -1 if unknown.
+ *
+ * The sequence is the frame number (the same number as in the drop records and
+ * in the names of the saved frames), so that the gaps are explicit:
+ * FRAME_FLAG_DISCONTINUITY is set on the first frame piped after frames
+ * which were not (each of them is reported by a drop record).
+ *
+ * Consumers must check the version, and skip header_size bytes (which may
+ * grow in later versions, the new fields being appended in the reserved
+ * bytes) to reach the start of the data.
+ *
+ * The checksum is the CRC-32C of the header (without the checksum field), so
+ * that after a partial read, a consumer can resynchronize on the next header
+ * by searching the magic and validating the checksum, without relying on
+ * delimiters which may appear in the image data. With
+ * FRAME_FLAG_PAYLOAD_CRC, payload_crc is the CRC-32C of the data_size bytes
+ * following the header (padding included).
+ *
+ * With FRAME_FLAG_FILTERED_TIMESTAMP, filtered_timestamp_ns is the capture
+ * time smoothed against the arrival times of the frames on the client (see
+ * timestamp_filter.h): it is strictly increasing and free of the encoder
+ * jitter. FRAME_FLAG_TIMESTAMP_OUTLIER is set when the raw timestamp was too
+ * far from the prediction (its filtered timestamp is the prediction). The v1
+ * headers carry the raw timestamp only.
+ *
+ * With FRAME_FLAG_EXPOSURE (--capture-exposure), the exposure of the camera
+ * frame is known: the timestamp is the start of the exposure of its first row,
+ * exposure_ns the exposure time of each row, and readout_ns the rolling
+ * shutter skew (the delay between the start of the exposure of the first and
+ * the last rows, 0 for a global shutter). The middle of the exposure of the
+ * row y of the image content (below content_y, of h = height - content_y
+ * rows) is:
+ *
+ *     timestamp_ns + exposure_ns / 2 + readout_ns * y / (h - 1)
+ *
+ * and mid_exposure_ns is the one of the middle row. For rectified frames, y is
+ * the row of the captured image, approximated by the row of the rectified one.
+ */
+#define FRAME_HEADER_V2_VERSION 2
+#define FRAME_HEADER_V2_SIZE 128
+#define FRAME_HEADER_V2_ALIGN 64
+#define FRAME_HEADER_V2_MAX_PLANES 3
+
+#pragma pack(push, 1)
+struct frame_header_v2 {
+    uint8_t magic[4];         // FRAME_HEADER_V2_MAGIC
+    uint16_t version;         // FRAME_HEADER_V2_VERSION
+    uint16_t header_size;     // FRAME_HEADER_V2_SIZE
+    uint16_t pixel_format;    // FRAME_PIXEL_FORMAT_*
+    uint16_t layout;          // FRAME_LAYOUT_*
+    uint32_t flags;           // FRAME_FLAG_*
+    uint64_t sequence;        // frame number
+    int64_t timestamp_ns;     // capture time, -1 if unknown
+    int32_t width;
+    int32_t height;
+    // Number of rows of the timestamps bar (--show-timestamps) above the
+    // image content
+    uint32_t content_y;
+    uint32_t plane_count;
+    uint32_t plane_offsets[FRAME_HEADER_V2_MAX_PLANES]; // from the header start
+    uint32_t plane_strides[FRAME_HEADER_V2_MAX_PLANES]; // in bytes
+    uint32_t data_size;       // bytes following the header
+    uint32_t payload_crc;     // 0 without FRAME_FLAG_PAYLOAD_CRC
+    // Filtered capture time, 0 without FRAME_FLAG_FILTERED_TIMESTAMP
+    int64_t filtered_timestamp_ns;
+    // Middle of the exposure of the middle row, 0 without FRAME_FLAG_EXPOSURE
+    int64_t mid_exposure_ns;
+    uint32_t exposure_ns;     // 0 without FRAME_FLAG_EXPOSURE
+    uint32_t readout_ns;      // 0 without FRAME_FLAG_EXPOSURE
+    uint8_t reserved[20];     // zero
+    uint32_t checksum;        // see calculate_header_v2_checksum()
+};
+#pragma pack(pop)
+
+static const uint8_t FRAME_HEADER_V2_MAGIC[4] = {'S', 'C', 'F', 'R'};
+
+// 3 planes: Y (width x height), then U and V (width/2 x height/2)
+#define FRAME_PIXEL_FORMAT_YUV420P 1
+// 1 plane of signed 16-bit disparities (see struct frame_depth_tag)
+#define FRAME_PIXEL_FORMAT_DISPARITY_S16 2
+// 1 plane: Y (width x height), without chroma (--output-planes=y)
+#define FRAME_PIXEL_FORMAT_GRAY8 3
+
+// A single image
+#define FRAME_LAYOUT_MONO 0
+// The left and right eyes side by side, each one on half the width
+#define FRAME_LAYOUT_SIDE_BY_SIDE 1
+
+// The eyes are rectified (--opencv-map or --opencv-calib)
+#define FRAME_FLAG_RECTIFIED 0x1
+// Some frames before this one were not piped (see the drop records)
+#define FRAME_FLAG_DISCONTINUITY 0x2
+// payload_crc is set (--pipe-payload-crc)
+#define FRAME_FLAG_PAYLOAD_CRC 0x4
+// filtered_timestamp_ns is set
+#define FRAME_FLAG_FILTERED_TIMESTAMP 0x8
+// The raw timestamp is an outlier of the timestamp filter
+#define FRAME_FLAG_TIMESTAMP_OUTLIER 0x10
+// mid_exposure_ns, exposure_ns and readout_ns are set (--capture-exposure)
+#define FRAME_FLAG_EXPOSURE 0x20
+
+/**
+ * Tag preceding each frame header written to the output pipe when several
+ * devices are captured at once (--multi-device)
+ *
+ * The device index is the position of the device in the --multi-device list
+ * (the mapping between the indexes and the serials is logged on start).
+ */
+#pragma pack(push, 1)
+struct frame_device_tag {
+    uint8_t magic[4];       // FRAME_DEVICE_TAG_MAGIC
+    uint32_t device_index;  // 4-byte device index
+};
+#pragma pack(pop)
+
+static const uint8_t FRAME_DEVICE_TAG_MAGIC[4] = {'S', 'C', 'D', 'V'};
+
+/**
+ * Tag preceding the frame header of each disparity map written to the output
+ * pipe (--pipe-depth), after the device tag if any
+ *
+ * Each map immediately follows the frame it is computed from. Its header has
+ * the timestamp of that frame and the size of the map, and its data are
+ * width * height signed 16-bit disparities (in host byte order, row by row),
+ * in 1/16 pixel at the map resolution, negative where unknown.
+ *
+ * The map covers one eye: its width is the half width of the frame (without
+ * the timestamps bar) divided by `scale`, and so is its height.
+ */
+#pragma pack(push, 1)
+struct frame_depth_tag {
+    uint8_t magic[4];  // FRAME_DEPTH_TAG_MAGIC
+    uint32_t scale;    // downscale factor from the frame to the map
+};
+#pragma pack(pop)
+
+static const uint8_t FRAME_DEPTH_TAG_MAGIC[4] = {'S', 'C', 'D', 'P'};
+
+/**
+ * Tag preceding the v2 frame header of each pyramid level written to the
+ * output pipe (--output-pyramid), after the device tag if any
+ *
+ * The selected levels immediately follow the frame they are computed from, in
+ * increasing order. Each one is a GRAY8 side-by-side frame: the Y plane of
+ * the frame reduced `level` times by 2 in both directions (each eye
+ * separately), with the sequence, timestamp and flags of the frame. Its
+ * content_y is the number of rows of the timestamps bar at this level
+ * (rounded up).
+ */
+#pragma pack(push, 1)
+struct frame_pyramid_tag {
+    uint8_t magic[4];  // FRAME_PYRAMID_TAG_MAGIC
+    uint32_t level;    // 1 for the half resolution, 2 for the quarter, etc.
+};
+#pragma pack(pop)
+
+static const uint8_t FRAME_PYRAMID_TAG_MAGIC[4] = {'S', 'C', 'P', 'Y'};
+
+/**
+ * Header of each feature packet written to the output pipe with
+ * --pipe-output=features, in place of the decoded frames, after the device
+ * tag if any
+ *
+ * The features are extracted from the luma of each rectified eye (below the
+ * timestamps bar, if any): ORB keypoints (FAST corners, on a pyramid of 8
+ * levels) with their 256-bit rBRIEF descriptors.
+ *
+ * The header is followed by the keypoints of the left eye then of the right
+ * eye (counts[0] + counts[1] records, struct frame_keypoint), then by their
+ * descriptors, in the same order (descriptor_size bytes each). The keypoint
+ * coordinates are in pixels in the image of their eye.
+ *
+ * The timestamp is the capture time of the frame, in nanoseconds since the
+ * Unix epoch (with a precision of one microsecond), or -1 if unknown.
+ *
+ * The checksum is the CRC-32C of the header (see calculate_crc32c()), without
+ * the checksum field.
+ */
+#pragma pack(push, 1)
+struct frame_features_header {
+    uint8_t magic[4];         // FRAME_FEATURES_MAGIC
+    uint32_t flags;           // FRAME_FLAG_*
+    uint64_t sequence;        // frame number
+    int64_t timestamp_ns;     // capture time, -1 if unknown
+    uint32_t eye_width;
+    uint32_t eye_height;
+    uint32_t counts[2];       // keypoints of the left and right eyes
+    uint32_t descriptor_size; // in bytes
+    uint32_t data_size;       // bytes following the header
+    uint32_t checksum;
+};
+
+struct frame_keypoint {
+    float x;
+    float y;
+    float size;               // diameter of the neighborhood, in pixels
+    float angle;              // orientation, in degrees [0, 360)
+    float response;           // corner strength (Harris score)
+    int32_t octave;           // pyramid level where it was detected
+};
+#pragma pack(pop)
+
+static const uint8_t FRAME_FEATURES_MAGIC[4] = {'S', 'C', 'F', 'T'};
+
+/**
+ * Header of each block of decoded audio written to the output pipe
+ * (--pipe-audio), between the frames
+ *
+ * The magic distinguishes the audio blocks from the frame headers (starting
+ * with FRAME_DELIMITER). The header is followed by data_size bytes of
+ * interleaved samples (32-bit float), sample_count per channel (20 ms).
+ *
+ * The timestamp is the capture time of the first sample, computed as for the
+ * video frames.
+ */
+#pragma pack(push, 1)
+struct audio_block_header {
+    uint8_t magic[4];      // AUDIO_BLOCK_MAGIC
+    int64_t timestamp_ms;  // 8-byte timestamp, -1 if unknown
+    uint32_t sample_rate;  // in Hz
+    uint16_t channels;
+    uint16_t format;       // AUDIO_BLOCK_FORMAT_F32
+    uint32_t sample_count; // per channel
+    uint32_t data_size;    // in bytes
+};
+#pragma pack(pop)
+
+static const uint8_t AUDIO_BLOCK_MAGIC[4] = {'S', 'C', 'A', 'U'};
+#define AUDIO_BLOCK_FORMAT_F32 1
+
+/**
+ * Header of each encoded video packet written to the output pipe with
+ * --pipe-output=packets, in place of the decoded frames
+ *
+ * The header is followed by size bytes of packet data, as encoded by the
+ * device. The config packets (FRAME_PACKET_FLAG_CONFIG) contain the codec
+ * configuration sent by the device (e.g. the H.264 and H.265 parameter sets,
+ * in Annex B format). With H.264 and H.265, the last config is also prepended
+ * to the next media packet, so that a consumer may start decoding at the
+ * first key frame following a config packet.
+ *
+ * The timestamp is the capture time, computed as for the video frames, in
+ * nanoseconds since the Unix epoch (with a precision of one microsecond), or
+ * -1 if unknown. The PTS is the device presentation timestamp, in
+ * microseconds (-1 for the config records).
+ *
+ * The checksum is the CRC-32C of the header (see calculate_crc32c()), without
+ * the checksum field.
+ */
+#pragma pack(push, 1)
+struct frame_packet_header {
+    uint8_t magic[4];      // FRAME_PACKET_MAGIC
+    uint32_t codec_id;     // FRAME_CODEC_ID_*
+    uint32_t flags;        // FRAME_PACKET_FLAG_*
+    uint32_t size;         // bytes of packet data following the header
+    uint64_t sequence;     // packet number, config records included
+    int64_t pts_us;        // device PTS, -1 if none
+    int64_t timestamp_ns;  // capture time, -1 if unknown
+    uint32_t checksum;
+};
+#pragma pack(pop)
+
+static const uint8_t FRAME_PACKET_MAGIC[4] = {'S', 'C', 'P', 'K'};
+// The codec names in ASCII, as integers (same values as the device protocol)
+#define FRAME_CODEC_ID_H264 UINT32_C(0x68323634) // "h264"
+#define FRAME_CODEC_ID_H265 UINT32_C(0x68323635) // "h265"
+#define FRAME_CODEC_ID_AV1 UINT32_C(0x00617631) // "av1"
+// The data are the codec extradata (or a config packet sent by the device)
+#define FRAME_PACKET_FLAG_CONFIG 0x1
+#define FRAME_PACKET_FLAG_KEY_FRAME 0x2
+
+/**
+ * Record written to the output pipe (--pipe-output) in place of each frame
+ * dropped by the client before being piped, after the device tag if any
+ *
+ * The frame number is the index of the frame among the frames decoded (the
+ * same number as in the names of the saved frames), and the timestamp its
+ * capture time, so that the consumers know exactly which frames are missing.
+ */
+#pragma pack(push, 1)
+struct frame_drop_record {
+    uint8_t magic[4];       // FRAME_DROP_MAGIC
+    uint32_t reason;        // FRAME_DROP_REASON_*
+    uint64_t frame_number;
+    int64_t timestamp_ms;   // 8-byte timestamp, -1 if unknown
+};
+#pragma pack(pop)
+
+static const uint8_t FRAME_DROP_MAGIC[4] = {'S', 'C', 'D', 'R'};
+#define FRAME_DROP_REASON_OVERWRITTEN 0  // replaced by a newer frame
+#define FRAME_DROP_REASON_SINK_BUSY 1    // the consumer was not ready
+#define FRAME_DROP_REASON_WRITE_FAILED 2
+#define FRAME_DROP_REASON_QUEUE_FULL 3   // the processing was too slow
+#define FRAME_DROP_REASON_DECODE_ERROR 4
+// Not actually dropped: the device repeated the previous frame (the captured
+// content did not change), and the repetition was skipped
+// (--skip-repeated-frames), or the frame barely differed from the previous one
+// output (--motion-threshold)
+#define FRAME_DROP_REASON_REPEATED 5
+
+/**
+ * Record sent by the consumer of the output pipe on the feedback connection
+ * (--pipe-feedback), to bound the number of frames in flight
+ *
+ * The consumer connects over TCP, and acknowledges the frames it has
+ * processed with PIPE_FEEDBACK_ACK records (value: the sequence number of the
+ * last frame processed, as in the v2 header). It may report its capacity with
+ * a PIPE_FEEDBACK_CAPACITY record (value: the number of piped frames it
+ * accepts beyond the last acknowledgement, 0 to disable the backpressure).
+ *
+ * When the capacity is reached, the next frames are not written in full: only
+ * their Y plane is piped (--pipe-backpressure=luma), up to twice the capacity,
+ * or a struct frame_drop_record with FRAME_DROP_REASON_SINK_BUSY is written in
+ * their place, so that the latency of the consumer stays bounded without
+ * blocking the capture.
+ *
+ * As in the timestamp index, the fields are written in little-endian.
+ */
+#pragma pack(push, 1)
+struct pipe_feedback_record {
+    uint8_t magic[4];       // PIPE_FEEDBACK_MAGIC
+    uint32_t type;          // PIPE_FEEDBACK_*
+    uint64_t value;
+};
+#pragma pack(pop)
+
+static const uint8_t PIPE_FEEDBACK_MAGIC[4] = {'S', 'C', 'F', 'B'};
+#define PIPE_FEEDBACK_ACK 0
+#define PIPE_FEEDBACK_CAPACITY 1
+
+/**
+ * Headset pose sample (--pose-rate), written to the output pipe before the
+ * next frame (after the device tag if any), and stored in the frame archive
+ * (see frame_archive.h)
+ *
+ * The timestamp is the capture time of the sample, on the same clock as the
+ * frame timestamps, but in microseconds (the samples are more frequent than
+ * the frames). The rotation is a unit quaternion, and the translation is zero
+ * if POSE_SAMPLE_FLAG_POSITION is not set (the device only reports the
+ * orientation).
+ */
+#pragma pack(push, 1)
+struct pose_sample_record {
+    uint8_t magic[4];       // POSE_SAMPLE_MAGIC
+    uint32_t flags;         // POSE_SAMPLE_FLAG_*
+    int64_t timestamp_us;   // 8-byte timestamp, -1 if unknown
+    float rotation[4];      // quaternion {x, y, z, w}
+    float translation[3];   // {x, y, z}, in meters
+};
+#pragma pack(pop)
+
+static const uint8_t POSE_SAMPLE_MAGIC[4] = {'S', 'C', 'P', 'S'};
+#define POSE_SAMPLE_FLAG_POSITION 1
+
+/**
+ * Timestamp index written along a recording (--record-timestamps), to
+ * "<record file>.ts.idx"
+ *
+ * The header is followed by one entry per recorded video frame, in the order
+ * of the frames in the recording, so that the entry of the frame N is at
+ * offset sizeof(struct timestamp_index_header) +
+ * N * sizeof(struct timestamp_index_entry).
+ *
+ * Contrary to the frame headers, the fields are written in little-endian, the
+ * file being read later, possibly on another machine.
+ */
+#pragma pack(push, 1)
+struct timestamp_index_header {
+    uint8_t magic[4];   // TIMESTAMP_INDEX_MAGIC
+    uint32_t version;   // TIMESTAMP_INDEX_VERSION
+};
+
+struct timestamp_index_entry {
+    int64_t pts_us;        // PTS of the frame in the recording, in microseconds
+    int64_t timestamp_ms;  // capture time since the Unix epoch, -1 if unknown
+};
+#pragma pack(pop)
+
+static const uint8_t TIMESTAMP_INDEX_MAGIC[4] = {'S', 'C', 'T', 'I'};
+#define TIMESTAMP_INDEX_VERSION 1
+
+/**
+ * Connection of a capture node to a central aggregator (--aggregator)
+ *
+ * The node connects over TCP, sends a struct uplink_hello, then the records of
+ * all its streams multiplexed on this single connection: each record is a
+ * struct uplink_record_header followed by size bytes of payload.
+ *
+ * The first record of each stream is an UPLINK_RECORD_STREAM (payload: struct
+ * uplink_stream_info), followed by its UPLINK_RECORD_PACKET records (payload:
+ * the encoded packet as received from the device, the config packets having
+ * UPLINK_RECORD_FLAG_CONFIG). The pose samples are UPLINK_RECORD_POSE records
+ * (payload: a struct pose_sample_record). An UPLINK_RECORD_END record ends the
+ * session.
+ *
+ * Flow control: the aggregator sends back the total number of record bytes
+ * (headers included) it has consumed, as an 8-byte integer, at least each time
+ * it has consumed UPLINK_WINDOW / 2 bytes since the last acknowledgement, and
+ * for the UPLINK_RECORD_END record. The node never sends more than
+ * UPLINK_WINDOW bytes beyond the last acknowledgement: when the aggregator (or
+ * the network) is too slow, the records are queued, then dropped (the video
+ * packets until the next key frame), and the next record of the stream has
+ * UPLINK_RECORD_FLAG_DISCONTINUITY.
+ *
+ * The timestamps are the capture times, computed as for the frames, in
+ * microseconds since the Unix epoch (-1 if unknown), and the PTS the device
+ * PTS in microseconds (-1 if none).
+ *
+ * As in the timestamp index, the fields (and the pose samples) are written in
+ * little-endian.
+ */
+#pragma pack(push, 1)
+struct uplink_hello {
+    uint8_t magic[4];   // UPLINK_MAGIC
+    uint32_t version;   // UPLINK_VERSION
+    char node[32];      // name of the node, NUL-padded
+};
+
+struct uplink_record_header {
+    uint8_t type;          // UPLINK_RECORD_*
+    uint8_t stream;        // UPLINK_STREAM_*
+    uint16_t flags;        // UPLINK_RECORD_FLAG_*
+    uint32_t size;         // bytes of payload following the header
+    int64_t pts_us;        // device PTS, -1 if none
+    int64_t timestamp_us;  // capture time, -1 if unknown
+};
+
+struct uplink_stream_info {
+    uint32_t codec_id;     // FRAME_CODEC_ID_* or UPLINK_CODEC_ID_*
+    uint32_t width;        // 0 for audio
+    uint32_t height;       // 0 for audio
+    uint32_t sample_rate;  // 0 for video
+    uint32_t channels;     // 0 for video
+};
+#pragma pack(pop)
+
+static const uint8_t UPLINK_MAGIC[4] = {'S', 'C', 'U', 'L'};
+#define UPLINK_VERSION 1
+#define UPLINK_WINDOW (16 * 1024 * 1024)
+
+#define UPLINK_RECORD_STREAM 0
+#define UPLINK_RECORD_PACKET 1
+#define UPLINK_RECORD_POSE 2
+#define UPLINK_RECORD_END 3
+
+#define UPLINK_STREAM_VIDEO 0
+#define UPLINK_STREAM_VIDEO_RIGHT 1 // --split-eyes
+#define UPLINK_STREAM_CAMERA 2      // --camera-record
+#define UPLINK_STREAM_AUDIO 3
+#define UPLINK_STREAM_POSE 4        // --pose-rate
+#define UPLINK_STREAM_COUNT 5
+
+#define UPLINK_RECORD_FLAG_CONFIG 0x1
+#define UPLINK_RECORD_FLAG_KEY_FRAME 0x2
+// Some records of the stream were dropped just before this one
+#define UPLINK_RECORD_FLAG_DISCONTINUITY 0x4
+
+// The audio codec names in ASCII, as integers (same values as the device
+// protocol)
+#define UPLINK_CODEC_ID_OPUS UINT32_C(0x6f707573) // "opus"
+#define UPLINK_CODEC_ID_AAC UINT32_C(0x00616163) // "aac"
+#define UPLINK_CODEC_ID_FLAC UINT32_C(0x666c6163) // "flac"
+#define UPLINK_CODEC_ID_RAW UINT32_C(0x00726177) // "raw"
+
+// Delimiter of the v1 frame headers
+//
+// It does not appear in limited range YUV420P data (Y max is 235, U and V max
+// are 240), but nothing prevents it in full range data: to resynchronize
+// reliably, use the v2 headers (and their CRC-32C).
+static const uint8_t FRAME_DELIMITER[8] = {
+    0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF
+};
+
+// Calculate checksum for header validation
+//
+// Kept for compatibility with the existing v1 consumers: only the last bytes
+// of the header actually influence it.
+static inline uint32_t
+calculate_header_checksum(const struct frame_header *header) {
+    uint32_t checksum = 0;
+    const uint8_t *data = (const uint8_t *)header;
+    // Skip the checksum field itself in calculation
+    size_t size = sizeof(struct frame_header) - sizeof(uint32_t);
+    
+    for (size_t i = 0; i < size; i++) {
+        checksum = (checksum << 8) ^ data[i];
+    }
+    return checksum;
+}
+
+// CRC-32C (Castagnoli, reflected polynomial 0x82f63b78), bit by bit
+//
+// Reference implementation for the consumers: the client computes the same
+// value with the crc32c instructions of the CPU (see util/crc32c.h).
+static inline uint32_t
+calculate_crc32c(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *) data;
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= p[i];
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+// Calculate the checksum (CRC-32C) of a v2 header
+static inline uint32_t
+calculate_header_v2_checksum(const struct frame_header_v2 *header) {
+    // The checksum is the last field
+    return calculate_crc32c(0, header,
+                            sizeof(struct frame_header_v2) - sizeof(uint32_t));
+}
+
+#endif
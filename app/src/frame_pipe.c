@@ -0,0 +1,526 @@
+#include "frame_pipe.h"
+
+#ifdef _WIN32
+# include <fcntl.h>
+# include <io.h>
+#endif
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/frame.h>
+
+#include "frame_header.h"
+#include "video_preprocess.h"
+#include "util/crc32c.h"
+#include "util/file.h"
+#include "util/log.h"
+
+// Set if the records are not written to stdout
+static bool sc_frame_pipe_redirected;
+
+bool
+sc_frame_pipe_open(const char *target, uint32_t buffer_size) {
+    if (!sc_file_open_output(target, buffer_size)) {
+        return false;
+    }
+
+    sc_frame_pipe_redirected = true;
+    return true;
+}
+
+void
+sc_frame_pipe_close(void) {
+    assert(sc_frame_pipe_redirected);
+    if (!sc_file_close_output()) {
+        LOGW("Could not write all the records to the pipe output");
+    }
+    sc_frame_pipe_redirected = false;
+}
+
+void
+sc_frame_pipe_init(void) {
+    if (sc_frame_pipe_redirected) {
+        // stdout is left to the text logs
+        return;
+    }
+
+#ifdef _WIN32
+    // Set stdout to binary mode on Windows
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    // The frames are written directly to the stdout file descriptor, the
+    // text logs must not be interleaved
+    sc_log_reserve_stdout();
+}
+
+static_assert(sizeof(struct frame_header_v2) == FRAME_HEADER_V2_SIZE,
+              "Unexpected v2 header size");
+
+// Chunks of the tags, the header and the planes written at once, if the planes
+// are not split into rows
+#define SC_FRAME_PIPE_V2_CHUNKS 8
+
+static int64_t
+to_ms(int64_t timestamp_us) {
+    return timestamp_us < 0 ? -1 : timestamp_us / 1000;
+}
+
+static void
+init_header(struct frame_header *header, int64_t timestamp_ms, int width,
+            int height, uint32_t frame_size) {
+    *header = (struct frame_header) {
+        .timestamp_ms = timestamp_ms,
+        .width = width,
+        .height = height,
+        .frame_size = frame_size
+    };
+    memcpy(header->delimiter, FRAME_DELIMITER, sizeof(FRAME_DELIMITER));
+
+    // Calculate and set checksum
+    header->checksum = calculate_header_checksum(header);
+}
+
+static void
+append_device_tag(struct sc_file_chunk *chunks, size_t *count,
+                  struct frame_device_tag *tag, int device_index) {
+    if (device_index >= 0) {
+        memcpy(tag->magic, FRAME_DEVICE_TAG_MAGIC, sizeof(tag->magic));
+        tag->device_index = (uint32_t) device_index;
+        chunks[(*count)++] = (struct sc_file_chunk) {tag, sizeof(*tag)};
+    }
+}
+
+static void
+append_plane(struct sc_file_chunk *chunks, size_t *count, const uint8_t *data,
+             int linesize, size_t row_size, int rows) {
+    if ((size_t) linesize == row_size) {
+        // Fast path: the plane is contiguous
+        chunks[(*count)++] = (struct sc_file_chunk) {data, row_size * rows};
+    } else {
+        for (int i = 0; i < rows; ++i) {
+            const uint8_t *row = data + i * linesize;
+            chunks[(*count)++] = (struct sc_file_chunk) {row, row_size};
+        }
+    }
+}
+
+static bool
+write_chunks(const struct sc_frame_pipe_dest *dest,
+             const struct sc_file_chunk *chunks, size_t count) {
+    if (!dest) {
+        return sc_file_write_output(chunks, count);
+    }
+    return dest->write(chunks, count, dest->userdata);
+}
+
+static size_t
+align_stride(size_t size) {
+    return (size + FRAME_HEADER_V2_ALIGN - 1)
+         & ~(size_t) (FRAME_HEADER_V2_ALIGN - 1);
+}
+
+// Write the planes of a frame, preceded by the `prefix` chunks (the tags, if
+// any) and its v2 header
+static bool
+write_frame_v2(const struct sc_frame_pipe_dest *dest, const AVFrame *frame,
+               const struct sc_frame_pipe_info *info,
+               unsigned pixel_format, unsigned layout,
+               const size_t row_sizes[], const int rows[],
+               unsigned plane_count, const struct sc_file_chunk *prefix,
+               size_t prefix_count) {
+    assert(plane_count <= FRAME_HEADER_V2_MAX_PLANES);
+
+    // Padding of the rows, shorter than the alignment
+    static const uint8_t zeros[FRAME_HEADER_V2_ALIGN] = {0};
+
+    struct frame_header_v2 header = {
+        .version = FRAME_HEADER_V2_VERSION,
+        .header_size = FRAME_HEADER_V2_SIZE,
+        .pixel_format = pixel_format,
+        .layout = layout,
+        .flags = info->flags,
+        .sequence = info->sequence,
+        .timestamp_ns = info->timestamp_us < 0 ? -1
+                                               : info->timestamp_us * 1000,
+        .filtered_timestamp_ns =
+            info->flags & FRAME_FLAG_FILTERED_TIMESTAMP
+                ? info->filtered_timestamp_us * 1000 : 0,
+        .mid_exposure_ns = info->flags & FRAME_FLAG_EXPOSURE
+                         ? info->mid_exposure_us * 1000 : 0,
+        .exposure_ns = info->flags & FRAME_FLAG_EXPOSURE
+                     ? info->exposure_ns : 0,
+        .readout_ns = info->flags & FRAME_FLAG_EXPOSURE
+                    ? info->readout_ns : 0,
+        .width = frame->width,
+        .height = frame->height,
+        .content_y = info->content_y,
+        .plane_count = plane_count,
+    };
+    memcpy(header.magic, FRAME_HEADER_V2_MAGIC, sizeof(header.magic));
+
+    // The planes are written as is if their linesizes are already aligned
+    // (the usual case), otherwise row by row, with padding
+    bool as_is[FRAME_HEADER_V2_MAX_PLANES];
+    size_t chunk_count = prefix_count + 1;
+    size_t offset = FRAME_HEADER_V2_SIZE;
+    for (unsigned i = 0; i < plane_count; ++i) {
+        int linesize = frame->linesize[i];
+        as_is[i] = linesize >= 0 && (size_t) linesize >= row_sizes[i]
+                && !(linesize % FRAME_HEADER_V2_ALIGN);
+        size_t stride = as_is[i] ? (size_t) linesize
+                                 : align_stride(row_sizes[i]);
+        header.plane_offsets[i] = offset;
+        header.plane_strides[i] = stride;
+        offset += stride * rows[i];
+        chunk_count += as_is[i] ? 1 : 2 * rows[i];
+    }
+    header.data_size = offset - FRAME_HEADER_V2_SIZE;
+
+    struct sc_file_chunk stack_chunks[SC_FRAME_PIPE_V2_CHUNKS];
+    struct sc_file_chunk *chunks = stack_chunks;
+    if (chunk_count > SC_FRAME_PIPE_V2_CHUNKS) {
+        chunks = malloc(chunk_count * sizeof(*chunks));
+        if (!chunks) {
+            LOG_OOM();
+            return false;
+        }
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < prefix_count; ++i) {
+        chunks[count++] = prefix[i];
+    }
+    chunks[count++] = (struct sc_file_chunk) {&header, sizeof(header)};
+    size_t payload_index = count;
+
+    for (unsigned i = 0; i < plane_count; ++i) {
+        const uint8_t *data = frame->data[i];
+        int linesize = frame->linesize[i];
+        if (as_is[i]) {
+            // The padding of the rows is written along
+            chunks[count++] =
+                (struct sc_file_chunk) {data, (size_t) linesize * rows[i]};
+        } else {
+            size_t padding = header.plane_strides[i] - row_sizes[i];
+            for (int y = 0; y < rows[i]; ++y) {
+                const uint8_t *row = data + y * linesize;
+                chunks[count++] =
+                    (struct sc_file_chunk) {row, row_sizes[i]};
+                chunks[count++] = (struct sc_file_chunk) {zeros, padding};
+            }
+        }
+    }
+    assert(count == chunk_count);
+
+    if (header.flags & FRAME_FLAG_PAYLOAD_CRC) {
+        // Computed over the chunks, exactly as they are written
+        uint32_t crc = 0;
+        for (size_t i = payload_index; i < count; ++i) {
+            crc = sc_crc32c(crc, chunks[i].data, chunks[i].size);
+        }
+        header.payload_crc = crc;
+    }
+    // Same value as calculate_header_v2_checksum(), with the crc32c
+    // instructions
+    header.checksum =
+        sc_crc32c(0, &header, sizeof(header) - sizeof(header.checksum));
+
+    bool ok = write_chunks(dest, chunks, count);
+
+    if (chunks != stack_chunks) {
+        free(chunks);
+    }
+
+    return ok;
+}
+
+static bool
+write_frame(const struct sc_frame_pipe_dest *dest, const AVFrame *frame,
+            const struct sc_frame_pipe_info *info, int device_index) {
+    int w = frame->width;
+    int h = frame->height;
+    assert(h <= SC_FRAME_PIPE_MAX_ROWS);
+
+    // Only the Y plane with --output-planes=y
+    bool gray = frame->format == AV_PIX_FMT_GRAY8;
+    assert(gray || frame->format == AV_PIX_FMT_YUV420P);
+    int plane_count = gray ? 1 : 3;
+
+    struct frame_device_tag tag;
+
+    if (info->format == SC_PIPE_FORMAT_V2) {
+        struct sc_file_chunk prefix[1];
+        size_t prefix_count = 0;
+        append_device_tag(prefix, &prefix_count, &tag, device_index);
+
+        size_t row_sizes[3] = {w, w / 2, w / 2};
+        int rows[3] = {h, h / 2, h / 2};
+        unsigned pixel_format = gray ? FRAME_PIXEL_FORMAT_GRAY8
+                                     : FRAME_PIXEL_FORMAT_YUV420P;
+        return write_frame_v2(dest, frame, info, pixel_format,
+                              FRAME_LAYOUT_SIDE_BY_SIDE, row_sizes, rows,
+                              plane_count, prefix, prefix_count);
+    }
+
+    // Calculate frame size
+    uint32_t frame_size = w * h;              // Y plane
+    if (!gray) {
+        frame_size += (w * h) / 4;            // U plane
+        frame_size += (w * h) / 4;            // V plane
+    }
+
+    struct frame_header header;
+    init_header(&header, to_ms(info->timestamp_us), w, h, frame_size);
+
+    // Gather the tag, the header and the YUV420P planes, to write them at once
+    struct sc_file_chunk chunks[2 + SC_FRAME_PIPE_MAX_ROWS * 3 / 2];
+    size_t count = 0;
+    append_device_tag(chunks, &count, &tag, device_index);
+    chunks[count++] = (struct sc_file_chunk) {&header, sizeof(header)};
+
+    int plane_widths[3] = {w, w / 2, w / 2};
+    int plane_heights[3] = {h, h / 2, h / 2};
+    for (int p = 0; p < plane_count; ++p) {
+        append_plane(chunks, &count, frame->data[p], frame->linesize[p],
+                     plane_widths[p], plane_heights[p]);
+    }
+
+    return write_chunks(dest, chunks, count);
+}
+
+bool
+sc_frame_pipe_write(const AVFrame *frame,
+                    const struct sc_frame_pipe_info *info, int device_index) {
+    return write_frame(NULL, frame, info, device_index);
+}
+
+bool
+sc_frame_pipe_send(const struct sc_frame_pipe_dest *dest, const AVFrame *frame,
+                   const struct sc_frame_pipe_info *info) {
+    return write_frame(dest, frame, info, -1);
+}
+
+bool
+sc_frame_pipe_write_depth(const AVFrame *depth, unsigned scale,
+                          const struct sc_frame_pipe_info *info,
+                          int device_index) {
+    int w = depth->width;
+    int h = depth->height;
+    assert(h <= SC_FRAME_PIPE_MAX_ROWS);
+
+    size_t row_size = (size_t) w * sizeof(int16_t);
+
+    struct frame_device_tag tag;
+    struct frame_depth_tag depth_tag;
+    memcpy(depth_tag.magic, FRAME_DEPTH_TAG_MAGIC, sizeof(depth_tag.magic));
+    depth_tag.scale = scale;
+
+    if (info->format == SC_PIPE_FORMAT_V2) {
+        struct sc_file_chunk prefix[2];
+        size_t prefix_count = 0;
+        append_device_tag(prefix, &prefix_count, &tag, device_index);
+        prefix[prefix_count++] =
+            (struct sc_file_chunk) {&depth_tag, sizeof(depth_tag)};
+
+        // The map covers the left eye only, without the timestamps bar
+        struct sc_frame_pipe_info depth_info = *info;
+        depth_info.content_y = 0;
+        int rows = h;
+        return write_frame_v2(NULL, depth, &depth_info,
+                              FRAME_PIXEL_FORMAT_DISPARITY_S16,
+                              FRAME_LAYOUT_MONO, &row_size, &rows, 1, prefix,
+                              prefix_count);
+    }
+
+    struct frame_header header;
+    init_header(&header, to_ms(info->timestamp_us), w, h, row_size * h);
+
+    struct sc_file_chunk chunks[3 + SC_FRAME_PIPE_MAX_ROWS];
+    size_t count = 0;
+    append_device_tag(chunks, &count, &tag, device_index);
+    chunks[count++] = (struct sc_file_chunk) {&depth_tag, sizeof(depth_tag)};
+    chunks[count++] = (struct sc_file_chunk) {&header, sizeof(header)};
+    append_plane(chunks, &count, depth->data[0], depth->linesize[0], row_size,
+                 h);
+
+    return sc_file_write_output(chunks, count);
+}
+
+bool
+sc_frame_pipe_write_pyramid_level(const AVFrame *level_frame, unsigned level,
+                                  const struct sc_frame_pipe_info *info,
+                                  int device_index) {
+    assert(info->format == SC_PIPE_FORMAT_V2);
+    assert(level_frame->format == AV_PIX_FMT_GRAY8);
+    assert(level_frame->height <= SC_FRAME_PIPE_MAX_ROWS);
+
+    struct frame_device_tag tag;
+    struct frame_pyramid_tag pyramid_tag;
+    memcpy(pyramid_tag.magic, FRAME_PYRAMID_TAG_MAGIC,
+           sizeof(pyramid_tag.magic));
+    pyramid_tag.level = level;
+
+    struct sc_file_chunk prefix[2];
+    size_t prefix_count = 0;
+    append_device_tag(prefix, &prefix_count, &tag, device_index);
+    prefix[prefix_count++] =
+        (struct sc_file_chunk) {&pyramid_tag, sizeof(pyramid_tag)};
+
+    // The timestamps bar is reduced with the image
+    struct sc_frame_pipe_info level_info = *info;
+    level_info.content_y = (info->content_y + (1u << level) - 1) >> level;
+    size_t row_size = level_frame->width;
+    int rows = level_frame->height;
+    return write_frame_v2(NULL, level_frame, &level_info,
+                          FRAME_PIXEL_FORMAT_GRAY8, FRAME_LAYOUT_SIDE_BY_SIDE,
+                          &row_size, &rows, 1, prefix, prefix_count);
+}
+
+bool
+sc_frame_pipe_write_features(const struct sc_video_features *features,
+                             const struct sc_frame_pipe_info *info,
+                             int device_index) {
+    uint32_t total = features->counts[0] + features->counts[1];
+    struct frame_features_header header = {
+        .flags = info->flags,
+        .sequence = info->sequence,
+        .timestamp_ns = info->timestamp_us < 0 ? -1
+                                               : info->timestamp_us * 1000,
+        .eye_width = features->eye_width,
+        .eye_height = features->eye_height,
+        .counts = {features->counts[0], features->counts[1]},
+        .descriptor_size = SC_VIDEO_PREPROCESS_DESCRIPTOR_SIZE,
+        .data_size = total * (sizeof(struct frame_keypoint)
+                                + SC_VIDEO_PREPROCESS_DESCRIPTOR_SIZE),
+    };
+    memcpy(header.magic, FRAME_FEATURES_MAGIC, sizeof(header.magic));
+    header.checksum =
+        sc_crc32c(0, &header, sizeof(header) - sizeof(header.checksum));
+
+    // The keypoints then the descriptors of each eye, gathered in one write
+    struct frame_device_tag tag;
+    struct sc_file_chunk chunks[6];
+    size_t count = 0;
+    append_device_tag(chunks, &count, &tag, device_index);
+    chunks[count++] = (struct sc_file_chunk) {&header, sizeof(header)};
+    for (unsigned i = 0; i < 2; ++i) {
+        chunks[count++] = (struct sc_file_chunk) {
+            features->keypoints[i],
+            features->counts[i] * sizeof(struct frame_keypoint),
+        };
+    }
+    for (unsigned i = 0; i < 2; ++i) {
+        chunks[count++] = (struct sc_file_chunk) {
+            features->descriptors[i],
+            features->counts[i] * SC_VIDEO_PREPROCESS_DESCRIPTOR_SIZE,
+        };
+    }
+
+    return sc_file_write_output(chunks, count);
+}
+
+static bool
+write_drop(const struct sc_frame_pipe_dest *dest, uint64_t frame_number,
+           unsigned reason, int64_t timestamp_ms, int device_index) {
+    struct frame_drop_record record = {
+        .reason = reason,
+        .frame_number = frame_number,
+        .timestamp_ms = timestamp_ms,
+    };
+    memcpy(record.magic, FRAME_DROP_MAGIC, sizeof(record.magic));
+
+    struct frame_device_tag tag;
+    struct sc_file_chunk chunks[2];
+    size_t count = 0;
+    append_device_tag(chunks, &count, &tag, device_index);
+    chunks[count++] = (struct sc_file_chunk) {&record, sizeof(record)};
+
+    return write_chunks(dest, chunks, count);
+}
+
+bool
+sc_frame_pipe_write_drop(uint64_t frame_number, unsigned reason,
+                         int64_t timestamp_ms, int device_index) {
+    return write_drop(NULL, frame_number, reason, timestamp_ms, device_index);
+}
+
+bool
+sc_frame_pipe_send_drop(const struct sc_frame_pipe_dest *dest,
+                        uint64_t frame_number, unsigned reason,
+                        int64_t timestamp_ms) {
+    return write_drop(dest, frame_number, reason, timestamp_ms, -1);
+}
+
+bool
+sc_frame_pipe_write_poses(const struct pose_sample_record *samples,
+                          unsigned count, int device_index) {
+    if (device_index < 0) {
+        // The records are contiguous
+        struct sc_file_chunk chunk = {samples, count * sizeof(*samples)};
+        return sc_file_write_output(&chunk, 1);
+    }
+
+    for (unsigned i = 0; i < count; ++i) {
+        struct frame_device_tag tag;
+        struct sc_file_chunk chunks[2];
+        size_t n = 0;
+        append_device_tag(chunks, &n, &tag, device_index);
+        chunks[n++] = (struct sc_file_chunk) {&samples[i], sizeof(*samples)};
+        if (!sc_file_write_output(chunks, n)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool
+sc_frame_pipe_write_packet(const uint8_t *prefix, uint32_t prefix_size,
+                           const uint8_t *data, uint32_t size,
+                           uint32_t codec_id, uint32_t flags, uint64_t sequence,
+                           int64_t pts_us, int64_t timestamp_us) {
+    struct frame_packet_header header = {
+        .codec_id = codec_id,
+        .flags = flags,
+        .size = prefix_size + size,
+        .sequence = sequence,
+        .pts_us = pts_us,
+        .timestamp_ns = timestamp_us < 0 ? -1 : timestamp_us * 1000,
+    };
+    memcpy(header.magic, FRAME_PACKET_MAGIC, sizeof(header.magic));
+    header.checksum =
+        sc_crc32c(0, &header, sizeof(header) - sizeof(header.checksum));
+
+    // The prefix is gathered in the same write, the packet is not copied
+    struct sc_file_chunk chunks[] = {
+        {&header, sizeof(header)},
+        {prefix, prefix_size},
+        {data, size},
+    };
+    return sc_file_write_output(chunks, ARRAY_LEN(chunks));
+}
+
+bool
+sc_frame_pipe_write_audio(const uint8_t *data, uint32_t sample_count,
+                          unsigned sample_rate, unsigned channels,
+                          int64_t timestamp_ms) {
+    uint32_t data_size = sample_count * channels * sizeof(float);
+
+    struct audio_block_header header = {
+        .timestamp_ms = timestamp_ms,
+        .sample_rate = sample_rate,
+        .channels = channels,
+        .format = AUDIO_BLOCK_FORMAT_F32,
+        .sample_count = sample_count,
+        .data_size = data_size,
+    };
+    memcpy(header.magic, AUDIO_BLOCK_MAGIC, sizeof(header.magic));
+
+    struct sc_file_chunk chunks[] = {
+        {&header, sizeof(header)},
+        {data, data_size},
+    };
+    return sc_file_write_output(chunks, ARRAY_LEN(chunks));
+}
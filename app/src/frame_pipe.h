@@ -0,0 +1,203 @@
+#ifndef SC_FRAME_PIPE_H
+#define SC_FRAME_PIPE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "options.h"
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+struct pose_sample_record;
+struct sc_file_chunk;
+struct sc_video_features;
+
+// Maximum frame height for the pipe output (the rows of a non-contiguous plane
+// are written as separate chunks)
+#define SC_FRAME_PIPE_MAX_ROWS 4096
+
+/**
+ * Write the records to `target` instead of stdout (--pipe-target, see
+ * sc_file_open_output()), with a pipe buffer of `buffer_size` bytes
+ * (--pipe-buffer-size, 0 for the default size)
+ *
+ * It must be called before sc_frame_pipe_init().
+ */
+bool
+sc_frame_pipe_open(const char *target, uint32_t buffer_size);
+
+/**
+ * Wait for the records being written, and close the target opened by
+ * sc_frame_pipe_open()
+ */
+void
+sc_frame_pipe_close(void);
+
+/**
+ * Prepare the pipe output to receive the frames (--pipe-output)
+ *
+ * If the pipe output is stdout (no sc_frame_pipe_open()), the frames are
+ * written directly to the stdout file descriptor, so the text logs are
+ * redirected to stderr.
+ */
+void
+sc_frame_pipe_init(void);
+
+// The description of a piped frame
+struct sc_frame_pipe_info {
+    enum sc_pipe_format format;
+    int64_t timestamp_us; // capture time, -1 if unknown
+    // Only written in the v2 headers
+    uint64_t sequence; // frame number
+    // Number of the first frame skipped on purpose (--pipe-output-fps) just
+    // before this one, or sequence if none: the frames skipped on purpose are
+    // not discontinuities
+    uint64_t sampled_from;
+    uint32_t flags; // FRAME_FLAG_*
+    // Only with FRAME_FLAG_FILTERED_TIMESTAMP (see timestamp_filter.h)
+    int64_t filtered_timestamp_us;
+    // Only with FRAME_FLAG_EXPOSURE (see struct sc_frame_times)
+    int64_t mid_exposure_us;
+    uint32_t exposure_ns;
+    uint32_t readout_ns;
+    unsigned content_y; // rows of the timestamps bar
+};
+
+/**
+ * Write a YUV420P frame, preceded by its header (see frame_header.h), to
+ * the pipe output
+ *
+ * If device_index is not negative, the header is preceded by a device tag.
+ *
+ * With the v2 format, the frame is written as is if its linesizes are
+ * multiples of FRAME_HEADER_V2_ALIGN, otherwise its rows are padded.
+ *
+ * The frame height must not exceed SC_FRAME_PIPE_MAX_ROWS. The writes from
+ * several threads must be serialized by the caller.
+ */
+bool
+sc_frame_pipe_write(const AVFrame *frame,
+                    const struct sc_frame_pipe_info *info, int device_index);
+
+/**
+ * Destination of the records written by sc_frame_pipe_send*(), other than
+ * the pipe output (e.g. the socket of a subscriber of the frame publisher)
+ */
+struct sc_frame_pipe_dest {
+    // Write all the chunks, in order. Return false on error.
+    bool (*write)(const struct sc_file_chunk *chunks, size_t count,
+                  void *userdata);
+    void *userdata;
+};
+
+/**
+ * Write a frame as sc_frame_pipe_write() does (without device tag), to `dest`
+ */
+bool
+sc_frame_pipe_send(const struct sc_frame_pipe_dest *dest, const AVFrame *frame,
+                   const struct sc_frame_pipe_info *info);
+
+/**
+ * Write a disparity map (a single plane of 16-bit values, see
+ * sc_video_preprocess_compute_depth()), preceded by its depth tag and its
+ * header (see frame_header.h), to the
+ * pipe output
+ *
+ * The info are those of the frame the map is computed from (its format,
+ * sequence and timestamp). The same rules as sc_frame_pipe_write() apply.
+ */
+bool
+sc_frame_pipe_write_depth(const AVFrame *depth, unsigned scale,
+                          const struct sc_frame_pipe_info *info,
+                          int device_index);
+
+/**
+ * Write a level of the pyramid of a frame (a GRAY8 frame, see
+ * frame_pyramid.h), preceded by its pyramid tag and its v2 header (see
+ * frame_header.h), to the pipe output (--output-pyramid)
+ *
+ * The info are those of the frame the level is computed from. The format must
+ * be SC_PIPE_FORMAT_V2. The same rules as sc_frame_pipe_write() apply.
+ */
+bool
+sc_frame_pipe_write_pyramid_level(const AVFrame *level_frame, unsigned level,
+                                  const struct sc_frame_pipe_info *info,
+                                  int device_index);
+
+/**
+ * Write the features of a frame (see sc_video_preprocess_extract_features()),
+ * preceded by their header (see frame_header.h), to the pipe output
+ * (--pipe-output=features)
+ *
+ * The info are those of the frame the features are extracted from (its
+ * sequence, timestamp and flags). The same rules as sc_frame_pipe_write()
+ * apply.
+ */
+bool
+sc_frame_pipe_write_features(const struct sc_video_features *features,
+                             const struct sc_frame_pipe_info *info,
+                             int device_index);
+
+/**
+ * Write the record of a dropped frame (see frame_header.h), preceded by the
+ * device tag if device_index is not negative, to
+ * the pipe output
+ *
+ * The reason is one of FRAME_DROP_REASON_*. The same rules as
+ * sc_frame_pipe_write() apply.
+ */
+bool
+sc_frame_pipe_write_drop(uint64_t frame_number, unsigned reason,
+                         int64_t timestamp_ms, int device_index);
+
+/**
+ * Write the record of a dropped frame as sc_frame_pipe_write_drop() does
+ * (without device tag), to `dest`
+ */
+bool
+sc_frame_pipe_send_drop(const struct sc_frame_pipe_dest *dest,
+                        uint64_t frame_number, unsigned reason,
+                        int64_t timestamp_ms);
+
+/**
+ * Write headset pose samples (see frame_header.h), each one preceded by the
+ * device tag if device_index is not negative, to
+ * the pipe output
+ *
+ * The same rules as sc_frame_pipe_write() apply.
+ */
+bool
+sc_frame_pipe_write_poses(const struct pose_sample_record *samples,
+                          unsigned count, int device_index);
+
+/**
+ * Write an encoded video packet, preceded by its header (see frame_header.h),
+ * to the pipe output (--pipe-output=packets)
+ *
+ * If `prefix_size` is not 0, `prefix` (the codec config of a new encoding
+ * session) is written before the packet data, in the same record.
+ *
+ * The codec id and the flags are FRAME_CODEC_ID_* and FRAME_PACKET_FLAG_*.
+ * The writes from several threads must be serialized by the caller.
+ */
+bool
+sc_frame_pipe_write_packet(const uint8_t *prefix, uint32_t prefix_size,
+                           const uint8_t *data, uint32_t size,
+                           uint32_t codec_id, uint32_t flags, uint64_t sequence,
+                           int64_t pts_us, int64_t timestamp_us);
+
+/**
+ * Write a block of interleaved 32-bit float samples, preceded by its header
+ * (see frame_header.h), to the pipe output
+ *
+ * The writes from several threads must be serialized by the caller.
+ */
+bool
+sc_frame_pipe_write_audio(const uint8_t *data, uint32_t sample_count,
+                          unsigned sample_rate, unsigned channels,
+                          int64_t timestamp_ms);
+
+#endif
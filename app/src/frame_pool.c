@@ -0,0 +1,173 @@
+#include "frame_pool.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <libavutil/avutil.h>
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+
+#include "pool_memory.h"
+#include "util/log.h"
+
+// Suitable for SIMD, and for the aligned rows of the v2 pipe format (see
+// frame_header.h), so that the piped frames are written as is
+#define SC_FRAME_POOL_ALIGN 64
+
+void
+sc_frame_pool_init(struct sc_frame_pool *fp) {
+    fp->pool = NULL;
+    fp->format = AV_PIX_FMT_NONE;
+    fp->width = 0;
+    fp->height = 0;
+    fp->size = 0;
+}
+
+void
+sc_frame_pool_destroy(struct sc_frame_pool *fp) {
+    // The buffers still referenced are freed when they are released
+    av_buffer_pool_uninit(&fp->pool);
+}
+
+static AVBufferRef *
+sc_frame_pool_alloc(void *opaque, SC_AV_BUFFER_SIZE size) {
+    (void) opaque;
+    return sc_pool_memory_alloc(size);
+}
+
+static bool
+sc_frame_pool_configure(struct sc_frame_pool *fp, int format, int width,
+                        int height) {
+    int linesize[4];
+    int ret = av_image_fill_linesizes(linesize, format, width);
+    if (ret < 0) {
+        LOGE("Could not compute frame pool linesizes (%dx%d)", width, height);
+        return false;
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        linesize[i] = FFALIGN(linesize[i], SC_FRAME_POOL_ALIGN);
+    }
+
+    // With a NULL base pointer, the plane pointers are just offsets, and the
+    // total size is returned
+    uint8_t *data[4];
+    ret = av_image_fill_pointers(data, format, height, NULL, linesize);
+    if (ret < 0) {
+        LOGE("Could not compute frame pool size (%dx%d)", width, height);
+        return false;
+    }
+
+    // Some SIMD readers may read slightly past the end of the last plane
+    size_t size = (size_t) ret + SC_FRAME_POOL_ALIGN;
+
+    AVBufferPool *pool = sc_pool_memory_is_enabled()
+        ? av_buffer_pool_init2(size, NULL, sc_frame_pool_alloc, NULL)
+        : av_buffer_pool_init(size, NULL);
+    if (!pool) {
+        LOG_OOM();
+        return false;
+    }
+
+    av_buffer_pool_uninit(&fp->pool);
+    fp->pool = pool;
+    fp->format = format;
+    fp->width = width;
+    fp->height = height;
+    memcpy(fp->linesize, linesize, sizeof(linesize));
+    fp->size = size;
+
+    LOGD("Frame pool configured: %dx%d, %" SC_PRIsizet " bytes per frame",
+         width, height, size);
+
+    return true;
+}
+
+static bool
+sc_frame_pool_ensure(struct sc_frame_pool *fp, int format, int width,
+                     int height) {
+    if (fp->pool && fp->format == format && fp->width == width
+            && fp->height == height) {
+        return true;
+    }
+
+    return sc_frame_pool_configure(fp, format, width, height);
+}
+
+bool
+sc_frame_pool_prepare(struct sc_frame_pool *fp, int format, int width,
+                      int height, unsigned count) {
+    assert(count <= SC_FRAME_POOL_PREPARE_MAX);
+
+    if (!sc_frame_pool_ensure(fp, format, width, height)) {
+        return false;
+    }
+
+    // Hold all the buffers at once, so that they are distinct
+    AVBufferRef *bufs[SC_FRAME_POOL_PREPARE_MAX];
+    unsigned i;
+    for (i = 0; i < count; ++i) {
+        bufs[i] = av_buffer_pool_get(fp->pool);
+        if (!bufs[i]) {
+            LOG_OOM();
+            break;
+        }
+        // Fault the pages in now rather than on the first write (the pool
+        // memory is already faulted in on allocation)
+        if (!sc_pool_memory_is_enabled()) {
+            memset(bufs[i]->data, 0, fp->size);
+        }
+    }
+
+    bool ok = i == count;
+
+    // Returned to the pool, which keeps them for the next requests
+    while (i--) {
+        av_buffer_unref(&bufs[i]);
+    }
+
+    return ok;
+}
+
+bool
+sc_frame_pool_get(struct sc_frame_pool *fp, AVFrame *frame, int format,
+                  int width, int height) {
+    assert(!frame->buf[0]);
+
+    if (!sc_frame_pool_ensure(fp, format, width, height)) {
+        return false;
+    }
+
+    AVBufferRef *buf = av_buffer_pool_get(fp->pool);
+    if (!buf) {
+        LOG_OOM();
+        return false;
+    }
+
+    frame->buf[0] = buf;
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+    memcpy(frame->linesize, fp->linesize, sizeof(fp->linesize));
+    av_image_fill_pointers(frame->data, format, height, buf->data,
+                           frame->linesize);
+    frame->extended_data = frame->data;
+
+    return true;
+}
+
+void
+sc_frame_keep_luma(AVFrame *frame) {
+    assert(frame->format == AV_PIX_FMT_YUV420P);
+
+    // The Y plane is the first one, in its own buffer or at the start of a
+    // single buffer holding all the planes
+    for (int i = 1; i < AV_NUM_DATA_POINTERS; ++i) {
+        av_buffer_unref(&frame->buf[i]);
+        frame->data[i] = NULL;
+        frame->linesize[i] = 0;
+    }
+    frame->extended_data = frame->data;
+    frame->format = AV_PIX_FMT_GRAY8;
+}
@@ -0,0 +1,76 @@
+#ifndef SC_FRAME_POOL_H
+#define SC_FRAME_POOL_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+typedef struct AVBufferPool AVBufferPool;
+
+/**
+ * A frame pool provides video frames whose data are recycled, to avoid a heap
+ * allocation per frame.
+ *
+ * It is configured lazily from the format and size of the requested frames,
+ * and reconfigured whenever they change (e.g. on device rotation). The frames
+ * are reference counted as usual: their buffer is returned to the pool once
+ * the last reference is released, even after the pool is destroyed.
+ *
+ * A frame pool is not thread-safe: the frames must be requested from a single
+ * thread, but they may be released from any thread.
+ */
+struct sc_frame_pool {
+    AVBufferPool *pool;
+
+    int format; // enum AVPixelFormat
+    int width;
+    int height;
+    int linesize[4];
+    size_t size; // size of the buffer holding all the planes
+};
+
+void
+sc_frame_pool_init(struct sc_frame_pool *fp);
+
+void
+sc_frame_pool_destroy(struct sc_frame_pool *fp);
+
+/**
+ * Maximum number of buffers preallocated by sc_frame_pool_prepare()
+ */
+#define SC_FRAME_POOL_PREPARE_MAX 8
+
+/**
+ * Configure the pool for the given format and size, and preallocate `count`
+ * buffers (their pages faulted in)
+ *
+ * Called once the video size is announced, so that the first frames are not
+ * delayed by the allocations. Must be called from the thread requesting the
+ * frames.
+ */
+bool
+sc_frame_pool_prepare(struct sc_frame_pool *fp, int format, int width,
+                      int height, unsigned count);
+
+/**
+ * Make `frame` reference a pooled buffer for the given format and size
+ *
+ * The frame must be empty (freshly allocated or unreferenced). Only the
+ * format, size and data fields are set; the content is uninitialized.
+ */
+bool
+sc_frame_pool_get(struct sc_frame_pool *fp, AVFrame *frame, int format,
+                  int width, int height);
+
+/**
+ * Turn a YUV420P frame into a GRAY8 frame, by releasing its chroma planes
+ *
+ * Only this reference is modified, the buffers are not copied.
+ */
+void
+sc_frame_keep_luma(AVFrame *frame);
+
+#endif
@@ -0,0 +1,484 @@
+#include "frame_publisher.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/frame.h>
+
+#include "frame_header.h"
+#include "memory_budget.h"
+#include "util/file.h"
+#include "util/log.h"
+
+// The chunks smaller than this buffer (typically the rows of the frames which
+// are not contiguous) are coalesced before being sent
+#define SC_FRAME_PUBLISHER_BUFFER_SIZE (64 * 1024)
+
+static void
+sc_frame_publisher_item_destroy(struct sc_frame_publisher_item *item) {
+    av_frame_free(&item->frame);
+    if (item->budget) {
+        sc_memory_budget_release(SC_MEMORY_OUTPUT, item->budget);
+        item->budget = 0;
+    }
+}
+
+static bool
+sc_frame_publisher_subscriber_send(struct sc_frame_publisher_subscriber *sub,
+                                   const void *data, size_t len) {
+    return net_send_all(sub->socket, data, len) == (ssize_t) len;
+}
+
+static bool
+sc_frame_publisher_subscriber_flush(struct sc_frame_publisher_subscriber *sub) {
+    if (!sub->buffer_len) {
+        return true;
+    }
+
+    bool ok = sc_frame_publisher_subscriber_send(sub, sub->buffer,
+                                                 sub->buffer_len);
+    sub->buffer_len = 0;
+    return ok;
+}
+
+static bool
+sc_frame_publisher_subscriber_write(const struct sc_file_chunk *chunks,
+                                    size_t count, void *userdata) {
+    struct sc_frame_publisher_subscriber *sub = userdata;
+
+    for (size_t i = 0; i < count; ++i) {
+        const struct sc_file_chunk *chunk = &chunks[i];
+        if (sub->buffer_len + chunk->size <= SC_FRAME_PUBLISHER_BUFFER_SIZE) {
+            memcpy(sub->buffer + sub->buffer_len, chunk->data, chunk->size);
+            sub->buffer_len += chunk->size;
+            continue;
+        }
+
+        if (!sc_frame_publisher_subscriber_flush(sub)) {
+            return false;
+        }
+
+        if (chunk->size >= SC_FRAME_PUBLISHER_BUFFER_SIZE) {
+            // Large planes are sent directly from the frame
+            if (!sc_frame_publisher_subscriber_send(sub, chunk->data,
+                                                    chunk->size)) {
+                return false;
+            }
+        } else {
+            memcpy(sub->buffer, chunk->data, chunk->size);
+            sub->buffer_len = chunk->size;
+        }
+    }
+
+    return sc_frame_publisher_subscriber_flush(sub);
+}
+
+static bool
+sc_frame_publisher_subscriber_send_item(
+        struct sc_frame_publisher_subscriber *sub,
+        const struct sc_frame_publisher_item *item) {
+    struct sc_frame_pipe_dest dest = {
+        .write = sc_frame_publisher_subscriber_write,
+        .userdata = sub,
+    };
+
+    if (!item->frame) {
+        int64_t timestamp_ms = item->info.timestamp_us < 0
+                             ? -1 : item->info.timestamp_us / 1000;
+        return sc_frame_pipe_send_drop(&dest, item->info.sequence,
+                                       item->drop_reason, timestamp_ms);
+    }
+
+    // The gaps are specific to each subscriber (its queue may have dropped
+    // frames), except the interruptions of the stream, already flagged
+    struct sc_frame_pipe_info info = item->info;
+    if (sub->started && info.sampled_from != sub->next_number) {
+        info.flags |= FRAME_FLAG_DISCONTINUITY;
+    }
+    sub->started = true;
+    sub->next_number = info.sequence + 1;
+
+    return sc_frame_pipe_send(&dest, item->frame, &info);
+}
+
+static int
+run_subscriber(void *data) {
+    struct sc_frame_publisher_subscriber *sub = data;
+    struct sc_frame_publisher *fp = sub->publisher;
+
+    for (;;) {
+        sc_mutex_lock(&fp->mutex);
+        while (!fp->stopped && sc_vecdeque_is_empty(&sub->queue)) {
+            sc_cond_wait(&sub->cond, &fp->mutex);
+        }
+        if (fp->stopped) {
+            sc_mutex_unlock(&fp->mutex);
+            break;
+        }
+        struct sc_frame_publisher_item item = sc_vecdeque_pop(&sub->queue);
+        sc_mutex_unlock(&fp->mutex);
+
+        bool ok = sc_frame_publisher_subscriber_send_item(sub, &item);
+        sc_frame_publisher_item_destroy(&item);
+        if (!ok) {
+            LOGI("Subscriber %u disconnected", sub->id);
+            break;
+        }
+    }
+
+    sc_mutex_lock(&fp->mutex);
+    sub->closed = true;
+    while (!sc_vecdeque_is_empty(&sub->queue)) {
+        struct sc_frame_publisher_item *item = sc_vecdeque_popref(&sub->queue);
+        sc_frame_publisher_item_destroy(item);
+    }
+    sc_mutex_unlock(&fp->mutex);
+
+    return 0;
+}
+
+// Called with the mutex locked
+static bool
+sc_frame_publisher_subscriber_init(struct sc_frame_publisher_subscriber *sub,
+                                   struct sc_frame_publisher *fp,
+                                   sc_socket socket) {
+    sub->publisher = fp;
+    sub->id = fp->next_id++;
+    sub->socket = socket;
+    sub->dropped = 0;
+    sub->closed = false;
+    sub->next_number = 0;
+    sub->started = false;
+    sub->buffer_len = 0;
+
+    sub->buffer = malloc(SC_FRAME_PUBLISHER_BUFFER_SIZE);
+    if (!sub->buffer) {
+        LOG_OOM();
+        return false;
+    }
+
+    sc_vecdeque_init(&sub->queue);
+    if (!sc_vecdeque_reserve(&sub->queue, fp->queue_size)) {
+        LOG_OOM();
+        goto error_free_buffer;
+    }
+
+    if (!sc_cond_init(&sub->cond)) {
+        goto error_destroy_queue;
+    }
+
+    bool ok = sc_thread_create(&sub->thread, run_subscriber, "scrcpy-pub",
+                               sub);
+    if (!ok) {
+        LOGE("Could not start subscriber thread");
+        goto error_destroy_cond;
+    }
+
+    sub->used = true;
+    return true;
+
+error_destroy_cond:
+    sc_cond_destroy(&sub->cond);
+error_destroy_queue:
+    sc_vecdeque_destroy(&sub->queue);
+error_free_buffer:
+    free(sub->buffer);
+
+    return false;
+}
+
+// The thread must have terminated (or been interrupted)
+static void
+sc_frame_publisher_subscriber_destroy(
+        struct sc_frame_publisher_subscriber *sub) {
+    sc_thread_join(&sub->thread, NULL);
+
+    if (sub->dropped) {
+        LOGI("Subscriber %u: %" PRIu64 " frames dropped (too slow)", sub->id,
+             sub->dropped);
+    }
+
+    // The queue has been flushed by the thread
+    assert(sc_vecdeque_is_empty(&sub->queue));
+    sc_vecdeque_destroy(&sub->queue);
+    sc_cond_destroy(&sub->cond);
+    free(sub->buffer);
+    net_close(sub->socket);
+}
+
+// Release the slots of the disconnected subscribers
+static void
+sc_frame_publisher_reap(struct sc_frame_publisher *fp) {
+    for (unsigned i = 0; i < SC_FRAME_PUBLISHER_MAX_SUBSCRIBERS; ++i) {
+        struct sc_frame_publisher_subscriber *sub = &fp->subscribers[i];
+
+        sc_mutex_lock(&fp->mutex);
+        bool reap = sub->used && sub->closed;
+        sc_mutex_unlock(&fp->mutex);
+
+        if (reap) {
+            // A closed subscriber is not accessed by the other threads
+            sc_frame_publisher_subscriber_destroy(sub);
+
+            sc_mutex_lock(&fp->mutex);
+            sub->used = false;
+            sc_mutex_unlock(&fp->mutex);
+        }
+    }
+}
+
+static int
+run_accept(void *data) {
+    struct sc_frame_publisher *fp = data;
+
+    for (;;) {
+        sc_socket socket = net_accept(fp->server_socket);
+        if (socket == SC_SOCKET_NONE) {
+            // Interrupted on stop (or failed)
+            break;
+        }
+
+        sc_frame_publisher_reap(fp);
+
+        // The frames are sent as soon as they are available
+        net_set_tcp_nodelay(socket, true);
+
+        sc_mutex_lock(&fp->mutex);
+
+        if (fp->stopped) {
+            sc_mutex_unlock(&fp->mutex);
+            net_close(socket);
+            break;
+        }
+
+        struct sc_frame_publisher_subscriber *sub = NULL;
+        for (unsigned i = 0; i < SC_FRAME_PUBLISHER_MAX_SUBSCRIBERS; ++i) {
+            if (!fp->subscribers[i].used) {
+                sub = &fp->subscribers[i];
+                break;
+            }
+        }
+
+        bool ok = false;
+        if (!sub) {
+            LOGW("Too many subscribers (max %d), connection refused",
+                 SC_FRAME_PUBLISHER_MAX_SUBSCRIBERS);
+        } else {
+            ok = sc_frame_publisher_subscriber_init(sub, fp, socket);
+            if (ok) {
+                LOGI("Subscriber %u connected", sub->id);
+            }
+        }
+
+        sc_mutex_unlock(&fp->mutex);
+
+        if (!ok) {
+            net_close(socket);
+        }
+    }
+
+    LOGD("Frame publisher accept thread ended");
+
+    return 0;
+}
+
+bool
+sc_frame_publisher_init(struct sc_frame_publisher *fp,
+                        const struct sc_frame_publisher_params *params) {
+    assert(params->queue_size);
+
+    fp->host = params->host;
+    fp->port = params->port;
+    fp->queue_size = params->queue_size;
+    fp->drop = params->drop;
+    fp->stopped = false;
+    fp->next_id = 0;
+
+    for (unsigned i = 0; i < SC_FRAME_PUBLISHER_MAX_SUBSCRIBERS; ++i) {
+        fp->subscribers[i].used = false;
+    }
+
+    if (!sc_mutex_init(&fp->mutex)) {
+        return false;
+    }
+
+    fp->server_socket = net_socket();
+    if (fp->server_socket == SC_SOCKET_NONE) {
+        LOGE("Could not create publisher socket");
+        goto error_destroy_mutex;
+    }
+
+    if (!net_listen(fp->server_socket, fp->host, fp->port,
+                    SC_FRAME_PUBLISHER_MAX_SUBSCRIBERS)) {
+        LOGE("Could not listen on port %" PRIu16 " to publish the frames",
+             fp->port);
+        goto error_close_socket;
+    }
+
+    return true;
+
+error_close_socket:
+    net_close(fp->server_socket);
+error_destroy_mutex:
+    sc_mutex_destroy(&fp->mutex);
+
+    return false;
+}
+
+bool
+sc_frame_publisher_start(struct sc_frame_publisher *fp) {
+    LOGD("Starting frame publisher");
+
+    bool ok = sc_thread_create(&fp->accept_thread, run_accept,
+                               "scrcpy-pubacc", fp);
+    if (!ok) {
+        LOGE("Could not start frame publisher thread");
+        return false;
+    }
+
+    LOGI("Publishing the frames on port %" PRIu16, fp->port);
+    return true;
+}
+
+void
+sc_frame_publisher_stop(struct sc_frame_publisher *fp) {
+    sc_mutex_lock(&fp->mutex);
+    fp->stopped = true;
+    for (unsigned i = 0; i < SC_FRAME_PUBLISHER_MAX_SUBSCRIBERS; ++i) {
+        struct sc_frame_publisher_subscriber *sub = &fp->subscribers[i];
+        if (sub->used && !sub->closed) {
+            sc_cond_signal(&sub->cond);
+            // Unblock a pending send
+            net_interrupt(sub->socket);
+        }
+    }
+    sc_mutex_unlock(&fp->mutex);
+
+    net_interrupt(fp->server_socket);
+}
+
+void
+sc_frame_publisher_join(struct sc_frame_publisher *fp) {
+    sc_thread_join(&fp->accept_thread, NULL);
+
+    // No subscriber may be added anymore
+    for (unsigned i = 0; i < SC_FRAME_PUBLISHER_MAX_SUBSCRIBERS; ++i) {
+        struct sc_frame_publisher_subscriber *sub = &fp->subscribers[i];
+        if (sub->used) {
+            sc_frame_publisher_subscriber_destroy(sub);
+            sub->used = false;
+        }
+    }
+}
+
+void
+sc_frame_publisher_destroy(struct sc_frame_publisher *fp) {
+    net_close(fp->server_socket);
+    sc_mutex_destroy(&fp->mutex);
+}
+
+// Called with the mutex locked. Return false if the item must be dropped.
+static bool
+sc_frame_publisher_make_room(struct sc_frame_publisher *fp,
+                             struct sc_frame_publisher_subscriber *sub) {
+    // The capacity reserved on init may be larger than the queue size, so
+    // compare the size explicitly
+    if (sc_vecdeque_size(&sub->queue) < fp->queue_size) {
+        return true;
+    }
+
+    if (fp->drop == SC_PUBLISH_DROP_NEWEST) {
+        return false;
+    }
+
+    assert(fp->drop == SC_PUBLISH_DROP_OLDEST);
+    struct sc_frame_publisher_item *oldest = sc_vecdeque_popref(&sub->queue);
+    if (oldest->frame) {
+        ++sub->dropped;
+    }
+    sc_frame_publisher_item_destroy(oldest);
+    return true;
+}
+
+void
+sc_frame_publisher_push(struct sc_frame_publisher *fp, const AVFrame *frame,
+                        const struct sc_frame_pipe_info *info) {
+    uint64_t size = sc_memory_budget_frame_size(frame);
+
+    sc_mutex_lock(&fp->mutex);
+
+    for (unsigned i = 0; i < SC_FRAME_PUBLISHER_MAX_SUBSCRIBERS; ++i) {
+        struct sc_frame_publisher_subscriber *sub = &fp->subscribers[i];
+        if (!sub->used || sub->closed) {
+            continue;
+        }
+
+        if (!sc_frame_publisher_make_room(fp, sub)) {
+            ++sub->dropped;
+            continue;
+        }
+
+        // Enforced before the frame is referenced
+        if (!sc_memory_budget_acquire(SC_MEMORY_OUTPUT, size)) {
+            ++sub->dropped;
+            continue;
+        }
+
+        // Each subscriber holds its own reference to the same frame buffers
+        AVFrame *ref = av_frame_alloc();
+        if (!ref) {
+            LOG_OOM();
+            sc_memory_budget_release(SC_MEMORY_OUTPUT, size);
+            break;
+        }
+        if (av_frame_ref(ref, frame)) {
+            LOG_OOM();
+            av_frame_free(&ref);
+            sc_memory_budget_release(SC_MEMORY_OUTPUT, size);
+            break;
+        }
+
+        struct sc_frame_publisher_item item = {
+            .frame = ref,
+            .budget = size,
+            .info = *info,
+        };
+        sc_vecdeque_push_noresize(&sub->queue, item);
+        sc_cond_signal(&sub->cond);
+    }
+
+    sc_mutex_unlock(&fp->mutex);
+}
+
+void
+sc_frame_publisher_push_drop(struct sc_frame_publisher *fp,
+                             uint64_t frame_number, unsigned reason,
+                             int64_t timestamp_us) {
+    struct sc_frame_publisher_item item = {
+        .frame = NULL,
+        .info = {
+            .timestamp_us = timestamp_us,
+            .sequence = frame_number,
+            .sampled_from = frame_number,
+        },
+        .drop_reason = reason,
+    };
+
+    sc_mutex_lock(&fp->mutex);
+
+    for (unsigned i = 0; i < SC_FRAME_PUBLISHER_MAX_SUBSCRIBERS; ++i) {
+        struct sc_frame_publisher_subscriber *sub = &fp->subscribers[i];
+        if (!sub->used || sub->closed) {
+            continue;
+        }
+
+        if (sc_frame_publisher_make_room(fp, sub)) {
+            sc_vecdeque_push_noresize(&sub->queue, item);
+            sc_cond_signal(&sub->cond);
+        }
+    }
+
+    sc_mutex_unlock(&fp->mutex);
+}
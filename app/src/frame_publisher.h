@@ -0,0 +1,124 @@
+#ifndef SC_FRAME_PUBLISHER_H
+#define SC_FRAME_PUBLISHER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame_pipe.h"
+#include "options.h"
+#include "util/net.h"
+#include "util/thread.h"
+#include "util/vecdeque.h"
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+
+#define SC_FRAME_PUBLISHER_MAX_SUBSCRIBERS 8
+
+// A frame (or the record of a dropped frame, if frame is NULL) to send
+struct sc_frame_publisher_item {
+    AVFrame *frame; // a reference to the published frame, NULL for a drop
+    uint64_t budget; // bytes acquired from the memory budget for the frame
+    struct sc_frame_pipe_info info;
+    unsigned drop_reason; // FRAME_DROP_REASON_*, if frame is NULL
+};
+
+struct sc_frame_publisher_queue SC_VECDEQUE(struct sc_frame_publisher_item);
+
+struct sc_frame_publisher;
+
+struct sc_frame_publisher_subscriber {
+    struct sc_frame_publisher *publisher;
+    unsigned id; // for the logs
+    sc_socket socket;
+    sc_thread thread;
+    sc_cond cond;
+
+    // Protected by the publisher mutex
+    struct sc_frame_publisher_queue queue;
+    bool used; // the slot is used (the thread must be joined)
+    bool closed; // the sender thread has terminated
+    uint64_t dropped;
+
+    // Only accessed from the sender thread
+    uint64_t next_number; // to flag the discontinuities
+    bool started; // a frame has been sent
+    uint8_t *buffer; // to coalesce the small chunks (e.g. rows)
+    size_t buffer_len;
+};
+
+/**
+ * Frame publisher, serving the pipe output (the records of frame_pipe.h,
+ * without device tag) over TCP to several subscribers (--publish)
+ *
+ * Each subscriber is served by its own thread, from its own bounded queue.
+ * The queues hold references to the published frames, so the frame buffers
+ * are shared, not copied. When the queue of a subscriber is full, a frame is
+ * dropped for this subscriber only (the oldest or the new one, depending on
+ * the policy): a slow subscriber never blocks the others or the capture.
+ *
+ * The sequence numbers (--pipe-format=v2) let each subscriber detect its
+ * gaps: FRAME_FLAG_DISCONTINUITY is set per subscriber.
+ */
+struct sc_frame_publisher {
+    uint32_t host;
+    uint16_t port;
+    unsigned queue_size;
+    enum sc_publish_drop drop;
+
+    sc_socket server_socket;
+    sc_thread accept_thread;
+
+    sc_mutex mutex;
+    bool stopped;
+    unsigned next_id;
+    struct sc_frame_publisher_subscriber
+        subscribers[SC_FRAME_PUBLISHER_MAX_SUBSCRIBERS];
+};
+
+struct sc_frame_publisher_params {
+    uint32_t host;
+    uint16_t port;
+    unsigned queue_size;
+    enum sc_publish_drop drop;
+};
+
+// Listen on the port (fail if it is not available)
+bool
+sc_frame_publisher_init(struct sc_frame_publisher *fp,
+                        const struct sc_frame_publisher_params *params);
+
+bool
+sc_frame_publisher_start(struct sc_frame_publisher *fp);
+
+// Disconnect all the subscribers
+void
+sc_frame_publisher_stop(struct sc_frame_publisher *fp);
+
+void
+sc_frame_publisher_join(struct sc_frame_publisher *fp);
+
+void
+sc_frame_publisher_destroy(struct sc_frame_publisher *fp);
+
+/**
+ * Queue a frame for all the connected subscribers
+ *
+ * The frame is referenced, not copied, so its content must not be modified
+ * afterwards. The DISCONTINUITY flag of the info is ignored (it is computed
+ * for each subscriber).
+ */
+void
+sc_frame_publisher_push(struct sc_frame_publisher *fp, const AVFrame *frame,
+                        const struct sc_frame_pipe_info *info);
+
+// Queue the record of a frame dropped before being published
+void
+sc_frame_publisher_push_drop(struct sc_frame_publisher *fp,
+                             uint64_t frame_number, unsigned reason,
+                             int64_t timestamp_us);
+
+#endif
@@ -0,0 +1,102 @@
+#include "frame_pyramid.h"
+
+#include <stdlib.h>
+
+#include <libavutil/frame.h>
+
+#include "util/log.h"
+#include "util/pyramid.h"
+
+bool
+sc_frame_pyramid_init(struct sc_frame_pyramid *pyramid, unsigned levels) {
+    assert(levels);
+    assert(!(levels & ~(((2u << SC_FRAME_PYRAMID_MAX_LEVEL) - 1) & ~1u)));
+
+    pyramid->levels = levels;
+    pyramid->top = 0;
+    while (levels >> (pyramid->top + 1)) {
+        ++pyramid->top;
+    }
+
+    pyramid->frames[0] = NULL;
+    for (unsigned i = 1; i <= pyramid->top; ++i) {
+        pyramid->frames[i] = av_frame_alloc();
+        if (!pyramid->frames[i]) {
+            LOG_OOM();
+            while (--i) {
+                av_frame_free(&pyramid->frames[i]);
+                sc_frame_pool_destroy(&pyramid->pools[i]);
+            }
+            return false;
+        }
+        sc_frame_pool_init(&pyramid->pools[i]);
+    }
+
+    pyramid->scratch = NULL;
+    pyramid->scratch_size = 0;
+    return true;
+}
+
+void
+sc_frame_pyramid_destroy(struct sc_frame_pyramid *pyramid) {
+    for (unsigned i = 1; i <= pyramid->top; ++i) {
+        av_frame_free(&pyramid->frames[i]);
+        sc_frame_pool_destroy(&pyramid->pools[i]);
+    }
+    free(pyramid->scratch);
+}
+
+bool
+sc_frame_pyramid_build(struct sc_frame_pyramid *pyramid, const AVFrame *frame) {
+    assert(frame->format == AV_PIX_FMT_YUV420P
+        || frame->format == AV_PIX_FMT_GRAY8);
+
+    // The eyes of the top level must not be empty
+    int eye_width = frame->width / 2;
+    if (!(eye_width >> pyramid->top) || !(frame->height >> pyramid->top)) {
+        LOGE("Frame too small for the pyramid levels (%dx%d)", frame->width,
+             frame->height);
+        return false;
+    }
+
+    if (pyramid->scratch_size < (size_t) eye_width + 1) {
+        uint16_t *scratch = realloc(pyramid->scratch,
+                                    (eye_width + 1) * sizeof(*scratch));
+        if (!scratch) {
+            LOG_OOM();
+            return false;
+        }
+        pyramid->scratch = scratch;
+        pyramid->scratch_size = eye_width + 1;
+    }
+
+    const uint8_t *src = frame->data[0];
+    int src_linesize = frame->linesize[0];
+    int height = frame->height;
+    for (unsigned i = 1; i <= pyramid->top; ++i) {
+        AVFrame *level = pyramid->frames[i];
+        // Release the level of the previous frame to its pool
+        av_frame_unref(level);
+
+        int dst_eye_width = eye_width / 2;
+        bool ok = sc_frame_pool_get(&pyramid->pools[i], level,
+                                    AV_PIX_FMT_GRAY8, 2 * dst_eye_width,
+                                    height / 2);
+        if (!ok) {
+            return false;
+        }
+
+        for (int eye = 0; eye < 2; ++eye) {
+            sc_pyramid_reduce(src + eye * eye_width, src_linesize, eye_width,
+                              height, level->data[0] + eye * dst_eye_width,
+                              level->linesize[0], pyramid->scratch);
+        }
+
+        src = level->data[0];
+        src_linesize = level->linesize[0];
+        eye_width = dst_eye_width;
+        height = level->height;
+    }
+
+    return true;
+}
@@ -0,0 +1,76 @@
+#ifndef SC_FRAME_PYRAMID_H
+#define SC_FRAME_PYRAMID_H
+
+#include "common.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame_pool.h"
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+
+// Highest level of the pyramid (1/16 of the resolution in both directions)
+#define SC_FRAME_PYRAMID_MAX_LEVEL 4
+
+/**
+ * Gaussian pyramid of the Y plane of the output frames (--output-pyramid),
+ * built once for all the consumers of the pipe and of the shared memory
+ *
+ * Level 0 is the Y plane of the frame itself; level n + 1 is level n reduced
+ * by 2 in both directions (see sc_pyramid_reduce()). The two eyes (side by
+ * side) are reduced separately, so that the filter does not blend them: each
+ * level is a GRAY8 frame of 2 * (eye_width / 2) x (height / 2), where
+ * eye_width is the half width of the level below.
+ *
+ * All the levels up to the highest one selected are built (each one from the
+ * previous one), but only the selected ones are published.
+ */
+struct sc_frame_pyramid {
+    unsigned levels; // bitmask of the levels selected (bit n for level n)
+    unsigned top; // highest level selected
+    struct sc_frame_pool pools[SC_FRAME_PYRAMID_MAX_LEVEL + 1];
+    AVFrame *frames[SC_FRAME_PYRAMID_MAX_LEVEL + 1]; // [0] is unused
+    uint16_t *scratch; // the vertical sums of a row
+    size_t scratch_size; // in values
+};
+
+/**
+ * Initialize a pyramid for the selected levels (a bitmask of the levels 1 to
+ * SC_FRAME_PYRAMID_MAX_LEVEL)
+ */
+bool
+sc_frame_pyramid_init(struct sc_frame_pyramid *pyramid, unsigned levels);
+
+void
+sc_frame_pyramid_destroy(struct sc_frame_pyramid *pyramid);
+
+/**
+ * Build the levels of a YUV420P (or GRAY8) side-by-side frame
+ *
+ * The levels remain valid until the next call. Return false on allocation
+ * failure, or if the frame is too small to be reduced.
+ */
+bool
+sc_frame_pyramid_build(struct sc_frame_pyramid *pyramid, const AVFrame *frame);
+
+static inline bool
+sc_frame_pyramid_selected(const struct sc_frame_pyramid *pyramid,
+                          unsigned level) {
+    return pyramid->levels & (1u << level);
+}
+
+/**
+ * Return the frame of a level (from 1 to pyramid->top) of the last frame built
+ */
+static inline const AVFrame *
+sc_frame_pyramid_level(const struct sc_frame_pyramid *pyramid,
+                       unsigned level) {
+    assert(level >= 1 && level <= pyramid->top);
+    return pyramid->frames[level];
+}
+
+#endif
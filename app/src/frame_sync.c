@@ -0,0 +1,276 @@
+#include "frame_sync.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include <libavutil/dict.h>
+#include <libavutil/frame.h>
+
+#include "video_processor.h"
+#include "util/log.h"
+
+/** Downcast frame_sink to sc_frame_sync_input */
+#define DOWNCAST(SINK) \
+    container_of(SINK, struct sc_frame_sync_input, frame_sink)
+
+static void
+sc_frame_sync_flush(struct sc_frame_sync_queue *queue) {
+    while (!sc_vecdeque_is_empty(queue)) {
+        struct sc_frame_sync_entry entry = sc_vecdeque_pop(queue);
+        av_frame_free(&entry.frame);
+    }
+}
+
+static bool
+sc_frame_sync_all_pending(struct sc_frame_sync *sync) {
+    for (unsigned i = 0; i < sync->count; ++i) {
+        if (sc_vecdeque_is_empty(&sync->inputs[i].queue)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int
+run_frame_sync(void *data) {
+    struct sc_frame_sync *sync = data;
+
+    AVFrame *frames[SC_FRAME_SYNC_MAX_INPUTS];
+    int64_t timestamps[SC_FRAME_SYNC_MAX_INPUTS];
+
+    sc_mutex_lock(&sync->mutex);
+    for (;;) {
+        while (!sync->stopped && !sc_frame_sync_all_pending(sync)) {
+            sc_cond_wait(&sync->queue_cond, &sync->mutex);
+        }
+
+        if (sync->stopped) {
+            break;
+        }
+
+        for (unsigned i = 0; i < sync->count; ++i) {
+            struct sc_frame_sync_queue *queue = &sync->inputs[i].queue;
+            timestamps[i] = sc_vecdeque_peekref(queue)->timestamp_ms;
+        }
+
+        unsigned oldest;
+        if (!sc_frame_sync_match(timestamps, sync->count, sync->tolerance_ms,
+                                 &oldest)) {
+            struct sc_frame_sync_entry entry =
+                sc_vecdeque_pop(&sync->inputs[oldest].queue);
+            av_frame_free(&entry.frame);
+            ++sync->dropped;
+            continue;
+        }
+
+        for (unsigned i = 0; i < sync->count; ++i) {
+            frames[i] = sc_vecdeque_pop(&sync->inputs[i].queue).frame;
+        }
+        ++sync->matched;
+        sc_mutex_unlock(&sync->mutex);
+
+        bool ok = sync->cbs->on_frames(sync, frames, timestamps, sync->count,
+                                       sync->cbs_userdata);
+        for (unsigned i = 0; i < sync->count; ++i) {
+            av_frame_free(&frames[i]);
+        }
+
+        sc_mutex_lock(&sync->mutex);
+        if (!ok) {
+            LOGE("Synchronized frames could not be pushed, stopping");
+            // Prevent to push any new frame
+            sync->stopped = true;
+            break;
+        }
+    }
+    sc_mutex_unlock(&sync->mutex);
+
+    LOGD("Frame synchronizer: %" PRIu64 " tuples, %" PRIu64 " frames dropped",
+         sync->matched, sync->dropped);
+    LOGD("Frame synchronizer thread ended");
+
+    return 0;
+}
+
+static bool
+sc_frame_sync_frame_sink_open(struct sc_frame_sink *sink,
+                              const AVCodecContext *ctx) {
+    (void) sink;
+    (void) ctx;
+    // The synchronizer is started explicitly, independently of its inputs
+    return true;
+}
+
+static void
+sc_frame_sync_frame_sink_close(struct sc_frame_sink *sink) {
+    (void) sink;
+    // The pending frames of a closed input are kept until the synchronizer
+    // is destroyed, no tuple will be emitted anymore
+}
+
+// Return the timestamp exported by the video processor, or -1 if unknown
+static int64_t
+sc_frame_sync_get_timestamp(const AVFrame *frame) {
+    AVDictionaryEntry *ts =
+        av_dict_get(frame->metadata, SC_VIDEO_PROCESSOR_METADATA_TIMESTAMP_MS,
+                    NULL, 0);
+    if (!ts) {
+        return -1;
+    }
+
+    char *end;
+    long long value = strtoll(ts->value, &end, 10);
+    if (*end != '\0' || value < 0) {
+        return -1;
+    }
+
+    return value;
+}
+
+static bool
+sc_frame_sync_frame_sink_push(struct sc_frame_sink *sink,
+                              const AVFrame *frame) {
+    struct sc_frame_sync_input *input = DOWNCAST(sink);
+    struct sc_frame_sync *sync = input->sync;
+
+    int64_t timestamp_ms = sc_frame_sync_get_timestamp(frame);
+    if (timestamp_ms < 0) {
+        // Could never be matched
+        sc_mutex_lock(&sync->mutex);
+        ++sync->dropped;
+        sc_mutex_unlock(&sync->mutex);
+        return true;
+    }
+
+    AVFrame *ref = av_frame_alloc();
+    if (!ref) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (av_frame_ref(ref, frame)) {
+        LOG_OOM();
+        av_frame_free(&ref);
+        return false;
+    }
+
+    sc_mutex_lock(&sync->mutex);
+
+    if (sync->stopped) {
+        sc_mutex_unlock(&sync->mutex);
+        av_frame_free(&ref);
+        return false;
+    }
+
+    // The capacity reserved on init may be larger than the queue size, so
+    // compare the size explicitly
+    if (sc_vecdeque_size(&input->queue) >= SC_FRAME_SYNC_QUEUE_SIZE) {
+        // The other inputs are late (or stalled), drop the oldest frame
+        struct sc_frame_sync_entry old = sc_vecdeque_pop(&input->queue);
+        av_frame_free(&old.frame);
+        ++sync->dropped;
+    }
+
+    struct sc_frame_sync_entry entry = {
+        .frame = ref,
+        .timestamp_ms = timestamp_ms,
+    };
+    sc_vecdeque_push_noresize(&input->queue, entry);
+    sc_cond_signal(&sync->queue_cond);
+
+    sc_mutex_unlock(&sync->mutex);
+
+    return true;
+}
+
+bool
+sc_frame_sync_init(struct sc_frame_sync *sync, unsigned count,
+                   int64_t tolerance_ms,
+                   const struct sc_frame_sync_callbacks *cbs,
+                   void *cbs_userdata) {
+    assert(count && count <= SC_FRAME_SYNC_MAX_INPUTS);
+    assert(tolerance_ms >= 0);
+    assert(cbs && cbs->on_frames);
+
+    bool ok = sc_mutex_init(&sync->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&sync->queue_cond);
+    if (!ok) {
+        sc_mutex_destroy(&sync->mutex);
+        return false;
+    }
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = sc_frame_sync_frame_sink_open,
+        .close = sc_frame_sync_frame_sink_close,
+        .push = sc_frame_sync_frame_sink_push,
+    };
+
+    for (unsigned i = 0; i < count; ++i) {
+        struct sc_frame_sync_input *input = &sync->inputs[i];
+        input->frame_sink.ops = &ops;
+        input->sync = sync;
+        sc_vecdeque_init(&input->queue);
+        if (!sc_vecdeque_reserve(&input->queue, SC_FRAME_SYNC_QUEUE_SIZE)) {
+            LOG_OOM();
+            while (i--) {
+                sc_vecdeque_destroy(&sync->inputs[i].queue);
+            }
+            sc_cond_destroy(&sync->queue_cond);
+            sc_mutex_destroy(&sync->mutex);
+            return false;
+        }
+    }
+
+    sync->count = count;
+    sync->tolerance_ms = tolerance_ms;
+    sync->cbs = cbs;
+    sync->cbs_userdata = cbs_userdata;
+    sync->stopped = false;
+    sync->matched = 0;
+    sync->dropped = 0;
+
+    return true;
+}
+
+void
+sc_frame_sync_destroy(struct sc_frame_sync *sync) {
+    for (unsigned i = 0; i < sync->count; ++i) {
+        struct sc_frame_sync_queue *queue = &sync->inputs[i].queue;
+        sc_frame_sync_flush(queue);
+        sc_vecdeque_destroy(queue);
+    }
+    sc_cond_destroy(&sync->queue_cond);
+    sc_mutex_destroy(&sync->mutex);
+}
+
+bool
+sc_frame_sync_start(struct sc_frame_sync *sync) {
+    LOGD("Starting frame synchronizer thread");
+
+    bool ok = sc_thread_create(&sync->thread, run_frame_sync, "scrcpy-fsync",
+                               sync);
+    if (!ok) {
+        LOGE("Could not start frame synchronizer thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_frame_sync_stop(struct sc_frame_sync *sync) {
+    sc_mutex_lock(&sync->mutex);
+    sync->stopped = true;
+    sc_cond_signal(&sync->queue_cond);
+    sc_mutex_unlock(&sync->mutex);
+}
+
+void
+sc_frame_sync_join(struct sc_frame_sync *sync) {
+    sc_thread_join(&sync->thread, NULL);
+}
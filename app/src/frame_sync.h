@@ -0,0 +1,123 @@
+#ifndef SC_FRAME_SYNC_H
+#define SC_FRAME_SYNC_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "trait/frame_sink.h"
+#include "util/thread.h"
+#include "util/vecdeque.h"
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+
+#define SC_FRAME_SYNC_MAX_INPUTS 8
+
+// Number of frames which may wait for a match on each input. If an input
+// stalls, the oldest frames of the other inputs are dropped.
+#define SC_FRAME_SYNC_QUEUE_SIZE 8
+
+struct sc_frame_sync_entry {
+    AVFrame *frame;
+    int64_t timestamp_ms;
+};
+
+struct sc_frame_sync_queue SC_VECDEQUE(struct sc_frame_sync_entry);
+
+struct sc_frame_sync;
+
+struct sc_frame_sync_input {
+    struct sc_frame_sink frame_sink; // frame sink trait
+    struct sc_frame_sync *sync;
+    struct sc_frame_sync_queue queue; // in timestamp order
+};
+
+struct sc_frame_sync_callbacks {
+    // Called from the synchronizer thread with one frame per input (in input
+    // order), captured within the tolerance. The frames are released after
+    // the call.
+    //
+    // Return false to stop the synchronization.
+    bool (*on_frames)(struct sc_frame_sync *sync, AVFrame *const frames[],
+                      const int64_t timestamps_ms[], unsigned count,
+                      void *userdata);
+};
+
+/**
+ * Frame synchronizer, grouping the frames of several sources (typically
+ * several devices) by capture time.
+ *
+ * Each input is a frame sink, receiving the frames of one source with their
+ * capture timestamp (see SC_VIDEO_PROCESSOR_METADATA_TIMESTAMP_MS), expressed
+ * in a common clock. Its own thread emits a tuple as soon as the oldest
+ * pending frames of all the inputs were captured within the tolerance, and
+ * drops the frames which can never be matched.
+ */
+struct sc_frame_sync {
+    struct sc_frame_sync_input inputs[SC_FRAME_SYNC_MAX_INPUTS];
+    unsigned count;
+    int64_t tolerance_ms;
+
+    const struct sc_frame_sync_callbacks *cbs;
+    void *cbs_userdata;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond queue_cond;
+    bool stopped;
+
+    uint64_t matched;
+    uint64_t dropped;
+};
+
+bool
+sc_frame_sync_init(struct sc_frame_sync *sync, unsigned count,
+                   int64_t tolerance_ms,
+                   const struct sc_frame_sync_callbacks *cbs,
+                   void *cbs_userdata);
+
+void
+sc_frame_sync_destroy(struct sc_frame_sync *sync);
+
+bool
+sc_frame_sync_start(struct sc_frame_sync *sync);
+
+void
+sc_frame_sync_stop(struct sc_frame_sync *sync);
+
+void
+sc_frame_sync_join(struct sc_frame_sync *sync);
+
+/**
+ * Match the timestamps of the oldest pending frame of each input
+ *
+ * Return true if they are all within the tolerance. Otherwise, set *oldest to
+ * the input of the oldest frame: the frames of each input being in timestamp
+ * order, it can never be matched with the frames of the input of the newest
+ * one.
+ */
+static inline bool
+sc_frame_sync_match(const int64_t timestamps_ms[], unsigned count,
+                    int64_t tolerance_ms, unsigned *oldest) {
+    unsigned min = 0;
+    unsigned max = 0;
+    for (unsigned i = 1; i < count; ++i) {
+        if (timestamps_ms[i] < timestamps_ms[min]) {
+            min = i;
+        }
+        if (timestamps_ms[i] > timestamps_ms[max]) {
+            max = i;
+        }
+    }
+
+    if (timestamps_ms[max] - timestamps_ms[min] <= tolerance_ms) {
+        return true;
+    }
+
+    *oldest = min;
+    return false;
+}
+
+#endif
@@ -0,0 +1,196 @@
+#include "frame_worker.h"
+
+#include <assert.h>
+
+#include <libavutil/frame.h>
+
+#include "util/log.h"
+
+static void
+sc_frame_worker_free_frames(struct sc_frame_worker *worker, unsigned count) {
+    for (unsigned i = 0; i < count; ++i) {
+        // Release the references still held, if any
+        av_frame_free(&worker->frames[i]);
+    }
+}
+
+static int
+run_frame_worker(void *data) {
+    struct sc_frame_worker *worker = data;
+
+    for (;;) {
+        sc_mutex_lock(&worker->mutex);
+
+        while (!worker->stopped && !worker->count) {
+            sc_cond_wait(&worker->queue_cond, &worker->mutex);
+        }
+
+        if (worker->stopped) {
+            sc_mutex_unlock(&worker->mutex);
+            break;
+        }
+
+        // Take the references of the oldest frame, so that its slot is
+        // released immediately
+        av_frame_move_ref(worker->out, worker->frames[worker->head]);
+        worker->head = (worker->head + 1) % worker->capacity;
+        --worker->count;
+        sc_cond_signal(&worker->space_cond);
+
+        sc_mutex_unlock(&worker->mutex);
+
+        bool ok = worker->sink->ops->push(worker->sink, worker->out);
+        av_frame_unref(worker->out);
+        if (!ok) {
+            LOGE("Frame could not be pushed to the %s, stopping",
+                 worker->drops.name);
+            sc_mutex_lock(&worker->mutex);
+            // Make the next push fail, so that the error is reported to the
+            // pusher
+            worker->failed = true;
+            sc_cond_signal(&worker->space_cond);
+            sc_mutex_unlock(&worker->mutex);
+            break;
+        }
+    }
+
+    LOGD("Frame worker of the %s ended", worker->drops.name);
+
+    return 0;
+}
+
+bool
+sc_frame_worker_open(struct sc_frame_worker *worker,
+                     struct sc_frame_sink *sink,
+                     enum sc_frame_worker_policy policy, const char *name,
+                     const AVCodecContext *ctx) {
+    worker->sink = sink;
+    worker->policy = policy;
+    worker->capacity = policy == SC_FRAME_WORKER_DROP_OLDEST
+                     ? 1 : SC_FRAME_WORKER_MAX_PENDING;
+    worker->head = 0;
+    worker->count = 0;
+    worker->stopped = false;
+    worker->failed = false;
+    sc_frame_drops_init(&worker->drops, name);
+
+    bool ok = sc_mutex_init(&worker->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&worker->queue_cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    ok = sc_cond_init(&worker->space_cond);
+    if (!ok) {
+        goto error_destroy_queue_cond;
+    }
+
+    unsigned i;
+    for (i = 0; i < worker->capacity; ++i) {
+        worker->frames[i] = av_frame_alloc();
+        if (!worker->frames[i]) {
+            LOG_OOM();
+            goto error_free_frames;
+        }
+    }
+
+    worker->out = av_frame_alloc();
+    if (!worker->out) {
+        LOG_OOM();
+        goto error_free_frames;
+    }
+
+    if (!sink->ops->open(sink, ctx)) {
+        goto error_free_out;
+    }
+
+    ok = sc_thread_create(&worker->thread, run_frame_worker, "scrcpy-fworker",
+                          worker);
+    if (!ok) {
+        LOGE("Could not start frame worker thread");
+        goto error_close_sink;
+    }
+
+    return true;
+
+error_close_sink:
+    sink->ops->close(sink);
+error_free_out:
+    av_frame_free(&worker->out);
+error_free_frames:
+    sc_frame_worker_free_frames(worker, i);
+    sc_cond_destroy(&worker->space_cond);
+error_destroy_queue_cond:
+    sc_cond_destroy(&worker->queue_cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&worker->mutex);
+
+    return false;
+}
+
+void
+sc_frame_worker_close(struct sc_frame_worker *worker) {
+    sc_mutex_lock(&worker->mutex);
+    worker->stopped = true;
+    sc_cond_signal(&worker->queue_cond);
+    sc_cond_signal(&worker->space_cond);
+    sc_mutex_unlock(&worker->mutex);
+
+    sc_thread_join(&worker->thread, NULL);
+
+    worker->sink->ops->close(worker->sink);
+
+    sc_frame_drops_log(&worker->drops);
+
+    av_frame_free(&worker->out);
+    sc_frame_worker_free_frames(worker, worker->capacity);
+    sc_cond_destroy(&worker->space_cond);
+    sc_cond_destroy(&worker->queue_cond);
+    sc_mutex_destroy(&worker->mutex);
+}
+
+bool
+sc_frame_worker_push(struct sc_frame_worker *worker, const AVFrame *frame) {
+    sc_mutex_lock(&worker->mutex);
+
+    if (worker->policy == SC_FRAME_WORKER_BLOCK) {
+        while (!worker->stopped && !worker->failed
+                && worker->count == worker->capacity) {
+            sc_cond_wait(&worker->space_cond, &worker->mutex);
+        }
+    }
+
+    if (worker->stopped || worker->failed) {
+        sc_mutex_unlock(&worker->mutex);
+        return false;
+    }
+
+    if (worker->count == worker->capacity) {
+        assert(worker->policy == SC_FRAME_WORKER_DROP_OLDEST);
+        // The sink is still busy with the previous frame, replace the pending
+        // one
+        av_frame_unref(worker->frames[worker->head]);
+        worker->head = (worker->head + 1) % worker->capacity;
+        --worker->count;
+        sc_frame_drops_add(&worker->drops, SC_FRAME_DROP_SINK_BUSY);
+    }
+
+    AVFrame *slot = worker->frames[(worker->head + worker->count)
+                                   % worker->capacity];
+    if (av_frame_ref(slot, frame)) {
+        sc_mutex_unlock(&worker->mutex);
+        LOG_OOM();
+        return false;
+    }
+
+    ++worker->count;
+    sc_cond_signal(&worker->queue_cond);
+
+    sc_mutex_unlock(&worker->mutex);
+
+    return true;
+}
@@ -0,0 +1,83 @@
+#ifndef SC_FRAME_WORKER_H
+#define SC_FRAME_WORKER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#include "frame_drops.h"
+#include "trait/frame_sink.h"
+#include "util/thread.h"
+
+// Maximum number of frames queued for a sink which must not drop frames
+#define SC_FRAME_WORKER_MAX_PENDING 4
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+
+enum sc_frame_worker_policy {
+    // Only keep the last frame: if the sink has not consumed the pending frame
+    // when a new one is pushed, the pending one is dropped (for the sinks
+    // which only need the latest frame, like the screen or a V4L2 device)
+    SC_FRAME_WORKER_DROP_OLDEST,
+    // Never drop frames: if SC_FRAME_WORKER_MAX_PENDING frames are pending,
+    // the push waits for the sink (for the encoders, the processor and the
+    // audio sinks)
+    SC_FRAME_WORKER_BLOCK,
+};
+
+/**
+ * Push the frames to a sink from a dedicated thread.
+ *
+ * The pushed frames are queued by reference (their buffers are not copied),
+ * so that the pusher (typically the decoder) does not wait for a slow sink.
+ */
+struct sc_frame_worker {
+    struct sc_frame_sink *sink;
+    enum sc_frame_worker_policy policy;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond queue_cond;
+    sc_cond space_cond;
+
+    // Ring of preallocated frames
+    AVFrame *frames[SC_FRAME_WORKER_MAX_PENDING];
+    unsigned capacity;
+    unsigned head; // index of the oldest frame
+    unsigned count;
+    struct sc_frame_drops drops;
+
+    AVFrame *out; // frame being pushed to the sink (by the thread)
+
+    bool stopped;
+    bool failed; // the sink failed to accept a frame
+};
+
+/**
+ * Open `sink` (from the caller thread) and start the worker thread
+ *
+ * The `name` (statically allocated) identifies the sink in the logs.
+ */
+bool
+sc_frame_worker_open(struct sc_frame_worker *worker,
+                     struct sc_frame_sink *sink,
+                     enum sc_frame_worker_policy policy, const char *name,
+                     const AVCodecContext *ctx);
+
+/**
+ * Stop and join the worker thread (the pending frames are discarded), then
+ * close the sink
+ */
+void
+sc_frame_worker_close(struct sc_frame_worker *worker);
+
+/**
+ * Queue a reference to the frame for the sink
+ *
+ * Return false if the sink failed to accept a previous frame.
+ */
+bool
+sc_frame_worker_push(struct sc_frame_worker *worker, const AVFrame *frame);
+
+#endif
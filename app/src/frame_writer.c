@@ -0,0 +1,1835 @@
+#include "frame_writer.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libavutil/frame.h>
+#ifdef HAVE_ZSTD
+# include <zstd.h>
+#endif
+
+#include "frame_cache.h"
+#include "frame_drops.h"
+#include "memory_budget.h"
+#include "metrics.h"
+#include "util/alloc_stats.h"
+#include "util/file.h"
+#include "util/log.h"
+#include "util/qoi.h"
+#include "video_preprocess.h"
+
+static void
+sc_frame_writer_job_destroy(struct sc_frame_writer_job *job) {
+    av_frame_free(&job->frame);
+    free(job->delta.tiles);
+    job->delta.tiles = NULL;
+    if (job->budget) {
+        sc_memory_budget_release(SC_MEMORY_ARCHIVE, job->budget);
+        job->budget = 0;
+    }
+    if (job->type == SC_FRAME_WRITER_JOB_POSES) {
+        free(job->poses.samples);
+    }
+}
+
+static const char *
+get_file_extension(enum sc_save_frames_format format, bool gray) {
+    switch (format) {
+        case SC_SAVE_FRAMES_FORMAT_PPM:
+            return gray ? "pgm" : "ppm";
+        case SC_SAVE_FRAMES_FORMAT_YUV:
+            return gray ? "gray" : "yuv";
+        case SC_SAVE_FRAMES_FORMAT_PNG:
+            return "png";
+        case SC_SAVE_FRAMES_FORMAT_QOI:
+            return "qoi";
+        case SC_SAVE_FRAMES_FORMAT_JPEG:
+            return "jpg";
+        default:
+            assert(!"unexpected format");
+            return NULL;
+    }
+}
+
+// Convert from YUV420P to RGB24, into a pooled frame (or reference the
+// conversion already made by another consumer of the frame)
+static AVFrame *
+convert_to_rgb(struct sc_frame_writer_worker *worker, const AVFrame *frame) {
+    AVFrame *rgb = av_frame_alloc();
+    if (!rgb) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    const struct sc_frame_cache_ctx ctx = {
+        .rgb_converter = &worker->rgb_converter,
+        .pool = &worker->rgb_pool,
+    };
+    if (!sc_frame_cache_get(frame, SC_FRAME_CACHE_RGB24, &ctx, rgb)) {
+        av_frame_free(&rgb);
+        return NULL;
+    }
+
+    return rgb;
+}
+
+// Rectify a YUV420P frame and convert it to RGB24 in a single pass, into a
+// pooled frame
+static AVFrame *
+rectify_to_rgb(struct sc_frame_writer_worker *worker, const AVFrame *frame) {
+    AVFrame *rgb = av_frame_alloc();
+    if (!rgb) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    if (!sc_video_preprocess_remap_rgb(worker->writer->remap, frame,
+                                       AV_PIX_FMT_RGB24, rgb,
+                                       &worker->rgb_pool)) {
+        av_frame_free(&rgb);
+        // Like apply_video_effects(), which leaves the frame unchanged if the
+        // maps cannot be applied
+        return convert_to_rgb(worker, frame);
+    }
+
+    return rgb;
+}
+
+// The output of a frame, as a list of chunks written consecutively
+struct sc_frame_writer_output {
+    struct sc_frame_archive_chunk chunks[3];
+    unsigned count;
+    char ppm_header[32];
+};
+
+static void
+add_chunk(struct sc_frame_writer_output *out, const uint8_t *data,
+          int linesize, int row_size, int rows) {
+    assert(out->count < ARRAY_LEN(out->chunks));
+    out->chunks[out->count++] = (struct sc_frame_archive_chunk) {
+        .data = data,
+        .linesize = linesize,
+        .row_size = row_size,
+        .rows = rows,
+    };
+}
+
+static void
+encode_yuv(struct sc_frame_writer_output *out, const AVFrame *frame) {
+    int w = frame->width;
+    int h = frame->height;
+    add_chunk(out, frame->data[0], frame->linesize[0], w, h);
+    if (frame->format == AV_PIX_FMT_GRAY8) {
+        // Y plane only
+        return;
+    }
+    assert(frame->format == AV_PIX_FMT_YUV420P);
+    add_chunk(out, frame->data[1], frame->linesize[1], w / 2, h / 2);
+    add_chunk(out, frame->data[2], frame->linesize[2], w / 2, h / 2);
+}
+
+// Write a RGB24 frame as PPM, or a GRAY8 frame as PGM
+static void
+encode_ppm(struct sc_frame_writer_output *out, const AVFrame *image) {
+    bool gray = image->format == AV_PIX_FMT_GRAY8;
+    int len = snprintf(out->ppm_header, sizeof(out->ppm_header),
+                       "%s\n%d %d\n255\n", gray ? "P5" : "P6", image->width,
+                       image->height);
+    assert(len > 0 && (size_t) len < sizeof(out->ppm_header));
+    add_chunk(out, (const uint8_t *) out->ppm_header, len, len, 1);
+
+    // The pooled rows may be padded
+    int pixel_size = gray ? 1 : 3;
+    add_chunk(out, image->data[0], image->linesize[0],
+              pixel_size * image->width, image->height);
+}
+
+static bool
+encode_qoi(struct sc_frame_writer_worker *worker,
+           struct sc_frame_writer_output *out, const AVFrame *rgb) {
+    size_t max_size = sc_qoi_max_size(rgb->width, rgb->height);
+    if (max_size > worker->encoded_cap) {
+        uint8_t *buf = realloc(worker->encoded, max_size);
+        if (!buf) {
+            LOG_OOM();
+            return false;
+        }
+        worker->encoded = buf;
+        worker->encoded_cap = max_size;
+    }
+
+    size_t size = sc_qoi_encode_rgb(rgb->data[0], rgb->linesize[0],
+                                    rgb->width, rgb->height,
+                                    worker->encoded);
+    if (size > INT_MAX) {
+        LOGE("Encoded QOI frame too large");
+        return false;
+    }
+
+    add_chunk(out, worker->encoded, size, size, 1);
+    return true;
+}
+
+// Pack the tiles of a delta frame (see tile_delta.h)
+static bool
+encode_tiles(struct sc_frame_writer_worker *worker,
+             struct sc_frame_writer_output *out,
+             const struct sc_frame_writer_job *job) {
+    size_t size = sc_tile_delta_payload_size(job->frame, &job->delta);
+    if (size > INT_MAX) {
+        LOGE("Delta frame too large");
+        return false;
+    }
+
+    if (size > worker->encoded_cap) {
+        uint8_t *buf = realloc(worker->encoded, size);
+        if (!buf) {
+            LOG_OOM();
+            return false;
+        }
+        worker->encoded = buf;
+        worker->encoded_cap = size;
+    }
+
+    sc_tile_delta_pack(job->frame, &job->delta, worker->encoded);
+    add_chunk(out, worker->encoded, size, size, 1);
+    return true;
+}
+
+// Quantizer scale of the FFmpeg MJPEG encoder (2, the best, to 31) for a JPEG
+// quality (100, the best, to 1)
+static int
+jpeg_qscale(unsigned quality) {
+    assert(quality >= 1 && quality <= 100);
+    return 2 + (100 - quality) * 29 / 99;
+}
+
+static bool
+open_image_encoder(struct sc_frame_writer_worker *worker,
+                   enum AVCodecID codec_id, int width, int height,
+                   enum AVPixelFormat pix_fmt) {
+    if (worker->image_ctx && worker->image_ctx->width == width
+            && worker->image_ctx->height == height
+            && worker->image_ctx->pix_fmt == pix_fmt) {
+        // Already open for this size and format
+        return true;
+    }
+
+    avcodec_free_context(&worker->image_ctx);
+
+    const AVCodec *codec = avcodec_find_encoder(codec_id);
+    assert(codec); // checked on init
+
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    if (!ctx) {
+        LOG_OOM();
+        return false;
+    }
+
+    ctx->width = width;
+    ctx->height = height;
+    ctx->pix_fmt = pix_fmt;
+    ctx->time_base = (AVRational) {1, 1};
+    // The I/O threads already run in parallel
+    ctx->thread_count = 1;
+
+    if (codec_id == AV_CODEC_ID_MJPEG) {
+        // Constant quantizer, set on each frame
+        ctx->flags |= AV_CODEC_FLAG_QSCALE;
+        ctx->global_quality =
+            FF_QP2LAMBDA * jpeg_qscale(worker->writer->quality);
+        // The planes are encoded as is, in limited range (flagged in a
+        // comment understood by the FFmpeg decoders), not expanded to the
+        // full range of JFIF
+        ctx->color_range = AVCOL_RANGE_MPEG;
+        ctx->strict_std_compliance = FF_COMPLIANCE_UNOFFICIAL;
+    }
+
+    if (avcodec_open2(ctx, codec, NULL) < 0) {
+        LOGE("Could not open %s encoder", codec->name);
+        avcodec_free_context(&ctx);
+        return false;
+    }
+
+    worker->image_ctx = ctx;
+    return true;
+}
+
+// Encode a frame with the image encoder opened for its size and format
+static bool
+encode_image(struct sc_frame_writer_worker *worker,
+             struct sc_frame_writer_output *out, const AVFrame *image) {
+    int ret = avcodec_send_frame(worker->image_ctx, image);
+    if (ret < 0) {
+        LOGE("Could not encode %s frame: %d", worker->image_ctx->codec->name,
+             ret);
+        return false;
+    }
+
+    // The previous packet is released only now, it may still be referenced
+    // by the previous output
+    av_packet_unref(worker->packet);
+
+    ret = avcodec_receive_packet(worker->image_ctx, worker->packet);
+    if (ret < 0) {
+        LOGE("Could not receive %s packet: %d",
+             worker->image_ctx->codec->name, ret);
+        return false;
+    }
+
+    add_chunk(out, worker->packet->data, worker->packet->size,
+              worker->packet->size, 1);
+    return true;
+}
+
+// Encode a RGB24 or GRAY8 frame
+static bool
+encode_png(struct sc_frame_writer_worker *worker,
+           struct sc_frame_writer_output *out, const AVFrame *image) {
+    if (!open_image_encoder(worker, AV_CODEC_ID_PNG, image->width,
+                            image->height, image->format)) {
+        return false;
+    }
+
+    return encode_image(worker, out, image);
+}
+
+// Encode a YUV420P frame, without color conversion
+static bool
+encode_jpeg(struct sc_frame_writer_worker *worker,
+            struct sc_frame_writer_output *out, AVFrame *frame) {
+    assert(frame->format == AV_PIX_FMT_YUV420P);
+    if (!open_image_encoder(worker, AV_CODEC_ID_MJPEG, frame->width,
+                            frame->height, frame->format)) {
+        return false;
+    }
+
+    // The MJPEG encoder reads the quantizer from each frame (the frame
+    // struct belongs to the job, only its data are shared)
+    frame->quality = worker->image_ctx->global_quality;
+    return encode_image(worker, out, frame);
+}
+
+#ifdef HAVE_ZSTD
+// Compress the output of a frame into a single zstd frame, which replaces its
+// chunks
+static bool
+compress_zstd(struct sc_frame_writer_worker *worker,
+              struct sc_frame_writer_output *out) {
+    size_t size = 0;
+    for (unsigned i = 0; i < out->count; ++i) {
+        size += (size_t) out->chunks[i].row_size * out->chunks[i].rows;
+    }
+
+    size_t max_size = ZSTD_compressBound(size);
+    if (max_size > worker->compressed_cap) {
+        uint8_t *buf = realloc(worker->compressed, max_size);
+        if (!buf) {
+            LOG_OOM();
+            return false;
+        }
+        worker->compressed = buf;
+        worker->compressed_cap = max_size;
+    }
+
+    ZSTD_CCtx *ctx = worker->zstd_ctx;
+    // The parameters and the dictionary are kept
+    ZSTD_CCtx_reset(ctx, ZSTD_reset_session_only);
+    // Written in the frame header, for the readers
+    ZSTD_CCtx_setPledgedSrcSize(ctx, size);
+
+    // The rows are streamed as is (the planes may be padded), the output
+    // buffer is large enough to never be full
+    ZSTD_outBuffer output = {worker->compressed, max_size, 0};
+    size_t ret;
+    for (unsigned i = 0; i < out->count; ++i) {
+        const struct sc_frame_archive_chunk *chunk = &out->chunks[i];
+        for (int row = 0; row < chunk->rows; ++row) {
+            ZSTD_inBuffer input = {
+                chunk->data + (size_t) row * chunk->linesize,
+                chunk->row_size,
+                0,
+            };
+            while (input.pos < input.size) {
+                ret = ZSTD_compressStream2(ctx, &output, &input,
+                                           ZSTD_e_continue);
+                if (ZSTD_isError(ret)) {
+                    goto error;
+                }
+            }
+        }
+    }
+
+    ZSTD_inBuffer end = {NULL, 0, 0};
+    do {
+        ret = ZSTD_compressStream2(ctx, &output, &end, ZSTD_e_end);
+        if (ZSTD_isError(ret)) {
+            goto error;
+        }
+    } while (ret);
+
+    if (output.pos > INT_MAX) {
+        LOGE("Compressed frame too large");
+        return false;
+    }
+
+    out->count = 0;
+    add_chunk(out, worker->compressed, output.pos, output.pos, 1);
+    return true;
+
+error:
+    LOGE("Could not compress frame: %s", ZSTD_getErrorName(ret));
+    return false;
+}
+#endif
+
+static void
+sc_frame_writer_drop(struct sc_frame_writer *fw,
+                     enum sc_frame_drop_reason reason, uint64_t frame_number,
+                     int64_t timestamp_ms) {
+    sc_frame_drops_add(&fw->drops, reason);
+    sc_metrics_add(SC_METRIC_WRITER_DROPPED_FRAMES, 1);
+    if (fw->archive_path) {
+        // Not held in the pre-trigger ring, the frame was committed
+        sc_frame_archive_add_dropped(&fw->archive, frame_number,
+                                     timestamp_ms);
+    }
+}
+
+// The buffers of the records written by the I/O threads, aligned for direct
+// I/O (and for io_uring)
+static void *
+sc_frame_writer_alloc_buffer(size_t size) {
+    assert(!(size % SC_FILE_DIRECT_ALIGNMENT));
+#ifdef _WIN32
+    return _aligned_malloc(size, SC_FILE_DIRECT_ALIGNMENT);
+#else
+    return aligned_alloc(SC_FILE_DIRECT_ALIGNMENT, size);
+#endif
+}
+
+static void
+sc_frame_writer_free_buffer(void *buffer) {
+#ifdef _WIN32
+    _aligned_free(buffer);
+#else
+    free(buffer);
+#endif
+}
+
+// Round up the capacity of a record buffer, to limit the reallocations
+static size_t
+sc_frame_writer_buffer_cap(size_t size) {
+    return (size + 0xFFFF) & ~(size_t) 0xFFFF;
+}
+
+// Size of the record written to the archive (header and payload), padded in
+// direct mode
+static size_t
+sc_frame_writer_record_size(struct sc_frame_writer *fw,
+                            const struct frame_header *header) {
+    size_t size = sizeof(*header) + header->frame_size;
+    if (fw->archive.direct) {
+        size_t align = SC_FILE_DIRECT_ALIGNMENT;
+        size = (size + align - 1) & ~(align - 1);
+    }
+    return size;
+}
+
+// Copy the record of a frame (`size` bytes, with its padding) to a buffer
+static void
+sc_frame_writer_copy_record(uint8_t *dst, size_t size,
+                            const struct frame_header *header,
+                            const struct sc_frame_writer_output *out) {
+    uint8_t *p = dst;
+    memcpy(p, header, sizeof(*header));
+    p += sizeof(*header);
+    for (unsigned i = 0; i < out->count; ++i) {
+        const struct sc_frame_archive_chunk *chunk = &out->chunks[i];
+        for (int row = 0; row < chunk->rows; ++row) {
+            memcpy(p, chunk->data + (size_t) row * chunk->linesize,
+                   chunk->row_size);
+            p += chunk->row_size;
+        }
+    }
+
+    size_t written = p - dst;
+    assert(written <= size);
+    memset(p, 0, size - written);
+}
+
+// Write the record of a frame to a direct archive, synchronously
+static bool
+sc_frame_writer_direct_append(struct sc_frame_writer_worker *worker,
+                              const struct sc_frame_writer_job *job,
+                              int width, int height,
+                              const struct sc_frame_writer_output *out) {
+    struct sc_frame_writer *fw = worker->writer;
+
+    struct frame_header header;
+    if (!sc_frame_archive_init_header(&header, job->timestamp_ms, width,
+                                      height, out->chunks, out->count)) {
+        return false;
+    }
+
+    size_t size = sc_frame_writer_record_size(fw, &header);
+    if (size > worker->direct_cap) {
+        size_t cap = sc_frame_writer_buffer_cap(size);
+        uint8_t *buf = sc_frame_writer_alloc_buffer(cap);
+        if (!buf) {
+            LOG_OOM();
+            return false;
+        }
+        sc_frame_writer_free_buffer(worker->direct_buffer);
+        worker->direct_buffer = buf;
+        worker->direct_cap = cap;
+    }
+
+    sc_frame_writer_copy_record(worker->direct_buffer, size, &header, out);
+
+    uint64_t offset;
+    if (!sc_frame_archive_reserve(&fw->archive, job->frame_number,
+                                  job->timestamp_ms, size, &offset)) {
+        return false;
+    }
+
+    if (!sc_file_write_at(fw->archive.fd, worker->direct_buffer, size,
+                          offset)) {
+        // The file content is now inconsistent with the index
+        sc_frame_archive_fail(&fw->archive);
+        return false;
+    }
+
+    return true;
+}
+
+#ifdef HAVE_IO_URING
+// Recycle the buffers of the completed writes, after submitting the queued
+// writes and waiting for at least `wait_nr` completions
+static void
+sc_frame_writer_uring_reap(struct sc_frame_writer_worker *worker,
+                           unsigned wait_nr) {
+    struct sc_frame_writer *fw = worker->writer;
+
+    if (!worker->ring_failed && !sc_io_ring_submit(&worker->ring, wait_nr)) {
+        // The writes in flight will never be reaped
+        worker->ring_failed = true;
+        sc_frame_archive_fail(&fw->archive);
+    }
+
+    struct sc_io_ring_completion c;
+    while (sc_io_ring_pop(&worker->ring, &c)) {
+        assert(c.user_data < SC_FRAME_WRITER_URING_BUFFERS);
+        struct sc_frame_writer_uring_buffer *buf =
+            &worker->buffers[c.user_data];
+        assert(buf->busy);
+        buf->busy = false;
+
+        if (c.res < 0 || (size_t) c.res != buf->size) {
+            // The file content is now inconsistent with the index
+            sc_frame_archive_fail(&fw->archive);
+            sc_frame_writer_drop(fw, SC_FRAME_DROP_WRITE_FAILED,
+                                 buf->frame_number, buf->timestamp_ms);
+            continue;
+        }
+
+        sc_metrics_add(SC_METRIC_SAVED_FRAMES, 1);
+    }
+}
+
+// Wait for all the writes in flight
+static void
+sc_frame_writer_uring_drain(struct sc_frame_writer_worker *worker) {
+    while (!worker->ring_failed
+            && (worker->ring.inflight || worker->ring.queued)) {
+        sc_frame_writer_uring_reap(worker,
+                                   worker->ring.inflight
+                                       + worker->ring.queued);
+    }
+}
+
+// Grow all the buffers to hold a record of `size` bytes, and register them
+static bool
+sc_frame_writer_uring_grow(struct sc_frame_writer_worker *worker,
+                           size_t size) {
+    // The buffers may only be registered again once they are not used
+    sc_frame_writer_uring_drain(worker);
+    if (worker->ring_failed) {
+        return false;
+    }
+
+    size_t cap = sc_frame_writer_buffer_cap(size);
+
+    void *data[SC_FRAME_WRITER_URING_BUFFERS];
+    size_t sizes[SC_FRAME_WRITER_URING_BUFFERS];
+    for (unsigned i = 0; i < SC_FRAME_WRITER_URING_BUFFERS; ++i) {
+        struct sc_frame_writer_uring_buffer *buf = &worker->buffers[i];
+        sc_frame_writer_free_buffer(buf->data);
+        buf->data = sc_frame_writer_alloc_buffer(cap);
+        if (!buf->data) {
+            LOG_OOM();
+            while (i--) {
+                sc_frame_writer_free_buffer(worker->buffers[i].data);
+                worker->buffers[i].data = NULL;
+            }
+            worker->buffer_cap = 0;
+            return false;
+        }
+        data[i] = buf->data;
+        sizes[i] = cap;
+    }
+
+    if (!sc_io_ring_register_buffers(&worker->ring, data, sizes,
+                                     SC_FRAME_WRITER_URING_BUFFERS)) {
+        worker->ring_failed = true;
+        sc_frame_archive_fail(&worker->writer->archive);
+        return false;
+    }
+
+    worker->buffer_cap = cap;
+    return true;
+}
+
+// Get a free buffer for a record of `size` bytes
+static struct sc_frame_writer_uring_buffer *
+sc_frame_writer_uring_get_buffer(struct sc_frame_writer_worker *worker,
+                                 size_t size, unsigned *index) {
+    if (size > worker->buffer_cap
+            && !sc_frame_writer_uring_grow(worker, size)) {
+        return NULL;
+    }
+
+    for (;;) {
+        for (unsigned i = 0; i < SC_FRAME_WRITER_URING_BUFFERS; ++i) {
+            if (!worker->buffers[i].busy) {
+                *index = i;
+                return &worker->buffers[i];
+            }
+        }
+
+        // All the buffers are in flight, wait for the oldest one
+        sc_frame_writer_uring_reap(worker, 1);
+        if (worker->ring_failed) {
+            return NULL;
+        }
+    }
+}
+
+// Copy the record of a frame into a registered buffer, and queue its write
+// (submitted by the next sc_frame_writer_uring_reap())
+static bool
+sc_frame_writer_uring_append(struct sc_frame_writer_worker *worker,
+                             const struct sc_frame_writer_job *job,
+                             int width, int height,
+                             const struct sc_frame_writer_output *out) {
+    struct sc_frame_writer *fw = worker->writer;
+    if (worker->ring_failed) {
+        return false;
+    }
+
+    struct frame_header header;
+    if (!sc_frame_archive_init_header(&header, job->timestamp_ms, width,
+                                      height, out->chunks, out->count)) {
+        return false;
+    }
+
+    size_t size = sc_frame_writer_record_size(fw, &header);
+    unsigned index;
+    struct sc_frame_writer_uring_buffer *buf =
+        sc_frame_writer_uring_get_buffer(worker, size, &index);
+    if (!buf) {
+        return false;
+    }
+
+    sc_frame_writer_copy_record(buf->data, size, &header, out);
+
+    uint64_t offset;
+    if (!sc_frame_archive_reserve(&fw->archive, job->frame_number,
+                                  job->timestamp_ms, size, &offset)) {
+        return false;
+    }
+
+    // There are at least as many submission entries as buffers
+    bool ok = sc_io_ring_write_fixed(&worker->ring, fw->archive.fd,
+                                     buf->data, size, offset, index, index);
+    assert(ok);
+    (void) ok;
+
+    buf->size = size;
+    buf->busy = true;
+    buf->frame_number = job->frame_number;
+    buf->timestamp_ms = job->timestamp_ms;
+    return true;
+}
+#endif
+
+static bool
+save_frame_as_image(struct sc_frame_writer_worker *worker,
+                    const struct sc_frame_writer_job *job) {
+    struct sc_frame_writer *fw = worker->writer;
+    const AVFrame *frame = job->frame;
+
+    int64_t timestamp_ms = job->timestamp_ms;
+
+    // The GRAY8 frames are written as is, without any color conversion
+    bool gray = frame->format == AV_PIX_FMT_GRAY8;
+    // QOI and JPEG are not supported in grayscale (rejected by the command
+    // line parser)
+    assert(!gray || (fw->format != SC_SAVE_FRAMES_FORMAT_QOI
+                  && fw->format != SC_SAVE_FRAMES_FORMAT_JPEG));
+
+    AVFrame *rgb = NULL;
+    if (fw->format != SC_SAVE_FRAMES_FORMAT_YUV
+            && fw->format != SC_SAVE_FRAMES_FORMAT_JPEG && !gray) {
+        rgb = job->rectify ? rectify_to_rgb(worker, frame)
+                           : convert_to_rgb(worker, frame);
+        if (!rgb) {
+            return false;
+        }
+    }
+    const AVFrame *image = gray ? frame : rgb;
+
+    struct sc_frame_writer_output out;
+    out.count = 0;
+
+    bool ok;
+    switch (fw->format) {
+        case SC_SAVE_FRAMES_FORMAT_YUV:
+            if (job->delta.delta) {
+                ok = encode_tiles(worker, &out, job);
+                break;
+            }
+            encode_yuv(&out, frame);
+            ok = true;
+            break;
+        case SC_SAVE_FRAMES_FORMAT_PNG:
+            ok = encode_png(worker, &out, image);
+            break;
+        case SC_SAVE_FRAMES_FORMAT_QOI:
+            ok = encode_qoi(worker, &out, rgb);
+            break;
+        case SC_SAVE_FRAMES_FORMAT_JPEG:
+            ok = encode_jpeg(worker, &out, job->frame);
+            break;
+        default:
+            assert(fw->format == SC_SAVE_FRAMES_FORMAT_PPM);
+            encode_ppm(&out, image);
+            ok = true;
+            break;
+    }
+
+#ifdef HAVE_ZSTD
+    if (ok && fw->zstd_level) {
+        ok = compress_zstd(worker, &out);
+    }
+#endif
+
+    if (!ok) {
+        av_frame_free(&rgb);
+        return false;
+    }
+
+#ifdef HAVE_IO_URING
+    if (fw->io == SC_SAVE_FRAMES_IO_URING) {
+        // The record is copied, the frame may be released, and the saved
+        // frame is counted once written
+        ok = sc_frame_writer_uring_append(worker, job, frame->width,
+                                          frame->height, &out);
+        av_frame_free(&rgb);
+        return ok;
+    }
+#endif
+
+    if (fw->archive_path) {
+        // On failure, the error is logged by the archive
+        if (fw->archive.direct) {
+            ok = sc_frame_writer_direct_append(worker, job, frame->width,
+                                               frame->height, &out);
+        } else {
+            ok = sc_frame_archive_append(&fw->archive, job->frame_number,
+                                         timestamp_ms, frame->width,
+                                         frame->height, out.chunks,
+                                         out.count);
+        }
+        if (ok) {
+            sc_metrics_add(SC_METRIC_SAVED_FRAMES, 1);
+        }
+        av_frame_free(&rgb);
+        return ok;
+    }
+
+    const char *ext = get_file_extension(fw->format, gray);
+    char filename[256];
+    if (timestamp_ms < 0) {
+        // If no PTS available, fallback to just frame number
+        snprintf(filename, sizeof(filename), "%s/frame_%06d.%s",
+                 fw->directory, (int) job->frame_number, ext);
+    } else {
+        snprintf(filename, sizeof(filename), "%s/frame_%06d_%" PRId64 ".%s",
+                 fw->directory, (int) job->frame_number, timestamp_ms, ext);
+    }
+
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        LOGE("Could not open file for frame saving: %s", filename);
+        av_frame_free(&rgb);
+        return false;
+    }
+
+    ok = sc_frame_archive_write_chunks(fp, out.chunks, out.count);
+
+    if (fclose(fp)) {
+        ok = false;
+    }
+
+    if (ok) {
+        sc_metrics_add(SC_METRIC_SAVED_FRAMES, 1);
+        if (fw->uploader) {
+            sc_uploader_push(fw->uploader, filename);
+        }
+    } else {
+        LOGE("Could not write frame: %s", filename);
+    }
+
+    av_frame_free(&rgb);
+    return ok;
+}
+
+// Return whether a frame is a delta whose base (or a base of its base) could
+// not be saved (called with the mutex locked)
+static bool
+sc_frame_writer_delta_broken(struct sc_frame_writer *fw,
+                             const struct sc_frame_writer_job *job) {
+    return fw->delta_broken && job->delta.delta
+        && job->delta.key_frame_number == fw->delta_broken_key
+        && job->frame_number > fw->delta_broken_frame;
+}
+
+// Store a frame in full instead of as a delta (its key frame number is kept,
+// the next frames of the chain still depend on it)
+static void
+sc_frame_writer_make_full(struct sc_frame_writer_job *job) {
+    free(job->delta.tiles);
+    job->delta.tiles = NULL;
+    job->delta.tile_count = 0;
+    job->delta.delta = false;
+}
+
+// Break the chain of tile deltas of a frame which could not be saved
+static void
+sc_frame_writer_break_chain(struct sc_frame_writer *fw,
+                            const struct sc_frame_writer_job *job) {
+    // The next frames encoded must not depend on it
+    sc_tile_delta_reset(&fw->delta_encoder);
+
+    sc_mutex_lock(&fw->mutex);
+    uint64_t key = job->delta.key_frame_number;
+    if (!fw->delta_broken || fw->delta_broken_key != key
+            || fw->delta_broken_frame > job->frame_number) {
+        // Keep the first break of the chain
+        fw->delta_broken = true;
+        fw->delta_broken_key = key;
+        fw->delta_broken_frame = job->frame_number;
+    }
+
+    // The frames already encoded against it are stored in full (those being
+    // saved by the other I/O threads are checked by sc_frame_writer_save(), and
+    // those already saved are dropped by the archive on close)
+    size_t count = sc_vecdeque_size(&fw->queue);
+    for (size_t i = 0; i < count; ++i) {
+        struct sc_frame_writer_job *queued = sc_vecdeque_getref(&fw->queue, i);
+        if (queued->type == SC_FRAME_WRITER_JOB_FRAME
+                && sc_frame_writer_delta_broken(fw, queued)) {
+            sc_frame_writer_make_full(queued);
+        }
+    }
+    sc_mutex_unlock(&fw->mutex);
+}
+
+static void
+sc_frame_writer_save(struct sc_frame_writer_worker *worker,
+                     const struct sc_frame_writer_job *job) {
+    struct sc_frame_writer *fw = worker->writer;
+
+    struct sc_frame_writer_job full;
+    if (job->delta.delta) {
+        // Its chain may have been broken since it was queued
+        sc_mutex_lock(&fw->mutex);
+        bool broken = sc_frame_writer_delta_broken(fw, job);
+        sc_mutex_unlock(&fw->mutex);
+        if (broken) {
+            // The tiles are released with the job
+            full = *job;
+            full.delta.delta = false;
+            job = &full;
+        }
+    }
+
+    if (!save_frame_as_image(worker, job)) {
+        sc_frame_writer_drop(fw, SC_FRAME_DROP_WRITE_FAILED,
+                             job->frame_number, job->timestamp_ms);
+        if (fw->tile_delta) {
+            sc_frame_writer_break_chain(fw, job);
+        }
+        return;
+    }
+
+    if (job->delta.delta) {
+        struct sc_frame_archive_delta delta = {
+            .frame_number = job->frame_number,
+            .base_frame_number = job->delta.base_frame_number,
+            .key_frame_number = job->delta.key_frame_number,
+        };
+        sc_frame_archive_add_delta(&fw->archive, &delta);
+    }
+}
+
+// Write a job of the queue or of the pre-trigger ring
+static void
+sc_frame_writer_process(struct sc_frame_writer_worker *worker,
+                        const struct sc_frame_writer_job *job) {
+    struct sc_frame_archive *archive = &worker->writer->archive;
+
+    switch (job->type) {
+        case SC_FRAME_WRITER_JOB_FRAME:
+            sc_frame_writer_save(worker, job);
+            break;
+        case SC_FRAME_WRITER_JOB_DROPPED:
+            sc_frame_archive_add_dropped(archive, job->frame_number,
+                                         job->timestamp_ms);
+            break;
+        case SC_FRAME_WRITER_JOB_REPEATED:
+            sc_frame_archive_add_repeated(archive, job->frame_number,
+                                          job->timestamp_ms);
+            break;
+        case SC_FRAME_WRITER_JOB_GAP:
+            sc_frame_archive_add_gap(archive, job->frame_number,
+                                     job->timestamp_ms);
+            break;
+        case SC_FRAME_WRITER_JOB_TIMESTAMP:
+            sc_frame_archive_add_timestamp(archive, &job->ts);
+            break;
+        case SC_FRAME_WRITER_JOB_POSES:
+            sc_frame_archive_add_poses(archive, job->poses.samples,
+                                       job->poses.count);
+            break;
+        default:
+            assert(!"unexpected job type");
+    }
+}
+
+// Memory held by a job (its frame)
+static uint64_t
+sc_frame_writer_job_size(const struct sc_frame_writer_job *job) {
+    uint64_t size = 0;
+    if (job->frame) {
+        for (unsigned i = 0; i < AV_NUM_DATA_POINTERS && job->frame->buf[i];
+                ++i) {
+            size += job->frame->buf[i]->size;
+        }
+    }
+    return size;
+}
+
+static bool
+sc_frame_writer_has_jobs(struct sc_frame_writer *fw) {
+    return !sc_vecdeque_is_empty(&fw->queue) || fw->ring_committed;
+}
+
+// Wake up an I/O thread to write the new jobs (called with the mutex locked)
+static void
+sc_frame_writer_signal(struct sc_frame_writer *fw) {
+    if (fw->active_count < fw->thread_count) {
+        // A single wake-up could be consumed by an inactive thread
+        sc_cond_broadcast(&fw->queue_cond);
+    } else {
+        sc_cond_signal(&fw->queue_cond);
+    }
+}
+
+// Pop the next job to write, from the queue or from the committed part of the
+// pre-trigger ring
+static struct sc_frame_writer_job
+sc_frame_writer_pop_job(struct sc_frame_writer *fw) {
+    if (!sc_vecdeque_is_empty(&fw->queue)) {
+        return sc_vecdeque_pop(&fw->queue);
+    }
+
+    assert(fw->ring_committed);
+    struct sc_frame_writer_job job = sc_vecdeque_pop(&fw->ring);
+    --fw->ring_committed;
+    fw->ring_size -= sc_frame_writer_job_size(&job);
+    return job;
+}
+
+// Prepare the I/O thread for the announced size of the frames, before the
+// first one (on failure, everything is allocated on the first frame)
+static void
+sc_frame_writer_prepare(struct sc_frame_writer_worker *worker) {
+    struct sc_frame_writer *fw = worker->writer;
+    int width = fw->width;
+    int height = fw->height;
+    if (!width || !height || fw->format == SC_SAVE_FRAMES_FORMAT_YUV) {
+        return;
+    }
+
+    if (fw->format == SC_SAVE_FRAMES_FORMAT_JPEG) {
+        // Encoded directly from the YUV420P planes
+        (void) open_image_encoder(worker, AV_CODEC_ID_MJPEG, width, height,
+                                  AV_PIX_FMT_YUV420P);
+        return;
+    }
+
+    // The GRAY8 frames are not converted
+    if (!fw->gray) {
+        (void) sc_frame_pool_prepare(&worker->rgb_pool, AV_PIX_FMT_RGB24,
+                                     width, height,
+                                     SC_FRAME_WRITER_PREPARED_FRAMES);
+    }
+
+    if (fw->format == SC_SAVE_FRAMES_FORMAT_PNG) {
+        (void) open_image_encoder(worker, AV_CODEC_ID_PNG, width, height,
+                                  fw->gray ? AV_PIX_FMT_GRAY8
+                                           : AV_PIX_FMT_RGB24);
+    }
+}
+
+static int
+run_frame_writer(void *data) {
+    struct sc_frame_writer_worker *worker = data;
+    struct sc_frame_writer *fw = worker->writer;
+
+    (void) sc_alloc_stats_enter(SC_ALLOC_WRITER);
+
+    sc_mutex_lock(&fw->mutex);
+    bool prepared = worker->index < fw->active_count;
+    sc_mutex_unlock(&fw->mutex);
+    if (prepared) {
+        sc_frame_writer_prepare(worker);
+    }
+
+    for (;;) {
+        sc_mutex_lock(&fw->mutex);
+
+        while (!fw->stopped && (worker->index >= fw->active_count
+                                    || !sc_frame_writer_has_jobs(fw))) {
+            sc_cond_wait(&fw->queue_cond, &fw->mutex);
+        }
+
+        if (fw->stopped && !sc_frame_writer_has_jobs(fw)) {
+            // All the queued (or committed) frames have been written
+            sc_mutex_unlock(&fw->mutex);
+            break;
+        }
+
+        // Dequeue several frames at once to reduce lock contention
+        struct sc_frame_writer_job batch[SC_FRAME_WRITER_BATCH_SIZE];
+        unsigned count = 0;
+        while (count < SC_FRAME_WRITER_BATCH_SIZE
+                && sc_frame_writer_has_jobs(fw)) {
+            batch[count++] = sc_frame_writer_pop_job(fw);
+        }
+        sc_metrics_set(SC_METRIC_WRITER_QUEUE, sc_vecdeque_size(&fw->queue));
+
+        sc_mutex_unlock(&fw->mutex);
+
+        sc_tick start = sc_tick_now();
+        for (unsigned i = 0; i < count; ++i) {
+            sc_frame_writer_process(worker, &batch[i]);
+            sc_frame_writer_job_destroy(&batch[i]);
+        }
+        sc_metrics_add(SC_METRIC_WRITE_US,
+                       SC_TICK_TO_US(sc_tick_now() - start));
+
+#ifdef HAVE_IO_URING
+        if (fw->io == SC_SAVE_FRAMES_IO_URING) {
+            // Submit the writes of the whole batch at once
+            sc_frame_writer_uring_reap(worker, 0);
+        }
+#endif
+    }
+
+#ifdef HAVE_IO_URING
+    if (fw->io == SC_SAVE_FRAMES_IO_URING) {
+        // The archive index is written once all the threads are joined
+        sc_frame_writer_uring_drain(worker);
+    }
+#endif
+
+    LOGD("Frame writer thread ended");
+
+    return 0;
+}
+
+#ifdef HAVE_IO_URING
+static void
+sc_frame_writer_destroy_uring(struct sc_frame_writer *fw, unsigned count) {
+    for (unsigned i = 0; i < count; ++i) {
+        struct sc_frame_writer_worker *worker = &fw->workers[i];
+        assert(worker->ring_failed || !worker->ring.inflight);
+        // Closing the ring waits for the writes in flight, if any
+        sc_io_ring_destroy(&worker->ring);
+        for (unsigned j = 0; j < SC_FRAME_WRITER_URING_BUFFERS; ++j) {
+            sc_frame_writer_free_buffer(worker->buffers[j].data);
+        }
+    }
+}
+
+static bool
+sc_frame_writer_init_uring(struct sc_frame_writer *fw) {
+    for (unsigned i = 0; i < fw->thread_count; ++i) {
+        struct sc_frame_writer_worker *worker = &fw->workers[i];
+        if (!sc_io_ring_init(&worker->ring, SC_FRAME_WRITER_URING_BUFFERS)) {
+            sc_frame_writer_destroy_uring(fw, i);
+            return false;
+        }
+        memset(worker->buffers, 0, sizeof(worker->buffers));
+        worker->buffer_cap = 0;
+        worker->ring_failed = false;
+    }
+
+    return true;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static void
+sc_frame_writer_destroy_zstd(struct sc_frame_writer *fw, unsigned count) {
+    for (unsigned i = 0; i < count; ++i) {
+        struct sc_frame_writer_worker *worker = &fw->workers[i];
+        ZSTD_freeCCtx(worker->zstd_ctx);
+        free(worker->compressed);
+    }
+    ZSTD_freeCDict(fw->zstd_cdict);
+    if (fw->zstd_dictionary.data) {
+        sc_file_unmap(&fw->zstd_dictionary);
+    }
+}
+
+static bool
+sc_frame_writer_init_zstd(struct sc_frame_writer *fw, int level,
+                          const char *dictionary) {
+    fw->zstd_level = level;
+    fw->zstd_dictionary.data = NULL;
+    fw->zstd_cdict = NULL;
+
+    if (dictionary) {
+        if (!sc_file_map(dictionary, &fw->zstd_dictionary)) {
+            LOGE("Could not read zstd dictionary: %s", dictionary);
+            return false;
+        }
+
+        // Digested once, then shared (read-only) by all the threads
+        fw->zstd_cdict = ZSTD_createCDict(fw->zstd_dictionary.data,
+                                          fw->zstd_dictionary.size, level);
+        if (!fw->zstd_cdict) {
+            LOGE("Invalid zstd dictionary: %s", dictionary);
+            sc_file_unmap(&fw->zstd_dictionary);
+            return false;
+        }
+    }
+
+    for (unsigned i = 0; i < fw->thread_count; ++i) {
+        struct sc_frame_writer_worker *worker = &fw->workers[i];
+        worker->compressed = NULL;
+        worker->compressed_cap = 0;
+        worker->zstd_ctx = ZSTD_createCCtx();
+        if (!worker->zstd_ctx) {
+            LOG_OOM();
+            sc_frame_writer_destroy_zstd(fw, i);
+            return false;
+        }
+
+        ZSTD_CCtx *ctx = worker->zstd_ctx;
+        ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, level);
+        // Let the readers detect a corrupted frame
+        ZSTD_CCtx_setParameter(ctx, ZSTD_c_checksumFlag, 1);
+        if (fw->zstd_cdict) {
+            ZSTD_CCtx_refCDict(ctx, fw->zstd_cdict);
+        }
+    }
+
+    // The dictionary is written with the index
+    sc_frame_archive_set_zstd(&fw->archive, fw->zstd_dictionary.data,
+                              fw->zstd_dictionary.data
+                                    ? fw->zstd_dictionary.size : 0);
+    return true;
+}
+#endif
+
+bool
+sc_frame_writer_init(struct sc_frame_writer *fw,
+                     const struct sc_frame_writer_params *params) {
+    const char *directory = params->directory;
+    const char *archive_path = params->archive_path;
+    enum sc_save_frames_format format = params->format;
+    unsigned thread_count = params->thread_count;
+    assert(directory || archive_path);
+    assert(thread_count > 0 && thread_count <= SC_FRAME_WRITER_MAX_THREADS);
+    assert(params->io == SC_SAVE_FRAMES_IO_SYNC || archive_path);
+    assert(!params->direct || archive_path);
+    assert(!params->pre_trigger || params->post_trigger);
+    assert(!params->zstd_level || archive_path);
+    assert(params->zstd_level || !params->zstd_dictionary);
+    assert(!params->tile_delta || (archive_path && !params->pre_trigger
+                                && format == SC_SAVE_FRAMES_FORMAT_YUV));
+#ifndef HAVE_ZSTD
+    // Rejected by the command line parser
+    assert(!params->zstd_level);
+#endif
+
+    if (format == SC_SAVE_FRAMES_FORMAT_PNG
+            && !avcodec_find_encoder(AV_CODEC_ID_PNG)) {
+        LOGE("PNG encoder not available in this FFmpeg build, use "
+             "--save-frames-format=qoi for lossless compression");
+        return false;
+    }
+
+    if (format == SC_SAVE_FRAMES_FORMAT_JPEG
+            && !avcodec_find_encoder(AV_CODEC_ID_MJPEG)) {
+        LOGE("JPEG encoder not available in this FFmpeg build");
+        return false;
+    }
+
+    bool ok = sc_mutex_init(&fw->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&fw->queue_cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    sc_vecdeque_init(&fw->queue);
+    ok = sc_vecdeque_reserve(&fw->queue, SC_FRAME_WRITER_QUEUE_SIZE);
+    if (!ok) {
+        LOG_OOM();
+        goto error_destroy_queue_cond;
+    }
+
+    if (archive_path) {
+        ok = sc_frame_archive_open(&fw->archive, archive_path, params->direct,
+                                   params->expected_duration);
+        if (!ok) {
+            goto error_destroy_queue;
+        }
+    }
+
+    fw->directory = directory;
+    fw->archive_path = archive_path;
+    fw->format = format;
+    assert(params->quality <= 100);
+    fw->quality = params->quality ? params->quality
+                                  : SC_FRAME_WRITER_DEFAULT_QUALITY;
+    fw->io = params->io;
+    fw->remap = params->remap;
+    fw->width = params->width;
+    fw->height = params->height;
+    fw->gray = params->gray;
+    fw->thread_count = thread_count;
+    assert(params->active_threads <= thread_count);
+    fw->active_count = params->active_threads ? params->active_threads
+                                              : thread_count;
+    fw->uploader = params->uploader;
+    fw->started_count = 0;
+    sc_frame_drops_init(&fw->drops, "Frame writer");
+    fw->stopped = false;
+
+    fw->pre_trigger = params->pre_trigger;
+    fw->post_trigger = params->post_trigger;
+    sc_vecdeque_init(&fw->ring);
+    fw->ring_committed = 0;
+    fw->ring_size = 0;
+    fw->ring_limited = false;
+    fw->budget_limited = false;
+    fw->recording = false;
+    fw->recording_end = 0;
+
+    fw->tile_delta = params->tile_delta;
+    fw->delta_broken = false;
+    fw->delta_broken_key = 0;
+    fw->delta_broken_frame = 0;
+    if (fw->tile_delta) {
+        unsigned key_interval = params->key_interval
+                              ? params->key_interval
+                              : SC_TILE_DELTA_DEFAULT_KEY_INTERVAL;
+        sc_tile_delta_init(&fw->delta_encoder, params->tile_threshold,
+                           key_interval);
+    }
+
+    unsigned i;
+    for (i = 0; i < thread_count; ++i) {
+        struct sc_frame_writer_worker *worker = &fw->workers[i];
+        worker->packet = av_packet_alloc();
+        if (!worker->packet) {
+            LOG_OOM();
+            goto error_destroy_workers;
+        }
+        worker->writer = fw;
+        worker->index = i;
+        sc_rgb_converter_init(&worker->rgb_converter,
+                              SC_RGB_CONVERTER_DEFAULT);
+        worker->image_ctx = NULL;
+        worker->encoded = NULL;
+        worker->encoded_cap = 0;
+        worker->direct_buffer = NULL;
+        worker->direct_cap = 0;
+        sc_frame_pool_init(&worker->rgb_pool);
+    }
+
+#ifdef HAVE_ZSTD
+    if (params->zstd_level) {
+        if (!sc_frame_writer_init_zstd(fw, params->zstd_level,
+                                       params->zstd_dictionary)) {
+            goto error_destroy_workers;
+        }
+    } else {
+        fw->zstd_level = 0;
+    }
+#endif
+
+#ifdef HAVE_IO_URING
+    if (fw->io == SC_SAVE_FRAMES_IO_URING
+            && !sc_frame_writer_init_uring(fw)) {
+        LOGW("Frame archive written without io_uring");
+        fw->io = SC_SAVE_FRAMES_IO_SYNC;
+    }
+#endif
+
+    return true;
+
+error_destroy_workers:
+    while (i--) {
+        av_packet_free(&fw->workers[i].packet);
+    }
+    if (fw->tile_delta) {
+        sc_tile_delta_destroy(&fw->delta_encoder);
+    }
+    if (archive_path) {
+        sc_frame_archive_close(&fw->archive);
+    }
+error_destroy_queue:
+    sc_vecdeque_destroy(&fw->queue);
+error_destroy_queue_cond:
+    sc_cond_destroy(&fw->queue_cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&fw->mutex);
+
+    return false;
+}
+
+void
+sc_frame_writer_destroy(struct sc_frame_writer *fw) {
+    // Only remaining if the threads have not been started
+    while (!sc_vecdeque_is_empty(&fw->queue)) {
+        struct sc_frame_writer_job *job = sc_vecdeque_popref(&fw->queue);
+        sc_frame_writer_job_destroy(job);
+    }
+
+    // The jobs of the pre-trigger ring not committed are discarded
+    while (!sc_vecdeque_is_empty(&fw->ring)) {
+        struct sc_frame_writer_job *job = sc_vecdeque_popref(&fw->ring);
+        sc_frame_writer_job_destroy(job);
+    }
+    sc_vecdeque_destroy(&fw->ring);
+
+    for (unsigned i = 0; i < fw->thread_count; ++i) {
+        struct sc_frame_writer_worker *worker = &fw->workers[i];
+        sc_rgb_converter_destroy(&worker->rgb_converter);
+        avcodec_free_context(&worker->image_ctx);
+        av_packet_free(&worker->packet);
+        free(worker->encoded);
+        sc_frame_writer_free_buffer(worker->direct_buffer);
+        sc_frame_pool_destroy(&worker->rgb_pool);
+    }
+
+#ifdef HAVE_IO_URING
+    if (fw->io == SC_SAVE_FRAMES_IO_URING) {
+        sc_frame_writer_destroy_uring(fw, fw->thread_count);
+    }
+#endif
+
+    if (fw->tile_delta) {
+        sc_tile_delta_destroy(&fw->delta_encoder);
+    }
+
+    if (fw->archive_path) {
+        // All the frames have been written, the index can be appended
+        sc_frame_archive_close(&fw->archive);
+        if (fw->uploader && !fw->archive.failed) {
+            sc_uploader_push(fw->uploader, fw->archive_path);
+        }
+    }
+
+#ifdef HAVE_ZSTD
+    if (fw->zstd_level) {
+        // After the archive, which writes the dictionary on close
+        sc_frame_writer_destroy_zstd(fw, fw->thread_count);
+    }
+#endif
+
+    sc_frame_drops_log(&fw->drops);
+
+    sc_vecdeque_destroy(&fw->queue);
+    sc_cond_destroy(&fw->queue_cond);
+    sc_mutex_destroy(&fw->mutex);
+}
+
+bool
+sc_frame_writer_start(struct sc_frame_writer *fw) {
+    LOGD("Starting frame writer (%u threads)", fw->thread_count);
+
+    for (unsigned i = 0; i < fw->thread_count; ++i) {
+        struct sc_frame_writer_worker *worker = &fw->workers[i];
+        bool ok = sc_thread_create(&worker->thread, run_frame_writer,
+                                   "scrcpy-fwriter", worker);
+        if (!ok) {
+            LOGE("Could not start frame writer thread");
+            if (!fw->started_count) {
+                return false;
+            }
+            // Continue with the threads already started
+            break;
+        }
+        ++fw->started_count;
+    }
+
+    return true;
+}
+
+unsigned
+sc_frame_writer_set_active_threads(struct sc_frame_writer *fw,
+                                   unsigned count) {
+    assert(count);
+
+    sc_mutex_lock(&fw->mutex);
+    if (count > fw->started_count) {
+        count = fw->started_count;
+    }
+    if (count != fw->active_count) {
+        fw->active_count = count;
+        // Wake up the threads activated (or deactivated, to wait)
+        sc_cond_broadcast(&fw->queue_cond);
+    }
+    sc_mutex_unlock(&fw->mutex);
+
+    return count;
+}
+
+void
+sc_frame_writer_stop(struct sc_frame_writer *fw) {
+    sc_mutex_lock(&fw->mutex);
+    fw->stopped = true;
+    sc_cond_broadcast(&fw->queue_cond);
+    sc_mutex_unlock(&fw->mutex);
+}
+
+void
+sc_frame_writer_join(struct sc_frame_writer *fw) {
+    for (unsigned i = 0; i < fw->started_count; ++i) {
+        sc_thread_join(&fw->workers[i].thread, NULL);
+    }
+}
+
+// Evict the jobs of the pre-trigger ring older than its duration, and the
+// oldest ones if `size` more bytes would exceed its maximum size
+static void
+sc_frame_writer_ring_evict(struct sc_frame_writer *fw, sc_tick now,
+                           uint64_t size) {
+    // The committed jobs are at the front, they are written before
+    while (!fw->ring_committed && !sc_vecdeque_is_empty(&fw->ring)) {
+        struct sc_frame_writer_job *job = sc_vecdeque_peekref(&fw->ring);
+        bool expired = now - job->time > fw->pre_trigger;
+        bool full = fw->ring_size + size > SC_FRAME_WRITER_RING_MAX_SIZE;
+        if (!expired && !full) {
+            break;
+        }
+
+        if (!expired && !fw->ring_limited) {
+            LOGW("Frame writer: pre-trigger ring limited to %" PRIu64 " MiB "
+                 "(%" PRItick " ms)", SC_FRAME_WRITER_RING_MAX_SIZE >> 20,
+                 SC_TICK_TO_MS(now - job->time));
+            fw->ring_limited = true;
+        }
+
+        fw->ring_size -= sc_frame_writer_job_size(job);
+        job = sc_vecdeque_popref(&fw->ring);
+        sc_frame_writer_job_destroy(job);
+    }
+}
+
+// Hold a job in the pre-trigger ring, committed if the capture was triggered
+//
+// Return false if it could not be held. The mutex must be locked.
+static bool
+sc_frame_writer_ring_push(struct sc_frame_writer *fw,
+                          struct sc_frame_writer_job *job) {
+    sc_tick now = sc_tick_now();
+    job->time = now;
+
+    if (fw->recording && now > fw->recording_end) {
+        LOGI("Frame writer: end of the triggered capture");
+        fw->recording = false;
+    }
+
+    uint64_t size = sc_frame_writer_job_size(job);
+    sc_frame_writer_ring_evict(fw, now, size);
+    if (fw->ring_size + size > SC_FRAME_WRITER_RING_MAX_SIZE) {
+        // The committed frames are not written yet (disk too slow)
+        return false;
+    }
+
+    if (!sc_vecdeque_push(&fw->ring, *job)) {
+        LOG_OOM();
+        return false;
+    }
+    fw->ring_size += size;
+
+    if (fw->recording) {
+        fw->ring_committed = sc_vecdeque_size(&fw->ring);
+        sc_frame_writer_signal(fw);
+    }
+
+    return true;
+}
+
+// Hold an index record in the pre-trigger ring
+static void
+sc_frame_writer_ring_push_record(struct sc_frame_writer *fw,
+                                 struct sc_frame_writer_job *job) {
+    sc_mutex_lock(&fw->mutex);
+    bool ok = sc_frame_writer_ring_push(fw, job);
+    sc_mutex_unlock(&fw->mutex);
+
+    if (!ok) {
+        sc_frame_writer_job_destroy(job);
+    }
+}
+
+// Acquire the memory of a frame from the budget, evicting the oldest frames of
+// the pre-trigger ring (not committed) if necessary
+static bool
+sc_frame_writer_acquire(struct sc_frame_writer *fw, uint64_t size) {
+    sc_mutex_lock(&fw->mutex);
+
+    bool ok;
+    while (!(ok = sc_memory_budget_acquire(SC_MEMORY_ARCHIVE, size))
+            && fw->pre_trigger && !fw->ring_committed
+            && !sc_vecdeque_is_empty(&fw->ring)) {
+        struct sc_frame_writer_job *job = sc_vecdeque_popref(&fw->ring);
+        fw->ring_size -= sc_frame_writer_job_size(job);
+        sc_frame_writer_job_destroy(job);
+    }
+
+    if (!ok && !fw->budget_limited) {
+        LOGW("Frame writer: memory budget exhausted, dropping frames");
+        fw->budget_limited = true;
+    }
+
+    sc_mutex_unlock(&fw->mutex);
+    return ok;
+}
+
+static bool
+sc_frame_writer_push_frame(struct sc_frame_writer *fw, const AVFrame *frame,
+                           uint64_t frame_number, int64_t timestamp_ms,
+                           bool rectify) {
+    // Enforced before the frame is referenced (the reference would prevent its
+    // buffers from being reused)
+    uint64_t size = sc_memory_budget_frame_size(frame);
+    if (!sc_frame_writer_acquire(fw, size)) {
+        sc_frame_drops_add(&fw->drops, SC_FRAME_DROP_QUEUE_FULL);
+        sc_metrics_add(SC_METRIC_WRITER_DROPPED_FRAMES, 1);
+        sc_frame_writer_mark_dropped(fw, frame_number, timestamp_ms);
+        return true;
+    }
+
+    AVFrame *ref = av_frame_alloc();
+    if (!ref) {
+        LOG_OOM();
+        sc_memory_budget_release(SC_MEMORY_ARCHIVE, size);
+        return false;
+    }
+
+    if (av_frame_ref(ref, frame)) {
+        LOG_OOM();
+        av_frame_free(&ref);
+        sc_memory_budget_release(SC_MEMORY_ARCHIVE, size);
+        return false;
+    }
+
+    struct sc_frame_writer_job job = {
+        .type = SC_FRAME_WRITER_JOB_FRAME,
+        .frame = ref,
+        .budget = size,
+        .rectify = rectify,
+        .frame_number = frame_number,
+        .timestamp_ms = timestamp_ms,
+    };
+
+    if (fw->tile_delta) {
+        // The frames are encoded in order, before being queued
+        sc_tile_delta_encode(&fw->delta_encoder, frame, frame_number,
+                             &job.delta);
+    }
+
+    sc_mutex_lock(&fw->mutex);
+
+    assert(!fw->stopped);
+
+    if (fw->pre_trigger) {
+        bool ok = sc_frame_writer_ring_push(fw, &job);
+        sc_mutex_unlock(&fw->mutex);
+        if (!ok) {
+            if (!sc_frame_drops_get(&fw->drops, SC_FRAME_DROP_QUEUE_FULL)) {
+                LOGW("Frame writer: pre-trigger ring full, dropping frames "
+                     "(disk too slow)");
+            }
+            sc_frame_drops_add(&fw->drops, SC_FRAME_DROP_QUEUE_FULL);
+            sc_metrics_add(SC_METRIC_WRITER_DROPPED_FRAMES, 1);
+            sc_frame_writer_job_destroy(&job);
+            // Recorded in the ring, like the frame would have been
+            sc_frame_writer_mark_dropped(fw, frame_number, timestamp_ms);
+        }
+        return true;
+    }
+
+    // The capacity reserved on init may be larger than the queue size, so
+    // compare the size explicitly
+    if (sc_vecdeque_size(&fw->queue) >= SC_FRAME_WRITER_QUEUE_SIZE) {
+        if (!sc_frame_drops_get(&fw->drops, SC_FRAME_DROP_QUEUE_FULL)) {
+            LOGW("Frame writer queue full, dropping frames (disk too slow)");
+        }
+        sc_mutex_unlock(&fw->mutex);
+        sc_frame_writer_drop(fw, SC_FRAME_DROP_QUEUE_FULL, frame_number,
+                             timestamp_ms);
+        sc_frame_writer_job_destroy(&job);
+        if (fw->tile_delta) {
+            // The reference contains the tiles of the dropped frame
+            sc_tile_delta_reset(&fw->delta_encoder);
+        }
+        return true;
+    }
+
+    sc_vecdeque_push_noresize(&fw->queue, job);
+    sc_metrics_set(SC_METRIC_WRITER_QUEUE, sc_vecdeque_size(&fw->queue));
+    sc_frame_writer_signal(fw);
+
+    sc_mutex_unlock(&fw->mutex);
+
+    return true;
+}
+
+bool
+sc_frame_writer_push(struct sc_frame_writer *fw, const AVFrame *frame,
+                     uint64_t frame_number, int64_t timestamp_ms) {
+    return sc_frame_writer_push_frame(fw, frame, frame_number, timestamp_ms,
+                                      false);
+}
+
+bool
+sc_frame_writer_can_rectify(const struct sc_frame_writer *fw) {
+    return fw->remap && (fw->format == SC_SAVE_FRAMES_FORMAT_PNG
+                      || fw->format == SC_SAVE_FRAMES_FORMAT_QOI
+                      || fw->format == SC_SAVE_FRAMES_FORMAT_PPM);
+}
+
+bool
+sc_frame_writer_push_unrectified(struct sc_frame_writer *fw,
+                                 const AVFrame *frame, uint64_t frame_number,
+                                 int64_t timestamp_ms) {
+    assert(sc_frame_writer_can_rectify(fw));
+    assert(frame->format == AV_PIX_FMT_YUV420P);
+    return sc_frame_writer_push_frame(fw, frame, frame_number, timestamp_ms,
+                                      true);
+}
+
+void
+sc_frame_writer_trigger(struct sc_frame_writer *fw) {
+    if (!fw->pre_trigger) {
+        return;
+    }
+
+    sc_mutex_lock(&fw->mutex);
+
+    sc_tick now = sc_tick_now();
+    if (fw->recording && now <= fw->recording_end) {
+        LOGI("Frame writer: triggered capture extended by %" PRItick " ms",
+             SC_TICK_TO_MS(now + fw->post_trigger - fw->recording_end));
+    } else {
+        sc_tick held = 0;
+        if (!sc_vecdeque_is_empty(&fw->ring)) {
+            held = now - sc_vecdeque_peekref(&fw->ring)->time;
+        }
+        LOGI("Frame writer: capture triggered, writing the last %" PRItick
+             " ms and the next %" PRItick " ms", SC_TICK_TO_MS(held),
+             SC_TICK_TO_MS(fw->post_trigger));
+    }
+
+    fw->recording = true;
+    fw->recording_end = now + fw->post_trigger;
+    fw->ring_committed = sc_vecdeque_size(&fw->ring);
+    sc_cond_broadcast(&fw->queue_cond);
+
+    sc_mutex_unlock(&fw->mutex);
+}
+
+void
+sc_frame_writer_mark_dropped(struct sc_frame_writer *fw, uint64_t frame_number,
+                             int64_t timestamp_ms) {
+    if (!fw->archive_path) {
+        return;
+    }
+
+    if (fw->pre_trigger) {
+        struct sc_frame_writer_job job = {
+            .type = SC_FRAME_WRITER_JOB_DROPPED,
+            .frame_number = frame_number,
+            .timestamp_ms = timestamp_ms,
+        };
+        sc_frame_writer_ring_push_record(fw, &job);
+        return;
+    }
+
+    sc_frame_archive_add_dropped(&fw->archive, frame_number, timestamp_ms);
+}
+
+void
+sc_frame_writer_mark_repeated(struct sc_frame_writer *fw,
+                              uint64_t frame_number, int64_t timestamp_ms) {
+    if (!fw->archive_path) {
+        return;
+    }
+
+    if (fw->pre_trigger) {
+        struct sc_frame_writer_job job = {
+            .type = SC_FRAME_WRITER_JOB_REPEATED,
+            .frame_number = frame_number,
+            .timestamp_ms = timestamp_ms,
+        };
+        sc_frame_writer_ring_push_record(fw, &job);
+        return;
+    }
+
+    sc_frame_archive_add_repeated(&fw->archive, frame_number, timestamp_ms);
+}
+
+void
+sc_frame_writer_mark_gap(struct sc_frame_writer *fw, uint64_t frame_number,
+                         int64_t duration_ms) {
+    if (!fw->archive_path) {
+        return;
+    }
+
+    if (fw->tile_delta) {
+        // The first frame after an interruption is a key frame, where the
+        // readers may start
+        sc_tile_delta_reset(&fw->delta_encoder);
+    }
+
+    if (fw->pre_trigger) {
+        struct sc_frame_writer_job job = {
+            .type = SC_FRAME_WRITER_JOB_GAP,
+            .frame_number = frame_number,
+            .timestamp_ms = duration_ms,
+        };
+        sc_frame_writer_ring_push_record(fw, &job);
+        return;
+    }
+
+    sc_frame_archive_add_gap(&fw->archive, frame_number, duration_ms);
+}
+
+void
+sc_frame_writer_add_poses(struct sc_frame_writer *fw,
+                          const struct pose_sample_record *samples,
+                          unsigned count) {
+    if (!fw->archive_path) {
+        return;
+    }
+
+    if (fw->pre_trigger) {
+        struct pose_sample_record *copy = malloc(count * sizeof(*samples));
+        if (!copy) {
+            LOG_OOM();
+            return;
+        }
+        memcpy(copy, samples, count * sizeof(*samples));
+
+        struct sc_frame_writer_job job = {
+            .type = SC_FRAME_WRITER_JOB_POSES,
+            .poses = {
+                .samples = copy,
+                .count = count,
+            },
+        };
+        sc_frame_writer_ring_push_record(fw, &job);
+        return;
+    }
+
+    sc_frame_archive_add_poses(&fw->archive, samples, count);
+}
+
+void
+sc_frame_writer_add_timestamp(struct sc_frame_writer *fw,
+                              uint64_t frame_number, int64_t raw_timestamp_us,
+                              int64_t filtered_timestamp_us, bool outlier) {
+    if (!fw->archive_path) {
+        return;
+    }
+
+    struct sc_frame_archive_timestamp ts = {
+        .frame_number = frame_number,
+        .raw_timestamp_us = raw_timestamp_us,
+        .filtered_timestamp_us = filtered_timestamp_us,
+        .flags = outlier ? FRAME_FLAG_TIMESTAMP_OUTLIER : 0,
+    };
+
+    if (fw->pre_trigger) {
+        struct sc_frame_writer_job job = {
+            .type = SC_FRAME_WRITER_JOB_TIMESTAMP,
+            .frame_number = frame_number,
+            .ts = ts,
+        };
+        sc_frame_writer_ring_push_record(fw, &job);
+        return;
+    }
+
+    sc_frame_archive_add_timestamp(&fw->archive, &ts);
+}
+
+void
+sc_frame_writer_write(struct sc_frame_writer *fw, const AVFrame *frame,
+                      uint64_t frame_number, int64_t timestamp_ms) {
+    assert(!fw->started_count);
+
+    struct sc_frame_writer_job job = {
+        .type = SC_FRAME_WRITER_JOB_FRAME,
+        // Not modified, and not unreferenced
+        .frame = (AVFrame *) frame,
+        .frame_number = frame_number,
+        .timestamp_ms = timestamp_ms,
+    };
+
+    if (fw->tile_delta) {
+        sc_tile_delta_encode(&fw->delta_encoder, frame, frame_number,
+                             &job.delta);
+    }
+
+    // Use the state of the first worker, which is not running
+    sc_frame_writer_save(&fw->workers[0], &job);
+    free(job.delta.tiles);
+
+#ifdef HAVE_IO_URING
+    if (fw->io == SC_SAVE_FRAMES_IO_URING) {
+        sc_frame_writer_uring_drain(&fw->workers[0]);
+    }
+#endif
+}
@@ -0,0 +1,416 @@
+#ifndef SC_FRAME_WRITER_H
+#define SC_FRAME_WRITER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "frame_archive.h"
+#include "frame_drops.h"
+#include "frame_pool.h"
+#include "options.h"
+#include "rgb_converter.h"
+#include "tile_delta.h"
+#include "uploader.h"
+#include "util/file.h"
+#include "util/thread.h"
+#include "util/vecdeque.h"
+#ifdef HAVE_IO_URING
+# include "util/io_ring.h"
+#endif
+
+// forward declarations
+typedef struct AVCodecContext AVCodecContext;
+typedef struct AVFrame AVFrame;
+typedef struct AVPacket AVPacket;
+struct sc_video_preprocess;
+#ifdef HAVE_ZSTD
+typedef struct ZSTD_CCtx_s ZSTD_CCtx;
+typedef struct ZSTD_CDict_s ZSTD_CDict;
+#endif
+
+#define SC_FRAME_WRITER_MAX_THREADS 8
+// Number of frames which may wait to be written. If the disk is too slow,
+// the new frames are dropped.
+#define SC_FRAME_WRITER_QUEUE_SIZE 32
+// Maximum number of frames dequeued at once by an I/O thread
+#define SC_FRAME_WRITER_BATCH_SIZE 4
+// Number of registered buffers (and so of writes in flight) of each I/O thread
+// with io_uring
+#define SC_FRAME_WRITER_URING_BUFFERS 8
+// Maximum memory held by the frames of the pre-trigger ring (the oldest frames
+// are evicted first)
+#define SC_FRAME_WRITER_RING_MAX_SIZE ((uint64_t) 2 << 30) // 2 GiB
+// JPEG quality (--save-frames-quality)
+#define SC_FRAME_WRITER_DEFAULT_QUALITY 90
+// Number of RGB frames preallocated by each I/O thread for the announced
+// size: the frame being written, and the one shared with the other consumers
+// of the next frame (see frame_cache.h)
+#define SC_FRAME_WRITER_PREPARED_FRAMES 2
+
+enum sc_frame_writer_job_type {
+    SC_FRAME_WRITER_JOB_FRAME,
+    // The records of the archive index, held in the pre-trigger ring with the
+    // frames
+    SC_FRAME_WRITER_JOB_DROPPED,
+    SC_FRAME_WRITER_JOB_REPEATED,
+    SC_FRAME_WRITER_JOB_GAP,
+    SC_FRAME_WRITER_JOB_TIMESTAMP,
+    SC_FRAME_WRITER_JOB_POSES,
+};
+
+struct sc_frame_writer_job {
+    enum sc_frame_writer_job_type type;
+    AVFrame *frame; // SC_FRAME_WRITER_JOB_FRAME only
+    uint64_t budget; // bytes acquired from the memory budget for the frame
+    // The frame is still to be rectified by fw->remap (see
+    // sc_frame_writer_push_unrectified())
+    bool rectify;
+    uint64_t frame_number;
+    // Capture time in milliseconds, -1 if unknown (the duration of the
+    // interruption for SC_FRAME_WRITER_JOB_GAP)
+    int64_t timestamp_ms;
+    sc_tick time; // when it was pushed to the pre-trigger ring
+    // How the frame is stored, with tile deltas (SC_FRAME_WRITER_JOB_FRAME)
+    struct sc_tile_delta_frame delta;
+    union {
+        struct sc_frame_archive_timestamp ts; // SC_FRAME_WRITER_JOB_TIMESTAMP
+        struct {
+            struct pose_sample_record *samples;
+            unsigned count;
+        } poses; // SC_FRAME_WRITER_JOB_POSES
+    };
+};
+
+struct sc_frame_writer_queue SC_VECDEQUE(struct sc_frame_writer_job);
+
+struct sc_frame_writer;
+
+#ifdef HAVE_IO_URING
+// A record of the archive being written by io_uring
+struct sc_frame_writer_uring_buffer {
+    uint8_t *data; // registered
+    size_t size; // of the record being written
+    bool busy; // until the write completes
+    uint64_t frame_number;
+    int64_t timestamp_ms;
+};
+#endif
+
+struct sc_frame_writer_worker {
+    struct sc_frame_writer *writer;
+    unsigned index; // only the first active_count workers dequeue frames
+    sc_thread thread;
+
+    // Only accessed from the worker thread
+    struct sc_rgb_converter rgb_converter;
+    struct sc_frame_pool rgb_pool;
+    // PNG or JPEG encoder, opened on first use, for the current size
+    AVCodecContext *image_ctx;
+    AVPacket *packet;
+    uint8_t *encoded; // QOI output buffer, reused across frames
+    size_t encoded_cap;
+    // Aligned record buffer, for the synchronous writes to a direct archive
+    uint8_t *direct_buffer;
+    size_t direct_cap;
+
+#ifdef HAVE_ZSTD
+    // With zstd_level, the compression context and its output buffer
+    ZSTD_CCtx *zstd_ctx;
+    uint8_t *compressed;
+    size_t compressed_cap;
+#endif
+
+#ifdef HAVE_IO_URING
+    // With SC_SAVE_FRAMES_IO_URING
+    struct sc_io_ring ring;
+    struct sc_frame_writer_uring_buffer buffers[SC_FRAME_WRITER_URING_BUFFERS];
+    size_t buffer_cap; // capacity of each buffer, 0 before the first frame
+    bool ring_failed;
+#endif
+};
+
+/**
+ * Asynchronous frame writer, to save frames as image files.
+ *
+ * The frames are written in the requested format: PPM, PNG or QOI (converted
+ * to RGB24), JPEG (encoded directly from the YUV420P planes, without RGB
+ * conversion), or the raw YUV420P planes, unconverted. The GRAY8 frames (the
+ * Y plane only, with --output-planes=y) are written without conversion, as
+ * PGM, grayscale PNG or the raw Y plane (QOI and JPEG are not supported).
+ *
+ * Each I/O thread has its own encoder, so the lossy and compressed formats
+ * are encoded in parallel by the thread pool.
+ *
+ * The frames are written by a set of I/O threads, so that disk latency never
+ * blocks the caller. The queue is bounded: if it is full, the pushed frame is
+ * dropped (and counted) instead of waiting.
+ *
+ * The frames are written either to separate files in a directory, or to a
+ * single indexed archive (see frame_archive.h). In an archive, the dropped
+ * frames are recorded in the index.
+ *
+ * With SC_SAVE_FRAMES_IO_URING (archive only), each I/O thread copies the
+ * records into its registered buffers, reserves their space in the archive,
+ * and submits their writes to its io_uring at once for each batch of frames.
+ * A buffer is reused once its write completes, so that up to
+ * SC_FRAME_WRITER_URING_BUFFERS writes are in flight per thread, without
+ * blocking the encoding of the next frames.
+ *
+ * With zstd compression (archive only), each frame is compressed by its I/O
+ * thread, independently of the others (see frame_archive.h), optionally with
+ * a dictionary shared by all the threads.
+ *
+ * In direct mode (archive only), the archive is written bypassing the page
+ * cache, with its disk space preallocated (see sc_frame_archive_open()): each
+ * record is copied into an aligned buffer of the I/O thread (a registered
+ * buffer with io_uring), padded, and written from there.
+ *
+ * With a pre-trigger ring (pre_trigger is not 0), the frames are not written
+ * continuously: the frames (and their index records) of the last
+ * `pre_trigger` are held in memory, as references to the decoded frames (not
+ * converted nor encoded yet). On sc_frame_writer_trigger(), they are all
+ * committed, along with the frames pushed during the next `post_trigger`, and
+ * the I/O threads write them in order (the ring is not bounded by the queue
+ * size). The memory held is bounded by SC_FRAME_WRITER_RING_MAX_SIZE.
+ *
+ * With an uploader, each frame file is uploaded once written, and the archive
+ * once closed (on destroy).
+ *
+ * On stop, the frames already queued (or committed) are still written before
+ * the threads terminate.
+ */
+struct sc_frame_writer {
+    const char *directory; // NULL if archive_path is set
+    const char *archive_path;
+    enum sc_save_frames_format format;
+    unsigned quality; // with SC_SAVE_FRAMES_FORMAT_JPEG
+    enum sc_save_frames_io io;
+    unsigned thread_count;
+    struct sc_uploader *uploader; // NULL if the files are not uploaded
+    // NULL if the frames are always pushed rectified
+    const struct sc_video_preprocess *remap;
+    // Announced size of the frames, 0 if unknown
+    int width;
+    int height;
+    bool gray;
+
+#ifdef HAVE_ZSTD
+    int zstd_level; // 0 if the frames are not compressed
+    struct sc_file_mapping zstd_dictionary; // data is NULL if none
+    ZSTD_CDict *zstd_cdict;
+#endif
+
+    // The frames of the archive are stored as tile deltas, selected by the
+    // producer thread
+    bool tile_delta;
+    struct sc_tile_delta delta_encoder;
+    // Last chain of tile deltas broken by a frame which could not be saved
+    // (protected by the mutex): the next frames of the chain, already encoded,
+    // are stored in full
+    bool delta_broken;
+    uint64_t delta_broken_key; // key frame number of the chain
+    uint64_t delta_broken_frame; // frame number of the frame not saved
+
+    struct sc_frame_writer_worker workers[SC_FRAME_WRITER_MAX_THREADS];
+    unsigned started_count;
+
+    sc_mutex mutex;
+    sc_cond queue_cond;
+    struct sc_frame_writer_queue queue;
+    struct sc_frame_drops drops;
+    bool stopped;
+    // I/O threads dequeuing the frames (see
+    // sc_frame_writer_set_active_threads()), the others wait
+    unsigned active_count;
+
+    // Pre-trigger ring, if pre_trigger is not 0 (protected by the mutex)
+    sc_tick pre_trigger;
+    sc_tick post_trigger;
+    struct sc_frame_writer_queue ring;
+    size_t ring_committed; // number of jobs at the front to be written
+    uint64_t ring_size; // memory held by the frames of the ring
+    bool ring_limited; // by SC_FRAME_WRITER_RING_MAX_SIZE (logged once)
+    bool budget_limited; // by the memory budget (logged once)
+    bool recording; // the pushed jobs are committed until recording_end
+    sc_tick recording_end;
+
+    struct sc_frame_archive archive; // if archive_path
+};
+
+struct sc_frame_writer_params {
+    // Exactly one of directory and archive_path must be set
+    const char *directory;
+    const char *archive_path;
+    enum sc_save_frames_format format;
+    // JPEG quality, from 1 to 100 (0 for SC_FRAME_WRITER_DEFAULT_QUALITY)
+    unsigned quality;
+    // SC_SAVE_FRAMES_IO_URING requires archive_path (it falls back to
+    // SC_SAVE_FRAMES_IO_SYNC if io_uring is not available)
+    enum sc_save_frames_io io;
+    // Bypass the page cache (requires archive_path)
+    bool direct;
+    // zstd compression level of the frames (requires archive_path and
+    // HAVE_ZSTD), 0 to disable
+    int zstd_level;
+    // Path of the dictionary to compress the frames with, NULL if none
+    const char *zstd_dictionary;
+    // Store the frames as tile deltas (requires archive_path, the YUV format
+    // and no pre-trigger ring), see tile_delta.h
+    bool tile_delta;
+    float tile_threshold;
+    unsigned key_interval; // 0 for SC_TILE_DELTA_DEFAULT_KEY_INTERVAL
+    // Expected duration of the capture (0 if unknown), to preallocate the
+    // disk space of a direct archive
+    sc_tick expected_duration;
+    // Duration of the pre-trigger ring (0 to write the frames continuously),
+    // and of the capture after a trigger
+    sc_tick pre_trigger;
+    sc_tick post_trigger;
+    unsigned thread_count;
+    // I/O threads initially dequeuing the frames, 0 for all (see
+    // sc_frame_writer_set_active_threads())
+    unsigned active_threads;
+    // If not NULL, each saved frame file (or the archive, once closed) is
+    // pushed to be uploaded (--upload-dir)
+    struct sc_uploader *uploader;
+    // If not NULL, the maps rectifying the frames pushed by
+    // sc_frame_writer_push_unrectified()
+    const struct sc_video_preprocess *remap;
+    // Size of the frames, announced before the first one (0 if unknown), so
+    // that the I/O threads prepare their encoders and buffers meanwhile
+    int width;
+    int height;
+    bool gray; // the frames are GRAY8
+};
+
+bool
+sc_frame_writer_init(struct sc_frame_writer *fw,
+                     const struct sc_frame_writer_params *params);
+
+void
+sc_frame_writer_destroy(struct sc_frame_writer *fw);
+
+bool
+sc_frame_writer_start(struct sc_frame_writer *fw);
+
+void
+sc_frame_writer_stop(struct sc_frame_writer *fw);
+
+void
+sc_frame_writer_join(struct sc_frame_writer *fw);
+
+/**
+ * Set the number of I/O threads dequeuing the frames (--auto-tune), between 1
+ * and the number of threads started
+ *
+ * The other threads wait, without holding any frame (those started inactive
+ * allocate their encoders and buffers on their first frame). All the threads
+ * write the remaining frames on stop.
+ *
+ * Return the number of active threads.
+ */
+unsigned
+sc_frame_writer_set_active_threads(struct sc_frame_writer *fw,
+                                   unsigned count);
+
+/**
+ * Queue a frame to be written
+ *
+ * The frame is referenced, not copied, so its content must not be modified
+ * afterwards. Return false only on error; a dropped frame is not an error.
+ */
+bool
+sc_frame_writer_push(struct sc_frame_writer *fw, const AVFrame *frame,
+                     uint64_t frame_number, int64_t timestamp_ms);
+
+/**
+ * Tell whether the frames may be pushed unrectified: the writer has the remap
+ * maps and converts the frames to RGB (PNG, QOI or PPM)
+ */
+bool
+sc_frame_writer_can_rectify(const struct sc_frame_writer *fw);
+
+/**
+ * Queue a YUV420P frame to be written rectified
+ *
+ * The frame is rectified and converted to RGB in a single pass by the writer
+ * threads (see sc_video_preprocess_remap_rgb()), rather than rectified then
+ * converted. sc_frame_writer_can_rectify() must be true.
+ */
+bool
+sc_frame_writer_push_unrectified(struct sc_frame_writer *fw,
+                                 const AVFrame *frame, uint64_t frame_number,
+                                 int64_t timestamp_ms);
+
+/**
+ * Write the frames of the pre-trigger ring, and the frames pushed during the
+ * next `post_trigger` (a trigger during this period extends it)
+ *
+ * It may be called from any thread. It does nothing without pre-trigger ring.
+ */
+void
+sc_frame_writer_trigger(struct sc_frame_writer *fw);
+
+/**
+ * Record a frame dropped before reaching the writer (by the caller)
+ *
+ * In an archive, the frame is marked as missing in the index. Otherwise, this
+ * does nothing.
+ */
+void
+sc_frame_writer_mark_dropped(struct sc_frame_writer *fw, uint64_t frame_number,
+                             int64_t timestamp_ms);
+
+/**
+ * Record a frame repeated by the device, skipped by the caller
+ *
+ * In an archive, the frame is marked as repeated in the index. Otherwise, this
+ * does nothing.
+ */
+void
+sc_frame_writer_mark_repeated(struct sc_frame_writer *fw,
+                              uint64_t frame_number, int64_t timestamp_ms);
+
+/**
+ * Record an interruption of the stream, before the frame `frame_number`
+ *
+ * In an archive, the gap is recorded in the index. Otherwise, this does
+ * nothing.
+ */
+void
+sc_frame_writer_mark_gap(struct sc_frame_writer *fw, uint64_t frame_number,
+                         int64_t duration_ms);
+
+/**
+ * Record headset pose samples
+ *
+ * In an archive, the samples are stored with the index. Otherwise, this does
+ * nothing.
+ */
+void
+sc_frame_writer_add_poses(struct sc_frame_writer *fw,
+                          const struct pose_sample_record *samples,
+                          unsigned count);
+
+/**
+ * Record the raw and filtered timestamps of a saved frame
+ *
+ * In an archive, they are stored with the index. Otherwise, this does nothing.
+ */
+void
+sc_frame_writer_add_timestamp(struct sc_frame_writer *fw,
+                              uint64_t frame_number, int64_t raw_timestamp_us,
+                              int64_t filtered_timestamp_us, bool outlier);
+
+/**
+ * Write a frame synchronously, from the calling thread (for benchmarks)
+ *
+ * The writer must not be started. The errors are only logged.
+ */
+void
+sc_frame_writer_write(struct sc_frame_writer *fw, const AVFrame *frame,
+                      uint64_t frame_number, int64_t timestamp_ms);
+
+#endif
@@ -0,0 +1,219 @@
+#include "gl_pbo.h"
+
+#include <assert.h>
+#include <string.h>
+#include <libavutil/pixfmt.h>
+
+#include "util/log.h"
+
+// Slots start on a cache line boundary
+#define SC_GL_PBO_SLOT_ALIGN 64
+
+// Waiting longer for the GPU means that the driver is stuck
+#define SC_GL_PBO_FENCE_TIMEOUT_NS UINT64_C(1000000000) // 1s
+
+static bool
+sc_gl_pbo_load_functions(struct sc_gl_pbo *pbo) {
+#define SC_GL_PBO_LOAD(NAME) \
+    pbo->NAME = SDL_GL_GetProcAddress("gl" #NAME); \
+    if (!pbo->NAME) { \
+        LOGW("OpenGL function not available: gl" #NAME); \
+        return false; \
+    }
+
+    SC_GL_PBO_LOAD(GenBuffers);
+    SC_GL_PBO_LOAD(DeleteBuffers);
+    SC_GL_PBO_LOAD(BindBuffer);
+    SC_GL_PBO_LOAD(BufferStorage);
+    SC_GL_PBO_LOAD(MapBufferRange);
+    SC_GL_PBO_LOAD(FenceSync);
+    SC_GL_PBO_LOAD(ClientWaitSync);
+    SC_GL_PBO_LOAD(DeleteSync);
+    SC_GL_PBO_LOAD(ActiveTexture);
+    SC_GL_PBO_LOAD(TexSubImage2D);
+    SC_GL_PBO_LOAD(PixelStorei);
+
+#undef SC_GL_PBO_LOAD
+
+    return true;
+}
+
+bool
+sc_gl_pbo_init(struct sc_gl_pbo *pbo) {
+    if (!sc_gl_pbo_load_functions(pbo)) {
+        return false;
+    }
+
+    pbo->buffer = 0;
+    pbo->mapped = NULL;
+    pbo->slot_size = 0;
+    for (unsigned i = 0; i < SC_GL_PBO_SLOTS; ++i) {
+        pbo->fences[i] = NULL;
+    }
+    pbo->next_slot = 0;
+
+    return true;
+}
+
+static void
+sc_gl_pbo_release(struct sc_gl_pbo *pbo) {
+    for (unsigned i = 0; i < SC_GL_PBO_SLOTS; ++i) {
+        if (pbo->fences[i]) {
+            pbo->DeleteSync(pbo->fences[i]);
+            pbo->fences[i] = NULL;
+        }
+    }
+
+    if (pbo->buffer) {
+        // A mapped buffer is unmapped on deletion (and actually released by
+        // the driver once the pending uploads are complete)
+        pbo->DeleteBuffers(1, &pbo->buffer);
+        pbo->buffer = 0;
+        pbo->mapped = NULL;
+        pbo->slot_size = 0;
+    }
+}
+
+void
+sc_gl_pbo_destroy(struct sc_gl_pbo *pbo) {
+    sc_gl_pbo_release(pbo);
+}
+
+static bool
+sc_gl_pbo_allocate(struct sc_gl_pbo *pbo, size_t slot_size) {
+    sc_gl_pbo_release(pbo);
+
+    GLsizeiptr size = slot_size * SC_GL_PBO_SLOTS;
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    pbo->GenBuffers(1, &pbo->buffer);
+    pbo->BindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->buffer);
+    pbo->BufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+    pbo->mapped = pbo->MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+    pbo->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (!pbo->mapped) {
+        LOGW("Could not map pixel buffer (%zu bytes)", (size_t) size);
+        pbo->DeleteBuffers(1, &pbo->buffer);
+        pbo->buffer = 0;
+        return false;
+    }
+
+    pbo->slot_size = slot_size;
+    pbo->next_slot = 0;
+
+    LOGD("Pixel buffer allocated: %u x %zu bytes", SC_GL_PBO_SLOTS, slot_size);
+    return true;
+}
+
+bool
+sc_gl_pbo_upload(struct sc_gl_pbo *pbo, SDL_Texture *texture,
+                 const AVFrame *frame) {
+    // Planes of the textures created by SDL: Y, U and V for YV12, Y and
+    // interleaved UV for NV12
+    int chroma_width = (frame->width + 1) / 2;
+    int chroma_height = (frame->height + 1) / 2;
+    int widths[3] = {frame->width, chroma_width, chroma_width};
+    int heights[3] = {frame->height, chroma_height, chroma_height};
+    GLenum formats[3] = {GL_LUMINANCE, GL_LUMINANCE, GL_LUMINANCE};
+    int pixel_sizes[3] = {1, 1, 1};
+    unsigned plane_count = 3;
+    if (frame->format == AV_PIX_FMT_NV12) {
+        formats[1] = GL_LUMINANCE_ALPHA;
+        pixel_sizes[1] = 2;
+        plane_count = 2;
+    } else {
+        assert(frame->format == AV_PIX_FMT_YUV420P);
+    }
+
+    // The planes are copied as is (with their padding), the texture update
+    // skips the padding (GL_UNPACK_ROW_LENGTH)
+    size_t offsets[3];
+    size_t slot_size = 0;
+    for (unsigned i = 0; i < plane_count; ++i) {
+        int linesize = frame->linesize[i];
+        if (linesize < widths[i] * pixel_sizes[i]
+                || linesize % pixel_sizes[i]) {
+            // e.g. negative linesize (flipped frame)
+            LOGW("Unsupported frame layout for pixel buffer uploads");
+            return false;
+        }
+        offsets[i] = slot_size;
+        slot_size += (size_t) linesize * heights[i];
+    }
+    slot_size = (slot_size + SC_GL_PBO_SLOT_ALIGN - 1)
+              & ~(size_t) (SC_GL_PBO_SLOT_ALIGN - 1);
+
+    // Flush the pending SDL commands, make the renderer context current and
+    // bind the planes to the texture units 0, 1 (and 2)
+    float tex_w;
+    float tex_h;
+    if (SDL_GL_BindTexture(texture, &tex_w, &tex_h)) {
+        LOGW("Could not bind texture: %s", SDL_GetError());
+        return false;
+    }
+
+    bool ok = false;
+
+    if (tex_w != 1.f || tex_h != 1.f) {
+        // Rectangle or padded (power of two) textures, not GL_TEXTURE_2D
+        LOGW("Unsupported texture for pixel buffer uploads");
+        goto end;
+    }
+
+    if (slot_size > pbo->slot_size) {
+        if (!sc_gl_pbo_allocate(pbo, slot_size)) {
+            goto end;
+        }
+    }
+
+    unsigned slot = pbo->next_slot;
+    if (pbo->fences[slot]) {
+        // Wait for the GPU to have read the slot (uploaded SC_GL_PBO_SLOTS
+        // frames ago, so this should be immediate)
+        GLenum result = pbo->ClientWaitSync(pbo->fences[slot],
+                                            GL_SYNC_FLUSH_COMMANDS_BIT,
+                                            SC_GL_PBO_FENCE_TIMEOUT_NS);
+        pbo->DeleteSync(pbo->fences[slot]);
+        pbo->fences[slot] = NULL;
+        if (result != GL_ALREADY_SIGNALED
+                && result != GL_CONDITION_SATISFIED) {
+            LOGW("Pixel buffer still in use by the GPU");
+            goto end;
+        }
+    }
+
+    size_t base = slot * pbo->slot_size;
+
+    pbo->BindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->buffer);
+    pbo->PixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (unsigned i = 0; i < plane_count; ++i) {
+        size_t offset = base + offsets[i];
+        memcpy(pbo->mapped + offset, frame->data[i],
+               (size_t) frame->linesize[i] * heights[i]);
+
+        // With a pixel unpack buffer bound, the "pixels" argument is an
+        // offset in the buffer
+        pbo->ActiveTexture(GL_TEXTURE0 + i);
+        pbo->PixelStorei(GL_UNPACK_ROW_LENGTH,
+                         frame->linesize[i] / pixel_sizes[i]);
+        pbo->TexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, widths[i], heights[i],
+                           formats[i], GL_UNSIGNED_BYTE,
+                           (const void *) (uintptr_t) offset);
+    }
+
+    pbo->fences[slot] = pbo->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    pbo->next_slot = (slot + 1) % SC_GL_PBO_SLOTS;
+
+    // Restore the state expected by SDL
+    pbo->PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    pbo->ActiveTexture(GL_TEXTURE0);
+    pbo->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    ok = true;
+
+end:
+    SDL_GL_UnbindTexture(texture);
+    return ok;
+}
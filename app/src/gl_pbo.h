@@ -0,0 +1,77 @@
+#ifndef SC_GL_PBO_H
+#define SC_GL_PBO_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavutil/frame.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+
+// Number of frames which may be uploaded concurrently
+#define SC_GL_PBO_SLOTS 3
+
+/**
+ * Texture upload through pixel buffer objects.
+ *
+ * Instead of SDL_UpdateYUVTexture(), which copies the planes to the driver
+ * synchronously, the planes are copied into a ring of slots of a persistently
+ * mapped buffer, and the textures are updated from this buffer: the transfer
+ * to the GPU is asynchronous, the main thread does not wait for it.
+ *
+ * A fence is inserted after each upload, so that a slot is not overwritten
+ * before the GPU has finished reading it.
+ *
+ * This requires the SDL "opengl" renderer with OpenGL 4.4+ (or
+ * GL_ARB_buffer_storage, with OpenGL 3.2+ for the fences).
+ */
+struct sc_gl_pbo {
+    GLuint buffer;
+    uint8_t *mapped; // persistently mapped, SC_GL_PBO_SLOTS * slot_size bytes
+    size_t slot_size;
+    GLsync fences[SC_GL_PBO_SLOTS];
+    unsigned next_slot;
+
+    void (*GenBuffers)(GLsizei n, GLuint *buffers);
+    void (*DeleteBuffers)(GLsizei n, const GLuint *buffers);
+    void (*BindBuffer)(GLenum target, GLuint buffer);
+    void (*BufferStorage)(GLenum target, GLsizeiptr size, const void *data,
+                          GLbitfield flags);
+    void *(*MapBufferRange)(GLenum target, GLintptr offset, GLsizeiptr length,
+                            GLbitfield access);
+    GLsync (*FenceSync)(GLenum condition, GLbitfield flags);
+    GLenum (*ClientWaitSync)(GLsync sync, GLbitfield flags, GLuint64 timeout);
+    void (*DeleteSync)(GLsync sync);
+    void (*ActiveTexture)(GLenum texture);
+    void (*TexSubImage2D)(GLenum target, GLint level, GLint xoffset,
+                          GLint yoffset, GLsizei width, GLsizei height,
+                          GLenum format, GLenum type, const void *pixels);
+    void (*PixelStorei)(GLenum pname, GLint param);
+};
+
+/**
+ * Load the OpenGL functions
+ *
+ * The buffer is allocated on the first upload, for the size of the frames.
+ */
+bool
+sc_gl_pbo_init(struct sc_gl_pbo *pbo);
+
+void
+sc_gl_pbo_destroy(struct sc_gl_pbo *pbo);
+
+/**
+ * Upload the YUV420P (or NV12) frame into the YV12 (or NV12) texture created
+ * by the SDL opengl renderer
+ *
+ * Return false if the texture could not be updated this way, so that the
+ * caller falls back to SDL_UpdateYUVTexture() (and should not use this
+ * uploader anymore).
+ */
+bool
+sc_gl_pbo_upload(struct sc_gl_pbo *pbo, SDL_Texture *texture,
+                 const AVFrame *frame);
+
+#endif
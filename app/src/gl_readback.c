@@ -0,0 +1,680 @@
+#include "gl_readback.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavutil/pixfmt.h>
+
+#include "opengl.h"
+#include "video_preprocess.h"
+#include "util/log.h"
+
+// Waiting longer for the GPU means that the driver is stuck
+#define SC_GL_READBACK_FENCE_TIMEOUT_NS UINT64_C(1000000000) // 1s
+
+// Values outside the mapped content, as written by the CPU remap
+#define SC_GL_READBACK_BORDER_LUMA 0
+#define SC_GL_READBACK_BORDER_CHROMA 128
+
+// Texture units
+#define SC_GL_READBACK_UNIT_PLANE 0
+#define SC_GL_READBACK_UNIT_MAP 1
+
+// GLSL 1.20, as the shader of sc_gl_remap
+static const char *const vertex_shader_source =
+    "#version 120\n"
+    "void main() {\n"
+    "    gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+    "    gl_Position = gl_Vertex;\n"
+    "}\n";
+
+// Same sampling as sc_gl_remap, for a single plane: the coordinates are
+// expressed in pixels of the Y plane, so that the chroma planes are sampled
+// through the same map.
+static const char *const fragment_shader_source =
+    "#version 120\n"
+    "uniform sampler2D plane_tex;\n"
+    "uniform sampler2D map_tex;\n"
+    "uniform vec2 frame_size;\n"
+    "uniform float offset;\n"
+    "uniform float border;\n"
+    "void main() {\n"
+    "    vec2 pos = gl_TexCoord[0].xy * frame_size;\n"
+    "    if (pos.y >= offset) {\n"
+    "        vec2 content_size = vec2(frame_size.x, frame_size.y - offset);\n"
+    "        vec2 uv = vec2(pos.x, pos.y - offset) / content_size;\n"
+    "        vec2 p = texture2D(map_tex, uv).xy;\n"
+    "        float half_width = frame_size.x / 2.0;\n"
+    "        float left = pos.x < half_width ? 0.0 : half_width;\n"
+    "        if (p.x < left - 0.5 || p.x > left + half_width - 0.5\n"
+    "                || p.y < -0.5 || p.y > content_size.y - 0.5) {\n"
+    "            gl_FragColor = vec4(border, 0.0, 0.0, 1.0);\n"
+    "            return;\n"
+    "        }\n"
+    "        pos = vec2(p.x + 0.5, p.y + 0.5 + offset);\n"
+    "    }\n"
+    "    gl_FragColor = vec4(texture2D(plane_tex, pos / frame_size).r,\n"
+    "                        0.0, 0.0, 1.0);\n"
+    "}\n";
+
+static bool
+sc_gl_readback_load_functions(struct sc_gl_readback *rb) {
+#define SC_GL_READBACK_LOAD(NAME) \
+    rb->NAME = SDL_GL_GetProcAddress("gl" #NAME); \
+    if (!rb->NAME) { \
+        LOGW("OpenGL function not available: gl" #NAME); \
+        return false; \
+    }
+
+    SC_GL_READBACK_LOAD(GenTextures);
+    SC_GL_READBACK_LOAD(DeleteTextures);
+    SC_GL_READBACK_LOAD(BindTexture);
+    SC_GL_READBACK_LOAD(ActiveTexture);
+    SC_GL_READBACK_LOAD(TexImage2D);
+    SC_GL_READBACK_LOAD(TexSubImage2D);
+    SC_GL_READBACK_LOAD(TexParameteri);
+    SC_GL_READBACK_LOAD(PixelStorei);
+    SC_GL_READBACK_LOAD(Viewport);
+    SC_GL_READBACK_LOAD(ReadPixels);
+    SC_GL_READBACK_LOAD(Flush);
+    SC_GL_READBACK_LOAD(GenFramebuffers);
+    SC_GL_READBACK_LOAD(DeleteFramebuffers);
+    SC_GL_READBACK_LOAD(BindFramebuffer);
+    SC_GL_READBACK_LOAD(FramebufferTexture2D);
+    SC_GL_READBACK_LOAD(CheckFramebufferStatus);
+    SC_GL_READBACK_LOAD(GenBuffers);
+    SC_GL_READBACK_LOAD(DeleteBuffers);
+    SC_GL_READBACK_LOAD(BindBuffer);
+    SC_GL_READBACK_LOAD(BufferData);
+    SC_GL_READBACK_LOAD(MapBufferRange);
+    SC_GL_READBACK_LOAD(UnmapBuffer);
+    SC_GL_READBACK_LOAD(FenceSync);
+    SC_GL_READBACK_LOAD(ClientWaitSync);
+    SC_GL_READBACK_LOAD(DeleteSync);
+    SC_GL_READBACK_LOAD(CreateShader);
+    SC_GL_READBACK_LOAD(ShaderSource);
+    SC_GL_READBACK_LOAD(CompileShader);
+    SC_GL_READBACK_LOAD(GetShaderiv);
+    SC_GL_READBACK_LOAD(GetShaderInfoLog);
+    SC_GL_READBACK_LOAD(DeleteShader);
+    SC_GL_READBACK_LOAD(CreateProgram);
+    SC_GL_READBACK_LOAD(AttachShader);
+    SC_GL_READBACK_LOAD(LinkProgram);
+    SC_GL_READBACK_LOAD(GetProgramiv);
+    SC_GL_READBACK_LOAD(GetProgramInfoLog);
+    SC_GL_READBACK_LOAD(DeleteProgram);
+    SC_GL_READBACK_LOAD(UseProgram);
+    SC_GL_READBACK_LOAD(GetUniformLocation);
+    SC_GL_READBACK_LOAD(Uniform1i);
+    SC_GL_READBACK_LOAD(Uniform1f);
+    SC_GL_READBACK_LOAD(Uniform2f);
+    SC_GL_READBACK_LOAD(Begin);
+    SC_GL_READBACK_LOAD(End);
+    SC_GL_READBACK_LOAD(TexCoord2f);
+    SC_GL_READBACK_LOAD(Vertex2f);
+
+#undef SC_GL_READBACK_LOAD
+
+    return true;
+}
+
+static GLuint
+sc_gl_readback_compile(struct sc_gl_readback *rb, GLenum type,
+                       const char *source) {
+    GLuint shader = rb->CreateShader(type);
+    if (!shader) {
+        LOGE("Could not create shader");
+        return 0;
+    }
+
+    rb->ShaderSource(shader, 1, &source, NULL);
+    rb->CompileShader(shader);
+
+    GLint status;
+    rb->GetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status) {
+        char log[512];
+        rb->GetShaderInfoLog(shader, sizeof(log), NULL, log);
+        LOGE("Could not compile shader: %s", log);
+        rb->DeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+static GLuint
+sc_gl_readback_create_program(struct sc_gl_readback *rb) {
+    GLuint vs = sc_gl_readback_compile(rb, GL_VERTEX_SHADER,
+                                       vertex_shader_source);
+    if (!vs) {
+        return 0;
+    }
+
+    GLuint fs = sc_gl_readback_compile(rb, GL_FRAGMENT_SHADER,
+                                       fragment_shader_source);
+    if (!fs) {
+        rb->DeleteShader(vs);
+        return 0;
+    }
+
+    GLuint program = rb->CreateProgram();
+    if (!program) {
+        LOGE("Could not create shader program");
+        goto end;
+    }
+
+    rb->AttachShader(program, vs);
+    rb->AttachShader(program, fs);
+    rb->LinkProgram(program);
+
+    GLint status;
+    rb->GetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+        char log[512];
+        rb->GetProgramInfoLog(program, sizeof(log), NULL, log);
+        LOGE("Could not link shader program: %s", log);
+        rb->DeleteProgram(program);
+        program = 0;
+    }
+
+end:
+    // Flagged for deletion, deleted along with the program
+    rb->DeleteShader(vs);
+    rb->DeleteShader(fs);
+
+    return program;
+}
+
+static void
+sc_gl_readback_set_texture_filter(struct sc_gl_readback *rb, GLint filter) {
+    rb->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    rb->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    rb->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    rb->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+// Upload the current maps of rb->vpp, for a content of width x height, into
+// the map texture
+static bool
+sc_gl_readback_upload_map(struct sc_gl_readback *rb, int width, int height) {
+    // If the maps are reloaded meanwhile, they will be uploaded again
+    rb->generation = sc_video_preprocess_get_generation(rb->vpp);
+
+    float *map = sc_video_preprocess_get_gpu_map(rb->vpp, width, height);
+    if (!map) {
+        return false;
+    }
+
+    rb->ActiveTexture(GL_TEXTURE0 + SC_GL_READBACK_UNIT_MAP);
+    rb->BindTexture(GL_TEXTURE_2D, rb->map_texture);
+    rb->PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    rb->PixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    rb->TexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, width, height, 0, GL_RG,
+                   GL_FLOAT, map);
+    rb->ActiveTexture(GL_TEXTURE0);
+    free(map);
+
+    rb->map_width = width;
+    rb->map_height = height;
+    return true;
+}
+
+// Upload the maps again if the video size changed or if they were reloaded
+static bool
+sc_gl_readback_update_map(struct sc_gl_readback *rb, int width,
+                          int content_height) {
+    if (width != rb->map_width || content_height != rb->map_height) {
+        // New video size, the maps are scaled
+        if (!sc_gl_readback_upload_map(rb, width, content_height)) {
+            return false;
+        }
+        LOGI("GPU readback map resized to %dx%d", width, content_height);
+    } else if (sc_video_preprocess_get_generation(rb->vpp)
+                   != rb->generation) {
+        // The calibration has been reloaded
+        if (!sc_gl_readback_upload_map(rb, width, content_height)) {
+            return false;
+        }
+        LOGI("GPU readback map reloaded");
+    }
+
+    return true;
+}
+
+// Allocate the source and target planes for frames of width x height
+static bool
+sc_gl_readback_update_textures(struct sc_gl_readback *rb, int width,
+                               int height) {
+    if (width == rb->texture_width && height == rb->texture_height) {
+        return true;
+    }
+
+    int chroma_width = (width + 1) / 2;
+    int chroma_height = (height + 1) / 2;
+    int widths[3] = {width, chroma_width, chroma_width};
+    int heights[3] = {height, chroma_height, chroma_height};
+
+    rb->BindFramebuffer(GL_FRAMEBUFFER, rb->framebuffer);
+    bool ok = true;
+    for (unsigned i = 0; i < 3; ++i) {
+        rb->BindTexture(GL_TEXTURE_2D, rb->plane_textures[i]);
+        rb->TexImage2D(GL_TEXTURE_2D, 0, GL_R8, widths[i], heights[i], 0,
+                       GL_RED, GL_UNSIGNED_BYTE, NULL);
+
+        rb->BindTexture(GL_TEXTURE_2D, rb->target_textures[i]);
+        rb->TexImage2D(GL_TEXTURE_2D, 0, GL_R8, widths[i], heights[i], 0,
+                       GL_RED, GL_UNSIGNED_BYTE, NULL);
+        rb->FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                 GL_TEXTURE_2D, rb->target_textures[i], 0);
+        if (rb->CheckFramebufferStatus(GL_FRAMEBUFFER)
+                != GL_FRAMEBUFFER_COMPLETE) {
+            LOGW("Could not render the GPU readback planes (%dx%d)",
+                 widths[i], heights[i]);
+            ok = false;
+            break;
+        }
+    }
+    rb->BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (!ok) {
+        // Allocated again on the next frame
+        rb->texture_width = 0;
+        rb->texture_height = 0;
+        return false;
+    }
+
+    rb->texture_width = width;
+    rb->texture_height = height;
+    return true;
+}
+
+static bool
+sc_gl_readback_create_objects(struct sc_gl_readback *rb) {
+    rb->program = sc_gl_readback_create_program(rb);
+    if (!rb->program) {
+        return false;
+    }
+
+    GLuint program = rb->program;
+    rb->loc_plane_tex = rb->GetUniformLocation(program, "plane_tex");
+    rb->loc_map_tex = rb->GetUniformLocation(program, "map_tex");
+    rb->loc_frame_size = rb->GetUniformLocation(program, "frame_size");
+    rb->loc_offset = rb->GetUniformLocation(program, "offset");
+    rb->loc_border = rb->GetUniformLocation(program, "border");
+
+    rb->GenFramebuffers(1, &rb->framebuffer);
+
+    rb->GenTextures(3, rb->plane_textures);
+    rb->GenTextures(3, rb->target_textures);
+    for (unsigned i = 0; i < 3; ++i) {
+        rb->BindTexture(GL_TEXTURE_2D, rb->plane_textures[i]);
+        sc_gl_readback_set_texture_filter(rb, GL_LINEAR);
+        rb->BindTexture(GL_TEXTURE_2D, rb->target_textures[i]);
+        sc_gl_readback_set_texture_filter(rb, GL_NEAREST);
+    }
+    rb->texture_width = 0;
+    rb->texture_height = 0;
+
+    rb->GenTextures(1, &rb->map_texture);
+    rb->BindTexture(GL_TEXTURE_2D, rb->map_texture);
+    sc_gl_readback_set_texture_filter(rb, GL_LINEAR);
+    rb->BindTexture(GL_TEXTURE_2D, 0);
+
+    // Until the first frame, assume the size of the calibration
+    unsigned width;
+    unsigned height;
+    sc_video_preprocess_get_size(rb->vpp, &width, &height);
+    if (!sc_gl_readback_upload_map(rb, width, height)) {
+        rb->DeleteTextures(1, &rb->map_texture);
+        rb->DeleteTextures(3, rb->target_textures);
+        rb->DeleteTextures(3, rb->plane_textures);
+        rb->DeleteFramebuffers(1, &rb->framebuffer);
+        rb->DeleteProgram(rb->program);
+        return false;
+    }
+
+    return true;
+}
+
+bool
+sc_gl_readback_init(struct sc_gl_readback *rb,
+                    const struct sc_video_preprocess *vpp, int offset) {
+    assert(offset >= 0);
+
+    rb->window = SDL_CreateWindow("scrcpy readback", SDL_WINDOWPOS_UNDEFINED,
+                                  SDL_WINDOWPOS_UNDEFINED, 1, 1,
+                                  SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    if (!rb->window) {
+        LOGW("Could not create GPU readback window: %s", SDL_GetError());
+        return false;
+    }
+
+    rb->context = SDL_GL_CreateContext(rb->window);
+    if (!rb->context) {
+        LOGW("Could not create GPU readback OpenGL context: %s",
+             SDL_GetError());
+        goto error_destroy_window;
+    }
+
+    struct sc_opengl gl;
+    sc_opengl_init(&gl);
+    // Framebuffer objects and float textures (OpenGL 3.0), fences (OpenGL
+    // 3.2), with the compatibility profile for the shader
+    if (gl.is_opengles || !sc_opengl_version_at_least(&gl, 3, 2, 0, 0)) {
+        LOGW("GPU readback disabled (OpenGL 3.2+ required, found %s)",
+             gl.version);
+        goto error_delete_context;
+    }
+
+    if (!sc_gl_readback_load_functions(rb)) {
+        goto error_delete_context;
+    }
+
+    rb->vpp = vpp;
+    rb->offset = offset;
+    if (!sc_gl_readback_create_objects(rb)) {
+        goto error_delete_context;
+    }
+
+    unsigned i;
+    for (i = 0; i < SC_GL_READBACK_DEPTH; ++i) {
+        struct sc_gl_readback_slot *slot = &rb->slots[i];
+        slot->props = av_frame_alloc();
+        if (!slot->props) {
+            LOG_OOM();
+            goto error_free_props;
+        }
+        slot->buffer = 0;
+        slot->size = 0;
+        slot->fence = NULL;
+    }
+    rb->head = 0;
+    rb->count = 0;
+
+    sc_frame_pool_init(&rb->pool);
+
+    // The context is made current by the thread submitting the frames
+    SDL_GL_MakeCurrent(rb->window, NULL);
+
+    LOGI("GPU readback enabled (OpenGL %s, map: %dx%d)", gl.version,
+         rb->map_width, rb->map_height);
+    return true;
+
+error_free_props:
+    while (i--) {
+        av_frame_free(&rb->slots[i].props);
+    }
+    rb->DeleteTextures(1, &rb->map_texture);
+    rb->DeleteTextures(3, rb->target_textures);
+    rb->DeleteTextures(3, rb->plane_textures);
+    rb->DeleteFramebuffers(1, &rb->framebuffer);
+    rb->DeleteProgram(rb->program);
+error_delete_context:
+    SDL_GL_MakeCurrent(rb->window, NULL);
+    SDL_GL_DeleteContext(rb->context);
+error_destroy_window:
+    SDL_DestroyWindow(rb->window);
+
+    return false;
+}
+
+void
+sc_gl_readback_destroy(struct sc_gl_readback *rb) {
+    assert(!rb->count);
+
+    if (SDL_GL_MakeCurrent(rb->window, rb->context)) {
+        LOGW("Could not make the GPU readback context current: %s",
+             SDL_GetError());
+    } else {
+        for (unsigned i = 0; i < SC_GL_READBACK_DEPTH; ++i) {
+            if (rb->slots[i].buffer) {
+                rb->DeleteBuffers(1, &rb->slots[i].buffer);
+            }
+        }
+        rb->DeleteTextures(1, &rb->map_texture);
+        rb->DeleteTextures(3, rb->target_textures);
+        rb->DeleteTextures(3, rb->plane_textures);
+        rb->DeleteFramebuffers(1, &rb->framebuffer);
+        rb->DeleteProgram(rb->program);
+        SDL_GL_MakeCurrent(rb->window, NULL);
+    }
+
+    for (unsigned i = 0; i < SC_GL_READBACK_DEPTH; ++i) {
+        av_frame_free(&rb->slots[i].props);
+    }
+    sc_frame_pool_destroy(&rb->pool);
+
+    // Deleted with the objects not deleted above, if any
+    SDL_GL_DeleteContext(rb->context);
+    SDL_DestroyWindow(rb->window);
+}
+
+bool
+sc_gl_readback_start(struct sc_gl_readback *rb) {
+    if (SDL_GL_MakeCurrent(rb->window, rb->context)) {
+        LOGE("Could not make the GPU readback context current: %s",
+             SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_gl_readback_stop(struct sc_gl_readback *rb) {
+    // The frames in flight are discarded
+    while (rb->count) {
+        struct sc_gl_readback_slot *slot = &rb->slots[rb->head];
+        rb->DeleteSync(slot->fence);
+        slot->fence = NULL;
+        av_frame_unref(slot->props);
+        rb->head = (rb->head + 1) % SC_GL_READBACK_DEPTH;
+        --rb->count;
+    }
+
+    SDL_GL_MakeCurrent(rb->window, NULL);
+}
+
+static void
+sc_gl_readback_draw_quad(struct sc_gl_readback *rb) {
+    // The first row of the textures is drawn at the bottom of the target,
+    // which is the first row read back
+    rb->Begin(GL_TRIANGLE_FAN);
+    rb->TexCoord2f(0, 0);
+    rb->Vertex2f(-1, -1);
+    rb->TexCoord2f(1, 0);
+    rb->Vertex2f(1, -1);
+    rb->TexCoord2f(1, 1);
+    rb->Vertex2f(1, 1);
+    rb->TexCoord2f(0, 1);
+    rb->Vertex2f(-1, 1);
+    rb->End();
+}
+
+bool
+sc_gl_readback_push(struct sc_gl_readback *rb, const AVFrame *frame,
+                    bool luma_only) {
+    assert(rb->count < SC_GL_READBACK_DEPTH);
+    assert(frame->format == AV_PIX_FMT_YUV420P
+            || frame->format == AV_PIX_FMT_GRAY8);
+
+    int width = frame->width;
+    int height = frame->height;
+    if (height <= rb->offset) {
+        return false;
+    }
+
+    bool gray = luma_only || frame->format == AV_PIX_FMT_GRAY8;
+    unsigned plane_count = gray ? 1 : 3;
+    int chroma_width = (width + 1) / 2;
+    int chroma_height = (height + 1) / 2;
+    int widths[3] = {width, chroma_width, chroma_width};
+    int heights[3] = {height, chroma_height, chroma_height};
+
+    size_t size = 0;
+    for (unsigned i = 0; i < plane_count; ++i) {
+        if (frame->linesize[i] < widths[i]) {
+            // e.g. negative linesize (flipped frame)
+            LOGW("Unsupported frame layout for the GPU readback");
+            return false;
+        }
+        size += (size_t) widths[i] * heights[i];
+    }
+
+    if (!sc_gl_readback_update_map(rb, width, height - rb->offset)
+            || !sc_gl_readback_update_textures(rb, width, height)) {
+        return false;
+    }
+
+    unsigned index = (rb->head + rb->count) % SC_GL_READBACK_DEPTH;
+    struct sc_gl_readback_slot *slot = &rb->slots[index];
+    if (av_frame_copy_props(slot->props, frame)) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (!slot->buffer) {
+        rb->GenBuffers(1, &slot->buffer);
+    }
+    rb->BindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+    if (size > slot->size) {
+        rb->BufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        slot->size = size;
+    }
+
+    rb->UseProgram(rb->program);
+    rb->Uniform1i(rb->loc_plane_tex, SC_GL_READBACK_UNIT_PLANE);
+    rb->Uniform1i(rb->loc_map_tex, SC_GL_READBACK_UNIT_MAP);
+    rb->Uniform2f(rb->loc_frame_size, width, height);
+    rb->Uniform1f(rb->loc_offset, rb->offset);
+
+    rb->ActiveTexture(GL_TEXTURE0 + SC_GL_READBACK_UNIT_MAP);
+    rb->BindTexture(GL_TEXTURE_2D, rb->map_texture);
+    rb->ActiveTexture(GL_TEXTURE0 + SC_GL_READBACK_UNIT_PLANE);
+
+    rb->BindFramebuffer(GL_FRAMEBUFFER, rb->framebuffer);
+    rb->PixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    rb->PixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    size_t offset = 0;
+    for (unsigned i = 0; i < plane_count; ++i) {
+        // The driver copies the plane before returning
+        rb->BindTexture(GL_TEXTURE_2D, rb->plane_textures[i]);
+        rb->PixelStorei(GL_UNPACK_ROW_LENGTH, frame->linesize[i]);
+        rb->TexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, widths[i], heights[i],
+                          GL_RED, GL_UNSIGNED_BYTE, frame->data[i]);
+
+        rb->FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                 GL_TEXTURE_2D, rb->target_textures[i], 0);
+        rb->Uniform1f(rb->loc_border, (i ? SC_GL_READBACK_BORDER_CHROMA
+                                         : SC_GL_READBACK_BORDER_LUMA)
+                                      / 255.f);
+        rb->Viewport(0, 0, widths[i], heights[i]);
+        sc_gl_readback_draw_quad(rb);
+
+        // With a pixel pack buffer bound, the "pixels" argument is an offset
+        // in the buffer: the copy is asynchronous
+        rb->ReadPixels(0, 0, widths[i], heights[i], GL_RED, GL_UNSIGNED_BYTE,
+                       (void *) (uintptr_t) offset);
+        offset += (size_t) widths[i] * heights[i];
+    }
+
+    slot->fence = rb->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // Start the execution now, the frame is taken later
+    rb->Flush();
+
+    rb->PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    rb->BindFramebuffer(GL_FRAMEBUFFER, 0);
+    rb->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot->format = gray ? AV_PIX_FMT_GRAY8 : AV_PIX_FMT_YUV420P;
+    slot->width = width;
+    slot->height = height;
+    ++rb->count;
+
+    return true;
+}
+
+// Copy the planes read back into slot->buffer (bound) to the frame
+static bool
+sc_gl_readback_copy(struct sc_gl_readback *rb,
+                    const struct sc_gl_readback_slot *slot, AVFrame *frame) {
+    bool gray = slot->format == AV_PIX_FMT_GRAY8;
+    unsigned plane_count = gray ? 1 : 3;
+    int chroma_width = (slot->width + 1) / 2;
+    int chroma_height = (slot->height + 1) / 2;
+    int widths[3] = {slot->width, chroma_width, chroma_width};
+    int heights[3] = {slot->height, chroma_height, chroma_height};
+
+    size_t size = 0;
+    for (unsigned i = 0; i < plane_count; ++i) {
+        size += (size_t) widths[i] * heights[i];
+    }
+
+    const uint8_t *data = rb->MapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size,
+                                             GL_MAP_READ_BIT);
+    if (!data) {
+        LOGW("Could not map the GPU readback buffer");
+        return false;
+    }
+
+    for (unsigned i = 0; i < plane_count; ++i) {
+        for (int y = 0; y < heights[i]; ++y) {
+            memcpy(frame->data[i] + (size_t) y * frame->linesize[i], data,
+                   widths[i]);
+            data += widths[i];
+        }
+    }
+
+    rb->UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    return true;
+}
+
+bool
+sc_gl_readback_pop(struct sc_gl_readback *rb, AVFrame *frame, bool wait) {
+    assert(rb->count);
+
+    struct sc_gl_readback_slot *slot = &rb->slots[rb->head];
+    GLenum result =
+        rb->ClientWaitSync(slot->fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                           wait ? SC_GL_READBACK_FENCE_TIMEOUT_NS : 0);
+    if (!wait && result == GL_TIMEOUT_EXPIRED) {
+        // Still in flight
+        return false;
+    }
+
+    rb->DeleteSync(slot->fence);
+    slot->fence = NULL;
+    rb->head = (rb->head + 1) % SC_GL_READBACK_DEPTH;
+    --rb->count;
+
+    if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+        LOGW("GPU readback not completed, frame dropped");
+        goto end;
+    }
+
+    if (!sc_frame_pool_get(&rb->pool, frame, slot->format, slot->width,
+                           slot->height)) {
+        goto end;
+    }
+
+    rb->BindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+    bool ok = sc_gl_readback_copy(rb, slot, frame);
+    rb->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (!ok) {
+        av_frame_unref(frame);
+        goto end;
+    }
+
+    if (av_frame_copy_props(frame, slot->props)) {
+        LOG_OOM();
+        av_frame_unref(frame);
+    }
+
+end:
+    av_frame_unref(slot->props);
+    return true;
+}
@@ -0,0 +1,198 @@
+#ifndef SC_GL_READBACK_H
+#define SC_GL_READBACK_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <libavutil/frame.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+
+#include "frame_pool.h"
+
+// forward declarations
+struct sc_video_preprocess;
+
+// Number of frames which may be in flight on the GPU
+#define SC_GL_READBACK_DEPTH 3
+
+struct sc_gl_readback_slot {
+    GLuint buffer; // pixel pack buffer
+    size_t size; // allocated bytes
+    GLsync fence;
+    AVFrame *props; // properties of the source frame (no data)
+    int format; // enum AVPixelFormat of the rectified frame
+    int width;
+    int height;
+};
+
+/**
+ * Stereo remap on the GPU for the frames consumed on the CPU (--gpu-readback).
+ *
+ * The planes of each frame are uploaded to a dedicated OpenGL context (of a
+ * hidden window), remapped by a fragment shader into offscreen targets (a
+ * pass per plane, through the same map texture as sc_gl_remap), and read back
+ * into a pixel pack buffer: the transfer completes asynchronously, while the
+ * next frames are submitted. Once its fence is signaled, a frame is copied
+ * from its buffer into a pooled frame, so the CPU never runs the remap.
+ *
+ * The first `offset` rows of the frames (the timestamps bar) are not part of
+ * the mapped content, they are copied unchanged.
+ *
+ * The context is created by the main thread (as any window), then used by a
+ * single thread between sc_gl_readback_start() and sc_gl_readback_stop().
+ *
+ * This requires OpenGL 3.2+ (framebuffer objects, float textures and fences).
+ */
+struct sc_gl_readback {
+    SDL_Window *window;
+    SDL_GLContext context;
+
+    const struct sc_video_preprocess *vpp;
+    // the maps are uploaded again if they are reloaded (see
+    // sc_video_preprocess_reload())
+    unsigned generation;
+    int offset;
+
+    GLuint program;
+    GLuint framebuffer;
+    GLuint map_texture;
+    int map_width;
+    int map_height;
+    GLuint plane_textures[3]; // source planes
+    GLuint target_textures[3]; // rectified planes
+    int texture_width; // size of the allocated textures, 0 if none
+    int texture_height;
+
+    GLint loc_plane_tex;
+    GLint loc_map_tex;
+    GLint loc_frame_size;
+    GLint loc_offset;
+    GLint loc_border;
+
+    // Ring of the frames in flight
+    struct sc_gl_readback_slot slots[SC_GL_READBACK_DEPTH];
+    unsigned head;
+    unsigned count;
+
+    struct sc_frame_pool pool; // rectified frames
+
+    void (*GenTextures)(GLsizei n, GLuint *textures);
+    void (*DeleteTextures)(GLsizei n, const GLuint *textures);
+    void (*BindTexture)(GLenum target, GLuint texture);
+    void (*ActiveTexture)(GLenum texture);
+    void (*TexImage2D)(GLenum target, GLint level, GLint internalformat,
+                       GLsizei width, GLsizei height, GLint border,
+                       GLenum format, GLenum type, const void *pixels);
+    void (*TexSubImage2D)(GLenum target, GLint level, GLint xoffset,
+                          GLint yoffset, GLsizei width, GLsizei height,
+                          GLenum format, GLenum type, const void *pixels);
+    void (*TexParameteri)(GLenum target, GLenum pname, GLint param);
+    void (*PixelStorei)(GLenum pname, GLint param);
+    void (*Viewport)(GLint x, GLint y, GLsizei width, GLsizei height);
+    void (*ReadPixels)(GLint x, GLint y, GLsizei width, GLsizei height,
+                       GLenum format, GLenum type, void *pixels);
+    void (*Flush)(void);
+
+    void (*GenFramebuffers)(GLsizei n, GLuint *framebuffers);
+    void (*DeleteFramebuffers)(GLsizei n, const GLuint *framebuffers);
+    void (*BindFramebuffer)(GLenum target, GLuint framebuffer);
+    void (*FramebufferTexture2D)(GLenum target, GLenum attachment,
+                                 GLenum textarget, GLuint texture,
+                                 GLint level);
+    GLenum (*CheckFramebufferStatus)(GLenum target);
+
+    void (*GenBuffers)(GLsizei n, GLuint *buffers);
+    void (*DeleteBuffers)(GLsizei n, const GLuint *buffers);
+    void (*BindBuffer)(GLenum target, GLuint buffer);
+    void (*BufferData)(GLenum target, GLsizeiptr size, const void *data,
+                       GLenum usage);
+    void *(*MapBufferRange)(GLenum target, GLintptr offset, GLsizeiptr length,
+                            GLbitfield access);
+    GLboolean (*UnmapBuffer)(GLenum target);
+    GLsync (*FenceSync)(GLenum condition, GLbitfield flags);
+    GLenum (*ClientWaitSync)(GLsync sync, GLbitfield flags, GLuint64 timeout);
+    void (*DeleteSync)(GLsync sync);
+
+    GLuint (*CreateShader)(GLenum type);
+    void (*ShaderSource)(GLuint shader, GLsizei count,
+                         const GLchar *const *string, const GLint *length);
+    void (*CompileShader)(GLuint shader);
+    void (*GetShaderiv)(GLuint shader, GLenum pname, GLint *params);
+    void (*GetShaderInfoLog)(GLuint shader, GLsizei size, GLsizei *length,
+                             GLchar *log);
+    void (*DeleteShader)(GLuint shader);
+    GLuint (*CreateProgram)(void);
+    void (*AttachShader)(GLuint program, GLuint shader);
+    void (*LinkProgram)(GLuint program);
+    void (*GetProgramiv)(GLuint program, GLenum pname, GLint *params);
+    void (*GetProgramInfoLog)(GLuint program, GLsizei size, GLsizei *length,
+                              GLchar *log);
+    void (*DeleteProgram)(GLuint program);
+    void (*UseProgram)(GLuint program);
+    GLint (*GetUniformLocation)(GLuint program, const GLchar *name);
+    void (*Uniform1i)(GLint location, GLint v0);
+    void (*Uniform1f)(GLint location, GLfloat v0);
+    void (*Uniform2f)(GLint location, GLfloat v0, GLfloat v1);
+
+    void (*Begin)(GLenum mode);
+    void (*End)(void);
+    void (*TexCoord2f)(GLfloat s, GLfloat t);
+    void (*Vertex2f)(GLfloat x, GLfloat y);
+};
+
+/**
+ * Create the OpenGL context, and initialize the remap from the maps of `vpp`
+ *
+ * Must be called from the main thread (the SDL video subsystem must be
+ * initialized). `vpp` must outlive the readback.
+ *
+ * Return false if the GPU remap is not available, so that the frames are
+ * remapped on the CPU.
+ */
+bool
+sc_gl_readback_init(struct sc_gl_readback *rb,
+                    const struct sc_video_preprocess *vpp, int offset);
+
+/**
+ * Release the context (from the main thread, once stopped)
+ */
+void
+sc_gl_readback_destroy(struct sc_gl_readback *rb);
+
+/**
+ * Make the context current on the calling thread, which submits the frames
+ */
+bool
+sc_gl_readback_start(struct sc_gl_readback *rb);
+
+/**
+ * Release the frames in flight and the context, from the same thread
+ */
+void
+sc_gl_readback_stop(struct sc_gl_readback *rb);
+
+/**
+ * Submit the remap of a YUV420P (or GRAY8) frame and its readback
+ *
+ * If `luma_only` is set, only the Y plane is remapped, into a GRAY8 frame.
+ * There must be less than SC_GL_READBACK_DEPTH frames in flight.
+ *
+ * Return false if the frame could not be submitted (for example if the maps
+ * cannot be scaled to its size), so that the caller outputs it as is.
+ */
+bool
+sc_gl_readback_push(struct sc_gl_readback *rb, const AVFrame *frame,
+                    bool luma_only);
+
+/**
+ * Take the oldest frame in flight, in submission order
+ *
+ * If `wait` is false and the frame has not been read back yet, return false.
+ * Otherwise, `frame` (which must be empty) references the rectified frame, or
+ * is left empty if the readback failed, and true is returned.
+ */
+bool
+sc_gl_readback_pop(struct sc_gl_readback *rb, AVFrame *frame, bool wait);
+
+#endif
@@ -0,0 +1,455 @@
+#include "gl_remap.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "video_preprocess.h"
+#include "util/log.h"
+
+// GLSL 1.20 (OpenGL 2.1), supported by the compatibility profile used by the
+// SDL opengl renderer
+static const char *const vertex_shader_source =
+    "#version 120\n"
+    "void main() {\n"
+    "    gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+    "    gl_Position = gl_Vertex;\n"
+    "}\n";
+
+// The coordinates are expressed in pixels, the center of the pixel i being at
+// i + 0.5. Like cv::remap(), a map value x refers to the center of the source
+// pixel x, and each eye (half of the frame) is sampled only inside its own
+// half.
+static const char *const fragment_shader_source =
+    "#version 120\n"
+    "uniform sampler2D y_tex;\n"
+    "uniform sampler2D u_tex;\n"
+    "uniform sampler2D v_tex;\n"
+    "uniform sampler2D map_tex;\n"
+    "uniform vec2 tex_scale;\n"
+    "uniform vec2 frame_size;\n"
+    "uniform float offset;\n"
+    "uniform vec3 yuv_offset;\n"
+    "uniform vec3 r_coeffs;\n"
+    "uniform vec3 g_coeffs;\n"
+    "uniform vec3 b_coeffs;\n"
+    "void main() {\n"
+    "    vec2 pos = gl_TexCoord[0].xy * frame_size;\n"
+    "    if (pos.y >= offset) {\n"
+    "        vec2 content_size = vec2(frame_size.x, frame_size.y - offset);\n"
+    "        vec2 uv = vec2(pos.x, pos.y - offset) / content_size;\n"
+    "        vec2 p = texture2D(map_tex, uv).xy;\n"
+    "        float half_width = frame_size.x / 2.0;\n"
+    "        float left = pos.x < half_width ? 0.0 : half_width;\n"
+    "        if (p.x < left - 0.5 || p.x > left + half_width - 0.5\n"
+    "                || p.y < -0.5 || p.y > content_size.y - 0.5) {\n"
+    "            gl_FragColor = vec4(0.0, 0.0, 0.0, 1.0);\n"
+    "            return;\n"
+    "        }\n"
+    "        pos = vec2(p.x + 0.5, p.y + 0.5 + offset);\n"
+    "    }\n"
+    "    vec2 tc = pos / frame_size * tex_scale;\n"
+    "    vec3 yuv = vec3(texture2D(y_tex, tc).r,\n"
+    "                    texture2D(u_tex, tc).r,\n"
+    "                    texture2D(v_tex, tc).r) - yuv_offset;\n"
+    "    gl_FragColor = vec4(dot(r_coeffs, yuv), dot(g_coeffs, yuv),\n"
+    "                        dot(b_coeffs, yuv), 1.0);\n"
+    "}\n";
+
+// Texture units of the planes bound by SDL_GL_BindTexture() for YUV textures
+#define SC_GL_REMAP_UNIT_Y 0
+#define SC_GL_REMAP_UNIT_U 1
+#define SC_GL_REMAP_UNIT_V 2
+#define SC_GL_REMAP_UNIT_MAP 3
+
+// Same threshold as SDL_YUV_CONVERSION_AUTOMATIC
+#define SC_GL_REMAP_SD_MAX_HEIGHT 576
+
+static bool
+sc_gl_remap_load_functions(struct sc_gl_remap *remap) {
+#define SC_GL_REMAP_LOAD(NAME) \
+    remap->NAME = SDL_GL_GetProcAddress("gl" #NAME); \
+    if (!remap->NAME) { \
+        LOGW("OpenGL function not available: gl" #NAME); \
+        return false; \
+    }
+
+    SC_GL_REMAP_LOAD(GenTextures);
+    SC_GL_REMAP_LOAD(DeleteTextures);
+    SC_GL_REMAP_LOAD(BindTexture);
+    SC_GL_REMAP_LOAD(ActiveTexture);
+    SC_GL_REMAP_LOAD(TexImage2D);
+    SC_GL_REMAP_LOAD(TexParameteri);
+    SC_GL_REMAP_LOAD(PixelStorei);
+    SC_GL_REMAP_LOAD(GetIntegerv);
+    SC_GL_REMAP_LOAD(Viewport);
+    SC_GL_REMAP_LOAD(ColorMask);
+    SC_GL_REMAP_LOAD(CreateShader);
+    SC_GL_REMAP_LOAD(ShaderSource);
+    SC_GL_REMAP_LOAD(CompileShader);
+    SC_GL_REMAP_LOAD(GetShaderiv);
+    SC_GL_REMAP_LOAD(GetShaderInfoLog);
+    SC_GL_REMAP_LOAD(DeleteShader);
+    SC_GL_REMAP_LOAD(CreateProgram);
+    SC_GL_REMAP_LOAD(AttachShader);
+    SC_GL_REMAP_LOAD(LinkProgram);
+    SC_GL_REMAP_LOAD(GetProgramiv);
+    SC_GL_REMAP_LOAD(GetProgramInfoLog);
+    SC_GL_REMAP_LOAD(DeleteProgram);
+    SC_GL_REMAP_LOAD(UseProgram);
+    SC_GL_REMAP_LOAD(GetUniformLocation);
+    SC_GL_REMAP_LOAD(Uniform1i);
+    SC_GL_REMAP_LOAD(Uniform1f);
+    SC_GL_REMAP_LOAD(Uniform2f);
+    SC_GL_REMAP_LOAD(Uniform3f);
+    SC_GL_REMAP_LOAD(Begin);
+    SC_GL_REMAP_LOAD(End);
+    SC_GL_REMAP_LOAD(TexCoord2f);
+    SC_GL_REMAP_LOAD(Vertex2f);
+
+#undef SC_GL_REMAP_LOAD
+
+    return true;
+}
+
+static GLuint
+sc_gl_remap_compile(struct sc_gl_remap *remap, GLenum type,
+                    const char *source) {
+    GLuint shader = remap->CreateShader(type);
+    if (!shader) {
+        LOGE("Could not create shader");
+        return 0;
+    }
+
+    remap->ShaderSource(shader, 1, &source, NULL);
+    remap->CompileShader(shader);
+
+    GLint status;
+    remap->GetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status) {
+        char log[512];
+        remap->GetShaderInfoLog(shader, sizeof(log), NULL, log);
+        LOGE("Could not compile shader: %s", log);
+        remap->DeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+static GLuint
+sc_gl_remap_create_program(struct sc_gl_remap *remap) {
+    GLuint vs = sc_gl_remap_compile(remap, GL_VERTEX_SHADER,
+                                    vertex_shader_source);
+    if (!vs) {
+        return 0;
+    }
+
+    GLuint fs = sc_gl_remap_compile(remap, GL_FRAGMENT_SHADER,
+                                    fragment_shader_source);
+    if (!fs) {
+        remap->DeleteShader(vs);
+        return 0;
+    }
+
+    GLuint program = remap->CreateProgram();
+    if (!program) {
+        LOGE("Could not create shader program");
+        goto end;
+    }
+
+    remap->AttachShader(program, vs);
+    remap->AttachShader(program, fs);
+    remap->LinkProgram(program);
+
+    GLint status;
+    remap->GetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+        char log[512];
+        remap->GetProgramInfoLog(program, sizeof(log), NULL, log);
+        LOGE("Could not link shader program: %s", log);
+        remap->DeleteProgram(program);
+        program = 0;
+    }
+
+end:
+    // Flagged for deletion, deleted along with the program
+    remap->DeleteShader(vs);
+    remap->DeleteShader(fs);
+
+    return program;
+}
+
+// Upload the current maps of remap->vpp, for a content of width x height,
+// into the bound map texture
+static bool
+sc_gl_remap_upload_map(struct sc_gl_remap *remap, int width, int height) {
+    // If the maps are reloaded meanwhile, they will be uploaded again
+    remap->generation = sc_video_preprocess_get_generation(remap->vpp);
+
+    float *map = sc_video_preprocess_get_gpu_map(remap->vpp, width, height);
+    if (!map) {
+        return false;
+    }
+
+    // The map rows are tightly packed (SDL sets its own unpack parameters
+    // before each texture update)
+    remap->PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    remap->PixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    remap->TexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, width, height, 0, GL_RG,
+                      GL_FLOAT, map);
+    free(map);
+
+    remap->map_width = width;
+    remap->map_height = height;
+    return true;
+}
+
+static bool
+sc_gl_remap_create_map_texture(struct sc_gl_remap *remap) {
+    GLint previous;
+    remap->GetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+
+    remap->GenTextures(1, &remap->map_texture);
+    remap->BindTexture(GL_TEXTURE_2D, remap->map_texture);
+    remap->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    remap->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    remap->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    remap->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    // Until the first frame, assume the size of the calibration
+    unsigned width;
+    unsigned height;
+    sc_video_preprocess_get_size(remap->vpp, &width, &height);
+    bool ok = sc_gl_remap_upload_map(remap, width, height);
+
+    remap->BindTexture(GL_TEXTURE_2D, previous);
+
+    if (!ok) {
+        remap->DeleteTextures(1, &remap->map_texture);
+        return false;
+    }
+
+    LOGI("GPU remap enabled (map: %dx%d)", remap->map_width,
+         remap->map_height);
+    return true;
+}
+
+bool
+sc_gl_remap_init(struct sc_gl_remap *remap,
+                 const struct sc_video_preprocess *vpp, int offset) {
+    assert(offset >= 0);
+
+    if (!sc_gl_remap_load_functions(remap)) {
+        return false;
+    }
+
+    remap->program = sc_gl_remap_create_program(remap);
+    if (!remap->program) {
+        return false;
+    }
+
+    GLuint program = remap->program;
+    remap->loc_y_tex = remap->GetUniformLocation(program, "y_tex");
+    remap->loc_u_tex = remap->GetUniformLocation(program, "u_tex");
+    remap->loc_v_tex = remap->GetUniformLocation(program, "v_tex");
+    remap->loc_map_tex = remap->GetUniformLocation(program, "map_tex");
+    remap->loc_tex_scale = remap->GetUniformLocation(program, "tex_scale");
+    remap->loc_frame_size = remap->GetUniformLocation(program, "frame_size");
+    remap->loc_offset = remap->GetUniformLocation(program, "offset");
+    remap->loc_yuv_offset = remap->GetUniformLocation(program, "yuv_offset");
+    remap->loc_r_coeffs = remap->GetUniformLocation(program, "r_coeffs");
+    remap->loc_g_coeffs = remap->GetUniformLocation(program, "g_coeffs");
+    remap->loc_b_coeffs = remap->GetUniformLocation(program, "b_coeffs");
+
+    remap->vpp = vpp;
+    if (!sc_gl_remap_create_map_texture(remap)) {
+        remap->DeleteProgram(remap->program);
+        return false;
+    }
+
+    remap->offset = offset;
+
+    return true;
+}
+
+void
+sc_gl_remap_destroy(struct sc_gl_remap *remap) {
+    remap->DeleteTextures(1, &remap->map_texture);
+    remap->DeleteProgram(remap->program);
+}
+
+static void
+sc_gl_remap_set_colorspace(struct sc_gl_remap *remap,
+                           enum AVColorRange color_range, int height) {
+    // Same conversions as SDL (see sc_display_to_sdl_color_range())
+    if (color_range == AVCOL_RANGE_JPEG) {
+        // BT.601, full range
+        remap->Uniform3f(remap->loc_yuv_offset, 0.f, 128 / 255.f, 128 / 255.f);
+        remap->Uniform3f(remap->loc_r_coeffs, 1.f, 0.f, 1.402f);
+        remap->Uniform3f(remap->loc_g_coeffs, 1.f, -0.344136f, -0.714136f);
+        remap->Uniform3f(remap->loc_b_coeffs, 1.f, 1.772f, 0.f);
+        return;
+    }
+
+    remap->Uniform3f(remap->loc_yuv_offset, 16 / 255.f, 128 / 255.f,
+                     128 / 255.f);
+    if (height <= SC_GL_REMAP_SD_MAX_HEIGHT) {
+        // BT.601, limited range
+        remap->Uniform3f(remap->loc_r_coeffs, 1.164383f, 0.f, 1.596027f);
+        remap->Uniform3f(remap->loc_g_coeffs, 1.164383f, -0.391762f,
+                         -0.812968f);
+        remap->Uniform3f(remap->loc_b_coeffs, 1.164383f, 2.017232f, 0.f);
+    } else {
+        // BT.709, limited range
+        remap->Uniform3f(remap->loc_r_coeffs, 1.164383f, 0.f, 1.792741f);
+        remap->Uniform3f(remap->loc_g_coeffs, 1.164383f, -0.213249f,
+                         -0.532909f);
+        remap->Uniform3f(remap->loc_b_coeffs, 1.164383f, 2.112402f, 0.f);
+    }
+}
+
+static void
+sc_gl_remap_draw_quad(struct sc_gl_remap *remap, const SDL_Rect *src,
+                      int width, int height, const SDL_Rect *geometry,
+                      int output_width, int output_height,
+                      enum sc_orientation orientation) {
+    // Source corners (texture coordinates), clockwise from the top-left
+    float u0 = 0;
+    float u1 = 1;
+    float v0 = 0;
+    float v1 = 1;
+    if (src) {
+        u0 = (float) src->x / width;
+        u1 = (float) (src->x + src->w) / width;
+        v0 = (float) src->y / height;
+        v1 = (float) (src->y + src->h) / height;
+    }
+    const float corners[4][2] = {{u0, v0}, {u1, v0}, {u1, v1}, {u0, v1}};
+
+    // Geometry corners (normalized device coordinates), clockwise from the
+    // top-left
+    float x0 = 2.f * geometry->x / output_width - 1;
+    float x1 = 2.f * (geometry->x + geometry->w) / output_width - 1;
+    float y0 = 1 - 2.f * geometry->y / output_height;
+    float y1 = 1 - 2.f * (geometry->y + geometry->h) / output_height;
+    const float vertices[4][2] = {{x0, y0}, {x1, y0}, {x1, y1}, {x0, y1}};
+
+    // Like SDL_RenderCopyEx(), the frame is flipped, then rotated
+    unsigned cw_rotation = sc_orientation_get_rotation(orientation);
+    bool mirror = sc_orientation_is_mirror(orientation);
+
+    remap->Begin(GL_TRIANGLE_FAN);
+    for (unsigned i = 0; i < 4; ++i) {
+        // A clockwise rotation moves the frame corner (i - rotation) to the
+        // corner i, a horizontal flip swaps the left and right corners
+        unsigned j = (i + 4 - cw_rotation) % 4;
+        if (mirror) {
+            j ^= 1;
+        }
+        remap->TexCoord2f(corners[j][0], corners[j][1]);
+        remap->Vertex2f(vertices[i][0], vertices[i][1]);
+    }
+    remap->End();
+}
+
+bool
+sc_gl_remap_render(struct sc_gl_remap *remap, SDL_Renderer *renderer,
+                   SDL_Texture *texture, const SDL_Rect *src,
+                   const SDL_Rect *geometry, enum sc_orientation orientation,
+                   enum AVColorRange color_range, const SDL_Color *color_mod) {
+    Uint32 format;
+    int width;
+    int height;
+    if (SDL_QueryTexture(texture, &format, NULL, &width, &height)) {
+        return false;
+    }
+
+    if (format != SDL_PIXELFORMAT_YV12) {
+        // The shader samples the U and V planes separately
+        return false;
+    }
+
+    int output_width;
+    int output_height;
+    if (SDL_GetRendererOutputSize(renderer, &output_width, &output_height)) {
+        return false;
+    }
+
+    // Flush the pending SDL commands, make the renderer context current and
+    // bind the Y, U and V planes to the texture units 0, 1 and 2
+    float tex_w;
+    float tex_h;
+    if (SDL_GL_BindTexture(texture, &tex_w, &tex_h)) {
+        LOGW("Could not bind texture: %s", SDL_GetError());
+        return false;
+    }
+
+    // SDL caches its own OpenGL state, restore it afterwards
+    GLint previous_program;
+    GLint previous_map_unit_texture;
+    GLint previous_viewport[4];
+    remap->GetIntegerv(GL_CURRENT_PROGRAM, &previous_program);
+    remap->GetIntegerv(GL_VIEWPORT, previous_viewport);
+    remap->ActiveTexture(GL_TEXTURE0 + SC_GL_REMAP_UNIT_MAP);
+    remap->GetIntegerv(GL_TEXTURE_BINDING_2D, &previous_map_unit_texture);
+    remap->BindTexture(GL_TEXTURE_2D, remap->map_texture);
+    bool ok = true;
+    int content_height = height - remap->offset;
+    if (width != remap->map_width || content_height != remap->map_height) {
+        // New video size, the maps are scaled (the error, if any, is logged
+        // only once, the frames are then rendered without remap)
+        ok = sc_gl_remap_upload_map(remap, width, content_height);
+        if (ok) {
+            LOGI("GPU remap map resized to %dx%d", width, content_height);
+        }
+    } else if (sc_video_preprocess_get_generation(remap->vpp)
+                   != remap->generation) {
+        // The calibration has been reloaded
+        ok = sc_gl_remap_upload_map(remap, width, content_height);
+        if (ok) {
+            LOGI("GPU remap map reloaded");
+        }
+    }
+    remap->ActiveTexture(GL_TEXTURE0);
+
+    if (!ok) {
+        goto end;
+    }
+
+    remap->Viewport(0, 0, output_width, output_height);
+
+    remap->UseProgram(remap->program);
+    remap->Uniform1i(remap->loc_y_tex, SC_GL_REMAP_UNIT_Y);
+    remap->Uniform1i(remap->loc_u_tex, SC_GL_REMAP_UNIT_U);
+    remap->Uniform1i(remap->loc_v_tex, SC_GL_REMAP_UNIT_V);
+    remap->Uniform1i(remap->loc_map_tex, SC_GL_REMAP_UNIT_MAP);
+    remap->Uniform2f(remap->loc_tex_scale, tex_w, tex_h);
+    remap->Uniform2f(remap->loc_frame_size, width, height);
+    remap->Uniform1f(remap->loc_offset, remap->offset);
+    sc_gl_remap_set_colorspace(remap, color_range, height);
+
+    if (color_mod) {
+        remap->ColorMask(color_mod->r != 0, color_mod->g != 0,
+                         color_mod->b != 0, GL_TRUE);
+    }
+
+    sc_gl_remap_draw_quad(remap, src, width, height, geometry, output_width,
+                          output_height, orientation);
+
+    if (color_mod) {
+        // SDL never changes the color mask
+        remap->ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    }
+
+end:
+    remap->UseProgram(previous_program);
+    remap->Viewport(previous_viewport[0], previous_viewport[1],
+                    previous_viewport[2], previous_viewport[3]);
+    remap->ActiveTexture(GL_TEXTURE0 + SC_GL_REMAP_UNIT_MAP);
+    remap->BindTexture(GL_TEXTURE_2D, previous_map_unit_texture);
+    remap->ActiveTexture(GL_TEXTURE0);
+
+    SDL_GL_UnbindTexture(texture);
+
+    return ok;
+}
@@ -0,0 +1,129 @@
+#ifndef SC_GL_REMAP_H
+#define SC_GL_REMAP_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <libavutil/pixfmt.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+
+#include "options.h"
+
+// forward declarations
+struct sc_video_preprocess;
+
+/**
+ * Stereo remap on the GPU, while rendering.
+ *
+ * Instead of letting SDL draw the YV12 texture, a fragment shader samples its
+ * planes through the remap map (the source coordinates of every destination
+ * pixel, stored in a float texture), and converts the result to RGB. The
+ * frames which are only displayed are therefore never remapped on the CPU.
+ *
+ * The first `offset` rows of the frames (the timestamps bar) are not part of
+ * the mapped content, they are drawn unchanged.
+ *
+ * This requires the SDL "opengl" renderer (OpenGL 3.0+, compatibility
+ * profile).
+ */
+struct sc_gl_remap {
+    const struct sc_video_preprocess *vpp;
+    // the maps are uploaded again if they are reloaded (see
+    // sc_video_preprocess_reload())
+    unsigned generation;
+
+    GLuint program;
+    GLuint map_texture;
+    int map_width;
+    int map_height;
+    int offset;
+
+    GLint loc_y_tex;
+    GLint loc_u_tex;
+    GLint loc_v_tex;
+    GLint loc_map_tex;
+    GLint loc_tex_scale;
+    GLint loc_frame_size;
+    GLint loc_offset;
+    GLint loc_yuv_offset;
+    GLint loc_r_coeffs;
+    GLint loc_g_coeffs;
+    GLint loc_b_coeffs;
+
+    void (*GenTextures)(GLsizei n, GLuint *textures);
+    void (*DeleteTextures)(GLsizei n, const GLuint *textures);
+    void (*BindTexture)(GLenum target, GLuint texture);
+    void (*ActiveTexture)(GLenum texture);
+    void (*TexImage2D)(GLenum target, GLint level, GLint internalformat,
+                       GLsizei width, GLsizei height, GLint border,
+                       GLenum format, GLenum type, const void *pixels);
+    void (*TexParameteri)(GLenum target, GLenum pname, GLint param);
+    void (*PixelStorei)(GLenum pname, GLint param);
+    void (*GetIntegerv)(GLenum pname, GLint *data);
+    void (*Viewport)(GLint x, GLint y, GLsizei width, GLsizei height);
+    void (*ColorMask)(GLboolean red, GLboolean green, GLboolean blue,
+                      GLboolean alpha);
+
+    GLuint (*CreateShader)(GLenum type);
+    void (*ShaderSource)(GLuint shader, GLsizei count,
+                         const GLchar *const *string, const GLint *length);
+    void (*CompileShader)(GLuint shader);
+    void (*GetShaderiv)(GLuint shader, GLenum pname, GLint *params);
+    void (*GetShaderInfoLog)(GLuint shader, GLsizei size, GLsizei *length,
+                             GLchar *log);
+    void (*DeleteShader)(GLuint shader);
+    GLuint (*CreateProgram)(void);
+    void (*AttachShader)(GLuint program, GLuint shader);
+    void (*LinkProgram)(GLuint program);
+    void (*GetProgramiv)(GLuint program, GLenum pname, GLint *params);
+    void (*GetProgramInfoLog)(GLuint program, GLsizei size, GLsizei *length,
+                              GLchar *log);
+    void (*DeleteProgram)(GLuint program);
+    void (*UseProgram)(GLuint program);
+    GLint (*GetUniformLocation)(GLuint program, const GLchar *name);
+    void (*Uniform1i)(GLint location, GLint v0);
+    void (*Uniform1f)(GLint location, GLfloat v0);
+    void (*Uniform2f)(GLint location, GLfloat v0, GLfloat v1);
+    void (*Uniform3f)(GLint location, GLfloat v0, GLfloat v1, GLfloat v2);
+
+    void (*Begin)(GLenum mode);
+    void (*End)(void);
+    void (*TexCoord2f)(GLfloat s, GLfloat t);
+    void (*Vertex2f)(GLfloat x, GLfloat y);
+};
+
+/**
+ * Initialize the GPU remap from the maps of `vpp`
+ *
+ * The maps are uploaded to a texture, and uploaded again on render if they
+ * have been reloaded meanwhile. `vpp` must outlive the GPU remap.
+ *
+ * The OpenGL context of the renderer must be current.
+ */
+bool
+sc_gl_remap_init(struct sc_gl_remap *remap,
+                 const struct sc_video_preprocess *vpp, int offset);
+
+void
+sc_gl_remap_destroy(struct sc_gl_remap *remap);
+
+/**
+ * Draw the `src` area (or the whole, if NULL) of the (remapped) YV12 texture
+ * into the geometry
+ *
+ * If `color_mod` is not NULL, only its non-zero channels are written.
+ *
+ * The maps are scaled to the size of the texture if needed (see
+ * sc_video_preprocess_check_size()).
+ *
+ * Return false if the texture could not be drawn (for example if the maps
+ * cannot be scaled to its size), so that the caller renders it normally.
+ */
+bool
+sc_gl_remap_render(struct sc_gl_remap *remap, SDL_Renderer *renderer,
+                   SDL_Texture *texture, const SDL_Rect *src,
+                   const SDL_Rect *geometry, enum sc_orientation orientation,
+                   enum AVColorRange color_range, const SDL_Color *color_mod);
+
+#endif
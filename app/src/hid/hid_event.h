@@ -3,6 +3,7 @@
 
 #include "common.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #define SC_HID_MAX_SIZE 15
@@ -11,6 +12,10 @@ struct sc_hid_input {
     uint16_t hid_id;
     uint8_t data[SC_HID_MAX_SIZE];
     uint8_t size;
+    // Only absolute values (e.g. gamepad axes) changed since the previous
+    // input of the same HID device: if it is not sent yet, this input may
+    // replace it
+    bool coalescable;
 };
 
 struct sc_hid_open {
@@ -316,6 +316,7 @@ sc_hid_gamepad_event_from_slot(uint16_t hid_id,
                                struct sc_hid_input *hid_input) {
     hid_input->hid_id = hid_id;
     hid_input->size = SC_HID_GAMEPAD_EVENT_SIZE;
+    hid_input->coalescable = false;
 
     uint8_t *data = hid_input->data;
     // Values must be written in little-endian
@@ -452,6 +453,9 @@ sc_hid_gamepad_generate_input_from_axis(struct sc_hid_gamepad *hid,
 
     uint16_t hid_id = sc_hid_gamepad_slot_get_id(slot_idx);
     sc_hid_gamepad_event_from_slot(hid_id, slot, hid_input);
+    // The buttons did not change, so the previous input of the same gamepad
+    // (if not sent yet) may be replaced by this one
+    hid_input->coalescable = true;
 
     return true;
 }
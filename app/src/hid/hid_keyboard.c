@@ -202,6 +202,7 @@ static void
 sc_hid_keyboard_input_init(struct sc_hid_input *hid_input) {
     hid_input->hid_id = SC_HID_ID_KEYBOARD;
     hid_input->size = SC_HID_KEYBOARD_INPUT_SIZE;
+    hid_input->coalescable = false;
 
     uint8_t *data = hid_input->data;
 
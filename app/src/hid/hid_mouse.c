@@ -125,6 +125,8 @@ static void
 sc_hid_mouse_input_init(struct sc_hid_input *hid_input) {
     hid_input->hid_id = SC_HID_ID_MOUSE;
     hid_input->size = SC_HID_MOUSE_INPUT_SIZE;
+    // Mouse motion is relative, so no input may be skipped
+    hid_input->coalescable = false;
     // Leave ->data uninitialized, it will be fully initialized by callers
 }
 
@@ -0,0 +1,200 @@
+#include "hud.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "metrics.h"
+#include "util/font.h"
+#include "util/log.h"
+
+// In font pixels
+#define SC_HUD_PADDING 2
+#define SC_HUD_ADVANCE (SC_FONT_GLYPH_COLS + 1)
+#define SC_HUD_LINE_HEIGHT (SC_FONT_GLYPH_ROWS + 2)
+
+// ARGB8888
+#define SC_HUD_BACKGROUND 0xB0000000
+#define SC_HUD_FOREGROUND 0xFFFFFFFF
+
+bool
+sc_hud_init(struct sc_hud *hud, SDL_Renderer *renderer) {
+    hud->width = (2 * SC_HUD_PADDING + SC_HUD_COLUMNS * SC_HUD_ADVANCE - 1)
+               * SC_HUD_SCALE;
+    hud->height = (2 * SC_HUD_PADDING + SC_HUD_LINES * SC_HUD_LINE_HEIGHT
+                    - (SC_HUD_LINE_HEIGHT - SC_FONT_GLYPH_ROWS))
+                * SC_HUD_SCALE;
+
+    hud->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                     SDL_TEXTUREACCESS_STREAMING,
+                                     hud->width, hud->height);
+    if (!hud->texture) {
+        LOGE("Could not create HUD texture: %s", SDL_GetError());
+        return false;
+    }
+
+    if (SDL_SetTextureBlendMode(hud->texture, SDL_BLENDMODE_BLEND)) {
+        LOGE("Could not set HUD blend mode: %s", SDL_GetError());
+        SDL_DestroyTexture(hud->texture);
+        return false;
+    }
+
+    // Updated on the first render
+    sc_tick now = sc_tick_now();
+    hud->next_update = now;
+    hud->last_time = now;
+    hud->last_recv_bytes = sc_metrics_get(SC_METRIC_RECV_BYTES);
+    hud->last_decoded_frames = sc_metrics_get(SC_METRIC_DECODED_FRAMES);
+    hud->last_rendered_frames = sc_metrics_get(SC_METRIC_RENDERED_FRAMES);
+
+    return true;
+}
+
+void
+sc_hud_destroy(struct sc_hud *hud) {
+    SDL_DestroyTexture(hud->texture);
+}
+
+// Format the duration in milliseconds of a latency gauge, "-" if not measured
+static void
+format_latency(char *buf, size_t size, enum sc_metric metric) {
+    int64_t us = sc_metrics_get(metric);
+    if (us) {
+        snprintf(buf, size, "%.1f", us / 1000.);
+    } else {
+        snprintf(buf, size, "-");
+    }
+}
+
+static void
+sc_hud_format(struct sc_hud *hud, sc_tick now) {
+    int64_t recv_bytes = sc_metrics_get(SC_METRIC_RECV_BYTES);
+    int64_t decoded_frames = sc_metrics_get(SC_METRIC_DECODED_FRAMES);
+    int64_t rendered_frames = sc_metrics_get(SC_METRIC_RENDERED_FRAMES);
+
+    double elapsed = (double) (now - hud->last_time) / SC_TICK_FREQ;
+    double decode_fps = 0;
+    double render_fps = 0;
+    double mbps = 0;
+    if (elapsed > 0) {
+        decode_fps = (decoded_frames - hud->last_decoded_frames) / elapsed;
+        render_fps = (rendered_frames - hud->last_rendered_frames) / elapsed;
+        mbps = (recv_bytes - hud->last_recv_bytes) * 8 / elapsed / 1000000;
+    }
+
+    hud->last_time = now;
+    hud->last_recv_bytes = recv_bytes;
+    hud->last_decoded_frames = decoded_frames;
+    hud->last_rendered_frames = rendered_frames;
+
+    char decode[16];
+    char preprocess[16];
+    char display[16];
+    char present[16];
+    char output[16];
+    format_latency(decode, sizeof(decode), SC_METRIC_DECODE_LATENCY_US);
+    format_latency(preprocess, sizeof(preprocess),
+                   SC_METRIC_PREPROCESS_LATENCY_US);
+    format_latency(display, sizeof(display), SC_METRIC_DISPLAY_LATENCY_US);
+    format_latency(present, sizeof(present), SC_METRIC_PRESENT_LATENCY_US);
+    format_latency(output, sizeof(output), SC_METRIC_OUTPUT_LATENCY_US);
+
+    // The lines are truncated to SC_HUD_COLUMNS
+    char (*lines)[SC_HUD_COLUMNS + 1] = hud->lines;
+    size_t size = sizeof(*lines);
+
+    snprintf(lines[0], size, "FPS     dec %.1f  ren %.1f", decode_fps,
+             render_fps);
+    snprintf(lines[1], size, "NET     %.2f Mbps", mbps);
+    snprintf(lines[2], size, "LATENCY dec %s  pre %s", decode, preprocess);
+    snprintf(lines[3], size, "(ms)    dis %s  prs %s  out %s", display,
+             present, output);
+    snprintf(lines[4], size,
+             "DROPS   net %" PRIi64 "  skip %" PRIi64 "  late %" PRIi64,
+             sc_metrics_get(SC_METRIC_SKIPPED_FRAMES),
+             sc_metrics_get(SC_METRIC_DISPLAY_SKIPPED_FRAMES),
+             sc_metrics_get(SC_METRIC_STALE_FRAMES));
+    snprintf(lines[5], size, "        proc %" PRIi64 "  save %" PRIi64,
+             sc_metrics_get(SC_METRIC_PROCESSOR_DROPPED_FRAMES),
+             sc_metrics_get(SC_METRIC_WRITER_DROPPED_FRAMES));
+    snprintf(lines[6], size, "QUEUES  proc %" PRIi64 "  save %" PRIi64,
+             sc_metrics_get(SC_METRIC_PROCESSOR_QUEUE),
+             sc_metrics_get(SC_METRIC_WRITER_QUEUE));
+
+    int64_t rtt = sc_metrics_get(SC_METRIC_RTT_US);
+    if (rtt) {
+        int64_t offset = sc_metrics_get(SC_METRIC_CLOCK_OFFSET_US);
+        snprintf(lines[7], size, "CLOCK   %+.1f ms  rtt %.1f ms",
+                 offset / 1000., rtt / 1000.);
+    } else {
+        // No clock sync
+        snprintf(lines[7], size, "CLOCK   -");
+    }
+}
+
+static void
+sc_hud_draw(struct sc_hud *hud, uint8_t *pixels, int pitch) {
+    for (int y = 0; y < hud->height; ++y) {
+        uint32_t *row = (uint32_t *) (pixels + (size_t) y * pitch);
+        for (int x = 0; x < hud->width; ++x) {
+            row[x] = SC_HUD_BACKGROUND;
+        }
+    }
+
+    for (unsigned l = 0; l < SC_HUD_LINES; ++l) {
+        int top = (SC_HUD_PADDING + l * SC_HUD_LINE_HEIGHT) * SC_HUD_SCALE;
+        const char *line = hud->lines[l];
+        for (unsigned i = 0; line[i]; ++i) {
+            if (line[i] == ' ') {
+                continue;
+            }
+
+            int left = (SC_HUD_PADDING + i * SC_HUD_ADVANCE) * SC_HUD_SCALE;
+            const uint8_t *glyph = sc_font_get_glyph(line[i]);
+            for (int gy = 0; gy < SC_FONT_GLYPH_ROWS * SC_HUD_SCALE; ++gy) {
+                uint8_t bits = glyph[gy / SC_HUD_SCALE];
+                uint32_t *row = (uint32_t *)
+                    (pixels + (size_t) (top + gy) * pitch) + left;
+                for (int gx = 0; gx < SC_FONT_GLYPH_COLS * SC_HUD_SCALE;
+                        ++gx) {
+                    if (bits & (0x10 >> (gx / SC_HUD_SCALE))) {
+                        row[gx] = SC_HUD_FOREGROUND;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void
+sc_hud_update(struct sc_hud *hud, sc_tick now) {
+    sc_hud_format(hud, now);
+
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(hud->texture, NULL, &pixels, &pitch)) {
+        LOGW("Could not lock HUD texture: %s", SDL_GetError());
+        return;
+    }
+
+    // The locked pixels are write-only: the whole texture is redrawn
+    sc_hud_draw(hud, pixels, pitch);
+    SDL_UnlockTexture(hud->texture);
+}
+
+void
+sc_hud_render(struct sc_hud *hud, SDL_Renderer *renderer) {
+    sc_tick now = sc_tick_now();
+    if (now >= hud->next_update) {
+        sc_hud_update(hud, now);
+        hud->next_update = now + SC_HUD_INTERVAL;
+    }
+
+    SDL_Rect rect = {
+        .x = SC_HUD_MARGIN,
+        .y = SC_HUD_MARGIN,
+        .w = hud->width,
+        .h = hud->height,
+    };
+    SDL_RenderCopy(renderer, hud->texture, NULL, &rect);
+}
@@ -0,0 +1,65 @@
+#ifndef SC_HUD_H
+#define SC_HUD_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "util/tick.h"
+
+// Interval between the updates of the HUD texture
+#define SC_HUD_INTERVAL SC_TICK_FROM_MS(250)
+#define SC_HUD_LINES 8
+#define SC_HUD_COLUMNS 44
+// Size of a font pixel, in pixels of the window
+#define SC_HUD_SCALE 2
+// Distance from the top-left corner of the window, in pixels
+#define SC_HUD_MARGIN 8
+
+/**
+ * Performance HUD drawn over the video in the window (--hud)
+ *
+ * It shows the metrics of the pipeline (see metrics.h): the decoding and
+ * rendering frame rates, the network throughput, the duration since the
+ * reception of the packet of the last frame at each stage (see
+ * latency_trace.h), the dropped frames, the depths of the queues and the
+ * clock sync offset.
+ *
+ * The text is drawn with the built-in bitmap font into a dedicated streaming
+ * texture, blended over the frame on every render: the frames themselves are
+ * never modified. The texture is only redrawn every SC_HUD_INTERVAL, the
+ * renders in between just copy it.
+ *
+ * It must be used from the thread owning the renderer.
+ */
+struct sc_hud {
+    SDL_Texture *texture;
+    int width;
+    int height;
+
+    sc_tick next_update;
+    // The counters on the last update, for the rates
+    sc_tick last_time;
+    int64_t last_recv_bytes;
+    int64_t last_decoded_frames;
+    int64_t last_rendered_frames;
+
+    char lines[SC_HUD_LINES][SC_HUD_COLUMNS + 1];
+};
+
+bool
+sc_hud_init(struct sc_hud *hud, SDL_Renderer *renderer);
+
+void
+sc_hud_destroy(struct sc_hud *hud);
+
+/**
+ * Draw the HUD over the current render target (updating its texture first if
+ * SC_HUD_INTERVAL has elapsed)
+ */
+void
+sc_hud_render(struct sc_hud *hud, SDL_Renderer *renderer);
+
+#endif
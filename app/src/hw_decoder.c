@@ -0,0 +1,119 @@
+#include "hw_decoder.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#include "util/log.h"
+
+#ifdef SCRCPY_LAVC_HAS_HW_CONFIG
+# include <libavutil/hwcontext.h>
+
+static enum AVPixelFormat
+sc_hw_decoder_get_format(AVCodecContext *ctx, const enum AVPixelFormat *fmts) {
+    enum AVPixelFormat hw_pix_fmt = (enum AVPixelFormat) (intptr_t) ctx->opaque;
+    for (const enum AVPixelFormat *p = fmts; *p != AV_PIX_FMT_NONE; ++p) {
+        if (*p == hw_pix_fmt) {
+            return *p;
+        }
+    }
+
+    LOGW("Hardware decoding not supported for this stream, fallback to "
+         "software decoding");
+    return avcodec_default_get_format(ctx, fmts);
+}
+
+static bool
+sc_hw_decoder_try(AVCodecContext *ctx, enum AVHWDeviceType type) {
+    const char *name = av_hwdevice_get_type_name(type);
+
+    enum AVPixelFormat hw_pix_fmt = AV_PIX_FMT_NONE;
+    for (int i = 0;; ++i) {
+        const AVCodecHWConfig *config = avcodec_get_hw_config(ctx->codec, i);
+        if (!config) {
+            break;
+        }
+        if ((config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX)
+                && config->device_type == type) {
+            hw_pix_fmt = config->pix_fmt;
+            break;
+        }
+    }
+
+    if (hw_pix_fmt == AV_PIX_FMT_NONE) {
+        LOGD("Hardware decoder %s does not support %s", name,
+             ctx->codec->name);
+        return false;
+    }
+
+    AVBufferRef *device_ctx;
+    int r = av_hwdevice_ctx_create(&device_ctx, type, NULL, NULL, 0);
+    if (r < 0) {
+        LOGD("Could not create %s device: %d", name, r);
+        return false;
+    }
+
+    ctx->hw_device_ctx = device_ctx; // owned by the codec context
+    ctx->opaque = (void *) (intptr_t) hw_pix_fmt;
+    ctx->get_format = sc_hw_decoder_get_format;
+
+    LOGI("Hardware decoding: %s", name);
+    return true;
+}
+
+static enum AVHWDeviceType
+sc_hw_decoder_to_device_type(enum sc_hw_decoder hw_decoder) {
+    switch (hw_decoder) {
+        case SC_HW_DECODER_D3D11VA:
+            return AV_HWDEVICE_TYPE_D3D11VA;
+        case SC_HW_DECODER_VAAPI:
+            return AV_HWDEVICE_TYPE_VAAPI;
+        case SC_HW_DECODER_VIDEOTOOLBOX:
+            return AV_HWDEVICE_TYPE_VIDEOTOOLBOX;
+        case SC_HW_DECODER_CUDA:
+            return AV_HWDEVICE_TYPE_CUDA;
+        default:
+            assert(!"unexpected hardware decoder");
+            return AV_HWDEVICE_TYPE_NONE;
+    }
+}
+#endif
+
+bool
+sc_hw_decoder_configure(AVCodecContext *ctx, enum sc_hw_decoder hw_decoder) {
+    assert(hw_decoder != SC_HW_DECODER_NONE);
+
+#ifdef SCRCPY_LAVC_HAS_HW_CONFIG
+    if (hw_decoder == SC_HW_DECODER_AUTO) {
+        // The device types expected to work on the current platform, in order
+        // of preference
+        static const enum AVHWDeviceType types[] = {
+# if defined(_WIN32)
+            AV_HWDEVICE_TYPE_D3D11VA,
+            AV_HWDEVICE_TYPE_CUDA,
+# elif defined(__APPLE__)
+            AV_HWDEVICE_TYPE_VIDEOTOOLBOX,
+# else
+            AV_HWDEVICE_TYPE_VAAPI,
+            AV_HWDEVICE_TYPE_CUDA,
+# endif
+        };
+        for (size_t i = 0; i < ARRAY_LEN(types); ++i) {
+            if (sc_hw_decoder_try(ctx, types[i])) {
+                return true;
+            }
+        }
+    } else {
+        enum AVHWDeviceType type = sc_hw_decoder_to_device_type(hw_decoder);
+        if (sc_hw_decoder_try(ctx, type)) {
+            return true;
+        }
+    }
+
+    LOGW("Hardware decoding not available, fallback to software decoding");
+#else
+    (void) ctx;
+    LOGW("Hardware decoding requires FFmpeg >= 4.0, fallback to software "
+         "decoding");
+#endif
+    return false;
+}
@@ -0,0 +1,24 @@
+#ifndef SC_HW_DECODER_H
+#define SC_HW_DECODER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <libavcodec/avcodec.h>
+
+#include "options.h"
+
+/**
+ * Configure the (not opened yet) codec context to decode with the given
+ * hardware device type
+ *
+ * The decoded frames are then hardware frames (with a non-NULL hw_frames_ctx),
+ * which must be downloaded before being accessed by the CPU (see decoder.c).
+ *
+ * Return false if hardware decoding is not available, in which case the
+ * context is left unchanged (software decoding).
+ */
+bool
+sc_hw_decoder_configure(AVCodecContext *ctx, enum sc_hw_decoder hw_decoder);
+
+#endif
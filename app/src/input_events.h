@@ -364,6 +364,34 @@ static_assert(sizeof(enum sc_keycode) >= sizeof(SDL_Keycode),
 static_assert(sizeof(enum sc_scancode) >= sizeof(SDL_Scancode),
               "SDL_Scancode must be convertible to sc_scancode");
 
+/**
+ * The keycodes are either an ASCII character, or a scancode tagged by
+ * SDLK_SCANCODE_MASK. Both ranges are mapped to a compact index, so that
+ * keycode tables may be direct-indexed arrays (initialized statically with
+ * designated initializers [SC_KEYCODE_INDEX(SC_KEYCODE_xxx)] = ...).
+ */
+#define SC_KEYCODE_ASCII_COUNT 128
+#define SC_KEYCODE_INDEX_COUNT (SC_KEYCODE_ASCII_COUNT + SDL_NUM_SCANCODES)
+#define SC_KEYCODE_INDEX(K) \
+    ((K) & SDLK_SCANCODE_MASK \
+        ? SC_KEYCODE_ASCII_COUNT + ((K) & ~SDLK_SCANCODE_MASK) \
+        : (K))
+
+/**
+ * Return the index of the keycode, or -1 if it is not indexable (e.g. a
+ * non-ASCII character of the keyboard layout)
+ */
+static inline int
+sc_keycode_index(enum sc_keycode keycode) {
+    uint32_t k = (uint32_t) keycode;
+    if (k & SDLK_SCANCODE_MASK) {
+        k &= ~SDLK_SCANCODE_MASK;
+        return k < SDL_NUM_SCANCODES ? SC_KEYCODE_ASCII_COUNT + (int) k
+                                     : -1;
+    }
+    return k < SC_KEYCODE_ASCII_COUNT ? (int) k : -1;
+}
+
 enum sc_touch_action {
     SC_TOUCH_ACTION_MOVE,
     SC_TOUCH_ACTION_DOWN,
@@ -1,14 +1,21 @@
 #include "input_manager.h"
 
 #include <assert.h>
+#include <stdlib.h>
 #include <SDL2/SDL_keycode.h>
+#include <SDL2/SDL_timer.h>
 
+#include "capture_trigger.h"
+#include "events.h"
 #include "input_events.h"
 #include "screen.h"
 #include "util/log.h"
 
 #define SC_SDL_SHORTCUT_MODS_MASK (KMOD_CTRL | KMOD_ALT | KMOD_GUI)
 
+// The relative motions of the HID mouse reports are limited to [-127, 127]
+#define SC_MOUSE_MOTION_MAX_REL 127
+
 static inline uint16_t
 to_sdl_mod(uint8_t shortcut_mod) {
     uint16_t sdl_mod = 0;
@@ -68,6 +75,9 @@ sc_input_manager_init(struct sc_input_manager *im,
     im->kp = params->kp;
     im->mp = params->mp;
     im->gp = params->gp;
+    im->remap_reloader = params->remap_reloader;
+    im->video_reconfigurer = params->video_reconfigurer;
+    im->capture_trigger = params->capture_trigger;
 
     im->mouse_bindings = params->mouse_bindings;
     im->legacy_paste = params->legacy_paste;
@@ -85,6 +95,11 @@ sc_input_manager_init(struct sc_input_manager *im,
     im->last_mod = 0;
     im->key_repeat = 0;
 
+    im->mouse_motion_interval = params->mouse_motion_interval;
+    im->last_motion_sent = 0;
+    im->motion_pending = false;
+    im->motion_flush_scheduled = false;
+
     im->next_sequence = 1; // 0 is reserved for SC_SEQUENCE_INVALID
 }
 
@@ -338,6 +353,15 @@ apply_orientation_transform(struct sc_input_manager *im,
     sc_screen_set_orientation(screen, new_orientation);
 }
 
+static void
+switch_stereo_view(struct sc_input_manager *im, bool backward) {
+    struct sc_screen *screen = im->screen;
+    unsigned step = backward ? SC_STEREO_VIEW_COUNT - 1 : 1;
+    enum sc_stereo_view view =
+        (screen->stereo_view + step) % SC_STEREO_VIEW_COUNT;
+    sc_screen_set_stereo_view(screen, view);
+}
+
 static void
 sc_input_manager_process_text_input(struct sc_input_manager *im,
                                     const SDL_TextInputEvent *event) {
@@ -512,6 +536,11 @@ sc_input_manager_process_key(struct sc_input_manager *im,
                     }
                 }
                 return;
+            case SDLK_e:
+                if (video && !repeat && down) {
+                    switch_stereo_view(im, shift);
+                }
+                return;
             case SDLK_c:
                 if (im->kp && !shift && !repeat && down && !paused) {
                     get_device_clipboard(im, SC_COPY_KEY_COPY);
@@ -570,6 +599,23 @@ sc_input_manager_process_key(struct sc_input_manager *im,
                     rotate_device(im);
                 }
                 return;
+            case SDLK_l:
+                if (im->remap_reloader && !shift && !repeat && down) {
+                    sc_remap_reloader_request(im->remap_reloader);
+                }
+                return;
+            case SDLK_j:
+                if (im->video_reconfigurer && !repeat && down) {
+                    sc_video_reconfigurer_switch(im->video_reconfigurer,
+                                                 !shift,
+                                                 im->screen->frame_size);
+                }
+                return;
+            case SDLK_t:
+                if (im->capture_trigger && !shift && !repeat && down) {
+                    sc_capture_trigger_request();
+                }
+                return;
             case SDLK_k:
                 if (control && !shift && !repeat && down && !paused
                         && im->kp && im->kp->hid) {
@@ -655,13 +701,8 @@ sc_input_manager_get_position(struct sc_input_manager *im, int32_t x,
 }
 
 static void
-sc_input_manager_process_mouse_motion(struct sc_input_manager *im,
-                                      const SDL_MouseMotionEvent *event) {
-    if (event->which == SDL_TOUCH_MOUSEID) {
-        // simulated from touch events, so it's a duplicate
-        return;
-    }
-
+sc_input_manager_send_mouse_motion(struct sc_input_manager *im,
+                                   const SDL_MouseMotionEvent *event) {
     struct sc_mouse_motion_event evt = {
         .position = sc_input_manager_get_position(im, event->x, event->y),
         .pointer_id = im->vfinger_down ? SC_POINTER_ID_GENERIC_FINGER
@@ -689,6 +730,92 @@ sc_input_manager_process_mouse_motion(struct sc_input_manager *im,
     }
 }
 
+static void
+sc_input_manager_flush_mouse_motion(struct sc_input_manager *im) {
+    if (im->motion_pending) {
+        sc_input_manager_send_mouse_motion(im, &im->pending_motion);
+        im->motion_pending = false;
+        im->last_motion_sent = sc_tick_now();
+    }
+}
+
+static void
+sc_input_manager_run_motion_flush(void *userdata) {
+    struct sc_input_manager *im = userdata;
+    im->motion_flush_scheduled = false;
+    sc_input_manager_flush_mouse_motion(im);
+}
+
+static Uint32
+sc_input_manager_on_motion_timer(Uint32 interval, void *userdata) {
+    (void) interval;
+
+    // Called from the SDL timer thread
+    bool ok = sc_post_to_main_thread(sc_input_manager_run_motion_flush,
+                                     userdata);
+    if (!ok) {
+        LOGD("Could not post mouse motion flush");
+    }
+
+    return 0; // do not repeat
+}
+
+static void
+sc_input_manager_process_mouse_motion(struct sc_input_manager *im,
+                                      const SDL_MouseMotionEvent *event) {
+    if (event->which == SDL_TOUCH_MOUSEID) {
+        // simulated from touch events, so it's a duplicate
+        return;
+    }
+
+    if (!im->mouse_motion_interval) {
+        sc_input_manager_send_mouse_motion(im, event);
+        return;
+    }
+
+    if (im->motion_pending) {
+        int32_t xrel = im->pending_motion.xrel + event->xrel;
+        int32_t yrel = im->pending_motion.yrel + event->yrel;
+        if (!im->mp->relative_mode || (abs(xrel) <= SC_MOUSE_MOTION_MAX_REL
+                                    && abs(yrel) <= SC_MOUSE_MOTION_MAX_REL)) {
+            // Merge: the last position, the accumulated relative motion
+            im->pending_motion = *event;
+            im->pending_motion.xrel = xrel;
+            im->pending_motion.yrel = yrel;
+            return;
+        }
+
+        // The accumulated motion would be truncated, send it now
+        sc_input_manager_flush_mouse_motion(im);
+    }
+
+    sc_tick now = sc_tick_now();
+    sc_tick next = im->last_motion_sent + im->mouse_motion_interval;
+    if (now >= next) {
+        // The first motion after a pause is not delayed
+        sc_input_manager_send_mouse_motion(im, event);
+        im->last_motion_sent = now;
+        return;
+    }
+
+    im->pending_motion = *event;
+    im->motion_pending = true;
+
+    if (!im->motion_flush_scheduled) {
+        // Round up, so that the flush is never too early
+        Uint32 delay_ms = (Uint32) SC_TICK_TO_MS(next - now + 999);
+        SDL_TimerID id = SDL_AddTimer(delay_ms,
+                                      sc_input_manager_on_motion_timer, im);
+        if (id) {
+            im->motion_flush_scheduled = true;
+        } else {
+            LOGW("Could not schedule mouse motion flush: %s",
+                 SDL_GetError());
+            sc_input_manager_flush_mouse_motion(im);
+        }
+    }
+}
+
 static void
 sc_input_manager_process_touch(struct sc_input_manager *im,
                                const SDL_TouchFingerEvent *event) {
@@ -1027,6 +1154,12 @@ sc_input_manager_handle_event(struct sc_input_manager *im,
                               const SDL_Event *event) {
     bool control = im->controller;
     bool paused = im->screen->paused;
+
+    if (im->motion_pending && event->type != SDL_MOUSEMOTION) {
+        // Preserve the order of the mouse motion and the other input events
+        sc_input_manager_flush_mouse_motion(im);
+    }
+
     switch (event->type) {
         case SDL_TEXTINPUT:
             if (!im->kp || paused) {
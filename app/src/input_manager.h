@@ -11,9 +11,12 @@
 #include "file_pusher.h"
 #include "fps_counter.h"
 #include "options.h"
+#include "remap_reloader.h"
 #include "trait/gamepad_processor.h"
 #include "trait/key_processor.h"
 #include "trait/mouse_processor.h"
+#include "util/tick.h"
+#include "video_reconfigurer.h"
 
 struct sc_input_manager {
     struct sc_controller *controller;
@@ -23,6 +26,9 @@ struct sc_input_manager {
     struct sc_key_processor *kp;
     struct sc_mouse_processor *mp;
     struct sc_gamepad_processor *gp;
+    struct sc_remap_reloader *remap_reloader; // may be NULL
+    struct sc_video_reconfigurer *video_reconfigurer; // may be NULL
+    bool capture_trigger; // MOD+t triggers the capture
 
     struct sc_mouse_bindings mouse_bindings;
     bool legacy_paste;
@@ -36,6 +42,15 @@ struct sc_input_manager {
 
     uint8_t mouse_buttons_state; // OR of enum sc_mouse_button values
 
+    // Mouse motion coalescing, if mouse_motion_interval is not 0: the motion
+    // events received less than mouse_motion_interval after the last one sent
+    // are merged into pending_motion (relative motions are accumulated)
+    sc_tick mouse_motion_interval;
+    sc_tick last_motion_sent;
+    bool motion_pending;
+    bool motion_flush_scheduled;
+    SDL_MouseMotionEvent pending_motion;
+
     // Tracks the number of identical consecutive shortcut key down events.
     // Not to be confused with event->repeat, which counts the number of
     // system-generated repeated key presses.
@@ -53,11 +68,15 @@ struct sc_input_manager_params {
     struct sc_key_processor *kp;
     struct sc_mouse_processor *mp;
     struct sc_gamepad_processor *gp;
+    struct sc_remap_reloader *remap_reloader; // may be NULL
+    struct sc_video_reconfigurer *video_reconfigurer; // may be NULL
+    bool capture_trigger; // --save-frames-pre-trigger
 
     struct sc_mouse_bindings mouse_bindings;
     bool legacy_paste;
     bool clipboard_autosync;
     uint8_t shortcut_mods; // OR of enum sc_shortcut_mod values
+    sc_tick mouse_motion_interval; // 0 to send every mouse motion
 };
 
 void
@@ -0,0 +1,298 @@
+#include "latency_probe.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+#include <libavutil/frame.h>
+
+#include "util/log.h"
+#include "util/thread.h"
+
+// Width of the bins of the histogram printed on exit
+#define SC_LATENCY_PROBE_REPORT_BIN_MS 10
+// Width of the bars of the histogram printed on exit
+#define SC_LATENCY_PROBE_REPORT_BAR 40
+
+struct sc_latency_probe_histogram {
+    uint32_t buckets[SC_LATENCY_PROBE_BUCKETS];
+    uint32_t count;
+    sc_tick max;
+};
+
+static struct {
+    // Written once before the window is rendered and the frames are measured
+    bool enabled;
+    struct sc_latency_probe_region region;
+
+    sc_mutex mutex;
+
+    // The following fields are protected by the mutex
+    bool has_code;
+    uint16_t last_code;
+    uint64_t undecoded; // frames without a readable pattern
+    // Reset on every report
+    struct sc_latency_probe_histogram interval;
+    // Since the start
+    struct sc_latency_probe_histogram total;
+    sc_tick next_report;
+} probe;
+
+static void
+histogram_add(struct sc_latency_probe_histogram *h, sc_tick latency) {
+    sc_tick index = SC_TICK_TO_US(latency) / SC_LATENCY_PROBE_BUCKET_US;
+    if (index >= SC_LATENCY_PROBE_BUCKETS) {
+        index = SC_LATENCY_PROBE_BUCKETS - 1;
+    }
+    ++h->buckets[index];
+    ++h->count;
+    if (latency > h->max) {
+        h->max = latency;
+    }
+}
+
+static double
+histogram_percentile_ms(const struct sc_latency_probe_histogram *h,
+                        unsigned p) {
+    assert(h->count);
+    // Nearest-rank, the upper bound of the bucket
+    uint64_t rank = ((uint64_t) p * h->count + 99) / 100;
+    uint64_t cumulated = 0;
+    for (unsigned i = 0; i < SC_LATENCY_PROBE_BUCKETS - 1; ++i) {
+        cumulated += h->buckets[i];
+        if (cumulated >= rank) {
+            sc_tick bound =
+                SC_TICK_FROM_US((i + 1) * SC_LATENCY_PROBE_BUCKET_US);
+            return SC_TICK_TO_US(MIN(bound, h->max)) / 1000.;
+        }
+    }
+    // In the overflow bucket
+    return SC_TICK_TO_US(h->max) / 1000.;
+}
+
+static void
+histogram_log_summary(const struct sc_latency_probe_histogram *h,
+                      const char *label) {
+    LOGI("%s glass-to-glass latency (p50/p95/p99/max ms): "
+         "%.1f/%.1f/%.1f/%.1f (%" PRIu32 " samples)", label,
+         histogram_percentile_ms(h, 50), histogram_percentile_ms(h, 95),
+         histogram_percentile_ms(h, 99), SC_TICK_TO_US(h->max) / 1000.,
+         h->count);
+}
+
+static void
+histogram_log_bins(const struct sc_latency_probe_histogram *h) {
+    static_assert(SC_LATENCY_PROBE_BUCKET_US == 1000, "1 ms buckets");
+    static_assert(SC_LATENCY_PROBE_BUCKETS % SC_LATENCY_PROBE_REPORT_BIN_MS
+                    == 0, "whole bins");
+
+    uint32_t bins[SC_LATENCY_PROBE_BUCKETS / SC_LATENCY_PROBE_REPORT_BIN_MS];
+    uint32_t max_bin = 0;
+    unsigned first = ARRAY_LEN(bins);
+    unsigned last = 0;
+    for (unsigned i = 0; i < ARRAY_LEN(bins); ++i) {
+        uint32_t n = 0;
+        for (unsigned j = 0; j < SC_LATENCY_PROBE_REPORT_BIN_MS; ++j) {
+            n += h->buckets[i * SC_LATENCY_PROBE_REPORT_BIN_MS + j];
+        }
+        bins[i] = n;
+        if (n) {
+            max_bin = MAX(max_bin, n);
+            first = MIN(first, i);
+            last = i;
+        }
+    }
+    assert(max_bin);
+
+    for (unsigned i = first; i <= last; ++i) {
+        char bar[SC_LATENCY_PROBE_REPORT_BAR + 1];
+        unsigned len = (uint64_t) bins[i] * SC_LATENCY_PROBE_REPORT_BAR
+                     / max_bin;
+        if (bins[i] && !len) {
+            len = 1;
+        }
+        memset(bar, '#', len);
+        bar[len] = '\0';
+
+        unsigned from = i * SC_LATENCY_PROBE_REPORT_BIN_MS;
+        if (i == ARRAY_LEN(bins) - 1) {
+            // The last bucket counts all the latencies above the range
+            LOGI("  >=%4u ms: %8" PRIu32 " %s", from, bins[i], bar);
+        } else {
+            LOGI("  %4u-%4u ms: %8" PRIu32 " %s", from,
+                 from + SC_LATENCY_PROBE_REPORT_BIN_MS, bins[i], bar);
+        }
+    }
+}
+
+bool
+sc_latency_probe_init(const struct sc_latency_probe_region *region) {
+    assert(!probe.enabled);
+    assert(region->width && region->height);
+
+    bool ok = sc_mutex_init(&probe.mutex);
+    if (!ok) {
+        return false;
+    }
+
+    probe.region = *region;
+    probe.has_code = false;
+    probe.undecoded = 0;
+    memset(&probe.interval, 0, sizeof(probe.interval));
+    memset(&probe.total, 0, sizeof(probe.total));
+    probe.next_report = sc_tick_now() + SC_LATENCY_PROBE_INTERVAL;
+    probe.enabled = true;
+
+    return true;
+}
+
+void
+sc_latency_probe_destroy(void) {
+    if (!probe.enabled) {
+        return;
+    }
+
+    if (probe.total.count) {
+        histogram_log_summary(&probe.total, "Total");
+        histogram_log_bins(&probe.total);
+    } else {
+        LOGW("Latency probe: no pattern decoded (check the region)");
+    }
+    if (probe.undecoded) {
+        LOGI("Latency probe: %" PRIu64 " frames without a readable pattern",
+             probe.undecoded);
+    }
+
+    sc_mutex_destroy(&probe.mutex);
+    probe.enabled = false;
+}
+
+bool
+sc_latency_probe_is_enabled(void) {
+    return probe.enabled;
+}
+
+uint16_t
+sc_latency_probe_encode(sc_tick time) {
+    uint16_t ms = SC_TICK_TO_MS(time);
+    // Gray code: consecutive values differ by a single bit
+    return ms ^ (ms >> 1);
+}
+
+static uint16_t
+gray_decode(uint16_t code) {
+    code ^= code >> 1;
+    code ^= code >> 2;
+    code ^= code >> 4;
+    code ^= code >> 8;
+    return code;
+}
+
+// Mean luma of the central part of a cell
+static unsigned
+sample_cell(const uint8_t *y, int linesize, int x, int top, int w, int h) {
+    int x0 = x + w / 4;
+    int x1 = MAX(x + w * 3 / 4, x0 + 1);
+    int y0 = top + h / 4;
+    int y1 = MAX(top + h * 3 / 4, y0 + 1);
+
+    unsigned sum = 0;
+    for (int row = y0; row < y1; ++row) {
+        const uint8_t *line = y + (size_t) row * linesize;
+        for (int col = x0; col < x1; ++col) {
+            sum += line[col];
+        }
+    }
+    return sum / ((x1 - x0) * (y1 - y0));
+}
+
+bool
+sc_latency_probe_decode(const uint8_t *y, int linesize, int width, int height,
+                        const struct sc_latency_probe_region *region,
+                        uint16_t *code) {
+    if (region->width < SC_LATENCY_PROBE_CELLS
+            || region->x + region->width > width
+            || region->y + region->height > height) {
+        return false;
+    }
+
+    unsigned samples[SC_LATENCY_PROBE_CELLS];
+    for (unsigned i = 0; i < SC_LATENCY_PROBE_CELLS; ++i) {
+        int x0 = region->x + region->width * i / SC_LATENCY_PROBE_CELLS;
+        int x1 = region->x + region->width * (i + 1) / SC_LATENCY_PROBE_CELLS;
+        samples[i] = sample_cell(y, linesize, x0, region->y, x1 - x0,
+                                 region->height);
+    }
+
+    unsigned white = samples[0];
+    unsigned black = samples[SC_LATENCY_PROBE_CELLS - 1];
+    if (white < black + SC_LATENCY_PROBE_MIN_CONTRAST) {
+        return false;
+    }
+
+    unsigned threshold = (white + black) / 2;
+    uint16_t value = 0;
+    for (unsigned i = 1; i <= SC_LATENCY_PROBE_BITS; ++i) {
+        value = (value << 1) | (samples[i] > threshold);
+    }
+
+    *code = value;
+    return true;
+}
+
+sc_tick
+sc_latency_probe_get_latency(uint16_t code, sc_tick now) {
+    uint16_t drawn_ms = gray_decode(code);
+    uint16_t now_ms = SC_TICK_TO_MS(now);
+    // Modulo 2^16
+    uint16_t elapsed_ms = now_ms - drawn_ms;
+    return SC_TICK_FROM_MS((sc_tick) elapsed_ms);
+}
+
+void
+sc_latency_probe_measure(const AVFrame *frame) {
+    assert(probe.enabled);
+
+    if (frame->format != AV_PIX_FMT_YUV420P
+            && frame->format != AV_PIX_FMT_NV12) {
+        return;
+    }
+
+    sc_tick now = sc_tick_now();
+
+    uint16_t code;
+    bool decoded = sc_latency_probe_decode(frame->data[0], frame->linesize[0],
+                                           frame->width, frame->height,
+                                           &probe.region, &code);
+    sc_tick latency = decoded ? sc_latency_probe_get_latency(code, now) : 0;
+
+    bool report = false;
+    struct sc_latency_probe_histogram interval;
+
+    sc_mutex_lock(&probe.mutex);
+
+    if (!decoded || latency > SC_LATENCY_PROBE_MAX_LATENCY) {
+        ++probe.undecoded;
+    } else if (!probe.has_code || code != probe.last_code) {
+        // Only the first frame capturing a code measures the latency (the
+        // next ones capture a pattern which has not been redrawn yet)
+        probe.has_code = true;
+        probe.last_code = code;
+        histogram_add(&probe.interval, latency);
+        histogram_add(&probe.total, latency);
+    }
+
+    if (now >= probe.next_report) {
+        if (probe.interval.count) {
+            interval = probe.interval;
+            report = true;
+        }
+        memset(&probe.interval, 0, sizeof(probe.interval));
+        probe.next_report = now + SC_LATENCY_PROBE_INTERVAL;
+    }
+
+    sc_mutex_unlock(&probe.mutex);
+
+    if (report) {
+        histogram_log_summary(&interval, "Last second");
+    }
+}
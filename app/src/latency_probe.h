@@ -0,0 +1,110 @@
+#ifndef SC_LATENCY_PROBE_H
+#define SC_LATENCY_PROBE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "options.h"
+#include "util/tick.h"
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+
+// Bits of the time code (in milliseconds, so it wraps every 65 seconds)
+#define SC_LATENCY_PROBE_BITS 16
+// The bits, between a white and a black guard cell
+#define SC_LATENCY_PROBE_CELLS (SC_LATENCY_PROBE_BITS + 2)
+// Size of the cells drawn in the window (smaller if the window is too narrow)
+#define SC_LATENCY_PROBE_CELL_SIZE 24
+// Minimal difference of luma between the guard cells for a pattern to be
+// decoded
+#define SC_LATENCY_PROBE_MIN_CONTRAST 48
+// The latencies above are considered as decoding errors
+#define SC_LATENCY_PROBE_MAX_LATENCY SC_TICK_FROM_SEC(10)
+
+// Interval between the latency reports
+#define SC_LATENCY_PROBE_INTERVAL SC_TICK_FROM_SEC(1)
+// Resolution and range of the histogram (the last bucket counts all the
+// latencies above the range)
+#define SC_LATENCY_PROBE_BUCKET_US 1000
+#define SC_LATENCY_PROBE_BUCKETS 1000 // 1 s
+
+/**
+ * Glass-to-glass latency measurement (--latency-probe)
+ *
+ * The window draws, in its bottom-left corner, a strip of black and white
+ * cells encoding the time it is presented (in milliseconds, Gray-coded so
+ * that a capture during a transition is off by at most one millisecond). The
+ * headset captures it back (through its cameras, or its display if the
+ * window is mirrored in the headset), and the video processor decodes it from
+ * the Y plane of the frames, in the region where the pattern appears.
+ *
+ * The difference with the decoding time is the full latency of the loop:
+ * presentation on the computer, capture, encoding, network and decoding.
+ * The latencies are summarized (p50/p95/p99/max) every
+ * SC_LATENCY_PROBE_INTERVAL, and their histogram is printed on exit.
+ *
+ * The pattern is redrawn on every render of the window, i.e. on every new
+ * frame: it is only measured on the first frame capturing each code.
+ *
+ * The probe is global (a single window draws the pattern).
+ */
+
+/**
+ * Enable the latency probe, decoding the pattern in `region` of the frames
+ *
+ * Must be called from the main thread, before the window is rendered and any
+ * frame is measured.
+ */
+bool
+sc_latency_probe_init(const struct sc_latency_probe_region *region);
+
+/**
+ * Print the histogram of the latencies
+ *
+ * All the threads measuring the frames must be joined.
+ */
+void
+sc_latency_probe_destroy(void);
+
+bool
+sc_latency_probe_is_enabled(void);
+
+/**
+ * Return the code to draw at the given time
+ *
+ * The cell i (from the left, after the white guard) is white if the bit
+ * (SC_LATENCY_PROBE_BITS - 1 - i) of the code is set.
+ */
+uint16_t
+sc_latency_probe_encode(sc_tick time);
+
+/**
+ * Decode the code drawn in `region` of a Y plane
+ *
+ * Return false if no pattern is found (e.g. not enough contrast).
+ */
+bool
+sc_latency_probe_decode(const uint8_t *y, int linesize, int width, int height,
+                        const struct sc_latency_probe_region *region,
+                        uint16_t *code);
+
+/**
+ * Return the time elapsed between the drawing of `code` and `now` (the code
+ * wraps, so it must have been drawn less than 65 seconds ago)
+ */
+sc_tick
+sc_latency_probe_get_latency(uint16_t code, sc_tick now);
+
+/**
+ * Decode the pattern from a decoded frame (YUV420P or NV12), and record the
+ * latency
+ *
+ * This may be called from any thread.
+ */
+void
+sc_latency_probe_measure(const AVFrame *frame);
+
+#endif
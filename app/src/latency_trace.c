@@ -0,0 +1,296 @@
+#include "latency_trace.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <libavutil/avutil.h>
+
+#include "metrics.h"
+#include "util/log.h"
+#include "util/thread.h"
+
+struct sc_latency_histogram {
+    uint32_t buckets[SC_LATENCY_TRACE_BUCKETS];
+    uint32_t count;
+    sc_tick max;
+};
+
+struct sc_latency_frame {
+    int64_t pts;
+    sc_tick stamps[SC_LATENCY_STAGE_COUNT]; // 0 if not stamped
+};
+
+struct sc_latency_summary {
+    uint32_t count;
+    sc_tick p50;
+    sc_tick p95;
+    sc_tick p99;
+    sc_tick max;
+};
+
+static const char *const stage_names[] = {
+    [SC_LATENCY_STAGE_RECV] = "recv",
+    [SC_LATENCY_STAGE_DECODE] = "decode",
+    [SC_LATENCY_STAGE_PREPROCESS] = "preprocess",
+    [SC_LATENCY_STAGE_DISPLAY] = "display",
+    [SC_LATENCY_STAGE_PRESENT] = "present",
+    [SC_LATENCY_STAGE_OUTPUT] = "output",
+};
+
+// The gauge of the last duration of each stage (the first one is unused)
+static const enum sc_metric stage_metrics[] = {
+    [SC_LATENCY_STAGE_RECV] = SC_METRIC_COUNT,
+    [SC_LATENCY_STAGE_DECODE] = SC_METRIC_DECODE_LATENCY_US,
+    [SC_LATENCY_STAGE_PREPROCESS] = SC_METRIC_PREPROCESS_LATENCY_US,
+    [SC_LATENCY_STAGE_DISPLAY] = SC_METRIC_DISPLAY_LATENCY_US,
+    [SC_LATENCY_STAGE_PRESENT] = SC_METRIC_PRESENT_LATENCY_US,
+    [SC_LATENCY_STAGE_OUTPUT] = SC_METRIC_OUTPUT_LATENCY_US,
+};
+
+static_assert(ARRAY_LEN(stage_metrics) == SC_LATENCY_STAGE_COUNT,
+              "missing stage metrics");
+
+static struct {
+    // Written once before the stamps
+    bool enabled;
+    bool print;
+
+    sc_mutex mutex;
+
+    // The following fields are protected by the mutex
+    struct sc_latency_frame frames[SC_LATENCY_TRACE_FRAMES];
+    unsigned head; // index of the next frame
+    unsigned count;
+
+    // The duration since SC_LATENCY_STAGE_RECV (the first histogram is
+    // unused)
+    struct sc_latency_histogram histograms[SC_LATENCY_STAGE_COUNT];
+    sc_tick next_report;
+
+    FILE *file; // Chrome trace file, NULL if disabled
+    sc_tick start;
+    bool first_event;
+} trace;
+
+static void
+histogram_add(struct sc_latency_histogram *h, sc_tick duration) {
+    sc_tick index = SC_TICK_TO_US(duration) / SC_LATENCY_TRACE_BUCKET_US;
+    if (index < 0) {
+        index = 0;
+    } else if (index >= SC_LATENCY_TRACE_BUCKETS) {
+        index = SC_LATENCY_TRACE_BUCKETS - 1;
+    }
+    ++h->buckets[index];
+    ++h->count;
+    if (duration > h->max) {
+        h->max = duration;
+    }
+}
+
+static sc_tick
+histogram_percentile(const struct sc_latency_histogram *h, unsigned p) {
+    assert(h->count);
+    // Nearest-rank, the upper bound of the bucket
+    uint64_t rank = ((uint64_t) p * h->count + 99) / 100;
+    uint64_t cumulated = 0;
+    for (unsigned i = 0; i < SC_LATENCY_TRACE_BUCKETS - 1; ++i) {
+        cumulated += h->buckets[i];
+        if (cumulated >= rank) {
+            sc_tick bound =
+                SC_TICK_FROM_US((i + 1) * SC_LATENCY_TRACE_BUCKET_US);
+            return MIN(bound, h->max);
+        }
+    }
+    // In the overflow bucket
+    return h->max;
+}
+
+static void
+histogram_summarize(struct sc_latency_histogram *h,
+                    struct sc_latency_summary *summary) {
+    summary->count = h->count;
+    if (h->count) {
+        summary->p50 = histogram_percentile(h, 50);
+        summary->p95 = histogram_percentile(h, 95);
+        summary->p99 = histogram_percentile(h, 99);
+        summary->max = h->max;
+    }
+    memset(h, 0, sizeof(*h));
+}
+
+// Must be called with the mutex locked
+static void
+summarize(struct sc_latency_summary summaries[]) {
+    for (unsigned i = SC_LATENCY_STAGE_DECODE; i < SC_LATENCY_STAGE_COUNT;
+            ++i) {
+        histogram_summarize(&trace.histograms[i], &summaries[i]);
+    }
+}
+
+static void
+print_summaries(const struct sc_latency_summary summaries[]) {
+    char buf[512];
+    size_t len = 0;
+    for (unsigned i = SC_LATENCY_STAGE_DECODE; i < SC_LATENCY_STAGE_COUNT;
+            ++i) {
+        const struct sc_latency_summary *s = &summaries[i];
+        if (!s->count) {
+            continue;
+        }
+        int r = snprintf(buf + len, sizeof(buf) - len,
+                         "%s%s %.1f/%.1f/%.1f/%.1f", len ? ", " : "",
+                         stage_names[i], SC_TICK_TO_US(s->p50) / 1000.,
+                         SC_TICK_TO_US(s->p95) / 1000.,
+                         SC_TICK_TO_US(s->p99) / 1000.,
+                         SC_TICK_TO_US(s->max) / 1000.);
+        if (r < 0 || (size_t) r >= sizeof(buf) - len) {
+            break;
+        }
+        len += r;
+    }
+
+    if (len) {
+        LOGI("Latency since recv (p50/p95/p99/max ms): %s", buf);
+    }
+}
+
+// Must be called with the mutex locked
+static void
+write_event(enum sc_latency_stage stage, int64_t pts, sc_tick begin,
+            sc_tick end) {
+    // One track (tid) per stage
+    fprintf(trace.file,
+            "%s{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,"
+            "\"tid\":%d,\"ts\":%" PRItick ",\"dur\":%" PRItick ","
+            "\"args\":{\"pts\":%" PRIi64 "}}",
+            trace.first_event ? "" : ",\n", stage_names[stage], (int) stage,
+            SC_TICK_TO_US(begin - trace.start), SC_TICK_TO_US(end - begin),
+            pts);
+    trace.first_event = false;
+}
+
+bool
+sc_latency_trace_init(bool print, const char *trace_filename) {
+    assert(!trace.enabled);
+
+    bool ok = sc_mutex_init(&trace.mutex);
+    if (!ok) {
+        return false;
+    }
+
+    if (trace_filename) {
+        trace.file = fopen(trace_filename, "w");
+        if (!trace.file) {
+            LOGE("Could not open latency trace file: %s", trace_filename);
+            sc_mutex_destroy(&trace.mutex);
+            return false;
+        }
+        fputs("[\n", trace.file);
+        trace.first_event = true;
+    }
+
+    trace.print = print;
+    trace.head = 0;
+    trace.count = 0;
+    memset(trace.histograms, 0, sizeof(trace.histograms));
+    trace.start = sc_tick_now();
+    trace.next_report = trace.start + SC_LATENCY_TRACE_INTERVAL;
+    trace.enabled = true;
+
+    return true;
+}
+
+void
+sc_latency_trace_destroy(void) {
+    if (!trace.enabled) {
+        return;
+    }
+
+    if (trace.print) {
+        struct sc_latency_summary summaries[SC_LATENCY_STAGE_COUNT] = {0};
+        summarize(summaries);
+        print_summaries(summaries);
+    }
+
+    if (trace.file) {
+        fputs("\n]\n", trace.file);
+        if (fclose(trace.file)) {
+            LOGE("Could not write latency trace file");
+        }
+        trace.file = NULL;
+    }
+
+    sc_mutex_destroy(&trace.mutex);
+    trace.enabled = false;
+}
+
+static struct sc_latency_frame *
+find_frame(int64_t pts) {
+    // Search from the most recent frame
+    for (unsigned i = 1; i <= trace.count; ++i) {
+        unsigned index = (trace.head + SC_LATENCY_TRACE_FRAMES - i)
+                       % SC_LATENCY_TRACE_FRAMES;
+        if (trace.frames[index].pts == pts) {
+            return &trace.frames[index];
+        }
+    }
+    return NULL;
+}
+
+void
+sc_latency_trace_stamp(enum sc_latency_stage stage, int64_t pts) {
+    if (!trace.enabled || pts == AV_NOPTS_VALUE) {
+        return;
+    }
+
+    assert(stage < SC_LATENCY_STAGE_COUNT);
+    sc_tick now = sc_tick_now();
+
+    struct sc_latency_summary summaries[SC_LATENCY_STAGE_COUNT];
+    bool report = false;
+
+    sc_mutex_lock(&trace.mutex);
+
+    if (stage == SC_LATENCY_STAGE_RECV) {
+        struct sc_latency_frame *frame = &trace.frames[trace.head];
+        frame->pts = pts;
+        memset(frame->stamps, 0, sizeof(frame->stamps));
+        frame->stamps[SC_LATENCY_STAGE_RECV] = now;
+        trace.head = (trace.head + 1) % SC_LATENCY_TRACE_FRAMES;
+        if (trace.count < SC_LATENCY_TRACE_FRAMES) {
+            ++trace.count;
+        }
+
+        if (trace.print && now >= trace.next_report) {
+            summarize(summaries);
+            report = true;
+            trace.next_report = now + SC_LATENCY_TRACE_INTERVAL;
+        }
+    } else {
+        struct sc_latency_frame *frame = find_frame(pts);
+        // A frame is stamped only once per stage (the first output)
+        if (frame && !frame->stamps[stage]) {
+            frame->stamps[stage] = now;
+            sc_tick recv = frame->stamps[SC_LATENCY_STAGE_RECV];
+            histogram_add(&trace.histograms[stage], now - recv);
+            sc_metrics_set(stage_metrics[stage], SC_TICK_TO_US(now - recv));
+
+            if (trace.file) {
+                // The stage starts at the previous stage reached by the frame
+                unsigned prev = stage - 1;
+                while (!frame->stamps[prev]) {
+                    assert(prev);
+                    --prev;
+                }
+                write_event(stage, pts, frame->stamps[prev], now);
+            }
+        }
+    }
+
+    sc_mutex_unlock(&trace.mutex);
+
+    if (report) {
+        print_summaries(summaries);
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef SC_LATENCY_TRACE_H
+#define SC_LATENCY_TRACE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/tick.h"
+
+// Interval between the latency reports (--print-latency)
+#define SC_LATENCY_TRACE_INTERVAL SC_TICK_FROM_SEC(1)
+
+// Resolution and range of the histograms (the last bucket counts all the
+// durations above the range)
+#define SC_LATENCY_TRACE_BUCKET_US 100
+#define SC_LATENCY_TRACE_BUCKETS 2000 // 200 ms
+
+// Number of frames tracked at the same time (the stamps of older frames are
+// ignored)
+#define SC_LATENCY_TRACE_FRAMES 64
+
+enum sc_latency_stage {
+    SC_LATENCY_STAGE_RECV, // packet received from the socket (demuxer)
+    SC_LATENCY_STAGE_DECODE, // frame decoded (decoder)
+    SC_LATENCY_STAGE_PREPROCESS, // effects applied (video processor)
+    SC_LATENCY_STAGE_DISPLAY, // texture updated (screen)
+    SC_LATENCY_STAGE_PRESENT, // first presented (display)
+    SC_LATENCY_STAGE_OUTPUT, // frame piped, written to shm or queued to save
+    SC_LATENCY_STAGE_COUNT,
+};
+
+/**
+ * Trace the latency of the video frames through the client pipeline
+ * (--print-latency and --latency-trace)
+ *
+ * Each video frame, identified by its PTS, is stamped with sc_tick_now() at
+ * every stage it goes through. The duration since the reception of its packet
+ * is accumulated in a histogram per stage, summarized (p50/p95/p99/max) every
+ * SC_LATENCY_TRACE_INTERVAL. If a trace file is set, the duration of every
+ * stage of every frame is also written as a Chrome trace event (it can be
+ * loaded in chrome://tracing or Perfetto).
+ *
+ * The duration of the last frame reaching each stage is also set as a gauge
+ * of the metrics (read by the HUD of the window, see hud.h).
+ *
+ * The trace is global (the PTS identify the frames of a single device).
+ */
+
+/**
+ * Enable the latency trace
+ *
+ * Must be called before any stamp, from the main thread. The stamps are
+ * ignored if it is not called.
+ */
+bool
+sc_latency_trace_init(bool print, const char *trace_filename);
+
+/**
+ * Print the last summary and close the trace file
+ *
+ * All the threads stamping the frames must be joined.
+ */
+void
+sc_latency_trace_destroy(void);
+
+/**
+ * Stamp the frame identified by pts at the given stage
+ *
+ * A frame must be stamped at SC_LATENCY_STAGE_RECV first. This may be called
+ * from any thread.
+ */
+void
+sc_latency_trace_stamp(enum sc_latency_stage stage, int64_t pts);
+
+#endif
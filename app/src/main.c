@@ -2,18 +2,23 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <string.h>
 #include <unistd.h>
 #include <libavformat/avformat.h>
-#ifdef HAVE_V4L2
-# include <libavdevice/avdevice.h>
-#endif
 #define SDL_MAIN_HANDLED // avoid link error on Linux Windows Subsystem
 #include <SDL2/SDL.h>
 
+#include "capture_trigger.h"
 #include "cli.h"
+#include "frame_pipe.h"
+#include "memory_budget.h"
 #include "options.h"
+#include "pool_memory.h"
 #include "scrcpy.h"
+#include "scrcpy_multi.h"
+#include "scrcpy_replay.h"
 #include "usb/scrcpy_otg.h"
+#include "util/alloc_stats.h"
 #include "util/log.h"
 #include "util/net.h"
 #include "util/thread.h"
@@ -22,6 +27,8 @@
 #ifdef _WIN32
 #include <windows.h>
 #include "util/str.h"
+#else
+#include <signal.h>
 #endif
 
 static int
@@ -31,11 +38,13 @@ main_scrcpy(int argc, char *argv[]) {
     // even line buffering (setvbuf() with mode _IOLBF) is not sufficient
     setbuf(stdout, NULL);
     setbuf(stderr, NULL);
+#else
+    // A write to a pipe (the pipe output) whose reader has exited must fail
+    // with EPIPE, so that the output is disabled, instead of killing the
+    // process
+    signal(SIGPIPE, SIG_IGN);
 #endif
 
-    printf("scrcpy " SCRCPY_VERSION
-           " <https://github.com/Genymobile/scrcpy>\n");
-
     struct scrcpy_cli_args args = {
         .opts = scrcpy_options_default,
         .help = false,
@@ -54,6 +63,13 @@ main_scrcpy(int argc, char *argv[]) {
         goto end;
     }
 
+    // The banner must not be interleaved with the records piped to stdout
+    const char *target = args.opts.pipe_target;
+    bool pipe_stdout = (args.opts.pipe_output || args.opts.pipe_packets)
+                    && (!target || !strcmp(target, "fd:1"));
+    fprintf(pipe_stdout ? stderr : stdout, "scrcpy " SCRCPY_VERSION
+            " <https://github.com/Genymobile/scrcpy>\n");
+
     sc_set_log_level(args.opts.log_level);
 
     if (args.help) {
@@ -71,16 +87,14 @@ main_scrcpy(int argc, char *argv[]) {
     // The current thread is the main thread
     SC_MAIN_THREAD_ID = sc_thread_get_id();
 
+    // Before any thread is started (args outlives all of them)
+    sc_thread_set_policies(args.opts.thread_policies,
+                           args.opts.thread_policy_count);
+
 #ifdef SCRCPY_LAVF_REQUIRES_REGISTER_ALL
     av_register_all();
 #endif
 
-#ifdef HAVE_V4L2
-    if (args.opts.v4l2_device) {
-        avdevice_register_all();
-    }
-#endif
-
     if (!net_init()) {
         ret = SCRCPY_EXIT_FAILURE;
         goto end;
@@ -88,13 +102,58 @@ main_scrcpy(int argc, char *argv[]) {
 
     sc_log_configure();
 
+    if (!sc_alloc_stats_init()) {
+        ret = SCRCPY_EXIT_FAILURE;
+        goto end;
+    }
+
+    if (args.opts.pipe_target
+            && !sc_frame_pipe_open(args.opts.pipe_target,
+                                   args.opts.pipe_buffer_size)) {
+        sc_alloc_stats_destroy();
+        ret = SCRCPY_EXIT_FAILURE;
+        goto end;
+    }
+
+    if (args.opts.save_frames_pre_trigger) {
+        sc_capture_trigger_install();
+    }
+
+    if (args.opts.huge_pages) {
+        // Before any pool is used
+        sc_pool_memory_enable();
+    }
+
+    // Before any queue is used
+    sc_memory_budget_init((uint64_t) args.opts.memory_budget << 20);
+
+    if (args.opts.replay_filename) {
+        ret = scrcpy_replay(&args.opts);
+    } else if (args.opts.multi_device) {
+        ret = scrcpy_multi(&args.opts);
+    } else {
 #ifdef HAVE_USB
-    ret = args.opts.otg ? scrcpy_otg(&args.opts) : scrcpy(&args.opts);
+        ret = args.opts.otg ? scrcpy_otg(&args.opts) : scrcpy(&args.opts);
 #else
-    ret = scrcpy(&args.opts);
+        ret = scrcpy(&args.opts);
 #endif
+    }
+
+    if (args.opts.pipe_target) {
+        sc_frame_pipe_close();
+    }
+
+    if (args.opts.huge_pages) {
+        sc_pool_memory_print_stats();
+    }
+
+    sc_memory_budget_log();
+
+    sc_alloc_stats_destroy();
 
 end:
+    sc_log_destroy();
+
     if (args.pause_on_exit == SC_PAUSE_ON_EXIT_TRUE ||
             (args.pause_on_exit == SC_PAUSE_ON_EXIT_IF_ERROR &&
                 ret != SCRCPY_EXIT_SUCCESS)) {
@@ -0,0 +1,130 @@
+#include "memory_budget.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <libavutil/frame.h>
+
+#include "util/log.h"
+
+// Share of the budget (in percent) the total may reach for a push of each
+// class to be accepted, so that the lower classes are refused first
+static const unsigned class_shares[] = {
+    [SC_MEMORY_PREVIEW] = 50,
+    [SC_MEMORY_OUTPUT] = 70,
+    [SC_MEMORY_STREAM] = 85,
+    [SC_MEMORY_ARCHIVE] = 100,
+};
+
+static const char *const class_names[] = {
+    [SC_MEMORY_PREVIEW] = "preview",
+    [SC_MEMORY_OUTPUT] = "output",
+    [SC_MEMORY_STREAM] = "stream",
+    [SC_MEMORY_ARCHIVE] = "archive",
+};
+
+static_assert(ARRAY_LEN(class_shares) == SC_MEMORY_CLASS_COUNT,
+              "missing class shares");
+static_assert(ARRAY_LEN(class_names) == SC_MEMORY_CLASS_COUNT,
+              "missing class names");
+
+// Set once on init, then only read
+static uint64_t budget;
+static uint64_t limits[SC_MEMORY_CLASS_COUNT];
+
+static atomic_uint_least64_t total;
+static struct {
+    atomic_uint_least64_t used;
+    atomic_uint_least64_t peak;
+    atomic_uint_least64_t refused;
+} classes[SC_MEMORY_CLASS_COUNT];
+
+void
+sc_memory_budget_init(uint64_t bytes) {
+    budget = bytes;
+    for (unsigned i = 0; i < SC_MEMORY_CLASS_COUNT; ++i) {
+        limits[i] = budget / 100 * class_shares[i];
+    }
+}
+
+static void
+update_peak(atomic_uint_least64_t *peak, uint64_t value) {
+    uint64_t current = atomic_load_explicit(peak, memory_order_relaxed);
+    while (value > current
+            && !atomic_compare_exchange_weak_explicit(peak, &current, value,
+                                                     memory_order_relaxed,
+                                                     memory_order_relaxed)) {
+        // current has been reloaded
+    }
+}
+
+bool
+sc_memory_budget_acquire(enum sc_memory_class cls, uint64_t size) {
+    assert(cls < SC_MEMORY_CLASS_COUNT);
+
+    if (budget) {
+        // Reserve on the total only if it stays within the limit of the
+        // class, so that concurrent pushes never exceed it
+        uint64_t current = atomic_load_explicit(&total, memory_order_relaxed);
+        do {
+            if (current + size > limits[cls]) {
+                atomic_fetch_add_explicit(&classes[cls].refused, 1,
+                                          memory_order_relaxed);
+                return false;
+            }
+        } while (!atomic_compare_exchange_weak_explicit(&total, &current,
+                                                        current + size,
+                                                        memory_order_relaxed,
+                                                        memory_order_relaxed));
+    } else {
+        atomic_fetch_add_explicit(&total, size, memory_order_relaxed);
+    }
+
+    uint64_t used = atomic_fetch_add_explicit(&classes[cls].used, size,
+                                              memory_order_relaxed) + size;
+    update_peak(&classes[cls].peak, used);
+    return true;
+}
+
+void
+sc_memory_budget_release(enum sc_memory_class cls, uint64_t size) {
+    assert(cls < SC_MEMORY_CLASS_COUNT);
+    assert(atomic_load_explicit(&classes[cls].used, memory_order_relaxed)
+            >= size);
+    atomic_fetch_sub_explicit(&classes[cls].used, size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&total, size, memory_order_relaxed);
+}
+
+uint64_t
+sc_memory_budget_frame_size(const AVFrame *frame) {
+    uint64_t size = 0;
+    for (unsigned i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; ++i) {
+        size += frame->buf[i]->size;
+    }
+    return size;
+}
+
+void
+sc_memory_budget_log(void) {
+    for (unsigned i = 0; i < SC_MEMORY_CLASS_COUNT; ++i) {
+        uint64_t peak = atomic_load_explicit(&classes[i].peak,
+                                             memory_order_relaxed);
+        uint64_t refused = atomic_load_explicit(&classes[i].refused,
+                                                memory_order_relaxed);
+        if (!peak && !refused) {
+            continue;
+        }
+
+        if (refused) {
+            LOGW("Memory budget: %s queues peaked at %" PRIu64 " MiB, %"
+                 PRIu64 " pushes refused", class_names[i], peak >> 20,
+                 refused);
+        } else if (budget) {
+            LOGI("Memory budget: %s queues peaked at %" PRIu64 " MiB",
+                 class_names[i], peak >> 20);
+        } else {
+            LOGD("Memory: %s queues peaked at %" PRIu64 " MiB",
+                 class_names[i], peak >> 20);
+        }
+    }
+}
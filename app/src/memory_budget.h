@@ -0,0 +1,82 @@
+#ifndef SC_MEMORY_BUDGET_H
+#define SC_MEMORY_BUDGET_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+
+/**
+ * Global memory budget of the queues of the pipeline (--memory-budget)
+ *
+ * The queues holding references to frames or packets account here for the
+ * bytes of the buffers they keep alive, before taking the references (a
+ * reference held by a queue prevents its buffer from being reused, so the
+ * decoder or the demuxer allocates a new one). The occupancy is tracked
+ * centrally, for all the queues of all the devices.
+ *
+ * With a budget, the queues of each class may only grow while the total stays
+ * below the share of the budget of their class: as the total grows, the
+ * preview is refused first, and the archive last. A refused push follows the
+ * existing policy of the queue when it is full (drop the frame, or the packets
+ * until the next key frame).
+ *
+ * A buffer referenced by several queues is counted by each of them, so the
+ * total is an upper bound of the memory held.
+ *
+ * Without budget, the occupancy is still tracked (its peak is logged on exit),
+ * but never refused: each queue is only bounded by its own limit.
+ */
+
+enum sc_memory_class {
+    // Frames delayed for the display (--display-buffer)
+    SC_MEMORY_PREVIEW,
+    // Frames queued for the subscribers of the frame publisher
+    SC_MEMORY_OUTPUT,
+    // Packets queued for the recorder and the packet pipe
+    SC_MEMORY_STREAM,
+    // Frames queued for the frame writer, and its pre-trigger ring
+    SC_MEMORY_ARCHIVE,
+};
+
+#define SC_MEMORY_CLASS_COUNT 4
+
+/**
+ * Set the budget, in bytes (0 for unlimited)
+ *
+ * Must be called once, before any queue is used.
+ */
+void
+sc_memory_budget_init(uint64_t budget);
+
+/**
+ * Account for `size` more bytes held by a queue of the class (from any thread)
+ *
+ * Return false (and account for nothing) if the budget of the class is
+ * exceeded.
+ */
+bool
+sc_memory_budget_acquire(enum sc_memory_class cls, uint64_t size);
+
+/**
+ * Release the bytes acquired by sc_memory_budget_acquire()
+ */
+void
+sc_memory_budget_release(enum sc_memory_class cls, uint64_t size);
+
+/**
+ * Return the size of the buffers referenced by a frame
+ */
+uint64_t
+sc_memory_budget_frame_size(const AVFrame *frame);
+
+/**
+ * Log the peak occupancy of each class, and the pushes refused
+ */
+void
+sc_memory_budget_log(void);
+
+#endif
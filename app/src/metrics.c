@@ -0,0 +1,192 @@
+#include "metrics.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "util/log.h"
+#include "util/thread.h"
+
+// Size of a cache line on the supported platforms
+#define SC_METRICS_CACHE_LINE 64
+
+struct sc_metric_value {
+    // Alone on its cache line, so that the threads updating different metrics
+    // never invalidate each other
+    _Alignas(SC_METRICS_CACHE_LINE) atomic_int_least64_t value;
+};
+
+static const char *const metric_names[] = {
+    [SC_METRIC_RECV_BYTES] = "recv_bytes",
+    [SC_METRIC_DECODED_FRAMES] = "decoded_frames",
+    [SC_METRIC_DECODE_US] = "decode_us",
+    [SC_METRIC_SKIPPED_FRAMES] = "skipped_frames",
+    [SC_METRIC_DISPLAY_SKIPPED_FRAMES] = "display_skipped_frames",
+    [SC_METRIC_RENDERED_FRAMES] = "rendered_frames",
+    [SC_METRIC_PROCESSED_FRAMES] = "processed_frames",
+    [SC_METRIC_PREPROCESS_US] = "preprocess_us",
+    [SC_METRIC_PIPED_FRAMES] = "piped_frames",
+    [SC_METRIC_SAVED_FRAMES] = "saved_frames",
+    [SC_METRIC_WRITE_US] = "write_us",
+    [SC_METRIC_PROCESSOR_DROPPED_FRAMES] = "processor_dropped_frames",
+    [SC_METRIC_WRITER_DROPPED_FRAMES] = "writer_dropped_frames",
+    [SC_METRIC_STALE_FRAMES] = "stale_frames",
+    [SC_METRIC_STATIC_FRAMES] = "static_frames",
+    [SC_METRIC_PROCESSOR_QUEUE] = "processor_queue",
+    [SC_METRIC_WRITER_QUEUE] = "writer_queue",
+    [SC_METRIC_CLOCK_OFFSET_US] = "clock_offset_us",
+    [SC_METRIC_RTT_US] = "rtt_us",
+    [SC_METRIC_HID_LATENCY_US] = "hid_latency_us",
+    [SC_METRIC_AUDIO_LATENCY_US] = "audio_latency_us",
+    [SC_METRIC_DECODE_LATENCY_US] = "decode_latency_us",
+    [SC_METRIC_PREPROCESS_LATENCY_US] = "preprocess_latency_us",
+    [SC_METRIC_DISPLAY_LATENCY_US] = "display_latency_us",
+    [SC_METRIC_PRESENT_LATENCY_US] = "present_latency_us",
+    [SC_METRIC_OUTPUT_LATENCY_US] = "output_latency_us",
+};
+
+static_assert(ARRAY_LEN(metric_names) == SC_METRIC_COUNT,
+              "missing metric names");
+
+static struct sc_metric_value metrics[SC_METRIC_COUNT];
+
+static struct {
+    bool enabled;
+    FILE *file;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped; // protected by the mutex
+} output;
+
+void
+sc_metrics_add(enum sc_metric metric, int64_t value) {
+    assert(metric < SC_METRIC_COUNT);
+    atomic_fetch_add_explicit(&metrics[metric].value, value,
+                              memory_order_relaxed);
+}
+
+void
+sc_metrics_set(enum sc_metric metric, int64_t value) {
+    assert(metric < SC_METRIC_COUNT);
+    atomic_store_explicit(&metrics[metric].value, value, memory_order_relaxed);
+}
+
+int64_t
+sc_metrics_get(enum sc_metric metric) {
+    assert(metric < SC_METRIC_COUNT);
+    return atomic_load_explicit(&metrics[metric].value, memory_order_relaxed);
+}
+
+static bool
+write_snapshot(void) {
+    // The metrics are read one by one, the snapshot is not atomic
+    fprintf(output.file, "{\"time_ms\":%" PRItick,
+            SC_TICK_TO_MS(sc_tick_now_realtime()));
+    for (unsigned i = 0; i < SC_METRIC_COUNT; ++i) {
+        fprintf(output.file, ",\"%s\":%" PRIi64, metric_names[i],
+                sc_metrics_get(i));
+    }
+    fputs("}\n", output.file);
+
+    // A line is complete for the readers tailing the file
+    return !fflush(output.file);
+}
+
+static int
+run_metrics(void *data) {
+    (void) data;
+
+    sc_tick deadline = sc_tick_now() + SC_METRICS_INTERVAL;
+
+    sc_mutex_lock(&output.mutex);
+    for (;;) {
+        while (!output.stopped
+                && sc_cond_timedwait(&output.cond, &output.mutex, deadline)) {
+            // spurious wake-up
+        }
+
+        if (output.stopped) {
+            break;
+        }
+
+        sc_mutex_unlock(&output.mutex);
+        if (!write_snapshot()) {
+            LOGE("Could not write metrics, disabling metrics output");
+            return 0;
+        }
+        deadline += SC_METRICS_INTERVAL;
+        sc_mutex_lock(&output.mutex);
+    }
+    sc_mutex_unlock(&output.mutex);
+
+    // The last snapshot, on exit
+    write_snapshot();
+
+    return 0;
+}
+
+bool
+sc_metrics_init(const char *filename) {
+    assert(!output.enabled);
+
+    output.file = fopen(filename, "w");
+    if (!output.file) {
+        LOGE("Could not open metrics file: %s", filename);
+        return false;
+    }
+
+    bool ok = sc_mutex_init(&output.mutex);
+    if (!ok) {
+        goto error_close_file;
+    }
+
+    ok = sc_cond_init(&output.cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    output.stopped = false;
+
+    ok = sc_thread_create(&output.thread, run_metrics, "scrcpy-metrics", NULL);
+    if (!ok) {
+        LOGE("Could not start metrics thread");
+        goto error_destroy_cond;
+    }
+
+    output.enabled = true;
+    return true;
+
+error_destroy_cond:
+    sc_cond_destroy(&output.cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&output.mutex);
+error_close_file:
+    fclose(output.file);
+
+    return false;
+}
+
+void
+sc_metrics_destroy(void) {
+    if (!output.enabled) {
+        return;
+    }
+
+    sc_mutex_lock(&output.mutex);
+    output.stopped = true;
+    sc_cond_signal(&output.cond);
+    sc_mutex_unlock(&output.mutex);
+
+    sc_thread_join(&output.thread, NULL);
+
+    if (fclose(output.file)) {
+        LOGE("Could not write metrics file");
+    }
+
+    sc_cond_destroy(&output.cond);
+    sc_mutex_destroy(&output.mutex);
+    output.enabled = false;
+}
@@ -0,0 +1,103 @@
+#ifndef SC_METRICS_H
+#define SC_METRICS_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/tick.h"
+
+// Interval between the lines written to the metrics file
+#define SC_METRICS_INTERVAL SC_TICK_FROM_SEC(1)
+
+enum sc_metric {
+    // Counters (since the start)
+    SC_METRIC_RECV_BYTES, // video bytes received (demuxer)
+    SC_METRIC_DECODED_FRAMES, // video frames decoded (decoder)
+    SC_METRIC_DECODE_US, // total duration of the video decoding calls
+    // Frames dropped while waiting for a key frame after a loss (demuxer)
+    SC_METRIC_SKIPPED_FRAMES,
+    // Decoded frames replaced before being rendered (screen)
+    SC_METRIC_DISPLAY_SKIPPED_FRAMES,
+    SC_METRIC_RENDERED_FRAMES, // frames uploaded to the window (screen)
+    SC_METRIC_PROCESSED_FRAMES, // frames processed (video processor)
+    SC_METRIC_PREPROCESS_US, // total duration of the effects
+    SC_METRIC_PIPED_FRAMES, // frames written to the pipe
+    SC_METRIC_SAVED_FRAMES, // frames written to disk (frame writer)
+    SC_METRIC_WRITE_US, // total duration of the I/O threads writing frames
+    // Frames dropped because the video processor queue was full
+    SC_METRIC_PROCESSOR_DROPPED_FRAMES,
+    // Frames dropped because the frame writer queue was full
+    SC_METRIC_WRITER_DROPPED_FRAMES,
+    // Frames not displayed because they exceeded the latency budget
+    SC_METRIC_STALE_FRAMES,
+    // Frames not saved nor output because of the motion gate
+    SC_METRIC_STATIC_FRAMES,
+
+    // Gauges (last value)
+    SC_METRIC_PROCESSOR_QUEUE, // frames waiting in the video processor
+    SC_METRIC_WRITER_QUEUE, // frames waiting to be saved
+    SC_METRIC_CLOCK_OFFSET_US, // device clock - local clock (clock sync)
+    SC_METRIC_RTT_US, // round-trip time of the last clock sync ping
+    SC_METRIC_HID_LATENCY_US, // average injection latency of the AOA inputs
+    // Capture on the device to playback, measured on each compensation
+    // update of the audio player (requires clock sync)
+    SC_METRIC_AUDIO_LATENCY_US,
+    // Duration since the reception of the packet of the last frame reaching
+    // each stage (requires the latency trace)
+    SC_METRIC_DECODE_LATENCY_US,
+    SC_METRIC_PREPROCESS_LATENCY_US,
+    SC_METRIC_DISPLAY_LATENCY_US,
+    SC_METRIC_PRESENT_LATENCY_US,
+    SC_METRIC_OUTPUT_LATENCY_US,
+
+    SC_METRIC_COUNT,
+};
+
+/**
+ * Metrics of the capture pipeline, for unattended nodes (--metrics)
+ *
+ * Each metric is a 64-bit atomic, alone on its cache line, updated without
+ * lock by the threads of the pipeline (with relaxed ordering, so that the
+ * frame hot path never contends on them). If enabled, a thread writes a
+ * snapshot of all the metrics as a JSON line to a file every
+ * SC_METRICS_INTERVAL.
+ *
+ * The metrics are global (a single device). Updating them is always allowed,
+ * even if the output is not enabled.
+ */
+
+/**
+ * Start writing the metrics to the file
+ *
+ * Must be called from the main thread.
+ */
+bool
+sc_metrics_init(const char *filename);
+
+/**
+ * Write the last snapshot and close the file
+ */
+void
+sc_metrics_destroy(void);
+
+/**
+ * Add a value to a counter (from any thread)
+ */
+void
+sc_metrics_add(enum sc_metric metric, int64_t value);
+
+/**
+ * Set the value of a gauge (from any thread)
+ */
+void
+sc_metrics_set(enum sc_metric metric, int64_t value);
+
+/**
+ * Read the current value of a metric (from any thread)
+ */
+int64_t
+sc_metrics_get(enum sc_metric metric);
+
+#endif
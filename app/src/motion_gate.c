@@ -0,0 +1,90 @@
+#include "motion_gate.h"
+
+#include <stdlib.h>
+
+#include "util/log.h"
+#include "util/motion.h"
+
+void
+sc_motion_gate_init(struct sc_motion_gate *gate, float threshold) {
+    gate->threshold = threshold;
+    gate->thumbnail = NULL;
+    gate->reference = NULL;
+    gate->width = 0;
+    gate->height = 0;
+    gate->has_reference = false;
+}
+
+void
+sc_motion_gate_destroy(struct sc_motion_gate *gate) {
+    free(gate->thumbnail);
+    free(gate->reference);
+}
+
+void
+sc_motion_gate_reset(struct sc_motion_gate *gate) {
+    gate->has_reference = false;
+}
+
+static bool
+sc_motion_gate_resize(struct sc_motion_gate *gate, int width, int height) {
+    free(gate->thumbnail);
+    free(gate->reference);
+    gate->width = 0;
+    gate->height = 0;
+
+    size_t size = (size_t) width * height;
+    gate->thumbnail = malloc(size);
+    gate->reference = malloc(size);
+    if (!gate->thumbnail || !gate->reference) {
+        LOG_OOM();
+        free(gate->thumbnail);
+        free(gate->reference);
+        gate->thumbnail = NULL;
+        gate->reference = NULL;
+        return false;
+    }
+
+    gate->width = width;
+    gate->height = height;
+    return true;
+}
+
+bool
+sc_motion_gate_accept(struct sc_motion_gate *gate, const uint8_t *y,
+                      int linesize, int width, int height) {
+    if (gate->threshold <= 0) {
+        return true;
+    }
+
+    int thumb_width = width / SC_MOTION_SCALE;
+    int thumb_height = height / SC_MOTION_SCALE;
+    if (!thumb_width || !thumb_height) {
+        // Too small to be compared
+        return true;
+    }
+
+    if (thumb_width != gate->width || thumb_height != gate->height) {
+        gate->has_reference = false;
+        if (!sc_motion_gate_resize(gate, thumb_width, thumb_height)) {
+            return true;
+        }
+    }
+
+    sc_motion_downscale(y, linesize, width, height, gate->thumbnail);
+
+    size_t count = (size_t) thumb_width * thumb_height;
+    if (gate->has_reference) {
+        uint64_t sad = sc_motion_sad(gate->thumbnail, gate->reference, count);
+        if ((double) sad < (double) gate->threshold * count) {
+            return false;
+        }
+    }
+
+    // The thumbnail of this frame becomes the reference
+    uint8_t *reference = gate->reference;
+    gate->reference = gate->thumbnail;
+    gate->thumbnail = reference;
+    gate->has_reference = true;
+    return true;
+}
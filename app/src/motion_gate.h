@@ -0,0 +1,52 @@
+#ifndef SC_MOTION_GATE_H
+#define SC_MOTION_GATE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Motion gate, selecting the frames of an output which differ enough from the
+ * last frame selected (--motion-threshold), for static scenes
+ *
+ * The frames are compared on their Y plane downscaled by 4 in both directions
+ * (see sc_motion_downscale()): the metric is the mean absolute difference of
+ * the thumbnails, in luma levels. Comparing to the last frame selected (rather
+ * than to the previous frame) accumulates a slow drift until it exceeds the
+ * threshold.
+ *
+ * The first frame, and the first frame after a change of size or a reset, are
+ * always selected.
+ */
+struct sc_motion_gate {
+    float threshold; // 0 to select all the frames
+    // Thumbnails of the current frame and of the last frame selected
+    uint8_t *thumbnail;
+    uint8_t *reference;
+    int width; // of the thumbnails
+    int height;
+    bool has_reference;
+};
+
+void
+sc_motion_gate_init(struct sc_motion_gate *gate, float threshold);
+
+void
+sc_motion_gate_destroy(struct sc_motion_gate *gate);
+
+// Select the next frame unconditionally (e.g. after an interruption)
+void
+sc_motion_gate_reset(struct sc_motion_gate *gate);
+
+/**
+ * Return true if the frame (its Y plane) must be output
+ *
+ * On allocation failure, the frame is selected.
+ */
+bool
+sc_motion_gate_accept(struct sc_motion_gate *gate, const uint8_t *y,
+                      int linesize, int width, int height);
+
+#endif
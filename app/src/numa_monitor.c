@@ -0,0 +1,94 @@
+#include "numa_monitor.h"
+
+#include <inttypes.h>
+#include <libavutil/frame.h>
+
+#include "util/log.h"
+#include "util/numa.h"
+
+/** Downcast frame_sink to sc_numa_monitor */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_numa_monitor, frame_sink)
+
+static bool
+sc_numa_monitor_frame_sink_open(struct sc_frame_sink *sink,
+                                const AVCodecContext *ctx) {
+    (void) ctx;
+
+    struct sc_numa_monitor *monitor = DOWNCAST(sink);
+    monitor->next_sample = 0;
+    monitor->frames = 0;
+    monitor->bytes = 0;
+    monitor->samples = 0;
+    monitor->remote_memory = 0;
+    monitor->remote_cpu = 0;
+    return true;
+}
+
+static void
+sc_numa_monitor_frame_sink_close(struct sc_frame_sink *sink) {
+    struct sc_numa_monitor *monitor = DOWNCAST(sink);
+
+    if (!monitor->samples) {
+        return;
+    }
+
+    // Extrapolate the volume of the frames on another node from the samples
+    uint64_t remote_bytes =
+        monitor->bytes * monitor->remote_memory / monitor->samples;
+    LOGI("Demuxer '%s': NUMA node %u, frame memory off node in %u/%u "
+         "samples (~%" PRIu64 " MB of %" PRIu64 " frames crossing nodes), "
+         "decoder off node in %u/%u samples", monitor->name, monitor->node,
+         monitor->remote_memory, monitor->samples, remote_bytes >> 20,
+         monitor->frames, monitor->remote_cpu, monitor->samples);
+}
+
+static bool
+sc_numa_monitor_frame_sink_push(struct sc_frame_sink *sink,
+                                const AVFrame *frame) {
+    struct sc_numa_monitor *monitor = DOWNCAST(sink);
+
+    size_t size = 0;
+    for (unsigned i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; ++i) {
+        size += frame->buf[i]->size;
+    }
+    ++monitor->frames;
+    monitor->bytes += size;
+
+    sc_tick now = sc_tick_now();
+    if (now < monitor->next_sample) {
+        return true;
+    }
+    monitor->next_sample = now + SC_NUMA_MONITOR_INTERVAL;
+
+    int memory_node = sc_numa_get_memory_node(frame->data[0]);
+    int cpu_node = sc_numa_get_current_node();
+    if (memory_node < 0 || cpu_node < 0) {
+        // Unknown placement, not sampled
+        return true;
+    }
+
+    ++monitor->samples;
+    if ((unsigned) memory_node != monitor->node) {
+        ++monitor->remote_memory;
+    }
+    if ((unsigned) cpu_node != monitor->node) {
+        ++monitor->remote_cpu;
+    }
+
+    return true;
+}
+
+void
+sc_numa_monitor_init(struct sc_numa_monitor *monitor, const char *name,
+                     unsigned node) {
+    monitor->name = name;
+    monitor->node = node;
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = sc_numa_monitor_frame_sink_open,
+        .close = sc_numa_monitor_frame_sink_close,
+        .push = sc_numa_monitor_frame_sink_push,
+    };
+
+    monitor->frame_sink.ops = &ops;
+}
@@ -0,0 +1,43 @@
+#ifndef SC_NUMA_MONITOR_H
+#define SC_NUMA_MONITOR_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "trait/frame_sink.h"
+#include "util/tick.h"
+
+// Interval between two placement samples
+#define SC_NUMA_MONITOR_INTERVAL SC_TICK_FROM_SEC(1)
+
+/**
+ * Monitor of the NUMA placement of a stream bound to a node (--numa)
+ *
+ * Frame sink plugged to the decoder of a device. Once per
+ * SC_NUMA_MONITOR_INTERVAL, it samples the node of the memory backing the
+ * decoded frame and the node of the processor running the decoder. On close,
+ * it logs the share of the samples off the node, and the volume of frames
+ * crossing the nodes extrapolated from them.
+ */
+struct sc_numa_monitor {
+    struct sc_frame_sink frame_sink; // frame sink trait
+
+    const char *name; // must be statically allocated
+    unsigned node;
+
+    // Only accessed from the decoder thread
+    sc_tick next_sample;
+    uint64_t frames;
+    uint64_t bytes;
+    unsigned samples;
+    unsigned remote_memory; // samples with frame data on another node
+    unsigned remote_cpu; // samples with the decoder running on another node
+};
+
+void
+sc_numa_monitor_init(struct sc_numa_monitor *monitor, const char *name,
+                     unsigned node);
+
+#endif
@@ -1,11 +1,14 @@
 #include "options.h"
 
+#include "util/net.h"
+
 const struct scrcpy_options scrcpy_options_default = {
     .serial = NULL,
     .crop = NULL,
     .record_filename = NULL,
     .window_title = NULL,
     .push_target = NULL,
+    .push_workers = 2,
     .render_driver = NULL,
     .video_codec_options = NULL,
     .audio_codec_options = NULL,
@@ -17,6 +20,7 @@ const struct scrcpy_options scrcpy_options_default = {
     .camera_fps = 0,
     .log_level = SC_LOG_LEVEL_INFO,
     .video_codec = SC_CODEC_H264,
+    .video_codec_auto = false,
     .audio_codec = SC_CODEC_OPUS,
     .video_source = SC_VIDEO_SOURCE_DISPLAY,
     .audio_source = SC_AUDIO_SOURCE_AUTO,
@@ -45,11 +49,24 @@ const struct scrcpy_options scrcpy_options_default = {
     },
     .tunnel_host = 0,
     .tunnel_port = 0,
+    .direct_tcp_port = 0,
+    .video_transport = SC_VIDEO_TRANSPORT_TCP,
+    .video_fec = 0,
+    .video_send_buffer = 0,
+    .reconnect_timeout = 0,
+    .server_host = 0,
+    .server_port = 0,
+    .aggregator_host = 0,
+    .aggregator_port = 0,
+    .aggregator_node = NULL,
     .shortcut_mods = SC_SHORTCUT_MOD_LALT | SC_SHORTCUT_MOD_LSUPER,
     .max_size = 0,
     .video_bit_rate = 0,
     .audio_bit_rate = 0,
+    .audio_read_size = 0,
+    .audio_latency = SC_AUDIO_LATENCY_DEFAULT,
     .max_fps = NULL,
+    .video_preset_count = 0,
     .lock_video_orientation = SC_LOCK_VIDEO_ORIENTATION_UNLOCKED,
     .display_orientation = SC_ORIENTATION_0,
     .record_orientation = SC_ORIENTATION_0,
@@ -60,7 +77,7 @@ const struct scrcpy_options scrcpy_options_default = {
     .display_id = 0,
     .display_buffer = 0,
     .audio_buffer = -1, // depends on the audio format,
-    .audio_output_buffer = SC_TICK_FROM_MS(5),
+    .audio_output_buffer = -1, // depends on the audio latency
     .time_limit = 0,
 #ifdef HAVE_V4L2
     .v4l2_device = NULL,
@@ -99,6 +116,8 @@ const struct scrcpy_options scrcpy_options_default = {
     .require_audio = false,
     .kill_adb_on_close = false,
     .camera_high_speed = false,
+    .capture_exposure = false,
+    .timestamp_sei = false,
     .list = 0,
     .window = true,
     .mouse_hover = true,
@@ -108,6 +127,96 @@ const struct scrcpy_options scrcpy_options_default = {
     .opencv_enabled = false,
     .opencv_map_path = NULL,
     .pipe_output = false,
+    .pipe_target = NULL,
+    .pipe_buffer_size = 0,
+    .pipe_packets = false,
+    .pipe_features = false,
+    .save_frames_threads = 2,
+    .save_frames_format = SC_SAVE_FRAMES_FORMAT_PPM,
+    .save_frames_quality = 0,
+    .save_frames_io = SC_SAVE_FRAMES_IO_SYNC,
+    .save_frames_direct = false,
+    .save_frames_zstd = 0,
+    .save_frames_zstd_dict = NULL,
+    .save_frames_tile_delta = false,
+    .save_frames_tile_threshold = 0,
+    .save_frames_key_interval = 0,
+    .upload_dir = NULL,
+    .upload_threads = 4,
+    .upload_max_rate = 0,
+    .upload_delete = false,
+    .save_frames_pre_trigger = 0,
+    .save_frames_post_trigger = SC_TICK_FROM_SEC(10),
+    .save_frames_rate = {0},
+    .pipe_output_rate = {0},
+    .motion_threshold = 0,
+    .output_planes = SC_OUTPUT_PLANES_YUV,
+    .output_pyramid = 0,
+    .pipe_format = SC_PIPE_FORMAT_V1,
+    .pipe_payload_crc = false,
+    .publish_port = 0,
+    .publish_host = IPV4_LOCALHOST,
+    .publish_queue = 4,
+    .publish_drop = SC_PUBLISH_DROP_OLDEST,
+    .pipe_feedback_port = 0,
+    .pipe_feedback_host = IPV4_LOCALHOST,
+    .pipe_backpressure = SC_PIPE_BACKPRESSURE_DROP,
+    .frame_archive = NULL,
+    .shm_output = NULL,
+    .cuda_ipc_output = NULL,
+    .gpu_remap = false,
+    .gpu_readback = false,
+    .pbo_upload = true,
+    .render_thread = false,
+    .low_latency_present = false,
+    .async_sinks = false,
+    .stereo_view = SC_STEREO_VIEW_SIDE_BY_SIDE,
+    .device_remap = false,
+    .device_remap_crop = false,
+    .split_eyes = false,
+    .camera_record_filename = NULL,
+    .camera_record_format = SC_RECORD_FORMAT_AUTO,
+    .latency_profile = SC_LATENCY_PROFILE_DEFAULT,
+    .encoder_async = false,
+    .repeat_frame_delay = 100,
+    .skip_repeated_frames = false,
+    .server_daemon = false,
+    .mouse_motion_rate = 0,
+    .pose_rate = 0,
+    .opencv_backend = SC_OPENCV_BACKEND_CPU,
+    .preview_downscale = 1,
+    .hw_decoder = SC_HW_DECODER_NONE,
+    .decoder_threads = 1,
+    .decoder_mode = SC_DECODER_MODE_LOW_LATENCY,
+    .adaptive_bit_rate = false,
+    .multi_device = NULL,
+    .multi_device_sync = 0,
+    .numa = false,
+    .record_rectified = false,
+    .record_timestamps = false,
+    .record_segment = 0,
+    .record_fragmented = false,
+    .v4l2_device_left = NULL,
+    .v4l2_device_right = NULL,
+    .pipe_depth = false,
+    .pipe_audio = false,
+    .print_encoder_latency = false,
+    .print_latency = false,
+    .latency_probe = {0},
+    .latency_trace_filename = NULL,
+    .dump_stream_filename = NULL,
+    .replay_filename = NULL,
+    .replay_max_speed = false,
+    .metrics_filename = NULL,
+    .auto_tune = false,
+    .hud = false,
+    .preprocess_threads = 0,
+    .preprocess_cpus = 0,
+    .thread_policy_count = 0,
+    .huge_pages = false,
+    .memory_budget = 0,
+    .latency_budget = 0,
+    .catch_up = 0,
 };
 
 enum sc_orientation
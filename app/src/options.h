@@ -8,6 +8,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "util/thread.h"
 #include "util/tick.h"
 
 enum sc_log_level {
@@ -50,6 +51,9 @@ enum sc_codec {
     SC_CODEC_RAW,
 };
 
+// The video codecs: H.264, H.265 and AV1
+#define SC_VIDEO_CODEC_COUNT 3
+
 enum sc_video_source {
     SC_VIDEO_SOURCE_DISPLAY,
     SC_VIDEO_SOURCE_CAMERA,
@@ -69,6 +73,87 @@ enum sc_camera_facing {
     SC_CAMERA_FACING_EXTERNAL,
 };
 
+enum sc_pipe_format {
+    SC_PIPE_FORMAT_V1, // packed 32-byte header, contiguous planes
+    SC_PIPE_FORMAT_V2, // versioned header, aligned planes (see frame_header.h)
+};
+
+// Frames dropped for a subscriber of the publisher when its queue is full
+enum sc_publish_drop {
+    SC_PUBLISH_DROP_OLDEST, // the subscriber receives the most recent frames
+    SC_PUBLISH_DROP_NEWEST, // the queued frames are kept
+};
+
+// Frames piped when the consumer reports that it is late (--pipe-feedback)
+enum sc_pipe_backpressure {
+    SC_PIPE_BACKPRESSURE_DROP, // a drop record is written instead
+    SC_PIPE_BACKPRESSURE_LUMA, // only the Y plane, then a drop record
+};
+
+enum sc_save_frames_format {
+    SC_SAVE_FRAMES_FORMAT_PPM,
+    SC_SAVE_FRAMES_FORMAT_YUV, // raw YUV420P planes, without conversion
+    SC_SAVE_FRAMES_FORMAT_PNG,
+    SC_SAVE_FRAMES_FORMAT_QOI,
+    SC_SAVE_FRAMES_FORMAT_JPEG, // lossy, encoded from the YUV420P planes
+};
+
+// How the frames are written to the archive (--save-frames-io)
+enum sc_save_frames_io {
+    SC_SAVE_FRAMES_IO_SYNC, // blocking writes from each I/O thread
+    SC_SAVE_FRAMES_IO_URING, // batched io_uring writes (Linux)
+};
+
+// Subsampling of the frames of an output
+struct sc_output_rate {
+    unsigned fps; // maximum rate, 0 for all the frames
+    bool key_frames; // only the key frames
+};
+
+enum sc_output_planes {
+    SC_OUTPUT_PLANES_YUV,
+    SC_OUTPUT_PLANES_Y, // luma only, for the vision consumers
+};
+
+enum sc_opencv_backend {
+    SC_OPENCV_BACKEND_CPU,
+    SC_OPENCV_BACKEND_OPENCL, // OpenCV transparent API (cv::UMat)
+    SC_OPENCV_BACKEND_CUDA, // requires OpenCV built with CUDA
+};
+
+enum sc_hw_decoder {
+    SC_HW_DECODER_NONE, // software decoding
+    SC_HW_DECODER_AUTO, // the first available on the platform
+    SC_HW_DECODER_D3D11VA,
+    SC_HW_DECODER_VAAPI,
+    SC_HW_DECODER_VIDEOTOOLBOX,
+    SC_HW_DECODER_CUDA,
+};
+
+enum sc_decoder_mode {
+    SC_DECODER_MODE_LOW_LATENCY, // slice threading, no frame delay
+    SC_DECODER_MODE_THROUGHPUT, // frame threading, one frame delay per thread
+};
+
+enum sc_latency_profile {
+    SC_LATENCY_PROFILE_DEFAULT,
+    // Realtime encoder without B-frames nor periodic key frames (intra
+    // refresh), fast decoding
+    SC_LATENCY_PROFILE_ULTRA_LOW,
+};
+
+enum sc_audio_latency {
+    SC_AUDIO_LATENCY_DEFAULT,
+    // Realtime audio encoder, smaller client buffers compensated more
+    // reactively
+    SC_AUDIO_LATENCY_LOW,
+};
+
+enum sc_video_transport {
+    SC_VIDEO_TRANSPORT_TCP, // on the video socket
+    SC_VIDEO_TRANSPORT_UDP, // RTP datagrams, requires a direct connection
+};
+
                               // ,----- hflip (applied before the rotation)
                               // | ,--- 180°
                               // | | ,- 90° clockwise
@@ -130,6 +215,35 @@ sc_orientation_get_name(enum sc_orientation orientation) {
     }
 }
 
+// How the stereo frames (both eyes side by side) are displayed
+enum sc_stereo_view {
+    SC_STEREO_VIEW_SIDE_BY_SIDE, // as received
+    SC_STEREO_VIEW_LEFT,
+    SC_STEREO_VIEW_RIGHT,
+    SC_STEREO_VIEW_TOP_BOTTOM, // left eye above the right eye
+    SC_STEREO_VIEW_ANAGLYPH, // red (left eye) and cyan (right eye)
+};
+
+#define SC_STEREO_VIEW_COUNT 5
+
+static inline const char *
+sc_stereo_view_get_name(enum sc_stereo_view view) {
+    switch (view) {
+        case SC_STEREO_VIEW_SIDE_BY_SIDE:
+            return "side-by-side";
+        case SC_STEREO_VIEW_LEFT:
+            return "left";
+        case SC_STEREO_VIEW_RIGHT:
+            return "right";
+        case SC_STEREO_VIEW_TOP_BOTTOM:
+            return "top-bottom";
+        case SC_STEREO_VIEW_ANAGLYPH:
+            return "anaglyph";
+        default:
+            return "(unknown)";
+    }
+}
+
 enum sc_lock_video_orientation {
     SC_LOCK_VIDEO_ORIENTATION_UNLOCKED = -1,
     // lock the current orientation when scrcpy starts
@@ -215,14 +329,40 @@ struct sc_port_range {
     uint16_t last;
 };
 
+// Region of the captured frames where the latency probe pattern appears
+// (--latency-probe), in pixels, a width of 0 if disabled
+struct sc_latency_probe_region {
+    uint16_t width;
+    uint16_t height;
+    uint16_t x;
+    uint16_t y;
+};
+
+// Capture size and frame rate switched during the session (--video-presets),
+// 0 if unlimited
+struct sc_video_preset {
+    uint16_t max_size;
+    uint16_t max_fps;
+};
+
+#define SC_MAX_VIDEO_PRESETS 8
+
 #define SC_WINDOW_POSITION_UNDEFINED (-0x8000)
 
+// Maximum number of devices captured at once (--multi-device)
+#define SC_MAX_MULTI_DEVICES 8
+
+// Max number of threads with a scheduling policy (--thread-affinity,
+// --realtime-threads)
+#define SC_MAX_THREAD_POLICIES 16
+
 struct scrcpy_options {
     const char *serial;
     const char *crop;
     const char *record_filename;
     const char *window_title;
     const char *push_target;
+    unsigned push_workers;
     const char *render_driver;
     const char *video_codec_options;
     const char *audio_codec_options;
@@ -234,6 +374,9 @@ struct scrcpy_options {
     uint16_t camera_fps;
     enum sc_log_level log_level;
     enum sc_codec video_codec;
+    // Select the video codec at startup (see codec_probe.h), video_codec is
+    // then ignored
+    bool video_codec_auto;
     enum sc_codec audio_codec;
     enum sc_video_source video_source;
     enum sc_audio_source audio_source;
@@ -246,11 +389,30 @@ struct scrcpy_options {
     struct sc_port_range port_range;
     uint32_t tunnel_host;
     uint16_t tunnel_port;
+    uint16_t direct_tcp_port; // 0 to connect through the adb tunnel
+    // Address of a server already running (--server-address), port 0 if unset
+    uint32_t server_host;
+    uint16_t server_port;
+    // Address of the aggregator to forward the streams to (--aggregator), port
+    // 0 if unset
+    uint32_t aggregator_host;
+    uint16_t aggregator_port;
+    const char *aggregator_node; // NULL for the device serial
+    enum sc_video_transport video_transport;
+    uint8_t video_fec; // FEC group size of the UDP video packets, 0 if disabled
+    // Send buffer of the device video socket, in bytes, 0 for the default
+    uint32_t video_send_buffer;
+    // In milliseconds, 0 to end the session when the video connection is lost
+    uint16_t reconnect_timeout;
     uint8_t shortcut_mods; // OR of enum sc_shortcut_mod values
     uint16_t max_size;
     uint32_t video_bit_rate;
     uint32_t audio_bit_rate;
+    uint16_t audio_read_size; // in samples, 0 for the default
+    enum sc_audio_latency audio_latency;
     const char *max_fps; // float to be parsed by the server
+    struct sc_video_preset video_presets[SC_MAX_VIDEO_PRESETS];
+    unsigned video_preset_count;
     enum sc_lock_video_orientation lock_video_orientation;
     enum sc_orientation display_orientation;
     enum sc_orientation record_orientation;
@@ -300,12 +462,19 @@ struct scrcpy_options {
     bool require_audio;
     bool kill_adb_on_close;
     bool camera_high_speed;
+    // Send the exposure of the camera frames (--capture-exposure)
+    bool capture_exposure;
+    // Embed the capture timestamps in the video bitstream (--timestamp-sei)
+    bool timestamp_sei;
     bool opencv_enabled;
-    const char *opencv_map_path;  // Path to .npz file containing map_x and map_y
+    // Path to the dense maps (--opencv-map) or to the camera parameters
+    // (--opencv-calib)
+    const char *opencv_map_path;
 #define SC_OPTION_LIST_ENCODERS 0x1
 #define SC_OPTION_LIST_DISPLAYS 0x2
 #define SC_OPTION_LIST_CAMERAS 0x4
 #define SC_OPTION_LIST_CAMERA_SIZES 0x8
+#define SC_OPTION_PROBE_ENCODERS 0x10
     uint8_t list;
     bool window;
     bool mouse_hover;
@@ -313,8 +482,126 @@ struct scrcpy_options {
     const char *frame_dir;     // Directory to save frames
     bool save_frames;          // Whether to save frames
     bool pipe_output;          // Whether to pipe output to a pipe
+    bool pipe_packets;         // Pipe the encoded packets instead of frames
+    bool pipe_features;        // Pipe the features instead of frames
+    const char *pipe_target;   // Path or "fd:N" of the pipe output, or NULL
+    uint32_t pipe_buffer_size; // Pipe buffer size of the target, 0 for default
     bool show_timestamps;      // Whether to render timestamps on screen
     const char *adb_path;      // Path to adb executable
+    unsigned save_frames_threads; // Number of I/O threads saving frames
+    enum sc_save_frames_format save_frames_format;
+    unsigned save_frames_quality; // JPEG quality (1 to 100), 0 for default
+    enum sc_save_frames_io save_frames_io;
+    bool save_frames_direct; // Bypass the page cache (archive only)
+    int save_frames_zstd; // zstd level of the archived frames, 0 to disable
+    const char *save_frames_zstd_dict; // zstd dictionary file, or NULL
+    // Store the archived frames as tile deltas (see tile_delta.h)
+    bool save_frames_tile_delta;
+    float save_frames_tile_threshold; // mean absolute luma difference
+    // Frames stored per key frame, 0 for the default
+    unsigned save_frames_key_interval;
+    // Directory (network mount) to upload the finished files to, or NULL
+    const char *upload_dir;
+    unsigned upload_threads;
+    uint32_t upload_max_rate; // in bytes per second, 0 if unbounded
+    bool upload_delete; // Delete the local files once uploaded
+    // Duration of the frames held in memory until a trigger (0 to save the
+    // frames continuously), and of the capture after a trigger
+    sc_tick save_frames_pre_trigger;
+    sc_tick save_frames_post_trigger;
+    struct sc_output_rate save_frames_rate;
+    // Rate of the frames piped, shared and published
+    struct sc_output_rate pipe_output_rate;
+    // Minimal mean luma difference of the saved and output frames (0 to
+    // output all the frames)
+    float motion_threshold;
+    // Planes of the saved, piped, shared and published frames
+    enum sc_output_planes output_planes;
+    // Bitmask of the levels of the Y plane pyramid piped and shared (bit n for
+    // level n, 0 to disable)
+    uint8_t output_pyramid;
+    enum sc_pipe_format pipe_format;
+    bool pipe_payload_crc; // CRC-32C of the piped frame data (v2 only)
+    // Serve the pipe output over TCP to several subscribers (0 to disable)
+    uint16_t publish_port;
+    uint32_t publish_host; // IPv4 address to listen on
+    unsigned publish_queue; // frames queued per subscriber
+    enum sc_publish_drop publish_drop;
+    uint16_t pipe_feedback_port; // 0 to disable
+    uint32_t pipe_feedback_host; // IPv4 address to listen on
+    enum sc_pipe_backpressure pipe_backpressure;
+    const char *frame_archive; // Single file to save frames into
+    const char *shm_output; // Name of the shared memory ring of frames
+    // Name of the shared memory of the ring of frames on the GPU
+    const char *cuda_ipc_output;
+    bool gpu_remap; // Apply the stereo remap while rendering, on the GPU
+    bool gpu_readback; // Apply the stereo remap of the outputs on the GPU
+    bool pbo_upload; // Upload the frames through pixel buffer objects
+    bool render_thread; // Render from a dedicated thread
+    bool low_latency_present; // Synchronize each present explicitly
+    bool async_sinks; // Push the packets and frames to the sinks from threads
+    enum sc_stereo_view stereo_view;
+    bool device_remap; // Apply the stereo remap on the device, before encoding
+    bool device_remap_crop; // Encode only the valid region of the eyes
+    bool split_eyes; // Encode, stream and decode the eyes separately
+    // Also capture the camera (with the display), and record it to this file
+    const char *camera_record_filename;
+    enum sc_record_format camera_record_format; // guessed from the filename
+    enum sc_opencv_backend opencv_backend;
+    unsigned preview_downscale; // Downscale factor of the displayed frames
+    enum sc_hw_decoder hw_decoder;
+    unsigned decoder_threads; // 0 for one thread per CPU core
+    enum sc_decoder_mode decoder_mode;
+    enum sc_latency_profile latency_profile;
+    bool encoder_async; // Write the encoder output from a bounded queue
+    // Delay before the device encoder repeats the previous frame, in
+    // milliseconds (0 to never repeat it)
+    uint16_t repeat_frame_delay;
+    bool skip_repeated_frames;
+    bool server_daemon;
+    uint16_t mouse_motion_rate; // in Hz, 0 to forward every motion event
+    uint16_t pose_rate; // in Hz, 0 to not sample the headset pose
+    bool adaptive_bit_rate; // Adapt the video bit rate to the link throughput
+    // Comma-separated serials of the devices captured in parallel, NULL to
+    // capture a single device
+    const char *multi_device;
+    // Tolerance of the synchronization of the frames of all the devices
+    // (--multi-device), 0 if disabled
+    sc_tick multi_device_sync;
+    // Bind the pipeline of each device (--multi-device) to a NUMA node
+    bool numa;
+    // Record the processed (rectified) frames, re-encoded, instead of the
+    // device stream
+    bool record_rectified;
+    // Write the capture time of the recorded frames to "<record>.ts.idx"
+    bool record_timestamps;
+    // Split the recording into segments of this duration, 0 if disabled
+    sc_tick record_segment;
+    bool record_fragmented; // Write fragmented MP4
+    // v4l2loopback devices receiving the rectified left and right halves
+    const char *v4l2_device_left;
+    const char *v4l2_device_right;
+    bool pipe_depth; // Pipe the disparity maps after the frames
+    bool pipe_audio; // Pipe the decoded audio between the frames
+    bool print_encoder_latency;
+    bool print_latency;
+    const char *latency_trace_filename; // Chrome trace of the frame latency
+    struct sc_latency_probe_region latency_probe;
+    bool hud; // Draw the performance HUD over the video
+    const char *dump_stream_filename; // Raw video stream, for --replay
+    const char *replay_filename; // Replay a dump instead of a device
+    bool replay_max_speed;
+    const char *metrics_filename; // JSON lines of the pipeline metrics
+    bool auto_tune; // Resize the thread pools to the measured costs
+    unsigned preprocess_threads; // 0 for one thread per CPU core
+    uint64_t preprocess_cpus; // affinity mask of the processors, 0 if unset
+    // --thread-affinity and --realtime-threads, by thread name
+    struct sc_thread_policy thread_policies[SC_MAX_THREAD_POLICIES];
+    unsigned thread_policy_count;
+    bool huge_pages; // Frame and packet pools in locked huge pages
+    uint32_t memory_budget; // of the queues, in MiB, 0 if unbounded
+    sc_tick latency_budget; // max age of the displayed frames, 0 if unset
+    sc_tick catch_up; // max lag of the received video packets, 0 if unset
 };
 
 extern const struct scrcpy_options scrcpy_options_default;
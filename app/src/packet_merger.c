@@ -28,16 +28,16 @@ sc_packet_merger_merge(struct sc_packet_merger *merger, AVPacket *packet) {
         memcpy(merger->config, packet->data, packet->size);
         merger->config_size = packet->size;
     } else if (merger->config) {
-        size_t config_size = merger->config_size;
-        size_t media_size = packet->size;
-
-        if (av_grow_packet(packet, config_size)) {
+        // Only the (small) config is copied, the media packet is unchanged
+        uint8_t *extradata =
+            av_packet_new_side_data(packet, AV_PKT_DATA_NEW_EXTRADATA,
+                                    merger->config_size);
+        if (!extradata) {
             LOG_OOM();
             return false;
         }
 
-        memmove(packet->data + config_size, packet->data, media_size);
-        memcpy(packet->data, merger->config, config_size);
+        memcpy(extradata, merger->config, merger->config_size);
 
         free(merger->config);
         merger->config = NULL;
@@ -13,11 +13,14 @@
  * device orientation change).
  *
  * Every time a config packet is received, it must be sent alone (for recorder
- * extradata), then concatenated to the next media packet (for correct decoding
- * and recording).
+ * extradata), then passed with the next media packet (for correct decoding and
+ * recording).
  *
- * This helper reads every input packet and modifies each media packet which
- * immediately follows a config packet to prepend the config packet payload.
+ * This helper reads every input packet and attaches the config packet payload
+ * to each media packet which immediately follows a config packet, as
+ * AV_PKT_DATA_NEW_EXTRADATA side data (handled by the H.264 and H.265
+ * decoders). The media packet data is not modified, so that the key frames
+ * are never copied to prepend the config.
  */
 
 struct sc_packet_merger {
@@ -34,7 +37,7 @@ sc_packet_merger_destroy(struct sc_packet_merger *merger);
 /**
  * If the packet is a config packet, then keep its data for later.
  * Otherwise (if the packet is a media packet), then if a config packet is
- * pending, prepend the config packet to this packet (so the packet is
+ * pending, attach it to this packet as side data (so the packet side data is
  * modified!).
  */
 bool
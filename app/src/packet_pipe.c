@@ -0,0 +1,135 @@
+#include "packet_pipe.h"
+
+#include "compat.h"
+#include "frame_header.h"
+#include "frame_pipe.h"
+#include "util/log.h"
+
+/** Downcast packet_sink to sc_packet_pipe */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_packet_pipe, packet_sink)
+
+static bool
+sc_packet_pipe_packet_sink_open(struct sc_packet_sink *sink,
+                                AVCodecContext *ctx) {
+    struct sc_packet_pipe *pipe = DOWNCAST(sink);
+
+    switch (ctx->codec_id) {
+        case AV_CODEC_ID_H264:
+            pipe->codec_id = FRAME_CODEC_ID_H264;
+            break;
+        case AV_CODEC_ID_HEVC:
+            pipe->codec_id = FRAME_CODEC_ID_H265;
+            break;
+        case AV_CODEC_ID_AV1:
+            pipe->codec_id = FRAME_CODEC_ID_AV1;
+            break;
+        default:
+            LOGE("Unsupported codec for the packet pipe: %s",
+                 avcodec_get_name(ctx->codec_id));
+            return false;
+    }
+
+    pipe->sequence = 0;
+    pipe->disabled = false;
+
+    // The boot time (without clock synchronization) is retrieved before the
+    // first packet
+    sc_frame_clock_prepare(&pipe->clock);
+
+    return true;
+}
+
+static void
+sc_packet_pipe_packet_sink_close(struct sc_packet_sink *sink) {
+    (void) sink;
+    // Nothing to do, the packets are written synchronously
+}
+
+static bool
+sc_packet_pipe_packet_sink_push(struct sc_packet_sink *sink,
+                                const AVPacket *packet) {
+    struct sc_packet_pipe *pipe = DOWNCAST(sink);
+
+    if (pipe->disabled) {
+        // The pipe is not required for the other outputs
+        return true;
+    }
+
+    bool config = packet->pts == AV_NOPTS_VALUE;
+
+    uint32_t flags = 0;
+    int64_t pts_us = -1;
+    int64_t timestamp_us = -1;
+    // The config of a new encoding session is still prepended to the next
+    // packet (see packet_merger.h), so that a consumer may start decoding at
+    // this packet
+    const uint8_t *prefix = NULL;
+    SC_AV_PACKET_SIDE_DATA_SIZE prefix_size = 0;
+    if (config) {
+        flags |= FRAME_PACKET_FLAG_CONFIG;
+    } else {
+        if (packet->flags & AV_PKT_FLAG_KEY) {
+            flags |= FRAME_PACKET_FLAG_KEY_FRAME;
+        }
+        pts_us = packet->pts;
+        prefix = av_packet_get_side_data(packet, AV_PKT_DATA_NEW_EXTRADATA,
+                                         &prefix_size);
+        if (!prefix) {
+            prefix_size = 0;
+        }
+
+        // The capture timestamp exported by the demuxer, if any
+        AVDictionary *metadata = NULL;
+        SC_AV_PACKET_SIDE_DATA_SIZE size;
+        const uint8_t *data =
+            av_packet_get_side_data(packet, AV_PKT_DATA_STRINGS_METADATA,
+                                    &size);
+        if (data && av_packet_unpack_dictionary(data, size, &metadata) < 0) {
+            // Fall back to the PTS
+            metadata = NULL;
+        }
+
+        timestamp_us = sc_frame_clock_get_timestamp_us(&pipe->clock, metadata,
+                                                       packet->pts);
+        av_dict_free(&metadata);
+    }
+
+    if (pipe->pipe_mutex) {
+        sc_mutex_lock(pipe->pipe_mutex);
+    }
+    bool ok = sc_frame_pipe_write_packet(prefix, prefix_size, packet->data,
+                                         packet->size, pipe->codec_id, flags,
+                                         pipe->sequence, pts_us, timestamp_us);
+    if (pipe->pipe_mutex) {
+        sc_mutex_unlock(pipe->pipe_mutex);
+    }
+
+    if (!ok) {
+        // Typically, the consumer closed the pipe
+        LOGE("Could not write packet to stdout, disabling packet pipe");
+        pipe->disabled = true;
+        return true;
+    }
+
+    ++pipe->sequence;
+    return true;
+}
+
+void
+sc_packet_pipe_init(struct sc_packet_pipe *pipe, sc_mutex *pipe_mutex,
+                    struct sc_clock_sync *clock_sync, const char *serial,
+                    int64_t device_boot_time) {
+    pipe->pipe_mutex = pipe_mutex;
+    sc_frame_clock_init(&pipe->clock, clock_sync, serial);
+    sc_frame_clock_set_boot_time(&pipe->clock, device_boot_time);
+
+    sc_frame_pipe_init();
+
+    static const struct sc_packet_sink_ops ops = {
+        .open = sc_packet_pipe_packet_sink_open,
+        .close = sc_packet_pipe_packet_sink_close,
+        .push = sc_packet_pipe_packet_sink_push,
+    };
+
+    pipe->packet_sink.ops = &ops;
+}
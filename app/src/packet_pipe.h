@@ -0,0 +1,42 @@
+#ifndef SC_PACKET_PIPE_H
+#define SC_PACKET_PIPE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "clock_sync.h"
+#include "frame_clock.h"
+#include "trait/packet_sink.h"
+#include "util/thread.h"
+
+/**
+ * Compressed video output to the pipe (--pipe-output=packets)
+ *
+ * It receives the encoded packets directly from the video demuxer, and writes
+ * them to stdout without decoding, each one with its capture time (see
+ * struct frame_packet_header in frame_header.h).
+ *
+ * The packets are written from the demuxer thread.
+ */
+struct sc_packet_pipe {
+    struct sc_packet_sink packet_sink; // packet sink trait
+
+    // Serialize the writes with the audio blocks (may be NULL if the video is
+    // the only output)
+    sc_mutex *pipe_mutex;
+
+    // Only accessed from the demuxer thread
+    struct sc_frame_clock clock;
+    uint32_t codec_id; // FRAME_CODEC_ID_*
+    uint64_t sequence;
+    bool disabled; // on pipe error
+};
+
+void
+sc_packet_pipe_init(struct sc_packet_pipe *pipe, sc_mutex *pipe_mutex,
+                    struct sc_clock_sync *clock_sync, const char *serial,
+                    int64_t device_boot_time);
+
+#endif
@@ -0,0 +1,91 @@
+#include "packet_pool.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+
+#include "pool_memory.h"
+#include "util/log.h"
+
+// Initial payload size, enough for most non-key frames
+#define SC_PACKET_POOL_MIN_SIZE (64 * 1024)
+
+void
+sc_packet_pool_init(struct sc_packet_pool *pp) {
+    pp->pool = NULL;
+    pp->size = 0;
+    pp->requested = 0;
+    pp->allocated = 0;
+}
+
+void
+sc_packet_pool_destroy(struct sc_packet_pool *pp) {
+    // The buffers still referenced are freed when they are released
+    av_buffer_pool_uninit(&pp->pool);
+}
+
+static AVBufferRef *
+sc_packet_pool_alloc(void *opaque, SC_AV_BUFFER_SIZE size) {
+    struct sc_packet_pool *pp = opaque;
+    // Called from sc_packet_pool_get(), on the requesting thread
+    ++pp->allocated;
+    if (sc_pool_memory_is_enabled()) {
+        return sc_pool_memory_alloc(size);
+    }
+    return av_buffer_alloc(size);
+}
+
+static bool
+sc_packet_pool_configure(struct sc_packet_pool *pp, size_t len) {
+    // Grow geometrically, so that slowly increasing packet sizes do not
+    // reconfigure the pool every time
+    size_t size = pp->size ? pp->size : SC_PACKET_POOL_MIN_SIZE;
+    while (size < len) {
+        size *= 2;
+    }
+
+    AVBufferPool *pool =
+        av_buffer_pool_init2(size + AV_INPUT_BUFFER_PADDING_SIZE, pp,
+                             sc_packet_pool_alloc, NULL);
+    if (!pool) {
+        LOG_OOM();
+        return false;
+    }
+
+    av_buffer_pool_uninit(&pp->pool);
+    pp->pool = pool;
+    pp->size = size;
+
+    LOGD("Packet pool configured: %" SC_PRIsizet " bytes per packet", size);
+
+    return true;
+}
+
+bool
+sc_packet_pool_get(struct sc_packet_pool *pp, AVPacket *packet, size_t len) {
+    assert(!packet->buf);
+
+    if (len > pp->size) {
+        if (!sc_packet_pool_configure(pp, len)) {
+            return false;
+        }
+    }
+
+    AVBufferRef *buf = av_buffer_pool_get(pp->pool);
+    if (!buf) {
+        LOG_OOM();
+        return false;
+    }
+
+    ++pp->requested;
+
+    packet->buf = buf;
+    packet->data = buf->data;
+    packet->size = len;
+    memset(packet->data + len, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef SC_PACKET_POOL_H
+#define SC_PACKET_POOL_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// forward declarations
+typedef struct AVPacket AVPacket;
+typedef struct AVBufferPool AVBufferPool;
+
+/**
+ * A packet pool provides packet payload buffers which are recycled, to avoid a
+ * heap allocation per packet.
+ *
+ * All the buffers have the same size, grown to the largest packet received so
+ * far (the pool is then reconfigured). Like for sc_frame_pool, the buffers are
+ * returned to the pool once the last reference is released, even from another
+ * thread (e.g. the recorder).
+ *
+ * A packet pool is not thread-safe: the packets must be requested from a
+ * single thread.
+ */
+struct sc_packet_pool {
+    AVBufferPool *pool;
+    size_t size; // payload size of the buffers (padding excluded)
+
+    // statistics
+    uint64_t requested;
+    uint64_t allocated; // buffers allocated (i.e. pool misses)
+};
+
+void
+sc_packet_pool_init(struct sc_packet_pool *pp);
+
+void
+sc_packet_pool_destroy(struct sc_packet_pool *pp);
+
+/**
+ * Make `packet` reference a pooled buffer for a payload of `len` bytes
+ *
+ * The packet must be empty (freshly allocated or unreferenced). Like
+ * av_new_packet(), the padding is zeroed, the payload is uninitialized.
+ */
+bool
+sc_packet_pool_get(struct sc_packet_pool *pp, AVPacket *packet, size_t len);
+
+#endif
@@ -0,0 +1,252 @@
+#include "packet_worker.h"
+
+#include <assert.h>
+#include <inttypes.h>
+
+#include "memory_budget.h"
+#include "util/log.h"
+
+// The packets queued for a sink which may drop them are accounted in the
+// memory budget (except the config packets, which are never dropped)
+static bool
+sc_packet_worker_is_budgeted(struct sc_packet_worker *worker,
+                             const AVPacket *packet) {
+    return worker->policy == SC_PACKET_WORKER_DROP_TO_KEY_FRAME
+        && packet->pts != AV_NOPTS_VALUE;
+}
+
+static void
+sc_packet_worker_free(struct sc_packet_worker *worker, AVPacket **packet) {
+    if (sc_packet_worker_is_budgeted(worker, *packet)) {
+        sc_memory_budget_release(SC_MEMORY_STREAM, (*packet)->size);
+    }
+    av_packet_free(packet);
+}
+
+static void
+sc_packet_worker_queue_clear(struct sc_packet_worker *worker) {
+    while (!sc_vecdeque_is_empty(&worker->queue)) {
+        AVPacket *p = sc_vecdeque_pop(&worker->queue);
+        sc_packet_worker_free(worker, &p);
+    }
+    worker->queued_bytes = 0;
+}
+
+static int
+run_packet_worker(void *data) {
+    struct sc_packet_worker *worker = data;
+
+    for (;;) {
+        sc_mutex_lock(&worker->mutex);
+
+        while (!worker->stopped && sc_vecdeque_is_empty(&worker->queue)) {
+            sc_cond_wait(&worker->queue_cond, &worker->mutex);
+        }
+
+        if (sc_vecdeque_is_empty(&worker->queue)) {
+            // Stopped, and all the queued packets have been pushed
+            assert(worker->stopped);
+            sc_mutex_unlock(&worker->mutex);
+            break;
+        }
+
+        AVPacket *packet = sc_vecdeque_pop(&worker->queue);
+        assert(worker->queued_bytes >= (size_t) packet->size);
+        worker->queued_bytes -= packet->size;
+        sc_cond_signal(&worker->space_cond);
+
+        sc_mutex_unlock(&worker->mutex);
+
+        bool ok = worker->sink->ops->push(worker->sink, packet);
+        sc_packet_worker_free(worker, &packet);
+        if (!ok) {
+            LOGE("Packet could not be pushed to the %s, stopping",
+                 worker->name);
+            sc_mutex_lock(&worker->mutex);
+            // Make the next push fail, so that the error is reported to the
+            // pusher
+            worker->failed = true;
+            sc_packet_worker_queue_clear(worker);
+            sc_cond_signal(&worker->space_cond);
+            sc_mutex_unlock(&worker->mutex);
+            break;
+        }
+    }
+
+    LOGD("Packet worker of the %s ended", worker->name);
+
+    return 0;
+}
+
+bool
+sc_packet_worker_open(struct sc_packet_worker *worker,
+                      struct sc_packet_sink *sink,
+                      enum sc_packet_worker_policy policy, const char *name,
+                      AVCodecContext *ctx) {
+    worker->sink = sink;
+    worker->policy = policy;
+    worker->name = name;
+    worker->max_bytes = policy == SC_PACKET_WORKER_BLOCK
+                      ? SC_PACKET_WORKER_BLOCK_MAX_BYTES
+                      : SC_PACKET_WORKER_DROP_MAX_BYTES;
+    worker->queued_bytes = 0;
+    worker->overflow = false;
+    worker->dropped = 0;
+    worker->stopped = false;
+    worker->failed = false;
+    sc_vecdeque_init(&worker->queue);
+
+    bool ok = sc_mutex_init(&worker->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&worker->queue_cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    ok = sc_cond_init(&worker->space_cond);
+    if (!ok) {
+        goto error_destroy_queue_cond;
+    }
+
+    if (!sink->ops->open(sink, ctx)) {
+        goto error_destroy_space_cond;
+    }
+
+    ok = sc_thread_create(&worker->thread, run_packet_worker, "scrcpy-pworker",
+                          worker);
+    if (!ok) {
+        LOGE("Could not start packet worker thread");
+        goto error_close_sink;
+    }
+
+    return true;
+
+error_close_sink:
+    sink->ops->close(sink);
+error_destroy_space_cond:
+    sc_cond_destroy(&worker->space_cond);
+error_destroy_queue_cond:
+    sc_cond_destroy(&worker->queue_cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&worker->mutex);
+
+    return false;
+}
+
+void
+sc_packet_worker_close(struct sc_packet_worker *worker) {
+    sc_mutex_lock(&worker->mutex);
+    // The thread pushes the packets still queued before ending
+    worker->stopped = true;
+    sc_cond_signal(&worker->queue_cond);
+    sc_cond_signal(&worker->space_cond);
+    sc_mutex_unlock(&worker->mutex);
+
+    sc_thread_join(&worker->thread, NULL);
+
+    worker->sink->ops->close(worker->sink);
+
+    if (worker->dropped) {
+        LOGW("%" PRIu64 " packets dropped by the %s (queue full)",
+             worker->dropped, worker->name);
+    }
+
+    sc_packet_worker_queue_clear(worker);
+    sc_vecdeque_destroy(&worker->queue);
+    sc_cond_destroy(&worker->space_cond);
+    sc_cond_destroy(&worker->queue_cond);
+    sc_mutex_destroy(&worker->mutex);
+}
+
+bool
+sc_packet_worker_push(struct sc_packet_worker *worker, const AVPacket *packet) {
+    sc_mutex_lock(&worker->mutex);
+
+    // The config packets are never dropped nor delayed
+    bool config = packet->pts == AV_NOPTS_VALUE;
+    size_t max_bytes = worker->max_bytes;
+
+    if (worker->policy == SC_PACKET_WORKER_BLOCK && !config) {
+        // A single packet larger than the limit is still accepted once the
+        // queue is empty
+        while (!worker->stopped && !worker->failed
+                && worker->queued_bytes
+                && worker->queued_bytes + packet->size > max_bytes) {
+            sc_cond_wait(&worker->space_cond, &worker->mutex);
+        }
+    }
+
+    if (worker->stopped || worker->failed) {
+        sc_mutex_unlock(&worker->mutex);
+        return false;
+    }
+
+    bool budgeted = sc_packet_worker_is_budgeted(worker, packet);
+    if (budgeted) {
+        bool full = worker->queued_bytes + packet->size > max_bytes;
+        // The next packets reference the dropped ones: resume on a key frame
+        // only
+        bool resumable = !worker->overflow
+                      || (packet->flags & AV_PKT_FLAG_KEY);
+        if (!full && resumable) {
+            // Enforced before the packet is referenced
+            full = !sc_memory_budget_acquire(SC_MEMORY_STREAM, packet->size);
+        }
+
+        if (worker->overflow) {
+            if (full || !resumable) {
+                ++worker->dropped;
+                sc_mutex_unlock(&worker->mutex);
+                return true;
+            }
+            worker->overflow = false;
+        } else if (full) {
+            if (!worker->dropped) {
+                LOGW("Queue of the %s full, dropping packets until the next "
+                     "key frame", worker->name);
+            }
+            worker->overflow = true;
+            ++worker->dropped;
+            sc_mutex_unlock(&worker->mutex);
+            return true;
+        }
+    }
+
+    AVPacket *p = av_packet_alloc();
+    if (!p) {
+        if (budgeted) {
+            sc_memory_budget_release(SC_MEMORY_STREAM, packet->size);
+        }
+        sc_mutex_unlock(&worker->mutex);
+        LOG_OOM();
+        return false;
+    }
+
+    if (av_packet_ref(p, packet)) {
+        av_packet_free(&p);
+        if (budgeted) {
+            sc_memory_budget_release(SC_MEMORY_STREAM, packet->size);
+        }
+        sc_mutex_unlock(&worker->mutex);
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = sc_vecdeque_push(&worker->queue, p);
+    if (!ok) {
+        sc_packet_worker_free(worker, &p);
+        sc_mutex_unlock(&worker->mutex);
+        LOG_OOM();
+        return false;
+    }
+
+    worker->queued_bytes += p->size;
+    sc_cond_signal(&worker->queue_cond);
+
+    sc_mutex_unlock(&worker->mutex);
+
+    return true;
+}
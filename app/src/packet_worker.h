@@ -0,0 +1,86 @@
+#ifndef SC_PACKET_WORKER_H
+#define SC_PACKET_WORKER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "trait/packet_sink.h"
+#include "util/thread.h"
+#include "util/vecdeque.h"
+
+// Maximum size of the packets queued for a sink which must not drop packets
+// (the decoders): beyond, the push waits for the sink
+#define SC_PACKET_WORKER_BLOCK_MAX_BYTES (16 * 1024 * 1024)
+// Maximum size of the packets queued for a sink which may drop packets (the
+// recorder, the packet pipe)
+#define SC_PACKET_WORKER_DROP_MAX_BYTES (64 * 1024 * 1024)
+
+enum sc_packet_worker_policy {
+    // Never drop packets: if the queue is full, the push waits for the sink
+    SC_PACKET_WORKER_BLOCK,
+    // If the queue is full, drop the packets until the next key frame (the
+    // config packets are never dropped), so that the pusher never waits
+    SC_PACKET_WORKER_DROP_TO_KEY_FRAME,
+};
+
+struct sc_packet_worker_queue SC_VECDEQUE(AVPacket *);
+
+/**
+ * Push the packets to a sink from a dedicated thread.
+ *
+ * The pushed packets are queued by reference (their data is not copied), so
+ * that the pusher (typically the demuxer) never waits for a slow sink, up to
+ * a maximum queued size.
+ */
+struct sc_packet_worker {
+    struct sc_packet_sink *sink;
+    enum sc_packet_worker_policy policy;
+    const char *name;
+    size_t max_bytes;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond queue_cond;
+    sc_cond space_cond;
+
+    struct sc_packet_worker_queue queue;
+    size_t queued_bytes;
+
+    // Set when the queue is full, until the next key frame
+    bool overflow;
+    uint64_t dropped;
+
+    bool stopped;
+    bool failed; // the sink failed to accept a packet
+};
+
+/**
+ * Open `sink` (from the caller thread) and start the worker thread
+ *
+ * The `name` (statically allocated) identifies the sink in the logs.
+ */
+bool
+sc_packet_worker_open(struct sc_packet_worker *worker,
+                      struct sc_packet_sink *sink,
+                      enum sc_packet_worker_policy policy, const char *name,
+                      AVCodecContext *ctx);
+
+/**
+ * Push the packets still queued to the sink, stop and join the worker thread,
+ * then close the sink
+ */
+void
+sc_packet_worker_close(struct sc_packet_worker *worker);
+
+/**
+ * Queue a reference to the packet for the sink
+ *
+ * Return false if the sink failed to accept a previous packet.
+ */
+bool
+sc_packet_worker_push(struct sc_packet_worker *worker, const AVPacket *packet);
+
+#endif
@@ -0,0 +1,223 @@
+#include "pipe_feedback.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "frame_header.h"
+#include "util/binary.h"
+#include "util/log.h"
+
+static_assert(sizeof(struct pipe_feedback_record) == 16,
+              "Unexpected pipe feedback record size");
+
+// Called with the mutex locked
+static void
+sc_pipe_feedback_ack(struct sc_pipe_feedback *fb, uint64_t sequence) {
+    while (fb->count && fb->in_flight[fb->head] <= sequence) {
+        fb->head = (fb->head + 1) % ARRAY_LEN(fb->in_flight);
+        --fb->count;
+    }
+}
+
+static void
+sc_pipe_feedback_serve(struct sc_pipe_feedback *fb, sc_socket socket) {
+    for (;;) {
+        uint8_t buf[sizeof(struct pipe_feedback_record)];
+        ssize_t r = net_recv_all(socket, buf, sizeof(buf));
+        if (r != (ssize_t) sizeof(buf)) {
+            // Disconnected (or interrupted on stop)
+            return;
+        }
+
+        if (memcmp(buf, PIPE_FEEDBACK_MAGIC, sizeof(PIPE_FEEDBACK_MAGIC))) {
+            LOGW("Invalid pipe feedback record, consumer disconnected");
+            return;
+        }
+
+        uint32_t type = sc_read32le(&buf[4]);
+        uint64_t value = sc_read64le(&buf[8]);
+
+        sc_mutex_lock(&fb->mutex);
+        if (type == PIPE_FEEDBACK_ACK) {
+            sc_pipe_feedback_ack(fb, value);
+        } else if (type == PIPE_FEEDBACK_CAPACITY) {
+            if (value > SC_PIPE_FEEDBACK_MAX_CAPACITY) {
+                LOGW("Pipe consumer capacity %" PRIu64 " limited to %d",
+                     value, SC_PIPE_FEEDBACK_MAX_CAPACITY);
+                value = SC_PIPE_FEEDBACK_MAX_CAPACITY;
+            }
+            fb->capacity = value;
+            if (!fb->capacity) {
+                // The frames are not accounted anymore
+                fb->count = 0;
+            }
+        }
+        // Ignore the unknown records, for forward compatibility
+        sc_mutex_unlock(&fb->mutex);
+    }
+}
+
+static int
+run_pipe_feedback(void *data) {
+    struct sc_pipe_feedback *fb = data;
+
+    for (;;) {
+        sc_socket socket = net_accept(fb->server_socket);
+        if (socket == SC_SOCKET_NONE) {
+            // Interrupted on stop (or failed)
+            break;
+        }
+
+        sc_mutex_lock(&fb->mutex);
+        if (fb->stopped) {
+            sc_mutex_unlock(&fb->mutex);
+            net_close(socket);
+            break;
+        }
+        fb->socket = socket;
+        fb->connected = true;
+        fb->capacity = SC_PIPE_FEEDBACK_DEFAULT_CAPACITY;
+        fb->head = 0;
+        fb->count = 0;
+        sc_mutex_unlock(&fb->mutex);
+
+        LOGI("Pipe consumer connected for feedback");
+        sc_pipe_feedback_serve(fb, socket);
+
+        sc_mutex_lock(&fb->mutex);
+        fb->connected = false;
+        bool stopped = fb->stopped;
+        sc_mutex_unlock(&fb->mutex);
+
+        net_close(socket);
+
+        if (stopped) {
+            break;
+        }
+        LOGI("Pipe consumer disconnected from feedback");
+    }
+
+    LOGD("Pipe feedback thread ended");
+
+    return 0;
+}
+
+bool
+sc_pipe_feedback_init(struct sc_pipe_feedback *fb,
+                      const struct sc_pipe_feedback_params *params) {
+    fb->host = params->host;
+    fb->port = params->port;
+    fb->policy = params->policy;
+    fb->socket = SC_SOCKET_NONE;
+    fb->stopped = false;
+    fb->connected = false;
+    fb->capacity = 0;
+    fb->head = 0;
+    fb->count = 0;
+    fb->degraded = 0;
+    fb->dropped = 0;
+
+    if (!sc_mutex_init(&fb->mutex)) {
+        return false;
+    }
+
+    fb->server_socket = net_socket();
+    if (fb->server_socket == SC_SOCKET_NONE) {
+        LOGE("Could not create pipe feedback socket");
+        goto error_destroy_mutex;
+    }
+
+    if (!net_listen(fb->server_socket, fb->host, fb->port, 1)) {
+        LOGE("Could not listen on port %" PRIu16 " for the pipe feedback",
+             fb->port);
+        goto error_close_socket;
+    }
+
+    return true;
+
+error_close_socket:
+    net_close(fb->server_socket);
+error_destroy_mutex:
+    sc_mutex_destroy(&fb->mutex);
+
+    return false;
+}
+
+bool
+sc_pipe_feedback_start(struct sc_pipe_feedback *fb) {
+    LOGD("Starting pipe feedback");
+
+    bool ok = sc_thread_create(&fb->thread, run_pipe_feedback,
+                               "scrcpy-pipefb", fb);
+    if (!ok) {
+        LOGE("Could not start pipe feedback thread");
+        return false;
+    }
+
+    LOGI("Waiting for the pipe feedback on port %" PRIu16, fb->port);
+    return true;
+}
+
+void
+sc_pipe_feedback_stop(struct sc_pipe_feedback *fb) {
+    sc_mutex_lock(&fb->mutex);
+    fb->stopped = true;
+    if (fb->connected) {
+        // Unblock the pending recv
+        net_interrupt(fb->socket);
+    }
+    sc_mutex_unlock(&fb->mutex);
+
+    net_interrupt(fb->server_socket);
+}
+
+void
+sc_pipe_feedback_join(struct sc_pipe_feedback *fb) {
+    sc_thread_join(&fb->thread, NULL);
+
+    if (fb->degraded || fb->dropped) {
+        LOGI("Pipe feedback: %" PRIu64 " frames reduced to their Y plane, %"
+             PRIu64 " frames dropped", fb->degraded, fb->dropped);
+    }
+}
+
+void
+sc_pipe_feedback_destroy(struct sc_pipe_feedback *fb) {
+    net_close(fb->server_socket);
+    sc_mutex_destroy(&fb->mutex);
+}
+
+enum sc_pipe_feedback_decision
+sc_pipe_feedback_admit(struct sc_pipe_feedback *fb, uint64_t sequence,
+                       bool luma) {
+    sc_mutex_lock(&fb->mutex);
+
+    if (!fb->connected || !fb->capacity) {
+        sc_mutex_unlock(&fb->mutex);
+        return SC_PIPE_FEEDBACK_FULL;
+    }
+
+    enum sc_pipe_feedback_decision decision;
+    if (fb->count < fb->capacity) {
+        decision = SC_PIPE_FEEDBACK_FULL;
+    } else if (fb->policy == SC_PIPE_BACKPRESSURE_LUMA && luma
+            && fb->count < 2 * fb->capacity) {
+        decision = SC_PIPE_FEEDBACK_LUMA;
+        ++fb->degraded;
+    } else {
+        decision = SC_PIPE_FEEDBACK_DROP;
+        ++fb->dropped;
+    }
+
+    if (decision != SC_PIPE_FEEDBACK_DROP) {
+        assert(fb->count < ARRAY_LEN(fb->in_flight));
+        unsigned index = (fb->head + fb->count) % ARRAY_LEN(fb->in_flight);
+        fb->in_flight[index] = sequence;
+        ++fb->count;
+    }
+
+    sc_mutex_unlock(&fb->mutex);
+
+    return decision;
+}
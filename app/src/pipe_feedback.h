@@ -0,0 +1,95 @@
+#ifndef SC_PIPE_FEEDBACK_H
+#define SC_PIPE_FEEDBACK_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "options.h"
+#include "util/net.h"
+#include "util/thread.h"
+
+// Frames in flight assumed until the consumer reports its capacity
+#define SC_PIPE_FEEDBACK_DEFAULT_CAPACITY 4
+// Maximum capacity accepted from the consumer
+#define SC_PIPE_FEEDBACK_MAX_CAPACITY 64
+
+// What to write to the pipe for a frame
+enum sc_pipe_feedback_decision {
+    SC_PIPE_FEEDBACK_FULL, // the frame as usual
+    SC_PIPE_FEEDBACK_LUMA, // only its Y plane
+    SC_PIPE_FEEDBACK_DROP, // a drop record (FRAME_DROP_REASON_SINK_BUSY)
+};
+
+/**
+ * Readiness channel of the consumer of the output pipe (--pipe-feedback)
+ *
+ * The consumer connects over TCP and acknowledges the frames it has processed
+ * (see struct pipe_feedback_record in frame_header.h). The frames piped but
+ * not acknowledged yet are in flight: once the capacity of the consumer is
+ * reached, the output thread degrades or drops the next frames before writing
+ * them, instead of blocking on a full pipe.
+ *
+ * Without a connected consumer, all the frames are piped in full, as without
+ * feedback. A single consumer is connected at a time; on disconnection, the
+ * frames in flight are forgotten, and the next consumer may connect.
+ */
+struct sc_pipe_feedback {
+    uint32_t host;
+    uint16_t port;
+    enum sc_pipe_backpressure policy;
+
+    sc_socket server_socket;
+    sc_socket socket; // of the connected consumer
+    sc_thread thread;
+
+    sc_mutex mutex;
+    bool stopped;
+    bool connected;
+    unsigned capacity; // 0 if the backpressure is disabled by the consumer
+    // Sequence numbers of the frames in flight, in order (ring)
+    uint64_t in_flight[2 * SC_PIPE_FEEDBACK_MAX_CAPACITY];
+    unsigned head;
+    unsigned count;
+    uint64_t degraded; // frames piped with their Y plane only
+    uint64_t dropped;
+};
+
+struct sc_pipe_feedback_params {
+    uint32_t host;
+    uint16_t port;
+    enum sc_pipe_backpressure policy;
+};
+
+// Listen on the port (fail if it is not available)
+bool
+sc_pipe_feedback_init(struct sc_pipe_feedback *fb,
+                      const struct sc_pipe_feedback_params *params);
+
+bool
+sc_pipe_feedback_start(struct sc_pipe_feedback *fb);
+
+void
+sc_pipe_feedback_stop(struct sc_pipe_feedback *fb);
+
+void
+sc_pipe_feedback_join(struct sc_pipe_feedback *fb);
+
+void
+sc_pipe_feedback_destroy(struct sc_pipe_feedback *fb);
+
+/**
+ * Decide how to pipe the frame `sequence` (called from the output thread,
+ * with increasing sequence numbers)
+ *
+ * If the frame is piped (in full or its Y plane only), it is accounted as in
+ * flight until the consumer acknowledges it. If `luma` is false, the frame
+ * can not be reduced to its Y plane (e.g. it is already GRAY8), so it is
+ * dropped instead.
+ */
+enum sc_pipe_feedback_decision
+sc_pipe_feedback_admit(struct sc_pipe_feedback *fb, uint64_t sequence,
+                       bool luma);
+
+#endif
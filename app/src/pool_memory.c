@@ -0,0 +1,109 @@
+#include "pool_memory.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <libavutil/buffer.h>
+
+#include "util/log.h"
+#include "util/pages.h"
+
+static struct {
+    bool enabled; // written once before the pools are used
+
+    atomic_uint_least64_t huge_buffers;
+    atomic_uint_least64_t huge_bytes;
+    atomic_uint_least64_t regular_buffers;
+    atomic_uint_least64_t regular_bytes;
+
+    atomic_bool huge_warned;
+    atomic_bool lock_warned;
+} pool_memory;
+
+void
+sc_pool_memory_enable(void) {
+    pool_memory.enabled = true;
+}
+
+bool
+sc_pool_memory_is_enabled(void) {
+    return pool_memory.enabled;
+}
+
+static void
+sc_pool_memory_free(void *opaque, uint8_t *data) {
+    (void) data;
+    struct sc_pages *pages = opaque;
+    sc_pages_free(pages);
+    free(pages);
+}
+
+AVBufferRef *
+sc_pool_memory_alloc(size_t size) {
+    assert(pool_memory.enabled);
+
+    struct sc_pages *pages = malloc(sizeof(*pages));
+    if (!pages) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    // A smaller buffer would waste most of its huge page
+    bool huge = size >= SC_HUGE_PAGE_SIZE / 2;
+    if (!sc_pages_alloc(pages, size, huge, true)) {
+        free(pages);
+        return NULL;
+    }
+
+    if (huge && !pages->huge
+            && !atomic_exchange(&pool_memory.huge_warned, true)) {
+#ifdef _WIN32
+        LOGW("Could not allocate large pages for the pool buffers "
+             "(the SeLockMemoryPrivilege is required)");
+#else
+        LOGW("Could not allocate huge pages for the pool buffers "
+             "(reserve them with the sysctl vm.nr_hugepages)");
+#endif
+    }
+    if (!pages->locked && !atomic_exchange(&pool_memory.lock_warned, true)) {
+#ifdef _WIN32
+        LOGW("Could not lock the pool buffers in memory");
+#else
+        LOGW("Could not lock the pool buffers in memory "
+             "(raise the limit of locked memory, see ulimit -l)");
+#endif
+    }
+
+    if (pages->huge) {
+        atomic_fetch_add(&pool_memory.huge_buffers, 1);
+        atomic_fetch_add(&pool_memory.huge_bytes, pages->size);
+    } else {
+        atomic_fetch_add(&pool_memory.regular_buffers, 1);
+        atomic_fetch_add(&pool_memory.regular_bytes, pages->size);
+    }
+
+    AVBufferRef *buf = av_buffer_create(pages->data, size, sc_pool_memory_free,
+                                        pages, 0);
+    if (!buf) {
+        LOG_OOM();
+        sc_pages_free(pages);
+        free(pages);
+        return NULL;
+    }
+
+    return buf;
+}
+
+void
+sc_pool_memory_print_stats(void) {
+    assert(pool_memory.enabled);
+
+    uint64_t huge_buffers = atomic_load(&pool_memory.huge_buffers);
+    uint64_t huge_bytes = atomic_load(&pool_memory.huge_bytes);
+    uint64_t regular_buffers = atomic_load(&pool_memory.regular_buffers);
+    uint64_t regular_bytes = atomic_load(&pool_memory.regular_bytes);
+    LOGI("Pool buffers: %" PRIu64 " in huge pages (%" PRIu64 " MiB), %" PRIu64
+         " in regular pages (%" PRIu64 " MiB)", huge_buffers, huge_bytes >> 20,
+         regular_buffers, regular_bytes >> 20);
+}
@@ -0,0 +1,54 @@
+#ifndef SC_POOL_MEMORY_H
+#define SC_POOL_MEMORY_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// forward declarations
+typedef struct AVBufferRef AVBufferRef;
+
+/**
+ * Backing memory of the frame and packet pools (--huge-pages)
+ *
+ * By default, the pools allocate their buffers from the heap. If enabled,
+ * each buffer is mapped directly from the system and locked in RAM (faulted
+ * in on allocation, never paged out), and the buffers of at least half a huge
+ * page (SC_HUGE_PAGE_SIZE) are backed by huge pages, so that the remap and
+ * copy loops over the frames do not thrash the TLB. The smaller buffers
+ * (most packets) would waste most of a huge page, they use regular pages.
+ *
+ * If the huge pages or the locking are not available, the buffers are still
+ * allocated (a warning is logged once).
+ *
+ * The configuration is global (it applies to all the pools of all the
+ * devices).
+ */
+
+/**
+ * Enable the locked (and huge) pages for the pools configured afterwards
+ *
+ * Must be called from the main thread, before any pool is used.
+ */
+void
+sc_pool_memory_enable(void);
+
+bool
+sc_pool_memory_is_enabled(void);
+
+/**
+ * Allocate a pool buffer of `size` bytes in locked (and possibly huge) pages
+ *
+ * May be called from any thread.
+ */
+AVBufferRef *
+sc_pool_memory_alloc(size_t size);
+
+/**
+ * Log the number of buffers allocated in huge and regular pages
+ */
+void
+sc_pool_memory_print_stats(void);
+
+#endif
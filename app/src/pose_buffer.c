@@ -0,0 +1,96 @@
+#include "pose_buffer.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "util/log.h"
+
+bool
+sc_pose_buffer_init(struct sc_pose_buffer *pb,
+                    struct sc_clock_sync *clock_sync) {
+    bool ok = sc_mutex_init(&pb->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    pb->clock_sync = clock_sync;
+    pb->uplink = NULL;
+    pb->buffered = true;
+    pb->head = 0;
+    pb->count = 0;
+    pb->overwritten = 0;
+
+    return true;
+}
+
+void
+sc_pose_buffer_destroy(struct sc_pose_buffer *pb) {
+    if (pb->overwritten) {
+        LOGW("Pose samples dropped (no frame to write them along): %" PRIu64,
+             pb->overwritten);
+    }
+    sc_mutex_destroy(&pb->mutex);
+}
+
+void
+sc_pose_buffer_configure_uplink(struct sc_pose_buffer *pb,
+                                struct sc_uplink *uplink, bool buffered) {
+    pb->uplink = uplink;
+    pb->buffered = buffered;
+}
+
+void
+sc_pose_buffer_push(struct sc_pose_buffer *pb, uint64_t pts,
+                    bool has_position, const float rotation[4],
+                    const float translation[3]) {
+    // Computed without lock, the clock sync has its own
+    int64_t timestamp_us = -1;
+    sc_tick realtime;
+    if (sc_clock_sync_to_realtime(pb->clock_sync, SC_TICK_FROM_US(pts),
+                                  &realtime)) {
+        timestamp_us = SC_TICK_TO_US(realtime);
+    }
+
+    struct pose_sample_record record = {
+        .flags = has_position ? POSE_SAMPLE_FLAG_POSITION : 0,
+        .timestamp_us = timestamp_us,
+    };
+    memcpy(record.magic, POSE_SAMPLE_MAGIC, sizeof(record.magic));
+    memcpy(record.rotation, rotation, sizeof(record.rotation));
+    memcpy(record.translation, translation, sizeof(record.translation));
+
+    if (pb->uplink) {
+        sc_uplink_push_pose(pb->uplink, &record);
+    }
+
+    if (!pb->buffered) {
+        return;
+    }
+
+    sc_mutex_lock(&pb->mutex);
+    unsigned index = (pb->head + pb->count) % SC_POSE_BUFFER_CAPACITY;
+    pb->samples[index] = record;
+    if (pb->count < SC_POSE_BUFFER_CAPACITY) {
+        ++pb->count;
+    } else {
+        // Overwrite the oldest sample
+        pb->head = (pb->head + 1) % SC_POSE_BUFFER_CAPACITY;
+        ++pb->overwritten;
+    }
+    sc_mutex_unlock(&pb->mutex);
+}
+
+unsigned
+sc_pose_buffer_take(struct sc_pose_buffer *pb,
+                    struct pose_sample_record *samples) {
+    sc_mutex_lock(&pb->mutex);
+    unsigned count = pb->count;
+    for (unsigned i = 0; i < count; ++i) {
+        samples[i] = pb->samples[(pb->head + i) % SC_POSE_BUFFER_CAPACITY];
+    }
+    pb->head = 0;
+    pb->count = 0;
+    sc_mutex_unlock(&pb->mutex);
+
+    return count;
+}
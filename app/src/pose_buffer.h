@@ -0,0 +1,82 @@
+#ifndef SC_POSE_BUFFER_H
+#define SC_POSE_BUFFER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "clock_sync.h"
+#include "frame_header.h"
+#include "uplink.h"
+#include "util/thread.h"
+
+// Number of pose samples which may wait for the next frame (the oldest are
+// overwritten beyond)
+#define SC_POSE_BUFFER_CAPACITY 256
+
+/**
+ * Headset pose samples (--pose-rate) received from the device, waiting to be
+ * written to the outputs along the frames.
+ *
+ * The samples are pushed by the receiver thread, which converts their capture
+ * time to the wall clock (without waiting for the clock synchronization: the
+ * pongs are received by the same thread). They are taken by the video
+ * processor on each frame, so that they are written to the pipe in order with
+ * the frames.
+ *
+ * They may also be forwarded to the aggregator (--aggregator) as soon as they
+ * are received.
+ */
+struct sc_pose_buffer {
+    struct sc_clock_sync *clock_sync;
+    struct sc_uplink *uplink; // may be NULL
+    bool buffered; // false if the samples are only forwarded
+
+    sc_mutex mutex;
+    struct pose_sample_record samples[SC_POSE_BUFFER_CAPACITY];
+    unsigned head; // index of the oldest sample
+    unsigned count;
+    uint64_t overwritten; // number of samples lost before being taken
+};
+
+bool
+sc_pose_buffer_init(struct sc_pose_buffer *pb,
+                    struct sc_clock_sync *clock_sync);
+
+void
+sc_pose_buffer_destroy(struct sc_pose_buffer *pb);
+
+/**
+ * Forward the samples to the aggregator
+ *
+ * If `buffered` is false, the samples are not kept for the frames (there is no
+ * pipe nor frame archive).
+ *
+ * It must be called before the first sample is pushed.
+ */
+void
+sc_pose_buffer_configure_uplink(struct sc_pose_buffer *pb,
+                                struct sc_uplink *uplink, bool buffered);
+
+/**
+ * Push a sample received from the device (called from the receiver thread)
+ *
+ * The PTS is in the device monotonic clock, in microseconds.
+ */
+void
+sc_pose_buffer_push(struct sc_pose_buffer *pb, uint64_t pts,
+                    bool has_position, const float rotation[4],
+                    const float translation[3]);
+
+/**
+ * Move the pending samples, oldest first, to `samples` (which must have room
+ * for SC_POSE_BUFFER_CAPACITY samples)
+ *
+ * Return the number of samples.
+ */
+unsigned
+sc_pose_buffer_take(struct sc_pose_buffer *pb,
+                    struct pose_sample_record *samples);
+
+#endif
@@ -0,0 +1,123 @@
+#include "present_sync.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+# define COBJMACROS
+# include <d3d11.h>
+# include <dxgi.h>
+#endif
+
+#include "util/log.h"
+
+#if defined(_WIN32) && SDL_VERSION_ATLEAST(2, 0, 16)
+# define SC_PRESENT_SYNC_HAS_D3D11
+// IID_IDXGIDevice1, defined here rather than linking dxguid
+static const IID sc_iid_dxgi_device1 = {
+    0x77db970f, 0x6276, 0x48ba, {0xba, 0x28, 0x07, 0x01, 0x43, 0xb4, 0x39, 0x2c}
+};
+#endif
+
+static bool
+sc_present_sync_init_gl(struct sc_present_sync *ps, struct sc_opengl *gl) {
+    if (!sc_opengl_version_at_least(gl, 3, 2, /* OpenGL 3.2+ */
+                                        3, 0  /* OpenGL ES 3.0+ */)) {
+        LOGW("Low-latency present disabled (OpenGL 3.2+ or ES 3.0+ required)");
+        return false;
+    }
+
+#define SC_PRESENT_SYNC_LOAD(NAME) \
+    ps->NAME = SDL_GL_GetProcAddress("gl" #NAME); \
+    if (!ps->NAME) { \
+        LOGW("OpenGL function not available: gl" #NAME); \
+        return false; \
+    }
+
+    SC_PRESENT_SYNC_LOAD(FenceSync);
+    SC_PRESENT_SYNC_LOAD(ClientWaitSync);
+    SC_PRESENT_SYNC_LOAD(DeleteSync);
+
+#undef SC_PRESENT_SYNC_LOAD
+
+    ps->backend = SC_PRESENT_SYNC_BACKEND_GL_FENCE;
+    LOGI("Low-latency present: OpenGL fences");
+    return true;
+}
+
+#ifdef SC_PRESENT_SYNC_HAS_D3D11
+static bool
+sc_present_sync_init_d3d11(struct sc_present_sync *ps,
+                           SDL_Renderer *renderer) {
+    // A new reference
+    ID3D11Device *device = SDL_RenderGetD3D11Device(renderer);
+    if (!device) {
+        LOGW("Could not get D3D11 device: %s", SDL_GetError());
+        return false;
+    }
+
+    IDXGIDevice1 *dxgi_device;
+    HRESULT hr = ID3D11Device_QueryInterface(device, &sc_iid_dxgi_device1,
+                                             (void **) &dxgi_device);
+    if (SUCCEEDED(hr)) {
+        hr = IDXGIDevice1_SetMaximumFrameLatency(dxgi_device, 1);
+        IDXGIDevice1_Release(dxgi_device);
+    }
+    ID3D11Device_Release(device);
+
+    if (FAILED(hr)) {
+        LOGW("Could not set the maximum frame latency: 0x%lx",
+             (unsigned long) hr);
+        return false;
+    }
+
+    ps->backend = SC_PRESENT_SYNC_BACKEND_D3D11;
+    LOGI("Low-latency present: DXGI maximum frame latency 1");
+    return true;
+}
+#endif
+
+bool
+sc_present_sync_init(struct sc_present_sync *ps, SDL_Renderer *renderer,
+                     struct sc_opengl *gl) {
+    ps->backend = SC_PRESENT_SYNC_BACKEND_NONE;
+
+    if (gl) {
+        return sc_present_sync_init_gl(ps, gl);
+    }
+
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info)) {
+        LOGW("Could not get renderer info: %s", SDL_GetError());
+        return false;
+    }
+
+#ifdef SC_PRESENT_SYNC_HAS_D3D11
+    if (!strcmp(info.name, "direct3d11")) {
+        return sc_present_sync_init_d3d11(ps, renderer);
+    }
+#endif
+
+    LOGW("Low-latency present not supported by the renderer %s "
+         "(OpenGL or direct3d11 required)", info.name);
+    return false;
+}
+
+void
+sc_present_sync_wait(struct sc_present_sync *ps) {
+    if (ps->backend != SC_PRESENT_SYNC_BACKEND_GL_FENCE) {
+        // The DXGI present blocks while a frame is queued
+        return;
+    }
+
+    GLsync fence = ps->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    if (!fence) {
+        return;
+    }
+
+    GLenum result = ps->ClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                       SC_PRESENT_SYNC_TIMEOUT_NS);
+    if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) {
+        LOGW("Present not completed by the GPU");
+    }
+    ps->DeleteSync(fence);
+}
@@ -0,0 +1,64 @@
+#ifndef SC_PRESENT_SYNC_H
+#define SC_PRESENT_SYNC_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_opengl.h>
+
+#include "opengl.h"
+
+// Waiting longer for the GPU means that the driver is stuck
+#define SC_PRESENT_SYNC_TIMEOUT_NS UINT64_C(100000000) // 100ms
+
+enum sc_present_sync_backend {
+    SC_PRESENT_SYNC_BACKEND_NONE,
+    // A fence after each present, waited for by the rendering thread
+    SC_PRESENT_SYNC_BACKEND_GL_FENCE,
+    // The DXGI queue of frames rendered ahead is limited to 1
+    SC_PRESENT_SYNC_BACKEND_D3D11,
+};
+
+/**
+ * Low-latency presentation (--low-latency-present).
+ *
+ * By default, the driver may queue several frames rendered ahead of the one
+ * scanned out, each one adding a refresh period of latency. The CPU is
+ * explicitly synchronized with the GPU so that at most one frame is in flight:
+ *  - with an OpenGL renderer (3.2+ or ES 3.0+), a fence is inserted after
+ *    each SDL_RenderPresent(), and waited for right away, so that the present
+ *    completes before the next frame is rendered;
+ *  - with the direct3d11 renderer (which presents through a DXGI flip-model
+ *    swap chain on Windows 8+), the maximum frame latency of the DXGI device
+ *    is set to 1.
+ *
+ * The render thread (or the main thread) returns once the frame is presented,
+ * so the stamp of SC_LATENCY_STAGE_PRESENT is the present latency.
+ */
+struct sc_present_sync {
+    enum sc_present_sync_backend backend;
+
+    GLsync (*FenceSync)(GLenum condition, GLbitfield flags);
+    GLenum (*ClientWaitSync)(GLsync sync, GLbitfield flags, GLuint64 timeout);
+    void (*DeleteSync)(GLsync sync);
+};
+
+/**
+ * Select the synchronization supported by the renderer
+ *
+ * `gl` is the OpenGL context of the renderer, NULL if it is not an OpenGL
+ * renderer. Return false if none is supported (presentation is then left to
+ * the driver).
+ */
+bool
+sc_present_sync_init(struct sc_present_sync *ps, SDL_Renderer *renderer,
+                     struct sc_opengl *gl);
+
+/**
+ * Wait for the frame just presented (after SDL_RenderPresent())
+ */
+void
+sc_present_sync_wait(struct sc_present_sync *ps);
+
+#endif
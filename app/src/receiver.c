@@ -29,6 +29,8 @@ sc_receiver_init(struct sc_receiver *receiver, sc_socket control_socket,
     receiver->control_socket = control_socket;
     receiver->acksync = NULL;
     receiver->uhid_devices = NULL;
+    receiver->clock_sync = NULL;
+    receiver->pose_buffer = NULL;
 
     assert(cbs && cbs->on_ended);
     receiver->cbs = cbs;
@@ -151,6 +153,59 @@ process_msg(struct sc_receiver *receiver, struct sc_device_msg *msg) {
             }
 
             break;
+        case DEVICE_MSG_TYPE_CLOCK_SYNC:
+            if (!receiver->clock_sync) {
+                LOGE("Received unexpected clock sync message");
+                return;
+            }
+
+            // Handled directly from the receiver thread, to not add any delay
+            sc_clock_sync_on_pong(receiver->clock_sync,
+                                  msg->clock_sync.client_time,
+                                  msg->clock_sync.receive_time,
+                                  msg->clock_sync.send_time);
+            // No allocation to free in the msg
+            break;
+        case DEVICE_MSG_TYPE_TIME_PONG:
+            if (!receiver->clock_sync) {
+                LOGE("Received unexpected time sync message");
+                return;
+            }
+
+            sc_clock_sync_on_time_pong(receiver->clock_sync,
+                                       msg->time_pong.client_time,
+                                       msg->time_pong.receive_time,
+                                       msg->time_pong.send_time,
+                                       msg->time_pong.receive_wall_time,
+                                       msg->time_pong.send_wall_time);
+            // No allocation to free in the msg
+            break;
+        case DEVICE_MSG_TYPE_POSE:
+            if (!receiver->pose_buffer) {
+                LOGE("Received unexpected pose message");
+                return;
+            }
+
+            sc_pose_buffer_push(receiver->pose_buffer, msg->pose.pts,
+                                msg->pose.has_position, msg->pose.rotation,
+                                msg->pose.translation);
+            // No allocation to free in the msg
+            break;
+        case DEVICE_MSG_TYPE_ENCODER_LATENCY: {
+            const struct sc_device_msg_latency *c =
+                &msg->encoder_latency.capture_to_dequeue;
+            const struct sc_device_msg_latency *w =
+                &msg->encoder_latency.dequeue_to_write;
+            // Logged alongside the client decoding latency (--print-fps)
+            LOGI("Encoder latency (%" PRIu32 " frames): capture->dequeue "
+                 "p50/p95/p99/max %.1f/%.1f/%.1f/%.1f ms, dequeue->write "
+                 "%.1f/%.1f/%.1f/%.1f ms", msg->encoder_latency.frame_count,
+                 c->p50 / 1000., c->p95 / 1000., c->p99 / 1000.,
+                 c->max / 1000., w->p50 / 1000., w->p95 / 1000.,
+                 w->p99 / 1000., w->max / 1000.);
+            // No allocation to free in the msg
+            break;
+        }
     }
 }
 
@@ -183,32 +238,45 @@ run_receiver(void *data) {
     struct sc_receiver *receiver = data;
 
     static uint8_t buf[DEVICE_MSG_MAX_SIZE];
+    // The messages are deserialized in place from buf[head..tail]
     size_t head = 0;
+    size_t tail = 0;
 
     bool error = false;
 
     for (;;) {
-        assert(head < DEVICE_MSG_MAX_SIZE);
-        ssize_t r = net_recv(receiver->control_socket, buf + head,
-                             DEVICE_MSG_MAX_SIZE - head);
+        if (tail == DEVICE_MSG_MAX_SIZE) {
+            // Only the start of an incomplete message remains at the end of
+            // the buffer: move it to the beginning (this is rare, most reads
+            // end on a message boundary)
+            assert(head);
+            tail -= head;
+            memmove(buf, &buf[head], tail);
+            head = 0;
+        }
+
+        assert(tail < DEVICE_MSG_MAX_SIZE);
+        ssize_t r = net_recv(receiver->control_socket, buf + tail,
+                             DEVICE_MSG_MAX_SIZE - tail);
         if (r <= 0) {
             LOGD("Receiver stopped");
             // device disconnected: keep error=false
             break;
         }
 
-        head += r;
-        ssize_t consumed = process_msgs(receiver, buf, head);
+        tail += r;
+        ssize_t consumed = process_msgs(receiver, &buf[head], tail - head);
         if (consumed == -1) {
             // an error occurred
             error = true;
             break;
         }
 
-        if (consumed) {
-            head -= consumed;
-            // shift the remaining data in the buffer
-            memmove(buf, &buf[consumed], head);
+        head += consumed;
+        if (head == tail) {
+            // Everything has been consumed, restart from the beginning
+            head = 0;
+            tail = 0;
         }
     }
 
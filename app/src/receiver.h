@@ -5,6 +5,8 @@
 
 #include <stdbool.h>
 
+#include "clock_sync.h"
+#include "pose_buffer.h"
 #include "uhid/uhid_output.h"
 #include "util/acksync.h"
 #include "util/net.h"
@@ -19,6 +21,8 @@ struct sc_receiver {
 
     struct sc_acksync *acksync;
     struct sc_uhid_devices *uhid_devices;
+    struct sc_clock_sync *clock_sync;
+    struct sc_pose_buffer *pose_buffer;
 
     const struct sc_receiver_callbacks *cbs;
     void *cbs_userdata;
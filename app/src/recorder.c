@@ -1,11 +1,18 @@
 #include "recorder.h"
 
 #include <assert.h>
+#include <stdio.h>
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/time.h>
 #include <libavutil/display.h>
 
+#include "async_avio.h"
+#include "compat.h"
+#include "frame_header.h"
+#include "memory_budget.h"
+#include "util/alloc_stats.h"
+#include "util/binary.h"
 #include "util/log.h"
 #include "util/str.h"
 
@@ -34,6 +41,15 @@ find_muxer(const char *name) {
     return oformat;
 }
 
+// The queued packets are accounted in the memory budget, except the config
+// packets (which are never dropped)
+static void
+sc_recorder_packet_release(const AVPacket *packet) {
+    if (packet->pts != AV_NOPTS_VALUE) {
+        sc_memory_budget_release(SC_MEMORY_STREAM, packet->size);
+    }
+}
+
 static AVPacket *
 sc_recorder_packet_ref(const AVPacket *packet) {
     AVPacket *p = av_packet_alloc();
@@ -50,10 +66,22 @@ sc_recorder_packet_ref(const AVPacket *packet) {
     return p;
 }
 
+// The mutex must be locked
+static AVPacket *
+sc_recorder_queue_pop(struct sc_recorder *recorder,
+                      struct sc_recorder_queue *queue) {
+    AVPacket *p = sc_vecdeque_pop(queue);
+    assert(recorder->queued_bytes >= (size_t) p->size);
+    recorder->queued_bytes -= p->size;
+    sc_recorder_packet_release(p);
+    return p;
+}
+
 static void
 sc_recorder_queue_clear(struct sc_recorder_queue *queue) {
     while (!sc_vecdeque_is_empty(queue)) {
         AVPacket *p = sc_vecdeque_pop(queue);
+        sc_recorder_packet_release(p);
         av_packet_free(&p);
     }
 }
@@ -95,6 +123,39 @@ sc_recorder_set_extradata(AVStream *ostream, const AVPacket *packet) {
     return true;
 }
 
+// The config of a new encoding session (e.g. on device orientation change) is
+// passed with the next media packet, as side data (see packet_merger.h). If it
+// differs from the extradata (the config of the first session), it is written
+// in-band, so that the recording remains decodable after the change.
+static bool
+sc_recorder_inline_new_config(AVStream *ostream, AVPacket *packet) {
+    SC_AV_PACKET_SIDE_DATA_SIZE size;
+    const uint8_t *config =
+        av_packet_get_side_data(packet, AV_PKT_DATA_NEW_EXTRADATA, &size);
+    if (!config || !size) {
+        return true;
+    }
+
+    AVCodecParameters *par = ostream->codecpar;
+    if ((int) size != par->extradata_size
+            || memcmp(config, par->extradata, size)) {
+        // Rare, so the packet (shared with the decoder) may be copied
+        int media_size = packet->size;
+        if (av_grow_packet(packet, size)) {
+            LOG_OOM();
+            return false;
+        }
+
+        memmove(packet->data + size, packet->data, media_size);
+        memcpy(packet->data, config, size);
+    }
+
+    // The config is either in the extradata or in-band, the muxer must not
+    // handle it again
+    av_packet_shrink_side_data(packet, AV_PKT_DATA_NEW_EXTRADATA, 0);
+    return true;
+}
+
 static inline void
 sc_recorder_rescale_packet(AVStream *stream, AVPacket *packet) {
     av_packet_rescale_ts(packet, SCRCPY_TIME_BASE, stream->time_base);
@@ -104,6 +165,9 @@ static bool
 sc_recorder_write_stream(struct sc_recorder *recorder,
                          struct sc_recorder_stream *st, AVPacket *packet) {
     AVStream *stream = recorder->ctx->streams[st->index];
+    // The PTS are relative to the start of the segment
+    packet->pts -= recorder->segment_start;
+    packet->dts = packet->pts;
     sc_recorder_rescale_packet(stream, packet);
     if (st->last_pts != AV_NOPTS_VALUE && packet->pts <= st->last_pts) {
         LOGD("Fixing PTS non monotonically increasing in stream %d "
@@ -117,6 +181,95 @@ sc_recorder_write_stream(struct sc_recorder *recorder,
     return av_interleaved_write_frame(recorder->ctx, packet) >= 0;
 }
 
+static bool
+sc_recorder_open_timestamps_file(struct sc_recorder *recorder) {
+    assert(recorder->timestamps);
+
+    // "<output filename>.ts.idx"
+    size_t len = strlen(recorder->output_filename);
+    recorder->timestamps_filename = malloc(len + sizeof(".ts.idx"));
+    if (!recorder->timestamps_filename) {
+        LOG_OOM();
+        return false;
+    }
+
+    memcpy(recorder->timestamps_filename, recorder->output_filename, len);
+    memcpy(&recorder->timestamps_filename[len], ".ts.idx", sizeof(".ts.idx"));
+
+    recorder->timestamps_file = fopen(recorder->timestamps_filename, "wb");
+    if (!recorder->timestamps_file) {
+        LOGE("Could not open timestamp index: %s",
+             recorder->timestamps_filename);
+        free(recorder->timestamps_filename);
+        return false;
+    }
+
+    uint8_t header[sizeof(struct timestamp_index_header)];
+    memcpy(header, TIMESTAMP_INDEX_MAGIC, sizeof(TIMESTAMP_INDEX_MAGIC));
+    sc_write32le(&header[4], TIMESTAMP_INDEX_VERSION);
+
+    if (fwrite(header, sizeof(header), 1, recorder->timestamps_file) != 1) {
+        LOGE("Could not write timestamp index: %s",
+             recorder->timestamps_filename);
+        fclose(recorder->timestamps_file);
+        free(recorder->timestamps_filename);
+        return false;
+    }
+
+    LOGI("Recording timestamps to %s", recorder->timestamps_filename);
+    return true;
+}
+
+static void
+sc_recorder_close_timestamps_file(struct sc_recorder *recorder) {
+    assert(recorder->timestamps);
+
+    if (fclose(recorder->timestamps_file)) {
+        LOGW("Could not close timestamp index: %s",
+             recorder->timestamps_filename);
+    } else if (recorder->uploader) {
+        sc_uploader_push(recorder->uploader, recorder->timestamps_filename);
+    }
+    free(recorder->timestamps_filename);
+}
+
+// The packet PTS is relative to pts_origin (in microseconds, not rescaled yet)
+static bool
+sc_recorder_write_timestamp(struct sc_recorder *recorder,
+                            const AVPacket *packet, int64_t pts_origin) {
+    assert(recorder->timestamps);
+
+    // The capture timestamp exported by the demuxer, if any
+    AVDictionary *metadata = NULL;
+    SC_AV_PACKET_SIDE_DATA_SIZE size;
+    const uint8_t *data =
+        av_packet_get_side_data(packet, AV_PKT_DATA_STRINGS_METADATA, &size);
+    if (data && av_packet_unpack_dictionary(data, size, &metadata) < 0) {
+        // Fall back to the PTS
+        metadata = NULL;
+    }
+
+    int64_t timestamp_ms =
+        sc_frame_clock_get_timestamp(&recorder->clock, metadata,
+                                     packet->pts + pts_origin);
+    av_dict_free(&metadata);
+
+    // The PTS in the segment
+    int64_t pts = packet->pts - recorder->segment_start;
+
+    uint8_t entry[sizeof(struct timestamp_index_entry)];
+    sc_write64le(entry, (uint64_t) pts);
+    sc_write64le(&entry[8], (uint64_t) timestamp_ms);
+
+    if (fwrite(entry, sizeof(entry), 1, recorder->timestamps_file) != 1) {
+        LOGE("Could not write timestamp index: %s",
+             recorder->timestamps_filename);
+        return false;
+    }
+
+    return true;
+}
+
 static inline bool
 sc_recorder_write_video(struct sc_recorder *recorder, AVPacket *packet) {
     return sc_recorder_write_stream(recorder, &recorder->video_stream, packet);
@@ -128,46 +281,232 @@ sc_recorder_write_audio(struct sc_recorder *recorder, AVPacket *packet) {
 }
 
 static bool
-sc_recorder_open_output_file(struct sc_recorder *recorder) {
+sc_recorder_set_orientation(AVStream *stream, enum sc_orientation orientation) {
+    assert(!sc_orientation_is_mirror(orientation));
+
+    uint8_t *raw_data;
+#ifdef SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
+    AVPacketSideData *sd =
+        av_packet_side_data_new(&stream->codecpar->coded_side_data,
+                                &stream->codecpar->nb_coded_side_data,
+                                AV_PKT_DATA_DISPLAYMATRIX,
+                                sizeof(int32_t) * 9, 0);
+    if (!sd) {
+        LOG_OOM();
+        return false;
+    }
+
+    raw_data = sd->data;
+#else
+    raw_data = av_stream_new_side_data(stream, AV_PKT_DATA_DISPLAYMATRIX,
+                                      sizeof(int32_t) * 9);
+    if (!raw_data) {
+        LOG_OOM();
+        return false;
+    }
+#endif
+
+    int32_t *matrix = (int32_t *) raw_data;
+
+    unsigned rotation = orientation;
+    unsigned angle = rotation * 90;
+
+    av_display_rotation_set(matrix, angle);
+
+    return true;
+}
+
+// "<stem>-<index>.<extension>", or "<filename>-<index>" without extension
+static char *
+sc_recorder_get_segment_filename(const char *filename, unsigned index) {
+    const char *ext = strrchr(filename, '.');
+    const char *sep = strrchr(filename, '/');
+#ifdef _WIN32
+    const char *backslash = strrchr(filename, '\\');
+    if (backslash && (!sep || backslash > sep)) {
+        sep = backslash;
+    }
+#endif
+    if (ext && sep && ext < sep) {
+        // The dot is in a directory name
+        ext = NULL;
+    }
+
+    size_t stem_len = ext ? (size_t) (ext - filename) : strlen(filename);
+    const char *suffix = ext ? ext : "";
+
+    // 10 digits for the index
+    size_t size = stem_len + 1 + 10 + strlen(suffix) + 1;
+    char *s = malloc(size);
+    if (!s) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    snprintf(s, size, "%.*s-%03u%s", (int) stem_len, filename, index, suffix);
+    return s;
+}
+
+static AVFormatContext *
+sc_recorder_open_output_file(struct sc_recorder *recorder,
+                             const char *filename) {
     const char *format_name = sc_recorder_get_format_name(recorder->format);
     assert(format_name);
     const AVOutputFormat *format = find_muxer(format_name);
     if (!format) {
         LOGE("Could not find muxer");
-        return false;
+        return NULL;
     }
 
-    recorder->ctx = avformat_alloc_context();
-    if (!recorder->ctx) {
+    AVFormatContext *ctx = avformat_alloc_context();
+    if (!ctx) {
         LOG_OOM();
-        return false;
+        return NULL;
     }
 
-    int ret = avio_open(&recorder->ctx->pb, recorder->filename,
-                        AVIO_FLAG_WRITE);
-    if (ret < 0) {
-        LOGE("Failed to open output file: %s", recorder->filename);
-        avformat_free_context(recorder->ctx);
-        return false;
+    // Written from a background thread, so that a slow disk does not stall
+    // the muxer (and back up the packet queues)
+    ctx->pb = sc_async_avio_open(filename);
+    if (!ctx->pb) {
+        LOGE("Failed to open output file: %s", filename);
+        avformat_free_context(ctx);
+        return NULL;
     }
+    ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
 
     // contrary to the deprecated API (av_oformat_next()), av_muxer_iterate()
     // returns (on purpose) a pointer-to-const, but AVFormatContext.oformat
     // still expects a pointer-to-non-const (it has not be updated accordingly)
     // <https://github.com/FFmpeg/FFmpeg/commit/0694d8702421e7aff1340038559c438b61bb30dd>
-    recorder->ctx->oformat = (AVOutputFormat *) format;
+    ctx->oformat = (AVOutputFormat *) format;
 
-    av_dict_set(&recorder->ctx->metadata, "comment",
+    av_dict_set(&ctx->metadata, "comment",
                 "Recorded by scrcpy " SCRCPY_VERSION, 0);
 
-    LOGI("Recording started to %s file: %s", format_name, recorder->filename);
+    LOGI("Recording started to %s file: %s", format_name, filename);
+    return ctx;
+}
+
+// Return false if the data could not be written entirely
+static bool
+sc_recorder_close_output_file(AVFormatContext *ctx) {
+    bool ok = sc_async_avio_close(ctx->pb);
+    avformat_free_context(ctx);
+    return ok;
+}
+
+static bool
+sc_recorder_write_header(struct sc_recorder *recorder) {
+    AVDictionary *opts = NULL;
+    if (recorder->fragmented) {
+        // Write a fragment on every video key frame, with an empty moov atom
+        // at the beginning, so that the file is playable even if the
+        // recording is interrupted
+        if (av_dict_set(&opts, "movflags",
+                        "frag_keyframe+empty_moov+default_base_moof", 0) < 0) {
+            LOG_OOM();
+            return false;
+        }
+    }
+
+    int ret = avformat_write_header(recorder->ctx, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        LOGE("Failed to write header to %s", recorder->output_filename);
+        return false;
+    }
+
     return true;
 }
 
-static void
-sc_recorder_close_output_file(struct sc_recorder *recorder) {
-    avio_close(recorder->ctx->pb);
-    avformat_free_context(recorder->ctx);
+// Finish the current segment and start the next one from the packet having
+// the given PTS (a video key frame)
+static bool
+sc_recorder_next_segment(struct sc_recorder *recorder, int64_t start) {
+    assert(recorder->segment_duration);
+
+    AVFormatContext *previous_ctx = recorder->ctx;
+    char *previous_filename = recorder->output_filename;
+
+    char *filename = sc_recorder_get_segment_filename(recorder->filename,
+                                                      recorder->segment_index
+                                                          + 1);
+    if (!filename) {
+        return false;
+    }
+
+    AVFormatContext *ctx = sc_recorder_open_output_file(recorder, filename);
+    if (!ctx) {
+        free(filename);
+        return false;
+    }
+
+    // Same streams, in the same order (the packets keep their stream index)
+    for (unsigned i = 0; i < previous_ctx->nb_streams; ++i) {
+        AVStream *in = previous_ctx->streams[i];
+        AVStream *out = avformat_new_stream(ctx, NULL);
+        if (!out) {
+            LOG_OOM();
+            goto error;
+        }
+
+        // The extradata (and the display matrix with the recent FFmpeg
+        // versions) are copied along with the codec parameters
+        if (avcodec_parameters_copy(out->codecpar, in->codecpar) < 0) {
+            LOG_OOM();
+            goto error;
+        }
+
+#ifndef SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
+        if ((int) i == recorder->video_stream.index
+                && recorder->orientation != SC_ORIENTATION_0
+                && !sc_recorder_set_orientation(out, recorder->orientation)) {
+            goto error;
+        }
+#endif
+    }
+
+    recorder->ctx = ctx;
+    recorder->output_filename = filename;
+
+    if (!sc_recorder_write_header(recorder)) {
+        recorder->ctx = previous_ctx;
+        recorder->output_filename = previous_filename;
+        goto error;
+    }
+
+    if (av_write_trailer(previous_ctx) < 0) {
+        // The next segments may still be valid
+        LOGE("Failed to write trailer to %s", previous_filename);
+    }
+    if (!sc_recorder_close_output_file(previous_ctx)) {
+        LOGE("Failed to write %s", previous_filename);
+    } else if (recorder->uploader) {
+        // Upload the finished segment while the next one is recorded
+        sc_uploader_push(recorder->uploader, previous_filename);
+    }
+    free(previous_filename);
+
+    ++recorder->segment_index;
+    recorder->segment_start = start;
+    recorder->video_stream.last_pts = AV_NOPTS_VALUE;
+    recorder->audio_stream.last_pts = AV_NOPTS_VALUE;
+
+    if (recorder->timestamps) {
+        sc_recorder_close_timestamps_file(recorder);
+        if (!sc_recorder_open_timestamps_file(recorder)) {
+            // Do not close it again at the end
+            recorder->timestamps = false;
+            return false;
+        }
+    }
+
+    return true;
+
+error:
+    sc_recorder_close_output_file(ctx);
+    free(filename);
+    return false;
 }
 
 static inline bool
@@ -209,14 +548,14 @@ sc_recorder_process_header(struct sc_recorder *recorder) {
     AVPacket *video_pkt = NULL;
     if (!sc_vecdeque_is_empty(&recorder->video_queue)) {
         assert(recorder->video);
-        video_pkt = sc_vecdeque_pop(&recorder->video_queue);
+        video_pkt = sc_recorder_queue_pop(recorder, &recorder->video_queue);
     }
 
     AVPacket *audio_pkt = NULL;
     if (recorder->audio_expects_config_packet &&
             !sc_vecdeque_is_empty(&recorder->audio_queue)) {
         assert(recorder->audio);
-        audio_pkt = sc_vecdeque_pop(&recorder->audio_queue);
+        audio_pkt = sc_recorder_queue_pop(recorder, &recorder->audio_queue);
     }
 
     sc_mutex_unlock(&recorder->mutex);
@@ -253,9 +592,8 @@ sc_recorder_process_header(struct sc_recorder *recorder) {
         }
     }
 
-    bool ok = avformat_write_header(recorder->ctx, NULL) >= 0;
+    bool ok = sc_recorder_write_header(recorder);
     if (!ok) {
-        LOGE("Failed to write header to %s", recorder->filename);
         goto end;
     }
 
@@ -281,6 +619,18 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
         return false;
     }
 
+    // The timestamps are configured before the first video packet is pushed,
+    // so the flag is up to date once the header is written
+    if (recorder->timestamps) {
+        if (!sc_recorder_open_timestamps_file(recorder)) {
+            recorder->timestamps = false;
+            return false;
+        }
+
+        // Retrieve the boot time if needed (the packets are queued meanwhile)
+        sc_frame_clock_prepare(&recorder->clock);
+    }
+
     AVPacket *video_pkt = NULL;
     AVPacket *audio_pkt = NULL;
 
@@ -321,11 +671,13 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
                 && sc_vecdeque_is_empty(&recorder->audio_queue)));
 
         if (!video_pkt && !sc_vecdeque_is_empty(&recorder->video_queue)) {
-            video_pkt = sc_vecdeque_pop(&recorder->video_queue);
+            video_pkt =
+                sc_recorder_queue_pop(recorder, &recorder->video_queue);
         }
 
         if (!audio_pkt && !sc_vecdeque_is_empty(&recorder->audio_queue)) {
-            audio_pkt = sc_vecdeque_pop(&recorder->audio_queue);
+            audio_pkt =
+                sc_recorder_queue_pop(recorder, &recorder->audio_queue);
         }
 
         if (recorder->stopped && !video_pkt && !audio_pkt) {
@@ -340,8 +692,8 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
         sc_mutex_unlock(&recorder->mutex);
 
         // Ignore further config packets (e.g. on device orientation
-        // change). The next non-config packet will have the config packet
-        // data prepended.
+        // change). The next non-config packet carries the config packet
+        // data (see sc_recorder_inline_new_config()).
         if (video_pkt && video_pkt->pts == AV_NOPTS_VALUE) {
             av_packet_free(&video_pkt);
             video_pkt = NULL;
@@ -381,6 +733,13 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
         assert(pts_origin != AV_NOPTS_VALUE);
 
         if (video_pkt) {
+            AVStream *video_stream =
+                recorder->ctx->streams[recorder->video_stream.index];
+            if (!sc_recorder_inline_new_config(video_stream, video_pkt)) {
+                error = true;
+                goto end;
+            }
+
             video_pkt->pts -= pts_origin;
             video_pkt->dts = video_pkt->pts;
 
@@ -389,7 +748,12 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
                 video_pkt_previous->duration = video_pkt->pts
                                              - video_pkt_previous->pts;
 
-                bool ok = sc_recorder_write_video(recorder, video_pkt_previous);
+                bool ok = !recorder->timestamps
+                       || sc_recorder_write_timestamp(recorder,
+                                                      video_pkt_previous,
+                                                      pts_origin);
+                ok = ok && sc_recorder_write_video(recorder,
+                                                   video_pkt_previous);
                 av_packet_free(&video_pkt_previous);
                 if (!ok) {
                     LOGE("Could not record video packet");
@@ -398,10 +762,30 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
                 }
             }
 
+            // A new segment may only start on a key frame
+            if (recorder->segment_duration
+                    && (video_pkt->flags & AV_PKT_FLAG_KEY)
+                    && video_pkt->pts - recorder->segment_start
+                        >= SC_TICK_TO_US(recorder->segment_duration)) {
+                if (!sc_recorder_next_segment(recorder, video_pkt->pts)) {
+                    LOGE("Could not start a new recording segment");
+                    error = true;
+                    goto end;
+                }
+            }
+
             video_pkt_previous = video_pkt;
             video_pkt = NULL;
         }
 
+        if (audio_pkt
+                && audio_pkt->pts - pts_origin < recorder->segment_start) {
+            // The previous segment is already finished
+            LOGD("Audio packet before the start of the segment dropped");
+            av_packet_free(&audio_pkt);
+            audio_pkt = NULL;
+        }
+
         if (audio_pkt) {
             audio_pkt->pts -= pts_origin;
             audio_pkt->dts = audio_pkt->pts;
@@ -423,7 +807,9 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
     if (last) {
         // assign an arbitrary duration to the last packet
         last->duration = 100000;
-        bool ok = sc_recorder_write_video(recorder, last);
+        bool ok = !recorder->timestamps
+               || sc_recorder_write_timestamp(recorder, last, pts_origin);
+        ok = ok && sc_recorder_write_video(recorder, last);
         if (!ok) {
             // failing to write the last frame is not very serious, no
             // future frame may depend on it, so the resulting file
@@ -435,7 +821,7 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
 
     int ret = av_write_trailer(recorder->ctx);
     if (ret < 0) {
-        LOGE("Failed to write trailer to %s", recorder->filename);
+        LOGE("Failed to write trailer to %s", recorder->output_filename);
         error = false;
     }
 
@@ -447,18 +833,44 @@ end:
         av_packet_free(&audio_pkt);
     }
 
+    if (recorder->timestamps) {
+        sc_recorder_close_timestamps_file(recorder);
+    }
+
     return !error;
 }
 
 static bool
 sc_recorder_record(struct sc_recorder *recorder) {
-    bool ok = sc_recorder_open_output_file(recorder);
-    if (!ok) {
+    if (recorder->segment_duration) {
+        recorder->output_filename =
+            sc_recorder_get_segment_filename(recorder->filename, 0);
+        if (!recorder->output_filename) {
+            return false;
+        }
+    } else {
+        recorder->output_filename = strdup(recorder->filename);
+        if (!recorder->output_filename) {
+            LOG_OOM();
+            return false;
+        }
+    }
+
+    recorder->ctx =
+        sc_recorder_open_output_file(recorder, recorder->output_filename);
+    if (!recorder->ctx) {
+        free(recorder->output_filename);
         return false;
     }
 
-    ok = sc_recorder_process_packets(recorder);
-    sc_recorder_close_output_file(recorder);
+    bool ok = sc_recorder_process_packets(recorder);
+    if (!sc_recorder_close_output_file(recorder->ctx)) {
+        LOGE("Failed to write %s", recorder->output_filename);
+        ok = false;
+    } else if (recorder->uploader) {
+        sc_uploader_push(recorder->uploader, recorder->output_filename);
+    }
+    free(recorder->output_filename);
     return ok;
 }
 
@@ -466,6 +878,8 @@ static int
 run_recorder(void *data) {
     struct sc_recorder *recorder = data;
 
+    (void) sc_alloc_stats_enter(SC_ALLOC_RECORDER);
+
     // Recording is a background task
     bool ok = sc_thread_set_priority(SC_THREAD_PRIORITY_LOW);
     (void) ok; // We don't care if it worked
@@ -478,8 +892,16 @@ run_recorder(void *data) {
     // Discard pending packets
     sc_recorder_queue_clear(&recorder->video_queue);
     sc_recorder_queue_clear(&recorder->audio_queue);
+    recorder->queued_bytes = 0;
+    uint64_t dropped_video = recorder->dropped_video;
+    uint64_t dropped_audio = recorder->dropped_audio;
     sc_mutex_unlock(&recorder->mutex);
 
+    if (dropped_video || dropped_audio) {
+        LOGW("Recording: %" PRIu64 " video and %" PRIu64 " audio packets "
+             "dropped (the disk was too slow)", dropped_video, dropped_audio);
+    }
+
     if (success) {
         const char *format_name = sc_recorder_get_format_name(recorder->format);
         LOGI("Recording complete to %s file: %s", format_name,
@@ -495,42 +917,6 @@ run_recorder(void *data) {
     return 0;
 }
 
-static bool
-sc_recorder_set_orientation(AVStream *stream, enum sc_orientation orientation) {
-    assert(!sc_orientation_is_mirror(orientation));
-
-    uint8_t *raw_data;
-#ifdef SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
-    AVPacketSideData *sd =
-        av_packet_side_data_new(&stream->codecpar->coded_side_data,
-                                &stream->codecpar->nb_coded_side_data,
-                                AV_PKT_DATA_DISPLAYMATRIX,
-                                sizeof(int32_t) * 9, 0);
-    if (!sd) {
-        LOG_OOM();
-        return false;
-    }
-
-    raw_data = sd->data;
-#else
-    raw_data = av_stream_new_side_data(stream, AV_PKT_DATA_DISPLAYMATRIX,
-                                      sizeof(int32_t) * 9);
-    if (!raw_data) {
-        LOG_OOM();
-        return false;
-    }
-#endif
-
-    int32_t *matrix = (int32_t *) raw_data;
-
-    unsigned rotation = orientation;
-    unsigned angle = rotation * 90;
-
-    av_display_rotation_set(matrix, angle);
-
-    return true;
-}
-
 static bool
 sc_recorder_video_packet_sink_open(struct sc_packet_sink *sink,
                                    AVCodecContext *ctx) {
@@ -603,9 +989,42 @@ sc_recorder_video_packet_sink_push(struct sc_packet_sink *sink,
         return false;
     }
 
+    // The config packets are never dropped
+    if (packet->pts != AV_NOPTS_VALUE) {
+        bool full = recorder->queued_bytes + packet->size
+                  > SC_RECORDER_QUEUE_MAX_BYTES;
+        // The next packets reference the dropped ones: resume on a key frame
+        // only
+        bool resumable = !recorder->video_overflow
+                      || (packet->flags & AV_PKT_FLAG_KEY);
+        if (!full && resumable) {
+            // Enforced before the packet is referenced
+            full = !sc_memory_budget_acquire(SC_MEMORY_STREAM, packet->size);
+        }
+
+        if (recorder->video_overflow) {
+            if (full || !resumable) {
+                ++recorder->dropped_video;
+                sc_mutex_unlock(&recorder->mutex);
+                return true;
+            }
+            recorder->video_overflow = false;
+        } else if (full) {
+            if (!recorder->dropped_video) {
+                LOGW("Recording queue full, dropping video packets until the "
+                     "next key frame");
+            }
+            recorder->video_overflow = true;
+            ++recorder->dropped_video;
+            sc_mutex_unlock(&recorder->mutex);
+            return true;
+        }
+    }
+
     AVPacket *rec = sc_recorder_packet_ref(packet);
     if (!rec) {
         LOG_OOM();
+        sc_recorder_packet_release(packet);
         sc_mutex_unlock(&recorder->mutex);
         return false;
     }
@@ -615,10 +1034,14 @@ sc_recorder_video_packet_sink_push(struct sc_packet_sink *sink,
     bool ok = sc_vecdeque_push(&recorder->video_queue, rec);
     if (!ok) {
         LOG_OOM();
+        sc_recorder_packet_release(rec);
+        av_packet_free(&rec);
         sc_mutex_unlock(&recorder->mutex);
         return false;
     }
 
+    recorder->queued_bytes += rec->size;
+
     sc_cond_signal(&recorder->cond);
 
     sc_mutex_unlock(&recorder->mutex);
@@ -690,9 +1113,23 @@ sc_recorder_audio_packet_sink_push(struct sc_packet_sink *sink,
         return false;
     }
 
+    if (packet->pts != AV_NOPTS_VALUE
+            && (recorder->queued_bytes + packet->size
+                    > SC_RECORDER_QUEUE_MAX_BYTES
+                || !sc_memory_budget_acquire(SC_MEMORY_STREAM,
+                                             packet->size))) {
+        if (!recorder->dropped_audio) {
+            LOGW("Recording queue full, dropping audio packets");
+        }
+        ++recorder->dropped_audio;
+        sc_mutex_unlock(&recorder->mutex);
+        return true;
+    }
+
     AVPacket *rec = sc_recorder_packet_ref(packet);
     if (!rec) {
         LOG_OOM();
+        sc_recorder_packet_release(packet);
         sc_mutex_unlock(&recorder->mutex);
         return false;
     }
@@ -702,10 +1139,14 @@ sc_recorder_audio_packet_sink_push(struct sc_packet_sink *sink,
     bool ok = sc_vecdeque_push(&recorder->audio_queue, rec);
     if (!ok) {
         LOG_OOM();
+        sc_recorder_packet_release(rec);
+        av_packet_free(&rec);
         sc_mutex_unlock(&recorder->mutex);
         return false;
     }
 
+    recorder->queued_bytes += rec->size;
+
     sc_cond_signal(&recorder->cond);
 
     sc_mutex_unlock(&recorder->mutex);
@@ -737,7 +1178,8 @@ sc_recorder_stream_init(struct sc_recorder_stream *stream) {
 bool
 sc_recorder_init(struct sc_recorder *recorder, const char *filename,
                  enum sc_record_format format, bool video, bool audio,
-                 enum sc_orientation orientation,
+                 enum sc_orientation orientation, sc_tick segment_duration,
+                 bool fragmented,
                  const struct sc_recorder_callbacks *cbs, void *cbs_userdata) {
     assert(!sc_orientation_is_mirror(orientation));
 
@@ -765,6 +1207,10 @@ sc_recorder_init(struct sc_recorder *recorder, const char *filename,
 
     sc_vecdeque_init(&recorder->video_queue);
     sc_vecdeque_init(&recorder->audio_queue);
+    recorder->queued_bytes = 0;
+    recorder->video_overflow = false;
+    recorder->dropped_video = 0;
+    recorder->dropped_audio = 0;
     recorder->stopped = false;
 
     recorder->video_init = false;
@@ -777,6 +1223,17 @@ sc_recorder_init(struct sc_recorder *recorder, const char *filename,
 
     recorder->format = format;
 
+    recorder->segment_duration = segment_duration;
+    recorder->fragmented = fragmented;
+    recorder->output_filename = NULL;
+    recorder->segment_index = 0;
+    recorder->segment_start = 0;
+
+    recorder->timestamps = false;
+    recorder->timestamps_filename = NULL;
+
+    recorder->uploader = NULL;
+
     assert(cbs && cbs->on_ended);
     recorder->cbs = cbs;
     recorder->cbs_userdata = cbs_userdata;
@@ -812,6 +1269,29 @@ error_free_filename:
     return false;
 }
 
+void
+sc_recorder_configure_timestamps(struct sc_recorder *recorder,
+                                 struct sc_clock_sync *clock_sync,
+                                 const char *serial, int64_t device_boot_time) {
+    assert(recorder->video);
+    assert(!recorder->timestamps);
+
+    sc_frame_clock_init(&recorder->clock, clock_sync, serial);
+    sc_frame_clock_set_boot_time(&recorder->clock, device_boot_time);
+
+    // The recorder thread reads it once the first video packet is pushed
+    // (with the mutex locked)
+    sc_mutex_lock(&recorder->mutex);
+    recorder->timestamps = true;
+    sc_mutex_unlock(&recorder->mutex);
+}
+
+void
+sc_recorder_set_uploader(struct sc_recorder *recorder,
+                         struct sc_uploader *uploader) {
+    recorder->uploader = uploader;
+}
+
 bool
 sc_recorder_start(struct sc_recorder *recorder) {
     bool ok = sc_thread_create(&recorder->thread, run_recorder,
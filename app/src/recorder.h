@@ -4,15 +4,25 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stdio.h>
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
 
+#include "clock_sync.h"
 #include "coords.h"
+#include "frame_clock.h"
 #include "options.h"
 #include "trait/packet_sink.h"
+#include "uploader.h"
 #include "util/thread.h"
+#include "util/tick.h"
 #include "util/vecdeque.h"
 
+// Maximum size of the packets waiting to be written (video and audio). If the
+// disk is too slow, the packets are dropped (the video packets until the next
+// key frame) rather than consuming memory without limit.
+#define SC_RECORDER_QUEUE_MAX_BYTES (64 * 1024 * 1024)
+
 struct sc_recorder_queue SC_VECDEQUE(AVPacket *);
 
 struct sc_recorder_stream {
@@ -41,6 +51,17 @@ struct sc_recorder {
     enum sc_record_format format;
     AVFormatContext *ctx;
 
+    // If not 0, the recording is split into segments of (at least) this
+    // duration, starting on a video key frame, written to
+    // "<filename stem>-<index>.<extension>"
+    sc_tick segment_duration;
+    // Write fragmented MP4 (playable even if the recording is interrupted)
+    bool fragmented;
+    // Only accessed from the recorder thread
+    char *output_filename; // the current segment, or filename
+    unsigned segment_index;
+    int64_t segment_start; // PTS of the first packet of the segment
+
     sc_thread thread;
     sc_mutex mutex;
     sc_cond cond;
@@ -48,6 +69,11 @@ struct sc_recorder {
     bool stopped;
     struct sc_recorder_queue video_queue;
     struct sc_recorder_queue audio_queue;
+    size_t queued_bytes;
+    // Set when the queue is full, until the next video key frame
+    bool video_overflow;
+    uint64_t dropped_video;
+    uint64_t dropped_audio;
 
     // wake up the recorder thread once the video or audio codec is known
     bool video_init;
@@ -58,6 +84,18 @@ struct sc_recorder {
     struct sc_recorder_stream video_stream;
     struct sc_recorder_stream audio_stream;
 
+    // If set, the capture time of every recorded video frame is written to the
+    // timestamp index (see frame_header.h), only accessed from the recorder
+    // thread once started
+    bool timestamps;
+    char *timestamps_filename; // the index of the current segment
+    FILE *timestamps_file;
+    struct sc_frame_clock clock;
+
+    // If not NULL, each finished file (segment and timestamp index) is pushed
+    // to be uploaded (--upload-dir)
+    struct sc_uploader *uploader;
+
     const struct sc_recorder_callbacks *cbs;
     void *cbs_userdata;
 
@@ -74,9 +112,28 @@ struct sc_recorder_callbacks {
 bool
 sc_recorder_init(struct sc_recorder *recorder, const char *filename,
                  enum sc_record_format format, bool video, bool audio,
-                 enum sc_orientation orientation,
+                 enum sc_orientation orientation, sc_tick segment_duration,
+                 bool fragmented,
                  const struct sc_recorder_callbacks *cbs, void *cbs_userdata);
 
+// Write the timestamp index of the recorded video frames to
+// "<output file>.ts.idx", one per segment (--record-timestamps)
+//
+// The clock_sync may be NULL (without control), the serial is used to
+// retrieve the device boot time in that case (unless device_boot_time, already
+// retrieved, is not 0). It must be called before the first video packet is
+// pushed.
+void
+sc_recorder_configure_timestamps(struct sc_recorder *recorder,
+                                 struct sc_clock_sync *clock_sync,
+                                 const char *serial, int64_t device_boot_time);
+
+// Upload each finished file (--upload-dir), to be called before
+// sc_recorder_start()
+void
+sc_recorder_set_uploader(struct sc_recorder *recorder,
+                         struct sc_uploader *uploader);
+
 bool
 sc_recorder_start(struct sc_recorder *recorder);
 
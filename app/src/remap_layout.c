@@ -0,0 +1,93 @@
+#include "remap_layout.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+static bool
+is_trimmed(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '"'
+        || c == '\'';
+}
+
+static bool
+equals(const char *s, size_t len, const char *value) {
+    return strlen(value) == len && !memcmp(s, value, len);
+}
+
+static bool
+parse_count(const char *s, const char *end, unsigned *value) {
+    if (s == end || *s < '1' || *s > '9') {
+        return false;
+    }
+    unsigned v = 0;
+    for (; s != end; ++s) {
+        if (*s < '0' || *s > '9') {
+            return false;
+        }
+        v = v * 10 + (*s - '0');
+        if (v > SC_REMAP_LAYOUT_MAX_VIEWS) {
+            return false;
+        }
+    }
+    *value = v;
+    return true;
+}
+
+bool
+sc_remap_layout_parse(const char *s, size_t len,
+                      struct sc_remap_layout *layout) {
+    while (len && is_trimmed(*s)) {
+        ++s;
+        --len;
+    }
+    while (len && is_trimmed(s[len - 1])) {
+        --len;
+    }
+
+    if (equals(s, len, "mono")) {
+        *layout = (struct sc_remap_layout) {1, 1};
+        return true;
+    }
+    if (equals(s, len, "side-by-side")) {
+        *layout = (struct sc_remap_layout) {2, 1};
+        return true;
+    }
+    if (equals(s, len, "top-bottom")) {
+        *layout = (struct sc_remap_layout) {1, 2};
+        return true;
+    }
+
+    const char *x = memchr(s, 'x', len);
+    if (!x) {
+        return false;
+    }
+
+    unsigned cols;
+    unsigned rows;
+    if (!parse_count(s, x, &cols) || !parse_count(x + 1, s + len, &rows)
+            || cols * rows > SC_REMAP_LAYOUT_MAX_VIEWS) {
+        return false;
+    }
+
+    layout->cols = cols;
+    layout->rows = rows;
+    return true;
+}
+
+void
+sc_remap_layout_get_map_name(const struct sc_remap_layout *layout,
+                             unsigned view, char axis, char *name,
+                             size_t size) {
+    assert(view < sc_remap_layout_get_views(layout));
+
+    if (layout->cols == 1 && layout->rows == 1) {
+        snprintf(name, size, "map%c", axis);
+    } else if (layout->cols == 2 && layout->rows == 1) {
+        snprintf(name, size, "%sMap%c", view ? "right" : "left", axis);
+    } else if (layout->cols == 1 && layout->rows == 2) {
+        snprintf(name, size, "%sMap%c", view ? "bottom" : "top", axis);
+    } else {
+        snprintf(name, size, "view%uMap%c", view, axis);
+    }
+}
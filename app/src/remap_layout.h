@@ -0,0 +1,65 @@
+#ifndef SC_REMAP_LAYOUT_H
+#define SC_REMAP_LAYOUT_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Arrangement of the views (one per camera) in the frames remapped by
+ * video_preprocess.h, each view being remapped by its own maps
+ *
+ * The views form a grid of equal tiles, numbered in row-major order: 1x1 for
+ * a single camera, 2x1 for the eyes side by side, 1x2 for the eyes one above
+ * the other...
+ */
+
+#define SC_REMAP_LAYOUT_MAX_VIEWS 4
+
+struct sc_remap_layout {
+    unsigned cols;
+    unsigned rows;
+};
+
+static inline unsigned
+sc_remap_layout_get_views(const struct sc_remap_layout *layout) {
+    return layout->cols * layout->rows;
+}
+
+static inline bool
+sc_remap_layout_equals(const struct sc_remap_layout *a,
+                       const struct sc_remap_layout *b) {
+    return a->cols == b->cols && a->rows == b->rows;
+}
+
+static inline bool
+sc_remap_layout_is_side_by_side(const struct sc_remap_layout *layout) {
+    return layout->cols == 2 && layout->rows == 1;
+}
+
+/**
+ * Parse a layout: "mono", "side-by-side", "top-bottom" or "<cols>x<rows>"
+ *
+ * The `len` first characters of `s` are parsed, ignoring the surrounding
+ * spaces and quotes (as written in the XML files).
+ *
+ * Return false if it is invalid or has more than SC_REMAP_LAYOUT_MAX_VIEWS
+ * views.
+ */
+bool
+sc_remap_layout_parse(const char *s, size_t len,
+                      struct sc_remap_layout *layout);
+
+/**
+ * Write the name of the dense map of the `view` along `axis` ('X' or 'Y') in
+ * the XML files: "mapX" for a single camera, "leftMapX" and "rightMapX" side
+ * by side, "topMapX" and "bottomMapX" one above the other, "view0MapX",
+ * "view1MapX"... otherwise
+ */
+void
+sc_remap_layout_get_map_name(const struct sc_remap_layout *layout,
+                             unsigned view, char axis, char *name,
+                             size_t size);
+
+#endif
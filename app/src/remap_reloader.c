@@ -0,0 +1,102 @@
+#include "remap_reloader.h"
+
+#include <inttypes.h>
+
+#include "video_preprocess.h"
+#include "util/log.h"
+#include "util/tick.h"
+
+bool
+sc_remap_reloader_init(struct sc_remap_reloader *reloader,
+                       struct sc_video_preprocess *vpp, const char *map_path) {
+    bool ok = sc_mutex_init(&reloader->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&reloader->cond);
+    if (!ok) {
+        sc_mutex_destroy(&reloader->mutex);
+        return false;
+    }
+
+    reloader->vpp = vpp;
+    reloader->map_path = map_path;
+    reloader->stopped = false;
+    reloader->requested = false;
+
+    return true;
+}
+
+void
+sc_remap_reloader_destroy(struct sc_remap_reloader *reloader) {
+    sc_cond_destroy(&reloader->cond);
+    sc_mutex_destroy(&reloader->mutex);
+}
+
+static int
+run_remap_reloader(void *data) {
+    struct sc_remap_reloader *reloader = data;
+
+    for (;;) {
+        sc_mutex_lock(&reloader->mutex);
+        while (!reloader->stopped && !reloader->requested) {
+            sc_cond_wait(&reloader->cond, &reloader->mutex);
+        }
+        if (reloader->stopped) {
+            sc_mutex_unlock(&reloader->mutex);
+            break;
+        }
+        // A request received during the reload triggers another one
+        reloader->requested = false;
+        sc_mutex_unlock(&reloader->mutex);
+
+        LOGI("Reloading calibration: %s", reloader->map_path);
+        sc_tick start = sc_tick_now();
+        if (sc_video_preprocess_reload(reloader->vpp, reloader->map_path)) {
+            LOGI("Calibration reloaded in %" PRItick " ms",
+                 SC_TICK_TO_MS(sc_tick_now() - start));
+        } else {
+            LOGW("Calibration not reloaded, the previous maps are kept");
+        }
+    }
+
+    LOGD("Remap reloader thread ended");
+
+    return 0;
+}
+
+bool
+sc_remap_reloader_start(struct sc_remap_reloader *reloader) {
+    LOGD("Starting remap reloader thread");
+
+    bool ok = sc_thread_create(&reloader->thread, run_remap_reloader,
+                               "scrcpy-reload", reloader);
+    if (!ok) {
+        LOGE("Could not start remap reloader thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_remap_reloader_stop(struct sc_remap_reloader *reloader) {
+    sc_mutex_lock(&reloader->mutex);
+    reloader->stopped = true;
+    sc_cond_signal(&reloader->cond);
+    sc_mutex_unlock(&reloader->mutex);
+}
+
+void
+sc_remap_reloader_join(struct sc_remap_reloader *reloader) {
+    sc_thread_join(&reloader->thread, NULL);
+}
+
+void
+sc_remap_reloader_request(struct sc_remap_reloader *reloader) {
+    sc_mutex_lock(&reloader->mutex);
+    reloader->requested = true;
+    sc_cond_signal(&reloader->cond);
+    sc_mutex_unlock(&reloader->mutex);
+}
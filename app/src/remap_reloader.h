@@ -0,0 +1,51 @@
+#ifndef SC_REMAP_RELOADER_H
+#define SC_REMAP_RELOADER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#include "util/thread.h"
+
+// forward declarations
+struct sc_video_preprocess;
+
+/**
+ * Reload of the stereo remap maps (after a new calibration), on request.
+ *
+ * The maps are loaded by its own thread, then swapped between frames (see
+ * sc_video_preprocess_reload()), so that neither the rendering nor the
+ * processing waits for them.
+ */
+struct sc_remap_reloader {
+    struct sc_video_preprocess *vpp;
+    const char *map_path;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped;
+    bool requested;
+};
+
+bool
+sc_remap_reloader_init(struct sc_remap_reloader *reloader,
+                       struct sc_video_preprocess *vpp, const char *map_path);
+
+void
+sc_remap_reloader_destroy(struct sc_remap_reloader *reloader);
+
+bool
+sc_remap_reloader_start(struct sc_remap_reloader *reloader);
+
+void
+sc_remap_reloader_stop(struct sc_remap_reloader *reloader);
+
+void
+sc_remap_reloader_join(struct sc_remap_reloader *reloader);
+
+// Request a reload (ignored if a reload is already pending)
+void
+sc_remap_reloader_request(struct sc_remap_reloader *reloader);
+
+#endif
@@ -0,0 +1,166 @@
+#include "remap_shm.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/log.h"
+
+#define SC_REMAP_SHM_ALIGN 64
+
+static bool
+get_name(char *name, size_t size, const struct sc_remap_shm_key *key) {
+    int r = snprintf(name, size, "scrcpy-remap-%016" PRIx64 "-%dx%d-%u",
+                     key->source_hash, key->width, key->height,
+                     key->preview_scale);
+    return r >= 0 && (size_t) r < size;
+}
+
+static size_t
+align_offset(size_t offset) {
+    return (offset + SC_REMAP_SHM_ALIGN - 1)
+         & ~(size_t) (SC_REMAP_SHM_ALIGN - 1);
+}
+
+static bool
+validate_grid(const struct sc_remap_shm_grid *g, size_t size) {
+    if (g->width <= 0 || g->height <= 0
+            || g->shift < SC_REMAP_GRID_MIN_SHIFT
+            || g->shift > SC_REMAP_GRID_MAX_SHIFT
+            || g->cols != ((g->width - 1) >> g->shift) + 2
+            || g->rows != ((g->height - 1) >> g->shift) + 2
+            || g->offset % SC_REMAP_SHM_ALIGN) {
+        return false;
+    }
+
+    uint64_t grid_size = (uint64_t) g->cols * g->rows * 2 * sizeof(int32_t);
+    return g->offset <= size && grid_size <= size - g->offset;
+}
+
+bool
+sc_remap_shm_attach(struct sc_shm *shm, const struct sc_remap_shm_key *key,
+                    struct sc_remap_grid *const grids[], unsigned count) {
+    assert(count && count <= SC_REMAP_SHM_MAX_GRIDS);
+
+    char name[64];
+    if (!get_name(name, sizeof(name), key)) {
+        return false;
+    }
+
+    struct sc_shm segment;
+    if (!sc_shm_open(&segment, name)) {
+        return false;
+    }
+
+    const struct sc_remap_shm_header *header = segment.data;
+    if (segment.size < sizeof(*header)
+            || memcmp(header->magic, SC_REMAP_SHM_MAGIC,
+                      sizeof(header->magic))) {
+        // Not published yet (or being published by another process)
+        LOGD("Remap shared memory %s not ready, ignored", name);
+        goto error;
+    }
+    // Read the content only after the magic
+    atomic_thread_fence(memory_order_acquire);
+
+    if (header->version != SC_REMAP_SHM_VERSION
+            || header->grid_count != count
+            || header->source_hash != key->source_hash
+            || header->size > segment.size) {
+        LOGW("Remap shared memory %s is invalid, ignored", name);
+        goto error;
+    }
+
+    for (unsigned i = 0; i < count; ++i) {
+        if (!validate_grid(&header->grids[i], header->size)) {
+            LOGW("Remap shared memory %s is invalid, ignored", name);
+            goto error;
+        }
+    }
+
+    for (unsigned i = 0; i < count; ++i) {
+        const struct sc_remap_shm_grid *g = &header->grids[i];
+        struct sc_remap_grid *grid = grids[i];
+        grid->width = g->width;
+        grid->height = g->height;
+        grid->shift = g->shift;
+        grid->cols = g->cols;
+        grid->rows = g->rows;
+        // The kernels never write to the control points
+        grid->xy = (int32_t *) ((uint8_t *) segment.data + g->offset);
+        grid->owned = false;
+        // Computed by the caller, which knows the size of the source
+        grid->spans = NULL;
+    }
+
+    LOGI("Remap grids attached from shared memory: %s", name);
+    *shm = segment;
+    return true;
+
+error:
+    sc_shm_close(&segment);
+    return false;
+}
+
+bool
+sc_remap_shm_publish(struct sc_shm *shm, const struct sc_remap_shm_key *key,
+                     struct sc_remap_grid *const grids[], unsigned count) {
+    assert(count && count <= SC_REMAP_SHM_MAX_GRIDS);
+
+    char name[64];
+    if (!get_name(name, sizeof(name), key)) {
+        return false;
+    }
+
+    size_t offsets[SC_REMAP_SHM_MAX_GRIDS];
+    size_t size = align_offset(sizeof(struct sc_remap_shm_header));
+    for (unsigned i = 0; i < count; ++i) {
+        assert(grids[i]->xy);
+        offsets[i] = size;
+        size = align_offset(size + sc_remap_grid_get_size(grids[i]));
+    }
+
+    struct sc_shm segment;
+    if (!sc_shm_create(&segment, name, size)) {
+        LOGD("Could not publish the remap grids to shared memory %s", name);
+        return false;
+    }
+
+    uint8_t *data = segment.data;
+    struct sc_remap_shm_header *header = segment.data;
+    header->version = SC_REMAP_SHM_VERSION;
+    header->grid_count = count;
+    header->source_hash = key->source_hash;
+    header->size = size;
+
+    for (unsigned i = 0; i < count; ++i) {
+        struct sc_remap_grid *grid = grids[i];
+        struct sc_remap_shm_grid *g = &header->grids[i];
+        g->width = grid->width;
+        g->height = grid->height;
+        g->shift = grid->shift;
+        g->cols = grid->cols;
+        g->rows = grid->rows;
+        g->offset = offsets[i];
+        memcpy(data + offsets[i], grid->xy, sc_remap_grid_get_size(grid));
+
+        // Use the shared copy, so that the memory is shared with the next
+        // processes (the spans are kept)
+        if (grid->owned) {
+            free(grid->xy);
+        }
+        grid->xy = (int32_t *) (data + offsets[i]);
+        grid->owned = false;
+    }
+
+    // Publish the content before the magic
+    atomic_thread_fence(memory_order_release);
+    memcpy(header->magic, SC_REMAP_SHM_MAGIC, sizeof(header->magic));
+
+    LOGI("Remap grids published to shared memory: %s", name);
+    *shm = segment;
+    return true;
+}
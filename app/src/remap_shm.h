@@ -0,0 +1,90 @@
+#ifndef SC_REMAP_SHM_H
+#define SC_REMAP_SHM_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/remap.h"
+#include "util/shm.h"
+
+#define SC_REMAP_SHM_MAGIC "SCRMGRID"
+#define SC_REMAP_SHM_VERSION 2
+#define SC_REMAP_SHM_MAX_GRIDS 16
+
+/**
+ * Remap grids (see util/remap.h) shared read-only between the scrcpy
+ * processes using the same calibration
+ *
+ * Parsing a calibration and converting its maps to grids takes time and
+ * memory in every process. Instead, the first process publishes its grids into
+ * a named shared memory, and the next ones map it.
+ *
+ * The shared memory starts with a `struct sc_remap_shm_header`, followed by
+ * the control points of each grid. The magic is written last, once the
+ * control points are written: a segment without it is ignored.
+ *
+ * On Unix, the segment remains once the processes exit (so that the next
+ * process does not compute the grids again), until reboot or until
+ * /dev/shm/scrcpy-remap-* is removed. On Windows, it remains as long as a
+ * process has it open.
+ */
+
+// Identifies the grids of a segment
+struct sc_remap_shm_key {
+    uint64_t source_hash; // of the calibration file
+    // Size of the frames (all the views) remapped by the grids, or
+    // 0x0 for the size of the calibration
+    int width;
+    int height;
+    unsigned preview_scale;
+};
+
+struct sc_remap_shm_grid {
+    int32_t width;
+    int32_t height;
+    uint32_t shift;
+    int32_t cols;
+    int32_t rows;
+    uint32_t reserved;
+    uint64_t offset; // of the control points
+};
+
+struct sc_remap_shm_header {
+    char magic[8]; // SC_REMAP_SHM_MAGIC, written last
+    uint32_t version;
+    uint32_t grid_count;
+    uint64_t source_hash;
+    uint64_t size; // of the whole segment
+    struct sc_remap_shm_grid grids[SC_REMAP_SHM_MAX_GRIDS];
+};
+
+/**
+ * Map the segment published for `key`, if any, and initialize the `count`
+ * grids to point to it (they are not owned)
+ *
+ * The segment must be closed by sc_shm_close() once the grids are not used
+ * anymore.
+ *
+ * Return false if there is no valid segment for `key`.
+ */
+bool
+sc_remap_shm_attach(struct sc_shm *shm, const struct sc_remap_shm_key *key,
+                    struct sc_remap_grid *const grids[], unsigned count);
+
+/**
+ * Publish the `count` grids for `key`, and replace them by grids pointing to
+ * the segment (their control points are freed)
+ *
+ * The segment must be closed by sc_shm_close() once the grids are not used
+ * anymore.
+ *
+ * Return false if the segment could not be created (the grids are kept
+ * unchanged).
+ */
+bool
+sc_remap_shm_publish(struct sc_shm *shm, const struct sc_remap_shm_key *key,
+                     struct sc_remap_grid *const grids[], unsigned count);
+
+#endif
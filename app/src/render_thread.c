@@ -0,0 +1,273 @@
+#include "render_thread.h"
+
+#include "events.h"
+#include "latency_trace.h"
+#include "metrics.h"
+#include "util/log.h"
+
+static inline bool
+sc_size_equals(struct sc_size a, struct sc_size b) {
+    return a.width == b.width && a.height == b.height;
+}
+
+// Return false on error
+static bool
+sc_render_thread_upload(struct sc_render_thread *rt) {
+    AVFrame *frame = rt->frame;
+
+    sc_fps_counter_add_rendered_frame(rt->fps_counter);
+    sc_metrics_add(SC_METRIC_RENDERED_FRAMES, 1);
+
+    struct sc_size size = {frame->width, frame->height};
+    if (!sc_size_equals(size, rt->texture_size)) {
+        enum sc_display_result res =
+            sc_display_set_texture_size(rt->display, size);
+        if (res == SC_DISPLAY_RESULT_ERROR) {
+            return false;
+        }
+        rt->texture_size = size;
+        if (res == SC_DISPLAY_RESULT_PENDING) {
+            // Not an error, but do not continue
+            return true;
+        }
+    }
+
+    enum sc_display_result res = sc_display_update_texture(rt->display, frame);
+    if (res == SC_DISPLAY_RESULT_ERROR) {
+        return false;
+    }
+    if (res == SC_DISPLAY_RESULT_PENDING) {
+        // Not an error, but do not continue
+        return true;
+    }
+
+    sc_latency_trace_stamp(SC_LATENCY_STAGE_DISPLAY, frame->pts);
+
+    if (!sc_size_equals(size, rt->reported_size)) {
+        // First frame, or new frame size: the main thread resizes the window
+        // (and shows it on the first frame)
+        rt->reported_size = size;
+
+        sc_mutex_lock(&rt->mutex);
+        rt->frame_size = size;
+        sc_mutex_unlock(&rt->mutex);
+
+        if (!sc_push_event(SC_EVENT_SCREEN_FRAME_SIZE)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int
+run_render_thread(void *data) {
+    struct sc_render_thread *rt = data;
+
+    // The renderer (and its OpenGL context) must be used from the thread which
+    // created it
+    bool ok = sc_display_init(rt->display, rt->window, NULL, rt->mipmaps,
+                              rt->gpu_remap, rt->gpu_remap_offset,
+                              rt->pbo_upload, true, rt->hud,
+                              rt->low_latency_present);
+
+    sc_mutex_lock(&rt->mutex);
+    rt->initialized = true;
+    rt->init_ok = ok;
+    sc_cond_signal(&rt->cond);
+    sc_mutex_unlock(&rt->mutex);
+
+    if (!ok) {
+        return 0;
+    }
+
+    for (;;) {
+        sc_mutex_lock(&rt->mutex);
+        while (!rt->stopped && !rt->frame_pending && !rt->render_requested) {
+            sc_cond_wait(&rt->cond, &rt->mutex);
+        }
+        if (rt->stopped) {
+            sc_mutex_unlock(&rt->mutex);
+            break;
+        }
+        bool new_frame = rt->frame_pending;
+        bool upload = !rt->paused || rt->refresh;
+        rt->frame_pending = false;
+        rt->render_requested = false;
+        rt->refresh = false;
+        SDL_Rect rect = rt->rect;
+        enum sc_orientation orientation = rt->orientation;
+        enum sc_stereo_view view = rt->view;
+        sc_mutex_unlock(&rt->mutex);
+
+        if (new_frame) {
+            // While paused, the last frame is kept in rt->frame, to be
+            // uploaded on resume
+            av_frame_unref(rt->frame);
+            sc_frame_buffer_consume(rt->fb, rt->frame);
+            rt->uploaded = false;
+        }
+
+        if (upload && !rt->uploaded) {
+            rt->uploaded = true;
+            if (!sc_render_thread_upload(rt)) {
+                LOGE("Frame update failed");
+                sc_push_event(SC_EVENT_SCREEN_RENDER_ERROR);
+                break;
+            }
+        }
+
+        if (!rt->reported_size.width) {
+            // Nothing to render before the first frame
+            continue;
+        }
+
+        // Blocks until the vertical blank (if vsync is supported), so that
+        // the frames received meanwhile are coalesced by the frame buffer
+        enum sc_display_result res =
+            sc_display_render(rt->display, &rect, orientation, view);
+        (void) res; // any error already logged
+    }
+
+    sc_display_destroy(rt->display);
+
+    return 0;
+}
+
+bool
+sc_render_thread_start(struct sc_render_thread *rt,
+                       const struct sc_render_thread_params *params) {
+    rt->display = params->display;
+    rt->fb = params->fb;
+    rt->fps_counter = params->fps_counter;
+    rt->window = params->window;
+    rt->mipmaps = params->mipmaps;
+    rt->gpu_remap = params->gpu_remap;
+    rt->gpu_remap_offset = params->gpu_remap_offset;
+    rt->pbo_upload = params->pbo_upload;
+    rt->hud = params->hud;
+    rt->low_latency_present = params->low_latency_present;
+
+    rt->initialized = false;
+    rt->init_ok = false;
+    rt->stopped = false;
+    rt->frame_pending = false;
+    rt->render_requested = false;
+    rt->paused = false;
+    rt->refresh = false;
+    rt->rect = (SDL_Rect) {0, 0, 0, 0};
+    rt->orientation = SC_ORIENTATION_0;
+    rt->view = SC_STEREO_VIEW_SIDE_BY_SIDE;
+    rt->frame_size = (struct sc_size) {0, 0};
+    rt->texture_size = (struct sc_size) {0, 0};
+    rt->reported_size = (struct sc_size) {0, 0};
+    rt->uploaded = true; // no frame yet
+
+    rt->frame = av_frame_alloc();
+    if (!rt->frame) {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = sc_mutex_init(&rt->mutex);
+    if (!ok) {
+        goto error_free_frame;
+    }
+
+    ok = sc_cond_init(&rt->cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    LOGD("Starting render thread");
+    ok = sc_thread_create(&rt->thread, run_render_thread, "scrcpy-render", rt);
+    if (!ok) {
+        LOGE("Could not start render thread");
+        goto error_destroy_cond;
+    }
+
+    sc_mutex_lock(&rt->mutex);
+    while (!rt->initialized) {
+        sc_cond_wait(&rt->cond, &rt->mutex);
+    }
+    ok = rt->init_ok;
+    sc_mutex_unlock(&rt->mutex);
+
+    if (!ok) {
+        // The thread has already returned
+        sc_thread_join(&rt->thread, NULL);
+        goto error_destroy_cond;
+    }
+
+    return true;
+
+error_destroy_cond:
+    sc_cond_destroy(&rt->cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&rt->mutex);
+error_free_frame:
+    av_frame_free(&rt->frame);
+
+    return false;
+}
+
+void
+sc_render_thread_stop(struct sc_render_thread *rt) {
+    sc_mutex_lock(&rt->mutex);
+    rt->stopped = true;
+    sc_cond_signal(&rt->cond);
+    sc_mutex_unlock(&rt->mutex);
+}
+
+void
+sc_render_thread_join(struct sc_render_thread *rt) {
+    sc_thread_join(&rt->thread, NULL);
+
+    sc_cond_destroy(&rt->cond);
+    sc_mutex_destroy(&rt->mutex);
+    av_frame_free(&rt->frame);
+}
+
+void
+sc_render_thread_notify_frame(struct sc_render_thread *rt) {
+    sc_mutex_lock(&rt->mutex);
+    rt->frame_pending = true;
+    sc_cond_signal(&rt->cond);
+    sc_mutex_unlock(&rt->mutex);
+}
+
+void
+sc_render_thread_request_render(struct sc_render_thread *rt,
+                                const SDL_Rect *rect,
+                                enum sc_orientation orientation,
+                                enum sc_stereo_view view) {
+    sc_mutex_lock(&rt->mutex);
+    rt->rect = *rect;
+    rt->orientation = orientation;
+    rt->view = view;
+    rt->render_requested = true;
+    sc_cond_signal(&rt->cond);
+    sc_mutex_unlock(&rt->mutex);
+}
+
+void
+sc_render_thread_set_paused(struct sc_render_thread *rt, bool paused) {
+    sc_mutex_lock(&rt->mutex);
+    if (rt->paused) {
+        // If display screen was paused, refresh the frame immediately, even if
+        // the new state is also paused
+        rt->refresh = true;
+        rt->render_requested = true;
+        sc_cond_signal(&rt->cond);
+    }
+    rt->paused = paused;
+    sc_mutex_unlock(&rt->mutex);
+}
+
+struct sc_size
+sc_render_thread_get_frame_size(struct sc_render_thread *rt) {
+    sc_mutex_lock(&rt->mutex);
+    struct sc_size size = rt->frame_size;
+    sc_mutex_unlock(&rt->mutex);
+    return size;
+}
@@ -0,0 +1,117 @@
+#ifndef SC_RENDER_THREAD_H
+#define SC_RENDER_THREAD_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+#include <libavutil/frame.h>
+
+#include "coords.h"
+#include "display.h"
+#include "fps_counter.h"
+#include "frame_buffer.h"
+#include "options.h"
+#include "util/thread.h"
+
+/**
+ * Dedicated thread owning the display (the SDL renderer and its OpenGL
+ * context).
+ *
+ * It latches the last frame from the frame buffer, uploads it and presents
+ * it with vsync, so that neither the texture upload nor the swap blocks the
+ * main thread, which only handles the events (and the window).
+ *
+ * The main thread sends the content rectangle and orientation of each render,
+ * and is notified (by SC_EVENT_SCREEN_FRAME_SIZE) when a frame of a new size
+ * has been uploaded.
+ */
+struct sc_render_thread {
+    struct sc_display *display;
+    struct sc_frame_buffer *fb;
+    struct sc_fps_counter *fps_counter;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+
+    bool initialized; // the display initialization is complete
+    bool init_ok;
+
+    bool stopped;
+    bool frame_pending; // a new frame is available in the frame buffer
+    bool render_requested;
+    bool paused;
+    bool refresh; // upload the last frame once, even if paused
+
+    SDL_Rect rect;
+    enum sc_orientation orientation;
+    enum sc_stereo_view view;
+
+    // size of the last uploaded frame, read by the main thread
+    struct sc_size frame_size;
+
+    // only accessed by the render thread
+    AVFrame *frame;
+    struct sc_size texture_size;
+    struct sc_size reported_size;
+    bool uploaded; // the frame has been uploaded to the texture
+
+    // display parameters, only accessed by the render thread
+    SDL_Window *window;
+    bool mipmaps;
+    const struct sc_video_preprocess *gpu_remap;
+    int gpu_remap_offset;
+    bool pbo_upload;
+    bool hud;
+    bool low_latency_present;
+};
+
+struct sc_render_thread_params {
+    struct sc_display *display;
+    struct sc_frame_buffer *fb;
+    struct sc_fps_counter *fps_counter;
+
+    SDL_Window *window;
+    bool mipmaps;
+    const struct sc_video_preprocess *gpu_remap; // may be NULL
+    int gpu_remap_offset;
+    bool pbo_upload;
+    bool hud;
+    bool low_latency_present;
+};
+
+/**
+ * Start the thread and initialize the display from it
+ *
+ * Return once the display is initialized (false on error).
+ */
+bool
+sc_render_thread_start(struct sc_render_thread *rt,
+                       const struct sc_render_thread_params *params);
+
+void
+sc_render_thread_stop(struct sc_render_thread *rt);
+
+// join the thread (the display is destroyed by the thread on exit)
+void
+sc_render_thread_join(struct sc_render_thread *rt);
+
+// a new frame has been pushed to the frame buffer (from any thread)
+void
+sc_render_thread_notify_frame(struct sc_render_thread *rt);
+
+void
+sc_render_thread_request_render(struct sc_render_thread *rt,
+                                const SDL_Rect *rect,
+                                enum sc_orientation orientation,
+                                enum sc_stereo_view view);
+
+void
+sc_render_thread_set_paused(struct sc_render_thread *rt, bool paused);
+
+// size of the last uploaded frame (on SC_EVENT_SCREEN_FRAME_SIZE)
+struct sc_size
+sc_render_thread_get_frame_size(struct sc_render_thread *rt);
+
+#endif
@@ -0,0 +1,59 @@
+#include "rgb_converter.h"
+
+#include <assert.h>
+
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+
+#include "util/log.h"
+#include "util/yuv_rgb.h"
+
+void
+sc_rgb_converter_init(struct sc_rgb_converter *conv,
+                      enum sc_rgb_converter_method method) {
+    conv->method = method;
+    conv->sws_ctx = NULL;
+}
+
+void
+sc_rgb_converter_destroy(struct sc_rgb_converter *conv) {
+    sws_freeContext(conv->sws_ctx);
+}
+
+static bool
+sc_rgb_converter_convert_swscale(struct sc_rgb_converter *conv,
+                                 const AVFrame *src, AVFrame *dst) {
+    // Same size: point sampling avoids computing the filter tables of a
+    // scaler, the unscaled conversion does not use them anyway. The context
+    // is only recreated if the frame size changes.
+    conv->sws_ctx = sws_getCachedContext(conv->sws_ctx,
+        src->width, src->height, AV_PIX_FMT_YUV420P,
+        src->width, src->height, AV_PIX_FMT_RGB24,
+        SWS_POINT, NULL, NULL, NULL);
+    if (!conv->sws_ctx) {
+        LOGE("Could not initialize SwsContext");
+        return false;
+    }
+
+    sws_scale(conv->sws_ctx, (const uint8_t * const *) src->data,
+              src->linesize, 0, src->height, dst->data, dst->linesize);
+    return true;
+}
+
+bool
+sc_rgb_converter_convert(struct sc_rgb_converter *conv, const AVFrame *src,
+                         AVFrame *dst) {
+    assert(src->format == AV_PIX_FMT_YUV420P);
+    assert(dst->format == AV_PIX_FMT_RGB24);
+    assert(src->width == dst->width && src->height == dst->height);
+
+    if (conv->method == SC_RGB_CONVERTER_INTEGER) {
+        sc_yuv420p_to_rgb24((const uint8_t * const *) src->data, src->linesize,
+                            dst->data[0], dst->linesize[0], src->width,
+                            src->height);
+        return true;
+    }
+
+    assert(conv->method == SC_RGB_CONVERTER_SWSCALE);
+    return sc_rgb_converter_convert_swscale(conv, src, dst);
+}
@@ -0,0 +1,55 @@
+#ifndef SC_RGB_CONVERTER_H
+#define SC_RGB_CONVERTER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+struct SwsContext;
+
+enum sc_rgb_converter_method {
+    // libswscale, whose unscaled YUV420P to RGB24 path is SIMD-optimized
+    SC_RGB_CONVERTER_SWSCALE,
+    // Portable fixed-point kernel (see util/yuv_rgb.h)
+    SC_RGB_CONVERTER_INTEGER,
+};
+
+// Selected from the "rgb" microbenchmarks (see bench/bench.c)
+#define SC_RGB_CONVERTER_DEFAULT SC_RGB_CONVERTER_SWSCALE
+
+/**
+ * Conversion of the decoded YUV420P frames to RGB24, at the same size (to
+ * save the frames as images).
+ *
+ * Both methods convert the limited range BT.601 colors (the swscale default),
+ * with the chroma samples replicated (no interpolation, there is no scaling).
+ * The swscale context is created once, and recreated only if the frame size
+ * changes.
+ *
+ * It is not thread-safe: each thread must use its own converter.
+ */
+struct sc_rgb_converter {
+    enum sc_rgb_converter_method method;
+    struct SwsContext *sws_ctx; // cached for the current frame size
+};
+
+void
+sc_rgb_converter_init(struct sc_rgb_converter *conv,
+                      enum sc_rgb_converter_method method);
+
+void
+sc_rgb_converter_destroy(struct sc_rgb_converter *conv);
+
+/**
+ * Convert a YUV420P frame into an RGB24 frame of the same size
+ *
+ * The buffer of the output frame must already be allocated.
+ */
+bool
+sc_rgb_converter_convert(struct sc_rgb_converter *conv, const AVFrame *src,
+                         AVFrame *dst);
+
+#endif
@@ -0,0 +1,361 @@
+#include "rtp_receiver.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/binary.h"
+#include "util/log.h"
+
+#define SC_RTP_VERSION 2
+// Upper bound of the packet size, to reject corrupted headers before any
+// allocation
+#define SC_RTP_MAX_PACKET_SIZE (64 * 1024 * 1024)
+
+struct sc_rtp_header {
+    uint32_t ssrc;
+    uint32_t index;
+    uint64_t pts_flags;
+    uint32_t size;
+    uint8_t clock_domain;
+    uint64_t capture_ns;
+    uint16_t fragment_index;
+    uint16_t fragment_count;
+    uint16_t fragment_size;
+    uint8_t fec_group;
+};
+
+void
+sc_rtp_receiver_init(struct sc_rtp_receiver *rx, uint32_t ssrc) {
+    memset(rx, 0, sizeof(*rx));
+    rx->ssrc = ssrc;
+    // The device starts at frame index 0
+    rx->next_index = 0;
+}
+
+void
+sc_rtp_receiver_destroy(struct sc_rtp_receiver *rx) {
+    for (unsigned i = 0; i < SC_RTP_RECEIVER_SLOTS; ++i) {
+        struct sc_rtp_receiver_slot *slot = &rx->slots[i];
+        free(slot->data);
+        free(slot->parity);
+        free(slot->present);
+    }
+}
+
+static inline unsigned
+sc_rtp_group_count(uint16_t fragment_count, uint8_t fec_group) {
+    return fec_group ? (fragment_count + fec_group - 1) / fec_group : 0;
+}
+
+static inline uint32_t
+sc_rtp_fragment_len(uint32_t size, uint16_t fragment_size, unsigned index) {
+    uint32_t offset = (uint32_t) index * fragment_size;
+    assert(offset < size);
+    uint32_t remaining = size - offset;
+    return remaining < fragment_size ? remaining : fragment_size;
+}
+
+static bool
+sc_rtp_parse_header(const uint8_t *datagram, size_t len,
+                    struct sc_rtp_header *hdr) {
+    if (len < SC_RTP_HEADER_SIZE + SC_RTP_PAYLOAD_HEADER_SIZE) {
+        return false;
+    }
+
+    if (datagram[0] >> 6 != SC_RTP_VERSION
+            || (datagram[0] & 0x3F) // padding, extension and CSRC count
+            || (datagram[1] & 0x7F) != SC_RTP_PAYLOAD_TYPE) {
+        return false;
+    }
+
+    hdr->ssrc = sc_read32be(&datagram[8]);
+
+    const uint8_t *p = &datagram[SC_RTP_HEADER_SIZE];
+    hdr->index = sc_read32be(p);
+    hdr->pts_flags = sc_read64be(&p[4]);
+    hdr->size = sc_read32be(&p[12]);
+    hdr->clock_domain = p[16];
+    hdr->capture_ns = sc_read64be(&p[17]);
+    hdr->fragment_index = sc_read16be(&p[25]);
+    hdr->fragment_count = sc_read16be(&p[27]);
+    hdr->fragment_size = sc_read16be(&p[29]);
+    hdr->fec_group = p[31];
+
+    if (!hdr->size || hdr->size > SC_RTP_MAX_PACKET_SIZE
+            || !hdr->fragment_size || !hdr->fragment_count) {
+        return false;
+    }
+
+    uint32_t expected_count =
+        (hdr->size + hdr->fragment_size - 1) / hdr->fragment_size;
+    if (expected_count != hdr->fragment_count) {
+        return false;
+    }
+
+    unsigned groups = sc_rtp_group_count(hdr->fragment_count, hdr->fec_group);
+    if (hdr->fragment_index >= hdr->fragment_count + groups) {
+        return false;
+    }
+
+    // The length of a parity fragment is the length of the first fragment of
+    // its group
+    unsigned data_index = hdr->fragment_index < hdr->fragment_count
+                        ? hdr->fragment_index
+                        : (hdr->fragment_index - hdr->fragment_count)
+                            * hdr->fec_group;
+    uint32_t payload_len =
+        sc_rtp_fragment_len(hdr->size, hdr->fragment_size, data_index);
+    if (len - SC_RTP_HEADER_SIZE - SC_RTP_PAYLOAD_HEADER_SIZE != payload_len) {
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+sc_rtp_slot_reserve(struct sc_rtp_receiver_slot *slot, size_t data_size,
+                    size_t parity_size, size_t present_count) {
+    if (data_size > slot->data_cap) {
+        uint8_t *data = realloc(slot->data, data_size);
+        if (!data) {
+            LOG_OOM();
+            return false;
+        }
+        slot->data = data;
+        slot->data_cap = data_size;
+    }
+
+    if (parity_size > slot->parity_cap) {
+        uint8_t *parity = realloc(slot->parity, parity_size);
+        if (!parity) {
+            LOG_OOM();
+            return false;
+        }
+        slot->parity = parity;
+        slot->parity_cap = parity_size;
+    }
+
+    if (present_count > slot->present_cap) {
+        bool *present = realloc(slot->present, present_count * sizeof(bool));
+        if (!present) {
+            LOG_OOM();
+            return false;
+        }
+        slot->present = present;
+        slot->present_cap = present_count;
+    }
+
+    return true;
+}
+
+static bool
+sc_rtp_slot_start(struct sc_rtp_receiver_slot *slot,
+                  const struct sc_rtp_header *hdr) {
+    unsigned groups = sc_rtp_group_count(hdr->fragment_count, hdr->fec_group);
+    size_t present_count = hdr->fragment_count + groups;
+    if (!sc_rtp_slot_reserve(slot, hdr->size,
+                             (size_t) groups * hdr->fragment_size,
+                             present_count)) {
+        return false;
+    }
+
+    memset(slot->present, 0, present_count * sizeof(bool));
+
+    slot->used = true;
+    slot->index = hdr->index;
+    slot->pts_flags = hdr->pts_flags;
+    slot->clock_domain = hdr->clock_domain;
+    slot->capture_ns = hdr->capture_ns;
+    slot->size = hdr->size;
+    slot->fragment_count = hdr->fragment_count;
+    slot->fragment_size = hdr->fragment_size;
+    slot->fec_group = hdr->fec_group;
+    slot->received = 0;
+    return true;
+}
+
+static bool
+sc_rtp_slot_matches(const struct sc_rtp_receiver_slot *slot,
+                    const struct sc_rtp_header *hdr) {
+    return slot->pts_flags == hdr->pts_flags
+        && slot->size == hdr->size
+        && slot->fragment_count == hdr->fragment_count
+        && slot->fragment_size == hdr->fragment_size
+        && slot->fec_group == hdr->fec_group;
+}
+
+// Drop all the frames before `index`
+static void
+sc_rtp_receiver_drop_until(struct sc_rtp_receiver *rx, uint32_t index) {
+    for (unsigned i = 0; i < SC_RTP_RECEIVER_SLOTS; ++i) {
+        struct sc_rtp_receiver_slot *slot = &rx->slots[i];
+        if (slot->used && (int32_t) (slot->index - index) < 0) {
+            slot->used = false;
+        }
+    }
+
+    uint32_t dropped = index - rx->next_index;
+    rx->pending_lost += dropped;
+    rx->lost += dropped;
+    rx->next_index = index;
+}
+
+static struct sc_rtp_receiver_slot *
+sc_rtp_receiver_get_slot(struct sc_rtp_receiver *rx,
+                         const struct sc_rtp_header *hdr) {
+    struct sc_rtp_receiver_slot *free_slot = NULL;
+    struct sc_rtp_receiver_slot *oldest = NULL;
+    for (unsigned i = 0; i < SC_RTP_RECEIVER_SLOTS; ++i) {
+        struct sc_rtp_receiver_slot *slot = &rx->slots[i];
+        if (!slot->used) {
+            if (!free_slot) {
+                free_slot = slot;
+            }
+        } else if (slot->index == hdr->index) {
+            return sc_rtp_slot_matches(slot, hdr) ? slot : NULL;
+        } else if (!oldest || (int32_t) (slot->index - oldest->index) < 0) {
+            oldest = slot;
+        }
+    }
+
+    if (!free_slot) {
+        // Too many incomplete frames, give up the oldest one
+        assert(oldest);
+        if ((int32_t) (hdr->index - oldest->index) < 0) {
+            // The datagram is even older
+            return NULL;
+        }
+        sc_rtp_receiver_drop_until(rx, oldest->index + 1);
+        free_slot = oldest;
+    }
+
+    if (!sc_rtp_slot_start(free_slot, hdr)) {
+        return NULL;
+    }
+
+    return free_slot;
+}
+
+static void
+sc_rtp_slot_try_recover(struct sc_rtp_receiver_slot *slot, unsigned group,
+                        uint64_t *recovered) {
+    unsigned first = group * slot->fec_group;
+    unsigned end = first + slot->fec_group;
+    if (end > slot->fragment_count) {
+        end = slot->fragment_count;
+    }
+
+    if (!slot->present[slot->fragment_count + group]) {
+        return;
+    }
+
+    unsigned missing = 0;
+    unsigned missing_index = 0;
+    for (unsigned i = first; i < end; ++i) {
+        if (!slot->present[i]) {
+            ++missing;
+            missing_index = i;
+        }
+    }
+
+    if (missing != 1) {
+        // Nothing to recover, or too many fragments lost
+        return;
+    }
+
+    uint8_t *out = slot->data + (size_t) missing_index * slot->fragment_size;
+    uint32_t out_len =
+        sc_rtp_fragment_len(slot->size, slot->fragment_size, missing_index);
+    const uint8_t *parity = slot->parity + (size_t) group * slot->fragment_size;
+    memcpy(out, parity, out_len);
+
+    for (unsigned i = first; i < end; ++i) {
+        if (i == missing_index) {
+            continue;
+        }
+        const uint8_t *in = slot->data + (size_t) i * slot->fragment_size;
+        uint32_t len = sc_rtp_fragment_len(slot->size, slot->fragment_size, i);
+        if (len > out_len) {
+            len = out_len;
+        }
+        for (uint32_t j = 0; j < len; ++j) {
+            out[j] ^= in[j];
+        }
+    }
+
+    slot->present[missing_index] = true;
+    ++slot->received;
+    ++*recovered;
+}
+
+bool
+sc_rtp_receiver_push(struct sc_rtp_receiver *rx, const uint8_t *datagram,
+                     size_t len, struct sc_rtp_frame *frame) {
+    struct sc_rtp_header hdr;
+    if (!sc_rtp_parse_header(datagram, len, &hdr) || hdr.ssrc != rx->ssrc) {
+        ++rx->invalid;
+        return false;
+    }
+
+    if ((int32_t) (hdr.index - rx->next_index) < 0) {
+        // Late datagram, its frame has already been delivered or dropped
+        return false;
+    }
+
+    struct sc_rtp_receiver_slot *slot = sc_rtp_receiver_get_slot(rx, &hdr);
+    if (!slot) {
+        ++rx->invalid;
+        return false;
+    }
+
+    if (slot->present[hdr.fragment_index]) {
+        // Duplicate, or already recovered
+        return false;
+    }
+    slot->present[hdr.fragment_index] = true;
+
+    const uint8_t *payload =
+        datagram + SC_RTP_HEADER_SIZE + SC_RTP_PAYLOAD_HEADER_SIZE;
+    size_t payload_len = len - SC_RTP_HEADER_SIZE - SC_RTP_PAYLOAD_HEADER_SIZE;
+
+    unsigned group;
+    if (hdr.fragment_index < hdr.fragment_count) {
+        memcpy(slot->data + (size_t) hdr.fragment_index * hdr.fragment_size,
+               payload, payload_len);
+        ++slot->received;
+        group = hdr.fec_group ? hdr.fragment_index / hdr.fec_group : 0;
+    } else {
+        group = hdr.fragment_index - hdr.fragment_count;
+        memcpy(slot->parity + (size_t) group * hdr.fragment_size, payload,
+               payload_len);
+    }
+
+    if (hdr.fec_group && slot->received < slot->fragment_count) {
+        sc_rtp_slot_try_recover(slot, group, &rx->recovered);
+    }
+
+    if (slot->received < slot->fragment_count) {
+        return false;
+    }
+
+    if (slot->index != rx->next_index) {
+        // The previous frames are still incomplete, and would only be
+        // completed late (if ever)
+        sc_rtp_receiver_drop_until(rx, slot->index);
+    }
+
+    slot->used = false; // the data remains valid until the next push
+    rx->next_index = slot->index + 1;
+    ++rx->frames;
+
+    frame->data = slot->data;
+    frame->size = slot->size;
+    frame->pts_flags = slot->pts_flags;
+    frame->clock_domain = slot->clock_domain;
+    frame->capture_ns = slot->capture_ns;
+    frame->lost = rx->pending_lost;
+    rx->pending_lost = 0;
+
+    return true;
+}
@@ -0,0 +1,109 @@
+#ifndef SC_RTP_RECEIVER_H
+#define SC_RTP_RECEIVER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The video packets received over UDP (--video-transport=udp) are split into
+// RTP datagrams (RFC 3550), with a dynamic payload type:
+//
+//  - the 12-byte RTP header (version 2, no CSRC, no extension), the marker bit
+//    set on the last datagram of each packet, the SSRC being the low 32 bits
+//    of the session token (--direct-tcp-port);
+//  - a 32-byte payload header (big-endian):
+//      [0] frame index (4 bytes), incremented for every packet
+//      [4] PTS and flags (8 bytes), as in the TCP packet header
+//     [12] packet size (4 bytes)
+//     [16] clock domain (1 byte) and capture timestamp (8 bytes)
+//     [25] fragment index (2 bytes)
+//     [27] fragment count (2 bytes), not including the parity fragments
+//     [29] fragment size (2 bytes), of every fragment except the last
+//     [31] FEC group size (1 byte), 0 if FEC is disabled
+//  - the fragment of the packet.
+//
+// With FEC, the data fragments are grouped by <FEC group size>, and every
+// group is followed by a parity fragment (the XOR of the fragments of the
+// group, zero-padded to the size of the first one), with the fragment index
+// <fragment count> + <group index>. A single missing fragment per group can
+// be recovered.
+#define SC_RTP_HEADER_SIZE 12
+#define SC_RTP_PAYLOAD_HEADER_SIZE 32
+#define SC_RTP_PAYLOAD_TYPE 96
+
+// Frames received concurrently (reordered or incomplete)
+#define SC_RTP_RECEIVER_SLOTS 4
+
+struct sc_rtp_frame {
+    const uint8_t *data; // valid until the next sc_rtp_receiver_push() call
+    uint32_t size;
+    uint64_t pts_flags;
+    uint8_t clock_domain;
+    uint64_t capture_ns;
+    // Number of frames dropped (incomplete or never received) just before
+    // this one
+    uint32_t lost;
+};
+
+struct sc_rtp_receiver_slot {
+    bool used;
+    uint32_t index;
+    uint64_t pts_flags;
+    uint8_t clock_domain;
+    uint64_t capture_ns;
+    uint32_t size;
+    uint16_t fragment_count;
+    uint16_t fragment_size;
+    uint8_t fec_group;
+    uint32_t received; // data fragments received or recovered
+
+    uint8_t *data;
+    size_t data_cap;
+    uint8_t *parity; // one fragment_size buffer per group
+    size_t parity_cap;
+    bool *present; // data fragments, then parity fragments
+    size_t present_cap;
+};
+
+/**
+ * Reassembly of the packets received over RTP.
+ *
+ * The packets are delivered in order, as soon as they are complete: the
+ * packets which are still incomplete when a later packet completes are
+ * dropped (there is no retransmission, so waiting for them would only stall
+ * the stream).
+ *
+ * A receiver is not thread-safe.
+ */
+struct sc_rtp_receiver {
+    uint32_t ssrc;
+    uint32_t next_index; // index of the next frame to deliver
+    uint32_t pending_lost; // dropped since the last delivered frame
+
+    struct sc_rtp_receiver_slot slots[SC_RTP_RECEIVER_SLOTS];
+
+    // statistics
+    uint64_t frames;
+    uint64_t lost;
+    uint64_t recovered; // fragments recovered by FEC
+    uint64_t invalid; // datagrams ignored
+};
+
+void
+sc_rtp_receiver_init(struct sc_rtp_receiver *rx, uint32_t ssrc);
+
+void
+sc_rtp_receiver_destroy(struct sc_rtp_receiver *rx);
+
+/**
+ * Process a received datagram
+ *
+ * Return true if it completed a frame, written to `frame`.
+ */
+bool
+sc_rtp_receiver_push(struct sc_rtp_receiver *rx, const uint8_t *datagram,
+                     size_t len, struct sc_rtp_frame *frame);
+
+#endif
@@ -1,6 +1,7 @@
 #include "scrcpy.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <libavformat/avformat.h>
@@ -13,21 +14,43 @@
 # include <windows.h>
 #endif
 
+#include "adb/adb.h"
+#include "audio_pipe.h"
 #include "audio_player.h"
+#include "auto_tune.h"
+#include "bitrate_control.h"
+#include "clock_sync.h"
+#include "codec_probe.h"
 #include "controller.h"
 #include "decoder.h"
 #include "delay_buffer.h"
 #include "demuxer.h"
+#include "device_remap.h"
 #include "events.h"
+#include "eye_merger.h"
 #include "file_pusher.h"
+#include "frame_encoder.h"
+#include "gl_readback.h"
 #include "keyboard_sdk.h"
+#include "latency_probe.h"
+#include "latency_trace.h"
+#include "metrics.h"
 #include "mouse_sdk.h"
+#include "packet_pipe.h"
+#include "pose_buffer.h"
 #include "recorder.h"
+#include "remap_reloader.h"
 #include "screen.h"
 #include "server.h"
+#include "stream_dump.h"
 #include "uhid/gamepad_uhid.h"
 #include "uhid/keyboard_uhid.h"
 #include "uhid/mouse_uhid.h"
+#include "uplink.h"
+#include "uploader.h"
+#include "video_preprocess.h"
+#include "video_reconfigurer.h"
+#include "video_processor.h"
 #ifdef HAVE_USB
 # include "usb/aoa_hid.h"
 # include "usb/gamepad_aoa.h"
@@ -51,17 +74,37 @@ struct scrcpy {
     struct sc_server server;
     struct sc_screen screen;
     struct sc_audio_player audio_player;
-    struct sc_demuxer video_demuxer;
+    struct sc_audio_pipe audio_pipe;
+    struct sc_packet_pipe packet_pipe;
+    // Serialize the video frames and the audio blocks written to stdout
+    sc_mutex pipe_mutex;
+    struct sc_demuxer video_demuxer; // left eye with --split-eyes
+    struct sc_demuxer video_right_demuxer; // --split-eyes
+    struct sc_demuxer camera_demuxer; // --camera-record
     struct sc_demuxer audio_demuxer;
+    struct sc_stream_dump stream_dump; // --dump-stream
     struct sc_decoder video_decoder;
+    struct sc_decoder video_right_decoder;
     struct sc_decoder audio_decoder;
+    struct sc_eye_merger eye_merger;
     struct sc_recorder recorder;
+    struct sc_recorder camera_recorder; // --camera-record
+    struct sc_uploader uploader;
     struct sc_delay_buffer display_buffer;
+    struct sc_video_processor video_processor;
+    struct sc_gl_readback gl_readback; // --gpu-readback
+    struct sc_frame_encoder frame_encoder;
 #ifdef HAVE_V4L2
     struct sc_v4l2_sink v4l2_sink;
     struct sc_delay_buffer v4l2_buffer;
+    struct sc_v4l2_sink v4l2_sink_left;
+    struct sc_v4l2_sink v4l2_sink_right;
 #endif
     struct sc_controller controller;
+    struct sc_clock_sync clock_sync;
+    struct sc_pose_buffer pose_buffer;
+    struct sc_uplink uplink; // --aggregator
+    struct sc_bitrate_control bitrate_control;
     struct sc_file_pusher file_pusher;
 #ifdef HAVE_USB
     struct sc_usb usb;
@@ -91,6 +134,13 @@ struct scrcpy {
 #endif
     };
     struct sc_timeout timeout;
+    // Remap maps, loaded during the server connection (NULL if disabled)
+    struct sc_video_preprocess *video_preprocess;
+    struct sc_remap_reloader remap_reloader;
+    struct sc_video_reconfigurer video_reconfigurer;
+
+    sc_tick start_time; // for the startup timing report
+    bool first_frame_reported;
 };
 
 #ifdef _WIN32
@@ -198,6 +248,18 @@ event_loop(struct scrcpy *s) {
                 run(userdata);
                 break;
             }
+            case SC_EVENT_NEW_FRAME:
+            case SC_EVENT_SCREEN_FRAME_SIZE:
+                if (!s->first_frame_reported) {
+                    sc_tick elapsed = sc_tick_now() - s->start_time;
+                    LOGI("Startup: first frame after %" PRItick " ms",
+                         SC_TICK_TO_MS(elapsed));
+                    s->first_frame_reported = true;
+                }
+                if (!sc_screen_handle_event(&s->screen, &event)) {
+                    return SCRCPY_EXIT_FAILURE;
+                }
+                break;
             default:
                 if (!sc_screen_handle_event(&s->screen, &event)) {
                     return SCRCPY_EXIT_FAILURE;
@@ -208,6 +270,48 @@ event_loop(struct scrcpy *s) {
     return SCRCPY_EXIT_FAILURE;
 }
 
+// The server steps are sequential (on the server thread), while the client
+// initialization (SDL, remap maps) runs concurrently on other threads
+static void
+log_startup_timing(const struct sc_server_timing *timing, sc_tick start_time,
+                   sc_tick client_ready, sc_tick remap_wait) {
+    LOGI("Startup: device selected in %" PRItick " ms, server started in %"
+         PRItick " ms, connected in %" PRItick " ms (total %" PRItick " ms)",
+         SC_TICK_TO_MS(timing->device_selected - timing->start),
+         SC_TICK_TO_MS(timing->server_started - timing->device_selected),
+         SC_TICK_TO_MS(timing->connected - timing->server_started),
+         SC_TICK_TO_MS(timing->connected - start_time));
+    LOGD("Startup: client initialized in %" PRItick " ms, remap maps awaited "
+         "for %" PRItick " ms after the connection",
+         SC_TICK_TO_MS(client_ready - start_time), SC_TICK_TO_MS(remap_wait));
+}
+
+// Add the sink to the source, pushed from its own thread if `async` is set
+// (--async-sinks)
+static void
+add_frame_sink(struct sc_frame_source *source, struct sc_frame_sink *sink,
+               bool async, enum sc_frame_worker_policy policy,
+               const char *name) {
+    if (async) {
+        sc_frame_source_add_async_sink(source, sink, policy, name);
+    } else {
+        sc_frame_source_add_sink(source, sink);
+    }
+}
+
+// Add the sink to the source, pushed from its own thread if `async` is set
+// (--async-sinks)
+static void
+add_packet_sink(struct sc_packet_source *source, struct sc_packet_sink *sink,
+                bool async, enum sc_packet_worker_policy policy,
+                const char *name) {
+    if (async) {
+        sc_packet_source_add_async_sink(source, sink, policy, name);
+    } else {
+        sc_packet_source_add_sink(source, sink);
+    }
+}
+
 static void
 terminate_event_loop(void) {
     sc_reject_new_runnables();
@@ -261,6 +365,15 @@ sc_recorder_on_ended(struct sc_recorder *recorder, bool success,
     }
 }
 
+static void
+sc_frame_encoder_on_error(struct sc_frame_encoder *fe, void *userdata) {
+    (void) fe;
+    (void) userdata;
+
+    // The rectified frames could not be recorded
+    sc_push_event(SC_EVENT_RECORDER_ERROR);
+}
+
 static void
 sc_video_demuxer_on_ended(struct sc_demuxer *demuxer,
                           enum sc_demuxer_status status, void *userdata) {
@@ -277,6 +390,45 @@ sc_video_demuxer_on_ended(struct sc_demuxer *demuxer,
     }
 }
 
+static void
+sc_request_key_frame(struct sc_controller *controller) {
+    if (!controller) {
+        // Without control, the stream only recovers on the next periodic key
+        // frame
+        return;
+    }
+
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_REQUEST_KEY_FRAME;
+
+    if (!sc_controller_push_msg(controller, &msg)) {
+        LOGW("Could not request a key frame");
+    }
+}
+
+static void
+sc_video_demuxer_on_key_frame_needed(struct sc_demuxer *demuxer,
+                                     void *userdata) {
+    (void) demuxer;
+    sc_request_key_frame(userdata);
+}
+
+static sc_socket
+sc_video_demuxer_on_reconnect(struct sc_demuxer *demuxer, void *userdata) {
+    (void) userdata;
+
+    // Only the (single) video demuxer is resumed
+    struct scrcpy *s = container_of(demuxer, struct scrcpy, video_demuxer);
+    return sc_server_reconnect_video(&s->server);
+}
+
+static void
+sc_video_decoder_on_key_frame_needed(struct sc_decoder *decoder,
+                                     void *userdata) {
+    (void) decoder;
+    sc_request_key_frame(userdata);
+}
+
 static void
 sc_audio_demuxer_on_ended(struct sc_demuxer *demuxer,
                           enum sc_demuxer_status status, void *userdata) {
@@ -286,7 +438,12 @@ sc_audio_demuxer_on_ended(struct sc_demuxer *demuxer,
 
     // Contrary to the video demuxer, keep mirroring if only the audio fails
     // (unless --require-audio is set).
-    if (status == SC_DEMUXER_STATUS_EOS) {
+    if (status == SC_DEMUXER_STATUS_EOS && options->reconnect_timeout
+            && !options->require_audio) {
+        // The audio connection is not resumed, but the session may survive
+        // the connection loss
+        LOGW("Audio connection lost, continuing without audio");
+    } else if (status == SC_DEMUXER_STATUS_EOS) {
         sc_push_event(SC_EVENT_DEVICE_DISCONNECTED);
     } else if (status == SC_DEMUXER_STATUS_ERROR
             || (status == SC_DEMUXER_STATUS_DISABLED
@@ -370,6 +527,44 @@ init_sdl_gamepads(void) {
 
 
 
+struct sc_video_preprocess_init {
+    const struct scrcpy_options *options;
+    struct sc_video_preprocess *vpp; // the result, NULL on error
+};
+
+static int
+run_video_preprocess_init(void *data) {
+    struct sc_video_preprocess_init *init = data;
+    const struct scrcpy_options *options = init->options;
+
+    init->vpp = sc_video_preprocess_new(options->opencv_map_path,
+                                        options->opencv_backend,
+                                        options->preview_downscale);
+    if (!init->vpp) {
+        return 1;
+    }
+
+    struct sc_remap_layout layout =
+        sc_video_preprocess_get_layout(init->vpp);
+    if ((options->pipe_depth || options->pipe_features)
+            && !sc_remap_layout_is_side_by_side(&layout)) {
+        // The disparities and the features match the two eyes
+        LOGE("--pipe-depth and --pipe-output=features require the remap maps "
+             "of a stereo pair side by side");
+        sc_video_preprocess_destroy(init->vpp);
+        init->vpp = NULL;
+        return 1;
+    }
+
+    if (options->cuda_ipc_output
+            && !sc_video_preprocess_set_cuda_ipc_output(
+                    init->vpp, options->cuda_ipc_output)) {
+        sc_video_preprocess_destroy(init->vpp);
+        init->vpp = NULL;
+    }
+    return init->vpp ? 0 : 1;
+}
+
 enum scrcpy_exit_code
 scrcpy(struct scrcpy_options *options) {
     static struct scrcpy scrcpy;
@@ -379,6 +574,10 @@ scrcpy(struct scrcpy_options *options) {
 #endif
     struct scrcpy *s = &scrcpy;
 
+    s->start_time = sc_tick_now();
+    s->first_frame_reported = false;
+    s->video_preprocess = NULL;
+
     // Minimal SDL initialization
     if (SDL_Init(SDL_INIT_EVENTS)) {
         LOGE("Could not initialize SDL: %s", SDL_GetError());
@@ -387,17 +586,37 @@ scrcpy(struct scrcpy_options *options) {
 
     atexit(SDL_Quit);
 
+    if (options->adb_path) {
+        sc_adb_set_executable(options->adb_path);
+    }
+
     enum scrcpy_exit_code ret = SCRCPY_EXIT_FAILURE;
 
     bool server_started = false;
+    bool video_preprocess_init_started = false;
+    sc_thread video_preprocess_init_thread;
+    struct sc_video_preprocess_init video_preprocess_init = {
+        .options = options,
+        .vpp = NULL,
+    };
     bool file_pusher_initialized = false;
     bool recorder_initialized = false;
     bool recorder_started = false;
+    bool camera_recorder_initialized = false;
+    bool camera_recorder_started = false;
+    bool uploader_initialized = false;
+    bool uploader_started = false;
 #ifdef HAVE_V4L2
     bool v4l2_sink_initialized = false;
+    bool v4l2_sink_left_initialized = false;
+    bool v4l2_sink_right_initialized = false;
 #endif
     bool video_demuxer_started = false;
+    bool video_right_demuxer_started = false;
+    bool camera_demuxer_started = false;
     bool audio_demuxer_started = false;
+    bool eye_merger_initialized = false;
+    bool stream_dump_opened = false;
 #ifdef HAVE_USB
     bool aoa_hid_initialized = false;
     bool keyboard_aoa_initialized = false;
@@ -406,7 +625,24 @@ scrcpy(struct scrcpy_options *options) {
 #endif
     bool controller_initialized = false;
     bool controller_started = false;
+    bool clock_sync_initialized = false;
+    bool clock_sync_started = false;
+    bool pose_buffer_initialized = false;
+    bool uplink_initialized = false;
+    bool uplink_started = false;
+    bool bitrate_control_initialized = false;
+    bool bitrate_control_started = false;
+    bool remap_reloader_initialized = false;
+    bool remap_reloader_started = false;
+    bool video_reconfigurer_initialized = false;
+    bool video_reconfigurer_started = false;
     bool screen_initialized = false;
+    bool gl_readback_initialized = false;
+    bool pipe_mutex_initialized = false;
+    bool latency_trace_initialized = false;
+    bool latency_probe_initialized = false;
+    bool metrics_initialized = false;
+    bool auto_tune_initialized = false;
     bool timeout_initialized = false;
     bool timeout_started = false;
 
@@ -414,6 +650,52 @@ scrcpy(struct scrcpy_options *options) {
 
     uint32_t scid = scrcpy_generate_scid();
 
+    // With --device-remap, the maps are needed before starting the server,
+    // to be pushed to the device (the client never remaps the frames)
+    char *remap_map = NULL;
+    if (options->device_remap) {
+        struct sc_video_preprocess *vpp =
+            sc_video_preprocess_new(options->opencv_map_path,
+                                    SC_OPENCV_BACKEND_CPU, 1);
+        if (!vpp) {
+            return SCRCPY_EXIT_FAILURE;
+        }
+
+        remap_map = sc_device_remap_write_map(vpp, scid,
+                                              options->device_remap_crop);
+        sc_video_preprocess_destroy(vpp);
+        if (!remap_map) {
+            return SCRCPY_EXIT_FAILURE;
+        }
+    }
+
+    // The frame timestamps are computed from the capture timestamps sent by
+    // the device in the video packet headers (or embedded in the bitstream,
+    // with --timestamp-sei)
+    bool capture_timestamp = options->video && !options->timestamp_sei
+                          && (options->show_timestamps || options->save_frames
+                           || options->pipe_output || options->pipe_packets
+                           || options->shm_output || options->cuda_ipc_output
+                           || options->publish_port
+                           || options->aggregator_port);
+    // The exposure of the camera frames follows the capture timestamp
+    bool capture_exposure = capture_timestamp && options->capture_exposure;
+
+    // Without clock synchronization (which requires control), the frame
+    // timestamps are computed from the device boot time
+    bool frame_timestamps = options->show_timestamps || options->save_frames
+                         || options->pipe_output || options->pipe_packets
+                         || options->shm_output || options->cuda_ipc_output
+                         || options->publish_port || options->aggregator_port;
+    // In low latency mode, the end-to-end audio latency is measured
+    bool audio_latency_measured = options->audio_playback
+            && options->audio_latency == SC_AUDIO_LATENCY_LOW;
+    bool clock_sync_enabled = options->control
+                           && (frame_timestamps || audio_latency_measured);
+    bool probe_boot_time = !clock_sync_enabled
+                        && (frame_timestamps || options->record_timestamps
+                            || options->pipe_audio);
+
     struct sc_server_params params = {
         .scid = scid,
         .req_serial = options->serial,
@@ -429,9 +711,18 @@ scrcpy(struct scrcpy_options *options) {
         .port_range = options->port_range,
         .tunnel_host = options->tunnel_host,
         .tunnel_port = options->tunnel_port,
+        .direct_port = options->direct_tcp_port,
+        .video_udp = options->video_transport == SC_VIDEO_TRANSPORT_UDP,
+        .reconnect_timeout = options->reconnect_timeout,
+        .connect_host = options->server_host,
+        .connect_port = options->server_port,
+        .video_fec = options->video_fec,
+        .video_send_buffer = options->video_send_buffer,
         .max_size = options->max_size,
         .video_bit_rate = options->video_bit_rate,
         .audio_bit_rate = options->audio_bit_rate,
+        .audio_read_size = options->audio_read_size,
+        .audio_low_latency = options->audio_latency == SC_AUDIO_LATENCY_LOW,
         .max_fps = options->max_fps,
         .lock_video_orientation = options->lock_video_orientation,
         .control = options->control,
@@ -459,22 +750,57 @@ scrcpy(struct scrcpy_options *options) {
         .power_on = options->power_on,
         .kill_adb_on_close = options->kill_adb_on_close,
         .camera_high_speed = options->camera_high_speed,
+        .capture_timestamp = capture_timestamp,
+        .capture_exposure = capture_exposure,
+        .timestamp_sei = options->timestamp_sei,
+        .encoder_latency = options->print_encoder_latency,
+        .pose_rate = options->pose_rate,
+        .remap_map = remap_map,
+        .split_eyes = options->split_eyes,
+        .camera_stream = !!options->camera_record_filename,
+        .latency_profile = options->latency_profile,
+        .encoder_async = options->encoder_async,
+        .repeat_frame_delay = options->repeat_frame_delay,
+        .daemon = options->server_daemon,
+        .probe_boot_time = probe_boot_time,
         .list = options->list,
     };
 
+    if (options->video && options->video_codec_auto && !options->list) {
+        // With --split-eyes, both eyes are decoded in parallel
+        unsigned streams = options->split_eyes ? 2 : 1;
+        params.video_codec_count =
+            sc_codec_probe_select_for_options(options, streams,
+                                              params.video_codecs);
+    }
+
     static const struct sc_server_callbacks cbs = {
         .on_connection_failed = sc_server_on_connection_failed,
         .on_connected = sc_server_on_connected,
         .on_disconnected = sc_server_on_disconnected,
     };
     if (!sc_server_init(&s->server, &params, &cbs, NULL)) {
+        if (remap_map) {
+            sc_device_remap_remove_map(remap_map);
+            free(remap_map);
+        }
         return SCRCPY_EXIT_FAILURE;
     }
 
     if (options->window) {
         // Set hints before starting the server thread to avoid race conditions
         // in SDL
-        sdl_set_hints(options->render_driver);
+        const char *render_driver = options->render_driver;
+#ifdef _WIN32
+        if (!render_driver && options->low_latency_present
+                && !options->gpu_remap && !options->gpu_readback) {
+            // Presents through a flip-model swap chain, with a configurable
+            // frame latency (the OpenGL renderers are required by the GPU
+            // remap)
+            render_driver = "direct3d11";
+        }
+#endif
+        sdl_set_hints(render_driver);
     }
 
     if (!sc_server_start(&s->server)) {
@@ -493,11 +819,38 @@ scrcpy(struct scrcpy_options *options) {
     assert(!options->video_playback || options->video);
     assert(!options->audio_playback || options->audio);
 
-    if (options->window ||
+    sc_video_preprocess_set_threads(options->preprocess_threads);
+
+    // Outputs of the decoded frames which do not require the video playback
+    bool video_outputs = options->video
+                      && (options->save_frames || options->pipe_output
+                       || options->shm_output || options->cuda_ipc_output
+                       || options->publish_port
+                       || options->record_rectified
+                       || options->v4l2_device_left
+                       || options->v4l2_device_right);
+
+    // The remap maps are loaded (and validated) during the server connection,
+    // rather than on the first frame
+    bool remap = (options->video_playback || video_outputs)
+              && options->opencv_enabled && options->opencv_map_path
+              && !options->device_remap;
+    if (remap) {
+        bool ok = sc_thread_create(&video_preprocess_init_thread,
+                                   run_video_preprocess_init, "scrcpy-remap",
+                                   &video_preprocess_init);
+        if (!ok) {
+            LOGE("Could not start remap initialization thread");
+            goto end;
+        }
+        video_preprocess_init_started = true;
+    }
+
+    if (options->window || options->gpu_readback ||
             (options->control && options->clipboard_autosync)) {
         // Initialize the video subsystem even if --no-video or
         // --no-video-playback is passed so that clipboard synchronization
-        // still works.
+        // still works (and for the OpenGL context of --gpu-readback).
         // <https://github.com/Genymobile/scrcpy/issues/4418>
         if (SDL_Init(SDL_INIT_VIDEO)) {
             // If it fails, it is an error only if video playback is enabled
@@ -525,6 +878,7 @@ scrcpy(struct scrcpy_options *options) {
     }
 
     sdl_configure(options->video_playback, options->disable_screensaver);
+    sc_tick client_ready = sc_tick_now();
 
     // Await for server without blocking Ctrl+C handling
     bool connected;
@@ -542,6 +896,65 @@ scrcpy(struct scrcpy_options *options) {
 
     LOGD("Server connected");
 
+    sc_tick remap_wait = 0;
+    if (video_preprocess_init_started) {
+        sc_tick remap_wait_start = sc_tick_now();
+        int status;
+        sc_thread_join(&video_preprocess_init_thread, &status);
+        video_preprocess_init_started = false;
+        s->video_preprocess = video_preprocess_init.vpp;
+        if (status) {
+            // error already logged
+            goto end;
+        }
+        remap_wait = sc_tick_now() - remap_wait_start;
+    }
+
+    log_startup_timing(&s->server.timing, s->start_time, client_ready,
+                       remap_wait);
+
+    struct sc_remap_reloader *remap_reloader = NULL;
+    if (s->video_preprocess && options->window) {
+        // The calibration may be reloaded by a shortcut
+        if (!sc_remap_reloader_init(&s->remap_reloader, s->video_preprocess,
+                                    options->opencv_map_path)) {
+            goto end;
+        }
+        remap_reloader_initialized = true;
+
+        if (!sc_remap_reloader_start(&s->remap_reloader)) {
+            goto end;
+        }
+        remap_reloader_started = true;
+        remap_reloader = &s->remap_reloader;
+    }
+
+    struct sc_video_reconfigurer *video_reconfigurer = NULL;
+    if (options->video_preset_count) {
+        // The maps for the next size may be scaled in advance only if the
+        // displayed frames have the size of the decoded frames
+        bool prewarm = remap && s->video_preprocess
+                    && options->preview_downscale <= 1
+                    && !options->show_timestamps;
+        if (!sc_video_reconfigurer_init(&s->video_reconfigurer,
+                                        &s->controller,
+                                        prewarm ? s->video_preprocess : NULL,
+                                        options->video_presets,
+                                        options->video_preset_count)) {
+            goto end;
+        }
+        video_reconfigurer_initialized = true;
+
+        if (!sc_video_reconfigurer_start(&s->video_reconfigurer)) {
+            goto end;
+        }
+        video_reconfigurer_started = true;
+        video_reconfigurer = &s->video_reconfigurer;
+    }
+
+    // 0 if not retrieved (the clock is synchronized over the control socket)
+    int64_t device_boot_time = sc_server_get_device_boot_time(&s->server);
+
     // It is necessarily initialized here, since the device is connected
     struct sc_server_info *info = &s->server.info;
 
@@ -552,7 +965,8 @@ scrcpy(struct scrcpy_options *options) {
 
     if (options->video_playback && options->control) {
         if (!sc_file_pusher_init(&s->file_pusher, serial,
-                                 options->push_target)) {
+                                 options->push_target,
+                                 options->push_workers)) {
             goto end;
         }
         fp = &s->file_pusher;
@@ -562,9 +976,92 @@ scrcpy(struct scrcpy_options *options) {
     if (options->video) {
         static const struct sc_demuxer_callbacks video_demuxer_cbs = {
             .on_ended = sc_video_demuxer_on_ended,
+            .on_key_frame_needed = sc_video_demuxer_on_key_frame_needed,
+        };
+        static const struct sc_demuxer_callbacks resumable_video_demuxer_cbs = {
+            .on_ended = sc_video_demuxer_on_ended,
+            .on_key_frame_needed = sc_video_demuxer_on_key_frame_needed,
+            .on_reconnect = sc_video_demuxer_on_reconnect,
+        };
+        // The video is decoded only for playback or V4L2
+        bool decoded = options->video_playback;
+#ifdef HAVE_V4L2
+        decoded |= !!options->v4l2_device;
+#endif
+        struct sc_decoder_config decoder_config = {
+            .hw_decoder = options->hw_decoder,
+            .threads = options->decoder_threads,
+            .mode = options->decoder_mode,
+            .latency_profile = options->latency_profile,
         };
         sc_demuxer_init(&s->video_demuxer, "video", s->server.video_socket,
-                        &video_demuxer_cbs, NULL);
+                        capture_timestamp, decoded ? &decoder_config : NULL,
+                        options->reconnect_timeout
+                            ? &resumable_video_demuxer_cbs
+                            : &video_demuxer_cbs,
+                        options->control ? &s->controller : NULL);
+        if (s->server.video_udp_socket != SC_SOCKET_NONE) {
+            // The controller is started before the demuxer, so the key frame
+            // requests may be pushed as soon as the packets are received
+            sc_demuxer_configure_rtp(&s->video_demuxer,
+                                     s->server.video_udp_socket,
+                                     (uint32_t) s->server.direct_token);
+        }
+
+        if (options->catch_up) {
+            sc_demuxer_configure_catch_up(&s->video_demuxer,
+                                          options->catch_up);
+        }
+
+        if (capture_exposure) {
+            sc_demuxer_configure_capture_exposure(&s->video_demuxer);
+        }
+
+        if (options->timestamp_sei) {
+            sc_demuxer_configure_timestamp_sei(&s->video_demuxer);
+        }
+
+        if (options->dump_stream_filename) {
+            if (!sc_stream_dump_open(&s->stream_dump,
+                                     options->dump_stream_filename,
+                                     capture_timestamp, capture_exposure)) {
+                goto end;
+            }
+            stream_dump_opened = true;
+            sc_demuxer_configure_dump(&s->video_demuxer, &s->stream_dump);
+        }
+
+        if (options->split_eyes) {
+            // Neither dumped nor received over RTP (rejected by the command
+            // line parser)
+            sc_demuxer_init(&s->video_right_demuxer, "video-right",
+                            s->server.video_right_socket, capture_timestamp,
+                            &decoder_config, &video_demuxer_cbs,
+                            options->control ? &s->controller : NULL);
+            if (capture_exposure) {
+                sc_demuxer_configure_capture_exposure(
+                    &s->video_right_demuxer);
+            }
+            if (options->timestamp_sei) {
+                sc_demuxer_configure_timestamp_sei(&s->video_right_demuxer);
+            }
+        }
+
+        if (options->camera_record_filename) {
+            // The camera stream is only recorded, not decoded. It is
+            // neither dumped nor received over RTP (rejected by the command
+            // line parser), and its key frames are periodic (the key frame
+            // requests target the display encoder).
+            static const struct sc_demuxer_callbacks camera_demuxer_cbs = {
+                .on_ended = sc_video_demuxer_on_ended,
+            };
+            sc_demuxer_init(&s->camera_demuxer, "camera",
+                            s->server.camera_socket, capture_timestamp, NULL,
+                            &camera_demuxer_cbs, NULL);
+            if (options->timestamp_sei) {
+                sc_demuxer_configure_timestamp_sei(&s->camera_demuxer);
+            }
+        }
     }
 
     if (options->audio) {
@@ -572,23 +1069,73 @@ scrcpy(struct scrcpy_options *options) {
             .on_ended = sc_audio_demuxer_on_ended,
         };
         sc_demuxer_init(&s->audio_demuxer, "audio", s->server.audio_socket,
-                        &audio_demuxer_cbs, options);
+                        false, NULL, &audio_demuxer_cbs, options);
     }
 
-    bool needs_video_decoder = options->video_playback;
+    bool needs_video_decoder = options->video_playback || video_outputs;
     bool needs_audio_decoder = options->audio_playback;
 #ifdef HAVE_V4L2
     needs_video_decoder |= !!options->v4l2_device;
 #endif
     if (needs_video_decoder) {
-        sc_decoder_init(&s->video_decoder, "video");
-        sc_packet_source_add_sink(&s->video_demuxer.packet_source,
-                                  &s->video_decoder.packet_sink);
+        static const struct sc_decoder_callbacks video_decoder_cbs = {
+            .on_key_frame_needed = sc_video_decoder_on_key_frame_needed,
+        };
+        sc_decoder_init(&s->video_decoder, "video", &video_decoder_cbs,
+                        options->control ? &s->controller : NULL);
+        add_packet_sink(&s->video_demuxer.packet_source,
+                        &s->video_decoder.packet_sink, options->async_sinks,
+                        SC_PACKET_WORKER_BLOCK, "video decoder");
+
+        if (options->split_eyes) {
+            // Each eye is decoded by its own demuxer thread, in parallel
+            sc_decoder_init(&s->video_right_decoder, "video-right",
+                            &video_decoder_cbs,
+                            options->control ? &s->controller : NULL);
+            add_packet_sink(&s->video_right_demuxer.packet_source,
+                            &s->video_right_decoder.packet_sink,
+                            options->async_sinks, SC_PACKET_WORKER_BLOCK,
+                            "right video decoder");
+
+            if (!sc_eye_merger_init(&s->eye_merger)) {
+                goto end;
+            }
+            eye_merger_initialized = true;
+
+            sc_frame_source_add_sink(&s->video_decoder.frame_source,
+                                     &s->eye_merger.inputs[SC_EYE_LEFT]
+                                         .frame_sink);
+            sc_frame_source_add_sink(&s->video_right_decoder.frame_source,
+                                     &s->eye_merger.inputs[SC_EYE_RIGHT]
+                                         .frame_sink);
+        }
     }
     if (needs_audio_decoder) {
-        sc_decoder_init(&s->audio_decoder, "audio");
-        sc_packet_source_add_sink(&s->audio_demuxer.packet_source,
-                                  &s->audio_decoder.packet_sink);
+        sc_decoder_init(&s->audio_decoder, "audio", NULL, NULL);
+        add_packet_sink(&s->audio_demuxer.packet_source,
+                        &s->audio_decoder.packet_sink, options->async_sinks,
+                        SC_PACKET_WORKER_BLOCK, "audio decoder");
+    }
+
+    // Fed by the recorder and the frame writer, until they are destroyed
+    struct sc_uploader *uploader = NULL;
+    if (options->upload_dir) {
+        struct sc_uploader_params uploader_params = {
+            .directory = options->upload_dir,
+            .max_rate = options->upload_max_rate,
+            .delete_local = options->upload_delete,
+            .thread_count = options->upload_threads,
+        };
+        if (!sc_uploader_init(&s->uploader, &uploader_params)) {
+            goto end;
+        }
+        uploader_initialized = true;
+
+        if (!sc_uploader_start(&s->uploader)) {
+            goto end;
+        }
+        uploader_started = true;
+        uploader = &s->uploader;
     }
 
     if (options->record_filename) {
@@ -598,27 +1145,108 @@ scrcpy(struct scrcpy_options *options) {
         if (!sc_recorder_init(&s->recorder, options->record_filename,
                               options->record_format, options->video,
                               options->audio, options->record_orientation,
+                              options->record_segment,
+                              options->record_fragmented,
                               &recorder_cbs, NULL)) {
             goto end;
         }
         recorder_initialized = true;
 
+        if (uploader) {
+            sc_recorder_set_uploader(&s->recorder, uploader);
+        }
+
         if (!sc_recorder_start(&s->recorder)) {
             goto end;
         }
         recorder_started = true;
 
-        if (options->video) {
-            sc_packet_source_add_sink(&s->video_demuxer.packet_source,
-                                      &s->recorder.video_packet_sink);
+        // With --record-rectified, the recorder receives the packets of the
+        // frame encoder instead (see below)
+        if (options->video && !options->record_rectified) {
+            add_packet_sink(&s->video_demuxer.packet_source,
+                            &s->recorder.video_packet_sink,
+                            options->async_sinks,
+                            SC_PACKET_WORKER_DROP_TO_KEY_FRAME,
+                            "video recorder");
+            // The recording keeps the packets skipped to catch up
+            sc_packet_source_set_lossless(&s->video_demuxer.packet_source,
+                                          &s->recorder.video_packet_sink);
         }
         if (options->audio) {
-            sc_packet_source_add_sink(&s->audio_demuxer.packet_source,
-                                      &s->recorder.audio_packet_sink);
+            add_packet_sink(&s->audio_demuxer.packet_source,
+                            &s->recorder.audio_packet_sink,
+                            options->async_sinks,
+                            SC_PACKET_WORKER_DROP_TO_KEY_FRAME,
+                            "audio recorder");
         }
     }
 
+    if (options->camera_record_filename) {
+        static const struct sc_recorder_callbacks camera_recorder_cbs = {
+            .on_ended = sc_recorder_on_ended,
+        };
+        // Video only: the audio is recorded with the display (--record). It
+        // is split and fragmented like the display recording.
+        if (!sc_recorder_init(&s->camera_recorder,
+                              options->camera_record_filename,
+                              options->camera_record_format, true, false,
+                              SC_ORIENTATION_0, options->record_segment,
+                              options->record_fragmented
+                                && options->camera_record_format
+                                    == SC_RECORD_FORMAT_MP4,
+                              &camera_recorder_cbs, NULL)) {
+            goto end;
+        }
+        camera_recorder_initialized = true;
+
+        if (uploader) {
+            sc_recorder_set_uploader(&s->camera_recorder, uploader);
+        }
+
+        if (!sc_recorder_start(&s->camera_recorder)) {
+            goto end;
+        }
+        camera_recorder_started = true;
+
+        add_packet_sink(&s->camera_demuxer.packet_source,
+                        &s->camera_recorder.video_packet_sink,
+                        options->async_sinks,
+                        SC_PACKET_WORKER_DROP_TO_KEY_FRAME,
+                        "camera recorder");
+        sc_packet_source_set_lossless(&s->camera_demuxer.packet_source,
+                                      &s->camera_recorder.video_packet_sink);
+    }
+
+    struct sc_uplink *uplink = NULL;
+    if (options->aggregator_port) {
+        // The clock sync is initialized below, before the first packet or
+        // pose sample is forwarded
+        struct sc_uplink_params uplink_params = {
+            .host = options->aggregator_host,
+            .port = options->aggregator_port,
+            .node = options->aggregator_node ? options->aggregator_node
+                                             : serial,
+            .clock_sync = clock_sync_enabled ? &s->clock_sync : NULL,
+            .serial = serial,
+            .device_boot_time = device_boot_time,
+        };
+        if (!sc_uplink_init(&s->uplink, &uplink_params)) {
+            goto end;
+        }
+        uplink_initialized = true;
+
+        if (!sc_uplink_start(&s->uplink)) {
+            goto end;
+        }
+        uplink_started = true;
+        uplink = &s->uplink;
+    }
+
     struct sc_controller *controller = NULL;
+    struct sc_clock_sync *clock_sync = NULL;
+    struct sc_pose_buffer *pose_buffer = NULL;
+    struct sc_bitrate_control *bitrate_control = NULL;
     struct sc_key_processor *kp = NULL;
     struct sc_mouse_processor *mp = NULL;
     struct sc_gamepad_processor *gp = NULL;
@@ -773,21 +1401,193 @@ aoa_complete:
             uhid_devices = &s->uhid_devices;
         }
 
-        sc_controller_configure(&s->controller, acksync, uhid_devices);
+        // The frames timestamps are computed from the device clock, which is
+        // synchronized over the control socket
+        if (clock_sync_enabled) {
+            if (!sc_clock_sync_init(&s->clock_sync, &s->controller)) {
+                goto end;
+            }
+            clock_sync_initialized = true;
+            clock_sync = &s->clock_sync;
+        }
+
+        // The pose samples are written along the frames (pipe or archive),
+        // so the clock is synchronized
+        if (options->pose_rate) {
+            assert(clock_sync);
+            if (!sc_pose_buffer_init(&s->pose_buffer, clock_sync)) {
+                goto end;
+            }
+            pose_buffer_initialized = true;
+            pose_buffer = &s->pose_buffer;
+
+            if (uplink) {
+                // Without pipe nor frame archive, the samples are only
+                // forwarded
+                bool buffered = options->video && (options->pipe_output
+                                                || options->frame_archive);
+                sc_pose_buffer_configure_uplink(pose_buffer, uplink, buffered);
+            }
+        }
+
+        sc_controller_configure(&s->controller, acksync, uhid_devices,
+                                clock_sync, pose_buffer);
 
         if (!sc_controller_start(&s->controller)) {
             goto end;
         }
         controller_started = true;
+
+        if (clock_sync) {
+            if (!sc_clock_sync_start(&s->clock_sync)) {
+                goto end;
+            }
+            clock_sync_started = true;
+        }
+
+        if (options->adaptive_bit_rate) {
+            assert(options->video);
+            // 8 Mbps is the default of the server
+            uint32_t max_bit_rate = options->video_bit_rate
+                                  ? options->video_bit_rate : 8000000;
+            // The backlog of a datagram socket is not measurable
+            sc_socket socket = options->video_transport
+                                    == SC_VIDEO_TRANSPORT_TCP
+                             ? s->server.video_socket : SC_SOCKET_NONE;
+            if (!sc_bitrate_control_init(&s->bitrate_control, &s->controller,
+                                         socket, max_bit_rate / 8,
+                                         max_bit_rate)) {
+                goto end;
+            }
+            bitrate_control_initialized = true;
+            bitrate_control = &s->bitrate_control;
+
+            // The demuxer is started later
+            sc_demuxer_configure_bitrate_control(&s->video_demuxer,
+                                                 bitrate_control);
+
+            if (!sc_bitrate_control_start(&s->bitrate_control)) {
+                goto end;
+            }
+            bitrate_control_started = true;
+        }
     }
 
     // There is a controller if and only if control is enabled
     assert(options->control == !!controller);
 
+    if (options->record_timestamps) {
+        assert((options->record_filename || options->camera_record_filename)
+               && options->video);
+        // The demuxers are started later. Both streams are timestamped by the
+        // same clock synchronization, so that their frames may be matched.
+        if (options->record_filename) {
+            sc_recorder_configure_timestamps(&s->recorder, clock_sync, serial,
+                                             device_boot_time);
+        }
+        if (options->camera_record_filename) {
+            sc_recorder_configure_timestamps(&s->camera_recorder, clock_sync,
+                                             serial, device_boot_time);
+        }
+    }
+
+    // The HUD shows the latency of the last frames
+    if (options->print_latency || options->latency_trace_filename
+            || options->hud) {
+        // The demuxer is started later
+        if (!sc_latency_trace_init(options->print_latency,
+                                   options->latency_trace_filename)) {
+            goto end;
+        }
+        latency_trace_initialized = true;
+    }
+
+    if (options->latency_probe.width) {
+        // Before the window is rendered
+        if (!sc_latency_probe_init(&options->latency_probe)) {
+            goto end;
+        }
+        latency_probe_initialized = true;
+    }
+
+    if (options->metrics_filename) {
+        if (!sc_metrics_init(options->metrics_filename)) {
+            goto end;
+        }
+        metrics_initialized = true;
+    }
+
+    if (options->auto_tune) {
+        struct sc_auto_tune_params params = {
+            .target_fps = options->max_fps ? strtof(options->max_fps, NULL)
+                                           : 0,
+            .preprocess_threads = options->preprocess_threads,
+            .decoder_threads = options->decoder_threads,
+            .writer_threads = options->save_frames_threads,
+        };
+        if (!sc_auto_tune_init(&params)) {
+            goto end;
+        }
+        auto_tune_initialized = true;
+    }
+
+    if (options->pipe_audio) {
+        if (!sc_mutex_init(&s->pipe_mutex)) {
+            goto end;
+        }
+        pipe_mutex_initialized = true;
+    }
+
+    // The saved, piped and published frames may be remapped on the GPU only if
+    // the remapped frames are not needed by the sinks
+    bool gl_readback = remap && options->gpu_readback && s->video_preprocess
+                    && (options->save_frames || options->pipe_output
+                     || options->shm_output || options->publish_port)
+                    && !options->record_rectified
+                    && !options->v4l2_device_left
+                    && !options->v4l2_device_right
+                    && !options->pipe_depth && !options->pipe_features;
+#ifdef HAVE_V4L2
+    gl_readback &= !options->v4l2_device;
+#endif
+    if (options->gpu_readback && !gl_readback) {
+        LOGW("GPU readback disabled (the remapped frames are also recorded, "
+             "sent to V4L2 or used for depth or features)");
+    } else if (gl_readback) {
+        int offset = options->show_timestamps
+                   ? SC_VIDEO_PREPROCESS_TEXT_HEIGHT : 0;
+        if (!sc_gl_readback_init(&s->gl_readback, s->video_preprocess,
+                                 offset)) {
+            LOGW("GPU readback not available, the frames are remapped on "
+                 "the CPU");
+        } else {
+            gl_readback_initialized = true;
+        }
+    }
+
+    // Set if the display remaps the frames while rendering
+    bool display_gpu_remap = false;
+
     if (options->window) {
         const char *window_title =
             options->window_title ? options->window_title : info->device_name;
 
+        // The remap may be applied while rendering only if the remapped
+        // frames are not needed by any other output
+        // (with --gpu-readback, the outputs are remapped separately)
+        bool gpu_remap = remap
+                      && (options->gpu_remap || gl_readback_initialized);
+        if (gpu_remap && !gl_readback_initialized
+                && (options->save_frames || options->pipe_output
+                    || options->shm_output || options->publish_port
+                    || options->record_rectified
+                    || options->v4l2_device_left
+                    || options->v4l2_device_right)) {
+            LOGW("GPU remap disabled (the remapped frames are also saved, "
+                 "piped, published, recorded or sent to V4L2)");
+            gpu_remap = false;
+        }
+
         struct sc_screen_params screen_params = {
             .video = options->video_playback,
             .controller = controller,
@@ -799,6 +1599,8 @@ aoa_complete:
             .legacy_paste = options->legacy_paste,
             .clipboard_autosync = options->clipboard_autosync,
             .shortcut_mods = options->shortcut_mods,
+            .mouse_motion_interval = options->mouse_motion_rate
+                ? SC_TICK_FREQ / options->mouse_motion_rate : 0,
             .window_title = window_title,
             .always_on_top = options->always_on_top,
             .window_x = options->window_x,
@@ -808,16 +1610,20 @@ aoa_complete:
             .window_borderless = options->window_borderless,
             .orientation = options->display_orientation,
             .mipmaps = options->mipmaps,
+            .gpu_remap = gpu_remap ? s->video_preprocess : NULL,
+            .remap_reloader = remap_reloader,
+            .video_reconfigurer = video_reconfigurer,
+            .capture_trigger = options->save_frames_pre_trigger != 0,
+            .gpu_remap_offset = options->show_timestamps
+                              ? SC_VIDEO_PREPROCESS_TEXT_HEIGHT : 0,
+            .pbo_upload = options->pbo_upload,
+            .hud = options->hud,
+            .low_latency_present = options->low_latency_present,
+            .render_thread = options->render_thread,
+            .stereo_view = options->stereo_view,
             .fullscreen = options->fullscreen,
             .start_fps_counter = options->start_fps_counter,
-            .save_frames = options->save_frames,
-            .frame_dir = options->frame_dir,
-            .opencv_enabled = options->opencv_enabled,
-            .opencv_map_path = options->opencv_map_path,
-            .serial = options->serial,
-            .pipe_output = options->pipe_output,
-            .show_timestamps = options->show_timestamps,
-            .adb_path = options->adb_path,
+            .bitrate_control = bitrate_control,
         };
 
         if (!sc_screen_init(&s->screen, &screen_params)) {
@@ -825,9 +1631,185 @@ aoa_complete:
         }
         screen_initialized = true;
 
-        if (options->video_playback) {
-            struct sc_frame_source *src = &s->video_decoder.frame_source;
+        display_gpu_remap = options->video_playback
+                         && s->screen.display.gpu_remap;
+    }
+
+    if (gl_readback_initialized && options->video_playback
+            && !display_gpu_remap) {
+        // The displayed frames are remapped by the video processor, the
+        // outputs are remapped with them
+        LOGW("GPU readback disabled (the displayed frames are remapped on the "
+             "CPU)");
+        sc_gl_readback_destroy(&s->gl_readback);
+        gl_readback_initialized = false;
+    }
+
+    // The decoded frames may be processed and output (saved, piped,
+    // published...) without window: in that case, no texture is uploaded and
+    // nothing is rendered
+    if (options->video_playback || video_outputs) {
+        struct sc_frame_source *src = options->split_eyes
+                                    ? &s->eye_merger.frame_source
+                                    : &s->video_decoder.frame_source;
+
+        // If the display remaps the frames, they must not be remapped on
+        // the CPU
+        bool cpu_remap = remap && !display_gpu_remap
+                      && !gl_readback_initialized;
+
+        bool process = cpu_remap || options->show_timestamps
+                    || options->save_frames || options->pipe_output
+                    || options->shm_output || options->cuda_ipc_output
+                    || options->publish_port
+                    || (options->video_playback
+                        && options->preview_downscale > 1)
+                    || options->latency_budget
+                    || options->latency_probe.width
+                    || options->record_rectified
+                    || options->v4l2_device_left
+                    || options->v4l2_device_right;
+        if (process) {
+            struct sc_video_processor_params vp_params = {
+                .remap = cpu_remap ? s->video_preprocess : NULL,
+                .gl_readback = gl_readback_initialized ? &s->gl_readback
+                                                       : NULL,
+                .preview_scale = options->video_playback
+                               ? options->preview_downscale : 1,
+                .show_timestamps = options->show_timestamps,
+                .save_frames = options->save_frames,
+                .frame_dir = options->frame_dir,
+                .frame_archive = options->frame_archive,
+                .frame_writer_format = options->save_frames_format,
+                .frame_writer_quality = options->save_frames_quality,
+                .frame_writer_io = options->save_frames_io,
+                .frame_writer_direct = options->save_frames_direct,
+                .frame_writer_zstd_level = options->save_frames_zstd,
+                .frame_writer_zstd_dict = options->save_frames_zstd_dict,
+                .frame_writer_tile_delta = options->save_frames_tile_delta,
+                .frame_writer_tile_threshold =
+                    options->save_frames_tile_threshold,
+                .frame_writer_key_interval =
+                    options->save_frames_key_interval,
+                .frame_writer_pre_trigger = options->save_frames_pre_trigger,
+                .frame_writer_post_trigger = options->save_frames_post_trigger,
+                .frame_writer_duration = options->time_limit,
+                .luma_only = options->output_planes == SC_OUTPUT_PLANES_Y,
+                .save_rate = options->save_frames_rate,
+                .output_rate = options->pipe_output_rate,
+                .motion_threshold = options->motion_threshold,
+                .frame_writer_threads = options->save_frames_threads,
+                .auto_tune = options->auto_tune,
+                .frame_writer_uploader = uploader,
+                .pipe_output = options->pipe_output,
+                .pipe_format = options->pipe_format,
+                .pipe_payload_crc = options->pipe_payload_crc,
+                .pipe_device = -1,
+                .pipe_mutex = pipe_mutex_initialized ? &s->pipe_mutex
+                                                     : NULL,
+                .pipe_depth = options->pipe_depth,
+                .pipe_features = options->pipe_features,
+                .pyramid_levels = options->output_pyramid,
+                .pipe_feedback_port = options->pipe_feedback_port,
+                .pipe_feedback_host = options->pipe_feedback_host,
+                .pipe_backpressure = options->pipe_backpressure,
+                .shm_output = options->shm_output,
+                .cuda_ipc_output = options->cuda_ipc_output != NULL,
+                .publish_port = options->publish_port,
+                .publish_host = options->publish_host,
+                .publish_queue = options->publish_queue,
+                .publish_drop = options->publish_drop,
+                .export_timestamp = false,
+                .cpu_affinity = options->preprocess_cpus,
+                .latency_budget = options->latency_budget,
+                .latency_probe = options->latency_probe.width,
+                .skip_repeated = options->skip_repeated_frames,
+                .clock_sync = clock_sync,
+                .pose_buffer = pose_buffer,
+                .serial = serial,
+                .device_boot_time = device_boot_time,
+            };
+            if (!sc_video_processor_init(&s->video_processor,
+                                         &vp_params)) {
+                goto end;
+            }
+            add_frame_sink(src, &s->video_processor.frame_sink,
+                           options->async_sinks, SC_FRAME_WORKER_BLOCK,
+                           "video processor");
+            src = &s->video_processor.frame_source;
+
+            // If the frames are only saved, at a reduced rate, the frames
+            // which will not be saved need not be decoded
+            bool save_only = options->save_frames && !options->video_playback
+                          && (options->save_frames_rate.fps
+                           || options->save_frames_rate.key_frames)
+                          && !options->pipe_output && !options->shm_output
+                          && !options->cuda_ipc_output
+                          && !options->publish_port
+                          && !options->record_rectified
+                          && !options->v4l2_device_left
+                          && !options->v4l2_device_right
+                          && !options->split_eyes;
+#ifdef HAVE_V4L2
+            save_only &= !options->v4l2_device;
+#endif
+            if (save_only) {
+                sc_decoder_set_output_rate(&s->video_decoder,
+                                           &options->save_frames_rate);
+            }
+
+            if (options->video_playback && !video_outputs) {
+                // The processed frames are only displayed, no need to process
+                // them while the display is paused
+                sc_screen_set_video_processor(&s->screen, &s->video_processor);
+            }
+        }
+
+        if (options->record_rectified) {
+            static const struct sc_frame_encoder_callbacks
+                frame_encoder_cbs = {
+                .on_error = sc_frame_encoder_on_error,
+            };
+            sc_frame_encoder_init(&s->frame_encoder,
+                                  options->video_bit_rate,
+                                  &frame_encoder_cbs, NULL);
+            add_frame_sink(src, &s->frame_encoder.frame_sink,
+                           options->async_sinks, SC_FRAME_WORKER_BLOCK,
+                           "frame encoder");
+            sc_packet_source_add_sink(&s->frame_encoder.packet_source,
+                                      &s->recorder.video_packet_sink);
+        }
+
+#ifdef HAVE_V4L2
+        // Each stereo sink copies its half directly from the processed
+        // frames, below the timestamps bar if any
+        unsigned skip_rows = options->show_timestamps
+                           ? SC_VIDEO_PREPROCESS_TEXT_HEIGHT : 0;
+        if (options->v4l2_device_left) {
+            if (!sc_v4l2_sink_init(&s->v4l2_sink_left,
+                                   options->v4l2_device_left,
+                                   SC_V4L2_SINK_REGION_LEFT, skip_rows)) {
+                goto end;
+            }
+            add_frame_sink(src, &s->v4l2_sink_left.frame_sink,
+                           options->async_sinks, SC_FRAME_WORKER_DROP_OLDEST,
+                           "left V4L2 sink");
+            v4l2_sink_left_initialized = true;
+        }
+        if (options->v4l2_device_right) {
+            if (!sc_v4l2_sink_init(&s->v4l2_sink_right,
+                                   options->v4l2_device_right,
+                                   SC_V4L2_SINK_REGION_RIGHT, skip_rows)) {
+                goto end;
+            }
+            add_frame_sink(src, &s->v4l2_sink_right.frame_sink,
+                           options->async_sinks, SC_FRAME_WORKER_DROP_OLDEST,
+                           "right V4L2 sink");
+            v4l2_sink_right_initialized = true;
+        }
+#endif
 
+        if (options->video_playback) {
             if (options->display_buffer) {
                 sc_delay_buffer_init(&s->display_buffer,
                                      options->display_buffer, true);
@@ -835,20 +1817,93 @@ aoa_complete:
                 src = &s->display_buffer.frame_source;
             }
 
-            sc_frame_source_add_sink(src, &s->screen.frame_sink);
+            // The display buffer already pushes from its own thread
+            add_frame_sink(src, &s->screen.frame_sink,
+                           options->async_sinks && !options->display_buffer,
+                           SC_FRAME_WORKER_DROP_OLDEST, "screen");
+
+#ifdef SCRCPY_SDL_HAS_UPDATE_NV_TEXTURE
+            // If the decoded frames are only displayed, the frames downloaded
+            // from the hardware decoder are not converted: the display
+            // supports NV12 (except for the GPU remap)
+            bool display_only = !process && !options->split_eyes
+                             && !display_gpu_remap;
+# ifdef HAVE_V4L2
+            display_only &= !options->v4l2_device;
+# endif
+            if (display_only) {
+                sc_decoder_allow_nv12(&s->video_decoder);
+            }
+#endif
         }
     }
 
     if (options->audio_playback) {
+        bool low_latency = options->audio_latency == SC_AUDIO_LATENCY_LOW;
         sc_audio_player_init(&s->audio_player, options->audio_buffer,
-                             options->audio_output_buffer);
-        sc_frame_source_add_sink(&s->audio_decoder.frame_source,
-                                 &s->audio_player.frame_sink);
+                             options->audio_output_buffer, low_latency,
+                             low_latency ? clock_sync : NULL);
+        add_frame_sink(&s->audio_decoder.frame_source,
+                       &s->audio_player.frame_sink, options->async_sinks,
+                       SC_FRAME_WORKER_BLOCK, "audio player");
+    }
+
+    if (options->pipe_audio) {
+        // Fed directly by the decoder, independently of the playback
+        sc_audio_pipe_init(&s->audio_pipe, &s->pipe_mutex, clock_sync, serial,
+                           device_boot_time);
+        add_frame_sink(&s->audio_decoder.frame_source,
+                       &s->audio_pipe.frame_sink, options->async_sinks,
+                       SC_FRAME_WORKER_BLOCK, "audio pipe");
+    }
+
+    if (options->pipe_packets) {
+        // Fed directly by the demuxer, the packets are not decoded
+        sc_packet_pipe_init(&s->packet_pipe,
+                            pipe_mutex_initialized ? &s->pipe_mutex : NULL,
+                            clock_sync, serial, device_boot_time);
+        add_packet_sink(&s->video_demuxer.packet_source,
+                        &s->packet_pipe.packet_sink, options->async_sinks,
+                        SC_PACKET_WORKER_DROP_TO_KEY_FRAME, "packet pipe");
+    }
+
+    if (uplink) {
+        // The uplink queues the packets itself, it never blocks the demuxers
+        struct sc_packet_sink *sink =
+            sc_uplink_get_sink(uplink, UPLINK_STREAM_VIDEO);
+        if (options->video) {
+            sc_packet_source_add_sink(&s->video_demuxer.packet_source, sink);
+            // The whole stream is forwarded, like a recording
+            sc_packet_source_set_lossless(&s->video_demuxer.packet_source,
+                                          sink);
+
+            if (options->split_eyes) {
+                sink = sc_uplink_get_sink(uplink, UPLINK_STREAM_VIDEO_RIGHT);
+                sc_packet_source_add_sink(
+                        &s->video_right_demuxer.packet_source, sink);
+                sc_packet_source_set_lossless(
+                        &s->video_right_demuxer.packet_source, sink);
+            }
+
+            if (options->camera_record_filename) {
+                sink = sc_uplink_get_sink(uplink, UPLINK_STREAM_CAMERA);
+                sc_packet_source_add_sink(&s->camera_demuxer.packet_source,
+                                          sink);
+                sc_packet_source_set_lossless(
+                        &s->camera_demuxer.packet_source, sink);
+            }
+        }
+
+        if (options->audio) {
+            sink = sc_uplink_get_sink(uplink, UPLINK_STREAM_AUDIO);
+            sc_packet_source_add_sink(&s->audio_demuxer.packet_source, sink);
+        }
     }
 
 #ifdef HAVE_V4L2
     if (options->v4l2_device) {
-        if (!sc_v4l2_sink_init(&s->v4l2_sink, options->v4l2_device)) {
+        if (!sc_v4l2_sink_init(&s->v4l2_sink, options->v4l2_device,
+                               SC_V4L2_SINK_REGION_FULL, 0)) {
             goto end;
         }
 
@@ -859,7 +1914,10 @@ aoa_complete:
             src = &s->v4l2_buffer.frame_source;
         }
 
-        sc_frame_source_add_sink(src, &s->v4l2_sink.frame_sink);
+        // The V4L2 buffer already pushes from its own thread
+        add_frame_sink(src, &s->v4l2_sink.frame_sink,
+                       options->async_sinks && !options->v4l2_buffer,
+                       SC_FRAME_WORKER_DROP_OLDEST, "V4L2 sink");
 
         v4l2_sink_initialized = true;
     }
@@ -873,6 +1931,20 @@ aoa_complete:
             goto end;
         }
         video_demuxer_started = true;
+
+        if (options->split_eyes) {
+            if (!sc_demuxer_start(&s->video_right_demuxer)) {
+                goto end;
+            }
+            video_right_demuxer_started = true;
+        }
+
+        if (options->camera_record_filename) {
+            if (!sc_demuxer_start(&s->camera_demuxer)) {
+                goto end;
+            }
+            camera_demuxer_started = true;
+        }
     }
 
     if (options->audio) {
@@ -936,6 +2008,11 @@ end:
         sc_timeout_stop(&s->timeout);
     }
 
+    if (video_preprocess_init_started) {
+        sc_thread_join(&video_preprocess_init_thread, NULL);
+        s->video_preprocess = video_preprocess_init.vpp;
+    }
+
     // The demuxer is not stopped explicitly, because it will stop by itself on
     // end-of-stream
 #ifdef HAVE_USB
@@ -956,6 +2033,18 @@ end:
         sc_acksync_destroy(acksync);
     }
 #endif
+    if (clock_sync_started) {
+        sc_clock_sync_stop(&s->clock_sync);
+    }
+    if (bitrate_control_started) {
+        sc_bitrate_control_stop(&s->bitrate_control);
+    }
+    if (remap_reloader_started) {
+        sc_remap_reloader_stop(&s->remap_reloader);
+    }
+    if (video_reconfigurer_started) {
+        sc_video_reconfigurer_stop(&s->video_reconfigurer);
+    }
     if (controller_started) {
         sc_controller_stop(&s->controller);
     }
@@ -965,6 +2054,9 @@ end:
     if (recorder_initialized) {
         sc_recorder_stop(&s->recorder);
     }
+    if (camera_recorder_initialized) {
+        sc_recorder_stop(&s->camera_recorder);
+    }
     if (screen_initialized) {
         sc_screen_interrupt(&s->screen);
     }
@@ -986,6 +2078,21 @@ end:
     if (video_demuxer_started) {
         sc_demuxer_join(&s->video_demuxer);
     }
+    if (video_right_demuxer_started) {
+        sc_demuxer_join(&s->video_right_demuxer);
+    }
+    if (camera_demuxer_started) {
+        sc_demuxer_join(&s->camera_demuxer);
+    }
+    // Fed by both video demuxer threads
+    if (eye_merger_initialized) {
+        sc_eye_merger_destroy(&s->eye_merger);
+    }
+
+    // The dump is written by the video demuxer
+    if (stream_dump_opened) {
+        sc_stream_dump_close(&s->stream_dump);
+    }
 
     if (audio_demuxer_started) {
         sc_demuxer_join(&s->audio_demuxer);
@@ -995,8 +2102,19 @@ end:
     if (v4l2_sink_initialized) {
         sc_v4l2_sink_destroy(&s->v4l2_sink);
     }
+    if (v4l2_sink_left_initialized) {
+        sc_v4l2_sink_destroy(&s->v4l2_sink_left);
+    }
+    if (v4l2_sink_right_initialized) {
+        sc_v4l2_sink_destroy(&s->v4l2_sink_right);
+    }
 #endif
 
+    // The pipe writers (the video processor and the audio decoder) are joined
+    if (pipe_mutex_initialized) {
+        sc_mutex_destroy(&s->pipe_mutex);
+    }
+
 #ifdef HAVE_USB
     if (aoa_hid_initialized) {
         sc_aoa_join(&s->aoa);
@@ -1015,6 +2133,27 @@ end:
         sc_screen_destroy(&s->screen);
     }
 
+    // The frames are stamped by the demuxer, the decoder, the video processor
+    // and the screen
+    if (latency_trace_initialized) {
+        sc_latency_trace_destroy();
+    }
+
+    // The pattern is measured by the video processor
+    if (latency_probe_initialized) {
+        sc_latency_probe_destroy();
+    }
+
+    // The metrics are only read, the last snapshot includes all the frames
+    if (metrics_initialized) {
+        sc_metrics_destroy();
+    }
+
+    // The frame writer is unregistered once the video processor is closed
+    if (auto_tune_initialized) {
+        sc_auto_tune_destroy();
+    }
+
     if (controller_started) {
         sc_controller_join(&s->controller);
     }
@@ -1022,12 +2161,79 @@ end:
         sc_controller_destroy(&s->controller);
     }
 
+    // The pose buffer is fed by the receiver and taken by the video processor
+    if (pose_buffer_initialized) {
+        sc_pose_buffer_destroy(&s->pose_buffer);
+    }
+
+    // The demuxers and the receiver (managed by the controller) are joined,
+    // the queued records are sent (for a limited time)
+    if (uplink_initialized) {
+        sc_uplink_stop(&s->uplink);
+    }
+    if (uplink_started) {
+        sc_uplink_join(&s->uplink);
+    }
+    if (uplink_initialized) {
+        sc_uplink_destroy(&s->uplink);
+    }
+
+    // The clock sync may be used by the receiver (managed by the controller)
+    // and by the video processor until they are joined
+    if (clock_sync_started) {
+        sc_clock_sync_join(&s->clock_sync);
+    }
+    if (clock_sync_initialized) {
+        sc_clock_sync_destroy(&s->clock_sync);
+    }
+
+    // The bit rate control may be used by the demuxer and the screen, which
+    // are joined and destroyed above
+    if (bitrate_control_started) {
+        sc_bitrate_control_join(&s->bitrate_control);
+    }
+    if (bitrate_control_initialized) {
+        sc_bitrate_control_destroy(&s->bitrate_control);
+    }
+
+    // A pending reload completes before the maps are destroyed
+    if (remap_reloader_started) {
+        sc_remap_reloader_join(&s->remap_reloader);
+    }
+    if (remap_reloader_initialized) {
+        sc_remap_reloader_destroy(&s->remap_reloader);
+    }
+    if (video_reconfigurer_started) {
+        sc_video_reconfigurer_join(&s->video_reconfigurer);
+    }
+    if (video_reconfigurer_initialized) {
+        sc_video_reconfigurer_destroy(&s->video_reconfigurer);
+    }
+
     if (recorder_started) {
         sc_recorder_join(&s->recorder);
     }
     if (recorder_initialized) {
         sc_recorder_destroy(&s->recorder);
     }
+    if (camera_recorder_started) {
+        sc_recorder_join(&s->camera_recorder);
+    }
+    if (camera_recorder_initialized) {
+        sc_recorder_destroy(&s->camera_recorder);
+    }
+
+    // The recorder and the frame writer (closed with the video processor) do
+    // not push any file anymore, the remaining uploads complete
+    if (uploader_initialized) {
+        sc_uploader_stop(&s->uploader);
+    }
+    if (uploader_started) {
+        sc_uploader_join(&s->uploader);
+    }
+    if (uploader_initialized) {
+        sc_uploader_destroy(&s->uploader);
+    }
 
     if (file_pusher_initialized) {
         sc_file_pusher_join(&s->file_pusher);
@@ -1040,5 +2246,21 @@ end:
 
     sc_server_destroy(&s->server);
 
+    // Used by the video processor thread, joined above
+    if (gl_readback_initialized) {
+        sc_gl_readback_destroy(&s->gl_readback);
+    }
+
+    // Used by the video processor and the display, closed and destroyed above
+    if (s->video_preprocess) {
+        sc_video_preprocess_destroy(s->video_preprocess);
+    }
+
+    if (remap_map) {
+        // Pushed to the device (if connected) by the server thread
+        sc_device_remap_remove_map(remap_map);
+        free(remap_map);
+    }
+
     return ret;
 }
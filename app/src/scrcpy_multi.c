@@ -0,0 +1,677 @@
+#include "scrcpy_multi.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#ifdef _WIN32
+// not needed here, but winsock2.h must never be included AFTER windows.h
+# include <winsock2.h>
+# include <windows.h>
+#endif
+
+#include "adb/adb.h"
+#include "codec_probe.h"
+#include "decoder.h"
+#include "demuxer.h"
+#include "events.h"
+#include "frame_header.h"
+#include "frame_pipe.h"
+#include "frame_sync.h"
+#include "numa_monitor.h"
+#include "server.h"
+#include "video_preprocess.h"
+#include "video_processor.h"
+#include "util/log.h"
+#include "util/numa.h"
+#include "util/rand.h"
+#include "util/thread.h"
+
+#define SC_MULTI_NAME_SIZE 16
+
+struct sc_multi_session {
+    unsigned index; // position in the --multi-device list
+    const char *serial;
+    char name[SC_MULTI_NAME_SIZE];
+
+    struct sc_server server;
+    struct sc_demuxer demuxer;
+    struct sc_decoder decoder;
+    struct sc_video_processor video_processor;
+    // NUMA node of the pipeline of the device, or -1 if not bound (--numa)
+    int numa_node;
+    struct sc_numa_monitor numa_monitor;
+
+    bool server_initialized;
+    bool server_started;
+    bool demuxer_started;
+};
+
+struct scrcpy_multi {
+    char *serials; // owned copy of the --multi-device list, split in place
+    struct sc_multi_session sessions[SC_MAX_MULTI_DEVICES];
+    unsigned count;
+
+    // Serialize the writes of the video processors to stdout
+    sc_mutex pipe_mutex;
+
+    // The remap maps are loaded once, and shared by the video processors of
+    // all the devices (NULL if disabled)
+    struct sc_video_preprocess *video_preprocess;
+
+    // The video codecs proposed to all the servers (--video-codec=auto), the
+    // decoders of all the devices sharing the client
+    enum sc_codec video_codecs[SC_VIDEO_CODEC_COUNT];
+    unsigned video_codec_count;
+
+    // If --multi-device-sync is set, the frames are piped by the synchronizer
+    // instead of the video processors
+    struct sc_frame_sync frame_sync;
+    // The description common to the synchronized frames, the sequence being
+    // the number of the tuple (only accessed from the synchronizer thread)
+    struct sc_frame_pipe_info sync_pipe_info;
+};
+
+#ifdef _WIN32
+static BOOL WINAPI windows_ctrl_handler(DWORD ctrl_type) {
+    if (ctrl_type == CTRL_C_EVENT) {
+        sc_push_event(SDL_QUIT);
+        return TRUE;
+    }
+    return FALSE;
+}
+#endif // _WIN32
+
+static void
+sc_multi_demuxer_on_ended(struct sc_demuxer *demuxer,
+                          enum sc_demuxer_status status, void *userdata) {
+    (void) demuxer;
+
+    struct sc_multi_session *session = userdata;
+
+    // The device may not decide to disable the video
+    assert(status != SC_DEMUXER_STATUS_DISABLED);
+
+    // The events carry no device identity, log it here
+    if (status == SC_DEMUXER_STATUS_EOS) {
+        LOGW("Device %u (%s) disconnected", session->index, session->serial);
+        sc_push_event(SC_EVENT_DEVICE_DISCONNECTED);
+    } else {
+        LOGE("Device %u (%s): demuxer error", session->index,
+             session->serial);
+        sc_push_event(SC_EVENT_DEMUXER_ERROR);
+    }
+}
+
+static void
+sc_multi_server_on_connection_failed(struct sc_server *server,
+                                     void *userdata) {
+    (void) server;
+
+    struct sc_multi_session *session = userdata;
+    LOGE("Device %u (%s): server connection failed", session->index,
+         session->serial);
+    sc_push_event(SC_EVENT_SERVER_CONNECTION_FAILED);
+}
+
+static void
+sc_multi_server_on_connected(struct sc_server *server, void *userdata) {
+    (void) server;
+
+    struct sc_multi_session *session = userdata;
+    LOGD("Device %u (%s): server connected", session->index, session->serial);
+    sc_push_event(SC_EVENT_SERVER_CONNECTED);
+}
+
+static void
+sc_multi_server_on_disconnected(struct sc_server *server, void *userdata) {
+    (void) server;
+
+    struct sc_multi_session *session = userdata;
+    LOGD("Device %u (%s): server disconnected", session->index,
+         session->serial);
+    // Do nothing, the disconnection will be handled by the "stream stopped"
+    // event
+}
+
+static bool
+sc_multi_frame_sync_on_frames(struct sc_frame_sync *sync,
+                              AVFrame *const frames[],
+                              const int64_t timestamps_ms[], unsigned count,
+                              void *userdata) {
+    (void) sync;
+
+    struct scrcpy_multi *s = userdata;
+    struct sc_frame_pipe_info info = s->sync_pipe_info;
+    ++s->sync_pipe_info.sequence;
+
+    // Only the synchronizer thread writes to stdout, the frames of a tuple
+    // are consecutive
+    for (unsigned i = 0; i < count; ++i) {
+        const AVFrame *frame = frames[i];
+        if (frame->height > SC_FRAME_PIPE_MAX_ROWS) {
+            LOGE("Frame too large to be piped (%dx%d)", frame->width,
+                 frame->height);
+            return false;
+        }
+
+        info.timestamp_us = timestamps_ms[i] < 0 ? -1
+                                                 : timestamps_ms[i] * 1000;
+        if (!sc_frame_pipe_write(frame, &info, (int) i)) {
+            // Typically, the consumer closed the pipe
+            LOGE("Could not write frame to stdout");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Split the --multi-device list (already validated by the command line
+// parser) into the sessions serials
+static bool
+sc_multi_parse_serials(struct scrcpy_multi *s, const char *list) {
+    s->serials = strdup(list);
+    if (!s->serials) {
+        LOG_OOM();
+        return false;
+    }
+
+    s->count = 0;
+    char *serial = s->serials;
+    for (;;) {
+        assert(s->count < SC_MAX_MULTI_DEVICES);
+        char *sep = strchr(serial, ',');
+        if (sep) {
+            *sep = '\0';
+        }
+
+        struct sc_multi_session *session = &s->sessions[s->count];
+        session->index = s->count;
+        session->serial = serial;
+        snprintf(session->name, sizeof(session->name), "video-%u",
+                 session->index);
+        ++s->count;
+
+        if (!sep) {
+            break;
+        }
+        serial = sep + 1;
+    }
+
+    return true;
+}
+
+// Return true on success (all the servers are connected), false on error or if
+// the user requested to quit (*quit is then set)
+static bool
+await_for_servers(unsigned count, bool *quit) {
+    *quit = false;
+
+    unsigned connected = 0;
+    SDL_Event event;
+    while (connected < count && SDL_WaitEvent(&event)) {
+        switch (event.type) {
+            case SDL_QUIT:
+                *quit = true;
+                return false;
+            case SC_EVENT_SERVER_CONNECTION_FAILED:
+                return false;
+            case SC_EVENT_SERVER_CONNECTED:
+                ++connected;
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (connected < count) {
+        LOGE("SDL_WaitEvent() error: %s", SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
+// Run until all the streams are stopped
+static enum scrcpy_exit_code
+event_loop(unsigned count) {
+    enum scrcpy_exit_code ret = SCRCPY_EXIT_SUCCESS;
+
+    unsigned ended = 0;
+    SDL_Event event;
+    while (ended < count && SDL_WaitEvent(&event)) {
+        switch (event.type) {
+            case SC_EVENT_DEVICE_DISCONNECTED:
+                // Keep capturing the other devices
+                ++ended;
+                if (ret == SCRCPY_EXIT_SUCCESS) {
+                    ret = SCRCPY_EXIT_DISCONNECTED;
+                }
+                break;
+            case SC_EVENT_DEMUXER_ERROR:
+                ++ended;
+                ret = SCRCPY_EXIT_FAILURE;
+                break;
+            case SDL_QUIT:
+                LOGD("User requested to quit");
+                return ret;
+            default:
+                break;
+        }
+    }
+
+    if (ended < count) {
+        LOGE("SDL_WaitEvent() error: %s", SDL_GetError());
+        return SCRCPY_EXIT_FAILURE;
+    }
+
+    return ret;
+}
+
+static bool
+sc_multi_session_init_server(struct sc_multi_session *session,
+                             const struct scrcpy_multi *s,
+                             const struct scrcpy_options *options,
+                             struct sc_rand *rand) {
+    struct sc_server_params params = {
+        // Only use 31 bits to avoid issues with signed values on the Java-side
+        .scid = sc_rand_u32(rand) & 0x7FFFFFFF,
+        .req_serial = session->serial,
+        .select_usb = false,
+        .select_tcpip = false,
+        .log_level = options->log_level,
+        .video_codec = options->video_codec,
+        .audio_codec = options->audio_codec,
+        .video_source = options->video_source,
+        .audio_source = options->audio_source,
+        .camera_facing = options->camera_facing,
+        .crop = options->crop,
+        .port_range = options->port_range,
+        .tunnel_host = 0,
+        .tunnel_port = 0,
+        .direct_port = options->direct_tcp_port,
+        .video_udp = options->video_transport == SC_VIDEO_TRANSPORT_UDP,
+        .video_fec = options->video_fec,
+        .max_size = options->max_size,
+        .video_bit_rate = options->video_bit_rate,
+        .audio_bit_rate = options->audio_bit_rate,
+        .max_fps = options->max_fps,
+        .lock_video_orientation = options->lock_video_orientation,
+        .control = false,
+        .display_id = options->display_id,
+        .video = true,
+        .audio = false,
+        .audio_dup = false,
+        .show_touches = false,
+        .stay_awake = false,
+        .video_codec_options = options->video_codec_options,
+        .audio_codec_options = NULL,
+        .video_encoder = options->video_encoder,
+        .audio_encoder = NULL,
+        .camera_id = options->camera_id,
+        .camera_size = options->camera_size,
+        .camera_ar = options->camera_ar,
+        .camera_fps = options->camera_fps,
+        .force_adb_forward = options->force_adb_forward,
+        .power_off_on_close = false,
+        .clipboard_autosync = false,
+        .downsize_on_error = options->downsize_on_error,
+        .tcpip = false,
+        .tcpip_dst = NULL,
+        .cleanup = options->cleanup,
+        .power_on = options->power_on,
+        .kill_adb_on_close = false,
+        .camera_high_speed = options->camera_high_speed,
+        // The piped frames are timestamped
+        .capture_timestamp = true,
+        .capture_exposure = options->capture_exposure,
+        .latency_profile = options->latency_profile,
+        .encoder_async = options->encoder_async,
+        .repeat_frame_delay = options->repeat_frame_delay,
+        .daemon = options->server_daemon,
+        // Without control, the frame timestamps are computed from the device
+        // boot time
+        .probe_boot_time = true,
+        .list = 0,
+    };
+    memcpy(params.video_codecs, s->video_codecs, sizeof(s->video_codecs));
+    params.video_codec_count = s->video_codec_count;
+
+    static const struct sc_server_callbacks cbs = {
+        .on_connection_failed = sc_multi_server_on_connection_failed,
+        .on_connected = sc_multi_server_on_connected,
+        .on_disconnected = sc_multi_server_on_disconnected,
+    };
+    return sc_server_init(&session->server, &params, &cbs, session);
+}
+
+// If frame_sync is set, the processed frames are forwarded to it instead of
+// being piped
+static bool
+sc_multi_session_start_stream(struct sc_multi_session *session,
+                              const struct scrcpy_options *options,
+                              const struct sc_video_preprocess *remap,
+                              sc_mutex *pipe_mutex,
+                              struct sc_frame_sync *frame_sync) {
+    struct sc_server *server = &session->server;
+
+    static const struct sc_demuxer_callbacks demuxer_cbs = {
+        .on_ended = sc_multi_demuxer_on_ended,
+    };
+    struct sc_decoder_config decoder_config = {
+        .hw_decoder = options->hw_decoder,
+        .threads = options->decoder_threads,
+        .mode = options->decoder_mode,
+        .latency_profile = options->latency_profile,
+    };
+    sc_demuxer_init(&session->demuxer, session->name, server->video_socket,
+                    true, &decoder_config, &demuxer_cbs, session);
+    if (server->video_udp_socket != SC_SOCKET_NONE) {
+        // Without control, the stream only recovers from losses on the next
+        // periodic key frame
+        sc_demuxer_configure_rtp(&session->demuxer, server->video_udp_socket,
+                                 (uint32_t) server->direct_token);
+    }
+
+    if (options->capture_exposure) {
+        sc_demuxer_configure_capture_exposure(&session->demuxer);
+    }
+
+    if (session->numa_node >= 0) {
+        sc_demuxer_configure_numa_node(&session->demuxer, session->numa_node);
+    }
+
+    sc_decoder_init(&session->decoder, session->name, NULL, NULL);
+    sc_packet_source_add_sink(&session->demuxer.packet_source,
+                              &session->decoder.packet_sink);
+
+    if (session->numa_node >= 0) {
+        sc_numa_monitor_init(&session->numa_monitor, session->name,
+                             session->numa_node);
+        sc_frame_source_add_sink(&session->decoder.frame_source,
+                                 &session->numa_monitor.frame_sink);
+    }
+
+    struct sc_video_processor_params vp_params = {
+        .remap = remap,
+        .preview_scale = 1,
+        .show_timestamps = options->show_timestamps,
+        .save_frames = false,
+        .frame_dir = NULL,
+        .frame_archive = NULL,
+        .frame_writer_format = options->save_frames_format,
+        .frame_writer_quality = options->save_frames_quality,
+        .frame_writer_io = options->save_frames_io,
+        .frame_writer_direct = options->save_frames_direct,
+        .frame_writer_pre_trigger = options->save_frames_pre_trigger,
+        .frame_writer_post_trigger = options->save_frames_post_trigger,
+        .luma_only = options->output_planes == SC_OUTPUT_PLANES_Y,
+        // The synchronizer only pipes the frames
+        .luma_sinks = true,
+        .save_rate = options->save_frames_rate,
+        .output_rate = options->pipe_output_rate,
+        .motion_threshold = options->motion_threshold,
+        .frame_writer_threads = options->save_frames_threads,
+        .pipe_output = !frame_sync,
+        .pipe_format = options->pipe_format,
+        .pipe_payload_crc = options->pipe_payload_crc,
+        .pipe_device = (int) session->index,
+        .pipe_mutex = pipe_mutex,
+        // Rejected with the frame synchronizer (see cli.c)
+        .pipe_depth = options->pipe_depth,
+        .pipe_features = options->pipe_features,
+        .pyramid_levels = options->output_pyramid,
+        .shm_output = NULL,
+        .export_timestamp = !!frame_sync,
+        .cpu_affinity = options->preprocess_cpus,
+        .latency_budget = 0, // no display
+        // Rejected with the frame synchronizer (see cli.c)
+        .skip_repeated = options->skip_repeated_frames,
+        // Without control, the timestamps are computed from the boot time of
+        // each device
+        .clock_sync = NULL,
+        .serial = server->serial,
+        .device_boot_time = sc_server_get_device_boot_time(server),
+    };
+    if (!sc_video_processor_init(&session->video_processor, &vp_params)) {
+        return false;
+    }
+    sc_frame_source_add_sink(&session->decoder.frame_source,
+                             &session->video_processor.frame_sink);
+    if (frame_sync) {
+        struct sc_frame_sync_input *input = &frame_sync->inputs[session->index];
+        sc_frame_source_add_sink(&session->video_processor.frame_source,
+                                 &input->frame_sink);
+    }
+
+    if (!sc_demuxer_start(&session->demuxer)) {
+        return false;
+    }
+    session->demuxer_started = true;
+
+    if (session->numa_node >= 0) {
+        LOGI("Device %u: %s (NUMA node %d)", session->index, server->serial,
+             session->numa_node);
+    } else {
+        LOGI("Device %u: %s", session->index, server->serial);
+    }
+    return true;
+}
+
+enum scrcpy_exit_code
+scrcpy_multi(struct scrcpy_options *options) {
+    static struct scrcpy_multi scrcpy_multi;
+#ifndef NDEBUG
+    // Detect missing initializations
+    memset(&scrcpy_multi, 42, sizeof(scrcpy_multi));
+#endif
+    struct scrcpy_multi *s = &scrcpy_multi;
+
+    assert(options->multi_device);
+    assert(options->pipe_output);
+
+    // Minimal SDL initialization
+    if (SDL_Init(SDL_INIT_EVENTS)) {
+        LOGE("Could not initialize SDL: %s", SDL_GetError());
+        return SCRCPY_EXIT_FAILURE;
+    }
+
+    atexit(SDL_Quit);
+
+#ifdef _WIN32
+    // Clean up properly on Ctrl+C on Windows
+    bool ok = SetConsoleCtrlHandler(windows_ctrl_handler, TRUE);
+    if (!ok) {
+        LOGW("Could not set Ctrl+C handler");
+    }
+#endif // _WIN32
+
+    if (options->adb_path) {
+        sc_adb_set_executable(options->adb_path);
+    }
+
+    if (!sc_multi_parse_serials(s, options->multi_device)) {
+        return SCRCPY_EXIT_FAILURE;
+    }
+
+    enum scrcpy_exit_code ret = SCRCPY_EXIT_FAILURE;
+
+    bool frame_sync_initialized = false;
+    bool frame_sync_started = false;
+
+    unsigned numa_nodes = 0;
+    if (options->numa) {
+        numa_nodes = sc_numa_get_node_count();
+        if (numa_nodes < 2) {
+            LOGW("--numa ignored: single NUMA node");
+            numa_nodes = 0;
+        } else if (options->multi_device_sync) {
+            // The synchronizer thread is not bound, it reads the frames of
+            // all the nodes
+            LOGI("--numa: the frames are synchronized across %u NUMA nodes",
+                 numa_nodes);
+        }
+    }
+
+    for (unsigned i = 0; i < s->count; ++i) {
+        struct sc_multi_session *session = &s->sessions[i];
+        // Round-robin, so that the devices are spread over the nodes
+        session->numa_node = numa_nodes ? (int) (i % numa_nodes) : -1;
+        session->server_initialized = false;
+        session->server_started = false;
+        session->demuxer_started = false;
+    }
+
+    if (!sc_mutex_init(&s->pipe_mutex)) {
+        free(s->serials);
+        return SCRCPY_EXIT_FAILURE;
+    }
+
+    sc_video_preprocess_set_threads(options->preprocess_threads);
+
+    s->video_preprocess = NULL;
+    if (options->opencv_enabled && options->opencv_map_path) {
+        s->video_preprocess =
+            sc_video_preprocess_new(options->opencv_map_path,
+                                    options->opencv_backend, 1);
+        if (!s->video_preprocess) {
+            // error already logged
+            goto end;
+        }
+
+        struct sc_remap_layout layout =
+            sc_video_preprocess_get_layout(s->video_preprocess);
+        if ((options->pipe_depth || options->pipe_features)
+                && !sc_remap_layout_is_side_by_side(&layout)) {
+            // The disparities and the features match the two eyes
+            LOGE("--pipe-depth and --pipe-output=features require the remap "
+                 "maps of a stereo pair side by side");
+            goto end;
+        }
+    }
+
+    s->video_codec_count = 0;
+    if (options->video_codec_auto) {
+        s->video_codec_count =
+            sc_codec_probe_select_for_options(options, s->count,
+                                              s->video_codecs);
+    }
+
+    struct sc_rand rand;
+    sc_rand_init(&rand);
+
+    // Start all the servers at once, the device connections are slow
+    for (unsigned i = 0; i < s->count; ++i) {
+        struct sc_multi_session *session = &s->sessions[i];
+        if (!sc_multi_session_init_server(session, s, options, &rand)) {
+            goto end;
+        }
+        session->server_initialized = true;
+
+        if (!sc_server_start(&session->server)) {
+            goto end;
+        }
+        session->server_started = true;
+    }
+
+    bool quit;
+    if (!await_for_servers(s->count, &quit)) {
+        if (quit) {
+            // This is not an error, user requested to quit
+            LOGD("User requested to quit");
+            ret = SCRCPY_EXIT_SUCCESS;
+        } else {
+            LOGE("Server connection failed");
+        }
+        goto end;
+    }
+
+    LOGD("Servers connected");
+
+    struct sc_frame_sync *frame_sync = NULL;
+    if (options->multi_device_sync) {
+        static const struct sc_frame_sync_callbacks frame_sync_cbs = {
+            .on_frames = sc_multi_frame_sync_on_frames,
+        };
+        s->sync_pipe_info = (struct sc_frame_pipe_info) {
+            .format = options->pipe_format,
+            .flags = (s->video_preprocess ? FRAME_FLAG_RECTIFIED : 0)
+                   | (options->pipe_payload_crc ? FRAME_FLAG_PAYLOAD_CRC : 0),
+            .content_y = options->show_timestamps
+                       ? SC_VIDEO_PREPROCESS_TEXT_HEIGHT : 0,
+        };
+        if (!sc_frame_sync_init(&s->frame_sync, s->count,
+                                SC_TICK_TO_MS(options->multi_device_sync),
+                                &frame_sync_cbs, s)) {
+            goto end;
+        }
+        frame_sync_initialized = true;
+
+        // The video processors do not pipe the frames themselves
+        sc_frame_pipe_init();
+
+        if (!sc_frame_sync_start(&s->frame_sync)) {
+            goto end;
+        }
+        frame_sync_started = true;
+        frame_sync = &s->frame_sync;
+    }
+
+    for (unsigned i = 0; i < s->count; ++i) {
+        if (!sc_multi_session_start_stream(&s->sessions[i], options,
+                                           s->video_preprocess,
+                                           &s->pipe_mutex, frame_sync)) {
+            goto end;
+        }
+    }
+
+    ret = event_loop(s->count);
+    LOGD("quit...");
+
+end:
+    for (unsigned i = 0; i < s->count; ++i) {
+        struct sc_multi_session *session = &s->sessions[i];
+        if (session->server_started) {
+            // shutdown the sockets and kill the server
+            sc_server_stop(&session->server);
+        }
+    }
+
+    // now that the sockets are shutdown, the demuxers are interrupted, we can
+    // join them
+    for (unsigned i = 0; i < s->count; ++i) {
+        struct sc_multi_session *session = &s->sessions[i];
+        if (session->demuxer_started) {
+            sc_demuxer_join(&session->demuxer);
+        }
+        if (session->server_started) {
+            sc_server_join(&session->server);
+        }
+        if (session->server_initialized) {
+            sc_server_destroy(&session->server);
+        }
+    }
+
+    // The synchronizer receives the frames of the video processors, which are
+    // closed once their demuxer is joined
+    if (frame_sync_started) {
+        sc_frame_sync_stop(&s->frame_sync);
+        sc_frame_sync_join(&s->frame_sync);
+    }
+    if (frame_sync_initialized) {
+        sc_frame_sync_destroy(&s->frame_sync);
+    }
+
+    // Used by the video processors, closed once their demuxer is joined
+    if (s->video_preprocess) {
+        sc_video_preprocess_destroy(s->video_preprocess);
+    }
+
+    sc_mutex_destroy(&s->pipe_mutex);
+    free(s->serials);
+
+    return ret;
+}
@@ -0,0 +1,18 @@
+#ifndef SCRCPY_MULTI_H
+#define SCRCPY_MULTI_H
+
+#include "common.h"
+
+#include "options.h"
+#include "scrcpy.h"
+
+/**
+ * Capture the video of several devices in parallel (--multi-device)
+ *
+ * Each device has its own server, demuxer, decoder and video processor, and
+ * all the processors multiplex their frames on stdout (see frame_header.h).
+ */
+enum scrcpy_exit_code
+scrcpy_multi(struct scrcpy_options *options);
+
+#endif
@@ -0,0 +1,297 @@
+#include "scrcpy_replay.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#ifdef _WIN32
+// not needed here, but winsock2.h must never be included AFTER windows.h
+# include <winsock2.h>
+# include <windows.h>
+#endif
+
+#include "auto_tune.h"
+#include "decoder.h"
+#include "demuxer.h"
+#include "events.h"
+#include "latency_trace.h"
+#include "metrics.h"
+#include "stream_dump.h"
+#include "video_preprocess.h"
+#include "video_processor.h"
+#include "util/log.h"
+
+struct scrcpy_replay {
+    struct sc_stream_replay replay;
+    struct sc_demuxer demuxer;
+    struct sc_decoder decoder;
+    struct sc_video_processor video_processor;
+    struct sc_video_preprocess *video_preprocess; // remap maps, may be NULL
+};
+
+#ifdef _WIN32
+static BOOL WINAPI windows_ctrl_handler(DWORD ctrl_type) {
+    if (ctrl_type == CTRL_C_EVENT) {
+        sc_push_event(SDL_QUIT);
+        return TRUE;
+    }
+    return FALSE;
+}
+#endif // _WIN32
+
+static void
+sc_replay_demuxer_on_ended(struct sc_demuxer *demuxer,
+                           enum sc_demuxer_status status, void *userdata) {
+    (void) demuxer;
+    (void) userdata;
+
+    if (status == SC_DEMUXER_STATUS_EOS) {
+        // The end of the dump (or an interruption)
+        sc_push_event(SC_EVENT_DEVICE_DISCONNECTED);
+    } else {
+        sc_push_event(SC_EVENT_DEMUXER_ERROR);
+    }
+}
+
+// Run until the end of the replay
+static enum scrcpy_exit_code
+event_loop(void) {
+    SDL_Event event;
+    while (SDL_WaitEvent(&event)) {
+        switch (event.type) {
+            case SC_EVENT_DEVICE_DISCONNECTED:
+                LOGI("End of replay");
+                return SCRCPY_EXIT_SUCCESS;
+            case SC_EVENT_DEMUXER_ERROR:
+                LOGE("Replay error");
+                return SCRCPY_EXIT_FAILURE;
+            case SDL_QUIT:
+                LOGD("User requested to quit");
+                return SCRCPY_EXIT_SUCCESS;
+            default:
+                break;
+        }
+    }
+
+    LOGE("SDL_WaitEvent() error: %s", SDL_GetError());
+    return SCRCPY_EXIT_FAILURE;
+}
+
+enum scrcpy_exit_code
+scrcpy_replay(struct scrcpy_options *options) {
+    static struct scrcpy_replay scrcpy_replay;
+#ifndef NDEBUG
+    // Detect missing initializations
+    memset(&scrcpy_replay, 42, sizeof(scrcpy_replay));
+#endif
+    struct scrcpy_replay *s = &scrcpy_replay;
+
+    assert(options->replay_filename);
+
+    // Minimal SDL initialization
+    if (SDL_Init(SDL_INIT_EVENTS)) {
+        LOGE("Could not initialize SDL: %s", SDL_GetError());
+        return SCRCPY_EXIT_FAILURE;
+    }
+
+    atexit(SDL_Quit);
+
+#ifdef _WIN32
+    // Clean up properly on Ctrl+C on Windows
+    bool ok = SetConsoleCtrlHandler(windows_ctrl_handler, TRUE);
+    if (!ok) {
+        LOGW("Could not set Ctrl+C handler");
+    }
+#endif // _WIN32
+
+    if (!sc_stream_replay_open(&s->replay, options->replay_filename,
+                               !options->replay_max_speed)) {
+        return SCRCPY_EXIT_FAILURE;
+    }
+
+    enum scrcpy_exit_code ret = SCRCPY_EXIT_FAILURE;
+
+    bool latency_trace_initialized = false;
+    bool metrics_initialized = false;
+    bool auto_tune_initialized = false;
+    bool demuxer_started = false;
+
+    sc_video_preprocess_set_threads(options->preprocess_threads);
+
+    s->video_preprocess = NULL;
+    bool remap = options->opencv_enabled && options->opencv_map_path;
+    if (remap) {
+        s->video_preprocess =
+            sc_video_preprocess_new(options->opencv_map_path,
+                                    options->opencv_backend, 1);
+        if (!s->video_preprocess) {
+            // error already logged
+            goto end;
+        }
+
+        struct sc_remap_layout layout =
+            sc_video_preprocess_get_layout(s->video_preprocess);
+        if ((options->pipe_depth || options->pipe_features)
+                && !sc_remap_layout_is_side_by_side(&layout)) {
+            // The disparities and the features match the two eyes
+            LOGE("--pipe-depth and --pipe-output=features require the remap "
+                 "maps of a stereo pair side by side");
+            goto end;
+        }
+
+        if (options->cuda_ipc_output
+                && !sc_video_preprocess_set_cuda_ipc_output(
+                        s->video_preprocess, options->cuda_ipc_output)) {
+            goto end;
+        }
+    }
+
+    if (options->print_latency || options->latency_trace_filename) {
+        if (!sc_latency_trace_init(options->print_latency,
+                                   options->latency_trace_filename)) {
+            goto end;
+        }
+        latency_trace_initialized = true;
+    }
+
+    if (options->metrics_filename) {
+        if (!sc_metrics_init(options->metrics_filename)) {
+            goto end;
+        }
+        metrics_initialized = true;
+    }
+
+    if (options->auto_tune) {
+        // Keep up with the rate of the replay
+        struct sc_auto_tune_params params = {
+            .target_fps = 0,
+            .preprocess_threads = options->preprocess_threads,
+            .decoder_threads = options->decoder_threads,
+            .writer_threads = options->save_frames_threads,
+        };
+        if (!sc_auto_tune_init(&params)) {
+            goto end;
+        }
+        auto_tune_initialized = true;
+    }
+
+    static const struct sc_demuxer_callbacks demuxer_cbs = {
+        .on_ended = sc_replay_demuxer_on_ended,
+    };
+    struct sc_decoder_config decoder_config = {
+        .hw_decoder = options->hw_decoder,
+        .threads = options->decoder_threads,
+        .mode = options->decoder_mode,
+        .latency_profile = options->latency_profile,
+    };
+    // The capture timestamp option is read from the dump
+    sc_demuxer_init(&s->demuxer, "video", SC_SOCKET_NONE, false,
+                    &decoder_config, &demuxer_cbs, NULL);
+    sc_demuxer_configure_replay(&s->demuxer, &s->replay);
+
+    sc_decoder_init(&s->decoder, "video", NULL, NULL);
+    sc_packet_source_add_sink(&s->demuxer.packet_source,
+                              &s->decoder.packet_sink);
+
+    // Without device, the frames are only processed if an output needs them
+    if (remap || options->show_timestamps || options->save_frames
+            || options->pipe_output || options->shm_output
+            || options->publish_port) {
+        struct sc_video_processor_params vp_params = {
+            .remap = s->video_preprocess,
+            .preview_scale = 1,
+            .show_timestamps = options->show_timestamps,
+            .save_frames = options->save_frames,
+            .frame_dir = options->frame_dir,
+            .frame_archive = options->frame_archive,
+            .frame_writer_format = options->save_frames_format,
+            .frame_writer_quality = options->save_frames_quality,
+            .frame_writer_io = options->save_frames_io,
+            .frame_writer_direct = options->save_frames_direct,
+            .frame_writer_zstd_level = options->save_frames_zstd,
+            .frame_writer_zstd_dict = options->save_frames_zstd_dict,
+            .frame_writer_tile_delta = options->save_frames_tile_delta,
+            .frame_writer_tile_threshold = options->save_frames_tile_threshold,
+            .frame_writer_key_interval = options->save_frames_key_interval,
+            .frame_writer_pre_trigger = options->save_frames_pre_trigger,
+            .frame_writer_post_trigger = options->save_frames_post_trigger,
+            .luma_only = options->output_planes == SC_OUTPUT_PLANES_Y,
+            .save_rate = options->save_frames_rate,
+            .output_rate = options->pipe_output_rate,
+            .motion_threshold = options->motion_threshold,
+            .frame_writer_threads = options->save_frames_threads,
+            .auto_tune = options->auto_tune,
+            .pipe_output = options->pipe_output,
+            .pipe_format = options->pipe_format,
+            .pipe_payload_crc = options->pipe_payload_crc,
+            .pipe_device = -1,
+            .pipe_mutex = NULL,
+            .pipe_depth = options->pipe_depth,
+            .pipe_features = options->pipe_features,
+            .pyramid_levels = options->output_pyramid,
+            .pipe_feedback_port = options->pipe_feedback_port,
+            .pipe_feedback_host = options->pipe_feedback_host,
+            .pipe_backpressure = options->pipe_backpressure,
+            .shm_output = options->shm_output,
+            .cuda_ipc_output = options->cuda_ipc_output != NULL,
+            .publish_port = options->publish_port,
+            .publish_host = options->publish_host,
+            .publish_queue = options->publish_queue,
+            .publish_drop = options->publish_drop,
+            .export_timestamp = false,
+            .cpu_affinity = options->preprocess_cpus,
+            .skip_repeated = options->skip_repeated_frames,
+            // Without device, the timestamps are in the device monotonic
+            // clock
+            .clock_sync = NULL,
+            .serial = NULL,
+        };
+        if (!sc_video_processor_init(&s->video_processor, &vp_params)) {
+            goto end;
+        }
+        sc_frame_source_add_sink(&s->decoder.frame_source,
+                                 &s->video_processor.frame_sink);
+    }
+
+    if (!sc_demuxer_start(&s->demuxer)) {
+        goto end;
+    }
+    demuxer_started = true;
+
+    LOGI("Replaying %s%s", options->replay_filename,
+         options->replay_max_speed ? " at maximum speed" : "");
+
+    ret = event_loop();
+    LOGD("quit...");
+
+end:
+    if (demuxer_started) {
+        // Interrupt the replay if the user requested to quit
+        sc_stream_replay_interrupt(&s->replay);
+        sc_demuxer_join(&s->demuxer);
+    }
+
+    // The frames are stamped by the demuxer, the decoder and the video
+    // processor, closed once the demuxer is joined
+    if (latency_trace_initialized) {
+        sc_latency_trace_destroy();
+    }
+
+    if (metrics_initialized) {
+        sc_metrics_destroy();
+    }
+
+    if (auto_tune_initialized) {
+        sc_auto_tune_destroy();
+    }
+
+    // Used by the video processor, closed once the demuxer is joined
+    if (s->video_preprocess) {
+        sc_video_preprocess_destroy(s->video_preprocess);
+    }
+
+    sc_stream_replay_close(&s->replay);
+
+    return ret;
+}
@@ -0,0 +1,19 @@
+#ifndef SCRCPY_REPLAY_H
+#define SCRCPY_REPLAY_H
+
+#include "common.h"
+
+#include "options.h"
+#include "scrcpy.h"
+
+/**
+ * Replay a video stream dumped by --dump-stream, without device (--replay)
+ *
+ * The dump is read by a demuxer instead of the video socket, and the packets
+ * go through the same decoder and video processor as during the capture, so
+ * that the client pipeline may be profiled deterministically.
+ */
+enum scrcpy_exit_code
+scrcpy_replay(struct scrcpy_options *options);
+
+#endif
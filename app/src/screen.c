@@ -1,43 +1,33 @@
 #include "screen.h"
-#ifdef _WIN32
-# include <fcntl.h>
-# include <io.h>
-#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
+#include <libavutil/dict.h>
 #include <SDL2/SDL.h>
-#include <sys/stat.h>
-#include <errno.h>
-
-#include "video_preprocess.h"
-#include "device_time.h"
 
+#include "decoder.h"
 #include "events.h"
+#include "latency_trace.h"
+#include "metrics.h"
 #include "icon.h"
 #include "options.h"
+#include "util/alloc_stats.h"
 #include "util/log.h"
+#include "video_processor.h"
 
 #ifdef __cplusplus 
 }
 #endif
-#include <libavutil/imgutils.h>
-#include <libswscale/swscale.h>
 
 #define DISPLAY_MARGINS 96
 
 #define DOWNCAST(SINK) container_of(SINK, struct sc_screen, frame_sink)
 
-// Forward declaration of save_frame_as_image function
-static void
-save_frame_as_image(const AVFrame *frame, const char *directory, uint64_t frame_number, int64_t boot_time_ms);
-
-static void pipe_frame(const AVFrame *frame, int64_t boot_time_ms);
-
 static inline struct sc_size
 get_oriented_size(struct sc_size size, enum sc_orientation orientation) {
     struct sc_size oriented_size;
@@ -51,6 +41,34 @@ get_oriented_size(struct sc_size size, enum sc_orientation orientation) {
     return oriented_size;
 }
 
+// size of the frame in the stereo view (before orientation)
+static inline struct sc_size
+get_stereo_view_size(struct sc_size size, enum sc_stereo_view view) {
+    struct sc_size view_size = size;
+    switch (view) {
+        case SC_STEREO_VIEW_LEFT:
+        case SC_STEREO_VIEW_RIGHT:
+        case SC_STEREO_VIEW_ANAGLYPH:
+            view_size.width = size.width / 2;
+            break;
+        case SC_STEREO_VIEW_TOP_BOTTOM:
+            view_size.width = size.width / 2;
+            view_size.height = size.height * 2;
+            break;
+        default:
+            assert(view == SC_STEREO_VIEW_SIDE_BY_SIDE);
+            break;
+    }
+    return view_size;
+}
+
+static inline struct sc_size
+get_content_size(struct sc_size frame_size, enum sc_stereo_view view,
+                 enum sc_orientation orientation) {
+    return get_oriented_size(get_stereo_view_size(frame_size, view),
+                             orientation);
+}
+
 // get the window size in a struct sc_size
 static struct sc_size
 get_window_size(const struct sc_screen *screen) {
@@ -279,15 +297,24 @@ sc_screen_render(struct sc_screen *screen, bool update_content_rect) {
         sc_screen_update_content_rect(screen);
     }
 
+    if (screen->threaded_rendering) {
+        sc_render_thread_request_render(&screen->render_thread, &screen->rect,
+                                        screen->orientation,
+                                        screen->stereo_view);
+        return;
+    }
+
     enum sc_display_result res =
-        sc_display_render(&screen->display, &screen->rect, screen->orientation);
+        sc_display_render(&screen->display, &screen->rect, screen->orientation,
+                          screen->stereo_view);
     (void) res; // any error already logged
 }
 
 static void
 sc_screen_render_novideo(struct sc_screen *screen) {
     enum sc_display_result res =
-        sc_display_render(&screen->display, NULL, SC_ORIENTATION_0);
+        sc_display_render(&screen->display, NULL, SC_ORIENTATION_0,
+                          SC_STEREO_VIEW_SIDE_BY_SIDE);
     (void) res; // any error already logged
 }
 
@@ -347,6 +374,12 @@ sc_screen_frame_sink_open(struct sc_frame_sink *sink,
     screen->open = true;
 #endif
 
+    // The video processor (if any) is open before its sinks and closed after
+    // them, so it can be paused meanwhile
+    sc_mutex_lock(&screen->processor_mutex);
+    screen->processor_open = true;
+    sc_mutex_unlock(&screen->processor_mutex);
+
     // nothing to do, the screen is already open on the main thread
     return true;
 }
@@ -354,12 +387,18 @@ sc_screen_frame_sink_open(struct sc_frame_sink *sink,
 static void
 sc_screen_frame_sink_close(struct sc_frame_sink *sink) {
     struct sc_screen *screen = DOWNCAST(sink);
-    (void) screen;
 #ifndef NDEBUG
     screen->open = false;
 #endif
 
-    // nothing to do, the screen lifecycle is not managed by the frame producer
+    sc_mutex_lock(&screen->processor_mutex);
+    screen->processor_open = false;
+    sc_mutex_unlock(&screen->processor_mutex);
+
+    sc_frame_drops_log(&screen->drops);
+
+    // nothing else to do, the screen lifecycle is not managed by the frame
+    // producer
 }
 
 static bool
@@ -367,16 +406,33 @@ sc_screen_frame_sink_push(struct sc_frame_sink *sink, const AVFrame *frame) {
     struct sc_screen *screen = DOWNCAST(sink);
     assert(screen->video);
 
+    AVDictionaryEntry *latency =
+        av_dict_get(frame->metadata, SC_DECODER_METADATA_LATENCY_US, NULL, 0);
+    if (latency) {
+        long long us = strtoll(latency->value, NULL, 10);
+        sc_fps_counter_add_decode_latency(&screen->fps_counter,
+                                          SC_TICK_FROM_US(us));
+    }
+
     bool previous_skipped;
     bool ok = sc_frame_buffer_push(&screen->fb, frame, &previous_skipped);
     if (!ok) {
         return false;
     }
 
+    if (screen->bitrate_control) {
+        sc_bitrate_control_add_frame(screen->bitrate_control,
+                                     previous_skipped);
+    }
+
     if (previous_skipped) {
         sc_fps_counter_add_skipped_frame(&screen->fps_counter);
+        sc_frame_drops_add(&screen->drops, SC_FRAME_DROP_OVERWRITTEN);
+        sc_metrics_add(SC_METRIC_DISPLAY_SKIPPED_FRAMES, 1);
         // The SC_EVENT_NEW_FRAME triggered for the previous frame will consume
         // this new frame instead
+    } else if (screen->threaded_rendering) {
+        sc_render_thread_notify_frame(&screen->render_thread);
     } else {
         // Post the event on the UI thread
         bool ok = sc_push_event(SC_EVENT_NEW_FRAME);
@@ -391,6 +447,9 @@ sc_screen_frame_sink_push(struct sc_frame_sink *sink, const AVFrame *frame) {
 bool
 sc_screen_init(struct sc_screen *screen,
                const struct sc_screen_params *params) {
+    // The main thread renders the screen
+    (void) sc_alloc_stats_enter(SC_ALLOC_SCREEN);
+
     screen->resize_pending = false;
     screen->has_frame = false;
     screen->fullscreen = false;
@@ -399,9 +458,13 @@ sc_screen_init(struct sc_screen *screen,
     screen->mouse_capture_key_pressed = 0;
     screen->paused = false;
     screen->resume_frame = NULL;
+    screen->video_processor = NULL;
+    screen->processor_open = false;
     screen->orientation = SC_ORIENTATION_0;
+    screen->stereo_view = SC_STEREO_VIEW_SIDE_BY_SIDE;
 
     screen->video = params->video;
+    screen->bitrate_control = params->bitrate_control;
 
     screen->req.x = params->window_x;
     screen->req.y = params->window_y;
@@ -410,31 +473,33 @@ sc_screen_init(struct sc_screen *screen,
     screen->req.fullscreen = params->fullscreen;
     screen->req.start_fps_counter = params->start_fps_counter;
 
-    if (params->save_frames || params->pipe_output || params->show_timestamps) {
-        const char *adb_path = params->adb_path ? params->adb_path : "adb";
-        screen->device_boot_time = get_device_boot_time(params->serial, adb_path);
-        // LOGI("Device boot time: %lld", screen->device_boot_time);
-    } else {
-        screen->device_boot_time = 0;
-    }
-    
-    screen->pipe_output = params->pipe_output;
+    sc_frame_drops_init(&screen->drops, "Display");
 
     bool ok = sc_frame_buffer_init(&screen->fb);
     if (!ok) {
         return false;
     }
 
-    if (!sc_fps_counter_init(&screen->fps_counter)) {
+    ok = sc_mutex_init(&screen->processor_mutex);
+    if (!ok) {
         goto error_destroy_frame_buffer;
     }
 
+    if (!sc_fps_counter_init(&screen->fps_counter)) {
+        goto error_destroy_processor_mutex;
+    }
+
     if (screen->video) {
         screen->orientation = params->orientation;
         if (screen->orientation != SC_ORIENTATION_0) {
             LOGI("Initial display orientation set to %s",
                  sc_orientation_get_name(screen->orientation));
         }
+        screen->stereo_view = params->stereo_view;
+        if (screen->stereo_view != SC_STEREO_VIEW_SIDE_BY_SIDE) {
+            LOGI("Initial stereo view set to %s",
+                 sc_stereo_view_get_name(screen->stereo_view));
+        }
     }
 
     uint32_t window_flags = SDL_WINDOW_ALLOW_HIGHDPI;
@@ -491,8 +556,31 @@ sc_screen_init(struct sc_screen *screen,
 
     SDL_Surface *icon_novideo = params->video ? NULL : icon;
     bool mipmaps = params->video && params->mipmaps;
-    ok = sc_display_init(&screen->display, screen->window, icon_novideo,
-                         mipmaps);
+    const struct sc_video_preprocess *gpu_remap =
+        params->video ? params->gpu_remap : NULL;
+    bool pbo_upload = params->video && params->pbo_upload;
+    bool hud = params->video && params->hud;
+    bool low_latency_present = params->video && params->low_latency_present;
+    screen->threaded_rendering = params->video && params->render_thread;
+    if (screen->threaded_rendering) {
+        struct sc_render_thread_params rt_params = {
+            .display = &screen->display,
+            .fb = &screen->fb,
+            .fps_counter = &screen->fps_counter,
+            .window = screen->window,
+            .mipmaps = mipmaps,
+            .gpu_remap = gpu_remap,
+            .gpu_remap_offset = params->gpu_remap_offset,
+            .pbo_upload = pbo_upload,
+            .hud = hud,
+            .low_latency_present = low_latency_present,
+        };
+        ok = sc_render_thread_start(&screen->render_thread, &rt_params);
+    } else {
+        ok = sc_display_init(&screen->display, screen->window, icon_novideo,
+                             mipmaps, gpu_remap, params->gpu_remap_offset,
+                             pbo_upload, false, hud, low_latency_present);
+    }
     if (icon) {
         scrcpy_icon_destroy(icon);
     }
@@ -506,13 +594,6 @@ sc_screen_init(struct sc_screen *screen,
         goto error_destroy_display;
     }
 
-    screen->processed_frame = av_frame_alloc();
-    if (!screen->processed_frame) {
-        LOG_OOM();
-        av_frame_free(&screen->frame);
-        goto error_destroy_display;
-    }
-
     struct sc_input_manager_params im_params = {
         .controller = params->controller,
         .fp = params->fp,
@@ -520,10 +601,14 @@ sc_screen_init(struct sc_screen *screen,
         .kp = params->kp,
         .mp = params->mp,
         .gp = params->gp,
+        .remap_reloader = params->remap_reloader,
+        .video_reconfigurer = params->video_reconfigurer,
+        .capture_trigger = params->capture_trigger,
         .mouse_bindings = params->mouse_bindings,
         .legacy_paste = params->legacy_paste,
         .clipboard_autosync = params->clipboard_autosync,
         .shortcut_mods = params->shortcut_mods,
+        .mouse_motion_interval = params->mouse_motion_interval,
     };
 
     sc_input_manager_init(&screen->im, &im_params);
@@ -551,36 +636,21 @@ sc_screen_init(struct sc_screen *screen,
         sc_screen_set_mouse_capture(screen, true);
     }
 
-    screen->frame_count = 0;
-    screen->save_frames = params->save_frames;
-    screen->frame_dir = params->frame_dir;
-    screen->opencv_enabled = params->opencv_enabled;
-    screen->opencv_map_path = params->opencv_map_path;
-    // LOGI("Saving frames: %d, Frame directory: %s", screen->save_frames, screen->frame_dir);
-    // Create directory if it doesn't exist and saving is enabled
-    if (screen->save_frames && screen->frame_dir) {
-#ifdef _WIN32
-        if (mkdir(screen->frame_dir) < 0 && errno != EEXIST) {
-#else
-        if (mkdir(screen->frame_dir, 0777) < 0 && errno != EEXIST) {
-#endif
-            LOGE("Could not create frame directory: %s", screen->frame_dir);
-            return false;
-        }
-    }
-    screen->show_timestamps = params->show_timestamps;
-    #ifdef _WIN32
-        // Set stdout to binary mode on Windows
-        _setmode(_fileno(stdout), _O_BINARY);
-    #endif
     return true;
 
 error_destroy_display:
-    sc_display_destroy(&screen->display);
+    if (screen->threaded_rendering) {
+        sc_render_thread_stop(&screen->render_thread);
+        sc_render_thread_join(&screen->render_thread);
+    } else {
+        sc_display_destroy(&screen->display);
+    }
 error_destroy_window:
     SDL_DestroyWindow(screen->window);
 error_destroy_fps_counter:
     sc_fps_counter_destroy(&screen->fps_counter);
+error_destroy_processor_mutex:
+    sc_mutex_destroy(&screen->processor_mutex);
 error_destroy_frame_buffer:
     sc_frame_buffer_destroy(&screen->fb);
 
@@ -620,11 +690,18 @@ sc_screen_hide_window(struct sc_screen *screen) {
 
 void
 sc_screen_interrupt(struct sc_screen *screen) {
+    if (screen->threaded_rendering) {
+        sc_render_thread_stop(&screen->render_thread);
+    }
     sc_fps_counter_interrupt(&screen->fps_counter);
 }
 
 void
 sc_screen_join(struct sc_screen *screen) {
+    if (screen->threaded_rendering) {
+        // The display is destroyed by the render thread
+        sc_render_thread_join(&screen->render_thread);
+    }
     sc_fps_counter_join(&screen->fps_counter);
 }
 
@@ -633,11 +710,13 @@ sc_screen_destroy(struct sc_screen *screen) {
 #ifndef NDEBUG
     assert(!screen->open);
 #endif
-    sc_display_destroy(&screen->display);
+    if (!screen->threaded_rendering) {
+        sc_display_destroy(&screen->display);
+    }
     av_frame_free(&screen->frame);
-    av_frame_free(&screen->processed_frame);
     SDL_DestroyWindow(screen->window);
     sc_fps_counter_destroy(&screen->fps_counter);
+    sc_mutex_destroy(&screen->processor_mutex);
     sc_frame_buffer_destroy(&screen->fb);
 }
 
@@ -697,7 +776,7 @@ sc_screen_set_orientation(struct sc_screen *screen,
     }
 
     struct sc_size new_content_size =
-        get_oriented_size(screen->frame_size, orientation);
+        get_content_size(screen->frame_size, screen->stereo_view, orientation);
 
     set_content_size(screen, new_content_size);
 
@@ -707,6 +786,25 @@ sc_screen_set_orientation(struct sc_screen *screen,
     sc_screen_render(screen, true);
 }
 
+void
+sc_screen_set_stereo_view(struct sc_screen *screen, enum sc_stereo_view view) {
+    assert(screen->video);
+
+    if (view == screen->stereo_view) {
+        return;
+    }
+
+    struct sc_size new_content_size =
+        get_content_size(screen->frame_size, view, screen->orientation);
+
+    set_content_size(screen, new_content_size);
+
+    screen->stereo_view = view;
+    LOGI("Stereo view set to %s", sc_stereo_view_get_name(view));
+
+    sc_screen_render(screen, true);
+}
+
 static bool
 sc_screen_init_size(struct sc_screen *screen) {
     // Before first frame
@@ -715,41 +813,74 @@ sc_screen_init_size(struct sc_screen *screen) {
     // The requested size is passed via screen->frame_size
 
     struct sc_size content_size =
-        get_oriented_size(screen->frame_size, screen->orientation);
+        get_content_size(screen->frame_size, screen->stereo_view,
+                         screen->orientation);
     screen->content_size = content_size;
 
+    if (screen->threaded_rendering) {
+        // The render thread creates the texture on the first frame
+        return true;
+    }
+
     enum sc_display_result res =
         sc_display_set_texture_size(&screen->display, screen->frame_size);
     return res != SC_DISPLAY_RESULT_ERROR;
 }
 
-// recreate the texture and resize the window if the frame size has changed
-static enum sc_display_result
-prepare_for_frame(struct sc_screen *screen, struct sc_size new_frame_size) {
+// resize the window if the frame size has changed
+//
+// Return true if the frame size has changed.
+static bool
+update_frame_size(struct sc_screen *screen, struct sc_size new_frame_size) {
     assert(screen->video);
 
     if (screen->frame_size.width == new_frame_size.width
             && screen->frame_size.height == new_frame_size.height) {
-        return SC_DISPLAY_RESULT_OK;
+        return false;
     }
 
     // frame dimension changed
     screen->frame_size = new_frame_size;
 
     struct sc_size new_content_size =
-        get_oriented_size(new_frame_size, screen->orientation);
+        get_content_size(new_frame_size, screen->stereo_view,
+                         screen->orientation);
     set_content_size(screen, new_content_size);
 
     sc_screen_update_content_rect(screen);
+    return true;
+}
+
+// recreate the texture and resize the window if the frame size has changed
+static enum sc_display_result
+prepare_for_frame(struct sc_screen *screen, struct sc_size new_frame_size) {
+    if (!update_frame_size(screen, new_frame_size)) {
+        return SC_DISPLAY_RESULT_OK;
+    }
 
     return sc_display_set_texture_size(&screen->display, screen->frame_size);
 }
 
+static void
+sc_screen_on_first_frame(struct sc_screen *screen) {
+    assert(!screen->has_frame);
+
+    screen->has_frame = true;
+    // this is the very first frame, show the window
+    sc_screen_show_initial_window(screen);
+
+    if (sc_screen_is_relative_mode(screen)) {
+        // Capture mouse on start
+        sc_screen_set_mouse_capture(screen, true);
+    }
+}
+
 static bool
 sc_screen_apply_frame(struct sc_screen *screen, AVFrame *frame) {
     assert(screen->video);
 
     sc_fps_counter_add_rendered_frame(&screen->fps_counter);
+    sc_metrics_add(SC_METRIC_RENDERED_FRAMES, 1);
 
     struct sc_size new_frame_size = {frame->width, frame->height};
     enum sc_display_result res = prepare_for_frame(screen, new_frame_size);
@@ -770,21 +901,32 @@ sc_screen_apply_frame(struct sc_screen *screen, AVFrame *frame) {
         return true;
     }
 
-    if (!screen->has_frame) {
-        screen->has_frame = true;
-        // this is the very first frame, show the window
-        sc_screen_show_initial_window(screen);
+    sc_latency_trace_stamp(SC_LATENCY_STAGE_DISPLAY, frame->pts);
 
-        if (sc_screen_is_relative_mode(screen)) {
-            // Capture mouse on start
-            sc_screen_set_mouse_capture(screen, true);
-        }
+    if (!screen->has_frame) {
+        sc_screen_on_first_frame(screen);
     }
 
     sc_screen_render(screen, false);
     return true;
 }
 
+// the render thread has uploaded a frame of a new size
+static void
+sc_screen_apply_frame_size(struct sc_screen *screen) {
+    assert(screen->threaded_rendering);
+
+    struct sc_size frame_size =
+        sc_render_thread_get_frame_size(&screen->render_thread);
+    update_frame_size(screen, frame_size);
+
+    if (!screen->has_frame) {
+        sc_screen_on_first_frame(screen);
+    }
+
+    sc_screen_render(screen, true);
+}
+
 static bool
 sc_screen_update_frame(struct sc_screen *screen) {
     assert(screen->video);
@@ -800,77 +942,12 @@ sc_screen_update_frame(struct sc_screen *screen) {
             av_frame_unref(screen->resume_frame);
         }
         sc_frame_buffer_consume(&screen->fb, screen->resume_frame);
-
-        // Create a copy of the frame for processing
-        av_frame_unref(screen->processed_frame);
-        av_frame_ref(screen->processed_frame, screen->resume_frame);
-
-        if ((screen->opencv_enabled && screen->opencv_map_path) || screen->show_timestamps) {
-            if (screen->show_timestamps) {
-                // Get PTS (Presentation TimeStamp) from frame
-                int64_t pts = screen->processed_frame->pts;
-                // Convert PTS from microseconds to milliseconds
-                int64_t pts_ms = pts / 1000;
-                char timestamp_str[64];
-                if (pts == AV_NOPTS_VALUE) {
-                    snprintf(timestamp_str, sizeof(timestamp_str), "%s", "No timestamps");
-                } else {
-                    // Calculate actual timestamp by adding PTS (converted to ms) to boot time
-                    int64_t timestamp_ms = screen->device_boot_time + pts_ms;
-                    snprintf(timestamp_str, sizeof(timestamp_str), "%s", fromTimestamp(timestamp_ms));
-                }
-                apply_video_effects(screen->processed_frame, screen->opencv_map_path, timestamp_str);
-            }else{
-                apply_video_effects(screen->processed_frame, screen->opencv_map_path, NULL);
-            }
-        }
-
         return true;
     }
 
     av_frame_unref(screen->frame);
     sc_frame_buffer_consume(&screen->fb, screen->frame);
-
-    // Create a deep copy instead of just referencing
-    screen->processed_frame->format = screen->frame->format;
-    screen->processed_frame->width = screen->frame->width;
-    screen->processed_frame->height = screen->frame->height;
-    screen->processed_frame->pts = screen->frame->pts;
-    av_frame_get_buffer(screen->processed_frame, 0);
-    av_frame_copy(screen->processed_frame, screen->frame);
-    av_frame_copy_props(screen->processed_frame, screen->frame);
-
-    // Apply video effects if enabled
-    if ((screen->opencv_enabled && screen->opencv_map_path) || screen->show_timestamps) {
-        if (screen->show_timestamps) {
-            // Get PTS (Presentation TimeStamp) from frame
-            int64_t pts = screen->processed_frame->pts;
-            // Convert PTS from microseconds to milliseconds
-            int64_t pts_ms = pts / 1000;
-            char timestamp_str[64];
-            if (pts == AV_NOPTS_VALUE) {
-                snprintf(timestamp_str, sizeof(timestamp_str), "%s", "No timestamps");
-            } else {
-                // Calculate actual timestamp by adding PTS (converted to ms) to boot time
-                int64_t timestamp_ms = screen->device_boot_time + pts_ms;
-                snprintf(timestamp_str, sizeof(timestamp_str), "%s", fromTimestamp(timestamp_ms));
-            }
-            apply_video_effects(screen->processed_frame, screen->opencv_map_path, timestamp_str);
-        }else{
-            apply_video_effects(screen->processed_frame, screen->opencv_map_path, NULL);
-        }
-    }
-
-    if (screen->save_frames && screen->frame_dir){
-        save_frame_as_image(screen->processed_frame, screen->frame_dir, 
-                            screen->frame_count++, screen->device_boot_time);
-    }
-
-    if (screen->pipe_output) {
-        pipe_frame(screen->processed_frame, screen->device_boot_time);
-    }
-
-    return sc_screen_apply_frame(screen, screen->processed_frame);
+    return sc_screen_apply_frame(screen, screen->frame);
 }
 
 void
@@ -882,7 +959,20 @@ sc_screen_set_paused(struct sc_screen *screen, bool paused) {
         return;
     }
 
-    if (screen->paused && screen->resume_frame) {
+    if (screen->video_processor) {
+        // While paused, the processor only holds the last decoded frame, it is
+        // processed on resume
+        sc_mutex_lock(&screen->processor_mutex);
+        if (screen->processor_open) {
+            sc_video_processor_set_paused(screen->video_processor, paused);
+        }
+        sc_mutex_unlock(&screen->processor_mutex);
+    }
+
+    if (screen->threaded_rendering) {
+        // The render thread keeps the last frame while paused
+        sc_render_thread_set_paused(&screen->render_thread, paused);
+    } else if (screen->paused && screen->resume_frame) {
         // If display screen was paused, refresh the frame immediately, even if
         // the new state is also paused.
         av_frame_free(&screen->frame);
@@ -902,6 +992,14 @@ sc_screen_set_paused(struct sc_screen *screen, bool paused) {
     screen->paused = paused;
 }
 
+void
+sc_screen_set_video_processor(struct sc_screen *screen,
+                              struct sc_video_processor *vp) {
+    assert(screen->video);
+    assert(!screen->paused);
+    screen->video_processor = vp;
+}
+
 void
 sc_screen_switch_fullscreen(struct sc_screen *screen) {
     assert(screen->video);
@@ -993,6 +1091,12 @@ sc_screen_handle_event(struct sc_screen *screen, const SDL_Event *event) {
             }
             return true;
         }
+        case SC_EVENT_SCREEN_FRAME_SIZE:
+            sc_screen_apply_frame_size(screen);
+            return true;
+        case SC_EVENT_SCREEN_RENDER_ERROR:
+            // already logged
+            return false;
         case SDL_WINDOWEVENT:
             if (!screen->video
                     && event->window.event == SDL_WINDOWEVENT_EXPOSED) {
@@ -1154,6 +1258,18 @@ sc_screen_convert_drawable_to_frame_coords(struct sc_screen *screen,
             break;
     }
 
+    // From the stereo view to the frame (the left eye for the anaglyph)
+    int32_t eye_width = screen->frame_size.width / 2;
+    int32_t frame_height = screen->frame_size.height;
+    if (screen->stereo_view == SC_STEREO_VIEW_RIGHT) {
+        result.x += eye_width;
+    } else if (screen->stereo_view == SC_STEREO_VIEW_TOP_BOTTOM
+            && result.y >= frame_height) {
+        // The bottom half is the right eye
+        result.x += eye_width;
+        result.y -= frame_height;
+    }
+
     return result;
 }
 
@@ -1175,182 +1291,3 @@ sc_screen_hidpi_scale_coords(struct sc_screen *screen, int32_t *x, int32_t *y) {
     *x = (int64_t) *x * dw / ww;
     *y = (int64_t) *y * dh / wh;
 }
-
-// Add this function to save frames
-static void
-save_frame_as_image(const AVFrame *frame, const char *directory, uint64_t frame_number, int64_t boot_time_ms) {
-    char filename[256];
-    // Get PTS (Presentation TimeStamp) from frame
-    int64_t pts = frame->pts;
-    // Convert PTS from microseconds to milliseconds
-    int64_t pts_ms = pts / 1000;
-    if (pts == AV_NOPTS_VALUE) {
-        // If no PTS available, fallback to just frame number
-        snprintf(filename, sizeof(filename), "%s/frame_%06d.ppm", 
-                 directory, (int)frame_number);
-    } else {
-        // Calculate actual timestamp by adding PTS (converted to ms) to boot time
-        int64_t timestamp_ms = boot_time_ms + pts_ms;
-        snprintf(filename, sizeof(filename), "%s/frame_%06d_%lld.ppm", 
-                 directory, (int)frame_number, timestamp_ms);
-    }
-
-    FILE *fp = fopen(filename, "wb");
-    if (!fp) {
-        LOGE("Could not open file for frame saving: %s", filename);
-        return;
-    }
-
-    // Create a copy of the frame for processing
-    AVFrame *processed = av_frame_alloc();
-    if (!processed) {
-        LOGE("Could not allocate processed frame");
-        fclose(fp);
-        return;
-    }
-    
-    // Copy the frame data
-    av_frame_copy_props(processed, frame);
-    processed->format = frame->format;
-    processed->width = frame->width;
-    processed->height = frame->height;
-    if (av_frame_get_buffer(processed, 0) < 0) {
-        LOGE("Could not allocate frame data");
-        av_frame_free(&processed);
-        fclose(fp);
-        return;
-    }
-    av_frame_copy(processed, frame);
-
-    // Convert from YUV420P to RGB24
-    int rgb_linesize[1] = { 3 * processed->width }; // RGB stride
-    uint8_t *rgb_data[1] = { NULL };               // RGB data buffer
-    rgb_data[0] = malloc(rgb_linesize[0] * processed->height);
-    if (!rgb_data[0]) {
-        LOGE("Could not allocate RGB buffer");
-        av_frame_free(&processed);
-        fclose(fp);
-        return;
-    }
-
-    struct SwsContext *sws_ctx = sws_getContext(
-        processed->width, processed->height, AV_PIX_FMT_YUV420P,
-        processed->width, processed->height, AV_PIX_FMT_RGB24,
-        SWS_BICUBIC, NULL, NULL, NULL);
-
-    if (!sws_ctx) {
-        LOGE("Could not initialize SwsContext");
-        free(rgb_data[0]);
-        av_frame_free(&processed);
-        fclose(fp);
-        return;
-    }
-
-    sws_scale(sws_ctx, (const uint8_t * const *)processed->data, 
-              processed->linesize, 0, processed->height,
-              rgb_data, rgb_linesize);
-
-    // Write PPM header
-    fprintf(fp, "P6\n%d %d\n255\n", processed->width, processed->height);
-    
-    // Write RGB data
-    fwrite(rgb_data[0], 1, rgb_linesize[0] * processed->height, fp);
-
-    // Cleanup
-    sws_freeContext(sws_ctx);
-    free(rgb_data[0]);
-    av_frame_free(&processed);
-    fclose(fp);
-}
-
-// Define frame header structure
-#pragma pack(push, 1)  // Ensure struct is packed without padding
-struct frame_header {
-    uint8_t delimiter[8];  // 8-byte delimiter that's unlikely to appear in YUV data
-    int64_t timestamp_ms;  // 8-byte timestamp
-    int32_t width;        // 4-byte width
-    int32_t height;       // 4-byte height
-    uint32_t frame_size;  // 4-byte frame size
-    uint32_t checksum;    // 4-byte checksum for header validation
-};
-#pragma pack(pop)
-
-// Define a unique delimiter that cannot appear in YUV420P data
-static const uint8_t FRAME_DELIMITER[8] = {
-    0xFF, 0xFF, 0xFF, 0xFF,  // Y max is 235
-    0xFF, 0xFF, 0xFF, 0xFF   // U,V max is 240
-};
-
-// Calculate checksum for header validation
-static uint32_t calculate_header_checksum(const struct frame_header *header) {
-    uint32_t checksum = 0;
-    const uint8_t *data = (const uint8_t *)header;
-    // Skip the checksum field itself in calculation
-    size_t size = sizeof(struct frame_header) - sizeof(uint32_t);
-    
-    for (size_t i = 0; i < size; i++) {
-        checksum = (checksum << 8) ^ data[i];
-    }
-    return checksum;
-}
-
-static void pipe_frame(const AVFrame *frame, int64_t boot_time_ms) {
-    // Calculate timestamp
-    int64_t pts_ms = frame->pts / 1000;
-    int64_t timestamp_ms = boot_time_ms + pts_ms;
-    
-    // Calculate frame size
-    uint32_t frame_size = frame->width * frame->height;          // Y plane
-    frame_size += (frame->width * frame->height) / 4;            // U plane
-    frame_size += (frame->width * frame->height) / 4;            // V plane
-
-    // Prepare header
-    struct frame_header header = {
-        .timestamp_ms = timestamp_ms,
-        .width = frame->width,
-        .height = frame->height,
-        .frame_size = frame_size
-    };
-    memcpy(header.delimiter, FRAME_DELIMITER, sizeof(FRAME_DELIMITER));
-    
-    // Calculate and set checksum
-    header.checksum = calculate_header_checksum(&header);
-
-    // Write header
-    if (fwrite(&header, sizeof(header), 1, stdout) != 1) {
-        LOGE("Failed to write frame header");
-        return;
-    }
-
-    // Write YUV420P frame data plane by plane
-    // Y plane
-    for (int i = 0; i < frame->height; i++) {
-        if (fwrite(frame->data[0] + i * frame->linesize[0], 
-                    frame->width, 1, stdout) != 1) {
-            LOGE("Failed to write Y plane");
-            return;
-        }
-    }
-
-    // U plane
-    for (int i = 0; i < frame->height/2; i++) {
-        if (fwrite(frame->data[1] + i * frame->linesize[1], 
-                    frame->width/2, 1, stdout) != 1) {
-            LOGE("Failed to write U plane");
-            return;
-        }
-    }
-
-    // V plane
-    for (int i = 0; i < frame->height/2; i++) {
-        if (fwrite(frame->data[2] + i * frame->linesize[2], 
-                    frame->width/2, 1, stdout) != 1) {
-            LOGE("Failed to write V plane");
-            return;
-        }
-    }
-    fflush(stdout);
-
-    return;
-}
-
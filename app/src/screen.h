@@ -7,17 +7,24 @@
 #include <SDL2/SDL.h>
 #include <libavformat/avformat.h>
 
+#include "bitrate_control.h"
 #include "controller.h"
 #include "coords.h"
 #include "display.h"
 #include "fps_counter.h"
 #include "frame_buffer.h"
+#include "frame_drops.h"
 #include "input_manager.h"
 #include "opengl.h"
 #include "options.h"
+#include "render_thread.h"
 #include "trait/key_processor.h"
 #include "trait/frame_sink.h"
 #include "trait/mouse_processor.h"
+#include "util/thread.h"
+
+// forward declarations
+struct sc_video_processor;
 
 struct sc_screen {
     struct sc_frame_sink frame_sink; // frame sink trait
@@ -29,9 +36,14 @@ struct sc_screen {
     bool video;
 
     struct sc_display display;
+    // If set, the display is owned by the render thread
+    bool threaded_rendering;
+    struct sc_render_thread render_thread;
     struct sc_input_manager im;
     struct sc_frame_buffer fb;
     struct sc_fps_counter fps_counter;
+    struct sc_frame_drops drops; // frames replaced before being rendered
+    struct sc_bitrate_control *bitrate_control; // may be NULL
 
     // The initial requested window properties
     struct {
@@ -45,7 +57,7 @@ struct sc_screen {
 
     SDL_Window *window;
     struct sc_size frame_size;
-    struct sc_size content_size; // rotated frame_size
+    struct sc_size content_size; // frame_size in the stereo view, rotated
 
     bool resize_pending; // resize requested while fullscreen or maximized
     // The content size the last time the window was not maximized or
@@ -54,6 +66,8 @@ struct sc_screen {
 
     // client orientation
     enum sc_orientation orientation;
+    // layout of the eyes
+    enum sc_stereo_view stereo_view;
     // rectangle of the content (excluding black borders)
     struct SDL_Rect rect;
     bool has_frame;
@@ -66,21 +80,16 @@ struct sc_screen {
     SDL_Keycode mouse_capture_key_pressed;
 
     AVFrame *frame;
-    AVFrame *processed_frame;
 
     bool paused;
     AVFrame *resume_frame;
 
-    // Frame saving
-    uint64_t frame_count;
-    bool save_frames;
-    const char *frame_dir;
-    bool opencv_enabled;
-    const char *opencv_map_path;
-
-    int64_t device_boot_time;  // Device boot time in milliseconds
-    bool pipe_output;
-    bool show_timestamps;
+    // If set, the video processor whose frames are only displayed, paused
+    // along with the screen so that it does not process frames meanwhile (see
+    // sc_screen_set_video_processor())
+    struct sc_video_processor *video_processor;
+    sc_mutex processor_mutex;
+    bool processor_open; // the frame sink is open, protected by the mutex
 };
 
 struct sc_screen_params {
@@ -96,6 +105,7 @@ struct sc_screen_params {
     bool legacy_paste;
     bool clipboard_autosync;
     uint8_t shortcut_mods; // OR of enum sc_shortcut_mod values
+    sc_tick mouse_motion_interval; // 0 to send every mouse motion
 
     const char *window_title;
     bool always_on_top;
@@ -108,19 +118,39 @@ struct sc_screen_params {
     bool window_borderless;
 
     enum sc_orientation orientation;
+    enum sc_stereo_view stereo_view;
     bool mipmaps;
 
+    // If not NULL, the stereo remap is applied on the GPU while rendering (the
+    // first gpu_remap_offset rows of the frames are not remapped)
+    const struct sc_video_preprocess *gpu_remap;
+    uint16_t gpu_remap_offset;
+
+    bool pbo_upload;
+
+    // Draw the performance HUD over the video
+    bool hud;
+
+    // Synchronize each present explicitly (see present_sync.h)
+    bool low_latency_present;
+
+    // Render from a dedicated thread (the main thread only handles events)
+    bool render_thread;
+
     bool fullscreen;
     bool start_fps_counter;
-    bool save_frames;
-    const char *frame_dir;
-    bool opencv_enabled;
-    const char *opencv_map_path;
-    int64_t device_boot_time;  // Device boot time in milliseconds
-    const char *serial;
-    bool pipe_output;
-    bool show_timestamps;
-    const char *adb_path;
+
+    // If set, the skipped frames are reported for the adaptive bit rate
+    struct sc_bitrate_control *bitrate_control;
+
+    // If set, the calibration may be reloaded by a shortcut
+    struct sc_remap_reloader *remap_reloader;
+
+    // If set, the video presets may be switched by a shortcut
+    struct sc_video_reconfigurer *video_reconfigurer;
+
+    // If set, the pre-trigger capture ring may be written by a shortcut
+    bool capture_trigger;
 };
 
 // initialize screen, create window, renderer and texture (window is hidden)
@@ -164,10 +194,20 @@ void
 sc_screen_set_orientation(struct sc_screen *screen,
                           enum sc_orientation orientation);
 
+// set the stereo view layout
+void
+sc_screen_set_stereo_view(struct sc_screen *screen, enum sc_stereo_view view);
+
 // set the display pause state
 void
 sc_screen_set_paused(struct sc_screen *screen, bool paused);
 
+// Pause the processor along with the screen, if the processed frames are only
+// forwarded to the screen (it must not be saved, piped nor published)
+void
+sc_screen_set_video_processor(struct sc_screen *screen,
+                              struct sc_video_processor *vp);
+
 // react to SDL events
 // If this function returns false, scrcpy must exit with an error.
 bool
@@ -4,6 +4,7 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
 #include <SDL2/SDL_timer.h>
 #include <SDL2/SDL_platform.h>
 
@@ -13,15 +14,28 @@
 #include "util/log.h"
 #include "util/net_intr.h"
 #include "util/process_intr.h"
+#include "util/rand.h"
 #include "util/str.h"
 
 #define SC_SERVER_FILENAME "scrcpy-server"
 
 #define SC_SERVER_PATH_DEFAULT PREFIX "/share/scrcpy/" SC_SERVER_FILENAME
 #define SC_DEVICE_SERVER_PATH "/data/local/tmp/scrcpy-server.jar"
+#define SC_DEVICE_REMAP_MAP_PATH "/data/local/tmp/scrcpy-remap.bin"
 
 #define SC_ADB_PORT_DEFAULT 5555
 #define SC_SOCKET_NAME_PREFIX "scrcpy_"
+// Kernel receive buffer size of the video and audio sockets
+#define SC_SERVER_RECV_BUFFER_SIZE (4 * 1024 * 1024)
+// Length of the session token sent on every direct TCP connection
+#define SC_DIRECT_TOKEN_LENGTH 8
+
+#define SC_DAEMON_SOCKET_NAME "scrcpy_daemon"
+#define SC_DAEMON_REQUEST_MAX_LENGTH 8192
+// Status byte replied by the server daemon to a session request
+#define SC_DAEMON_STATUS_ACCEPTED 0
+#define SC_DAEMON_STATUS_MISMATCH 1 // another server version, the daemon exits
+#define SC_DAEMON_STATUS_INVALID 2
 
 static char *
 get_server_path(void) {
@@ -78,6 +92,7 @@ sc_server_params_destroy(struct sc_server_params *params) {
     free((char *) params->tcpip_dst);
     free((char *) params->camera_id);
     free((char *) params->camera_ar);
+    free((char *) params->remap_map);
 }
 
 static bool
@@ -107,6 +122,7 @@ sc_server_params_copy(struct sc_server_params *dst,
     COPY(tcpip_dst);
     COPY(camera_id);
     COPY(camera_ar);
+    COPY(remap_map);
 #undef COPY
 
     return true;
@@ -127,7 +143,8 @@ push_server(struct sc_intr *intr, const char *serial) {
         free(server_path);
         return false;
     }
-    bool ok = sc_adb_push(intr, serial, server_path, SC_DEVICE_SERVER_PATH, 0);
+    bool ok = sc_adb_push(intr, serial, server_path, SC_DEVICE_SERVER_PATH,
+                          NULL, 0);
     free(server_path);
     return ok;
 }
@@ -233,41 +250,14 @@ validate_string(const char *s) {
     return true;
 }
 
-static sc_pid
-execute_server(struct sc_server *server,
-               const struct sc_server_params *params) {
-    sc_pid pid = SC_PROCESS_NONE;
-
-    const char *serial = server->serial;
-    assert(serial);
-
-    const char *cmd[128];
-    unsigned count = 0;
-    cmd[count++] = sc_adb_get_executable();
-    cmd[count++] = "-s";
-    cmd[count++] = serial;
-    cmd[count++] = "shell";
-    cmd[count++] = "CLASSPATH=" SC_DEVICE_SERVER_PATH;
-    cmd[count++] = "app_process";
-
-#ifdef SERVER_DEBUGGER
-# define SERVER_DEBUGGER_PORT "5005"
-    cmd[count++] =
-# ifdef SERVER_DEBUGGER_METHOD_NEW
-        /* Android 9 and above */
-        "-XjdwpProvider:internal -XjdwpOptions:transport=dt_socket,suspend=y,"
-        "server=y,address="
-# else
-        /* Android 8 and below */
-        "-agentlib:jdwp=transport=dt_socket,suspend=y,server=y,address="
-# endif
-            SERVER_DEBUGGER_PORT;
-#endif
-    cmd[count++] = "/"; // unused
-    cmd[count++] = "com.genymobile.scrcpy.Server";
-    cmd[count++] = SCRCPY_VERSION;
+// Append the server arguments ("key=value", allocated) to cmd
+static bool
+sc_server_append_params(struct sc_server *server,
+                        const struct sc_server_params *params,
+                        const char *cmd[], unsigned *pcount) {
+    unsigned count = *pcount;
+    bool ok = false;
 
-    unsigned dyn_idx = count; // from there, the strings are allocated
 #define ADD_PARAM(fmt, ...) do { \
         char *p; \
         if (asprintf(&p, fmt, ## __VA_ARGS__) == -1) { \
@@ -296,7 +286,23 @@ execute_server(struct sc_server *server,
     if (params->audio_bit_rate) {
         ADD_PARAM("audio_bit_rate=%" PRIu32, params->audio_bit_rate);
     }
-    if (params->video_codec != SC_CODEC_H264) {
+    if (params->audio_read_size) {
+        ADD_PARAM("audio_read_samples=%" PRIu16, params->audio_read_size);
+    }
+    if (params->audio_low_latency) {
+        ADD_PARAM("audio_low_latency=true");
+    }
+    if (params->video_codec_count) {
+        char codecs[32];
+        size_t len = 0;
+        for (unsigned i = 0; i < params->video_codec_count; ++i) {
+            len += snprintf(codecs + len, sizeof(codecs) - len, "%s%s",
+                            i ? "," : "",
+                            sc_server_get_codec_name(params->video_codecs[i]));
+            assert(len < sizeof(codecs));
+        }
+        ADD_PARAM("video_codecs=%s", codecs);
+    } else if (params->video_codec != SC_CODEC_H264) {
         ADD_PARAM("video_codec=%s",
                   sc_server_get_codec_name(params->video_codec));
     }
@@ -331,6 +337,22 @@ execute_server(struct sc_server *server,
     if (server->tunnel.forward) {
         ADD_PARAM("tunnel_forward=true");
     }
+    if (params->direct_port) {
+        ADD_PARAM("direct_port=%" PRIu16, params->direct_port);
+        ADD_PARAM("direct_token=%016" PRIx64, server->direct_token);
+        if (params->reconnect_timeout) {
+            ADD_PARAM("reconnect_timeout=%" PRIu16, params->reconnect_timeout);
+        }
+    }
+    if (params->video_send_buffer) {
+        ADD_PARAM("video_send_buffer=%" PRIu32, params->video_send_buffer);
+    }
+    if (server->video_udp_socket != SC_SOCKET_NONE) {
+        ADD_PARAM("video_udp_port=%" PRIu16, server->video_udp_port);
+        if (params->video_fec) {
+            ADD_PARAM("video_fec=%" PRIu8, params->video_fec);
+        }
+    }
     if (params->crop) {
         VALIDATE_STRING(params->crop);
         ADD_PARAM("crop=%s", params->crop);
@@ -405,6 +427,40 @@ execute_server(struct sc_server *server,
         // By default, power_on is true
         ADD_PARAM("power_on=false");
     }
+    if (params->capture_timestamp) {
+        ADD_PARAM("capture_timestamp=true");
+    }
+    if (params->capture_exposure) {
+        ADD_PARAM("capture_exposure=true");
+    }
+    if (params->timestamp_sei) {
+        ADD_PARAM("timestamp_sei=true");
+    }
+    if (params->encoder_latency) {
+        ADD_PARAM("encoder_latency=true");
+    }
+    if (params->pose_rate) {
+        ADD_PARAM("pose_rate=%" PRIu16, params->pose_rate);
+    }
+    if (params->remap_map) {
+        ADD_PARAM("remap_map=" SC_DEVICE_REMAP_MAP_PATH);
+    }
+    if (params->split_eyes) {
+        ADD_PARAM("split_eyes=true");
+    }
+    if (params->camera_stream) {
+        ADD_PARAM("camera_stream=true");
+    }
+    if (params->latency_profile != SC_LATENCY_PROFILE_DEFAULT) {
+        assert(params->latency_profile == SC_LATENCY_PROFILE_ULTRA_LOW);
+        ADD_PARAM("latency_profile=ultra-low");
+    }
+    if (params->encoder_async) {
+        ADD_PARAM("encoder_async=true");
+    }
+    if (params->repeat_frame_delay != 100) {
+        ADD_PARAM("repeat_frame_delay=%" PRIu16, params->repeat_frame_delay);
+    }
     if (params->list & SC_OPTION_LIST_ENCODERS) {
         ADD_PARAM("list_encoders=true");
     }
@@ -417,8 +473,58 @@ execute_server(struct sc_server *server,
     if (params->list & SC_OPTION_LIST_CAMERA_SIZES) {
         ADD_PARAM("list_camera_sizes=true");
     }
+    if (params->list & SC_OPTION_PROBE_ENCODERS) {
+        ADD_PARAM("probe_encoders=true");
+    }
 
 #undef ADD_PARAM
+#undef VALIDATE_STRING
+
+    ok = true;
+
+end:
+    *pcount = count;
+    return ok;
+}
+
+static sc_pid
+execute_server(struct sc_server *server,
+               const struct sc_server_params *params) {
+    sc_pid pid = SC_PROCESS_NONE;
+
+    const char *serial = server->serial;
+    assert(serial);
+
+    const char *cmd[128];
+    unsigned count = 0;
+    cmd[count++] = sc_adb_get_executable();
+    cmd[count++] = "-s";
+    cmd[count++] = serial;
+    cmd[count++] = "shell";
+    cmd[count++] = "CLASSPATH=" SC_DEVICE_SERVER_PATH;
+    cmd[count++] = "app_process";
+
+#ifdef SERVER_DEBUGGER
+# define SERVER_DEBUGGER_PORT "5005"
+    cmd[count++] =
+# ifdef SERVER_DEBUGGER_METHOD_NEW
+        /* Android 9 and above */
+        "-XjdwpProvider:internal -XjdwpOptions:transport=dt_socket,suspend=y,"
+        "server=y,address="
+# else
+        /* Android 8 and below */
+        "-agentlib:jdwp=transport=dt_socket,suspend=y,server=y,address="
+# endif
+            SERVER_DEBUGGER_PORT;
+#endif
+    cmd[count++] = "/"; // unused
+    cmd[count++] = "com.genymobile.scrcpy.Server";
+    cmd[count++] = SCRCPY_VERSION;
+
+    unsigned dyn_idx = count; // from there, the strings are allocated
+    if (!sc_server_append_params(server, params, cmd, &count)) {
+        goto end;
+    }
 
     cmd[count++] = NULL;
 
@@ -444,10 +550,280 @@ end:
     return pid;
 }
 
+// 64-bit FNV-1a hash of the local server file, to detect if the server daemon
+// running on the device executes the same server
+static bool
+sc_server_hash(char hash[static 17]) {
+    char *server_path = get_server_path();
+    if (!server_path) {
+        return false;
+    }
+
+    struct sc_file_mapping mapping;
+    bool ok = sc_file_map(server_path, &mapping);
+    if (!ok) {
+        LOGE("Could not read '%s'", server_path);
+        free(server_path);
+        return false;
+    }
+    free(server_path);
+
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+    const uint8_t *data = mapping.data;
+    for (size_t i = 0; i < mapping.size; ++i) {
+        h ^= data[i];
+        h *= UINT64_C(0x100000001b3);
+    }
+    sc_file_unmap(&mapping);
+
+    int r = snprintf(hash, 17, "%016" PRIx64, h);
+    assert(r == 16);
+    (void) r;
+    return true;
+}
+
+static bool
+execute_server_daemon(struct sc_server *server, const char *hash) {
+    const char *serial = server->serial;
+    assert(serial);
+
+    char daemon_id[sizeof("daemon_id=") + 16];
+    int r = snprintf(daemon_id, sizeof(daemon_id), "daemon_id=%s", hash);
+    assert(r >= 0 && (size_t) r < sizeof(daemon_id));
+    (void) r;
+
+    char log_level[32];
+    r = snprintf(log_level, sizeof(log_level), "log_level=%s",
+                 log_level_to_server_string(server->params.log_level));
+    assert(r >= 0 && (size_t) r < sizeof(log_level));
+
+    // The daemon must survive the "adb shell" session which starts it, so it
+    // is detached from the shell (its logs are only available in logcat)
+    const char *const cmd[] = {
+        sc_adb_get_executable(),
+        "-s",
+        serial,
+        "shell",
+        "CLASSPATH=" SC_DEVICE_SERVER_PATH,
+        "nohup",
+        "app_process",
+        "/", // unused
+        "com.genymobile.scrcpy.Server",
+        SCRCPY_VERSION,
+        daemon_id,
+        log_level,
+        ">/dev/null",
+        "2>&1",
+        "&",
+        NULL,
+    };
+
+    sc_pid pid = sc_adb_execute(cmd, 0);
+    if (pid == SC_PROCESS_NONE) {
+        LOGE("Could not start the server daemon");
+        return false;
+    }
+
+    sc_exit_code exit_code = sc_process_wait(pid, true);
+    if (exit_code) {
+        LOGE("Could not start the server daemon (exit code %d)",
+             (int) exit_code);
+        return false;
+    }
+
+    return true;
+}
+
+// Request a new session to the server daemon (through the daemon tunnel)
+//
+// Return the status replied by the daemon, or -1 if no daemon is listening.
+static int
+sc_server_daemon_request(struct sc_server *server, const char *request,
+                         size_t len) {
+    sc_socket socket = net_socket();
+    if (socket == SC_SOCKET_NONE) {
+        return -1;
+    }
+
+    bool ok = net_connect_intr(&server->intr, socket, IPV4_LOCALHOST,
+                               server->daemon_tunnel.local_port);
+    if (!ok) {
+        net_close(socket);
+        return -1;
+    }
+
+    ssize_t w = net_send_all_intr(&server->intr, socket, request, len);
+    if (w != (ssize_t) len) {
+        net_close(socket);
+        return -1;
+    }
+
+    // the connection may succeed even if no daemon is listening behind the
+    // "adb forward" tunnel, in that case it is closed without any reply
+    uint8_t status;
+    if (net_recv_intr(&server->intr, socket, &status, 1) != 1) {
+        net_close(socket);
+        return -1;
+    }
+
+    if (status == SC_DAEMON_STATUS_ACCEPTED) {
+        // Kept open until the end of the session
+        server->daemon_socket = socket;
+    } else {
+        net_close(socket);
+    }
+
+    return status;
+}
+
 static bool
-connect_and_read_byte(struct sc_intr *intr, sc_socket socket,
-                      uint32_t tunnel_host, uint16_t tunnel_port) {
-    bool ok = net_connect_intr(intr, socket, tunnel_host, tunnel_port);
+sc_server_build_daemon_request(struct sc_server *server, const char *hash,
+                               char *request, size_t *len) {
+    const char *tokens[128];
+    unsigned count = 0;
+    tokens[count++] = hash;
+    tokens[count++] = SCRCPY_VERSION;
+
+    unsigned dyn_idx = count; // from there, the strings are allocated
+    bool ok = sc_server_append_params(server, &server->params, tokens,
+                                      &count);
+    if (ok) {
+        tokens[count++] = NULL;
+        size_t n = sc_str_join(request, tokens, ' ',
+                               SC_DAEMON_REQUEST_MAX_LENGTH - 1);
+        if (n >= SC_DAEMON_REQUEST_MAX_LENGTH - 1) {
+            LOGE("Server daemon request too long");
+            ok = false;
+        } else {
+            request[n] = '\n';
+            *len = n + 1;
+        }
+        --count; // do not free the NULL terminator
+    }
+
+    for (unsigned i = dyn_idx; i < count; ++i) {
+        free((char *) tokens[i]);
+    }
+
+    return ok;
+}
+
+// Start the session on the server daemon, after pushing and starting the
+// server daemon if it is not running (or if it runs another server version)
+static bool
+sc_server_open_daemon_session(struct sc_server *server, const char *serial) {
+    char hash[17];
+    bool ok = sc_server_hash(hash);
+    if (!ok) {
+        return false;
+    }
+
+    char request[SC_DAEMON_REQUEST_MAX_LENGTH];
+    size_t len;
+    ok = sc_server_build_daemon_request(server, hash, request, &len);
+    if (!ok) {
+        return false;
+    }
+
+    // Do not retry on the port of the session tunnel, it is already used
+    struct sc_port_range port_range = server->params.port_range;
+    if (server->tunnel.enabled && server->tunnel.local_port < port_range.last) {
+        port_range.first = server->tunnel.local_port + 1;
+    }
+
+    ok = sc_adb_tunnel_open(&server->daemon_tunnel, &server->intr, serial,
+                            SC_DAEMON_SOCKET_NAME, port_range, true);
+    if (!ok) {
+        return false;
+    }
+
+    int status = sc_server_daemon_request(server, request, len);
+    if (status == SC_DAEMON_STATUS_ACCEPTED) {
+        LOGI("Session started on the running server daemon");
+        return true;
+    }
+
+    if (status == SC_DAEMON_STATUS_INVALID) {
+        LOGE("Session rejected by the server daemon (see adb logcat)");
+        goto error;
+    }
+
+    if (sc_intr_is_interrupted(&server->intr)) {
+        goto error;
+    }
+
+    if (status == SC_DAEMON_STATUS_MISMATCH) {
+        LOGI("Replacing the server daemon (different server version)");
+    } else {
+        LOGI("Starting the server daemon");
+    }
+
+    ok = push_server(&server->intr, serial);
+    if (!ok) {
+        goto error;
+    }
+
+    ok = execute_server_daemon(server, hash);
+    if (!ok) {
+        goto error;
+    }
+
+    // Wait for the new daemon to listen
+    unsigned attempts = 100;
+    sc_tick delay = SC_TICK_FROM_MS(100);
+    for (;;) {
+        status = sc_server_daemon_request(server, request, len);
+        if (status != -1 || sc_intr_is_interrupted(&server->intr)
+                || !--attempts) {
+            break;
+        }
+
+        sc_tick deadline = sc_tick_now() + delay;
+        if (!sc_server_sleep(server, deadline)) {
+            LOGI("Connection attempt stopped");
+            break;
+        }
+    }
+
+    if (status == SC_DAEMON_STATUS_ACCEPTED) {
+        return true;
+    }
+
+    LOGE("Could not start a session on the server daemon");
+
+error:
+    sc_adb_tunnel_close(&server->daemon_tunnel, &server->intr, serial,
+                        SC_DAEMON_SOCKET_NAME);
+    return false;
+}
+
+static bool
+connect_socket(struct sc_server *server, sc_socket socket, uint32_t host,
+               uint16_t port) {
+    bool ok = net_connect_intr(&server->intr, socket, host, port);
+    if (!ok) {
+        return false;
+    }
+
+    if (server->params.direct_port) {
+        // The server closes the direct connections which do not start with
+        // the session token
+        uint8_t token[SC_DIRECT_TOKEN_LENGTH];
+        sc_write64be(token, server->direct_token);
+        ssize_t w = net_send_all_intr(&server->intr, socket, token,
+                                      sizeof(token));
+        if (w != sizeof(token)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+connect_and_read_byte(struct sc_server *server, sc_socket socket,
+                      uint32_t host, uint16_t port) {
+    bool ok = connect_socket(server, socket, host, port);
     if (!ok) {
         return false;
     }
@@ -455,7 +831,7 @@ connect_and_read_byte(struct sc_intr *intr, sc_socket socket,
     char byte;
     // the connection may succeed even if the server behind the "adb tunnel"
     // is not listening, so read one byte to detect a working connection
-    if (net_recv_intr(intr, socket, &byte, 1) != 1) {
+    if (net_recv_intr(&server->intr, socket, &byte, 1) != 1) {
         // the server is not listening yet behind the adb tunnel
         return false;
     }
@@ -470,7 +846,7 @@ connect_to_server(struct sc_server *server, unsigned attempts, sc_tick delay,
         LOGD("Remaining connection attempts: %u", attempts);
         sc_socket socket = net_socket();
         if (socket != SC_SOCKET_NONE) {
-            bool ok = connect_and_read_byte(&server->intr, socket, host, port);
+            bool ok = connect_and_read_byte(server, socket, host, port);
             if (ok) {
                 // it worked!
                 return socket;
@@ -531,10 +907,21 @@ sc_server_init(struct sc_server *server, const struct sc_server_params *params,
     server->stopped = false;
 
     server->video_socket = SC_SOCKET_NONE;
+    server->video_right_socket = SC_SOCKET_NONE;
+    server->camera_socket = SC_SOCKET_NONE;
     server->audio_socket = SC_SOCKET_NONE;
     server->control_socket = SC_SOCKET_NONE;
+    server->video_udp_socket = SC_SOCKET_NONE;
+    server->video_udp_port = 0;
 
     sc_adb_tunnel_init(&server->tunnel);
+    sc_adb_tunnel_init(&server->daemon_tunnel);
+    server->daemon_socket = SC_SOCKET_NONE;
+    memset(&server->timing, 0, sizeof(server->timing));
+    server->boot_time_probing = false;
+    server->device_boot_time = 0;
+    server->direct_host = 0;
+    server->direct_token = 0;
 
     assert(cbs);
     assert(cbs->on_connection_failed);
@@ -566,20 +953,27 @@ device_read_info(struct sc_intr *intr, sc_socket device_socket,
 static bool
 sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
     struct sc_adb_tunnel *tunnel = &server->tunnel;
+    uint16_t direct_port = server->params.direct_port;
+    uint16_t connect_port = server->params.connect_port;
 
-    assert(tunnel->enabled);
+    assert(tunnel->enabled != (direct_port || connect_port));
 
     const char *serial = server->serial;
     assert(serial);
 
     bool video = server->params.video;
+    bool video_right = video && server->params.split_eyes;
+    bool camera = video && server->params.camera_stream;
     bool audio = server->params.audio;
     bool control = server->params.control;
 
+    // The sockets are connected in the order expected by the server
     sc_socket video_socket = SC_SOCKET_NONE;
+    sc_socket video_right_socket = SC_SOCKET_NONE;
+    sc_socket camera_socket = SC_SOCKET_NONE;
     sc_socket audio_socket = SC_SOCKET_NONE;
     sc_socket control_socket = SC_SOCKET_NONE;
-    if (!tunnel->forward) {
+    if (!direct_port && !connect_port && !tunnel->forward) {
         if (video) {
             video_socket =
                 net_accept_intr(&server->intr, tunnel->server_socket);
@@ -588,6 +982,22 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
             }
         }
 
+        if (video_right) {
+            video_right_socket =
+                net_accept_intr(&server->intr, tunnel->server_socket);
+            if (video_right_socket == SC_SOCKET_NONE) {
+                goto fail;
+            }
+        }
+
+        if (camera) {
+            camera_socket =
+                net_accept_intr(&server->intr, tunnel->server_socket);
+            if (camera_socket == SC_SOCKET_NONE) {
+                goto fail;
+            }
+        }
+
         if (audio) {
             audio_socket =
                 net_accept_intr(&server->intr, tunnel->server_socket);
@@ -604,20 +1014,30 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
             }
         }
     } else {
-        uint32_t tunnel_host = server->params.tunnel_host;
-        if (!tunnel_host) {
-            tunnel_host = IPV4_LOCALHOST;
-        }
+        uint32_t host;
+        uint16_t port;
+        if (direct_port) {
+            host = server->direct_host;
+            port = direct_port;
+        } else if (connect_port) {
+            host = server->params.connect_host;
+            port = connect_port;
+        } else {
+            host = server->params.tunnel_host;
+            if (!host) {
+                host = IPV4_LOCALHOST;
+            }
 
-        uint16_t tunnel_port = server->params.tunnel_port;
-        if (!tunnel_port) {
-            tunnel_port = tunnel->local_port;
+            port = server->params.tunnel_port;
+            if (!port) {
+                port = tunnel->local_port;
+            }
         }
 
         unsigned attempts = 100;
         sc_tick delay = SC_TICK_FROM_MS(100);
         sc_socket first_socket = connect_to_server(server, attempts, delay,
-                                                   tunnel_host, tunnel_port);
+                                                   host, port);
         if (first_socket == SC_SOCKET_NONE) {
             goto fail;
         }
@@ -626,6 +1046,28 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
             video_socket = first_socket;
         }
 
+        if (video_right) {
+            video_right_socket = net_socket();
+            if (video_right_socket == SC_SOCKET_NONE) {
+                goto fail;
+            }
+            bool ok = connect_socket(server, video_right_socket, host, port);
+            if (!ok) {
+                goto fail;
+            }
+        }
+
+        if (camera) {
+            camera_socket = net_socket();
+            if (camera_socket == SC_SOCKET_NONE) {
+                goto fail;
+            }
+            bool ok = connect_socket(server, camera_socket, host, port);
+            if (!ok) {
+                goto fail;
+            }
+        }
+
         if (audio) {
             if (!video) {
                 audio_socket = first_socket;
@@ -634,8 +1076,7 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
                 if (audio_socket == SC_SOCKET_NONE) {
                     goto fail;
                 }
-                bool ok = net_connect_intr(&server->intr, audio_socket,
-                                           tunnel_host, tunnel_port);
+                bool ok = connect_socket(server, audio_socket, host, port);
                 if (!ok) {
                     goto fail;
                 }
@@ -650,8 +1091,8 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
                 if (control_socket == SC_SOCKET_NONE) {
                     goto fail;
                 }
-                bool ok = net_connect_intr(&server->intr, control_socket,
-                                           tunnel_host, tunnel_port);
+                bool ok = connect_socket(server, control_socket, host,
+                                         port);
                 if (!ok) {
                     goto fail;
                 }
@@ -667,9 +1108,34 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
         (void) ok; // error already logged
     }
 
-    // we don't need the adb tunnel anymore
-    sc_adb_tunnel_close(tunnel, &server->intr, serial,
-                        server->device_socket_name);
+    // Large receive buffers absorb the bursts of large packets (key frames),
+    // especially over Wi-Fi
+    if (video_socket != SC_SOCKET_NONE) {
+        bool ok = net_set_recv_buffer_size(video_socket,
+                                           SC_SERVER_RECV_BUFFER_SIZE);
+        (void) ok; // error already logged
+    }
+    if (video_right_socket != SC_SOCKET_NONE) {
+        bool ok = net_set_recv_buffer_size(video_right_socket,
+                                           SC_SERVER_RECV_BUFFER_SIZE);
+        (void) ok; // error already logged
+    }
+    if (camera_socket != SC_SOCKET_NONE) {
+        bool ok = net_set_recv_buffer_size(camera_socket,
+                                           SC_SERVER_RECV_BUFFER_SIZE);
+        (void) ok; // error already logged
+    }
+    if (audio_socket != SC_SOCKET_NONE) {
+        bool ok = net_set_recv_buffer_size(audio_socket,
+                                           SC_SERVER_RECV_BUFFER_SIZE);
+        (void) ok; // error already logged
+    }
+
+    if (tunnel->enabled) {
+        // we don't need the adb tunnel anymore
+        sc_adb_tunnel_close(tunnel, &server->intr, serial,
+                            server->device_socket_name);
+    }
 
     sc_socket first_socket = video ? video_socket
                            : audio ? audio_socket
@@ -682,10 +1148,14 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
     }
 
     assert(!video || video_socket != SC_SOCKET_NONE);
+    assert(!video_right || video_right_socket != SC_SOCKET_NONE);
+    assert(!camera || camera_socket != SC_SOCKET_NONE);
     assert(!audio || audio_socket != SC_SOCKET_NONE);
     assert(!control || control_socket != SC_SOCKET_NONE);
 
     server->video_socket = video_socket;
+    server->video_right_socket = video_right_socket;
+    server->camera_socket = camera_socket;
     server->audio_socket = audio_socket;
     server->control_socket = control_socket;
 
@@ -698,6 +1168,18 @@ fail:
         }
     }
 
+    if (video_right_socket != SC_SOCKET_NONE) {
+        if (!net_close(video_right_socket)) {
+            LOGW("Could not close right eye video socket");
+        }
+    }
+
+    if (camera_socket != SC_SOCKET_NONE) {
+        if (!net_close(camera_socket)) {
+            LOGW("Could not close camera video socket");
+        }
+    }
+
     if (audio_socket != SC_SOCKET_NONE) {
         if (!net_close(audio_socket)) {
             LOGW("Could not close audio socket");
@@ -903,6 +1385,74 @@ sc_server_configure_tcpip_unknown_address(struct sc_server *server,
     return sc_server_connect_to_tcpip(server, ip_port);
 }
 
+static bool
+sc_server_open_video_udp_socket(struct sc_server *server) {
+    // Bound before starting the server, which sends the datagrams to this port
+    sc_socket socket = net_udp_socket();
+    if (socket == SC_SOCKET_NONE) {
+        return false;
+    }
+
+    // Any address (INADDR_ANY), ephemeral port
+    uint16_t port;
+    bool ok = net_bind(socket, 0, 0) && net_get_local_port(socket, &port);
+    if (!ok) {
+        net_close(socket);
+        return false;
+    }
+
+    ok = net_set_recv_buffer_size(socket, SC_SERVER_RECV_BUFFER_SIZE);
+    (void) ok; // error already logged
+
+    LOGD("Receiving the video over UDP on port %" PRIu16, port);
+    server->video_udp_socket = socket;
+    server->video_udp_port = port;
+    return true;
+}
+
+static bool
+sc_server_configure_direct(struct sc_server *server, const char *serial) {
+    char *ip;
+    if (sc_adb_device_get_type(serial) == SC_ADB_DEVICE_TYPE_TCPIP) {
+        // The serial is "ip:port", the device is reachable at this address
+        ip = strdup(serial);
+        if (!ip) {
+            LOG_OOM();
+            return false;
+        }
+        char *colon = strrchr(ip, ':');
+        assert(colon);
+        *colon = '\0';
+    } else {
+        ip = sc_adb_get_device_ip(&server->intr, serial, 0);
+        if (!ip) {
+            LOGE("Could not find the device IP address for --direct-tcp-port");
+            return false;
+        }
+    }
+
+    bool ok = net_parse_ipv4(ip, &server->direct_host);
+    if (!ok) {
+        free(ip);
+        return false;
+    }
+
+    LOGI("Connecting directly to %s:%" PRIu16, ip, server->params.direct_port);
+    free(ip);
+
+    // The token is passed to the server over adb, so that only this client
+    // may connect to the listening port
+    struct sc_rand rand;
+    sc_rand_init(&rand);
+    server->direct_token = sc_rand_u64(&rand);
+
+    if (server->params.video && server->params.video_udp) {
+        return sc_server_open_video_udp_socket(server);
+    }
+
+    return true;
+}
+
 static void
 sc_server_kill_adb_if_requested(struct sc_server *server) {
     if (server->params.kill_adb_on_close) {
@@ -912,12 +1462,184 @@ sc_server_kill_adb_if_requested(struct sc_server *server) {
     }
 }
 
+static int
+run_boot_time_probe(void *data) {
+    struct sc_server *server = data;
+
+    // Not interruptible (the server intr is used by the server thread), but
+    // the command is short
+    if (!sc_adb_get_boot_time(NULL, server->serial, 0,
+                              &server->device_boot_time)) {
+        LOGE("Failed to get device boot time");
+        server->device_boot_time = 0;
+    }
+
+    return 0;
+}
+
+static void
+sc_server_interrupt_sockets(struct sc_server *server) {
+    // The video socket may be replaced on reconnection
+    sc_mutex_lock(&server->mutex);
+    if (server->video_socket != SC_SOCKET_NONE) {
+        // There is no video_socket if --no-video is set
+        net_interrupt(server->video_socket);
+    }
+    sc_mutex_unlock(&server->mutex);
+
+    if (server->video_right_socket != SC_SOCKET_NONE) {
+        net_interrupt(server->video_right_socket);
+    }
+
+    if (server->camera_socket != SC_SOCKET_NONE) {
+        net_interrupt(server->camera_socket);
+    }
+
+    if (server->audio_socket != SC_SOCKET_NONE) {
+        // There is no audio_socket if --no-audio is set
+        net_interrupt(server->audio_socket);
+    }
+
+    if (server->control_socket != SC_SOCKET_NONE) {
+        // There is no control_socket if --no-control is set
+        net_interrupt(server->control_socket);
+    }
+
+    if (server->video_udp_socket != SC_SOCKET_NONE) {
+        net_interrupt(server->video_udp_socket);
+    }
+}
+
+static void
+sc_server_wait_stopped(struct sc_server *server) {
+    sc_mutex_lock(&server->mutex);
+    while (!server->stopped) {
+        sc_cond_wait(&server->cond_stopped, &server->mutex);
+    }
+    sc_mutex_unlock(&server->mutex);
+}
+
+static int
+run_daemon_observer(void *data) {
+    struct sc_server *server = data;
+
+    // The server daemon closes the connection once the session has ended
+    // (the daemon itself keeps running)
+    char byte;
+    ssize_t r = net_recv(server->daemon_socket, &byte, 1);
+    (void) r;
+
+    sc_server_on_terminated(server);
+    return 0;
+}
+
+// Run the session started by sc_server_open_daemon_session()
+static int
+run_server_daemon_session(struct sc_server *server) {
+    const char *serial = server->serial;
+    assert(server->daemon_socket != SC_SOCKET_NONE);
+
+    sc_thread observer;
+    bool ok = sc_thread_create(&observer, run_daemon_observer,
+                               "scrcpy-daemon", server);
+    if (!ok) {
+        LOGE("Could not create server daemon observer thread");
+        if (server->tunnel.enabled) {
+            sc_adb_tunnel_close(&server->tunnel, &server->intr, serial,
+                                server->device_socket_name);
+        }
+        goto error_connection_failed;
+    }
+
+    ok = sc_server_connect_to(server, &server->info);
+    // The tunnel is always closed by server_connect_to()
+    if (!ok) {
+        net_interrupt(server->daemon_socket);
+        sc_thread_join(&observer, NULL);
+        goto error_connection_failed;
+    }
+
+    // Now connected
+    server->timing.connected = sc_tick_now();
+    server->cbs->on_connected(server, server->cbs_userdata);
+
+    sc_server_wait_stopped(server);
+
+    // Closing the sockets ends the session on the device. Unlike the server
+    // process, the daemon is never killed (it would not be reused otherwise).
+    sc_server_interrupt_sockets(server);
+    net_interrupt(server->daemon_socket);
+    sc_thread_join(&observer, NULL);
+
+    // The intr is interrupted once stopped, so the tunnel removal must not
+    // depend on it
+    sc_adb_tunnel_close(&server->daemon_tunnel, NULL, serial,
+                        SC_DAEMON_SOCKET_NAME);
+
+    sc_server_kill_adb_if_requested(server);
+
+    return 0;
+
+error_connection_failed:
+    sc_adb_tunnel_close(&server->daemon_tunnel, NULL, serial,
+                        SC_DAEMON_SOCKET_NAME);
+    sc_server_kill_adb_if_requested(server);
+    server->cbs->on_connection_failed(server, server->cbs_userdata);
+    return -1;
+}
+
+// Connect to a server already running (connect_port), without adb
+static int
+run_server_connect(struct sc_server *server) {
+    const struct sc_server_params *params = &server->params;
+    uint32_t host = params->connect_host;
+
+    // There is no device serial: the address identifies the server
+    int r = asprintf(&server->serial, "%" PRIu32 ".%" PRIu32 ".%" PRIu32
+                     ".%" PRIu32 ":%" PRIu16, host >> 24, (host >> 16) & 0xFF,
+                     (host >> 8) & 0xFF, host & 0xFF, params->connect_port);
+    if (r == -1) {
+        LOG_OOM();
+        goto error_connection_failed;
+    }
+    LOGI("Connecting to the server at %s (without adb)", server->serial);
+
+    server->timing.device_selected = sc_tick_now();
+    server->timing.server_started = server->timing.device_selected;
+
+    bool ok = sc_server_connect_to(server, &server->info);
+    if (!ok) {
+        goto error_connection_failed;
+    }
+
+    // Now connected
+    server->timing.connected = sc_tick_now();
+    server->cbs->on_connected(server, server->cbs_userdata);
+
+    sc_server_wait_stopped(server);
+
+    // The server ends the session once its sockets are closed
+    sc_server_interrupt_sockets(server);
+
+    return 0;
+
+error_connection_failed:
+    server->cbs->on_connection_failed(server, server->cbs_userdata);
+    return -1;
+}
+
 static int
 run_server(void *data) {
     struct sc_server *server = data;
 
     const struct sc_server_params *params = &server->params;
 
+    server->timing.start = sc_tick_now();
+
+    if (params->connect_port) {
+        return run_server_connect(server);
+    }
+
     // Execute "adb start-server" before "adb devices" so that daemon starting
     // output/errors is correctly printed in the console ("adb devices" output
     // is parsed, so it is not output)
@@ -996,10 +1718,35 @@ run_server(void *data) {
     const char *serial = server->serial;
     assert(serial);
     LOGD("Device serial: %s", serial);
+    server->timing.device_selected = sc_tick_now();
+
+    if (params->probe_boot_time && !params->list) {
+        // Retrieved concurrently with the server push and start, rather than
+        // on the first frame
+        server->boot_time_probing =
+            sc_thread_create(&server->boot_time_thread, run_boot_time_probe,
+                             "scrcpy-boottime", server);
+        if (!server->boot_time_probing) {
+            LOGW("Could not start boot time probe thread");
+        }
+    }
 
-    ok = push_server(&server->intr, serial);
-    if (!ok) {
-        goto error_connection_failed;
+    // In daemon mode, the server is pushed only if the server daemon must be
+    // (re)started (the listing is still executed by a server process)
+    if (!params->daemon || params->list) {
+        ok = push_server(&server->intr, serial);
+        if (!ok) {
+            goto error_connection_failed;
+        }
+    }
+
+    if (params->remap_map) {
+        ok = sc_adb_push(&server->intr, serial, params->remap_map,
+                         SC_DEVICE_REMAP_MAP_PATH, NULL, 0);
+        if (!ok) {
+            LOGE("Could not push the remap map to the device");
+            goto error_connection_failed;
+        }
     }
 
     // If --list-* is passed, then the server just prints the requested data
@@ -1025,20 +1772,42 @@ run_server(void *data) {
     assert(r == sizeof(SC_SOCKET_NAME_PREFIX) - 1 + 8);
     assert(server->device_socket_name);
 
-    ok = sc_adb_tunnel_open(&server->tunnel, &server->intr, serial,
-                            server->device_socket_name, params->port_range,
-                            params->force_adb_forward);
+    if (params->direct_port) {
+        ok = sc_server_configure_direct(server, serial);
+    } else {
+        ok = sc_adb_tunnel_open(&server->tunnel, &server->intr, serial,
+                                server->device_socket_name, params->port_range,
+                                params->force_adb_forward);
+    }
     if (!ok) {
         goto error_connection_failed;
     }
 
+    if (params->daemon) {
+        // the server daemon will connect to our server socket
+        ok = sc_server_open_daemon_session(server, serial);
+        if (!ok) {
+            if (server->tunnel.enabled) {
+                sc_adb_tunnel_close(&server->tunnel, &server->intr, serial,
+                                    server->device_socket_name);
+            }
+            goto error_connection_failed;
+        }
+        server->timing.server_started = sc_tick_now();
+
+        return run_server_daemon_session(server);
+    }
+
     // server will connect to our server socket
     sc_pid pid = execute_server(server, params);
     if (pid == SC_PROCESS_NONE) {
-        sc_adb_tunnel_close(&server->tunnel, &server->intr, serial,
-                            server->device_socket_name);
+        if (server->tunnel.enabled) {
+            sc_adb_tunnel_close(&server->tunnel, &server->intr, serial,
+                                server->device_socket_name);
+        }
         goto error_connection_failed;
     }
+    server->timing.server_started = sc_tick_now();
 
     static const struct sc_process_listener listener = {
         .on_terminated = sc_server_on_terminated,
@@ -1048,8 +1817,10 @@ run_server(void *data) {
     if (!ok) {
         sc_process_terminate(pid);
         sc_process_wait(pid, true); // ignore exit code
-        sc_adb_tunnel_close(&server->tunnel, &server->intr, serial,
-                            server->device_socket_name);
+        if (server->tunnel.enabled) {
+            sc_adb_tunnel_close(&server->tunnel, &server->intr, serial,
+                                server->device_socket_name);
+        }
         goto error_connection_failed;
     }
 
@@ -1064,31 +1835,14 @@ run_server(void *data) {
     }
 
     // Now connected
+    server->timing.connected = sc_tick_now();
     server->cbs->on_connected(server, server->cbs_userdata);
 
     // Wait for server_stop()
-    sc_mutex_lock(&server->mutex);
-    while (!server->stopped) {
-        sc_cond_wait(&server->cond_stopped, &server->mutex);
-    }
-    sc_mutex_unlock(&server->mutex);
+    sc_server_wait_stopped(server);
 
     // Interrupt sockets to wake up socket blocking calls on the server
-
-    if (server->video_socket != SC_SOCKET_NONE) {
-        // There is no video_socket if --no-video is set
-        net_interrupt(server->video_socket);
-    }
-
-    if (server->audio_socket != SC_SOCKET_NONE) {
-        // There is no audio_socket if --no-audio is set
-        net_interrupt(server->audio_socket);
-    }
-
-    if (server->control_socket != SC_SOCKET_NONE) {
-        // There is no control_socket if --no-control is set
-        net_interrupt(server->control_socket);
-    }
+    sc_server_interrupt_sockets(server);
 
     // Give some delay for the server to terminate properly
 #define WATCHDOG_DELAY SC_TICK_FROM_SEC(1)
@@ -1145,6 +1899,76 @@ sc_server_stop(struct sc_server *server) {
 void
 sc_server_join(struct sc_server *server) {
     sc_thread_join(&server->thread, NULL);
+    if (server->boot_time_probing) {
+        sc_thread_join(&server->boot_time_thread, NULL);
+        server->boot_time_probing = false;
+    }
+}
+
+int64_t
+sc_server_get_device_boot_time(struct sc_server *server) {
+    if (server->boot_time_probing) {
+        sc_thread_join(&server->boot_time_thread, NULL);
+        server->boot_time_probing = false;
+    }
+    return server->device_boot_time;
+}
+
+sc_socket
+sc_server_reconnect_video(struct sc_server *server) {
+    assert(server->params.direct_port);
+    assert(server->params.reconnect_timeout);
+
+    // Once connected, the intr is not used by the server thread anymore (it
+    // only waits for sc_server_stop())
+    sc_tick deadline =
+        sc_tick_now() + SC_TICK_FROM_MS(server->params.reconnect_timeout);
+    sc_tick delay = SC_TICK_FROM_MS(50);
+    unsigned attempts = 0;
+    for (;;) {
+        ++attempts;
+        sc_socket socket = net_socket();
+        if (socket != SC_SOCKET_NONE) {
+            // The server does not send a dummy byte on reconnection
+            bool ok = connect_socket(server, socket, server->direct_host,
+                                     server->params.direct_port);
+            if (ok) {
+                ok = net_set_recv_buffer_size(socket,
+                                              SC_SERVER_RECV_BUFFER_SIZE);
+                (void) ok; // error already logged
+
+                sc_mutex_lock(&server->mutex);
+                bool stopped = server->stopped;
+                sc_socket old = server->video_socket;
+                if (!stopped) {
+                    server->video_socket = socket;
+                }
+                sc_mutex_unlock(&server->mutex);
+
+                if (stopped) {
+                    net_close(socket);
+                    return SC_SOCKET_NONE;
+                }
+
+                LOGD("Video socket reconnected after %u attempt(s)",
+                     attempts);
+                // The caller does not read the previous socket anymore
+                net_close(old);
+                return socket;
+            }
+
+            net_close(socket);
+        }
+
+        if (sc_intr_is_interrupted(&server->intr)) {
+            return SC_SOCKET_NONE;
+        }
+
+        sc_tick next = sc_tick_now() + delay;
+        if (next >= deadline || !sc_server_sleep(server, next)) {
+            return SC_SOCKET_NONE;
+        }
+    }
 }
 
 void
@@ -1152,12 +1976,24 @@ sc_server_destroy(struct sc_server *server) {
     if (server->video_socket != SC_SOCKET_NONE) {
         net_close(server->video_socket);
     }
+    if (server->video_right_socket != SC_SOCKET_NONE) {
+        net_close(server->video_right_socket);
+    }
+    if (server->camera_socket != SC_SOCKET_NONE) {
+        net_close(server->camera_socket);
+    }
     if (server->audio_socket != SC_SOCKET_NONE) {
         net_close(server->audio_socket);
     }
     if (server->control_socket != SC_SOCKET_NONE) {
         net_close(server->control_socket);
     }
+    if (server->video_udp_socket != SC_SOCKET_NONE) {
+        net_close(server->video_udp_socket);
+    }
+    if (server->daemon_socket != SC_SOCKET_NONE) {
+        net_close(server->daemon_socket);
+    }
 
     free(server->serial);
     free(server->device_socket_name);
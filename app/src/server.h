@@ -14,6 +14,7 @@
 #include "util/log.h"
 #include "util/net.h"
 #include "util/thread.h"
+#include "util/tick.h"
 
 #define SC_DEVICE_NAME_FIELD_LENGTH 64
 struct sc_server_info {
@@ -25,6 +26,10 @@ struct sc_server_params {
     const char *req_serial;
     enum sc_log_level log_level;
     enum sc_codec video_codec;
+    // If not 0, the server uses the first of these video codecs it can encode
+    // (--video-codec=auto) instead of video_codec
+    enum sc_codec video_codecs[SC_VIDEO_CODEC_COUNT];
+    unsigned video_codec_count;
     enum sc_codec audio_codec;
     enum sc_video_source video_source;
     enum sc_audio_source audio_source;
@@ -41,9 +46,28 @@ struct sc_server_params {
     struct sc_port_range port_range;
     uint32_t tunnel_host;
     uint16_t tunnel_port;
+    // If not 0, the server listens on this TCP port of the device, and the
+    // sockets are connected directly instead of through an adb tunnel
+    uint16_t direct_port;
+    // If set (requires direct_port), the video packets are received over UDP
+    bool video_udp;
+    uint8_t video_fec; // FEC group size of the UDP video packets, 0 if disabled
+    // If not 0, the send buffer of the device video socket is bounded to this
+    // size (in bytes), and the non-reference frames are skipped while it is
+    // full
+    uint32_t video_send_buffer;
+    // If not 0 (requires direct_port), the video connection is resumed if it
+    // is lost, within this delay (in milliseconds)
+    uint16_t reconnect_timeout;
+    // If not 0, connect to a server already running at this address (e.g. the
+    // load generator), without adb: the parameters are not sent to it
+    uint32_t connect_host;
+    uint16_t connect_port;
     uint16_t max_size;
     uint32_t video_bit_rate;
     uint32_t audio_bit_rate;
+    uint16_t audio_read_size;
+    bool audio_low_latency;
     const char *max_fps; // float to be parsed by the server
     int8_t lock_video_orientation;
     bool control;
@@ -65,9 +89,39 @@ struct sc_server_params {
     bool power_on;
     bool kill_adb_on_close;
     bool camera_high_speed;
+    bool capture_timestamp;
+    bool capture_exposure; // requires capture_timestamp
+    bool timestamp_sei;
+    bool encoder_latency;
+    uint16_t pose_rate; // in Hz, 0 to not sample the headset pose
+    // If set, this local file (see device_remap.h) is pushed to the device,
+    // which rectifies the frames before encoding them
+    const char *remap_map;
+    // If set, the eyes (halves of the frames) are encoded separately, and the
+    // right eye is streamed on its own socket
+    bool split_eyes;
+    // If set, the camera is captured along with the display, and streamed on
+    // its own socket
+    bool camera_stream;
+    enum sc_latency_profile latency_profile;
+    bool encoder_async;
+    uint16_t repeat_frame_delay; // in milliseconds
+    // If set, start the session on a persistent server daemon
+    bool daemon;
+    // If set, the device boot time is retrieved via adb concurrently with the
+    // server push and start (see sc_server_get_device_boot_time())
+    bool probe_boot_time;
     uint8_t list;
 };
 
+// Startup steps completion times, set by the server thread (0 if not reached)
+struct sc_server_timing {
+    sc_tick start;
+    sc_tick device_selected;
+    sc_tick server_started; // pushed and executed, or requested to the daemon
+    sc_tick connected;
+};
+
 struct sc_server {
     // The internal allocated strings are copies owned by the server
     struct sc_server_params params;
@@ -82,11 +136,27 @@ struct sc_server {
     bool stopped;
 
     struct sc_intr intr;
-    struct sc_adb_tunnel tunnel;
-
-    sc_socket video_socket;
+    struct sc_adb_tunnel tunnel; // not enabled if params.direct_port
+    struct sc_adb_tunnel daemon_tunnel; // if params.daemon
+    sc_socket daemon_socket; // open during the session, if params.daemon
+    uint32_t direct_host; // device IPv4 address, if params.direct_port
+    uint64_t direct_token; // sent on every direct connection
+
+    sc_socket video_socket; // left eye if params.split_eyes
+    sc_socket video_right_socket; // if params.split_eyes
+    sc_socket camera_socket; // if params.camera_stream
     sc_socket audio_socket;
     sc_socket control_socket;
+    // The video packets are received on this socket if params.video_udp
+    sc_socket video_udp_socket;
+    uint16_t video_udp_port;
+
+    // Only valid once connected
+    struct sc_server_timing timing;
+
+    sc_thread boot_time_thread;
+    bool boot_time_probing; // the thread must be joined
+    int64_t device_boot_time; // in milliseconds, 0 if unknown
 
     const struct sc_server_callbacks *cbs;
     void *cbs_userdata;
@@ -129,6 +199,24 @@ sc_server_stop(struct sc_server *server);
 void
 sc_server_join(struct sc_server *server);
 
+// Return the device boot time (in milliseconds) retrieved during the startup if
+// params.probe_boot_time is set, or 0 if unknown
+//
+// It must be called once connected, from the thread joining the server (it may
+// wait for the end of the adb command).
+int64_t
+sc_server_get_device_boot_time(struct sc_server *server);
+
+// Connect a new video socket to the server still running on the device, to
+// replace the lost one (params.reconnect_timeout must be set)
+//
+// It retries until params.reconnect_timeout expires or the server is stopped.
+// It must be called once connected, from the thread reading the video socket.
+// The previous video socket is closed. Return the new socket (owned by the
+// server), or SC_SOCKET_NONE on failure.
+sc_socket
+sc_server_reconnect_video(struct sc_server *server);
+
 // close and release sockets
 void
 sc_server_destroy(struct sc_server *server);
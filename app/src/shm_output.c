@@ -0,0 +1,207 @@
+#include "shm_output.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include <libavutil/frame.h>
+
+#include "frame_pyramid.h"
+#include "shm_ring.h"
+#include "util/log.h"
+
+#define SC_ALIGN(x, a) (((x) + (a) - 1) / (a) * (a))
+
+static_assert(sizeof(struct sc_shm_ring_slot) == SC_SHM_RING_ALIGN,
+              "unexpected slot header size");
+
+// The counters are plain integers in the (self-contained) layout, but they are
+// shared with other processes, so they are always accessed atomically
+static inline atomic_uint_least64_t *
+sc_shm_counter(uint64_t *counter) {
+    return (atomic_uint_least64_t *) counter;
+}
+
+static inline struct sc_shm_ring_header *
+sc_shm_output_header(struct sc_shm_output *so) {
+    return so->shm.data;
+}
+
+static inline struct sc_shm_ring_slot *
+sc_shm_output_slot(struct sc_shm_output *so, uint64_t index) {
+    struct sc_shm_ring_header *header = sc_shm_output_header(so);
+    uint8_t *base = (uint8_t *) so->shm.data + header->slot_offset;
+    return (struct sc_shm_ring_slot *) (base + index * header->slot_size);
+}
+
+static uint64_t
+sc_shm_output_frame_size(const AVFrame *frame) {
+    uint64_t area = (uint64_t) frame->width * frame->height;
+    if (frame->format == AV_PIX_FMT_GRAY8) {
+        // Y plane only
+        return area;
+    }
+    // Y plane, then U and V planes at half resolution
+    return area + 2 * (area / 4);
+}
+
+// Upper bound of the size of the pyramid levels, which does not depend on the
+// orientation of the frame
+static uint64_t
+sc_shm_output_pyramid_capacity(const struct sc_shm_output *so,
+                               const AVFrame *frame) {
+    uint64_t area = (uint64_t) frame->width * frame->height;
+    uint64_t capacity = 0;
+    for (unsigned i = 1; i <= SC_FRAME_PYRAMID_MAX_LEVEL; ++i) {
+        if (so->pyramid_levels & (1u << i)) {
+            capacity += area >> (2 * i);
+        }
+    }
+    return capacity;
+}
+
+void
+sc_shm_output_init(struct sc_shm_output *so, const char *name,
+                   unsigned pyramid_levels) {
+    so->name = name;
+    so->pyramid_levels = pyramid_levels;
+    so->created = false;
+    so->capacity = 0;
+    so->count = 0;
+}
+
+void
+sc_shm_output_destroy(struct sc_shm_output *so) {
+    if (so->created) {
+        sc_shm_destroy(&so->shm);
+    }
+}
+
+static bool
+sc_shm_output_create(struct sc_shm_output *so, uint64_t capacity) {
+    uint64_t slot_offset =
+        SC_ALIGN(sizeof(struct sc_shm_ring_header), SC_SHM_RING_ALIGN);
+    uint64_t slot_size = SC_ALIGN(sizeof(struct sc_shm_ring_slot) + capacity,
+                                  SC_SHM_RING_ALIGN);
+    uint64_t size = slot_offset + SC_SHM_OUTPUT_SLOT_COUNT * slot_size;
+    if (size > SIZE_MAX) {
+        LOGE("Shared memory too large");
+        return false;
+    }
+
+    if (!sc_shm_create(&so->shm, so->name, size)) {
+        LOGE("Could not create shared memory: %s", so->name);
+        return false;
+    }
+
+    struct sc_shm_ring_header *header = sc_shm_output_header(so);
+    header->version = SC_SHM_RING_VERSION;
+    header->slot_count = SC_SHM_OUTPUT_SLOT_COUNT;
+    header->slot_size = slot_size;
+    header->slot_offset = slot_offset;
+    atomic_init(sc_shm_counter(&header->write_count), 0);
+
+    // Publish the header only once it is fully initialized
+    atomic_thread_fence(memory_order_release);
+    memcpy(header->magic, SC_SHM_RING_MAGIC, sizeof(header->magic));
+
+    so->created = true;
+    so->capacity = capacity;
+
+    LOGI("Shared memory output: %s (%d slots of %" PRIu64 " bytes)",
+         so->name, SC_SHM_OUTPUT_SLOT_COUNT, slot_size);
+    return true;
+}
+
+static void
+sc_shm_output_copy_plane(uint8_t *dst, const AVFrame *frame, int plane,
+                         int width, int height) {
+    const uint8_t *src = frame->data[plane];
+    int linesize = frame->linesize[plane];
+    if (linesize == width) {
+        // Fast path: the plane is contiguous
+        memcpy(dst, src, (size_t) width * height);
+        return;
+    }
+
+    for (int i = 0; i < height; ++i) {
+        memcpy(dst + (size_t) i * width, src + (size_t) i * linesize, width);
+    }
+}
+
+bool
+sc_shm_output_push(struct sc_shm_output *so, const AVFrame *frame,
+                   const struct sc_frame_pyramid *pyramid,
+                   int64_t timestamp_ms) {
+    assert(frame->format == AV_PIX_FMT_YUV420P
+        || frame->format == AV_PIX_FMT_GRAY8);
+    assert(!pyramid || pyramid->levels == so->pyramid_levels);
+
+    uint64_t frame_size = sc_shm_output_frame_size(frame);
+    uint64_t pyramid_capacity = sc_shm_output_pyramid_capacity(so, frame);
+    if (!so->created) {
+        if (!sc_shm_output_create(so, frame_size + pyramid_capacity)) {
+            return false;
+        }
+    } else if (frame_size + pyramid_capacity > so->capacity) {
+        LOGE("Frame too large for the shared memory slots (%dx%d)",
+             frame->width, frame->height);
+        return false;
+    }
+
+    struct sc_shm_ring_header *header = sc_shm_output_header(so);
+    uint64_t n = so->count;
+    struct sc_shm_ring_slot *slot =
+        sc_shm_output_slot(so, n % SC_SHM_OUTPUT_SLOT_COUNT);
+
+    atomic_uint_least64_t *sequence = sc_shm_counter(&slot->sequence);
+    uint64_t seq = atomic_load_explicit(sequence, memory_order_relaxed);
+    assert(!(seq & 1));
+
+    // Mark the slot as being written before modifying its content
+    atomic_store_explicit(sequence, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->frame_number = n;
+    struct frame_header *fh = &slot->frame;
+    memcpy(fh->delimiter, FRAME_DELIMITER, sizeof(FRAME_DELIMITER));
+    fh->timestamp_ms = timestamp_ms;
+    fh->width = frame->width;
+    fh->height = frame->height;
+    fh->frame_size = frame_size;
+    fh->checksum = calculate_header_checksum(fh);
+
+    int w = frame->width;
+    int h = frame->height;
+    uint8_t *data = (uint8_t *) (slot + 1);
+    sc_shm_output_copy_plane(data, frame, 0, w, h);
+    if (frame->format == AV_PIX_FMT_YUV420P) {
+        data += (size_t) w * h;
+        sc_shm_output_copy_plane(data, frame, 1, w / 2, h / 2);
+        data += (size_t) (w / 2) * (h / 2);
+        sc_shm_output_copy_plane(data, frame, 2, w / 2, h / 2);
+    }
+
+    slot->pyramid_levels = pyramid ? pyramid->levels : 0;
+    if (pyramid) {
+        // The levels follow the frame data
+        data = (uint8_t *) (slot + 1) + frame_size;
+        for (unsigned i = 1; i <= pyramid->top; ++i) {
+            if (sc_frame_pyramid_selected(pyramid, i)) {
+                const AVFrame *level = sc_frame_pyramid_level(pyramid, i);
+                sc_shm_output_copy_plane(data, level, 0, level->width,
+                                         level->height);
+                data += (size_t) level->width * level->height;
+            }
+        }
+    }
+
+    atomic_store_explicit(sequence, seq + 2, memory_order_release);
+
+    so->count = n + 1;
+    atomic_store_explicit(sc_shm_counter(&header->write_count), so->count,
+                          memory_order_release);
+
+    return true;
+}
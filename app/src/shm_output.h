@@ -0,0 +1,57 @@
+#ifndef SC_SHM_OUTPUT_H
+#define SC_SHM_OUTPUT_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/shm.h"
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+struct sc_frame_pyramid;
+
+#define SC_SHM_OUTPUT_SLOT_COUNT 4
+
+/**
+ * Shared memory ring of frames, for local consumers (--shm-output)
+ *
+ * See shm_ring.h for the layout and the synchronization protocol.
+ *
+ * The shared memory is created on the first frame, with slots large enough
+ * for frames of the same area (so that the frames still fit after a device
+ * rotation), and for their pyramid levels if pyramid_levels is not 0.
+ */
+struct sc_shm_output {
+    const char *name;
+    struct sc_shm shm;
+    bool created;
+    unsigned pyramid_levels; // bitmask of the levels (--output-pyramid)
+    uint64_t capacity; // maximum size of the frame data in a slot
+    uint64_t count; // number of frames written
+};
+
+void
+sc_shm_output_init(struct sc_shm_output *so, const char *name,
+                   unsigned pyramid_levels);
+
+void
+sc_shm_output_destroy(struct sc_shm_output *so);
+
+/**
+ * Write a YUV420P (or GRAY8, Y plane only) frame to the next slot, followed by
+ * the selected levels of its pyramid
+ *
+ * If pyramid is NULL (it could not be built), the slot contains the frame
+ * only.
+ *
+ * Return false on error (the shared memory could not be created, or the frame
+ * does not fit in a slot).
+ */
+bool
+sc_shm_output_push(struct sc_shm_output *so, const AVFrame *frame,
+                   const struct sc_frame_pyramid *pyramid,
+                   int64_t timestamp_ms);
+
+#endif
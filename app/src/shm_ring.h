@@ -0,0 +1,65 @@
+#ifndef SC_SHM_RING_H
+#define SC_SHM_RING_H
+
+// This header is self-contained (it does not include common.h), because it
+// describes the shared memory layout used by external consumers
+#include <stdint.h>
+
+#include "frame_header.h"
+
+/**
+ * Layout of the shared memory ring of frames (--shm-output)
+ *
+ * The shared memory starts with a `struct sc_shm_ring_header`, followed by
+ * `slot_count` slots of `slot_size` bytes, starting at `slot_offset`.
+ *
+ * Each slot starts with a `struct sc_shm_ring_slot`, immediately followed by
+ * the YUV420P planes, packed (the linesize is the plane width): the Y plane,
+ * then the U and V planes (both at half resolution). With --output-planes=y,
+ * only the Y plane is written (frame_size is width x height).
+ *
+ * With --output-pyramid, the frame data are followed by the selected levels
+ * of its pyramid, in increasing order, packed: `pyramid_levels` is the
+ * bitmask of the levels present in the slot (bit n for level n, 0 if none).
+ * Level n is a single plane of 2 * (eye_width_n) x (height >> n) bytes, where
+ * eye_width_0 is width / 2 and eye_width_n is eye_width_(n-1) / 2 (the eyes
+ * side by side are reduced separately, see frame_pyramid.h).
+ *
+ * The producer writes the frame number N in slot N % slot_count, then
+ * increments `write_count`. The last frame written is in slot
+ * (write_count - 1) % slot_count.
+ *
+ * Each slot is protected by a sequence lock: `sequence` is odd while the slot
+ * is being written. To read a slot without copy, a consumer must:
+ *  1. load `sequence` (acquire), and retry later if it is odd;
+ *  2. read the frame;
+ *  3. load `sequence` again (after an acquire fence): if it changed, the slot
+ *     has been overwritten meanwhile, and the frame must be discarded.
+ *
+ * All the fields are in host byte order. The 64-bit counters must be accessed
+ * atomically.
+ */
+
+#define SC_SHM_RING_MAGIC "SCSHMRNG"
+#define SC_SHM_RING_VERSION 1
+#define SC_SHM_RING_ALIGN 64
+
+struct sc_shm_ring_header {
+    char magic[8]; // SC_SHM_RING_MAGIC, written last on initialization
+    uint32_t version;
+    uint32_t slot_count;
+    uint64_t slot_size; // in bytes, including the slot header
+    uint64_t slot_offset; // offset of the first slot
+    uint64_t write_count; // number of frames written so far
+};
+
+struct sc_shm_ring_slot {
+    uint64_t sequence; // odd while the slot is being written
+    uint64_t frame_number;
+    struct frame_header frame;
+    uint32_t pyramid_levels; // levels following the frame data
+    uint8_t reserved[SC_SHM_RING_ALIGN - 2 * sizeof(uint64_t)
+                     - sizeof(struct frame_header) - sizeof(uint32_t)];
+};
+
+#endif
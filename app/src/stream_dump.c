@@ -0,0 +1,157 @@
+#include "stream_dump.h"
+
+#include <assert.h>
+#include <string.h>
+#include <libavutil/avutil.h>
+
+#include "util/log.h"
+
+bool
+sc_stream_dump_open(struct sc_stream_dump *dump, const char *filename,
+                    bool capture_timestamp, bool capture_exposure) {
+    assert(!capture_exposure || capture_timestamp);
+
+    dump->file = fopen(filename, "wb");
+    if (!dump->file) {
+        LOGE("Could not open stream dump file: %s", filename);
+        return false;
+    }
+
+    dump->capture_timestamp = capture_timestamp;
+    dump->capture_exposure = capture_exposure;
+    dump->failed = false;
+
+    uint8_t header[SC_STREAM_DUMP_HEADER_SIZE] = {0};
+    memcpy(header, SC_STREAM_DUMP_MAGIC, 4);
+    header[4] = SC_STREAM_DUMP_VERSION;
+    header[5] = capture_timestamp ? SC_STREAM_DUMP_FLAG_CAPTURE_TIMESTAMP : 0;
+    if (capture_exposure) {
+        header[5] |= SC_STREAM_DUMP_FLAG_CAPTURE_EXPOSURE;
+    }
+    sc_stream_dump_write(dump, header, sizeof(header));
+
+    return true;
+}
+
+void
+sc_stream_dump_close(struct sc_stream_dump *dump) {
+    if (fclose(dump->file) && !dump->failed) {
+        LOGE("Could not write stream dump file");
+    }
+}
+
+void
+sc_stream_dump_write(struct sc_stream_dump *dump, const void *data,
+                     size_t len) {
+    if (dump->failed) {
+        return;
+    }
+
+    if (fwrite(data, 1, len, dump->file) != len) {
+        LOGE("Could not write stream dump file, disabling the dump");
+        dump->failed = true;
+    }
+}
+
+bool
+sc_stream_replay_open(struct sc_stream_replay *replay, const char *filename,
+                      bool realtime) {
+    replay->file = fopen(filename, "rb");
+    if (!replay->file) {
+        LOGE("Could not open stream dump file: %s", filename);
+        return false;
+    }
+
+    uint8_t header[SC_STREAM_DUMP_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), replay->file) != sizeof(header)
+            || memcmp(header, SC_STREAM_DUMP_MAGIC, 4)) {
+        LOGE("Not a stream dump file: %s", filename);
+        goto error_close_file;
+    }
+
+    if (header[4] != SC_STREAM_DUMP_VERSION) {
+        LOGE("Unsupported stream dump version: %u", (unsigned) header[4]);
+        goto error_close_file;
+    }
+
+    if (!sc_mutex_init(&replay->mutex)) {
+        goto error_close_file;
+    }
+
+    if (!sc_cond_init(&replay->cond)) {
+        goto error_destroy_mutex;
+    }
+
+    replay->capture_timestamp =
+        header[5] & SC_STREAM_DUMP_FLAG_CAPTURE_TIMESTAMP;
+    replay->capture_exposure =
+        replay->capture_timestamp
+            && (header[5] & SC_STREAM_DUMP_FLAG_CAPTURE_EXPOSURE);
+    replay->realtime = realtime;
+    replay->start = 0;
+    replay->first_pts = -1;
+    replay->interrupted = false;
+
+    return true;
+
+error_destroy_mutex:
+    sc_mutex_destroy(&replay->mutex);
+error_close_file:
+    fclose(replay->file);
+
+    return false;
+}
+
+void
+sc_stream_replay_close(struct sc_stream_replay *replay) {
+    sc_cond_destroy(&replay->cond);
+    sc_mutex_destroy(&replay->mutex);
+    fclose(replay->file);
+}
+
+ssize_t
+sc_stream_replay_read(struct sc_stream_replay *replay, void *dst, size_t len) {
+    sc_mutex_lock(&replay->mutex);
+    bool interrupted = replay->interrupted;
+    sc_mutex_unlock(&replay->mutex);
+    if (interrupted) {
+        return -1;
+    }
+
+    return fread(dst, 1, len, replay->file);
+}
+
+bool
+sc_stream_replay_wait(struct sc_stream_replay *replay, int64_t pts) {
+    if (!replay->realtime || pts == AV_NOPTS_VALUE) {
+        return true;
+    }
+
+    if (replay->first_pts == -1) {
+        replay->first_pts = pts;
+        replay->start = sc_tick_now();
+        return true;
+    }
+
+    // PTS are in microseconds
+    sc_tick deadline = replay->start + SC_TICK_FROM_US(pts - replay->first_pts);
+
+    sc_mutex_lock(&replay->mutex);
+    bool timed_out = false;
+    while (!replay->interrupted && !timed_out) {
+        timed_out = !sc_cond_timedwait(&replay->cond, &replay->mutex,
+                                       deadline);
+    }
+    bool interrupted = replay->interrupted;
+    sc_mutex_unlock(&replay->mutex);
+
+    return !interrupted;
+}
+
+void
+sc_stream_replay_interrupt(struct sc_stream_replay *replay) {
+    sc_mutex_lock(&replay->mutex);
+    replay->interrupted = true;
+    sc_cond_signal(&replay->cond);
+    sc_mutex_unlock(&replay->mutex);
+}
@@ -0,0 +1,117 @@
+#ifndef SC_STREAM_DUMP_H
+#define SC_STREAM_DUMP_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "util/thread.h"
+#include "util/tick.h"
+
+#define SC_STREAM_DUMP_MAGIC "SCRS"
+#define SC_STREAM_DUMP_VERSION 1
+#define SC_STREAM_DUMP_HEADER_SIZE 8
+
+// The packet headers contain the capture timestamp (21 bytes instead of 12)
+#define SC_STREAM_DUMP_FLAG_CAPTURE_TIMESTAMP 1
+// They also contain the exposure (29 bytes, requires the capture timestamp)
+#define SC_STREAM_DUMP_FLAG_CAPTURE_EXPOSURE 2
+
+/**
+ * Dump of the raw video stream received from the device (--dump-stream), to
+ * be replayed offline (--replay).
+ *
+ * The file starts with an 8-byte header:
+ *
+ * [S C R S|V|F|0 0]
+ *  <-----> - - <->
+ *   magic  | |  reserved
+ *          | `- flags (SC_STREAM_DUMP_FLAG_*)
+ *          `--- version (SC_STREAM_DUMP_VERSION)
+ *
+ * It is followed by the video stream exactly as sent on the video socket (see
+ * sc_demuxer_recv_packet()): the codec id, the initial video size, then the
+ * packets, each prefixed with its "meta" header. The packets received over
+ * RTP are written with the same header, so that a dump never depends on the
+ * transport.
+ */
+struct sc_stream_dump {
+    FILE *file;
+    bool capture_timestamp;
+    bool capture_exposure;
+    bool failed; // on write error, the dump is disabled
+};
+
+bool
+sc_stream_dump_open(struct sc_stream_dump *dump, const char *filename,
+                    bool capture_timestamp, bool capture_exposure);
+
+void
+sc_stream_dump_close(struct sc_stream_dump *dump);
+
+/**
+ * Append raw stream data
+ *
+ * On error, the dump is disabled (the stream is not interrupted).
+ */
+void
+sc_stream_dump_write(struct sc_stream_dump *dump, const void *data,
+                     size_t len);
+
+/**
+ * Reader of a stream dump, replacing the video socket (--replay)
+ *
+ * If realtime is set, the packets are delivered at the pace of their PTS,
+ * otherwise as fast as the pipeline consumes them.
+ */
+struct sc_stream_replay {
+    FILE *file;
+    bool capture_timestamp;
+    bool capture_exposure;
+    bool realtime;
+
+    // Only accessed from the demuxer thread
+    sc_tick start; // time of the first packet
+    int64_t first_pts; // -1 before the first packet
+
+    sc_mutex mutex;
+    sc_cond cond;
+    bool interrupted;
+};
+
+bool
+sc_stream_replay_open(struct sc_stream_replay *replay, const char *filename,
+                      bool realtime);
+
+void
+sc_stream_replay_close(struct sc_stream_replay *replay);
+
+/**
+ * Read exactly len bytes (like sc_net_reader_read_all())
+ *
+ * Return the number of bytes read, which is less than len on end of file,
+ * error or interruption.
+ */
+ssize_t
+sc_stream_replay_read(struct sc_stream_replay *replay, void *dst, size_t len);
+
+/**
+ * Wait until the packet with the given PTS (in microseconds) must be
+ * delivered, if realtime is set
+ *
+ * Return false if interrupted.
+ */
+bool
+sc_stream_replay_wait(struct sc_stream_replay *replay, int64_t pts);
+
+/**
+ * Interrupt the reads and waits, from another thread
+ */
+void
+sc_stream_replay_interrupt(struct sc_stream_replay *replay);
+
+#endif
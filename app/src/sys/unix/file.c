@@ -1,13 +1,18 @@
 #include "util/file.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "util/log.h"
+#include "util/str.h"
 
 bool
 sc_file_executable_exists(const char *file) {
@@ -68,6 +73,23 @@ sc_file_get_executable_path(void) {
 #endif
 }
 
+char *
+sc_file_get_temp_path(const char *name) {
+    const char *dir = getenv("TMPDIR");
+    if (!dir || !*dir) {
+        dir = "/tmp";
+    }
+
+    char *path;
+    int r = asprintf(&path, "%s/%s", dir, name);
+    if (r == -1) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    return path;
+}
+
 bool
 sc_file_is_regular(const char *path) {
     struct stat path_stat;
@@ -79,3 +101,237 @@ sc_file_is_regular(const char *path) {
     return S_ISREG(path_stat.st_mode);
 }
 
+
+bool
+sc_file_map(const char *path, struct sc_file_mapping *mapping) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) || !S_ISREG(sb.st_mode) || !sb.st_size) {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping remains valid after the file descriptor is closed
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return false;
+    }
+
+    mapping->data = data;
+    mapping->size = sb.st_size;
+    return true;
+}
+
+void
+sc_file_unmap(struct sc_file_mapping *mapping) {
+    munmap((void *) mapping->data, mapping->size);
+}
+
+static int sc_file_output_fd = STDOUT_FILENO;
+
+static void
+sc_file_enlarge_pipe(int fd, uint32_t buffer_size) {
+#ifdef F_SETPIPE_SZ
+    struct stat sb;
+    if (fstat(fd, &sb) || !S_ISFIFO(sb.st_mode)) {
+        return;
+    }
+
+    // Without CAP_SYS_RESOURCE, the size is limited by
+    // /proc/sys/fs/pipe-max-size (1 MiB by default)
+    for (int size = buffer_size; size > 0x10000; size /= 2) {
+        if (fcntl(fd, F_SETPIPE_SZ, size) != -1) {
+            LOGD("Pipe output buffer: %d bytes", size);
+            return;
+        }
+    }
+    LOGW("Could not enlarge the pipe output buffer");
+#else
+    (void) fd;
+    (void) buffer_size;
+#endif
+}
+
+bool
+sc_file_open_output(const char *target, uint32_t buffer_size) {
+    int fd;
+    if (!strncmp(target, "fd:", 3)) {
+        long value;
+        if (!sc_str_parse_integer(target + 3, &value) || value < 0
+                || value > INT_MAX) {
+            LOGE("Invalid pipe output file descriptor: %s", target + 3);
+            return false;
+        }
+        fd = value;
+        if (fcntl(fd, F_GETFD) == -1) {
+            LOGE("Pipe output file descriptor %d is not open", fd);
+            return false;
+        }
+    } else {
+        fd = open(target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (fd == -1) {
+            LOGE("Could not open pipe output %s: %s", target,
+                 strerror(errno));
+            return false;
+        }
+    }
+
+    sc_file_enlarge_pipe(fd, buffer_size ? buffer_size
+                                         : SC_FILE_OUTPUT_PIPE_SIZE);
+    sc_file_output_fd = fd;
+    return true;
+}
+
+bool
+sc_file_write_output(const struct sc_file_chunk *chunks, size_t count) {
+    struct iovec iov[64];
+
+    size_t i = 0;
+    size_t offset = 0; // offset in chunks[i], in case of partial write
+    while (i < count) {
+        // Gather as many chunks as possible in a single writev() call
+        int iovcnt = 0;
+        for (size_t j = i; j < count && iovcnt < (int) ARRAY_LEN(iov); ++j) {
+            size_t skip = j == i ? offset : 0;
+            iov[iovcnt].iov_base = (char *) chunks[j].data + skip;
+            iov[iovcnt].iov_len = chunks[j].size - skip;
+            ++iovcnt;
+        }
+
+        ssize_t w = writev(sc_file_output_fd, iov, iovcnt);
+        if (w == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EPIPE) {
+                // SIGPIPE is ignored (see main.c)
+                LOGW("The pipe output reader has exited");
+            }
+            return false;
+        }
+
+        // Advance past the written bytes
+        size_t written = w;
+        while (i < count && written >= chunks[i].size - offset) {
+            written -= chunks[i].size - offset;
+            offset = 0;
+            ++i;
+        }
+        offset += written;
+    }
+
+    return true;
+}
+
+bool
+sc_file_close_output(void) {
+    // The writes are synchronous, there is nothing to wait for
+    if (sc_file_output_fd == STDOUT_FILENO) {
+        return true;
+    }
+
+    bool ok = !close(sc_file_output_fd);
+    sc_file_output_fd = STDOUT_FILENO;
+    return ok;
+}
+
+int
+sc_file_open_write(const char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        LOGE("Could not open %s: %s", path, strerror(errno));
+    }
+    return fd;
+}
+
+int
+sc_file_open_direct(const char *path) {
+#if defined(__linux__)
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT,
+                  0644);
+    if (fd == -1) {
+        // EINVAL if the file system does not support O_DIRECT
+        LOGW("Could not open %s for direct I/O: %s", path, strerror(errno));
+    }
+    return fd;
+#elif defined(__APPLE__)
+    int fd = sc_file_open_write(path);
+    if (fd == -1) {
+        return -1;
+    }
+    if (fcntl(fd, F_NOCACHE, 1) == -1) {
+        LOGW("Could not disable the cache of %s: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    (void) path;
+    LOGW("Direct I/O not supported on this platform");
+    return -1;
+#endif
+}
+
+bool
+sc_file_write_at(int fd, const void *data, size_t size, int64_t offset) {
+    const char *p = data;
+    while (size) {
+        ssize_t w = pwrite(fd, p, size, offset);
+        if (w == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOGE("Could not write to file: %s", strerror(errno));
+            return false;
+        }
+        p += w;
+        size -= w;
+        offset += w;
+    }
+
+    return true;
+}
+
+bool
+sc_file_preallocate(int fd, int64_t size) {
+#ifdef __linux__
+    // Unsupported on some file systems (EOPNOTSUPP), e.g. network shares
+    return !fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, size);
+#else
+    (void) fd;
+    (void) size;
+    return false;
+#endif
+}
+
+bool
+sc_file_extend_uninitialized(int fd, int64_t size) {
+    // The preallocated extents are already marked as unwritten (read as
+    // zeros without being written)
+    (void) fd;
+    (void) size;
+    return false;
+}
+
+bool
+sc_file_truncate(int fd, int64_t size) {
+    if (ftruncate(fd, size)) {
+        LOGW("Could not truncate file: %s", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_file_close(int fd) {
+    if (close(fd)) {
+        LOGW("Could not close file: %s", strerror(errno));
+    }
+}
@@ -0,0 +1,67 @@
+#include "util/pages.h"
+
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static size_t
+align_up(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+static void *
+map_pages(size_t size, int flags) {
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    return data == MAP_FAILED ? NULL : data;
+}
+
+bool
+sc_pages_alloc(struct sc_pages *pages, size_t size, bool huge, bool lock) {
+    int flags = 0;
+#ifdef MAP_POPULATE
+    if (lock) {
+        // Fault the pages in now rather than on first access
+        flags |= MAP_POPULATE;
+    }
+#endif
+
+    void *data = NULL;
+    size_t mapped_size = 0;
+#ifdef MAP_HUGETLB
+    if (huge) {
+        // Fails if not enough huge pages are reserved (vm.nr_hugepages)
+        mapped_size = align_up(size, SC_HUGE_PAGE_SIZE);
+        data = map_pages(mapped_size, flags | MAP_HUGETLB);
+    }
+#endif
+    pages->huge = data != NULL;
+
+    if (!data) {
+        mapped_size = align_up(size, sysconf(_SC_PAGESIZE));
+        data = map_pages(mapped_size, flags);
+        if (!data) {
+            perror("mmap");
+            return false;
+        }
+#ifdef MADV_HUGEPAGE
+        if (huge) {
+            // Transparent huge pages, if enabled in "madvise" mode
+            madvise(data, mapped_size, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+    // Best effort, limited by RLIMIT_MEMLOCK without CAP_IPC_LOCK
+    pages->locked = lock && !mlock(data, mapped_size);
+
+    pages->data = data;
+    pages->size = mapped_size;
+    return true;
+}
+
+void
+sc_pages_free(struct sc_pages *pages) {
+    // Unmapping also unlocks the pages
+    munmap(pages->data, pages->size);
+}
@@ -0,0 +1,132 @@
+#include "util/shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "util/log.h"
+
+static char *
+sc_shm_get_path(const char *name) {
+    size_t len = strlen(name);
+    char *path = malloc(len + 2);
+    if (!path) {
+        LOG_OOM();
+        return NULL;
+    }
+    path[0] = '/';
+    memcpy(path + 1, name, len + 1);
+    return path;
+}
+
+bool
+sc_shm_create(struct sc_shm *shm, const char *name, size_t size) {
+    char *path = sc_shm_get_path(name);
+    if (!path) {
+        return false;
+    }
+
+    // Replace any stale object, so that it has the expected size
+    shm_unlink(path);
+
+    int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd == -1) {
+        perror("shm_open");
+        free(path);
+        return false;
+    }
+
+    if (ftruncate(fd, size)) {
+        perror("ftruncate");
+        goto error;
+    }
+
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        goto error;
+    }
+
+    // The mapping remains valid after the file descriptor is closed
+    close(fd);
+
+    shm->data = data;
+    shm->size = size;
+    shm->name = path;
+    return true;
+
+error:
+    close(fd);
+    shm_unlink(path);
+    free(path);
+    return false;
+}
+
+void
+sc_shm_destroy(struct sc_shm *shm) {
+    munmap(shm->data, shm->size);
+    shm_unlink(shm->name);
+    free(shm->name);
+}
+
+bool
+sc_shm_open(struct sc_shm *shm, const char *name) {
+    char *path = sc_shm_get_path(name);
+    if (!path) {
+        return false;
+    }
+
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            perror("shm_open");
+        }
+        free(path);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st)) {
+        perror("fstat");
+        goto error;
+    }
+
+    if (st.st_uid != geteuid()) {
+        // Another user could provide any data
+        LOGW("Shared memory %s is owned by another user, ignored", name);
+        goto error;
+    }
+
+    if (!st.st_size) {
+        goto error;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        goto error;
+    }
+
+    close(fd);
+
+    shm->data = data;
+    shm->size = st.st_size;
+    shm->name = path;
+    return true;
+
+error:
+    close(fd);
+    free(path);
+    return false;
+}
+
+void
+sc_shm_close(struct sc_shm *shm) {
+    munmap(shm->data, shm->size);
+    free(shm->name);
+}
@@ -2,6 +2,12 @@
 
 #include <windows.h>
 
+#include <fcntl.h>
+#include <io.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 
 #include "util/log.h"
@@ -22,6 +28,32 @@ sc_file_get_executable_path(void) {
     return sc_str_from_wchars(buf);
 }
 
+char *
+sc_file_get_temp_path(const char *name) {
+    WCHAR buf[MAX_PATH + 1]; // +1 for the null byte
+    DWORD len = GetTempPathW(MAX_PATH + 1, buf);
+    if (!len || len > MAX_PATH) {
+        return NULL;
+    }
+
+    // The directory already ends with a backslash
+    char *dir = sc_str_from_wchars(buf);
+    if (!dir) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    char *path;
+    int r = asprintf(&path, "%s%s", dir, name);
+    free(dir);
+    if (r == -1) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    return path;
+}
+
 bool
 sc_file_is_regular(const char *path) {
     wchar_t *wide_path = sc_str_to_wchars(path);
@@ -41,3 +73,534 @@ sc_file_is_regular(const char *path) {
     return S_ISREG(path_stat.st_mode);
 }
 
+
+bool
+sc_file_map(const char *path, struct sc_file_mapping *mapping) {
+    wchar_t *wide_path = sc_str_to_wchars(path);
+    if (!wide_path) {
+        LOG_OOM();
+        return false;
+    }
+
+    HANDLE file = CreateFileW(wide_path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    free(wide_path);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || !size.QuadPart) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE handle = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    // The mapping object keeps a reference to the file
+    CloseHandle(file);
+    if (!handle) {
+        sc_log_windows_error("Could not create file mapping", GetLastError());
+        return false;
+    }
+
+    void *data = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        sc_log_windows_error("Could not map file", GetLastError());
+        CloseHandle(handle);
+        return false;
+    }
+
+    mapping->data = data;
+    mapping->size = size.QuadPart;
+    mapping->handle = handle;
+    return true;
+}
+
+void
+sc_file_unmap(struct sc_file_mapping *mapping) {
+    UnmapViewOfFile(mapping->data);
+    CloseHandle(mapping->handle);
+}
+
+// Size of the buffer to coalesce small writes on stdout
+#define SC_FILE_COALESCE_SIZE 0x10000
+
+// Log the error of a write to the pipe output
+static void
+sc_file_log_write_error(DWORD err) {
+    if (err == ERROR_BROKEN_PIPE || err == ERROR_NO_DATA) {
+        // The equivalent of EPIPE: the output is disabled, without a crash
+        LOGW("The pipe output reader has exited");
+    } else {
+        sc_log_windows_error("Could not write to the pipe output", err);
+    }
+}
+
+static bool
+sc_file_write_handle(HANDLE handle, const void *data, size_t size) {
+    const char *p = data;
+    while (size) {
+        DWORD len = size > 0x40000000 ? 0x40000000 : (DWORD) size;
+        DWORD written;
+        if (!WriteFile(handle, p, len, &written, NULL)) {
+            sc_file_log_write_error(GetLastError());
+            return false;
+        }
+        p += written;
+        size -= written;
+    }
+    return true;
+}
+
+// NULL for stdout
+static HANDLE sc_file_output_handle;
+
+// An overlapped write in flight (or completed, but not collected yet)
+struct sc_file_pending_write {
+    OVERLAPPED overlapped;
+    char *buf; // copy of the chunks, which must live until the completion
+    size_t capacity;
+    DWORD len;
+    bool pending;
+};
+
+// Set if sc_file_output_handle is a named pipe created by scrcpy, opened for
+// overlapped I/O
+static bool sc_file_output_overlapped;
+static struct sc_file_pending_write
+    sc_file_pending_writes[SC_FILE_OUTPUT_MAX_PENDING];
+static unsigned sc_file_pending_head; // next slot to use
+static bool sc_file_output_failed;
+// Set if sc_file_output_handle was opened by scrcpy (not inherited)
+static bool sc_file_output_owned;
+
+// On close, do not wait forever for a client which does not read anymore
+#define SC_FILE_OUTPUT_CLOSE_TIMEOUT_MS 2000
+
+static HANDLE
+sc_file_create_pipe(const wchar_t *name, uint32_t buffer_size) {
+    // The buffer sizes are only advisory, but a large outbound buffer lets
+    // WriteFile() complete before the client has read the data
+    HANDLE handle = CreateNamedPipeW(name,
+                                     PIPE_ACCESS_OUTBOUND
+                                         | FILE_FLAG_OVERLAPPED,
+                                     PIPE_TYPE_BYTE | PIPE_WAIT, 1,
+                                     buffer_size, 0, 0, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        sc_log_windows_error("Could not create named pipe", GetLastError());
+        return NULL;
+    }
+
+    OVERLAPPED overlapped = {0};
+    overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (!overlapped.hEvent) {
+        sc_log_windows_error("Could not create event", GetLastError());
+        CloseHandle(handle);
+        return NULL;
+    }
+
+    LOGI("Waiting for a client on the pipe output...");
+    bool ok = ConnectNamedPipe(handle, &overlapped);
+    if (!ok) {
+        DWORD err = GetLastError();
+        if (err == ERROR_IO_PENDING) {
+            DWORD unused;
+            ok = GetOverlappedResult(handle, &overlapped, &unused, TRUE);
+        } else {
+            ok = err == ERROR_PIPE_CONNECTED;
+        }
+    }
+    CloseHandle(overlapped.hEvent);
+
+    if (!ok) {
+        sc_log_windows_error("Could not connect named pipe", GetLastError());
+        CloseHandle(handle);
+        return NULL;
+    }
+
+    for (unsigned i = 0; i < SC_FILE_OUTPUT_MAX_PENDING; ++i) {
+        struct sc_file_pending_write *w = &sc_file_pending_writes[i];
+        w->overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        if (!w->overlapped.hEvent) {
+            sc_log_windows_error("Could not create event", GetLastError());
+            while (i--) {
+                CloseHandle(sc_file_pending_writes[i].overlapped.hEvent);
+            }
+            CloseHandle(handle);
+            return NULL;
+        }
+    }
+
+    sc_file_output_overlapped = true;
+    return handle;
+}
+
+bool
+sc_file_open_output(const char *target, uint32_t buffer_size) {
+    if (!buffer_size) {
+        buffer_size = SC_FILE_OUTPUT_PIPE_SIZE;
+    }
+
+    HANDLE handle;
+    if (!strncmp(target, "fd:", 3)) {
+        long value;
+        if (!sc_str_parse_integer(target + 3, &value) || value < 0
+                || value > INT_MAX) {
+            LOGE("Invalid pipe output file descriptor: %s", target + 3);
+            return false;
+        }
+        handle = (HANDLE) _get_osfhandle((int) value);
+        if (handle == INVALID_HANDLE_VALUE) {
+            LOGE("Pipe output file descriptor %ld is not open", value);
+            return false;
+        }
+        // WriteFile() has no text mode: the output is always binary
+    } else {
+        wchar_t *wide = sc_str_to_wchars(target);
+        if (!wide) {
+            LOG_OOM();
+            return false;
+        }
+
+        if (!strncmp(target, "\\\\.\\pipe\\", 9)) {
+            handle = sc_file_create_pipe(wide, buffer_size);
+        } else {
+            handle = CreateFileW(wide, GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                                 CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (handle == INVALID_HANDLE_VALUE) {
+                sc_log_windows_error("Could not open pipe output",
+                                     GetLastError());
+                handle = NULL;
+            }
+        }
+        free(wide);
+
+        if (!handle) {
+            return false;
+        }
+        sc_file_output_owned = true;
+    }
+
+    sc_file_output_handle = handle;
+    return true;
+}
+
+// Wait for the completion of a write in flight, if any, for at most
+// `timeout_ms` (then the write is cancelled)
+static bool
+sc_file_collect_write(struct sc_file_pending_write *w, DWORD timeout_ms) {
+    if (!w->pending) {
+        return true;
+    }
+
+    w->pending = false;
+    if (WaitForSingleObject(w->overlapped.hEvent, timeout_ms)
+            == WAIT_TIMEOUT) {
+        CancelIoEx(sc_file_output_handle, &w->overlapped);
+    }
+    DWORD written;
+    if (!GetOverlappedResult(sc_file_output_handle, &w->overlapped, &written,
+                             TRUE) || written != w->len) {
+        if (!sc_file_output_failed) {
+            sc_file_log_write_error(GetLastError());
+        }
+        sc_file_output_failed = true;
+        return false;
+    }
+    return true;
+}
+
+// Copy the chunks and write them asynchronously, in a single WriteFile()
+static bool
+sc_file_write_overlapped(const struct sc_file_chunk *chunks, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        total += chunks[i].size;
+    }
+    if (total > MAXDWORD) {
+        LOGE("Record too large for the pipe output");
+        return false;
+    }
+
+    // Reuse the oldest slot once its write is complete: the writes are
+    // issued (and completed) in order
+    struct sc_file_pending_write *w =
+        &sc_file_pending_writes[sc_file_pending_head];
+    if (!sc_file_collect_write(w, INFINITE) || sc_file_output_failed) {
+        return false;
+    }
+
+    if (total > w->capacity) {
+        char *buf = realloc(w->buf, total);
+        if (!buf) {
+            LOG_OOM();
+            return false;
+        }
+        w->buf = buf;
+        w->capacity = total;
+    }
+
+    char *p = w->buf;
+    for (size_t i = 0; i < count; ++i) {
+        memcpy(p, chunks[i].data, chunks[i].size);
+        p += chunks[i].size;
+    }
+
+    HANDLE event = w->overlapped.hEvent;
+    w->overlapped = (OVERLAPPED) {.hEvent = event};
+    w->len = total;
+    if (!WriteFile(sc_file_output_handle, w->buf, w->len, NULL,
+                   &w->overlapped) && GetLastError() != ERROR_IO_PENDING) {
+        sc_file_log_write_error(GetLastError());
+        sc_file_output_failed = true;
+        return false;
+    }
+
+    // Even if the write completed immediately, its result is collected later
+    w->pending = true;
+    sc_file_pending_head =
+        (sc_file_pending_head + 1) % SC_FILE_OUTPUT_MAX_PENDING;
+    return true;
+}
+
+bool
+sc_file_write_output(const struct sc_file_chunk *chunks, size_t count) {
+    if (sc_file_output_overlapped) {
+        return sc_file_write_overlapped(chunks, count);
+    }
+
+    HANDLE handle = sc_file_output_handle;
+    if (!handle) {
+        handle = GetStdHandle(STD_OUTPUT_HANDLE);
+        if (handle == INVALID_HANDLE_VALUE || !handle) {
+            return false;
+        }
+    }
+
+    // There is no gather write for pipes: write the large chunks directly,
+    // and coalesce the small ones to limit the number of system calls
+    char *buf = NULL;
+    size_t len = 0;
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < count; ++i) {
+        const struct sc_file_chunk *chunk = &chunks[i];
+        if (chunk->size >= SC_FILE_COALESCE_SIZE / 4) {
+            if (len) {
+                ok = sc_file_write_handle(handle, buf, len);
+                len = 0;
+            }
+            ok = ok && sc_file_write_handle(handle, chunk->data, chunk->size);
+            continue;
+        }
+
+        if (!buf) {
+            buf = malloc(SC_FILE_COALESCE_SIZE);
+            if (!buf) {
+                LOG_OOM();
+                return false;
+            }
+        }
+
+        if (len + chunk->size > SC_FILE_COALESCE_SIZE) {
+            ok = sc_file_write_handle(handle, buf, len);
+            len = 0;
+        }
+        memcpy(buf + len, chunk->data, chunk->size);
+        len += chunk->size;
+    }
+
+    if (ok && len) {
+        ok = sc_file_write_handle(handle, buf, len);
+    }
+
+    free(buf);
+    return ok;
+}
+
+bool
+sc_file_close_output(void) {
+    if (!sc_file_output_handle) {
+        // stdout
+        return true;
+    }
+
+    bool ok = true;
+    if (sc_file_output_overlapped) {
+        // Collect the writes in flight in order (the oldest one is at the
+        // head)
+        for (unsigned i = 0; i < SC_FILE_OUTPUT_MAX_PENDING; ++i) {
+            unsigned index =
+                (sc_file_pending_head + i) % SC_FILE_OUTPUT_MAX_PENDING;
+            struct sc_file_pending_write *w = &sc_file_pending_writes[index];
+            ok &= sc_file_collect_write(w, SC_FILE_OUTPUT_CLOSE_TIMEOUT_MS);
+            CloseHandle(w->overlapped.hEvent);
+            free(w->buf);
+            *w = (struct sc_file_pending_write) {0};
+        }
+        ok &= !sc_file_output_failed;
+        sc_file_output_overlapped = false;
+    }
+
+    // The data written remain readable by the client after the pipe is
+    // closed (they would be discarded by DisconnectNamedPipe())
+    if (sc_file_output_owned) {
+        ok &= CloseHandle(sc_file_output_handle);
+    }
+    sc_file_output_handle = NULL;
+    return ok;
+}
+
+int
+sc_file_open_write(const char *path) {
+    wchar_t *wide_path = sc_str_to_wchars(path);
+    if (!wide_path) {
+        LOG_OOM();
+        return -1;
+    }
+
+    int fd = _wopen(wide_path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY
+                               | _O_NOINHERIT, _S_IREAD | _S_IWRITE);
+    free(wide_path);
+    if (fd == -1) {
+        LOGE("Could not open %s", path);
+    }
+    return fd;
+}
+
+int
+sc_file_open_direct(const char *path) {
+    wchar_t *wide_path = sc_str_to_wchars(path);
+    if (!wide_path) {
+        LOG_OOM();
+        return -1;
+    }
+
+    // The file may also be open by another (buffered) handle
+    HANDLE handle = CreateFileW(wide_path, GENERIC_WRITE,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                CREATE_ALWAYS,
+                                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING
+                                    | FILE_FLAG_WRITE_THROUGH,
+                                NULL);
+    free(wide_path);
+    if (handle == INVALID_HANDLE_VALUE) {
+        LOGW("Could not open %s for direct I/O", path);
+        return -1;
+    }
+
+    int fd = _open_osfhandle((intptr_t) handle, _O_WRONLY | _O_BINARY);
+    if (fd == -1) {
+        LOGE("Could not open %s", path);
+        CloseHandle(handle);
+    }
+    return fd;
+}
+
+bool
+sc_file_write_at(int fd, const void *data, size_t size, int64_t offset) {
+    HANDLE handle = (HANDLE) _get_osfhandle(fd);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    const char *p = data;
+    while (size) {
+        // An explicit offset does not depend on the (shared) file position,
+        // and a multiple of the sector size keeps the unbuffered writes valid
+        DWORD chunk = MIN(size, 1 << 30);
+        OVERLAPPED ov = {
+            .Offset = (DWORD) offset,
+            .OffsetHigh = (DWORD) ((uint64_t) offset >> 32),
+        };
+        DWORD w;
+        if (!WriteFile(handle, p, chunk, &w, &ov)) {
+            LOGE("Could not write to file");
+            return false;
+        }
+        p += w;
+        size -= w;
+        offset += w;
+    }
+
+    return true;
+}
+
+bool
+sc_file_preallocate(int fd, int64_t size) {
+    HANDLE handle = (HANDLE) _get_osfhandle(fd);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = size;
+    return SetFileInformationByHandle(handle, FileAllocationInfo, &info,
+                                      sizeof(info));
+}
+
+static bool
+sc_file_enable_manage_volume(void) {
+    static int enabled = -1; // unknown
+
+    if (enabled == -1) {
+        enabled = 0;
+
+        HANDLE token;
+        if (!OpenProcessToken(GetCurrentProcess(),
+                              TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+            return false;
+        }
+
+        TOKEN_PRIVILEGES tp = {
+            .PrivilegeCount = 1,
+        };
+        tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        if (LookupPrivilegeValueW(NULL, SE_MANAGE_VOLUME_NAME,
+                                  &tp.Privileges[0].Luid)
+                && AdjustTokenPrivileges(token, FALSE, &tp, 0, NULL, NULL)
+                // Succeeds even if the privilege is not held
+                && GetLastError() == ERROR_SUCCESS) {
+            enabled = 1;
+        }
+        CloseHandle(token);
+    }
+
+    return enabled;
+}
+
+bool
+sc_file_extend_uninitialized(int fd, int64_t size) {
+    HANDLE handle = (HANDLE) _get_osfhandle(fd);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    if (!sc_file_enable_manage_volume()) {
+        LOGD("SE_MANAGE_VOLUME_NAME privilege not held");
+        return false;
+    }
+
+    FILE_END_OF_FILE_INFO info;
+    info.EndOfFile.QuadPart = size;
+    return SetFileInformationByHandle(handle, FileEndOfFileInfo, &info,
+                                      sizeof(info))
+        && SetFileValidData(handle, size);
+}
+
+bool
+sc_file_truncate(int fd, int64_t size) {
+    if (_chsize_s(fd, size)) {
+        LOGW("Could not truncate file");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_file_close(int fd) {
+    if (_close(fd)) {
+        LOGW("Could not close file");
+    }
+}
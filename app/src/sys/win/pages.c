@@ -0,0 +1,95 @@
+#include "util/pages.h"
+
+#include <windows.h>
+
+#include <stdatomic.h>
+
+#include "util/log.h"
+
+static size_t
+align_up(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+// The large pages require the SeLockMemoryPrivilege to be enabled in the
+// process token (it must have been granted to the user)
+static bool
+enable_lock_memory_privilege(void) {
+    // 0: not attempted yet, 1: enabled, -1: not available
+    // (enabling it concurrently from several threads is harmless)
+    static atomic_int state;
+    int s = atomic_load(&state);
+    if (s) {
+        return s > 0;
+    }
+
+    bool ok = false;
+    HANDLE token;
+    if (OpenProcessToken(GetCurrentProcess(),
+                         TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+        TOKEN_PRIVILEGES tp;
+        tp.PrivilegeCount = 1;
+        tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        if (LookupPrivilegeValueW(NULL, L"SeLockMemoryPrivilege",
+                                  &tp.Privileges[0].Luid)) {
+            // Succeeds even if the privilege is not granted
+            ok = AdjustTokenPrivileges(token, FALSE, &tp, 0, NULL, NULL)
+              && GetLastError() == ERROR_SUCCESS;
+        }
+        CloseHandle(token);
+    }
+
+    if (!ok) {
+        LOGD("SeLockMemoryPrivilege not available");
+    }
+
+    atomic_store(&state, ok ? 1 : -1);
+    return ok;
+}
+
+bool
+sc_pages_alloc(struct sc_pages *pages, size_t size, bool huge, bool lock) {
+    void *data = NULL;
+    size_t mapped_size = 0;
+
+    if (huge) {
+        size_t large_page_size = GetLargePageMinimum();
+        if (large_page_size && enable_lock_memory_privilege()) {
+            mapped_size = align_up(size, large_page_size);
+            // The large pages are never paged out
+            data = VirtualAlloc(NULL, mapped_size,
+                                MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                                PAGE_READWRITE);
+        }
+    }
+
+    if (data) {
+        pages->huge = true;
+        pages->locked = true;
+    } else {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        mapped_size = align_up(size, info.dwPageSize);
+        data = VirtualAlloc(NULL, mapped_size, MEM_RESERVE | MEM_COMMIT,
+                            PAGE_READWRITE);
+        if (!data) {
+            sc_log_windows_error("Could not allocate memory",
+                                 GetLastError());
+            return false;
+        }
+
+        pages->huge = false;
+        // Best effort, limited by the minimum working set size of the process
+        pages->locked = lock && VirtualLock(data, mapped_size);
+    }
+
+    pages->data = data;
+    pages->size = mapped_size;
+    return true;
+}
+
+void
+sc_pages_free(struct sc_pages *pages) {
+    // Releasing also unlocks the pages
+    VirtualFree(pages->data, 0, MEM_RELEASE);
+}
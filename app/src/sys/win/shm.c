@@ -0,0 +1,120 @@
+#include "util/shm.h"
+
+#include <windows.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util/log.h"
+#include "util/str.h"
+
+bool
+sc_shm_create(struct sc_shm *shm, const char *name, size_t size) {
+    char *path;
+    int r = asprintf(&path, "Local\\%s", name);
+    if (r == -1) {
+        LOG_OOM();
+        return false;
+    }
+
+    wchar_t *wide_path = sc_str_to_wchars(path);
+    free(path);
+    if (!wide_path) {
+        LOG_OOM();
+        return false;
+    }
+
+    uint64_t size64 = size;
+    // Backed by the paging file, zero-initialized
+    HANDLE handle = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL,
+                                       PAGE_READWRITE, size64 >> 32,
+                                       size64 & 0xFFFFFFFF, wide_path);
+    free(wide_path);
+    if (!handle) {
+        sc_log_windows_error("Could not create shared memory",
+                             GetLastError());
+        return false;
+    }
+
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        // The object is still open (by a consumer or another scrcpy
+        // instance), its size cannot be changed
+        LOGE("Shared memory %s already exists", name);
+        CloseHandle(handle);
+        return false;
+    }
+
+    void *data = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!data) {
+        sc_log_windows_error("Could not map shared memory", GetLastError());
+        CloseHandle(handle);
+        return false;
+    }
+
+    shm->data = data;
+    shm->size = size;
+    shm->handle = handle;
+    return true;
+}
+
+void
+sc_shm_destroy(struct sc_shm *shm) {
+    UnmapViewOfFile(shm->data);
+    // The object is destroyed once the last handle is closed
+    CloseHandle(shm->handle);
+}
+
+bool
+sc_shm_open(struct sc_shm *shm, const char *name) {
+    char *path;
+    int r = asprintf(&path, "Local\\%s", name);
+    if (r == -1) {
+        LOG_OOM();
+        return false;
+    }
+
+    wchar_t *wide_path = sc_str_to_wchars(path);
+    free(path);
+    if (!wide_path) {
+        LOG_OOM();
+        return false;
+    }
+
+    HANDLE handle = OpenFileMappingW(FILE_MAP_READ, FALSE, wide_path);
+    free(wide_path);
+    if (!handle) {
+        DWORD err = GetLastError();
+        if (err != ERROR_FILE_NOT_FOUND) {
+            sc_log_windows_error("Could not open shared memory", err);
+        }
+        return false;
+    }
+
+    void *data = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        sc_log_windows_error("Could not map shared memory", GetLastError());
+        CloseHandle(handle);
+        return false;
+    }
+
+    // The view covers the whole object, rounded up to the page size
+    MEMORY_BASIC_INFORMATION info;
+    if (!VirtualQuery(data, &info, sizeof(info))) {
+        sc_log_windows_error("Could not query shared memory", GetLastError());
+        UnmapViewOfFile(data);
+        CloseHandle(handle);
+        return false;
+    }
+
+    shm->data = data;
+    shm->size = info.RegionSize;
+    shm->handle = handle;
+    return true;
+}
+
+void
+sc_shm_close(struct sc_shm *shm) {
+    UnmapViewOfFile(shm->data);
+    CloseHandle(shm->handle);
+}
@@ -0,0 +1,322 @@
+#include "tile_delta.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+
+#include "frame_archive.h"
+#include "util/log.h"
+#include "util/motion.h"
+
+// Rectangle of a tile in a plane, empty if the tile is beyond its edges (the
+// chroma planes of odd sizes)
+struct sc_tile_delta_rect {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+static unsigned
+sc_tile_delta_plane_count(int format) {
+    return format == AV_PIX_FMT_GRAY8 ? 1 : 3;
+}
+
+static void
+sc_tile_delta_plane_size(int width, int height, unsigned plane, int *pw,
+                         int *ph) {
+    *pw = plane ? width / 2 : width;
+    *ph = plane ? height / 2 : height;
+}
+
+static unsigned
+sc_tile_delta_tiles_per_row(int width) {
+    return (width + SC_TILE_DELTA_TILE_SIZE - 1) / SC_TILE_DELTA_TILE_SIZE;
+}
+
+static unsigned
+sc_tile_delta_tile_count(int width, int height) {
+    unsigned rows =
+        (height + SC_TILE_DELTA_TILE_SIZE - 1) / SC_TILE_DELTA_TILE_SIZE;
+    return sc_tile_delta_tiles_per_row(width) * rows;
+}
+
+static struct sc_tile_delta_rect
+sc_tile_delta_tile_rect(int width, int height, uint32_t tile,
+                        unsigned plane) {
+    int pw;
+    int ph;
+    sc_tile_delta_plane_size(width, height, plane, &pw, &ph);
+
+    int size = plane ? SC_TILE_DELTA_TILE_SIZE / 2 : SC_TILE_DELTA_TILE_SIZE;
+    unsigned per_row = sc_tile_delta_tiles_per_row(width);
+    int x = (tile % per_row) * size;
+    int y = (tile / per_row) * size;
+
+    struct sc_tile_delta_rect rect = {
+        .x = x,
+        .y = y,
+        .width = x < pw ? MIN(size, pw - x) : 0,
+        .height = y < ph ? MIN(size, ph - y) : 0,
+    };
+    return rect;
+}
+
+static void
+sc_tile_delta_copy_rect(uint8_t *dst, int dst_linesize, const uint8_t *src,
+                        int src_linesize, const struct sc_tile_delta_rect *r) {
+    for (int row = 0; row < r->height; ++row) {
+        memcpy(dst + (ptrdiff_t) (r->y + row) * dst_linesize + r->x,
+               src + (ptrdiff_t) (r->y + row) * src_linesize + r->x,
+               r->width);
+    }
+}
+
+void
+sc_tile_delta_init(struct sc_tile_delta *td, float threshold,
+                   unsigned key_interval) {
+    assert(threshold >= 0);
+    assert(key_interval);
+    td->threshold = threshold;
+    td->key_interval = key_interval;
+    td->planes[0] = NULL;
+    td->planes[1] = NULL;
+    td->planes[2] = NULL;
+    td->width = 0;
+    td->height = 0;
+    td->format = -1;
+    td->frame_number = 0;
+    td->key_frame_number = 0;
+    td->since_key = 0;
+    atomic_init(&td->reset, false);
+    td->key_frames = 0;
+    td->delta_frames = 0;
+    td->stored_tiles = 0;
+    td->total_tiles = 0;
+}
+
+static void
+sc_tile_delta_free_planes(struct sc_tile_delta *td) {
+    for (unsigned i = 0; i < 3; ++i) {
+        free(td->planes[i]);
+        td->planes[i] = NULL;
+    }
+    td->format = -1;
+}
+
+void
+sc_tile_delta_destroy(struct sc_tile_delta *td) {
+    sc_tile_delta_free_planes(td);
+
+    if (td->delta_frames) {
+        LOGI("Tile deltas: %" PRIu64 " key frames, %" PRIu64 " delta frames "
+             "(%.1f%% of their tiles stored)", td->key_frames,
+             td->delta_frames, 100.0 * td->stored_tiles / td->total_tiles);
+    }
+}
+
+void
+sc_tile_delta_reset(struct sc_tile_delta *td) {
+    atomic_store_explicit(&td->reset, true, memory_order_relaxed);
+}
+
+// Copy a whole frame into the reference, reallocated on a change of size
+static bool
+sc_tile_delta_set_reference(struct sc_tile_delta *td, const AVFrame *frame) {
+    int w = frame->width;
+    int h = frame->height;
+    unsigned count = sc_tile_delta_plane_count(frame->format);
+
+    if (w != td->width || h != td->height || frame->format != td->format) {
+        sc_tile_delta_free_planes(td);
+        for (unsigned i = 0; i < count; ++i) {
+            int pw;
+            int ph;
+            sc_tile_delta_plane_size(w, h, i, &pw, &ph);
+            td->planes[i] = malloc((size_t) pw * ph);
+            if (!td->planes[i]) {
+                LOG_OOM();
+                sc_tile_delta_free_planes(td);
+                return false;
+            }
+        }
+        td->width = w;
+        td->height = h;
+        td->format = frame->format;
+    }
+
+    for (unsigned i = 0; i < count; ++i) {
+        int pw;
+        int ph;
+        sc_tile_delta_plane_size(w, h, i, &pw, &ph);
+        struct sc_tile_delta_rect all = {0, 0, pw, ph};
+        sc_tile_delta_copy_rect(td->planes[i], pw, frame->data[i],
+                                frame->linesize[i], &all);
+    }
+
+    return true;
+}
+
+static void
+sc_tile_delta_encode_key(struct sc_tile_delta *td, const AVFrame *frame,
+                         uint64_t frame_number) {
+    if (!sc_tile_delta_set_reference(td, frame)) {
+        // No reference, the next frame is a key frame too
+        return;
+    }
+
+    td->key_frame_number = frame_number;
+    td->since_key = 1;
+    ++td->key_frames;
+}
+
+// Compare a tile of a plane to the reference
+static bool
+sc_tile_delta_changed(const struct sc_tile_delta *td, const AVFrame *frame,
+                      unsigned plane, const struct sc_tile_delta_rect *r) {
+    int linesize = frame->linesize[plane];
+    int ref_linesize = plane ? td->width / 2 : td->width;
+    const uint8_t *a = frame->data[plane] + (ptrdiff_t) r->y * linesize + r->x;
+    const uint8_t *b = td->planes[plane] + (ptrdiff_t) r->y * ref_linesize
+                     + r->x;
+    uint64_t sad = sc_motion_sad_2d(a, linesize, b, ref_linesize, r->width,
+                                    r->height);
+    // With a threshold of 0, only the identical tiles are skipped
+    double area = (double) r->width * r->height;
+    return sad && (double) sad >= (double) td->threshold * area;
+}
+
+void
+sc_tile_delta_encode(struct sc_tile_delta *td, const AVFrame *frame,
+                     uint64_t frame_number, struct sc_tile_delta_frame *out) {
+    assert(frame->format == AV_PIX_FMT_YUV420P
+        || frame->format == AV_PIX_FMT_GRAY8);
+
+    *out = (struct sc_tile_delta_frame) {
+        .delta = false,
+        .key_frame_number = frame_number,
+    };
+
+    bool reset = atomic_exchange_explicit(&td->reset, false,
+                                          memory_order_relaxed);
+    int w = frame->width;
+    int h = frame->height;
+    if (reset || td->format != frame->format || td->width != w
+            || td->height != h || td->since_key >= td->key_interval) {
+        sc_tile_delta_encode_key(td, frame, frame_number);
+        td->frame_number = frame_number;
+        return;
+    }
+
+    unsigned total = sc_tile_delta_tile_count(w, h);
+    uint32_t *tiles = malloc(total * sizeof(*tiles));
+    if (!tiles) {
+        LOG_OOM();
+        sc_tile_delta_encode_key(td, frame, frame_number);
+        td->frame_number = frame_number;
+        return;
+    }
+
+    unsigned count = sc_tile_delta_plane_count(frame->format);
+    uint32_t stored = 0;
+    for (uint32_t tile = 0; tile < total; ++tile) {
+        struct sc_tile_delta_rect rects[3];
+        bool changed = false;
+        for (unsigned i = 0; i < count; ++i) {
+            rects[i] = sc_tile_delta_tile_rect(w, h, tile, i);
+            if (!changed) {
+                changed = sc_tile_delta_changed(td, frame, i, &rects[i]);
+            }
+        }
+
+        if (!changed) {
+            continue;
+        }
+
+        tiles[stored++] = tile;
+        for (unsigned i = 0; i < count; ++i) {
+            int pw = i ? w / 2 : w;
+            sc_tile_delta_copy_rect(td->planes[i], pw, frame->data[i],
+                                    frame->linesize[i], &rects[i]);
+        }
+    }
+
+    if (!stored) {
+        free(tiles);
+        tiles = NULL;
+    }
+
+    *out = (struct sc_tile_delta_frame) {
+        .delta = true,
+        .base_frame_number = td->frame_number,
+        .key_frame_number = td->key_frame_number,
+        .tiles = tiles,
+        .tile_count = stored,
+    };
+
+    td->frame_number = frame_number;
+    ++td->since_key;
+    ++td->delta_frames;
+    td->stored_tiles += stored;
+    td->total_tiles += total;
+}
+
+size_t
+sc_tile_delta_payload_size(const AVFrame *frame,
+                           const struct sc_tile_delta_frame *df) {
+    assert(df->delta);
+
+    size_t size = sizeof(struct sc_frame_archive_tiles_header)
+                + df->tile_count * sizeof(uint32_t);
+    unsigned count = sc_tile_delta_plane_count(frame->format);
+    for (uint32_t i = 0; i < df->tile_count; ++i) {
+        for (unsigned p = 0; p < count; ++p) {
+            struct sc_tile_delta_rect r =
+                sc_tile_delta_tile_rect(frame->width, frame->height,
+                                        df->tiles[i], p);
+            size += (size_t) r.width * r.height;
+        }
+    }
+    return size;
+}
+
+void
+sc_tile_delta_pack(const AVFrame *frame, const struct sc_tile_delta_frame *df,
+                   uint8_t *dst) {
+    assert(df->delta);
+
+    struct sc_frame_archive_tiles_header header = {
+        .base_frame_number = df->base_frame_number,
+        .key_frame_number = df->key_frame_number,
+        .tile_size = SC_TILE_DELTA_TILE_SIZE,
+        .tile_count = df->tile_count,
+    };
+    memcpy(header.magic, SC_FRAME_ARCHIVE_TILES_MAGIC, sizeof(header.magic));
+
+    uint8_t *p = dst;
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    if (df->tile_count) {
+        size_t size = df->tile_count * sizeof(*df->tiles);
+        memcpy(p, df->tiles, size);
+        p += size;
+    }
+
+    unsigned count = sc_tile_delta_plane_count(frame->format);
+    for (uint32_t i = 0; i < df->tile_count; ++i) {
+        for (unsigned plane = 0; plane < count; ++plane) {
+            struct sc_tile_delta_rect r =
+                sc_tile_delta_tile_rect(frame->width, frame->height,
+                                        df->tiles[i], plane);
+            int linesize = frame->linesize[plane];
+            for (int row = 0; row < r.height; ++row) {
+                memcpy(p, frame->data[plane]
+                        + (ptrdiff_t) (r.y + row) * linesize + r.x, r.width);
+                p += r.width;
+            }
+        }
+    }
+}
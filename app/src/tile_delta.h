@@ -0,0 +1,112 @@
+#ifndef SC_TILE_DELTA_H
+#define SC_TILE_DELTA_H
+
+#include "common.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+
+// Size of the tiles of the Y plane, in pixels (the tiles of the U and V planes
+// are half as large)
+#define SC_TILE_DELTA_TILE_SIZE 64
+// Number of frames stored between two key frames (--save-frames-key-interval)
+#define SC_TILE_DELTA_DEFAULT_KEY_INTERVAL 60
+
+// How a frame is stored
+struct sc_tile_delta_frame {
+    bool delta; // false for a key frame, stored in full
+    uint64_t base_frame_number; // previous frame stored
+    uint64_t key_frame_number;
+    uint32_t *tiles; // indices of the tiles stored (NULL if none)
+    uint32_t tile_count;
+};
+
+/**
+ * Tile delta encoder of the archived frames (--save-frames-tile-delta), for
+ * near-static scenes
+ *
+ * A key frame is stored in full every `key_interval` frames. The other frames
+ * are stored as the 64x64 tiles whose mean absolute difference (SIMD SAD, see
+ * sc_motion_sad_2d()) against the previous frame stored reaches the threshold,
+ * on the Y plane or on the U or V plane (their 32x32 tiles). The reference is
+ * the image as reconstructed by the readers (only the tiles stored are
+ * updated), so that the differences below the threshold accumulate until the
+ * tile is stored.
+ *
+ * The frames are encoded in order by the producer thread, which only selects
+ * the tiles: their pixels are packed by the I/O threads, from the frame
+ * (sc_tile_delta_pack()).
+ *
+ * A frame which could not be stored breaks the chain of the next ones: the
+ * next frame must then be a key frame (sc_tile_delta_reset()), and the frames
+ * already encoded against it must be stored in full.
+ */
+struct sc_tile_delta {
+    float threshold; // 0 to store exactly the tiles which changed
+    unsigned key_interval;
+
+    // Reference image (packed planes), format -1 if none
+    uint8_t *planes[3];
+    int width;
+    int height;
+    int format; // enum AVPixelFormat (YUV420P or GRAY8)
+    uint64_t frame_number; // of the previous frame stored
+    uint64_t key_frame_number;
+    unsigned since_key; // frames stored since the key frame (included)
+
+    atomic_bool reset;
+
+    // Statistics, logged on destroy
+    uint64_t key_frames;
+    uint64_t delta_frames;
+    uint64_t stored_tiles; // by the delta frames
+    uint64_t total_tiles; // of the delta frames
+};
+
+void
+sc_tile_delta_init(struct sc_tile_delta *td, float threshold,
+                   unsigned key_interval);
+
+void
+sc_tile_delta_destroy(struct sc_tile_delta *td);
+
+/**
+ * Store the next frame as a key frame
+ *
+ * It may be called from any thread.
+ */
+void
+sc_tile_delta_reset(struct sc_tile_delta *td);
+
+/**
+ * Select how the next frame stored (YUV420P or GRAY8) is encoded
+ *
+ * The caller owns `out->tiles`. On allocation failure, the frame is a key
+ * frame.
+ */
+void
+sc_tile_delta_encode(struct sc_tile_delta *td, const AVFrame *frame,
+                     uint64_t frame_number, struct sc_tile_delta_frame *out);
+
+/**
+ * Size of the image data of a delta frame (see frame_archive.h)
+ */
+size_t
+sc_tile_delta_payload_size(const AVFrame *frame,
+                           const struct sc_tile_delta_frame *df);
+
+/**
+ * Write the image data of a delta frame
+ *
+ * `dst` must hold sc_tile_delta_payload_size() bytes.
+ */
+void
+sc_tile_delta_pack(const AVFrame *frame, const struct sc_tile_delta_frame *df,
+                   uint8_t *dst);
+
+#endif
@@ -0,0 +1,96 @@
+#include "timestamp_filter.h"
+
+#include <assert.h>
+#include <math.h>
+
+// Weight of the innovation in the correction of the rate (critically damped
+// for the gain)
+#define SC_TIMESTAMP_FILTER_RATE_GAIN \
+    (SC_TIMESTAMP_FILTER_GAIN * SC_TIMESTAMP_FILTER_GAIN \
+        / (2 - SC_TIMESTAMP_FILTER_GAIN))
+// The clocks of the device and of the computer drift very slowly, a larger
+// rate correction is caused by the jitter
+#define SC_TIMESTAMP_FILTER_MAX_DRIFT 0.01
+
+void
+sc_timestamp_filter_init(struct sc_timestamp_filter *tf) {
+    tf->started = false;
+    tf->count = 0;
+    tf->last_arrival = 0;
+    tf->estimate = 0;
+    tf->rate = 1;
+    tf->deviation = SC_TIMESTAMP_FILTER_OUTLIER_MIN_US;
+    tf->outlier_run = 0;
+    tf->last_filtered_us = 0;
+    tf->outliers = 0;
+    tf->restarts = 0;
+}
+
+static int64_t
+sc_timestamp_filter_restart(struct sc_timestamp_filter *tf, int64_t raw_us,
+                            sc_tick arrival) {
+    if (tf->started) {
+        ++tf->restarts;
+    }
+    tf->started = true;
+    tf->count = 1;
+    tf->last_arrival = arrival;
+    tf->estimate = raw_us;
+    tf->rate = 1;
+    tf->deviation = SC_TIMESTAMP_FILTER_OUTLIER_MIN_US;
+    tf->outlier_run = 0;
+    // Strictly increasing, unless the raw timestamps went backwards
+    tf->last_filtered_us = raw_us;
+    return raw_us;
+}
+
+int64_t
+sc_timestamp_filter_push(struct sc_timestamp_filter *tf, int64_t raw_us,
+                         sc_tick arrival, bool *outlier) {
+    assert(raw_us >= 0);
+    *outlier = false;
+
+    sc_tick elapsed = arrival - tf->last_arrival;
+    if (!tf->started || elapsed < 0
+            || elapsed > SC_TIMESTAMP_FILTER_RESET_US) {
+        return sc_timestamp_filter_restart(tf, raw_us, arrival);
+    }
+
+    double prediction = tf->estimate + tf->rate * SC_TICK_TO_US(elapsed);
+    double innovation = raw_us - prediction;
+    double distance = fabs(innovation);
+
+    bool warm = tf->count >= SC_TIMESTAMP_FILTER_WARMUP;
+    double threshold = SC_TIMESTAMP_FILTER_OUTLIER_K * tf->deviation;
+    if (warm && distance > threshold
+            && distance > SC_TIMESTAMP_FILTER_OUTLIER_MIN_US) {
+        if (++tf->outlier_run > SC_TIMESTAMP_FILTER_MAX_OUTLIERS) {
+            // Not an outlier, the clock stepped
+            return sc_timestamp_filter_restart(tf, raw_us, arrival);
+        }
+        *outlier = true;
+        ++tf->outliers;
+        tf->estimate = prediction;
+    } else {
+        tf->outlier_run = 0;
+        tf->estimate = prediction + SC_TIMESTAMP_FILTER_GAIN * innovation;
+        if (elapsed) {
+            tf->rate += SC_TIMESTAMP_FILTER_RATE_GAIN * innovation / elapsed;
+            tf->rate = CLAMP(tf->rate, 1 - SC_TIMESTAMP_FILTER_MAX_DRIFT,
+                             1 + SC_TIMESTAMP_FILTER_MAX_DRIFT);
+        }
+        tf->deviation += (distance - tf->deviation) / 16;
+        if (!warm) {
+            ++tf->count;
+        }
+    }
+
+    tf->last_arrival = arrival;
+
+    int64_t filtered_us = llround(tf->estimate);
+    if (filtered_us <= tf->last_filtered_us) {
+        filtered_us = tf->last_filtered_us + 1;
+    }
+    tf->last_filtered_us = filtered_us;
+    return filtered_us;
+}
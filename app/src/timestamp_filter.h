@@ -0,0 +1,74 @@
+#ifndef SC_TIMESTAMP_FILTER_H
+#define SC_TIMESTAMP_FILTER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/tick.h"
+
+// Weight of the raw timestamp in each correction of the estimate
+#define SC_TIMESTAMP_FILTER_GAIN 0.125
+// Updates before the outliers are detected
+#define SC_TIMESTAMP_FILTER_WARMUP 8
+// A raw timestamp is an outlier if it is farther from the prediction than this
+// number of mean absolute deviations...
+#define SC_TIMESTAMP_FILTER_OUTLIER_K 4
+// ... and than this delay
+#define SC_TIMESTAMP_FILTER_OUTLIER_MIN_US 2000
+// Consecutive outliers accepted as a step of the clock
+#define SC_TIMESTAMP_FILTER_MAX_OUTLIERS 3
+// Gap of the arrivals after which the filter restarts
+#define SC_TIMESTAMP_FILTER_RESET_US SC_TICK_FROM_SEC(1)
+
+/**
+ * Online filter of the capture timestamps of the video frames, against their
+ * arrival time on the client
+ *
+ * The raw timestamps (derived from the encoder PTS) are jittery. The capture
+ * clock is tracked as a constant-rate clock along the arrival times, by a
+ * steady-state Kalman filter of its time and rate (an alpha-beta filter): for
+ * each frame, the capture time is predicted from the previous estimate and the
+ * elapsed arrival time, then corrected by a fraction of the difference with
+ * the raw timestamp. The filtered timestamps are smooth and strictly
+ * increasing.
+ *
+ * A raw timestamp too far from the prediction (see
+ * SC_TIMESTAMP_FILTER_OUTLIER_K) is flagged as an outlier, and does not
+ * correct the estimate (its filtered timestamp is the prediction). After
+ * SC_TIMESTAMP_FILTER_MAX_OUTLIERS consecutive outliers (a step of the clock,
+ * e.g. on a clock sync update) or a gap of the arrivals, the filter restarts
+ * from the raw timestamp.
+ *
+ * Each update is O(1), without allocation. It is not thread-safe.
+ */
+struct sc_timestamp_filter {
+    bool started;
+    unsigned count; // updates since the start, saturated at the warm-up
+    sc_tick last_arrival;
+    double estimate; // filtered capture time of the last frame, in us
+    double rate; // capture time elapsed per arrival time (close to 1)
+    double deviation; // mean absolute deviation of the inliers, in us
+    unsigned outlier_run; // consecutive outliers
+    int64_t last_filtered_us;
+
+    uint64_t outliers;
+    uint64_t restarts;
+};
+
+void
+sc_timestamp_filter_init(struct sc_timestamp_filter *tf);
+
+/**
+ * Filter the raw capture timestamp (in microseconds, not negative) of the next
+ * frame, received at `arrival`
+ *
+ * Return the filtered timestamp (in microseconds), and set `outlier` if the
+ * raw timestamp is flagged as an outlier.
+ */
+int64_t
+sc_timestamp_filter_push(struct sc_timestamp_filter *tf, int64_t raw_us,
+                         sc_tick arrival, bool *outlier);
+
+#endif
@@ -0,0 +1,95 @@
+#include "timestamp_sei.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "util/binary.h"
+
+#define SC_SEI_PAYLOAD_TYPE_USER_DATA_UNREGISTERED 5
+#define SC_TIMESTAMP_SEI_UUID_SIZE 16
+// UUID, clock domain, capture timestamp and sequence number
+#define SC_TIMESTAMP_SEI_PAYLOAD_SIZE (SC_TIMESTAMP_SEI_UUID_SIZE + 13)
+
+static_assert(sizeof(SC_TIMESTAMP_SEI_UUID) - 1 == SC_TIMESTAMP_SEI_UUID_SIZE,
+              "invalid UUID size");
+
+// Read the payload of the SEI message starting at `data` (just after the NAL
+// unit header), if it is a timestamp SEI
+static bool
+sc_timestamp_sei_read(const uint8_t *data, size_t len,
+                      struct sc_timestamp_sei *sei) {
+    // The payload type, the payload size and the UUID contain no zero byte,
+    // so they are never escaped
+    if (len < 2 + SC_TIMESTAMP_SEI_UUID_SIZE
+            || data[0] != SC_SEI_PAYLOAD_TYPE_USER_DATA_UNREGISTERED
+            || data[1] != SC_TIMESTAMP_SEI_PAYLOAD_SIZE
+            || memcmp(&data[2], SC_TIMESTAMP_SEI_UUID,
+                      SC_TIMESTAMP_SEI_UUID_SIZE)) {
+        return false;
+    }
+
+    // Remove the emulation prevention bytes from the rest of the payload
+    uint8_t payload[13];
+    size_t n = 0;
+    unsigned zeros = 0;
+    for (size_t i = 2 + SC_TIMESTAMP_SEI_UUID_SIZE;
+            i < len && n < sizeof(payload); ++i) {
+        if (zeros >= 2 && data[i] == 3) {
+            zeros = 0;
+            continue;
+        }
+        payload[n++] = data[i];
+        zeros = data[i] ? 0 : zeros + 1;
+    }
+
+    if (n < sizeof(payload)) {
+        return false;
+    }
+
+    sei->clock_domain = payload[0];
+    sei->capture_ns = sc_read64be(&payload[1]);
+    sei->sequence = sc_read32be(&payload[9]);
+    return true;
+}
+
+bool
+sc_timestamp_sei_find(const uint8_t *data, size_t len, bool hevc,
+                      struct sc_timestamp_sei *sei) {
+    unsigned zeros = 0;
+    for (size_t i = 0; i + 1 < len; ++i) {
+        if (!data[i]) {
+            ++zeros;
+            continue;
+        }
+
+        if (data[i] == 1 && zeros >= 2) {
+            // Start code, the NAL unit header follows
+            const uint8_t *nal = &data[i + 1];
+            size_t nal_len = len - i - 1;
+            if (hevc) {
+                unsigned type = (nal[0] >> 1) & 0x3f;
+                if (type < 32) {
+                    // Slice, the SEI is before
+                    return false;
+                }
+                if (type == 39 && nal_len > 2 // PREFIX_SEI_NUT
+                        && sc_timestamp_sei_read(&nal[2], nal_len - 2, sei)) {
+                    return true;
+                }
+            } else {
+                unsigned type = nal[0] & 0x1f;
+                if (type >= 1 && type <= 5) {
+                    // Slice, the SEI is before
+                    return false;
+                }
+                if (type == 6
+                        && sc_timestamp_sei_read(&nal[1], nal_len - 1, sei)) {
+                    return true;
+                }
+            }
+        }
+        zeros = 0;
+    }
+
+    return false;
+}
@@ -0,0 +1,43 @@
+#ifndef SC_TIMESTAMP_SEI_H
+#define SC_TIMESTAMP_SEI_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Identifier of the timestamp SEI ("user data unregistered" UUID)
+#define SC_TIMESTAMP_SEI_UUID "scrcpy-timestamp"
+
+/**
+ * Capture timestamp of a frame, embedded by the device in the H.264 or H.265
+ * bitstream (--timestamp-sei)
+ *
+ * The device inserts a "user data unregistered" SEI NAL unit before the data
+ * of each video frame. Its payload is the UUID, the clock domain (1 byte), the
+ * capture timestamp in nanoseconds (8 bytes) and a sequence number (4 bytes),
+ * in big-endian.
+ *
+ * The timestamp is carried by the bitstream itself, so it is kept in the
+ * recordings and the raw streams, and ignored by the decoders.
+ */
+struct sc_timestamp_sei {
+    uint8_t clock_domain;
+    uint64_t capture_ns;
+    uint32_t sequence;
+};
+
+/**
+ * Find the timestamp SEI in the data of a frame (in Annex B format)
+ *
+ * Only the NAL units before the first slice are inspected, and the bitstream
+ * is not parsed beyond their headers, so this is cheap.
+ *
+ * Return true if found.
+ */
+bool
+sc_timestamp_sei_find(const uint8_t *data, size_t len, bool hevc,
+                      struct sc_timestamp_sei *sei);
+
+#endif
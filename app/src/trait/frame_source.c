@@ -1,5 +1,9 @@
 #include "frame_source.h"
 
+#include <stdlib.h>
+
+#include "util/log.h"
+
 void
 sc_frame_source_init(struct sc_frame_source *source) {
     source->sink_count = 0;
@@ -11,15 +15,67 @@ sc_frame_source_add_sink(struct sc_frame_source *source,
     assert(source->sink_count < SC_FRAME_SOURCE_MAX_SINKS);
     assert(sink);
     assert(sink->ops);
+    source->async[source->sink_count].enabled = false;
     source->sinks[source->sink_count++] = sink;
 }
 
+void
+sc_frame_source_add_async_sink(struct sc_frame_source *source,
+                               struct sc_frame_sink *sink,
+                               enum sc_frame_worker_policy policy,
+                               const char *name) {
+    unsigned index = source->sink_count;
+    sc_frame_source_add_sink(source, sink);
+    source->async[index].enabled = true;
+    source->async[index].policy = policy;
+    source->async[index].name = name;
+    source->async[index].worker = NULL;
+}
+
+static bool
+sc_frame_source_sink_open(struct sc_frame_source *source, unsigned index,
+                          const AVCodecContext *ctx) {
+    struct sc_frame_sink *sink = source->sinks[index];
+    if (!source->async[index].enabled) {
+        return sink->ops->open(sink, ctx);
+    }
+
+    struct sc_frame_worker *worker = malloc(sizeof(*worker));
+    if (!worker) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (!sc_frame_worker_open(worker, sink, source->async[index].policy,
+                              source->async[index].name, ctx)) {
+        free(worker);
+        return false;
+    }
+
+    source->async[index].worker = worker;
+    return true;
+}
+
+static void
+sc_frame_source_sink_close(struct sc_frame_source *source, unsigned index) {
+    if (!source->async[index].enabled) {
+        struct sc_frame_sink *sink = source->sinks[index];
+        sink->ops->close(sink);
+        return;
+    }
+
+    struct sc_frame_worker *worker = source->async[index].worker;
+    assert(worker);
+    sc_frame_worker_close(worker);
+    free(worker);
+    source->async[index].worker = NULL;
+}
+
 static void
 sc_frame_source_sinks_close_firsts(struct sc_frame_source *source,
                                     unsigned count) {
     while (count) {
-        struct sc_frame_sink *sink = source->sinks[--count];
-        sink->ops->close(sink);
+        sc_frame_source_sink_close(source, --count);
     }
 }
 
@@ -28,8 +84,7 @@ sc_frame_source_sinks_open(struct sc_frame_source *source,
                            const AVCodecContext *ctx) {
     assert(source->sink_count);
     for (unsigned i = 0; i < source->sink_count; ++i) {
-        struct sc_frame_sink *sink = source->sinks[i];
-        if (!sink->ops->open(sink, ctx)) {
+        if (!sc_frame_source_sink_open(source, i, ctx)) {
             sc_frame_source_sinks_close_firsts(source, i);
             return false;
         }
@@ -49,8 +104,15 @@ sc_frame_source_sinks_push(struct sc_frame_source *source,
                             const AVFrame *frame) {
     assert(source->sink_count);
     for (unsigned i = 0; i < source->sink_count; ++i) {
-        struct sc_frame_sink *sink = source->sinks[i];
-        if (!sink->ops->push(sink, frame)) {
+        bool ok;
+        if (source->async[i].enabled) {
+            // Only a reference is queued, the sink is fed by its worker
+            ok = sc_frame_worker_push(source->async[i].worker, frame);
+        } else {
+            struct sc_frame_sink *sink = source->sinks[i];
+            ok = sink->ops->push(sink, frame);
+        }
+        if (!ok) {
             return false;
         }
     }
@@ -4,8 +4,9 @@
 #include "common.h"
 
 #include "frame_sink.h"
+#include "frame_worker.h"
 
-#define SC_FRAME_SOURCE_MAX_SINKS 2
+#define SC_FRAME_SOURCE_MAX_SINKS 4
 
 /**
  * Frame source trait
@@ -15,6 +16,15 @@
 struct sc_frame_source {
     struct sc_frame_sink *sinks[SC_FRAME_SOURCE_MAX_SINKS];
     unsigned sink_count;
+
+    // For each sink, if it is fed from its own thread
+    // (see sc_frame_source_add_async_sink())
+    struct {
+        bool enabled;
+        enum sc_frame_worker_policy policy;
+        const char *name;
+        struct sc_frame_worker *worker; // allocated on open
+    } async[SC_FRAME_SOURCE_MAX_SINKS];
 };
 
 void
@@ -24,6 +34,18 @@ void
 sc_frame_source_add_sink(struct sc_frame_source *source,
                          struct sc_frame_sink *sink);
 
+/**
+ * Add a sink fed from its own thread (see frame_worker.h), so that the frames
+ * are pushed without waiting for it
+ *
+ * The `name` (statically allocated) identifies the sink in the logs.
+ */
+void
+sc_frame_source_add_async_sink(struct sc_frame_source *source,
+                               struct sc_frame_sink *sink,
+                               enum sc_frame_worker_policy policy,
+                               const char *name);
+
 bool
 sc_frame_source_sinks_open(struct sc_frame_source *source,
                            const AVCodecContext *ctx);
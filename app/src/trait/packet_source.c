@@ -1,5 +1,9 @@
 #include "packet_source.h"
 
+#include <stdlib.h>
+
+#include "util/log.h"
+
 void
 sc_packet_source_init(struct sc_packet_source *source) {
     source->sink_count = 0;
@@ -11,15 +15,81 @@ sc_packet_source_add_sink(struct sc_packet_source *source,
     assert(source->sink_count < SC_PACKET_SOURCE_MAX_SINKS);
     assert(sink);
     assert(sink->ops);
+    source->async[source->sink_count].enabled = false;
+    source->lossless[source->sink_count] = false;
     source->sinks[source->sink_count++] = sink;
 }
 
+void
+sc_packet_source_add_async_sink(struct sc_packet_source *source,
+                                struct sc_packet_sink *sink,
+                                enum sc_packet_worker_policy policy,
+                                const char *name) {
+    unsigned index = source->sink_count;
+    sc_packet_source_add_sink(source, sink);
+    source->async[index].enabled = true;
+    source->async[index].policy = policy;
+    source->async[index].name = name;
+    source->async[index].worker = NULL;
+}
+
+void
+sc_packet_source_set_lossless(struct sc_packet_source *source,
+                              struct sc_packet_sink *sink) {
+    for (unsigned i = 0; i < source->sink_count; ++i) {
+        if (source->sinks[i] == sink) {
+            source->lossless[i] = true;
+            return;
+        }
+    }
+
+    assert(!"Lossless sink not added");
+}
+
+static bool
+sc_packet_source_sink_open(struct sc_packet_source *source, unsigned index,
+                           AVCodecContext *ctx) {
+    struct sc_packet_sink *sink = source->sinks[index];
+    if (!source->async[index].enabled) {
+        return sink->ops->open(sink, ctx);
+    }
+
+    struct sc_packet_worker *worker = malloc(sizeof(*worker));
+    if (!worker) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (!sc_packet_worker_open(worker, sink, source->async[index].policy,
+                               source->async[index].name, ctx)) {
+        free(worker);
+        return false;
+    }
+
+    source->async[index].worker = worker;
+    return true;
+}
+
+static void
+sc_packet_source_sink_close(struct sc_packet_source *source, unsigned index) {
+    if (!source->async[index].enabled) {
+        struct sc_packet_sink *sink = source->sinks[index];
+        sink->ops->close(sink);
+        return;
+    }
+
+    struct sc_packet_worker *worker = source->async[index].worker;
+    assert(worker);
+    sc_packet_worker_close(worker);
+    free(worker);
+    source->async[index].worker = NULL;
+}
+
 static void
 sc_packet_source_sinks_close_firsts(struct sc_packet_source *source,
                                     unsigned count) {
     while (count) {
-        struct sc_packet_sink *sink = source->sinks[--count];
-        sink->ops->close(sink);
+        sc_packet_source_sink_close(source, --count);
     }
 }
 
@@ -28,8 +98,7 @@ sc_packet_source_sinks_open(struct sc_packet_source *source,
                             AVCodecContext *ctx) {
     assert(source->sink_count);
     for (unsigned i = 0; i < source->sink_count; ++i) {
-        struct sc_packet_sink *sink = source->sinks[i];
-        if (!sink->ops->open(sink, ctx)) {
+        if (!sc_packet_source_sink_open(source, i, ctx)) {
             sc_packet_source_sinks_close_firsts(source, i);
             return false;
         }
@@ -44,13 +113,38 @@ sc_packet_source_sinks_close(struct sc_packet_source *source) {
     sc_packet_source_sinks_close_firsts(source, source->sink_count);
 }
 
+static bool
+sc_packet_source_sink_push(struct sc_packet_source *source, unsigned index,
+                           const AVPacket *packet) {
+    if (source->async[index].enabled) {
+        // Only a reference is queued, the sink is fed by its worker
+        return sc_packet_worker_push(source->async[index].worker, packet);
+    }
+
+    struct sc_packet_sink *sink = source->sinks[index];
+    return sink->ops->push(sink, packet);
+}
+
 bool
 sc_packet_source_sinks_push(struct sc_packet_source *source,
                             const AVPacket *packet) {
     assert(source->sink_count);
     for (unsigned i = 0; i < source->sink_count; ++i) {
-        struct sc_packet_sink *sink = source->sinks[i];
-        if (!sink->ops->push(sink, packet)) {
+        if (!sc_packet_source_sink_push(source, i, packet)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool
+sc_packet_source_sinks_push_lossless(struct sc_packet_source *source,
+                                     const AVPacket *packet) {
+    assert(source->sink_count);
+    for (unsigned i = 0; i < source->sink_count; ++i) {
+        if (source->lossless[i]
+                && !sc_packet_source_sink_push(source, i, packet)) {
             return false;
         }
     }
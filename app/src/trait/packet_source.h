@@ -4,8 +4,11 @@
 #include "common.h"
 
 #include "packet_sink.h"
+#include "packet_worker.h"
 
-#define SC_PACKET_SOURCE_MAX_SINKS 2
+// The video demuxer may feed the decoder, the recorder, the packet pipe and
+// the aggregator uplink
+#define SC_PACKET_SOURCE_MAX_SINKS 4
 
 /**
  * Packet source trait
@@ -15,6 +18,19 @@
 struct sc_packet_source {
     struct sc_packet_sink *sinks[SC_PACKET_SOURCE_MAX_SINKS];
     unsigned sink_count;
+
+    // For each sink, if it also receives the packets skipped by the source
+    // (see sc_packet_source_sinks_push_lossless())
+    bool lossless[SC_PACKET_SOURCE_MAX_SINKS];
+
+    // For each sink, if it is fed from its own thread
+    // (see sc_packet_source_add_async_sink())
+    struct {
+        bool enabled;
+        enum sc_packet_worker_policy policy;
+        const char *name;
+        struct sc_packet_worker *worker; // allocated on open
+    } async[SC_PACKET_SOURCE_MAX_SINKS];
 };
 
 void
@@ -24,6 +40,26 @@ void
 sc_packet_source_add_sink(struct sc_packet_source *source,
                           struct sc_packet_sink *sink);
 
+/**
+ * Add a sink fed from its own thread (see packet_worker.h), so that the
+ * packets are pushed without waiting for it
+ *
+ * The `name` (statically allocated) identifies the sink in the logs.
+ */
+void
+sc_packet_source_add_async_sink(struct sc_packet_source *source,
+                                struct sc_packet_sink *sink,
+                                enum sc_packet_worker_policy policy,
+                                const char *name);
+
+/**
+ * Also push to this sink (already added) the packets skipped by the source to
+ * catch up with the live stream, for example to record the whole stream
+ */
+void
+sc_packet_source_set_lossless(struct sc_packet_source *source,
+                              struct sc_packet_sink *sink);
+
 bool
 sc_packet_source_sinks_open(struct sc_packet_source *source,
                             AVCodecContext *ctx);
@@ -35,6 +71,11 @@ bool
 sc_packet_source_sinks_push(struct sc_packet_source *source,
                             const AVPacket *packet);
 
+// Push a packet skipped by the source to the lossless sinks only
+bool
+sc_packet_source_sinks_push_lossless(struct sc_packet_source *source,
+                                     const AVPacket *packet);
+
 void
 sc_packet_source_sinks_disable(struct sc_packet_source *source);
 
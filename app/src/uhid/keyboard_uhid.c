@@ -19,6 +19,7 @@ sc_keyboard_uhid_send_input(struct sc_keyboard_uhid *kb,
     assert(hid_input->size <= SC_HID_MAX_SIZE);
     memcpy(msg.uhid_input.data, hid_input->data, hid_input->size);
     msg.uhid_input.size = hid_input->size;
+    msg.uhid_input.coalescable = hid_input->coalescable;
 
     if (!sc_controller_push_msg(kb->controller, &msg)) {
         LOGE("Could not push UHID_INPUT message (key)");
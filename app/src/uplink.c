@@ -0,0 +1,619 @@
+#include "uplink.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "compat.h"
+#include "memory_budget.h"
+#include "util/binary.h"
+#include "util/log.h"
+
+/** Downcast packet_sink to sc_uplink_stream */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_uplink_stream, packet_sink)
+
+#define SC_UPLINK_HEADER_SIZE sizeof(struct uplink_record_header)
+
+static_assert(sizeof(struct uplink_stream_info)
+                <= sizeof(((struct sc_uplink_record *) NULL)->payload),
+              "stream info too large");
+
+static void
+sc_uplink_record_free(struct sc_uplink_record *record) {
+    if (record->packet) {
+        if (record->budgeted) {
+            sc_memory_budget_release(SC_MEMORY_STREAM, record->size);
+        }
+        av_packet_free(&record->packet);
+    }
+}
+
+static void
+sc_uplink_queue_clear(struct sc_uplink *uplink) {
+    while (!sc_vecdeque_is_empty(&uplink->queue)) {
+        struct sc_uplink_record *record = sc_vecdeque_popref(&uplink->queue);
+        sc_uplink_record_free(record);
+    }
+    uplink->queued_bytes = 0;
+}
+
+static void
+sc_uplink_write_header(uint8_t *buf, uint8_t type, uint8_t stream,
+                       uint16_t flags, uint32_t size, int64_t pts_us,
+                       int64_t timestamp_us) {
+    buf[0] = type;
+    buf[1] = stream;
+    sc_write16le(&buf[2], flags);
+    sc_write32le(&buf[4], size);
+    sc_write64le(&buf[8], (uint64_t) pts_us);
+    sc_write64le(&buf[16], (uint64_t) timestamp_us);
+}
+
+static void
+sc_uplink_write_float(uint8_t *buf, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    sc_write32le(buf, bits);
+}
+
+// Queue a record (with the mutex locked)
+//
+// The stream info records are never dropped, nor the config packets (the next
+// packets could not be decoded without them). The other video packets are
+// dropped until the next key frame once the queue is full, the audio packets
+// and the pose samples individually.
+//
+// Return false if the record is dropped. The packet, if any, is referenced on
+// success.
+static bool
+sc_uplink_queue_locked(struct sc_uplink *uplink, uint8_t type,
+                       uint8_t stream, uint16_t flags,
+                       const AVPacket *packet, const uint8_t *payload,
+                       uint32_t size, int64_t pts_us, int64_t timestamp_us) {
+    if (uplink->failed || uplink->stopping) {
+        return false;
+    }
+
+    bool droppable = type == UPLINK_RECORD_POSE
+                  || (type == UPLINK_RECORD_PACKET
+                      && !(flags & UPLINK_RECORD_FLAG_CONFIG));
+    bool budgeted = false;
+    if (droppable) {
+        bool video = stream != UPLINK_STREAM_AUDIO
+                  && stream != UPLINK_STREAM_POSE;
+        // The next packets reference the dropped ones: resume on a key frame
+        // only (overflow is only set for the video streams)
+        bool resumable = !uplink->overflow[stream]
+                      || (flags & UPLINK_RECORD_FLAG_KEY_FRAME);
+        bool full = uplink->queued_bytes + SC_UPLINK_HEADER_SIZE + size
+                        > SC_UPLINK_MAX_BYTES;
+        if (!full && resumable && packet) {
+            // Enforced before the packet is referenced
+            full = !sc_memory_budget_acquire(SC_MEMORY_STREAM, size);
+            budgeted = !full;
+        }
+
+        if (full || !resumable) {
+            if (!uplink->dropped) {
+                LOGW("Aggregator too slow, dropping records");
+            }
+            ++uplink->dropped;
+            uplink->overflow[stream] = video;
+            uplink->discontinuity[stream] = true;
+            return false;
+        }
+        uplink->overflow[stream] = false;
+    }
+
+    if (uplink->discontinuity[stream]) {
+        flags |= UPLINK_RECORD_FLAG_DISCONTINUITY;
+        uplink->discontinuity[stream] = false;
+    }
+
+    struct sc_uplink_record record = {
+        .packet = NULL,
+        .size = size,
+        .budgeted = budgeted,
+    };
+    sc_uplink_write_header(record.header, type, stream, flags, size, pts_us,
+                           timestamp_us);
+    if (packet) {
+        record.packet = av_packet_alloc();
+        if (!record.packet) {
+            goto error;
+        }
+        if (av_packet_ref(record.packet, packet)) {
+            av_packet_free(&record.packet);
+            goto error;
+        }
+    } else {
+        assert(size <= sizeof(record.payload));
+        memcpy(record.payload, payload, size);
+    }
+
+    bool ok = sc_vecdeque_push(&uplink->queue, record);
+    if (!ok) {
+        sc_uplink_record_free(&record);
+        LOG_OOM();
+        return false;
+    }
+
+    uplink->queued_bytes += SC_UPLINK_HEADER_SIZE + size;
+    sc_cond_signal(&uplink->cond);
+    return true;
+
+error:
+    if (budgeted) {
+        sc_memory_budget_release(SC_MEMORY_STREAM, size);
+    }
+    LOG_OOM();
+    return false;
+}
+
+static bool
+sc_uplink_send_record(struct sc_uplink *uplink,
+                      const struct sc_uplink_record *record) {
+    ssize_t w;
+    if (!record->packet) {
+        // Send the header and the inline payload at once
+        uint8_t buf[SC_UPLINK_HEADER_SIZE + sizeof(record->payload)];
+        memcpy(buf, record->header, SC_UPLINK_HEADER_SIZE);
+        memcpy(&buf[SC_UPLINK_HEADER_SIZE], record->payload, record->size);
+        size_t len = SC_UPLINK_HEADER_SIZE + record->size;
+        w = net_send_all(uplink->socket, buf, len);
+        return w == (ssize_t) len;
+    }
+
+    w = net_send_all(uplink->socket, record->header, SC_UPLINK_HEADER_SIZE);
+    if (w != (ssize_t) SC_UPLINK_HEADER_SIZE) {
+        return false;
+    }
+
+    w = net_send_all(uplink->socket, record->packet->data, record->size);
+    return w == (ssize_t) record->size;
+}
+
+// Never more than UPLINK_WINDOW bytes beyond the acknowledged bytes
+static bool
+sc_uplink_can_send(struct sc_uplink *uplink) {
+    return !sc_vecdeque_is_empty(&uplink->queue)
+        && uplink->sent_bytes - uplink->acked_bytes < UPLINK_WINDOW;
+}
+
+static int
+run_uplink_send(void *data) {
+    struct sc_uplink *uplink = data;
+
+    sc_mutex_lock(&uplink->mutex);
+
+    for (;;) {
+        while (!uplink->failed && !sc_uplink_can_send(uplink)) {
+            if (!uplink->stopping) {
+                sc_cond_wait(&uplink->cond, &uplink->mutex);
+            } else if (sc_vecdeque_is_empty(&uplink->queue)
+                    || !sc_cond_timedwait(&uplink->cond, &uplink->mutex,
+                                          uplink->deadline)) {
+                break;
+            }
+        }
+
+        if (uplink->failed || !sc_uplink_can_send(uplink)
+                || (uplink->stopping && sc_tick_now() >= uplink->deadline)) {
+            // Failed, stopped with all the records sent, or drain timeout
+            break;
+        }
+
+        struct sc_uplink_record record = sc_vecdeque_pop(&uplink->queue);
+        uint64_t bytes = SC_UPLINK_HEADER_SIZE + record.size;
+        assert(uplink->queued_bytes >= bytes);
+        uplink->queued_bytes -= bytes;
+        uplink->sent_bytes += bytes;
+
+        sc_mutex_unlock(&uplink->mutex);
+        bool ok = sc_uplink_send_record(uplink, &record);
+        sc_uplink_record_free(&record);
+        sc_mutex_lock(&uplink->mutex);
+
+        if (!ok) {
+            if (!uplink->failed && !uplink->interrupted) {
+                LOGE("Could not send to the aggregator, stopping forwarding");
+                uplink->failed = true;
+            }
+            break;
+        }
+    }
+
+    bool drained = !uplink->failed && sc_vecdeque_is_empty(&uplink->queue);
+    sc_uplink_queue_clear(uplink);
+    sc_mutex_unlock(&uplink->mutex);
+
+    if (drained) {
+        uint8_t end[SC_UPLINK_HEADER_SIZE];
+        sc_uplink_write_header(end, UPLINK_RECORD_END, 0, 0, 0, -1, -1);
+        ssize_t w = net_send_all(uplink->socket, end, sizeof(end));
+        if (w == (ssize_t) sizeof(end)) {
+            sc_mutex_lock(&uplink->mutex);
+            uplink->sent_bytes += sizeof(end);
+            // Wait for the aggregator to consume everything
+            while (!uplink->failed
+                    && uplink->acked_bytes != uplink->sent_bytes) {
+                if (!sc_cond_timedwait(&uplink->cond, &uplink->mutex,
+                                       uplink->deadline)) {
+                    break;
+                }
+            }
+            drained = uplink->acked_bytes == uplink->sent_bytes;
+            sc_mutex_unlock(&uplink->mutex);
+        } else {
+            drained = false;
+        }
+    }
+
+    if (!drained) {
+        LOGW("Not all the records were received by the aggregator");
+    }
+
+    sc_mutex_lock(&uplink->mutex);
+    uplink->finished = true;
+    sc_cond_broadcast(&uplink->cond);
+    sc_mutex_unlock(&uplink->mutex);
+
+    LOGD("Uplink send thread ended");
+    return 0;
+}
+
+static int
+run_uplink_ack(void *data) {
+    struct sc_uplink *uplink = data;
+
+    for (;;) {
+        uint8_t buf[8];
+        ssize_t r = net_recv_all(uplink->socket, buf, sizeof(buf));
+        if (r != (ssize_t) sizeof(buf)) {
+            break;
+        }
+
+        uint64_t acked = sc_read64le(buf);
+
+        sc_mutex_lock(&uplink->mutex);
+        bool valid = acked >= uplink->acked_bytes
+                  && acked <= uplink->sent_bytes;
+        if (valid) {
+            uplink->acked_bytes = acked;
+            sc_cond_broadcast(&uplink->cond);
+        }
+        sc_mutex_unlock(&uplink->mutex);
+
+        if (!valid) {
+            LOGE("Invalid acknowledgement from the aggregator: %" PRIu64,
+                 acked);
+            break;
+        }
+    }
+
+    sc_mutex_lock(&uplink->mutex);
+    if (!uplink->failed && !uplink->finished && !uplink->interrupted) {
+        LOGE("Connection to the aggregator lost, stopping forwarding");
+        uplink->failed = true;
+        sc_uplink_queue_clear(uplink);
+    }
+    sc_cond_broadcast(&uplink->cond);
+    sc_mutex_unlock(&uplink->mutex);
+
+    LOGD("Uplink ack thread ended");
+    return 0;
+}
+
+static bool
+sc_uplink_stream_get_codec_id(enum AVCodecID codec_id, uint32_t *id) {
+    switch (codec_id) {
+        case AV_CODEC_ID_H264:
+            *id = FRAME_CODEC_ID_H264;
+            return true;
+        case AV_CODEC_ID_HEVC:
+            *id = FRAME_CODEC_ID_H265;
+            return true;
+        case AV_CODEC_ID_AV1:
+            *id = FRAME_CODEC_ID_AV1;
+            return true;
+        case AV_CODEC_ID_OPUS:
+            *id = UPLINK_CODEC_ID_OPUS;
+            return true;
+        case AV_CODEC_ID_AAC:
+            *id = UPLINK_CODEC_ID_AAC;
+            return true;
+        case AV_CODEC_ID_FLAC:
+            *id = UPLINK_CODEC_ID_FLAC;
+            return true;
+        case AV_CODEC_ID_PCM_S16LE:
+            *id = UPLINK_CODEC_ID_RAW;
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool
+sc_uplink_stream_packet_sink_open(struct sc_packet_sink *sink,
+                                  AVCodecContext *ctx) {
+    struct sc_uplink_stream *stream = DOWNCAST(sink);
+    struct sc_uplink *uplink = stream->uplink;
+
+    uint32_t codec_id;
+    if (!sc_uplink_stream_get_codec_id(ctx->codec_id, &codec_id)) {
+        LOGE("Unsupported codec for the aggregator: %s",
+             avcodec_get_name(ctx->codec_id));
+        return false;
+    }
+
+    bool audio = stream->id == UPLINK_STREAM_AUDIO;
+    unsigned channels = 0;
+    if (audio) {
+#ifdef SCRCPY_LAVU_HAS_CHLAYOUT
+        channels = ctx->ch_layout.nb_channels;
+#else
+        channels = ctx->channels;
+#endif
+    }
+
+    uint8_t info[sizeof(struct uplink_stream_info)];
+    sc_write32le(&info[0], codec_id);
+    sc_write32le(&info[4], audio ? 0 : ctx->width);
+    sc_write32le(&info[8], audio ? 0 : ctx->height);
+    sc_write32le(&info[12], audio ? ctx->sample_rate : 0);
+    sc_write32le(&info[16], channels);
+
+    // The boot time (without clock synchronization) is retrieved before the
+    // first packet
+    sc_frame_clock_prepare(&stream->clock);
+
+    sc_mutex_lock(&uplink->mutex);
+    // A new stream (after a reconnection) does not follow the dropped records
+    uplink->overflow[stream->id] = false;
+    uplink->discontinuity[stream->id] = false;
+    sc_uplink_queue_locked(uplink, UPLINK_RECORD_STREAM, stream->id, 0, NULL,
+                           info, sizeof(info), -1, -1);
+    sc_mutex_unlock(&uplink->mutex);
+
+    // A forwarding failure never fails the local pipeline
+    return true;
+}
+
+static void
+sc_uplink_stream_packet_sink_close(struct sc_packet_sink *sink) {
+    (void) sink;
+    // Nothing to do, the records are sent until the uplink is stopped
+}
+
+static bool
+sc_uplink_stream_packet_sink_push(struct sc_packet_sink *sink,
+                                  const AVPacket *packet) {
+    struct sc_uplink_stream *stream = DOWNCAST(sink);
+    struct sc_uplink *uplink = stream->uplink;
+
+    uint16_t flags = 0;
+    int64_t pts_us = -1;
+    int64_t timestamp_us = -1;
+    if (packet->pts == AV_NOPTS_VALUE) {
+        flags |= UPLINK_RECORD_FLAG_CONFIG;
+    } else {
+        if (packet->flags & AV_PKT_FLAG_KEY) {
+            flags |= UPLINK_RECORD_FLAG_KEY_FRAME;
+        }
+        pts_us = packet->pts;
+
+        // The capture timestamp exported by the demuxer, if any
+        AVDictionary *metadata = NULL;
+        SC_AV_PACKET_SIDE_DATA_SIZE size;
+        const uint8_t *data =
+            av_packet_get_side_data(packet, AV_PKT_DATA_STRINGS_METADATA,
+                                    &size);
+        if (data && av_packet_unpack_dictionary(data, size, &metadata) < 0) {
+            // Fall back to the PTS
+            metadata = NULL;
+        }
+
+        timestamp_us = sc_frame_clock_get_timestamp_us(&stream->clock,
+                                                       metadata, packet->pts);
+        av_dict_free(&metadata);
+    }
+
+    sc_mutex_lock(&uplink->mutex);
+    sc_uplink_queue_locked(uplink, UPLINK_RECORD_PACKET, stream->id, flags,
+                           packet, NULL, packet->size, pts_us, timestamp_us);
+    sc_mutex_unlock(&uplink->mutex);
+
+    // A forwarding failure never fails the local pipeline
+    return true;
+}
+
+void
+sc_uplink_push_pose(struct sc_uplink *uplink,
+                    const struct pose_sample_record *sample) {
+    uint8_t payload[sizeof(*sample)];
+    memcpy(payload, sample->magic, sizeof(sample->magic));
+    sc_write32le(&payload[4], sample->flags);
+    sc_write64le(&payload[8], (uint64_t) sample->timestamp_us);
+    for (unsigned i = 0; i < 4; ++i) {
+        sc_uplink_write_float(&payload[16 + 4 * i], sample->rotation[i]);
+    }
+    for (unsigned i = 0; i < 3; ++i) {
+        sc_uplink_write_float(&payload[32 + 4 * i], sample->translation[i]);
+    }
+
+    sc_mutex_lock(&uplink->mutex);
+    sc_uplink_queue_locked(uplink, UPLINK_RECORD_POSE, UPLINK_STREAM_POSE, 0,
+                           NULL, payload, sizeof(payload), -1,
+                           sample->timestamp_us);
+    sc_mutex_unlock(&uplink->mutex);
+}
+
+bool
+sc_uplink_init(struct sc_uplink *uplink,
+               const struct sc_uplink_params *params) {
+    bool ok = sc_mutex_init(&uplink->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&uplink->cond);
+    if (!ok) {
+        sc_mutex_destroy(&uplink->mutex);
+        return false;
+    }
+
+    uplink->host = params->host;
+    uplink->port = params->port;
+
+    memset(uplink->hello, 0, sizeof(uplink->hello));
+    memcpy(uplink->hello, UPLINK_MAGIC, sizeof(UPLINK_MAGIC));
+    sc_write32le(&uplink->hello[4], UPLINK_VERSION);
+    // Truncated if too long, NUL-padded
+    size_t node_len = strlen(params->node);
+    size_t node_max = sizeof(uplink->hello) - 8;
+    memcpy(&uplink->hello[8], params->node,
+           node_len < node_max ? node_len : node_max);
+
+    uplink->socket = SC_SOCKET_NONE;
+    sc_vecdeque_init(&uplink->queue);
+    uplink->queued_bytes = 0;
+    uplink->sent_bytes = 0;
+    uplink->acked_bytes = 0;
+    uplink->dropped = 0;
+    uplink->stopping = false;
+    uplink->deadline = 0;
+    uplink->finished = false;
+    uplink->interrupted = false;
+    uplink->failed = false;
+
+    static const struct sc_packet_sink_ops ops = {
+        .open = sc_uplink_stream_packet_sink_open,
+        .close = sc_uplink_stream_packet_sink_close,
+        .push = sc_uplink_stream_packet_sink_push,
+    };
+
+    for (uint8_t i = 0; i < UPLINK_STREAM_COUNT; ++i) {
+        struct sc_uplink_stream *stream = &uplink->streams[i];
+        stream->packet_sink.ops = &ops;
+        stream->uplink = uplink;
+        stream->id = i;
+        sc_frame_clock_init(&stream->clock, params->clock_sync,
+                            params->serial);
+        sc_frame_clock_set_boot_time(&stream->clock,
+                                     params->device_boot_time);
+        uplink->overflow[i] = false;
+        uplink->discontinuity[i] = false;
+    }
+
+    return true;
+}
+
+bool
+sc_uplink_start(struct sc_uplink *uplink) {
+    sc_socket socket = net_socket();
+    if (socket == SC_SOCKET_NONE) {
+        LOGE("Could not create the aggregator socket");
+        return false;
+    }
+
+    bool ok = net_connect(socket, uplink->host, uplink->port);
+    if (!ok) {
+        LOGE("Could not connect to the aggregator");
+        goto error_close_socket;
+    }
+
+    // The records are queued then sent as soon as possible, and the inline
+    // records are small
+    if (!net_set_tcp_nodelay(socket, true)) {
+        LOGW("Could not set TCP_NODELAY on the aggregator socket");
+    }
+
+    ssize_t w = net_send_all(socket, uplink->hello, sizeof(uplink->hello));
+    if (w != (ssize_t) sizeof(uplink->hello)) {
+        LOGE("Could not send the hello to the aggregator");
+        goto error_close_socket;
+    }
+
+    uplink->socket = socket;
+
+    ok = sc_thread_create(&uplink->send_thread, run_uplink_send,
+                          "scrcpy-uplink", uplink);
+    if (!ok) {
+        LOGE("Could not start uplink send thread");
+        goto error_reset_socket;
+    }
+
+    ok = sc_thread_create(&uplink->ack_thread, run_uplink_ack,
+                          "scrcpy-uplink-ack", uplink);
+    if (!ok) {
+        LOGE("Could not start uplink ack thread");
+        sc_mutex_lock(&uplink->mutex);
+        uplink->failed = true;
+        sc_cond_broadcast(&uplink->cond);
+        sc_mutex_unlock(&uplink->mutex);
+        sc_thread_join(&uplink->send_thread, NULL);
+        goto error_reset_socket;
+    }
+
+    uint32_t host = uplink->host;
+    LOGI("Forwarding to the aggregator %" PRIu32 ".%" PRIu32 ".%" PRIu32
+         ".%" PRIu32 ":%" PRIu16, host >> 24, (host >> 16) & 0xFF,
+         (host >> 8) & 0xFF, host & 0xFF, uplink->port);
+
+    return true;
+
+error_reset_socket:
+    uplink->socket = SC_SOCKET_NONE;
+error_close_socket:
+    net_close(socket);
+    return false;
+}
+
+void
+sc_uplink_stop(struct sc_uplink *uplink) {
+    sc_mutex_lock(&uplink->mutex);
+    if (!uplink->stopping) {
+        uplink->stopping = true;
+        uplink->deadline = sc_tick_now() + SC_UPLINK_DRAIN_TIMEOUT;
+        sc_cond_broadcast(&uplink->cond);
+    }
+    sc_mutex_unlock(&uplink->mutex);
+}
+
+void
+sc_uplink_join(struct sc_uplink *uplink) {
+    // The send thread may be blocked on a full socket: give it until the
+    // deadline to send the queued records, then interrupt the socket
+    sc_mutex_lock(&uplink->mutex);
+    assert(uplink->stopping);
+    while (!uplink->finished) {
+        if (!sc_cond_timedwait(&uplink->cond, &uplink->mutex,
+                               uplink->deadline)) {
+            break;
+        }
+    }
+    // Also wake up the ack thread
+    uplink->interrupted = true;
+    sc_mutex_unlock(&uplink->mutex);
+
+    net_interrupt(uplink->socket);
+
+    sc_thread_join(&uplink->send_thread, NULL);
+    sc_thread_join(&uplink->ack_thread, NULL);
+}
+
+void
+sc_uplink_destroy(struct sc_uplink *uplink) {
+    if (uplink->dropped) {
+        LOGW("Records not forwarded to the aggregator: %" PRIu64,
+             uplink->dropped);
+    }
+
+    if (uplink->socket != SC_SOCKET_NONE) {
+        net_close(uplink->socket);
+    }
+    sc_uplink_queue_clear(uplink);
+    sc_vecdeque_destroy(&uplink->queue);
+    sc_cond_destroy(&uplink->cond);
+    sc_mutex_destroy(&uplink->mutex);
+}
@@ -0,0 +1,132 @@
+#ifndef SC_UPLINK_H
+#define SC_UPLINK_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "clock_sync.h"
+#include "frame_clock.h"
+#include "frame_header.h"
+#include "trait/packet_sink.h"
+#include "util/net.h"
+#include "util/thread.h"
+#include "util/tick.h"
+#include "util/vecdeque.h"
+
+// Maximum number of record bytes queued for sending (beyond, the records are
+// dropped)
+#define SC_UPLINK_MAX_BYTES (64 * 1024 * 1024)
+// Delay to send the queued records once stopped
+#define SC_UPLINK_DRAIN_TIMEOUT SC_TICK_FROM_SEC(2)
+
+struct sc_uplink;
+
+// One of the streams forwarded to the aggregator, fed by a demuxer
+struct sc_uplink_stream {
+    struct sc_packet_sink packet_sink; // packet sink trait
+
+    struct sc_uplink *uplink;
+    uint8_t id; // UPLINK_STREAM_*
+
+    // Only accessed from the demuxer thread
+    struct sc_frame_clock clock;
+};
+
+struct sc_uplink_record {
+    uint8_t header[sizeof(struct uplink_record_header)]; // serialized
+    AVPacket *packet; // the payload, or NULL if inline
+    uint8_t payload[sizeof(struct pose_sample_record)]; // inline payload
+    uint32_t size; // payload size
+    bool budgeted; // accounted in the memory budget
+};
+
+struct sc_uplink_record_queue SC_VECDEQUE(struct sc_uplink_record);
+
+/**
+ * Forwarding of the encoded packets, with their capture timestamps, and of
+ * the pose samples to a central aggregator (--aggregator), so that the
+ * streams of several capture nodes are gathered (and decoded) on a single
+ * machine
+ *
+ * All the streams are multiplexed on a single TCP connection (see struct
+ * uplink_hello in frame_header.h). The packets are queued by reference from
+ * the demuxer threads, and sent by a dedicated thread, within the window
+ * acknowledged by the aggregator, so that a slow aggregator never blocks the
+ * local pipeline: the records are dropped instead.
+ *
+ * A connection failure is not fatal: it is reported, and the next records are
+ * discarded.
+ */
+struct sc_uplink {
+    struct sc_uplink_stream streams[UPLINK_STREAM_COUNT];
+
+    uint32_t host;
+    uint16_t port;
+    uint8_t hello[sizeof(struct uplink_hello)]; // serialized
+
+    sc_socket socket;
+    sc_thread send_thread;
+    sc_thread ack_thread;
+
+    sc_mutex mutex;
+    sc_cond cond; // queue, acknowledgements or state changed
+    struct sc_uplink_record_queue queue;
+    uint64_t queued_bytes;
+    uint64_t sent_bytes; // headers included
+    uint64_t acked_bytes;
+    // Per stream: dropping the video packets until the next key frame
+    bool overflow[UPLINK_STREAM_COUNT];
+    // Per stream: the next record follows dropped records
+    bool discontinuity[UPLINK_STREAM_COUNT];
+    uint64_t dropped;
+    bool stopping; // send the remaining records, then end
+    sc_tick deadline; // to send the remaining records once stopping
+    bool finished; // the send thread has ended
+    bool interrupted; // the socket is interrupted on join
+    bool failed; // the connection is lost
+};
+
+struct sc_uplink_params {
+    uint32_t host;
+    uint16_t port;
+    const char *node;
+    struct sc_clock_sync *clock_sync; // may be NULL
+    const char *serial;
+    int64_t device_boot_time; // 0 if unknown
+};
+
+bool
+sc_uplink_init(struct sc_uplink *uplink,
+               const struct sc_uplink_params *params);
+
+// Connect to the aggregator, and start sending
+bool
+sc_uplink_start(struct sc_uplink *uplink);
+
+// The packet sink to add to the demuxer of a stream (UPLINK_STREAM_*)
+static inline struct sc_packet_sink *
+sc_uplink_get_sink(struct sc_uplink *uplink, uint8_t stream) {
+    assert(stream < UPLINK_STREAM_COUNT && stream != UPLINK_STREAM_POSE);
+    return &uplink->streams[stream].packet_sink;
+}
+
+/**
+ * Forward a pose sample (called from the receiver thread)
+ */
+void
+sc_uplink_push_pose(struct sc_uplink *uplink,
+                    const struct pose_sample_record *sample);
+
+// Stop once the queued records are sent (within SC_UPLINK_DRAIN_TIMEOUT)
+void
+sc_uplink_stop(struct sc_uplink *uplink);
+
+void
+sc_uplink_join(struct sc_uplink *uplink);
+
+void
+sc_uplink_destroy(struct sc_uplink *uplink);
+
+#endif
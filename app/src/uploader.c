@@ -0,0 +1,398 @@
+#include "uploader.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/file.h"
+#include "util/log.h"
+
+#define PART_SUFFIX ".part"
+
+struct sc_upload_file {
+    char *path;
+    char *target; // "<directory>/<name>.part"
+    struct sc_file_mapping mapping; // data is NULL until opened
+    int fd; // of the target, -1 until opened
+    uint64_t size;
+    unsigned part_count;
+    // Protected by the uploader mutex once the first part is written
+    unsigned next_part; // the next part to claim
+    unsigned done_parts;
+    bool failed;
+    struct sc_upload_file *next; // in the active list
+};
+
+static void
+sc_upload_file_free(struct sc_upload_file *file) {
+    free(file->target);
+    free(file->path);
+    free(file);
+}
+
+static const char *
+get_file_name(const char *path) {
+    const char *name = strrchr(path, '/');
+#ifdef _WIN32
+    const char *bs = strrchr(path, '\\');
+    if (bs && (!name || bs > name)) {
+        name = bs;
+    }
+#endif
+    return name ? name + 1 : path;
+}
+
+bool
+sc_uploader_init(struct sc_uploader *uploader,
+                 const struct sc_uploader_params *params) {
+    assert(params->directory);
+    assert(params->thread_count
+            && params->thread_count <= SC_UPLOADER_MAX_THREADS);
+
+    bool ok = sc_mutex_init(&uploader->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&uploader->queue_cond);
+    if (!ok) {
+        sc_mutex_destroy(&uploader->mutex);
+        return false;
+    }
+
+    uploader->directory = params->directory;
+    uploader->max_rate = params->max_rate;
+    uploader->delete_local = params->delete_local;
+    uploader->thread_count = params->thread_count;
+    uploader->started_count = 0;
+
+    sc_vecdeque_init(&uploader->queue);
+    uploader->active = NULL;
+    uploader->uploading = 0;
+    uploader->stopped = false;
+    uploader->next_write = 0;
+
+    uploader->uploaded_files = 0;
+    uploader->uploaded_bytes = 0;
+    uploader->failed_files = 0;
+
+    return true;
+}
+
+void
+sc_uploader_destroy(struct sc_uploader *uploader) {
+    // Only remaining if the threads have not been started
+    while (!sc_vecdeque_is_empty(&uploader->queue)) {
+        sc_upload_file_free(sc_vecdeque_pop(&uploader->queue));
+    }
+    sc_vecdeque_destroy(&uploader->queue);
+    assert(!uploader->active);
+
+    if (uploader->uploaded_files || uploader->failed_files) {
+        LOGI("Uploaded %" PRIu64 " files (%" PRIu64 " MiB) to %s, %" PRIu64
+             " failed", uploader->uploaded_files,
+             uploader->uploaded_bytes >> 20, uploader->directory,
+             uploader->failed_files);
+    }
+
+    sc_cond_destroy(&uploader->queue_cond);
+    sc_mutex_destroy(&uploader->mutex);
+}
+
+bool
+sc_uploader_push(struct sc_uploader *uploader, const char *path) {
+    struct sc_upload_file *file = malloc(sizeof(*file));
+    if (!file) {
+        LOG_OOM();
+        return false;
+    }
+
+    file->path = strdup(path);
+    if (!file->path) {
+        LOG_OOM();
+        free(file);
+        return false;
+    }
+
+    const char *name = get_file_name(path);
+    size_t len = strlen(uploader->directory) + 1 + strlen(name)
+               + sizeof(PART_SUFFIX);
+    file->target = malloc(len);
+    if (!file->target) {
+        LOG_OOM();
+        free(file->path);
+        free(file);
+        return false;
+    }
+    snprintf(file->target, len, "%s/%s" PART_SUFFIX, uploader->directory,
+             name);
+
+    file->mapping.data = NULL;
+    file->fd = -1;
+    file->size = 0;
+    file->part_count = 0;
+    file->next_part = 0;
+    file->done_parts = 0;
+    file->failed = false;
+    file->next = NULL;
+
+    sc_mutex_lock(&uploader->mutex);
+    bool ok = sc_vecdeque_push(&uploader->queue, file);
+    if (!ok) {
+        sc_mutex_unlock(&uploader->mutex);
+        LOG_OOM();
+        sc_upload_file_free(file);
+        return false;
+    }
+    ++uploader->uploading;
+    // The cond is also waited on for pacing, wake up an idle thread for sure
+    sc_cond_broadcast(&uploader->queue_cond);
+    sc_mutex_unlock(&uploader->mutex);
+
+    return true;
+}
+
+// Map the file and create its target, once its first part is claimed
+static bool
+sc_upload_file_open(struct sc_upload_file *file) {
+    if (!sc_file_map(file->path, &file->mapping)) {
+        LOGE("Upload: could not read %s", file->path);
+        file->mapping.data = NULL;
+        return false;
+    }
+
+    file->fd = sc_file_open_write(file->target);
+    if (file->fd == -1) {
+        // Logged by sc_file_open_write()
+        return false;
+    }
+
+    file->size = file->mapping.size;
+    file->part_count = (file->size + SC_UPLOADER_PART_SIZE - 1)
+                     / SC_UPLOADER_PART_SIZE;
+    assert(file->part_count);
+    return true;
+}
+
+// Wait until `size` more bytes may be written without exceeding max_rate
+static void
+sc_uploader_pace(struct sc_uploader *uploader, size_t size) {
+    if (!uploader->max_rate) {
+        return;
+    }
+
+    sc_mutex_lock(&uploader->mutex);
+    sc_tick now = sc_tick_now();
+    sc_tick start = MAX(now, uploader->next_write);
+    // The next write waits for the time this one takes at max_rate
+    uploader->next_write =
+        start + (sc_tick) (size * SC_TICK_FREQ / uploader->max_rate);
+    while (sc_tick_now() < start) {
+        // Woken up early on push, wait again
+        sc_cond_timedwait(&uploader->queue_cond, &uploader->mutex, start);
+    }
+    sc_mutex_unlock(&uploader->mutex);
+}
+
+static bool
+sc_upload_file_write_part(struct sc_uploader *uploader,
+                          struct sc_upload_file *file, unsigned part) {
+    const uint8_t *data = file->mapping.data;
+    uint64_t offset = part * SC_UPLOADER_PART_SIZE;
+    uint64_t end = MIN(offset + SC_UPLOADER_PART_SIZE, file->size);
+
+    while (offset < end) {
+        size_t size = MIN(end - offset, SC_UPLOADER_CHUNK_SIZE);
+        sc_uploader_pace(uploader, size);
+        if (!sc_file_write_at(file->fd, data + offset, size, offset)) {
+            LOGE("Upload: could not write %s", file->target);
+            return false;
+        }
+        offset += size;
+    }
+
+    return true;
+}
+
+// Rename the target once all its parts are written (or remove it on failure)
+static void
+sc_upload_file_finish(struct sc_uploader *uploader,
+                      struct sc_upload_file *file) {
+    bool ok = !file->failed;
+
+    if (file->fd != -1) {
+        sc_file_close(file->fd);
+    }
+    if (file->mapping.data) {
+        // Before the local file may be deleted (required on Windows)
+        sc_file_unmap(&file->mapping);
+    }
+
+    if (ok) {
+        // Strip the suffix of the target
+        size_t len = strlen(file->target) - (sizeof(PART_SUFFIX) - 1);
+        char *final_path = strdup(file->target);
+        if (final_path) {
+            final_path[len] = '\0';
+#ifdef _WIN32
+            // rename() does not replace an existing file on Windows
+            remove(final_path);
+#endif
+            if (rename(file->target, final_path)) {
+                LOGE("Upload: could not rename %s", file->target);
+                ok = false;
+            }
+            free(final_path);
+        } else {
+            LOG_OOM();
+            ok = false;
+        }
+    }
+
+    if (!ok && file->fd != -1) {
+        remove(file->target);
+    }
+
+    if (ok) {
+        LOGD("Uploaded %s", file->path);
+        if (uploader->delete_local && remove(file->path)) {
+            LOGW("Upload: could not delete %s", file->path);
+        }
+    }
+
+    sc_mutex_lock(&uploader->mutex);
+    if (ok) {
+        ++uploader->uploaded_files;
+        uploader->uploaded_bytes += file->size;
+    } else {
+        ++uploader->failed_files;
+    }
+    assert(uploader->uploading);
+    --uploader->uploading;
+    sc_mutex_unlock(&uploader->mutex);
+
+    sc_upload_file_free(file);
+}
+
+// Append a file to the list of the files having parts to claim
+static void
+sc_uploader_activate(struct sc_uploader *uploader,
+                     struct sc_upload_file *file) {
+    struct sc_upload_file **p = &uploader->active;
+    while (*p) {
+        p = &(*p)->next;
+    }
+    file->next = NULL;
+    *p = file;
+}
+
+static int
+run_uploader(void *data) {
+    struct sc_uploader *uploader = data;
+
+    for (;;) {
+        sc_mutex_lock(&uploader->mutex);
+
+        while (!uploader->stopped && !uploader->active
+                && sc_vecdeque_is_empty(&uploader->queue)) {
+            sc_cond_wait(&uploader->queue_cond, &uploader->mutex);
+        }
+
+        if (!uploader->active && sc_vecdeque_is_empty(&uploader->queue)) {
+            // Stopped, and all the parts are claimed
+            sc_mutex_unlock(&uploader->mutex);
+            break;
+        }
+
+        // Finish the files already open first, so that they are renamed
+        // (and deleted locally) as soon as possible
+        struct sc_upload_file *file;
+        unsigned part;
+        if (uploader->active) {
+            file = uploader->active;
+            part = file->next_part++;
+            if (file->next_part == file->part_count) {
+                // All its parts are claimed
+                uploader->active = file->next;
+            }
+        } else {
+            file = sc_vecdeque_pop(&uploader->queue);
+            part = 0;
+        }
+
+        sc_mutex_unlock(&uploader->mutex);
+
+        if (!part) {
+            // The file is not visible to the other threads while it is opened
+            if (!sc_upload_file_open(file)) {
+                file->failed = true;
+                sc_upload_file_finish(uploader, file);
+                continue;
+            }
+
+            file->next_part = 1;
+            if (file->part_count > 1) {
+                // Let the other threads write the next parts concurrently
+                sc_mutex_lock(&uploader->mutex);
+                sc_uploader_activate(uploader, file);
+                sc_cond_broadcast(&uploader->queue_cond);
+                sc_mutex_unlock(&uploader->mutex);
+            }
+        }
+
+        bool ok = sc_upload_file_write_part(uploader, file, part);
+
+        sc_mutex_lock(&uploader->mutex);
+        if (!ok) {
+            file->failed = true;
+        }
+        bool last = ++file->done_parts == file->part_count;
+        sc_mutex_unlock(&uploader->mutex);
+
+        if (last) {
+            sc_upload_file_finish(uploader, file);
+        }
+    }
+
+    LOGD("Uploader thread ended");
+    return 0;
+}
+
+bool
+sc_uploader_start(struct sc_uploader *uploader) {
+    LOGD("Starting uploader (%u threads)", uploader->thread_count);
+
+    for (unsigned i = 0; i < uploader->thread_count; ++i) {
+        bool ok = sc_thread_create(&uploader->threads[i], run_uploader,
+                                   "scrcpy-upload", uploader);
+        if (!ok) {
+            LOGE("Could not start uploader thread");
+            break;
+        }
+        ++uploader->started_count;
+    }
+
+    // The threads already started are stopped and joined as usual
+    return uploader->started_count > 0;
+}
+
+void
+sc_uploader_stop(struct sc_uploader *uploader) {
+    sc_mutex_lock(&uploader->mutex);
+    uploader->stopped = true;
+    if (uploader->uploading) {
+        LOGI("Waiting for %u uploads to %s", uploader->uploading,
+             uploader->directory);
+    }
+    sc_cond_broadcast(&uploader->queue_cond);
+    sc_mutex_unlock(&uploader->mutex);
+}
+
+void
+sc_uploader_join(struct sc_uploader *uploader) {
+    for (unsigned i = 0; i < uploader->started_count; ++i) {
+        sc_thread_join(&uploader->threads[i], NULL);
+    }
+}
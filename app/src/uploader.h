@@ -0,0 +1,103 @@
+#ifndef SC_UPLOADER_H
+#define SC_UPLOADER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/thread.h"
+#include "util/tick.h"
+#include "util/vecdeque.h"
+
+#define SC_UPLOADER_MAX_THREADS 8
+// Size of the parts of a file, copied concurrently by the threads
+#define SC_UPLOADER_PART_SIZE ((uint64_t) 64 << 20) // 64 MiB
+// Size of each write to the destination (the unit of the pacing)
+#define SC_UPLOADER_CHUNK_SIZE (4 << 20) // 4 MiB
+
+struct sc_upload_file;
+
+struct sc_uploader_queue SC_VECDEQUE(struct sc_upload_file *);
+
+/**
+ * Uploader of the finished capture files to a network storage (--upload-dir)
+ *
+ * The recorder (each finished segment with --record-segment) and the frame
+ * writer (each saved frame, or the archive once closed) push their finished
+ * files, which are copied to the destination directory (typically a SMB or
+ * NFS mount) by a pool of threads while the capture continues.
+ *
+ * Each file is mapped in memory and split into parts of
+ * SC_UPLOADER_PART_SIZE, written concurrently by the threads at their offsets
+ * (so that several writes are in flight even for a single large archive), in
+ * chunks of SC_UPLOADER_CHUNK_SIZE. It is written as "<name>.part", and
+ * renamed once complete, so that the readers of the destination never see a
+ * partial file. The local file is then deleted if requested.
+ *
+ * With a maximum rate, the writes of all the threads are paced so that the
+ * upload does not saturate the network.
+ *
+ * Only the paths are queued, the queue is not bounded: if the network is
+ * slower than the capture, the backlog remains on the local disk. On stop,
+ * the files already queued are still uploaded before the threads terminate.
+ */
+struct sc_uploader {
+    const char *directory;
+    uint64_t max_rate; // in bytes per second, 0 if unbounded
+    bool delete_local;
+
+    unsigned thread_count;
+    unsigned started_count;
+    sc_thread threads[SC_UPLOADER_MAX_THREADS];
+
+    sc_mutex mutex;
+    sc_cond queue_cond;
+    // The files not opened yet, in the order pushed
+    struct sc_uploader_queue queue;
+    // The files opened, whose parts are not all claimed yet (linked list)
+    struct sc_upload_file *active;
+    unsigned uploading; // number of files pushed and not finished
+    bool stopped;
+    sc_tick next_write; // with max_rate, earliest time of the next write
+
+    // Statistics, logged on destroy
+    uint64_t uploaded_files;
+    uint64_t uploaded_bytes;
+    uint64_t failed_files;
+};
+
+struct sc_uploader_params {
+    const char *directory;
+    uint64_t max_rate; // in bytes per second, 0 if unbounded
+    bool delete_local;
+    unsigned thread_count; // in [1, SC_UPLOADER_MAX_THREADS]
+};
+
+bool
+sc_uploader_init(struct sc_uploader *uploader,
+                 const struct sc_uploader_params *params);
+
+void
+sc_uploader_destroy(struct sc_uploader *uploader);
+
+bool
+sc_uploader_start(struct sc_uploader *uploader);
+
+// The files already queued are still uploaded
+void
+sc_uploader_stop(struct sc_uploader *uploader);
+
+void
+sc_uploader_join(struct sc_uploader *uploader);
+
+/**
+ * Queue a finished file to be uploaded
+ *
+ * It may be called from any thread, and never blocks on the network. The path
+ * is copied. The file must not be modified anymore.
+ */
+bool
+sc_uploader_push(struct sc_uploader *uploader, const char *path);
+
+#endif
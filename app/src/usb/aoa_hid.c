@@ -3,9 +3,11 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "aoa_hid.h"
 #include "events.h"
+#include "metrics.h"
 #include "util/log.h"
 #include "util/str.h"
 #include "util/vector.h"
@@ -18,8 +20,12 @@
 
 #define DEFAULT_TIMEOUT 1000
 
-// Drop droppable events above this limit
-#define SC_AOA_EVENT_QUEUE_LIMIT 60
+// Interval between two reports of the HID injection latency
+#define SC_AOA_LATENCY_PERIOD SC_TICK_FROM_SEC(5)
+
+// Maximum duration of a libusb event handling by the AOA thread (it is
+// interrupted on new events anyway)
+#define SC_AOA_USB_EVENTS_TIMEOUT_US 100000
 
 struct sc_vec_hid_ids SC_VECTOR(uint16_t);
 
@@ -57,12 +63,7 @@ sc_hid_close_log(const struct sc_hid_close *hid_close) {
 bool
 sc_aoa_init(struct sc_aoa *aoa, struct sc_usb *usb,
             struct sc_acksync *acksync) {
-    sc_vecdeque_init(&aoa->queue);
-
-    // Add 4 to support 4 non-droppable events without re-allocation
-    if (!sc_vecdeque_reserve(&aoa->queue, SC_AOA_EVENT_QUEUE_LIMIT + 4)) {
-        return false;
-    }
+    sc_vecdeque_init_inline(&aoa->queue);
 
     if (!sc_mutex_init(&aoa->mutex)) {
         sc_vecdeque_destroy(&aoa->queue);
@@ -75,15 +76,51 @@ sc_aoa_init(struct sc_aoa *aoa, struct sc_usb *usb,
         return false;
     }
 
+    unsigned i;
+    for (i = 0; i < SC_AOA_MAX_TRANSFERS; ++i) {
+        struct sc_aoa_transfer *t = &aoa->transfers[i];
+        t->transfer = libusb_alloc_transfer(0);
+        if (!t->transfer) {
+            LOG_OOM();
+            goto error_free_transfers;
+        }
+        t->aoa = aoa;
+        t->submitted = false;
+        aoa->free_transfers[i] = t;
+    }
+    aoa->free_count = SC_AOA_MAX_TRANSFERS;
+    aoa->usb_wakeup = 0;
+
+    aoa->latency.since = sc_tick_now();
+    aoa->latency.count = 0;
+    aoa->latency.total = 0;
+    aoa->latency.max = 0;
+
     aoa->stopped = false;
     aoa->acksync = acksync;
     aoa->usb = usb;
 
     return true;
+
+error_free_transfers:
+    while (i--) {
+        libusb_free_transfer(aoa->transfers[i].transfer);
+    }
+    sc_cond_destroy(&aoa->event_cond);
+    sc_mutex_destroy(&aoa->mutex);
+    sc_vecdeque_destroy(&aoa->queue);
+
+    return false;
 }
 
 void
 sc_aoa_destroy(struct sc_aoa *aoa) {
+    // The AOA thread waits for the completion of all the transfers on exit
+    assert(aoa->free_count == SC_AOA_MAX_TRANSFERS);
+    for (unsigned i = 0; i < SC_AOA_MAX_TRANSFERS; ++i) {
+        libusb_free_transfer(aoa->transfers[i].transfer);
+    }
+
     sc_vecdeque_destroy(&aoa->queue);
 
     sc_cond_destroy(&aoa->event_cond);
@@ -151,9 +188,75 @@ sc_aoa_set_hid_report_desc(struct sc_aoa *aoa, uint16_t accessory_id,
     return true;
 }
 
-static bool
-sc_aoa_send_hid_event(struct sc_aoa *aoa,
-                      const struct sc_hid_input *hid_input) {
+static void
+sc_aoa_report_latency(struct sc_aoa *aoa, sc_tick latency, sc_tick now) {
+    // Called with the mutex locked
+    struct sc_aoa_latency *l = &aoa->latency;
+    ++l->count;
+    l->total += latency;
+    if (latency > l->max) {
+        l->max = latency;
+    }
+
+    if (now - l->since < SC_AOA_LATENCY_PERIOD) {
+        return;
+    }
+
+    sc_tick avg = l->total / (sc_tick) l->count;
+    LOGD("HID injection latency: avg %" PRItick " us, max %" PRItick " us "
+         "(%" PRIu64 " inputs)", SC_TICK_TO_US(avg), SC_TICK_TO_US(l->max),
+         l->count);
+    sc_metrics_set(SC_METRIC_HID_LATENCY_US, SC_TICK_TO_US(avg));
+
+    l->since = now;
+    l->count = 0;
+    l->total = 0;
+    l->max = 0;
+}
+
+static void LIBUSB_CALL
+sc_aoa_on_hid_event_sent(struct libusb_transfer *transfer) {
+    // Called from the thread handling the libusb events (the AOA thread or
+    // the libusb event thread)
+    struct sc_aoa_transfer *t = transfer->user_data;
+    struct sc_aoa *aoa = t->aoa;
+
+    sc_tick now = sc_tick_now();
+    bool ok = transfer->status == LIBUSB_TRANSFER_COMPLETED;
+    if (!ok && transfer->status != LIBUSB_TRANSFER_CANCELLED) {
+        LOGW("Could not send HID event to USB device: %" PRIu16 " (%s)",
+             t->hid_id, libusb_error_name(transfer->status));
+        if (transfer->status == LIBUSB_TRANSFER_NO_DEVICE) {
+            sc_usb_check_disconnected(aoa->usb, LIBUSB_ERROR_NO_DEVICE);
+        }
+    } else if (ok && sc_get_log_level() <= SC_LOG_LEVEL_VERBOSE) {
+        // Realtime timestamp, to align the input log with the recorded
+        // frames
+        LOGV("HID input sent: [%" PRIu16 "] at %" PRItick " us "
+             "(latency %" PRItick " us)", t->hid_id,
+             SC_TICK_TO_US(sc_tick_now_realtime()),
+             SC_TICK_TO_US(now - t->timestamp));
+    }
+
+    sc_mutex_lock(&aoa->mutex);
+    if (ok) {
+        sc_aoa_report_latency(aoa, now - t->timestamp, now);
+    }
+    t->submitted = false;
+    assert(aoa->free_count < SC_AOA_MAX_TRANSFERS);
+    aoa->free_transfers[aoa->free_count++] = t;
+    aoa->usb_wakeup = 1;
+    sc_mutex_unlock(&aoa->mutex);
+}
+
+static struct sc_aoa_transfer *
+sc_aoa_prepare_hid_event(struct sc_aoa *aoa,
+                         const struct sc_hid_input *hid_input,
+                         sc_tick timestamp) {
+    // Called with the mutex locked
+    assert(aoa->free_count);
+    struct sc_aoa_transfer *t = aoa->free_transfers[--aoa->free_count];
+
     uint8_t request_type = LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR;
     uint8_t request = ACCESSORY_SEND_HID_EVENT;
     // <https://source.android.com/devices/accessories/aoa2.html#hid-support>
@@ -161,20 +264,72 @@ sc_aoa_send_hid_event(struct sc_aoa *aoa,
     // index (arg1): 0 (unused)
     uint16_t value = hid_input->hid_id;
     uint16_t index = 0;
-    unsigned char *data = (uint8_t *) hid_input->data; // discard const
     uint16_t length = hid_input->size;
-    int result = libusb_control_transfer(aoa->usb->handle, request_type,
-                                         request, value, index, data, length,
-                                         DEFAULT_TIMEOUT);
+    assert(length <= SC_HID_MAX_SIZE);
+    libusb_fill_control_setup(t->buffer, request_type, request, value, index,
+                              length);
+    memcpy(t->buffer + LIBUSB_CONTROL_SETUP_SIZE, hid_input->data, length);
+    libusb_fill_control_transfer(t->transfer, aoa->usb->handle, t->buffer,
+                                 sc_aoa_on_hid_event_sent, t, DEFAULT_TIMEOUT);
+
+    t->submitted = true;
+    t->hid_id = hid_input->hid_id;
+    t->timestamp = timestamp;
+    return t;
+}
+
+static bool
+sc_aoa_submit_hid_event(struct sc_aoa *aoa, struct sc_aoa_transfer *t) {
+    // The completion is notified asynchronously, so several HID events may be
+    // in flight
+    int result = libusb_submit_transfer(t->transfer);
     if (result < 0) {
         LOGE("SEND_HID_EVENT: libusb error: %s", libusb_strerror(result));
         sc_usb_check_disconnected(aoa->usb, result);
+
+        sc_mutex_lock(&aoa->mutex);
+        t->submitted = false;
+        aoa->free_transfers[aoa->free_count++] = t;
+        sc_mutex_unlock(&aoa->mutex);
         return false;
     }
 
     return true;
 }
 
+static void
+sc_aoa_handle_usb_events(struct sc_aoa *aoa) {
+    // Called with the mutex locked, to wait for the completion of the HID
+    // events in flight, or for new events to process
+    aoa->usb_wakeup = 0;
+    sc_mutex_unlock(&aoa->mutex);
+
+    // If the libusb event thread is already handling the events, this waits
+    // for it to complete them
+    struct timeval tv = {
+        .tv_sec = 0,
+        .tv_usec = SC_AOA_USB_EVENTS_TIMEOUT_US,
+    };
+    int result = libusb_handle_events_timeout_completed(aoa->usb->context,
+                                                        &tv, &aoa->usb_wakeup);
+    if (result < 0 && result != LIBUSB_ERROR_INTERRUPTED) {
+        LOGW("Handle USB events: libusb error: %s", libusb_strerror(result));
+    }
+
+    sc_mutex_lock(&aoa->mutex);
+}
+
+static void
+sc_aoa_wakeup(struct sc_aoa *aoa) {
+    // Called with the mutex locked
+    sc_cond_signal(&aoa->event_cond);
+    if (aoa->free_count < SC_AOA_MAX_TRANSFERS) {
+        // The AOA thread may be handling libusb events
+        aoa->usb_wakeup = 1;
+        libusb_interrupt_event_handler(aoa->usb->context);
+    }
+}
+
 static bool
 sc_aoa_unregister_hid(struct sc_aoa *aoa, uint16_t accessory_id) {
     uint8_t request_type = LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR;
@@ -218,6 +373,20 @@ sc_aoa_setup_hid(struct sc_aoa *aoa, uint16_t accessory_id,
     return true;
 }
 
+static bool
+sc_aoa_input_is_superseded_by(const struct sc_aoa_event *event,
+                              const struct sc_hid_input *hid_input,
+                              uint64_t ack_to_wait) {
+    // Both inputs must only change absolute values of the same device, so
+    // that sending the last one is equivalent to sending both
+    return event->type == SC_AOA_EVENT_TYPE_INPUT
+        && event->input.hid.coalescable
+        && hid_input->coalescable
+        && event->input.hid.hid_id == hid_input->hid_id
+        && event->input.ack_to_wait == SC_SEQUENCE_INVALID
+        && ack_to_wait == SC_SEQUENCE_INVALID;
+}
+
 bool
 sc_aoa_push_input_with_ack_to_wait(struct sc_aoa *aoa,
                                    const struct sc_hid_input *hid_input,
@@ -226,12 +395,21 @@ sc_aoa_push_input_with_ack_to_wait(struct sc_aoa *aoa,
         sc_hid_input_log(hid_input);
     }
 
+    sc_tick now = sc_tick_now();
+
     sc_mutex_lock(&aoa->mutex);
 
     bool pushed = false;
 
     size_t size = sc_vecdeque_size(&aoa->queue);
-    if (size < SC_AOA_EVENT_QUEUE_LIMIT) {
+    struct sc_aoa_event *last =
+        size ? sc_vecdeque_peekref_back(&aoa->queue) : NULL;
+    if (last && sc_aoa_input_is_superseded_by(last, hid_input, ack_to_wait)) {
+        // The last input is not sent yet, replace it (keep its timestamp to
+        // measure the delay since the first coalesced input)
+        last->input.hid = *hid_input;
+        pushed = true;
+    } else if (size < SC_AOA_EVENT_QUEUE_LIMIT) {
         bool was_empty = sc_vecdeque_is_empty(&aoa->queue);
 
         struct sc_aoa_event *aoa_event =
@@ -239,10 +417,11 @@ sc_aoa_push_input_with_ack_to_wait(struct sc_aoa *aoa,
         aoa_event->type = SC_AOA_EVENT_TYPE_INPUT;
         aoa_event->input.hid = *hid_input;
         aoa_event->input.ack_to_wait = ack_to_wait;
+        aoa_event->input.timestamp = now;
         pushed = true;
 
         if (was_empty) {
-            sc_cond_signal(&aoa->event_cond);
+            sc_aoa_wakeup(aoa);
         }
     }
     // Otherwise, the event is discarded
@@ -276,7 +455,7 @@ sc_aoa_push_open(struct sc_aoa *aoa, const struct sc_hid_open *hid_open,
     aoa_event->open.exit_on_error = exit_on_open_error;
 
     if (was_empty) {
-        sc_cond_signal(&aoa->event_cond);
+        sc_aoa_wakeup(aoa);
     }
 
     sc_mutex_unlock(&aoa->mutex);
@@ -306,7 +485,7 @@ sc_aoa_push_close(struct sc_aoa *aoa, const struct sc_hid_close *hid_close) {
     aoa_event->close.hid = *hid_close;
 
     if (was_empty) {
-        sc_cond_signal(&aoa->event_cond);
+        sc_aoa_wakeup(aoa);
     }
 
     sc_mutex_unlock(&aoa->mutex);
@@ -343,12 +522,14 @@ sc_aoa_process_event(struct sc_aoa *aoa, struct sc_aoa_event *event,
                 }
             }
 
-            struct sc_hid_input *hid_input = &event->input.hid;
-            bool ok = sc_aoa_send_hid_event(aoa, hid_input);
-            if (!ok) {
-                LOGW("Could not send HID event to USB device: %" PRIu16,
-                     hid_input->hid_id);
-            }
+            sc_mutex_lock(&aoa->mutex);
+            struct sc_aoa_transfer *t =
+                sc_aoa_prepare_hid_event(aoa, &event->input.hid,
+                                         event->input.timestamp);
+            sc_mutex_unlock(&aoa->mutex);
+
+            // On error, the event is discarded
+            sc_aoa_submit_hid_event(aoa, t);
 
             break;
         }
@@ -398,6 +579,31 @@ sc_aoa_process_event(struct sc_aoa *aoa, struct sc_aoa_event *event,
     return true;
 }
 
+static bool
+sc_aoa_is_async_input(const struct sc_aoa_event *event) {
+    // An input waiting for an ack must not be sent before the ack is
+    // received, so it is processed on its own
+    return event->type == SC_AOA_EVENT_TYPE_INPUT
+        && event->input.ack_to_wait == SC_SEQUENCE_INVALID;
+}
+
+static bool
+sc_aoa_has_ready_event(struct sc_aoa *aoa) {
+    // Called with the mutex locked
+    if (sc_vecdeque_is_empty(&aoa->queue)) {
+        return false;
+    }
+
+    const struct sc_aoa_event *event = sc_vecdeque_peekref(&aoa->queue);
+    if (sc_aoa_is_async_input(event)) {
+        return aoa->free_count > 0;
+    }
+
+    // The other events are processed synchronously, once all the HID events
+    // in flight are completed, to preserve the order
+    return aoa->free_count == SC_AOA_MAX_TRANSFERS;
+}
+
 static int
 run_aoa_thread(void *data) {
     struct sc_aoa *aoa = data;
@@ -407,8 +613,13 @@ run_aoa_thread(void *data) {
 
     for (;;) {
         sc_mutex_lock(&aoa->mutex);
-        while (!aoa->stopped && sc_vecdeque_is_empty(&aoa->queue)) {
-            sc_cond_wait(&aoa->event_cond, &aoa->mutex);
+        while (!aoa->stopped && !sc_aoa_has_ready_event(aoa)) {
+            if (aoa->free_count < SC_AOA_MAX_TRANSFERS) {
+                // Process the completion of the HID events in flight
+                sc_aoa_handle_usb_events(aoa);
+            } else {
+                sc_cond_wait(&aoa->event_cond, &aoa->mutex);
+            }
         }
         if (aoa->stopped) {
             // Stop immediately, do not process further events
@@ -417,6 +628,28 @@ run_aoa_thread(void *data) {
         }
 
         assert(!sc_vecdeque_is_empty(&aoa->queue));
+        if (sc_aoa_is_async_input(sc_vecdeque_peekref(&aoa->queue))) {
+            // Send all the pending inputs at once, within the limit of the
+            // transfers in flight
+            struct sc_aoa_transfer *batch[SC_AOA_MAX_TRANSFERS];
+            unsigned count = 0;
+            while (aoa->free_count && !sc_vecdeque_is_empty(&aoa->queue)
+                    && sc_aoa_is_async_input(
+                            sc_vecdeque_peekref(&aoa->queue))) {
+                struct sc_aoa_event *event = sc_vecdeque_popref(&aoa->queue);
+                batch[count++] =
+                    sc_aoa_prepare_hid_event(aoa, &event->input.hid,
+                                             event->input.timestamp);
+            }
+            sc_mutex_unlock(&aoa->mutex);
+
+            for (unsigned i = 0; i < count; ++i) {
+                // On error, the event is discarded
+                sc_aoa_submit_hid_event(aoa, batch[i]);
+            }
+            continue;
+        }
+
         struct sc_aoa_event event = sc_vecdeque_pop(&aoa->queue);
         sc_mutex_unlock(&aoa->mutex);
 
@@ -427,6 +660,21 @@ run_aoa_thread(void *data) {
         }
     }
 
+    // Cancel the HID events in flight, and wait for their completion before
+    // the transfers are released
+    sc_mutex_lock(&aoa->mutex);
+    for (unsigned i = 0; i < SC_AOA_MAX_TRANSFERS; ++i) {
+        struct sc_aoa_transfer *t = &aoa->transfers[i];
+        if (t->submitted) {
+            // May fail if the transfer is already complete
+            libusb_cancel_transfer(t->transfer);
+        }
+    }
+    while (aoa->free_count < SC_AOA_MAX_TRANSFERS) {
+        sc_aoa_handle_usb_events(aoa);
+    }
+    sc_mutex_unlock(&aoa->mutex);
+
     // Explicitly unregister all registered HID ids before exiting
     for (size_t i = 0; i < vec_open.size; ++i) {
         uint16_t hid_id = vec_open.data[i];
@@ -458,7 +706,7 @@ void
 sc_aoa_stop(struct sc_aoa *aoa) {
     sc_mutex_lock(&aoa->mutex);
     aoa->stopped = true;
-    sc_cond_signal(&aoa->event_cond);
+    sc_aoa_wakeup(aoa);
     sc_mutex_unlock(&aoa->mutex);
 
     if (aoa->acksync) {
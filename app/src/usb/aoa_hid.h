@@ -32,11 +32,40 @@ struct sc_aoa_event {
         struct {
             struct sc_hid_input hid;
             uint64_t ack_to_wait;
+            // When the input was pushed, to measure the delay until it is sent
+            sc_tick timestamp;
         } input;
     };
 };
 
-struct sc_aoa_event_queue SC_VECDEQUE(struct sc_aoa_event);
+// Drop droppable events above this limit
+#define SC_AOA_EVENT_QUEUE_LIMIT 60
+
+// Add 4 to support 4 non-droppable events without allocation
+struct sc_aoa_event_queue
+    SC_VECDEQUE_INLINE(struct sc_aoa_event, SC_AOA_EVENT_QUEUE_LIMIT + 4);
+
+// Maximum number of HID inputs sent concurrently (in flight)
+#define SC_AOA_MAX_TRANSFERS 8
+
+struct sc_aoa;
+
+struct sc_aoa_transfer {
+    struct sc_aoa *aoa;
+    struct libusb_transfer *transfer;
+    bool submitted;
+    uint16_t hid_id;
+    // When the input was pushed, to measure the injection latency
+    sc_tick timestamp;
+    unsigned char buffer[LIBUSB_CONTROL_SETUP_SIZE + SC_HID_MAX_SIZE];
+};
+
+struct sc_aoa_latency {
+    sc_tick since; // start of the current report period
+    uint64_t count;
+    sc_tick total;
+    sc_tick max;
+};
 
 struct sc_aoa {
     struct sc_usb *usb;
@@ -46,6 +75,15 @@ struct sc_aoa {
     bool stopped;
     struct sc_aoa_event_queue queue;
 
+    // HID inputs are sent asynchronously, without waiting for the previous
+    // ones to complete (protected by the mutex)
+    struct sc_aoa_transfer transfers[SC_AOA_MAX_TRANSFERS];
+    struct sc_aoa_transfer *free_transfers[SC_AOA_MAX_TRANSFERS];
+    unsigned free_count;
+    // Set to interrupt the libusb event handling of the AOA thread
+    int usb_wakeup;
+    struct sc_aoa_latency latency;
+
     struct sc_acksync *acksync;
 };
 
@@ -0,0 +1,215 @@
+#include "alloc_stats.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "log.h"
+#include "thread.h"
+
+#ifndef __GLIBC__
+# error "alloc_stats requires glibc"
+#endif
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+struct sc_alloc_counter {
+    // Alone on its cache line, the subsystems run on different threads
+    _Alignas(64) atomic_uint_least64_t count;
+    atomic_uint_least64_t bytes;
+};
+
+static const char *const subsystem_names[] = {
+    [SC_ALLOC_OTHER] = "other",
+    [SC_ALLOC_DEMUXER] = "demuxer",
+    [SC_ALLOC_DECODER] = "decoder",
+    [SC_ALLOC_SCREEN] = "screen",
+    [SC_ALLOC_PREPROCESS] = "preprocess",
+    [SC_ALLOC_WRITER] = "writer",
+    [SC_ALLOC_RECORDER] = "recorder",
+};
+
+static_assert(ARRAY_LEN(subsystem_names) == SC_ALLOC_SUBSYSTEM_COUNT,
+              "missing subsystem names");
+
+static struct sc_alloc_counter counters[SC_ALLOC_SUBSYSTEM_COUNT];
+
+static _Thread_local enum sc_alloc_subsystem current_subsystem;
+
+static struct {
+    bool enabled;
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped; // protected by the mutex
+} report;
+
+static inline void
+count_alloc(size_t size) {
+    struct sc_alloc_counter *counter = &counters[current_subsystem];
+    atomic_fetch_add_explicit(&counter->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&counter->bytes, size, memory_order_relaxed);
+}
+
+void *
+malloc(size_t size) {
+    count_alloc(size);
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t n, size_t size) {
+    count_alloc(n * size);
+    return __libc_calloc(n, size);
+}
+
+void *
+realloc(void *ptr, size_t size) {
+    count_alloc(size);
+    return __libc_realloc(ptr, size);
+}
+
+int
+posix_memalign(void **ptr, size_t alignment, size_t size) {
+    count_alloc(size);
+    void *p = __libc_memalign(alignment, size);
+    if (!p) {
+        return ENOMEM;
+    }
+    *ptr = p;
+    return 0;
+}
+
+void *
+aligned_alloc(size_t alignment, size_t size) {
+    count_alloc(size);
+    return __libc_memalign(alignment, size);
+}
+
+enum sc_alloc_subsystem
+sc_alloc_stats_enter(enum sc_alloc_subsystem subsystem) {
+    assert(subsystem < SC_ALLOC_SUBSYSTEM_COUNT);
+    enum sc_alloc_subsystem previous = current_subsystem;
+    current_subsystem = subsystem;
+    return previous;
+}
+
+void
+sc_alloc_stats_leave(enum sc_alloc_subsystem previous) {
+    assert(previous < SC_ALLOC_SUBSYSTEM_COUNT);
+    current_subsystem = previous;
+}
+
+static void
+print_report(uint64_t last_counts[], uint64_t last_bytes[]) {
+    char buf[512];
+    size_t len = 0;
+    for (unsigned i = 0; i < SC_ALLOC_SUBSYSTEM_COUNT; ++i) {
+        uint64_t count = atomic_load_explicit(&counters[i].count,
+                                              memory_order_relaxed);
+        uint64_t bytes = atomic_load_explicit(&counters[i].bytes,
+                                              memory_order_relaxed);
+        int r = snprintf(buf + len, sizeof(buf) - len,
+                         "%s%s %" PRIu64 " (%" PRIu64 " KiB)", len ? ", " : "",
+                         subsystem_names[i], count - last_counts[i],
+                         (bytes - last_bytes[i]) / 1024);
+        last_counts[i] = count;
+        last_bytes[i] = bytes;
+        if (r < 0 || (size_t) r >= sizeof(buf) - len) {
+            break;
+        }
+        len += r;
+    }
+
+    LOGI("Allocations per second: %s", buf);
+}
+
+static int
+run_alloc_stats(void *data) {
+    (void) data;
+
+    // The reports are attributed to "other"
+    uint64_t last_counts[SC_ALLOC_SUBSYSTEM_COUNT] = {0};
+    uint64_t last_bytes[SC_ALLOC_SUBSYSTEM_COUNT] = {0};
+
+    sc_tick deadline = sc_tick_now() + SC_ALLOC_STATS_INTERVAL;
+
+    sc_mutex_lock(&report.mutex);
+    for (;;) {
+        while (!report.stopped
+                && sc_cond_timedwait(&report.cond, &report.mutex, deadline)) {
+            // spurious wake-up
+        }
+
+        if (report.stopped) {
+            break;
+        }
+
+        sc_mutex_unlock(&report.mutex);
+        print_report(last_counts, last_bytes);
+        deadline += SC_ALLOC_STATS_INTERVAL;
+        sc_mutex_lock(&report.mutex);
+    }
+    sc_mutex_unlock(&report.mutex);
+
+    return 0;
+}
+
+bool
+sc_alloc_stats_init(void) {
+    assert(!report.enabled);
+
+    bool ok = sc_mutex_init(&report.mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&report.cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    report.stopped = false;
+
+    ok = sc_thread_create(&report.thread, run_alloc_stats, "scrcpy-allocs",
+                          NULL);
+    if (!ok) {
+        LOGE("Could not start allocation stats thread");
+        goto error_destroy_cond;
+    }
+
+    report.enabled = true;
+    return true;
+
+error_destroy_cond:
+    sc_cond_destroy(&report.cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&report.mutex);
+
+    return false;
+}
+
+void
+sc_alloc_stats_destroy(void) {
+    if (!report.enabled) {
+        return;
+    }
+
+    sc_mutex_lock(&report.mutex);
+    report.stopped = true;
+    sc_cond_signal(&report.cond);
+    sc_mutex_unlock(&report.mutex);
+
+    sc_thread_join(&report.thread, NULL);
+
+    sc_cond_destroy(&report.cond);
+    sc_mutex_destroy(&report.mutex);
+    report.enabled = false;
+}
@@ -0,0 +1,82 @@
+#ifndef SC_ALLOC_STATS_H
+#define SC_ALLOC_STATS_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#include "tick.h"
+
+// Interval between the allocation reports
+#define SC_ALLOC_STATS_INTERVAL SC_TICK_FROM_SEC(1)
+
+enum sc_alloc_subsystem {
+    SC_ALLOC_OTHER,
+    SC_ALLOC_DEMUXER,
+    SC_ALLOC_DECODER,
+    SC_ALLOC_SCREEN, // the main thread, once the screen is initialized
+    SC_ALLOC_PREPROCESS, // the video processor
+    SC_ALLOC_WRITER, // the frame writer
+    SC_ALLOC_RECORDER,
+    SC_ALLOC_SUBSYSTEM_COUNT,
+};
+
+/**
+ * Accounting of the heap allocations per subsystem (meson option alloc_stats,
+ * glibc only)
+ *
+ * The allocator is interposed, so that all the allocations are counted,
+ * including those of FFmpeg, SDL and OpenCV. Each allocation is attributed to
+ * the subsystem of the current thread, set when the thread starts, or
+ * explicitly around the synchronous calls into another subsystem (the decoder
+ * is called from the demuxer thread).
+ *
+ * The number of allocations and bytes per subsystem is logged every
+ * SC_ALLOC_STATS_INTERVAL, to verify that the frame paths reach zero
+ * steady-state allocations.
+ *
+ * Without the build option, these functions do nothing.
+ */
+
+#ifdef ALLOC_STATS
+/**
+ * Start the periodic reports
+ */
+bool
+sc_alloc_stats_init(void);
+
+void
+sc_alloc_stats_destroy(void);
+
+/**
+ * Attribute the next allocations of the current thread to the subsystem
+ *
+ * Return the previous subsystem, to be restored by sc_alloc_stats_leave().
+ */
+enum sc_alloc_subsystem
+sc_alloc_stats_enter(enum sc_alloc_subsystem subsystem);
+
+void
+sc_alloc_stats_leave(enum sc_alloc_subsystem previous);
+#else
+static inline bool
+sc_alloc_stats_init(void) {
+    return true;
+}
+
+static inline void
+sc_alloc_stats_destroy(void) {}
+
+static inline enum sc_alloc_subsystem
+sc_alloc_stats_enter(enum sc_alloc_subsystem subsystem) {
+    (void) subsystem;
+    return SC_ALLOC_OTHER;
+}
+
+static inline void
+sc_alloc_stats_leave(enum sc_alloc_subsystem previous) {
+    (void) previous;
+}
+#endif
+
+#endif
@@ -116,3 +116,28 @@ sc_audiobuf_write(struct sc_audiobuf *buf, const void *from_,
 
     return samples_count;
 }
+
+uint32_t
+sc_audiobuf_reserve(struct sc_audiobuf *buf, uint8_t **data) {
+    // Only the writer thread can write head
+    uint32_t head = atomic_load_explicit(&buf->head, memory_order_relaxed);
+
+    // The tail cursor is updated after the data is consumed by the reader
+    uint32_t tail = atomic_load_explicit(&buf->tail, memory_order_acquire);
+
+    uint32_t can_write = (buf->alloc_size + tail - head - 1) % buf->alloc_size;
+    uint32_t right_count = buf->alloc_size - head;
+
+    *data = buf->data + (head * buf->sample_size);
+    return MIN(can_write, right_count);
+}
+
+void
+sc_audiobuf_commit(struct sc_audiobuf *buf, uint32_t samples_count) {
+    uint32_t head = atomic_load_explicit(&buf->head, memory_order_relaxed);
+    assert(samples_count <= buf->alloc_size - head);
+
+    // Publish the samples written by the caller
+    uint32_t new_head = (head + samples_count) % buf->alloc_size;
+    atomic_store_explicit(&buf->head, new_head, memory_order_release);
+}
@@ -49,6 +49,25 @@ uint32_t
 sc_audiobuf_write(struct sc_audiobuf *buf, const void *from,
                   uint32_t samples_count);
 
+/**
+ * Reserve the contiguous space available for writing at the writer cursor
+ *
+ * The samples may be produced directly into *data (up to the returned count),
+ * then published by sc_audiobuf_commit(). Since the space may wrap around the
+ * end of the array, a second reservation may return the remaining space.
+ *
+ * Like sc_audiobuf_write(), it must only be called from the writer thread.
+ */
+uint32_t
+sc_audiobuf_reserve(struct sc_audiobuf *buf, uint8_t **data);
+
+/**
+ * Publish the samples written into the space returned by the last
+ * sc_audiobuf_reserve()
+ */
+void
+sc_audiobuf_commit(struct sc_audiobuf *buf, uint32_t samples_count);
+
 static inline uint32_t
 sc_audiobuf_capacity(struct sc_audiobuf *buf) {
     assert(buf->alloc_size);
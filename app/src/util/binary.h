@@ -6,6 +6,7 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 static inline void
 sc_write16be(uint8_t *buf, uint16_t value) {
@@ -64,6 +65,28 @@ sc_read64be(const uint8_t *buf) {
     return ((uint64_t) msb << 32) | lsb;
 }
 
+static inline uint32_t
+sc_read32le(const uint8_t *buf) {
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t) buf[3] << 24);
+}
+
+static inline uint64_t
+sc_read64le(const uint8_t *buf) {
+    uint32_t lsb = sc_read32le(buf);
+    uint32_t msb = sc_read32le(&buf[4]);
+    return ((uint64_t) msb << 32) | lsb;
+}
+
+// Read a 32-bit IEEE 754 float (as written by Java DataOutputStream)
+static inline float
+sc_readfloatbe(const uint8_t *buf) {
+    static_assert(sizeof(float) == 4, "float must be 32-bit");
+    uint32_t bits = sc_read32be(buf);
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
 /**
  * Convert a float between 0 and 1 to an unsigned 16-bit fixed-point value
  */
@@ -0,0 +1,22 @@
+#ifndef SC_CRC32C_H
+#define SC_CRC32C_H
+
+#include "common.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * CRC-32C (Castagnoli polynomial, as computed by the SSE4.2 and ARMv8 crc32c
+ * instructions, which are used when available)
+ *
+ * The CRC of data split into several parts is computed by passing the result
+ * for the previous parts as `crc` (0 for the first part):
+ *
+ *     crc = sc_crc32c(0, a, a_len);
+ *     crc = sc_crc32c(crc, b, b_len); // the CRC of a followed by b
+ */
+uint32_t
+sc_crc32c(uint32_t crc, const void *data, size_t len);
+
+#endif
@@ -4,6 +4,8 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef _WIN32
 # define SC_PATH_SEPARATOR '\\'
@@ -40,10 +42,164 @@ sc_file_get_executable_path(void);
 char *
 sc_file_get_local_path(const char *name);
 
+/**
+ * Return the absolute path of a file in the temporary directory of the user
+ *
+ * The file is not created. The result must be freed by the caller using
+ * free(). It may return NULL on error.
+ */
+char *
+sc_file_get_temp_path(const char *name);
+
 /**
  * Indicate if the file exists and is not a directory
  */
 bool
 sc_file_is_regular(const char *path);
 
+/**
+ * Read-only memory mapping of a whole file
+ */
+struct sc_file_mapping {
+    const void *data;
+    size_t size;
+#ifdef _WIN32
+    void *handle; // HANDLE of the file mapping object
+#endif
+};
+
+/**
+ * Map a whole file in memory (read-only)
+ *
+ * The mapping must be released by sc_file_unmap().
+ */
+bool
+sc_file_map(const char *path, struct sc_file_mapping *mapping);
+
+void
+sc_file_unmap(struct sc_file_mapping *mapping);
+
+struct sc_file_chunk {
+    const void *data;
+    size_t size;
+};
+
+// Default size requested for the kernel buffer of a pipe output (the system
+// may grant less, see sc_file_open_output())
+#define SC_FILE_OUTPUT_PIPE_SIZE (8 << 20)
+
+// Maximum number of overlapped writes in flight on a named pipe output created
+// by scrcpy (Windows)
+#define SC_FILE_OUTPUT_MAX_PENDING 4
+
+/**
+ * Redirect sc_file_write_output() from stdout to `target`
+ *
+ * The target is either "fd:N", an inherited file descriptor, or a path. On
+ * Windows, a path of the form \\.\pipe\name creates a named pipe and waits
+ * for a client to connect; on other systems, opening a FIFO waits for a
+ * reader. If the target is a pipe, its kernel buffer is enlarged up to
+ * `buffer_size` bytes (SC_FILE_OUTPUT_PIPE_SIZE if 0).
+ *
+ * On Windows, the named pipes created by scrcpy are written asynchronously
+ * (overlapped I/O), with up to SC_FILE_OUTPUT_MAX_PENDING writes in flight:
+ * sc_file_write_output() copies the records and returns without waiting for
+ * the client to read them. A write error may then only be reported by one of
+ * the next calls.
+ *
+ * It must be called before any write.
+ */
+bool
+sc_file_open_output(const char *target, uint32_t buffer_size);
+
+/**
+ * Write all the chunks to the output (stdout, unless redirected by
+ * sc_file_open_output()), in order, with as few system calls as possible
+ *
+ * The stdio buffers are bypassed, so if the output is stdout, it must not be
+ * written via stdio concurrently (see sc_log_reserve_stdout()).
+ */
+bool
+sc_file_write_output(const struct sc_file_chunk *chunks, size_t count);
+
+/**
+ * Wait for the writes in flight, and close the output if it was redirected by
+ * sc_file_open_output()
+ *
+ * Return false if a write failed.
+ */
+bool
+sc_file_close_output(void);
+
+/**
+ * Open a file for writing (created, or truncated if it exists)
+ *
+ * Return a file descriptor, or -1 on error.
+ */
+int
+sc_file_open_write(const char *path);
+
+// Alignment of the buffers, the offsets and the sizes of the writes to a file
+// opened by sc_file_open_direct() (the largest logical sector size)
+#define SC_FILE_DIRECT_ALIGNMENT 4096
+
+/**
+ * Open a file for writing (created, or truncated if it exists), bypassing the
+ * page cache: O_DIRECT on Linux, F_NOCACHE on macOS, FILE_FLAG_NO_BUFFERING
+ * (and FILE_FLAG_WRITE_THROUGH) on Windows
+ *
+ * The data is transferred to the disk directly from the buffers passed to
+ * sc_file_write_at(), so their address, their size and the file offset must
+ * be multiples of SC_FILE_DIRECT_ALIGNMENT.
+ *
+ * Return -1 if the platform or the file system does not support it (e.g.
+ * tmpfs), or on error.
+ */
+int
+sc_file_open_direct(const char *path);
+
+/**
+ * Write all the data at the given offset of the file
+ *
+ * The file position is unspecified afterwards. Several threads may write to
+ * the same file descriptor concurrently, at different offsets.
+ */
+bool
+sc_file_write_at(int fd, const void *data, size_t size, int64_t offset);
+
+/**
+ * Reserve the disk space of the file up to `size` bytes, without changing its
+ * size
+ *
+ * The space reserved beyond the end of the file may be kept after it is
+ * closed: truncate the file to its final size to release it.
+ *
+ * Return false if the file system (or the platform) does not support it.
+ */
+bool
+sc_file_preallocate(int fd, int64_t size);
+
+/**
+ * Extend the file to `size` bytes without initializing the new space, so that
+ * writing beyond the previous end never waits for the file system to fill the
+ * gap with zeros (SetFileValidData())
+ *
+ * The content of the new space is whatever was on the disk: the file must be
+ * truncated to the size actually written before it is closed.
+ *
+ * Only implemented on Windows, where it requires the SE_MANAGE_VOLUME_NAME
+ * privilege (granted to the administrators). Return false otherwise.
+ */
+bool
+sc_file_extend_uninitialized(int fd, int64_t size);
+
+/**
+ * Set the size of the file (releasing the disk space reserved beyond)
+ */
+bool
+sc_file_truncate(int fd, int64_t size);
+
+void
+sc_file_close(int fd);
+
 #endif
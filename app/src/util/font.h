@@ -0,0 +1,28 @@
+#ifndef SC_FONT_H
+#define SC_FONT_H
+
+#include "common.h"
+
+#include <stdint.h>
+
+#define SC_FONT_GLYPH_COLS 5
+#define SC_FONT_GLYPH_ROWS 7
+
+/**
+ * Built-in 5x7 bitmap font, for the text drawn without font library (the
+ * timestamps of the lite preprocessor, the HUD of the window)
+ *
+ * It covers the digits, the upper-case letters, most lower-case letters and
+ * some punctuation.
+ */
+
+/**
+ * Return the rows of the glyph of `c` (SC_FONT_GLYPH_ROWS items, the most
+ * significant of the 5 bits being the left column)
+ *
+ * The characters not covered are drawn as '?'. It never returns NULL.
+ */
+const uint8_t *
+sc_font_get_glyph(char c);
+
+#endif
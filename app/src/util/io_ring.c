@@ -0,0 +1,238 @@
+#include "io_ring.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "util/log.h"
+
+// The memory shared with the kernel is accessed with explicit barriers
+#define SC_LOAD_ACQUIRE(p) \
+    atomic_load_explicit((_Atomic unsigned *) (p), memory_order_acquire)
+#define SC_STORE_RELEASE(p, v) \
+    atomic_store_explicit((_Atomic unsigned *) (p), (v), memory_order_release)
+
+static int
+sc_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+sc_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                  unsigned flags) {
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                         flags, NULL, 0);
+}
+
+static int
+sc_io_uring_register(int fd, unsigned opcode, const void *arg,
+                     unsigned nr_args) {
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void *
+sc_io_ring_map(int fd, size_t size, off_t offset) {
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, offset);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+bool
+sc_io_ring_init(struct sc_io_ring *ring, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    int fd = sc_io_uring_setup(entries, &p);
+    if (fd < 0) {
+        LOGW("io_uring not available: %s", strerror(errno));
+        return false;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = fd;
+    ring->entries = p.sq_entries;
+
+    ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size =
+        p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && ring->cq_ring_size > ring->sq_ring_size) {
+        ring->sq_ring_size = ring->cq_ring_size;
+    }
+
+    ring->sq_ring = sc_io_ring_map(fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+    if (!ring->sq_ring) {
+        LOGE("Could not map the io_uring submission queue");
+        goto error_close;
+    }
+
+    if (single_mmap) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = sc_io_ring_map(fd, ring->cq_ring_size,
+                                       IORING_OFF_CQ_RING);
+        if (!ring->cq_ring) {
+            LOGE("Could not map the io_uring completion queue");
+            goto error_unmap_sq;
+        }
+    }
+
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = sc_io_ring_map(fd, ring->sqes_size, IORING_OFF_SQES);
+    if (!ring->sqes) {
+        LOGE("Could not map the io_uring submission entries");
+        goto error_unmap_cq;
+    }
+
+    uint8_t *sq = ring->sq_ring;
+    ring->sq_head = (unsigned *) (sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) (sq + p.sq_off.array);
+
+    uint8_t *cq = ring->cq_ring;
+    ring->cq_head = (unsigned *) (cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+    ring->cqes = cq + p.cq_off.cqes;
+
+    return true;
+
+error_unmap_cq:
+    if (ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+error_unmap_sq:
+    munmap(ring->sq_ring, ring->sq_ring_size);
+error_close:
+    close(fd);
+    return false;
+}
+
+void
+sc_io_ring_destroy(struct sc_io_ring *ring) {
+    // Closing the ring waits for the requests in flight, if any
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+bool
+sc_io_ring_register_buffers(struct sc_io_ring *ring, void *const buffers[],
+                            const size_t sizes[], unsigned count) {
+    assert(!ring->inflight && !ring->queued);
+    assert(count <= 16);
+
+    if (ring->buffers_registered) {
+        sc_io_uring_register(ring->fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+        ring->buffers_registered = false;
+    }
+
+    struct iovec iov[16];
+    for (unsigned i = 0; i < count; ++i) {
+        iov[i].iov_base = buffers[i];
+        iov[i].iov_len = sizes[i];
+    }
+
+    if (sc_io_uring_register(ring->fd, IORING_REGISTER_BUFFERS, iov, count)) {
+        // Typically RLIMIT_MEMLOCK on old kernels
+        LOGE("Could not register the io_uring buffers: %s", strerror(errno));
+        return false;
+    }
+
+    ring->buffers_registered = true;
+    return true;
+}
+
+bool
+sc_io_ring_write_fixed(struct sc_io_ring *ring, int fd, const void *data,
+                       size_t size, uint64_t offset, unsigned buf_index,
+                       uint64_t user_data) {
+    assert(ring->buffers_registered);
+    assert(size <= UINT32_MAX);
+
+    unsigned head = SC_LOAD_ACQUIRE(ring->sq_head);
+    unsigned tail = *ring->sq_tail;
+    if (tail - head >= ring->entries) {
+        return false;
+    }
+
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *) ring->sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t) data;
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->buf_index = buf_index;
+    sqe->user_data = user_data;
+
+    ring->sq_array[index] = index;
+    SC_STORE_RELEASE(ring->sq_tail, tail + 1);
+    ++ring->queued;
+    return true;
+}
+
+bool
+sc_io_ring_submit(struct sc_io_ring *ring, unsigned wait_nr) {
+    unsigned to_submit = ring->queued;
+    assert(wait_nr <= ring->inflight + to_submit);
+    if (!to_submit && !wait_nr) {
+        return true;
+    }
+
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    for (;;) {
+        int r = sc_io_uring_enter(ring->fd, to_submit, wait_nr, flags);
+        if (r >= 0) {
+            assert((unsigned) r <= to_submit);
+            ring->queued -= r;
+            ring->inflight += r;
+            to_submit -= r;
+            if (!to_submit) {
+                return true;
+            }
+            // Partially submitted, submit the remaining entries
+            continue;
+        }
+
+        if (errno == EINTR) {
+            continue;
+        }
+
+        // The callers never have more requests in flight than submission
+        // entries, so the completion queue (twice as large) cannot overflow
+        LOGE("io_uring_enter() failed: %s", strerror(errno));
+        return false;
+    }
+}
+
+bool
+sc_io_ring_pop(struct sc_io_ring *ring,
+               struct sc_io_ring_completion *completion) {
+    unsigned head = *ring->cq_head;
+    unsigned tail = SC_LOAD_ACQUIRE(ring->cq_tail);
+    if (head == tail) {
+        return false;
+    }
+
+    const struct io_uring_cqe *cqe =
+        (const struct io_uring_cqe *) ring->cqes + (head & *ring->cq_mask);
+    completion->user_data = cqe->user_data;
+    completion->res = cqe->res;
+
+    SC_STORE_RELEASE(ring->cq_head, head + 1);
+    assert(ring->inflight);
+    --ring->inflight;
+    return true;
+}
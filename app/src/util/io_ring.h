@@ -0,0 +1,99 @@
+#ifndef SC_IO_RING_H
+#define SC_IO_RING_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Minimal io_uring wrapper (Linux only, HAVE_IO_URING), without liburing
+ *
+ * Only the operations needed by the frame writer are supported: writes from
+ * registered buffers, at explicit file offsets.
+ *
+ * A ring is not thread-safe: it must be used from a single thread.
+ */
+struct sc_io_ring {
+    int fd;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring; // may be the same mapping as sq_ring
+    size_t cq_ring_size;
+    void *sqes;
+    size_t sqes_size;
+
+    // Pointers into the mapped rings
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    void *cqes;
+
+    unsigned entries;
+    unsigned queued; // entries queued, not submitted yet
+    unsigned inflight; // entries submitted, not completed yet
+    bool buffers_registered;
+};
+
+struct sc_io_ring_completion {
+    uint64_t user_data;
+    int32_t res; // bytes written, or -errno
+};
+
+/**
+ * Create a ring of `entries` submission entries
+ *
+ * Return false if io_uring is not available (e.g. an old kernel, or disabled
+ * by seccomp or by /proc/sys/kernel/io_uring_disabled).
+ */
+bool
+sc_io_ring_init(struct sc_io_ring *ring, unsigned entries);
+
+void
+sc_io_ring_destroy(struct sc_io_ring *ring);
+
+/**
+ * Register (pin) the buffers used by sc_io_ring_write_fixed()
+ *
+ * The buffers previously registered, if any, are unregistered first. There
+ * must be no write in flight.
+ */
+bool
+sc_io_ring_register_buffers(struct sc_io_ring *ring, void *const buffers[],
+                            const size_t sizes[], unsigned count);
+
+/**
+ * Queue a write of `size` bytes from the registered buffer `buf_index`, at
+ * `offset` in the file `fd`
+ *
+ * The write is only started by the next sc_io_ring_submit(). Return false if
+ * the submission queue is full (submit and wait for completions first).
+ */
+bool
+sc_io_ring_write_fixed(struct sc_io_ring *ring, int fd, const void *data,
+                       size_t size, uint64_t offset, unsigned buf_index,
+                       uint64_t user_data);
+
+/**
+ * Submit the queued entries (if any), then wait until at least `wait_nr`
+ * completions are available
+ */
+bool
+sc_io_ring_submit(struct sc_io_ring *ring, unsigned wait_nr);
+
+/**
+ * Pop a completion, without waiting
+ *
+ * Return false if there is none.
+ */
+bool
+sc_io_ring_pop(struct sc_io_ring *ring,
+               struct sc_io_ring_completion *completion);
+
+#endif
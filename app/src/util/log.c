@@ -4,8 +4,24 @@
 # include <windows.h>
 #endif
 #include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <libavformat/avformat.h>
 
+#include "util/thread.h"
+#include "util/tick.h"
+
+// Number of pending messages (must be a power of 2)
+#define SC_LOG_RING_SIZE 256
+// Longer messages (rare) are printed synchronously
+#define SC_LOG_MESSAGE_MAX 1024
+// Maximum delay before a message is printed if a wake-up is missed
+#define SC_LOG_DRAIN_PERIOD SC_TICK_FROM_MS(100)
+// Delay before reporting that the last message has been repeated
+#define SC_LOG_REPEAT_PERIOD SC_TICK_FROM_SEC(1)
+
 static SDL_LogPriority
 log_level_sc_to_sdl(enum sc_log_level level) {
     switch (level) {
@@ -134,17 +150,248 @@ static const char *const sc_sdl_log_priority_names[SDL_NUM_LOG_PRIORITIES] = {
     [SDL_LOG_PRIORITY_CRITICAL] = "CRITICAL",
 };
 
+static bool sc_log_stdout_reserved = false;
+
+struct sc_log_entry {
+    // Bounded MPMC queue sequence: the entry at position pos is writable when
+    // seq == pos, and readable when seq == pos + 1
+    atomic_size_t seq;
+    SDL_LogPriority priority;
+    char message[SC_LOG_MESSAGE_MAX];
+};
+
+static struct {
+    struct sc_log_entry entries[SC_LOG_RING_SIZE];
+    atomic_size_t head; // next position to write (any thread)
+    size_t tail; // next position to read (log thread only)
+    atomic_size_t dropped;
+
+    // Set while the messages are pushed to the ring
+    atomic_bool running;
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped;
+
+    // Protect the console output (log thread, synchronous logs and
+    // sc_log_reserve_stdout())
+    sc_mutex print_mutex;
+    // Set once print_mutex is initialized (it is never destroyed)
+    atomic_bool print_locked;
+
+    // Last printed message, to collapse the repetitions (log thread only)
+    SDL_LogPriority last_priority;
+    char last_message[SC_LOG_MESSAGE_MAX];
+    unsigned repeated;
+    sc_tick repeat_start;
+} sc_log_ring;
+
+static void
+sc_log_print(SDL_LogPriority priority, const char *message) {
+    assert(priority < SDL_NUM_LOG_PRIORITIES);
+    const char *prio_name = sc_sdl_log_priority_names[priority];
+
+    bool locked = atomic_load_explicit(&sc_log_ring.print_locked,
+                                       memory_order_relaxed);
+    if (locked) {
+        sc_mutex_lock(&sc_log_ring.print_mutex);
+    }
+    FILE *out = priority < SDL_LOG_PRIORITY_WARN && !sc_log_stdout_reserved
+              ? stdout : stderr;
+    fprintf(out, "%s: %s\n", prio_name, message);
+    if (locked) {
+        sc_mutex_unlock(&sc_log_ring.print_mutex);
+    }
+}
+
+// Called from any thread, without blocking on the console output
+//
+// Return false if the message must be printed synchronously instead.
+static bool
+sc_log_push(SDL_LogPriority priority, const char *message) {
+    size_t len = strlen(message);
+    if (len >= SC_LOG_MESSAGE_MAX) {
+        return false;
+    }
+
+    struct sc_log_entry *entry;
+    size_t pos = atomic_load_explicit(&sc_log_ring.head, memory_order_relaxed);
+    for (;;) {
+        entry = &sc_log_ring.entries[pos & (SC_LOG_RING_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+        if (!diff) {
+            if (atomic_compare_exchange_weak_explicit(&sc_log_ring.head, &pos,
+                                                      pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+            // pos has been updated, retry
+        } else if (diff < 0) {
+            // The ring is full: never block the caller, except for the errors
+            // (printed synchronously, rather than lost)
+            if (priority >= SDL_LOG_PRIORITY_ERROR) {
+                return false;
+            }
+            atomic_fetch_add_explicit(&sc_log_ring.dropped, 1,
+                                      memory_order_relaxed);
+            return true;
+        } else {
+            pos = atomic_load_explicit(&sc_log_ring.head,
+                                       memory_order_relaxed);
+        }
+    }
+
+    entry->priority = priority;
+    memcpy(entry->message, message, len + 1);
+    atomic_store_explicit(&entry->seq, pos + 1, memory_order_release);
+
+    // Not under the mutex: a missed wake-up only delays the message until the
+    // next drain period
+    sc_cond_signal(&sc_log_ring.cond);
+    return true;
+}
+
+static void
+sc_log_report_repeated(void) {
+    if (sc_log_ring.repeated) {
+        char report[64];
+        snprintf(report, sizeof(report),
+                 "(last message repeated %u times)", sc_log_ring.repeated);
+        sc_log_print(sc_log_ring.last_priority, report);
+        sc_log_ring.repeated = 0;
+    }
+}
+
+static void
+sc_log_drain(void) {
+    for (;;) {
+        size_t pos = sc_log_ring.tail;
+        struct sc_log_entry *entry =
+            &sc_log_ring.entries[pos & (SC_LOG_RING_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+        if (seq != pos + 1) {
+            // empty
+            break;
+        }
+
+        if (entry->priority == sc_log_ring.last_priority
+                && !strcmp(entry->message, sc_log_ring.last_message)) {
+            // Print the first occurrence only, then the number of repetitions
+            if (!sc_log_ring.repeated++) {
+                sc_log_ring.repeat_start = sc_tick_now();
+            }
+        } else {
+            sc_log_report_repeated();
+            sc_log_print(entry->priority, entry->message);
+            sc_log_ring.last_priority = entry->priority;
+            memcpy(sc_log_ring.last_message, entry->message,
+                   strlen(entry->message) + 1);
+        }
+
+        atomic_store_explicit(&entry->seq, pos + SC_LOG_RING_SIZE,
+                              memory_order_release);
+        sc_log_ring.tail = pos + 1;
+    }
+
+    if (sc_log_ring.repeated
+            && sc_tick_now() - sc_log_ring.repeat_start
+                >= SC_LOG_REPEAT_PERIOD) {
+        sc_log_report_repeated();
+        // The next occurrence is printed again
+        sc_log_ring.last_message[0] = '\0';
+    }
+
+    size_t dropped = atomic_exchange_explicit(&sc_log_ring.dropped, 0,
+                                              memory_order_relaxed);
+    if (dropped) {
+        char report[64];
+        snprintf(report, sizeof(report), "(%zu log messages dropped)",
+                 dropped);
+        sc_log_print(SDL_LOG_PRIORITY_WARN, report);
+    }
+}
+
+static int
+run_log(void *data) {
+    (void) data;
+
+    sc_mutex_lock(&sc_log_ring.mutex);
+    while (!sc_log_ring.stopped) {
+        sc_mutex_unlock(&sc_log_ring.mutex);
+        sc_log_drain();
+        sc_mutex_lock(&sc_log_ring.mutex);
+        if (!sc_log_ring.stopped) {
+            sc_tick deadline = sc_tick_now() + SC_LOG_DRAIN_PERIOD;
+            sc_cond_timedwait(&sc_log_ring.cond, &sc_log_ring.mutex,
+                              deadline);
+        }
+    }
+    sc_mutex_unlock(&sc_log_ring.mutex);
+
+    return 0;
+}
+
 static void SDLCALL
 sc_sdl_log_print(void *userdata, int category, SDL_LogPriority priority,
                  const char *message) {
     (void) userdata;
     (void) category;
 
-    FILE *out = priority < SDL_LOG_PRIORITY_WARN ? stdout : stderr;
-    assert(priority < SDL_NUM_LOG_PRIORITIES);
-    const char *prio_name = sc_sdl_log_priority_names[priority];
-    fprintf(out, "%s: %s\n", prio_name, message);
-    //fprintf(stderr,"%s: %s\n", prio_name, message);
+    if (atomic_load_explicit(&sc_log_ring.running, memory_order_relaxed)
+            && sc_log_push(priority, message)) {
+        return;
+    }
+
+    sc_log_print(priority, message);
+}
+
+static bool
+sc_log_start_thread(void) {
+    for (size_t i = 0; i < SC_LOG_RING_SIZE; ++i) {
+        atomic_init(&sc_log_ring.entries[i].seq, i);
+    }
+    atomic_init(&sc_log_ring.head, 0);
+    sc_log_ring.tail = 0;
+    atomic_init(&sc_log_ring.dropped, 0);
+    sc_log_ring.stopped = false;
+    sc_log_ring.last_message[0] = '\0';
+    sc_log_ring.repeated = 0;
+
+    if (!sc_mutex_init(&sc_log_ring.mutex)) {
+        return false;
+    }
+
+    if (!sc_cond_init(&sc_log_ring.cond)) {
+        goto error_destroy_mutex;
+    }
+
+    if (!sc_mutex_init(&sc_log_ring.print_mutex)) {
+        goto error_destroy_cond;
+    }
+
+    // Set before the thread is started, so that sc_log_print() locks
+    // print_mutex as soon as the output may be concurrent
+    atomic_store(&sc_log_ring.print_locked, true);
+    atomic_store(&sc_log_ring.running, true);
+
+    if (!sc_thread_create(&sc_log_ring.thread, run_log, "scrcpy-log", NULL)) {
+        atomic_store(&sc_log_ring.running, false);
+        atomic_store(&sc_log_ring.print_locked, false);
+        goto error_destroy_print_mutex;
+    }
+
+    return true;
+
+error_destroy_print_mutex:
+    sc_mutex_destroy(&sc_log_ring.print_mutex);
+error_destroy_cond:
+    sc_cond_destroy(&sc_log_ring.cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&sc_log_ring.mutex);
+
+    return false;
 }
 
 void
@@ -152,4 +399,50 @@ sc_log_configure(void) {
     SDL_LogSetOutputFunction(sc_sdl_log_print, NULL);
     // Redirect FFmpeg logs to SDL logs
     av_log_set_callback(sc_av_log_callback);
+
+    if (!sc_log_start_thread()) {
+        LOGW("Could not start the log thread, logging synchronously");
+    }
+}
+
+void
+sc_log_destroy(void) {
+    if (!atomic_load(&sc_log_ring.running)) {
+        return;
+    }
+
+    // From now on, log synchronously (before the thread is stopped, so that
+    // the messages logged meanwhile are not left in the ring)
+    atomic_store(&sc_log_ring.running, false);
+
+    sc_mutex_lock(&sc_log_ring.mutex);
+    sc_log_ring.stopped = true;
+    sc_cond_signal(&sc_log_ring.cond);
+    sc_mutex_unlock(&sc_log_ring.mutex);
+
+    sc_thread_join(&sc_log_ring.thread, NULL);
+
+    // Print the remaining messages, including those pushed by the threads
+    // which read `running` just before it was reset
+    sc_log_drain();
+    sc_log_report_repeated();
+
+    // The mutexes and the cond are not destroyed: the synchronous logs still
+    // lock print_mutex, and a detached thread may have read `running` just
+    // before, and still signal the cond. They live until the process exits.
+}
+
+void
+sc_log_reserve_stdout(void) {
+    bool locked = atomic_load(&sc_log_ring.print_locked);
+    if (locked) {
+        // Wait for the message being printed, if any
+        sc_mutex_lock(&sc_log_ring.print_mutex);
+    }
+    // Flush what has already been logged to stdout
+    fflush(stdout);
+    sc_log_stdout_reserved = true;
+    if (locked) {
+        sc_mutex_unlock(&sc_log_ring.print_mutex);
+    }
 }
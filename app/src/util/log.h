@@ -35,7 +35,30 @@ bool
 sc_log_windows_error(const char *prefix, int error);
 #endif
 
+/**
+ * Redirect the SDL and FFmpeg logs to the scrcpy output
+ *
+ * The messages are queued in a lock-free ring and printed by a background
+ * thread, so that logging never blocks the calling thread on the console I/O.
+ * The consecutive repetitions of a message are collapsed (at most one message
+ * per second). If the ring is full, the messages are dropped (and counted),
+ * except the errors, which are printed synchronously.
+ */
 void
 sc_log_configure(void);
 
+// Print the pending logs and stop the log thread (the next logs are printed
+// synchronously)
+//
+// The threads still running (e.g. detached) may keep logging.
+void
+sc_log_destroy(void);
+
+// Print all the logs to stderr, so that stdout only contains binary output
+// (--pipe-output)
+//
+// It must be called before the threads which may log are started.
+void
+sc_log_reserve_stdout(void);
+
 #endif
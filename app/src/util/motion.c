@@ -0,0 +1,219 @@
+#include "motion.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define SC_MOTION_AVX2
+# include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+# define SC_MOTION_NEON
+# include <arm_neon.h>
+#endif
+
+typedef void (*sc_motion_downscale_row_fn)(const uint8_t *const rows[4],
+                                           uint8_t *dst, int begin, int end);
+typedef uint64_t (*sc_motion_sad_fn)(const uint8_t *a, const uint8_t *b,
+                                     size_t len);
+
+static inline unsigned
+sc_motion_avg(unsigned a, unsigned b) {
+    return (a + b + 1) >> 1;
+}
+
+// Downscale the columns [begin, end) of the destination row
+static void
+sc_motion_downscale_row_scalar(const uint8_t *const rows[4], uint8_t *dst,
+                               int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+        unsigned sum = 0;
+        for (int k = 0; k < SC_MOTION_SCALE; ++k) {
+            int x = i * SC_MOTION_SCALE + k;
+            sum += sc_motion_avg(sc_motion_avg(rows[0][x], rows[1][x]),
+                                 sc_motion_avg(rows[2][x], rows[3][x]));
+        }
+        dst[i] = (sum + 2) >> 2;
+    }
+}
+
+static uint64_t
+sc_motion_sad_scalar(const uint8_t *a, const uint8_t *b, size_t len) {
+    uint64_t sad = 0;
+    for (size_t i = 0; i < len; ++i) {
+        sad += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+    }
+    return sad;
+}
+
+#ifdef SC_MOTION_AVX2
+__attribute__((target("avx2")))
+static void
+sc_motion_downscale_row_avx2(const uint8_t *const rows[4], uint8_t *dst,
+                             int begin, int end) {
+    const __m256i ones8 = _mm256_set1_epi8(1);
+    const __m256i ones16 = _mm256_set1_epi16(1);
+    const __m256i two = _mm256_set1_epi32(2);
+
+    // 32 source columns (8 destination pixels) at a time
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        int x = i * SC_MOTION_SCALE;
+        __m256i r0 = _mm256_loadu_si256((const __m256i *) (rows[0] + x));
+        __m256i r1 = _mm256_loadu_si256((const __m256i *) (rows[1] + x));
+        __m256i r2 = _mm256_loadu_si256((const __m256i *) (rows[2] + x));
+        __m256i r3 = _mm256_loadu_si256((const __m256i *) (rows[3] + x));
+        __m256i v = _mm256_avg_epu8(_mm256_avg_epu8(r0, r1),
+                                    _mm256_avg_epu8(r2, r3));
+
+        // Horizontal sums of 2, then 4 columns
+        __m256i pairs = _mm256_maddubs_epi16(v, ones8);
+        __m256i quads = _mm256_madd_epi16(pairs, ones16);
+        quads = _mm256_srli_epi32(_mm256_add_epi32(quads, two), 2);
+
+        // The 4 results of each 128-bit lane end up in its low 32 bits
+        __m256i p = _mm256_packus_epi16(_mm256_packs_epi32(quads, quads),
+                                        _mm256_setzero_si256());
+        uint32_t lo = (uint32_t) _mm256_cvtsi256_si32(p);
+        uint32_t hi = (uint32_t) _mm256_extract_epi32(p, 4);
+        memcpy(dst + i, &lo, 4);
+        memcpy(dst + i + 4, &hi, 4);
+    }
+
+    sc_motion_downscale_row_scalar(rows, dst, i, end);
+}
+
+__attribute__((target("avx2")))
+static uint64_t
+sc_motion_sad_avx2(const uint8_t *a, const uint8_t *b, size_t len) {
+    __m256i acc = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i *) (a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *) (b + i));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(va, vb));
+    }
+
+    uint64_t sums[4];
+    _mm256_storeu_si256((__m256i *) sums, acc);
+    return sums[0] + sums[1] + sums[2] + sums[3]
+         + sc_motion_sad_scalar(a + i, b + i, len - i);
+}
+
+static bool
+sc_motion_has_avx2(void) {
+    // Cheap: the CPU features are detected once, on startup
+    return __builtin_cpu_supports("avx2");
+}
+#elif defined(SC_MOTION_NEON)
+static void
+sc_motion_downscale_row_neon(const uint8_t *const rows[4], uint8_t *dst,
+                             int begin, int end) {
+    // 32 source columns (8 destination pixels) at a time
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        int x = i * SC_MOTION_SCALE;
+        uint16x4_t halves[2];
+        for (unsigned h = 0; h < 2; ++h) {
+            int hx = x + h * 16;
+            uint8x16_t v =
+                vrhaddq_u8(vrhaddq_u8(vld1q_u8(rows[0] + hx),
+                                      vld1q_u8(rows[1] + hx)),
+                           vrhaddq_u8(vld1q_u8(rows[2] + hx),
+                                      vld1q_u8(rows[3] + hx)));
+            // Horizontal sums of 2, then 4 columns
+            uint32x4_t quads = vpaddlq_u16(vpaddlq_u8(v));
+            halves[h] = vrshrn_n_u32(quads, 2);
+        }
+        vst1_u8(dst + i, vmovn_u16(vcombine_u16(halves[0], halves[1])));
+    }
+
+    sc_motion_downscale_row_scalar(rows, dst, i, end);
+}
+
+static uint64_t
+sc_motion_sad_neon(const uint8_t *a, const uint8_t *b, size_t len) {
+    uint64x2_t acc = vdupq_n_u64(0);
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t d = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+        acc = vpadalq_u32(acc, vpaddlq_u16(vpaddlq_u8(d)));
+    }
+
+    return vaddvq_u64(acc) + sc_motion_sad_scalar(a + i, b + i, len - i);
+}
+#endif
+
+void
+sc_motion_downscale(const uint8_t *src, int linesize, int width, int height,
+                    uint8_t *dst) {
+    assert(width >= 0 && height >= 0);
+
+    sc_motion_downscale_row_fn row_fn = sc_motion_downscale_row_scalar;
+#ifdef SC_MOTION_AVX2
+    if (sc_motion_has_avx2()) {
+        row_fn = sc_motion_downscale_row_avx2;
+    }
+#elif defined(SC_MOTION_NEON)
+    row_fn = sc_motion_downscale_row_neon;
+#endif
+
+    int dst_width = width / SC_MOTION_SCALE;
+    int dst_height = height / SC_MOTION_SCALE;
+    for (int j = 0; j < dst_height; ++j) {
+        const uint8_t *row = src + (ptrdiff_t) j * SC_MOTION_SCALE * linesize;
+        const uint8_t *const rows[4] = {
+            row,
+            row + linesize,
+            row + 2 * (ptrdiff_t) linesize,
+            row + 3 * (ptrdiff_t) linesize,
+        };
+        row_fn(rows, dst + (ptrdiff_t) j * dst_width, 0, dst_width);
+    }
+}
+
+static sc_motion_sad_fn
+sc_motion_select_sad(void) {
+#ifdef SC_MOTION_AVX2
+    if (sc_motion_has_avx2()) {
+        return sc_motion_sad_avx2;
+    }
+#elif defined(SC_MOTION_NEON)
+    return sc_motion_sad_neon;
+#endif
+    return sc_motion_sad_scalar;
+}
+
+uint64_t
+sc_motion_sad(const uint8_t *a, const uint8_t *b, size_t len) {
+    return sc_motion_select_sad()(a, b, len);
+}
+
+uint64_t
+sc_motion_sad_2d(const uint8_t *a, int a_linesize, const uint8_t *b,
+                 int b_linesize, int width, int height) {
+    assert(width >= 0 && height >= 0);
+
+    sc_motion_sad_fn sad_fn = sc_motion_select_sad();
+
+    uint64_t sad = 0;
+    for (int y = 0; y < height; ++y) {
+        sad += sad_fn(a + (ptrdiff_t) y * a_linesize,
+                      b + (ptrdiff_t) y * b_linesize, width);
+    }
+    return sad;
+}
+
+const char *
+sc_motion_simd(void) {
+#ifdef SC_MOTION_AVX2
+    if (sc_motion_has_avx2()) {
+        return "avx2";
+    }
+#elif defined(SC_MOTION_NEON)
+    return "neon";
+#endif
+    return NULL;
+}
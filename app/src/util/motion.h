@@ -0,0 +1,48 @@
+#ifndef SC_MOTION_H
+#define SC_MOTION_H
+
+#include "common.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Downscale factor of sc_motion_downscale(), in both directions
+#define SC_MOTION_SCALE 4
+
+/**
+ * Downscale an 8-bit plane by SC_MOTION_SCALE in both directions (1/16 of the
+ * pixels), to compare frames cheaply
+ *
+ * Each destination pixel is the average of a 4x4 block: the 4 rows are
+ * averaged by pairs, rounded up (as _mm_avg_epu8()), then the 4 columns,
+ * rounded to the nearest. The incomplete blocks on the right and bottom edges
+ * are ignored.
+ *
+ * The destination is (width / 4) x (height / 4), without padding.
+ */
+void
+sc_motion_downscale(const uint8_t *src, int linesize, int width, int height,
+                    uint8_t *dst);
+
+/**
+ * Sum of the absolute differences between the `len` bytes of a and b
+ */
+uint64_t
+sc_motion_sad(const uint8_t *a, const uint8_t *b, size_t len);
+
+/**
+ * Sum of the absolute differences between two blocks of `width` x `height`
+ * bytes, whose rows are separated by `a_linesize` and `b_linesize` bytes
+ */
+uint64_t
+sc_motion_sad_2d(const uint8_t *a, int a_linesize, const uint8_t *b,
+                 int b_linesize, int width, int height);
+
+/**
+ * Return the SIMD instruction set used (e.g. "avx2"), or NULL for the scalar
+ * fallback
+ */
+const char *
+sc_motion_simd(void);
+
+#endif
@@ -19,6 +19,7 @@
 # include <arpa/inet.h>
 # include <unistd.h>
 # include <fcntl.h>
+# include <sys/ioctl.h>
 # define SOCKET_ERROR -1
   typedef struct sockaddr_in SOCKADDR_IN;
   typedef struct sockaddr SOCKADDR;
@@ -123,12 +124,12 @@ net_perror(const char *s) {
 #endif
 }
 
-sc_socket
-net_socket(void) {
+static sc_socket
+net_socket_type(int type) {
 #ifdef HAVE_SOCK_CLOEXEC
-    sc_raw_socket raw_sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sc_raw_socket raw_sock = socket(AF_INET, type | SOCK_CLOEXEC, 0);
 #else
-    sc_raw_socket raw_sock = socket(AF_INET, SOCK_STREAM, 0);
+    sc_raw_socket raw_sock = socket(AF_INET, type, 0);
     if (raw_sock != SC_RAW_SOCKET_NONE && !set_cloexec_flag(raw_sock)) {
         sc_raw_socket_close(raw_sock);
         return SC_SOCKET_NONE;
@@ -142,6 +143,48 @@ net_socket(void) {
     return sock;
 }
 
+sc_socket
+net_socket(void) {
+    return net_socket_type(SOCK_STREAM);
+}
+
+sc_socket
+net_udp_socket(void) {
+    return net_socket_type(SOCK_DGRAM);
+}
+
+bool
+net_bind(sc_socket socket, uint32_t addr, uint16_t port) {
+    sc_raw_socket raw_sock = unwrap(socket);
+
+    SOCKADDR_IN sin;
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(addr); // htonl() harmless on INADDR_ANY
+    sin.sin_port = htons(port);
+
+    if (bind(raw_sock, (SOCKADDR *) &sin, sizeof(sin)) == SOCKET_ERROR) {
+        net_perror("bind");
+        return false;
+    }
+
+    return true;
+}
+
+bool
+net_get_local_port(sc_socket socket, uint16_t *port) {
+    sc_raw_socket raw_sock = unwrap(socket);
+
+    SOCKADDR_IN sin;
+    socklen_t sinsize = sizeof(sin);
+    if (getsockname(raw_sock, (SOCKADDR *) &sin, &sinsize) == SOCKET_ERROR) {
+        net_perror("getsockname");
+        return false;
+    }
+
+    *port = ntohs(sin.sin_port);
+    return true;
+}
+
 bool
 net_connect(sc_socket socket, uint32_t addr, uint16_t port) {
     sc_raw_socket raw_sock = unwrap(socket);
@@ -224,7 +267,12 @@ net_recv_all(sc_socket socket, void *buf, size_t len) {
 ssize_t
 net_send(sc_socket socket, const void *buf, size_t len) {
     sc_raw_socket raw_sock = unwrap(socket);
+#ifdef MSG_NOSIGNAL
+    // Report a closed connection as an error (EPIPE) rather than by SIGPIPE
+    return send(raw_sock, buf, len, MSG_NOSIGNAL);
+#else
     return send(raw_sock, buf, len, 0);
+#endif
 }
 
 ssize_t
@@ -290,6 +338,41 @@ net_set_tcp_nodelay(sc_socket socket, bool tcp_nodelay) {
     return true;
 }
 
+bool
+net_set_recv_buffer_size(sc_socket socket, int size) {
+    sc_raw_socket raw_sock = unwrap(socket);
+
+    int ret = setsockopt(raw_sock, SOL_SOCKET, SO_RCVBUF,
+                         (const void *) &size, sizeof(size));
+    if (ret == -1) {
+        net_perror("setsockopt(SO_RCVBUF)");
+        return false;
+    }
+
+    assert(ret == 0);
+    return true;
+}
+
+bool
+net_get_pending_size(sc_socket socket, size_t *size) {
+    sc_raw_socket raw_sock = unwrap(socket);
+
+#ifdef _WIN32
+    u_long pending;
+    int ret = ioctlsocket(raw_sock, FIONREAD, &pending);
+#else
+    int pending;
+    int ret = ioctl(raw_sock, FIONREAD, &pending);
+#endif
+    if (ret == SOCKET_ERROR) {
+        net_perror("ioctl(FIONREAD)");
+        return false;
+    }
+
+    *size = pending;
+    return true;
+}
+
 bool
 net_parse_ipv4(const char *s, uint32_t *ipv4) {
     struct in_addr addr;
@@ -35,6 +35,17 @@ net_cleanup(void);
 sc_socket
 net_socket(void);
 
+// Datagram socket
+sc_socket
+net_udp_socket(void);
+
+bool
+net_bind(sc_socket socket, uint32_t addr, uint16_t port);
+
+// Retrieve the port the socket is bound to (e.g. an ephemeral port)
+bool
+net_get_local_port(sc_socket socket, uint16_t *port);
+
 bool
 net_connect(sc_socket socket, uint32_t addr, uint16_t port);
 
@@ -71,6 +82,14 @@ net_close(sc_socket socket);
 bool
 net_set_tcp_nodelay(sc_socket socket, bool tcp_nodelay);
 
+// Set the size of the kernel receive buffer (SO_RCVBUF)
+bool
+net_set_recv_buffer_size(sc_socket socket, int size);
+
+// Retrieve the number of bytes received but not read yet (FIONREAD)
+bool
+net_get_pending_size(sc_socket socket, size_t *size);
+
 /**
  * Parse `ip` "xxx.xxx.xxx.xxx" to an IPv4 host representation
  */
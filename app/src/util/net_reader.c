@@ -0,0 +1,80 @@
+#include "net_reader.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+bool
+sc_net_reader_init(struct sc_net_reader *reader, sc_socket socket,
+                   size_t cap) {
+    assert(cap);
+
+    reader->buf = malloc(cap);
+    if (!reader->buf) {
+        LOG_OOM();
+        return false;
+    }
+
+    reader->socket = socket;
+    reader->cap = cap;
+    reader->head = 0;
+    reader->len = 0;
+
+    return true;
+}
+
+void
+sc_net_reader_destroy(struct sc_net_reader *reader) {
+    free(reader->buf);
+}
+
+void
+sc_net_reader_reset(struct sc_net_reader *reader, sc_socket socket) {
+    reader->socket = socket;
+    reader->head = 0;
+    reader->len = 0;
+}
+
+ssize_t
+sc_net_reader_read_all(struct sc_net_reader *reader, void *dst, size_t len) {
+    uint8_t *out = dst;
+    size_t done = 0;
+
+    while (done < len) {
+        if (reader->len) {
+            // Consume the buffered bytes first
+            size_t n = len - done;
+            if (n > reader->len) {
+                n = reader->len;
+            }
+            memcpy(out + done, reader->buf + reader->head, n);
+            reader->head += n;
+            reader->len -= n;
+            done += n;
+            continue;
+        }
+
+        size_t remaining = len - done;
+        if (remaining >= reader->cap) {
+            // Large read: receive directly into the destination
+            ssize_t r = net_recv_all(reader->socket, out + done, remaining);
+            if (r <= 0) {
+                break;
+            }
+            done += r;
+            continue;
+        }
+
+        // Refill the buffer, with as many bytes as available (at least 1)
+        ssize_t r = net_recv(reader->socket, reader->buf, reader->cap);
+        if (r <= 0) {
+            break;
+        }
+        reader->head = 0;
+        reader->len = r;
+    }
+
+    return done;
+}
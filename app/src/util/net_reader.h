@@ -0,0 +1,55 @@
+#ifndef SC_NET_READER_H
+#define SC_NET_READER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "net.h"
+
+/**
+ * Buffered reader of a socket.
+ *
+ * Small reads (like the packet headers) are served from a user-space buffer,
+ * filled by large recv() calls, so that a header and the beginning of its
+ * payload (or several small packets) are received by a single syscall.
+ *
+ * Reads larger than the buffer are received directly into the destination,
+ * after the bytes already buffered, so that large payloads are never copied.
+ *
+ * A reader is not thread-safe.
+ */
+struct sc_net_reader {
+    sc_socket socket;
+    uint8_t *buf;
+    size_t cap;
+    size_t head; // index of the first unread byte
+    size_t len; // number of unread bytes
+};
+
+bool
+sc_net_reader_init(struct sc_net_reader *reader, sc_socket socket,
+                   size_t cap);
+
+void
+sc_net_reader_destroy(struct sc_net_reader *reader);
+
+/**
+ * Read from another socket, discarding the bytes buffered from the previous
+ * one
+ */
+void
+sc_net_reader_reset(struct sc_net_reader *reader, sc_socket socket);
+
+/**
+ * Read exactly len bytes (like net_recv_all())
+ *
+ * Return the number of bytes read, which is less than len on end of stream or
+ * error.
+ */
+ssize_t
+sc_net_reader_read_all(struct sc_net_reader *reader, void *dst, size_t len);
+
+#endif
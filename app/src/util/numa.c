@@ -0,0 +1,229 @@
+#include "numa.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef __linux__
+# include <pthread.h>
+# include <sched.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif
+#ifdef _WIN32
+# include <windows.h>
+# include <psapi.h>
+#endif
+
+#include "log.h"
+
+#ifdef __linux__
+
+#define SC_NUMA_SYSFS "/sys/devices/system/node/"
+// From <linux/mempolicy.h>
+#define SC_MPOL_PREFERRED 1
+
+// Read a list of ranges like "0-15,32-47" from a sysfs file, calling `fn` for
+// each range
+static bool
+read_range_list(const char *path, void (*fn)(unsigned first, unsigned last,
+                                             void *userdata),
+                void *userdata) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+
+    char buf[1024];
+    bool ok = fgets(buf, sizeof(buf), file);
+    fclose(file);
+    if (!ok) {
+        return false;
+    }
+
+    char *s = buf;
+    while (*s >= '0' && *s <= '9') {
+        char *end;
+        unsigned long first = strtoul(s, &end, 10);
+        unsigned long last = first;
+        if (*end == '-') {
+            last = strtoul(end + 1, &end, 10);
+        }
+        if (last < first) {
+            return false;
+        }
+        fn(first, last, userdata);
+
+        if (*end != ',') {
+            break;
+        }
+        s = end + 1;
+    }
+
+    return true;
+}
+
+static void
+update_max(unsigned first, unsigned last, void *userdata) {
+    (void) first;
+    unsigned *max = userdata;
+    if (last > *max) {
+        *max = last;
+    }
+}
+
+static void
+add_cpus(unsigned first, unsigned last, void *userdata) {
+    cpu_set_t *set = userdata;
+    for (unsigned cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+        CPU_SET(cpu, set);
+    }
+}
+
+unsigned
+sc_numa_get_node_count(void) {
+    unsigned max = 0;
+    if (!read_range_list(SC_NUMA_SYSFS "online", update_max, &max)) {
+        return 1;
+    }
+    return max + 1;
+}
+
+bool
+sc_numa_bind_thread(unsigned node) {
+    char path[64];
+    snprintf(path, sizeof(path), SC_NUMA_SYSFS "node%u/cpulist", node);
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (!read_range_list(path, add_cpus, &set) || !CPU_COUNT(&set)) {
+        LOGW("Could not read the processors of NUMA node %u", node);
+        return false;
+    }
+
+    int r = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (r) {
+        LOGW("Could not bind thread to NUMA node %u: error %d", node, r);
+        return false;
+    }
+
+#ifdef SYS_set_mempolicy
+    unsigned long mask = 1UL << node;
+    // The kernel expects the number of bits of the mask plus one
+    if (node < sizeof(mask) * 8 - 1
+            && syscall(SYS_set_mempolicy, SC_MPOL_PREFERRED, &mask,
+                       sizeof(mask) * 8 + 1)) {
+        LOGW("Could not set the memory policy of NUMA node %u", node);
+        // The pages are still allocated on the node of the first touch
+    }
+#endif
+
+    return true;
+}
+
+int
+sc_numa_get_current_node(void) {
+#ifdef SYS_getcpu
+    unsigned cpu;
+    unsigned node;
+    if (!syscall(SYS_getcpu, &cpu, &node, NULL)) {
+        return node;
+    }
+#endif
+    return -1;
+}
+
+int
+sc_numa_get_memory_node(const void *addr) {
+#ifdef SYS_move_pages
+    uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    void *page = (void *) ((uintptr_t) addr & ~(page_size - 1));
+    int status;
+    // Without target nodes, only query the node of the page
+    if (!syscall(SYS_move_pages, 0, 1UL, &page, NULL, &status, 0)
+            && status >= 0) {
+        return status;
+    }
+#else
+    (void) addr;
+#endif
+    return -1;
+}
+
+#elif defined(_WIN32)
+
+unsigned
+sc_numa_get_node_count(void) {
+    ULONG highest;
+    if (!GetNumaHighestNodeNumber(&highest)) {
+        return 1;
+    }
+    return highest + 1;
+}
+
+bool
+sc_numa_bind_thread(unsigned node) {
+    GROUP_AFFINITY affinity;
+    if (!GetNumaNodeProcessorMaskEx((USHORT) node, &affinity)
+            || !affinity.Mask) {
+        LOGW("Could not read the processors of NUMA node %u", node);
+        return false;
+    }
+
+    if (!SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL)) {
+        LOGW("Could not bind thread to NUMA node %u: error %lu", node,
+             (unsigned long) GetLastError());
+        return false;
+    }
+
+    return true;
+}
+
+int
+sc_numa_get_current_node(void) {
+    PROCESSOR_NUMBER processor;
+    GetCurrentProcessorNumberEx(&processor);
+    USHORT node;
+    if (!GetNumaProcessorNodeEx(&processor, &node)) {
+        return -1;
+    }
+    return node;
+}
+
+int
+sc_numa_get_memory_node(const void *addr) {
+    PSAPI_WORKING_SET_EX_INFORMATION info = {
+        .VirtualAddress = (void *) addr,
+    };
+    if (!QueryWorkingSetEx(GetCurrentProcess(), &info, sizeof(info))
+            || !info.VirtualAttributes.Valid) {
+        return -1;
+    }
+    return info.VirtualAttributes.Node;
+}
+
+#else
+
+unsigned
+sc_numa_get_node_count(void) {
+    return 1;
+}
+
+bool
+sc_numa_bind_thread(unsigned node) {
+    (void) node;
+    LOGW("NUMA binding is not supported on this platform");
+    return false;
+}
+
+int
+sc_numa_get_current_node(void) {
+    return -1;
+}
+
+int
+sc_numa_get_memory_node(const void *addr) {
+    (void) addr;
+    return -1;
+}
+
+#endif
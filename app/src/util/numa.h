@@ -0,0 +1,46 @@
+#ifndef SC_NUMA_H
+#define SC_NUMA_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+/**
+ * NUMA topology (Linux and Windows)
+ *
+ * The nodes are identified by their index, in [0, sc_numa_get_node_count()).
+ */
+
+/**
+ * Return the number of NUMA nodes (1 if the system is not NUMA or if the
+ * topology is not available)
+ */
+unsigned
+sc_numa_get_node_count(void);
+
+/**
+ * Bind the current thread to a node: pin it to the processors of the node,
+ * and allocate its memory preferably on the node
+ *
+ * The threads it creates afterwards inherit the binding. On Windows, the
+ * memory is allocated on the node of the processor which touches it first,
+ * so the processor pinning is enough.
+ */
+bool
+sc_numa_bind_thread(unsigned node);
+
+/**
+ * Return the node of the processor running the current thread, or -1 if
+ * unknown
+ */
+int
+sc_numa_get_current_node(void);
+
+/**
+ * Return the node of the physical page backing `addr`, or -1 if unknown (for
+ * example if the page is not faulted in)
+ */
+int
+sc_numa_get_memory_node(const void *addr);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef SC_PAGES_H
+#define SC_PAGES_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Size of the huge pages requested (the large page minimum on Windows, 2 MB
+// on x86-64 and most arm64 systems)
+#define SC_HUGE_PAGE_SIZE ((size_t) 2 << 20)
+
+/**
+ * Private memory mapped directly from the system, page-aligned
+ */
+struct sc_pages {
+    void *data;
+    size_t size; // mapped size, a multiple of the page size
+    bool huge; // backed by huge pages
+    bool locked; // locked in RAM (never paged out)
+};
+
+/**
+ * Map at least `size` bytes of private memory (uninitialized)
+ *
+ * If `huge` is set, huge pages are tried first: on Linux, they must be
+ * reserved (vm.nr_hugepages), otherwise transparent huge pages are requested
+ * for the regular mapping. On Windows, the SeLockMemoryPrivilege is required
+ * (large pages are always locked).
+ *
+ * If `lock` is set, the pages are locked in RAM and faulted in immediately,
+ * so that they are never paged out nor faulted on first access. Failing to
+ * lock them (e.g. because of RLIMIT_MEMLOCK) is not an error.
+ *
+ * The flags `huge` and `locked` of `pages` tell what was actually obtained.
+ */
+bool
+sc_pages_alloc(struct sc_pages *pages, size_t size, bool huge, bool lock);
+
+void
+sc_pages_free(struct sc_pages *pages);
+
+#endif
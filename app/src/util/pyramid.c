@@ -0,0 +1,164 @@
+#include "pyramid.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define SC_PYRAMID_AVX2
+# include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+# define SC_PYRAMID_NEON
+# include <arm_neon.h>
+#endif
+
+// Vertical filter of the columns [begin, end): t = r0 + 2 * r1 + r2
+typedef void (*sc_pyramid_vfilter_fn)(const uint8_t *r0, const uint8_t *r1,
+                                      const uint8_t *r2, uint16_t *t,
+                                      int begin, int end);
+// Horizontal filter and decimation of the destination columns [begin, end),
+// t[-1] being valid
+typedef void (*sc_pyramid_hfilter_fn)(const uint16_t *t, uint8_t *dst,
+                                      int begin, int end);
+
+static void
+sc_pyramid_vfilter_scalar(const uint8_t *r0, const uint8_t *r1,
+                          const uint8_t *r2, uint16_t *t, int begin, int end) {
+    for (int x = begin; x < end; ++x) {
+        t[x] = r0[x] + 2 * r1[x] + r2[x];
+    }
+}
+
+static void
+sc_pyramid_hfilter_scalar(const uint16_t *t, uint8_t *dst, int begin,
+                          int end) {
+    for (int x = begin; x < end; ++x) {
+        unsigned sum = t[2 * x - 1] + 2 * t[2 * x] + t[2 * x + 1];
+        dst[x] = (sum + 8) >> 4;
+    }
+}
+
+#ifdef SC_PYRAMID_AVX2
+__attribute__((target("avx2")))
+static void
+sc_pyramid_vfilter_avx2(const uint8_t *r0, const uint8_t *r1,
+                        const uint8_t *r2, uint16_t *t, int begin, int end) {
+    int x = begin;
+    for (; x + 16 <= end; x += 16) {
+        __m256i a = _mm256_cvtepu8_epi16(
+                _mm_loadu_si128((const __m128i *) (r0 + x)));
+        __m256i b = _mm256_cvtepu8_epi16(
+                _mm_loadu_si128((const __m128i *) (r1 + x)));
+        __m256i c = _mm256_cvtepu8_epi16(
+                _mm_loadu_si128((const __m128i *) (r2 + x)));
+        __m256i v = _mm256_add_epi16(_mm256_add_epi16(a, c),
+                                     _mm256_slli_epi16(b, 1));
+        _mm256_storeu_si256((__m256i *) (t + x), v);
+    }
+
+    sc_pyramid_vfilter_scalar(r0, r1, r2, t, x, end);
+}
+
+__attribute__((target("avx2")))
+static void
+sc_pyramid_hfilter_avx2(const uint16_t *t, uint8_t *dst, int begin, int end) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i eight = _mm256_set1_epi32(8);
+
+    // 16 destination pixels at a time
+    int x = begin;
+    for (; x + 16 <= end; x += 16) {
+        const uint16_t *p = t + 2 * x;
+        // In each 32-bit lane, (t[2x], t[2x+1]) and (t[2x-1], t[2x]): the sum
+        // of the 4 values is t[2x-1] + 2 * t[2x] + t[2x+1]
+        __m256i s0 = _mm256_add_epi32(
+            _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *) p), ones),
+            _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *) (p - 1)),
+                              ones));
+        __m256i s1 = _mm256_add_epi32(
+            _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *) (p + 16)),
+                              ones),
+            _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *) (p + 15)),
+                              ones));
+        s0 = _mm256_srli_epi32(_mm256_add_epi32(s0, eight), 4);
+        s1 = _mm256_srli_epi32(_mm256_add_epi32(s1, eight), 4);
+
+        // Restore the order of the 128-bit lanes after the packing
+        __m256i w = _mm256_permute4x64_epi64(_mm256_packus_epi32(s0, s1),
+                                             0xD8);
+        __m128i v = _mm_packus_epi16(_mm256_castsi256_si128(w),
+                                     _mm256_extracti128_si256(w, 1));
+        _mm_storeu_si128((__m128i *) (dst + x), v);
+    }
+
+    sc_pyramid_hfilter_scalar(t, dst, x, end);
+}
+
+static bool
+sc_pyramid_has_avx2(void) {
+    // Cheap: the CPU features are detected once, on startup
+    return __builtin_cpu_supports("avx2");
+}
+#elif defined(SC_PYRAMID_NEON)
+static void
+sc_pyramid_vfilter_neon(const uint8_t *r0, const uint8_t *r1,
+                        const uint8_t *r2, uint16_t *t, int begin, int end) {
+    int x = begin;
+    for (; x + 8 <= end; x += 8) {
+        uint16x8_t v = vaddl_u8(vld1_u8(r0 + x), vld1_u8(r2 + x));
+        v = vmlal_u8(v, vld1_u8(r1 + x), vdup_n_u8(2));
+        vst1q_u16(t + x, v);
+    }
+
+    sc_pyramid_vfilter_scalar(r0, r1, r2, t, x, end);
+}
+
+static void
+sc_pyramid_hfilter_neon(const uint16_t *t, uint8_t *dst, int begin, int end) {
+    // 8 destination pixels at a time
+    int x = begin;
+    for (; x + 8 <= end; x += 8) {
+        const uint16_t *p = t + 2 * x;
+        // (t[2x], t[2x+1]) and (t[2x-1], t[2x]), deinterleaved
+        uint16x8x2_t a = vld2q_u16(p);
+        uint16x8x2_t b = vld2q_u16(p - 1);
+        uint16x8_t sum = vaddq_u16(vaddq_u16(a.val[0], a.val[1]),
+                                   vaddq_u16(b.val[0], b.val[1]));
+        vst1_u8(dst + x, vrshrn_n_u16(sum, 4));
+    }
+
+    sc_pyramid_hfilter_scalar(t, dst, x, end);
+}
+#endif
+
+void
+sc_pyramid_reduce(const uint8_t *src, int src_linesize, int width, int height,
+                  uint8_t *dst, int dst_linesize, uint16_t *scratch) {
+    assert(width >= 0 && height >= 0);
+
+    sc_pyramid_vfilter_fn vfilter = sc_pyramid_vfilter_scalar;
+    sc_pyramid_hfilter_fn hfilter = sc_pyramid_hfilter_scalar;
+#ifdef SC_PYRAMID_AVX2
+    if (sc_pyramid_has_avx2()) {
+        vfilter = sc_pyramid_vfilter_avx2;
+        hfilter = sc_pyramid_hfilter_avx2;
+    }
+#elif defined(SC_PYRAMID_NEON)
+    vfilter = sc_pyramid_vfilter_neon;
+    hfilter = sc_pyramid_hfilter_neon;
+#endif
+
+    int dst_width = width / 2;
+    int dst_height = height / 2;
+    // The vertical sums of a row, preceded by a copy of the first one (the
+    // left edge)
+    uint16_t *t = scratch + 1;
+    for (int y = 0; y < dst_height; ++y) {
+        const uint8_t *r1 = src + (ptrdiff_t) 2 * y * src_linesize;
+        const uint8_t *r0 = y ? r1 - src_linesize : r1;
+        const uint8_t *r2 = r1 + src_linesize;
+        vfilter(r0, r1, r2, t, 0, 2 * dst_width);
+        t[-1] = t[0];
+        hfilter(t, dst + (ptrdiff_t) y * dst_linesize, 0, dst_width);
+    }
+}
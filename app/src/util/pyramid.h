@@ -0,0 +1,25 @@
+#ifndef SC_PYRAMID_H
+#define SC_PYRAMID_H
+
+#include "common.h"
+
+#include <stdint.h>
+
+/**
+ * Reduce an 8-bit plane to half its resolution in both directions: one level
+ * of a Gaussian pyramid
+ *
+ * Each destination pixel (x, y) is the source filtered by the separable
+ * binomial kernel [1 2 1] / 4 (in both directions), centered on (2x, 2y),
+ * rounded to the nearest. The source is clamped on the left and top edges
+ * (the right and bottom neighbors always exist).
+ *
+ * The destination is (width / 2) x (height / 2). The vertical and horizontal
+ * filters are fused in a single pass over the source rows: `scratch` must hold
+ * width + 1 values.
+ */
+void
+sc_pyramid_reduce(const uint8_t *src, int src_linesize, int width, int height,
+                  uint8_t *dst, int dst_linesize, uint16_t *scratch);
+
+#endif
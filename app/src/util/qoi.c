@@ -0,0 +1,129 @@
+#include "qoi.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "util/binary.h"
+
+#define SC_QOI_HEADER_SIZE 14
+#define SC_QOI_END_MARKER_SIZE 8
+
+#define SC_QOI_OP_INDEX 0x00 // 00xxxxxx
+#define SC_QOI_OP_DIFF  0x40 // 01xxxxxx
+#define SC_QOI_OP_LUMA  0x80 // 10xxxxxx
+#define SC_QOI_OP_RUN   0xc0 // 11xxxxxx
+#define SC_QOI_OP_RGB   0xfe // 11111110
+
+#define SC_QOI_MAX_RUN 62
+
+struct sc_qoi_rgb {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+};
+
+static inline bool
+sc_qoi_rgb_equals(struct sc_qoi_rgb a, struct sc_qoi_rgb b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+static inline unsigned
+sc_qoi_hash(struct sc_qoi_rgb px) {
+    // The alpha is always 255 (255 * 11 = 2805)
+    return (px.r * 3 + px.g * 5 + px.b * 7 + 2805) % 64;
+}
+
+size_t
+sc_qoi_max_size(uint32_t width, uint32_t height) {
+    // In the worst case, each pixel is encoded as QOI_OP_RGB (4 bytes)
+    return (size_t) width * height * 4 + SC_QOI_HEADER_SIZE
+         + SC_QOI_END_MARKER_SIZE;
+}
+
+size_t
+sc_qoi_encode_rgb(const uint8_t *rgb, int linesize, uint32_t width,
+                  uint32_t height, uint8_t *out) {
+    uint8_t *p = out;
+
+    memcpy(p, "qoif", 4);
+    sc_write32be(p + 4, width);
+    sc_write32be(p + 8, height);
+    p[12] = 3; // channels: RGB
+    p[13] = 0; // colorspace: sRGB with linear alpha
+    p += SC_QOI_HEADER_SIZE;
+
+    // All the pixels of the index are zero-initialized, including alpha, so
+    // they never match an opaque pixel until they are written
+    struct sc_qoi_rgb index[64];
+    bool index_valid[64] = {false};
+
+    struct sc_qoi_rgb prev = {0, 0, 0};
+    unsigned run = 0;
+
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint8_t *row = rgb + (size_t) y * linesize;
+        for (uint32_t x = 0; x < width; ++x) {
+            struct sc_qoi_rgb px = {row[3 * x], row[3 * x + 1],
+                                    row[3 * x + 2]};
+
+            if (sc_qoi_rgb_equals(px, prev)) {
+                ++run;
+                if (run == SC_QOI_MAX_RUN) {
+                    *p++ = SC_QOI_OP_RUN | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run) {
+                *p++ = SC_QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+
+            unsigned hash = sc_qoi_hash(px);
+            if (index_valid[hash] && sc_qoi_rgb_equals(index[hash], px)) {
+                *p++ = SC_QOI_OP_INDEX | hash;
+            } else {
+                index[hash] = px;
+                index_valid[hash] = true;
+
+                int8_t vr = (int8_t) (px.r - prev.r);
+                int8_t vg = (int8_t) (px.g - prev.g);
+                int8_t vb = (int8_t) (px.b - prev.b);
+                int8_t vg_r = vr - vg;
+                int8_t vg_b = vb - vg;
+
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2
+                        && vb > -3 && vb < 2) {
+                    *p++ = SC_QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2
+                         | (vb + 2);
+                } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32
+                        && vg_b > -9 && vg_b < 8) {
+                    *p++ = SC_QOI_OP_LUMA | (vg + 32);
+                    *p++ = (vg_r + 8) << 4 | (vg_b + 8);
+                } else {
+                    *p++ = SC_QOI_OP_RGB;
+                    *p++ = px.r;
+                    *p++ = px.g;
+                    *p++ = px.b;
+                }
+            }
+
+            prev = px;
+        }
+    }
+
+    if (run) {
+        *p++ = SC_QOI_OP_RUN | (run - 1);
+    }
+
+    static const uint8_t end_marker[SC_QOI_END_MARKER_SIZE] =
+        {0, 0, 0, 0, 0, 0, 0, 1};
+    memcpy(p, end_marker, sizeof(end_marker));
+    p += sizeof(end_marker);
+
+    size_t size = p - out;
+    assert(size <= sc_qoi_max_size(width, height));
+    return size;
+}
@@ -0,0 +1,33 @@
+#ifndef SC_QOI_H
+#define SC_QOI_H
+
+#include "common.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Encoder for the QOI ("Quite OK Image") lossless image format
+ *
+ * <https://qoiformat.org/qoi-specification.pdf>
+ *
+ * It compresses much faster than PNG, for a similar ratio on camera content.
+ * Only 3-channel (RGB24) images are supported.
+ */
+
+// Maximum size of an encoded image (in bytes)
+size_t
+sc_qoi_max_size(uint32_t width, uint32_t height);
+
+/**
+ * Encode an RGB24 image into `out`
+ *
+ * `out` must be at least sc_qoi_max_size(width, height) bytes.
+ *
+ * Return the number of bytes written.
+ */
+size_t
+sc_qoi_encode_rgb(const uint8_t *rgb, int linesize, uint32_t width,
+                  uint32_t height, uint8_t *out);
+
+#endif
@@ -0,0 +1,1061 @@
+#include "remap.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define SC_REMAP_AVX2
+# include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+# define SC_REMAP_NEON
+# include <arm_neon.h>
+#endif
+
+#include "util/log.h"
+
+// Fractional bits of the maps (INTER_BITS in OpenCV)
+#define SC_REMAP_FRAC_BITS 5
+#define SC_REMAP_FRAC_ONE (1 << SC_REMAP_FRAC_BITS)
+#define SC_REMAP_FRAC_MASK (SC_REMAP_FRAC_ONE - 1)
+// The weights of the 4 samples sum to 1 << SC_REMAP_WEIGHT_BITS
+#define SC_REMAP_WEIGHT_BITS (2 * SC_REMAP_FRAC_BITS)
+
+// Tiles of the destination: with the rectification maps, the source rows read
+// by a tile (a bit more than its height) stay in the L2 cache
+#define SC_REMAP_TILE_WIDTH 256
+#define SC_REMAP_TILE_HEIGHT 32
+#define SC_REMAP_CACHE_LINE 64
+
+// Rows remapped at once by sc_remap_yuv420p_to_rgb() (even), before their
+// conversion
+#define SC_REMAP_RGB_BAND_ROWS 16
+// Black
+#define SC_REMAP_RGB_BORDER_LUMA 0
+#define SC_REMAP_RGB_BORDER_CHROMA 128
+
+// Fractional bits of the coordinates interpolated between the control points
+// of a grid: 32-bit, with some margin for the coordinates in the int16 range
+#define SC_REMAP_GRID_STEP_BITS 15
+#define SC_REMAP_GRID_STEP_SHIFT (SC_REMAP_GRID_STEP_BITS - SC_REMAP_FRAC_BITS)
+#define SC_REMAP_GRID_STEP_ROUND (1 << (SC_REMAP_GRID_STEP_SHIFT - 1))
+
+struct sc_remap_src {
+    const uint8_t *data;
+    ptrdiff_t linesize;
+    int width;
+    int height;
+    uint8_t border;
+};
+
+typedef void (*sc_remap_row_fn)(const struct sc_remap_src *src, uint8_t *dst,
+                                const int16_t *xy, const uint16_t *frac,
+                                int begin, int end);
+
+static inline unsigned
+sc_remap_sample(const struct sc_remap_src *src, int x, int y) {
+    if ((unsigned) x < (unsigned) src->width
+            && (unsigned) y < (unsigned) src->height) {
+        return src->data[y * src->linesize + x];
+    }
+    return src->border;
+}
+
+static inline uint8_t
+sc_remap_pixel(const struct sc_remap_src *src, int x, int y, unsigned frac) {
+    unsigned fx = frac & SC_REMAP_FRAC_MASK;
+    unsigned fy = (frac >> SC_REMAP_FRAC_BITS) & SC_REMAP_FRAC_MASK;
+
+    unsigned p00, p01, p10, p11;
+    if ((unsigned) x < (unsigned) (src->width - 1)
+            && (unsigned) y < (unsigned) (src->height - 1)) {
+        const uint8_t *p = src->data + y * src->linesize + x;
+        p00 = p[0];
+        p01 = p[1];
+        p10 = p[src->linesize];
+        p11 = p[src->linesize + 1];
+    } else {
+        p00 = sc_remap_sample(src, x, y);
+        p01 = sc_remap_sample(src, x + 1, y);
+        p10 = sc_remap_sample(src, x, y + 1);
+        p11 = sc_remap_sample(src, x + 1, y + 1);
+    }
+
+    unsigned top = p00 * (SC_REMAP_FRAC_ONE - fx) + p01 * fx;
+    unsigned bottom = p10 * (SC_REMAP_FRAC_ONE - fx) + p11 * fx;
+    unsigned v = top * (SC_REMAP_FRAC_ONE - fy) + bottom * fy;
+    return (v + (1 << (SC_REMAP_WEIGHT_BITS - 1))) >> SC_REMAP_WEIGHT_BITS;
+}
+
+static void
+sc_remap_row_scalar(const struct sc_remap_src *src, uint8_t *dst,
+                    const int16_t *xy, const uint16_t *frac, int begin,
+                    int end) {
+    for (int i = begin; i < end; ++i) {
+        dst[i] = sc_remap_pixel(src, xy[2 * i], xy[2 * i + 1], frac[i]);
+    }
+}
+
+#ifdef SC_REMAP_AVX2
+// The constants of sc_remap_8_avx2(), initialized once per row (in locals, so
+// that they are not reloaded after every store to the destination)
+struct sc_remap_avx2 {
+    // The 2 samples of a row are gathered as 4 bytes, which must all be in
+    // the row of the plane
+    __m256i max_x;
+    __m256i max_y;
+    __m256i linesize;
+    const int *top_base;
+    const int *bottom_base;
+};
+
+__attribute__((target("avx2")))
+static inline void
+sc_remap_avx2_init(struct sc_remap_avx2 *k, const struct sc_remap_src *src) {
+    k->max_x = _mm256_set1_epi32(src->width - 4);
+    k->max_y = _mm256_set1_epi32(src->height - 2);
+    k->linesize = _mm256_set1_epi32((int) src->linesize);
+    k->top_base = (const int *) src->data;
+    k->bottom_base = (const int *) (src->data + src->linesize);
+}
+
+// Interpolate 8 pixels from their integer source coordinates (x, y) and their
+// fractions (fx, fy), as 32-bit lanes
+//
+// Return false (and write nothing) if any of them is close to the borders.
+__attribute__((target("avx2")))
+static inline bool
+sc_remap_8_avx2(const struct sc_remap_avx2 *k, uint8_t *dst, __m256i x,
+                __m256i y, __m256i fx, __m256i fy) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i frac_one = _mm256_set1_epi32(SC_REMAP_FRAC_ONE);
+    const __m256i round = _mm256_set1_epi32(1 << (SC_REMAP_WEIGHT_BITS - 1));
+    // Spread the 2 first bytes of each 32-bit lane to 16-bit values
+    const __m256i spread = _mm256_setr_epi8(
+            0, -1, 1, -1, 4, -1, 5, -1, 8, -1, 9, -1, 12, -1, 13, -1,
+            0, -1, 1, -1, 4, -1, 5, -1, 8, -1, 9, -1, 12, -1, 13, -1);
+
+    __m256i outside = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpgt_epi32(zero, x),
+                            _mm256_cmpgt_epi32(x, k->max_x)),
+            _mm256_or_si256(_mm256_cmpgt_epi32(zero, y),
+                            _mm256_cmpgt_epi32(y, k->max_y)));
+    if (!_mm256_testz_si256(outside, outside)) {
+        return false;
+    }
+
+    __m256i offsets = _mm256_add_epi32(_mm256_mullo_epi32(y, k->linesize), x);
+    __m256i top = _mm256_i32gather_epi32(k->top_base, offsets, 1);
+    __m256i bottom = _mm256_i32gather_epi32(k->bottom_base, offsets, 1);
+
+    // {1 - f, f} as pairs of 16-bit weights
+    __m256i wx = _mm256_or_si256(_mm256_sub_epi32(frac_one, fx),
+                                 _mm256_slli_epi32(fx, 16));
+    __m256i wy = _mm256_or_si256(_mm256_sub_epi32(frac_one, fy),
+                                 _mm256_slli_epi32(fy, 16));
+
+    top = _mm256_madd_epi16(_mm256_shuffle_epi8(top, spread), wx);
+    bottom = _mm256_madd_epi16(_mm256_shuffle_epi8(bottom, spread), wx);
+    // The horizontal results fit in 16 bits
+    __m256i r = _mm256_madd_epi16(
+            _mm256_or_si256(top, _mm256_slli_epi32(bottom, 16)), wy);
+    r = _mm256_srli_epi32(_mm256_add_epi32(r, round), SC_REMAP_WEIGHT_BITS);
+
+    __m128i r16 = _mm_packus_epi32(_mm256_castsi256_si128(r),
+                                   _mm256_extracti128_si256(r, 1));
+    _mm_storel_epi64((__m128i *) dst, _mm_packus_epi16(r16, r16));
+    return true;
+}
+
+__attribute__((target("avx2")))
+static void
+sc_remap_row_avx2(const struct sc_remap_src *src, uint8_t *dst,
+                  const int16_t *xy, const uint16_t *frac, int begin,
+                  int end) {
+    const __m256i frac_mask = _mm256_set1_epi32(SC_REMAP_FRAC_MASK);
+    struct sc_remap_avx2 k;
+    sc_remap_avx2_init(&k, src);
+
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (xy + 2 * i));
+        __m256i x = _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16);
+        __m256i y = _mm256_srai_epi32(v, 16);
+
+        __m256i f = _mm256_cvtepu16_epi32(
+                _mm_loadu_si128((const __m128i *) (frac + i)));
+        __m256i fx = _mm256_and_si256(f, frac_mask);
+        __m256i fy = _mm256_and_si256(
+                _mm256_srli_epi32(f, SC_REMAP_FRAC_BITS), frac_mask);
+
+        if (!sc_remap_8_avx2(&k, dst + i, x, y, fx, fy)) {
+            // Close to the borders
+            sc_remap_row_scalar(src, dst, xy, frac, i, i + 8);
+        }
+    }
+
+    sc_remap_row_scalar(src, dst, xy, frac, i, end);
+}
+
+static bool
+sc_remap_has_avx2(void) {
+    // Cheap: the CPU features are detected once, on startup
+    return __builtin_cpu_supports("avx2");
+}
+#elif defined(SC_REMAP_NEON)
+static void
+sc_remap_row_neon(const struct sc_remap_src *src, uint8_t *dst,
+                  const int16_t *xy, const uint16_t *frac, int begin,
+                  int end) {
+    // There is no gather: the samples are loaded one by one, the weights are
+    // computed and applied 8 pixels at a time
+    const int16x8_t max_x = vdupq_n_s16(src->width - 2);
+    const int16x8_t max_y = vdupq_n_s16(src->height - 2);
+    const uint16x8_t frac_mask = vdupq_n_u16(SC_REMAP_FRAC_MASK);
+    const uint16x8_t frac_one = vdupq_n_u16(SC_REMAP_FRAC_ONE);
+    ptrdiff_t linesize = src->linesize;
+
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        int16x8x2_t v = vld2q_s16(xy + 2 * i);
+        uint16x8_t outside =
+            vorrq_u16(vorrq_u16(vcltzq_s16(v.val[0]),
+                                vcgtq_s16(v.val[0], max_x)),
+                      vorrq_u16(vcltzq_s16(v.val[1]),
+                                vcgtq_s16(v.val[1], max_y)));
+        if (vmaxvq_u16(outside)) {
+            // Close to the borders
+            sc_remap_row_scalar(src, dst, xy, frac, i, i + 8);
+            continue;
+        }
+
+        int16_t xs[8];
+        int16_t ys[8];
+        vst1q_s16(xs, v.val[0]);
+        vst1q_s16(ys, v.val[1]);
+
+        uint8_t p00[8], p01[8], p10[8], p11[8];
+        for (unsigned k = 0; k < 8; ++k) {
+            const uint8_t *p = src->data + ys[k] * linesize + xs[k];
+            p00[k] = p[0];
+            p01[k] = p[1];
+            p10[k] = p[linesize];
+            p11[k] = p[linesize + 1];
+        }
+
+        uint16x8_t f = vld1q_u16(frac + i);
+        uint16x8_t fx = vandq_u16(f, frac_mask);
+        uint16x8_t fy = vandq_u16(vshrq_n_u16(f, SC_REMAP_FRAC_BITS),
+                                  frac_mask);
+        uint16x8_t gx = vsubq_u16(frac_one, fx);
+        uint16x8_t gy = vsubq_u16(frac_one, fy);
+
+        uint16x8_t top = vmlaq_u16(vmulq_u16(vmovl_u8(vld1_u8(p00)), gx),
+                                   vmovl_u8(vld1_u8(p01)), fx);
+        uint16x8_t bottom = vmlaq_u16(vmulq_u16(vmovl_u8(vld1_u8(p10)), gx),
+                                      vmovl_u8(vld1_u8(p11)), fx);
+
+        uint32x4_t lo = vmlal_u16(vmull_u16(vget_low_u16(top),
+                                            vget_low_u16(gy)),
+                                  vget_low_u16(bottom), vget_low_u16(fy));
+        uint32x4_t hi = vmlal_high_u16(vmull_high_u16(top, gy), bottom, fy);
+        // Rounded shifts, the results fit in 8 bits
+        uint16x8_t r = vcombine_u16(vrshrn_n_u32(lo, SC_REMAP_WEIGHT_BITS),
+                                    vrshrn_n_u32(hi, SC_REMAP_WEIGHT_BITS));
+        vst1_u8(dst + i, vmovn_u16(r));
+    }
+
+    sc_remap_row_scalar(src, dst, xy, frac, i, end);
+}
+#endif
+
+// Prefetch the maps of the columns [begin, end) of the row following xy and
+// frac
+static inline void
+sc_remap_prefetch_maps(const int16_t *xy, const uint16_t *frac,
+                       int map1_linesize, int map2_linesize, int begin,
+                       int end) {
+    const char *next1 = (const char *) xy + map1_linesize;
+    const char *next2 = (const char *) frac + map2_linesize;
+    for (int i = begin * 4; i < end * 4; i += SC_REMAP_CACHE_LINE) {
+        __builtin_prefetch(next1 + i);
+    }
+    for (int i = begin * 2; i < end * 2; i += SC_REMAP_CACHE_LINE) {
+        __builtin_prefetch(next2 + i);
+    }
+}
+
+static sc_remap_row_fn
+sc_remap_select(void) {
+#ifdef SC_REMAP_AVX2
+    if (sc_remap_has_avx2()) {
+        return sc_remap_row_avx2;
+    }
+#elif defined(SC_REMAP_NEON)
+    return sc_remap_row_neon;
+#endif
+    return sc_remap_row_scalar;
+}
+
+// Tell whether the 4 samples of the source pixel (sx, sy) are all outside of
+// the source (the destination pixel is exactly the border)
+static inline bool
+sc_remap_is_outside(int sx, int sy, int src_width, int src_height) {
+    return sx < -1 || sy < -1 || sx >= src_width || sy >= src_height;
+}
+
+// Compute the span of a row of integer coordinates (x, y)
+static void
+sc_remap_span_init(struct sc_remap_span *span, const int16_t *xy, int width,
+                   int src_width, int src_height) {
+    int x0 = 0;
+    while (x0 < width && sc_remap_is_outside(xy[2 * x0], xy[2 * x0 + 1],
+                                             src_width, src_height)) {
+        ++x0;
+    }
+    int x1 = width;
+    while (x1 > x0 && sc_remap_is_outside(xy[2 * x1 - 2], xy[2 * x1 - 1],
+                                          src_width, src_height)) {
+        --x1;
+    }
+    span->x0 = x0;
+    span->x1 = x1;
+}
+
+// Restrict the pixels [*begin, *end) of a row to its span (the row and the
+// range being shifted by `offset` pixels), filling the others with the border
+static inline void
+sc_remap_clip_span(const struct sc_remap_span *span, int offset, uint8_t *row,
+                   int *begin, int *end, uint8_t border) {
+    int x0 = CLAMP(span->x0 - offset, *begin, *end);
+    int x1 = CLAMP(span->x1 - offset, x0, *end);
+    memset(row + *begin, border, x0 - *begin);
+    memset(row + x1, border, *end - x1);
+    *begin = x0;
+    *end = x1;
+}
+
+void
+sc_remap_spans_init(struct sc_remap_span *spans, const int16_t *map1,
+                    int map1_linesize, int width, int height, int src_width,
+                    int src_height) {
+    for (int y = 0; y < height; ++y) {
+        const int16_t *xy = (const int16_t *)
+            ((const uint8_t *) map1 + (ptrdiff_t) y * map1_linesize);
+        sc_remap_span_init(&spans[y], xy, width, src_width, src_height);
+    }
+}
+
+const char *
+sc_remap_u8_simd(void) {
+#ifdef SC_REMAP_AVX2
+    if (sc_remap_has_avx2()) {
+        return "avx2";
+    }
+#elif defined(SC_REMAP_NEON)
+    return "neon";
+#endif
+    return NULL;
+}
+
+void
+sc_remap_u8(const uint8_t *src, int src_linesize, int src_width,
+            int src_height, uint8_t *dst, int dst_linesize, int width,
+            int height, const int16_t *map1, int map1_linesize,
+            const uint16_t *map2, int map2_linesize, uint8_t border) {
+    sc_remap_u8_spans(src, src_linesize, src_width, src_height, dst,
+                      dst_linesize, width, height, map1, map1_linesize, map2,
+                      map2_linesize, NULL, border);
+}
+
+void
+sc_remap_u8_spans(const uint8_t *src, int src_linesize, int src_width,
+                  int src_height, uint8_t *dst, int dst_linesize, int width,
+                  int height, const int16_t *map1, int map1_linesize,
+                  const uint16_t *map2, int map2_linesize,
+                  const struct sc_remap_span *spans, uint8_t border) {
+    const struct sc_remap_src s = {
+        .data = src,
+        .linesize = src_linesize,
+        .width = src_width,
+        .height = src_height,
+        .border = border,
+    };
+    sc_remap_row_fn remap_row = sc_remap_select();
+
+    const uint8_t *map1_data = (const uint8_t *) map1;
+    const uint8_t *map2_data = (const uint8_t *) map2;
+
+    for (int ty = 0; ty < height; ty += SC_REMAP_TILE_HEIGHT) {
+        int ty_end = MIN(ty + SC_REMAP_TILE_HEIGHT, height);
+        for (int tx = 0; tx < width; tx += SC_REMAP_TILE_WIDTH) {
+            int tx_end = MIN(tx + SC_REMAP_TILE_WIDTH, width);
+            for (int y = ty; y < ty_end; ++y) {
+                const int16_t *xy = (const int16_t *)
+                    (map1_data + (ptrdiff_t) y * map1_linesize);
+                const uint16_t *frac = (const uint16_t *)
+                    (map2_data + (ptrdiff_t) y * map2_linesize);
+                uint8_t *row = dst + (ptrdiff_t) y * dst_linesize;
+                int begin = tx;
+                int end = tx_end;
+                if (spans) {
+                    sc_remap_clip_span(&spans[y], 0, row, &begin, &end,
+                                       border);
+                    if (begin == end) {
+                        continue;
+                    }
+                }
+                if (y + 1 < ty_end) {
+                    // The maps of a tile are not contiguous, so the hardware
+                    // prefetcher does not anticipate the next row
+                    sc_remap_prefetch_maps(xy, frac, map1_linesize,
+                                           map2_linesize, begin, end);
+                }
+                remap_row(&s, row, xy, frac, begin, end);
+            }
+        }
+    }
+}
+
+// Source coordinates of the dense map at (x, y), in 1/32 pixel
+static inline void
+sc_remap_dense_get(const int16_t *map1, int map1_linesize,
+                   const uint16_t *map2, int map2_linesize, int x, int y,
+                   int32_t *qx, int32_t *qy) {
+    const int16_t *xy = (const int16_t *)
+        ((const uint8_t *) map1 + (ptrdiff_t) y * map1_linesize);
+    const uint16_t *frac = (const uint16_t *)
+        ((const uint8_t *) map2 + (ptrdiff_t) y * map2_linesize);
+    *qx = xy[2 * x] * SC_REMAP_FRAC_ONE + (frac[x] & SC_REMAP_FRAC_MASK);
+    *qy = xy[2 * x + 1] * SC_REMAP_FRAC_ONE
+        + ((frac[x] >> SC_REMAP_FRAC_BITS) & SC_REMAP_FRAC_MASK);
+}
+
+static inline int32_t
+sc_remap_grid_clamp(int64_t q) {
+    // Saturated to the int16_t range of map1, like cv::convertMaps()
+    const int64_t min = INT16_MIN * SC_REMAP_FRAC_ONE;
+    const int64_t max = INT16_MAX * SC_REMAP_FRAC_ONE + SC_REMAP_FRAC_MASK;
+    return q < min ? min : q > max ? max : q;
+}
+
+// Fill the control points of the grid from the dense map (the points beyond
+// the map are extrapolated linearly from its last pixels)
+static void
+sc_remap_grid_fill(struct sc_remap_grid *grid, const int16_t *map1,
+                   int map1_linesize, const uint16_t *map2,
+                   int map2_linesize) {
+    const unsigned to_grid = SC_REMAP_GRID_FRAC_BITS - SC_REMAP_FRAC_BITS;
+    int32_t *p = grid->xy;
+    for (int r = 0; r < grid->rows; ++r) {
+        int py = r << grid->shift;
+        int cy = MIN(py, grid->height - 1);
+        int prev_y = MAX(cy - 1, 0);
+        for (int c = 0; c < grid->cols; ++c) {
+            int px = c << grid->shift;
+            int cx = MIN(px, grid->width - 1);
+            int prev_x = MAX(cx - 1, 0);
+
+            int32_t x, y, x_left, y_left, x_up, y_up;
+            sc_remap_dense_get(map1, map1_linesize, map2, map2_linesize, cx,
+                               cy, &x, &y);
+            sc_remap_dense_get(map1, map1_linesize, map2, map2_linesize,
+                               prev_x, cy, &x_left, &y_left);
+            sc_remap_dense_get(map1, map1_linesize, map2, map2_linesize, cx,
+                               prev_y, &x_up, &y_up);
+
+            int64_t gx = x + (int64_t) (px - cx) * (x - x_left)
+                           + (int64_t) (py - cy) * (x - x_up);
+            int64_t gy = y + (int64_t) (px - cx) * (y - y_left)
+                           + (int64_t) (py - cy) * (y - y_up);
+            *p++ = sc_remap_grid_clamp(gx) * (1 << to_grid);
+            *p++ = sc_remap_grid_clamp(gy) * (1 << to_grid);
+        }
+    }
+}
+
+typedef void (*sc_remap_grid_expand_fn)(int32_t vx, int32_t vy, int32_t dx,
+                                        int32_t dy, int n, int16_t *xy,
+                                        uint16_t *frac);
+typedef void (*sc_remap_grid_row_fn)(const struct sc_remap_grid *grid, int y,
+                                     int x0, int count, int16_t *xy,
+                                     uint16_t *frac);
+
+// Expand n coordinates interpolated from (vx, vy) by steps of (dx, dy), with
+// SC_REMAP_GRID_STEP_BITS fractional bits, to the dense representation
+static inline void
+sc_remap_grid_expand_scalar(int32_t vx, int32_t vy, int32_t dx, int32_t dy,
+                            int n, int16_t *xy, uint16_t *frac) {
+    for (int j = 0; j < n; ++j) {
+        int32_t qx = (vx + dx * j + SC_REMAP_GRID_STEP_ROUND)
+                   >> SC_REMAP_GRID_STEP_SHIFT;
+        int32_t qy = (vy + dy * j + SC_REMAP_GRID_STEP_ROUND)
+                   >> SC_REMAP_GRID_STEP_SHIFT;
+        xy[2 * j] = qx >> SC_REMAP_FRAC_BITS;
+        xy[2 * j + 1] = qy >> SC_REMAP_FRAC_BITS;
+        frac[j] = (qy & SC_REMAP_FRAC_MASK) << SC_REMAP_FRAC_BITS
+                | (qx & SC_REMAP_FRAC_MASK);
+    }
+}
+
+#ifdef SC_REMAP_AVX2
+__attribute__((target("avx2")))
+static inline void
+sc_remap_grid_expand_avx2(int32_t vx, int32_t vy, int32_t dx, int32_t dy,
+                          int n, int16_t *xy, uint16_t *frac) {
+    const __m256i iota = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i frac_mask = _mm256_set1_epi32(SC_REMAP_FRAC_MASK);
+    const __m256i low16 = _mm256_set1_epi32(0xFFFF);
+    const __m256i dx8 = _mm256_set1_epi32(dx * 8);
+    const __m256i dy8 = _mm256_set1_epi32(dy * 8);
+
+    __m256i x = _mm256_add_epi32(
+            _mm256_set1_epi32(vx + SC_REMAP_GRID_STEP_ROUND),
+            _mm256_mullo_epi32(iota, _mm256_set1_epi32(dx)));
+    __m256i y = _mm256_add_epi32(
+            _mm256_set1_epi32(vy + SC_REMAP_GRID_STEP_ROUND),
+            _mm256_mullo_epi32(iota, _mm256_set1_epi32(dy)));
+
+    int j = 0;
+    for (; j + 8 <= n; j += 8) {
+        __m256i qx = _mm256_srai_epi32(x, SC_REMAP_GRID_STEP_SHIFT);
+        __m256i qy = _mm256_srai_epi32(y, SC_REMAP_GRID_STEP_SHIFT);
+
+        // {x, y} as pairs of 16-bit values
+        __m256i v = _mm256_or_si256(
+                _mm256_and_si256(_mm256_srai_epi32(qx, SC_REMAP_FRAC_BITS),
+                                 low16),
+                _mm256_slli_epi32(_mm256_srai_epi32(qy, SC_REMAP_FRAC_BITS),
+                                  16));
+        _mm256_storeu_si256((__m256i *) (xy + 2 * j), v);
+
+        __m256i f = _mm256_or_si256(
+                _mm256_slli_epi32(_mm256_and_si256(qy, frac_mask),
+                                  SC_REMAP_FRAC_BITS),
+                _mm256_and_si256(qx, frac_mask));
+        _mm_storeu_si128((__m128i *) (frac + j),
+                         _mm_packus_epi32(_mm256_castsi256_si128(f),
+                                          _mm256_extracti128_si256(f, 1)));
+
+        x = _mm256_add_epi32(x, dx8);
+        y = _mm256_add_epi32(y, dy8);
+    }
+
+    sc_remap_grid_expand_scalar(vx + dx * j, vy + dy * j, dx, dy, n - j,
+                                xy + 2 * j, frac + j);
+}
+#endif
+
+// Iterate over the cells of a row of a grid
+struct sc_remap_grid_cursor {
+    const int32_t *top;
+    const int32_t *bottom;
+    unsigned shift;
+    int64_t ty;
+    int c;
+    // Right side of the current cell, interpolated vertically (it is the left
+    // side of the next one)
+    int64_t rx;
+    int64_t ry;
+};
+
+static inline void
+sc_remap_grid_cursor_init(struct sc_remap_grid_cursor *cursor,
+                          const struct sc_remap_grid *grid, int y, int x) {
+    unsigned shift = grid->shift;
+    int64_t step = 1 << shift;
+    cursor->shift = shift;
+    cursor->ty = y & (step - 1);
+    cursor->top = grid->xy + (size_t) (y >> shift) * grid->cols * 2;
+    cursor->bottom = cursor->top + grid->cols * 2;
+    // The cell before the one containing x
+    cursor->c = (x >> shift) - 1;
+
+    int c = x >> shift;
+    cursor->rx = cursor->top[2 * c] * (step - cursor->ty)
+               + cursor->bottom[2 * c] * cursor->ty;
+    cursor->ry = cursor->top[2 * c + 1] * (step - cursor->ty)
+               + cursor->bottom[2 * c + 1] * cursor->ty;
+}
+
+// Move to the cell containing x (the next one), and return the coordinates
+// interpolated at x and their steps per pixel, with SC_REMAP_GRID_STEP_BITS
+// fractional bits, and the number of pixels of the cell from x (up to end)
+static inline int
+sc_remap_grid_cursor_next(struct sc_remap_grid_cursor *cursor, int x, int end,
+                          int32_t *vx, int32_t *vy, int32_t *dx,
+                          int32_t *dy) {
+    unsigned shift = cursor->shift;
+    int64_t step = 1 << shift;
+    int64_t ty = cursor->ty;
+    int c = ++cursor->c;
+    assert(c == x >> shift);
+
+    // Interpolate vertically the control points of both sides of the cell
+    int64_t lx = cursor->rx;
+    int64_t ly = cursor->ry;
+    int64_t rx = cursor->top[2 * c + 2] * (step - ty)
+               + cursor->bottom[2 * c + 2] * ty;
+    int64_t ry = cursor->top[2 * c + 3] * (step - ty)
+               + cursor->bottom[2 * c + 3] * ty;
+    cursor->rx = rx;
+    cursor->ry = ry;
+
+    // Then horizontally, in 32-bit so that the pixels are vectorized (the
+    // error accumulated over a cell is far below the map precision)
+    unsigned down = 2 * shift + SC_REMAP_GRID_FRAC_BITS
+                  - SC_REMAP_GRID_STEP_BITS;
+    int64_t tx = x & (step - 1);
+    *vx = (lx * step + (rx - lx) * tx) >> down;
+    *vy = (ly * step + (ry - ly) * tx) >> down;
+    *dx = (rx - lx) >> down;
+    *dy = (ry - ly) >> down;
+
+    // The interpolated coordinates are between the control points (up to
+    // the rounding), which are in the range of the dense maps
+    return MIN((c + 1) << shift, end) - x;
+}
+
+static inline void
+sc_remap_grid_row(const struct sc_remap_grid *grid, int y, int x0, int count,
+                  int16_t *xy, uint16_t *frac, sc_remap_grid_expand_fn expand) {
+    struct sc_remap_grid_cursor cursor;
+    sc_remap_grid_cursor_init(&cursor, grid, y, x0);
+
+    int x = x0;
+    int end = x0 + count;
+    while (x < end) {
+        int32_t vx, vy, dx, dy;
+        int n = sc_remap_grid_cursor_next(&cursor, x, end, &vx, &vy, &dx, &dy);
+        expand(vx, vy, dx, dy, n, xy + 2 * (x - x0), frac + (x - x0));
+        x += n;
+    }
+}
+
+static void
+sc_remap_grid_row_scalar(const struct sc_remap_grid *grid, int y, int x0,
+                         int count, int16_t *xy, uint16_t *frac) {
+    sc_remap_grid_row(grid, y, x0, count, xy, frac,
+                      sc_remap_grid_expand_scalar);
+}
+
+#ifdef SC_REMAP_AVX2
+__attribute__((target("avx2")))
+static void
+sc_remap_grid_row_avx2(const struct sc_remap_grid *grid, int y, int x0,
+                       int count, int16_t *xy, uint16_t *frac) {
+    sc_remap_grid_row(grid, y, x0, count, xy, frac,
+                      sc_remap_grid_expand_avx2);
+}
+
+// Remap the pixels [j0, j1) interpolated from (vx, vy) by steps of (dx, dy)
+static void
+sc_remap_grid_pixels_scalar(const struct sc_remap_src *src, uint8_t *dst,
+                            int32_t vx, int32_t vy, int32_t dx, int32_t dy,
+                            int j0, int j1) {
+    for (int j = j0; j < j1; ++j) {
+        int32_t qx = (vx + dx * j + SC_REMAP_GRID_STEP_ROUND)
+                   >> SC_REMAP_GRID_STEP_SHIFT;
+        int32_t qy = (vy + dy * j + SC_REMAP_GRID_STEP_ROUND)
+                   >> SC_REMAP_GRID_STEP_SHIFT;
+        unsigned f = (qy & SC_REMAP_FRAC_MASK) << SC_REMAP_FRAC_BITS
+                   | (qx & SC_REMAP_FRAC_MASK);
+        dst[j] = sc_remap_pixel(src, qx >> SC_REMAP_FRAC_BITS,
+                                qy >> SC_REMAP_FRAC_BITS, f);
+    }
+}
+
+// Remap a tile (the rows [y0, y1) of the pixels [x0, x0 + count)) of the grid,
+// with the coordinates interpolated in the registers (never stored)
+//
+// The cells must be at least 8 pixels wide, and x0 a multiple of their width.
+__attribute__((target("avx2")))
+static void
+sc_remap_grid_remap_tile_avx2(const struct sc_remap_src *src, uint8_t *dst,
+                              int dst_linesize,
+                              const struct sc_remap_grid *grid,
+                              const struct sc_remap_span *spans, int x0,
+                              int count, int y0, int y1) {
+    const __m256i iota = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i frac_mask = _mm256_set1_epi32(SC_REMAP_FRAC_MASK);
+    struct sc_remap_avx2 k;
+    sc_remap_avx2_init(&k, src);
+
+    unsigned shift = grid->shift;
+    assert(shift >= 3 && !(x0 & ((1 << shift) - 1)));
+    int64_t step = 1 << shift;
+    int c0 = x0 >> shift;
+    int cols = ((x0 + count - 1) >> shift) - c0 + 2;
+    assert(cols <= SC_REMAP_TILE_WIDTH / 8 + 2);
+
+    // The control points of the columns of the tile interpolated vertically,
+    // with SC_REMAP_GRID_FRAC_BITS + shift fractional bits, and their steps
+    // per row (constant within a row of cells)
+    int64_t col[2 * (SC_REMAP_TILE_WIDTH / 8 + 2)];
+    int64_t col_step[2 * (SC_REMAP_TILE_WIDTH / 8 + 2)];
+
+    unsigned down = shift + SC_REMAP_GRID_FRAC_BITS - SC_REMAP_GRID_STEP_BITS;
+    for (int y = y0; y < y1; ++y) {
+        int64_t ty = y & (step - 1);
+        if (y == y0 || !ty) {
+            const int32_t *top =
+                grid->xy + ((size_t) (y >> shift) * grid->cols + c0) * 2;
+            const int32_t *bottom = top + grid->cols * 2;
+            for (int i = 0; i < 2 * cols; ++i) {
+                col[i] = top[i] * (step - ty) + bottom[i] * ty;
+                col_step[i] = bottom[i] - top[i];
+            }
+        } else {
+            for (int i = 0; i < 2 * cols; ++i) {
+                col[i] += col_step[i];
+            }
+        }
+
+        uint8_t *row = dst + (ptrdiff_t) (y - y0) * dst_linesize;
+        int begin = 0;
+        int end = count;
+        if (spans) {
+            sc_remap_clip_span(&spans[y], x0, row, &begin, &end,
+                               src->border);
+            // From the start of its cell (the pixels before the span are
+            // computed as the border)
+            begin &= ~(step - 1);
+        }
+        for (int x = begin; x < end; x += step) {
+            int c = x >> shift;
+            int n = MIN(step, end - x);
+            // Interpolate horizontally, in 32-bit (the error accumulated over
+            // a cell is far below the map precision)
+            int32_t vx = col[2 * c] >> down;
+            int32_t vy = col[2 * c + 1] >> down;
+            int32_t dx = (col[2 * c + 2] - col[2 * c]) >> (down + shift);
+            int32_t dy = (col[2 * c + 3] - col[2 * c + 1]) >> (down + shift);
+            uint8_t *out = row + x;
+
+            __m256i qx = _mm256_add_epi32(
+                    _mm256_set1_epi32(vx + SC_REMAP_GRID_STEP_ROUND),
+                    _mm256_mullo_epi32(iota, _mm256_set1_epi32(dx)));
+            __m256i qy = _mm256_add_epi32(
+                    _mm256_set1_epi32(vy + SC_REMAP_GRID_STEP_ROUND),
+                    _mm256_mullo_epi32(iota, _mm256_set1_epi32(dy)));
+            const __m256i dx8 = _mm256_set1_epi32(dx * 8);
+            const __m256i dy8 = _mm256_set1_epi32(dy * 8);
+
+            int j = 0;
+            for (; j + 8 <= n; j += 8) {
+                __m256i px = _mm256_srai_epi32(qx, SC_REMAP_GRID_STEP_SHIFT);
+                __m256i py = _mm256_srai_epi32(qy, SC_REMAP_GRID_STEP_SHIFT);
+                __m256i ix = _mm256_srai_epi32(px, SC_REMAP_FRAC_BITS);
+                __m256i iy = _mm256_srai_epi32(py, SC_REMAP_FRAC_BITS);
+                __m256i fx = _mm256_and_si256(px, frac_mask);
+                __m256i fy = _mm256_and_si256(py, frac_mask);
+                if (!sc_remap_8_avx2(&k, out + j, ix, iy, fx, fy)) {
+                    // Close to the borders
+                    sc_remap_grid_pixels_scalar(src, out, vx, vy, dx, dy, j,
+                                                j + 8);
+                }
+                qx = _mm256_add_epi32(qx, dx8);
+                qy = _mm256_add_epi32(qy, dy8);
+            }
+
+            // The last pixels of the row
+            sc_remap_grid_pixels_scalar(src, out, vx, vy, dx, dy, j, n);
+        }
+    }
+}
+#endif
+
+static sc_remap_grid_row_fn
+sc_remap_grid_select(void) {
+#ifdef SC_REMAP_AVX2
+    if (sc_remap_has_avx2()) {
+        return sc_remap_grid_row_avx2;
+    }
+#endif
+    return sc_remap_grid_row_scalar;
+}
+
+void
+sc_remap_grid_get_row(const struct sc_remap_grid *grid, int y, int x0,
+                      int count, int16_t *xy, uint16_t *frac) {
+    sc_remap_grid_row_fn get_row = sc_remap_grid_select();
+    get_row(grid, y, x0, count, xy, frac);
+}
+
+// Return the maximal difference between the source coordinates of the grid
+// and the dense map, in 1/32 pixel
+static int32_t
+sc_remap_grid_get_error(const struct sc_remap_grid *grid,
+                        const int16_t *map1, int map1_linesize,
+                        const uint16_t *map2, int map2_linesize,
+                        int src_width, int src_height, int16_t *xy,
+                        uint16_t *frac) {
+    int32_t error = 0;
+    for (int y = 0; y < grid->height; ++y) {
+        sc_remap_grid_get_row(grid, y, 0, grid->width, xy, frac);
+        for (int x = 0; x < grid->width; ++x) {
+            int32_t qx, qy;
+            sc_remap_dense_get(map1, map1_linesize, map2, map2_linesize, x, y,
+                               &qx, &qy);
+            if (qx <= -SC_REMAP_FRAC_ONE || qy <= -SC_REMAP_FRAC_ONE
+                    || qx >= src_width * SC_REMAP_FRAC_ONE
+                    || qy >= src_height * SC_REMAP_FRAC_ONE) {
+                // Only the border is sampled
+                continue;
+            }
+
+            int32_t gx = xy[2 * x] * SC_REMAP_FRAC_ONE
+                       + (frac[x] & SC_REMAP_FRAC_MASK);
+            int32_t gy = xy[2 * x + 1] * SC_REMAP_FRAC_ONE
+                       + (frac[x] >> SC_REMAP_FRAC_BITS);
+            error = MAX(error, abs(gx - qx));
+            error = MAX(error, abs(gy - qy));
+        }
+    }
+    return error;
+}
+
+bool
+sc_remap_grid_init(struct sc_remap_grid *grid, const int16_t *map1,
+                   int map1_linesize, const uint16_t *map2, int map2_linesize,
+                   int width, int height, int src_width, int src_height) {
+    assert(width > 0 && height > 0);
+    grid->xy = NULL;
+    grid->owned = true;
+    grid->spans = NULL;
+
+    // Expanded rows, to compare with the dense map
+    int16_t *xy = malloc((size_t) width * 2 * sizeof(*xy));
+    uint16_t *frac = malloc((size_t) width * sizeof(*frac));
+    if (!xy || !frac) {
+        LOG_OOM();
+        free(xy);
+        free(frac);
+        return false;
+    }
+
+    bool ok = false;
+    for (unsigned shift = SC_REMAP_GRID_MAX_SHIFT;
+            shift >= SC_REMAP_GRID_MIN_SHIFT; --shift) {
+        grid->width = width;
+        grid->height = height;
+        grid->shift = shift;
+        grid->cols = ((width - 1) >> shift) + 2;
+        grid->rows = ((height - 1) >> shift) + 2;
+
+        free(grid->xy);
+        grid->xy = malloc(sc_remap_grid_get_size(grid));
+        if (!grid->xy) {
+            LOG_OOM();
+            break;
+        }
+
+        sc_remap_grid_fill(grid, map1, map1_linesize, map2, map2_linesize);
+        int32_t error = sc_remap_grid_get_error(grid, map1, map1_linesize,
+                                                map2, map2_linesize, src_width,
+                                                src_height, xy, frac);
+        if (error <= SC_REMAP_GRID_MAX_ERROR) {
+            ok = true;
+            break;
+        }
+    }
+
+    free(xy);
+    free(frac);
+    if (!ok) {
+        free(grid->xy);
+        grid->xy = NULL;
+        return false;
+    }
+
+    sc_remap_grid_init_spans(grid, src_width, src_height);
+    return true;
+}
+
+void
+sc_remap_grid_init_spans(struct sc_remap_grid *grid, int src_width,
+                         int src_height) {
+    free(grid->spans);
+    grid->spans = NULL;
+
+    struct sc_remap_span *spans =
+        malloc((size_t) grid->height * sizeof(*spans));
+    int16_t *xy = malloc((size_t) grid->width * 2 * sizeof(*xy));
+    uint16_t *frac = malloc((size_t) grid->width * sizeof(*frac));
+    if (!spans || !xy || !frac) {
+        LOG_OOM();
+        free(spans);
+        free(xy);
+        free(frac);
+        return;
+    }
+
+    for (int y = 0; y < grid->height; ++y) {
+        sc_remap_grid_get_row(grid, y, 0, grid->width, xy, frac);
+        sc_remap_span_init(&spans[y], xy, grid->width, src_width, src_height);
+    }
+
+    free(xy);
+    free(frac);
+    grid->spans = spans;
+    grid->spans_src_width = src_width;
+    grid->spans_src_height = src_height;
+}
+
+void
+sc_remap_grid_destroy(struct sc_remap_grid *grid) {
+    if (grid->owned) {
+        free(grid->xy);
+    }
+    grid->xy = NULL;
+    free(grid->spans);
+    grid->spans = NULL;
+}
+
+size_t
+sc_remap_grid_get_size(const struct sc_remap_grid *grid) {
+    return (size_t) grid->cols * grid->rows * 2 * sizeof(int32_t);
+}
+
+void
+sc_remap_grid_u8(const uint8_t *src, int src_linesize, int src_width,
+                 int src_height, uint8_t *dst, int dst_linesize,
+                 const struct sc_remap_grid *grid, int y0, int y1,
+                 uint8_t border) {
+    assert(0 <= y0 && y0 <= y1 && y1 <= grid->height);
+
+    const struct sc_remap_src s = {
+        .data = src,
+        .linesize = src_linesize,
+        .width = src_width,
+        .height = src_height,
+        .border = border,
+    };
+    sc_remap_row_fn remap_row = sc_remap_select();
+    sc_remap_grid_row_fn get_row = sc_remap_grid_select();
+    const struct sc_remap_span *spans =
+        grid->spans && grid->spans_src_width == src_width
+                    && grid->spans_src_height == src_height ? grid->spans
+                                                            : NULL;
+#ifdef SC_REMAP_AVX2
+    // With cells of 8 pixels or more, the coordinates of 8 pixels are
+    // interpolated at once, in the registers
+    bool fused = grid->shift >= 3 && sc_remap_has_avx2();
+#endif
+
+    // The dense coordinates of a row of a tile, in the L1 cache
+    int16_t xy[2 * SC_REMAP_TILE_WIDTH];
+    uint16_t frac[SC_REMAP_TILE_WIDTH];
+
+    int width = grid->width;
+    for (int ty = y0; ty < y1; ty += SC_REMAP_TILE_HEIGHT) {
+        int ty_end = MIN(ty + SC_REMAP_TILE_HEIGHT, y1);
+        for (int tx = 0; tx < width; tx += SC_REMAP_TILE_WIDTH) {
+            int count = MIN(SC_REMAP_TILE_WIDTH, width - tx);
+#ifdef SC_REMAP_AVX2
+            if (fused) {
+                uint8_t *tile = dst + (ptrdiff_t) (ty - y0) * dst_linesize
+                              + tx;
+                sc_remap_grid_remap_tile_avx2(&s, tile, dst_linesize, grid,
+                                              spans, tx, count, ty, ty_end);
+                continue;
+            }
+#endif
+            for (int y = ty; y < ty_end; ++y) {
+                uint8_t *row = dst + (ptrdiff_t) (y - y0) * dst_linesize + tx;
+                int begin = 0;
+                int end = count;
+                if (spans) {
+                    sc_remap_clip_span(&spans[y], tx, row, &begin, &end,
+                                       border);
+                    if (begin == end) {
+                        continue;
+                    }
+                }
+                // Only the coordinates of the span are expanded
+                get_row(grid, y, tx + begin, end - begin, xy, frac);
+                remap_row(&s, row + begin, xy, frac, 0, end - begin);
+            }
+        }
+    }
+}
+
+// Remap the rows [y0, y1) of a plane by a dense map or a grid (dst points to
+// the row y0)
+static void
+sc_remap_plane_rows(const uint8_t *src, int src_linesize, int src_width,
+                    int src_height, uint8_t *dst, int dst_linesize, int width,
+                    const struct sc_remap_plane_map *map, int y0, int y1,
+                    uint8_t border) {
+    if (map->grid) {
+        sc_remap_grid_u8(src, src_linesize, src_width, src_height, dst,
+                         dst_linesize, map->grid, y0, y1, border);
+        return;
+    }
+
+    const int16_t *map1 = (const int16_t *)
+        ((const uint8_t *) map->map1 + (ptrdiff_t) y0 * map->map1_linesize);
+    const uint16_t *map2 = (const uint16_t *)
+        ((const uint8_t *) map->map2 + (ptrdiff_t) y0 * map->map2_linesize);
+    const struct sc_remap_span *spans = map->spans ? map->spans + y0 : NULL;
+    sc_remap_u8_spans(src, src_linesize, src_width, src_height, dst,
+                      dst_linesize, width, y1 - y0, map1, map->map1_linesize,
+                      map2, map->map2_linesize, spans, border);
+}
+
+bool
+sc_remap_yuv420p_to_rgb(const uint8_t *const src[3],
+                        const int src_linesizes[3], int src_width,
+                        int src_height, const struct sc_remap_plane_map *luma,
+                        const struct sc_remap_plane_map *chroma, uint8_t *dst,
+                        int dst_linesize, int width, int y0, int y1,
+                        enum sc_rgb_format format) {
+    assert(!(width & 1) && !(y0 & 1) && y0 <= y1);
+
+    int chroma_width = width / 2;
+    // The luma rows of a band, then the U and V rows covering them
+    int band_rows = SC_REMAP_RGB_BAND_ROWS;
+    uint8_t *buf = malloc((size_t) band_rows * (width + chroma_width));
+    if (!buf) {
+        LOG_OOM();
+        return false;
+    }
+    uint8_t *y_band = buf;
+    uint8_t *u_band = y_band + (size_t) band_rows * width;
+    uint8_t *v_band = u_band + (size_t) (band_rows / 2) * chroma_width;
+
+    int chroma_src_width = src_width / 2;
+    int chroma_src_height = src_height / 2;
+
+    for (int y = y0; y < y1; y += band_rows) {
+        int y_end = MIN(y + band_rows, y1);
+        int cy0 = y / 2;
+        int cy1 = (y_end + 1) / 2;
+
+        sc_remap_plane_rows(src[0], src_linesizes[0], src_width, src_height,
+                            y_band, width, width, luma, y, y_end,
+                            SC_REMAP_RGB_BORDER_LUMA);
+        sc_remap_plane_rows(src[1], src_linesizes[1], chroma_src_width,
+                            chroma_src_height, u_band, chroma_width,
+                            chroma_width, chroma, cy0, cy1,
+                            SC_REMAP_RGB_BORDER_CHROMA);
+        sc_remap_plane_rows(src[2], src_linesizes[2], chroma_src_width,
+                            chroma_src_height, v_band, chroma_width,
+                            chroma_width, chroma, cy0, cy1,
+                            SC_REMAP_RGB_BORDER_CHROMA);
+
+        // Converted while the band is still in the cache
+        for (int row = y; row < y_end; ++row) {
+            size_t c = (size_t) (row / 2 - cy0) * chroma_width;
+            sc_yuv_to_rgb_row(y_band + (size_t) (row - y) * width,
+                              u_band + c, v_band + c,
+                              dst + (ptrdiff_t) (row - y0) * dst_linesize,
+                              width, format);
+        }
+    }
+
+    free(buf);
+    return true;
+}
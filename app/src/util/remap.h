@@ -0,0 +1,213 @@
+#ifndef SC_REMAP_H
+#define SC_REMAP_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/yuv_rgb.h"
+
+/**
+ * Bilinear remap of an 8-bit plane, with the fixed-point maps computed by
+ * cv::convertMaps() (CV_16SC2 map1 and CV_16UC1 map2, 5 fractional bits)
+ *
+ * For each destination pixel (x, y), map1 contains the integer source
+ * coordinates (sx, sy), and map2 the fractions (fy << 5 | fx) in 1/32 pixel.
+ * The source samples outside of the plane are `border`. The result is the same
+ * as cv::remap() with cv::INTER_LINEAR and cv::BORDER_CONSTANT (same weights,
+ * same rounding).
+ *
+ * The destination is processed by tiles (so that the source rows read by a
+ * tile stay in cache), 8 pixels at a time with AVX2 (if the CPU supports it,
+ * detected at runtime) or NEON (on aarch64).
+ *
+ * The linesizes are in bytes.
+ */
+void
+sc_remap_u8(const uint8_t *src, int src_linesize, int src_width,
+            int src_height, uint8_t *dst, int dst_linesize, int width,
+            int height, const int16_t *map1, int map1_linesize,
+            const uint16_t *map2, int map2_linesize, uint8_t border);
+
+/**
+ * The destination pixels of a row which may be mapped from the source,
+ * [x0, x1) (empty if x0 == x1): the pixels before and after are mapped from
+ * outside of the source, so they are exactly the border
+ *
+ * A large part of the rectified views (their corners, or whole rows at the top
+ * and the bottom) is outside of the source: with the spans, these pixels are
+ * just filled with the border, without any sampling.
+ */
+struct sc_remap_span {
+    int x0;
+    int x1;
+};
+
+/**
+ * Compute the spans of the rows of a dense map (see sc_remap_u8()) of width x
+ * height, remapping from a source of src_width x src_height, into `spans`
+ * (`height` entries)
+ */
+void
+sc_remap_spans_init(struct sc_remap_span *spans, const int16_t *map1,
+                    int map1_linesize, int width, int height, int src_width,
+                    int src_height);
+
+/**
+ * Same as sc_remap_u8(), only sampling the spans of the rows (`height` entries
+ * computed for this source size by sc_remap_spans_init(), NULL to sample all
+ * the pixels)
+ */
+void
+sc_remap_u8_spans(const uint8_t *src, int src_linesize, int src_width,
+                  int src_height, uint8_t *dst, int dst_linesize, int width,
+                  int height, const int16_t *map1, int map1_linesize,
+                  const uint16_t *map2, int map2_linesize,
+                  const struct sc_remap_span *spans, uint8_t border);
+
+// Fractional bits of the coordinates of the control points of a grid
+#define SC_REMAP_GRID_FRAC_BITS 16
+// Largest step tried by sc_remap_grid_init(), as a power of 2 (16 pixels)
+#define SC_REMAP_GRID_MAX_SHIFT 4
+// Smallest step tried by sc_remap_grid_init() (4 pixels: 12 times less memory
+// than the dense maps)
+#define SC_REMAP_GRID_MIN_SHIFT 2
+// Maximal difference, in 1/32 pixel, between the source coordinates
+// interpolated from the grid and the dense map
+#define SC_REMAP_GRID_MAX_ERROR 2
+
+/**
+ * Compact representation of a remap map: the source coordinates of a sparse
+ * grid of control points, every `1 << shift` destination pixels in both
+ * directions, bilinearly interpolated on the fly for the pixels in between
+ *
+ * A dense fixed-point map costs 6 bytes per pixel, read for every frame. The
+ * lens rectification maps are smooth, so a grid of a few pixels reproduces
+ * them within a fraction of a pixel, for 8 bytes per control point: 12 to 192
+ * times less memory and memory bandwidth.
+ */
+struct sc_remap_grid {
+    // Size of the destination
+    int width;
+    int height;
+    unsigned shift;
+    // Control points per row and per column (the last ones may be beyond the
+    // destination, extrapolated from the map)
+    int cols;
+    int rows;
+    // (x, y) of the control points, with SC_REMAP_GRID_FRAC_BITS fractional
+    // bits, row by row
+    int32_t *xy;
+    // xy is freed by sc_remap_grid_destroy() (false if it points to memory
+    // owned by the caller, e.g. shared with other processes)
+    bool owned;
+    // The spans of the rows (always owned), NULL if not computed, and the
+    // size of the source they were computed for
+    struct sc_remap_span *spans;
+    int spans_src_width;
+    int spans_src_height;
+};
+
+/**
+ * Build the grid reproducing a dense fixed-point map (see sc_remap_u8()) of
+ * width x height, remapping from a source of src_width x src_height
+ *
+ * The steps from 1 << SC_REMAP_GRID_MAX_SHIFT down to
+ * 1 << SC_REMAP_GRID_MIN_SHIFT are tried, and the first one which reproduces
+ * the source coordinates of the map within SC_REMAP_GRID_MAX_ERROR is kept
+ * (the pixels mapped from outside of the source, always the border, are not
+ * compared).
+ *
+ * The spans of the rows are also computed (see sc_remap_grid_init_spans()).
+ *
+ * Return false if no grid is accurate enough (or on allocation failure): the
+ * dense map must be used.
+ */
+bool
+sc_remap_grid_init(struct sc_remap_grid *grid, const int16_t *map1,
+                   int map1_linesize, const uint16_t *map2, int map2_linesize,
+                   int width, int height, int src_width, int src_height);
+
+/**
+ * Compute the spans of the rows of the grid (see struct sc_remap_span), for a
+ * source of src_width x src_height, from the coordinates interpolated by the
+ * grid
+ *
+ * They are only used by sc_remap_grid_u8() for a source of this size. On
+ * allocation failure, the grid is just used without spans.
+ */
+void
+sc_remap_grid_init_spans(struct sc_remap_grid *grid, int src_width,
+                         int src_height);
+
+void
+sc_remap_grid_destroy(struct sc_remap_grid *grid);
+
+// Memory used by the control points
+size_t
+sc_remap_grid_get_size(const struct sc_remap_grid *grid);
+
+/**
+ * Expand the columns [x0, x0 + count) of the row y of the grid to the dense
+ * fixed-point representation (xy and frac indexed from 0)
+ */
+void
+sc_remap_grid_get_row(const struct sc_remap_grid *grid, int y, int x0,
+                      int count, int16_t *xy, uint16_t *frac);
+
+/**
+ * Bilinear remap of the rows [y0, y1) of an 8-bit plane by a grid
+ *
+ * Same as sc_remap_u8() with the map expanded from the grid (dst points to the
+ * row y0), only sampling the spans of the rows if the grid has spans for this
+ * source size. With AVX2 and cells of 8 pixels or more, the coordinates of 8
+ * pixels are interpolated at once in the registers; otherwise they are expanded
+ * by tiles, in the cache, for the vectorized kernel.
+ */
+void
+sc_remap_grid_u8(const uint8_t *src, int src_linesize, int src_width,
+                 int src_height, uint8_t *dst, int dst_linesize,
+                 const struct sc_remap_grid *grid, int y0, int y1,
+                 uint8_t border);
+
+// The map of a plane: a dense fixed-point map (see sc_remap_u8_spans()), or a
+// grid (see sc_remap_grid_u8()) if not NULL
+struct sc_remap_plane_map {
+    const int16_t *map1;
+    int map1_linesize;
+    const uint16_t *map2;
+    int map2_linesize;
+    const struct sc_remap_span *spans; // of the dense map, may be NULL
+    const struct sc_remap_grid *grid;
+};
+
+/**
+ * Remap the rows [y0, y1) of YUV420P planes and convert them to packed RGB, in
+ * a single pass
+ *
+ * The luma map has width columns, the chroma map (applied to both chroma
+ * planes) half the columns and half the rows. The rows are processed by small
+ * bands: each band of the three planes is remapped into a buffer which stays
+ * in the cache, then converted (see sc_yuv_to_rgb_row()) directly into dst
+ * (pointing to the row y0), so the remapped YUV frame is never written to
+ * memory. The result is the same as sc_remap_u8() on each plane (with the
+ * black borders) followed by sc_yuv420p_to_rgb24().
+ *
+ * The width and y0 must be even. Return false on allocation failure.
+ */
+bool
+sc_remap_yuv420p_to_rgb(const uint8_t *const src[3],
+                        const int src_linesizes[3], int src_width,
+                        int src_height, const struct sc_remap_plane_map *luma,
+                        const struct sc_remap_plane_map *chroma, uint8_t *dst,
+                        int dst_linesize, int width, int y0, int y1,
+                        enum sc_rgb_format format);
+
+// Return the name of the vectorized implementation used by sc_remap_u8()
+// ("avx2" or "neon"), or NULL if only the portable one is available
+const char *
+sc_remap_u8_simd(void);
+
+#endif
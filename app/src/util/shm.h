@@ -0,0 +1,62 @@
+#ifndef SC_SHM_H
+#define SC_SHM_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Named shared memory, readable and writable by other processes
+ */
+struct sc_shm {
+    void *data;
+    size_t size;
+#ifdef _WIN32
+    void *handle; // HANDLE of the file mapping object
+#else
+    char *name;
+#endif
+};
+
+/**
+ * Create a named shared memory of `size` bytes (zero-initialized)
+ *
+ * On Unix, it is a POSIX shared memory object "/<name>". On Windows, it is a
+ * file mapping object "Local\<name>".
+ *
+ * On Unix, an existing object with the same name (e.g. left by a previous
+ * crash) is replaced. On Windows, the object is destroyed once it is not open
+ * anymore, so creating it fails if it is still open by another process.
+ */
+bool
+sc_shm_create(struct sc_shm *shm, const char *name, size_t size);
+
+/**
+ * Unmap and remove the shared memory
+ *
+ * The consumers which have already mapped it may continue to access it.
+ */
+void
+sc_shm_destroy(struct sc_shm *shm);
+
+/**
+ * Map an existing named shared memory, read-only
+ *
+ * On Unix, only an object owned by the current user is opened.
+ *
+ * Return false if it does not exist (nothing is logged) or on error.
+ */
+bool
+sc_shm_open(struct sc_shm *shm, const char *name);
+
+/**
+ * Unmap the shared memory, without removing it
+ *
+ * On Unix, the object remains until it is removed (or until reboot). On
+ * Windows, it is destroyed once no process has it open anymore.
+ */
+void
+sc_shm_close(struct sc_shm *shm);
+
+#endif
@@ -1,21 +1,145 @@
 #include "thread.h"
 
 #include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
 #include <string.h>
+#ifdef __linux__
+# include <pthread.h>
+# include <sched.h>
+#endif
+#ifdef _WIN32
+# include <windows.h>
+# include <avrt.h>
+# include <timeapi.h>
+#endif
 #include <SDL2/SDL_thread.h>
 
 #include "log.h"
 
 sc_thread_id SC_MAIN_THREAD_ID;
 
+// Written once on startup, before any thread is created
+static const struct sc_thread_policy *sc_thread_policies;
+static size_t sc_thread_policy_count;
+
+// The arguments of a thread started with a policy
+struct sc_thread_start {
+    sc_thread_fn *fn;
+    void *userdata;
+    const struct sc_thread_policy *policy;
+};
+
+void
+sc_thread_set_policies(const struct sc_thread_policy *policies, size_t count) {
+    sc_thread_policies = policies;
+    sc_thread_policy_count = count;
+}
+
+static const struct sc_thread_policy *
+sc_thread_find_policy(const char *name) {
+    size_t prefix_len = sizeof(SC_THREAD_NAME_PREFIX) - 1;
+    if (strncmp(name, SC_THREAD_NAME_PREFIX, prefix_len)) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < sc_thread_policy_count; ++i) {
+        if (!strcmp(name + prefix_len, sc_thread_policies[i].name)) {
+            return &sc_thread_policies[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Return the MMCSS registration to revert when the thread terminates (on
+// Windows), or NULL
+static void *
+sc_thread_set_realtime(void) {
+#ifdef __linux__
+    // The lowest real-time priority still preempts all the normal threads
+    struct sched_param param = {
+        .sched_priority = sched_get_priority_min(SCHED_FIFO),
+    };
+    int r = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (!r) {
+        return NULL;
+    }
+    LOGW("Could not set real-time scheduling (error %d), CAP_SYS_NICE or an "
+         "rtprio limit is required", r);
+#elif defined(_WIN32)
+    DWORD task_index = 0;
+    HANDLE mmcss = AvSetMmThreadCharacteristicsW(L"Playback", &task_index);
+    if (mmcss) {
+        return mmcss;
+    }
+    LOGW("Could not register the thread to MMCSS: error %lu",
+         (unsigned long) GetLastError());
+#endif
+
+    (void) sc_thread_set_priority(SC_THREAD_PRIORITY_TIME_CRITICAL);
+    return NULL;
+}
+
+static int
+run_thread_with_policy(void *data) {
+    struct sc_thread_start *start = data;
+    sc_thread_fn *fn = start->fn;
+    void *userdata = start->userdata;
+    const struct sc_thread_policy *policy = start->policy;
+    free(start);
+
+    if (policy->cpus) {
+        (void) sc_thread_set_affinity(policy->cpus);
+    }
+
+    void *mmcss = NULL;
+    if (policy->realtime) {
+        mmcss = sc_thread_set_realtime();
+    }
+
+    LOGD("Thread " SC_THREAD_NAME_PREFIX "%s: cpus 0x%" PRIx64 "%s",
+         policy->name, policy->cpus, policy->realtime ? ", real-time" : "");
+
+    int ret = fn(userdata);
+
+#ifdef _WIN32
+    if (mmcss) {
+        AvRevertMmThreadCharacteristics(mmcss);
+    }
+#else
+    assert(!mmcss);
+#endif
+    return ret;
+}
+
 bool
 sc_thread_create(sc_thread *thread, sc_thread_fn fn, const char *name,
                  void *userdata) {
     // The thread name length is limited on some systems. Never use a name
     // longer than 16 bytes (including the final '\0')
-    assert(strlen(name) <= 15);
+    assert(strlen(name) <= SC_THREAD_NAME_MAX);
+
+    SDL_Thread *sdl_thread;
+    const struct sc_thread_policy *policy = sc_thread_find_policy(name);
+    if (policy) {
+        // The policy is applied by the new thread itself
+        struct sc_thread_start *start = malloc(sizeof(*start));
+        if (!start) {
+            LOG_OOM();
+            return false;
+        }
+        start->fn = fn;
+        start->userdata = userdata;
+        start->policy = policy;
 
-    SDL_Thread *sdl_thread = SDL_CreateThread(fn, name, userdata);
+        sdl_thread = SDL_CreateThread(run_thread_with_policy, name, start);
+        if (!sdl_thread) {
+            free(start);
+        }
+    } else {
+        sdl_thread = SDL_CreateThread(fn, name, userdata);
+    }
     if (!sdl_thread) {
         LOG_OOM();
         return false;
@@ -58,6 +182,40 @@ sc_thread_set_priority(enum sc_thread_priority priority) {
     return true;
 }
 
+bool
+sc_thread_set_affinity(uint64_t cpus) {
+    assert(cpus);
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned i = 0; i < 64; ++i) {
+        if (cpus & (UINT64_C(1) << i)) {
+            CPU_SET(i, &set);
+        }
+    }
+
+    int r = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (r) {
+        LOGW("Could not set thread affinity: error %d", r);
+        return false;
+    }
+
+    return true;
+#elif defined(_WIN32)
+    if (!SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR) cpus)) {
+        LOGW("Could not set thread affinity: error %lu",
+             (unsigned long) GetLastError());
+        return false;
+    }
+
+    return true;
+#else
+    (void) cpus;
+    LOGW("Thread affinity is not supported on this platform");
+    return false;
+#endif
+}
+
 void
 sc_thread_join(sc_thread *thread, int *status) {
     SDL_WaitThread(thread->thread, status);
@@ -165,6 +323,58 @@ sc_cond_wait(sc_cond *cond, sc_mutex *mutex) {
 #endif
 }
 
+#ifdef _WIN32
+# ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#  define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+# endif
+
+// The timed waits of SDL expire on the ticks of the system timer, every
+// 15.6 ms by default: waiting for the next frame at 72 fps (every 13.9 ms)
+// could last an additional frame period. Request a 1 ms resolution for the
+// process, once (it is restored by the system when the process exits).
+static void
+sc_cond_init_timer_resolution(void) {
+    static atomic_bool initialized;
+    if (!atomic_exchange_explicit(&initialized, true, memory_order_relaxed)) {
+        if (timeBeginPeriod(1) != TIMERR_NOERROR) {
+            LOGW("Could not set the timer resolution to 1 ms");
+        }
+    }
+}
+
+// Sleep until the deadline, with a precision better than the millisecond
+static void
+sc_sleep_until_precise(sc_tick deadline) {
+    // Available since Windows 10 1803
+    HANDLE timer =
+        CreateWaitableTimerExW(NULL, NULL,
+                               CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+                               TIMER_ALL_ACCESS);
+
+    sc_tick now;
+    while ((now = sc_tick_now()) < deadline) {
+        if (timer) {
+            // Relative due time, in units of 100 ns
+            LARGE_INTEGER due;
+            due.QuadPart = -(LONGLONG) (SC_TICK_TO_NS(deadline - now) / 100);
+            if (!due.QuadPart) {
+                due.QuadPart = -1;
+            }
+            if (SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE)) {
+                WaitForSingleObject(timer, INFINITE);
+                continue;
+            }
+        }
+        // Limited to the 1 ms resolution of the system timer
+        Sleep(1);
+    }
+
+    if (timer) {
+        CloseHandle(timer);
+    }
+}
+#endif
+
 bool
 sc_cond_timedwait(sc_cond *cond, sc_mutex *mutex, sc_tick deadline) {
     sc_tick now = sc_tick_now();
@@ -172,10 +382,19 @@ sc_cond_timedwait(sc_cond *cond, sc_mutex *mutex, sc_tick deadline) {
         return false; // timeout
     }
 
+#ifdef _WIN32
+    sc_cond_init_timer_resolution();
+    // Only wait on the condition for the whole milliseconds, the remaining
+    // fraction is waited precisely below
+    uint32_t ms = SC_TICK_TO_MS(deadline - now);
+    int r = ms ? SDL_CondWaitTimeout(cond->cond, mutex->mutex, ms)
+               : SDL_MUTEX_TIMEDOUT;
+#else
     // Round up to the next millisecond to guarantee that the deadline is
     // reached when returning due to timeout
     uint32_t ms = SC_TICK_TO_MS(deadline - now + SC_TICK_FROM_MS(1) - 1);
     int r = SDL_CondWaitTimeout(cond->cond, mutex->mutex, ms);
+#endif
 #ifndef NDEBUG
     if (r < 0) {
         LOGE("Could not wait on condition with timeout: %s", SDL_GetError());
@@ -186,6 +405,16 @@ sc_cond_timedwait(sc_cond *cond, sc_mutex *mutex, sc_tick deadline) {
                           memory_order_relaxed);
 #endif
     assert(r == 0 || r == SDL_MUTEX_TIMEDOUT);
+#ifdef _WIN32
+    if (r == SDL_MUTEX_TIMEDOUT && sc_tick_now() < deadline) {
+        // Wait the remaining time without the mutex: a signal meanwhile is
+        // reported as a timeout, as if it was received just after the
+        // deadline (the callers check their state anyway)
+        sc_mutex_unlock(mutex);
+        sc_sleep_until_precise(deadline);
+        sc_mutex_lock(mutex);
+    }
+#endif
     // The deadline is reached on timeout
     assert(r != SDL_MUTEX_TIMEDOUT || sc_tick_now() >= deadline);
     return r == 0;
@@ -5,6 +5,8 @@
 
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #include "tick.h"
 
@@ -28,6 +30,19 @@ enum sc_thread_priority {
     SC_THREAD_PRIORITY_TIME_CRITICAL,
 };
 
+// Max length of a thread name, for all systems
+#define SC_THREAD_NAME_MAX 15
+// Prefix of all the thread names, omitted in the thread policies
+#define SC_THREAD_NAME_PREFIX "scrcpy-"
+
+// Scheduling of the threads of a given name (see sc_thread_set_policies())
+struct sc_thread_policy {
+    // The thread name, without SC_THREAD_NAME_PREFIX (e.g. "demuxer")
+    char name[SC_THREAD_NAME_MAX + 1 - (sizeof(SC_THREAD_NAME_PREFIX) - 1)];
+    uint64_t cpus; // affinity mask (bit i for the core i), 0 to inherit it
+    bool realtime;
+};
+
 typedef struct sc_mutex {
     SDL_mutex *mutex;
 #ifndef NDEBUG
@@ -41,6 +56,22 @@ typedef struct sc_cond {
 
 extern sc_thread_id SC_MAIN_THREAD_ID;
 
+/**
+ * Set the scheduling policies of the threads created afterwards by
+ * sc_thread_create(), matched by name
+ *
+ * A thread with a policy is pinned to its cores, and if `realtime` is set,
+ * runs with a real-time scheduling class: SCHED_FIFO on Linux (which requires
+ * CAP_SYS_NICE or an rtprio limit), registered to the Multimedia Class
+ * Scheduler Service (MMCSS) on Windows, or the highest SDL priority otherwise
+ * (also the fallback on failure).
+ *
+ * It must be called once on startup, before any thread is created. The
+ * policies are not copied: they must outlive all the threads.
+ */
+void
+sc_thread_set_policies(const struct sc_thread_policy *policies, size_t count);
+
 bool
 sc_thread_create(sc_thread *thread, sc_thread_fn fn, const char *name,
                  void *userdata);
@@ -51,6 +82,15 @@ sc_thread_join(sc_thread *thread, int *status);
 bool
 sc_thread_set_priority(enum sc_thread_priority priority);
 
+/**
+ * Pin the current thread to a set of CPU cores (bit i for the core i)
+ *
+ * The threads it creates afterwards inherit the affinity. Only supported on
+ * Linux and Windows.
+ */
+bool
+sc_thread_set_affinity(uint64_t cpus);
+
 bool
 sc_mutex_init(sc_mutex *mutex);
 
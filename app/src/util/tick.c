@@ -53,3 +53,26 @@ sc_tick_now(void) {
     return secs + subsec;
 #endif
 }
+
+sc_tick
+sc_tick_now_realtime(void) {
+#ifndef _WIN32
+    struct timespec ts;
+    int ret = clock_gettime(CLOCK_REALTIME, &ts);
+    if (ret) {
+        abort();
+    }
+
+    return SC_TICK_FROM_SEC(ts.tv_sec) + SC_TICK_FROM_NS(ts.tv_nsec);
+#else
+    // GetSystemTimePreciseAsFileTime() requires Windows 8
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+
+    // Number of 100ns intervals since 1601-01-01
+    uint64_t t = ((uint64_t) ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    // Offset between 1601-01-01 and 1970-01-01, in 100ns intervals
+    t -= UINT64_C(116444736000000000);
+    return SC_TICK_FROM_NS((sc_tick) t * 100);
+#endif
+}
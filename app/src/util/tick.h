@@ -22,4 +22,9 @@ typedef int64_t sc_tick;
 sc_tick
 sc_tick_now(void);
 
+// Wall clock time since the Unix epoch, which may jump if the system time is
+// changed (unlike sc_tick_now())
+sc_tick
+sc_tick_now_realtime(void);
+
 #endif
@@ -36,16 +36,44 @@
  * Functions and macros having name ending with '_' are private.
  */
 #define SC_VECDEQUE(type) { \
+    SC_VECDEQUE_FIELDS_(type) \
+}
+
+/**
+ * VecDeque struct body with inline storage for N items
+ *
+ * The items are stored in the struct itself while they fit, so that a queue
+ * which does not exceed N items never touches the allocator:
+ *
+ *     struct queue_int SC_VECDEQUE_INLINE(int, 64);
+ *
+ * It must be initialized by sc_vecdeque_init_inline() (or
+ * sc_vecdeque_init_fixed()), then all the sc_vecdeque_* helpers apply.
+ *
+ * Since it references its own storage, it must not be copied or moved once
+ * initialized.
+ */
+#define SC_VECDEQUE_INLINE(type, N) { \
+    SC_VECDEQUE_FIELDS_(type) \
+    type inline_storage_[N]; \
+}
+
+/**
+ * Private.
+ */
+#define SC_VECDEQUE_FIELDS_(type) \
     size_t cap; \
     size_t origin; \
     size_t size; \
     type *data; \
-}
+    type *inline_data_; /* NULL if no inline storage */ \
+    size_t inline_cap_; \
+    bool fixed_; /* never reallocated */
 
 /**
  * Static initializer for a VecDeque
  */
-#define SC_VECDEQUE_INITIALIZER { 0, 0, 0, NULL }
+#define SC_VECDEQUE_INITIALIZER { 0, 0, 0, NULL, NULL, 0, false }
 
 /**
  * Initialize an empty VecDeque
@@ -56,23 +84,71 @@
     (pv)->origin = 0; \
     (pv)->size = 0; \
     (pv)->data = NULL; \
+    (pv)->inline_data_ = NULL; \
+    (pv)->inline_cap_ = 0; \
+    (pv)->fixed_ = false; \
+})
+
+#define sc_vecdeque_init_inline_(pv, fixed) \
+({ \
+    (pv)->inline_data_ = (pv)->inline_storage_; \
+    (pv)->inline_cap_ = ARRAY_LEN((pv)->inline_storage_); \
+    (pv)->cap = (pv)->inline_cap_; \
+    (pv)->origin = 0; \
+    (pv)->size = 0; \
+    (pv)->data = (pv)->inline_data_; \
+    (pv)->fixed_ = fixed; \
 })
 
+/**
+ * Initialize an empty VecDeque declared with SC_VECDEQUE_INLINE()
+ *
+ * Beyond its inline capacity, the items are moved to a heap allocation (which
+ * is kept until the VecDeque is cleared or destroyed).
+ */
+#define sc_vecdeque_init_inline(pv) \
+    sc_vecdeque_init_inline_(pv, false)
+
+/**
+ * Initialize an empty VecDeque declared with SC_VECDEQUE_INLINE(), whose
+ * capacity is fixed to its inline capacity
+ *
+ * Pushing to a full fixed VecDeque fails (like an allocation failure), so it
+ * is a bounded ring buffer which never allocates.
+ */
+#define sc_vecdeque_init_fixed(pv) \
+    sc_vecdeque_init_inline_(pv, true)
+
+/**
+ * Return whether the items are currently stored inline
+ *
+ * Private.
+ */
+#define sc_vecdeque_is_inline_(pv) \
+    ((pv)->inline_data_ && (pv)->data == (pv)->inline_data_)
+
 /**
  * Destroy a VecDeque
  */
 #define sc_vecdeque_destroy(pv) \
-    free((pv)->data)
+(void) ({ \
+    if (!sc_vecdeque_is_inline_(pv)) { \
+        free((pv)->data); \
+    } \
+})
 
 /**
  * Clear a VecDeque
  *
- * Remove all items.
+ * Remove all items (and release the heap allocation, if any).
  */
 #define sc_vecdeque_clear(pv) \
 (void) ({ \
     sc_vecdeque_destroy(pv); \
-    sc_vecdeque_init(pv); \
+    (pv)->cap = (pv)->inline_cap_; \
+    (pv)->origin = 0; \
+    (pv)->size = 0; \
+    (pv)->data = (pv)->inline_data_; \
 })
 
 /**
@@ -92,7 +168,7 @@
  *
  * A VecDeque is full when its size equals its current capacity. However, it
  * does not prevent to push a new item (with sc_vecdeque_push()), since this
- * will increase its capacity.
+ * will increase its capacity (unless it is fixed).
  */
 #define sc_vecdeque_is_full(pv) \
     ((pv)->size == (pv)->cap)
@@ -130,19 +206,22 @@
  * \param pcap a pointer to the `cap` field of the SC_VECDEQUE [IN/OUT]
  * \param porigin a pointer to pv->origin [IN/OUT]
  * \param size the `size` field of the SC_VECDEQUE
+ * \param owned false if `ptr` is the inline storage (which must not be
+ *              reallocated nor freed)
  * \return the new array to assign to the `data` field of the SC_VECDEQUE (if
  *         not NULL)
  */
 static inline void *
 sc_vecdeque_reallocdata_(void *ptr, size_t newcap, size_t item_size,
-                         size_t *pcap, size_t *porigin, size_t size) {
+                         size_t *pcap, size_t *porigin, size_t size,
+                         bool owned) {
 
     size_t oldcap = *pcap;
     size_t oldorigin = *porigin;
 
     assert(newcap > oldcap); // Could only grow
 
-    if (oldorigin + size <= oldcap) {
+    if (owned && oldorigin + size <= oldcap) {
         // The current content will stay in place, just realloc
         //
         // As an example, here is the content of a ring-buffer (oldcap=10)
@@ -182,22 +261,31 @@ sc_vecdeque_reallocdata_(void *ptr, size_t newcap, size_t item_size,
     //     ^
     //     origin
 
-    assert(size);
+    //
+    // The inline storage is always copied this way (even if the content does
+    // not wrap around), since it may not be reallocated.
+
+    assert(size || !owned);
     void *newptr = sc_allocarray(newcap, item_size);
     if (!newptr) {
         return NULL;
     }
 
-    size_t right_len = MIN(size, oldcap - oldorigin);
-    assert(right_len);
-    memcpy(newptr, (char *) ptr + (oldorigin * item_size), right_len * item_size);
+    if (size) {
+        size_t right_len = MIN(size, oldcap - oldorigin);
+        assert(right_len);
+        memcpy(newptr, (char *) ptr + (oldorigin * item_size),
+               right_len * item_size);
 
-    if (size > right_len) {
-        memcpy((char *) newptr + (right_len * item_size), ptr,
-               (size - right_len) * item_size);
+        if (size > right_len) {
+            memcpy((char *) newptr + (right_len * item_size), ptr,
+                   (size - right_len) * item_size);
+        }
     }
 
-    free(ptr);
+    if (owned) {
+        free(ptr);
+    }
 
     *pcap = newcap;
     *porigin = 0;
@@ -216,7 +304,8 @@ sc_vecdeque_reallocdata_(void *ptr, size_t newcap, size_t item_size,
 ({ \
     void *p = sc_vecdeque_reallocdata_((pv)->data, newcap, \
                                        sizeof(*(pv)->data), &(pv)->cap, \
-                                       &(pv)->origin, (pv)->size); \
+                                       &(pv)->origin, (pv)->size, \
+                                       !sc_vecdeque_is_inline_(pv)); \
     if (p) { \
         (pv)->data = p; \
     } \
@@ -236,7 +325,8 @@ sc_vecdeque_growsize_(size_t value)
  * \param pv a pointer to the VecDeque
  * \param mincap (`size_t`) the requested capacity
  * \retval true on success
- * \retval false on allocation failure (the VecDeque is left untouched)
+ * \retval false on allocation failure, or if the VecDeque is fixed and
+ *               `mincap` exceeds its capacity (the VecDeque is left untouched)
  */
 #define sc_vecdeque_reserve(pv, mincap) \
 ({ \
@@ -244,9 +334,11 @@ sc_vecdeque_growsize_(size_t value)
     bool ok; \
     /* avoid to allocate tiny arrays (< SC_VECDEQUE_MINCAP_) */ \
     size_t mincap_ = MAX(mincap, SC_VECDEQUE_MINCAP_); \
-    if (mincap_ <= (pv)->cap) { \
+    if ((size_t) (mincap) <= (pv)->cap) { \
         /* nothing to do */ \
         ok = true; \
+    } else if ((pv)->fixed_) { \
+        ok = false; \
     } else if (mincap_ <= sc_vecdeque_max_cap_(pv)) { \
         /* not too big */ \
         size_t newsize = sc_vecdeque_growsize_((pv)->cap); \
@@ -264,12 +356,13 @@ sc_vecdeque_growsize_(size_t value)
  * Private.
  *
  * \retval true on success
- * \retval false on allocation failure (the VecDeque is left untouched)
+ * \retval false on allocation failure or if the VecDeque is fixed (the
+ *               VecDeque is left untouched)
  */
 #define sc_vecdeque_grow_(pv) \
 ({ \
     bool ok; \
-    if ((pv)->cap < sc_vecdeque_max_cap_(pv)) { \
+    if (!(pv)->fixed_ && (pv)->cap < sc_vecdeque_max_cap_(pv)) { \
         size_t newsize = sc_vecdeque_growsize_((pv)->cap); \
         newsize = CLAMP(newsize, SC_VECDEQUE_MINCAP_, \
                         sc_vecdeque_max_cap_(pv)); \
@@ -340,7 +433,8 @@ sc_vecdeque_growsize_(size_t value)
  * If the VecDeque is full, it is resized.
  *
  * \retval true on success
- * \retval false on allocation failure (the VecDeque is left untouched)
+ * \retval false on allocation failure, or if the VecDeque is fixed and full
+ *               (the VecDeque is left untouched)
  */
 #define sc_vecdeque_push(pv, item) \
 ({ \
@@ -368,6 +462,39 @@ sc_vecdeque_growsize_(size_t value)
     &(pv)->data[pos]; \
 })
 
+/**
+ * Return a pointer to the oldest item, without popping it
+ *
+ * It is an error to call this function if the VecDeque is empty.
+ */
+#define sc_vecdeque_peekref(pv) \
+({ \
+    assert(!sc_vecdeque_is_empty(pv)); \
+    &(pv)->data[(pv)->origin]; \
+})
+
+/**
+ * Return a pointer to the newest item (the last pushed), without popping it
+ *
+ * It is an error to call this function if the VecDeque is empty.
+ */
+#define sc_vecdeque_peekref_back(pv) \
+({ \
+    assert(!sc_vecdeque_is_empty(pv)); \
+    &(pv)->data[((pv)->origin + (pv)->size - 1) % (pv)->cap]; \
+})
+
+/**
+ * Return a pointer to the i-th item from the oldest one, without popping it
+ *
+ * It is an error to call this function with `i` beyond the size.
+ */
+#define sc_vecdeque_getref(pv, i) \
+({ \
+    assert((size_t) (i) < (pv)->size); \
+    &(pv)->data[((pv)->origin + (i)) % (pv)->cap]; \
+})
+
 /**
  * Pop an item and return it
  *
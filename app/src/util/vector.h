@@ -3,6 +3,7 @@
 
 #include "common.h"
 
+#include <assert.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -33,15 +34,41 @@
  */
 #define SC_VECTOR(type) \
 { \
+    SC_VECTOR_FIELDS_(type) \
+}
+
+/**
+ * Vector struct body with inline storage for N items
+ *
+ * The items are stored in the struct itself while they fit, and moved to a
+ * heap allocation beyond:
+ *
+ *     struct vec_int SC_VECTOR_INLINE(int, 16);
+ *
+ * It must be initialized by sc_vector_init_inline(), then all the sc_vector_*
+ * helpers apply.
+ *
+ * Since it references its own storage, it must not be copied or moved once
+ * initialized.
+ */
+#define SC_VECTOR_INLINE(type, N) \
+{ \
+    SC_VECTOR_FIELDS_(type) \
+    type inline_storage_[N]; \
+}
+
+#define SC_VECTOR_FIELDS_(type) \
     size_t cap; \
     size_t size; \
     type *data; \
-}
+    type *inline_data_; /* NULL if no inline storage */ \
+    size_t inline_cap_; \
+    type *heap_; /* heap allocation (data, if not inline), or NULL */
 
 /**
  * Static initializer for a vector
  */
-#define SC_VECTOR_INITIALIZER { 0, 0, NULL }
+#define SC_VECTOR_INITIALIZER { 0, 0, NULL, NULL, 0, NULL }
 
 /**
  * Initialize an empty vector
@@ -51,25 +78,56 @@
     (pv)->cap = 0; \
     (pv)->size = 0; \
     (pv)->data = NULL; \
+    (pv)->inline_data_ = NULL; \
+    (pv)->inline_cap_ = 0; \
+    (pv)->heap_ = NULL; \
 })
 
+/**
+ * Initialize an empty vector declared with SC_VECTOR_INLINE()
+ */
+#define sc_vector_init_inline(pv) \
+({ \
+    (pv)->inline_data_ = (pv)->inline_storage_; \
+    (pv)->inline_cap_ = ARRAY_LEN((pv)->inline_storage_); \
+    (pv)->cap = (pv)->inline_cap_; \
+    (pv)->size = 0; \
+    (pv)->data = (pv)->inline_data_; \
+    (pv)->heap_ = NULL; \
+})
+
+/**
+ * Return whether the items are currently stored inline
+ *
+ * Private.
+ */
+#define sc_vector_is_inline_(pv) \
+    ((pv)->inline_data_ && !(pv)->heap_)
+
 /**
  * Destroy a vector
  *
  * The vector may not be used anymore unless sc_vector_init() is called.
  */
 #define sc_vector_destroy(pv) \
-    free((pv)->data)
+(void) ({ \
+    /* never free(data): the compiler could not prove that it is not the \
+     * inline storage (-Wfree-nonheap-object) */ \
+    free((pv)->heap_); \
+})
 
 /**
  * Clear a vector
  *
- * Remove all items from the vector.
+ * Remove all items from the vector (and release the heap allocation, if any).
  */
 #define sc_vector_clear(pv) \
 ({ \
     sc_vector_destroy(pv); \
-    sc_vector_init(pv);\
+    (pv)->cap = (pv)->inline_cap_; \
+    (pv)->size = 0; \
+    (pv)->data = (pv)->inline_data_; \
+    (pv)->heap_ = NULL; \
 })
 
 /**
@@ -107,7 +165,8 @@ sc_vector_clamp_(size_t x, size_t min, size_t max)
  *
  * Private.
  *
- * \param ptr the current `data` field of the vector to realloc
+ * \param heap the current `heap_` field of the vector to realloc
+ * \param ptr the current `data` field of the vector
  * \param count the requested capacity, in number of items
  * \param size the size of one item
  * \param pcap a pointer to the `cap` field of the vector [IN/OUT]
@@ -115,14 +174,19 @@ sc_vector_clamp_(size_t x, size_t min, size_t max)
  * \return the new ptr on success, NULL on error
  */
 static inline void *
-sc_vector_reallocdata_(void *ptr, size_t count, size_t size,
+sc_vector_reallocdata_(void *heap, const void *ptr, size_t count, size_t size,
                         size_t *restrict pcap, size_t *restrict psize)
 {
-    void *p = reallocarray(ptr, count, size);
+    void *p = reallocarray(heap, count, size);
     if (!p) {
         return NULL;
     }
 
+    if (!heap && *psize) {
+        /* the inline storage is never reallocated, its content is copied */
+        memcpy(p, ptr, sc_vector_min_(*psize, count) * size);
+    }
+
     *pcap = count;
     *psize = sc_vector_min_(*psize, count);
     return p;
@@ -130,10 +194,12 @@ sc_vector_reallocdata_(void *ptr, size_t count, size_t size,
 
 #define sc_vector_realloc_(pv, newcap) \
 ({ \
-    void *p = sc_vector_reallocdata_((pv)->data, newcap, sizeof(*(pv)->data), \
-                                     &(pv)->cap, &(pv)->size); \
+    void *p = sc_vector_reallocdata_((pv)->heap_, (pv)->data, newcap, \
+                                     sizeof(*(pv)->data), &(pv)->cap, \
+                                     &(pv)->size); \
     if (p) { \
         (pv)->data = p; \
+        (pv)->heap_ = p; \
     } \
     (bool) p; \
 });
@@ -143,8 +209,21 @@ sc_vector_reallocdata_(void *ptr, size_t count, size_t size,
     bool ok; \
     if ((pv)->cap == (newcap)) { \
         ok = true; \
-    } else if ((newcap) > 0) { \
+    } else if (sc_vector_is_inline_(pv) && (newcap) < (pv)->cap) { \
+        /* the inline storage is never shrunk */ \
+        ok = true; \
+    } else if ((newcap) > (pv)->inline_cap_) { \
         ok = sc_vector_realloc_(pv, (newcap)); \
+    } else if ((pv)->inline_data_) { \
+        /* move the items back to the inline storage */ \
+        assert((pv)->size <= (pv)->inline_cap_); \
+        memcpy((pv)->inline_data_, (pv)->data, \
+               (pv)->size * sizeof(*(pv)->data)); \
+        free((pv)->heap_); \
+        (pv)->heap_ = NULL; \
+        (pv)->data = (pv)->inline_data_; \
+        (pv)->cap = (pv)->inline_cap_; \
+        ok = true; \
     } else { \
         sc_vector_clear(pv); \
         ok = true; \
@@ -175,7 +254,7 @@ sc_vector_growsize_(size_t value)
     bool ok; \
     /* avoid to allocate tiny arrays (< SC_VECTOR_MINCAP_) */ \
     size_t mincap_ = sc_vector_max_(mincap, SC_VECTOR_MINCAP_); \
-    if (mincap_ <= (pv)->cap) { \
+    if ((size_t) (mincap) <= (pv)->cap) { \
         /* nothing to do */ \
         ok = true; \
     } else if (mincap_ <= sc_vector_max_cap_(pv)) { \
@@ -0,0 +1,91 @@
+#include "yuv_rgb.h"
+
+#include <assert.h>
+#include <stdbool.h>
+
+// Coefficients of the BT.601 limited range conversion, in Q14
+#define SC_YUV_RGB_SHIFT 14
+#define SC_YUV_RGB_Y 19077 // 255/219
+#define SC_YUV_RGB_RV 26149 // 1.596
+#define SC_YUV_RGB_GU 6419 // 0.392
+#define SC_YUV_RGB_GV 13320 // 0.813
+#define SC_YUV_RGB_BU 33050 // 2.017
+
+static inline uint8_t
+clamp_u8(int32_t value) {
+    value >>= SC_YUV_RGB_SHIFT;
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+static inline void
+convert_pixel(int32_t y, int32_t ruv, int32_t guv, int32_t buv, uint8_t *out,
+              bool bgra) {
+    int32_t luma = (y - 16) * SC_YUV_RGB_Y + (1 << (SC_YUV_RGB_SHIFT - 1));
+    uint8_t r = clamp_u8(luma + ruv);
+    uint8_t g = clamp_u8(luma - guv);
+    uint8_t b = clamp_u8(luma + buv);
+    if (bgra) {
+        out[0] = b;
+        out[1] = g;
+        out[2] = r;
+        out[3] = 255;
+    } else {
+        out[0] = r;
+        out[1] = g;
+        out[2] = b;
+    }
+}
+
+// Inlined with a constant `bgra`, so that each format has its own loop
+static inline void
+convert_row(const uint8_t *restrict y_row, const uint8_t *restrict u_row,
+            const uint8_t *restrict v_row, uint8_t *restrict out, int width,
+            bool bgra) {
+    int bpp = bgra ? 4 : 3;
+
+    // Each chroma sample covers 2 pixels of the row
+    int x = 0;
+    for (; x + 1 < width; x += 2) {
+        int32_t u = u_row[x / 2] - 128;
+        int32_t v = v_row[x / 2] - 128;
+        int32_t ruv = SC_YUV_RGB_RV * v;
+        int32_t guv = SC_YUV_RGB_GU * u + SC_YUV_RGB_GV * v;
+        int32_t buv = SC_YUV_RGB_BU * u;
+        convert_pixel(y_row[x], ruv, guv, buv, &out[bpp * x], bgra);
+        convert_pixel(y_row[x + 1], ruv, guv, buv, &out[bpp * x + bpp],
+                      bgra);
+    }
+
+    if (x < width) {
+        // Odd width
+        int32_t u = u_row[x / 2] - 128;
+        int32_t v = v_row[x / 2] - 128;
+        convert_pixel(y_row[x], SC_YUV_RGB_RV * v,
+                      SC_YUV_RGB_GU * u + SC_YUV_RGB_GV * v,
+                      SC_YUV_RGB_BU * u, &out[bpp * x], bgra);
+    }
+}
+
+void
+sc_yuv_to_rgb_row(const uint8_t *y_row, const uint8_t *u_row,
+                  const uint8_t *v_row, uint8_t *out, int width,
+                  enum sc_rgb_format format) {
+    if (format == SC_RGB_FORMAT_BGRA) {
+        convert_row(y_row, u_row, v_row, out, width, true);
+    } else {
+        assert(format == SC_RGB_FORMAT_RGB24);
+        convert_row(y_row, u_row, v_row, out, width, false);
+    }
+}
+
+void
+sc_yuv420p_to_rgb24(const uint8_t *const planes[3], const int linesizes[3],
+                    uint8_t *rgb, int rgb_linesize, int width, int height) {
+    for (int row = 0; row < height; ++row) {
+        const uint8_t *y_row = planes[0] + (size_t) row * linesizes[0];
+        const uint8_t *u_row = planes[1] + (size_t) (row / 2) * linesizes[1];
+        const uint8_t *v_row = planes[2] + (size_t) (row / 2) * linesizes[2];
+        uint8_t *out = rgb + (size_t) row * rgb_linesize;
+        convert_row(y_row, u_row, v_row, out, width, false);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef SC_YUV_RGB_H
+#define SC_YUV_RGB_H
+
+#include "common.h"
+
+#include <stdint.h>
+
+/**
+ * Conversion of YUV420P planes to RGB24, at the same size
+ *
+ * The colors are limited range BT.601 (the swscale default), and the chroma
+ * samples are replicated over their 2x2 pixels. The computation is in fixed
+ * point (Q14), without SIMD intrinsics, so it is portable but slower than the
+ * SIMD paths of swscale.
+ *
+ * The width and height may be odd (the chroma planes are rounded up).
+ */
+void
+sc_yuv420p_to_rgb24(const uint8_t *const planes[3], const int linesizes[3],
+                    uint8_t *rgb, int rgb_linesize, int width, int height);
+
+// The packed formats written by sc_yuv_to_rgb_row()
+enum sc_rgb_format {
+    SC_RGB_FORMAT_RGB24, // R, G, B
+    SC_RGB_FORMAT_BGRA, // B, G, R, 255
+};
+
+// Bytes per pixel of a packed format
+static inline int
+sc_rgb_format_get_bpp(enum sc_rgb_format format) {
+    return format == SC_RGB_FORMAT_BGRA ? 4 : 3;
+}
+
+/**
+ * Convert a single row, each chroma sample covering 2 pixels (same conversion
+ * as sc_yuv420p_to_rgb24())
+ */
+void
+sc_yuv_to_rgb_row(const uint8_t *y_row, const uint8_t *u_row,
+                  const uint8_t *v_row, uint8_t *out, int width,
+                  enum sc_rgb_format format);
+
+#endif
@@ -1,51 +1,89 @@
 #include "v4l2_sink.h"
 
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
 
 #include "util/log.h"
-#include "util/str.h"
 
 /** Downcast frame_sink to sc_v4l2_sink */
 #define DOWNCAST(SINK) container_of(SINK, struct sc_v4l2_sink, frame_sink)
 
-static const AVRational SCRCPY_TIME_BASE = {1, 1000000}; // timestamps in us
-
-static const AVOutputFormat *
-find_muxer(const char *name) {
-#ifdef SCRCPY_LAVF_HAS_NEW_MUXER_ITERATOR_API
-    void *opaque = NULL;
-#endif
-    const AVOutputFormat *oformat = NULL;
+static int
+xioctl(int fd, unsigned long request, void *arg) {
+    int r;
     do {
-#ifdef SCRCPY_LAVF_HAS_NEW_MUXER_ITERATOR_API
-        oformat = av_muxer_iterate(&opaque);
-#else
-        oformat = av_oformat_next(oformat);
-#endif
-        // until null or containing the requested name
-    } while (oformat && !sc_str_list_contains(oformat->name, ',', name));
-    return oformat;
+        r = ioctl(fd, request, arg);
+    } while (r == -1 && errno == EINTR);
+    return r;
 }
 
-static bool
-write_header(struct sc_v4l2_sink *vs, const AVPacket *packet) {
-    AVStream *ostream = vs->format_ctx->streams[0];
-
-    uint8_t *extradata = av_malloc(packet->size * sizeof(uint8_t));
-    if (!extradata) {
-        LOG_OOM();
-        return false;
+static void
+copy_plane(uint8_t *dst, size_t dst_stride, const uint8_t *src,
+           int src_stride, size_t width, int height) {
+    for (int y = 0; y < height; ++y) {
+        memcpy(dst, src, width);
+        dst += dst_stride;
+        src += src_stride;
     }
+}
 
-    // copy the first packet to the extra data
-    memcpy(extradata, packet->data, packet->size);
+// Copy the YUV420P planes of the region contiguously (the
+// V4L2_PIX_FMT_YUV420 layout)
+static void
+copy_frame(struct sc_v4l2_sink *vs, uint8_t *dst, const AVFrame *frame) {
+    size_t w = vs->width;
+    size_t h = vs->height;
+    size_t cw = (w + 1) / 2;
+    size_t ch = (h + 1) / 2;
+
+    // The offsets are even (checked on open)
+    size_t x = vs->x;
+    size_t y = vs->y;
+    size_t cx = x / 2;
+    size_t cy = y / 2;
+
+    const uint8_t *src_y = frame->data[0] + y * frame->linesize[0] + x;
+    const uint8_t *src_u = frame->data[1] + cy * frame->linesize[1] + cx;
+    const uint8_t *src_v = frame->data[2] + cy * frame->linesize[2] + cx;
+
+    copy_plane(dst, w, src_y, frame->linesize[0], w, h);
+    dst += w * h;
+    copy_plane(dst, cw, src_u, frame->linesize[1], cw, ch);
+    dst += cw * ch;
+    copy_plane(dst, cw, src_v, frame->linesize[2], cw, ch);
+}
 
-    ostream->codecpar->extradata = extradata;
-    ostream->codecpar->extradata_size = packet->size;
+static bool
+sc_v4l2_sink_set_format(struct sc_v4l2_sink *vs) {
+    struct v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    fmt.fmt.pix.width = vs->width;
+    fmt.fmt.pix.height = vs->height;
+    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUV420;
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    fmt.fmt.pix.bytesperline = vs->width;
+    fmt.fmt.pix.sizeimage = vs->frame_size;
+    fmt.fmt.pix.colorspace = V4L2_COLORSPACE_SRGB;
+
+    if (xioctl(vs->fd, VIDIOC_S_FMT, &fmt) == -1) {
+        LOGE("Could not set v4l2 format %dx%d on %s: %s", vs->width,
+             vs->height, vs->device_name, strerror(errno));
+        return false;
+    }
 
-    int ret = avformat_write_header(vs->format_ctx, NULL);
-    if (ret < 0) {
-        LOGE("Failed to write header to %s", vs->device_name);
+    if (fmt.fmt.pix.width != (unsigned) vs->width
+            || fmt.fmt.pix.height != (unsigned) vs->height
+            || fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_YUV420) {
+        LOGE("Format %dx%d YUV420 not supported by %s", vs->width, vs->height,
+             vs->device_name);
         return false;
     }
 
@@ -53,60 +91,181 @@ write_header(struct sc_v4l2_sink *vs, const AVPacket *packet) {
 }
 
 static void
-rescale_packet(struct sc_v4l2_sink *vs, AVPacket *packet) {
-    AVStream *ostream = vs->format_ctx->streams[0];
-    av_packet_rescale_ts(packet, SCRCPY_TIME_BASE, ostream->time_base);
+sc_v4l2_sink_unmap_buffers(struct sc_v4l2_sink *vs) {
+    for (unsigned i = 0; i < vs->buffer_count; ++i) {
+        munmap(vs->buffers[i].data, vs->buffers[i].length);
+    }
+    vs->buffer_count = 0;
+
+    // Release the buffers
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = 0;
+    req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    req.memory = V4L2_MEMORY_MMAP;
+    xioctl(vs->fd, VIDIOC_REQBUFS, &req);
 }
 
+// Return false if the driver does not support mmap'd buffers
 static bool
-write_packet(struct sc_v4l2_sink *vs, AVPacket *packet) {
-    if (!vs->header_written) {
-        bool ok = write_header(vs, packet);
-        if (!ok) {
-            return false;
+sc_v4l2_sink_map_buffers(struct sc_v4l2_sink *vs) {
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = SC_V4L2_SINK_BUFFERS;
+    req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    req.memory = V4L2_MEMORY_MMAP;
+
+    if (xioctl(vs->fd, VIDIOC_REQBUFS, &req) == -1 || !req.count) {
+        LOGD("v4l2: mmap'd buffers not supported: %s", strerror(errno));
+        return false;
+    }
+
+    vs->buffer_count = 0;
+    unsigned count = MIN(req.count, SC_V4L2_SINK_BUFFERS);
+    for (unsigned i = 0; i < count; ++i) {
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+
+        if (xioctl(vs->fd, VIDIOC_QUERYBUF, &buf) == -1) {
+            LOGE("Could not query v4l2 buffer: %s", strerror(errno));
+            goto error;
         }
-        vs->header_written = true;
-        return true;
+
+        if (buf.length < vs->frame_size) {
+            LOGE("v4l2 buffer too small: %u < %" SC_PRIsizet, buf.length,
+                 vs->frame_size);
+            goto error;
+        }
+
+        void *data = mmap(NULL, buf.length, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, vs->fd, buf.m.offset);
+        if (data == MAP_FAILED) {
+            LOGE("Could not mmap v4l2 buffer: %s", strerror(errno));
+            goto error;
+        }
+
+        vs->buffers[i].data = data;
+        vs->buffers[i].length = buf.length;
+        vs->buffers[i].queued = false;
+        ++vs->buffer_count;
     }
 
-    rescale_packet(vs, packet);
+    LOGD("v4l2: %u mmap'd buffers", vs->buffer_count);
+    return true;
 
-    bool ok = av_write_frame(vs->format_ctx, packet) >= 0;
+error:
+    sc_v4l2_sink_unmap_buffers(vs);
+    return false;
+}
 
-    // Failing to write the last frame is not very serious, no future frame may
-    // depend on it, so the resulting file will still be valid
-    (void) ok;
+// Return the index of a buffer owned by the application
+static bool
+sc_v4l2_sink_get_buffer(struct sc_v4l2_sink *vs, unsigned *index) {
+    for (unsigned i = 0; i < vs->buffer_count; ++i) {
+        if (!vs->buffers[i].queued) {
+            *index = i;
+            return true;
+        }
+    }
 
+    // All the buffers are queued, reclaim the oldest one
+    struct v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    buf.memory = V4L2_MEMORY_MMAP;
+
+    if (xioctl(vs->fd, VIDIOC_DQBUF, &buf) == -1) {
+        LOGE("Could not dequeue v4l2 buffer: %s", strerror(errno));
+        return false;
+    }
+
+    assert(buf.index < vs->buffer_count);
+    vs->buffers[buf.index].queued = false;
+    *index = buf.index;
     return true;
 }
 
 static bool
-encode_and_write_frame(struct sc_v4l2_sink *vs, const AVFrame *frame) {
-    int ret = avcodec_send_frame(vs->encoder_ctx, frame);
-    if (ret < 0 && ret != AVERROR(EAGAIN)) {
-        LOGE("Could not send v4l2 video frame: %d", ret);
+sc_v4l2_sink_queue_frame(struct sc_v4l2_sink *vs, const AVFrame *frame) {
+    unsigned index;
+    if (!sc_v4l2_sink_get_buffer(vs, &index)) {
         return false;
     }
 
-    AVPacket *packet = vs->packet;
-    ret = avcodec_receive_packet(vs->encoder_ctx, packet);
-    if (ret == 0) {
-        // A packet was received
+    copy_frame(vs, vs->buffers[index].data, frame);
+
+    struct v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = index;
+    buf.bytesused = vs->frame_size;
+    buf.field = V4L2_FIELD_NONE;
+    if (frame->pts != AV_NOPTS_VALUE) {
+        // PTS are in microseconds
+        buf.timestamp.tv_sec = frame->pts / 1000000;
+        buf.timestamp.tv_usec = frame->pts % 1000000;
+    }
+
+    if (xioctl(vs->fd, VIDIOC_QBUF, &buf) == -1) {
+        LOGE("Could not queue v4l2 buffer: %s", strerror(errno));
+        return false;
+    }
+    vs->buffers[index].queued = true;
 
-        bool ok = write_packet(vs, packet);
-        av_packet_unref(packet);
-        if (!ok) {
-            LOGW("Could not send packet to v4l2 sink");
+    if (!vs->stream_on) {
+        // Start streaming once a buffer is queued
+        int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        if (xioctl(vs->fd, VIDIOC_STREAMON, &type) == -1) {
+            LOGE("Could not start v4l2 streaming: %s", strerror(errno));
             return false;
         }
-    } else if (ret != AVERROR(EAGAIN)) {
-        LOGE("Could not receive v4l2 video packet: %d", ret);
+        vs->stream_on = true;
+    }
+
+    return true;
+}
+
+static bool
+sc_v4l2_sink_write_frame(struct sc_v4l2_sink *vs, const AVFrame *frame) {
+    copy_frame(vs, vs->write_buffer, frame);
+
+    ssize_t w = write(vs->fd, vs->write_buffer, vs->frame_size);
+    if (w < 0) {
+        if (errno == EINTR || errno == EAGAIN) {
+            // Drop the frame
+            return true;
+        }
+        LOGE("Could not write frame to v4l2 device: %s", strerror(errno));
         return false;
     }
 
     return true;
 }
 
+static bool
+sc_v4l2_sink_send_frame(struct sc_v4l2_sink *vs, const AVFrame *frame) {
+    if (frame->width != vs->frame_width || frame->height != vs->frame_height
+            || frame->format != AV_PIX_FMT_YUV420P) {
+        // The device format could not be changed while streaming
+        if (!vs->unsupported_frame) {
+            LOGW("v4l2: frame format changed (%dx%d, format %d), frames "
+                 "ignored", frame->width, frame->height, frame->format);
+            vs->unsupported_frame = true;
+        }
+        return true;
+    }
+
+    if (vs->streaming) {
+        return sc_v4l2_sink_queue_frame(vs, frame);
+    }
+
+    return sc_v4l2_sink_write_frame(vs, frame);
+}
+
 static int
 run_v4l2_sink(void *data) {
     struct sc_v4l2_sink *vs = data;
@@ -128,7 +287,7 @@ run_v4l2_sink(void *data) {
 
         sc_frame_buffer_consume(&vs->fb, vs->frame);
 
-        bool ok = encode_and_write_frame(vs, vs->frame);
+        bool ok = sc_v4l2_sink_send_frame(vs, vs->frame);
         av_frame_unref(vs->frame);
         if (!ok) {
             LOGE("Could not send frame to v4l2 sink");
@@ -142,138 +301,147 @@ run_v4l2_sink(void *data) {
 }
 
 static bool
-sc_v4l2_sink_open(struct sc_v4l2_sink *vs, const AVCodecContext *ctx) {
-    assert(ctx->pix_fmt == AV_PIX_FMT_YUV420P);
-    (void) ctx;
-
-    bool ok = sc_frame_buffer_init(&vs->fb);
-    if (!ok) {
+sc_v4l2_sink_open_device(struct sc_v4l2_sink *vs) {
+    vs->fd = open(vs->device_name, O_RDWR | O_CLOEXEC);
+    if (vs->fd == -1) {
+        LOGE("Failed to open output device: %s (%s)", vs->device_name,
+             strerror(errno));
         return false;
     }
 
-    ok = sc_mutex_init(&vs->mutex);
-    if (!ok) {
-        goto error_frame_buffer_destroy;
+    struct v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if (xioctl(vs->fd, VIDIOC_QUERYCAP, &cap) == -1) {
+        LOGE("%s is not a v4l2 device", vs->device_name);
+        goto error_close;
     }
 
-    ok = sc_cond_init(&vs->cond);
-    if (!ok) {
-        goto error_mutex_destroy;
+    uint32_t caps = cap.capabilities & V4L2_CAP_DEVICE_CAPS ? cap.device_caps
+                                                            : cap.capabilities;
+    if (!(caps & V4L2_CAP_VIDEO_OUTPUT)) {
+        LOGE("%s is not a v4l2 output device", vs->device_name);
+        goto error_close;
     }
 
-    const AVOutputFormat *format = find_muxer("v4l2");
-    if (!format) {
-        // Alternative name
-        format = find_muxer("video4linux2");
-    }
-    if (!format) {
-        LOGE("Could not find v4l2 muxer");
-        goto error_cond_destroy;
+    if (!sc_v4l2_sink_set_format(vs)) {
+        goto error_close;
     }
 
-    const AVCodec *encoder = avcodec_find_encoder(AV_CODEC_ID_RAWVIDEO);
-    if (!encoder) {
-        LOGE("Raw video encoder not found");
-        return false;
-    }
+    vs->streaming = (caps & V4L2_CAP_STREAMING)
+                 && sc_v4l2_sink_map_buffers(vs);
+    if (!vs->streaming) {
+        if (!(caps & V4L2_CAP_READWRITE)) {
+            LOGE("%s supports neither streaming nor write()",
+                 vs->device_name);
+            goto error_close;
+        }
 
-    vs->format_ctx = avformat_alloc_context();
-    if (!vs->format_ctx) {
-        LOG_OOM();
-        return false;
+        vs->write_buffer = malloc(vs->frame_size);
+        if (!vs->write_buffer) {
+            LOG_OOM();
+            goto error_close;
+        }
     }
 
-    // contrary to the deprecated API (av_oformat_next()), av_muxer_iterate()
-    // returns (on purpose) a pointer-to-const, but AVFormatContext.oformat
-    // still expects a pointer-to-non-const (it has not be updated accordingly)
-    // <https://github.com/FFmpeg/FFmpeg/commit/0694d8702421e7aff1340038559c438b61bb30dd>
-    vs->format_ctx->oformat = (AVOutputFormat *) format;
-#ifdef SCRCPY_LAVF_HAS_AVFORMATCONTEXT_URL
-    vs->format_ctx->url = strdup(vs->device_name);
-    if (!vs->format_ctx->url) {
-        LOG_OOM();
-        goto error_avformat_free_context;
-    }
-#else
-    strncpy(vs->format_ctx->filename, vs->device_name,
-            sizeof(vs->format_ctx->filename));
-#endif
+    vs->stream_on = false;
+    return true;
 
-    AVStream *ostream = avformat_new_stream(vs->format_ctx, encoder);
-    if (!ostream) {
-        LOG_OOM();
-        goto error_avformat_free_context;
+error_close:
+    close(vs->fd);
+    return false;
+}
+
+static void
+sc_v4l2_sink_close_device(struct sc_v4l2_sink *vs) {
+    if (vs->streaming) {
+        if (vs->stream_on) {
+            int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+            xioctl(vs->fd, VIDIOC_STREAMOFF, &type);
+        }
+        sc_v4l2_sink_unmap_buffers(vs);
+    } else {
+        free(vs->write_buffer);
     }
 
-    int r = avcodec_parameters_from_context(ostream->codecpar, ctx);
-    if (r < 0) {
-        goto error_avformat_free_context;
+    close(vs->fd);
+}
+
+static bool
+sc_v4l2_sink_open(struct sc_v4l2_sink *vs, const AVCodecContext *ctx) {
+    assert(ctx->pix_fmt == AV_PIX_FMT_YUV420P);
+
+    // The frames may contain additional rows on top (the timestamps bar)
+    vs->frame_width = ctx->width;
+    vs->frame_height = ctx->height + vs->skip_rows;
+
+    if (vs->region == SC_V4L2_SINK_REGION_FULL) {
+        vs->x = 0;
+        vs->width = ctx->width;
+    } else {
+        // Each half must start on a chroma sample
+        if (ctx->width % 4) {
+            LOGE("v4l2: cannot split a frame of width %d in two halves",
+                 ctx->width);
+            return false;
+        }
+        vs->width = ctx->width / 2;
+        vs->x = vs->region == SC_V4L2_SINK_REGION_LEFT ? 0 : vs->width;
     }
+    vs->y = vs->skip_rows;
+    vs->height = ctx->height;
 
-    // The codec is from the v4l2 encoder, not from the decoder
-    ostream->codecpar->codec_id = encoder->id;
+    vs->frame_size = (size_t) vs->width * vs->height
+                   + 2 * (size_t) ((vs->width + 1) / 2)
+                       * ((vs->height + 1) / 2);
+    vs->buffer_count = 0;
+    vs->write_buffer = NULL;
+    vs->unsupported_frame = false;
 
-    int ret = avio_open(&vs->format_ctx->pb, vs->device_name, AVIO_FLAG_WRITE);
-    if (ret < 0) {
-        LOGE("Failed to open output device: %s", vs->device_name);
-        // ostream will be cleaned up during context cleaning
-        goto error_avformat_free_context;
+    bool ok = sc_frame_buffer_init(&vs->fb);
+    if (!ok) {
+        return false;
     }
 
-    vs->encoder_ctx = avcodec_alloc_context3(encoder);
-    if (!vs->encoder_ctx) {
-        LOG_OOM();
-        goto error_avio_close;
+    ok = sc_mutex_init(&vs->mutex);
+    if (!ok) {
+        goto error_frame_buffer_destroy;
     }
 
-    vs->encoder_ctx->width = ctx->width;
-    vs->encoder_ctx->height = ctx->height;
-    vs->encoder_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
-    vs->encoder_ctx->time_base.num = 1;
-    vs->encoder_ctx->time_base.den = 1;
+    ok = sc_cond_init(&vs->cond);
+    if (!ok) {
+        goto error_mutex_destroy;
+    }
 
-    if (avcodec_open2(vs->encoder_ctx, encoder, NULL) < 0) {
-        LOGE("Could not open codec for v4l2");
-        goto error_avcodec_free_context;
+    ok = sc_v4l2_sink_open_device(vs);
+    if (!ok) {
+        goto error_cond_destroy;
     }
 
     vs->frame = av_frame_alloc();
     if (!vs->frame) {
         LOG_OOM();
-        goto error_avcodec_free_context;
-    }
-
-    vs->packet = av_packet_alloc();
-    if (!vs->packet) {
-        LOG_OOM();
-        goto error_av_frame_free;
+        goto error_close_device;
     }
 
     vs->has_frame = false;
-    vs->header_written = false;
     vs->stopped = false;
 
     LOGD("Starting v4l2 thread");
     ok = sc_thread_create(&vs->thread, run_v4l2_sink, "scrcpy-v4l2", vs);
     if (!ok) {
         LOGE("Could not start v4l2 thread");
-        goto error_av_packet_free;
+        goto error_av_frame_free;
     }
 
-    LOGI("v4l2 sink started to device: %s", vs->device_name);
+    LOGI("v4l2 sink started to device: %s (%s)", vs->device_name,
+         vs->streaming ? "mmap" : "write");
 
     return true;
 
-error_av_packet_free:
-    av_packet_free(&vs->packet);
 error_av_frame_free:
     av_frame_free(&vs->frame);
-error_avcodec_free_context:
-    avcodec_free_context(&vs->encoder_ctx);
-error_avio_close:
-    avio_close(vs->format_ctx->pb);
-error_avformat_free_context:
-    avformat_free_context(vs->format_ctx);
+error_close_device:
+    sc_v4l2_sink_close_device(vs);
 error_cond_destroy:
     sc_cond_destroy(&vs->cond);
 error_mutex_destroy:
@@ -293,14 +461,13 @@ sc_v4l2_sink_close(struct sc_v4l2_sink *vs) {
 
     sc_thread_join(&vs->thread, NULL);
 
-    av_packet_free(&vs->packet);
     av_frame_free(&vs->frame);
-    avcodec_free_context(&vs->encoder_ctx);
-    avio_close(vs->format_ctx->pb);
-    avformat_free_context(vs->format_ctx);
+    sc_v4l2_sink_close_device(vs);
     sc_cond_destroy(&vs->cond);
     sc_mutex_destroy(&vs->mutex);
     sc_frame_buffer_destroy(&vs->fb);
+
+    sc_frame_drops_log(&vs->drops);
 }
 
 static bool
@@ -311,7 +478,9 @@ sc_v4l2_sink_push(struct sc_v4l2_sink *vs, const AVFrame *frame) {
         return false;
     }
 
-    if (!previous_skipped) {
+    if (previous_skipped) {
+        sc_frame_drops_add(&vs->drops, SC_FRAME_DROP_OVERWRITTEN);
+    } else {
         sc_mutex_lock(&vs->mutex);
         vs->has_frame = true;
         sc_cond_signal(&vs->cond);
@@ -340,13 +509,21 @@ sc_v4l2_frame_sink_push(struct sc_frame_sink *sink, const AVFrame *frame) {
 }
 
 bool
-sc_v4l2_sink_init(struct sc_v4l2_sink *vs, const char *device_name) {
+sc_v4l2_sink_init(struct sc_v4l2_sink *vs, const char *device_name,
+                  enum sc_v4l2_sink_region region, unsigned skip_rows) {
+    // The chroma planes are subsampled vertically
+    assert(!(skip_rows % 2));
+
     vs->device_name = strdup(device_name);
     if (!vs->device_name) {
         LOGE("Could not strdup v4l2 device name");
         return false;
     }
 
+    vs->region = region;
+    vs->skip_rows = skip_rows;
+    sc_frame_drops_init(&vs->drops, "V4L2 sink");
+
     static const struct sc_frame_sink_ops ops = {
         .open = sc_v4l2_frame_sink_open,
         .close = sc_v4l2_frame_sink_close,
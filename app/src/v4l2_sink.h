@@ -3,36 +3,83 @@
 
 #include "common.h"
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <libavcodec/avcodec.h>
-#include <libavformat/avformat.h>
 
 #include "coords.h"
 #include "trait/frame_sink.h"
 #include "frame_buffer.h"
+#include "frame_drops.h"
+#include "util/thread.h"
 #include "util/tick.h"
 
+// Number of mmap'd output buffers requested to the driver
+#define SC_V4L2_SINK_BUFFERS 4
+
+enum sc_v4l2_sink_region {
+    SC_V4L2_SINK_REGION_FULL,
+    SC_V4L2_SINK_REGION_LEFT, // left half (left eye)
+    SC_V4L2_SINK_REGION_RIGHT, // right half (right eye)
+};
+
+struct sc_v4l2_sink_buffer {
+    void *data;
+    size_t length;
+    bool queued; // owned by the driver until dequeued
+};
+
+/**
+ * Native V4L2 output (typically to a v4l2loopback device).
+ *
+ * The frames are copied once, directly from the decoded (or processed) planes
+ * into the buffers mmap'd from the driver, which are queued to the device. If
+ * the driver does not support streaming I/O, the frames are written with
+ * write() instead.
+ *
+ * A sink may output only a region of the frames (one half of the side-by-side
+ * stereo frames): the region is copied directly from the frame planes, without
+ * intermediate frame.
+ */
 struct sc_v4l2_sink {
     struct sc_frame_sink frame_sink; // frame sink trait
 
     struct sc_frame_buffer fb;
-    AVFormatContext *format_ctx;
-    AVCodecContext *encoder_ctx;
+    struct sc_frame_drops drops; // frames replaced before being sent
 
     char *device_name;
+    enum sc_v4l2_sink_region region;
+    unsigned skip_rows; // rows to skip on top of the frames (timestamps bar)
+
+    // Only accessed from the v4l2 thread once started
+    int fd;
+    int frame_width; // expected input frame size
+    int frame_height;
+    int x; // region in the input frames
+    int y;
+    int width; // output size
+    int height;
+    size_t frame_size; // YUV420P
+    bool streaming; // mmap'd buffers, otherwise write()
+    bool stream_on;
+    struct sc_v4l2_sink_buffer buffers[SC_V4L2_SINK_BUFFERS];
+    unsigned buffer_count;
+    uint8_t *write_buffer; // if !streaming
+    bool unsupported_frame; // to log the warning only once
 
     sc_thread thread;
     sc_mutex mutex;
     sc_cond cond;
     bool has_frame;
     bool stopped;
-    bool header_written;
 
     AVFrame *frame;
-    AVPacket *packet;
 };
 
 bool
-sc_v4l2_sink_init(struct sc_v4l2_sink *vs, const char *device_name);
+sc_v4l2_sink_init(struct sc_v4l2_sink *vs, const char *device_name,
+                  enum sc_v4l2_sink_region region, unsigned skip_rows);
 
 void
 sc_v4l2_sink_destroy(struct sc_v4l2_sink *vs);
@@ -1,148 +1,2192 @@
-#ifdef _OPENMP
-#include <omp.h>
-#endif
 
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
 #include <opencv2/opencv.hpp>
+#include <opencv2/core/ocl.hpp>
+#ifdef HAVE_OPENCV_CUDAWARPING
+# include <opencv2/core/cuda.hpp>
+# include <opencv2/cudawarping.hpp>
+#endif
 #include "video_preprocess.h"
 #include "util/log.h"
 #include "options.h"
 
-static cv::Mat cached_leftMapX, cached_leftMapY, cached_rightMapX, cached_rightMapY;
-static bool maps_loaded = false;
+extern "C" {
+#include "cuda_ipc_output.h"
+#include "frame_pool.h"
+#include "remap_layout.h"
+#include "remap_shm.h"
+#include "util/file.h"
+#include "util/remap.h"
+#include "util/tick.h"
+}
+
+// The rectified frames may be exported to other processes without leaving the
+// GPU (--cuda-ipc-output)
+#if defined(HAVE_OPENCV_CUDAWARPING) && defined(HAVE_CUDA_IPC)
+# define SC_CUDA_IPC_OUTPUT
+#endif
+
+// Sidecar cache of the converted maps, stored next to the source XML file
+#define SC_REMAP_CACHE_SUFFIX ".scmap"
+#define SC_REMAP_CACHE_MAGIC "SCRMAP\0\0"
+#define SC_REMAP_CACHE_VERSION 2
+#define SC_REMAP_CACHE_ALIGN 64
+// A luma and a chroma map per view
+#define SC_REMAP_MAX_MAPS (2 * SC_REMAP_LAYOUT_MAX_VIEWS)
+
+struct sc_remap_cache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t map_count; // the luma maps of the views, then their chroma maps
+    uint64_t source_hash; // FNV-1a of the source XML file
+    uint32_t layout_cols;
+    uint32_t layout_rows;
+    struct {
+        int32_t cols;
+        int32_t rows;
+    } sizes[SC_REMAP_MAX_MAPS];
+};
+
+// Indices of the maps of the view v in struct sc_remap_maps
+#define SC_REMAP_LUMA(v) (v)
+#define SC_REMAP_CHROMA(v) (SC_REMAP_LAYOUT_MAX_VIEWS + (v))
 
+struct sc_remap_grid_deleter {
+    void operator()(struct sc_remap_grid *grid) const {
+        sc_remap_grid_destroy(grid);
+        delete grid;
+    }
+};
+
+typedef std::unique_ptr<struct sc_remap_grid, sc_remap_grid_deleter>
+    sc_remap_grid_ptr;
+
+// The maps remapping the frames to one output resolution
+struct sc_remap_maps {
+    // The views of the frames, each one remapped by its own maps (only the
+    // maps of these views are used)
+    struct sc_remap_layout layout = {0, 0};
+    // Fixed-point maps {map1, map2} (CV_16SC2 + CV_16UC1), as computed by
+    // cv::convertMaps(). The chroma maps are at half resolution, to remap the
+    // U and V planes of YUV420P frames.
+    cv::Mat host[SC_REMAP_MAX_MAPS][2];
+    // On the CPU backend, the sparse grids replacing the host maps which they
+    // reproduce accurately (host[i] is then empty, see util/remap.h)
+    sc_remap_grid_ptr grid[SC_REMAP_MAX_MAPS];
+    // On the CPU backend, the spans of the rows of the host maps kept dense
+    // (empty if not computed, see util/remap.h)
+    std::vector<struct sc_remap_span> spans[SC_REMAP_MAX_MAPS];
+    // Copies resident on the device, uploaded once after loading
+    cv::UMat ocl[SC_REMAP_MAX_MAPS][2];
+#ifdef HAVE_OPENCV_CUDAWARPING
+    // cv::cuda::remap() only accepts float maps (x, y)
+    cv::cuda::GpuMat cuda[SC_REMAP_MAX_MAPS][2];
+#endif
+};
 
-void apply_video_effects(AVFrame *frame, const char *map_path, const char *show_text) {
-    // Enable OpenMP for OpenCV operations
-    #ifdef _OPENMP
-    cv::setNumThreads(omp_get_max_threads());
-    #endif
+// The camera parameters of a fisheye calibration (--opencv-calib)
+struct sc_camera_calib {
+    struct sc_remap_layout layout;
+    cv::Size image_size; // of each view
+    cv::Mat k[SC_REMAP_LAYOUT_MAX_VIEWS]; // intrinsics (3x3)
+    cv::Mat d[SC_REMAP_LAYOUT_MAX_VIEWS]; // fisheye distortion coefficients (4)
+    // For a stereo pair, rectified together (otherwise each view is only
+    // undistorted)
+    bool stereo;
+    cv::Mat r; // rotation from the left to the right camera (3x3)
+    cv::Mat t; // translation from the left to the right camera (3)
+};
 
-    int text_height = 60;
-    int original_height = frame->height;
-    int display_height = show_text ? original_height + text_height : original_height;
+// The maps for frames of another size than the calibration
+struct sc_scaled_maps {
+    struct sc_remap_maps full_maps;
+    struct sc_remap_maps preview_maps; // if preview_scale > 1
+    // On the CPU backend, the grids may point to this shared memory (see
+    // remap_shm.h)
+    struct sc_shm shm;
+    bool shared = false;
+
+    ~sc_scaled_maps() {
+        if (shared) {
+            full_maps = sc_remap_maps();
+            preview_maps = sc_remap_maps();
+            sc_shm_close(&shm);
+        }
+    }
+};
+
+// The maps loaded from one calibration file, immutable once loaded (except
+// the cache of the scaled maps)
+struct sc_remap_state {
+    // The cached maps may point directly to this mapping, so it is unmapped
+    // only once they are released
+    struct sc_file_mapping cache_mapping;
+    bool cache_mapped = false;
+    struct sc_remap_maps full_maps; // stored in the cache
+    struct sc_remap_maps preview_maps; // if preview_scale > 1
+    uint64_t source_hash = 0; // of the calibration file
+    // On the CPU backend, the grids may point to this shared memory (see
+    // remap_shm.h)
+    struct sc_shm shm;
+    bool shared = false;
+
+    // If the maps are computed from the camera parameters, for any video size
+    bool has_calib = false;
+    struct sc_camera_calib calib;
+
+    // Derived from full_maps on first use, by frame size (NULL if the
+    // calibration cannot be scaled to this size). The entries are never
+    // removed, so they may be used without holding the mutex.
+    mutable std::mutex scaled_mutex;
+    mutable std::map<std::pair<int, int>,
+                     std::unique_ptr<const struct sc_scaled_maps>> scaled;
+
+    ~sc_remap_state() {
+        if (cache_mapped) {
+            // The full maps point to the mapped cache, release them first
+            full_maps = sc_remap_maps();
+            sc_file_unmap(&cache_mapping);
+        }
+        if (shared) {
+            full_maps = sc_remap_maps();
+            preview_maps = sc_remap_maps();
+            sc_shm_close(&shm);
+        }
+    }
+};
+
+struct sc_video_preprocess {
+    enum sc_opencv_backend backend;
+    unsigned preview_scale;
+
+    // Replaced on reload: each frame is processed with the state taken at its
+    // start, which is released once the last frame using it is processed
+    mutable std::mutex mutex;
+    std::shared_ptr<const struct sc_remap_state> state;
+    std::atomic<unsigned> generation; // incremented on each reload
+
+    // The full resolution frames remapped by the cuda backend are also
+    // exported in this ring, if not NULL
+    struct sc_cuda_ipc_output *cuda_ipc_output;
+};
+
+static std::shared_ptr<const struct sc_remap_state>
+get_state(const struct sc_video_preprocess *vpp) {
+    std::lock_guard<std::mutex> lock(vpp->mutex);
+    return vpp->state;
+}
+
+static uint64_t
+hash_data(const void *data, size_t size) {
+    // 64-bit FNV-1a
+    const uint8_t *p = (const uint8_t *) data;
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= p[i];
+        hash *= UINT64_C(0x100000001b3);
+    }
+    return hash;
+}
 
-    // Load mapping matrices only once
-    if (!maps_loaded) {
-        // Load mapping file
-        if (!map_path) {
-            if (show_text == NULL) {
-                LOGE("No mapping file path provided. Use --opencv-map to specify the path.");
-                return;                
+static size_t
+align_offset(size_t offset) {
+    return (offset + SC_REMAP_CACHE_ALIGN - 1)
+         & ~(size_t) (SC_REMAP_CACHE_ALIGN - 1);
+}
+
+// Size of the map1 (CV_16SC2) and map2 (CV_16UC1) data for one map
+static size_t
+map1_size(int cols, int rows) {
+    return (size_t) cols * rows * 2 * sizeof(int16_t);
+}
+
+static size_t
+map2_size(int cols, int rows) {
+    return (size_t) cols * rows * sizeof(uint16_t);
+}
+
+// Number of maps used by the layout
+static unsigned
+get_map_count(const struct sc_remap_layout &layout) {
+    return 2 * sc_remap_layout_get_views(&layout);
+}
+
+// Index in struct sc_remap_maps of the i-th map used by the layout: the luma
+// maps of the views, then their chroma maps (the order of the cache)
+static unsigned
+get_map_index(const struct sc_remap_layout &layout, unsigned i) {
+    unsigned views = sc_remap_layout_get_views(&layout);
+    return i < views ? SC_REMAP_LUMA(i) : SC_REMAP_CHROMA(i - views);
+}
+
+static bool
+is_chroma_map(unsigned index) {
+    return index >= SC_REMAP_CHROMA(0);
+}
+
+static bool
+load_maps_from_cache(struct sc_remap_state *state, const char *cache_path,
+                     uint64_t source_hash) {
+    if (!sc_file_map(cache_path, &state->cache_mapping)) {
+        return false;
+    }
+
+    const uint8_t *data = (const uint8_t *) state->cache_mapping.data;
+    size_t size = state->cache_mapping.size;
+
+    struct sc_remap_cache_header header;
+    if (size < sizeof(header)) {
+        goto invalid;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, SC_REMAP_CACHE_MAGIC, sizeof(header.magic))
+            || header.version != SC_REMAP_CACHE_VERSION
+            || header.source_hash != source_hash
+            || !header.layout_cols || !header.layout_rows
+            || header.layout_cols * header.layout_rows
+                   > SC_REMAP_LAYOUT_MAX_VIEWS) {
+        goto invalid;
+    }
+    state->full_maps.layout.cols = header.layout_cols;
+    state->full_maps.layout.rows = header.layout_rows;
+    if (header.map_count != get_map_count(state->full_maps.layout)) {
+        goto invalid;
+    }
+
+    {
+        size_t offset = align_offset(sizeof(header));
+        for (unsigned i = 0; i < header.map_count; ++i) {
+            int cols = header.sizes[i].cols;
+            int rows = header.sizes[i].rows;
+            if (cols <= 0 || rows <= 0) {
+                goto invalid;
+            }
+
+            size_t size1 = map1_size(cols, rows);
+            size_t size2 = map2_size(cols, rows);
+            size_t offset2 = align_offset(offset + size1);
+            if (offset2 + size2 > size) {
+                goto invalid;
             }
-            LOGE("Text is enabled, Continue without mapping.");
-        }else{
-            cv::FileStorage fs(map_path, cv::FileStorage::READ);
-            if (!fs.isOpened()) {
-                LOGE("Could not open mapping file: %s", map_path);
-                return;
+
+            // No copy: the matrices point to the mapped file (OpenCV only
+            // reads the maps)
+            void *ptr1 = const_cast<uint8_t *>(data + offset);
+            void *ptr2 = const_cast<uint8_t *>(data + offset2);
+            cv::Mat (&host)[2] =
+                state->full_maps.host[get_map_index(state->full_maps.layout,
+                                                    i)];
+            host[0] = cv::Mat(rows, cols, CV_16SC2, ptr1);
+            host[1] = cv::Mat(rows, cols, CV_16UC1, ptr2);
+
+            offset = align_offset(offset2 + size2);
+        }
+    }
+
+    state->cache_mapped = true;
+    return true;
+
+invalid:
+    LOGW("Ignoring invalid or outdated remap cache: %s", cache_path);
+    state->full_maps = sc_remap_maps();
+    sc_file_unmap(&state->cache_mapping);
+    return false;
+}
+
+static bool
+write_padding(FILE *file, size_t *offset) {
+    static const uint8_t zeros[SC_REMAP_CACHE_ALIGN] = {0};
+    size_t aligned = align_offset(*offset);
+    size_t len = aligned - *offset;
+    if (len && fwrite(zeros, 1, len, file) != len) {
+        return false;
+    }
+    *offset = aligned;
+    return true;
+}
+
+static bool
+write_maps_to_file(FILE *file, const struct sc_remap_maps &maps,
+                   uint64_t source_hash) {
+    struct sc_remap_cache_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SC_REMAP_CACHE_MAGIC, sizeof(header.magic));
+    header.version = SC_REMAP_CACHE_VERSION;
+    header.map_count = get_map_count(maps.layout);
+    header.source_hash = source_hash;
+    header.layout_cols = maps.layout.cols;
+    header.layout_rows = maps.layout.rows;
+    for (unsigned i = 0; i < header.map_count; ++i) {
+        const cv::Mat &map1 = maps.host[get_map_index(maps.layout, i)][0];
+        header.sizes[i].cols = map1.cols;
+        header.sizes[i].rows = map1.rows;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        return false;
+    }
+    size_t offset = sizeof(header);
+
+    for (unsigned i = 0; i < header.map_count; ++i) {
+        for (unsigned j = 0; j < 2; ++j) {
+            const cv::Mat &map = maps.host[get_map_index(maps.layout, i)][j];
+            // Freshly converted maps are always continuous
+            assert(map.isContinuous());
+            size_t len = map.total() * map.elemSize();
+            if (!write_padding(file, &offset)
+                    || fwrite(map.data, 1, len, file) != len) {
+                return false;
             }
+            offset += len;
+        }
+    }
+
+    return true;
+}
+
+static void
+write_maps_to_cache(const struct sc_remap_maps &maps, const char *cache_path,
+                    uint64_t source_hash) {
+    // Write to a temporary file first, so that an interrupted write never
+    // leaves a truncated cache
+    std::string tmp_path = std::string(cache_path) + ".tmp";
+    FILE *file = fopen(tmp_path.c_str(), "wb");
+    if (!file) {
+        LOGW("Could not create remap cache: %s", tmp_path.c_str());
+        return;
+    }
+
+    bool ok = write_maps_to_file(file, maps, source_hash);
+    ok &= !fclose(file);
+    if (!ok) {
+        LOGW("Could not write remap cache: %s", tmp_path.c_str());
+        remove(tmp_path.c_str());
+        return;
+    }
+
+#ifdef _WIN32
+    // rename() does not replace an existing file on Windows
+    remove(cache_path);
+#endif
+    if (rename(tmp_path.c_str(), cache_path)) {
+        LOGW("Could not rename remap cache: %s", cache_path);
+        remove(tmp_path.c_str());
+        return;
+    }
+
+    LOGI("Remap cache written: %s", cache_path);
+}
+
+static void
+convert_map(const cv::Mat &map_x, const cv::Mat &map_y, cv::Mat &map1,
+            cv::Mat &map2) {
+    cv::convertMaps(map_x, map_y, map1, map2, CV_16SC2, false);
+}
+
+// Luma value used for the black text bar and for pixels mapped from outside
+// the source image
+#define SC_REMAP_BORDER_LUMA 0
+// Chroma value of a gray pixel
+#define SC_REMAP_BORDER_CHROMA 128
+
+static void
+compute_chroma_map(const cv::Mat &luma_map, cv::Mat &chroma_map) {
+    // Each chroma sample covers a 2x2 block of luma samples: average the luma
+    // coordinates over the block, then convert them to the chroma sampling
+    // grid (the chroma sample i is centered on the luma coordinate 2*i+0.5)
+    cv::Mat half;
+    cv::resize(luma_map, half, cv::Size(luma_map.cols / 2, luma_map.rows / 2),
+               0, 0, cv::INTER_AREA);
+    half.convertTo(chroma_map, CV_32F, 0.5, -0.25);
+}
+
+// Convert the luma maps (as floats) of the views of `layout` to the
+// fixed-point luma and chroma maps
+static void
+convert_view_maps(const struct sc_remap_layout &layout, const cv::Mat *map_x,
+                  const cv::Mat *map_y, struct sc_remap_maps &maps) {
+    maps.layout = layout;
+    unsigned views = sc_remap_layout_get_views(&layout);
+    for (unsigned v = 0; v < views; ++v) {
+        cv::Mat chroma_x, chroma_y;
+        compute_chroma_map(map_x[v], chroma_x);
+        compute_chroma_map(map_y[v], chroma_y);
+
+        cv::Mat (&host)[SC_REMAP_MAX_MAPS][2] = maps.host;
+        convert_map(map_x[v], map_y[v], host[SC_REMAP_LUMA(v)][0],
+                    host[SC_REMAP_LUMA(v)][1]);
+        convert_map(chroma_x, chroma_y, host[SC_REMAP_CHROMA(v)][0],
+                    host[SC_REMAP_CHROMA(v)][1]);
+    }
+}
+
+// Read the layout of the views from the optional "layout" node of the XML
+// file, or use `fallback`
+static bool
+read_layout(const cv::FileStorage &fs, const struct sc_remap_layout &fallback,
+            struct sc_remap_layout &layout, const char *path) {
+    cv::FileNode node = fs["layout"];
+    if (node.empty()) {
+        layout = fallback;
+        return true;
+    }
+
+    std::string value = node.isString() ? (std::string) node : "";
+    if (!sc_remap_layout_parse(value.c_str(), value.size(), &layout)) {
+        LOGE("Invalid layout \"%s\" (expected mono, side-by-side, "
+             "top-bottom or <cols>x<rows>, up to %d views) in: %s",
+             value.c_str(), SC_REMAP_LAYOUT_MAX_VIEWS, path);
+        return false;
+    }
+    return true;
+}
+
+static bool
+read_calib_matrix(const cv::FileStorage &fs, const char *name, int rows,
+                  int cols, cv::Mat &mat, const char *path) {
+    fs[name] >> mat;
+    if (mat.empty() || mat.total() != (size_t) rows * cols
+            || mat.channels() != 1) {
+        LOGE("Missing or invalid %s (%dx%d) in: %s", name, rows, cols, path);
+        return false;
+    }
+    mat.reshape(1, rows).convertTo(mat, CV_64F);
+    return true;
+}
+
+// Read the camera parameters: K<n> and D<n> of each view n (from 1), and for
+// a stereo pair (2 views) R and T
+//
+// Without "layout" node, a single camera is assumed if there is no K2.
+static bool
+read_calib(const cv::FileStorage &fs, struct sc_camera_calib &calib,
+           const char *path) {
+    int width = (int) fs["image_width"];
+    int height = (int) fs["image_height"];
+    if (width <= 0 || height <= 0) {
+        LOGE("Missing or invalid image_width or image_height in: %s", path);
+        return false;
+    }
+    calib.image_size = cv::Size(width, height);
+
+    struct sc_remap_layout fallback = {1, 1};
+    if (!fs["K2"].empty()) {
+        fallback.cols = 2;
+    }
+    if (!read_layout(fs, fallback, calib.layout, path)) {
+        return false;
+    }
+
+    unsigned views = sc_remap_layout_get_views(&calib.layout);
+    for (unsigned v = 0; v < views; ++v) {
+        char k_name[8];
+        char d_name[8];
+        snprintf(k_name, sizeof(k_name), "K%u", v + 1);
+        snprintf(d_name, sizeof(d_name), "D%u", v + 1);
+        if (!read_calib_matrix(fs, k_name, 3, 3, calib.k[v], path)
+                || !read_calib_matrix(fs, d_name, 4, 1, calib.d[v], path)) {
+            return false;
+        }
+    }
+
+    calib.stereo = views == 2;
+    return !calib.stereo
+        || (read_calib_matrix(fs, "R", 3, 3, calib.r, path)
+            && read_calib_matrix(fs, "T", 3, 1, calib.t, path));
+}
+
+// Compute the maps of the views, for frames of `view_size` per view, from the
+// camera parameters: a stereo pair is rectified, a single camera (or each
+// camera of more views) is only undistorted
+static void
+compute_maps_from_calib(const struct sc_camera_calib &calib,
+                        struct sc_remap_maps &maps, cv::Size view_size) {
+    // The intrinsics are scaled to the video size (the pixel centers are at
+    // +0.5), so that the maps are computed exactly for this size
+    double sx = (double) view_size.width / calib.image_size.width;
+    double sy = (double) view_size.height / calib.image_size.height;
+    unsigned views = sc_remap_layout_get_views(&calib.layout);
+    cv::Mat k[SC_REMAP_LAYOUT_MAX_VIEWS];
+    for (unsigned i = 0; i < views; ++i) {
+        k[i] = calib.k[i].clone();
+        k[i].at<double>(0, 0) *= sx;
+        k[i].at<double>(0, 2) = (k[i].at<double>(0, 2) + 0.5) * sx - 0.5;
+        k[i].at<double>(1, 1) *= sy;
+        k[i].at<double>(1, 2) = (k[i].at<double>(1, 2) + 0.5) * sy - 0.5;
+    }
+
+    cv::Mat r[SC_REMAP_LAYOUT_MAX_VIEWS];
+    cv::Mat p[SC_REMAP_LAYOUT_MAX_VIEWS];
+    if (calib.stereo) {
+        cv::Mat q;
+        cv::fisheye::stereoRectify(k[0], calib.d[0], k[1], calib.d[1],
+                                   view_size, calib.r, calib.t, r[0], r[1],
+                                   p[0], p[1], q, cv::CALIB_ZERO_DISPARITY);
+    } else {
+        for (unsigned i = 0; i < views; ++i) {
+            r[i] = cv::Mat::eye(3, 3, CV_64F);
+            // Keep only the valid pixels (balance 0)
+            cv::fisheye::estimateNewCameraMatrixForUndistortRectify(
+                    k[i], calib.d[i], view_size, r[i], p[i]);
+        }
+    }
+
+    // The views are computed in parallel, on the OpenCV worker threads
+    cv::Mat map_x[SC_REMAP_LAYOUT_MAX_VIEWS];
+    cv::Mat map_y[SC_REMAP_LAYOUT_MAX_VIEWS];
+    cv::parallel_for_(cv::Range(0, views), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; ++i) {
+            cv::fisheye::initUndistortRectifyMap(k[i], calib.d[i], r[i], p[i],
+                                                 view_size, CV_32FC1,
+                                                 map_x[i], map_y[i]);
+        }
+    }, views);
+
+    convert_view_maps(calib.layout, map_x, map_y, maps);
+}
+
+// Without "layout" node, the layout is recognized by the names of the maps
+static struct sc_remap_layout
+detect_map_layout(const cv::FileStorage &fs) {
+    static const struct sc_remap_layout layouts[] = {{1, 1}, {1, 2}};
+    for (const struct sc_remap_layout &layout : layouts) {
+        char name[32];
+        sc_remap_layout_get_map_name(&layout, 0, 'X', name, sizeof(name));
+        if (!fs[name].empty()) {
+            return layout;
+        }
+    }
+    // Both eyes side by side (leftMapX...)
+    return {2, 1};
+}
+
+static bool
+load_maps_from_xml(struct sc_remap_maps &full_maps, cv::FileStorage &fs,
+                   const char *map_path) {
+    struct sc_remap_layout layout;
+    if (!read_layout(fs, detect_map_layout(fs), layout, map_path)) {
+        return false;
+    }
+
+    unsigned views = sc_remap_layout_get_views(&layout);
+    cv::Mat map_x[SC_REMAP_LAYOUT_MAX_VIEWS];
+    cv::Mat map_y[SC_REMAP_LAYOUT_MAX_VIEWS];
+    for (unsigned v = 0; v < views; ++v) {
+        char name_x[32];
+        char name_y[32];
+        sc_remap_layout_get_map_name(&layout, v, 'X', name_x, sizeof(name_x));
+        sc_remap_layout_get_map_name(&layout, v, 'Y', name_y, sizeof(name_y));
+        fs[name_x] >> map_x[v];
+        fs[name_y] >> map_y[v];
+
+        if (map_x[v].empty() || map_y[v].empty()) {
+            LOGE("Missing %s or %s in: %s", name_x, name_y, map_path);
+            return false;
+        }
+        if (map_x[v].size() != map_y[v].size()) {
+            LOGE("The X and Y maps must have the same size: %s", map_path);
+            return false;
+        }
 
-            fs["leftMapX"] >> cached_leftMapX;
-            fs["leftMapY"] >> cached_leftMapY;
-            fs["rightMapX"] >> cached_rightMapX;
-            fs["rightMapY"] >> cached_rightMapY;
-
-            // Convert maps to float32 if needed
-            if (cached_leftMapX.type() != CV_32F) cached_leftMapX.convertTo(cached_leftMapX, CV_32F);
-            if (cached_leftMapY.type() != CV_32F) cached_leftMapY.convertTo(cached_leftMapY, CV_32F);
-            if (cached_rightMapX.type() != CV_32F) cached_rightMapX.convertTo(cached_rightMapX, CV_32F);
-            if (cached_rightMapY.type() != CV_32F) cached_rightMapY.convertTo(cached_rightMapY, CV_32F);
-
-            fs.release();
-        }
-        maps_loaded = true; // either map loaded or continue without mapping
-    }
-
-
-    // Create separate planes for YUV data
-    cv::Mat y(frame->height, frame->width, CV_8UC1, frame->data[0], frame->linesize[0]);
-    cv::Mat u(frame->height/2, frame->width/2, CV_8UC1, frame->data[1], frame->linesize[1]);
-    cv::Mat v(frame->height/2, frame->width/2, CV_8UC1, frame->data[2], frame->linesize[2]);
-    
-    // Create continuous copies and resize U,V to match Y
-    cv::Mat y_cont = y.clone();
-    cv::Mat u_cont_resized, v_cont_resized;
-    cv::resize(u.clone(), u_cont_resized, y.size());
-    cv::resize(v.clone(), v_cont_resized, y.size());
-    
-    // Merge planes into a single matrix
-    std::vector<cv::Mat> yuv_planes = {y_cont, u_cont_resized, v_cont_resized};
-    cv::Mat yuv;
-    cv::merge(yuv_planes, yuv);
-    
-    // Convert to BGR
-    cv::Mat bgr;
-    cv::cvtColor(yuv, bgr, cv::COLOR_YUV2BGR);
-
-    // Split into left and right halves
-    cv::Mat left_half = bgr(cv::Rect(0, 0, bgr.cols / 2, bgr.rows));
-    cv::Mat right_half = bgr(cv::Rect(bgr.cols / 2, 0, bgr.cols - bgr.cols / 2, bgr.rows));
-
-    // Apply mapping to each half
-    cv::Mat left_mapped, right_mapped;
-    if (map_path) {
-        cv::remap(left_half, left_mapped, cached_leftMapX, cached_leftMapY, cv::INTER_LINEAR);
-        cv::remap(right_half, right_mapped, cached_rightMapX, cached_rightMapY, cv::INTER_LINEAR);
+        // Convert maps to float32 if needed
+        if (map_x[v].type() != CV_32F) map_x[v].convertTo(map_x[v], CV_32F);
+        if (map_y[v].type() != CV_32F) map_y[v].convertTo(map_y[v], CV_32F);
+    }
+
+    fs.release();
+
+    // The fixed-point representation is processed much faster by remap()
+    convert_view_maps(layout, map_x, map_y, full_maps);
+
+    return true;
+}
+
+static void
+upload_maps(struct sc_remap_maps &maps, enum sc_opencv_backend backend) {
+    unsigned count = get_map_count(maps.layout);
+    for (unsigned j = 0; j < count; ++j) {
+        unsigned i = get_map_index(maps.layout, j);
+        const cv::Mat &map1 = maps.host[i][0];
+        const cv::Mat &map2 = maps.host[i][1];
+        if (backend == SC_OPENCV_BACKEND_OPENCL) {
+            map1.copyTo(maps.ocl[i][0]);
+            map2.copyTo(maps.ocl[i][1]);
+        }
+#ifdef HAVE_OPENCV_CUDAWARPING
+        else if (backend == SC_OPENCV_BACKEND_CUDA) {
+            cv::Mat map_x, map_y;
+            cv::convertMaps(map1, map2, map_x, map_y, CV_32FC1);
+            maps.cuda[i][0].upload(map_x);
+            maps.cuda[i][1].upload(map_y);
+        }
+#endif
+    }
+}
+
+// Size of the map i (whether it is stored dense or as a grid)
+static cv::Size
+get_map_size(const struct sc_remap_maps &maps, unsigned i) {
+    const struct sc_remap_grid *grid = maps.grid[i].get();
+    if (grid) {
+        return cv::Size(grid->width, grid->height);
+    }
+    return maps.host[i][0].size();
+}
+
+// Use the grids published by another process (see remap_shm.h), if any,
+// instead of the host maps of the views of `layout`
+static bool
+attach_maps(struct sc_shm &shm, const struct sc_remap_shm_key &key,
+            const struct sc_remap_layout &layout,
+            struct sc_remap_maps &full_maps,
+            struct sc_remap_maps &preview_maps, unsigned scale) {
+    unsigned map_count = get_map_count(layout);
+    unsigned count = scale > 1 ? 2 * map_count : map_count;
+    // Value-initialized, so that they may be destroyed if the attach fails
+    sc_remap_grid_ptr grids[SC_REMAP_SHM_MAX_GRIDS];
+    struct sc_remap_grid *ptrs[SC_REMAP_SHM_MAX_GRIDS];
+    for (unsigned i = 0; i < count; ++i) {
+        grids[i].reset(new (std::nothrow) sc_remap_grid());
+        if (!grids[i]) {
+            LOG_OOM();
+            return false;
+        }
+        ptrs[i] = grids[i].get();
+    }
+
+    if (!sc_remap_shm_attach(&shm, &key, ptrs, count)) {
+        return false;
+    }
+
+    full_maps.layout = layout;
+    preview_maps.layout = layout;
+    for (unsigned j = 0; j < map_count; ++j) {
+        unsigned i = get_map_index(layout, j);
+        full_maps.host[i][0].release();
+        full_maps.host[i][1].release();
+        // The full maps remap frames of their own size
+        struct sc_remap_grid *full = grids[j].get();
+        sc_remap_grid_init_spans(full, full->width, full->height);
+        if (scale > 1) {
+            sc_remap_grid_init_spans(grids[map_count + j].get(), full->width,
+                                     full->height);
+            preview_maps.grid[i] = std::move(grids[map_count + j]);
+        }
+        full_maps.grid[i] = std::move(grids[j]);
+    }
+    return true;
+}
+
+// Publish the grids for the next processes, if all the maps are grids (the
+// dense calibration maps are already shared through the mapped cache)
+static bool
+publish_maps(struct sc_shm &shm, const struct sc_remap_shm_key &key,
+             struct sc_remap_maps &full_maps,
+             struct sc_remap_maps &preview_maps, unsigned scale) {
+    unsigned map_count = get_map_count(full_maps.layout);
+    unsigned count = 0;
+    struct sc_remap_grid *ptrs[SC_REMAP_SHM_MAX_GRIDS];
+    for (unsigned j = 0; j < map_count; ++j) {
+        unsigned index = get_map_index(full_maps.layout, j);
+        ptrs[count++] = full_maps.grid[index].get();
+    }
+    if (scale > 1) {
+        for (unsigned j = 0; j < map_count; ++j) {
+            unsigned i = get_map_index(preview_maps.layout, j);
+            ptrs[count++] = preview_maps.grid[i].get();
+        }
+    }
+    for (unsigned i = 0; i < count; ++i) {
+        if (!ptrs[i]) {
+            return false;
+        }
+    }
+
+    return sc_remap_shm_publish(&shm, &key, ptrs, count);
+}
+
+// On the CPU backend, use the grids of the calibration maps (of the views of
+// `layout`) published by another process, if any
+static bool
+attach_state_maps(struct sc_remap_state *state,
+                  const struct sc_remap_layout &layout,
+                  enum sc_opencv_backend backend, unsigned scale) {
+    if (backend != SC_OPENCV_BACKEND_CPU) {
+        return false;
+    }
+
+    struct sc_remap_shm_key key = {};
+    key.source_hash = state->source_hash;
+    key.preview_scale = scale;
+    if (!attach_maps(state->shm, key, layout, state->full_maps,
+                     state->preview_maps, scale)) {
+        return false;
+    }
+    state->shared = true;
+
+    if (state->cache_mapped) {
+        // No map points to the cache anymore
+        sc_file_unmap(&state->cache_mapping);
+        state->cache_mapped = false;
+    }
+    return true;
+}
+
+static bool
+load_maps_to_host(struct sc_remap_state *state, const char *map_path,
+                  enum sc_opencv_backend backend, unsigned scale) {
+    struct sc_file_mapping source;
+    if (!sc_file_map(map_path, &source)) {
+        LOGE("Could not open mapping file: %s", map_path);
+        return false;
+    }
+    uint64_t source_hash = hash_data(source.data, source.size);
+    sc_file_unmap(&source);
+    state->source_hash = source_hash;
+
+    std::string cache_path = std::string(map_path) + SC_REMAP_CACHE_SUFFIX;
+    if (load_maps_from_cache(state, cache_path.c_str(), source_hash)) {
+        LOGI("Remap cache loaded: %s", cache_path.c_str());
+        // Another process may have published the grids of these maps
+        attach_state_maps(state, state->full_maps.layout, backend, scale);
+        return true;
+    }
+
+    cv::FileStorage fs(map_path, cv::FileStorage::READ);
+    if (!fs.isOpened()) {
+        LOGE("Could not open mapping file: %s", map_path);
+        return false;
+    }
+
+    if (!fs["K1"].empty()) {
+        // Camera parameters (--opencv-calib): computing the maps is faster
+        // than loading them, they are not cached
+        if (!read_calib(fs, state->calib, map_path)) {
+            return false;
+        }
+        state->has_calib = true;
+
+        if (attach_state_maps(state, state->calib.layout, backend, scale)) {
+            return true;
+        }
+
+        sc_tick start = sc_tick_now();
+        compute_maps_from_calib(state->calib, state->full_maps,
+                                state->calib.image_size);
+        LOGI("Remap maps computed from the camera parameters in %" PRItick
+             " ms", SC_TICK_TO_MS(sc_tick_now() - start));
+        return true;
+    }
+
+    if (!load_maps_from_xml(state->full_maps, fs, map_path)) {
+        return false;
+    }
+
+    write_maps_to_cache(state->full_maps, cache_path.c_str(), source_hash);
+    return true;
+}
+
+static bool
+validate_maps(const struct sc_remap_maps &full_maps) {
+    cv::Size luma_size = get_map_size(full_maps, SC_REMAP_LUMA(0));
+    if (luma_size.empty()) {
+        LOGE("Missing remap maps");
+        return false;
+    }
+
+    // The chroma maps are computed from the luma maps, at half resolution
+    cv::Size chroma_size(luma_size.width / 2, luma_size.height / 2);
+    unsigned count = get_map_count(full_maps.layout);
+    for (unsigned j = 0; j < count; ++j) {
+        unsigned i = get_map_index(full_maps.layout, j);
+        cv::Size expected = is_chroma_map(i) ? chroma_size : luma_size;
+        bool grid = full_maps.grid[i] != nullptr;
+        if (get_map_size(full_maps, i) != expected
+                || (!grid && full_maps.host[i][1].size() != expected)) {
+            LOGE("Inconsistent remap map sizes (the maps of all the views "
+                 "must have the same size)");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Get the rows [y0, y1) of the dense maps of the map i, expanded if it is
+// stored as a grid
+static void
+get_dense_maps(const struct sc_remap_maps &maps, unsigned i, int y0, int y1,
+               cv::Mat &map1, cv::Mat &map2) {
+    const struct sc_remap_grid *grid = maps.grid[i].get();
+    if (!grid) {
+        cv::Rect rows(0, y0, maps.host[i][0].cols, y1 - y0);
+        map1 = maps.host[i][0](rows);
+        map2 = maps.host[i][1](rows);
+        return;
+    }
+
+    map1.create(y1 - y0, grid->width, CV_16SC2);
+    map2.create(y1 - y0, grid->width, CV_16UC1);
+    for (int y = y0; y < y1; ++y) {
+        sc_remap_grid_get_row(grid, y, 0, grid->width,
+                              map1.ptr<int16_t>(y - y0),
+                              map2.ptr<uint16_t>(y - y0));
+    }
+}
+
+// Get the float maps (CV_32FC1) of the map i
+static void
+get_float_maps(const struct sc_remap_maps &maps, unsigned i, cv::Mat &map_x,
+               cv::Mat &map_y) {
+    cv::Mat map1, map2;
+    get_dense_maps(maps, i, 0, get_map_size(maps, i).height, map1, map2);
+    cv::convertMaps(map1, map2, map_x, map_y, CV_32FC1);
+}
+
+// Replace the dense host maps by sparse grids where they reproduce them
+// accurately (see util/remap.h), to reduce the memory and the memory bandwidth
+// of the CPU remap. The maps remap frames of src_size per view.
+//
+// Return true if all the maps are stored as grids.
+static bool
+compact_maps(struct sc_remap_maps &maps, cv::Size src_size,
+             const char *name) {
+    size_t dense_size = 0;
+    size_t grid_size = 0;
+    unsigned shift = 0;
+    bool all = true;
+    unsigned count = get_map_count(maps.layout);
+    for (unsigned j = 0; j < count; ++j) {
+        unsigned i = get_map_index(maps.layout, j);
+        cv::Mat (&host)[2] = maps.host[i];
+        bool chroma = is_chroma_map(i);
+        int sw = chroma ? src_size.width / 2 : src_size.width;
+        int sh = chroma ? src_size.height / 2 : src_size.height;
+        size_t size = host[0].total() * host[0].elemSize()
+                    + host[1].total() * host[1].elemSize();
+        dense_size += size;
+
+        sc_remap_grid_ptr grid(new (std::nothrow) sc_remap_grid());
+        if (!grid || !sc_remap_grid_init(grid.get(), host[0].ptr<int16_t>(),
+                                         (int) host[0].step,
+                                         host[1].ptr<uint16_t>(),
+                                         (int) host[1].step, host[0].cols,
+                                         host[0].rows, sw, sh)) {
+            grid_size += size;
+            all = false;
+            // The pixels mapped from outside of the source are skipped by the
+            // dense remap too
+            maps.spans[i].resize(host[0].rows);
+            sc_remap_spans_init(maps.spans[i].data(), host[0].ptr<int16_t>(),
+                                (int) host[0].step, host[0].cols,
+                                host[0].rows, sw, sh);
+            continue;
+        }
+
+        grid_size += sc_remap_grid_get_size(grid.get());
+        shift = std::max(shift, grid->shift);
+        maps.grid[i] = std::move(grid);
+        host[0].release();
+        host[1].release();
+    }
+
+    if (grid_size < dense_size) {
+        LOGI("Remap maps (%s): %" PRIu64 " KiB instead of %" PRIu64 " KiB "
+             "(grid of up to %u pixels)", name, (uint64_t) grid_size / 1024,
+             (uint64_t) dense_size / 1024, 1u << shift);
     } else {
-        left_mapped = left_half;
-        right_mapped = right_half;
+        LOGD("Remap maps (%s): kept dense (not smooth enough for a grid)",
+             name);
     }
+    return all;
+}
 
-    // Create a larger result matrix to accommodate the text bar
-    cv::Mat result = cv::Mat::zeros(display_height, frame->width, bgr.type());
+// Compute the maps remapping the full resolution frames directly to frames
+// downscaled by `scale`, so that the preview never needs a full resolution
+// remap followed by a resize
+static bool
+compute_preview_maps(const struct sc_remap_maps &full_maps,
+                     struct sc_remap_maps &preview_maps, unsigned scale) {
+    cv::Size view = get_map_size(full_maps, SC_REMAP_LUMA(0));
+    cv::Size size(view.width / scale, view.height / scale);
+    // The chroma planes must keep exactly half the luma resolution
+    if (size.width < 2 || size.height < 2 || size.width % 2
+            || size.height % 2) {
+        LOGE("Invalid preview downscale factor %u for the %dx%d remap maps",
+             scale, view.width, view.height);
+        return false;
+    }
+
+    unsigned views = sc_remap_layout_get_views(&full_maps.layout);
+    cv::Mat small_x[SC_REMAP_LAYOUT_MAX_VIEWS];
+    cv::Mat small_y[SC_REMAP_LAYOUT_MAX_VIEWS];
+    for (unsigned v = 0; v < views; ++v) {
+        cv::Mat map_x, map_y;
+        get_float_maps(full_maps, SC_REMAP_LUMA(v), map_x, map_y);
 
-    // Copy mapped halves to result (offset by 30 pixels if showing text)
-    int y_offset = show_text ? text_height : 0;
-    // Use ROI (Region of Interest) to ensure proper copying
-    cv::Mat dest_roi = result(cv::Rect(0, y_offset, frame->width, original_height));
-    
-    // Copy the mapped halves into the ROI
-    left_mapped.copyTo(dest_roi(cv::Rect(0, 0, bgr.cols/2, original_height)));
-    right_mapped.copyTo(dest_roi(cv::Rect(bgr.cols/2, 0, bgr.cols - bgr.cols/2, original_height)));
+        // Averaging the source coordinates of the covered destination pixels
+        // gives the source coordinates of the downscaled destination pixel
+        cv::resize(map_x, small_x[v], size, 0, 0, cv::INTER_AREA);
+        cv::resize(map_y, small_y[v], size, 0, 0, cv::INTER_AREA);
+    }
+
+    convert_view_maps(full_maps.layout, small_x, small_y, preview_maps);
+    return true;
+}
+
+// Derive from the calibration maps `full_maps` the maps for frames of `size`
+// (all the views), with the same field of view
+static void
+compute_scaled_maps(const struct sc_remap_maps &full_maps,
+                    struct sc_remap_maps &scaled_maps, cv::Size size) {
+    const struct sc_remap_layout &layout = full_maps.layout;
+    cv::Size view = get_map_size(full_maps, SC_REMAP_LUMA(0));
+    cv::Size view_size(size.width / layout.cols, size.height / layout.rows);
+    double sx = (double) view_size.width / view.width;
+    double sy = (double) view_size.height / view.height;
+    int interpolation = view_size.width < view.width ? cv::INTER_AREA
+                                                     : cv::INTER_LINEAR;
+
+    unsigned views = sc_remap_layout_get_views(&layout);
+    cv::Mat scaled_x[SC_REMAP_LAYOUT_MAX_VIEWS];
+    cv::Mat scaled_y[SC_REMAP_LAYOUT_MAX_VIEWS];
+    for (unsigned v = 0; v < views; ++v) {
+        cv::Mat map_x, map_y;
+        get_float_maps(full_maps, SC_REMAP_LUMA(v), map_x, map_y);
+
+        cv::resize(map_x, scaled_x[v], view_size, 0, 0, interpolation);
+        cv::resize(map_y, scaled_y[v], view_size, 0, 0, interpolation);
+
+        // The source coordinates are scaled too (the pixel centers are at
+        // +0.5)
+        scaled_x[v].convertTo(scaled_x[v], CV_32F, sx, 0.5 * sx - 0.5);
+        scaled_y[v].convertTo(scaled_y[v], CV_32F, sy, 0.5 * sy - 0.5);
+    }
+
+    convert_view_maps(layout, scaled_x, scaled_y, scaled_maps);
+}
+
+// Return NULL on error
+static std::shared_ptr<struct sc_remap_state>
+load_maps(const char *map_path, enum sc_opencv_backend backend,
+          unsigned scale) {
+    auto state = std::make_shared<struct sc_remap_state>();
+
+    if (!load_maps_to_host(state.get(), map_path, backend, scale)
+            || !validate_maps(state->full_maps)) {
+        return nullptr;
+    }
+
+    if (state->shared) {
+        // The preview grids are attached too
+        return state;
+    }
+
+    if (scale > 1 && !compute_preview_maps(state->full_maps,
+                                           state->preview_maps, scale)) {
+        return nullptr;
+    }
+
+    if (backend != SC_OPENCV_BACKEND_CPU) {
+        upload_maps(state->full_maps, backend);
+        if (scale > 1) {
+            upload_maps(state->preview_maps, backend);
+        }
+    } else {
+        // Once the preview maps are derived from the dense maps
+        cv::Size view_size = get_map_size(state->full_maps, SC_REMAP_LUMA(0));
+        bool grids = compact_maps(state->full_maps, view_size, "full");
+        if (grids && state->cache_mapped) {
+            // No map points to the cache anymore
+            sc_file_unmap(&state->cache_mapping);
+            state->cache_mapped = false;
+        }
+        if (scale > 1) {
+            grids &= compact_maps(state->preview_maps, view_size, "preview");
+        }
+        if (grids) {
+            struct sc_remap_shm_key key = {};
+            key.source_hash = state->source_hash;
+            key.preview_scale = scale;
+            state->shared = publish_maps(state->shm, key, state->full_maps,
+                                         state->preview_maps, scale);
+        }
+    }
+    return state;
+}
+
+// Number of luma rows of the tiles remapped as independent tasks on the CPU
+//
+// All the planes of a tile are remapped by the same task, one after the other,
+// so that the working set of a task (the rows of the maps, of the source and
+// of the destination, about 500 KB for a view of the full resolution frames)
+// stays in the L2 cache instead of streaming each plane of the whole frame
+// through the memory
+#define SC_REMAP_TILE_ROWS 32
+
+// Remap the 8-bit planes on the CPU by the vectorized kernel (if supported)
+// rather than by cv::remap()
+static std::atomic<bool> simd_remap(true);
+
+void
+sc_video_preprocess_set_simd_remap(bool enable) {
+    simd_remap.store(enable, std::memory_order_relaxed);
+}
+
+// A plane to remap, the view v using the maps maps.host[first + v]
+struct sc_remap_plane {
+    cv::Mat src;
+    cv::Mat dst; // whose views have the size of the maps
+    unsigned first; // SC_REMAP_LUMA(0) or SC_REMAP_CHROMA(0)
+    uint8_t border;
+};
+
+// Split a plane into the rectangles of the views of the layout
+static void
+split_views(const cv::Mat &plane, const struct sc_remap_layout &layout,
+            cv::Rect (&rects)[SC_REMAP_LAYOUT_MAX_VIEWS]) {
+    int cols = layout.cols;
+    int rows = layout.rows;
+    for (int row = 0; row < rows; ++row) {
+        int y0 = plane.rows * row / rows;
+        int y1 = plane.rows * (row + 1) / rows;
+        for (int col = 0; col < cols; ++col) {
+            int x0 = plane.cols * col / cols;
+            int x1 = plane.cols * (col + 1) / cols;
+            rects[row * cols + col] = cv::Rect(x0, y0, x1 - x0, y1 - y0);
+        }
+    }
+}
+
+// Remap the rows [y0, y1) of one view of a plane by the map maps.host[index]
+// (or maps.grid[index])
+static void
+remap_rows_cpu(const cv::Mat &src, const cv::Mat &dst,
+               const struct sc_remap_maps &maps, unsigned index, int y0,
+               int y1, uint8_t border, bool simd) {
+    cv::Rect rows(0, y0, dst.cols, y1 - y0);
+    // The band already has the expected size and type, so cv::remap() writes
+    // directly into the destination frame
+    cv::Mat dst_band = dst(rows);
+    const struct sc_remap_grid *grid = maps.grid[index].get();
+    if (grid) {
+        if (simd && src.type() == CV_8UC1) {
+            sc_remap_grid_u8(src.ptr(), (int) src.step, src.cols, src.rows,
+                             dst_band.ptr(), (int) dst_band.step, grid, y0, y1,
+                             border);
+        } else {
+            // Expanded for the band only
+            cv::Mat map1, map2;
+            get_dense_maps(maps, index, y0, y1, map1, map2);
+            cv::remap(src, dst_band, map1, map2, cv::INTER_LINEAR,
+                      cv::BORDER_CONSTANT, cv::Scalar(border));
+        }
+        return;
+    }
+
+    const cv::Mat (&map)[2] = maps.host[index];
+    if (simd && src.type() == CV_8UC1) {
+        // Same result as cv::remap(), specialized for the constant
+        // fixed-point maps of the 8-bit planes
+        const std::vector<struct sc_remap_span> &spans = maps.spans[index];
+        sc_remap_u8_spans(src.ptr(), (int) src.step, src.cols, src.rows,
+                          dst_band.ptr(), (int) dst_band.step, dst_band.cols,
+                          dst_band.rows, map[0].ptr<int16_t>(y0),
+                          (int) map[0].step, map[1].ptr<uint16_t>(y0),
+                          (int) map[1].step,
+                          spans.empty() ? NULL : &spans[y0], border);
+    } else {
+        cv::remap(src, dst_band, map[0](rows), map[1](rows), cv::INTER_LINEAR,
+                  cv::BORDER_CONSTANT, cv::Scalar(border));
+    }
+}
+
+// Remap the planes of a frame (the first one being the luma plane, the others
+// having half its rows) by tiles of rows
+static void
+remap_planes_cpu(const struct sc_remap_plane *planes, unsigned count,
+                 const struct sc_remap_maps &maps) {
+    assert(count && count <= 3);
+    const struct sc_remap_layout &layout = maps.layout;
+    cv::Rect src_rects[3][SC_REMAP_LAYOUT_MAX_VIEWS];
+    cv::Rect dst_rects[3][SC_REMAP_LAYOUT_MAX_VIEWS];
+    for (unsigned p = 0; p < count; ++p) {
+        split_views(planes[p].src, layout, src_rects[p]);
+        split_views(planes[p].dst, layout, dst_rects[p]);
+    }
+
+    bool simd = simd_remap.load(std::memory_order_relaxed)
+             && sc_remap_u8_simd();
+    // All the views have the same size
+    int views = sc_remap_layout_get_views(&layout);
+    int rows = dst_rects[0][0].height;
+    int tiles = (rows + SC_REMAP_TILE_ROWS - 1) / SC_REMAP_TILE_ROWS;
+
+    // The destination rows only depend on the same rows of the maps, so all
+    // the views are split into tiles of rows, all remapped in parallel (a
+    // single cv::remap() per view would run the views one after the other)
+    cv::parallel_for_(cv::Range(0, views * tiles),
+                      [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; ++i) {
+            unsigned view = i % views;
+            int tile = i / views;
+            int r0 = tile * SC_REMAP_TILE_ROWS;
+            int r1 = std::min(r0 + SC_REMAP_TILE_ROWS, rows);
+            for (unsigned p = 0; p < count; ++p) {
+                const struct sc_remap_plane &plane = planes[p];
+                int plane_rows = dst_rects[p][view].height;
+                int y0 = (int) ((int64_t) r0 * plane_rows / rows);
+                int y1 = (int) ((int64_t) r1 * plane_rows / rows);
+                if (y0 == y1) {
+                    continue;
+                }
+
+                remap_rows_cpu(plane.src(src_rects[p][view]),
+                               plane.dst(dst_rects[p][view]), maps,
+                               plane.first + view, y0, y1, plane.border,
+                               simd);
+            }
+        }
+    }, views * tiles);
+}
+
+static void
+remap_plane_opencl(const cv::Mat &src, cv::Mat &dst,
+                   const cv::Rect (&src_rects)[SC_REMAP_LAYOUT_MAX_VIEWS],
+                   const cv::Rect (&dst_rects)[SC_REMAP_LAYOUT_MAX_VIEWS],
+                   const struct sc_remap_maps &maps, unsigned first,
+                   uint8_t border) {
+    // Upload the whole plane once, and download the result once
+    cv::UMat usrc;
+    src.copyTo(usrc);
+    cv::UMat udst(dst.size(), dst.type());
+
+    unsigned views = sc_remap_layout_get_views(&maps.layout);
+    for (unsigned v = 0; v < views; ++v) {
+        cv::UMat udst_view = udst(dst_rects[v]);
+        cv::remap(usrc(src_rects[v]), udst_view, maps.ocl[first + v][0],
+                  maps.ocl[first + v][1], cv::INTER_LINEAR,
+                  cv::BORDER_CONSTANT, cv::Scalar(border));
+    }
+
+    udst.copyTo(dst);
+}
+
+#ifdef HAVE_OPENCV_CUDAWARPING
+static void
+remap_plane_cuda(const cv::Mat &src, cv::Mat &dst,
+                 const cv::Rect (&src_rects)[SC_REMAP_LAYOUT_MAX_VIEWS],
+                 const cv::Rect (&dst_rects)[SC_REMAP_LAYOUT_MAX_VIEWS],
+                 const struct sc_remap_maps &maps, unsigned first,
+                 uint8_t border, const struct sc_cuda_ipc_plane *gpu_dst) {
+    // Upload the whole plane once, and download the result once
+    cv::cuda::GpuMat gsrc;
+    gsrc.upload(src);
+    cv::cuda::GpuMat gdst;
+    if (gpu_dst) {
+        // Remap directly into the exported slot
+        gdst = cv::cuda::GpuMat(dst.size(), dst.type(), gpu_dst->data,
+                                gpu_dst->pitch);
+    } else {
+        gdst.create(dst.size(), dst.type());
+    }
+
+    unsigned views = sc_remap_layout_get_views(&maps.layout);
+    for (unsigned v = 0; v < views; ++v) {
+        cv::cuda::GpuMat gdst_view = gdst(dst_rects[v]);
+        cv::cuda::remap(gsrc(src_rects[v]), gdst_view, maps.cuda[first + v][0],
+                        maps.cuda[first + v][1], cv::INTER_LINEAR,
+                        cv::BORDER_CONSTANT, cv::Scalar(border));
+    }
+
+    gdst.download(dst);
+}
+#endif
+
+// Remap src into dst, which is either the same size as src (full maps) or
+// downscaled (preview maps)
+//
+// With the cuda backend, if gpu_dst is not NULL, the result is also kept in
+// this device memory.
+static void
+remap_plane(const cv::Mat &src, cv::Mat &dst, enum sc_opencv_backend backend,
+            const struct sc_remap_maps *maps, unsigned first, uint8_t border,
+            const struct sc_cuda_ipc_plane *gpu_dst) {
+#ifndef HAVE_OPENCV_CUDAWARPING
+    (void) gpu_dst;
+#endif
+    if (!maps) {
+        if (src.size() == dst.size()) {
+            // No mapping, just copy the plane
+            src.copyTo(dst);
+        } else {
+            cv::resize(src, dst, dst.size(), 0, 0, cv::INTER_AREA);
+        }
+        return;
+    }
+
+    cv::Rect src_rects[SC_REMAP_LAYOUT_MAX_VIEWS];
+    cv::Rect dst_rects[SC_REMAP_LAYOUT_MAX_VIEWS];
+    split_views(src, maps->layout, src_rects);
+    split_views(dst, maps->layout, dst_rects);
+
+    switch (backend) {
+        case SC_OPENCV_BACKEND_OPENCL:
+            remap_plane_opencl(src, dst, src_rects, dst_rects, *maps, first,
+                               border);
+            break;
+#ifdef HAVE_OPENCV_CUDAWARPING
+        case SC_OPENCV_BACKEND_CUDA:
+            remap_plane_cuda(src, dst, src_rects, dst_rects, *maps, first,
+                             border, gpu_dst);
+            break;
+#endif
+        default: {
+            struct sc_remap_plane plane = {src, dst, first, border};
+            remap_planes_cpu(&plane, 1, *maps);
+            break;
+        }
+    }
+}
+
+static bool
+select_backend(enum sc_opencv_backend selected) {
+    switch (selected) {
+        case SC_OPENCV_BACKEND_CPU: {
+            const char *simd = sc_remap_u8_simd();
+            LOGD("CPU remap: %s", simd ? simd : "OpenCV");
+            break;
+        }
+        case SC_OPENCV_BACKEND_OPENCL:
+            // Note: cv::ocl::setUseOpenCL() only affects the calling thread,
+            // the cv::UMat operations use OpenCL by default when available
+            if (!cv::ocl::haveOpenCL()) {
+                LOGE("OpenCV backend opencl: OpenCL is not available");
+                return false;
+            }
+            LOGI("OpenCV backend: OpenCL (%s)",
+                 cv::ocl::Device::getDefault().name().c_str());
+            break;
+        case SC_OPENCV_BACKEND_CUDA:
+#ifdef HAVE_OPENCV_CUDAWARPING
+            if (cv::cuda::getCudaEnabledDeviceCount() <= 0) {
+                LOGE("OpenCV backend cuda: no CUDA device available");
+                return false;
+            }
+            LOGI("OpenCV backend: CUDA");
+            break;
+#else
+            LOGE("OpenCV backend cuda: OpenCV was built without CUDA support");
+            return false;
+#endif
+        default:
+            assert(!"unexpected backend");
+            return false;
+    }
+
+    return true;
+}
+
+void sc_video_preprocess_set_threads(unsigned count) {
+    if (!count) {
+        count = cv::getNumberOfCPUs();
+    }
+
+    // Global to all the threads calling OpenCV (whatever its parallel
+    // backend)
+    cv::setNumThreads(count);
+    LOGD("OpenCV: %u preprocessing threads", count);
+}
+
+struct sc_video_preprocess *
+sc_video_preprocess_new(const char *map_path, enum sc_opencv_backend backend,
+                        unsigned scale) {
+    assert(map_path);
+    assert(scale >= 1);
+
+    if (!select_backend(backend)) {
+        return NULL;
+    }
+
+    std::shared_ptr<struct sc_remap_state> state =
+        load_maps(map_path, backend, scale);
+    if (!state) {
+        return NULL;
+    }
+
+    struct sc_video_preprocess *vpp = new (std::nothrow) sc_video_preprocess;
+    if (!vpp) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    vpp->backend = backend;
+    vpp->preview_scale = scale;
+    vpp->state = std::move(state);
+    vpp->generation = 0;
+    vpp->cuda_ipc_output = NULL;
+
+    return vpp;
+}
+
+void sc_video_preprocess_destroy(struct sc_video_preprocess *vpp) {
+#ifdef SC_CUDA_IPC_OUTPUT
+    if (vpp->cuda_ipc_output) {
+        sc_cuda_ipc_output_destroy(vpp->cuda_ipc_output);
+    }
+#endif
+    delete vpp;
+}
+
+bool sc_video_preprocess_set_cuda_ipc_output(struct sc_video_preprocess *vpp,
+                                             const char *name) {
+    assert(!vpp->cuda_ipc_output);
+#ifdef SC_CUDA_IPC_OUTPUT
+    if (vpp->backend != SC_OPENCV_BACKEND_CUDA) {
+        LOGE("The CUDA IPC output requires the cuda backend");
+        return false;
+    }
+
+    vpp->cuda_ipc_output = sc_cuda_ipc_output_new(name);
+    return vpp->cuda_ipc_output;
+#else
+    (void) name;
+    LOGE("The CUDA IPC output requires an OpenCV build with CUDA support and "
+         "the CUDA runtime");
+    return false;
+#endif
+}
+
+void sc_video_preprocess_publish_cuda_ipc(
+        const struct sc_video_preprocess *vpp, int64_t pts,
+        uint64_t frame_number, int64_t timestamp_us) {
+#ifdef SC_CUDA_IPC_OUTPUT
+    if (vpp->cuda_ipc_output) {
+        sc_cuda_ipc_output_publish(vpp->cuda_ipc_output, pts, frame_number,
+                                   timestamp_us);
+    }
+#else
+    (void) vpp;
+    (void) pts;
+    (void) frame_number;
+    (void) timestamp_us;
+#endif
+}
+
+bool sc_video_preprocess_reload(struct sc_video_preprocess *vpp,
+                                const char *map_path) {
+    std::shared_ptr<struct sc_remap_state> state =
+        load_maps(map_path, vpp->backend, vpp->preview_scale);
+    if (!state) {
+        // The current maps are kept
+        return false;
+    }
+
+    // The consumers of the views (depth, features, device remap) are set up
+    // for the initial layout
+    struct sc_remap_layout layout = get_state(vpp)->full_maps.layout;
+    if (!sc_remap_layout_equals(&state->full_maps.layout, &layout)) {
+        LOGE("The new remap maps have another layout (%ux%u instead of %ux%u)",
+             state->full_maps.layout.cols, state->full_maps.layout.rows,
+             layout.cols, layout.rows);
+        return false;
+    }
+
+    // The new calibration may have another size: its maps are scaled to the
+    // video size on first use
+    {
+        std::lock_guard<std::mutex> lock(vpp->mutex);
+        vpp->state = std::move(state);
+    }
+    ++vpp->generation;
+
+    return true;
+}
+
+unsigned sc_video_preprocess_get_generation(
+        const struct sc_video_preprocess *vpp) {
+    return vpp->generation;
+}
+
+// Derive the maps of `state` for frames of width x height
+//
+// Return NULL if the calibration cannot be scaled to this size.
+static std::unique_ptr<const struct sc_scaled_maps>
+scale_maps(const struct sc_video_preprocess *vpp,
+           const struct sc_remap_state &state, int width, int height) {
+    const struct sc_remap_layout &layout = state.full_maps.layout;
+    cv::Size view = get_map_size(state.full_maps, SC_REMAP_LUMA(0));
+    int cols = layout.cols;
+    int rows = layout.rows;
+    int map_width = cols * view.width;
+    int map_height = rows * view.height;
+
+    // The chroma planes of each view must keep exactly half the luma
+    // resolution
+    if (width < 2 * cols || height < 2 * rows || width % (2 * cols)
+            || height % (2 * rows)) {
+        LOGE("Could not scale the remap maps (%dx%d) to the video size %dx%d "
+             "(the width must be a multiple of %d, the height of %d)",
+             map_width, map_height, width, height, 2 * cols, 2 * rows);
+        return nullptr;
+    }
+
+    // Only the same field of view may be scaled, up to the rounding of the
+    // video size by the encoder (to multiples of 8)
+    int64_t diff = (int64_t) width * map_height - (int64_t) height * map_width;
+    if (std::abs(diff) > (int64_t) 8 * std::max(map_width, map_height)) {
+        LOGE("Video size %dx%d does not have the aspect ratio of the remap "
+             "maps (%dx%d), adjust the capture or the calibration", width,
+             height, map_width, map_height);
+        return nullptr;
+    }
+
+    std::unique_ptr<struct sc_scaled_maps> scaled(
+        new (std::nothrow) sc_scaled_maps);
+    if (!scaled) {
+        LOG_OOM();
+        return nullptr;
+    }
+
+    struct sc_remap_shm_key key = {};
+    key.source_hash = state.source_hash;
+    key.width = width;
+    key.height = height;
+    key.preview_scale = vpp->preview_scale;
+    if (vpp->backend == SC_OPENCV_BACKEND_CPU
+            && attach_maps(scaled->shm, key, layout, scaled->full_maps,
+                           scaled->preview_maps, vpp->preview_scale)) {
+        scaled->shared = true;
+        return std::unique_ptr<const struct sc_scaled_maps>(std::move(scaled));
+    }
+
+    if (state.has_calib) {
+        // Computed exactly for this size
+        compute_maps_from_calib(state.calib, scaled->full_maps,
+                                cv::Size(width / cols, height / rows));
+    } else {
+        compute_scaled_maps(state.full_maps, scaled->full_maps,
+                            cv::Size(width, height));
+    }
+    if (vpp->preview_scale > 1
+            && !compute_preview_maps(scaled->full_maps, scaled->preview_maps,
+                                     vpp->preview_scale)) {
+        return nullptr;
+    }
+
+    if (vpp->backend != SC_OPENCV_BACKEND_CPU) {
+        upload_maps(scaled->full_maps, vpp->backend);
+        if (vpp->preview_scale > 1) {
+            upload_maps(scaled->preview_maps, vpp->backend);
+        }
+    } else {
+        cv::Size view_size(width / cols, height / rows);
+        bool grids = compact_maps(scaled->full_maps, view_size, "scaled");
+        if (vpp->preview_scale > 1) {
+            grids &= compact_maps(scaled->preview_maps, view_size,
+                                  "scaled preview");
+        }
+        if (grids) {
+            scaled->shared = publish_maps(scaled->shm, key, scaled->full_maps,
+                                          scaled->preview_maps,
+                                          vpp->preview_scale);
+        }
+    }
+
+    LOGI("Remap maps scaled from %dx%d to %dx%d", map_width, map_height,
+         width, height);
+    return std::unique_ptr<const struct sc_scaled_maps>(std::move(scaled));
+}
+
+// Get the maps of `state` for frames of width x height: the calibration maps,
+// or maps derived from them (computed on the first frame of each size)
+//
+// Return false if the calibration cannot be scaled to this size.
+static bool
+get_maps(const struct sc_video_preprocess *vpp,
+         const struct sc_remap_state &state, int width, int height,
+         const struct sc_remap_maps **full_maps,
+         const struct sc_remap_maps **preview_maps) {
+    const struct sc_remap_layout &layout = state.full_maps.layout;
+    cv::Size view = get_map_size(state.full_maps, SC_REMAP_LUMA(0));
+    if (width == (int) layout.cols * view.width
+            && height == (int) layout.rows * view.height) {
+        *full_maps = &state.full_maps;
+        *preview_maps = &state.preview_maps;
+        return true;
+    }
+
+    const struct sc_scaled_maps *scaled;
+    {
+        std::lock_guard<std::mutex> lock(state.scaled_mutex);
+        std::pair<int, int> key(width, height);
+        auto it = state.scaled.find(key);
+        if (it == state.scaled.end()) {
+            // A failure is also stored, so that it is reported only once
+            it = state.scaled.emplace(key, scale_maps(vpp, state, width,
+                                                      height)).first;
+        }
+        scaled = it->second.get();
+    }
+
+    if (!scaled) {
+        return false;
+    }
+
+    *full_maps = &scaled->full_maps;
+    *preview_maps = &scaled->preview_maps;
+    return true;
+}
+
+void sc_video_preprocess_get_size(const struct sc_video_preprocess *vpp,
+                                  unsigned *width, unsigned *height) {
+    std::shared_ptr<const struct sc_remap_state> state = get_state(vpp);
+
+    const struct sc_remap_layout &layout = state->full_maps.layout;
+    cv::Size view = get_map_size(state->full_maps, SC_REMAP_LUMA(0));
+    *width = layout.cols * view.width;
+    *height = layout.rows * view.height;
+}
+
+struct sc_remap_layout
+sc_video_preprocess_get_layout(const struct sc_video_preprocess *vpp) {
+    std::shared_ptr<const struct sc_remap_state> state = get_state(vpp);
+    return state->full_maps.layout;
+}
+
+bool sc_video_preprocess_check_size(const struct sc_video_preprocess *vpp,
+                                    unsigned width, unsigned height) {
+    std::shared_ptr<const struct sc_remap_state> state = get_state(vpp);
+
+    // Scale the maps immediately, rather than on the first frame
+    const struct sc_remap_maps *full_maps;
+    const struct sc_remap_maps *preview_maps;
+    return get_maps(vpp, *state, width, height, &full_maps, &preview_maps);
+}
+
+// Printable ASCII characters, rasterized once into the glyph atlas
+#define SC_TEXT_GLYPH_FIRST ' '
+#define SC_TEXT_GLYPH_LAST '~'
+#define SC_TEXT_GLYPH_COUNT (SC_TEXT_GLYPH_LAST - SC_TEXT_GLYPH_FIRST + 1)
+// Margin around each glyph, for the anti-aliased edges exceeding its advance
+#define SC_TEXT_GLYPH_PADDING 2
+#define SC_TEXT_X 10
+#define SC_TEXT_BASELINE (SC_VIDEO_PREPROCESS_TEXT_HEIGHT - 10)
+
+// The luma of every glyph, white on black, side by side
+struct sc_glyph_atlas {
+    cv::Mat atlas; // SC_VIDEO_PREPROCESS_TEXT_HEIGHT rows
+    int x[SC_TEXT_GLYPH_COUNT]; // left of the glyph cell, padding included
+    int advance[SC_TEXT_GLYPH_COUNT];
+};
+
+static struct sc_glyph_atlas
+build_glyph_atlas(void) {
+    struct sc_glyph_atlas atlas;
+    int font = cv::FONT_HERSHEY_SIMPLEX;
+
+    int total_width = 0;
+    for (int i = 0; i < SC_TEXT_GLYPH_COUNT; ++i) {
+        char s[2] = {(char) (SC_TEXT_GLYPH_FIRST + i), '\0'};
+        int baseline;
+        cv::Size size = cv::getTextSize(s, font, 1, 1, &baseline);
+        atlas.x[i] = total_width;
+        atlas.advance[i] = size.width;
+        total_width += size.width + 2 * SC_TEXT_GLYPH_PADDING;
+    }
+
+    atlas.atlas = cv::Mat::zeros(SC_VIDEO_PREPROCESS_TEXT_HEIGHT, total_width,
+                                 CV_8UC1);
+    for (int i = 0; i < SC_TEXT_GLYPH_COUNT; ++i) {
+        char s[2] = {(char) (SC_TEXT_GLYPH_FIRST + i), '\0'};
+        cv::Point origin(atlas.x[i] + SC_TEXT_GLYPH_PADDING, SC_TEXT_BASELINE);
+        cv::putText(atlas.atlas, s, origin, font, 1, cv::Scalar(255), 1,
+                    cv::LINE_AA);
+    }
+
+    return atlas;
+}
+
+// Draw white text into the luma plane of the (black) timestamps bar, by
+// blitting the cached glyphs
+static void
+draw_text(cv::Mat &bar, const char *text) {
+    // C++11 guarantees a thread-safe initialization, on first use
+    static const struct sc_glyph_atlas glyphs = build_glyph_atlas();
+    assert(bar.rows == glyphs.atlas.rows);
+
+    int pen = SC_TEXT_X;
+    for (const char *c = text; *c; ++c) {
+        int ch = (unsigned char) *c;
+        if (ch < SC_TEXT_GLYPH_FIRST || ch > SC_TEXT_GLYPH_LAST) {
+            ch = '?';
+        }
+        int i = ch - SC_TEXT_GLYPH_FIRST;
+
+        int x = pen - SC_TEXT_GLYPH_PADDING;
+        int width = glyphs.advance[i] + 2 * SC_TEXT_GLYPH_PADDING;
+        if (x + width > bar.cols) {
+            // The text does not fit (very small frames)
+            break;
+        }
+
+        // The cells of adjacent glyphs overlap on their padding
+        cv::Mat dst = bar(cv::Rect(x, 0, width, bar.rows));
+        cv::max(dst, glyphs.atlas(cv::Rect(glyphs.x[i], 0, width, bar.rows)),
+                dst);
+        pen += glyphs.advance[i];
+    }
+}
+
+// Write the content of frame, remapped by maps (or just copied or resized if
+// REMAP is false, maps being NULL) to width x height, into output, a new frame
+// from the pool
+//
+// The variants are instantiated for each configuration, so that the
+// configuration is resolved at compile time instead of being tested for each
+// plane: if LUMA_ONLY is set, output is a GRAY8 frame, the chroma planes are
+// skipped; if OVERLAY is set, the timestamps bar (show_text) is added above
+// the video content.
+//
+// With the cuda backend, if gpu is not NULL, the remapped planes (without the
+// timestamps bar) are also kept in this slot of the CUDA IPC output.
+template <bool REMAP, bool LUMA_ONLY, bool OVERLAY>
+static bool
+process_frame(const AVFrame *frame, AVFrame *output, int width, int height,
+              enum sc_opencv_backend backend, const struct sc_remap_maps *maps,
+              const char *show_text, struct sc_frame_pool *pool,
+              const struct sc_cuda_ipc_slot *gpu) {
+    // The decoded frames are always converted to YUV420P (only the luma of
+    // a GRAY8 frame may be processed)
+    assert(LUMA_ONLY || frame->format == AV_PIX_FMT_YUV420P);
+    assert(REMAP == !!maps);
+    assert(OVERLAY == !!show_text);
+    assert(!gpu || (REMAP && gpu->plane_count == (LUMA_ONLY ? 1 : 3)));
+
+    const int text_height = SC_VIDEO_PREPROCESS_TEXT_HEIGHT;
+    const int y_offset = OVERLAY ? text_height : 0;
+    int display_height = height + y_offset;
+
+    int format = LUMA_ONLY ? AV_PIX_FMT_GRAY8 : AV_PIX_FMT_YUV420P;
+    if (!sc_frame_pool_get(pool, output, format, width, display_height)) {
+        return false;
+    }
+
+    // Wrap the source and destination planes (no copy)
+    cv::Mat src_y(frame->height, frame->width, CV_8UC1, frame->data[0],
+                  frame->linesize[0]);
+    cv::Mat dst_y(display_height, width, CV_8UC1, output->data[0],
+                  output->linesize[0]);
+
+    // The text bar is above the video content
+    cv::Mat dst_y_roi = dst_y(cv::Rect(0, y_offset, width, height));
+    struct sc_remap_plane planes[3];
+    const unsigned plane_count = LUMA_ONLY ? 1 : 3;
+    planes[0] = {src_y, dst_y_roi, SC_REMAP_LUMA(0), SC_REMAP_BORDER_LUMA};
+
+    if (!LUMA_ONLY) {
+        int src_chroma_width = frame->width / 2;
+        int src_chroma_height = frame->height / 2;
+        int chroma_width = width / 2;
+        int chroma_height = height / 2;
+
+        cv::Mat src_u(src_chroma_height, src_chroma_width, CV_8UC1,
+                      frame->data[1], frame->linesize[1]);
+        cv::Mat src_v(src_chroma_height, src_chroma_width, CV_8UC1,
+                      frame->data[2], frame->linesize[2]);
+        cv::Mat dst_u(display_height / 2, chroma_width, CV_8UC1,
+                      output->data[1], output->linesize[1]);
+        cv::Mat dst_v(display_height / 2, chroma_width, CV_8UC1,
+                      output->data[2], output->linesize[2]);
+
+        cv::Rect chroma_roi(0, y_offset / 2, chroma_width, chroma_height);
+        cv::Mat dst_u_roi = dst_u(chroma_roi);
+        cv::Mat dst_v_roi = dst_v(chroma_roi);
+        planes[1] = {src_u, dst_u_roi, SC_REMAP_CHROMA(0),
+                     SC_REMAP_BORDER_CHROMA};
+        planes[2] = {src_v, dst_v_roi, SC_REMAP_CHROMA(0),
+                     SC_REMAP_BORDER_CHROMA};
+
+        if (OVERLAY) {
+            // A black bar is Y=0 with neutral chroma
+            dst_u(cv::Rect(0, 0, chroma_width, text_height / 2))
+                .setTo(cv::Scalar(SC_REMAP_BORDER_CHROMA));
+            dst_v(cv::Rect(0, 0, chroma_width, text_height / 2))
+                .setTo(cv::Scalar(SC_REMAP_BORDER_CHROMA));
+        }
+    }
+
+    if (REMAP && backend == SC_OPENCV_BACKEND_CPU) {
+        // All the planes of a tile at once
+        remap_planes_cpu(planes, plane_count, *maps);
+    } else {
+        for (unsigned i = 0; i < plane_count; ++i) {
+            remap_plane(planes[i].src, planes[i].dst, backend, maps,
+                        planes[i].first, planes[i].border,
+                        gpu ? &gpu->planes[i] : NULL);
+        }
+    }
 
     // If text should be shown, add a black bar and text at the top
-    if (show_text != NULL) {
-        // Create a black bar at the top
-        cv::rectangle(result, 
-                     cv::Point(0, 0), 
-                     cv::Point(result.cols, text_height), 
-                     cv::Scalar(0, 0, 0),  // Black in BGR
-                     -1);  // Filled rectangle
-
-        // Add white text
-        cv::putText(result, 
-                    show_text,
-                    cv::Point(10, text_height - 10),  // Position (10px from left, 50px from top)
-                    cv::FONT_HERSHEY_SIMPLEX,  // Font
-                    1,  // Scale
-                    cv::Scalar(255, 255, 255),  // White in BGR
-                    1,    // Thickness
-                    cv::LINE_AA);  // Anti-aliased
-    }
-
-    // Convert back to YUV
-    cv::Mat yuv_output;
-    cv::cvtColor(result, yuv_output, cv::COLOR_BGR2YUV);
-    
-    // Split back into planes
-    std::vector<cv::Mat> output_planes;
-    cv::split(yuv_output, output_planes);
-    
-    // Resize U,V back to original size
-    cv::Mat u_small, v_small;
-    cv::resize(output_planes[1], u_small, cv::Size(frame->width/2, display_height/2));
-    cv::resize(output_planes[2], v_small, cv::Size(frame->width/2, display_height/2));
-
-    // Update frame height
-    frame->height = display_height;
-    
-    // Reallocate frame buffers if needed
-    if (show_text != NULL) {
-        av_frame_get_buffer(frame, 32);
-    }
-
-    // Copy data back to AVFrame
-    memcpy(frame->data[0], output_planes[0].data, frame->linesize[0] * frame->height);
-    memcpy(frame->data[1], u_small.data, frame->linesize[1] * frame->height/2);
-    memcpy(frame->data[2], v_small.data, frame->linesize[2] * frame->height/2);
-}
\ No newline at end of file
+    if (OVERLAY) {
+        cv::Mat bar_y = dst_y(cv::Rect(0, 0, width, text_height));
+        bar_y.setTo(cv::Scalar(SC_REMAP_BORDER_LUMA));
+
+        // White text only affects the luma plane
+        draw_text(bar_y, show_text);
+    }
+
+    av_frame_copy_props(output, frame);
+    return true;
+}
+
+typedef bool (*process_frame_fn)(const AVFrame *frame, AVFrame *output,
+                                 int width, int height,
+                                 enum sc_opencv_backend backend,
+                                 const struct sc_remap_maps *maps,
+                                 const char *show_text,
+                                 struct sc_frame_pool *pool,
+                                 const struct sc_cuda_ipc_slot *gpu);
+
+// Indexed by [remap][luma_only][overlay]
+static const process_frame_fn process_frame_variants[2][2][2] = {
+    {
+        {process_frame<false, false, false>, process_frame<false, false, true>},
+        {process_frame<false, true, false>, process_frame<false, true, true>},
+    },
+    {
+        {process_frame<true, false, false>, process_frame<true, false, true>},
+        {process_frame<true, true, false>, process_frame<true, true, true>},
+    },
+};
+
+static process_frame_fn
+select_process_frame(const struct sc_remap_maps *maps, bool luma_only,
+                     const char *show_text) {
+    return process_frame_variants[!!maps][luma_only][!!show_text];
+}
+
+// The size of the preview of the frames of frame_width x frame_height, by the
+// preview maps if not NULL
+static bool
+get_preview_size(const struct sc_remap_maps *maps, unsigned scale,
+                 int frame_width, int frame_height, int *width, int *height) {
+    if (maps) {
+        // The remapped size is the size of the preview maps
+        cv::Size view = get_map_size(*maps, SC_REMAP_LUMA(0));
+        *width = maps->layout.cols * view.width;
+        *height = maps->layout.rows * view.height;
+        return true;
+    }
+
+    // Keep even dimensions for the chroma planes
+    *width = (frame_width / scale) & ~1;
+    *height = (frame_height / scale) & ~1;
+    return *width && *height;
+}
+
+bool sc_video_preprocess_get_preview_size(
+        const struct sc_video_preprocess *remap, unsigned scale, int width,
+        int height, int *preview_width, int *preview_height) {
+    assert(scale > 1);
+    assert(!remap || scale == remap->preview_scale);
+
+    std::shared_ptr<const struct sc_remap_state> state;
+    const struct sc_remap_maps *maps = NULL;
+    if (remap) {
+        state = get_state(remap);
+        const struct sc_remap_maps *full_maps;
+        if (!get_maps(remap, *state, width, height, &full_maps, &maps)) {
+            return false;
+        }
+    }
+
+    return get_preview_size(maps, scale, width, height, preview_width,
+                            preview_height);
+}
+
+void apply_video_effects(AVFrame *frame,
+                         const struct sc_video_preprocess *remap,
+                         const char *show_text, bool luma_only,
+                         struct sc_frame_pool *pool) {
+    // The remapped planes are written directly into a new pooled frame (remap
+    // cannot work in place), which then replaces the content of the input
+    // frame
+    AVFrame *output = av_frame_alloc();
+    if (!output) {
+        LOG_OOM();
+        return;
+    }
+
+    // Kept until the frame is processed, even if the maps are reloaded
+    // meanwhile
+    std::shared_ptr<const struct sc_remap_state> state;
+    const struct sc_remap_maps *maps = NULL;
+    enum sc_opencv_backend backend = SC_OPENCV_BACKEND_CPU;
+    if (remap) {
+        state = get_state(remap);
+        backend = remap->backend;
+        const struct sc_remap_maps *preview_maps;
+        if (!get_maps(remap, *state, frame->width, frame->height, &maps,
+                      &preview_maps)) {
+            // The error has been logged on the first frame of this size
+            av_frame_free(&output);
+            return;
+        }
+    }
+
+    const struct sc_cuda_ipc_slot *gpu = NULL;
+#ifdef SC_CUDA_IPC_OUTPUT
+    // The remapped frame is also exported on the GPU, if a slot is available
+    struct sc_cuda_ipc_output *cuda_ipc =
+        maps && backend == SC_OPENCV_BACKEND_CUDA ? remap->cuda_ipc_output
+                                                  : NULL;
+    struct sc_cuda_ipc_slot slot;
+    if (cuda_ipc && sc_cuda_ipc_output_acquire(cuda_ipc, frame->width,
+                                               frame->height,
+                                               luma_only ? 1 : 3, &slot)) {
+        gpu = &slot;
+    }
+#endif
+
+    process_frame_fn process = select_process_frame(maps, luma_only,
+                                                    show_text);
+    bool ok = process(frame, output, frame->width, frame->height, backend,
+                      maps, show_text, pool, gpu);
+#ifdef SC_CUDA_IPC_OUTPUT
+    if (gpu) {
+        // The download of the planes has waited for the remap on the device
+        sc_cuda_ipc_output_fill(cuda_ipc, gpu, frame->pts, ok);
+    }
+#endif
+    if (!ok) {
+        av_frame_free(&output);
+        return;
+    }
+
+    // Replace the input frame by the processed frame
+    av_frame_unref(frame);
+    av_frame_move_ref(frame, output);
+    av_frame_free(&output);
+}
+
+bool apply_video_effects_preview(const AVFrame *frame, AVFrame *preview,
+                                 unsigned scale,
+                                 const struct sc_video_preprocess *remap,
+                                 const char *show_text,
+                                 struct sc_frame_pool *pool) {
+    assert(scale > 1);
+    // The preview maps are computed by sc_video_preprocess_new()
+    assert(!remap || scale == remap->preview_scale);
+
+    std::shared_ptr<const struct sc_remap_state> state;
+    const struct sc_remap_maps *maps = NULL;
+    enum sc_opencv_backend backend = SC_OPENCV_BACKEND_CPU;
+    if (remap) {
+        state = get_state(remap);
+        backend = remap->backend;
+        const struct sc_remap_maps *full_maps;
+        if (!get_maps(remap, *state, frame->width, frame->height, &full_maps,
+                      &maps)) {
+            return false;
+        }
+    }
+
+    int width;
+    int height;
+    if (!get_preview_size(maps, scale, frame->width, frame->height, &width,
+                          &height)) {
+        return false;
+    }
+
+    process_frame_fn process = select_process_frame(maps, false, show_text);
+    return process(frame, preview, width, height, backend, maps, show_text,
+                   pool, NULL);
+}
+
+static struct sc_remap_plane_map
+get_plane_map(const struct sc_remap_maps &maps, unsigned index) {
+    struct sc_remap_plane_map map = {};
+    map.grid = maps.grid[index].get();
+    if (!map.grid) {
+        const cv::Mat (&host)[2] = maps.host[index];
+        map.map1 = host[0].ptr<int16_t>();
+        map.map1_linesize = (int) host[0].step;
+        map.map2 = host[1].ptr<uint16_t>();
+        map.map2_linesize = (int) host[1].step;
+        if (!maps.spans[index].empty()) {
+            map.spans = maps.spans[index].data();
+        }
+    }
+    return map;
+}
+
+bool sc_video_preprocess_remap_rgb(const struct sc_video_preprocess *vpp,
+                                   const AVFrame *frame,
+                                   enum AVPixelFormat format, AVFrame *rgb,
+                                   struct sc_frame_pool *pool) {
+    assert(frame->format == AV_PIX_FMT_YUV420P);
+    assert(format == AV_PIX_FMT_RGB24 || format == AV_PIX_FMT_BGRA);
+    enum sc_rgb_format rgb_format = format == AV_PIX_FMT_BGRA
+                                  ? SC_RGB_FORMAT_BGRA : SC_RGB_FORMAT_RGB24;
+    int bpp = sc_rgb_format_get_bpp(rgb_format);
+
+    // The host maps are kept whatever the backend
+    std::shared_ptr<const struct sc_remap_state> state = get_state(vpp);
+    const struct sc_remap_maps *maps;
+    const struct sc_remap_maps *preview_maps;
+    if (!get_maps(vpp, *state, frame->width, frame->height, &maps,
+                  &preview_maps)) {
+        return false;
+    }
+
+    if (!sc_frame_pool_get(pool, rgb, format, frame->width, frame->height)) {
+        return false;
+    }
+
+    cv::Mat luma(frame->height, frame->width, CV_8UC1, frame->data[0],
+                 frame->linesize[0]);
+    cv::Rect rects[SC_REMAP_LAYOUT_MAX_VIEWS];
+    split_views(luma, maps->layout, rects);
+
+    // All the views have the same size
+    int views = sc_remap_layout_get_views(&maps->layout);
+    int rows = rects[0].height;
+    int tiles = (rows + SC_REMAP_TILE_ROWS - 1) / SC_REMAP_TILE_ROWS;
+
+    // As in remap_planes_cpu(), all the views are split into tiles of rows
+    // (even), converted in parallel
+    std::atomic<bool> ok(true);
+    cv::parallel_for_(cv::Range(0, views * tiles),
+                      [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; ++i) {
+            unsigned view = i % views;
+            int tile = i / views;
+            int y0 = tile * SC_REMAP_TILE_ROWS;
+            int y1 = std::min(y0 + SC_REMAP_TILE_ROWS, rows);
+
+            const cv::Rect &r = rects[view];
+            // The chroma views are at half the position
+            assert(!(r.x & 1) && !(r.y & 1));
+            const uint8_t *src[3] = {
+                frame->data[0] + (size_t) r.y * frame->linesize[0] + r.x,
+                frame->data[1] + (size_t) (r.y / 2) * frame->linesize[1]
+                               + r.x / 2,
+                frame->data[2] + (size_t) (r.y / 2) * frame->linesize[2]
+                               + r.x / 2,
+            };
+            // The output has the size of the frame
+            uint8_t *dst = rgb->data[0]
+                         + (size_t) (r.y + y0) * rgb->linesize[0]
+                         + (size_t) r.x * bpp;
+
+            struct sc_remap_plane_map luma_map =
+                get_plane_map(*maps, SC_REMAP_LUMA(view));
+            struct sc_remap_plane_map chroma_map =
+                get_plane_map(*maps, SC_REMAP_CHROMA(view));
+            if (!sc_remap_yuv420p_to_rgb(src, frame->linesize, r.width,
+                                         r.height, &luma_map, &chroma_map,
+                                         dst, rgb->linesize[0], r.width, y0,
+                                         y1, rgb_format)) {
+                ok = false;
+            }
+        }
+    }, views * tiles);
+
+    if (!ok) {
+        av_frame_unref(rgb);
+        return false;
+    }
+
+    av_frame_copy_props(rgb, frame);
+    return true;
+}
+
+float *sc_video_preprocess_get_gpu_map(const struct sc_video_preprocess *vpp,
+                                       int width, int height) {
+    std::shared_ptr<const struct sc_remap_state> state = get_state(vpp);
+
+    const struct sc_remap_maps *full_maps;
+    const struct sc_remap_maps *preview_maps;
+    if (!get_maps(vpp, *state, width, height, &full_maps, &preview_maps)) {
+        return NULL;
+    }
+
+    const struct sc_remap_layout &layout = full_maps->layout;
+    cv::Size size = get_map_size(*full_maps, SC_REMAP_LUMA(0));
+    int w = layout.cols * size.width;
+    int h = layout.rows * size.height;
+    assert(w == width && h == height);
+    float *map = (float *) malloc((size_t) w * h * 2 * sizeof(float));
+    if (!map) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    unsigned views = sc_remap_layout_get_views(&layout);
+    for (unsigned v = 0; v < views; ++v) {
+        // Back to float coordinates (exact, up to the fixed-point precision)
+        cv::Mat view, unused;
+        cv::Mat map1, map2;
+        get_dense_maps(*full_maps, SC_REMAP_LUMA(v), 0, size.height, map1,
+                       map2);
+        cv::convertMaps(map1, map2, view, unused, CV_32FC2);
+
+        // The source coordinates of each view are shifted to its position
+        // in the whole frame
+        int x0 = (v % layout.cols) * size.width;
+        int y0 = (v / layout.cols) * size.height;
+        for (int y = 0; y < size.height; ++y) {
+            const cv::Vec2f *src = view.ptr<cv::Vec2f>(y);
+            float *row = map + ((size_t) (y0 + y) * w + x0) * 2;
+            for (int x = 0; x < size.width; ++x) {
+                row[2 * x] = src[x][0] + x0;
+                row[2 * x + 1] = src[x][1] + y0;
+            }
+        }
+    }
+
+    return map;
+}
+
+// Matching block size (odd), at the map resolution
+#define SC_DEPTH_BLOCK_SIZE 5
+
+static cv::Ptr<cv::StereoSGBM>
+create_stereo_matcher(void) {
+    int block = SC_DEPTH_BLOCK_SIZE;
+    // Usual smoothness penalties for a single channel
+    int p1 = 8 * block * block;
+    int p2 = 32 * block * block;
+    return cv::StereoSGBM::create(0, SC_VIDEO_PREPROCESS_DEPTH_DISPARITIES,
+                                  block, p1, p2, 1, 0, 10, 100, 1,
+                                  cv::StereoSGBM::MODE_SGBM_3WAY);
+}
+
+bool sc_video_preprocess_compute_depth(const AVFrame *frame,
+                                       unsigned skip_rows, AVFrame *depth,
+                                       struct sc_frame_pool *pool) {
+    assert((int) skip_rows < frame->height);
+
+    int half_width = frame->width / 2;
+    int height = frame->height - (int) skip_rows;
+    int width = half_width / SC_VIDEO_PREPROCESS_DEPTH_SCALE;
+    int depth_height = height / SC_VIDEO_PREPROCESS_DEPTH_SCALE;
+    if (width <= SC_VIDEO_PREPROCESS_DEPTH_DISPARITIES || !depth_height) {
+        // Too small to be matched
+        return false;
+    }
+
+    // Reused across the frames of the processor thread, to avoid an
+    // allocation per frame
+    static thread_local cv::Ptr<cv::StereoSGBM> matcher;
+    static thread_local cv::Mat small_left;
+    static thread_local cv::Mat small_right;
+    if (!matcher) {
+        matcher = create_stereo_matcher();
+    }
+
+    // Wrap the eyes of the luma plane (no copy)
+    cv::Mat y(frame->height, frame->width, CV_8UC1, frame->data[0],
+              frame->linesize[0]);
+    cv::Mat left = y(cv::Rect(0, skip_rows, half_width, height));
+    cv::Mat right = y(cv::Rect(half_width, skip_rows, half_width, height));
+
+    cv::Size size(width, depth_height);
+    cv::resize(left, small_left, size, 0, 0, cv::INTER_AREA);
+    cv::resize(right, small_right, size, 0, 0, cv::INTER_AREA);
+
+    if (!sc_frame_pool_get(pool, depth, AV_PIX_FMT_GRAY16, width,
+                           depth_height)) {
+        return false;
+    }
+
+    // The matcher writes directly into the pooled frame, the wrapper having
+    // the size and type of its output
+    cv::Mat disparity(depth_height, width, CV_16SC1, depth->data[0],
+                      depth->linesize[0]);
+    matcher->compute(small_left, small_right, disparity);
+    assert(disparity.data == depth->data[0]);
+
+    av_frame_copy_props(depth, frame);
+    return true;
+}
+
+bool sc_video_preprocess_extract_features(const AVFrame *frame,
+                                          unsigned skip_rows,
+                                          struct sc_video_features *features) {
+    assert((int) skip_rows < frame->height);
+
+    int half_width = frame->width / 2;
+    int height = frame->height - (int) skip_rows;
+
+    // One detector per eye, reused across the frames of the calling thread
+    // (the eyes are processed concurrently)
+    static thread_local cv::Ptr<cv::ORB> detectors[2];
+    static thread_local cv::Mat descriptors[2];
+    static thread_local std::vector<cv::KeyPoint> keypoints[2];
+    if (!detectors[0]) {
+        for (unsigned i = 0; i < 2; ++i) {
+            detectors[i] =
+                cv::ORB::create(SC_VIDEO_PREPROCESS_FEATURES_MAX, 1.2f, 8, 31,
+                                0, 2, cv::ORB::HARRIS_SCORE, 31, 20);
+        }
+    }
+
+    // Wrap the eyes of the luma plane (no copy)
+    cv::Mat y(frame->height, frame->width, CV_8UC1, frame->data[0],
+              frame->linesize[0]);
+    const cv::Mat eyes[2] = {
+        y(cv::Rect(0, skip_rows, half_width, height)),
+        y(cv::Rect(half_width, skip_rows, half_width, height)),
+    };
+
+    cv::parallel_for_(cv::Range(0, 2), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; ++i) {
+            detectors[i]->detectAndCompute(eyes[i], cv::noArray(),
+                                           keypoints[i], descriptors[i]);
+        }
+    });
+
+    features->eye_width = half_width;
+    features->eye_height = height;
+    for (unsigned i = 0; i < 2; ++i) {
+        // The detector keeps the strongest keypoints, their descriptors are
+        // the rows of the matrix, in the same order
+        size_t count = std::min(keypoints[i].size(),
+                                (size_t) SC_VIDEO_PREPROCESS_FEATURES_MAX);
+        assert(!count
+            || (descriptors[i].type() == CV_8UC1
+                && descriptors[i].cols == SC_VIDEO_PREPROCESS_DESCRIPTOR_SIZE
+                && (size_t) descriptors[i].rows >= count));
+        for (size_t k = 0; k < count; ++k) {
+            const cv::KeyPoint &kp = keypoints[i][k];
+            struct frame_keypoint *out = &features->keypoints[i][k];
+            out->x = kp.pt.x;
+            out->y = kp.pt.y;
+            out->size = kp.size;
+            out->angle = kp.angle;
+            out->response = kp.response;
+            out->octave = kp.octave;
+            memcpy(features->descriptors[i][k], descriptors[i].ptr((int) k),
+                   SC_VIDEO_PREPROCESS_DESCRIPTOR_SIZE);
+        }
+        features->counts[i] = (unsigned) count;
+    }
+
+    return true;
+}
@@ -5,10 +5,247 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
 #include <libavcodec/avcodec.h>
 
+#include "frame_header.h"
+#include "options.h"
+#include "remap_layout.h"
+
+struct sc_frame_pool;
+
+// The remap maps of the views (at full and preview resolution) and the backend
+// applying them, shared by all the users of the same calibration
+struct sc_video_preprocess;
+
+// Height of the timestamps bar added above the frames
+#define SC_VIDEO_PREPROCESS_TEXT_HEIGHT 60
+
+// Downscale factor of the disparity maps (see
+// sc_video_preprocess_compute_depth())
+#define SC_VIDEO_PREPROCESS_DEPTH_SCALE 4
+// Number of disparities searched, at the map resolution (a multiple of 16)
+#define SC_VIDEO_PREPROCESS_DEPTH_DISPARITIES 64
+
+// Maximum number of features extracted per eye (see
+// sc_video_preprocess_extract_features())
+#define SC_VIDEO_PREPROCESS_FEATURES_MAX 500
+// Size of the ORB descriptors, in bytes
+#define SC_VIDEO_PREPROCESS_DESCRIPTOR_SIZE 32
+
+// The features extracted from the eyes of a frame, left then right
+struct sc_video_features {
+    int eye_width;
+    int eye_height;
+    unsigned counts[2];
+    struct frame_keypoint keypoints[2][SC_VIDEO_PREPROCESS_FEATURES_MAX];
+    uint8_t descriptors[2][SC_VIDEO_PREPROCESS_FEATURES_MAX]
+                       [SC_VIDEO_PREPROCESS_DESCRIPTOR_SIZE];
+};
+
+// Set the number of threads running the effects (0 for one thread per CPU
+// core)
+//
+// This must be called once, before any effect is applied. The threads are
+// shared by all the video processors.
+void sc_video_preprocess_set_threads(unsigned count);
+
+// Select the device running the remap, then load and validate the maps
+//
+// `map_path` contains either the dense maps (leftMapX, leftMapY, rightMapX and
+// rightMapY), or the camera parameters of a stereo fisheye calibration
+// (image_width, image_height, K1, D1, K2, D2, R and T), from which the maps
+// are computed.
+//
+// The frames may also contain a single view (mapX and mapY, or only K1 and D1,
+// for example a single camera captured by --video-source=camera), or several
+// views arranged as declared by a "layout" node (see remap_layout.h), each
+// view being remapped by its own maps.
+//
+// It may be called from any thread, for example during the server connection.
+// With the OpenCL or CUDA backend, the maps are uploaded once to the device,
+// and each plane is uploaded and downloaded once per frame.
+//
+// If `preview_scale` is greater than 1, the maps remapping the frames directly
+// to the preview resolution (downscaled by `preview_scale`) are also computed
+// (see apply_video_effects_preview()).
+//
+// The maps are only read afterwards (except by sc_video_preprocess_reload()),
+// so they may be used concurrently by several processors (and displays) until
+// sc_video_preprocess_destroy().
+//
+// Return NULL if the backend is not available or if the maps could not be
+// loaded.
+struct sc_video_preprocess *
+sc_video_preprocess_new(const char *map_path, enum sc_opencv_backend backend,
+                        unsigned preview_scale);
+
+void sc_video_preprocess_destroy(struct sc_video_preprocess *vpp);
+
+// Reload the maps from `map_path` (typically the same file, after a new
+// calibration), with the backend and the preview scale of `vpp`
+//
+// The maps are loaded by the calling thread (this may take a while), then
+// swapped between frames: the frames being processed keep the previous maps,
+// no frame is dropped.
+//
+// Return false (keeping the current maps) if the new maps could not be
+// loaded.
+bool sc_video_preprocess_reload(struct sc_video_preprocess *vpp,
+                                const char *map_path);
+
+// Number of successful reloads, to detect that the maps have changed (for
+// example to upload them again to the GPU)
+unsigned sc_video_preprocess_get_generation(
+        const struct sc_video_preprocess *vpp);
+
+// Also export the full resolution frames remapped by the cuda backend, without
+// leaving the GPU, in a ring of CUDA IPC memory handles whose metadata is in
+// the shared memory `name` (see cuda_ipc_ring.h)
+//
+// This must be called once, before any effect is applied. The exported frames
+// are published by sc_video_preprocess_publish_cuda_ipc().
+//
+// Return false if the cuda backend is not selected, if scrcpy is built without
+// the CUDA runtime, or on error.
+bool sc_video_preprocess_set_cuda_ipc_output(struct sc_video_preprocess *vpp,
+                                             const char *name);
+
+// Publish the exported frame `pts` (processed by apply_video_effects()), with
+// its frame number and its timestamp, in output order
+//
+// It is a no-op if the frame has not been exported.
+void sc_video_preprocess_publish_cuda_ipc(
+        const struct sc_video_preprocess *vpp, int64_t pts,
+        uint64_t frame_number, int64_t timestamp_us);
+
+// Get the video size of the calibration, the maps of the views being arranged
+// as in the frames
+void sc_video_preprocess_get_size(const struct sc_video_preprocess *vpp,
+                                  unsigned *width, unsigned *height);
+
+// Get the arrangement of the views in the frames (2x1 for a stereo pair side
+// by side)
+struct sc_remap_layout
+sc_video_preprocess_get_layout(const struct sc_video_preprocess *vpp);
+
+// Check that the maps may be applied to frames of width x height
+//
+// For another size than the calibration, the maps are scaled, or computed
+// again from the camera parameters (this requires the same aspect ratio, the
+// width being a multiple of 4 and the height even).
+// The scaled maps are computed once per video size, on the first frame of
+// this size (immediately by this function), so that the video size may change
+// during the session (for example if the encoder falls back to a lower
+// resolution).
+bool sc_video_preprocess_check_size(const struct sc_video_preprocess *vpp,
+                                    unsigned width, unsigned height);
+
 // Function to apply video effects to a frame
-void apply_video_effects(AVFrame *frame, const char *map_path, const char *show_text);
+//
+// If `remap` is not NULL, the remap of the views (scaled to the frame size, see
+// sc_video_preprocess_check_size()) is applied directly on the YUV420P planes.
+// If the maps cannot be scaled to the frame size, the frame is left
+// unchanged. The frame buffers are replaced by
+// newly allocated ones, so the input buffers (which may be shared with other
+// references) are never modified. The new buffers are taken from `pool`.
+//
+// If `luma_only` is set, only the Y plane is processed, and the frame is
+// replaced by a GRAY8 frame (the chroma planes are not needed).
+void apply_video_effects(AVFrame *frame,
+                         const struct sc_video_preprocess *remap,
+                         const char *show_text, bool luma_only,
+                         struct sc_frame_pool *pool);
+
+// Produce the preview of a frame, downscaled by `scale`, into `preview` (an
+// empty frame), without modifying `frame`
+//
+// If `remap` is not NULL, the frame is remapped directly to the preview
+// resolution by the preview maps (`scale` must be the `preview_scale` passed to
+// sc_video_preprocess_new()), otherwise it is just resized. The timestamps bar
+// keeps its height.
+//
+// Return false on error.
+bool apply_video_effects_preview(const AVFrame *frame, AVFrame *preview,
+                                 unsigned scale,
+                                 const struct sc_video_preprocess *remap,
+                                 const char *show_text,
+                                 struct sc_frame_pool *pool);
+
+// Get the size of the preview of the frames of width x height (without the
+// timestamps bar), as produced by apply_video_effects_preview()
+//
+// Return false if the preview maps cannot be scaled to the frame size.
+bool sc_video_preprocess_get_preview_size(
+        const struct sc_video_preprocess *remap, unsigned scale, int width,
+        int height, int *preview_width, int *preview_height);
+
+// Rectify a YUV420P frame (by the full resolution maps, as
+// apply_video_effects()) and convert it to packed RGB in a single pass, into
+// `rgb` (an empty frame) from `pool`, of the same size in `format`
+// (AV_PIX_FMT_RGB24 or AV_PIX_FMT_BGRA)
+//
+// For a consumer of RGB frames (e.g. the frames saved as PNG), this replaces
+// apply_video_effects() followed by a conversion: the rectified YUV planes are
+// never written to memory (see sc_remap_yuv420p_to_rgb()). It always runs on
+// the CPU, whatever the backend, the rows in parallel.
+//
+// Return false if the maps cannot be scaled to the frame size, or on error.
+bool sc_video_preprocess_remap_rgb(const struct sc_video_preprocess *vpp,
+                                   const AVFrame *frame,
+                                   enum AVPixelFormat format, AVFrame *rgb,
+                                   struct sc_frame_pool *pool);
+
+// Select how the planes are remapped by the CPU backend: by the vectorized
+// kernel of util/remap.h if the CPU supports it (the default), or always by
+// cv::remap() (for example to compare them in the benchmarks)
+//
+// The results are identical. It applies to the whole process.
+void sc_video_preprocess_set_simd_remap(bool enable);
+
+// Build the map of the whole frame for the GPU remap (see gl_remap.h), for
+// frames of width x height (see sc_video_preprocess_check_size())
+//
+// For each destination pixel, the map contains the source coordinates (x, y)
+// in the whole frame (the map of each view is shifted to its position), as
+// interleaved floats.
+//
+// Return NULL on error. The map must be released by free().
+float *sc_video_preprocess_get_gpu_map(const struct sc_video_preprocess *vpp,
+                                       int width, int height);
+
+// Compute the disparity map of the left eye from a remapped frame (as
+// processed by apply_video_effects()), into `depth` (an empty frame)
+//
+// The luma of both halves (below the `skip_rows` of the timestamps bar, if
+// any) is downscaled by SC_VIDEO_PREPROCESS_DEPTH_SCALE, then matched by
+// semi-global block matching. The map is written directly into a pooled
+// frame (AV_PIX_FMT_GRAY16), as signed 16-bit disparities in 1/16 pixel at the
+// map resolution, negative where unknown (see frame_header.h).
+//
+// The matcher state is per thread, so that several processors may compute
+// their maps in parallel.
+//
+// Return false on error.
+bool sc_video_preprocess_compute_depth(const AVFrame *frame,
+                                       unsigned skip_rows, AVFrame *depth,
+                                       struct sc_frame_pool *pool);
+
+// Extract the features of both eyes of a remapped frame (as processed by
+// apply_video_effects()), into `features`
+//
+// The luma of each eye (below the `skip_rows` of the timestamps bar, if any)
+// is processed by an ORB detector (FAST corners and rBRIEF descriptors,
+// vectorized by OpenCV), both eyes in parallel. At most
+// SC_VIDEO_PREPROCESS_FEATURES_MAX keypoints are kept per eye, the strongest.
+//
+// The detectors are per thread, so that several processors may extract their
+// features in parallel.
+//
+// Return false if the features cannot be extracted (without OpenCV).
+bool sc_video_preprocess_extract_features(const AVFrame *frame,
+                                          unsigned skip_rows,
+                                          struct sc_video_features *features);
 
 #ifdef __cplusplus
 }
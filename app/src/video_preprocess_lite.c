@@ -0,0 +1,1929 @@
+// Implementation of video_preprocess.h without OpenCV (-Dopencv=false)
+//
+// It loads the dense maps of the XML files written by OpenCV (or their .scmap
+// cache, shared with the OpenCV builds), and remaps the planes by the kernel
+// of util/remap.h (view by view, see remap_layout.h), on the calling thread.
+// The camera parameters
+// (--opencv-calib), the disparity maps (--pipe-depth) and the OpenCL and CUDA
+// backends require OpenCV.
+
+#include "video_preprocess.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavutil/frame.h>
+
+#include "frame_pool.h"
+#include "remap_layout.h"
+#include "remap_shm.h"
+#include "util/file.h"
+#include "util/font.h"
+#include "util/log.h"
+#include "util/remap.h"
+#include "util/thread.h"
+#include "util/tick.h"
+
+// Sidecar cache of the converted maps, stored next to the source XML file (same
+// format as video_preprocess.cpp)
+#define SC_REMAP_CACHE_SUFFIX ".scmap"
+#define SC_REMAP_CACHE_MAGIC "SCRMAP\0\0"
+#define SC_REMAP_CACHE_VERSION 2
+#define SC_REMAP_CACHE_ALIGN 64
+// A luma and a chroma map per view
+#define SC_REMAP_MAX_MAPS (2 * SC_REMAP_LAYOUT_MAX_VIEWS)
+
+struct sc_remap_cache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t map_count; // the luma maps of the views, then their chroma maps
+    uint64_t source_hash; // FNV-1a of the source XML file
+    uint32_t layout_cols;
+    uint32_t layout_rows;
+    struct {
+        int32_t cols;
+        int32_t rows;
+    } sizes[SC_REMAP_MAX_MAPS];
+};
+
+// Indices of the maps of the view v in struct sc_remap_maps
+#define SC_REMAP_LUMA(v) (v)
+#define SC_REMAP_CHROMA(v) (SC_REMAP_LAYOUT_MAX_VIEWS + (v))
+
+// Luma value used for the black text bar and for pixels mapped from outside
+// the source image
+#define SC_REMAP_BORDER_LUMA 0
+// Chroma value of a gray pixel
+#define SC_REMAP_BORDER_CHROMA 128
+
+// Fixed-point map of one view (the representation of cv::convertMaps(), see
+// util/remap.h), without padding between the rows
+//
+// Once loaded, the dense maps are replaced by a sparse grid if it reproduces
+// them accurately (map1 and map2 are then NULL).
+struct sc_remap_map {
+    int cols;
+    int rows;
+    int16_t *map1; // (x, y)
+    uint16_t *map2; // (fy << 5 | fx)
+    bool owned; // allocated, rather than pointing to the mapped cache
+    // The spans of the rows of the dense map (NULL if not computed)
+    struct sc_remap_span *spans;
+    struct sc_remap_grid grid; // if grid.xy is not NULL
+};
+
+// The maps remapping the frames to one output resolution
+struct sc_remap_maps {
+    // The views of the frames, each one remapped by its own maps (only the
+    // maps of these views are used)
+    struct sc_remap_layout layout;
+    struct sc_remap_map host[SC_REMAP_MAX_MAPS];
+};
+
+// Float coordinates of one view
+struct sc_float_map {
+    int cols;
+    int rows;
+    float *x;
+    float *y;
+};
+
+// The maps for frames of another size than the calibration
+struct sc_scaled_maps {
+    int width;
+    int height;
+    bool ok; // a failure is also stored, so that it is reported only once
+    struct sc_remap_maps full_maps;
+    struct sc_remap_maps preview_maps; // if preview_scale > 1
+    // The grids point to this shared memory (see remap_shm.h)
+    struct sc_shm shm;
+    bool shared;
+    struct sc_scaled_maps *next;
+};
+
+// The maps loaded from one calibration file, immutable once loaded (except the
+// cache of the scaled maps)
+struct sc_remap_state {
+    atomic_uint refs;
+
+    // The cached maps may point directly to this mapping, so it is unmapped
+    // only once they are released
+    struct sc_file_mapping cache_mapping;
+    bool cache_mapped;
+    struct sc_remap_maps full_maps; // stored in the cache
+    struct sc_remap_maps preview_maps; // if preview_scale > 1
+    uint64_t source_hash; // of the calibration file
+    // The grids point to this shared memory (see remap_shm.h)
+    struct sc_shm shm;
+    bool shared;
+
+    // Derived from full_maps on first use, by frame size. The entries are
+    // never removed, so they may be used without holding the mutex.
+    sc_mutex scaled_mutex;
+    struct sc_scaled_maps *scaled;
+};
+
+struct sc_video_preprocess {
+    unsigned preview_scale;
+
+    // Replaced on reload: each frame is processed with the state taken at its
+    // start, which is released once the last frame using it is processed
+    sc_mutex mutex;
+    struct sc_remap_state *state;
+    atomic_uint generation; // incremented on each reload
+};
+
+static void
+free_maps(struct sc_remap_maps *maps) {
+    for (unsigned i = 0; i < SC_REMAP_MAX_MAPS; ++i) {
+        struct sc_remap_map *map = &maps->host[i];
+        if (map->owned) {
+            free(map->map1);
+            free(map->map2);
+        }
+        free(map->spans);
+        sc_remap_grid_destroy(&map->grid);
+        memset(map, 0, sizeof(*map));
+    }
+}
+
+static void
+release_state(struct sc_remap_state *state) {
+    if (atomic_fetch_sub_explicit(&state->refs, 1, memory_order_acq_rel) > 1) {
+        return;
+    }
+
+    struct sc_scaled_maps *scaled = state->scaled;
+    while (scaled) {
+        struct sc_scaled_maps *next = scaled->next;
+        free_maps(&scaled->full_maps);
+        free_maps(&scaled->preview_maps);
+        if (scaled->shared) {
+            sc_shm_close(&scaled->shm);
+        }
+        free(scaled);
+        scaled = next;
+    }
+    sc_mutex_destroy(&state->scaled_mutex);
+
+    // The full maps may point to the mapped cache, release them first
+    free_maps(&state->full_maps);
+    free_maps(&state->preview_maps);
+    if (state->shared) {
+        sc_shm_close(&state->shm);
+    }
+    if (state->cache_mapped) {
+        sc_file_unmap(&state->cache_mapping);
+    }
+    free(state);
+}
+
+static struct sc_remap_state *
+get_state(const struct sc_video_preprocess *vpp) {
+    // The mutex is not part of the logical state
+    sc_mutex *mutex = (sc_mutex *) &vpp->mutex;
+    sc_mutex_lock(mutex);
+    struct sc_remap_state *state = vpp->state;
+    atomic_fetch_add_explicit(&state->refs, 1, memory_order_relaxed);
+    sc_mutex_unlock(mutex);
+    return state;
+}
+
+static uint64_t
+hash_data(const void *data, size_t size) {
+    // 64-bit FNV-1a
+    const uint8_t *p = data;
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= p[i];
+        hash *= UINT64_C(0x100000001b3);
+    }
+    return hash;
+}
+
+static size_t
+align_offset(size_t offset) {
+    return (offset + SC_REMAP_CACHE_ALIGN - 1)
+         & ~(size_t) (SC_REMAP_CACHE_ALIGN - 1);
+}
+
+static size_t
+map1_size(int cols, int rows) {
+    return (size_t) cols * rows * 2 * sizeof(int16_t);
+}
+
+static size_t
+map2_size(int cols, int rows) {
+    return (size_t) cols * rows * sizeof(uint16_t);
+}
+
+// Number of maps used by the layout
+static unsigned
+get_map_count(const struct sc_remap_layout *layout) {
+    return 2 * sc_remap_layout_get_views(layout);
+}
+
+// Index in struct sc_remap_maps of the i-th map used by the layout: the luma
+// maps of the views, then their chroma maps (the order of the cache)
+static unsigned
+get_map_index(const struct sc_remap_layout *layout, unsigned i) {
+    unsigned views = sc_remap_layout_get_views(layout);
+    return i < views ? SC_REMAP_LUMA(i) : SC_REMAP_CHROMA(i - views);
+}
+
+static bool
+is_chroma_map(unsigned index) {
+    return index >= SC_REMAP_CHROMA(0);
+}
+
+static bool
+load_maps_from_cache(struct sc_remap_state *state, const char *cache_path,
+                     uint64_t source_hash) {
+    if (!sc_file_map(cache_path, &state->cache_mapping)) {
+        return false;
+    }
+
+    const uint8_t *data = state->cache_mapping.data;
+    size_t size = state->cache_mapping.size;
+
+    struct sc_remap_cache_header header;
+    if (size < sizeof(header)) {
+        goto invalid;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, SC_REMAP_CACHE_MAGIC, sizeof(header.magic))
+            || header.version != SC_REMAP_CACHE_VERSION
+            || header.source_hash != source_hash
+            || !header.layout_cols || !header.layout_rows
+            || header.layout_cols * header.layout_rows
+                   > SC_REMAP_LAYOUT_MAX_VIEWS) {
+        goto invalid;
+    }
+    struct sc_remap_layout *layout = &state->full_maps.layout;
+    layout->cols = header.layout_cols;
+    layout->rows = header.layout_rows;
+    if (header.map_count != get_map_count(layout)) {
+        goto invalid;
+    }
+
+    size_t offset = align_offset(sizeof(header));
+    for (unsigned i = 0; i < header.map_count; ++i) {
+        int cols = header.sizes[i].cols;
+        int rows = header.sizes[i].rows;
+        if (cols <= 0 || rows <= 0) {
+            goto invalid;
+        }
+
+        size_t size1 = map1_size(cols, rows);
+        size_t size2 = map2_size(cols, rows);
+        size_t offset2 = align_offset(offset + size1);
+        if (offset2 + size2 > size) {
+            goto invalid;
+        }
+
+        // No copy: the maps point to the mapped file (they are only read)
+        struct sc_remap_map *map =
+            &state->full_maps.host[get_map_index(layout, i)];
+        map->cols = cols;
+        map->rows = rows;
+        map->map1 = (int16_t *) (data + offset);
+        map->map2 = (uint16_t *) (data + offset2);
+        map->owned = false;
+
+        offset = align_offset(offset2 + size2);
+    }
+
+    state->cache_mapped = true;
+    return true;
+
+invalid:
+    LOGW("Ignoring invalid or outdated remap cache: %s", cache_path);
+    free_maps(&state->full_maps);
+    sc_file_unmap(&state->cache_mapping);
+    return false;
+}
+
+static bool
+write_padding(FILE *file, size_t *offset) {
+    static const uint8_t zeros[SC_REMAP_CACHE_ALIGN] = {0};
+    size_t aligned = align_offset(*offset);
+    size_t len = aligned - *offset;
+    if (len && fwrite(zeros, 1, len, file) != len) {
+        return false;
+    }
+    *offset = aligned;
+    return true;
+}
+
+static bool
+write_chunk(FILE *file, const void *data, size_t len, size_t *offset) {
+    if (!write_padding(file, offset) || fwrite(data, 1, len, file) != len) {
+        return false;
+    }
+    *offset += len;
+    return true;
+}
+
+static bool
+write_maps_to_file(FILE *file, const struct sc_remap_maps *maps,
+                   uint64_t source_hash) {
+    struct sc_remap_cache_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SC_REMAP_CACHE_MAGIC, sizeof(header.magic));
+    header.version = SC_REMAP_CACHE_VERSION;
+    header.map_count = get_map_count(&maps->layout);
+    header.source_hash = source_hash;
+    header.layout_cols = maps->layout.cols;
+    header.layout_rows = maps->layout.rows;
+    for (unsigned i = 0; i < header.map_count; ++i) {
+        const struct sc_remap_map *map =
+            &maps->host[get_map_index(&maps->layout, i)];
+        header.sizes[i].cols = map->cols;
+        header.sizes[i].rows = map->rows;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        return false;
+    }
+    size_t offset = sizeof(header);
+
+    for (unsigned i = 0; i < header.map_count; ++i) {
+        const struct sc_remap_map *map =
+            &maps->host[get_map_index(&maps->layout, i)];
+        if (!write_chunk(file, map->map1, map1_size(map->cols, map->rows),
+                         &offset)
+                || !write_chunk(file, map->map2,
+                                map2_size(map->cols, map->rows), &offset)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void
+write_maps_to_cache(const struct sc_remap_maps *maps, const char *cache_path,
+                    uint64_t source_hash) {
+    // Write to a temporary file first, so that an interrupted write never
+    // leaves a truncated cache
+    char *tmp_path;
+    if (asprintf(&tmp_path, "%s.tmp", cache_path) == -1) {
+        LOG_OOM();
+        return;
+    }
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        LOGW("Could not create remap cache: %s", tmp_path);
+        free(tmp_path);
+        return;
+    }
+
+    bool ok = write_maps_to_file(file, maps, source_hash);
+    ok &= !fclose(file);
+    if (!ok) {
+        LOGW("Could not write remap cache: %s", tmp_path);
+        remove(tmp_path);
+        free(tmp_path);
+        return;
+    }
+
+#ifdef _WIN32
+    // rename() does not replace an existing file on Windows
+    remove(cache_path);
+#endif
+    if (rename(tmp_path, cache_path)) {
+        LOGW("Could not rename remap cache: %s", cache_path);
+        remove(tmp_path);
+        free(tmp_path);
+        return;
+    }
+
+    free(tmp_path);
+    LOGI("Remap cache written: %s", cache_path);
+}
+
+static bool
+float_map_init(struct sc_float_map *map, int cols, int rows) {
+    size_t count = (size_t) cols * rows;
+    map->cols = cols;
+    map->rows = rows;
+    map->x = malloc(count * sizeof(float));
+    map->y = malloc(count * sizeof(float));
+    if (!map->x || !map->y) {
+        LOG_OOM();
+        free(map->x);
+        free(map->y);
+        return false;
+    }
+    return true;
+}
+
+static void
+float_map_destroy(struct sc_float_map *map) {
+    free(map->x);
+    free(map->y);
+}
+
+// Convert float coordinates to the fixed-point representation, like
+// cv::convertMaps() to CV_16SC2 (rounded to the nearest 1/32 pixel)
+static bool
+convert_map(const struct sc_float_map *fmap, struct sc_remap_map *map) {
+    size_t count = (size_t) fmap->cols * fmap->rows;
+    map->cols = fmap->cols;
+    map->rows = fmap->rows;
+    map->map1 = malloc(count * 2 * sizeof(int16_t));
+    map->map2 = malloc(count * sizeof(uint16_t));
+    map->owned = true;
+    if (!map->map1 || !map->map2) {
+        LOG_OOM();
+        return false;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        // Saturated to the int16_t range, like cv::convertMaps()
+        float x = fminf(fmaxf(fmap->x[i], INT16_MIN), INT16_MAX);
+        float y = fminf(fmaxf(fmap->y[i], INT16_MIN), INT16_MAX);
+        long ix = lrintf(x * 32);
+        long iy = lrintf(y * 32);
+        map->map1[2 * i] = (int16_t) (ix >> 5);
+        map->map1[2 * i + 1] = (int16_t) (iy >> 5);
+        map->map2[i] = (uint16_t) ((iy & 31) << 5 | (ix & 31));
+    }
+
+    return true;
+}
+
+// Get the fixed-point coordinates of the row y of the map, expanded into
+// xy_buf and frac_buf (of map->cols pixels) if it is stored as a grid
+static void
+get_map_row(const struct sc_remap_map *map, int y, int16_t *xy_buf,
+            uint16_t *frac_buf, const int16_t **xy, const uint16_t **frac) {
+    if (map->grid.xy) {
+        sc_remap_grid_get_row(&map->grid, y, 0, map->cols, xy_buf, frac_buf);
+        *xy = xy_buf;
+        *frac = frac_buf;
+    } else {
+        *xy = map->map1 + (size_t) y * map->cols * 2;
+        *frac = map->map2 + (size_t) y * map->cols;
+    }
+}
+
+// Back to float coordinates (exact, up to the fixed-point precision)
+static bool
+unconvert_map(const struct sc_remap_map *map, struct sc_float_map *fmap) {
+    int16_t *xy_buf = malloc((size_t) map->cols * 2 * sizeof(*xy_buf));
+    uint16_t *frac_buf = malloc((size_t) map->cols * sizeof(*frac_buf));
+    if (!xy_buf || !frac_buf) {
+        LOG_OOM();
+        free(xy_buf);
+        free(frac_buf);
+        return false;
+    }
+
+    if (!float_map_init(fmap, map->cols, map->rows)) {
+        free(xy_buf);
+        free(frac_buf);
+        return false;
+    }
+
+    for (int y = 0; y < map->rows; ++y) {
+        const int16_t *xy;
+        const uint16_t *frac;
+        get_map_row(map, y, xy_buf, frac_buf, &xy, &frac);
+        size_t offset = (size_t) y * map->cols;
+        for (int x = 0; x < map->cols; ++x) {
+            fmap->x[offset + x] = xy[2 * x] + (frac[x] & 31) / 32.f;
+            fmap->y[offset + x] = xy[2 * x + 1] + (frac[x] >> 5) / 32.f;
+        }
+    }
+
+    free(xy_buf);
+    free(frac_buf);
+    return true;
+}
+
+// Downscale by averaging the covered pixels (like cv::INTER_AREA for integer
+// factors, approximated otherwise)
+static void
+resize_area_f32(const float *src, int src_cols, int src_rows, float *dst,
+                int cols, int rows) {
+    for (int y = 0; y < rows; ++y) {
+        int y0 = (int) ((int64_t) y * src_rows / rows);
+        // At least one source row (for a ratio slightly below 1)
+        int y1 = MAX(y0 + 1, (int) ((int64_t) (y + 1) * src_rows / rows));
+        for (int x = 0; x < cols; ++x) {
+            int x0 = (int) ((int64_t) x * src_cols / cols);
+            int x1 = MAX(x0 + 1, (int) ((int64_t) (x + 1) * src_cols / cols));
+            double sum = 0;
+            for (int sy = y0; sy < y1; ++sy) {
+                for (int sx = x0; sx < x1; ++sx) {
+                    sum += src[(size_t) sy * src_cols + sx];
+                }
+            }
+            dst[(size_t) y * cols + x] = sum / ((y1 - y0) * (x1 - x0));
+        }
+    }
+}
+
+static void
+resize_area_u8(const uint8_t *src, int src_linesize, int src_cols,
+               int src_rows, uint8_t *dst, int dst_linesize, int cols,
+               int rows) {
+    for (int y = 0; y < rows; ++y) {
+        int y0 = (int) ((int64_t) y * src_rows / rows);
+        // At least one source row (for a ratio slightly below 1)
+        int y1 = MAX(y0 + 1, (int) ((int64_t) (y + 1) * src_rows / rows));
+        for (int x = 0; x < cols; ++x) {
+            int x0 = (int) ((int64_t) x * src_cols / cols);
+            int x1 = MAX(x0 + 1, (int) ((int64_t) (x + 1) * src_cols / cols));
+            unsigned area = (y1 - y0) * (x1 - x0);
+            unsigned sum = 0;
+            for (int sy = y0; sy < y1; ++sy) {
+                const uint8_t *row = src + (size_t) sy * src_linesize;
+                for (int sx = x0; sx < x1; ++sx) {
+                    sum += row[sx];
+                }
+            }
+            dst[(size_t) y * dst_linesize + x] = (sum + area / 2) / area;
+        }
+    }
+}
+
+// Upscale by bilinear interpolation, the pixel centers being aligned (like
+// cv::INTER_LINEAR)
+static void
+resize_linear_f32(const float *src, int src_cols, int src_rows, float *dst,
+                  int cols, int rows) {
+    double fx = (double) src_cols / cols;
+    double fy = (double) src_rows / rows;
+    for (int y = 0; y < rows; ++y) {
+        double sy = fmin(fmax((y + 0.5) * fy - 0.5, 0), src_rows - 1);
+        int y0 = (int) sy;
+        int y1 = y0 + (y0 < src_rows - 1);
+        double wy = sy - y0;
+        const float *row0 = src + (size_t) y0 * src_cols;
+        const float *row1 = src + (size_t) y1 * src_cols;
+        for (int x = 0; x < cols; ++x) {
+            double sx = fmin(fmax((x + 0.5) * fx - 0.5, 0), src_cols - 1);
+            int x0 = (int) sx;
+            int x1 = x0 + (x0 < src_cols - 1);
+            double wx = sx - x0;
+            double top = row0[x0] * (1 - wx) + row0[x1] * wx;
+            double bottom = row1[x0] * (1 - wx) + row1[x1] * wx;
+            dst[(size_t) y * cols + x] = top * (1 - wy) + bottom * wy;
+        }
+    }
+}
+
+static bool
+compute_chroma_map(const struct sc_float_map *luma,
+                   struct sc_float_map *chroma) {
+    // Each chroma sample covers a 2x2 block of luma samples: average the luma
+    // coordinates over the block, then convert them to the chroma sampling
+    // grid (the chroma sample i is centered on the luma coordinate 2*i+0.5)
+    int cols = luma->cols / 2;
+    int rows = luma->rows / 2;
+    if (!float_map_init(chroma, cols, rows)) {
+        return false;
+    }
+
+    resize_area_f32(luma->x, luma->cols, luma->rows, chroma->x, cols, rows);
+    resize_area_f32(luma->y, luma->cols, luma->rows, chroma->y, cols, rows);
+    size_t count = (size_t) cols * rows;
+    for (size_t i = 0; i < count; ++i) {
+        chroma->x[i] = chroma->x[i] * 0.5 - 0.25;
+        chroma->y[i] = chroma->y[i] * 0.5 - 0.25;
+    }
+    return true;
+}
+
+// Convert the luma maps (as floats) of the views of `layout` to the
+// fixed-point luma and chroma maps
+static bool
+convert_view_maps(const struct sc_remap_layout *layout,
+                  const struct sc_float_map views[],
+                  struct sc_remap_maps *maps) {
+    maps->layout = *layout;
+    unsigned count = sc_remap_layout_get_views(layout);
+    for (unsigned v = 0; v < count; ++v) {
+        struct sc_float_map chroma_map;
+        if (!compute_chroma_map(&views[v], &chroma_map)) {
+            return false;
+        }
+
+        bool ok = convert_map(&views[v], &maps->host[SC_REMAP_LUMA(v)])
+               && convert_map(&chroma_map, &maps->host[SC_REMAP_CHROMA(v)]);
+        float_map_destroy(&chroma_map);
+        if (!ok) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Find the content of the element <name ...> of an OpenCV XML file
+//
+// Return NULL if it is not found.
+static const char *
+find_element(const char *xml, const char *name, const char **end) {
+    size_t len = strlen(name);
+    const char *p = xml;
+    while ((p = strchr(p, '<'))) {
+        ++p;
+        if (!strncmp(p, name, len) && (p[len] == '>' || p[len] == ' '
+                                       || p[len] == '\t' || p[len] == '\r'
+                                       || p[len] == '\n')) {
+            const char *content = strchr(p + len, '>');
+            if (!content) {
+                return NULL;
+            }
+            ++content;
+
+            // The matrices are not nested: the first closing tag matches
+            const char *close = content;
+            while ((close = strstr(close, "</"))) {
+                if (!strncmp(close + 2, name, len) && close[2 + len] == '>') {
+                    *end = close;
+                    return content;
+                }
+                close += 2;
+            }
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+static bool
+read_int_element(const char *xml, const char *xml_end, const char *name,
+                 long *value) {
+    const char *end;
+    const char *content = find_element(xml, name, &end);
+    if (!content || end > xml_end) {
+        return false;
+    }
+    char *parsed;
+    *value = strtol(content, &parsed, 10);
+    return parsed != content && parsed <= end;
+}
+
+// Read a single-channel matrix (<name type_id="opencv-matrix">) of an OpenCV
+// XML file, as floats
+static bool
+read_xml_map(const char *xml, const char *name, float **data, int *cols,
+             int *rows, const char *path) {
+    const char *end;
+    const char *content = find_element(xml, name, &end);
+    if (!content) {
+        LOGE("Missing %s in: %s", name, path);
+        return false;
+    }
+
+    long r;
+    long c;
+    if (!read_int_element(content, end, "rows", &r)
+            || !read_int_element(content, end, "cols", &c)
+            || r <= 0 || c <= 0 || r > INT16_MAX || c > INT16_MAX) {
+        LOGE("Invalid size of %s in: %s", name, path);
+        return false;
+    }
+
+    // The type is a single character for a single channel ("f", "d", "u"...)
+    const char *dt_end;
+    const char *dt = find_element(content, "dt", &dt_end);
+    while (dt && dt < dt_end && (*dt == ' ' || *dt == '\n' || *dt == '\r')) {
+        ++dt;
+    }
+    if (!dt || dt_end > end || dt + 1 > dt_end
+            || (dt + 1 < dt_end && dt[1] != ' ' && dt[1] != '\n'
+                && dt[1] != '\r')
+            || !strchr("ucwsifd", *dt)) {
+        LOGE("%s must be a single-channel matrix: %s", name, path);
+        return false;
+    }
+
+    const char *data_end;
+    const char *p = find_element(content, "data", &data_end);
+    if (!p || data_end > end) {
+        LOGE("Missing data of %s in: %s", name, path);
+        return false;
+    }
+
+    size_t count = (size_t) r * c;
+    float *values = malloc(count * sizeof(float));
+    if (!values) {
+        LOG_OOM();
+        return false;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        char *parsed;
+        double value = strtod(p, &parsed);
+        if (parsed == p || parsed > data_end) {
+            LOGE("Truncated data of %s in: %s", name, path);
+            free(values);
+            return false;
+        }
+        values[i] = value;
+        p = parsed;
+    }
+
+    *data = values;
+    *cols = c;
+    *rows = r;
+    return true;
+}
+
+// Read the layout of the views from the optional "layout" element, or
+// recognize it by the names of the maps
+static bool
+read_layout(const char *xml, struct sc_remap_layout *layout,
+            const char *map_path) {
+    const char *end;
+    const char *content = find_element(xml, "layout", &end);
+    if (content) {
+        if (!sc_remap_layout_parse(content, end - content, layout)) {
+            LOGE("Invalid layout \"%.*s\" (expected mono, side-by-side, "
+                 "top-bottom or <cols>x<rows>, up to %d views) in: %s",
+                 (int) (end - content), content, SC_REMAP_LAYOUT_MAX_VIEWS,
+                 map_path);
+            return false;
+        }
+        return true;
+    }
+
+    static const struct sc_remap_layout layouts[] = {{1, 1}, {1, 2}};
+    for (unsigned i = 0; i < ARRAY_LEN(layouts); ++i) {
+        char name[32];
+        sc_remap_layout_get_map_name(&layouts[i], 0, 'X', name, sizeof(name));
+        if (find_element(xml, name, &end)) {
+            *layout = layouts[i];
+            return true;
+        }
+    }
+
+    // Both eyes side by side (leftMapX...)
+    *layout = (struct sc_remap_layout) {2, 1};
+    return true;
+}
+
+static bool
+load_maps_from_xml(struct sc_remap_maps *full_maps, const char *xml,
+                   const char *map_path) {
+    if (!strstr(xml, "<opencv_storage>")) {
+        LOGE("Only the XML maps may be loaded without OpenCV: %s", map_path);
+        return false;
+    }
+
+    const char *end;
+    if (find_element(xml, "K1", &end)) {
+        LOGE("The camera parameters (--opencv-calib) require OpenCV, provide "
+             "the dense maps (--opencv-map): %s", map_path);
+        return false;
+    }
+
+    struct sc_remap_layout layout;
+    if (!read_layout(xml, &layout, map_path)) {
+        return false;
+    }
+
+    unsigned count = sc_remap_layout_get_views(&layout);
+    struct sc_float_map views[SC_REMAP_LAYOUT_MAX_VIEWS];
+    memset(views, 0, sizeof(views));
+    bool ok = true;
+    for (unsigned i = 0; ok && i < count; ++i) {
+        char name_x[32];
+        char name_y[32];
+        sc_remap_layout_get_map_name(&layout, i, 'X', name_x, sizeof(name_x));
+        sc_remap_layout_get_map_name(&layout, i, 'Y', name_y, sizeof(name_y));
+
+        int cols_x, rows_x, cols_y, rows_y;
+        ok = read_xml_map(xml, name_x, &views[i].x, &cols_x, &rows_x,
+                          map_path)
+          && read_xml_map(xml, name_y, &views[i].y, &cols_y, &rows_y,
+                          map_path);
+        if (ok && (cols_x != cols_y || rows_x != rows_y)) {
+            LOGE("The X and Y maps must have the same size: %s", map_path);
+            ok = false;
+        }
+        if (ok) {
+            views[i].cols = cols_x;
+            views[i].rows = rows_x;
+        }
+    }
+
+    // The fixed-point representation is what the remap kernel reads
+    ok = ok && convert_view_maps(&layout, views, full_maps);
+
+    for (unsigned i = 0; i < count; ++i) {
+        float_map_destroy(&views[i]);
+    }
+    return ok;
+}
+
+// Collect the grids of the full maps, then of the preview maps (if
+// scale > 1), of the views of `layout`
+static unsigned
+get_grids(const struct sc_remap_layout *layout,
+          struct sc_remap_maps *full_maps, struct sc_remap_maps *preview_maps,
+          unsigned scale, struct sc_remap_grid *grids[]) {
+    unsigned map_count = get_map_count(layout);
+    unsigned count = 0;
+    for (unsigned i = 0; i < map_count; ++i) {
+        grids[count++] = &full_maps->host[get_map_index(layout, i)].grid;
+    }
+    if (scale > 1) {
+        for (unsigned i = 0; i < map_count; ++i) {
+            grids[count++] = &preview_maps->host[get_map_index(layout, i)].grid;
+        }
+    }
+    return count;
+}
+
+// Use the grids (of the views of `layout`) published by another process, if
+// any
+static bool
+attach_maps(struct sc_shm *shm, const struct sc_remap_shm_key *key,
+            const struct sc_remap_layout *layout,
+            struct sc_remap_maps *full_maps,
+            struct sc_remap_maps *preview_maps, unsigned scale) {
+    struct sc_remap_grid *grids[SC_REMAP_SHM_MAX_GRIDS];
+    unsigned count = get_grids(layout, full_maps, preview_maps, scale, grids);
+    if (!sc_remap_shm_attach(shm, key, grids, count)) {
+        return false;
+    }
+
+    full_maps->layout = *layout;
+    preview_maps->layout = *layout;
+    unsigned map_count = get_map_count(layout);
+    for (unsigned i = 0; i < map_count; ++i) {
+        unsigned index = get_map_index(layout, i);
+        struct sc_remap_map *map = &full_maps->host[index];
+        // The dense maps (of the mapped cache, if any) are not used anymore
+        map->map1 = NULL;
+        map->map2 = NULL;
+        map->cols = map->grid.width;
+        map->rows = map->grid.height;
+        // The full maps remap frames of their own size
+        sc_remap_grid_init_spans(&map->grid, map->cols, map->rows);
+        if (scale > 1) {
+            int src_cols = map->cols;
+            int src_rows = map->rows;
+            map = &preview_maps->host[index];
+            map->cols = map->grid.width;
+            map->rows = map->grid.height;
+            sc_remap_grid_init_spans(&map->grid, src_cols, src_rows);
+        }
+    }
+    return true;
+}
+
+// Publish the grids for the next processes, if all the maps are grids (the
+// dense calibration maps are already shared through the mapped cache)
+static bool
+publish_maps(struct sc_shm *shm, const struct sc_remap_shm_key *key,
+             struct sc_remap_maps *full_maps,
+             struct sc_remap_maps *preview_maps, unsigned scale) {
+    struct sc_remap_grid *grids[SC_REMAP_SHM_MAX_GRIDS];
+    unsigned count = get_grids(&full_maps->layout, full_maps, preview_maps,
+                               scale, grids);
+    for (unsigned i = 0; i < count; ++i) {
+        if (!grids[i]->xy) {
+            return false;
+        }
+    }
+
+    return sc_remap_shm_publish(shm, key, grids, count);
+}
+
+static bool
+load_maps_to_host(struct sc_remap_state *state, const char *map_path,
+                  unsigned scale) {
+    struct sc_file_mapping source;
+    if (!sc_file_map(map_path, &source)) {
+        LOGE("Could not open mapping file: %s", map_path);
+        return false;
+    }
+    uint64_t source_hash = hash_data(source.data, source.size);
+    state->source_hash = source_hash;
+
+    char *cache_path;
+    if (asprintf(&cache_path, "%s%s", map_path, SC_REMAP_CACHE_SUFFIX) == -1) {
+        LOG_OOM();
+        sc_file_unmap(&source);
+        return false;
+    }
+
+    if (load_maps_from_cache(state, cache_path, source_hash)) {
+        LOGI("Remap cache loaded: %s", cache_path);
+        sc_file_unmap(&source);
+        free(cache_path);
+
+        // Another process may have published the grids of these maps (the
+        // cache header gives their layout)
+        struct sc_remap_shm_key key = {
+            .source_hash = source_hash,
+            .preview_scale = scale,
+        };
+        struct sc_remap_layout layout = state->full_maps.layout;
+        if (attach_maps(&state->shm, &key, &layout, &state->full_maps,
+                        &state->preview_maps, scale)) {
+            state->shared = true;
+            // No map points to the cache anymore
+            sc_file_unmap(&state->cache_mapping);
+            state->cache_mapped = false;
+        }
+        return true;
+    }
+
+    // The parser needs a null-terminated copy
+    char *xml = malloc(source.size + 1);
+    if (!xml) {
+        LOG_OOM();
+        sc_file_unmap(&source);
+        free(cache_path);
+        return false;
+    }
+    memcpy(xml, source.data, source.size);
+    xml[source.size] = '\0';
+    sc_file_unmap(&source);
+
+    sc_tick start = sc_tick_now();
+    bool ok = load_maps_from_xml(&state->full_maps, xml, map_path);
+    free(xml);
+    if (ok) {
+        LOGI("Remap maps parsed in %" PRItick " ms",
+             SC_TICK_TO_MS(sc_tick_now() - start));
+        write_maps_to_cache(&state->full_maps, cache_path, source_hash);
+    }
+
+    free(cache_path);
+    return ok;
+}
+
+static bool
+validate_maps(const struct sc_remap_maps *full_maps) {
+    const struct sc_remap_map *first = &full_maps->host[SC_REMAP_LUMA(0)];
+
+    // The chroma maps are computed from the luma maps, at half resolution
+    unsigned count = get_map_count(&full_maps->layout);
+    for (unsigned j = 0; j < count; ++j) {
+        unsigned i = get_map_index(&full_maps->layout, j);
+        bool chroma = is_chroma_map(i);
+        int cols = chroma ? first->cols / 2 : first->cols;
+        int rows = chroma ? first->rows / 2 : first->rows;
+        if (full_maps->host[i].cols != cols
+                || full_maps->host[i].rows != rows) {
+            LOGE("Inconsistent remap map sizes (the maps of all the views "
+                 "must have the same size)");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Replace the dense maps by sparse grids where they reproduce them accurately
+// (see util/remap.h), to reduce the memory and the memory bandwidth of the
+// remap. The maps remap frames of src_cols x src_rows per view.
+//
+// Return true if all the maps are stored as grids.
+static bool
+compact_maps(struct sc_remap_maps *maps, int src_cols, int src_rows,
+             const char *name) {
+    size_t dense_size = 0;
+    size_t grid_size = 0;
+    unsigned shift = 0;
+    bool all = true;
+    unsigned count = get_map_count(&maps->layout);
+    for (unsigned j = 0; j < count; ++j) {
+        unsigned i = get_map_index(&maps->layout, j);
+        struct sc_remap_map *map = &maps->host[i];
+        bool chroma = is_chroma_map(i);
+        int sw = chroma ? src_cols / 2 : src_cols;
+        int sh = chroma ? src_rows / 2 : src_rows;
+        size_t size = (size_t) map->cols * map->rows
+                    * (2 * sizeof(int16_t) + sizeof(uint16_t));
+        dense_size += size;
+
+        if (!sc_remap_grid_init(&map->grid, map->map1,
+                                map->cols * 2 * sizeof(int16_t), map->map2,
+                                map->cols * sizeof(uint16_t), map->cols,
+                                map->rows, sw, sh)) {
+            grid_size += size;
+            all = false;
+            // The pixels mapped from outside of the source are skipped by the
+            // dense remap too (on allocation failure, they are just sampled)
+            free(map->spans);
+            map->spans = malloc((size_t) map->rows * sizeof(*map->spans));
+            if (map->spans) {
+                sc_remap_spans_init(map->spans, map->map1,
+                                    map->cols * 2 * sizeof(int16_t),
+                                    map->cols, map->rows, sw, sh);
+            }
+            continue;
+        }
+
+        grid_size += sc_remap_grid_get_size(&map->grid);
+        shift = MAX(shift, map->grid.shift);
+        if (map->owned) {
+            free(map->map1);
+            free(map->map2);
+        }
+        map->map1 = NULL;
+        map->map2 = NULL;
+        map->owned = false;
+    }
+
+    if (grid_size < dense_size) {
+        LOGI("Remap maps (%s): %" PRIu64 " KiB instead of %" PRIu64 " KiB "
+             "(grid of up to %u pixels)", name, (uint64_t) grid_size / 1024,
+             (uint64_t) dense_size / 1024, 1u << shift);
+    } else {
+        LOGD("Remap maps (%s): kept dense (not smooth enough for a grid)",
+             name);
+    }
+    return all;
+}
+
+// Compute the maps remapping the full resolution frames directly to frames
+// downscaled by `scale`, so that the preview never needs a full resolution
+// remap followed by a resize
+static bool
+compute_preview_maps(const struct sc_remap_maps *full_maps,
+                     struct sc_remap_maps *preview_maps, unsigned scale) {
+    const struct sc_remap_map *view = &full_maps->host[SC_REMAP_LUMA(0)];
+    int cols = view->cols / scale;
+    int rows = view->rows / scale;
+    // The chroma planes must keep exactly half the luma resolution
+    if (cols < 2 || rows < 2 || cols % 2 || rows % 2) {
+        LOGE("Invalid preview downscale factor %u for the %dx%d remap maps",
+             scale, view->cols, view->rows);
+        return false;
+    }
+
+    unsigned views = sc_remap_layout_get_views(&full_maps->layout);
+    struct sc_float_map small[SC_REMAP_LAYOUT_MAX_VIEWS];
+    memset(small, 0, sizeof(small));
+    bool ok = true;
+    for (unsigned i = 0; ok && i < views; ++i) {
+        struct sc_float_map full;
+        ok = unconvert_map(&full_maps->host[SC_REMAP_LUMA(i)], &full);
+        if (!ok) {
+            break;
+        }
+
+        // Averaging the source coordinates of the covered destination pixels
+        // gives the source coordinates of the downscaled destination pixel
+        ok = float_map_init(&small[i], cols, rows);
+        if (ok) {
+            resize_area_f32(full.x, full.cols, full.rows, small[i].x, cols,
+                            rows);
+            resize_area_f32(full.y, full.cols, full.rows, small[i].y, cols,
+                            rows);
+        }
+        float_map_destroy(&full);
+    }
+
+    ok = ok && convert_view_maps(&full_maps->layout, small, preview_maps);
+
+    for (unsigned i = 0; i < views; ++i) {
+        float_map_destroy(&small[i]);
+    }
+    return ok;
+}
+
+// Derive from the calibration maps `full_maps` the maps for frames of
+// width x height (all the views), with the same field of view
+static bool
+compute_scaled_maps(const struct sc_remap_maps *full_maps,
+                    struct sc_remap_maps *scaled_maps, int width,
+                    int height) {
+    const struct sc_remap_layout *layout = &full_maps->layout;
+    const struct sc_remap_map *view = &full_maps->host[SC_REMAP_LUMA(0)];
+    int cols = width / (int) layout->cols;
+    int rows = height / (int) layout->rows;
+    double sx = (double) cols / view->cols;
+    double sy = (double) rows / view->rows;
+    bool downscale = cols < view->cols;
+
+    unsigned views = sc_remap_layout_get_views(layout);
+    struct sc_float_map scaled[SC_REMAP_LAYOUT_MAX_VIEWS];
+    memset(scaled, 0, sizeof(scaled));
+    bool ok = true;
+    for (unsigned i = 0; ok && i < views; ++i) {
+        struct sc_float_map full;
+        ok = unconvert_map(&full_maps->host[SC_REMAP_LUMA(i)], &full);
+        if (!ok) {
+            break;
+        }
+
+        ok = float_map_init(&scaled[i], cols, rows);
+        if (ok) {
+            if (downscale) {
+                resize_area_f32(full.x, full.cols, full.rows, scaled[i].x,
+                                cols, rows);
+                resize_area_f32(full.y, full.cols, full.rows, scaled[i].y,
+                                cols, rows);
+            } else {
+                resize_linear_f32(full.x, full.cols, full.rows, scaled[i].x,
+                                  cols, rows);
+                resize_linear_f32(full.y, full.cols, full.rows, scaled[i].y,
+                                  cols, rows);
+            }
+
+            // The source coordinates are scaled too (the pixel centers are at
+            // +0.5)
+            size_t count = (size_t) cols * rows;
+            for (size_t j = 0; j < count; ++j) {
+                scaled[i].x[j] = scaled[i].x[j] * sx + 0.5 * sx - 0.5;
+                scaled[i].y[j] = scaled[i].y[j] * sy + 0.5 * sy - 0.5;
+            }
+        }
+        float_map_destroy(&full);
+    }
+
+    ok = ok && convert_view_maps(layout, scaled, scaled_maps);
+
+    for (unsigned i = 0; i < views; ++i) {
+        float_map_destroy(&scaled[i]);
+    }
+    return ok;
+}
+
+// Return NULL on error
+static struct sc_remap_state *
+load_maps(const char *map_path, unsigned scale) {
+    struct sc_remap_state *state = calloc(1, sizeof(*state));
+    if (!state) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    if (!sc_mutex_init(&state->scaled_mutex)) {
+        free(state);
+        return NULL;
+    }
+    atomic_init(&state->refs, 1);
+
+    if (!load_maps_to_host(state, map_path, scale)
+            || !validate_maps(&state->full_maps)) {
+        release_state(state);
+        return NULL;
+    }
+
+    if (state->shared) {
+        // The preview grids are attached too
+        return state;
+    }
+
+    if (scale > 1 && !compute_preview_maps(&state->full_maps,
+                                           &state->preview_maps, scale)) {
+        release_state(state);
+        return NULL;
+    }
+
+    // Once the preview maps are derived from the dense maps
+    const struct sc_remap_map *view = &state->full_maps.host[SC_REMAP_LUMA(0)];
+    int cols = view->cols;
+    int rows = view->rows;
+    bool grids = compact_maps(&state->full_maps, cols, rows, "full");
+    if (grids && state->cache_mapped) {
+        // No map points to the cache anymore
+        sc_file_unmap(&state->cache_mapping);
+        state->cache_mapped = false;
+    }
+    if (scale > 1) {
+        grids &= compact_maps(&state->preview_maps, cols, rows, "preview");
+    }
+
+    if (grids) {
+        struct sc_remap_shm_key key = {
+            .source_hash = state->source_hash,
+            .preview_scale = scale,
+        };
+        state->shared = publish_maps(&state->shm, &key, &state->full_maps,
+                                     &state->preview_maps, scale);
+    }
+
+    return state;
+}
+
+void sc_video_preprocess_set_threads(unsigned count) {
+    // The remap runs on the thread of each processor
+    if (count != 1) {
+        LOGD("Built without OpenCV: the effects run on the processor threads");
+    }
+}
+
+void
+sc_video_preprocess_set_simd_remap(bool enable) {
+    // util/remap.h is the only implementation, it selects its kernel itself
+    (void) enable;
+}
+
+struct sc_video_preprocess *
+sc_video_preprocess_new(const char *map_path, enum sc_opencv_backend backend,
+                        unsigned scale) {
+    assert(map_path);
+    assert(scale >= 1);
+
+    if (backend != SC_OPENCV_BACKEND_CPU) {
+        LOGE("The OpenCL and CUDA backends require OpenCV");
+        return NULL;
+    }
+    const char *simd = sc_remap_u8_simd();
+    LOGD("CPU remap: %s", simd ? simd : "portable");
+
+    struct sc_remap_state *state = load_maps(map_path, scale);
+    if (!state) {
+        return NULL;
+    }
+
+    struct sc_video_preprocess *vpp = malloc(sizeof(*vpp));
+    if (!vpp) {
+        LOG_OOM();
+        release_state(state);
+        return NULL;
+    }
+
+    if (!sc_mutex_init(&vpp->mutex)) {
+        release_state(state);
+        free(vpp);
+        return NULL;
+    }
+
+    vpp->preview_scale = scale;
+    vpp->state = state;
+    atomic_init(&vpp->generation, 0);
+
+    return vpp;
+}
+
+void sc_video_preprocess_destroy(struct sc_video_preprocess *vpp) {
+    release_state(vpp->state);
+    sc_mutex_destroy(&vpp->mutex);
+    free(vpp);
+}
+
+bool sc_video_preprocess_reload(struct sc_video_preprocess *vpp,
+                                const char *map_path) {
+    struct sc_remap_state *state = load_maps(map_path, vpp->preview_scale);
+    if (!state) {
+        // The current maps are kept
+        return false;
+    }
+
+    // The consumers of the views (depth, features, device remap) are set up
+    // for the initial layout
+    struct sc_remap_layout layout = sc_video_preprocess_get_layout(vpp);
+    if (!sc_remap_layout_equals(&state->full_maps.layout, &layout)) {
+        LOGE("The new remap maps have another layout (%ux%u instead of %ux%u)",
+             state->full_maps.layout.cols, state->full_maps.layout.rows,
+             layout.cols, layout.rows);
+        release_state(state);
+        return false;
+    }
+
+    // The new calibration may have another size: its maps are scaled to the
+    // video size on first use
+    sc_mutex_lock(&vpp->mutex);
+    struct sc_remap_state *old = vpp->state;
+    vpp->state = state;
+    sc_mutex_unlock(&vpp->mutex);
+    release_state(old);
+
+    atomic_fetch_add_explicit(&vpp->generation, 1, memory_order_relaxed);
+    return true;
+}
+
+unsigned sc_video_preprocess_get_generation(
+        const struct sc_video_preprocess *vpp) {
+    return atomic_load_explicit(&vpp->generation, memory_order_relaxed);
+}
+
+bool sc_video_preprocess_set_cuda_ipc_output(struct sc_video_preprocess *vpp,
+                                             const char *name) {
+    (void) vpp;
+    (void) name;
+    LOGE("The CUDA IPC output requires OpenCV");
+    return false;
+}
+
+void sc_video_preprocess_publish_cuda_ipc(
+        const struct sc_video_preprocess *vpp, int64_t pts,
+        uint64_t frame_number, int64_t timestamp_us) {
+    (void) vpp;
+    (void) pts;
+    (void) frame_number;
+    (void) timestamp_us;
+}
+
+// Derive the maps of `state` for frames of width x height
+//
+// Return false if the calibration cannot be scaled to this size.
+static bool
+scale_maps(const struct sc_video_preprocess *vpp,
+           const struct sc_remap_state *state, struct sc_scaled_maps *scaled) {
+    const struct sc_remap_layout *layout = &state->full_maps.layout;
+    const struct sc_remap_map *view = &state->full_maps.host[SC_REMAP_LUMA(0)];
+    int cols = layout->cols;
+    int rows = layout->rows;
+    int map_width = cols * view->cols;
+    int map_height = rows * view->rows;
+    int width = scaled->width;
+    int height = scaled->height;
+
+    // The chroma planes of each view must keep exactly half the luma
+    // resolution
+    if (width < 2 * cols || height < 2 * rows || width % (2 * cols)
+            || height % (2 * rows)) {
+        LOGE("Could not scale the remap maps (%dx%d) to the video size %dx%d "
+             "(the width must be a multiple of %d, the height of %d)",
+             map_width, map_height, width, height, 2 * cols, 2 * rows);
+        return false;
+    }
+
+    // Only the same field of view may be scaled, up to the rounding of the
+    // video size by the encoder (to multiples of 8)
+    int64_t diff = (int64_t) width * map_height - (int64_t) height * map_width;
+    int64_t max_size = map_width > map_height ? map_width : map_height;
+    if (llabs(diff) > 8 * max_size) {
+        LOGE("Video size %dx%d does not have the aspect ratio of the remap "
+             "maps (%dx%d), adjust the capture or the calibration", width,
+             height, map_width, map_height);
+        return false;
+    }
+
+    unsigned scale = vpp->preview_scale;
+    struct sc_remap_shm_key key = {
+        .source_hash = state->source_hash,
+        .width = width,
+        .height = height,
+        .preview_scale = scale,
+    };
+    if (attach_maps(&scaled->shm, &key, layout, &scaled->full_maps,
+                    &scaled->preview_maps, scale)) {
+        scaled->shared = true;
+        return true;
+    }
+
+    if (!compute_scaled_maps(&state->full_maps, &scaled->full_maps, width,
+                             height)) {
+        return false;
+    }
+    if (scale > 1 && !compute_preview_maps(&scaled->full_maps,
+                                           &scaled->preview_maps, scale)) {
+        return false;
+    }
+
+    bool grids = compact_maps(&scaled->full_maps, width / cols,
+                              height / rows, "scaled");
+    if (scale > 1) {
+        grids &= compact_maps(&scaled->preview_maps, width / cols,
+                              height / rows, "scaled preview");
+    }
+    if (grids) {
+        scaled->shared = publish_maps(&scaled->shm, &key, &scaled->full_maps,
+                                      &scaled->preview_maps, scale);
+    }
+
+    LOGI("Remap maps scaled from %dx%d to %dx%d", map_width, map_height,
+         width, height);
+    return true;
+}
+
+// Get the maps of `state` for frames of width x height: the calibration maps,
+// or maps derived from them (computed on the first frame of each size)
+//
+// Return false if the calibration cannot be scaled to this size.
+static bool
+get_maps(const struct sc_video_preprocess *vpp,
+         struct sc_remap_state *state, int width, int height,
+         const struct sc_remap_maps **full_maps,
+         const struct sc_remap_maps **preview_maps) {
+    const struct sc_remap_layout *layout = &state->full_maps.layout;
+    const struct sc_remap_map *view = &state->full_maps.host[SC_REMAP_LUMA(0)];
+    if (width == (int) layout->cols * view->cols
+            && height == (int) layout->rows * view->rows) {
+        *full_maps = &state->full_maps;
+        *preview_maps = &state->preview_maps;
+        return true;
+    }
+
+    sc_mutex_lock(&state->scaled_mutex);
+    struct sc_scaled_maps *scaled = state->scaled;
+    while (scaled && (scaled->width != width || scaled->height != height)) {
+        scaled = scaled->next;
+    }
+    if (!scaled) {
+        scaled = calloc(1, sizeof(*scaled));
+        if (!scaled) {
+            LOG_OOM();
+            sc_mutex_unlock(&state->scaled_mutex);
+            return false;
+        }
+        scaled->width = width;
+        scaled->height = height;
+        scaled->ok = scale_maps(vpp, state, scaled);
+        if (!scaled->ok) {
+            free_maps(&scaled->full_maps);
+            free_maps(&scaled->preview_maps);
+        }
+        scaled->next = state->scaled;
+        state->scaled = scaled;
+    }
+    sc_mutex_unlock(&state->scaled_mutex);
+
+    if (!scaled->ok) {
+        return false;
+    }
+
+    *full_maps = &scaled->full_maps;
+    *preview_maps = &scaled->preview_maps;
+    return true;
+}
+
+void sc_video_preprocess_get_size(const struct sc_video_preprocess *vpp,
+                                  unsigned *width, unsigned *height) {
+    struct sc_remap_state *state = get_state(vpp);
+
+    const struct sc_remap_layout *layout = &state->full_maps.layout;
+    const struct sc_remap_map *view = &state->full_maps.host[SC_REMAP_LUMA(0)];
+    *width = layout->cols * view->cols;
+    *height = layout->rows * view->rows;
+
+    release_state(state);
+}
+
+struct sc_remap_layout
+sc_video_preprocess_get_layout(const struct sc_video_preprocess *vpp) {
+    struct sc_remap_state *state = get_state(vpp);
+    struct sc_remap_layout layout = state->full_maps.layout;
+    release_state(state);
+    return layout;
+}
+
+bool sc_video_preprocess_check_size(const struct sc_video_preprocess *vpp,
+                                    unsigned width, unsigned height) {
+    struct sc_remap_state *state = get_state(vpp);
+
+    // Scale the maps immediately, rather than on the first frame
+    const struct sc_remap_maps *full_maps;
+    const struct sc_remap_maps *preview_maps;
+    bool ok = get_maps(vpp, state, width, height, &full_maps, &preview_maps);
+
+    release_state(state);
+    return ok;
+}
+
+// Size of a font pixel, so that the digits have about the height of the
+// OpenCV font
+#define SC_GLYPH_SCALE 3
+#define SC_GLYPH_ADVANCE ((SC_FONT_GLYPH_COLS + 1) * SC_GLYPH_SCALE)
+#define SC_TEXT_X 10
+#define SC_TEXT_BASELINE (SC_VIDEO_PREPROCESS_TEXT_HEIGHT - 10)
+
+// Draw white text into the luma plane of the (black) timestamps bar
+static void
+draw_text(uint8_t *bar, int linesize, int width, const char *text) {
+    static_assert(SC_TEXT_BASELINE >= SC_FONT_GLYPH_ROWS * SC_GLYPH_SCALE,
+                  "The glyphs must fit in the bar");
+    int top = SC_TEXT_BASELINE - SC_FONT_GLYPH_ROWS * SC_GLYPH_SCALE;
+
+    int pen = SC_TEXT_X;
+    for (const char *c = text; *c; ++c) {
+        if (pen + SC_FONT_GLYPH_COLS * SC_GLYPH_SCALE > width) {
+            // The text does not fit (very small frames)
+            break;
+        }
+
+        const uint8_t *glyph = sc_font_get_glyph(*c);
+
+        for (int gy = 0; gy < SC_FONT_GLYPH_ROWS * SC_GLYPH_SCALE; ++gy) {
+            uint8_t bits = glyph[gy / SC_GLYPH_SCALE];
+            uint8_t *row = bar + (size_t) (top + gy) * linesize + pen;
+            for (int gx = 0; gx < SC_FONT_GLYPH_COLS * SC_GLYPH_SCALE; ++gx) {
+                int col = gx / SC_GLYPH_SCALE;
+                if (bits & (0x10 >> col)) {
+                    row[gx] = 255;
+                }
+            }
+        }
+        pen += SC_GLYPH_ADVANCE;
+    }
+}
+
+// Remap (or just copy or resize if maps is NULL) the plane src into dst,
+// the view v using maps->host[first + v]
+static void
+remap_plane(const uint8_t *src, int src_linesize, int src_width,
+            int src_height, uint8_t *dst, int dst_linesize, int width,
+            int height, const struct sc_remap_maps *maps, unsigned first,
+            uint8_t border) {
+    if (!maps) {
+        if (src_width == width && src_height == height) {
+            // No mapping, just copy the plane
+            for (int y = 0; y < height; ++y) {
+                memcpy(dst + (size_t) y * dst_linesize,
+                       src + (size_t) y * src_linesize, width);
+            }
+        } else {
+            resize_area_u8(src, src_linesize, src_width, src_height, dst,
+                           dst_linesize, width, height);
+        }
+        return;
+    }
+
+    // Each view is remapped from the same view of the source
+    int cols = maps->layout.cols;
+    int rows = maps->layout.rows;
+    unsigned views = sc_remap_layout_get_views(&maps->layout);
+    for (unsigned v = 0; v < views; ++v) {
+        const struct sc_remap_map *map = &maps->host[first + v];
+        int col = v % cols;
+        int row = v / cols;
+        int src_x = src_width * col / cols;
+        int src_y = src_height * row / rows;
+        int src_cols = src_width * (col + 1) / cols - src_x;
+        int src_rows = src_height * (row + 1) / rows - src_y;
+        int dst_x = width * col / cols;
+        int dst_y = height * row / rows;
+        assert(map->cols == width * (col + 1) / cols - dst_x);
+        assert(map->rows == height * (row + 1) / rows - dst_y);
+        const uint8_t *src_view = src + (size_t) src_y * src_linesize + src_x;
+        uint8_t *dst_view = dst + (size_t) dst_y * dst_linesize + dst_x;
+        if (map->grid.xy) {
+            sc_remap_grid_u8(src_view, src_linesize, src_cols, src_rows,
+                             dst_view, dst_linesize, &map->grid, 0, map->rows,
+                             border);
+            continue;
+        }
+        sc_remap_u8_spans(src_view, src_linesize, src_cols, src_rows,
+                          dst_view, dst_linesize, map->cols, map->rows,
+                          map->map1, map->cols * 2 * sizeof(int16_t),
+                          map->map2, map->cols * sizeof(uint16_t), map->spans,
+                          border);
+    }
+}
+
+static void
+fill_rows(uint8_t *data, int linesize, int width, int rows, uint8_t value) {
+    for (int y = 0; y < rows; ++y) {
+        memset(data + (size_t) y * linesize, value, width);
+    }
+}
+
+// Write the content of frame, remapped by maps (or just copied or resized if
+// maps is NULL) to width x height, into output, a new frame from the pool
+//
+// If luma_only is set, output is a GRAY8 frame, the chroma planes are skipped.
+static bool
+process_frame(const AVFrame *frame, AVFrame *output, int width, int height,
+              const struct sc_remap_maps *maps, const char *show_text,
+              bool luma_only, struct sc_frame_pool *pool) {
+    int text_height = SC_VIDEO_PREPROCESS_TEXT_HEIGHT;
+    int y_offset = show_text ? text_height : 0;
+    int display_height = height + y_offset;
+
+    int format = luma_only ? AV_PIX_FMT_GRAY8 : frame->format;
+    if (!sc_frame_pool_get(pool, output, format, width, display_height)) {
+        return false;
+    }
+
+    // The text bar is above the video content
+    remap_plane(frame->data[0], frame->linesize[0], frame->width,
+                frame->height,
+                output->data[0] + (size_t) y_offset * output->linesize[0],
+                output->linesize[0], width, height, maps, SC_REMAP_LUMA(0),
+                SC_REMAP_BORDER_LUMA);
+
+    if (!luma_only) {
+        for (unsigned i = 1; i < 3; ++i) {
+            int dst_offset = (y_offset / 2) * output->linesize[i];
+            remap_plane(frame->data[i], frame->linesize[i], frame->width / 2,
+                        frame->height / 2, output->data[i] + dst_offset,
+                        output->linesize[i], width / 2, height / 2, maps,
+                        SC_REMAP_CHROMA(0), SC_REMAP_BORDER_CHROMA);
+
+            if (show_text != NULL) {
+                // A black bar is Y=0 with neutral chroma
+                fill_rows(output->data[i], output->linesize[i], width / 2,
+                          text_height / 2, SC_REMAP_BORDER_CHROMA);
+            }
+        }
+    }
+
+    // If text should be shown, add a black bar and text at the top
+    if (show_text != NULL) {
+        fill_rows(output->data[0], output->linesize[0], width, text_height,
+                  SC_REMAP_BORDER_LUMA);
+
+        // White text only affects the luma plane
+        draw_text(output->data[0], output->linesize[0], width, show_text);
+    }
+
+    av_frame_copy_props(output, frame);
+    return true;
+}
+
+// The size of the preview of the frames of frame_width x frame_height, by the
+// preview maps if not NULL
+static bool
+get_preview_size(const struct sc_remap_maps *maps, unsigned scale,
+                 int frame_width, int frame_height, int *width, int *height) {
+    if (maps) {
+        // The remapped size is the size of the preview maps
+        const struct sc_remap_map *view = &maps->host[SC_REMAP_LUMA(0)];
+        *width = maps->layout.cols * view->cols;
+        *height = maps->layout.rows * view->rows;
+        return true;
+    }
+
+    // Keep even dimensions for the chroma planes
+    *width = (frame_width / scale) & ~1;
+    *height = (frame_height / scale) & ~1;
+    return *width && *height;
+}
+
+bool sc_video_preprocess_get_preview_size(
+        const struct sc_video_preprocess *remap, unsigned scale, int width,
+        int height, int *preview_width, int *preview_height) {
+    assert(scale > 1);
+    assert(!remap || scale == remap->preview_scale);
+
+    struct sc_remap_state *state = NULL;
+    const struct sc_remap_maps *maps = NULL;
+    if (remap) {
+        state = get_state(remap);
+        const struct sc_remap_maps *full_maps;
+        if (!get_maps(remap, state, width, height, &full_maps, &maps)) {
+            release_state(state);
+            return false;
+        }
+    }
+
+    bool ok = get_preview_size(maps, scale, width, height, preview_width,
+                               preview_height);
+    if (state) {
+        release_state(state);
+    }
+    return ok;
+}
+
+void apply_video_effects(AVFrame *frame,
+                         const struct sc_video_preprocess *remap,
+                         const char *show_text, bool luma_only,
+                         struct sc_frame_pool *pool) {
+    // The remapped planes are written directly into a new pooled frame (remap
+    // cannot work in place), which then replaces the content of the input
+    // frame
+    AVFrame *output = av_frame_alloc();
+    if (!output) {
+        LOG_OOM();
+        return;
+    }
+
+    // Kept until the frame is processed, even if the maps are reloaded
+    // meanwhile
+    struct sc_remap_state *state = NULL;
+    const struct sc_remap_maps *maps = NULL;
+    if (remap) {
+        state = get_state(remap);
+        const struct sc_remap_maps *preview_maps;
+        if (!get_maps(remap, state, frame->width, frame->height, &maps,
+                      &preview_maps)) {
+            // The error has been logged on the first frame of this size
+            release_state(state);
+            av_frame_free(&output);
+            return;
+        }
+    }
+
+    bool ok = process_frame(frame, output, frame->width, frame->height, maps,
+                            show_text, luma_only, pool);
+    if (state) {
+        release_state(state);
+    }
+    if (!ok) {
+        av_frame_free(&output);
+        return;
+    }
+
+    // Replace the input frame by the processed frame
+    av_frame_unref(frame);
+    av_frame_move_ref(frame, output);
+    av_frame_free(&output);
+}
+
+bool apply_video_effects_preview(const AVFrame *frame, AVFrame *preview,
+                                 unsigned scale,
+                                 const struct sc_video_preprocess *remap,
+                                 const char *show_text,
+                                 struct sc_frame_pool *pool) {
+    assert(scale > 1);
+    // The preview maps are computed by sc_video_preprocess_new()
+    assert(!remap || scale == remap->preview_scale);
+
+    struct sc_remap_state *state = NULL;
+    const struct sc_remap_maps *maps = NULL;
+    if (remap) {
+        state = get_state(remap);
+        const struct sc_remap_maps *full_maps;
+        if (!get_maps(remap, state, frame->width, frame->height, &full_maps,
+                      &maps)) {
+            release_state(state);
+            return false;
+        }
+    }
+
+    int width;
+    int height;
+    if (!get_preview_size(maps, scale, frame->width, frame->height, &width,
+                          &height)) {
+        if (state) {
+            release_state(state);
+        }
+        return false;
+    }
+
+    bool ok = process_frame(frame, preview, width, height, maps, show_text,
+                            false, pool);
+    if (state) {
+        release_state(state);
+    }
+    return ok;
+}
+
+static struct sc_remap_plane_map
+get_plane_map(const struct sc_remap_map *map) {
+    if (map->grid.xy) {
+        return (struct sc_remap_plane_map) {.grid = &map->grid};
+    }
+    return (struct sc_remap_plane_map) {
+        .map1 = map->map1,
+        .map1_linesize = map->cols * 2 * sizeof(int16_t),
+        .map2 = map->map2,
+        .map2_linesize = map->cols * sizeof(uint16_t),
+        .spans = map->spans,
+    };
+}
+
+bool sc_video_preprocess_remap_rgb(const struct sc_video_preprocess *vpp,
+                                   const AVFrame *frame,
+                                   enum AVPixelFormat format, AVFrame *rgb,
+                                   struct sc_frame_pool *pool) {
+    assert(frame->format == AV_PIX_FMT_YUV420P);
+    assert(format == AV_PIX_FMT_RGB24 || format == AV_PIX_FMT_BGRA);
+    enum sc_rgb_format rgb_format = format == AV_PIX_FMT_BGRA
+                                  ? SC_RGB_FORMAT_BGRA : SC_RGB_FORMAT_RGB24;
+    int bpp = sc_rgb_format_get_bpp(rgb_format);
+
+    struct sc_remap_state *state = get_state(vpp);
+    const struct sc_remap_maps *maps;
+    const struct sc_remap_maps *preview_maps;
+    if (!get_maps(vpp, state, frame->width, frame->height, &maps,
+                  &preview_maps)) {
+        release_state(state);
+        return false;
+    }
+
+    if (!sc_frame_pool_get(pool, rgb, format, frame->width, frame->height)) {
+        release_state(state);
+        return false;
+    }
+
+    // Each view is remapped from the same view of the source (see
+    // remap_plane())
+    int cols = maps->layout.cols;
+    int rows = maps->layout.rows;
+    unsigned views = sc_remap_layout_get_views(&maps->layout);
+    bool ok = true;
+    for (unsigned v = 0; ok && v < views; ++v) {
+        const struct sc_remap_map *luma = &maps->host[SC_REMAP_LUMA(v)];
+        const struct sc_remap_map *chroma = &maps->host[SC_REMAP_CHROMA(v)];
+        int col = v % cols;
+        int row = v / cols;
+        int src_x = frame->width * col / cols;
+        int src_y = frame->height * row / rows;
+        int src_cols = frame->width * (col + 1) / cols - src_x;
+        int src_rows = frame->height * (row + 1) / rows - src_y;
+        // The chroma views are at half the position
+        assert(!(src_x & 1) && !(src_y & 1));
+        assert(chroma->cols * 2 == luma->cols);
+        assert(chroma->rows * 2 == luma->rows);
+
+        const uint8_t *src[3] = {
+            frame->data[0] + (size_t) src_y * frame->linesize[0] + src_x,
+            frame->data[1] + (size_t) (src_y / 2) * frame->linesize[1]
+                           + src_x / 2,
+            frame->data[2] + (size_t) (src_y / 2) * frame->linesize[2]
+                           + src_x / 2,
+        };
+        // The output has the size of the frame
+        uint8_t *dst = rgb->data[0] + (size_t) src_y * rgb->linesize[0]
+                     + (size_t) src_x * bpp;
+
+        struct sc_remap_plane_map luma_map = get_plane_map(luma);
+        struct sc_remap_plane_map chroma_map = get_plane_map(chroma);
+        ok = sc_remap_yuv420p_to_rgb(src, frame->linesize, src_cols, src_rows,
+                                     &luma_map, &chroma_map, dst,
+                                     rgb->linesize[0], luma->cols, 0,
+                                     luma->rows, rgb_format);
+    }
+
+    release_state(state);
+    if (!ok) {
+        av_frame_unref(rgb);
+        return false;
+    }
+
+    av_frame_copy_props(rgb, frame);
+    return true;
+}
+
+float *sc_video_preprocess_get_gpu_map(const struct sc_video_preprocess *vpp,
+                                       int width, int height) {
+    struct sc_remap_state *state = get_state(vpp);
+
+    const struct sc_remap_maps *full_maps;
+    const struct sc_remap_maps *preview_maps;
+    if (!get_maps(vpp, state, width, height, &full_maps, &preview_maps)) {
+        release_state(state);
+        return NULL;
+    }
+
+    const struct sc_remap_layout *layout = &full_maps->layout;
+    int view_width = full_maps->host[SC_REMAP_LUMA(0)].cols;
+    int view_height = full_maps->host[SC_REMAP_LUMA(0)].rows;
+    int w = layout->cols * view_width;
+    int h = layout->rows * view_height;
+    assert(w == width && h == height);
+    float *map = malloc((size_t) w * h * 2 * sizeof(float));
+    // A row of a view, expanded if the map is stored as a grid
+    int16_t *xy_buf = malloc((size_t) view_width * 2 * sizeof(*xy_buf));
+    uint16_t *frac_buf = malloc((size_t) view_width * sizeof(*frac_buf));
+    if (!map || !xy_buf || !frac_buf) {
+        LOG_OOM();
+        free(map);
+        free(xy_buf);
+        free(frac_buf);
+        release_state(state);
+        return NULL;
+    }
+
+    // Back to float coordinates (exact, up to the fixed-point precision),
+    // the source coordinates of each view being shifted to its position in
+    // the whole frame
+    unsigned views = sc_remap_layout_get_views(layout);
+    for (unsigned v = 0; v < views; ++v) {
+        const struct sc_remap_map *view = &full_maps->host[SC_REMAP_LUMA(v)];
+        int x0 = (v % layout->cols) * view_width;
+        int y0 = (v / layout->cols) * view_height;
+        for (int y = 0; y < view_height; ++y) {
+            const int16_t *xy;
+            const uint16_t *frac;
+            get_map_row(view, y, xy_buf, frac_buf, &xy, &frac);
+            float *row = map + ((size_t) (y0 + y) * w + x0) * 2;
+            for (int x = 0; x < view_width; ++x) {
+                row[2 * x] = xy[2 * x] + (frac[x] & 31) / 32.f + x0;
+                row[2 * x + 1] = xy[2 * x + 1] + (frac[x] >> 5) / 32.f + y0;
+            }
+        }
+    }
+
+    free(xy_buf);
+    free(frac_buf);
+    release_state(state);
+    return map;
+}
+
+bool sc_video_preprocess_compute_depth(const AVFrame *frame,
+                                       unsigned skip_rows, AVFrame *depth,
+                                       struct sc_frame_pool *pool) {
+    (void) frame;
+    (void) skip_rows;
+    (void) depth;
+    (void) pool;
+    // The stereo matcher requires OpenCV (--pipe-depth is rejected by the
+    // command line parser)
+    return false;
+}
+
+bool sc_video_preprocess_extract_features(const AVFrame *frame,
+                                          unsigned skip_rows,
+                                          struct sc_video_features *features) {
+    (void) frame;
+    (void) skip_rows;
+    (void) features;
+    // The ORB detector requires OpenCV (--pipe-output=features is rejected by
+    // the command line parser)
+    return false;
+}
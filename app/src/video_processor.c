@@ -0,0 +1,1731 @@
+#include "video_processor.h"
+
+#ifdef _WIN32
+# include <io.h> // mkdir()
+#endif
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <libavutil/avutil.h>
+#include <libavutil/dict.h>
+#include <libavutil/frame.h>
+
+#include "auto_tune.h"
+#include "capture_trigger.h"
+#include "decoder.h"
+#include "demuxer.h"
+#include "device_time.h"
+#include "frame_cache.h"
+#include "frame_clock.h"
+#include "frame_drops.h"
+#include "frame_pipe.h"
+#include "frame_pool.h"
+#include "frame_pyramid.h"
+#include "frame_writer.h"
+#include "gl_readback.h"
+#include "latency_probe.h"
+#include "latency_trace.h"
+#include "metrics.h"
+#include "shm_output.h"
+#include "video_preprocess.h"
+#include "util/alloc_stats.h"
+#include "util/log.h"
+
+/** Downcast frame_sink to sc_video_processor */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_video_processor, frame_sink)
+
+static bool
+pipe_frame(struct sc_video_processor *vp, const AVFrame *frame,
+           const struct sc_frame_pipe_info *info) {
+    if (!vp->pipe_mutex) {
+        return sc_frame_pipe_write(frame, info, vp->pipe_device);
+    }
+
+    // The frames of all the devices (or the audio blocks) are multiplexed on
+    // stdout
+    sc_mutex_lock(vp->pipe_mutex);
+    bool ok = sc_frame_pipe_write(frame, info, vp->pipe_device);
+    sc_mutex_unlock(vp->pipe_mutex);
+
+    return ok;
+}
+
+static bool
+pipe_drop(struct sc_video_processor *vp, uint64_t frame_number,
+          unsigned reason, int64_t timestamp_us) {
+    if (vp->pipe_mutex) {
+        sc_mutex_lock(vp->pipe_mutex);
+    }
+    int64_t timestamp_ms = sc_frame_clock_us_to_ms(timestamp_us);
+    bool ok = sc_frame_pipe_write_drop(frame_number, reason, timestamp_ms,
+                                       vp->pipe_device);
+    if (vp->pipe_mutex) {
+        sc_mutex_unlock(vp->pipe_mutex);
+    }
+
+    return ok;
+}
+
+static bool
+pipe_depth(struct sc_video_processor *vp, const AVFrame *frame,
+           const struct sc_frame_pipe_info *info) {
+    unsigned skip_rows = vp->show_timestamps ? SC_VIDEO_PREPROCESS_TEXT_HEIGHT
+                                             : 0;
+    if (!sc_video_preprocess_compute_depth(frame, skip_rows, vp->depth,
+                                           &vp->depth_pool)) {
+        LOGE("Could not compute the disparity map, disabling depth output");
+        vp->pipe_depth = false;
+        return true;
+    }
+
+    if (vp->pipe_mutex) {
+        sc_mutex_lock(vp->pipe_mutex);
+    }
+    bool ok = sc_frame_pipe_write_depth(vp->depth,
+                                        SC_VIDEO_PREPROCESS_DEPTH_SCALE, info,
+                                        vp->pipe_device);
+    if (vp->pipe_mutex) {
+        sc_mutex_unlock(vp->pipe_mutex);
+    }
+
+    // Release the map buffer to the pool
+    av_frame_unref(vp->depth);
+    return ok;
+}
+
+static bool
+pipe_pyramid(struct sc_video_processor *vp,
+             const struct sc_frame_pyramid *pyramid,
+             const struct sc_frame_pipe_info *info) {
+    if (vp->pipe_mutex) {
+        sc_mutex_lock(vp->pipe_mutex);
+    }
+    bool ok = true;
+    for (unsigned i = 1; ok && i <= pyramid->top; ++i) {
+        if (sc_frame_pyramid_selected(pyramid, i)) {
+            const AVFrame *level = sc_frame_pyramid_level(pyramid, i);
+            ok = sc_frame_pipe_write_pyramid_level(level, i, info,
+                                                   vp->pipe_device);
+        }
+    }
+    if (vp->pipe_mutex) {
+        sc_mutex_unlock(vp->pipe_mutex);
+    }
+
+    return ok;
+}
+
+static bool
+pipe_features(struct sc_video_processor *vp, const AVFrame *frame,
+              const struct sc_frame_pipe_info *info) {
+    unsigned skip_rows = vp->show_timestamps ? SC_VIDEO_PREPROCESS_TEXT_HEIGHT
+                                             : 0;
+    if (!sc_video_preprocess_extract_features(frame, skip_rows,
+                                              vp->features)) {
+        return false;
+    }
+
+    if (vp->pipe_mutex) {
+        sc_mutex_lock(vp->pipe_mutex);
+    }
+    bool ok = sc_frame_pipe_write_features(vp->features, info,
+                                           vp->pipe_device);
+    if (vp->pipe_mutex) {
+        sc_mutex_unlock(vp->pipe_mutex);
+    }
+
+    return ok;
+}
+
+// Queue a processed frame (or the record of a dropped frame if frame is NULL,
+// with its drop reason) for the output thread, waiting while the outputs are
+// too slow
+static void
+sc_video_processor_push_output(struct sc_video_processor *vp,
+                               const AVFrame *frame, unsigned drop_reason,
+                               uint64_t frame_number, int64_t timestamp_us) {
+    sc_mutex_lock(&vp->mutex);
+    while (!vp->output_stopped
+            && vp->output_count == SC_VIDEO_PROCESSOR_OUTPUT_DEPTH) {
+        sc_cond_wait(&vp->output_cond, &vp->mutex);
+    }
+    // The output thread is stopped after the processor thread
+    assert(!vp->output_stopped);
+    unsigned index = (vp->output_head + vp->output_count)
+                   % SC_VIDEO_PROCESSOR_OUTPUT_DEPTH;
+    sc_mutex_unlock(&vp->mutex);
+
+    // The slot is not accessed by the output thread until it is counted
+    struct sc_video_processor_output *out = &vp->pending[index];
+    if (frame && av_frame_ref(out->frame, frame)) {
+        LOG_OOM();
+        return;
+    }
+    out->dropped = !frame;
+    out->drop_reason = drop_reason;
+    out->frame_number = frame_number;
+    out->sampled_from = frame && vp->output_skipped ? vp->output_skipped_from
+                                                    : frame_number;
+    vp->output_skipped = false;
+    // Reported on the next frame (a drop record is not a frame)
+    out->interrupted = frame && vp->output_interrupted;
+    if (frame) {
+        vp->output_interrupted = false;
+    }
+    out->timestamp_us = timestamp_us;
+    out->filtered_timestamp_us = frame ? vp->filtered_timestamp_us : -1;
+    out->timestamp_outlier = frame && vp->timestamp_outlier;
+    out->exposure_ns = frame ? vp->frame_times.exposure_ns : 0;
+    out->readout_ns = frame ? vp->frame_times.readout_ns : 0;
+    out->mid_exposure_us = frame ? vp->frame_times.mid_us : -1;
+    // The pose samples taken are attached to the first output which follows
+    memcpy(out->poses, vp->poses, vp->pose_count * sizeof(*vp->poses));
+    out->pose_count = vp->pose_count;
+    vp->pose_count = 0;
+
+    sc_mutex_lock(&vp->mutex);
+    ++vp->output_count;
+    sc_cond_signal(&vp->output_cond);
+    sc_mutex_unlock(&vp->mutex);
+}
+
+static bool
+sc_video_processor_push_save(struct sc_video_processor *vp,
+                             const AVFrame *frame, uint64_t frame_number,
+                             int64_t timestamp_ms, bool unrectified) {
+    if (unrectified) {
+        return sc_frame_writer_push_unrectified(&vp->frame_writer, frame,
+                                                frame_number, timestamp_ms);
+    }
+    return sc_frame_writer_push(&vp->frame_writer, frame, frame_number,
+                                timestamp_ms);
+}
+
+// Save and output a processed frame (NULL if it could not be processed)
+static void
+sc_video_processor_deliver(struct sc_video_processor *vp,
+                           const AVFrame *frame,
+                           const struct sc_video_processor_delivery *d) {
+    // Read by sc_video_processor_push_output()
+    vp->frame_times = d->frame_times;
+    vp->filtered_timestamp_us = d->filtered_timestamp_us;
+    vp->timestamp_outlier = d->timestamp_outlier;
+
+    int64_t timestamp_ms = sc_frame_clock_us_to_ms(d->timestamp_us);
+
+    if (d->save) {
+        if (!frame) {
+            sc_frame_writer_mark_dropped(&vp->frame_writer, d->frame_number,
+                                         timestamp_ms);
+        } else if (!sc_video_processor_push_save(vp, frame, d->frame_number,
+                                                 timestamp_ms,
+                                                 d->unrectified)) {
+            LOGE("Could not queue frame for saving");
+        } else if (d->filtered_timestamp_us >= 0) {
+            sc_frame_writer_add_timestamp(&vp->frame_writer, d->frame_number,
+                                          d->timestamp_us,
+                                          d->filtered_timestamp_us,
+                                          d->timestamp_outlier);
+        }
+    }
+
+    if (d->output) {
+        // Piped and published while the next frame is processed
+        sc_video_processor_push_output(vp, frame,
+                                       frame ? 0 : SC_FRAME_DROP_WRITE_FAILED,
+                                       d->frame_number, d->timestamp_us);
+    } else if (d->save) {
+        sc_latency_trace_stamp(SC_LATENCY_STAGE_OUTPUT, d->pts);
+    }
+}
+
+// Deliver the oldest frame in flight on the GPU, once read back
+//
+// Return false if it is not read back yet (only if `wait` is false).
+static bool
+sc_video_processor_complete_readback(struct sc_video_processor *vp,
+                                     bool wait) {
+    assert(vp->readback_count);
+
+    AVFrame *frame = vp->readback;
+    if (!sc_gl_readback_pop(vp->gl_readback, frame, wait)) {
+        return false;
+    }
+
+    const struct sc_video_processor_delivery *d =
+        &vp->readbacks[vp->readback_head];
+    vp->readback_head = (vp->readback_head + 1) % SC_GL_READBACK_DEPTH;
+    --vp->readback_count;
+
+    // Left empty if the readback failed
+    bool ok = frame->data[0];
+    if (ok && frame->format == AV_PIX_FMT_YUV420P) {
+        // Its content is final (see sc_video_processor_process())
+        sc_frame_cache_attach(frame);
+    }
+    sc_video_processor_deliver(vp, ok ? frame : NULL, d);
+    av_frame_unref(frame);
+
+    return true;
+}
+
+// Deliver the frames in flight on the GPU, in order: all of them if `wait`,
+// otherwise only those already read back
+//
+// The outputs are written in order, so this must be called with `wait` before
+// anything else is saved or output.
+static void
+sc_video_processor_complete_readbacks(struct sc_video_processor *vp,
+                                      bool wait) {
+    while (vp->readback_count
+            && sc_video_processor_complete_readback(vp, wait)) {
+        // continue
+    }
+}
+
+// Submit the frame to be rectified on the GPU: its outputs are delivered once
+// it is read back, while the next frames are processed
+//
+// Return false if the frame could not be submitted.
+static bool
+sc_video_processor_push_readback(struct sc_video_processor *vp,
+                                 const AVFrame *frame,
+                                 const struct sc_video_processor_delivery *d) {
+    if (frame->format != AV_PIX_FMT_YUV420P
+            && frame->format != AV_PIX_FMT_GRAY8) {
+        return false;
+    }
+
+    if (vp->readback_count == SC_GL_READBACK_DEPTH) {
+        // The oldest frame has been submitted SC_GL_READBACK_DEPTH frames ago,
+        // so this should be immediate
+        bool ok = sc_video_processor_complete_readback(vp, true);
+        assert(ok);
+        (void) ok;
+    }
+
+    if (!sc_gl_readback_push(vp->gl_readback, frame, vp->luma_only)) {
+        return false;
+    }
+
+    unsigned index = (vp->readback_head + vp->readback_count)
+                   % SC_GL_READBACK_DEPTH;
+    vp->readbacks[index] = *d;
+    ++vp->readback_count;
+
+    return true;
+}
+
+// Take the pose samples received since the previous frame
+static void
+sc_video_processor_take_poses(struct sc_video_processor *vp) {
+    struct pose_sample_record samples[SC_POSE_BUFFER_CAPACITY];
+    unsigned count = sc_pose_buffer_take(vp->pose_buffer, samples);
+    if (!count) {
+        return;
+    }
+
+    if (vp->save_frames) {
+        sc_frame_writer_add_poses(&vp->frame_writer, samples, count);
+    }
+
+    if (vp->outputs) {
+        // Written to the pipe before the next output. Every frame is pushed to
+        // the outputs except the frames skipped by the output rate, whose
+        // samples are kept for the next output (the oldest are discarded if
+        // there are too many)
+        unsigned total = vp->pose_count + count;
+        if (total > SC_POSE_BUFFER_CAPACITY) {
+            unsigned excess = total - SC_POSE_BUFFER_CAPACITY;
+            assert(excess <= vp->pose_count);
+            memmove(vp->poses, vp->poses + excess,
+                    (vp->pose_count - excess) * sizeof(*vp->poses));
+            vp->pose_count -= excess;
+        }
+        memcpy(vp->poses + vp->pose_count, samples, count * sizeof(*samples));
+        vp->pose_count += count;
+    }
+}
+
+static void
+sc_video_processor_report_drop(struct sc_video_processor *vp,
+                               struct sc_video_processor_drop *drop) {
+    if (!vp->save_frames && !vp->outputs) {
+        return;
+    }
+
+    // After the frames in flight on the GPU
+    sc_video_processor_complete_readbacks(vp, true);
+
+    int64_t timestamp_us = sc_frame_clock_get_timestamp_us(&vp->clock,
+                                                           drop->metadata,
+                                                           drop->pts);
+
+    if (vp->save_frames) {
+        sc_frame_writer_mark_dropped(&vp->frame_writer, drop->frame_number,
+                                     sc_frame_clock_us_to_ms(timestamp_us));
+    }
+
+    if (vp->outputs) {
+        // Written to the pipe in order, by the output thread
+        sc_video_processor_push_output(vp, NULL, SC_FRAME_DROP_QUEUE_FULL,
+                                       drop->frame_number, timestamp_us);
+    }
+}
+
+// Report the frames dropped since the last processed frame, in order
+static void
+sc_video_processor_report_drops(struct sc_video_processor *vp) {
+    struct sc_video_processor_drop drops[SC_VIDEO_PROCESSOR_PENDING_DROPS];
+    unsigned count = 0;
+
+    sc_mutex_lock(&vp->mutex);
+    while (!sc_vecdeque_is_empty(&vp->pending_drops)) {
+        assert(count < SC_VIDEO_PROCESSOR_PENDING_DROPS);
+        drops[count++] = sc_vecdeque_pop(&vp->pending_drops);
+    }
+    sc_mutex_unlock(&vp->mutex);
+
+    for (unsigned i = 0; i < count; ++i) {
+        sc_video_processor_report_drop(vp, &drops[i]);
+        av_dict_free(&drops[i].metadata);
+    }
+}
+
+static bool
+sc_video_processor_is_key_frame(const AVFrame *frame) {
+#ifdef SCRCPY_LAVU_HAS_FRAME_FLAG_KEY
+    return frame->flags & AV_FRAME_FLAG_KEY;
+#else
+    return frame->key_frame;
+#endif
+}
+
+static bool
+sc_video_processor_is_repeated(const AVFrame *frame) {
+    return av_dict_get(frame->metadata, SC_DEMUXER_METADATA_REPEATED, NULL, 0);
+}
+
+// Record a frame as a repetition of the previous one in the outputs, in place
+// of the frame
+static void
+sc_video_processor_record_repeated(struct sc_video_processor *vp,
+                                   uint64_t frame_number, int64_t timestamp_us,
+                                   bool save, bool output) {
+    // After the frames in flight on the GPU
+    sc_video_processor_complete_readbacks(vp, true);
+
+    if (save) {
+        sc_frame_writer_mark_repeated(&vp->frame_writer, frame_number,
+                                      sc_frame_clock_us_to_ms(timestamp_us));
+    }
+    if (output) {
+        sc_video_processor_push_output(vp, NULL, FRAME_DROP_REASON_REPEATED,
+                                       frame_number, timestamp_us);
+    }
+}
+
+// Record a skipped repeated frame in the outputs, in place of the frame
+static void
+sc_video_processor_skip_repeated(struct sc_video_processor *vp,
+                                 const AVFrame *frame, uint64_t frame_number) {
+    ++vp->repeated_count;
+    if (!vp->save_frames && !vp->outputs) {
+        return;
+    }
+
+    int64_t timestamp_us = sc_frame_clock_get_timestamp_us(&vp->clock,
+                                                           frame->metadata,
+                                                           frame->pts);
+    sc_video_processor_record_repeated(vp, frame_number, timestamp_us,
+                                       vp->save_frames, vp->outputs);
+}
+
+// Return true if the frame differs enough from the last frame saved or output
+// (see motion_gate.h)
+static bool
+sc_video_processor_has_motion(struct sc_video_processor *vp,
+                              const AVFrame *frame) {
+    if (frame->format != AV_PIX_FMT_YUV420P
+            && frame->format != AV_PIX_FMT_NV12
+            && frame->format != AV_PIX_FMT_GRAY8) {
+        // No Y plane to compare
+        return true;
+    }
+
+    return sc_motion_gate_accept(&vp->motion_gate, frame->data[0],
+                                 frame->linesize[0], frame->width,
+                                 frame->height);
+}
+
+// Record the interruption of the stream before the first frame received after a
+// reconnection, if this is the one
+static void
+sc_video_processor_check_resumed(struct sc_video_processor *vp,
+                                 const AVFrame *frame, uint64_t frame_number) {
+    AVDictionaryEntry *gap =
+        av_dict_get(frame->metadata, SC_DEMUXER_METADATA_RESUMED, NULL, 0);
+    if (!gap) {
+        return;
+    }
+
+    ++vp->gap_count;
+    // Recorded after the frames in flight on the GPU
+    sc_video_processor_complete_readbacks(vp, true);
+    // The first frame after the interruption is always output
+    sc_motion_gate_reset(&vp->motion_gate);
+    if (vp->save_frames) {
+        int64_t duration_ms = strtoll(gap->value, NULL, 10);
+        sc_frame_writer_mark_gap(&vp->frame_writer, frame_number,
+                                 duration_ms);
+    }
+    if (vp->outputs) {
+        vp->output_interrupted = true;
+    }
+}
+
+// Return the time of the reception of the frame packet (the decoding latency
+// is reported by the decoder in the frame metadata)
+static sc_tick
+sc_video_processor_get_arrival(const struct sc_video_processor_input *input) {
+    sc_tick arrival = input->recv_time;
+
+    AVDictionaryEntry *latency =
+        av_dict_get(input->frame->metadata, SC_DECODER_METADATA_LATENCY_US,
+                    NULL, 0);
+    if (latency) {
+        long long us = strtoll(latency->value, NULL, 10);
+        arrival -= SC_TICK_FROM_US(us);
+    }
+
+    return arrival;
+}
+
+// Return the frame to forward to the sinks: either the processed frame or its
+// preview (vp->preview), or NULL if the frame is stale (it must not be
+// forwarded)
+static AVFrame *
+sc_video_processor_process(struct sc_video_processor *vp, AVFrame *frame,
+                           uint64_t frame_number, sc_tick arrival,
+                           bool stale) {
+    if (vp->save_frames && vp->frame_writer_pre_trigger
+            && sc_capture_trigger_poll(&vp->trigger_seen)) {
+        // Before this frame is pushed, so that it is written (after the
+        // frames in flight on the GPU)
+        sc_video_processor_complete_readbacks(vp, true);
+        sc_frame_writer_trigger(&vp->frame_writer);
+    }
+
+    // The subsampling is decided first, to skip any per-output processing
+    bool key_frame = sc_video_processor_is_key_frame(frame);
+    bool save = vp->save_frames
+             && sc_frame_decimator_accept(&vp->save_decimator, frame->pts,
+                                          key_frame);
+    bool output = vp->outputs
+               && sc_frame_decimator_accept(&vp->output_decimator, frame->pts,
+                                            key_frame);
+    if (vp->outputs && !output && !vp->output_skipped) {
+        // Not a discontinuity for the pipe readers
+        vp->output_skipped = true;
+        vp->output_skipped_from = frame_number;
+    }
+
+    vp->frame_times = (struct sc_frame_times) {
+        .start_us = -1,
+        .mid_us = -1,
+    };
+    if (vp->show_timestamps || save || output || vp->export_timestamp) {
+        // With the exposure, if any, computed once for all the outputs
+        sc_frame_clock_get_times(&vp->clock, frame->metadata, frame->pts,
+                                 &vp->frame_times);
+    }
+    int64_t timestamp_us = vp->frame_times.start_us;
+
+    if ((save || output) && vp->motion_threshold > 0
+            && !sc_video_processor_has_motion(vp, frame)) {
+        // Before any effect: only the timestamp of the frame is output
+        ++vp->static_count;
+        sc_metrics_add(SC_METRIC_STATIC_FRAMES, 1);
+        sc_video_processor_record_repeated(vp, frame_number, timestamp_us,
+                                           save, output);
+        save = false;
+        output = false;
+    }
+    int64_t timestamp_ms = sc_frame_clock_us_to_ms(timestamp_us);
+
+    vp->filtered_timestamp_us = -1;
+    vp->timestamp_outlier = false;
+    if ((save || output) && timestamp_us >= 0) {
+        vp->filtered_timestamp_us =
+            sc_timestamp_filter_push(&vp->timestamp_filter, timestamp_us,
+                                     arrival, &vp->timestamp_outlier);
+    }
+
+    char timestamp_str[SC_TIMESTAMP_STR_SIZE];
+    const char *show_text = NULL;
+    if (vp->show_timestamps) {
+        if (timestamp_ms < 0) {
+            snprintf(timestamp_str, sizeof(timestamp_str), "%s",
+                     "No timestamps");
+        } else {
+            fromTimestamp(timestamp_ms, timestamp_str, sizeof(timestamp_str));
+        }
+        show_text = timestamp_str;
+    }
+
+    if (vp->auto_tune) {
+        // Between two frames, the effects are not running
+        sc_auto_tune_apply();
+    }
+
+    sc_tick start = sc_tick_now();
+
+    AVFrame *forwarded = stale ? NULL : frame;
+    if (!stale && vp->preview_scale > 1) {
+        // Computed from the decoded frame, before any full resolution effect
+        if (apply_video_effects_preview(frame, vp->preview, vp->preview_scale,
+                                        vp->remap, show_text,
+                                        &vp->preview_pool)) {
+            forwarded = vp->preview;
+        }
+    }
+
+    // If the frame is only saved, in RGB, it is rectified by the frame writer
+    // while it is converted (in a single pass, without writing the rectified
+    // YUV planes)
+    bool save_unrectified = save && !output && forwarded != frame
+                         && vp->remap && !vp->show_timestamps
+                         && !vp->luma_only
+                         && frame->format == AV_PIX_FMT_YUV420P
+                         && sc_frame_writer_can_rectify(&vp->frame_writer);
+
+    // The full resolution frame is only needed by the other outputs if the
+    // preview is forwarded to the sinks
+    bool full_needed = forwarded == frame || output
+                    || (save && !save_unrectified);
+    // The chroma planes are only needed if the frame is forwarded to sinks
+    // which use them
+    bool color_sinks = forwarded == frame && vp->frame_source.sink_count
+                    && !vp->luma_sinks;
+    bool luma_only = vp->luma_only && !color_sinks;
+    if (full_needed && (vp->remap || vp->show_timestamps)) {
+        apply_video_effects(frame, vp->remap, show_text, luma_only,
+                            &vp->frame_pool);
+    }
+
+    struct sc_video_processor_delivery delivery = {
+        .frame_number = frame_number,
+        .pts = frame->pts,
+        .save = save,
+        .output = output,
+        .unrectified = save_unrectified,
+        .timestamp_us = timestamp_us,
+        .filtered_timestamp_us = vp->filtered_timestamp_us,
+        .timestamp_outlier = vp->timestamp_outlier,
+        .frame_times = vp->frame_times,
+    };
+
+    // The outputs are rectified on the GPU, the frame is forwarded as is
+    bool read_back = (save || output) && vp->gl_readback
+                  && sc_video_processor_push_readback(vp, frame, &delivery);
+
+    // The frame saved, piped, shared and published (only its Y plane with
+    // luma_only), NULL if it could not be referenced
+    const AVFrame *out_frame = frame;
+    if (!read_back && (save || output)) {
+        if (frame->format == AV_PIX_FMT_YUV420P && !luma_only) {
+            // Its content is final: the representations derived by its
+            // consumers (e.g. RGB24 to save it) are computed once, and shared
+            // with the other consumers (on error, each one computes its own)
+            sc_frame_cache_attach(frame);
+        }
+
+        if (vp->luma_only && frame->format == AV_PIX_FMT_YUV420P) {
+            if (luma_only) {
+                // Not processed, the chroma planes of this reference are just
+                // released
+                sc_frame_keep_luma(frame);
+            } else if (!sc_frame_cache_get(frame, SC_FRAME_CACHE_LUMA, NULL,
+                                           vp->luma)) {
+                // The frame is forwarded in color to the sinks
+                out_frame = NULL;
+            } else {
+                out_frame = vp->luma;
+            }
+        }
+    }
+    sc_latency_trace_stamp(SC_LATENCY_STAGE_PREPROCESS, frame->pts);
+    sc_metrics_add(SC_METRIC_PROCESSED_FRAMES, 1);
+    sc_metrics_add(SC_METRIC_PREPROCESS_US,
+                   SC_TICK_TO_US(sc_tick_now() - start));
+
+    if (!read_back) {
+        // After the frames in flight on the GPU, if any
+        sc_video_processor_complete_readbacks(vp, true);
+        sc_video_processor_deliver(vp, out_frame, &delivery);
+    }
+
+    if (out_frame && out_frame == vp->luma) {
+        // The outputs hold their own references
+        av_frame_unref(vp->luma);
+    }
+
+    if (forwarded && vp->export_timestamp && timestamp_ms >= 0) {
+        char value[32];
+        snprintf(value, sizeof(value), "%" PRId64, timestamp_ms);
+        // On allocation failure, the frame is just not synchronized
+        av_dict_set(&forwarded->metadata,
+                    SC_VIDEO_PROCESSOR_METADATA_TIMESTAMP_MS, value, 0);
+    }
+
+    return forwarded;
+}
+
+// Preallocate the processed frames for the announced video size, while the
+// other sinks are being opened, so that the first frames are not delayed by
+// the allocations (on failure, they are allocated on the first frames)
+static void
+sc_video_processor_prepare(struct sc_video_processor *vp) {
+    int text_height = vp->show_timestamps ? SC_VIDEO_PREPROCESS_TEXT_HEIGHT
+                                          : 0;
+    bool ok = true;
+
+    if (vp->remap || vp->show_timestamps) {
+        // As decided for each frame (the full resolution frame is forwarded
+        // to the sinks if there is no preview)
+        bool color_sinks = vp->preview_scale <= 1
+                        && vp->frame_source.sink_count && !vp->luma_sinks;
+        int format = vp->luma_only && !color_sinks ? AV_PIX_FMT_GRAY8
+                                                   : AV_PIX_FMT_YUV420P;
+        ok = sc_frame_pool_prepare(&vp->frame_pool, format, vp->width,
+                                   vp->height + text_height,
+                                   SC_VIDEO_PROCESSOR_PREPARED_FRAMES);
+    }
+
+    if (ok && vp->preview_scale > 1) {
+        int width;
+        int height;
+        ok = sc_video_preprocess_get_preview_size(vp->remap,
+                                                  vp->preview_scale,
+                                                  vp->width, vp->height,
+                                                  &width, &height)
+          && sc_frame_pool_prepare(&vp->preview_pool, AV_PIX_FMT_YUV420P,
+                                   width, height + text_height,
+                                   SC_VIDEO_PROCESSOR_PREPARED_FRAMES);
+    }
+
+    if (!ok) {
+        LOGW("Could not preallocate the processed frames");
+    }
+}
+
+static int
+run_video_processor(void *data) {
+    struct sc_video_processor *vp = data;
+
+    (void) sc_alloc_stats_enter(SC_ALLOC_PREPROCESS);
+
+    if (vp->cpu_affinity) {
+        // On failure, the warning is logged and the thread is not pinned
+        (void) sc_thread_set_affinity(vp->cpu_affinity);
+    }
+
+    // After pinning, so that the pages are faulted in from the node of the
+    // processor thread
+    sc_video_processor_prepare(vp);
+
+    if (vp->needs_boot_time) {
+        // Frames received meanwhile wait in the queue (or are dropped)
+        sc_frame_clock_prepare(&vp->clock);
+    }
+
+    if (vp->gl_readback && !sc_gl_readback_start(vp->gl_readback)) {
+        LOGE("Could not start GPU readback, stopping");
+        vp->gl_readback = NULL;
+        sc_mutex_lock(&vp->mutex);
+        vp->stopped = true;
+        sc_mutex_unlock(&vp->mutex);
+        goto stopped;
+    }
+
+    for (;;) {
+        sc_mutex_lock(&vp->mutex);
+
+        // While paused, the last frame is held in the queue, unprocessed
+        while (!vp->stopped && (sc_vecdeque_is_empty(&vp->queue)
+                                || vp->paused)) {
+            if (!vp->readback_count) {
+                sc_cond_wait(&vp->queue_cond, &vp->mutex);
+                continue;
+            }
+
+            // Deliver the frames read back meanwhile
+            sc_tick deadline = sc_tick_now()
+                             + SC_VIDEO_PROCESSOR_READBACK_POLL;
+            sc_cond_timedwait(&vp->queue_cond, &vp->mutex, deadline);
+            sc_mutex_unlock(&vp->mutex);
+            sc_video_processor_complete_readbacks(vp, false);
+            sc_mutex_lock(&vp->mutex);
+        }
+
+        if (vp->stopped) {
+            sc_mutex_unlock(&vp->mutex);
+            goto stopped;
+        }
+
+        struct sc_video_processor_input input = sc_vecdeque_pop(&vp->queue);
+        uint64_t frame_number = input.frame_number;
+        sc_metrics_set(SC_METRIC_PROCESSOR_QUEUE, sc_vecdeque_size(&vp->queue));
+        // A frame held while paused is late by design, it must not be
+        // discarded as stale
+        bool held = vp->resumed;
+        vp->resumed = false;
+        sc_mutex_unlock(&vp->mutex);
+
+        AVFrame *frame = input.frame;
+
+        sc_video_processor_complete_readbacks(vp, false);
+
+        if (vp->pose_buffer) {
+            sc_video_processor_take_poses(vp);
+        }
+
+        // The drops precede the frame in the outputs
+        sc_video_processor_report_drops(vp);
+
+        sc_video_processor_check_resumed(vp, frame, frame_number);
+
+        if (vp->skip_repeated && sc_video_processor_is_repeated(frame)) {
+            // The sinks keep the previous frame
+            sc_video_processor_skip_repeated(vp, frame, frame_number);
+            av_frame_free(&frame);
+            continue;
+        }
+
+        if (vp->latency_probe) {
+            // Before any effect moves the pattern
+            sc_latency_probe_measure(frame);
+        }
+
+        sc_tick arrival = sc_video_processor_get_arrival(&input);
+        bool stale = vp->latency_budget && !held
+                  && sc_tick_now() - arrival > vp->latency_budget;
+        if (stale) {
+            ++vp->stale_count;
+            sc_metrics_add(SC_METRIC_STALE_FRAMES, 1);
+        }
+
+        AVFrame *forwarded = sc_video_processor_process(vp, frame,
+                                                        frame_number, arrival,
+                                                        stale);
+
+        // Without sinks, the frames are only piped
+        bool ok = !forwarded || !vp->frame_source.sink_count
+               || sc_frame_source_sinks_push(&vp->frame_source, forwarded);
+        if (forwarded && forwarded == vp->preview) {
+            // Release the preview buffer to the pool
+            av_frame_unref(vp->preview);
+        }
+        av_frame_free(&frame);
+        if (!ok) {
+            LOGE("Processed frame could not be pushed, stopping");
+            sc_mutex_lock(&vp->mutex);
+            // Prevent to push any new frame
+            vp->stopped = true;
+            sc_mutex_unlock(&vp->mutex);
+            goto stopped;
+        }
+    }
+
+stopped:
+    assert(vp->stopped);
+
+    if (vp->gl_readback) {
+        // The frames submitted are still saved and output
+        sc_video_processor_complete_readbacks(vp, true);
+        sc_gl_readback_stop(vp->gl_readback);
+    }
+
+    // Flush queue
+    while (!sc_vecdeque_is_empty(&vp->queue)) {
+        struct sc_video_processor_input *input =
+            sc_vecdeque_popref(&vp->queue);
+        av_frame_free(&input->frame);
+    }
+    while (!sc_vecdeque_is_empty(&vp->pending_drops)) {
+        struct sc_video_processor_drop *drop =
+            sc_vecdeque_popref(&vp->pending_drops);
+        av_dict_free(&drop->metadata);
+    }
+
+    LOGD("Video processor thread ended");
+
+    return 0;
+}
+
+static void
+sc_video_processor_write_output(struct sc_video_processor *vp,
+                                struct sc_video_processor_output *out) {
+    if (out->pose_count && vp->pipe_output) {
+        if (vp->pipe_mutex) {
+            sc_mutex_lock(vp->pipe_mutex);
+        }
+        bool ok = sc_frame_pipe_write_poses(out->poses, out->pose_count,
+                                            vp->pipe_device);
+        if (vp->pipe_mutex) {
+            sc_mutex_unlock(vp->pipe_mutex);
+        }
+        if (!ok) {
+            LOGE("Could not write to stdout, disabling pipe output");
+            vp->pipe_output = false;
+        }
+    }
+
+    if (out->dropped) {
+        if (vp->pipe_output && !pipe_drop(vp, out->frame_number,
+                                          out->drop_reason,
+                                          out->timestamp_us)) {
+            LOGE("Could not write to stdout, disabling pipe output");
+            vp->pipe_output = false;
+        }
+        if (vp->publish_port) {
+            sc_frame_publisher_push_drop(&vp->publisher, out->frame_number,
+                                         out->drop_reason, out->timestamp_us);
+        }
+        return;
+    }
+
+    const AVFrame *frame = out->frame;
+    int64_t timestamp_ms = sc_frame_clock_us_to_ms(out->timestamp_us);
+
+    struct sc_frame_pipe_info info = {
+        .format = vp->pipe_format,
+        .timestamp_us = out->timestamp_us,
+        .sequence = out->frame_number,
+        .sampled_from = out->sampled_from,
+        .flags = (vp->rectified ? FRAME_FLAG_RECTIFIED : 0)
+               | (out->interrupted ? FRAME_FLAG_DISCONTINUITY : 0),
+        .content_y = vp->show_timestamps ? SC_VIDEO_PREPROCESS_TEXT_HEIGHT : 0,
+    };
+    if (vp->pipe_payload_crc) {
+        info.flags |= FRAME_FLAG_PAYLOAD_CRC;
+    }
+    if (out->filtered_timestamp_us >= 0) {
+        info.flags |= FRAME_FLAG_FILTERED_TIMESTAMP;
+        info.filtered_timestamp_us = out->filtered_timestamp_us;
+        if (out->timestamp_outlier) {
+            info.flags |= FRAME_FLAG_TIMESTAMP_OUTLIER;
+        }
+    }
+    if (out->exposure_ns && out->timestamp_us >= 0) {
+        info.flags |= FRAME_FLAG_EXPOSURE;
+        info.mid_exposure_us = out->mid_exposure_us;
+        info.exposure_ns = out->exposure_ns;
+        info.readout_ns = out->readout_ns;
+    }
+
+    if (vp->publish_port) {
+        if (frame->height <= SC_FRAME_PIPE_MAX_ROWS) {
+            // Queued for the subscribers (the discontinuities are computed for
+            // each one)
+            sc_frame_publisher_push(&vp->publisher, frame, &info);
+        } else {
+            sc_frame_publisher_push_drop(&vp->publisher, out->frame_number,
+                                         SC_FRAME_DROP_WRITE_FAILED,
+                                         out->timestamp_us);
+        }
+    }
+
+    // Built once for the pipe and the shared memory
+    const struct sc_frame_pyramid *pyramid = NULL;
+    if (vp->pyramid_output && (vp->pipe_output || vp->shm_output)) {
+        if (sc_frame_pyramid_build(&vp->pyramid, frame)) {
+            pyramid = &vp->pyramid;
+        } else {
+            LOGE("Could not build the pyramid, disabling pyramid output");
+            vp->pyramid_output = false;
+        }
+    }
+
+    // Decided before writing, so that a late consumer never blocks the pipe
+    enum sc_pipe_feedback_decision decision = SC_PIPE_FEEDBACK_FULL;
+    if (vp->pipe_output && vp->pipe_feedback_port) {
+        bool luma = !vp->pipe_features
+                 && frame->format == AV_PIX_FMT_YUV420P;
+        decision = sc_pipe_feedback_admit(&vp->pipe_feedback,
+                                          out->frame_number, luma);
+    }
+
+    if (vp->pipe_output && decision == SC_PIPE_FEEDBACK_DROP) {
+        // The next piped frame is flagged as a discontinuity
+        sc_frame_drops_add(&vp->drops, SC_FRAME_DROP_SINK_BUSY);
+        if (!pipe_drop(vp, out->frame_number, SC_FRAME_DROP_SINK_BUSY,
+                       out->timestamp_us)) {
+            LOGE("Could not write to stdout, disabling pipe output");
+            vp->pipe_output = false;
+        }
+    } else if (vp->pipe_output) {
+        if (out->sampled_from != vp->pipe_next_number) {
+            info.flags |= FRAME_FLAG_DISCONTINUITY;
+        }
+        vp->pipe_next_number = out->frame_number + 1;
+
+        if (decision == SC_PIPE_FEEDBACK_LUMA
+                && frame->height <= SC_FRAME_PIPE_MAX_ROWS) {
+            // Only the Y plane of this reference, without pyramid nor depth
+            bool ok = !av_frame_ref(vp->pipe_luma, frame);
+            if (ok) {
+                sc_frame_keep_luma(vp->pipe_luma);
+                ok = pipe_frame(vp, vp->pipe_luma, &info);
+                av_frame_unref(vp->pipe_luma);
+            }
+            if (!ok) {
+                LOGE("Could not write frame to stdout, disabling pipe output");
+                sc_frame_drops_add(&vp->drops, SC_FRAME_DROP_WRITE_FAILED);
+                vp->pipe_output = false;
+            } else {
+                sc_metrics_add(SC_METRIC_PIPED_FRAMES, 1);
+            }
+        } else if (vp->pipe_features) {
+            // The features are piped in place of the frame
+            if (!pipe_features(vp, frame, &info)) {
+                LOGE("Could not pipe the features, disabling pipe output");
+                sc_frame_drops_add(&vp->drops, SC_FRAME_DROP_WRITE_FAILED);
+                vp->pipe_output = false;
+            } else {
+                sc_metrics_add(SC_METRIC_PIPED_FRAMES, 1);
+            }
+        } else if (frame->height > SC_FRAME_PIPE_MAX_ROWS) {
+            LOGE("Frame too large to be piped (%dx%d), disabling pipe output",
+                 frame->width, frame->height);
+            vp->pipe_output = false;
+        } else if (!pipe_frame(vp, frame, &info)
+                || (pyramid && !pipe_pyramid(vp, pyramid, &info))
+                || (vp->pipe_depth && !pipe_depth(vp, frame, &info))) {
+            // Typically, the consumer closed the pipe
+            LOGE("Could not write frame to stdout, disabling pipe output");
+            sc_frame_drops_add(&vp->drops, SC_FRAME_DROP_WRITE_FAILED);
+            vp->pipe_output = false;
+        } else {
+            sc_metrics_add(SC_METRIC_PIPED_FRAMES, 1);
+        }
+    }
+
+    if (vp->shm_output) {
+        if (!sc_shm_output_push(&vp->shm, frame, pyramid, timestamp_ms)) {
+            LOGE("Could not write frame to shared memory, disabling shared "
+                 "memory output");
+            vp->shm_output = NULL;
+        }
+    }
+
+    if (vp->cuda_ipc_output) {
+        sc_video_preprocess_publish_cuda_ipc(vp->remap, frame->pts,
+                                             out->frame_number,
+                                             out->timestamp_us);
+    }
+
+    sc_latency_trace_stamp(SC_LATENCY_STAGE_OUTPUT, frame->pts);
+}
+
+static int
+run_video_processor_output(void *data) {
+    struct sc_video_processor *vp = data;
+
+    (void) sc_alloc_stats_enter(SC_ALLOC_PREPROCESS);
+
+    if (vp->cpu_affinity) {
+        (void) sc_thread_set_affinity(vp->cpu_affinity);
+    }
+
+    for (;;) {
+        sc_mutex_lock(&vp->mutex);
+        while (!vp->output_stopped && !vp->output_count) {
+            sc_cond_wait(&vp->output_cond, &vp->mutex);
+        }
+
+        if (!vp->output_count) {
+            // Stopped, and all the pending outputs have been written
+            assert(vp->output_stopped);
+            sc_mutex_unlock(&vp->mutex);
+            break;
+        }
+
+        struct sc_video_processor_output *out = &vp->pending[vp->output_head];
+        sc_mutex_unlock(&vp->mutex);
+
+        sc_video_processor_write_output(vp, out);
+        av_frame_unref(out->frame);
+
+        sc_mutex_lock(&vp->mutex);
+        vp->output_head = (vp->output_head + 1)
+                        % SC_VIDEO_PROCESSOR_OUTPUT_DEPTH;
+        --vp->output_count;
+        sc_cond_signal(&vp->output_cond);
+        sc_mutex_unlock(&vp->mutex);
+    }
+
+    LOGD("Video processor output thread ended");
+
+    return 0;
+}
+
+static void
+sc_video_processor_free_outputs(struct sc_video_processor *vp) {
+    for (unsigned i = 0; i < SC_VIDEO_PROCESSOR_OUTPUT_DEPTH; ++i) {
+        av_frame_free(&vp->pending[i].frame);
+    }
+}
+
+static bool
+sc_video_processor_start_outputs(struct sc_video_processor *vp) {
+    for (unsigned i = 0; i < SC_VIDEO_PROCESSOR_OUTPUT_DEPTH; ++i) {
+        vp->pending[i].frame = NULL;
+    }
+
+    if (!vp->outputs) {
+        return true;
+    }
+
+    for (unsigned i = 0; i < SC_VIDEO_PROCESSOR_OUTPUT_DEPTH; ++i) {
+        vp->pending[i].frame = av_frame_alloc();
+        if (!vp->pending[i].frame) {
+            LOG_OOM();
+            goto error_free_outputs;
+        }
+    }
+
+    if (!sc_cond_init(&vp->output_cond)) {
+        goto error_free_outputs;
+    }
+
+    vp->output_head = 0;
+    vp->output_count = 0;
+    vp->output_stopped = false;
+
+    bool ok = sc_thread_create(&vp->output_thread, run_video_processor_output,
+                               "scrcpy-vpout", vp);
+    if (!ok) {
+        LOGE("Could not start video processor output thread");
+        sc_cond_destroy(&vp->output_cond);
+        goto error_free_outputs;
+    }
+
+    return true;
+
+error_free_outputs:
+    sc_video_processor_free_outputs(vp);
+    return false;
+}
+
+// The processor thread must be joined
+static void
+sc_video_processor_stop_outputs(struct sc_video_processor *vp) {
+    if (!vp->outputs) {
+        return;
+    }
+
+    sc_mutex_lock(&vp->mutex);
+    vp->output_stopped = true;
+    sc_cond_signal(&vp->output_cond);
+    sc_mutex_unlock(&vp->mutex);
+
+    sc_thread_join(&vp->output_thread, NULL);
+
+    sc_cond_destroy(&vp->output_cond);
+    sc_video_processor_free_outputs(vp);
+}
+
+static bool
+sc_video_processor_frame_sink_open(struct sc_frame_sink *sink,
+                                   const AVCodecContext *ctx) {
+    struct sc_video_processor *vp = DOWNCAST(sink);
+
+    // Fail immediately if the maps cannot be scaled to the negotiated video
+    // size (they are scaled now rather than on the first frame)
+    if (vp->remap && !sc_video_preprocess_check_size(vp->remap, ctx->width,
+                                                     ctx->height)) {
+        return false;
+    }
+    if (vp->gl_readback
+            && !sc_video_preprocess_check_size(vp->gl_readback->vpp,
+                                               ctx->width, ctx->height)) {
+        return false;
+    }
+
+    bool ok = sc_mutex_init(&vp->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&vp->queue_cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    sc_vecdeque_init(&vp->queue);
+    ok = sc_vecdeque_reserve(&vp->queue, SC_VIDEO_PROCESSOR_QUEUE_SIZE);
+    if (!ok) {
+        LOG_OOM();
+        goto error_destroy_queue_cond;
+    }
+
+    sc_vecdeque_init(&vp->pending_drops);
+    ok = sc_vecdeque_reserve(&vp->pending_drops,
+                             SC_VIDEO_PROCESSOR_PENDING_DROPS);
+    if (!ok) {
+        LOG_OOM();
+        goto error_destroy_queue;
+    }
+
+    vp->width = ctx->width;
+    vp->height = ctx->height;
+    sc_frame_pool_init(&vp->frame_pool);
+    sc_frame_pool_init(&vp->preview_pool);
+    sc_frame_pool_init(&vp->depth_pool);
+    vp->preview = NULL;
+    vp->luma = NULL;
+    vp->readback = NULL;
+    vp->pipe_luma = NULL;
+    vp->depth = NULL;
+    vp->features = NULL;
+
+    if (vp->preview_scale > 1) {
+        vp->preview = av_frame_alloc();
+        if (!vp->preview) {
+            LOG_OOM();
+            goto error_destroy_frame_pool;
+        }
+    }
+
+    if (vp->luma_only) {
+        vp->luma = av_frame_alloc();
+        if (!vp->luma) {
+            LOG_OOM();
+            goto error_destroy_frame_pool;
+        }
+    }
+
+    if (vp->gl_readback) {
+        vp->readback = av_frame_alloc();
+        if (!vp->readback) {
+            LOG_OOM();
+            goto error_destroy_frame_pool;
+        }
+    }
+
+    if (vp->pipe_feedback_port) {
+        vp->pipe_luma = av_frame_alloc();
+        if (!vp->pipe_luma) {
+            LOG_OOM();
+            goto error_destroy_frame_pool;
+        }
+    }
+
+    if (vp->pipe_depth) {
+        vp->depth = av_frame_alloc();
+        if (!vp->depth) {
+            LOG_OOM();
+            goto error_destroy_frame_pool;
+        }
+    }
+
+    if (vp->pipe_features) {
+        vp->features = malloc(sizeof(*vp->features));
+        if (!vp->features) {
+            LOG_OOM();
+            goto error_destroy_frame_pool;
+        }
+    }
+
+    if (vp->pyramid_levels) {
+        if (!sc_frame_pyramid_init(&vp->pyramid, vp->pyramid_levels)) {
+            goto error_destroy_frame_pool;
+        }
+    }
+    vp->pyramid_output = vp->pyramid_levels;
+
+    if (vp->save_frames) {
+        struct sc_frame_writer_params fw_params = {
+            .directory = vp->frame_archive ? NULL : vp->frame_dir,
+            .archive_path = vp->frame_archive,
+            .format = vp->frame_writer_format,
+            .quality = vp->frame_writer_quality,
+            .io = vp->frame_writer_io,
+            .direct = vp->frame_writer_direct,
+            .zstd_level = vp->frame_writer_zstd_level,
+            .zstd_dictionary = vp->frame_writer_zstd_dict,
+            .tile_delta = vp->frame_writer_tile_delta,
+            .tile_threshold = vp->frame_writer_tile_threshold,
+            .key_interval = vp->frame_writer_key_interval,
+            .expected_duration = vp->frame_writer_duration,
+            .pre_trigger = vp->frame_writer_pre_trigger,
+            .post_trigger = vp->frame_writer_post_trigger,
+            // With --auto-tune, all the I/O threads are started, and only
+            // the number requested are active
+            .thread_count = vp->auto_tune ? SC_FRAME_WRITER_MAX_THREADS
+                                          : vp->frame_writer_threads,
+            .active_threads = vp->auto_tune ? vp->frame_writer_threads : 0,
+            .uploader = vp->frame_writer_uploader,
+            .remap = vp->remap,
+            // The saved frames are processed at full resolution
+            .width = ctx->width,
+            .height = ctx->height + (vp->show_timestamps
+                                   ? SC_VIDEO_PREPROCESS_TEXT_HEIGHT : 0),
+            .gray = vp->luma_only,
+        };
+        ok = sc_frame_writer_init(&vp->frame_writer, &fw_params);
+        if (!ok) {
+            goto error_destroy_pyramid;
+        }
+
+        ok = sc_frame_writer_start(&vp->frame_writer);
+        if (!ok) {
+            sc_frame_writer_destroy(&vp->frame_writer);
+            goto error_destroy_pyramid;
+        }
+
+        if (vp->auto_tune) {
+            sc_auto_tune_set_frame_writer(&vp->frame_writer);
+        }
+    }
+
+    if (vp->publish_port) {
+        struct sc_frame_publisher_params fp_params = {
+            .host = vp->publish_host,
+            .port = vp->publish_port,
+            .queue_size = vp->publish_queue,
+            .drop = vp->publish_drop,
+        };
+        ok = sc_frame_publisher_init(&vp->publisher, &fp_params);
+        if (!ok) {
+            goto error_stop_frame_writer;
+        }
+
+        ok = sc_frame_publisher_start(&vp->publisher);
+        if (!ok) {
+            sc_frame_publisher_destroy(&vp->publisher);
+            goto error_stop_frame_writer;
+        }
+    }
+
+    if (vp->pipe_feedback_port) {
+        struct sc_pipe_feedback_params pf_params = {
+            .host = vp->pipe_feedback_host,
+            .port = vp->pipe_feedback_port,
+            .policy = vp->pipe_backpressure,
+        };
+        ok = sc_pipe_feedback_init(&vp->pipe_feedback, &pf_params);
+        if (!ok) {
+            goto error_stop_publisher;
+        }
+
+        ok = sc_pipe_feedback_start(&vp->pipe_feedback);
+        if (!ok) {
+            sc_pipe_feedback_destroy(&vp->pipe_feedback);
+            goto error_stop_publisher;
+        }
+    }
+
+    vp->input_count = 0;
+    vp->stale_count = 0;
+    vp->repeated_count = 0;
+    vp->static_count = 0;
+    vp->gap_count = 0;
+    sc_motion_gate_init(&vp->motion_gate, vp->motion_threshold);
+    sc_timestamp_filter_init(&vp->timestamp_filter);
+    vp->filtered_timestamp_us = -1;
+    vp->timestamp_outlier = false;
+    vp->frame_times = (struct sc_frame_times) {
+        .start_us = -1,
+        .mid_us = -1,
+    };
+    sc_frame_drops_init(&vp->drops, "Video processor");
+    vp->stopped = false;
+
+    if (vp->frame_source.sink_count
+            && !sc_frame_source_sinks_open(&vp->frame_source, ctx)) {
+        goto error_stop_pipe_feedback;
+    }
+
+    if (!sc_video_processor_start_outputs(vp)) {
+        goto error_close_sinks;
+    }
+
+    ok = sc_thread_create(&vp->thread, run_video_processor, "scrcpy-vproc",
+                          vp);
+    if (!ok) {
+        LOGE("Could not start video processor thread");
+        goto error_stop_outputs;
+    }
+
+    return true;
+
+error_stop_outputs:
+    sc_video_processor_stop_outputs(vp);
+error_close_sinks:
+    if (vp->frame_source.sink_count) {
+        sc_frame_source_sinks_close(&vp->frame_source);
+    }
+error_stop_pipe_feedback:
+    if (vp->pipe_feedback_port) {
+        sc_pipe_feedback_stop(&vp->pipe_feedback);
+        sc_pipe_feedback_join(&vp->pipe_feedback);
+        sc_pipe_feedback_destroy(&vp->pipe_feedback);
+    }
+error_stop_publisher:
+    if (vp->publish_port) {
+        sc_frame_publisher_stop(&vp->publisher);
+        sc_frame_publisher_join(&vp->publisher);
+        sc_frame_publisher_destroy(&vp->publisher);
+    }
+error_stop_frame_writer:
+    if (vp->save_frames) {
+        if (vp->auto_tune) {
+            sc_auto_tune_set_frame_writer(NULL);
+        }
+        sc_frame_writer_stop(&vp->frame_writer);
+        sc_frame_writer_join(&vp->frame_writer);
+        sc_frame_writer_destroy(&vp->frame_writer);
+    }
+error_destroy_pyramid:
+    if (vp->pyramid_levels) {
+        sc_frame_pyramid_destroy(&vp->pyramid);
+    }
+error_destroy_frame_pool:
+    free(vp->features);
+    av_frame_free(&vp->depth);
+    av_frame_free(&vp->luma);
+    av_frame_free(&vp->readback);
+    av_frame_free(&vp->pipe_luma);
+    av_frame_free(&vp->preview);
+    sc_frame_pool_destroy(&vp->depth_pool);
+    sc_frame_pool_destroy(&vp->preview_pool);
+    sc_frame_pool_destroy(&vp->frame_pool);
+    sc_vecdeque_destroy(&vp->pending_drops);
+error_destroy_queue:
+    sc_vecdeque_destroy(&vp->queue);
+error_destroy_queue_cond:
+    sc_cond_destroy(&vp->queue_cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&vp->mutex);
+
+    return false;
+}
+
+static void
+sc_video_processor_frame_sink_close(struct sc_frame_sink *sink) {
+    struct sc_video_processor *vp = DOWNCAST(sink);
+
+    sc_mutex_lock(&vp->mutex);
+    vp->stopped = true;
+    sc_cond_signal(&vp->queue_cond);
+    sc_mutex_unlock(&vp->mutex);
+
+    sc_thread_join(&vp->thread, NULL);
+
+    // The pending outputs are written before the thread terminates
+    sc_video_processor_stop_outputs(vp);
+
+    if (vp->frame_source.sink_count) {
+        sc_frame_source_sinks_close(&vp->frame_source);
+    }
+
+    sc_frame_drops_log(&vp->drops);
+    if (vp->stale_count) {
+        LOGI("Video processor: %" PRIu64 " stale frames not displayed",
+             vp->stale_count);
+    }
+    if (vp->repeated_count) {
+        LOGI("Video processor: %" PRIu64 " repeated frames skipped",
+             vp->repeated_count);
+    }
+    if (vp->static_count) {
+        LOGI("Video processor: %" PRIu64 " static frames not output (motion "
+             "gate)", vp->static_count);
+    }
+    if (vp->gap_count) {
+        LOGI("Video processor: %" PRIu64 " stream interruptions",
+             vp->gap_count);
+    }
+    if (vp->timestamp_filter.outliers || vp->timestamp_filter.restarts) {
+        LOGI("Video processor: %" PRIu64 " timestamp outliers, %" PRIu64
+             " timestamp filter restarts", vp->timestamp_filter.outliers,
+             vp->timestamp_filter.restarts);
+    }
+
+    if (vp->pipe_feedback_port) {
+        sc_pipe_feedback_stop(&vp->pipe_feedback);
+        sc_pipe_feedback_join(&vp->pipe_feedback);
+        sc_pipe_feedback_destroy(&vp->pipe_feedback);
+    }
+
+    if (vp->publish_port) {
+        sc_frame_publisher_stop(&vp->publisher);
+        sc_frame_publisher_join(&vp->publisher);
+        sc_frame_publisher_destroy(&vp->publisher);
+    }
+
+    if (vp->save_frames) {
+        if (vp->auto_tune) {
+            sc_auto_tune_set_frame_writer(NULL);
+        }
+        // The frames already queued are written before the threads terminate
+        sc_frame_writer_stop(&vp->frame_writer);
+        sc_frame_writer_join(&vp->frame_writer);
+        sc_frame_writer_destroy(&vp->frame_writer);
+    }
+
+    sc_shm_output_destroy(&vp->shm);
+    sc_motion_gate_destroy(&vp->motion_gate);
+    if (vp->pyramid_levels) {
+        sc_frame_pyramid_destroy(&vp->pyramid);
+    }
+    free(vp->features);
+    av_frame_free(&vp->depth);
+    av_frame_free(&vp->luma);
+    av_frame_free(&vp->readback);
+    av_frame_free(&vp->pipe_luma);
+    av_frame_free(&vp->preview);
+    sc_frame_pool_destroy(&vp->depth_pool);
+    sc_frame_pool_destroy(&vp->preview_pool);
+    sc_frame_pool_destroy(&vp->frame_pool);
+    sc_vecdeque_destroy(&vp->pending_drops);
+    sc_vecdeque_destroy(&vp->queue);
+    sc_cond_destroy(&vp->queue_cond);
+    sc_mutex_destroy(&vp->mutex);
+}
+
+static bool
+sc_video_processor_frame_sink_push(struct sc_frame_sink *sink,
+                                   const AVFrame *frame) {
+    struct sc_video_processor *vp = DOWNCAST(sink);
+
+    AVFrame *ref = av_frame_alloc();
+    if (!ref) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (av_frame_ref(ref, frame)) {
+        LOG_OOM();
+        av_frame_free(&ref);
+        return false;
+    }
+
+    // The frames not output by the decoder are numbered as if received
+    uint64_t skipped = 0;
+    AVDictionaryEntry *entry =
+        av_dict_get(ref->metadata, SC_DECODER_METADATA_SKIPPED, NULL, 0);
+    if (entry) {
+        skipped = strtoull(entry->value, NULL, 10);
+    }
+
+    sc_mutex_lock(&vp->mutex);
+
+    if (vp->stopped) {
+        sc_mutex_unlock(&vp->mutex);
+        av_frame_free(&ref);
+        return false;
+    }
+
+    if (vp->paused) {
+        // Only the last frame is held (the frames are only displayed, so the
+        // replaced ones need not be reported as dropped)
+        while (!sc_vecdeque_is_empty(&vp->queue)) {
+            AVFrame *old = sc_vecdeque_pop(&vp->queue).frame;
+            av_frame_free(&old);
+        }
+    } else if (sc_vecdeque_size(&vp->queue) >= SC_VIDEO_PROCESSOR_QUEUE_SIZE) {
+        // The processing is too slow, drop the oldest pending frame (the
+        // capacity reserved on open may be larger than the queue size, so the
+        // size is compared explicitly)
+        struct sc_video_processor_input dropped =
+            sc_vecdeque_pop(&vp->queue);
+        AVFrame *old = dropped.frame;
+        if (sc_vecdeque_size(&vp->pending_drops)
+                < SC_VIDEO_PROCESSOR_PENDING_DROPS) {
+            struct sc_video_processor_drop drop = {
+                .frame_number = dropped.frame_number,
+                .pts = old->pts,
+                .metadata = old->metadata,
+            };
+            // Moved to the drop record
+            old->metadata = NULL;
+            sc_vecdeque_push_noresize(&vp->pending_drops, drop);
+        }
+        av_frame_free(&old);
+        sc_frame_drops_add(&vp->drops, SC_FRAME_DROP_QUEUE_FULL);
+        sc_metrics_add(SC_METRIC_PROCESSOR_DROPPED_FRAMES, 1);
+    }
+
+    struct sc_video_processor_input input = {
+        .frame = ref,
+        .recv_time = sc_tick_now(),
+        .frame_number = vp->input_count + skipped,
+    };
+    sc_vecdeque_push_noresize(&vp->queue, input);
+    vp->input_count = input.frame_number + 1;
+    sc_metrics_set(SC_METRIC_PROCESSOR_QUEUE, sc_vecdeque_size(&vp->queue));
+    sc_cond_signal(&vp->queue_cond);
+
+    sc_mutex_unlock(&vp->mutex);
+
+    return true;
+}
+
+void
+sc_video_processor_set_paused(struct sc_video_processor *vp, bool paused) {
+    // The frames held while paused are not reported to the other outputs
+    assert(!vp->save_frames && !vp->outputs);
+
+    sc_mutex_lock(&vp->mutex);
+    if (vp->paused && !paused) {
+        // The held frame (if any) is processed first
+        vp->resumed = !sc_vecdeque_is_empty(&vp->queue);
+        sc_cond_signal(&vp->queue_cond);
+    }
+    vp->paused = paused;
+    sc_mutex_unlock(&vp->mutex);
+}
+
+bool
+sc_video_processor_init(struct sc_video_processor *vp,
+                        const struct sc_video_processor_params *params) {
+    vp->remap = params->remap;
+    vp->gl_readback = params->gl_readback;
+    vp->rectified = params->remap || params->gl_readback;
+    vp->readback_head = 0;
+    vp->readback_count = 0;
+    vp->preview_scale = params->preview_scale;
+    vp->show_timestamps = params->show_timestamps;
+    // The frames are saved either to separate files or to an archive
+    vp->save_frames = params->save_frames
+                   && (params->frame_dir || params->frame_archive);
+    vp->frame_dir = params->frame_dir;
+    vp->frame_archive = params->frame_archive;
+    vp->frame_writer_format = params->frame_writer_format;
+    vp->frame_writer_quality = params->frame_writer_quality;
+    vp->frame_writer_io = params->frame_writer_io;
+    vp->frame_writer_direct = params->frame_writer_direct;
+    vp->frame_writer_zstd_level = params->frame_writer_zstd_level;
+    vp->frame_writer_zstd_dict = params->frame_writer_zstd_dict;
+    vp->frame_writer_tile_delta = params->frame_writer_tile_delta;
+    vp->frame_writer_tile_threshold = params->frame_writer_tile_threshold;
+    vp->frame_writer_key_interval = params->frame_writer_key_interval;
+    vp->frame_writer_duration = params->frame_writer_duration;
+    vp->frame_writer_pre_trigger = params->frame_writer_pre_trigger;
+    vp->frame_writer_post_trigger = params->frame_writer_post_trigger;
+    vp->frame_writer_uploader = params->frame_writer_uploader;
+    vp->trigger_seen = sc_capture_trigger_count();
+    vp->frame_writer_threads = params->frame_writer_threads;
+    vp->auto_tune = params->auto_tune;
+    assert(!params->luma_only
+        || (params->frame_writer_format != SC_SAVE_FRAMES_FORMAT_QOI
+            && params->frame_writer_format != SC_SAVE_FRAMES_FORMAT_JPEG));
+    vp->luma_only = params->luma_only;
+    vp->luma_sinks = params->luma_sinks;
+    sc_frame_decimator_init(&vp->save_decimator, &params->save_rate);
+    sc_frame_decimator_init(&vp->output_decimator, &params->output_rate);
+    vp->output_skipped = false;
+    vp->output_interrupted = false;
+    vp->output_skipped_from = 0;
+    vp->pipe_output = params->pipe_output;
+    vp->pipe_format = params->pipe_format;
+    vp->pipe_payload_crc = params->pipe_payload_crc;
+    vp->pipe_next_number = 0;
+    assert(params->pipe_device < 0 || params->pipe_mutex);
+    vp->pipe_device = params->pipe_device;
+    vp->pipe_mutex = params->pipe_mutex;
+    // The disparities are only meaningful between rectified eyes
+    assert(!params->pipe_depth || (params->remap && params->pipe_output));
+    vp->pipe_depth = params->pipe_depth;
+    // The features are only meaningful on the rectified eyes
+    assert(!params->pipe_features
+        || (params->remap && params->pipe_output && !params->pipe_depth));
+    vp->pipe_features = params->pipe_features;
+    // The levels are piped in v2 records only
+    assert(!params->pyramid_levels
+        || (params->pipe_output && !params->pipe_features
+                && params->pipe_format == SC_PIPE_FORMAT_V2)
+        || (!params->pipe_output && params->shm_output));
+    vp->pyramid_levels = params->pyramid_levels;
+    // The acknowledgements refer to the sequence numbers of the v2 headers
+    assert(!params->pipe_feedback_port
+        || (params->pipe_output
+                && params->pipe_format == SC_PIPE_FORMAT_V2));
+    vp->pipe_feedback_port = params->pipe_feedback_port;
+    vp->pipe_feedback_host = params->pipe_feedback_host;
+    vp->pipe_backpressure = params->pipe_backpressure;
+    vp->shm_output = params->shm_output;
+    // The frames are exported by the remap
+    assert(!params->cuda_ipc_output || params->remap);
+    // The GPU readback replaces the CPU remap
+    assert(!(params->remap && params->gl_readback));
+    vp->cuda_ipc_output = params->cuda_ipc_output;
+    vp->publish_port = params->publish_port;
+    vp->publish_host = params->publish_host;
+    vp->publish_queue = params->publish_queue;
+    vp->publish_drop = params->publish_drop;
+    vp->outputs = vp->pipe_output || vp->shm_output || vp->publish_port
+                || vp->cuda_ipc_output;
+    vp->export_timestamp = params->export_timestamp;
+    vp->cpu_affinity = params->cpu_affinity;
+    vp->latency_budget = params->latency_budget;
+    vp->latency_probe = params->latency_probe;
+    vp->skip_repeated = params->skip_repeated;
+    assert(params->motion_threshold >= 0);
+    vp->motion_threshold = params->motion_threshold;
+    vp->paused = false;
+    vp->resumed = false;
+    vp->pose_buffer = params->pose_buffer;
+    vp->pose_count = 0;
+    sc_frame_clock_init(&vp->clock, params->clock_sync, params->serial);
+    sc_frame_clock_set_boot_time(&vp->clock, params->device_boot_time);
+
+    // Without control socket, the device clock cannot be synchronized: fall
+    // back to the boot time retrieved once via adb (from the processor thread,
+    // not to delay the window)
+    vp->needs_boot_time = !params->clock_sync
+                       && (params->save_frames || params->pipe_output
+                            || params->shm_output || params->publish_port
+                            || params->cuda_ipc_output
+                            || params->show_timestamps
+                            || params->export_timestamp);
+
+    // Create directory if it doesn't exist and saving is enabled
+    if (vp->save_frames && !vp->frame_archive) {
+#ifdef _WIN32
+        if (mkdir(vp->frame_dir) < 0 && errno != EEXIST) {
+#else
+        if (mkdir(vp->frame_dir, 0777) < 0 && errno != EEXIST) {
+#endif
+            LOGE("Could not create frame directory: %s", vp->frame_dir);
+            return false;
+        }
+    }
+
+    if (vp->pipe_output) {
+        sc_frame_pipe_init();
+    }
+
+    // The shared memory (if enabled) is created on the first frame
+    sc_shm_output_init(&vp->shm, vp->shm_output, vp->pyramid_levels);
+
+    sc_frame_source_init(&vp->frame_source);
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = sc_video_processor_frame_sink_open,
+        .close = sc_video_processor_frame_sink_close,
+        .push = sc_video_processor_frame_sink_push,
+    };
+
+    vp->frame_sink.ops = &ops;
+
+    return true;
+}
@@ -0,0 +1,460 @@
+#ifndef SC_VIDEO_PROCESSOR_H
+#define SC_VIDEO_PROCESSOR_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "clock_sync.h"
+#include "frame_clock.h"
+#include "frame_decimator.h"
+#include "frame_drops.h"
+#include "frame_pool.h"
+#include "frame_publisher.h"
+#include "frame_pyramid.h"
+#include "pipe_feedback.h"
+#include "frame_writer.h"
+#include "gl_readback.h"
+#include "motion_gate.h"
+#include "pose_buffer.h"
+#include "shm_output.h"
+#include "timestamp_filter.h"
+#include "trait/frame_source.h"
+#include "trait/frame_sink.h"
+#include "util/thread.h"
+#include "util/tick.h"
+#include "util/vecdeque.h"
+
+// forward declarations
+typedef struct AVDictionary AVDictionary;
+typedef struct AVFrame AVFrame;
+struct sc_video_features;
+struct sc_video_preprocess;
+
+// Number of decoded frames which may wait for processing. If the processing
+// is too slow, the oldest pending frames are dropped.
+#define SC_VIDEO_PROCESSOR_QUEUE_SIZE 3
+
+// A decoded frame waiting for processing
+struct sc_video_processor_input {
+    AVFrame *frame;
+    sc_tick recv_time; // time when the frame was pushed to the processor
+    // Including the frames not output by the decoder (see
+    // SC_DECODER_METADATA_SKIPPED)
+    uint64_t frame_number;
+};
+
+struct sc_video_processor_queue SC_VECDEQUE(struct sc_video_processor_input);
+
+// Number of dropped frames which may wait to be reported to the outputs (the
+// drops beyond are only counted)
+#define SC_VIDEO_PROCESSOR_PENDING_DROPS 16
+
+// A frame dropped from the queue, reported to the outputs from the processor
+// thread (where its timestamp can be computed)
+struct sc_video_processor_drop {
+    uint64_t frame_number;
+    int64_t pts;
+    AVDictionary *metadata; // owned, for the capture timestamp
+};
+
+struct sc_video_processor_drop_queue
+    SC_VECDEQUE(struct sc_video_processor_drop);
+
+// Number of processed frames which may wait to be piped or published in shared
+// memory. If these outputs are too slow, the processing waits (and the new
+// decoded frames are dropped from the queue).
+#define SC_VIDEO_PROCESSOR_OUTPUT_DEPTH 2
+
+// Number of processed frames preallocated once the video size is announced:
+// the frame being processed, the frames waiting for the outputs, and the frame
+// held by the sinks
+#define SC_VIDEO_PROCESSOR_PREPARED_FRAMES (SC_VIDEO_PROCESSOR_OUTPUT_DEPTH + 2)
+
+// Interval at which the frames in flight on the GPU are polled while the
+// processor waits for a new frame
+#define SC_VIDEO_PROCESSOR_READBACK_POLL SC_TICK_FROM_MS(2)
+
+// The outputs of a processed frame, delivered once its content is final (a
+// frame rectified on the GPU is delivered once read back)
+struct sc_video_processor_delivery {
+    uint64_t frame_number;
+    int64_t pts;
+    bool save;
+    bool output;
+    bool unrectified; // saved unrectified, rectified by the frame writer
+    int64_t timestamp_us;
+    int64_t filtered_timestamp_us;
+    bool timestamp_outlier;
+    struct sc_frame_times frame_times;
+};
+
+// A processed frame, or the record of a dropped frame, waiting for the output
+// thread
+struct sc_video_processor_output {
+    AVFrame *frame; // preallocated, empty for a dropped frame
+    bool dropped;
+    unsigned drop_reason; // FRAME_DROP_REASON_*, if dropped
+    uint64_t frame_number;
+    // The first of the frames skipped by the output rate just before this one
+    // (see struct sc_frame_pipe_info)
+    uint64_t sampled_from;
+    // The stream was interrupted before this frame (it is a discontinuity
+    // even if the frame numbers are contiguous)
+    bool interrupted;
+    int64_t timestamp_us; // capture time, -1 if unknown
+    // Capture time smoothed by the timestamp filter, -1 if unknown
+    int64_t filtered_timestamp_us;
+    bool timestamp_outlier;
+    // Exposure of the camera frame (--capture-exposure), exposure_ns 0 if
+    // unknown
+    int64_t mid_exposure_us;
+    uint32_t exposure_ns;
+    uint32_t readout_ns;
+    // Pose samples received before the frame, written to the pipe first
+    struct pose_sample_record poses[SC_POSE_BUFFER_CAPACITY];
+    unsigned pose_count;
+};
+
+// Metadata key of the capture timestamp (in milliseconds since the Unix epoch)
+// of the forwarded frames, if export_timestamp is set
+#define SC_VIDEO_PROCESSOR_METADATA_TIMESTAMP_MS "scrcpy_timestamp_ms"
+
+/**
+ * Video processing stage, between the decoder and the screen.
+ *
+ * It applies the OpenCV effects (stereo remap, timestamps), saves, pipes and
+ * publishes (in shared memory) the frames from its own thread, so that a slow
+ * disk or a slow pipe reader never blocks rendering and input handling on the
+ * main thread.
+ *
+ * The stages are pipelined: while a frame is decoded, the previous one is
+ * processed, and the one before is piped and published by a second thread (the
+ * saved frames have their own writer threads). The outputs receive the frames
+ * in order, with their timestamps.
+ *
+ * The processed frames are forwarded to its own frame sinks. The decoded frames
+ * are never deep-copied: they are forwarded by reference when no effect is
+ * enabled, and the effects write into pooled frames (see frame_pool.h).
+ *
+ * It may have no sinks at all, if the frames are only piped (--multi-device).
+ *
+ * If pipe_depth is set, the disparity map of each remapped frame is piped after
+ * the frame (see sc_video_preprocess_compute_depth()).
+ *
+ * If pipe_features is set, the features of each remapped frame (see
+ * sc_video_preprocess_extract_features()) are piped in place of the frame.
+ *
+ * If pyramid_levels is not 0, the Gaussian pyramid of each output frame (see
+ * frame_pyramid.h) is built once, and its selected levels are piped after the
+ * frame and written after it in the shared memory slot.
+ *
+ * The frames are numbered in the order they are received. The frames dropped
+ * because the processing is too slow are reported to the pipe and the saved
+ * frames archive, so that the consumers know which numbers are missing.
+ *
+ * If preview_scale > 1, the sinks receive a downscaled preview instead,
+ * computed directly from the decoded frame, so that the full resolution frame
+ * is processed only if it is saved, piped or published.
+ *
+ * If latency_budget is set, the frames older than the budget (since the
+ * reception of their packet) when their processing starts are not forwarded to
+ * the sinks, so that the display never lags behind the device. They are still
+ * processed (at full resolution only) if they are saved, piped or published.
+ *
+ * If skip_repeated is set, the frames repeated by the device encoder (see
+ * SC_DEMUXER_METADATA_REPEATED) are neither processed, forwarded, saved, piped
+ * nor published: only their record is written to the pipe and the archive
+ * index, as for the dropped frames.
+ *
+ * If motion_threshold is set, the saved and output frames which barely differ
+ * from the last one saved or output (see motion_gate.h) are neither processed
+ * for these outputs, saved, piped, shared nor published: they are recorded as
+ * repeated frames, so that the timeline stays complete. They are still
+ * forwarded to the sinks.
+ *
+ * If pose_buffer is set, the headset pose samples received meanwhile are taken
+ * on each frame, and written to the pipe before it and to the frame archive.
+ *
+ * The saved frames and the output frames (piped, shared and published) may be
+ * subsampled independently (save_rate and output_rate), before any effect or
+ * conversion: a frame is processed only if it is forwarded or output. The
+ * frames skipped on purpose are not recorded as dropped.
+ *
+ * The capture timestamps of the saved and output frames are also filtered
+ * against the arrival times of the frames (see timestamp_filter.h): both the
+ * raw and the filtered timestamps are written to the v2 frame headers and to
+ * the frame archive.
+ *
+ * If luma_only is set, only the Y plane (GRAY8) is saved, piped, shared and
+ * published. The chroma planes are not even processed, unless the full frame
+ * is forwarded to sinks which need them (i.e. if luma_sinks is not set).
+ *
+ * If pipe_feedback_port is set, the pipe consumer reports the frames it has
+ * processed (see pipe_feedback.h): beyond its capacity, the output thread
+ * pipes only the Y plane of the next frames or a drop record in their place,
+ * rather than blocking on the pipe.
+ */
+struct sc_video_processor {
+    struct sc_frame_source frame_source; // frame source trait
+    struct sc_frame_sink frame_sink; // frame sink trait
+
+    // stereo remap maps (see sc_video_preprocess_new()), NULL to disable
+    const struct sc_video_preprocess *remap;
+    // Rectify the frames saved and output on the GPU, the frames forwarded to
+    // the sinks are not rectified (NULL to disable)
+    struct sc_gl_readback *gl_readback;
+    // The saved and output frames are rectified (by remap or gl_readback)
+    bool rectified;
+    // If greater than 1, the frames forwarded to the sinks are downscaled
+    // (the other outputs keep the full resolution)
+    unsigned preview_scale;
+    bool show_timestamps;
+    bool save_frames;
+    const char *frame_dir;
+    const char *frame_archive; // if set, frame_dir is ignored
+    enum sc_save_frames_format frame_writer_format;
+    unsigned frame_writer_quality; // JPEG quality, 0 for the default
+    enum sc_save_frames_io frame_writer_io;
+    bool frame_writer_direct;
+    int frame_writer_zstd_level; // 0 to disable
+    const char *frame_writer_zstd_dict; // NULL if none
+    bool frame_writer_tile_delta;
+    float frame_writer_tile_threshold;
+    unsigned frame_writer_key_interval;
+    sc_tick frame_writer_duration; // expected duration, 0 if unknown
+    sc_tick frame_writer_pre_trigger;
+    sc_tick frame_writer_post_trigger;
+    unsigned trigger_seen; // see sc_capture_trigger_poll()
+    unsigned frame_writer_threads;
+    bool auto_tune; // the thread pools are resized by the tuner
+    struct sc_uploader *frame_writer_uploader; // NULL if none
+    bool luma_only; // --output-planes=y
+    bool luma_sinks; // the sinks only need the Y plane (with luma_only)
+    // Only accessed from the processor thread
+    struct sc_frame_decimator save_decimator;
+    struct sc_frame_decimator output_decimator;
+    // The frames skipped by output_decimator since the last output
+    bool output_skipped;
+    uint64_t output_skipped_from;
+    // The stream was interrupted since the last output frame
+    bool output_interrupted;
+    // pipe_output, pipe_depth, shm_output and cuda_ipc_output are only accessed
+    // from the output thread once started
+    bool pipe_output;
+    enum sc_pipe_format pipe_format;
+    bool pipe_payload_crc;
+    // If not negative, each piped frame is preceded by a device tag
+    int pipe_device;
+    // If set, the writes are serialized by pipe_mutex (shared by all the
+    // processors and the audio pipe writing to stdout)
+    sc_mutex *pipe_mutex;
+    bool pipe_depth; // pipe the disparity maps, requires remap and pipe_output
+    // pipe the features instead of the frames, requires remap and pipe_output
+    bool pipe_features;
+    // Levels of the pyramid piped and shared (see frame_pyramid.h), 0 if
+    // none
+    unsigned pyramid_levels;
+    // The number of the next frame expected by the pipe, to flag the
+    // discontinuities (only accessed from the output thread)
+    uint64_t pipe_next_number;
+    // Readiness of the pipe consumer (see pipe_feedback.h), 0 to disable
+    uint16_t pipe_feedback_port;
+    uint32_t pipe_feedback_host;
+    enum sc_pipe_backpressure pipe_backpressure;
+    struct sc_pipe_feedback pipe_feedback; // if pipe_feedback_port
+    // Y plane of a frame piped under backpressure (only accessed from the
+    // output thread)
+    AVFrame *pipe_luma;
+    const char *shm_output; // shared memory name, NULL if disabled
+    // Publish the frames exported by remap on the GPU (see
+    // sc_video_preprocess_set_cuda_ipc_output())
+    bool cuda_ipc_output;
+    // Serve the frames over TCP (see frame_publisher.h), 0 to disable
+    uint16_t publish_port;
+    uint32_t publish_host;
+    unsigned publish_queue;
+    enum sc_publish_drop publish_drop;
+    bool export_timestamp; // for the frame synchronizer (see frame_sync.h)
+    // If not 0, the processor thread (and the OpenCV threads it starts) are
+    // pinned to these CPU cores
+    uint64_t cpu_affinity;
+    // If not 0, the stale frames are not forwarded to the sinks
+    sc_tick latency_budget;
+    bool latency_probe; // measure the frames (see latency_probe.h)
+    bool skip_repeated;
+    float motion_threshold; // 0 to disable the motion gate
+    struct sc_pose_buffer *pose_buffer; // may be NULL
+
+    // While paused, the frames are neither processed nor forwarded, only the
+    // last one is held in the queue (protected by the mutex)
+    bool paused;
+    bool resumed; // the head of the queue is the frame held while paused
+
+    // Pose samples taken for the next output (only accessed from the
+    // processor thread)
+    struct pose_sample_record poses[SC_POSE_BUFFER_CAPACITY];
+    unsigned pose_count;
+
+    // Only accessed from the processor thread
+    struct sc_frame_clock clock;
+    struct sc_timestamp_filter timestamp_filter;
+    struct sc_motion_gate motion_gate;
+    // Result of the timestamp filter for the current frame, -1 if none
+    int64_t filtered_timestamp_us;
+    bool timestamp_outlier;
+    // Capture times of the current frame (see sc_frame_clock_get_times())
+    struct sc_frame_times frame_times;
+    // The device boot time is retrieved via adb by the processor thread if
+    // the timestamps are needed without clock synchronization
+    bool needs_boot_time;
+
+    // The video size announced on open, to prepare the pools
+    int width;
+    int height;
+
+    // Only accessed from the processor thread
+    struct sc_frame_pool frame_pool; // processed frames
+    struct sc_frame_pool preview_pool; // preview frames, if preview_scale > 1
+    AVFrame *preview; // if preview_scale > 1
+    AVFrame *luma; // Y plane of a frame forwarded in color, if luma_only
+    // Outputs of the frames in flight in gl_readback, in submission order
+    struct sc_video_processor_delivery readbacks[SC_GL_READBACK_DEPTH];
+    unsigned readback_head;
+    unsigned readback_count;
+    AVFrame *readback; // frame read back, if gl_readback
+
+    // Only accessed from the output thread
+    struct sc_frame_pool depth_pool; // disparity maps, if pipe_depth
+    AVFrame *depth; // if pipe_depth
+    struct sc_video_features *features; // if pipe_features
+    struct sc_frame_pyramid pyramid; // if pyramid_levels
+    bool pyramid_output; // cleared if the pyramid could not be built
+
+    struct sc_frame_writer frame_writer; // if save_frames
+    struct sc_shm_output shm;
+    struct sc_frame_publisher publisher; // if publish_port
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond queue_cond;
+
+    struct sc_video_processor_queue queue;
+    // Number of frames received (including the ones not output by the
+    // decoder), the number of the next frame
+    uint64_t input_count;
+    // Number of frames not forwarded to the sinks because of the latency
+    // budget (only accessed from the processor thread)
+    uint64_t stale_count;
+    // Number of repeated frames skipped (only accessed from the processor
+    // thread)
+    uint64_t repeated_count;
+    // Number of frames not output by the motion gate (only accessed from the
+    // processor thread)
+    uint64_t static_count;
+    // Number of interruptions of the stream (only accessed from the processor
+    // thread)
+    uint64_t gap_count;
+    struct sc_video_processor_drop_queue pending_drops;
+    struct sc_frame_drops drops;
+    bool stopped;
+
+    // If the frames are piped or published, these outputs run on a second
+    // thread, fed by a ring of pending outputs (protected by the mutex)
+    bool outputs;
+    sc_thread output_thread;
+    sc_cond output_cond;
+    struct sc_video_processor_output pending[SC_VIDEO_PROCESSOR_OUTPUT_DEPTH];
+    unsigned output_head; // index of the oldest pending output
+    unsigned output_count;
+    bool output_stopped;
+};
+
+struct sc_video_processor_params {
+    const struct sc_video_preprocess *remap; // NULL to disable
+    // Rectify the saved and output frames on the GPU, instead of remap (NULL
+    // to disable, see gl_readback.h)
+    struct sc_gl_readback *gl_readback;
+    unsigned preview_scale; // 1 to disable
+    bool show_timestamps;
+    bool save_frames;
+    const char *frame_dir;
+    const char *frame_archive; // if set, frame_dir is ignored
+    enum sc_save_frames_format frame_writer_format;
+    unsigned frame_writer_quality; // JPEG quality, 0 for the default
+    enum sc_save_frames_io frame_writer_io;
+    bool frame_writer_direct;
+    int frame_writer_zstd_level; // 0 to disable
+    const char *frame_writer_zstd_dict; // NULL if none
+    bool frame_writer_tile_delta;
+    float frame_writer_tile_threshold;
+    unsigned frame_writer_key_interval;
+    sc_tick frame_writer_duration; // expected duration, 0 if unknown
+    // Pre-trigger ring (0 to save the frames continuously)
+    sc_tick frame_writer_pre_trigger;
+    sc_tick frame_writer_post_trigger;
+    unsigned frame_writer_threads;
+    // Resize the thread pools to the measured costs (see auto_tune.h)
+    bool auto_tune;
+    // Upload the saved frames (--upload-dir), NULL if none
+    struct sc_uploader *frame_writer_uploader;
+    bool luma_only; // QOI and JPEG not supported
+    bool luma_sinks; // e.g. the frame synchronizer, which only pipes them
+    struct sc_output_rate save_rate; // of the saved frames
+    struct sc_output_rate output_rate; // of the piped and published frames
+    bool pipe_output;
+    enum sc_pipe_format pipe_format;
+    bool pipe_payload_crc; // requires SC_PIPE_FORMAT_V2
+    int pipe_device; // -1 if the frames are not tagged (a single device)
+    sc_mutex *pipe_mutex; // required if pipe_device >= 0 or with --pipe-audio
+    bool pipe_depth; // requires remap and pipe_output
+    bool pipe_features; // requires remap and pipe_output, not pipe_depth
+    // Bitmask of the pyramid levels (see frame_pyramid.h), requires
+    // shm_output or pipe_output with SC_PIPE_FORMAT_V2 (not pipe_features)
+    unsigned pyramid_levels;
+    // Readiness channel of the pipe consumer, 0 to disable (requires
+    // pipe_output with SC_PIPE_FORMAT_V2)
+    uint16_t pipe_feedback_port;
+    uint32_t pipe_feedback_host;
+    enum sc_pipe_backpressure pipe_backpressure;
+    const char *shm_output;
+    bool cuda_ipc_output; // requires remap, with a CUDA IPC output
+    uint16_t publish_port; // 0 to disable
+    uint32_t publish_host;
+    unsigned publish_queue; // frames queued per subscriber
+    enum sc_publish_drop publish_drop;
+    bool export_timestamp;
+    uint64_t cpu_affinity; // 0 to not pin the processor thread
+    sc_tick latency_budget; // 0 to forward all the frames to the sinks
+    bool latency_probe; // requires sc_latency_probe_init()
+    bool skip_repeated;
+    // Mean luma difference below which the saved and output frames are
+    // skipped (see motion_gate.h), 0 to disable
+    float motion_threshold;
+    struct sc_clock_sync *clock_sync; // may be NULL (without control)
+    // Pose samples to write along the frames, may be NULL
+    struct sc_pose_buffer *pose_buffer;
+
+    const char *serial; // to retrieve the boot time without clock_sync
+    // If not 0, the boot time already retrieved (it is not retrieved again)
+    int64_t device_boot_time;
+};
+
+bool
+sc_video_processor_init(struct sc_video_processor *vp,
+                        const struct sc_video_processor_params *params);
+
+/**
+ * Pause or resume the processing, while the frame sink is open
+ *
+ * While paused, the decoded frames are not processed: the last one is held,
+ * and processed and forwarded on resume.
+ *
+ * Only for a processor whose frames are only displayed: the frames replaced
+ * while paused are not reported as dropped.
+ */
+void
+sc_video_processor_set_paused(struct sc_video_processor *vp, bool paused);
+
+#endif
@@ -0,0 +1,177 @@
+#include "video_reconfigurer.h"
+
+#include <assert.h>
+#include <inttypes.h>
+
+#include "video_preprocess.h"
+#include "util/log.h"
+#include "util/tick.h"
+
+bool
+sc_video_reconfigurer_init(struct sc_video_reconfigurer *reconfigurer,
+                           struct sc_controller *controller,
+                           const struct sc_video_preprocess *vpp,
+                           const struct sc_video_preset *presets,
+                           unsigned preset_count) {
+    assert(preset_count);
+
+    bool ok = sc_mutex_init(&reconfigurer->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&reconfigurer->cond);
+    if (!ok) {
+        sc_mutex_destroy(&reconfigurer->mutex);
+        return false;
+    }
+
+    reconfigurer->controller = controller;
+    reconfigurer->vpp = vpp;
+    reconfigurer->presets = presets;
+    reconfigurer->preset_count = preset_count;
+    reconfigurer->index = -1;
+    reconfigurer->full_size.width = 0;
+    reconfigurer->full_size.height = 0;
+    reconfigurer->stopped = false;
+    reconfigurer->pending_size.width = 0;
+    reconfigurer->pending_size.height = 0;
+
+    return true;
+}
+
+void
+sc_video_reconfigurer_destroy(struct sc_video_reconfigurer *reconfigurer) {
+    sc_cond_destroy(&reconfigurer->cond);
+    sc_mutex_destroy(&reconfigurer->mutex);
+}
+
+static int
+run_video_reconfigurer(void *data) {
+    struct sc_video_reconfigurer *reconfigurer = data;
+
+    for (;;) {
+        sc_mutex_lock(&reconfigurer->mutex);
+        while (!reconfigurer->stopped && !reconfigurer->pending_size.width) {
+            sc_cond_wait(&reconfigurer->cond, &reconfigurer->mutex);
+        }
+        if (reconfigurer->stopped) {
+            sc_mutex_unlock(&reconfigurer->mutex);
+            break;
+        }
+        // A switch requested meanwhile replaces the pending size
+        struct sc_size size = reconfigurer->pending_size;
+        reconfigurer->pending_size.width = 0;
+        sc_mutex_unlock(&reconfigurer->mutex);
+
+        sc_tick start = sc_tick_now();
+        if (sc_video_preprocess_check_size(reconfigurer->vpp, size.width,
+                                           size.height)) {
+            LOGD("Remap maps ready for %" PRIu16 "x%" PRIu16 " in %" PRItick
+                 " ms", size.width, size.height,
+                 SC_TICK_TO_MS(sc_tick_now() - start));
+        }
+        // Otherwise, the frames of this size will be left unchanged (logged
+        // by the processor)
+    }
+
+    LOGD("Video reconfigurer thread ended");
+
+    return 0;
+}
+
+bool
+sc_video_reconfigurer_start(struct sc_video_reconfigurer *reconfigurer) {
+    LOGD("Starting video reconfigurer thread");
+
+    bool ok = sc_thread_create(&reconfigurer->thread, run_video_reconfigurer,
+                               "scrcpy-reconf", reconfigurer);
+    if (!ok) {
+        LOGE("Could not start video reconfigurer thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_video_reconfigurer_stop(struct sc_video_reconfigurer *reconfigurer) {
+    sc_mutex_lock(&reconfigurer->mutex);
+    reconfigurer->stopped = true;
+    sc_cond_signal(&reconfigurer->cond);
+    sc_mutex_unlock(&reconfigurer->mutex);
+}
+
+void
+sc_video_reconfigurer_join(struct sc_video_reconfigurer *reconfigurer) {
+    sc_thread_join(&reconfigurer->thread, NULL);
+}
+
+// Compute the video size the way the server does (see ScreenInfo)
+static struct sc_size
+predict_size(struct sc_size full_size, uint16_t max_size) {
+    bool portrait = full_size.height > full_size.width;
+    unsigned major = portrait ? full_size.height : full_size.width;
+    unsigned minor = portrait ? full_size.width : full_size.height;
+
+    if (max_size && major > max_size) {
+        minor = ((minor * max_size / major) + 4) & ~7;
+        major = max_size;
+    }
+
+    struct sc_size size = {
+        .width = portrait ? minor : major,
+        .height = portrait ? major : minor,
+    };
+    return size;
+}
+
+void
+sc_video_reconfigurer_switch(struct sc_video_reconfigurer *reconfigurer,
+                             bool next, struct sc_size frame_size) {
+    int count = reconfigurer->preset_count;
+    int index = reconfigurer->index;
+    if (next) {
+        index = (index + 1) % count;
+    } else {
+        index = index <= 0 ? count - 1 : index - 1;
+    }
+
+    const struct sc_video_preset *preset = &reconfigurer->presets[index];
+
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_RECONFIGURE_VIDEO;
+    msg.reconfigure_video.max_size = preset->max_size;
+    msg.reconfigure_video.max_fps = preset->max_fps;
+
+    if (!sc_controller_push_msg(reconfigurer->controller, &msg)) {
+        LOGW("Could not request video reconfiguration");
+        return;
+    }
+
+    reconfigurer->index = index;
+    LOGI("Video preset %d/%u: max size %" PRIu16 ", max fps %" PRIu16
+         " (0 for unlimited)", index + 1, reconfigurer->preset_count,
+         preset->max_size, preset->max_fps);
+
+    struct sc_size *full = &reconfigurer->full_size;
+    if ((uint32_t) frame_size.width * frame_size.height
+            > (uint32_t) full->width * full->height) {
+        *full = frame_size;
+    }
+
+    if (!reconfigurer->vpp || !full->width) {
+        return;
+    }
+
+    struct sc_size size = predict_size(*full, preset->max_size);
+    if (size.width == frame_size.width && size.height == frame_size.height) {
+        // The maps for the current size are already scaled
+        return;
+    }
+
+    sc_mutex_lock(&reconfigurer->mutex);
+    reconfigurer->pending_size = size;
+    sc_cond_signal(&reconfigurer->cond);
+    sc_mutex_unlock(&reconfigurer->mutex);
+}
@@ -0,0 +1,76 @@
+#ifndef SC_VIDEO_RECONFIGURER_H
+#define SC_VIDEO_RECONFIGURER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#include "controller.h"
+#include "coords.h"
+#include "options.h"
+#include "util/thread.h"
+
+// forward declarations
+struct sc_video_preprocess;
+
+/**
+ * Switch of the capture size and frame rate during the session
+ * (--video-presets), on request.
+ *
+ * The server applies the new configuration on the next encoder restart,
+ * without ending the session: the decoder receives new codec parameters, and
+ * the following frames have the new size.
+ *
+ * If the frames are remapped by the client, the maps for the new size are
+ * scaled by its own thread as soon as the switch is requested (see
+ * sc_video_preprocess_check_size()), rather than by the processor on the
+ * first frame of the new size. The new size is predicted the way the server
+ * computes it, from the largest frame size received so far: if the device
+ * size is not known yet (the session started with a lower --max-size), the
+ * maps are scaled on the first frame as usual.
+ */
+struct sc_video_reconfigurer {
+    struct sc_controller *controller;
+    const struct sc_video_preprocess *vpp; // may be NULL
+
+    const struct sc_video_preset *presets;
+    unsigned preset_count;
+    int index; // -1 for the initial configuration (--max-size, --max-fps)
+    // The largest frame size received, assumed to be the device size
+    struct sc_size full_size;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped;
+    // The predicted frame size to scale the maps for, width 0 if none
+    struct sc_size pending_size;
+};
+
+bool
+sc_video_reconfigurer_init(struct sc_video_reconfigurer *reconfigurer,
+                           struct sc_controller *controller,
+                           const struct sc_video_preprocess *vpp,
+                           const struct sc_video_preset *presets,
+                           unsigned preset_count);
+
+void
+sc_video_reconfigurer_destroy(struct sc_video_reconfigurer *reconfigurer);
+
+bool
+sc_video_reconfigurer_start(struct sc_video_reconfigurer *reconfigurer);
+
+void
+sc_video_reconfigurer_stop(struct sc_video_reconfigurer *reconfigurer);
+
+void
+sc_video_reconfigurer_join(struct sc_video_reconfigurer *reconfigurer);
+
+// Switch to the next (or previous) preset, given the current frame size
+//
+// It must be called from the main thread.
+void
+sc_video_reconfigurer_switch(struct sc_video_reconfigurer *reconfigurer,
+                             bool next, struct sc_size frame_size);
+
+#endif
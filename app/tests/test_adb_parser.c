@@ -253,6 +253,31 @@ static void test_get_ip_truncated(void) {
     assert(!ip);
 }
 
+static void test_boot_time(void) {
+    const char *output = "1700000000123\r\n12345.67 23456.78\r\n";
+
+    int64_t boot_time;
+    bool ok = sc_adb_parse_boot_time(output, &boot_time);
+    assert(ok);
+    assert(boot_time == 1700000000123 - 12345670);
+}
+
+static void test_boot_time_without_decimals(void) {
+    const char *output = "1700000000123\n12345 23456\n";
+
+    int64_t boot_time;
+    bool ok = sc_adb_parse_boot_time(output, &boot_time);
+    assert(ok);
+    assert(boot_time == 1700000000123 - 12345000);
+}
+
+static void test_boot_time_invalid(void) {
+    int64_t boot_time;
+    assert(!sc_adb_parse_boot_time("", &boot_time));
+    assert(!sc_adb_parse_boot_time("%s%3N\n12345.67 23456.78\n", &boot_time));
+    assert(!sc_adb_parse_boot_time("1700000000123\n", &boot_time));
+}
+
 int main(int argc, char *argv[]) {
     (void) argc;
     (void) argv;
@@ -276,5 +301,9 @@ int main(int argc, char *argv[]) {
     test_get_ip_no_wlan_without_eol();
     test_get_ip_truncated();
 
+    test_boot_time();
+    test_boot_time_without_decimals();
+    test_boot_time_invalid();
+
     return 0;
 }
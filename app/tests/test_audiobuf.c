@@ -116,6 +116,48 @@ static void test_audiobuf_partial_read_write(void) {
     sc_audiobuf_destroy(&buf);
 }
 
+static void test_audiobuf_reserve_commit(void) {
+    struct sc_audiobuf buf;
+    uint32_t data[10];
+
+    bool ok = sc_audiobuf_init(&buf, 4, 10);
+    assert(ok);
+
+    uint8_t *out;
+    uint32_t n = sc_audiobuf_reserve(&buf, &out);
+    assert(n == 10);
+
+    uint32_t samples[] = {1, 2, 3, 4, 5, 6, 7, 8};
+    memcpy(out, samples, sizeof(samples));
+    // Nothing is readable before commit
+    assert(sc_audiobuf_can_read(&buf) == 0);
+    sc_audiobuf_commit(&buf, 8);
+    assert(sc_audiobuf_can_read(&buf) == 8);
+
+    uint32_t r = sc_audiobuf_read(&buf, data, 6);
+    assert(r == 6);
+
+    // The free space wraps around the end of the array (of 11 samples)
+    n = sc_audiobuf_reserve(&buf, &out);
+    assert(n == 3);
+    uint32_t samples2[] = {9, 10, 11};
+    memcpy(out, samples2, sizeof(samples2));
+    sc_audiobuf_commit(&buf, 3);
+
+    n = sc_audiobuf_reserve(&buf, &out);
+    assert(n == 5);
+    uint32_t single = 12;
+    memcpy(out, &single, sizeof(single));
+    sc_audiobuf_commit(&buf, 1);
+
+    r = sc_audiobuf_read(&buf, data, 10);
+    assert(r == 6);
+    uint32_t expected[] = {7, 8, 9, 10, 11, 12};
+    assert(!memcmp(data, expected, sizeof(expected)));
+
+    sc_audiobuf_destroy(&buf);
+}
+
 int main(int argc, char *argv[]) {
     (void) argc;
     (void) argv;
@@ -123,6 +165,7 @@ int main(int argc, char *argv[]) {
     test_audiobuf_simple();
     test_audiobuf_boundaries();
     test_audiobuf_partial_read_write();
+    test_audiobuf_reserve_commit();
 
     return 0;
 }
@@ -105,6 +105,15 @@ static void test_read64be(void) {
     assert(val == 0xABCD1234567890EF);
 }
 
+static void test_read64le(void) {
+    uint8_t buf[8] = {0xEF, 0x90, 0x78, 0x56,
+                      0x34, 0x12, 0xCD, 0xAB};
+
+    uint64_t val = sc_read64le(buf);
+
+    assert(val == 0xABCD1234567890EF);
+}
+
 static void test_float_to_u16fp(void) {
     assert(sc_float_to_u16fp(0.0f) == 0);
     assert(sc_float_to_u16fp(0.03125f) == 0x800);
@@ -149,6 +158,7 @@ int main(int argc, char *argv[]) {
     test_write16le();
     test_write32le();
     test_write64le();
+    test_read64le();
 
     test_float_to_u16fp();
     test_float_to_i16fp();
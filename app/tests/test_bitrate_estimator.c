@@ -0,0 +1,102 @@
+#include "common.h"
+
+#include <assert.h>
+
+#include "bitrate_estimator.h"
+
+#define MAX_BIT_RATE 8000000
+#define MIN_BIT_RATE 1000000
+#define INTERVAL SC_TICK_FROM_SEC(1)
+
+static void test_stable(void) {
+    struct sc_bitrate_estimator est;
+    sc_bitrate_estimator_init(&est, MIN_BIT_RATE, MAX_BIT_RATE);
+    assert(est.bit_rate == MAX_BIT_RATE);
+
+    struct sc_bitrate_stats stats = {
+        .received_bytes = MAX_BIT_RATE / 8,
+        .frames = 60,
+    };
+
+    // Never above the maximum
+    for (int i = 0; i < 10; ++i) {
+        assert(!sc_bitrate_estimator_update(&est, &stats, INTERVAL));
+    }
+    assert(est.bit_rate == MAX_BIT_RATE);
+}
+
+static void test_backlog(void) {
+    struct sc_bitrate_estimator est;
+    sc_bitrate_estimator_init(&est, MIN_BIT_RATE, MAX_BIT_RATE);
+
+    // The link only delivers 6 Mbps, 200 ms of video are pending
+    struct sc_bitrate_stats stats = {
+        .received_bytes = 6000000 / 8,
+        .frames = 60,
+        .backlog = MAX_BIT_RATE / 8 / 5,
+    };
+    assert(sc_bitrate_estimator_update(&est, &stats, INTERVAL));
+    assert(est.bit_rate == 6000000 * 3 / 4);
+
+    // Below 100 ms of the current bit rate, not congested
+    stats.backlog = est.bit_rate / 8 / 20;
+    assert(!sc_bitrate_estimator_update(&est, &stats, INTERVAL));
+    assert(!sc_bitrate_estimator_update(&est, &stats, INTERVAL));
+    // Increased on the third stable interval
+    assert(sc_bitrate_estimator_update(&est, &stats, INTERVAL));
+    assert(est.bit_rate == 6000000 * 3 / 4 + MAX_BIT_RATE / 20);
+}
+
+static void test_bounds(void) {
+    struct sc_bitrate_estimator est;
+    sc_bitrate_estimator_init(&est, MIN_BIT_RATE, MAX_BIT_RATE);
+
+    // Almost nothing received: the bit rate is at most halved at once
+    struct sc_bitrate_stats stats = {
+        .received_bytes = 1000,
+        .frames = 60,
+        .backlog = 1000000,
+    };
+    assert(sc_bitrate_estimator_update(&est, &stats, INTERVAL));
+    assert(est.bit_rate == MAX_BIT_RATE / 2);
+
+    for (int i = 0; i < 10; ++i) {
+        sc_bitrate_estimator_update(&est, &stats, INTERVAL);
+    }
+    assert(est.bit_rate == MIN_BIT_RATE);
+    assert(!sc_bitrate_estimator_update(&est, &stats, INTERVAL));
+}
+
+static void test_skipped_and_lost(void) {
+    struct sc_bitrate_estimator est;
+    sc_bitrate_estimator_init(&est, MIN_BIT_RATE, MAX_BIT_RATE);
+
+    // 10% skipped is tolerated
+    struct sc_bitrate_stats stats = {
+        .received_bytes = 1000, // ignored without backlog
+        .frames = 60,
+        .skipped = 6,
+    };
+    assert(!sc_bitrate_estimator_update(&est, &stats, INTERVAL));
+
+    stats.skipped = 7;
+    assert(sc_bitrate_estimator_update(&est, &stats, INTERVAL));
+    assert(est.bit_rate == MAX_BIT_RATE * 3 / 4);
+
+    stats.skipped = 0;
+    stats.lost = 1;
+    assert(sc_bitrate_estimator_update(&est, &stats, INTERVAL));
+    assert(est.bit_rate == MAX_BIT_RATE * 9 / 16);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_stable();
+    test_backlog();
+    test_bounds();
+    test_skipped_and_lost();
+
+    return 0;
+}
@@ -123,6 +123,252 @@ static void test_options2(void) {
     assert(opts->record_format == SC_RECORD_FORMAT_MP4);
 }
 
+static void test_save_frames_options(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--save-frames",
+        "--frame-dir", "frames",
+        "--save-frames-format=qoi",
+        "--save-frames-threads=4",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+
+    const struct scrcpy_options *opts = &args.opts;
+    assert(opts->save_frames);
+    assert(!strcmp(opts->frame_dir, "frames"));
+    assert(opts->save_frames_format == SC_SAVE_FRAMES_FORMAT_QOI);
+    assert(opts->save_frames_threads == 4);
+}
+
+static void test_publish_options(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--publish=0.0.0.0:5555",
+        "--publish-queue=8",
+        "--publish-drop=newest",
+        "--pipe-format=v2", // allowed without --pipe-output
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+
+    const struct scrcpy_options *opts = &args.opts;
+    assert(opts->publish_port == 5555);
+    assert(opts->publish_host == 0);
+    assert(opts->publish_queue == 8);
+    assert(opts->publish_drop == SC_PUBLISH_DROP_NEWEST);
+    assert(opts->pipe_format == SC_PIPE_FORMAT_V2);
+    assert(!opts->pipe_output);
+}
+
+static void test_pipe_packets_options(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--pipe-output=packets",
+        "--pipe-target=fd:3",
+        "--no-window",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+
+    const struct scrcpy_options *opts = &args.opts;
+    assert(opts->pipe_packets);
+    assert(!opts->pipe_output);
+    assert(opts->video);
+    assert(!strcmp(opts->pipe_target, "fd:3"));
+
+    // Nothing to pipe
+    struct scrcpy_cli_args args2 = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv2[] = {
+        "scrcpy",
+        "--pipe-target=/tmp/frames.fifo",
+    };
+
+    ok = scrcpy_parse_args(&args2, ARRAY_LEN(argv2), argv2);
+    assert(!ok);
+}
+
+static void test_output_planes(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--pipe-output",
+        "--output-planes=y",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+    assert(args.opts.output_planes == SC_OUTPUT_PLANES_Y);
+
+    // No grayscale QOI
+    struct scrcpy_cli_args args2 = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv2[] = {
+        "scrcpy",
+        "--save-frames-archive=capture.scfa",
+        "--save-frames-format=qoi",
+        "--output-planes=y",
+    };
+
+    ok = scrcpy_parse_args(&args2, ARRAY_LEN(argv2), argv2);
+    assert(!ok);
+}
+
+static void test_output_rates(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--save-frames",
+        "--save-frames-fps=5",
+        "--pipe-output",
+        "--pipe-output-fps=key",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+    assert(args.opts.save_frames_rate.fps == 5);
+    assert(!args.opts.save_frames_rate.key_frames);
+    assert(!args.opts.pipe_output_rate.fps);
+    assert(args.opts.pipe_output_rate.key_frames);
+
+    // Nothing to subsample
+    struct scrcpy_cli_args args2 = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv2[] = {
+        "scrcpy",
+        "--save-frames",
+        "--pipe-output-fps=10",
+    };
+
+    ok = scrcpy_parse_args(&args2, ARRAY_LEN(argv2), argv2);
+    assert(!ok);
+}
+
+static void test_thread_policies(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--thread-affinity=demuxer:0-1",
+        "--thread-affinity=vproc:2,3",
+        "--realtime-threads=demuxer,render",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+    assert(args.opts.thread_policy_count == 3);
+    assert(!strcmp(args.opts.thread_policies[0].name, "demuxer"));
+    assert(args.opts.thread_policies[0].cpus == 0x3);
+    assert(args.opts.thread_policies[0].realtime);
+    assert(!strcmp(args.opts.thread_policies[1].name, "vproc"));
+    assert(args.opts.thread_policies[1].cpus == 0xc);
+    assert(!args.opts.thread_policies[1].realtime);
+    assert(!strcmp(args.opts.thread_policies[2].name, "render"));
+    assert(!args.opts.thread_policies[2].cpus);
+    assert(args.opts.thread_policies[2].realtime);
+
+    // Empty thread name
+    struct scrcpy_cli_args args2 = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv2[] = {
+        "scrcpy",
+        "--realtime-threads=demuxer,,render",
+    };
+
+    ok = scrcpy_parse_args(&args2, ARRAY_LEN(argv2), argv2);
+    assert(!ok);
+}
+
+static void test_audio_latency(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--audio-latency=low",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+    assert(args.opts.audio_latency == SC_AUDIO_LATENCY_LOW);
+    assert(args.opts.audio_buffer == SC_TICK_FROM_MS(30));
+    assert(args.opts.audio_output_buffer == SC_TICK_FROM_MS(3));
+
+    // Not low latency
+    struct scrcpy_cli_args args2 = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv2[] = {
+        "scrcpy",
+        "--audio-codec=flac",
+        "--audio-latency=low",
+    };
+
+    ok = scrcpy_parse_args(&args2, ARRAY_LEN(argv2), argv2);
+    assert(ok);
+    assert(args2.opts.audio_latency == SC_AUDIO_LATENCY_DEFAULT);
+    assert(args2.opts.audio_buffer == SC_TICK_FROM_MS(120));
+    assert(args2.opts.audio_output_buffer == SC_TICK_FROM_MS(5));
+}
+
 static void test_parse_shortcut_mods(void) {
     uint8_t mods;
     bool ok;
@@ -159,6 +405,13 @@ int main(int argc, char *argv[]) {
     test_flag_help();
     test_options();
     test_options2();
+    test_save_frames_options();
+    test_publish_options();
+    test_pipe_packets_options();
+    test_output_planes();
+    test_output_rates();
+    test_thread_policies();
+    test_audio_latency();
     test_parse_shortcut_mods();
     return 0;
 }
@@ -289,6 +289,28 @@ static void test_serialize_set_clipboard_long(void) {
     assert(!memcmp(buf, expected, sizeof(expected)));
 }
 
+static void test_serialize_set_clipboard_chunk(void) {
+    const char *text = "hello, world!";
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_SET_CLIPBOARD_CHUNK,
+        .set_clipboard_chunk = {
+            .data = text,
+            .len = 5,
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 10);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_SET_CLIPBOARD_CHUNK,
+        0x00, 0x00, 0x00, 0x05, // length
+        'h', 'e', 'l', 'l', 'o',
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
 static void test_serialize_set_screen_power_mode(void) {
     struct sc_control_msg msg = {
         .type = SC_CONTROL_MSG_TYPE_SET_SCREEN_POWER_MODE,
@@ -407,6 +429,171 @@ static void test_serialize_open_hard_keyboard(void) {
     assert(!memcmp(buf, expected, sizeof(expected)));
 }
 
+static void test_serialize_request_key_frame(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_REQUEST_KEY_FRAME,
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 1);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_REQUEST_KEY_FRAME,
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+static void test_serialize_clock_sync(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_CLOCK_SYNC,
+        .clock_sync = {
+            .client_time = UINT64_C(0x0102030405060708),
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 9);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_CLOCK_SYNC,
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // client time
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+static void test_serialize_set_video_bit_rate(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_SET_VIDEO_BIT_RATE,
+        .set_video_bit_rate = {
+            .bit_rate = 4000000,
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 5);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_SET_VIDEO_BIT_RATE,
+        0x00, 0x3d, 0x09, 0x00, // 4000000
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+static void test_serialize_reconfigure_video(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_RECONFIGURE_VIDEO,
+        .reconfigure_video = {
+            .max_size = 1920,
+            .max_fps = 90,
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 5);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_RECONFIGURE_VIDEO,
+        0x07, 0x80, // 1920
+        0x00, 0x5a, // 90
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+static void test_serialize_time_ping(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_TIME_PING,
+        .time_ping = {
+            .client_time = UINT64_C(0x0102030405060708),
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 9);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_TIME_PING,
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // client time
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+static void test_is_superseded_by(void) {
+    struct sc_control_msg move1 = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT,
+        .inject_touch_event = {
+            .action = AMOTION_EVENT_ACTION_MOVE,
+            .pointer_id = SC_POINTER_ID_MOUSE,
+            .position = {
+                .point = {
+                    .x = 100,
+                    .y = 200,
+                },
+                .screen_size = {
+                    .width = 1080,
+                    .height = 1920,
+                },
+            },
+            .pressure = 1.0f,
+            .buttons = AMOTION_EVENT_BUTTON_PRIMARY,
+        },
+    };
+
+    struct sc_control_msg move2 = move1;
+    move2.inject_touch_event.position.point.x = 110;
+    assert(sc_control_msg_is_superseded_by(&move1, &move2));
+
+    // Another pointer
+    struct sc_control_msg other = move2;
+    other.inject_touch_event.pointer_id = SC_POINTER_ID_GENERIC_FINGER;
+    assert(!sc_control_msg_is_superseded_by(&move1, &other));
+
+    // The buttons changed
+    other = move2;
+    other.inject_touch_event.buttons = 0;
+    assert(!sc_control_msg_is_superseded_by(&move1, &other));
+
+    // The up event must not be dropped
+    other = move2;
+    other.inject_touch_event.action = AMOTION_EVENT_ACTION_UP;
+    assert(!sc_control_msg_is_superseded_by(&move1, &other));
+    assert(!sc_control_msg_is_superseded_by(&other, &move2));
+
+    struct sc_control_msg clock_sync = {
+        .type = SC_CONTROL_MSG_TYPE_CLOCK_SYNC,
+    };
+    assert(!sc_control_msg_is_superseded_by(&move1, &clock_sync));
+
+    struct sc_control_msg axis1 = {
+        .type = SC_CONTROL_MSG_TYPE_UHID_INPUT,
+        .uhid_input = {
+            .id = 3,
+            .size = 2,
+            .data = {1, 2},
+            .coalescable = true,
+        },
+    };
+    struct sc_control_msg axis2 = axis1;
+    axis2.uhid_input.data[0] = 4;
+    assert(sc_control_msg_is_superseded_by(&axis1, &axis2));
+
+    // Another device
+    other = axis2;
+    other.uhid_input.id = 4;
+    assert(!sc_control_msg_is_superseded_by(&axis1, &other));
+
+    // A button input must not be dropped
+    other = axis2;
+    other.uhid_input.coalescable = false;
+    assert(!sc_control_msg_is_superseded_by(&axis1, &other));
+    assert(!sc_control_msg_is_superseded_by(&other, &axis2));
+    assert(!sc_control_msg_is_superseded_by(&axis1, &move1));
+}
+
 int main(int argc, char *argv[]) {
     (void) argc;
     (void) argv;
@@ -423,11 +610,18 @@ int main(int argc, char *argv[]) {
     test_serialize_get_clipboard();
     test_serialize_set_clipboard();
     test_serialize_set_clipboard_long();
+    test_serialize_set_clipboard_chunk();
     test_serialize_set_screen_power_mode();
     test_serialize_rotate_device();
     test_serialize_uhid_create();
     test_serialize_uhid_input();
     test_serialize_uhid_destroy();
     test_serialize_open_hard_keyboard();
+    test_serialize_clock_sync();
+    test_serialize_request_key_frame();
+    test_serialize_set_video_bit_rate();
+    test_serialize_reconfigure_video();
+    test_serialize_time_ping();
+    test_is_superseded_by();
     return 0;
 }
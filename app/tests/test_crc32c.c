@@ -0,0 +1,60 @@
+#include "common.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "frame_header.h"
+#include "util/crc32c.h"
+
+static void test_crc32c_check_value(void) {
+    // Standard check value of CRC-32C
+    const char *s = "123456789";
+    assert(sc_crc32c(0, s, 9) == 0xe3069283);
+    assert(calculate_crc32c(0, s, 9) == 0xe3069283);
+
+    assert(sc_crc32c(0, NULL, 0) == 0);
+}
+
+static void test_crc32c_parts(void) {
+    uint8_t data[1000];
+    for (size_t i = 0; i < sizeof(data); ++i) {
+        data[i] = i * 7;
+    }
+
+    uint32_t crc = sc_crc32c(0, data, sizeof(data));
+    assert(crc == calculate_crc32c(0, data, sizeof(data)));
+
+    // Any split, including unaligned starts
+    for (size_t split = 0; split < 20; ++split) {
+        uint32_t part = sc_crc32c(0, data, split);
+        part = sc_crc32c(part, data + split, sizeof(data) - split);
+        assert(part == crc);
+    }
+}
+
+static void test_header_v2_checksum(void) {
+    struct frame_header_v2 header = {
+        .version = FRAME_HEADER_V2_VERSION,
+        .header_size = FRAME_HEADER_V2_SIZE,
+        .width = 1920,
+        .height = 1080,
+    };
+    memcpy(header.magic, FRAME_HEADER_V2_MAGIC, sizeof(header.magic));
+
+    uint32_t checksum = calculate_header_v2_checksum(&header);
+    assert(checksum == sc_crc32c(0, &header, sizeof(header) - 4));
+
+    // Unlike the v1 checksum, the first bytes matter
+    header.version = 3;
+    assert(calculate_header_v2_checksum(&header) != checksum);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_crc32c_check_value();
+    test_crc32c_parts();
+    test_header_v2_checksum();
+    return 0;
+}
@@ -83,6 +83,122 @@ static void test_deserialize_uhid_output(void) {
     sc_device_msg_destroy(&msg);
 }
 
+static void test_deserialize_clock_sync(void) {
+    const uint8_t input[] = {
+        DEVICE_MSG_TYPE_CLOCK_SYNC,
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // client time
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xE2, 0x40, // receive time
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xE2, 0x41, // send time
+    };
+
+    struct sc_device_msg msg;
+    ssize_t r = sc_device_msg_deserialize(input, sizeof(input), &msg);
+    assert(r == 25);
+
+    assert(msg.type == DEVICE_MSG_TYPE_CLOCK_SYNC);
+    assert(msg.clock_sync.client_time == UINT64_C(0x0102030405060708));
+    assert(msg.clock_sync.receive_time == 123456);
+    assert(msg.clock_sync.send_time == 123457);
+
+    // incomplete message
+    r = sc_device_msg_deserialize(input, sizeof(input) - 1, &msg);
+    assert(r == 0);
+}
+
+static void test_deserialize_time_pong(void) {
+    const uint8_t input[] = {
+        DEVICE_MSG_TYPE_TIME_PONG,
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // client time
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xE2, 0x40, // receive time
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xE2, 0x41, // send time
+        0x00, 0x06, 0x0A, 0x24, 0x18, 0x1E, 0x40, 0x00, // receive wall time
+        0x00, 0x06, 0x0A, 0x24, 0x18, 0x1E, 0x43, 0xE8, // send wall time
+    };
+
+    struct sc_device_msg msg;
+    ssize_t r = sc_device_msg_deserialize(input, sizeof(input), &msg);
+    assert(r == 41);
+
+    assert(msg.type == DEVICE_MSG_TYPE_TIME_PONG);
+    assert(msg.time_pong.client_time == UINT64_C(0x0102030405060708));
+    assert(msg.time_pong.receive_time == 123456);
+    assert(msg.time_pong.send_time == 123457);
+    assert(msg.time_pong.receive_wall_time == UINT64_C(1700000000000000));
+    assert(msg.time_pong.send_wall_time == UINT64_C(1700000000001000));
+
+    // incomplete message
+    r = sc_device_msg_deserialize(input, sizeof(input) - 1, &msg);
+    assert(r == 0);
+}
+
+static void test_deserialize_pose(void) {
+    const uint8_t input[] = {
+        DEVICE_MSG_TYPE_POSE,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xE2, 0x40, // pts
+        0x01, // has position
+        0x3F, 0x00, 0x00, 0x00, // rotation x: 0.5
+        0xBF, 0x00, 0x00, 0x00, // rotation y: -0.5
+        0x3F, 0x00, 0x00, 0x00, // rotation z: 0.5
+        0x3F, 0x00, 0x00, 0x00, // rotation w: 0.5
+        0x3E, 0x80, 0x00, 0x00, // translation x: 0.25
+        0x3F, 0xC0, 0x00, 0x00, // translation y: 1.5
+        0xC0, 0x00, 0x00, 0x00, // translation z: -2
+    };
+
+    struct sc_device_msg msg;
+    ssize_t r = sc_device_msg_deserialize(input, sizeof(input), &msg);
+    assert(r == 38);
+
+    assert(msg.type == DEVICE_MSG_TYPE_POSE);
+    assert(msg.pose.pts == 123456);
+    assert(msg.pose.has_position);
+    assert(msg.pose.rotation[0] == 0.5f);
+    assert(msg.pose.rotation[1] == -0.5f);
+    assert(msg.pose.rotation[2] == 0.5f);
+    assert(msg.pose.rotation[3] == 0.5f);
+    assert(msg.pose.translation[0] == 0.25f);
+    assert(msg.pose.translation[1] == 1.5f);
+    assert(msg.pose.translation[2] == -2.0f);
+
+    // incomplete message
+    r = sc_device_msg_deserialize(input, sizeof(input) - 1, &msg);
+    assert(r == 0);
+}
+
+static void test_deserialize_encoder_latency(void) {
+    const uint8_t input[] = {
+        DEVICE_MSG_TYPE_ENCODER_LATENCY,
+        0x00, 0x00, 0x00, 0x3C, // frame count
+        0x00, 0x00, 0x1F, 0x40, // capture to dequeue p50
+        0x00, 0x00, 0x23, 0x28, // capture to dequeue p95
+        0x00, 0x00, 0x2E, 0xE0, // capture to dequeue p99
+        0x00, 0x00, 0x3A, 0x98, // capture to dequeue max
+        0x00, 0x00, 0x00, 0x64, // dequeue to write p50
+        0x00, 0x00, 0x00, 0xC8, // dequeue to write p95
+        0x00, 0x00, 0x01, 0x2C, // dequeue to write p99
+        0x00, 0x00, 0x01, 0x90, // dequeue to write max
+    };
+
+    struct sc_device_msg msg;
+    ssize_t r = sc_device_msg_deserialize(input, sizeof(input), &msg);
+    assert(r == 37);
+
+    assert(msg.type == DEVICE_MSG_TYPE_ENCODER_LATENCY);
+    assert(msg.encoder_latency.frame_count == 60);
+    assert(msg.encoder_latency.capture_to_dequeue.p50 == 8000);
+    assert(msg.encoder_latency.capture_to_dequeue.p95 == 9000);
+    assert(msg.encoder_latency.capture_to_dequeue.p99 == 12000);
+    assert(msg.encoder_latency.capture_to_dequeue.max == 15000);
+    assert(msg.encoder_latency.dequeue_to_write.p50 == 100);
+    assert(msg.encoder_latency.dequeue_to_write.p95 == 200);
+    assert(msg.encoder_latency.dequeue_to_write.p99 == 300);
+    assert(msg.encoder_latency.dequeue_to_write.max == 400);
+
+    // incomplete message
+    r = sc_device_msg_deserialize(input, sizeof(input) - 1, &msg);
+    assert(r == 0);
+}
+
 int main(int argc, char *argv[]) {
     (void) argc;
     (void) argv;
@@ -91,5 +207,9 @@ int main(int argc, char *argv[]) {
     test_deserialize_clipboard_big();
     test_deserialize_ack_set_clipboard();
     test_deserialize_uhid_output();
+    test_deserialize_clock_sync();
+    test_deserialize_encoder_latency();
+    test_deserialize_time_pong();
+    test_deserialize_pose();
     return 0;
 }
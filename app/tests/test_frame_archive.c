@@ -0,0 +1,114 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "frame_archive.h"
+
+static void
+append(struct sc_frame_archive *archive, uint64_t frame_number) {
+    uint8_t data[16];
+    memset(data, (int) frame_number, sizeof(data));
+    struct sc_frame_archive_chunk chunk = {
+        .data = data,
+        .linesize = sizeof(data),
+        .row_size = sizeof(data),
+        .rows = 1,
+    };
+    bool ok = sc_frame_archive_append(archive, frame_number, frame_number * 10,
+                                      4, 4, &chunk, 1);
+    assert(ok);
+}
+
+static void
+append_delta(struct sc_frame_archive *archive, uint64_t frame_number,
+             uint64_t base_frame_number, uint64_t key_frame_number) {
+    append(archive, frame_number);
+    struct sc_frame_archive_delta delta = {
+        .frame_number = frame_number,
+        .base_frame_number = base_frame_number,
+        .key_frame_number = key_frame_number,
+    };
+    sc_frame_archive_add_delta(archive, &delta);
+}
+
+static void test_broken_delta_chain(void) {
+    char filename[] = "/tmp/test_frame_archive_XXXXXX";
+    int fd = mkstemp(filename);
+    assert(fd != -1);
+    close(fd);
+
+    struct sc_frame_archive archive;
+    bool ok = sc_frame_archive_open(&archive, filename, false, 0);
+    assert(ok);
+
+    append(&archive, 0); // key frame
+    append_delta(&archive, 1, 0, 0);
+    // The save of frame 2 failed (e.g. its compression), after frame 3,
+    // encoded against it, was written by another I/O thread
+    append_delta(&archive, 3, 2, 0);
+    sc_frame_archive_add_dropped(&archive, 2, 20);
+    append_delta(&archive, 4, 3, 0);
+    // The chain restarts on a key frame
+    append(&archive, 5);
+    append_delta(&archive, 6, 5, 5);
+
+    sc_frame_archive_close(&archive);
+
+    FILE *file = fopen(filename, "rb");
+    assert(file);
+
+    struct sc_frame_archive_footer footer;
+    ok = !fseek(file, -(long) sizeof(footer), SEEK_END)
+      && fread(&footer, sizeof(footer), 1, file) == 1;
+    assert(ok);
+    assert(!memcmp(footer.magic, SC_FRAME_ARCHIVE_INDEX_MAGIC,
+                   sizeof(footer.magic)));
+    assert(footer.entry_count == 7);
+
+    struct sc_frame_archive_entry entries[7];
+    ok = !fseek(file, (long) footer.index_offset, SEEK_SET)
+      && fread(entries, sizeof(entries), 1, file) == 1;
+    assert(ok);
+
+    // In the order of the writes
+    static const uint64_t frame_numbers[] = {0, 1, 3, 2, 4, 5, 6};
+    static const bool saved[] = {true, true, false, false, false, true, true};
+    for (unsigned i = 0; i < 7; ++i) {
+        assert(entries[i].frame_number == frame_numbers[i]);
+        assert((entries[i].offset != SC_FRAME_ARCHIVE_DROPPED) == saved[i]);
+    }
+
+    // The delta section is written just before the index
+    struct sc_frame_archive_delta_footer delta_footer;
+    ok = !fseek(file, (long) (footer.index_offset - sizeof(delta_footer)),
+                SEEK_SET)
+      && fread(&delta_footer, sizeof(delta_footer), 1, file) == 1;
+    assert(ok);
+    assert(!memcmp(delta_footer.magic, SC_FRAME_ARCHIVE_DELTA_MAGIC,
+                   sizeof(delta_footer.magic)));
+    assert(delta_footer.delta_count == 2);
+
+    struct sc_frame_archive_delta deltas[2];
+    ok = !fseek(file, (long) delta_footer.deltas_offset, SEEK_SET)
+      && fread(deltas, sizeof(deltas), 1, file) == 1;
+    assert(ok);
+    assert(deltas[0].frame_number == 1);
+    assert(deltas[0].base_frame_number == 0);
+    assert(deltas[1].frame_number == 6);
+    assert(deltas[1].base_frame_number == 5);
+
+    fclose(file);
+    unlink(filename);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_broken_delta_chain();
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "common.h"
+
+#include <assert.h>
+
+#include "frame_decimator.h"
+
+// Count the frames accepted during one second at the given capture rate
+static unsigned
+count_accepted(struct sc_frame_decimator *fd, unsigned capture_fps,
+               int64_t start_pts) {
+    unsigned count = 0;
+    for (unsigned i = 0; i < capture_fps; ++i) {
+        int64_t pts = start_pts + (int64_t) i * 1000000 / capture_fps;
+        // Some jitter
+        pts += (int64_t) (i % 3) * 500 - 500;
+        if (sc_frame_decimator_accept(fd, pts, false)) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+static void test_all_frames(void) {
+    struct sc_output_rate rate = {0};
+    struct sc_frame_decimator fd;
+    sc_frame_decimator_init(&fd, &rate);
+
+    assert(count_accepted(&fd, 72, 0) == 72);
+}
+
+static void test_subsample(void) {
+    struct sc_output_rate rate = {.fps = 10};
+    struct sc_frame_decimator fd;
+    sc_frame_decimator_init(&fd, &rate);
+
+    // 10 frames per second, even if 10 does not divide 72
+    assert(count_accepted(&fd, 72, 0) == 10);
+    assert(count_accepted(&fd, 72, 1000000) == 10);
+
+    // Exactly one frame out of two
+    rate.fps = 30;
+    sc_frame_decimator_init(&fd, &rate);
+    assert(count_accepted(&fd, 60, 0) == 30);
+}
+
+static void test_discontinuity(void) {
+    struct sc_output_rate rate = {.fps = 10};
+    struct sc_frame_decimator fd;
+    sc_frame_decimator_init(&fd, &rate);
+
+    assert(sc_frame_decimator_accept(&fd, 0, false));
+    assert(!sc_frame_decimator_accept(&fd, 50000, false));
+
+    // After a pause, the first frame is accepted
+    assert(sc_frame_decimator_accept(&fd, 5000000, false));
+    assert(!sc_frame_decimator_accept(&fd, 5010000, false));
+
+    // PTS going backwards
+    assert(sc_frame_decimator_accept(&fd, 1000000, false));
+}
+
+static void test_key_frames(void) {
+    struct sc_output_rate rate = {.key_frames = true};
+    struct sc_frame_decimator fd;
+    sc_frame_decimator_init(&fd, &rate);
+
+    assert(sc_frame_decimator_accept(&fd, 0, true));
+    assert(!sc_frame_decimator_accept(&fd, 10000, false));
+    assert(sc_frame_decimator_accept(&fd, 20000, true));
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_all_frames();
+    test_subsample();
+    test_discontinuity();
+    test_key_frames();
+    return 0;
+}
@@ -0,0 +1,45 @@
+#include "common.h"
+
+#include <assert.h>
+
+#include "frame_sync.h"
+
+static void test_match(void) {
+    unsigned oldest = 42;
+
+    int64_t single[] = {1000};
+    assert(sc_frame_sync_match(single, 1, 0, &oldest));
+
+    int64_t exact[] = {1000, 1000, 1000};
+    assert(sc_frame_sync_match(exact, 3, 0, &oldest));
+
+    int64_t close[] = {1005, 1000, 1008};
+    assert(sc_frame_sync_match(close, 3, 8, &oldest));
+    assert(oldest == 42); // untouched on match
+
+    assert(!sc_frame_sync_match(close, 3, 7, &oldest));
+    assert(oldest == 1);
+}
+
+static void test_match_drop_oldest(void) {
+    // Device 1 started late: its first frame can never be matched with the
+    // frames of device 0, which are all newer
+    int64_t ts[] = {2000, 1960};
+    unsigned oldest;
+    assert(!sc_frame_sync_match(ts, 2, 10, &oldest));
+    assert(oldest == 1);
+
+    // Its next frame matches
+    ts[1] = 1995;
+    assert(sc_frame_sync_match(ts, 2, 10, &oldest));
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_match();
+    test_match_drop_oldest();
+
+    return 0;
+}
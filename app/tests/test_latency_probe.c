@@ -0,0 +1,108 @@
+#include "common.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "latency_probe.h"
+
+#define WIDTH 320
+#define HEIGHT 240
+
+// Draw the pattern of the code in the region, as the window does, with some
+// margin and noise
+static void
+draw(uint8_t *y, uint16_t code, const struct sc_latency_probe_region *region,
+     uint8_t black, uint8_t white) {
+    memset(y, 128, WIDTH * HEIGHT);
+    for (int row = region->y; row < region->y + region->height; ++row) {
+        for (int col = region->x; col < region->x + region->width; ++col) {
+            unsigned i = (col - region->x) * SC_LATENCY_PROBE_CELLS
+                       / region->width;
+            bool on;
+            if (!i) {
+                on = true;
+            } else if (i == SC_LATENCY_PROBE_CELLS - 1) {
+                on = false;
+            } else {
+                on = code & (1 << (SC_LATENCY_PROBE_BITS - i));
+            }
+            uint8_t noise = (row * 7 + col * 3) % 9;
+            y[row * WIDTH + col] = (on ? white : black) + noise;
+        }
+    }
+}
+
+static void test_encode_gray(void) {
+    // Consecutive milliseconds differ by a single bit
+    for (sc_tick ms = 0; ms < 70000; ++ms) {
+        uint16_t a = sc_latency_probe_encode(SC_TICK_FROM_MS(ms));
+        uint16_t b = sc_latency_probe_encode(SC_TICK_FROM_MS(ms + 1));
+        uint16_t diff = a ^ b;
+        assert(diff && !(diff & (diff - 1)));
+    }
+}
+
+static void test_round_trip(void) {
+    struct sc_latency_probe_region region = {
+        .width = 180,
+        .height = 10,
+        .x = 20,
+        .y = 200,
+    };
+    uint8_t y[WIDTH * HEIGHT];
+
+    sc_tick drawn = SC_TICK_FROM_MS(123456);
+    uint16_t code = sc_latency_probe_encode(drawn);
+    draw(y, code, &region, 16, 235);
+
+    uint16_t decoded;
+    bool ok = sc_latency_probe_decode(y, WIDTH, WIDTH, HEIGHT, &region,
+                                      &decoded);
+    assert(ok);
+    assert(decoded == code);
+
+    sc_tick latency =
+        sc_latency_probe_get_latency(decoded, drawn + SC_TICK_FROM_MS(87));
+    assert(latency == SC_TICK_FROM_MS(87));
+}
+
+static void test_wrap(void) {
+    // Drawn just before the code wraps, decoded just after
+    sc_tick drawn = SC_TICK_FROM_MS(65535);
+    uint16_t code = sc_latency_probe_encode(drawn);
+    sc_tick latency =
+        sc_latency_probe_get_latency(code, drawn + SC_TICK_FROM_MS(50));
+    assert(latency == SC_TICK_FROM_MS(50));
+}
+
+static void test_no_pattern(void) {
+    struct sc_latency_probe_region region = {
+        .width = 180,
+        .height = 10,
+        .x = 20,
+        .y = 200,
+    };
+    uint8_t y[WIDTH * HEIGHT];
+    uint16_t decoded;
+
+    // Not enough contrast
+    draw(y, 0x1234, &region, 100, 120);
+    assert(!sc_latency_probe_decode(y, WIDTH, WIDTH, HEIGHT, &region,
+                                    &decoded));
+
+    // Out of the frame
+    region.y = 235;
+    assert(!sc_latency_probe_decode(y, WIDTH, WIDTH, HEIGHT, &region,
+                                    &decoded));
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_encode_gray();
+    test_round_trip();
+    test_wrap();
+    test_no_pattern();
+    return 0;
+}
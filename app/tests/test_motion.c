@@ -0,0 +1,155 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "motion_gate.h"
+#include "util/motion.h"
+
+#define SRC_W 203 // not a multiple of the block size nor of the vector size
+#define SRC_H 37
+#define SRC_LINESIZE 208
+#define THUMB_W (SRC_W / SC_MOTION_SCALE)
+#define THUMB_H (SRC_H / SC_MOTION_SCALE)
+
+static uint8_t src[SRC_H * SRC_LINESIZE];
+
+static unsigned avg(unsigned a, unsigned b) {
+    return (a + b + 1) >> 1;
+}
+
+static void fill(uint8_t *plane, unsigned seed) {
+    for (int i = 0; i < SRC_H * SRC_LINESIZE; ++i) {
+        plane[i] = (uint8_t) ((i * 7919u + seed * 104729u) >> 3);
+    }
+}
+
+static void test_motion_downscale(void) {
+    fill(src, 1);
+
+    uint8_t thumb[THUMB_H][THUMB_W];
+    sc_motion_downscale(src, SRC_LINESIZE, SRC_W, SRC_H, &thumb[0][0]);
+
+    for (int y = 0; y < THUMB_H; ++y) {
+        for (int x = 0; x < THUMB_W; ++x) {
+            unsigned sum = 0;
+            for (int k = 0; k < 4; ++k) {
+                const uint8_t *p = src + y * 4 * SRC_LINESIZE + x * 4 + k;
+                sum += avg(avg(p[0], p[SRC_LINESIZE]),
+                           avg(p[2 * SRC_LINESIZE], p[3 * SRC_LINESIZE]));
+            }
+            assert(thumb[y][x] == (sum + 2) >> 2);
+        }
+    }
+
+    // A uniform plane stays uniform
+    memset(src, 200, sizeof(src));
+    sc_motion_downscale(src, SRC_LINESIZE, SRC_W, SRC_H, &thumb[0][0]);
+    for (int y = 0; y < THUMB_H; ++y) {
+        for (int x = 0; x < THUMB_W; ++x) {
+            assert(thumb[y][x] == 200);
+        }
+    }
+}
+
+static void test_motion_sad(void) {
+    uint8_t a[1001];
+    uint8_t b[1001];
+    for (unsigned i = 0; i < sizeof(a); ++i) {
+        a[i] = (uint8_t) (i * 31);
+        b[i] = (uint8_t) (i * 17 + 5);
+    }
+
+    // Unaligned, with a scalar tail
+    for (unsigned offset = 0; offset < 3; ++offset) {
+        size_t len = sizeof(a) - offset;
+        uint64_t expected = 0;
+        for (unsigned i = offset; i < sizeof(a); ++i) {
+            expected += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        }
+        assert(sc_motion_sad(a + offset, b + offset, len) == expected);
+    }
+
+    assert(sc_motion_sad(a, a, sizeof(a)) == 0);
+}
+
+static void test_motion_sad_2d(void) {
+    static uint8_t other[SRC_H * SRC_LINESIZE];
+    fill(src, 1);
+    fill(other, 2);
+
+    // A block of the source against a block of another plane, with
+    // different line sizes
+    int x = 3;
+    int y = 5;
+    int w = 67;
+    int h = 19;
+    int other_linesize = 101;
+    uint64_t expected = 0;
+    for (int j = 0; j < h; ++j) {
+        for (int i = 0; i < w; ++i) {
+            uint8_t a = src[(y + j) * SRC_LINESIZE + x + i];
+            uint8_t b = other[j * other_linesize + i];
+            expected += a > b ? a - b : b - a;
+        }
+    }
+
+    const uint8_t *block = src + y * SRC_LINESIZE + x;
+    assert(sc_motion_sad_2d(block, SRC_LINESIZE, other, other_linesize, w, h)
+            == expected);
+    assert(sc_motion_sad_2d(block, SRC_LINESIZE, block, SRC_LINESIZE, w, h)
+            == 0);
+}
+
+static void test_motion_gate(void) {
+    struct sc_motion_gate gate;
+    sc_motion_gate_init(&gate, 1.5f);
+
+    fill(src, 1);
+    // The first frame is always accepted
+    assert(sc_motion_gate_accept(&gate, src, SRC_LINESIZE, SRC_W, SRC_H));
+    // The same frame is not
+    assert(!sc_motion_gate_accept(&gate, src, SRC_LINESIZE, SRC_W, SRC_H));
+
+    // A slow drift accumulates against the last frame accepted
+    unsigned accepted = 0;
+    for (int i = 0; i < 4; ++i) {
+        for (size_t j = 0; j < sizeof(src); ++j) {
+            if (src[j] < 255) {
+                ++src[j];
+            }
+        }
+        if (sc_motion_gate_accept(&gate, src, SRC_LINESIZE, SRC_W, SRC_H)) {
+            ++accepted;
+        }
+    }
+    // +1 is below the threshold, +2 is not
+    assert(accepted == 2);
+
+    // After a reset, the frame is accepted
+    sc_motion_gate_reset(&gate);
+    assert(sc_motion_gate_accept(&gate, src, SRC_LINESIZE, SRC_W, SRC_H));
+
+    // A change of size too
+    assert(sc_motion_gate_accept(&gate, src, SRC_LINESIZE, SRC_W - 8, SRC_H));
+    assert(!sc_motion_gate_accept(&gate, src, SRC_LINESIZE, SRC_W - 8, SRC_H));
+
+    // A completely different frame is accepted
+    fill(src, 2);
+    assert(sc_motion_gate_accept(&gate, src, SRC_LINESIZE, SRC_W - 8, SRC_H));
+
+    sc_motion_gate_destroy(&gate);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_motion_downscale();
+    test_motion_sad();
+    test_motion_sad_2d();
+    test_motion_gate();
+    return 0;
+}
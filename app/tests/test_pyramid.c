@@ -0,0 +1,72 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "util/pyramid.h"
+
+#define SRC_W 77 // odd, and not a multiple of the vector size
+#define SRC_H 23
+#define SRC_LINESIZE 80
+#define DST_W (SRC_W / 2)
+#define DST_H (SRC_H / 2)
+#define DST_LINESIZE 40
+
+static uint8_t src[SRC_H * SRC_LINESIZE];
+static uint8_t dst[DST_H * DST_LINESIZE];
+static uint16_t scratch[SRC_W + 1];
+
+static unsigned
+at(int x, int y) {
+    // Clamped on the left and top edges
+    x = x < 0 ? 0 : x;
+    y = y < 0 ? 0 : y;
+    assert(x < SRC_W && y < SRC_H);
+    return src[y * SRC_LINESIZE + x];
+}
+
+static void test_pyramid_reduce(void) {
+    for (int i = 0; i < SRC_H * SRC_LINESIZE; ++i) {
+        src[i] = (uint8_t) ((i * 7919u) >> 3);
+    }
+    memset(dst, 0xAA, sizeof(dst));
+
+    sc_pyramid_reduce(src, SRC_LINESIZE, SRC_W, SRC_H, dst, DST_LINESIZE,
+                      scratch);
+
+    static const unsigned k[3] = {1, 2, 1};
+    for (int y = 0; y < DST_H; ++y) {
+        for (int x = 0; x < DST_W; ++x) {
+            unsigned sum = 0;
+            for (int j = 0; j < 3; ++j) {
+                for (int i = 0; i < 3; ++i) {
+                    sum += k[j] * k[i] * at(2 * x + i - 1, 2 * y + j - 1);
+                }
+            }
+            assert(dst[y * DST_LINESIZE + x] == (sum + 8) >> 4);
+        }
+        // The padding is not written
+        for (int x = DST_W; x < DST_LINESIZE; ++x) {
+            assert(dst[y * DST_LINESIZE + x] == 0xAA);
+        }
+    }
+
+    // A uniform plane stays uniform, without overflow
+    memset(src, 255, sizeof(src));
+    sc_pyramid_reduce(src, SRC_LINESIZE, SRC_W, SRC_H, dst, DST_LINESIZE,
+                      scratch);
+    for (int y = 0; y < DST_H; ++y) {
+        for (int x = 0; x < DST_W; ++x) {
+            assert(dst[y * DST_LINESIZE + x] == 255);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_pyramid_reduce();
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "util/qoi.h"
+
+static void test_qoi_header(void) {
+    uint8_t rgb[3] = {0, 0, 0};
+    uint8_t out[64];
+
+    size_t size = sc_qoi_encode_rgb(rgb, 3, 1, 1, out);
+    assert(size <= sc_qoi_max_size(1, 1));
+
+    static const uint8_t expected_header[] = {
+        'q', 'o', 'i', 'f',
+        0x00, 0x00, 0x00, 0x01, // width
+        0x00, 0x00, 0x00, 0x01, // height
+        0x03, // channels
+        0x00, // colorspace
+    };
+    assert(!memcmp(out, expected_header, sizeof(expected_header)));
+
+    static const uint8_t expected_end[] = {0, 0, 0, 0, 0, 0, 0, 1};
+    assert(!memcmp(out + size - 8, expected_end, sizeof(expected_end)));
+}
+
+static void test_qoi_run(void) {
+    // 2x2 black pixels, equal to the initial previous pixel
+    uint8_t rgb[12] = {0};
+    uint8_t out[64];
+
+    size_t size = sc_qoi_encode_rgb(rgb, 6, 2, 2, out);
+    assert(size == 14 + 1 + 8);
+    assert(out[14] == (0xc0 | 3)); // QOI_OP_RUN, run length 4
+}
+
+static void test_qoi_ops(void) {
+    uint8_t rgb[] = {
+        0xff, 0x00, 0x00, // red: small diff from black (wrapping)
+        0x10, 0x20, 0x30, // large diff: QOI_OP_RGB
+        0x12, 0x24, 0x30, // luma diff
+        0xff, 0x00, 0x00, // red again: in the index
+    };
+    uint8_t out[64];
+
+    size_t size = sc_qoi_encode_rgb(rgb, sizeof(rgb), 4, 1, out);
+    static const uint8_t expected[] = {
+        0x40 | (1 << 4) | (2 << 2) | 2, // QOI_OP_DIFF (-1, 0, 0)
+        0xfe, 0x10, 0x20, 0x30, // QOI_OP_RGB
+        0x80 | (4 + 32), ((-2 + 8) << 4) | (-4 + 8), // QOI_OP_LUMA
+        0x00 | 50, // QOI_OP_INDEX
+    };
+    assert(size == 14 + sizeof(expected) + 8);
+    assert(!memcmp(out + 14, expected, sizeof(expected)));
+}
+
+static void test_qoi_linesize(void) {
+    // Rows are padded: the padding must be ignored
+    uint8_t rgb[2 * 8] = {
+        1, 2, 3, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA,
+        1, 2, 3, 0xBB, 0xBB, 0xBB, 0xBB, 0xBB,
+    };
+    uint8_t out[64];
+
+    size_t size = sc_qoi_encode_rgb(rgb, 8, 1, 2, out);
+    static const uint8_t expected[] = {
+        0x80 | (2 + 32), ((-1 + 8) << 4) | (1 + 8), // QOI_OP_LUMA
+        0xc0, // QOI_OP_RUN, run length 1
+    };
+    assert(size == 14 + sizeof(expected) + 8);
+    assert(!memcmp(out + 14, expected, sizeof(expected)));
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_qoi_header();
+    test_qoi_run();
+    test_qoi_ops();
+    test_qoi_linesize();
+    return 0;
+}
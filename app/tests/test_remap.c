@@ -0,0 +1,312 @@
+#include "common.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/remap.h"
+
+#define SRC_W 37
+#define SRC_H 23
+#define SRC_LINESIZE 40
+#define DST_W 301 // not a multiple of the vector size
+#define DST_H 19
+#define BORDER 7
+
+static uint8_t src[SRC_H * SRC_LINESIZE];
+static int16_t map1[DST_H][DST_W][2];
+static uint16_t map2[DST_H][DST_W];
+static uint8_t dst[DST_H][DST_W];
+
+static double sample(int x, int y) {
+    if (x < 0 || x >= SRC_W || y < 0 || y >= SRC_H) {
+        return BORDER;
+    }
+    return src[y * SRC_LINESIZE + x];
+}
+
+static void test_remap_bilinear(void) {
+    for (int y = 0; y < SRC_H; ++y) {
+        for (int x = 0; x < SRC_LINESIZE; ++x) {
+            // The padding must never be read
+            src[y * SRC_LINESIZE + x] = x < SRC_W ? (x * 29 + y * 71) & 0xff
+                                                  : 0xff;
+        }
+    }
+
+    // A rotation with scaling, partially outside of the source
+    for (int y = 0; y < DST_H; ++y) {
+        for (int x = 0; x < DST_W; ++x) {
+            double sx = x * 0.15 - y * 0.2 - 3;
+            double sy = x * 0.07 + y * 0.9 - 2;
+            int ix = lround(sx * 32);
+            int iy = lround(sy * 32);
+            map1[y][x][0] = ix >> 5;
+            map1[y][x][1] = iy >> 5;
+            map2[y][x] = (iy & 31) << 5 | (ix & 31);
+        }
+    }
+
+    sc_remap_u8(src, SRC_LINESIZE, SRC_W, SRC_H, &dst[0][0], DST_W, DST_W,
+                DST_H, &map1[0][0][0], DST_W * 4, &map2[0][0], DST_W * 2,
+                BORDER);
+
+    for (int y = 0; y < DST_H; ++y) {
+        for (int x = 0; x < DST_W; ++x) {
+            int sx = map1[y][x][0];
+            int sy = map1[y][x][1];
+            double fx = (map2[y][x] & 31) / 32.;
+            double fy = (map2[y][x] >> 5) / 32.;
+            double v = (sample(sx, sy) * (1 - fx) + sample(sx + 1, sy) * fx)
+                     * (1 - fy)
+                     + (sample(sx, sy + 1) * (1 - fx)
+                        + sample(sx + 1, sy + 1) * fx) * fy;
+            // Rounded half up, like cv::remap()
+            assert(dst[y][x] == (int) floor(v + 0.5));
+        }
+    }
+}
+
+static void
+set_map(int x, int y, double sx, double sy) {
+    int ix = lround(sx * 32);
+    int iy = lround(sy * 32);
+    map1[y][x][0] = ix >> 5;
+    map1[y][x][1] = iy >> 5;
+    map2[y][x] = (iy & 31) << 5 | (ix & 31);
+}
+
+static void test_remap_grid(void) {
+    for (int y = 0; y < SRC_H; ++y) {
+        for (int x = 0; x < SRC_W; ++x) {
+            src[y * SRC_LINESIZE + x] = (x * 13 + y * 37) & 0xff;
+        }
+    }
+
+    // A smooth distortion (like a lens), partially outside of the source
+    for (int y = 0; y < DST_H; ++y) {
+        for (int x = 0; x < DST_W; ++x) {
+            double u = x / (double) DST_W - 0.5;
+            double v = y / (double) DST_H - 0.5;
+            double k = 1 + 0.05 * (u * u + v * v);
+            set_map(x, y, (u * k + 0.5) * SRC_W, (v * k + 0.5) * SRC_H);
+        }
+    }
+
+    struct sc_remap_grid grid;
+    bool ok = sc_remap_grid_init(&grid, &map1[0][0][0], DST_W * 4,
+                                 &map2[0][0], DST_W * 2, DST_W, DST_H, SRC_W,
+                                 SRC_H);
+    assert(ok);
+    assert(grid.shift >= SC_REMAP_GRID_MIN_SHIFT);
+    assert(sc_remap_grid_get_size(&grid) < sizeof(map1) + sizeof(map2));
+
+    // The grid is within the tolerance of the dense map
+    static int16_t xy[DST_H][DST_W][2];
+    static uint16_t frac[DST_H][DST_W];
+    for (int y = 0; y < DST_H; ++y) {
+        sc_remap_grid_get_row(&grid, y, 0, DST_W, &xy[y][0][0], &frac[y][0]);
+        for (int x = 0; x < DST_W; ++x) {
+            int gx = xy[y][x][0] * 32 + (frac[y][x] & 31);
+            int gy = xy[y][x][1] * 32 + (frac[y][x] >> 5);
+            int qx = map1[y][x][0] * 32 + (map2[y][x] & 31);
+            int qy = map1[y][x][1] * 32 + (map2[y][x] >> 5);
+            if (qx <= -32 || qy <= -32 || qx >= SRC_W * 32
+                    || qy >= SRC_H * 32) {
+                // Only the border is sampled, not compared
+                continue;
+            }
+            assert(abs(gx - qx) <= SC_REMAP_GRID_MAX_ERROR);
+            assert(abs(gy - qy) <= SC_REMAP_GRID_MAX_ERROR);
+        }
+    }
+
+    // Same result as the dense remap by the expanded map, for a band of rows
+    static uint8_t expected[DST_H][DST_W];
+    sc_remap_u8(src, SRC_LINESIZE, SRC_W, SRC_H, &expected[0][0], DST_W,
+                DST_W, DST_H, &xy[0][0][0], DST_W * 4, &frac[0][0], DST_W * 2,
+                BORDER);
+    memset(dst, 0, sizeof(dst));
+    sc_remap_grid_u8(src, SRC_LINESIZE, SRC_W, SRC_H, &dst[3][0], DST_W,
+                     &grid, 3, 17, BORDER);
+    assert(!memcmp(&dst[3][0], &expected[3][0], 14 * DST_W));
+    assert(dst[2][0] == 0 && dst[17][0] == 0);
+
+    sc_remap_grid_destroy(&grid);
+}
+
+static void test_remap_grid_rejected(void) {
+    // Not smooth: no grid reproduces it
+    for (int y = 0; y < DST_H; ++y) {
+        for (int x = 0; x < DST_W; ++x) {
+            set_map(x, y, (x * 7919 % 37) * 0.9, (y * 104729 % 23) * 0.9);
+        }
+    }
+
+    struct sc_remap_grid grid;
+    bool ok = sc_remap_grid_init(&grid, &map1[0][0][0], DST_W * 4,
+                                 &map2[0][0], DST_W * 2, DST_W, DST_H, SRC_W,
+                                 SRC_H);
+    assert(!ok);
+}
+
+static void test_remap_spans(void) {
+    for (int y = 0; y < SRC_H; ++y) {
+        for (int x = 0; x < SRC_W; ++x) {
+            src[y * SRC_LINESIZE + x] = (x * 17 + y * 43) & 0xff;
+        }
+    }
+
+    // Zoomed out: the left, right, top and bottom of the destination are
+    // outside of the source
+    for (int y = 0; y < DST_H; ++y) {
+        for (int x = 0; x < DST_W; ++x) {
+            double u = x / (double) DST_W - 0.5;
+            double v = y / (double) DST_H - 0.5;
+            set_map(x, y, (u * 1.6 + 0.5) * SRC_W, (v * 1.6 + 0.5) * SRC_H);
+        }
+    }
+
+    static struct sc_remap_span spans[DST_H];
+    sc_remap_spans_init(spans, &map1[0][0][0], DST_W * 4, DST_W, DST_H, SRC_W,
+                        SRC_H);
+    // The rows at the top are entirely outside, the others partially
+    assert(spans[0].x0 == spans[0].x1);
+    assert(spans[DST_H / 2].x0 > 0 && spans[DST_H / 2].x1 < DST_W);
+
+    static uint8_t expected[DST_H][DST_W];
+    sc_remap_u8(src, SRC_LINESIZE, SRC_W, SRC_H, &expected[0][0], DST_W,
+                DST_W, DST_H, &map1[0][0][0], DST_W * 4, &map2[0][0],
+                DST_W * 2, BORDER);
+    memset(dst, 0, sizeof(dst));
+    sc_remap_u8_spans(src, SRC_LINESIZE, SRC_W, SRC_H, &dst[0][0], DST_W,
+                      DST_W, DST_H, &map1[0][0][0], DST_W * 4, &map2[0][0],
+                      DST_W * 2, spans, BORDER);
+    assert(!memcmp(dst, expected, sizeof(dst)));
+
+    // The grid computes its own spans
+    struct sc_remap_grid grid;
+    bool ok = sc_remap_grid_init(&grid, &map1[0][0][0], DST_W * 4,
+                                 &map2[0][0], DST_W * 2, DST_W, DST_H, SRC_W,
+                                 SRC_H);
+    assert(ok);
+    assert(grid.spans);
+
+    static uint8_t without_spans[DST_H][DST_W];
+    struct sc_remap_span *grid_spans = grid.spans;
+    grid.spans = NULL;
+    sc_remap_grid_u8(src, SRC_LINESIZE, SRC_W, SRC_H, &without_spans[0][0],
+                     DST_W, &grid, 0, DST_H, BORDER);
+    grid.spans = grid_spans;
+
+    memset(dst, 0, sizeof(dst));
+    sc_remap_grid_u8(src, SRC_LINESIZE, SRC_W, SRC_H, &dst[0][0], DST_W,
+                     &grid, 0, DST_H, BORDER);
+    assert(!memcmp(dst, without_spans, sizeof(dst)));
+
+    sc_remap_grid_destroy(&grid);
+}
+
+#define YUV_SRC_W 40
+#define YUV_SRC_H 24
+#define YUV_W 38 // more rows than a band
+#define YUV_H 36
+
+static void
+set_yuv_map(int16_t *m1, uint16_t *m2, int width, int height, double scale) {
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            // A slight rotation, partially outside of the source
+            double sx = (x * 1.1 - y * 0.1 - 1) * scale;
+            double sy = (x * 0.05 + y * 0.7 - 1) * scale;
+            int ix = lround(sx * 32);
+            int iy = lround(sy * 32);
+            m1[2 * (y * width + x)] = ix >> 5;
+            m1[2 * (y * width + x) + 1] = iy >> 5;
+            m2[y * width + x] = (iy & 31) << 5 | (ix & 31);
+        }
+    }
+}
+
+static void test_remap_yuv420p_to_rgb(void) {
+    static uint8_t planes[3][YUV_SRC_H * YUV_SRC_W];
+    for (int i = 0; i < YUV_SRC_H * YUV_SRC_W; ++i) {
+        planes[0][i] = (i * 37) & 0xff;
+        planes[1][i] = (i * 11 + 50) & 0xff;
+        planes[2][i] = (i * 23 + 100) & 0xff;
+    }
+    const uint8_t *src_planes[3] = {planes[0], planes[1], planes[2]};
+    int src_linesizes[3] = {YUV_SRC_W, YUV_SRC_W / 2, YUV_SRC_W / 2};
+
+    static int16_t luma1[YUV_H * YUV_W * 2];
+    static uint16_t luma2[YUV_H * YUV_W];
+    static int16_t chroma1[YUV_H * YUV_W / 2];
+    static uint16_t chroma2[YUV_H * YUV_W / 4];
+    set_yuv_map(luma1, luma2, YUV_W, YUV_H, 1);
+    set_yuv_map(chroma1, chroma2, YUV_W / 2, YUV_H / 2, 0.5);
+
+    // Reference: each plane remapped, then converted
+    static uint8_t yuv[3][YUV_H * YUV_W];
+    sc_remap_u8(planes[0], YUV_SRC_W, YUV_SRC_W, YUV_SRC_H, yuv[0], YUV_W,
+                YUV_W, YUV_H, luma1, YUV_W * 4, luma2, YUV_W * 2, 0);
+    for (int i = 1; i < 3; ++i) {
+        sc_remap_u8(planes[i], YUV_SRC_W / 2, YUV_SRC_W / 2, YUV_SRC_H / 2,
+                    yuv[i], YUV_W / 2, YUV_W / 2, YUV_H / 2, chroma1,
+                    YUV_W * 2, chroma2, YUV_W, 128);
+    }
+    const uint8_t *yuv_planes[3] = {yuv[0], yuv[1], yuv[2]};
+    int yuv_linesizes[3] = {YUV_W, YUV_W / 2, YUV_W / 2};
+    static uint8_t expected[YUV_H * YUV_W * 3];
+    sc_yuv420p_to_rgb24(yuv_planes, yuv_linesizes, expected, YUV_W * 3, YUV_W,
+                        YUV_H);
+
+    struct sc_remap_plane_map luma = {
+        .map1 = luma1,
+        .map1_linesize = YUV_W * 4,
+        .map2 = luma2,
+        .map2_linesize = YUV_W * 2,
+    };
+    struct sc_remap_plane_map chroma = {
+        .map1 = chroma1,
+        .map1_linesize = YUV_W * 2,
+        .map2 = chroma2,
+        .map2_linesize = YUV_W,
+    };
+
+    static uint8_t rgb[YUV_H * YUV_W * 3];
+    bool ok = sc_remap_yuv420p_to_rgb(src_planes, src_linesizes, YUV_SRC_W,
+                                      YUV_SRC_H, &luma, &chroma, rgb,
+                                      YUV_W * 3, YUV_W, 0, YUV_H,
+                                      SC_RGB_FORMAT_RGB24);
+    assert(ok);
+    assert(!memcmp(rgb, expected, sizeof(rgb)));
+
+    // A range of rows, as processed by a thread, in BGRA
+    static uint8_t bgra[YUV_H * YUV_W * 4];
+    ok = sc_remap_yuv420p_to_rgb(src_planes, src_linesizes, YUV_SRC_W,
+                                 YUV_SRC_H, &luma, &chroma, bgra, YUV_W * 4,
+                                 YUV_W, 6, 30, SC_RGB_FORMAT_BGRA);
+    assert(ok);
+    for (int y = 6; y < 30; ++y) {
+        for (int x = 0; x < YUV_W; ++x) {
+            const uint8_t *e = &expected[(y * YUV_W + x) * 3];
+            const uint8_t *p = &bgra[((y - 6) * YUV_W + x) * 4];
+            assert(p[0] == e[2] && p[1] == e[1] && p[2] == e[0]);
+            assert(p[3] == 255);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_remap_bilinear();
+    test_remap_grid();
+    test_remap_grid_rejected();
+    test_remap_spans();
+    test_remap_yuv420p_to_rgb();
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include "common.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "remap_layout.h"
+
+static bool parse(const char *s, struct sc_remap_layout *layout) {
+    return sc_remap_layout_parse(s, strlen(s), layout);
+}
+
+static void test_parse_names(void) {
+    struct sc_remap_layout layout;
+
+    assert(parse("mono", &layout));
+    assert(layout.cols == 1 && layout.rows == 1);
+
+    assert(parse("side-by-side", &layout));
+    assert(layout.cols == 2 && layout.rows == 1);
+
+    assert(parse("top-bottom", &layout));
+    assert(layout.cols == 1 && layout.rows == 2);
+
+    // As written by cv::FileStorage
+    assert(parse(" \"mono\"\n", &layout));
+    assert(layout.cols == 1 && layout.rows == 1);
+}
+
+static void test_parse_grid(void) {
+    struct sc_remap_layout layout;
+
+    assert(parse("2x2", &layout));
+    assert(layout.cols == 2 && layout.rows == 2);
+    assert(sc_remap_layout_get_views(&layout) == 4);
+
+    assert(parse("3x1", &layout));
+    assert(layout.cols == 3 && layout.rows == 1);
+
+    assert(!parse("3x2", &layout)); // more than SC_REMAP_LAYOUT_MAX_VIEWS
+    assert(!parse("0x1", &layout));
+    assert(!parse("2x", &layout));
+    assert(!parse("x2", &layout));
+    assert(!parse("2x1x1", &layout));
+    assert(!parse("stereo", &layout));
+    assert(!parse("", &layout));
+}
+
+static void test_map_names(void) {
+    char name[32];
+
+    struct sc_remap_layout mono = {1, 1};
+    sc_remap_layout_get_map_name(&mono, 0, 'X', name, sizeof(name));
+    assert(!strcmp(name, "mapX"));
+
+    struct sc_remap_layout sbs = {2, 1};
+    sc_remap_layout_get_map_name(&sbs, 0, 'X', name, sizeof(name));
+    assert(!strcmp(name, "leftMapX"));
+    sc_remap_layout_get_map_name(&sbs, 1, 'Y', name, sizeof(name));
+    assert(!strcmp(name, "rightMapY"));
+
+    struct sc_remap_layout tb = {1, 2};
+    sc_remap_layout_get_map_name(&tb, 1, 'X', name, sizeof(name));
+    assert(!strcmp(name, "bottomMapX"));
+
+    struct sc_remap_layout grid = {2, 2};
+    sc_remap_layout_get_map_name(&grid, 3, 'Y', name, sizeof(name));
+    assert(!strcmp(name, "view3MapY"));
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_parse_names();
+    test_parse_grid();
+    test_map_names();
+    return 0;
+}
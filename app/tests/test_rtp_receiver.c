@@ -0,0 +1,230 @@
+#include "common.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "rtp_receiver.h"
+#include "util/binary.h"
+
+#define SSRC 0x12345678
+#define MAX_DATAGRAMS 32
+#define MAX_FRAGMENT_SIZE 64
+
+struct datagram {
+    uint8_t data[SC_RTP_HEADER_SIZE + SC_RTP_PAYLOAD_HEADER_SIZE
+                 + MAX_FRAGMENT_SIZE];
+    size_t len;
+};
+
+static void
+write_header(uint8_t *p, uint32_t index, uint32_t size, uint16_t fragment_index,
+             uint16_t fragment_count, uint16_t fragment_size,
+             uint8_t fec_group) {
+    p[0] = 2 << 6;
+    p[1] = SC_RTP_PAYLOAD_TYPE;
+    sc_write16be(&p[2], 0);
+    sc_write32be(&p[4], 0);
+    sc_write32be(&p[8], SSRC);
+    p += SC_RTP_HEADER_SIZE;
+    sc_write32be(p, index);
+    sc_write64be(&p[4], 1000 + index); // pts
+    sc_write32be(&p[12], size);
+    p[16] = 0;
+    sc_write64be(&p[17], 42);
+    sc_write16be(&p[25], fragment_index);
+    sc_write16be(&p[27], fragment_count);
+    sc_write16be(&p[29], fragment_size);
+    p[31] = fec_group;
+}
+
+// Split a packet like the device does, return the number of datagrams
+static unsigned
+packetize(uint32_t index, const uint8_t *data, uint32_t size,
+          uint16_t fragment_size, uint8_t fec_group, struct datagram *out) {
+    uint16_t count = (size + fragment_size - 1) / fragment_size;
+    unsigned n = 0;
+    uint8_t parity[MAX_FRAGMENT_SIZE];
+    size_t parity_len = 0;
+    for (uint16_t i = 0; i < count; ++i) {
+        uint32_t offset = i * fragment_size;
+        uint32_t len = size - offset < fragment_size ? size - offset
+                                                     : fragment_size;
+        struct datagram *d = &out[n++];
+        write_header(d->data, index, size, i, count, fragment_size, fec_group);
+        memcpy(d->data + SC_RTP_HEADER_SIZE + SC_RTP_PAYLOAD_HEADER_SIZE,
+               data + offset, len);
+        d->len = SC_RTP_HEADER_SIZE + SC_RTP_PAYLOAD_HEADER_SIZE + len;
+
+        if (fec_group) {
+            if (i % fec_group == 0) {
+                memset(parity, 0, sizeof(parity));
+                parity_len = len;
+            }
+            for (uint32_t j = 0; j < len; ++j) {
+                parity[j] ^= data[offset + j];
+            }
+            if (i % fec_group == fec_group - 1 || i == count - 1) {
+                struct datagram *p = &out[n++];
+                write_header(p->data, index, size, count + i / fec_group,
+                             count, fragment_size, fec_group);
+                memcpy(p->data + SC_RTP_HEADER_SIZE
+                            + SC_RTP_PAYLOAD_HEADER_SIZE,
+                       parity, parity_len);
+                p->len = SC_RTP_HEADER_SIZE + SC_RTP_PAYLOAD_HEADER_SIZE
+                       + parity_len;
+            }
+        }
+    }
+    assert(n <= MAX_DATAGRAMS);
+    return n;
+}
+
+static void
+fill(uint8_t *data, size_t size, uint8_t seed) {
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = (uint8_t) (seed + i * 7);
+    }
+}
+
+static void test_reassemble(void) {
+    struct sc_rtp_receiver rx;
+    sc_rtp_receiver_init(&rx, SSRC);
+
+    uint8_t data[100];
+    fill(data, sizeof(data), 1);
+
+    struct datagram dgrams[MAX_DATAGRAMS];
+    unsigned n = packetize(0, data, sizeof(data), 32, 0, dgrams);
+    assert(n == 4);
+
+    struct sc_rtp_frame frame;
+    // Reordered fragments
+    assert(!sc_rtp_receiver_push(&rx, dgrams[2].data, dgrams[2].len, &frame));
+    assert(!sc_rtp_receiver_push(&rx, dgrams[0].data, dgrams[0].len, &frame));
+    assert(!sc_rtp_receiver_push(&rx, dgrams[3].data, dgrams[3].len, &frame));
+    assert(sc_rtp_receiver_push(&rx, dgrams[1].data, dgrams[1].len, &frame));
+
+    assert(frame.size == sizeof(data));
+    assert(!memcmp(frame.data, data, sizeof(data)));
+    assert(frame.pts_flags == 1000);
+    assert(frame.capture_ns == 42);
+    assert(frame.lost == 0);
+
+    // Duplicates of a delivered frame are ignored
+    assert(!sc_rtp_receiver_push(&rx, dgrams[1].data, dgrams[1].len, &frame));
+
+    sc_rtp_receiver_destroy(&rx);
+}
+
+static void test_fec_recovery(void) {
+    struct sc_rtp_receiver rx;
+    sc_rtp_receiver_init(&rx, SSRC);
+
+    uint8_t data[150];
+    fill(data, sizeof(data), 3);
+
+    // 5 data fragments (the last one is 22 bytes), in groups of 2: 3 parity
+    // fragments
+    struct datagram dgrams[MAX_DATAGRAMS];
+    unsigned n = packetize(0, data, sizeof(data), 32, 2, dgrams);
+    assert(n == 8);
+
+    // Lose one fragment in every group (including the short last one)
+    struct sc_rtp_frame frame;
+    bool complete = false;
+    unsigned lost[] = {1, 3, 6};
+    for (unsigned i = 0; i < n; ++i) {
+        if (i == lost[0] || i == lost[1] || i == lost[2]) {
+            continue;
+        }
+        assert(!complete);
+        complete = sc_rtp_receiver_push(&rx, dgrams[i].data, dgrams[i].len,
+                                        &frame);
+    }
+
+    assert(complete);
+    assert(frame.size == sizeof(data));
+    assert(!memcmp(frame.data, data, sizeof(data)));
+    assert(rx.recovered == 3);
+
+    sc_rtp_receiver_destroy(&rx);
+}
+
+static void test_drop_incomplete(void) {
+    struct sc_rtp_receiver rx;
+    sc_rtp_receiver_init(&rx, SSRC);
+
+    uint8_t data0[64];
+    uint8_t data1[64];
+    uint8_t data3[10];
+    fill(data0, sizeof(data0), 5);
+    fill(data1, sizeof(data1), 6);
+    fill(data3, sizeof(data3), 7);
+
+    struct datagram d0[MAX_DATAGRAMS];
+    struct datagram d1[MAX_DATAGRAMS];
+    struct datagram d3[MAX_DATAGRAMS];
+    unsigned n0 = packetize(0, data0, sizeof(data0), 32, 0, d0);
+    unsigned n1 = packetize(1, data1, sizeof(data1), 32, 0, d1);
+    unsigned n3 = packetize(3, data3, sizeof(data3), 32, 0, d3);
+    assert(n0 == 2 && n1 == 2 && n3 == 1);
+
+    struct sc_rtp_frame frame;
+    // Frame 0 is incomplete when frame 1 completes
+    assert(!sc_rtp_receiver_push(&rx, d0[0].data, d0[0].len, &frame));
+    assert(!sc_rtp_receiver_push(&rx, d1[0].data, d1[0].len, &frame));
+    assert(sc_rtp_receiver_push(&rx, d1[1].data, d1[1].len, &frame));
+    assert(!memcmp(frame.data, data1, sizeof(data1)));
+    assert(frame.lost == 1);
+
+    // The end of frame 0 arrives too late
+    assert(!sc_rtp_receiver_push(&rx, d0[1].data, d0[1].len, &frame));
+
+    // Frame 2 is never received
+    assert(sc_rtp_receiver_push(&rx, d3[0].data, d3[0].len, &frame));
+    assert(!memcmp(frame.data, data3, sizeof(data3)));
+    assert(frame.pts_flags == 1003);
+    assert(frame.lost == 1);
+
+    assert(rx.frames == 2);
+    assert(rx.lost == 2);
+
+    sc_rtp_receiver_destroy(&rx);
+}
+
+static void test_invalid(void) {
+    struct sc_rtp_receiver rx;
+    sc_rtp_receiver_init(&rx, SSRC + 1); // another session
+
+    uint8_t data[10];
+    fill(data, sizeof(data), 9);
+
+    struct datagram dgrams[MAX_DATAGRAMS];
+    unsigned n = packetize(0, data, sizeof(data), 32, 0, dgrams);
+    assert(n == 1);
+
+    struct sc_rtp_frame frame;
+    assert(!sc_rtp_receiver_push(&rx, dgrams[0].data, dgrams[0].len, &frame));
+
+    // Truncated
+    rx.ssrc = SSRC;
+    assert(!sc_rtp_receiver_push(&rx, dgrams[0].data, dgrams[0].len - 1,
+                                 &frame));
+    assert(rx.invalid == 2);
+
+    assert(sc_rtp_receiver_push(&rx, dgrams[0].data, dgrams[0].len, &frame));
+
+    sc_rtp_receiver_destroy(&rx);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_reassemble();
+    test_fec_recovery();
+    test_drop_incomplete();
+    test_invalid();
+
+    return 0;
+}
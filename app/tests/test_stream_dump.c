@@ -0,0 +1,79 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stream_dump.h"
+#include "util/binary.h"
+
+static void test_round_trip(void) {
+    char filename[] = "/tmp/test_stream_dump_XXXXXX";
+    int fd = mkstemp(filename);
+    assert(fd != -1);
+    close(fd);
+
+    struct sc_stream_dump dump;
+    bool ok = sc_stream_dump_open(&dump, filename, true, true);
+    assert(ok);
+
+    uint8_t codec_id[4];
+    sc_write32be(codec_id, 0x68323634); // "h264"
+    sc_stream_dump_write(&dump, codec_id, sizeof(codec_id));
+    uint8_t payload[] = {1, 2, 3, 4, 5};
+    sc_stream_dump_write(&dump, payload, sizeof(payload));
+    sc_stream_dump_close(&dump);
+
+    struct sc_stream_replay replay;
+    ok = sc_stream_replay_open(&replay, filename, false);
+    assert(ok);
+    assert(replay.capture_timestamp);
+    assert(replay.capture_exposure);
+
+    uint8_t data[8];
+    ssize_t r = sc_stream_replay_read(&replay, data, 4);
+    assert(r == 4);
+    assert(sc_read32be(data) == 0x68323634);
+
+    // Not realtime, it must never wait
+    ok = sc_stream_replay_wait(&replay, 1000000);
+    assert(ok);
+
+    r = sc_stream_replay_read(&replay, data, sizeof(data));
+    assert(r == sizeof(payload));
+    assert(!memcmp(data, payload, sizeof(payload)));
+
+    sc_stream_replay_interrupt(&replay);
+    r = sc_stream_replay_read(&replay, data, 1);
+    assert(r == -1);
+
+    sc_stream_replay_close(&replay);
+    remove(filename);
+}
+
+static void test_invalid(void) {
+    char filename[] = "/tmp/test_stream_dump_XXXXXX";
+    int fd = mkstemp(filename);
+    assert(fd != -1);
+    ssize_t w = write(fd, "NOPE\1\0\0\0", 8);
+    assert(w == 8);
+    close(fd);
+
+    struct sc_stream_replay replay;
+    bool ok = sc_stream_replay_open(&replay, filename, false);
+    assert(!ok);
+
+    remove(filename);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_round_trip();
+    test_invalid();
+
+    return 0;
+}
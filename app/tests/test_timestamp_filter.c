@@ -0,0 +1,123 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "timestamp_filter.h"
+
+// 72 fps
+#define PERIOD_US 13889
+
+// Deterministic jitter in [-amplitude, amplitude]
+static int64_t
+jitter(unsigned i, int64_t amplitude) {
+    return (int64_t) ((i * 7919) % 201) * amplitude / 100 - amplitude;
+}
+
+static void test_smooth(void) {
+    struct sc_timestamp_filter tf;
+    sc_timestamp_filter_init(&tf);
+
+    int64_t raw_error = 0;
+    int64_t filtered_error = 0;
+    int64_t last = -1;
+    for (unsigned i = 0; i < 500; ++i) {
+        int64_t capture = 1000000 + (int64_t) i * PERIOD_US;
+        int64_t raw = capture + jitter(i, 1000);
+        // Constant transport delay, with its own jitter
+        sc_tick arrival = capture + 20000 + jitter(i + 3, 500);
+        bool outlier;
+        int64_t filtered = sc_timestamp_filter_push(&tf, raw, arrival,
+                                                    &outlier);
+        assert(!outlier);
+        assert(filtered > last);
+        last = filtered;
+        if (i >= 100) {
+            raw_error += llabs(raw - capture);
+            filtered_error += llabs(filtered - capture);
+        }
+    }
+
+    // The filtered timestamps are closer to the actual capture times
+    assert(filtered_error * 2 < raw_error);
+    assert(!tf.outliers);
+    assert(!tf.restarts);
+}
+
+static void test_outlier(void) {
+    struct sc_timestamp_filter tf;
+    sc_timestamp_filter_init(&tf);
+
+    bool outlier;
+    for (unsigned i = 0; i < 50; ++i) {
+        int64_t capture = (int64_t) i * PERIOD_US;
+        sc_timestamp_filter_push(&tf, capture, capture + 20000, &outlier);
+        assert(!outlier);
+    }
+
+    // A single late timestamp is ignored
+    int64_t capture = 50 * PERIOD_US;
+    int64_t filtered = sc_timestamp_filter_push(&tf, capture + 30000,
+                                                capture + 20000, &outlier);
+    assert(outlier);
+    assert(llabs(filtered - capture) < 100);
+
+    capture = 51 * PERIOD_US;
+    sc_timestamp_filter_push(&tf, capture, capture + 20000, &outlier);
+    assert(!outlier);
+    assert(tf.outliers == 1);
+    assert(!tf.restarts);
+}
+
+static void test_step(void) {
+    struct sc_timestamp_filter tf;
+    sc_timestamp_filter_init(&tf);
+
+    bool outlier;
+    for (unsigned i = 0; i < 50; ++i) {
+        int64_t capture = (int64_t) i * PERIOD_US;
+        sc_timestamp_filter_push(&tf, capture, capture + 20000, &outlier);
+    }
+
+    // The capture clock steps by 100 ms: after a few outliers, the filter
+    // follows it
+    int64_t filtered = 0;
+    for (unsigned i = 50; i < 60; ++i) {
+        int64_t capture = (int64_t) i * PERIOD_US;
+        filtered = sc_timestamp_filter_push(&tf, capture + 100000,
+                                            capture + 20000, &outlier);
+    }
+    assert(tf.restarts == 1);
+    assert(tf.outliers == SC_TIMESTAMP_FILTER_MAX_OUTLIERS);
+    assert(llabs(filtered - (59 * PERIOD_US + 100000)) < 100);
+}
+
+static void test_arrival_gap(void) {
+    struct sc_timestamp_filter tf;
+    sc_timestamp_filter_init(&tf);
+
+    bool outlier;
+    for (unsigned i = 0; i < 20; ++i) {
+        int64_t capture = (int64_t) i * PERIOD_US;
+        sc_timestamp_filter_push(&tf, capture, capture + 20000, &outlier);
+    }
+
+    // No frame for 2 seconds: the filter restarts from the raw timestamp
+    int64_t capture = 20 * PERIOD_US + 2000000;
+    int64_t filtered = sc_timestamp_filter_push(&tf, capture, capture + 20000,
+                                                &outlier);
+    assert(!outlier);
+    assert(filtered == capture);
+    assert(tf.restarts == 1);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_smooth();
+    test_outlier();
+    test_step();
+    test_arrival_gap();
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include "common.h"
+
+#include <assert.h>
+
+#include "timestamp_sei.h"
+
+#define UUID_BYTES 0x73, 0x63, 0x72, 0x63, 0x70, 0x79, 0x2d, 0x74, \
+                   0x69, 0x6d, 0x65, 0x73, 0x74, 0x61, 0x6d, 0x70
+
+static void test_h264(void) {
+    // SEI, then a slice
+    static const uint8_t data[] = {
+        0, 0, 0, 1, 0x06, 5, 29, UUID_BYTES,
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 0x0a, 0x0b, 0x0c, 0x0d, 0x80,
+        0, 0, 0, 1, 0x41, 0x9a,
+    };
+
+    struct sc_timestamp_sei sei;
+    bool ok = sc_timestamp_sei_find(data, sizeof(data), false, &sei);
+    assert(ok);
+    assert(sei.clock_domain == 0);
+    assert(sei.capture_ns == UINT64_C(0x0102030405060708));
+    assert(sei.sequence == 0x0a0b0c0d);
+}
+
+static void test_h265_after_config(void) {
+    // VPS (truncated), then the prefix SEI, then a slice
+    static const uint8_t data[] = {
+        0, 0, 0, 1, 0x40, 0x01, 0x0c,
+        0, 0, 0, 1, 0x4e, 0x01, 5, 29, UUID_BYTES,
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 0x0a, 0x0b, 0x0c, 0x0d, 0x80,
+        0, 0, 1, 0x02, 0x01, 0xaf,
+    };
+
+    struct sc_timestamp_sei sei;
+    bool ok = sc_timestamp_sei_find(data, sizeof(data), true, &sei);
+    assert(ok);
+    assert(sei.capture_ns == UINT64_C(0x0102030405060708));
+    assert(sei.sequence == 0x0a0b0c0d);
+}
+
+static void test_emulation_prevention(void) {
+    static const uint8_t data[] = {
+        0, 0, 0, 1, 0x06, 5, 29, UUID_BYTES,
+        0, 0, 3, 0, 0, 3, 1, 0, 0, 3, 0, 0,
+        3, 0, 0, 3, 0, 0, 0x80,
+    };
+
+    struct sc_timestamp_sei sei;
+    bool ok = sc_timestamp_sei_find(data, sizeof(data), false, &sei);
+    assert(ok);
+    assert(sei.clock_domain == 0);
+    assert(sei.capture_ns == UINT64_C(0x0000000100000000));
+    assert(sei.sequence == 0);
+}
+
+static void test_not_found(void) {
+    struct sc_timestamp_sei sei;
+
+    // The SEI after the slice is ignored
+    static const uint8_t after_slice[] = {
+        0, 0, 0, 1, 0x65, 0x88,
+        0, 0, 0, 1, 0x06, 5, 29, UUID_BYTES,
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 0x0a, 0x0b, 0x0c, 0x0d, 0x80,
+    };
+    assert(!sc_timestamp_sei_find(after_slice, sizeof(after_slice), false,
+                                  &sei));
+
+    // Another UUID
+    static const uint8_t other_uuid[] = {
+        0, 0, 0, 1, 0x06, 5, 29, UUID_BYTES + 1,
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 0x0a, 0x0b, 0x0c, 0x0d, 0x80,
+    };
+    assert(!sc_timestamp_sei_find(other_uuid, sizeof(other_uuid), false,
+                                  &sei));
+
+    // Truncated
+    static const uint8_t truncated[] = {
+        0, 0, 0, 1, 0x06, 5, 29, UUID_BYTES, 0, 1, 2,
+    };
+    assert(!sc_timestamp_sei_find(truncated, sizeof(truncated), false, &sei));
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_h264();
+    test_h265_after_config();
+    test_emulation_prevention();
+    test_not_found();
+
+    return 0;
+}
@@ -34,7 +34,18 @@ static void test_vecdeque_push_pop(void) {
     assert(ok);
     assert(sc_vecdeque_size(&vdq) == 2);
 
-    int *p = sc_vecdeque_popref(&vdq);
+    int *p = sc_vecdeque_peekref(&vdq);
+    assert(*p == 12);
+    assert(sc_vecdeque_size(&vdq) == 2);
+
+    p = sc_vecdeque_peekref_back(&vdq);
+    assert(*p == 7);
+    assert(sc_vecdeque_size(&vdq) == 2);
+
+    p = sc_vecdeque_getref(&vdq, 1);
+    assert(*p == 7);
+
+    p = sc_vecdeque_popref(&vdq);
     assert(p);
     assert(*p == 12);
     assert(sc_vecdeque_size(&vdq) == 1);
@@ -184,6 +195,99 @@ static void test_vecdeque_push_hole(void) {
     sc_vecdeque_destroy(&vdq);
 }
 
+static void test_vecdeque_inline(void) {
+    struct SC_VECDEQUE_INLINE(int, 4) vdq;
+    sc_vecdeque_init_inline(&vdq);
+
+    int *storage = vdq.inline_storage_;
+    assert(vdq.cap == 4);
+
+    for (int i = 0; i < 3; ++i) {
+        bool ok = sc_vecdeque_push(&vdq, i);
+        assert(ok);
+    }
+
+    // Wrap around in the inline storage
+    assert(sc_vecdeque_pop(&vdq) == 0);
+    assert(sc_vecdeque_pop(&vdq) == 1);
+    for (int i = 3; i < 6; ++i) {
+        bool ok = sc_vecdeque_push(&vdq, i);
+        assert(ok);
+    }
+    assert(sc_vecdeque_is_full(&vdq));
+    assert(vdq.data == storage);
+
+    // Move to the heap
+    bool ok = sc_vecdeque_push(&vdq, 6);
+    assert(ok);
+    assert(vdq.data != storage);
+    assert(vdq.cap > 4);
+    assert(sc_vecdeque_size(&vdq) == 5);
+
+    for (int i = 2; i < 7; ++i) {
+        int v = sc_vecdeque_pop(&vdq);
+        assert(v == i);
+    }
+    assert(sc_vecdeque_is_empty(&vdq));
+
+    // Back to the inline storage
+    sc_vecdeque_clear(&vdq);
+    assert(vdq.data == storage);
+    assert(vdq.cap == 4);
+
+    ok = sc_vecdeque_push(&vdq, 42);
+    assert(ok);
+    assert(sc_vecdeque_pop(&vdq) == 42);
+
+    sc_vecdeque_destroy(&vdq);
+}
+
+static void test_vecdeque_inline_reserve(void) {
+    struct SC_VECDEQUE_INLINE(int, 4) vdq;
+    sc_vecdeque_init_inline(&vdq);
+
+    // Fits the inline storage
+    bool ok = sc_vecdeque_reserve(&vdq, 3);
+    assert(ok);
+    assert(vdq.data == vdq.inline_storage_);
+
+    ok = sc_vecdeque_reserve(&vdq, 20);
+    assert(ok);
+    assert(vdq.data != vdq.inline_storage_);
+    assert(vdq.cap == 20);
+
+    sc_vecdeque_destroy(&vdq);
+}
+
+static void test_vecdeque_fixed(void) {
+    struct SC_VECDEQUE_INLINE(int, 3) vdq;
+    sc_vecdeque_init_fixed(&vdq);
+
+    for (int i = 0; i < 3; ++i) {
+        bool ok = sc_vecdeque_push(&vdq, i);
+        assert(ok);
+    }
+    assert(sc_vecdeque_is_full(&vdq));
+
+    bool ok = sc_vecdeque_push(&vdq, 3);
+    assert(!ok);
+    assert(!sc_vecdeque_push_hole(&vdq));
+    ok = sc_vecdeque_reserve(&vdq, 4);
+    assert(!ok);
+    assert(sc_vecdeque_size(&vdq) == 3);
+    assert(vdq.data == vdq.inline_storage_);
+
+    for (int n = 0; n < 10; ++n) {
+        int v = sc_vecdeque_pop(&vdq);
+        assert(v == n);
+        ok = sc_vecdeque_push(&vdq, n + 3);
+        assert(ok);
+        assert(vdq.cap == 3);
+    }
+
+    sc_vecdeque_destroy(&vdq);
+}
+
 int main(int argc, char *argv[]) {
     (void) argc;
     (void) argv;
@@ -192,6 +296,9 @@ int main(int argc, char *argv[]) {
     test_vecdeque_reserve();
     test_vecdeque_grow();
     test_vecdeque_push_hole();
+    test_vecdeque_inline();
+    test_vecdeque_inline_reserve();
+    test_vecdeque_fixed();
 
     return 0;
 }
@@ -400,6 +400,51 @@ static void test_vector_move_slice_backward(void) {
     sc_vector_destroy(&vec);
 }
 
+static void test_vector_inline(void) {
+    struct SC_VECTOR_INLINE(int, 4) vec;
+    sc_vector_init_inline(&vec);
+
+    int *storage = vec.inline_storage_;
+    assert(vec.cap == 4);
+
+    bool ok;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        ok = sc_vector_push(&vec, i);
+        assert(ok);
+    }
+    assert(vec.data == storage); /* no allocation */
+
+    /* move to the heap */
+    ok = sc_vector_push(&vec, 4);
+    assert(ok);
+    assert(vec.data != storage);
+    assert(vec.size == 5);
+    for (int i = 0; i < 5; ++i)
+        assert(vec.data[i] == i);
+
+    /* move back to the inline storage */
+    sc_vector_remove_slice(&vec, 3, 2);
+    sc_vector_shrink_to_fit(&vec);
+    assert(vec.data == storage);
+    assert(vec.cap == 4);
+    assert(vec.size == 3);
+    for (int i = 0; i < 3; ++i)
+        assert(vec.data[i] == i);
+
+    /* the inline storage is never shrunk */
+    sc_vector_shrink_to_fit(&vec);
+    assert(vec.data == storage);
+    assert(vec.cap == 4);
+
+    sc_vector_clear(&vec);
+    assert(vec.data == storage);
+    assert(vec.size == 0);
+
+    sc_vector_destroy(&vec);
+}
+
 int main(int argc, char *argv[]) {
     (void) argc;
     (void) argv;
@@ -417,5 +462,6 @@ int main(int argc, char *argv[]) {
     test_vector_exp_growth();
     test_vector_reserve();
     test_vector_shrink_to_fit();
+    test_vector_inline();
     return 0;
 }
@@ -0,0 +1,107 @@
+#include "common.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "util/yuv_rgb.h"
+
+static int clamp(double value) {
+    long v = lround(value);
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+static void check_pixel(const uint8_t *rgb, int y, int u, int v) {
+    double c = 255.0 / 219 * (y - 16);
+    int r = clamp(c + 1.596 * (v - 128));
+    int g = clamp(c - 0.392 * (u - 128) - 0.813 * (v - 128));
+    int b = clamp(c + 2.017 * (u - 128));
+    assert(abs(rgb[0] - r) <= 1);
+    assert(abs(rgb[1] - g) <= 1);
+    assert(abs(rgb[2] - b) <= 1);
+}
+
+static void test_yuv_rgb_levels(void) {
+    // Black and white, with neutral chroma
+    uint8_t y[4] = {16, 235, 16, 235};
+    uint8_t u[1] = {128};
+    uint8_t v[1] = {128};
+    const uint8_t *planes[3] = {y, u, v};
+    int linesizes[3] = {2, 1, 1};
+
+    uint8_t rgb[12];
+    sc_yuv420p_to_rgb24(planes, linesizes, rgb, 6, 2, 2);
+
+    static const uint8_t expected[12] = {
+        0, 0, 0, 255, 255, 255,
+        0, 0, 0, 255, 255, 255,
+    };
+    for (unsigned i = 0; i < 12; ++i) {
+        assert(rgb[i] == expected[i]);
+    }
+}
+
+static void test_yuv_rgb_odd_size(void) {
+    // 3x3 pixels, 2x2 chroma samples, with padding in the linesizes
+    uint8_t y[4 * 3];
+    uint8_t u[3 * 2];
+    uint8_t v[3 * 2];
+    for (unsigned i = 0; i < sizeof(y); ++i) {
+        y[i] = 20 + i * 17;
+    }
+    for (unsigned i = 0; i < sizeof(u); ++i) {
+        u[i] = 40 + i * 31;
+        v[i] = 220 - i * 29;
+    }
+    const uint8_t *planes[3] = {y, u, v};
+    int linesizes[3] = {4, 3, 3};
+
+    uint8_t rgb[3 * 10];
+    sc_yuv420p_to_rgb24(planes, linesizes, rgb, 10, 3, 3);
+
+    for (int row = 0; row < 3; ++row) {
+        for (int x = 0; x < 3; ++x) {
+            int ci = (row / 2) * 3 + x / 2;
+            check_pixel(&rgb[row * 10 + x * 3], y[row * 4 + x], u[ci], v[ci]);
+        }
+    }
+}
+
+static void test_yuv_rgb_all_values(void) {
+    // Every luma value, for a few chroma values
+    static const int chroma[] = {0, 16, 100, 128, 200, 240, 255};
+    for (unsigned i = 0; i < ARRAY_LEN(chroma); ++i) {
+        for (unsigned j = 0; j < ARRAY_LEN(chroma); ++j) {
+            uint8_t y[512];
+            for (int k = 0; k < 512; ++k) {
+                y[k] = k / 2;
+            }
+            uint8_t u[256];
+            uint8_t v[256];
+            for (int k = 0; k < 256; ++k) {
+                u[k] = chroma[i];
+                v[k] = chroma[j];
+            }
+            const uint8_t *planes[3] = {y, u, v};
+            int linesizes[3] = {512, 256, 256};
+
+            uint8_t rgb[512 * 3];
+            sc_yuv420p_to_rgb24(planes, linesizes, rgb, 512 * 3, 512, 1);
+
+            for (int k = 0; k < 512; ++k) {
+                check_pixel(&rgb[k * 3], y[k], chroma[i], chroma[j]);
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_yuv_rgb_levels();
+    test_yuv_rgb_odd_size();
+    test_yuv_rgb_all_values();
+
+    return 0;
+}
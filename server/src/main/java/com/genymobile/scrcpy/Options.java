@@ -8,10 +8,13 @@ import com.genymobile.scrcpy.util.Ln;
 import com.genymobile.scrcpy.video.CameraAspectRatio;
 import com.genymobile.scrcpy.video.CameraFacing;
 import com.genymobile.scrcpy.video.VideoCodec;
+import com.genymobile.scrcpy.video.LatencyProfile;
 import com.genymobile.scrcpy.video.VideoSource;
 
 import android.graphics.Rect;
 
+import java.math.BigInteger;
+import java.util.ArrayList;
 import java.util.List;
 import java.util.Locale;
 
@@ -23,15 +26,24 @@ public class Options {
     private boolean audio = true;
     private int maxSize;
     private VideoCodec videoCodec = VideoCodec.H264;
+    private List<VideoCodec> videoCodecCandidates; // --video-codec=auto, in order of preference
     private AudioCodec audioCodec = AudioCodec.OPUS;
     private VideoSource videoSource = VideoSource.DISPLAY;
     private AudioSource audioSource = AudioSource.OUTPUT;
     private boolean audioDup;
     private int videoBitRate = 8000000;
     private int audioBitRate = 128000;
+    private int audioReadSamples; // 0 for the default (aligned to the encoder frame)
+    private boolean audioLowLatency;
     private float maxFps;
     private int lockVideoOrientation = -1;
     private boolean tunnelForward;
+    private int directPort; // listen on this TCP port instead of the local socket, or 0
+    private long directToken; // expected at the start of every direct connection
+    private int reconnectTimeout; // in milliseconds, 0 to end the session when the video connection is lost
+    private int videoUdpPort; // send the video packets over UDP to this client port, or 0
+    private int videoFec; // FEC group size of the UDP video packets, or 0
+    private int videoSendBuffer; // send buffer of the video socket in bytes, 0 for the system default
     private Rect crop;
     private boolean control = true;
     private int displayId;
@@ -41,6 +53,18 @@ public class Options {
     private CameraAspectRatio cameraAspectRatio;
     private int cameraFps;
     private boolean cameraHighSpeed;
+    private boolean captureTimestamp; // extend the video frame meta with the capture timestamp
+    private boolean captureExposure; // extend it further with the exposure and readout times (camera only)
+    private boolean timestampSei; // embed the capture timestamp of the video frames in the bitstream (H.264 and H.265 only)
+    private boolean encoderLatency; // report the encoder latency to the client
+    private int poseRate; // in Hz, 0 to not sample the headset pose
+    private String remapMap; // path of the stereo remap map, to rectify the frames before encoding
+    private boolean splitEyes; // encode and stream each half of the frames separately
+    private boolean cameraStream; // capture the camera along with the display, streamed separately
+    private LatencyProfile latencyProfile = LatencyProfile.DEFAULT;
+    private boolean encoderAsync; // receive the encoder output through the asynchronous callbacks
+    private int repeatFrameDelay = 100; // in milliseconds, 0 to never repeat the previous frame
+    private String daemonId; // if set, stay running and accept the sessions of the clients having the same server hash
     private boolean showTouches;
     private boolean stayAwake;
     private List<CodecOption> videoCodecOptions;
@@ -58,6 +82,7 @@ public class Options {
     private boolean listDisplays;
     private boolean listCameras;
     private boolean listCameraSizes;
+    private boolean probeEncoders;
 
     // Options not used by the scrcpy client, but useful to use scrcpy-server directly
     private boolean sendDeviceMeta = true; // send device name and size
@@ -89,6 +114,14 @@ public class Options {
         return videoCodec;
     }
 
+    /**
+     * Return the video codecs the client decodes fast enough (--video-codec=auto), most preferred first, or {@code null} to use
+     * {@link #getVideoCodec()}.
+     */
+    public List<VideoCodec> getVideoCodecCandidates() {
+        return videoCodecCandidates;
+    }
+
     public AudioCodec getAudioCodec() {
         return audioCodec;
     }
@@ -113,6 +146,14 @@ public class Options {
         return audioBitRate;
     }
 
+    public int getAudioReadSamples() {
+        return audioReadSamples;
+    }
+
+    public boolean getAudioLowLatency() {
+        return audioLowLatency;
+    }
+
     public float getMaxFps() {
         return maxFps;
     }
@@ -125,6 +166,30 @@ public class Options {
         return tunnelForward;
     }
 
+    public int getDirectPort() {
+        return directPort;
+    }
+
+    public long getDirectToken() {
+        return directToken;
+    }
+
+    public int getReconnectTimeout() {
+        return reconnectTimeout;
+    }
+
+    public int getVideoUdpPort() {
+        return videoUdpPort;
+    }
+
+    public int getVideoFec() {
+        return videoFec;
+    }
+
+    public int getVideoSendBuffer() {
+        return videoSendBuffer;
+    }
+
     public Rect getCrop() {
         return crop;
     }
@@ -161,6 +226,54 @@ public class Options {
         return cameraHighSpeed;
     }
 
+    public boolean getCaptureTimestamp() {
+        return captureTimestamp;
+    }
+
+    public boolean getCaptureExposure() {
+        return captureExposure;
+    }
+
+    public boolean getTimestampSei() {
+        return timestampSei;
+    }
+
+    public boolean getEncoderLatency() {
+        return encoderLatency;
+    }
+
+    public int getPoseRate() {
+        return poseRate;
+    }
+
+    public String getRemapMap() {
+        return remapMap;
+    }
+
+    public boolean getSplitEyes() {
+        return splitEyes;
+    }
+
+    public boolean getCameraStream() {
+        return cameraStream;
+    }
+
+    public LatencyProfile getLatencyProfile() {
+        return latencyProfile;
+    }
+
+    public boolean getEncoderAsync() {
+        return encoderAsync;
+    }
+
+    public int getRepeatFrameDelay() {
+        return repeatFrameDelay;
+    }
+
+    public String getDaemonId() {
+        return daemonId;
+    }
+
     public boolean getShowTouches() {
         return showTouches;
     }
@@ -206,7 +319,7 @@ public class Options {
     }
 
     public boolean getList() {
-        return listEncoders || listDisplays || listCameras || listCameraSizes;
+        return listEncoders || listDisplays || listCameras || listCameraSizes || probeEncoders;
     }
 
     public boolean getListEncoders() {
@@ -225,6 +338,10 @@ public class Options {
         return listCameraSizes;
     }
 
+    public boolean getProbeEncoders() {
+        return probeEncoders;
+    }
+
     public boolean getSendDeviceMeta() {
         return sendDeviceMeta;
     }
@@ -287,6 +404,9 @@ public class Options {
                     }
                     options.videoCodec = videoCodec;
                     break;
+                case "video_codecs":
+                    options.videoCodecCandidates = parseVideoCodecs(value);
+                    break;
                 case "audio_codec":
                     AudioCodec audioCodec = AudioCodec.findByName(value);
                     if (audioCodec == null) {
@@ -320,6 +440,12 @@ public class Options {
                 case "audio_bit_rate":
                     options.audioBitRate = Integer.parseInt(value);
                     break;
+                case "audio_read_samples":
+                    options.audioReadSamples = Integer.parseInt(value);
+                    break;
+                case "audio_low_latency":
+                    options.audioLowLatency = Boolean.parseBoolean(value);
+                    break;
                 case "max_fps":
                     options.maxFps = parseFloat("max_fps", value);
                     break;
@@ -329,6 +455,45 @@ public class Options {
                 case "tunnel_forward":
                     options.tunnelForward = Boolean.parseBoolean(value);
                     break;
+                case "direct_port":
+                    int directPort = Integer.parseInt(value);
+                    if (directPort < 0 || directPort > 0xFFFF) {
+                        throw new IllegalArgumentException("Invalid direct_port: " + directPort);
+                    }
+                    options.directPort = directPort;
+                    break;
+                case "direct_token":
+                    // 64-bit unsigned hexadecimal value (Long.parseUnsignedLong() requires API 26)
+                    options.directToken = new BigInteger(value, 0x10).longValue();
+                    break;
+                case "reconnect_timeout":
+                    int reconnectTimeout = Integer.parseInt(value);
+                    if (reconnectTimeout < 0) {
+                        throw new IllegalArgumentException("Invalid reconnect_timeout: " + reconnectTimeout);
+                    }
+                    options.reconnectTimeout = reconnectTimeout;
+                    break;
+                case "video_udp_port":
+                    int videoUdpPort = Integer.parseInt(value);
+                    if (videoUdpPort < 0 || videoUdpPort > 0xFFFF) {
+                        throw new IllegalArgumentException("Invalid video_udp_port: " + videoUdpPort);
+                    }
+                    options.videoUdpPort = videoUdpPort;
+                    break;
+                case "video_fec":
+                    int videoFec = Integer.parseInt(value);
+                    if (videoFec < 0 || videoFec > 0xFF) {
+                        throw new IllegalArgumentException("Invalid video_fec: " + videoFec);
+                    }
+                    options.videoFec = videoFec;
+                    break;
+                case "video_send_buffer":
+                    int videoSendBuffer = Integer.parseInt(value);
+                    if (videoSendBuffer < 0) {
+                        throw new IllegalArgumentException("Invalid video_send_buffer: " + videoSendBuffer);
+                    }
+                    options.videoSendBuffer = videoSendBuffer;
+                    break;
                 case "crop":
                     if (!value.isEmpty()) {
                         options.crop = parseCrop(value);
@@ -388,6 +553,9 @@ public class Options {
                 case "list_camera_sizes":
                     options.listCameraSizes = Boolean.parseBoolean(value);
                     break;
+                case "probe_encoders":
+                    options.probeEncoders = Boolean.parseBoolean(value);
+                    break;
                 case "camera_id":
                     if (!value.isEmpty()) {
                         options.cameraId = value;
@@ -418,6 +586,54 @@ public class Options {
                 case "camera_high_speed":
                     options.cameraHighSpeed = Boolean.parseBoolean(value);
                     break;
+                case "capture_timestamp":
+                    options.captureTimestamp = Boolean.parseBoolean(value);
+                    break;
+                case "capture_exposure":
+                    options.captureExposure = Boolean.parseBoolean(value);
+                    break;
+                case "encoder_latency":
+                    options.encoderLatency = Boolean.parseBoolean(value);
+                    break;
+                case "pose_rate":
+                    options.poseRate = Integer.parseInt(value);
+                    break;
+                case "remap_map":
+                    if (!value.isEmpty()) {
+                        options.remapMap = value;
+                    }
+                    break;
+                case "split_eyes":
+                    options.splitEyes = Boolean.parseBoolean(value);
+                    break;
+                case "timestamp_sei":
+                    options.timestampSei = Boolean.parseBoolean(value);
+                    break;
+                case "camera_stream":
+                    options.cameraStream = Boolean.parseBoolean(value);
+                    break;
+                case "latency_profile":
+                    LatencyProfile latencyProfile = LatencyProfile.findByName(value);
+                    if (latencyProfile == null) {
+                        throw new IllegalArgumentException("Latency profile " + value + " not supported");
+                    }
+                    options.latencyProfile = latencyProfile;
+                    break;
+                case "encoder_async":
+                    options.encoderAsync = Boolean.parseBoolean(value);
+                    break;
+                case "repeat_frame_delay":
+                    int repeatFrameDelay = Integer.parseInt(value);
+                    if (repeatFrameDelay < 0) {
+                        throw new IllegalArgumentException("Invalid repeat frame delay: " + repeatFrameDelay);
+                    }
+                    options.repeatFrameDelay = repeatFrameDelay;
+                    break;
+                case "daemon_id":
+                    if (!value.isEmpty()) {
+                        options.daemonId = value;
+                    }
+                    break;
                 case "send_device_meta":
                     options.sendDeviceMeta = Boolean.parseBoolean(value);
                     break;
@@ -448,6 +664,19 @@ public class Options {
         return options;
     }
 
+    private static List<VideoCodec> parseVideoCodecs(String value) {
+        // input format: "<codec>[,<codec>...]"
+        List<VideoCodec> codecs = new ArrayList<>();
+        for (String name : value.split(",")) {
+            VideoCodec codec = VideoCodec.findByName(name);
+            if (codec == null) {
+                throw new IllegalArgumentException("Video codec " + name + " not supported");
+            }
+            codecs.add(codec);
+        }
+        return codecs;
+    }
+
     private static Rect parseCrop(String crop) {
         // input format: "width:height:x:y"
         String[] tokens = crop.split(":");
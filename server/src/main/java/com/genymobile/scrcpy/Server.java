@@ -2,6 +2,7 @@ package com.genymobile.scrcpy;
 
 import com.genymobile.scrcpy.audio.AudioCapture;
 import com.genymobile.scrcpy.audio.AudioCodec;
+import com.genymobile.scrcpy.audio.AudioConfig;
 import com.genymobile.scrcpy.audio.AudioDirectCapture;
 import com.genymobile.scrcpy.audio.AudioEncoder;
 import com.genymobile.scrcpy.audio.AudioPlaybackCapture;
@@ -10,32 +11,54 @@ import com.genymobile.scrcpy.audio.AudioSource;
 import com.genymobile.scrcpy.control.ControlChannel;
 import com.genymobile.scrcpy.control.Controller;
 import com.genymobile.scrcpy.control.DeviceMessage;
+import com.genymobile.scrcpy.control.DeviceMessageSender;
 import com.genymobile.scrcpy.device.ConfigurationException;
 import com.genymobile.scrcpy.device.DesktopConnection;
 import com.genymobile.scrcpy.device.Device;
+import com.genymobile.scrcpy.device.RtpSender;
 import com.genymobile.scrcpy.device.Streamer;
 import com.genymobile.scrcpy.util.Ln;
 import com.genymobile.scrcpy.util.LogUtils;
 import com.genymobile.scrcpy.util.Settings;
 import com.genymobile.scrcpy.util.SettingsException;
 import com.genymobile.scrcpy.video.CameraCapture;
+import com.genymobile.scrcpy.video.EncoderProbe;
 import com.genymobile.scrcpy.video.ScreenCapture;
 import com.genymobile.scrcpy.video.SurfaceCapture;
 import com.genymobile.scrcpy.video.SurfaceEncoder;
+import com.genymobile.scrcpy.video.TimestampSei;
+import com.genymobile.scrcpy.video.VideoCodec;
+import com.genymobile.scrcpy.video.VideoCodecSelector;
 import com.genymobile.scrcpy.video.VideoSource;
 
+import android.net.LocalServerSocket;
+import android.net.LocalSocket;
 import android.os.BatteryManager;
 import android.os.Build;
 
+import java.io.ByteArrayOutputStream;
 import java.io.File;
 import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.net.InetAddress;
+import java.nio.charset.StandardCharsets;
 import java.util.ArrayList;
+import java.util.Arrays;
 import java.util.List;
+import java.util.concurrent.atomic.AtomicBoolean;
 
 public final class Server {
 
     public static final String SERVER_PATH;
 
+    private static final String DAEMON_SOCKET_NAME = "scrcpy_daemon";
+    private static final int DAEMON_MAX_REQUEST_LENGTH = 8192;
+    private static final int DAEMON_STATUS_ACCEPTED = 0;
+    private static final int DAEMON_STATUS_MISMATCH = 1;
+    private static final int DAEMON_STATUS_INVALID = 2;
+    private static final long DAEMON_WATCHDOG_DELAY_MS = 1000;
+
     static {
         String[] classPaths = System.getProperty("java.class.path").split(File.pathSeparator);
         // By convention, scrcpy is always executed with the absolute path of scrcpy-server.jar as the first item in the classpath
@@ -136,11 +159,39 @@ public final class Server {
 
         int scid = options.getScid();
         boolean tunnelForward = options.isTunnelForward();
+        int directPort = options.getDirectPort();
+        long directToken = options.getDirectToken();
         boolean control = options.getControl();
         boolean video = options.getVideo();
         boolean audio = options.getAudio();
         boolean sendDummyByte = options.getSendDummyByte();
         boolean camera = video && options.getVideoSource() == VideoSource.CAMERA;
+        boolean splitEyes = video && options.getSplitEyes();
+        boolean cameraStream = video && options.getCameraStream();
+
+        if (splitEyes && options.getVideoUdpPort() != 0) {
+            Ln.e("The eyes may not be encoded separately with the UDP video transport");
+            throw new ConfigurationException("Split eyes with UDP video");
+        }
+
+        if (cameraStream && (camera || splitEyes || options.getVideoUdpPort() != 0)) {
+            Ln.e("The camera stream requires the display video source, over TCP, without split eyes");
+            throw new ConfigurationException("Unsupported camera_stream");
+        }
+
+        // The exposure is only known for the camera frames, and follows the capture timestamp in the packet headers (not sent over RTP)
+        boolean captureExposure = video && options.getCaptureExposure();
+        if (captureExposure && (!camera || !options.getCaptureTimestamp() || options.getVideoUdpPort() != 0)) {
+            Ln.e("The capture exposure requires the camera video source and the capture timestamp over TCP");
+            throw new ConfigurationException("Unsupported capture_exposure");
+        }
+
+        // Only the (single) TCP video stream of a direct connection may be resumed
+        int reconnectTimeout = options.getReconnectTimeout();
+        if (reconnectTimeout > 0 && (directPort == 0 || !video || splitEyes || cameraStream || options.getVideoUdpPort() != 0)) {
+            Ln.e("The video connection may only be resumed for a single video stream over a direct TCP connection");
+            throw new ConfigurationException("Unsupported reconnect_timeout");
+        }
 
         final Device device = camera ? null : new Device(options);
 
@@ -148,46 +199,80 @@ public final class Server {
 
         List<AsyncProcessor> asyncProcessors = new ArrayList<>();
 
-        DesktopConnection connection = DesktopConnection.open(scid, tunnelForward, video, audio, control, sendDummyByte);
+        DesktopConnection connection = DesktopConnection.open(scid, tunnelForward, directPort, directToken, video, splitEyes, cameraStream,
+                audio, control, sendDummyByte, reconnectTimeout, options.getVideoSendBuffer());
+        RtpSender rtpSender = null;
         try {
             if (options.getSendDeviceMeta()) {
                 connection.sendDeviceMeta(Device.getDeviceName());
             }
 
+            Controller controller = null;
             if (control) {
                 ControlChannel controlChannel = connection.getControlChannel();
-                Controller controller = new Controller(device, controlChannel, cleanUp, options.getClipboardAutosync(), options.getPowerOn());
+                controller = new Controller(device, controlChannel, cleanUp, options.getClipboardAutosync(), options.getPowerOn());
+                DeviceMessageSender sender = controller.getSender();
                 device.setClipboardListener(text -> {
                     DeviceMessage msg = DeviceMessage.createClipboard(text);
-                    controller.getSender().send(msg);
+                    sender.send(msg);
                 });
+                if (options.getPoseRate() > 0) {
+                    controller.setPoseRate(options.getPoseRate());
+                }
                 asyncProcessors.add(controller);
             }
 
+            AsyncProcessor audioProcessor = null;
             if (audio) {
                 AudioCodec audioCodec = options.getAudioCodec();
                 AudioSource audioSource = options.getAudioSource();
+                boolean audioLowLatency = options.getAudioLowLatency();
+                int audioReadSize = AudioConfig.getReadSize(audioCodec, options.getAudioReadSamples(), audioLowLatency);
                 AudioCapture audioCapture;
                 if (audioSource.isDirect()) {
-                    audioCapture = new AudioDirectCapture(audioSource);
+                    audioCapture = new AudioDirectCapture(audioSource, audioReadSize);
                 } else {
-                    audioCapture = new AudioPlaybackCapture(options.getAudioDup());
+                    audioCapture = new AudioPlaybackCapture(options.getAudioDup(), audioReadSize);
                 }
 
-                Streamer audioStreamer = new Streamer(connection.getAudioFd(), audioCodec, options.getSendCodecMeta(), options.getSendFrameMeta());
+                Streamer audioStreamer = new Streamer(connection.getAudioFd(), audioCodec, options.getSendCodecMeta(), options.getSendFrameMeta(),
+                        false);
                 AsyncProcessor audioRecorder;
                 if (audioCodec == AudioCodec.RAW) {
-                    audioRecorder = new AudioRawRecorder(audioCapture, audioStreamer);
+                    audioRecorder = new AudioRawRecorder(audioCapture, audioStreamer, audioReadSize);
                 } else {
-                    audioRecorder = new AudioEncoder(audioCapture, audioStreamer, options.getAudioBitRate(), options.getAudioCodecOptions(),
-                            options.getAudioEncoder());
+                    AudioEncoder audioEncoder = new AudioEncoder(audioCapture, audioStreamer, options.getAudioBitRate(),
+                            options.getAudioCodecOptions(), options.getAudioEncoder(), audioReadSize);
+                    audioEncoder.setLowLatency(audioLowLatency);
+                    audioRecorder = audioEncoder;
                 }
                 asyncProcessors.add(audioRecorder);
+                audioProcessor = audioRecorder;
             }
 
             if (video) {
-                Streamer videoStreamer = new Streamer(connection.getVideoFd(), options.getVideoCodec(), options.getSendCodecMeta(),
-                        options.getSendFrameMeta());
+                VideoCodec videoCodec = options.getVideoCodec();
+                if (options.getVideoCodecCandidates() != null) {
+                    // The client reads the selected codec from the stream header
+                    videoCodec = VideoCodecSelector.select(options.getVideoCodecCandidates(), options.getMaxFps());
+                }
+                if (options.getTimestampSei() && !TimestampSei.isSupported(videoCodec)) {
+                    Ln.e("The timestamp SEI requires the H.264 or H.265 video codec");
+                    throw new ConfigurationException("Unsupported timestamp_sei");
+                }
+                Streamer videoStreamer = new Streamer(connection.getVideoFd(), videoCodec, options.getSendCodecMeta(),
+                        options.getSendFrameMeta(), options.getCaptureTimestamp());
+                videoStreamer.setSendCaptureExposure(captureExposure);
+                videoStreamer.setTimestampSei(options.getTimestampSei());
+                if (options.getVideoUdpPort() != 0) {
+                    InetAddress clientAddress = connection.getVideoRemoteAddress();
+                    if (clientAddress == null) {
+                        throw new ConfigurationException("The UDP video transport requires a direct connection");
+                    }
+                    // The SSRC identifies the session, the client ignores any other datagram
+                    rtpSender = new RtpSender(clientAddress, options.getVideoUdpPort(), options.getVideoFec(), (int) directToken);
+                    videoStreamer.setRtpSender(rtpSender);
+                }
                 SurfaceCapture surfaceCapture;
                 if (options.getVideoSource() == VideoSource.DISPLAY) {
                     surfaceCapture = new ScreenCapture(device);
@@ -197,13 +282,54 @@ public final class Server {
                 }
                 SurfaceEncoder surfaceEncoder = new SurfaceEncoder(surfaceCapture, videoStreamer, options.getVideoBitRate(), options.getMaxFps(),
                         options.getVideoCodecOptions(), options.getVideoEncoder(), options.getDownsizeOnError());
+                if (controller != null) {
+                    controller.setSurfaceEncoder(surfaceEncoder);
+                    if (options.getEncoderLatency()) {
+                        surfaceEncoder.setLatencySender(controller.getSender());
+                    }
+                }
+                if (options.getRemapMap() != null) {
+                    surfaceEncoder.setRemapMap(options.getRemapMap());
+                }
+                surfaceEncoder.setLatencyProfile(options.getLatencyProfile());
+                surfaceEncoder.setAsync(options.getEncoderAsync());
+                surfaceEncoder.setRepeatFrameDelay(options.getRepeatFrameDelay());
+                surfaceEncoder.setSkipWhenCongested(options.getVideoSendBuffer() > 0);
+                if (reconnectTimeout > 0) {
+                    videoStreamer.setReconnector(connection::reconnectVideo, surfaceEncoder::requestKeyFrame);
+                }
+                if (splitEyes) {
+                    Streamer rightStreamer = new Streamer(connection.getVideoRightFd(), videoCodec, options.getSendCodecMeta(),
+                            options.getSendFrameMeta(), options.getCaptureTimestamp());
+                    rightStreamer.setSendCaptureExposure(captureExposure);
+                    rightStreamer.setTimestampSei(options.getTimestampSei());
+                    surfaceEncoder.setRightEyeStreamer(rightStreamer);
+                }
                 asyncProcessors.add(surfaceEncoder);
+
+                if (cameraStream) {
+                    // Captured and encoded independently of the display, in the same session (and so on the same device clock)
+                    Streamer cameraStreamer = new Streamer(connection.getCameraFd(), videoCodec, options.getSendCodecMeta(),
+                            options.getSendFrameMeta(), options.getCaptureTimestamp());
+                    cameraStreamer.setTimestampSei(options.getTimestampSei());
+                    SurfaceCapture cameraCapture = new CameraCapture(options.getCameraId(), options.getCameraFacing(), options.getCameraSize(),
+                            options.getMaxSize(), options.getCameraAspectRatio(), options.getCameraFps(), options.getCameraHighSpeed());
+                    SurfaceEncoder cameraEncoder = new SurfaceEncoder(cameraCapture, cameraStreamer, options.getVideoBitRate(),
+                            options.getMaxFps(), options.getVideoCodecOptions(), options.getVideoEncoder(), options.getDownsizeOnError());
+                    cameraEncoder.setLatencyProfile(options.getLatencyProfile());
+                    cameraEncoder.setAsync(options.getEncoderAsync());
+                    cameraEncoder.setRepeatFrameDelay(options.getRepeatFrameDelay());
+                    cameraEncoder.setSkipWhenCongested(options.getVideoSendBuffer() > 0);
+                    asyncProcessors.add(cameraEncoder);
+                }
             }
 
             Completion completion = new Completion(asyncProcessors.size());
             for (AsyncProcessor asyncProcessor : asyncProcessors) {
+                // The audio connection is not resumed, but its loss must not end a session which may survive it
+                boolean mayEnd = reconnectTimeout > 0 && asyncProcessor == audioProcessor;
                 asyncProcessor.start((fatalError) -> {
-                    completion.addCompleted(fatalError);
+                    completion.addCompleted(fatalError && !mayEnd);
                 });
             }
 
@@ -229,10 +355,130 @@ public final class Server {
                 // ignore
             }
 
+            if (rtpSender != null) {
+                rtpSender.close();
+            }
             connection.close();
         }
     }
 
+    /**
+     * Run the sessions requested by the clients, one at a time, without exiting in between.
+     * <p>
+     * A client connects to the daemon socket and sends a single line: the server hash followed by the usual server arguments (separated by
+     * spaces). The daemon replies with a status byte, then runs the session, and closes the connection once the session has ended. If the hash
+     * does not match (the client has another server version), then the daemon exits, so that the client can push and start its own server.
+     */
+    private static void daemon(String daemonId) throws IOException {
+        LocalServerSocket serverSocket = new LocalServerSocket(DAEMON_SOCKET_NAME);
+        Ln.i("Server daemon started");
+        try {
+            boolean running = true;
+            while (running) {
+                LocalSocket socket = serverSocket.accept();
+                try {
+                    running = runDaemonSession(daemonId, serverSocket, socket);
+                } catch (IOException e) {
+                    // The client is gone, wait for the next one
+                    Ln.w("Server daemon session error: " + e.getMessage());
+                } finally {
+                    // Closing the daemon connection notifies the client that the session has ended
+                    socket.close();
+                }
+            }
+        } finally {
+            serverSocket.close();
+        }
+    }
+
+    private static boolean runDaemonSession(String daemonId, LocalServerSocket serverSocket, LocalSocket socket) throws IOException {
+        String[] request = readDaemonRequest(socket.getInputStream());
+        if (request == null) {
+            // The client closed the connection without sending a request
+            return true;
+        }
+
+        OutputStream out = socket.getOutputStream();
+        if (!daemonId.equals(request[0])) {
+            Ln.i("Server daemon replaced by another server version");
+            // Release the socket name before replying, so that the new server can listen on it immediately
+            serverSocket.close();
+            out.write(DAEMON_STATUS_MISMATCH);
+            return false;
+        }
+
+        Options options;
+        try {
+            options = Options.parse(Arrays.copyOfRange(request, 1, request.length));
+        } catch (IllegalArgumentException e) {
+            Ln.e("Invalid session request: " + e.getMessage());
+            out.write(DAEMON_STATUS_INVALID);
+            return true;
+        }
+
+        if (options.getList() || options.getCleanup()) {
+            Ln.e("Invalid session request: listing and cleanup are not supported by the server daemon");
+            out.write(DAEMON_STATUS_INVALID);
+            return true;
+        }
+
+        out.write(DAEMON_STATUS_ACCEPTED);
+
+        Ln.initLogLevel(options.getLogLevel());
+        AtomicBoolean sessionEnded = new AtomicBoolean();
+        startDaemonWatchdog(socket.getInputStream(), sessionEnded);
+        try {
+            scrcpy(options);
+        } catch (ConfigurationException e) {
+            // Do not print stack trace, a user-friendly error-message has already been logged
+        } finally {
+            sessionEnded.set(true);
+        }
+        return true;
+    }
+
+    private static void startDaemonWatchdog(InputStream in, AtomicBoolean sessionEnded) {
+        // The client closes the daemon connection when it stops. Like the client kills the server process if it does not terminate shortly (for
+        // example if it is blocked waiting for a connection), exit the daemon if the session does not terminate shortly.
+        Thread thread = new Thread(() -> {
+            try {
+                while (in.read() != -1) {
+                    // ignore
+                }
+            } catch (IOException e) {
+                // closed
+            }
+
+            try {
+                Thread.sleep(DAEMON_WATCHDOG_DELAY_MS);
+            } catch (InterruptedException e) {
+                // ignore
+            }
+
+            if (!sessionEnded.get()) {
+                Ln.w("Session not terminated, exiting the server daemon");
+                System.exit(1);
+            }
+        }, "daemon-watchdog");
+        thread.setDaemon(true);
+        thread.start();
+    }
+
+    private static String[] readDaemonRequest(InputStream in) throws IOException {
+        ByteArrayOutputStream line = new ByteArrayOutputStream();
+        int c;
+        while ((c = in.read()) != '\n') {
+            if (c == -1) {
+                return null;
+            }
+            if (line.size() == DAEMON_MAX_REQUEST_LENGTH) {
+                throw new IOException("Server daemon request too long");
+            }
+            line.write(c);
+        }
+        return new String(line.toByteArray(), StandardCharsets.UTF_8).split(" ");
+    }
+
     private static Thread startInitThread(final Options options, final CleanUp cleanUp) {
         Thread thread = new Thread(() -> initAndCleanUp(options, cleanUp), "init-cleanup");
         thread.start();
@@ -266,6 +512,11 @@ public final class Server {
 
         Ln.i("Device: [" + Build.MANUFACTURER + "] " + Build.BRAND + " " + Build.MODEL + " (Android " + Build.VERSION.RELEASE + ")");
 
+        if (options.getDaemonId() != null) {
+            daemon(options.getDaemonId());
+            return;
+        }
+
         if (options.getList()) {
             if (options.getCleanup()) {
                 CleanUp.unlinkSelf();
@@ -282,6 +533,10 @@ public final class Server {
                 Workarounds.apply();
                 Ln.i(LogUtils.buildCameraListMessage(options.getListCameraSizes()));
             }
+            if (options.getProbeEncoders()) {
+                Ln.i(EncoderProbe.run(options.getVideoBitRate(), options.getMaxSize(), options.getLatencyProfile(),
+                        options.getVideoCodecOptions()));
+            }
             // Just print the requested data, do not mirror
             return;
         }
@@ -10,7 +10,9 @@ public interface AudioCapture {
     void stop();
 
     /**
-     * Read a chunk of {@link AudioConfig#MAX_READ_SIZE} samples.
+     * Read a chunk of audio samples, of the read size of the capture (or less if the buffer is smaller).
+     * <p>
+     * The samples are written at the start of the direct buffer (use a slice to write at an offset), to avoid any copy.
      *
      * @param outDirectBuffer The target buffer
      * @param outBufferInfo The info to provide to MediaCodec
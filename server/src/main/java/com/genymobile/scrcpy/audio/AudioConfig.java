@@ -10,15 +10,55 @@ public final class AudioConfig {
     public static final int ENCODING = AudioFormat.ENCODING_PCM_16BIT;
     public static final int BYTES_PER_SAMPLE = 2;
 
-    // Never read more than 1024 samples, even if the buffer is bigger (that would increase latency).
+    // By default, never read more than 1024 samples, even if the buffer is bigger (that would increase latency).
     // A lower value is useless, since the system captures audio samples by blocks of 1024 (so for example if we read by blocks of 256 samples, we
     // receive 4 successive blocks without waiting, then we wait for the 4 next ones).
-    public static final int MAX_READ_SIZE = 1024 * CHANNELS * BYTES_PER_SAMPLE;
+    public static final int DEFAULT_READ_SAMPLES = 1024;
+    // Default read size of raw audio in low latency mode (10 ms)
+    public static final int LOW_LATENCY_READ_SAMPLES = 480;
 
     private AudioConfig() {
         // Not instantiable
     }
 
+    /**
+     * Return the number of samples of an encoder input frame.
+     * <p>
+     * Reading whole frames avoids to keep a partial frame in the encoder until the next read.
+     */
+    private static int getFrameSamples(AudioCodec codec) {
+        switch (codec) {
+            case OPUS:
+                return 960; // 20 ms, the default frame duration of the Opus encoder
+            case AAC:
+                return 1024; // AAC-LC
+            default:
+                // The FLAC encoder accumulates its own blocks, and raw audio is not encoded
+                return 1;
+        }
+    }
+
+    /**
+     * Return the size of the chunks read from the capture, in bytes.
+     *
+     * @param codec The audio codec
+     * @param readSamples The requested number of samples per read (rounded up to a multiple of the encoder frame), or 0 for the default
+     * @param lowLatency Whether to read smaller chunks of raw audio by default
+     * @return the read size in bytes
+     */
+    public static int getReadSize(AudioCodec codec, int readSamples, boolean lowLatency) {
+        int frameSamples = getFrameSamples(codec);
+        int samples;
+        if (readSamples > 0) {
+            samples = (readSamples + frameSamples - 1) / frameSamples * frameSamples;
+        } else if (frameSamples > 1) {
+            samples = frameSamples;
+        } else {
+            samples = lowLatency && codec == AudioCodec.RAW ? LOW_LATENCY_READ_SAMPLES : DEFAULT_READ_SAMPLES;
+        }
+        return samples * CHANNELS * BYTES_PER_SAMPLE;
+    }
+
     public static AudioFormat createAudioFormat() {
         AudioFormat.Builder builder = new AudioFormat.Builder();
         builder.setEncoding(ENCODING);
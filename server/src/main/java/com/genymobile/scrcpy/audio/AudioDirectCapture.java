@@ -26,12 +26,14 @@ public class AudioDirectCapture implements AudioCapture {
     private static final int ENCODING = AudioConfig.ENCODING;
 
     private final int audioSource;
+    private final int readSize;
 
     private AudioRecord recorder;
     private AudioRecordReader reader;
 
-    public AudioDirectCapture(AudioSource audioSource) {
+    public AudioDirectCapture(AudioSource audioSource, int readSize) {
         this.audioSource = getAudioSourceValue(audioSource);
+        this.readSize = readSize;
     }
 
     private static int getAudioSourceValue(AudioSource audioSource) {
@@ -47,7 +49,7 @@ public class AudioDirectCapture implements AudioCapture {
 
     @TargetApi(Build.VERSION_CODES.M)
     @SuppressLint({"WrongConstant", "MissingPermission"})
-    private static AudioRecord createAudioRecord(int audioSource) {
+    private static AudioRecord createAudioRecord(int audioSource, int readSize) {
         AudioRecord.Builder builder = new AudioRecord.Builder();
         if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.S) {
             // On older APIs, Workarounds.fillAppInfo() must be called beforehand
@@ -57,8 +59,8 @@ public class AudioDirectCapture implements AudioCapture {
         builder.setAudioFormat(AudioConfig.createAudioFormat());
         int minBufferSize = AudioRecord.getMinBufferSize(SAMPLE_RATE, CHANNEL_CONFIG, ENCODING);
         if (minBufferSize > 0) {
-            // This buffer size does not impact latency
-            builder.setBufferSizeInBytes(8 * minBufferSize);
+            // This buffer size does not impact latency (but it must hold several reads)
+            builder.setBufferSizeInBytes(Math.max(8 * minBufferSize, 4 * readSize));
         }
 
         return builder.build();
@@ -104,7 +106,7 @@ public class AudioDirectCapture implements AudioCapture {
 
     private void startRecording() throws AudioCaptureException {
         try {
-            recorder = createAudioRecord(audioSource);
+            recorder = createAudioRecord(audioSource, readSize);
         } catch (NullPointerException e) {
             // Creating an AudioRecord using an AudioRecord.Builder does not work on Vivo phones:
             // - <https://github.com/Genymobile/scrcpy/issues/3805>
@@ -112,7 +114,7 @@ public class AudioDirectCapture implements AudioCapture {
             recorder = Workarounds.createAudioRecord(audioSource, SAMPLE_RATE, CHANNEL_CONFIG, CHANNELS, CHANNEL_MASK, ENCODING);
         }
         recorder.startRecording();
-        reader = new AudioRecordReader(recorder);
+        reader = new AudioRecordReader(recorder, readSize);
     }
 
     @Override
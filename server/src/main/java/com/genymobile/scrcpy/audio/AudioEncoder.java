@@ -26,14 +26,6 @@ import java.util.concurrent.BlockingQueue;
 
 public final class AudioEncoder implements AsyncProcessor {
 
-    private static class InputTask {
-        private final int index;
-
-        InputTask(int index) {
-            this.index = index;
-        }
-    }
-
     private static class OutputTask {
         private final int index;
         private final MediaCodec.BufferInfo bufferInfo;
@@ -52,10 +44,13 @@ public final class AudioEncoder implements AsyncProcessor {
     private final int bitRate;
     private final List<CodecOption> codecOptions;
     private final String encoderName;
+    private final int readSize;
+    private boolean lowLatency;
 
     // Capacity of 64 is in practice "infinite" (it is limited by the number of available MediaCodec buffers, typically 4).
     // So many pending tasks would lead to an unacceptable delay anyway.
-    private final BlockingQueue<InputTask> inputTasks = new ArrayBlockingQueue<>(64);
+    // The input tasks are the buffer indices: small values, so boxing them does not allocate.
+    private final BlockingQueue<Integer> inputTasks = new ArrayBlockingQueue<>(64);
     private final BlockingQueue<OutputTask> outputTasks = new ArrayBlockingQueue<>(64);
 
     private Thread thread;
@@ -66,20 +61,36 @@ public final class AudioEncoder implements AsyncProcessor {
 
     private boolean ended;
 
-    public AudioEncoder(AudioCapture capture, Streamer streamer, int bitRate, List<CodecOption> codecOptions, String encoderName) {
+    public AudioEncoder(AudioCapture capture, Streamer streamer, int bitRate, List<CodecOption> codecOptions, String encoderName, int readSize) {
         this.capture = capture;
         this.streamer = streamer;
         this.bitRate = bitRate;
         this.codecOptions = codecOptions;
         this.encoderName = encoderName;
+        this.readSize = readSize;
+    }
+
+    /**
+     * Run the encoder with a realtime priority (the codec options take precedence).
+     * <p>
+     * Must be called before start().
+     */
+    public void setLowLatency(boolean lowLatency) {
+        this.lowLatency = lowLatency;
     }
 
-    private static MediaFormat createFormat(String mimeType, int bitRate, List<CodecOption> codecOptions) {
+    private static MediaFormat createFormat(String mimeType, int bitRate, List<CodecOption> codecOptions, int readSize, boolean lowLatency) {
         MediaFormat format = new MediaFormat();
         format.setString(MediaFormat.KEY_MIME, mimeType);
         format.setInteger(MediaFormat.KEY_BIT_RATE, bitRate);
         format.setInteger(MediaFormat.KEY_CHANNEL_COUNT, CHANNELS);
         format.setInteger(MediaFormat.KEY_SAMPLE_RATE, SAMPLE_RATE);
+        // The samples are read directly into the codec input buffers, which must hold a whole read
+        format.setInteger(MediaFormat.KEY_MAX_INPUT_SIZE, readSize);
+        if (lowLatency && Build.VERSION.SDK_INT >= Build.VERSION_CODES.M) {
+            // Realtime, so that each input buffer is encoded as soon as it is queued
+            format.setInteger(MediaFormat.KEY_PRIORITY, 0);
+        }
 
         if (codecOptions != null) {
             for (CodecOption option : codecOptions) {
@@ -98,14 +109,14 @@ public final class AudioEncoder implements AsyncProcessor {
         final MediaCodec.BufferInfo bufferInfo = new MediaCodec.BufferInfo();
 
         while (!Thread.currentThread().isInterrupted()) {
-            InputTask task = inputTasks.take();
-            ByteBuffer buffer = mediaCodec.getInputBuffer(task.index);
+            int index = inputTasks.take();
+            ByteBuffer buffer = mediaCodec.getInputBuffer(index);
             int r = capture.read(buffer, bufferInfo);
             if (r <= 0) {
                 throw new IOException("Could not read audio: " + r);
             }
 
-            mediaCodec.queueInputBuffer(task.index, bufferInfo.offset, bufferInfo.size, bufferInfo.presentationTimeUs, bufferInfo.flags);
+            mediaCodec.queueInputBuffer(index, bufferInfo.offset, bufferInfo.size, bufferInfo.presentationTimeUs, bufferInfo.flags);
         }
     }
 
@@ -195,7 +206,7 @@ public final class AudioEncoder implements AsyncProcessor {
             mediaCodecThread = new HandlerThread("media-codec");
             mediaCodecThread.start();
 
-            MediaFormat format = createFormat(codec.getMimeType(), bitRate, codecOptions);
+            MediaFormat format = createFormat(codec.getMimeType(), bitRate, codecOptions, readSize, lowLatency);
             mediaCodec.setCallback(new EncoderCallback(), new Handler(mediaCodecThread.getLooper()));
             mediaCodec.configure(format, null, null, MediaCodec.CONFIGURE_FLAG_ENCODE);
 
@@ -312,7 +323,7 @@ public final class AudioEncoder implements AsyncProcessor {
         @Override
         public void onInputBufferAvailable(MediaCodec codec, int index) {
             try {
-                inputTasks.put(new InputTask(index));
+                inputTasks.put(index);
             } catch (InterruptedException e) {
                 end();
             }
@@ -19,12 +19,14 @@ import java.nio.ByteBuffer;
 public final class AudioPlaybackCapture implements AudioCapture {
 
     private final boolean keepPlayingOnDevice;
+    private final int readSize;
 
     private AudioRecord recorder;
     private AudioRecordReader reader;
 
-    public AudioPlaybackCapture(boolean keepPlayingOnDevice) {
+    public AudioPlaybackCapture(boolean keepPlayingOnDevice, int readSize) {
         this.keepPlayingOnDevice = keepPlayingOnDevice;
+        this.readSize = readSize;
     }
 
     @SuppressLint("PrivateApi")
@@ -118,7 +120,7 @@ public final class AudioPlaybackCapture implements AudioCapture {
     public void start() throws AudioCaptureException {
         recorder = createAudioRecord();
         recorder.startRecording();
-        reader = new AudioRecordReader(recorder);
+        reader = new AudioRecordReader(recorder, readSize);
     }
 
     @Override
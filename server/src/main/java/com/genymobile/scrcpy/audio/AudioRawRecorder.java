@@ -15,12 +15,14 @@ public final class AudioRawRecorder implements AsyncProcessor {
 
     private final AudioCapture capture;
     private final Streamer streamer;
+    private final int readSize;
 
     private Thread thread;
 
-    public AudioRawRecorder(AudioCapture capture, Streamer streamer) {
+    public AudioRawRecorder(AudioCapture capture, Streamer streamer, int readSize) {
         this.capture = capture;
         this.streamer = streamer;
+        this.readSize = readSize;
     }
 
     private void record() throws IOException, AudioCaptureException {
@@ -30,7 +32,11 @@ public final class AudioRawRecorder implements AsyncProcessor {
             return;
         }
 
-        final ByteBuffer buffer = ByteBuffer.allocateDirect(AudioConfig.MAX_READ_SIZE);
+        // The samples are read after some headroom, so that the streamer writes the packet header in place: the same direct buffer is reused
+        // for every packet, and the samples are never copied
+        final ByteBuffer buffer = ByteBuffer.allocateDirect(Streamer.PACKET_HEADROOM + readSize);
+        buffer.position(Streamer.PACKET_HEADROOM);
+        final ByteBuffer samples = buffer.slice();
         final MediaCodec.BufferInfo bufferInfo = new MediaCodec.BufferInfo();
 
         try {
@@ -44,14 +50,15 @@ public final class AudioRawRecorder implements AsyncProcessor {
 
             streamer.writeAudioHeader();
             while (!Thread.currentThread().isInterrupted()) {
-                buffer.position(0);
-                int r = capture.read(buffer, bufferInfo);
+                samples.clear();
+                int r = capture.read(samples, bufferInfo);
                 if (r < 0) {
                     throw new IOException("Could not read audio: " + r);
                 }
-                buffer.limit(r);
+                buffer.limit(Streamer.PACKET_HEADROOM + r);
+                buffer.position(Streamer.PACKET_HEADROOM);
 
-                streamer.writePacket(buffer, bufferInfo);
+                streamer.writePacketInPlace(buffer, bufferInfo);
             }
         } catch (IOException e) {
             // Broken pipe is expected on close, because the socket is closed by the client
@@ -23,6 +23,13 @@ public final class ControlMessage {
     public static final int TYPE_UHID_INPUT = 13;
     public static final int TYPE_UHID_DESTROY = 14;
     public static final int TYPE_OPEN_HARD_KEYBOARD_SETTINGS = 15;
+    public static final int TYPE_CLOCK_SYNC = 16;
+    public static final int TYPE_REQUEST_KEY_FRAME = 17;
+    public static final int TYPE_SET_VIDEO_BIT_RATE = 18;
+    public static final int TYPE_TIME_PING = 19;
+    // Consumed by ControlMessageReader, never returned
+    public static final int TYPE_SET_CLIPBOARD_CHUNK = 20;
+    public static final int TYPE_RECONFIGURE_VIDEO = 21;
 
     public static final long SEQUENCE_INVALID = 0;
 
@@ -48,6 +55,10 @@ public final class ControlMessage {
     private long sequence;
     private int id;
     private byte[] data;
+    private long clientTime;
+    private int bitRate;
+    private int maxSize;
+    private int maxFps;
 
     private ControlMessage() {
     }
@@ -148,6 +159,35 @@ public final class ControlMessage {
         return msg;
     }
 
+    public static ControlMessage createClockSync(long clientTime) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_CLOCK_SYNC;
+        msg.clientTime = clientTime;
+        return msg;
+    }
+
+    public static ControlMessage createTimePing(long clientTime) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_TIME_PING;
+        msg.clientTime = clientTime;
+        return msg;
+    }
+
+    public static ControlMessage createSetVideoBitRate(int bitRate) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_SET_VIDEO_BIT_RATE;
+        msg.bitRate = bitRate;
+        return msg;
+    }
+
+    public static ControlMessage createReconfigureVideo(int maxSize, int maxFps) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_RECONFIGURE_VIDEO;
+        msg.maxSize = maxSize;
+        msg.maxFps = maxFps;
+        return msg;
+    }
+
     public static ControlMessage createUhidDestroy(int id) {
         ControlMessage msg = new ControlMessage();
         msg.type = TYPE_UHID_DESTROY;
@@ -226,4 +266,20 @@ public final class ControlMessage {
     public byte[] getData() {
         return data;
     }
+
+    public long getClientTime() {
+        return clientTime;
+    }
+
+    public int getBitRate() {
+        return bitRate;
+    }
+
+    public int getMaxSize() {
+        return maxSize;
+    }
+
+    public int getMaxFps() {
+        return maxFps;
+    }
 }
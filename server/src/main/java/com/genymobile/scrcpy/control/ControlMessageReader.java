@@ -4,6 +4,7 @@ import com.genymobile.scrcpy.util.Binary;
 import com.genymobile.scrcpy.device.Position;
 
 import java.io.BufferedInputStream;
+import java.io.ByteArrayOutputStream;
 import java.io.DataInputStream;
 import java.io.IOException;
 import java.io.InputStream;
@@ -15,15 +16,43 @@ public class ControlMessageReader {
 
     public static final int CLIPBOARD_TEXT_MAX_LENGTH = MESSAGE_MAX_SIZE - 14; // type: 1 byte; sequence: 8 bytes; paste flag: 1 byte; length: 4 bytes
     public static final int INJECT_TEXT_MAX_LENGTH = 300;
+    // A longer clipboard text is received as several chunks, concatenated before the final SET_CLIPBOARD message
+    public static final int CLIPBOARD_CHUNK_SIZE = 1 << 14; // 16k
+    public static final int CLIPBOARD_TOTAL_MAX_LENGTH = 1 << 24; // 16M
 
     private final DataInputStream dis;
 
+    // The clipboard chunks received so far (raw bytes, a chunk may split a UTF-8 sequence)
+    private final ByteArrayOutputStream clipboardChunks = new ByteArrayOutputStream();
+
     public ControlMessageReader(InputStream rawInputStream) {
         dis = new DataInputStream(new BufferedInputStream(rawInputStream));
     }
 
+    /**
+     * Read the messages already received, to handle them back to back.
+     * <p>
+     * Block until at least one message is received, then read the next ones as long as some data is available (the client writes each message
+     * at once), up to {@code batch.length} messages.
+     *
+     * @param batch the array to fill
+     * @return the number of messages read into {@code batch}
+     */
+    public int readBatch(ControlMessage[] batch) throws IOException {
+        int count = 0;
+        do {
+            batch[count++] = read();
+        } while (count < batch.length && dis.available() > 0);
+        return count;
+    }
+
     public ControlMessage read() throws IOException {
         int type = dis.readUnsignedByte();
+        while (type == ControlMessage.TYPE_SET_CLIPBOARD_CHUNK) {
+            parseSetClipboardChunk();
+            type = dis.readUnsignedByte();
+        }
+
         switch (type) {
             case ControlMessage.TYPE_INJECT_KEYCODE:
                 return parseInjectKeycode();
@@ -46,6 +75,7 @@ public class ControlMessageReader {
             case ControlMessage.TYPE_COLLAPSE_PANELS:
             case ControlMessage.TYPE_ROTATE_DEVICE:
             case ControlMessage.TYPE_OPEN_HARD_KEYBOARD_SETTINGS:
+            case ControlMessage.TYPE_REQUEST_KEY_FRAME:
                 return ControlMessage.createEmpty(type);
             case ControlMessage.TYPE_UHID_CREATE:
                 return parseUhidCreate();
@@ -53,6 +83,14 @@ public class ControlMessageReader {
                 return parseUhidInput();
             case ControlMessage.TYPE_UHID_DESTROY:
                 return parseUhidDestroy();
+            case ControlMessage.TYPE_CLOCK_SYNC:
+                return parseClockSync();
+            case ControlMessage.TYPE_SET_VIDEO_BIT_RATE:
+                return parseSetVideoBitRate();
+            case ControlMessage.TYPE_TIME_PING:
+                return parseTimePing();
+            case ControlMessage.TYPE_RECONFIGURE_VIDEO:
+                return parseReconfigureVideo();
             default:
                 throw new ControlProtocolException("Unknown event type: " + type);
         }
@@ -125,10 +163,29 @@ public class ControlMessageReader {
         return ControlMessage.createGetClipboard(copyKey);
     }
 
+    private void parseSetClipboardChunk() throws IOException {
+        int len = parseBufferLength(4);
+        if (len > CLIPBOARD_CHUNK_SIZE || clipboardChunks.size() + len > CLIPBOARD_TOTAL_MAX_LENGTH) {
+            throw new ControlProtocolException("Clipboard text too long");
+        }
+        byte[] data = new byte[len];
+        dis.readFully(data);
+        clipboardChunks.write(data, 0, len);
+    }
+
     private ControlMessage parseSetClipboard() throws IOException {
         long sequence = dis.readLong();
         boolean paste = dis.readByte() != 0;
-        String text = parseString();
+        String text;
+        if (clipboardChunks.size() == 0) {
+            text = parseString();
+        } else {
+            // The end of the text, after the chunks
+            byte[] end = parseByteArray(4);
+            clipboardChunks.write(end, 0, end.length);
+            text = new String(clipboardChunks.toByteArray(), StandardCharsets.UTF_8);
+            clipboardChunks.reset();
+        }
         return ControlMessage.createSetClipboard(sequence, text, paste);
     }
 
@@ -155,6 +212,27 @@ public class ControlMessageReader {
         return ControlMessage.createUhidDestroy(id);
     }
 
+    private ControlMessage parseClockSync() throws IOException {
+        long clientTime = dis.readLong();
+        return ControlMessage.createClockSync(clientTime);
+    }
+
+    private ControlMessage parseTimePing() throws IOException {
+        long clientTime = dis.readLong();
+        return ControlMessage.createTimePing(clientTime);
+    }
+
+    private ControlMessage parseSetVideoBitRate() throws IOException {
+        int bitRate = dis.readInt();
+        return ControlMessage.createSetVideoBitRate(bitRate);
+    }
+
+    private ControlMessage parseReconfigureVideo() throws IOException {
+        int maxSize = dis.readUnsignedShort();
+        int maxFps = dis.readUnsignedShort();
+        return ControlMessage.createReconfigureVideo(maxSize, maxFps);
+    }
+
     private Position parsePosition() throws IOException {
         int x = dis.readInt();
         int y = dis.readInt();
@@ -6,6 +6,7 @@ import com.genymobile.scrcpy.device.Device;
 import com.genymobile.scrcpy.util.Ln;
 import com.genymobile.scrcpy.device.Point;
 import com.genymobile.scrcpy.device.Position;
+import com.genymobile.scrcpy.video.SurfaceEncoder;
 import com.genymobile.scrcpy.wrappers.InputManager;
 import com.genymobile.scrcpy.wrappers.ServiceManager;
 
@@ -29,6 +30,9 @@ public class Controller implements AsyncProcessor {
     // control_msg.h values of the pointerId field in inject_touch_event message
     private static final int POINTER_ID_MOUSE = -1;
 
+    // Maximum number of messages received together and handled back to back
+    private static final int BATCH_MAX_SIZE = 64;
+
     private static final ScheduledExecutorService EXECUTOR = Executors.newSingleThreadScheduledExecutor();
 
     private Thread thread;
@@ -49,8 +53,13 @@ public class Controller implements AsyncProcessor {
     private final MotionEvent.PointerProperties[] pointerProperties = new MotionEvent.PointerProperties[PointersState.MAX_POINTERS];
     private final MotionEvent.PointerCoords[] pointerCoords = new MotionEvent.PointerCoords[PointersState.MAX_POINTERS];
 
+    private final ControlMessage[] batch = new ControlMessage[BATCH_MAX_SIZE];
+
     private boolean keepPowerModeOff;
 
+    private SurfaceEncoder surfaceEncoder; // null without video
+    private PoseSampler poseSampler; // null if the pose is not sampled
+
     public Controller(Device device, ControlChannel controlChannel, CleanUp cleanUp, boolean clipboardAutosync, boolean powerOn) {
         this.device = device;
         this.controlChannel = controlChannel;
@@ -61,6 +70,16 @@ public class Controller implements AsyncProcessor {
         sender = new DeviceMessageSender(controlChannel);
     }
 
+    public void setSurfaceEncoder(SurfaceEncoder surfaceEncoder) {
+        // Must be called before start()
+        this.surfaceEncoder = surfaceEncoder;
+    }
+
+    public void setPoseRate(int poseRate) {
+        // Must be called before start()
+        poseSampler = new PoseSampler(sender, poseRate);
+    }
+
     private UhidManager getUhidManager() {
         if (uhidManager == null) {
             uhidManager = new UhidManager(sender);
@@ -99,7 +118,7 @@ public class Controller implements AsyncProcessor {
 
         boolean alive = true;
         while (!Thread.currentThread().isInterrupted() && alive) {
-            alive = handleEvent();
+            alive = handleEvents();
         }
     }
 
@@ -120,6 +139,9 @@ public class Controller implements AsyncProcessor {
         }, "control-recv");
         thread.start();
         sender.start();
+        if (poseSampler != null) {
+            poseSampler.start();
+        }
     }
 
     @Override
@@ -128,6 +150,9 @@ public class Controller implements AsyncProcessor {
             thread.interrupt();
         }
         sender.stop();
+        if (poseSampler != null) {
+            poseSampler.stop();
+        }
     }
 
     @Override
@@ -142,15 +167,25 @@ public class Controller implements AsyncProcessor {
         return sender;
     }
 
-    private boolean handleEvent() throws IOException {
-        ControlMessage msg;
+    private boolean handleEvents() throws IOException {
+        int count;
         try {
-            msg = controlChannel.recv();
+            count = controlChannel.recvBatch(batch);
         } catch (IOException e) {
             // this is expected on close
             return false;
         }
 
+        // The messages sent together by the client (e.g. a burst of touch events) are injected back to back
+        for (int i = 0; i < count; ++i) {
+            handleEvent(batch[i]);
+            batch[i] = null;
+        }
+
+        return true;
+    }
+
+    private void handleEvent(ControlMessage msg) throws IOException {
         switch (msg.getType()) {
             case ControlMessage.TYPE_INJECT_KEYCODE:
                 if (device.supportsInputEvents()) {
@@ -221,11 +256,30 @@ public class Controller implements AsyncProcessor {
             case ControlMessage.TYPE_OPEN_HARD_KEYBOARD_SETTINGS:
                 openHardKeyboardSettings();
                 break;
+            case ControlMessage.TYPE_CLOCK_SYNC:
+                replyClockSync(msg.getClientTime());
+                break;
+            case ControlMessage.TYPE_TIME_PING:
+                replyTimePing(msg.getClientTime());
+                break;
+            case ControlMessage.TYPE_REQUEST_KEY_FRAME:
+                if (surfaceEncoder != null) {
+                    surfaceEncoder.requestKeyFrame();
+                }
+                break;
+            case ControlMessage.TYPE_SET_VIDEO_BIT_RATE:
+                if (surfaceEncoder != null) {
+                    surfaceEncoder.setBitRate(msg.getBitRate());
+                }
+                break;
+            case ControlMessage.TYPE_RECONFIGURE_VIDEO:
+                if (surfaceEncoder != null) {
+                    surfaceEncoder.reconfigure(msg.getMaxSize(), msg.getMaxFps());
+                }
+                break;
             default:
                 // do nothing
         }
-
-        return true;
     }
 
     private boolean injectKeycode(int action, int keycode, int repeat, int metaState) {
@@ -324,7 +378,7 @@ public class Controller implements AsyncProcessor {
                     // First button pressed: ACTION_DOWN
                     MotionEvent downEvent = MotionEvent.obtain(lastTouchDown, now, MotionEvent.ACTION_DOWN, pointerCount, pointerProperties,
                             pointerCoords, 0, buttons, 1f, 1f, DEFAULT_DEVICE_ID, 0, source, 0);
-                    if (!device.injectEvent(downEvent, Device.INJECT_MODE_ASYNC)) {
+                    if (!injectAndRecycle(downEvent)) {
                         return false;
                     }
                 }
@@ -333,9 +387,10 @@ public class Controller implements AsyncProcessor {
                 MotionEvent pressEvent = MotionEvent.obtain(lastTouchDown, now, MotionEvent.ACTION_BUTTON_PRESS, pointerCount, pointerProperties,
                         pointerCoords, 0, buttons, 1f, 1f, DEFAULT_DEVICE_ID, 0, source, 0);
                 if (!InputManager.setActionButton(pressEvent, actionButton)) {
+                    pressEvent.recycle();
                     return false;
                 }
-                if (!device.injectEvent(pressEvent, Device.INJECT_MODE_ASYNC)) {
+                if (!injectAndRecycle(pressEvent)) {
                     return false;
                 }
 
@@ -347,9 +402,10 @@ public class Controller implements AsyncProcessor {
                 MotionEvent releaseEvent = MotionEvent.obtain(lastTouchDown, now, MotionEvent.ACTION_BUTTON_RELEASE, pointerCount, pointerProperties,
                         pointerCoords, 0, buttons, 1f, 1f, DEFAULT_DEVICE_ID, 0, source, 0);
                 if (!InputManager.setActionButton(releaseEvent, actionButton)) {
+                    releaseEvent.recycle();
                     return false;
                 }
-                if (!device.injectEvent(releaseEvent, Device.INJECT_MODE_ASYNC)) {
+                if (!injectAndRecycle(releaseEvent)) {
                     return false;
                 }
 
@@ -357,7 +413,7 @@ public class Controller implements AsyncProcessor {
                     // Last button released: ACTION_UP
                     MotionEvent upEvent = MotionEvent.obtain(lastTouchDown, now, MotionEvent.ACTION_UP, pointerCount, pointerProperties,
                             pointerCoords, 0, buttons, 1f, 1f, DEFAULT_DEVICE_ID, 0, source, 0);
-                    if (!device.injectEvent(upEvent, Device.INJECT_MODE_ASYNC)) {
+                    if (!injectAndRecycle(upEvent)) {
                         return false;
                     }
                 }
@@ -368,7 +424,7 @@ public class Controller implements AsyncProcessor {
 
         MotionEvent event = MotionEvent.obtain(lastTouchDown, now, action, pointerCount, pointerProperties, pointerCoords, 0, buttons, 1f, 1f,
                 DEFAULT_DEVICE_ID, 0, source, 0);
-        return device.injectEvent(event, Device.INJECT_MODE_ASYNC);
+        return injectAndRecycle(event);
     }
 
     private boolean injectScroll(Position position, float hScroll, float vScroll, int buttons) {
@@ -390,7 +446,15 @@ public class Controller implements AsyncProcessor {
 
         MotionEvent event = MotionEvent.obtain(lastTouchDown, now, MotionEvent.ACTION_SCROLL, 1, pointerProperties, pointerCoords, 0, buttons, 1f, 1f,
                 DEFAULT_DEVICE_ID, 0, InputDevice.SOURCE_MOUSE, 0);
-        return device.injectEvent(event, Device.INJECT_MODE_ASYNC);
+        return injectAndRecycle(event);
+    }
+
+    private boolean injectAndRecycle(MotionEvent event) {
+        // The event is copied by the binder call (even in async mode), so it can be returned to the pool of MotionEvent.obtain(), to be reused
+        // by the next injection instead of allocating a new native event
+        boolean ok = device.injectEvent(event, Device.INJECT_MODE_ASYNC);
+        event.recycle();
+        return ok;
     }
 
     /**
@@ -465,4 +529,23 @@ public class Controller implements AsyncProcessor {
         Intent intent = new Intent("android.settings.HARD_KEYBOARD_SETTINGS");
         ServiceManager.getActivityManager().startActivity(intent);
     }
+
+    private void replyClockSync(long clientTime) {
+        // The video PTS are in the System.nanoTime() time base (in microseconds)
+        long receiveTime = System.nanoTime() / 1000;
+        // The reply is queued: any additional delay until it is actually sent increases the round-trip time measured by the client, so
+        // such a sample will be filtered out
+        long sendTime = System.nanoTime() / 1000;
+        DeviceMessage msg = DeviceMessage.createClockSync(clientTime, receiveTime, sendTime);
+        sender.send(msg);
+    }
+
+    private void replyTimePing(long clientTime) {
+        long receiveTime = SystemClock.elapsedRealtimeNanos() / 1000;
+        long receiveWallTime = System.currentTimeMillis() * 1000;
+        long sendTime = SystemClock.elapsedRealtimeNanos() / 1000;
+        long sendWallTime = System.currentTimeMillis() * 1000;
+        DeviceMessage msg = DeviceMessage.createTimePong(clientTime, receiveTime, sendTime, receiveWallTime, sendWallTime);
+        sender.send(msg);
+    }
 }
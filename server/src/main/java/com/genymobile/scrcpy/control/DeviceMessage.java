@@ -5,12 +5,28 @@ public final class DeviceMessage {
     public static final int TYPE_CLIPBOARD = 0;
     public static final int TYPE_ACK_CLIPBOARD = 1;
     public static final int TYPE_UHID_OUTPUT = 2;
+    public static final int TYPE_CLOCK_SYNC = 3;
+    public static final int TYPE_ENCODER_LATENCY = 4;
+    public static final int TYPE_TIME_PONG = 5;
+    public static final int TYPE_POSE = 6;
 
     private int type;
     private String text;
     private long sequence;
     private int id;
     private byte[] data;
+    private long clientTime;
+    private long receiveTime;
+    private long sendTime;
+    private long receiveWallTime;
+    private long sendWallTime;
+    private int frameCount;
+    private int[] captureToDequeue;
+    private int[] dequeueToWrite;
+    private long pts;
+    private boolean hasPosition;
+    private float[] rotation;
+    private float[] translation;
 
     private DeviceMessage() {
     }
@@ -37,6 +53,68 @@ public final class DeviceMessage {
         return event;
     }
 
+    /**
+     * @param clientTime the time of the client, echoed
+     * @param receiveTime the device monotonic time (in microseconds) when the request was received
+     * @param sendTime the device monotonic time (in microseconds) when the reply is sent
+     */
+    public static DeviceMessage createClockSync(long clientTime, long receiveTime, long sendTime) {
+        DeviceMessage event = new DeviceMessage();
+        event.type = TYPE_CLOCK_SYNC;
+        event.clientTime = clientTime;
+        event.receiveTime = receiveTime;
+        event.sendTime = sendTime;
+        return event;
+    }
+
+    /**
+     * @param clientTime the time of the client, echoed
+     * @param receiveTime the device boot time (in microseconds, including deep sleep) when the request was received
+     * @param sendTime the device boot time (in microseconds, including deep sleep) when the reply is sent
+     * @param receiveWallTime the device wall clock time (in microseconds since the Unix epoch) when the request was received
+     * @param sendWallTime the device wall clock time (in microseconds since the Unix epoch) when the reply is sent
+     */
+    public static DeviceMessage createTimePong(long clientTime, long receiveTime, long sendTime, long receiveWallTime, long sendWallTime) {
+        DeviceMessage event = new DeviceMessage();
+        event.type = TYPE_TIME_PONG;
+        event.clientTime = clientTime;
+        event.receiveTime = receiveTime;
+        event.sendTime = sendTime;
+        event.receiveWallTime = receiveWallTime;
+        event.sendWallTime = sendWallTime;
+        return event;
+    }
+
+    /**
+     * @param frameCount the number of frames measured
+     * @param captureToDequeue the summary {p50, p95, p99, max} of the durations (in microseconds) between the capture and the encoder output
+     * @param dequeueToWrite the summary {p50, p95, p99, max} of the durations (in microseconds) to write the encoded packets
+     */
+    public static DeviceMessage createEncoderLatency(int frameCount, int[] captureToDequeue, int[] dequeueToWrite) {
+        DeviceMessage event = new DeviceMessage();
+        event.type = TYPE_ENCODER_LATENCY;
+        event.frameCount = frameCount;
+        event.captureToDequeue = captureToDequeue;
+        event.dequeueToWrite = dequeueToWrite;
+        return event;
+    }
+
+    /**
+     * @param pts the capture time of the sample, in the time base of the video PTS (in microseconds)
+     * @param hasPosition {@code true} if the translation is known, {@code false} for an orientation only
+     * @param rotation the orientation quaternion {x, y, z, w}
+     * @param translation the position {x, y, z}, in meters
+     */
+    public static DeviceMessage createPose(long pts, boolean hasPosition, float[] rotation, float[] translation) {
+        DeviceMessage event = new DeviceMessage();
+        event.type = TYPE_POSE;
+        event.pts = pts;
+        event.hasPosition = hasPosition;
+        event.rotation = rotation;
+        event.translation = translation;
+        return event;
+    }
+
     public int getType() {
         return type;
     }
@@ -56,4 +134,52 @@ public final class DeviceMessage {
     public byte[] getData() {
         return data;
     }
+
+    public long getClientTime() {
+        return clientTime;
+    }
+
+    public long getReceiveTime() {
+        return receiveTime;
+    }
+
+    public long getSendTime() {
+        return sendTime;
+    }
+
+    public long getReceiveWallTime() {
+        return receiveWallTime;
+    }
+
+    public long getSendWallTime() {
+        return sendWallTime;
+    }
+
+    public int getFrameCount() {
+        return frameCount;
+    }
+
+    public int[] getCaptureToDequeue() {
+        return captureToDequeue;
+    }
+
+    public int[] getDequeueToWrite() {
+        return dequeueToWrite;
+    }
+
+    public long getPts() {
+        return pts;
+    }
+
+    public boolean hasPosition() {
+        return hasPosition;
+    }
+
+    public float[] getRotation() {
+        return rotation;
+    }
+
+    public float[] getTranslation() {
+        return translation;
+    }
 }
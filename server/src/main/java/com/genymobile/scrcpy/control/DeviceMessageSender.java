@@ -23,6 +23,15 @@ public final class DeviceMessageSender {
         }
     }
 
+    /**
+     * Send a message unless the queue is full (without logging the drop).
+     *
+     * @return {@code true} if the message has been queued
+     */
+    public boolean trySend(DeviceMessage msg) {
+        return queue.offer(msg);
+    }
+
     private void loop() throws IOException, InterruptedException {
         while (!Thread.currentThread().isInterrupted()) {
             DeviceMessage msg = queue.take();
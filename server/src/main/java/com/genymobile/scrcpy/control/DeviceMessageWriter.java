@@ -39,6 +39,37 @@ public class DeviceMessageWriter {
                 dos.writeShort(data.length);
                 dos.write(data);
                 break;
+            case DeviceMessage.TYPE_CLOCK_SYNC:
+                dos.writeLong(msg.getClientTime());
+                dos.writeLong(msg.getReceiveTime());
+                dos.writeLong(msg.getSendTime());
+                break;
+            case DeviceMessage.TYPE_TIME_PONG:
+                dos.writeLong(msg.getClientTime());
+                dos.writeLong(msg.getReceiveTime());
+                dos.writeLong(msg.getSendTime());
+                dos.writeLong(msg.getReceiveWallTime());
+                dos.writeLong(msg.getSendWallTime());
+                break;
+            case DeviceMessage.TYPE_POSE:
+                dos.writeLong(msg.getPts());
+                dos.writeByte(msg.hasPosition() ? 1 : 0);
+                for (float value : msg.getRotation()) {
+                    dos.writeFloat(value);
+                }
+                for (float value : msg.getTranslation()) {
+                    dos.writeFloat(value);
+                }
+                break;
+            case DeviceMessage.TYPE_ENCODER_LATENCY:
+                dos.writeInt(msg.getFrameCount());
+                for (int value : msg.getCaptureToDequeue()) {
+                    dos.writeInt(value);
+                }
+                for (int value : msg.getDequeueToWrite()) {
+                    dos.writeInt(value);
+                }
+                break;
             default:
                 throw new ControlProtocolException("Unknown event type: " + type);
         }
@@ -0,0 +1,124 @@
+package com.genymobile.scrcpy.control;
+
+import com.genymobile.scrcpy.FakeContext;
+import com.genymobile.scrcpy.util.Ln;
+
+import android.content.Context;
+import android.hardware.Sensor;
+import android.hardware.SensorEvent;
+import android.hardware.SensorEventListener;
+import android.hardware.SensorManager;
+import android.os.Handler;
+import android.os.HandlerThread;
+import android.os.SystemClock;
+
+/**
+ * Sample the headset pose and send it to the client as device messages, timestamped in the time base of the video PTS.
+ * <p>
+ * The 6DoF pose sensor is used if the device exposes it. Otherwise, only the orientation is sampled (from the game rotation vector), without
+ * position.
+ */
+public final class PoseSampler {
+
+    private final DeviceMessageSender sender;
+    private final int rate;
+
+    private HandlerThread thread;
+    private SensorManager sensorManager;
+    private SensorEventListener listener;
+    private volatile long droppedSamples; // written by the sampler thread only
+
+    /**
+     * @param sender the sender of the device messages
+     * @param rate the requested sampling rate, in Hz
+     */
+    public PoseSampler(DeviceMessageSender sender, int rate) {
+        this.sender = sender;
+        this.rate = rate;
+    }
+
+    public void start() {
+        sensorManager = (SensorManager) FakeContext.get().getSystemService(Context.SENSOR_SERVICE);
+        if (sensorManager == null) {
+            Ln.w("Sensor service not available, pose not sampled");
+            return;
+        }
+
+        Sensor sensor = sensorManager.getDefaultSensor(Sensor.TYPE_POSE_6DOF);
+        boolean hasPosition = sensor != null;
+        if (sensor == null) {
+            sensor = sensorManager.getDefaultSensor(Sensor.TYPE_GAME_ROTATION_VECTOR);
+            if (sensor == null) {
+                Ln.w("No pose sensor available, pose not sampled");
+                return;
+            }
+            Ln.w("6DoF pose sensor not available, sampling the orientation only");
+        }
+
+        Ln.i("Sampling the pose from \"" + sensor.getName() + "\" at " + rate + " Hz");
+
+        listener = new SensorEventListener() {
+            @Override
+            public void onSensorChanged(SensorEvent event) {
+                onSample(event, hasPosition);
+            }
+
+            @Override
+            public void onAccuracyChanged(Sensor sensor, int accuracy) {
+                // ignore
+            }
+        };
+
+        thread = new HandlerThread("pose-sampler");
+        thread.start();
+        Handler handler = new Handler(thread.getLooper());
+        if (!sensorManager.registerListener(listener, sensor, 1_000_000 / rate, handler)) {
+            Ln.w("Could not register the pose sensor listener");
+            listener = null;
+            thread.quit();
+            thread = null;
+        }
+    }
+
+    private void onSample(SensorEvent event, boolean hasPosition) {
+        // The sensor timestamps are in the SystemClock.elapsedRealtimeNanos() time base, while the video PTS are in the System.nanoTime() time
+        // base (which excludes deep sleep)
+        long ptsUs = (event.timestamp - (SystemClock.elapsedRealtimeNanos() - System.nanoTime())) / 1000;
+
+        float[] v = event.values;
+        float[] rotation = new float[4];
+        // Without the (optional) cos(θ/2) component, it must be computed from the others
+        if (v.length >= 4) {
+            System.arraycopy(v, 0, rotation, 0, 4);
+        } else {
+            System.arraycopy(v, 0, rotation, 0, 3);
+            double w2 = 1 - (v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+            rotation[3] = w2 > 0 ? (float) Math.sqrt(w2) : 0;
+        }
+
+        float[] translation = new float[3];
+        if (hasPosition) {
+            System.arraycopy(v, 4, translation, 0, 3);
+        }
+
+        DeviceMessage msg = DeviceMessage.createPose(ptsUs, hasPosition, rotation, translation);
+        if (!sender.trySend(msg)) {
+            // The samples are not worth a warning each
+            ++droppedSamples;
+        }
+    }
+
+    public void stop() {
+        if (listener != null) {
+            sensorManager.unregisterListener(listener);
+            listener = null;
+        }
+        if (thread != null) {
+            thread.quitSafely();
+            thread = null;
+        }
+        if (droppedSamples > 0) {
+            Ln.w("Pose samples dropped: " + droppedSamples);
+        }
+    }
+}
@@ -2,15 +2,27 @@ package com.genymobile.scrcpy.device;
 
 import com.genymobile.scrcpy.control.ControlChannel;
 import com.genymobile.scrcpy.util.IO;
+import com.genymobile.scrcpy.util.Ln;
 import com.genymobile.scrcpy.util.StringUtils;
 
 import android.net.LocalServerSocket;
 import android.net.LocalSocket;
 import android.net.LocalSocketAddress;
+import android.os.ParcelFileDescriptor;
+import android.system.ErrnoException;
+import android.system.Os;
+import android.system.OsConstants;
+import android.system.StructTimeval;
 
 import java.io.Closeable;
+import java.io.DataInputStream;
 import java.io.FileDescriptor;
 import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.net.InetAddress;
+import java.net.ServerSocket;
+import java.net.Socket;
 import java.nio.charset.StandardCharsets;
 
 public final class DesktopConnection implements Closeable {
@@ -19,29 +31,177 @@ public final class DesktopConnection implements Closeable {
 
     private static final String SOCKET_NAME_PREFIX = "scrcpy";
 
-    private final LocalSocket videoSocket;
-    private final FileDescriptor videoFd;
+    // A direct client which does not send its token within this delay is rejected
+    private static final int DIRECT_TOKEN_TIMEOUT_MS = 5000;
 
-    private final LocalSocket audioSocket;
+    // From linux/tcp.h (not exposed by OsConstants)
+    private static final int TCP_NOTSENT_LOWAT = 25;
+
+    /**
+     * A connected stream socket, either a local socket (behind the adb tunnel) or a TCP socket (direct connection).
+     */
+    private static final class Connection implements Closeable {
+        private final Closeable socket;
+        private final FileDescriptor fd;
+        private final InputStream input;
+        private final OutputStream output;
+        private final InetAddress remoteAddress; // null for a local socket
+
+        private Connection(Closeable socket, FileDescriptor fd, InputStream input, OutputStream output, InetAddress remoteAddress) {
+            this.socket = socket;
+            this.fd = fd;
+            this.input = input;
+            this.output = output;
+            this.remoteAddress = remoteAddress;
+        }
+
+        static Connection wrap(LocalSocket socket) throws IOException {
+            return new Connection(socket, socket.getFileDescriptor(), socket.getInputStream(), socket.getOutputStream(), null);
+        }
+
+        static Connection wrap(Socket socket) throws IOException {
+            // Socket does not expose its file descriptor, but the video and audio streams are written directly to the fd
+            ParcelFileDescriptor pfd = ParcelFileDescriptor.fromSocket(socket);
+            Closeable closeable = () -> {
+                try {
+                    pfd.close();
+                } finally {
+                    socket.close();
+                }
+            };
+            return new Connection(closeable, pfd.getFileDescriptor(), socket.getInputStream(), socket.getOutputStream(),
+                    socket.getInetAddress());
+        }
+
+        void setSendTimeout(int timeoutMs) throws IOException {
+            try {
+                Os.setsockoptTimeval(fd, OsConstants.SOL_SOCKET, OsConstants.SO_SNDTIMEO, StructTimeval.fromMillis(timeoutMs));
+            } catch (ErrnoException e) {
+                throw new IOException(e);
+            }
+        }
+
+        /**
+         * Bound the bytes queued in the socket, so that the encoder output loop notices a congestion (the socket is not writable) before
+         * seconds of video are queued in the kernel.
+         * <p>
+         * For a TCP socket, the socket is also writable only when less than half this size is not sent yet (TCP_NOTSENT_LOWAT), so that
+         * most of the buffer holds the bytes in flight rather than the stale ones. It is best effort: a failure is only logged.
+         */
+        void setSendBuffer(int size) {
+            try {
+                Os.setsockoptInt(fd, OsConstants.SOL_SOCKET, OsConstants.SO_SNDBUF, size);
+                if (remoteAddress != null) {
+                    Os.setsockoptInt(fd, OsConstants.IPPROTO_TCP, TCP_NOTSENT_LOWAT, size / 2);
+                }
+            } catch (ErrnoException e) {
+                Ln.w("Could not set the video send buffer: " + e.getMessage());
+            }
+        }
+
+        void shutdown() throws IOException {
+            try {
+                Os.shutdown(fd, OsConstants.SHUT_RDWR);
+            } catch (ErrnoException e) {
+                throw new IOException(e);
+            }
+        }
+
+        @Override
+        public void close() throws IOException {
+            socket.close();
+        }
+    }
+
+    // Replaced on reconnection
+    private volatile Connection videoSocket;
+    private volatile FileDescriptor videoFd;
+
+    // Still listening for the reconnections of the video socket, if enabled
+    private final ServerSocket reconnectServerSocket;
+    private final long directToken;
+    private final int reconnectTimeout;
+    private final int videoSendBuffer;
+
+    // Stream of the right eye, if the eyes are encoded separately (the video socket then streams the left eye)
+    private final Connection videoRightSocket;
+    private final FileDescriptor videoRightFd;
+
+    // Stream of the camera, if it is captured along with the display
+    private final Connection cameraSocket;
+    private final FileDescriptor cameraFd;
+
+    private final Connection audioSocket;
     private final FileDescriptor audioFd;
 
-    private final LocalSocket controlSocket;
+    private final Connection controlSocket;
     private final ControlChannel controlChannel;
 
-    private DesktopConnection(LocalSocket videoSocket, LocalSocket audioSocket, LocalSocket controlSocket) throws IOException {
+    private DesktopConnection(Connection videoSocket, Connection videoRightSocket, Connection cameraSocket, Connection audioSocket,
+            Connection controlSocket, ServerSocket reconnectServerSocket, long directToken, int reconnectTimeout, int videoSendBuffer) {
         this.videoSocket = videoSocket;
+        this.reconnectServerSocket = reconnectServerSocket;
+        this.directToken = directToken;
+        this.reconnectTimeout = reconnectTimeout;
+        this.videoSendBuffer = videoSendBuffer;
+        this.videoRightSocket = videoRightSocket;
+        this.cameraSocket = cameraSocket;
         this.audioSocket = audioSocket;
         this.controlSocket = controlSocket;
 
-        videoFd = videoSocket != null ? videoSocket.getFileDescriptor() : null;
-        audioFd = audioSocket != null ? audioSocket.getFileDescriptor() : null;
-        controlChannel = controlSocket != null ? new ControlChannel(controlSocket) : null;
+        videoFd = videoSocket != null ? videoSocket.fd : null;
+        videoRightFd = videoRightSocket != null ? videoRightSocket.fd : null;
+        cameraFd = cameraSocket != null ? cameraSocket.fd : null;
+        audioFd = audioSocket != null ? audioSocket.fd : null;
+        controlChannel = controlSocket != null ? new ControlChannel(controlSocket.input, controlSocket.output) : null;
     }
 
-    private static LocalSocket connect(String abstractName) throws IOException {
+    private static Connection connect(String abstractName) throws IOException {
         LocalSocket localSocket = new LocalSocket();
-        localSocket.connect(new LocalSocketAddress(abstractName));
-        return localSocket;
+        try {
+            localSocket.connect(new LocalSocketAddress(abstractName));
+            return Connection.wrap(localSocket);
+        } catch (IOException e) {
+            localSocket.close();
+            throw e;
+        }
+    }
+
+    private static Connection acceptDirect(ServerSocket serverSocket, long token) throws IOException {
+        while (true) {
+            Socket socket = serverSocket.accept();
+            boolean accepted = false;
+            try {
+                // Only the client which started the server knows the token (passed over adb)
+                socket.setSoTimeout(DIRECT_TOKEN_TIMEOUT_MS);
+                long received = new DataInputStream(socket.getInputStream()).readLong();
+                if (received == token) {
+                    socket.setSoTimeout(0);
+                    // The video packets must not be delayed by Nagle's algorithm
+                    socket.setTcpNoDelay(true);
+                    accepted = true;
+                } else {
+                    Ln.w("Direct connection from " + socket.getRemoteSocketAddress() + " rejected: invalid token");
+                }
+            } catch (IOException e) {
+                Ln.w("Direct connection from " + socket.getRemoteSocketAddress() + " rejected: " + e.getMessage());
+            }
+
+            if (accepted) {
+                try {
+                    return Connection.wrap(socket);
+                } catch (IOException e) {
+                    socket.close();
+                    throw e;
+                }
+            }
+            socket.close();
+        }
+    }
+
+    private static void sendDummyByte(Connection connection) throws IOException {
+        // send one byte so the client may read() to detect a connection error
+        connection.output.write(0);
     }
 
     private static String getSocketName(int scid) {
@@ -53,37 +213,92 @@ public final class DesktopConnection implements Closeable {
         return SOCKET_NAME_PREFIX + String.format("_%08x", scid);
     }
 
-    public static DesktopConnection open(int scid, boolean tunnelForward, boolean video, boolean audio, boolean control, boolean sendDummyByte)
-            throws IOException {
+    /**
+     * Open the sockets, in order: video, right eye video (if {@code videoRight}), camera video (if {@code camera}), audio and control.
+     * <p>
+     * If {@code reconnectTimeout} is not 0 (which requires a direct connection), the server keeps listening so that the client may reconnect
+     * the video socket (see {@link #reconnectVideo()}), and a video write blocked for this delay fails.
+     * <p>
+     * If {@code videoSendBuffer} is not 0, the send buffer of the video sockets is bounded to this size (in bytes).
+     */
+    public static DesktopConnection open(int scid, boolean tunnelForward, int directPort, long directToken, boolean video, boolean videoRight,
+            boolean camera, boolean audio, boolean control, boolean sendDummyByte, int reconnectTimeout, int videoSendBuffer) throws IOException {
         String socketName = getSocketName(scid);
 
-        LocalSocket videoSocket = null;
-        LocalSocket audioSocket = null;
-        LocalSocket controlSocket = null;
+        Connection videoSocket = null;
+        Connection videoRightSocket = null;
+        Connection cameraSocket = null;
+        Connection audioSocket = null;
+        Connection controlSocket = null;
+        ServerSocket reconnectServerSocket = null;
         try {
-            if (tunnelForward) {
+            if (directPort != 0) {
+                ServerSocket serverSocket = new ServerSocket(directPort);
+                try {
+                    Ln.i("Waiting for a direct connection on port " + directPort);
+                    if (video) {
+                        videoSocket = acceptDirect(serverSocket, directToken);
+                        if (sendDummyByte) {
+                            sendDummyByte(videoSocket);
+                            sendDummyByte = false;
+                        }
+                    }
+                    if (videoRight) {
+                        // The dummy byte, if any, has been sent on the video socket
+                        videoRightSocket = acceptDirect(serverSocket, directToken);
+                    }
+                    if (camera) {
+                        cameraSocket = acceptDirect(serverSocket, directToken);
+                    }
+                    if (audio) {
+                        audioSocket = acceptDirect(serverSocket, directToken);
+                        if (sendDummyByte) {
+                            sendDummyByte(audioSocket);
+                            sendDummyByte = false;
+                        }
+                    }
+                    if (control) {
+                        controlSocket = acceptDirect(serverSocket, directToken);
+                        if (sendDummyByte) {
+                            sendDummyByte(controlSocket);
+                            sendDummyByte = false;
+                        }
+                    }
+                    if (video && reconnectTimeout > 0) {
+                        videoSocket.setSendTimeout(reconnectTimeout);
+                        reconnectServerSocket = serverSocket;
+                    }
+                } finally {
+                    if (reconnectServerSocket == null) {
+                        serverSocket.close();
+                    }
+                }
+            } else if (tunnelForward) {
                 try (LocalServerSocket localServerSocket = new LocalServerSocket(socketName)) {
                     if (video) {
-                        videoSocket = localServerSocket.accept();
+                        videoSocket = Connection.wrap(localServerSocket.accept());
                         if (sendDummyByte) {
-                            // send one byte so the client may read() to detect a connection error
-                            videoSocket.getOutputStream().write(0);
+                            sendDummyByte(videoSocket);
                             sendDummyByte = false;
                         }
                     }
+                    if (videoRight) {
+                        videoRightSocket = Connection.wrap(localServerSocket.accept());
+                    }
+                    if (camera) {
+                        cameraSocket = Connection.wrap(localServerSocket.accept());
+                    }
                     if (audio) {
-                        audioSocket = localServerSocket.accept();
+                        audioSocket = Connection.wrap(localServerSocket.accept());
                         if (sendDummyByte) {
-                            // send one byte so the client may read() to detect a connection error
-                            audioSocket.getOutputStream().write(0);
+                            sendDummyByte(audioSocket);
                             sendDummyByte = false;
                         }
                     }
                     if (control) {
-                        controlSocket = localServerSocket.accept();
+                        controlSocket = Connection.wrap(localServerSocket.accept());
                         if (sendDummyByte) {
-                            // send one byte so the client may read() to detect a connection error
-                            controlSocket.getOutputStream().write(0);
+                            sendDummyByte(controlSocket);
                             sendDummyByte = false;
                         }
                     }
@@ -92,6 +307,12 @@ public final class DesktopConnection implements Closeable {
                 if (video) {
                     videoSocket = connect(socketName);
                 }
+                if (videoRight) {
+                    videoRightSocket = connect(socketName);
+                }
+                if (camera) {
+                    cameraSocket = connect(socketName);
+                }
                 if (audio) {
                     audioSocket = connect(socketName);
                 }
@@ -103,19 +324,64 @@ public final class DesktopConnection implements Closeable {
             if (videoSocket != null) {
                 videoSocket.close();
             }
+            if (videoRightSocket != null) {
+                videoRightSocket.close();
+            }
+            if (cameraSocket != null) {
+                cameraSocket.close();
+            }
             if (audioSocket != null) {
                 audioSocket.close();
             }
             if (controlSocket != null) {
                 controlSocket.close();
             }
+            if (reconnectServerSocket != null) {
+                reconnectServerSocket.close();
+            }
             throw e;
         }
 
-        return new DesktopConnection(videoSocket, audioSocket, controlSocket);
+        if (videoSendBuffer > 0) {
+            if (videoSocket != null) {
+                videoSocket.setSendBuffer(videoSendBuffer);
+            }
+            if (videoRightSocket != null) {
+                videoRightSocket.setSendBuffer(videoSendBuffer);
+            }
+            if (cameraSocket != null) {
+                cameraSocket.setSendBuffer(videoSendBuffer);
+            }
+        }
+
+        return new DesktopConnection(videoSocket, videoRightSocket, cameraSocket, audioSocket, controlSocket, reconnectServerSocket,
+                directToken, reconnectTimeout, videoSendBuffer);
     }
 
-    private LocalSocket getFirstSocket() {
+    /**
+     * Close the lost video socket, and wait for the client to connect a new one.
+     *
+     * @return the file descriptor of the new video socket
+     * @throws IOException if the client did not reconnect within the reconnect timeout, or if the connection is shut down
+     */
+    public FileDescriptor reconnectVideo() throws IOException {
+        assert reconnectServerSocket != null;
+
+        // Closed first, so that the client (possibly still waiting for data) is notified as soon as the network is back
+        videoSocket.close();
+
+        reconnectServerSocket.setSoTimeout(reconnectTimeout);
+        Connection connection = acceptDirect(reconnectServerSocket, directToken);
+        connection.setSendTimeout(reconnectTimeout);
+        if (videoSendBuffer > 0) {
+            connection.setSendBuffer(videoSendBuffer);
+        }
+        videoSocket = connection;
+        videoFd = connection.fd;
+        return videoFd;
+    }
+
+    private Connection getFirstSocket() {
         if (videoSocket != null) {
             return videoSocket;
         }
@@ -126,24 +392,40 @@ public final class DesktopConnection implements Closeable {
     }
 
     public void shutdown() throws IOException {
+        if (reconnectServerSocket != null) {
+            // Interrupt any pending reconnection
+            reconnectServerSocket.close();
+        }
         if (videoSocket != null) {
-            videoSocket.shutdownInput();
-            videoSocket.shutdownOutput();
+            videoSocket.shutdown();
+        }
+        if (videoRightSocket != null) {
+            videoRightSocket.shutdown();
+        }
+        if (cameraSocket != null) {
+            cameraSocket.shutdown();
         }
         if (audioSocket != null) {
-            audioSocket.shutdownInput();
-            audioSocket.shutdownOutput();
+            audioSocket.shutdown();
         }
         if (controlSocket != null) {
-            controlSocket.shutdownInput();
-            controlSocket.shutdownOutput();
+            controlSocket.shutdown();
         }
     }
 
     public void close() throws IOException {
+        if (reconnectServerSocket != null) {
+            reconnectServerSocket.close();
+        }
         if (videoSocket != null) {
             videoSocket.close();
         }
+        if (videoRightSocket != null) {
+            videoRightSocket.close();
+        }
+        if (cameraSocket != null) {
+            cameraSocket.close();
+        }
         if (audioSocket != null) {
             audioSocket.close();
         }
@@ -160,7 +442,7 @@ public final class DesktopConnection implements Closeable {
         System.arraycopy(deviceNameBytes, 0, buffer, 0, len);
         // byte[] are always 0-initialized in java, no need to set '\0' explicitly
 
-        FileDescriptor fd = getFirstSocket().getFileDescriptor();
+        FileDescriptor fd = getFirstSocket().fd;
         IO.writeFully(fd, buffer, 0, buffer.length);
     }
 
@@ -168,6 +450,21 @@ public final class DesktopConnection implements Closeable {
         return videoFd;
     }
 
+    public FileDescriptor getVideoRightFd() {
+        return videoRightFd;
+    }
+
+    public FileDescriptor getCameraFd() {
+        return cameraFd;
+    }
+
+    /**
+     * Return the address of the client, if the video socket is a direct connection, or {@code null}.
+     */
+    public InetAddress getVideoRemoteAddress() {
+        return videoSocket != null ? videoSocket.remoteAddress : null;
+    }
+
     public FileDescriptor getAudioFd() {
         return audioFd;
     }
@@ -0,0 +1,142 @@
+package com.genymobile.scrcpy.device;
+
+import java.io.Closeable;
+import java.io.IOException;
+import java.net.DatagramPacket;
+import java.net.DatagramSocket;
+import java.net.InetAddress;
+import java.nio.ByteBuffer;
+import java.util.Arrays;
+
+/**
+ * Send the video packets over UDP, split into RTP datagrams.
+ * <p>
+ * The datagram format is described in app/src/rtp_receiver.h. Each packet is split into fragments, optionally followed by XOR parity
+ * fragments (one per group of {@code fecGroupSize} fragments), so that the client may recover a single lost fragment per group. The packets
+ * are never retransmitted: the client drops the frames it cannot recover, and requests a key frame instead.
+ */
+public final class RtpSender implements Closeable {
+
+    // Small enough to never be fragmented by IP over Wi-Fi
+    private static final int DATAGRAM_SIZE = 1200;
+    private static final int RTP_HEADER_SIZE = 12;
+    private static final int PAYLOAD_HEADER_SIZE = 32;
+    private static final int HEADER_SIZE = RTP_HEADER_SIZE + PAYLOAD_HEADER_SIZE;
+    private static final int FRAGMENT_SIZE = DATAGRAM_SIZE - HEADER_SIZE;
+    private static final int MAX_FRAGMENTS = 0xFFFF;
+
+    private static final int RTP_VERSION = 2;
+    private static final int PAYLOAD_TYPE = 96; // dynamic
+    private static final int RTP_CLOCK_RATE = 90000;
+
+    // Absorb the bursts of datagrams of the key frames
+    private static final int SEND_BUFFER_SIZE = 4 * 1024 * 1024;
+
+    private final DatagramSocket socket;
+    private final int fecGroupSize;
+    private final int ssrc;
+
+    private final byte[] datagram = new byte[DATAGRAM_SIZE];
+    private final ByteBuffer header = ByteBuffer.wrap(datagram);
+    private final DatagramPacket packet = new DatagramPacket(datagram, DATAGRAM_SIZE);
+    private final byte[] parity = new byte[FRAGMENT_SIZE];
+
+    private int sequenceNumber;
+    private int frameIndex;
+
+    public RtpSender(InetAddress address, int port, int fecGroupSize, int ssrc) throws IOException {
+        if (fecGroupSize < 0 || fecGroupSize > 0xFF) {
+            throw new IllegalArgumentException("Invalid FEC group size: " + fecGroupSize);
+        }
+        this.fecGroupSize = fecGroupSize;
+        this.ssrc = ssrc;
+
+        socket = new DatagramSocket();
+        try {
+            socket.setSendBufferSize(SEND_BUFFER_SIZE);
+            socket.connect(address, port);
+        } catch (IOException e) {
+            socket.close();
+            throw e;
+        }
+    }
+
+    public void send(ByteBuffer buffer, long ptsAndFlags, int clockDomain, long captureTimestampNs, long ptsUs) throws IOException {
+        int size = buffer.remaining();
+        int fragmentCount = (size + FRAGMENT_SIZE - 1) / FRAGMENT_SIZE;
+        if (fragmentCount == 0) {
+            return;
+        }
+        if (fragmentCount > MAX_FRAGMENTS) {
+            throw new IOException("Packet too large to be sent over RTP: " + size);
+        }
+
+        int index = frameIndex++;
+        int rtpTimestamp = (int) (ptsUs * RTP_CLOCK_RATE / 1_000_000);
+        int start = buffer.position();
+
+        for (int i = 0; i < fragmentCount; ++i) {
+            int offset = i * FRAGMENT_SIZE;
+            int len = Math.min(FRAGMENT_SIZE, size - offset);
+            boolean lastData = i == fragmentCount - 1;
+
+            // Without FEC, the last data fragment is the last datagram of the packet
+            writeHeader(lastData && fecGroupSize == 0, rtpTimestamp, index, ptsAndFlags, size, clockDomain, captureTimestampNs, i,
+                    fragmentCount);
+            buffer.position(start + offset);
+            buffer.get(datagram, HEADER_SIZE, len);
+            sendDatagram(HEADER_SIZE + len);
+
+            if (fecGroupSize != 0) {
+                if (i % fecGroupSize == 0) {
+                    Arrays.fill(parity, (byte) 0);
+                }
+                for (int j = 0; j < len; ++j) {
+                    parity[j] ^= datagram[HEADER_SIZE + j];
+                }
+
+                if (i % fecGroupSize == fecGroupSize - 1 || lastData) {
+                    int group = i / fecGroupSize;
+                    // The parity fragment has the length of the first (largest) fragment of its group
+                    int parityLen = Math.min(FRAGMENT_SIZE, size - group * fecGroupSize * FRAGMENT_SIZE);
+                    writeHeader(lastData, rtpTimestamp, index, ptsAndFlags, size, clockDomain, captureTimestampNs, fragmentCount + group,
+                            fragmentCount);
+                    System.arraycopy(parity, 0, datagram, HEADER_SIZE, parityLen);
+                    sendDatagram(HEADER_SIZE + parityLen);
+                }
+            }
+        }
+
+        buffer.position(start + size);
+    }
+
+    private void writeHeader(boolean marker, int rtpTimestamp, int index, long ptsAndFlags, int size, int clockDomain, long captureTimestampNs,
+            int fragmentIndex, int fragmentCount) {
+        header.clear();
+        header.put((byte) (RTP_VERSION << 6));
+        header.put((byte) ((marker ? 0x80 : 0) | PAYLOAD_TYPE));
+        header.putShort((short) sequenceNumber++);
+        header.putInt(rtpTimestamp);
+        header.putInt(ssrc);
+
+        header.putInt(index);
+        header.putLong(ptsAndFlags);
+        header.putInt(size);
+        header.put((byte) clockDomain);
+        header.putLong(captureTimestampNs);
+        header.putShort((short) fragmentIndex);
+        header.putShort((short) fragmentCount);
+        header.putShort((short) FRAGMENT_SIZE);
+        header.put((byte) fecGroupSize);
+    }
+
+    private void sendDatagram(int len) throws IOException {
+        packet.setLength(len);
+        socket.send(packet);
+    }
+
+    @Override
+    public void close() {
+        socket.close();
+    }
+}
@@ -3,8 +3,15 @@ package com.genymobile.scrcpy.device;
 import com.genymobile.scrcpy.audio.AudioCodec;
 import com.genymobile.scrcpy.util.Codec;
 import com.genymobile.scrcpy.util.IO;
+import com.genymobile.scrcpy.util.Ln;
+import com.genymobile.scrcpy.video.TimestampSei;
 
 import android.media.MediaCodec;
+import android.os.SystemClock;
+import android.system.ErrnoException;
+import android.system.Os;
+import android.system.OsConstants;
+import android.system.StructPollfd;
 
 import java.io.FileDescriptor;
 import java.io.IOException;
@@ -16,19 +23,141 @@ public final class Streamer {
 
     private static final long PACKET_FLAG_CONFIG = 1L << 63;
     private static final long PACKET_FLAG_KEY_FRAME = 1L << 62;
+    // The frame is a repetition of the previous one by the encoder (the captured content did not change)
+    private static final long PACKET_FLAG_REPEATED = 1L << 61;
 
-    private final FileDescriptor fd;
+    // Clock domain of the capture timestamps
+    private static final int CLOCK_DOMAIN_MONOTONIC = 0; // System.nanoTime()
+
+    private FileDescriptor fd; // replaced on reconnection
     private final Codec codec;
     private final boolean sendCodecMeta;
     private final boolean sendFrameMeta;
+    private final boolean sendCaptureTimestamp;
+
+    // Whether the PTS are in the SystemClock.elapsedRealtimeNanos() time base (which includes deep sleep) rather than System.nanoTime()
+    private boolean bootTimePts;
+    // If set, provides the exact capture timestamps of the frames (the PTS are truncated to microseconds)
+    private CaptureTimestampSource captureTimestampSource;
+    // Whether the capture timestamp is followed by the exposure and readout times of the frame (requires sendCaptureTimestamp)
+    private boolean sendCaptureExposure;
+    private CaptureExposureSource captureExposureSource;
+
+    // If set, a timestamp SEI is inserted before the data of each video frame (H.264 and H.265 only)
+    private boolean timestampSei;
+    private final byte[] sei = new byte[TimestampSei.MAX_SIZE];
+    private int seiSequence;
+    // The SEI followed by the payload, for the RTP packets (grown to the largest packet)
+    private ByteBuffer seiPacketBuffer;
+
+    // PTS and flags (8 bytes), packet size (4 bytes), and if enabled, clock domain (1 byte) and capture timestamp (8 bytes), then exposure
+    // time (4 bytes) and readout time (4 bytes)
+    private static final int MAX_HEADER_SIZE = 29;
+
+    // Space to reserve before the payload for writePacketInPlace()
+    public static final int PACKET_HEADROOM = MAX_HEADER_SIZE;
+
+    // Frame meta header (if enabled), followed by the timestamp SEI (if any), written with the payload by a single writev()
+    private final ByteBuffer headerBuffer = ByteBuffer.allocate(MAX_HEADER_SIZE + TimestampSei.MAX_SIZE);
+
+    // If set, the packets are sent over UDP instead of the stream socket (which still carries the stream header)
+    private RtpSender rtpSender;
+    // Last config packet, sent again before every key frame over UDP, so that a lost config packet does not break the stream
+    private byte[] lastConfig;
+    private boolean configSent;
+
+    // If set, a lost connection does not end the stream: the packets are written to the new connection of the client, from the next key
+    // frame
+    private Reconnector reconnector;
+    private Runnable keyFrameRequester;
+    private boolean waitKeyFrame;
+
+    // To check whether the socket is writable, allocated on first use
+    private StructPollfd[] pollFds;
+
+    public interface Reconnector {
+        /**
+         * Wait for the client to reconnect the stream.
+         *
+         * @return the file descriptor of the new connection
+         * @throws IOException if the client did not reconnect
+         */
+        FileDescriptor reconnect() throws IOException;
+    }
+
+    public interface CaptureTimestampSource {
+        /**
+         * Return the capture timestamp of the frame having the given PTS, in the same time base as the PTS.
+         *
+         * @param ptsUs the PTS of the frame
+         * @return the capture timestamp in nanoseconds, or 0 if unknown
+         */
+        long getCaptureTimestampNs(long ptsUs);
+    }
 
-    private final ByteBuffer headerBuffer = ByteBuffer.allocate(12);
+    public interface CaptureExposureSource {
+        /**
+         * Return the exposure of the frame having the given PTS, packed as {@code (exposureNs << 32) | readoutNs} (to not allocate for each
+         * frame).
+         *
+         * @param ptsUs the PTS of the frame
+         * @return the packed exposure and readout (rolling shutter skew) times in nanoseconds, or 0 if unknown
+         */
+        long getCaptureExposure(long ptsUs);
+    }
 
-    public Streamer(FileDescriptor fd, Codec codec, boolean sendCodecMeta, boolean sendFrameMeta) {
+    public Streamer(FileDescriptor fd, Codec codec, boolean sendCodecMeta, boolean sendFrameMeta, boolean sendCaptureTimestamp) {
         this.fd = fd;
         this.codec = codec;
         this.sendCodecMeta = sendCodecMeta;
         this.sendFrameMeta = sendFrameMeta;
+        this.sendCaptureTimestamp = sendCaptureTimestamp;
+    }
+
+    public void setBootTimePts(boolean bootTimePts) {
+        this.bootTimePts = bootTimePts;
+    }
+
+    public void setCaptureTimestampSource(CaptureTimestampSource source) {
+        this.captureTimestampSource = source;
+    }
+
+    /**
+     * Extend the header of the video packets with the exposure and readout times of the frame (the capture timestamp must be sent).
+     * <p>
+     * Must be called before the first packet is written.
+     */
+    public void setSendCaptureExposure(boolean sendCaptureExposure) {
+        assert !sendCaptureExposure || sendCaptureTimestamp;
+        this.sendCaptureExposure = sendCaptureExposure;
+    }
+
+    public void setCaptureExposureSource(CaptureExposureSource source) {
+        this.captureExposureSource = source;
+    }
+
+    /**
+     * Embed the capture timestamp and a sequence number of each video frame in the bitstream, as a SEI NAL unit (see {@link TimestampSei}).
+     * <p>
+     * Must be called before the first packet is written.
+     */
+    public void setTimestampSei(boolean timestampSei) {
+        assert !timestampSei || TimestampSei.isSupported(codec);
+        this.timestampSei = timestampSei;
+    }
+
+    /**
+     * Resume the stream on a new connection if the current one is lost.
+     * <p>
+     * The packets are then dropped until the next key frame, requested by {@code keyFrameRequester}.
+     */
+    public void setReconnector(Reconnector reconnector, Runnable keyFrameRequester) {
+        this.reconnector = reconnector;
+        this.keyFrameRequester = keyFrameRequester;
+    }
+
+    public void setRtpSender(RtpSender rtpSender) {
+        this.rtpSender = rtpSender;
     }
 
     public Codec getCodec() {
@@ -67,6 +196,10 @@ public final class Streamer {
     }
 
     public void writePacket(ByteBuffer buffer, long pts, boolean config, boolean keyFrame) throws IOException {
+        writePacket(buffer, pts, config, keyFrame, false);
+    }
+
+    public void writePacket(ByteBuffer buffer, long pts, boolean config, boolean keyFrame, boolean repeated) throws IOException {
         if (config) {
             if (codec == AudioCodec.OPUS) {
                 fixOpusConfigPacket(buffer);
@@ -75,37 +208,223 @@ public final class Streamer {
             }
         }
 
-        if (sendFrameMeta) {
-            writeFrameMeta(fd, buffer.remaining(), pts, config, keyFrame);
+        int seiSize = 0;
+        if (timestampSei && !config) {
+            // The sequence number is incremented even if the frame is skipped, so that the gaps reveal the frames lost
+            seiSize = TimestampSei.write(codec, CLOCK_DOMAIN_MONOTONIC, getCaptureTimestampNs(pts), seiSequence++, sei);
+        }
+
+        if (rtpSender != null) {
+            sendRtpPacket(prependSei(buffer, seiSize), pts, config, keyFrame, repeated);
+            return;
         }
 
-        IO.writeFully(fd, buffer);
+        if (skipUntilKeyFrame(config, keyFrame)) {
+            return;
+        }
+
+        if (sendFrameMeta || seiSize > 0) {
+            writeHeaderAndPayload(buffer, seiSize, pts, config, keyFrame, repeated);
+        } else {
+            writeStream(buffer);
+        }
+    }
+
+    private ByteBuffer prependSei(ByteBuffer payload, int seiSize) {
+        if (seiSize == 0) {
+            return payload;
+        }
+
+        int size = seiSize + payload.remaining();
+        if (seiPacketBuffer == null || seiPacketBuffer.capacity() < size) {
+            seiPacketBuffer = ByteBuffer.allocateDirect(size + size / 2);
+        }
+        seiPacketBuffer.clear();
+        seiPacketBuffer.put(sei, 0, seiSize);
+        seiPacketBuffer.put(payload);
+        seiPacketBuffer.flip();
+        return seiPacketBuffer;
+    }
+
+    /**
+     * Indicate whether a packet written now would wait in the socket, because the bytes already queued exceed its send buffer (or
+     * TCP_NOTSENT_LOWAT), so that a frame which may be skipped is not queued behind them.
+     * <p>
+     * Over UDP, the packets never wait: the stream is never congested.
+     */
+    public boolean isCongested() {
+        if (rtpSender != null) {
+            return false;
+        }
+
+        if (pollFds == null) {
+            pollFds = new StructPollfd[] {new StructPollfd()};
+            pollFds[0].events = (short) OsConstants.POLLOUT;
+        }
+        // The fd is replaced on reconnection
+        pollFds[0].fd = fd;
+        try {
+            return Os.poll(pollFds, 0) == 0;
+        } catch (ErrnoException e) {
+            // The next write reports the error
+            return false;
+        }
+    }
+
+    private boolean skipUntilKeyFrame(boolean config, boolean keyFrame) {
+        if (!waitKeyFrame || config) {
+            return false;
+        }
+        if (!keyFrame) {
+            // It may reference frames which have not been received by the client
+            return true;
+        }
+        waitKeyFrame = false;
+        return false;
+    }
+
+    private void writeStream(ByteBuffer buffer) throws IOException {
+        try {
+            IO.writeFully(fd, buffer);
+        } catch (IOException e) {
+            handleStreamError(e);
+        }
+    }
+
+    private void writeStream(ByteBuffer header, ByteBuffer payload) throws IOException {
+        try {
+            IO.writevFully(fd, header, payload);
+        } catch (IOException e) {
+            handleStreamError(e);
+        }
+    }
+
+    private void handleStreamError(IOException e) throws IOException {
+        if (reconnector == null) {
+            throw e;
+        }
+
+        // The packet being written is lost
+        Ln.w("Stream connection lost (" + e.getMessage() + "), waiting for the client to reconnect...");
+        fd = reconnector.reconnect();
+        Ln.i("Stream reconnected, resuming on the next key frame");
+        waitKeyFrame = true;
+        keyFrameRequester.run();
+    }
+
+    private void sendRtpPacket(ByteBuffer buffer, long pts, boolean config, boolean keyFrame, boolean repeated) throws IOException {
+        if (config) {
+            lastConfig = new byte[buffer.remaining()];
+            buffer.duplicate().get(lastConfig);
+        } else if (keyFrame && !configSent && lastConfig != null) {
+            rtpSender.send(ByteBuffer.wrap(lastConfig), PACKET_FLAG_CONFIG, CLOCK_DOMAIN_MONOTONIC, 0, 0);
+        }
+        configSent = config;
+
+        long captureTimestampNs = config ? 0 : getCaptureTimestampNs(pts);
+        rtpSender.send(buffer, getPtsAndFlags(pts, config, keyFrame, repeated), CLOCK_DOMAIN_MONOTONIC, captureTimestampNs, config ? 0 : pts);
+    }
+
+    private static long getPtsAndFlags(long pts, boolean config, boolean keyFrame, boolean repeated) {
+        if (config) {
+            return PACKET_FLAG_CONFIG; // non-media data packet
+        }
+        long ptsAndFlags = pts;
+        if (keyFrame) {
+            ptsAndFlags |= PACKET_FLAG_KEY_FRAME;
+        }
+        if (repeated) {
+            ptsAndFlags |= PACKET_FLAG_REPEATED;
+        }
+        return ptsAndFlags;
     }
 
     public void writePacket(ByteBuffer codecBuffer, MediaCodec.BufferInfo bufferInfo) throws IOException {
+        writePacket(codecBuffer, bufferInfo, false);
+    }
+
+    public void writePacket(ByteBuffer codecBuffer, MediaCodec.BufferInfo bufferInfo, boolean repeated) throws IOException {
         long pts = bufferInfo.presentationTimeUs;
         boolean config = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_CODEC_CONFIG) != 0;
         boolean keyFrame = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_KEY_FRAME) != 0;
-        writePacket(codecBuffer, pts, config, keyFrame);
+        writePacket(codecBuffer, pts, config, keyFrame, repeated);
     }
 
-    private void writeFrameMeta(FileDescriptor fd, int packetSize, long pts, boolean config, boolean keyFrame) throws IOException {
-        headerBuffer.clear();
+    /**
+     * Write a packet whose payload (between the position and the limit of the buffer) is preceded by at least {@link #PACKET_HEADROOM} bytes
+     * available in the same buffer.
+     * <p>
+     * The frame meta header is written in place just before the payload, so that the packet is sent by a single write() without copying the
+     * payload.
+     */
+    public void writePacketInPlace(ByteBuffer buffer, MediaCodec.BufferInfo bufferInfo) throws IOException {
+        boolean config = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_CODEC_CONFIG) != 0;
+        if (!sendFrameMeta || rtpSender != null || config || timestampSei) {
+            writePacket(buffer, bufferInfo);
+            return;
+        }
 
-        long ptsAndFlags;
-        if (config) {
-            ptsAndFlags = PACKET_FLAG_CONFIG; // non-media data packet
-        } else {
-            ptsAndFlags = pts;
-            if (keyFrame) {
-                ptsAndFlags |= PACKET_FLAG_KEY_FRAME;
-            }
+        long pts = bufferInfo.presentationTimeUs;
+        boolean keyFrame = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_KEY_FRAME) != 0;
+        if (skipUntilKeyFrame(false, keyFrame)) {
+            return;
         }
 
-        headerBuffer.putLong(ptsAndFlags);
-        headerBuffer.putInt(packetSize);
+        int start = buffer.position() - getHeaderSize();
+        assert start >= 0;
+        ByteBuffer header = buffer.duplicate();
+        header.position(start);
+        putFrameMeta(header, buffer.remaining(), pts, false, keyFrame, false);
+
+        buffer.position(start);
+        writeStream(buffer);
+    }
+
+    private int getHeaderSize() {
+        if (sendCaptureExposure) {
+            return 29;
+        }
+        return sendCaptureTimestamp ? 21 : 12;
+    }
+
+    private void putFrameMeta(ByteBuffer dst, int packetSize, long pts, boolean config, boolean keyFrame, boolean repeated) {
+        dst.putLong(getPtsAndFlags(pts, config, keyFrame, repeated));
+        dst.putInt(packetSize);
+        if (sendCaptureTimestamp) {
+            dst.put((byte) CLOCK_DOMAIN_MONOTONIC);
+            dst.putLong(config ? 0 : getCaptureTimestampNs(pts));
+        }
+        if (sendCaptureExposure) {
+            long exposure = config || captureExposureSource == null ? 0 : captureExposureSource.getCaptureExposure(pts);
+            // Exposure time, then readout time
+            dst.putLong(exposure);
+        }
+    }
+
+    private void writeHeaderAndPayload(ByteBuffer payload, int seiSize, long pts, boolean config, boolean keyFrame, boolean repeated)
+            throws IOException {
+        headerBuffer.clear();
+        if (sendFrameMeta) {
+            putFrameMeta(headerBuffer, seiSize + payload.remaining(), pts, config, keyFrame, repeated);
+        }
+        headerBuffer.put(sei, 0, seiSize);
         headerBuffer.flip();
-        IO.writeFully(fd, headerBuffer);
+        // A single writev(), instead of a second write() (and a second TCP segment with TCP_NODELAY), without copying the payload
+        writeStream(headerBuffer, payload);
+    }
+
+    public long getCaptureTimestampNs(long ptsUs) {
+        long ns = captureTimestampSource != null ? captureTimestampSource.getCaptureTimestampNs(ptsUs) : 0;
+        if (ns == 0) {
+            // MediaCodec only provides the capture timestamp of the input surface in microseconds
+            ns = ptsUs * 1000;
+        }
+        if (bootTimePts) {
+            // Convert to the System.nanoTime() time base, which is also used for clock synchronization (the deep sleep duration cannot change
+            // while capturing)
+            ns -= SystemClock.elapsedRealtimeNanos() - System.nanoTime();
+        }
+        return ns;
     }
 
     private static void fixOpusConfigPacket(ByteBuffer buffer) throws IOException {
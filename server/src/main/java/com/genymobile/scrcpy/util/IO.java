@@ -42,6 +42,58 @@ public final class IO {
         writeFully(fd, ByteBuffer.wrap(buffer, offset, len));
     }
 
+    /**
+     * Write the remaining bytes of all the buffers, in order, by a gathered write (a single writev() if the file accepts them at once).
+     * <p>
+     * The buffers must be either direct or backed by an array. Their positions are set to their limits.
+     */
+    public static void writevFully(FileDescriptor fd, ByteBuffer... buffers) throws IOException {
+        int count = buffers.length;
+        Object[] arrays = new Object[count];
+        int[] offsets = new int[count];
+        int[] byteCounts = new int[count];
+        int remaining = 0;
+        for (int i = 0; i < count; ++i) {
+            ByteBuffer buffer = buffers[i];
+            // Os.writev() accepts byte arrays and direct buffers, and ignores their positions
+            if (buffer.isDirect()) {
+                arrays[i] = buffer;
+                offsets[i] = buffer.position();
+            } else {
+                arrays[i] = buffer.array();
+                offsets[i] = buffer.arrayOffset() + buffer.position();
+            }
+            byteCounts[i] = buffer.remaining();
+            remaining += byteCounts[i];
+        }
+
+        while (remaining > 0) {
+            try {
+                int w = Os.writev(fd, arrays, offsets, byteCounts);
+                if (BuildConfig.DEBUG && w < 0) {
+                    // w should not be negative, since an exception is thrown on error
+                    throw new AssertionError("Os.writev() returned a negative value (" + w + ")");
+                }
+                remaining -= w;
+                // Skip the bytes written, on a partial write
+                for (int i = 0; w > 0; ++i) {
+                    int n = Math.min(w, byteCounts[i]);
+                    offsets[i] += n;
+                    byteCounts[i] -= n;
+                    w -= n;
+                }
+            } catch (ErrnoException e) {
+                if (e.errno != OsConstants.EINTR) {
+                    throw new IOException(e);
+                }
+            }
+        }
+
+        for (ByteBuffer buffer : buffers) {
+            buffer.position(buffer.limit());
+        }
+    }
+
     public static String toString(InputStream inputStream) {
         StringBuilder builder = new StringBuilder();
         Scanner scanner = new Scanner(inputStream);
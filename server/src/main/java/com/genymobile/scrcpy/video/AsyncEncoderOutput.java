@@ -0,0 +1,160 @@
+package com.genymobile.scrcpy.video;
+
+import android.media.MediaCodec;
+import android.media.MediaFormat;
+
+import java.nio.ByteBuffer;
+import java.util.ArrayDeque;
+import java.util.Iterator;
+
+/**
+ * Output of a video encoder in asynchronous (callback) mode.
+ * <p>
+ * The codec callbacks (on their own thread) only queue the output buffers, which are written directly from the codec memory (without copy) and
+ * released by the writer thread. If the queue is full (the socket does not keep up), the frames not referenced by other frames (see
+ * {@link NalUnits}) are dropped and released immediately, so that the encoder is not starved of output buffers. The referenced frames are never
+ * dropped (the stream would be corrupted until the next key frame).
+ */
+public final class AsyncEncoderOutput extends MediaCodec.Callback {
+
+    public static final class Buffer {
+        private final int index;
+        private final MediaCodec.BufferInfo info;
+        private final long receivedNs;
+        private final boolean droppable;
+
+        private Buffer(int index, MediaCodec.BufferInfo info, long receivedNs, boolean droppable) {
+            this.index = index;
+            this.info = info;
+            this.receivedNs = receivedNs;
+            this.droppable = droppable;
+        }
+
+        public int getIndex() {
+            return index;
+        }
+
+        public MediaCodec.BufferInfo getInfo() {
+            return info;
+        }
+
+        /**
+         * Indicate whether the frame is not referenced by other frames (see {@link NalUnits}), so that it may be skipped.
+         */
+        public boolean isDroppable() {
+            return droppable;
+        }
+
+        /**
+         * Return the time (in the {@code System.nanoTime()} time base) when the encoder delivered the buffer.
+         */
+        public long getReceivedNs() {
+            return receivedNs;
+        }
+    }
+
+    private final VideoCodec codec;
+    private final int capacity;
+    private final ArrayDeque<Buffer> queue = new ArrayDeque<>();
+    private MediaCodec.CodecException error;
+    private long droppedFrames;
+
+    public AsyncEncoderOutput(VideoCodec codec, int capacity) {
+        this.codec = codec;
+        this.capacity = capacity;
+    }
+
+    @Override
+    public void onInputBufferAvailable(MediaCodec mediaCodec, int index) {
+        // The encoder input is a Surface
+    }
+
+    @Override
+    public void onOutputBufferAvailable(MediaCodec mediaCodec, int index, MediaCodec.BufferInfo info) {
+        long receivedNs = System.nanoTime();
+        MediaCodec.BufferInfo copy = new MediaCodec.BufferInfo();
+        copy.set(info.offset, info.size, info.presentationTimeUs, info.flags);
+
+        boolean droppable = false;
+        int noDropFlags = MediaCodec.BUFFER_FLAG_CODEC_CONFIG | MediaCodec.BUFFER_FLAG_KEY_FRAME | MediaCodec.BUFFER_FLAG_END_OF_STREAM;
+        if ((info.flags & noDropFlags) == 0) {
+            ByteBuffer data = mediaCodec.getOutputBuffer(index);
+            droppable = data != null && NalUnits.isNonReference(codec, data);
+        }
+
+        synchronized (this) {
+            if (queue.size() >= capacity) {
+                if (droppable) {
+                    mediaCodec.releaseOutputBuffer(index, false);
+                    ++droppedFrames;
+                    return;
+                }
+                // Make room by dropping a queued frame, if any is droppable (otherwise, exceed the capacity)
+                dropOldestDroppable(mediaCodec);
+            }
+
+            queue.addLast(new Buffer(index, copy, receivedNs, droppable));
+            notify();
+        }
+    }
+
+    private void dropOldestDroppable(MediaCodec mediaCodec) {
+        Iterator<Buffer> it = queue.iterator();
+        while (it.hasNext()) {
+            Buffer buffer = it.next();
+            if (buffer.droppable) {
+                it.remove();
+                mediaCodec.releaseOutputBuffer(buffer.index, false);
+                ++droppedFrames;
+                return;
+            }
+        }
+    }
+
+    @Override
+    public synchronized void onError(MediaCodec mediaCodec, MediaCodec.CodecException e) {
+        error = e;
+        notify();
+    }
+
+    @Override
+    public void onOutputFormatChanged(MediaCodec mediaCodec, MediaFormat format) {
+        // The config packets are received as output buffers
+    }
+
+    /**
+     * Take the next output buffer, which must be released by the caller.
+     *
+     * @param timeoutMs maximum time to wait
+     * @return the buffer, or {@code null} on timeout
+     * @throws MediaCodec.CodecException if the encoder reported an error
+     */
+    public synchronized Buffer take(long timeoutMs) throws InterruptedException {
+        long deadline = System.currentTimeMillis() + timeoutMs;
+        while (queue.isEmpty() && error == null) {
+            long remaining = deadline - System.currentTimeMillis();
+            if (remaining <= 0) {
+                return null;
+            }
+            wait(remaining);
+        }
+
+        if (error != null) {
+            throw error;
+        }
+        return queue.removeFirst();
+    }
+
+    /**
+     * Forget the queued buffers and the error, once the encoder has been reset (the buffers are invalidated).
+     *
+     * @return the number of frames dropped since the last call
+     */
+    public synchronized long reset() {
+        queue.clear();
+        error = null;
+        long dropped = droppedFrames;
+        droppedFrames = 0;
+        return dropped;
+    }
+}
@@ -16,6 +16,8 @@ import android.hardware.camera2.CameraDevice;
 import android.hardware.camera2.CameraManager;
 import android.hardware.camera2.CaptureFailure;
 import android.hardware.camera2.CaptureRequest;
+import android.hardware.camera2.CaptureResult;
+import android.hardware.camera2.TotalCaptureResult;
 import android.hardware.camera2.params.OutputConfiguration;
 import android.hardware.camera2.params.SessionConfiguration;
 import android.hardware.camera2.params.StreamConfigurationMap;
@@ -38,6 +40,9 @@ import java.util.stream.Stream;
 
 public class CameraCapture extends SurfaceCapture {
 
+    // Number of sensor timestamps kept to be matched with the encoded frames (more than the encoder latency at high speed)
+    private static final int SENSOR_TIMESTAMP_HISTORY = 64;
+
     private final String explicitCameraId;
     private final CameraFacing cameraFacing;
     private final Size explicitSize;
@@ -48,6 +53,7 @@ public class CameraCapture extends SurfaceCapture {
 
     private String cameraId;
     private Size size;
+    private boolean bootTimeClock;
 
     private HandlerThread cameraThread;
     private Handler cameraHandler;
@@ -56,6 +62,9 @@ public class CameraCapture extends SurfaceCapture {
 
     private final AtomicBoolean disconnected = new AtomicBoolean();
 
+    private final TimestampHistory sensorTimestamps = new TimestampHistory(SENSOR_TIMESTAMP_HISTORY);
+    private final ExposureHistory exposures = new ExposureHistory(SENSOR_TIMESTAMP_HISTORY);
+
     public CameraCapture(String explicitCameraId, CameraFacing cameraFacing, Size explicitSize, int maxSize, CameraAspectRatio aspectRatio, int fps,
             boolean highSpeed) {
         this.explicitCameraId = explicitCameraId;
@@ -80,10 +89,18 @@ public class CameraCapture extends SurfaceCapture {
                 throw new IOException("No matching camera found");
             }
 
-            size = selectSize(cameraId, explicitSize, maxSize, aspectRatio, highSpeed);
+            size = selectSize(cameraId, explicitSize, maxSize, aspectRatio, highSpeed, fps);
             if (size == null) {
                 throw new IOException("Could not select camera size");
             }
+            if (highSpeed) {
+                Ln.i("High-speed capture: " + size.getWidth() + "x" + size.getHeight() + " at " + fps + " fps");
+            }
+
+            CameraCharacteristics characteristics = ServiceManager.getCameraManager().getCameraCharacteristics(cameraId);
+            Integer timestampSource = characteristics.get(CameraCharacteristics.SENSOR_INFO_TIMESTAMP_SOURCE);
+            // A "realtime" source is in the SystemClock.elapsedRealtimeNanos() time base
+            bootTimeClock = timestampSource != null && timestampSource == CameraCharacteristics.SENSOR_INFO_TIMESTAMP_SOURCE_REALTIME;
 
             Ln.i("Using camera '" + cameraId + "'");
             cameraDevice = openCamera(cameraId);
@@ -119,8 +136,8 @@ public class CameraCapture extends SurfaceCapture {
     }
 
     @TargetApi(Build.VERSION_CODES.N)
-    private static Size selectSize(String cameraId, Size explicitSize, int maxSize, CameraAspectRatio aspectRatio, boolean highSpeed)
-            throws CameraAccessException {
+    private static Size selectSize(String cameraId, Size explicitSize, int maxSize, CameraAspectRatio aspectRatio, boolean highSpeed,
+            int fps) throws CameraAccessException {
         if (explicitSize != null) {
             return explicitSize;
         }
@@ -135,6 +152,10 @@ public class CameraCapture extends SurfaceCapture {
         }
 
         Stream<android.util.Size> stream = Arrays.stream(sizes);
+        if (highSpeed && fps > 0) {
+            // A high-speed session only supports the fps ranges of the size (e.g. [120, 120] for recording)
+            stream = stream.filter(it -> supportsHighSpeedFps(configs, it, fps));
+        }
         if (maxSize > 0) {
             stream = stream.filter(it -> it.getWidth() <= maxSize && it.getHeight() <= maxSize);
         }
@@ -186,6 +207,15 @@ public class CameraCapture extends SurfaceCapture {
         return null;
     }
 
+    private static boolean supportsHighSpeedFps(StreamConfigurationMap configs, android.util.Size size, int fps) {
+        for (Range<Integer> range : configs.getHighSpeedVideoFpsRangesFor(size)) {
+            if (range.getLower() == fps && range.getUpper() == fps) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     private static Float resolveAspectRatio(CameraAspectRatio ratio, CameraCharacteristics characteristics) {
         if (ratio == null) {
             return null;
@@ -201,6 +231,9 @@ public class CameraCapture extends SurfaceCapture {
 
     @Override
     public void start(Surface surface) throws IOException {
+        // The timestamps of the previous session can never match
+        sensorTimestamps.clear();
+        exposures.clear();
         try {
             CameraCaptureSession session = createCaptureSession(cameraDevice, surface);
             CaptureRequest request = createCaptureRequest(surface);
@@ -233,7 +266,7 @@ public class CameraCapture extends SurfaceCapture {
 
         this.maxSize = maxSize;
         try {
-            size = selectSize(cameraId, null, maxSize, aspectRatio, highSpeed);
+            size = selectSize(cameraId, null, maxSize, aspectRatio, highSpeed, fps);
             return size != null;
         } catch (CameraAccessException e) {
             Ln.w("Could not select camera size", e);
@@ -333,7 +366,21 @@ public class CameraCapture extends SurfaceCapture {
         CameraCaptureSession.CaptureCallback callback = new CameraCaptureSession.CaptureCallback() {
             @Override
             public void onCaptureStarted(CameraCaptureSession session, CaptureRequest request, long timestamp, long frameNumber) {
-                // Called for each frame captured, do nothing
+                // Called for each frame captured: the timestamp is its CaptureResult.SENSOR_TIMESTAMP (the start of exposure), received before
+                // the capture result, and before the frame is encoded
+                sensorTimestamps.add(timestamp);
+            }
+
+            @Override
+            public void onCaptureCompleted(CameraCaptureSession session, CaptureRequest request, TotalCaptureResult result) {
+                Long timestamp = result.get(CaptureResult.SENSOR_TIMESTAMP);
+                Long exposureTime = result.get(CaptureResult.SENSOR_EXPOSURE_TIME);
+                if (timestamp == null || exposureTime == null) {
+                    return;
+                }
+                // The readout time of a global shutter is 0
+                Long skew = result.get(CaptureResult.SENSOR_ROLLING_SHUTTER_SKEW);
+                exposures.add(timestamp, ExposureHistory.pack(exposureTime, skew != null ? skew : 0));
             }
 
             @Override
@@ -351,6 +398,22 @@ public class CameraCapture extends SurfaceCapture {
         }
     }
 
+    @Override
+    public boolean isBootTimeClock() {
+        return bootTimeClock;
+    }
+
+    @Override
+    public long getCaptureTimestampNs(long ptsUs) {
+        // The frames are rendered to the encoder surface with their sensor timestamp
+        return sensorTimestamps.find(ptsUs);
+    }
+
+    @Override
+    public long getCaptureExposure(long ptsUs) {
+        return exposures.find(ptsUs);
+    }
+
     @Override
     public boolean isClosed() {
         return disconnected.get();
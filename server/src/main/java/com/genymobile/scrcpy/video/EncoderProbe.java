@@ -0,0 +1,349 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.device.Size;
+import com.genymobile.scrcpy.util.CodecOption;
+import com.genymobile.scrcpy.util.CodecUtils;
+import com.genymobile.scrcpy.util.Ln;
+
+import android.graphics.Canvas;
+import android.graphics.Color;
+import android.graphics.Paint;
+import android.media.MediaCodec;
+import android.media.MediaCodecInfo;
+import android.media.MediaFormat;
+import android.os.Build;
+import android.view.Surface;
+
+import java.io.BufferedReader;
+import java.io.File;
+import java.io.FileReader;
+import java.io.FileWriter;
+import java.io.IOException;
+import java.io.PrintWriter;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+import java.util.Locale;
+import java.util.Random;
+
+/**
+ * Short synthetic encode benchmark of each video encoder of the device (--probe-encoders).
+ * <p>
+ * Each encoder is configured as for a capture ({@link SurfaceEncoder#createFormat}), and fed as fast as possible with frames drawn on its
+ * input surface. The achieved frame rate, the encode latency (from the time a frame is posted to the time its output is dequeued) and the
+ * bit rate accuracy (the output bit rate at the nominal 60 fps, relative to the requested one) are reported.
+ * <p>
+ * The results are saved on the device, so that the next sessions without explicit encoder use the fastest one for their codec (see
+ * {@link #findFastestEncoder(VideoCodec)}).
+ */
+public final class EncoderProbe {
+
+    public static final String RESULTS_PATH = "/data/local/tmp/scrcpy-encoder-probe.txt";
+
+    // Sizes probed if no max size is requested
+    private static final Size[] DEFAULT_SIZES = {new Size(1280, 720), new Size(1920, 1080), new Size(2560, 1440)};
+
+    private static final int FRAME_COUNT = 90;
+    private static final int WARM_UP_FRAMES = 10; // excluded from the measures
+    private static final long TIMEOUT_NS = 5_000_000_000L;
+    private static final long DEQUEUE_TIMEOUT_US = 10_000;
+    // The frame rate configured by createFormat()
+    private static final int NOMINAL_FPS = 60;
+
+    public static final class Result {
+        private final VideoCodec codec;
+        private final String encoderName;
+        private final Size size;
+        private final float fps;
+        private final float latencyMs; // median
+        private final float bitRateRatio; // achieved / requested
+
+        Result(VideoCodec codec, String encoderName, Size size, float fps, float latencyMs, float bitRateRatio) {
+            this.codec = codec;
+            this.encoderName = encoderName;
+            this.size = size;
+            this.fps = fps;
+            this.latencyMs = latencyMs;
+            this.bitRateRatio = bitRateRatio;
+        }
+
+        public VideoCodec getCodec() {
+            return codec;
+        }
+
+        public String getEncoderName() {
+            return encoderName;
+        }
+
+        public Size getSize() {
+            return size;
+        }
+
+        public float getFps() {
+            return fps;
+        }
+
+        public float getLatencyMs() {
+            return latencyMs;
+        }
+
+        public float getBitRateRatio() {
+            return bitRateRatio;
+        }
+
+        // Pixels encoded per second, to compare the encoders probed at different sizes
+        float getPixelRate() {
+            return fps * size.getWidth() * size.getHeight();
+        }
+
+        String serialize() {
+            return String.format(Locale.US, "%s %d %d %.1f %.2f %.3f %s", codec.getName(), size.getWidth(), size.getHeight(), fps, latencyMs,
+                    bitRateRatio, encoderName);
+        }
+
+        static Result parse(String line) {
+            String[] tokens = line.split(" ", 7);
+            if (tokens.length != 7) {
+                return null;
+            }
+            VideoCodec codec = VideoCodec.findByName(tokens[0]);
+            if (codec == null) {
+                return null;
+            }
+            try {
+                Size size = new Size(Integer.parseInt(tokens[1]), Integer.parseInt(tokens[2]));
+                return new Result(codec, tokens[6], size, Float.parseFloat(tokens[3]), Float.parseFloat(tokens[4]), Float.parseFloat(tokens[5]));
+            } catch (NumberFormatException e) {
+                return null;
+            }
+        }
+    }
+
+    private EncoderProbe() {
+        // not instantiable
+    }
+
+    private static Size[] getProbeSizes(int maxSize) {
+        if (maxSize == 0) {
+            return DEFAULT_SIZES;
+        }
+        // 16:9, multiple of 16
+        int width = maxSize & ~15;
+        int height = (maxSize * 9 / 16) & ~15;
+        return new Size[] {new Size(width, height)};
+    }
+
+    public static String run(int bitRate, int maxSize, LatencyProfile latencyProfile, List<CodecOption> codecOptions) {
+        List<Result> results = new ArrayList<>();
+        StringBuilder builder = new StringBuilder("Encoder probe (" + FRAME_COUNT + " frames, " + bitRate + " bps):");
+
+        List<CodecUtils.DeviceEncoder> encoders = CodecUtils.listVideoEncoders();
+        if (encoders.isEmpty()) {
+            builder.append("\n    (none)");
+        }
+
+        for (CodecUtils.DeviceEncoder encoder : encoders) {
+            VideoCodec codec = (VideoCodec) encoder.getCodec();
+            MediaCodecInfo info = encoder.getInfo();
+            MediaCodecInfo.VideoCapabilities capabilities = info.getCapabilitiesForType(codec.getMimeType()).getVideoCapabilities();
+            for (Size size : getProbeSizes(maxSize)) {
+                builder.append("\n    --video-codec=").append(codec.getName());
+                builder.append(" --video-encoder='").append(info.getName()).append("' ");
+                builder.append(size.getWidth()).append('x').append(size.getHeight()).append(": ");
+
+                if (capabilities != null && !capabilities.isSizeSupported(size.getWidth(), size.getHeight())) {
+                    builder.append("unsupported size");
+                    continue;
+                }
+
+                Ln.d("Probing encoder '" + info.getName() + "' at " + size);
+                try {
+                    Result result = probe(codec, info.getName(), size, bitRate, latencyProfile, codecOptions);
+                    results.add(result);
+                    builder.append(String.format(Locale.US, "%.1f fps, latency %.1f ms, bit rate %+.0f%%", result.getFps(), result.getLatencyMs(),
+                            (result.getBitRateRatio() - 1) * 100));
+                } catch (IOException | RuntimeException e) {
+                    // Some encoders reject some configurations
+                    Ln.d("Encoder '" + info.getName() + "' failed at " + size + ": " + e);
+                    builder.append("failed");
+                }
+            }
+        }
+
+        save(results);
+        return builder.toString();
+    }
+
+    private static Result probe(VideoCodec codec, String encoderName, Size size, int bitRate, LatencyProfile latencyProfile,
+            List<CodecOption> codecOptions) throws IOException {
+        MediaCodec mediaCodec = MediaCodec.createByCodecName(encoderName);
+        Surface surface = null;
+        Thread producer = null;
+        try {
+            MediaFormat format = SurfaceEncoder.createFormat(mediaCodec, codec.getMimeType(), bitRate, 0, 0, latencyProfile, codecOptions);
+            format.setInteger(MediaFormat.KEY_WIDTH, size.getWidth());
+            format.setInteger(MediaFormat.KEY_HEIGHT, size.getHeight());
+            mediaCodec.configure(format, null, null, MediaCodec.CONFIGURE_FLAG_ENCODE);
+            surface = mediaCodec.createInputSurface();
+            mediaCodec.start();
+
+            // The frames are drawn by a separate thread: posting a frame blocks while the encoder has no free input buffer
+            Surface inputSurface = surface;
+            producer = new Thread(() -> drawFrames(inputSurface, size), "encoder-probe");
+            producer.start();
+
+            return measure(mediaCodec, codec, encoderName, size, bitRate);
+        } finally {
+            if (producer != null) {
+                producer.interrupt();
+            }
+            try {
+                // Also unblocks the producer waiting for an input buffer
+                mediaCodec.stop();
+            } catch (IllegalStateException e) {
+                // not started
+            }
+            mediaCodec.release();
+            if (producer != null) {
+                try {
+                    producer.join();
+                } catch (InterruptedException e) {
+                    Thread.currentThread().interrupt();
+                }
+            }
+            if (surface != null) {
+                surface.release();
+            }
+        }
+    }
+
+    private static Result measure(MediaCodec mediaCodec, VideoCodec codec, String encoderName, Size size, int bitRate) {
+        MediaCodec.BufferInfo bufferInfo = new MediaCodec.BufferInfo();
+        long[] latenciesUs = new long[FRAME_COUNT];
+        int outputFrames = 0;
+        int measuredFrames = 0;
+        long measuredBytes = 0;
+        long measureStartNs = 0;
+        long lastOutputNs = 0;
+        long deadline = System.nanoTime() + TIMEOUT_NS;
+
+        while (outputFrames < FRAME_COUNT && System.nanoTime() < deadline) {
+            int outputBufferId = mediaCodec.dequeueOutputBuffer(bufferInfo, DEQUEUE_TIMEOUT_US);
+            if (outputBufferId < 0) {
+                continue;
+            }
+            long nowNs = System.nanoTime();
+            boolean config = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_CODEC_CONFIG) != 0;
+            mediaCodec.releaseOutputBuffer(outputBufferId, false);
+            if (config) {
+                continue;
+            }
+
+            ++outputFrames;
+            if (outputFrames == WARM_UP_FRAMES) {
+                measureStartNs = nowNs;
+            } else if (outputFrames > WARM_UP_FRAMES) {
+                // The input surface timestamps the frames with System.nanoTime() when they are posted
+                latenciesUs[measuredFrames++] = nowNs / 1000 - bufferInfo.presentationTimeUs;
+                measuredBytes += bufferInfo.size;
+                lastOutputNs = nowNs;
+            }
+        }
+
+        if (measuredFrames < 2) {
+            throw new IllegalStateException("No output in " + TIMEOUT_NS / 1_000_000_000 + " seconds");
+        }
+
+        float fps = measuredFrames * 1e9f / (lastOutputNs - measureStartNs);
+        Arrays.sort(latenciesUs, 0, measuredFrames);
+        float latencyMs = latenciesUs[measuredFrames / 2] / 1000f;
+        float achievedBitRate = measuredBytes * 8f * NOMINAL_FPS / measuredFrames;
+        return new Result(codec, encoderName, size, fps, latencyMs, achievedBitRate / bitRate);
+    }
+
+    private static void drawFrames(Surface surface, Size size) {
+        int width = size.getWidth();
+        int height = size.getHeight();
+        Paint paint = new Paint();
+        // Moving random blocks, so that each frame differs from the previous one like a real capture
+        Random random = new Random(0);
+        for (int i = 0; !Thread.currentThread().isInterrupted(); ++i) {
+            Canvas canvas;
+            try {
+                canvas = Build.VERSION.SDK_INT >= Build.VERSION_CODES.M ? surface.lockHardwareCanvas() : surface.lockCanvas(null);
+            } catch (IllegalStateException | IllegalArgumentException e) {
+                // The encoder is stopped
+                return;
+            }
+            canvas.drawColor(Color.rgb(i & 0xFF, (i * 3) & 0xFF, (i * 7) & 0xFF));
+            for (int j = 0; j < 32; ++j) {
+                paint.setColor(0xFF000000 | random.nextInt(0x1000000));
+                int x = random.nextInt(width);
+                int y = random.nextInt(height);
+                canvas.drawRect(x, y, x + width / 8, y + height / 8, paint);
+            }
+            try {
+                surface.unlockCanvasAndPost(canvas);
+            } catch (IllegalStateException | IllegalArgumentException e) {
+                return;
+            }
+        }
+    }
+
+    private static void save(List<Result> results) {
+        try (PrintWriter writer = new PrintWriter(new FileWriter(RESULTS_PATH))) {
+            for (Result result : results) {
+                writer.println(result.serialize());
+            }
+        } catch (IOException e) {
+            Ln.w("Could not save the encoder probe results to " + RESULTS_PATH + ": " + e.getMessage());
+        }
+    }
+
+    private static List<Result> load() {
+        List<Result> results = new ArrayList<>();
+        File file = new File(RESULTS_PATH);
+        if (!file.exists()) {
+            return results;
+        }
+        try (BufferedReader reader = new BufferedReader(new FileReader(file))) {
+            String line;
+            while ((line = reader.readLine()) != null) {
+                Result result = Result.parse(line);
+                if (result != null) {
+                    results.add(result);
+                }
+            }
+        } catch (IOException e) {
+            Ln.w("Could not read the encoder probe results from " + RESULTS_PATH + ": " + e.getMessage());
+        }
+        return results;
+    }
+
+    /**
+     * Return the result of the encoder of the codec having encoded the most pixels per second (at any probed size), or {@code null} if the
+     * encoders were not probed (--probe-encoders).
+     */
+    public static Result findFastest(VideoCodec codec) {
+        List<Result> results = load();
+        Result best = null;
+        for (Result result : results) {
+            if (result.getCodec() != codec) {
+                continue;
+            }
+            if (best == null || result.getPixelRate() > best.getPixelRate()) {
+                best = result;
+            }
+        }
+        return best;
+    }
+
+    /**
+     * Return the encoder of the codec having encoded the most pixels per second (at any probed size), or {@code null} if the encoders were
+     * not probed (--probe-encoders).
+     */
+    public static String findFastestEncoder(VideoCodec codec) {
+        Result best = findFastest(codec);
+        return best != null ? best.getEncoderName() : null;
+    }
+}
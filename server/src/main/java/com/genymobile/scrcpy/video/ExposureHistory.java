@@ -0,0 +1,67 @@
+package com.genymobile.scrcpy.video;
+
+/**
+ * History of the exposure of the last captured frames (from their capture results), to retrieve it from the PTS of the encoded frames.
+ * <p>
+ * The exposures are added by the capture thread when the capture results are received, and retrieved by the encoding thread. A capture result
+ * is normally received before its frame is encoded; if it is not (yet), the exposure of the latest result is returned, the exposure varying
+ * slowly between consecutive frames.
+ */
+public final class ExposureHistory {
+
+    private final long[] timestamps; // sensor timestamps, in nanoseconds
+    private final long[] exposures; // packed as (exposureNs << 32) | readoutNs
+    private int head; // index of the next entry to write
+    private long latest;
+
+    public ExposureHistory(int capacity) {
+        timestamps = new long[capacity];
+        exposures = new long[capacity];
+    }
+
+    /**
+     * Pack an exposure time and a readout time (each saturated to 32 bits).
+     *
+     * @param exposureNs the exposure time of each row
+     * @param readoutNs the readout time (the delay between the start of exposure of the first and the last rows)
+     * @return the packed value
+     */
+    public static long pack(long exposureNs, long readoutNs) {
+        long exposure = Math.min(Math.max(exposureNs, 0), 0xFFFFFFFFL);
+        long readout = Math.min(Math.max(readoutNs, 0), 0xFFFFFFFFL);
+        return (exposure << 32) | readout;
+    }
+
+    public synchronized void add(long timestampNs, long exposure) {
+        timestamps[head] = timestampNs;
+        exposures[head] = exposure;
+        head = (head + 1) % timestamps.length;
+        latest = exposure;
+    }
+
+    /**
+     * Find the exposure of the frame having the given PTS.
+     *
+     * @param ptsUs the PTS of the encoded frame
+     * @return the packed exposure, the latest one if not found, or 0 if none has been received
+     */
+    public synchronized long find(long ptsUs) {
+        for (int i = 1; i <= timestamps.length; ++i) {
+            int index = (head - i + timestamps.length) % timestamps.length;
+            long ns = timestamps[index];
+            if (ns != 0 && ns / 1000 == ptsUs) {
+                return exposures[index];
+            }
+        }
+        return latest;
+    }
+
+    public synchronized void clear() {
+        for (int i = 0; i < timestamps.length; ++i) {
+            timestamps[i] = 0;
+            exposures[i] = 0;
+        }
+        head = 0;
+        latest = 0;
+    }
+}
@@ -0,0 +1,60 @@
+package com.genymobile.scrcpy.video;
+
+import java.util.Arrays;
+
+/**
+ * Collect latency samples (in microseconds) over a period, to summarize them as percentiles.
+ */
+public final class LatencyHistogram {
+
+    // p50, p95, p99, max
+    public static final int SUMMARY_LENGTH = 4;
+
+    private final int[] samples;
+    private int count;
+
+    public LatencyHistogram(int capacity) {
+        samples = new int[capacity];
+    }
+
+    public void add(long us) {
+        if (count == samples.length) {
+            // The summary is computed from the first samples of the period
+            return;
+        }
+        samples[count++] = (int) Math.max(0, Math.min(us, Integer.MAX_VALUE));
+    }
+
+    public int getCount() {
+        return count;
+    }
+
+    /**
+     * Compute the summary of the samples collected since the last reset.
+     *
+     * @return {p50, p95, p99, max}, in microseconds
+     */
+    public int[] summarize() {
+        int[] summary = new int[SUMMARY_LENGTH];
+        if (count == 0) {
+            return summary;
+        }
+
+        Arrays.sort(samples, 0, count);
+        summary[0] = percentile(50);
+        summary[1] = percentile(95);
+        summary[2] = percentile(99);
+        summary[3] = samples[count - 1];
+        return summary;
+    }
+
+    private int percentile(int p) {
+        // Nearest-rank
+        int rank = (p * count + 99) / 100;
+        return samples[Math.max(rank, 1) - 1];
+    }
+
+    public void reset() {
+        count = 0;
+    }
+}
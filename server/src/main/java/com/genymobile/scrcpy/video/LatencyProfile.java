@@ -0,0 +1,23 @@
+package com.genymobile.scrcpy.video;
+
+public enum LatencyProfile {
+    DEFAULT("default"),
+    // Realtime encoder without B-frames nor periodic key frames (intra refresh)
+    ULTRA_LOW("ultra-low");
+
+    private final String name;
+
+    LatencyProfile(String name) {
+        this.name = name;
+    }
+
+    public static LatencyProfile findByName(String name) {
+        for (LatencyProfile profile : LatencyProfile.values()) {
+            if (name.equals(profile.name)) {
+                return profile;
+            }
+        }
+
+        return null;
+    }
+}
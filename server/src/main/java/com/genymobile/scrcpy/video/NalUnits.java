@@ -0,0 +1,60 @@
+package com.genymobile.scrcpy.video;
+
+import java.nio.ByteBuffer;
+
+/**
+ * Inspection of the NAL units of an encoded H.264 or H.265 frame (in Annex B format, as produced by MediaCodec).
+ */
+public final class NalUnits {
+
+    private NalUnits() {
+        // not instantiable
+    }
+
+    /**
+     * Indicate whether the frame is not referenced by any other frame, so that it may be dropped without corrupting the following ones.
+     * <p>
+     * This is read from the header of the first slice: {@code nal_ref_idc == 0} for H.264, a sub-layer non-reference picture type for H.265.
+     * For any other codec, or if the frame contains no slice, it is considered referenced.
+     *
+     * @param codec the video codec
+     * @param buffer the frame data (between its position and its limit, not modified)
+     * @return {@code true} if the frame may be dropped
+     */
+    public static boolean isNonReference(VideoCodec codec, ByteBuffer buffer) {
+        if (codec != VideoCodec.H264 && codec != VideoCodec.H265) {
+            return false;
+        }
+
+        int limit = buffer.limit();
+        int zeros = 0;
+        for (int i = buffer.position(); i < limit - 1; ++i) {
+            byte b = buffer.get(i);
+            if (b == 0) {
+                ++zeros;
+                continue;
+            }
+
+            if (b == 1 && zeros >= 2) {
+                // Start code, the NAL unit header follows
+                int header = buffer.get(i + 1) & 0xff;
+                if (codec == VideoCodec.H264) {
+                    int type = header & 0x1f;
+                    if (type >= 1 && type <= 5) {
+                        // Slice, an IDR (type 5) is always referenced
+                        return type != 5 && (header & 0x60) == 0;
+                    }
+                } else {
+                    int type = (header >> 1) & 0x3f;
+                    if (type <= 31) {
+                        // VCL, the even types up to RSV_VCL_N14 are the sub-layer non-reference pictures
+                        return type <= 14 && type % 2 == 0;
+                    }
+                }
+            }
+            zeros = 0;
+        }
+
+        return false;
+    }
+}
@@ -0,0 +1,91 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.device.ConfigurationException;
+import com.genymobile.scrcpy.device.Size;
+import com.genymobile.scrcpy.util.Ln;
+
+import java.io.FileInputStream;
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.channels.FileChannel;
+
+/**
+ * Stereo remap map of the whole frame, pushed by the client (see app/src/device_remap.h).
+ * <p>
+ * For each destination pixel, row by row from the top, it contains the source coordinates (x, y) in the whole frame, as 32-bit little-endian
+ * floats. The map may cover only the valid region of the rectified eyes, so its size may be smaller than the size of the source frames.
+ */
+public final class RemapMap {
+
+    private static final int MAGIC = 0x5343524D; // "SCRM"
+    private static final int HEADER_SIZE = 20;
+
+    private final Size size;
+    private final Size sourceSize;
+    private final ByteBuffer data; // direct, in native order (all the Android ABIs are little-endian)
+
+    private RemapMap(Size size, Size sourceSize, ByteBuffer data) {
+        this.size = size;
+        this.sourceSize = sourceSize;
+        this.data = data;
+    }
+
+    public static RemapMap load(String path) throws IOException, ConfigurationException {
+        try (FileInputStream input = new FileInputStream(path); FileChannel channel = input.getChannel()) {
+            ByteBuffer header = ByteBuffer.allocate(HEADER_SIZE);
+            readFully(channel, header);
+            header.flip();
+            if (header.getInt() != MAGIC) {
+                Ln.e("Invalid remap map: " + path);
+                throw new ConfigurationException("Invalid remap map");
+            }
+
+            int width = header.getInt();
+            int height = header.getInt();
+            int sourceWidth = header.getInt();
+            int sourceHeight = header.getInt();
+            long dataSize = (long) width * height * 2 * 4; // 2 floats per pixel
+            if (width <= 0 || height <= 0 || sourceWidth <= 0 || sourceHeight <= 0 || dataSize != channel.size() - HEADER_SIZE) {
+                Ln.e("Invalid remap map size: " + width + "x" + height);
+                throw new ConfigurationException("Invalid remap map size");
+            }
+
+            ByteBuffer data = ByteBuffer.allocateDirect((int) dataSize).order(ByteOrder.nativeOrder());
+            readFully(channel, data);
+            data.flip();
+
+            Ln.i("Remap map loaded: " + width + "x" + height + " (from " + sourceWidth + "x" + sourceHeight + ")");
+            return new RemapMap(new Size(width, height), new Size(sourceWidth, sourceHeight), data);
+        }
+    }
+
+    private static void readFully(FileChannel channel, ByteBuffer buffer) throws IOException {
+        while (buffer.hasRemaining()) {
+            if (channel.read(buffer) == -1) {
+                throw new IOException("Unexpected end of remap map");
+            }
+        }
+    }
+
+    /**
+     * Return the size of the remapped (encoded) frames.
+     */
+    public Size getSize() {
+        return size;
+    }
+
+    /**
+     * Return the size of the captured frames.
+     */
+    public Size getSourceSize() {
+        return sourceSize;
+    }
+
+    /**
+     * Return the map data, interleaved (x, y) floats, to be uploaded as a {@code GL_RG32F} texture.
+     */
+    public ByteBuffer getData() {
+        return data.duplicate().order(ByteOrder.nativeOrder());
+    }
+}
@@ -0,0 +1,374 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.device.Size;
+import com.genymobile.scrcpy.util.Ln;
+
+import android.graphics.SurfaceTexture;
+import android.opengl.EGL14;
+import android.opengl.EGLConfig;
+import android.opengl.EGLContext;
+import android.opengl.EGLDisplay;
+import android.opengl.EGLExt;
+import android.opengl.EGLSurface;
+import android.opengl.GLES11Ext;
+import android.opengl.GLES20;
+import android.opengl.GLES30;
+import android.os.Handler;
+import android.os.HandlerThread;
+import android.view.Surface;
+
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.FloatBuffer;
+import java.util.Arrays;
+
+/**
+ * Stereo remap on the device, between the capture and the encoder(s).
+ * <p>
+ * The capture writes into a {@link SurfaceTexture} (an external OES texture). On each new frame, a fragment shader samples it through the map
+ * (uploaded once as a float texture) and draws the result into the encoder input surface, with the timestamp of the captured frame. The client
+ * therefore receives rectified frames.
+ * <p>
+ * The frame may also be split into its two eyes, each one drawn into the input surface of its own encoder (with the same timestamp). In that
+ * case, the map is optional: without it, the eyes are copied as captured.
+ * <p>
+ * The frames are rendered from a dedicated thread, so that the capture callbacks are never blocked by the GPU.
+ */
+public final class RemapRenderer {
+
+    private static final int EGL_RECORDABLE_ANDROID = 0x3142;
+
+    private static final String VERTEX_SHADER = ""
+            + "attribute vec2 position;\n"
+            + "void main() {\n"
+            + "    gl_Position = vec4(position, 0.0, 1.0);\n"
+            + "}\n";
+
+    private static final float[] QUAD = {-1, -1, 1, -1, -1, 1, 1, 1};
+
+    // The coordinates are expressed in pixels, rows from the top, the center of the pixel i being at i + 0.5. Like cv::remap() on the client, a
+    // map value x refers to the center of the source pixel x, and each eye (half of the frame) is sampled only inside its own half.
+    // The output surface covers the columns from x_offset of the whole (remapped) frame.
+    private static String createFragmentShader(boolean remap) {
+        return ""
+                + "#extension GL_OES_EGL_image_external : require\n"
+                + "precision highp float;\n"
+                + "uniform samplerExternalOES tex;\n"
+                + "uniform sampler2D map_tex;\n"
+                + "uniform mat4 tex_matrix;\n"
+                + "uniform vec2 size;\n"
+                + "uniform vec2 src_size;\n"
+                + "uniform float x_offset;\n"
+                + "void main() {\n"
+                + "    vec2 pos = vec2(gl_FragCoord.x + x_offset, size.y - gl_FragCoord.y);\n"
+                + (remap ? "    vec2 p = texture2D(map_tex, pos / size).xy;\n"
+                         : "    vec2 p = pos - 0.5;\n")
+                + "    float half_width = src_size.x / 2.0;\n"
+                + "    float left = pos.x < size.x / 2.0 ? 0.0 : half_width;\n"
+                + "    if (p.x < left - 0.5 || p.x > left + half_width - 0.5\n"
+                + "            || p.y < -0.5 || p.y > src_size.y - 0.5) {\n"
+                + "        gl_FragColor = vec4(0.0, 0.0, 0.0, 1.0);\n"
+                + "        return;\n"
+                + "    }\n"
+                // The texture coordinates of the SurfaceTexture have their origin at the bottom
+                + "    vec2 tc = vec2((p.x + 0.5) / src_size.x, 1.0 - (p.y + 0.5) / src_size.y);\n"
+                + "    gl_FragColor = texture2D(tex, (tex_matrix * vec4(tc, 0.0, 1.0)).xy);\n"
+                + "}\n";
+    }
+
+    private final Size size; // of the remapped frames
+    private final Size sourceSize; // of the captured frames
+    private final int outputWidth; // of each output surface
+
+    private final HandlerThread thread;
+    private final Handler handler;
+
+    private EGLDisplay eglDisplay = EGL14.EGL_NO_DISPLAY;
+    private EGLContext eglContext = EGL14.EGL_NO_CONTEXT;
+    private final EGLSurface[] eglSurfaces;
+    private boolean currentOnThread;
+
+    private int program;
+    private int positionLoc;
+    private int texMatrixLoc;
+    private int xOffsetLoc;
+    private int oesTexture;
+    private int mapTexture;
+    private final float[] texMatrix = new float[16];
+    private final FloatBuffer quad;
+
+    private SurfaceTexture surfaceTexture;
+    private Surface inputSurface;
+
+    /**
+     * Create the renderer, drawing into the encoder input surface.
+     * <p>
+     * The captured frames must have the source size of the map.
+     */
+    public RemapRenderer(RemapMap map, Surface outputSurface) throws IOException {
+        this(map, map.getSourceSize(), outputSurface);
+    }
+
+    /**
+     * Create the renderer, drawing the frame split horizontally into equal parts (the eyes) into the encoder input surfaces, from left to right.
+     * <p>
+     * If the map is null, the captured frames (of the given source size) are not remapped. Otherwise, they must have the source size of the map.
+     */
+    public RemapRenderer(RemapMap map, Size sourceSize, Surface... outputSurfaces) throws IOException {
+        this.sourceSize = sourceSize;
+        size = map != null ? map.getSize() : sourceSize;
+        outputWidth = size.getWidth() / outputSurfaces.length;
+        eglSurfaces = new EGLSurface[outputSurfaces.length];
+        Arrays.fill(eglSurfaces, EGL14.EGL_NO_SURFACE);
+        quad = ByteBuffer.allocateDirect(QUAD.length * 4).order(ByteOrder.nativeOrder()).asFloatBuffer();
+        quad.put(QUAD).flip();
+
+        thread = new HandlerThread("remap");
+        thread.start();
+        handler = new Handler(thread.getLooper());
+
+        try {
+            // Initialized on the caller thread, the context is made current on the render thread on the first frame
+            initEgl(outputSurfaces);
+            initGl(map);
+            EGL14.eglMakeCurrent(eglDisplay, EGL14.EGL_NO_SURFACE, EGL14.EGL_NO_SURFACE, EGL14.EGL_NO_CONTEXT);
+        } catch (IOException e) {
+            releaseGl();
+            thread.quit();
+            throw e;
+        }
+
+        surfaceTexture.setOnFrameAvailableListener(st -> render(), handler);
+    }
+
+    /**
+     * Return the surface the capture must write into.
+     */
+    public Surface getInputSurface() {
+        return inputSurface;
+    }
+
+    private void initEgl(Surface[] outputSurfaces) throws IOException {
+        eglDisplay = EGL14.eglGetDisplay(EGL14.EGL_DEFAULT_DISPLAY);
+        int[] version = new int[2];
+        if (eglDisplay == EGL14.EGL_NO_DISPLAY || !EGL14.eglInitialize(eglDisplay, version, 0, version, 1)) {
+            throw new IOException("Could not initialize EGL");
+        }
+
+        int[] configAttribs = {
+                EGL14.EGL_RED_SIZE, 8,
+                EGL14.EGL_GREEN_SIZE, 8,
+                EGL14.EGL_BLUE_SIZE, 8,
+                EGL14.EGL_RENDERABLE_TYPE, EGLExt.EGL_OPENGL_ES3_BIT_KHR,
+                EGL_RECORDABLE_ANDROID, 1,
+                EGL14.EGL_NONE,
+        };
+        EGLConfig[] configs = new EGLConfig[1];
+        int[] numConfigs = new int[1];
+        if (!EGL14.eglChooseConfig(eglDisplay, configAttribs, 0, configs, 0, 1, numConfigs, 0) || numConfigs[0] == 0) {
+            throw new IOException("No recordable OpenGL ES 3 EGL config");
+        }
+
+        int[] contextAttribs = {EGL14.EGL_CONTEXT_CLIENT_VERSION, 3, EGL14.EGL_NONE};
+        eglContext = EGL14.eglCreateContext(eglDisplay, configs[0], EGL14.EGL_NO_CONTEXT, contextAttribs, 0);
+        if (eglContext == EGL14.EGL_NO_CONTEXT) {
+            throw new IOException("Could not create the EGL context");
+        }
+
+        int[] surfaceAttribs = {EGL14.EGL_NONE};
+        for (int i = 0; i < outputSurfaces.length; ++i) {
+            eglSurfaces[i] = EGL14.eglCreateWindowSurface(eglDisplay, configs[0], outputSurfaces[i], surfaceAttribs, 0);
+            if (eglSurfaces[i] == EGL14.EGL_NO_SURFACE) {
+                throw new IOException("Could not create the EGL surface of the encoder");
+            }
+        }
+
+        if (!EGL14.eglMakeCurrent(eglDisplay, eglSurfaces[0], eglSurfaces[0], eglContext)) {
+            throw new IOException("Could not make the EGL context current");
+        }
+    }
+
+    private void initGl(RemapMap map) throws IOException {
+        program = createProgram(map != null);
+        positionLoc = GLES20.glGetAttribLocation(program, "position");
+        texMatrixLoc = GLES20.glGetUniformLocation(program, "tex_matrix");
+        xOffsetLoc = GLES20.glGetUniformLocation(program, "x_offset");
+
+        int[] textures = new int[2];
+        GLES20.glGenTextures(2, textures, 0);
+        oesTexture = textures[0];
+        mapTexture = textures[1];
+
+        GLES20.glBindTexture(GLES11Ext.GL_TEXTURE_EXTERNAL_OES, oesTexture);
+        GLES20.glTexParameteri(GLES11Ext.GL_TEXTURE_EXTERNAL_OES, GLES20.GL_TEXTURE_MIN_FILTER, GLES20.GL_LINEAR);
+        GLES20.glTexParameteri(GLES11Ext.GL_TEXTURE_EXTERNAL_OES, GLES20.GL_TEXTURE_MAG_FILTER, GLES20.GL_LINEAR);
+        GLES20.glTexParameteri(GLES11Ext.GL_TEXTURE_EXTERNAL_OES, GLES20.GL_TEXTURE_WRAP_S, GLES20.GL_CLAMP_TO_EDGE);
+        GLES20.glTexParameteri(GLES11Ext.GL_TEXTURE_EXTERNAL_OES, GLES20.GL_TEXTURE_WRAP_T, GLES20.GL_CLAMP_TO_EDGE);
+
+        if (map != null) {
+            // One texel per destination pixel, sampled at its center: the float texture needs no filtering (which is not supported everywhere)
+            GLES20.glBindTexture(GLES20.GL_TEXTURE_2D, mapTexture);
+            GLES20.glTexParameteri(GLES20.GL_TEXTURE_2D, GLES20.GL_TEXTURE_MIN_FILTER, GLES20.GL_NEAREST);
+            GLES20.glTexParameteri(GLES20.GL_TEXTURE_2D, GLES20.GL_TEXTURE_MAG_FILTER, GLES20.GL_NEAREST);
+            GLES20.glTexParameteri(GLES20.GL_TEXTURE_2D, GLES20.GL_TEXTURE_WRAP_S, GLES20.GL_CLAMP_TO_EDGE);
+            GLES20.glTexParameteri(GLES20.GL_TEXTURE_2D, GLES20.GL_TEXTURE_WRAP_T, GLES20.GL_CLAMP_TO_EDGE);
+            GLES20.glPixelStorei(GLES20.GL_UNPACK_ALIGNMENT, 4);
+            GLES30.glTexImage2D(GLES20.GL_TEXTURE_2D, 0, GLES30.GL_RG32F, size.getWidth(), size.getHeight(), 0, GLES30.GL_RG, GLES20.GL_FLOAT,
+                    map.getData());
+            if (GLES20.glGetError() != GLES20.GL_NO_ERROR) {
+                throw new IOException("Could not upload the remap map");
+            }
+        }
+
+        GLES20.glUseProgram(program);
+        GLES20.glUniform1i(GLES20.glGetUniformLocation(program, "tex"), 0);
+        GLES20.glUniform1i(GLES20.glGetUniformLocation(program, "map_tex"), 1);
+        GLES20.glUniform2f(GLES20.glGetUniformLocation(program, "size"), size.getWidth(), size.getHeight());
+        GLES20.glUniform2f(GLES20.glGetUniformLocation(program, "src_size"), sourceSize.getWidth(), sourceSize.getHeight());
+
+        surfaceTexture = new SurfaceTexture(oesTexture);
+        surfaceTexture.setDefaultBufferSize(sourceSize.getWidth(), sourceSize.getHeight());
+        inputSurface = new Surface(surfaceTexture);
+    }
+
+    private static int compileShader(int type, String source) throws IOException {
+        int shader = GLES20.glCreateShader(type);
+        GLES20.glShaderSource(shader, source);
+        GLES20.glCompileShader(shader);
+        int[] status = new int[1];
+        GLES20.glGetShaderiv(shader, GLES20.GL_COMPILE_STATUS, status, 0);
+        if (status[0] == 0) {
+            String log = GLES20.glGetShaderInfoLog(shader);
+            GLES20.glDeleteShader(shader);
+            throw new IOException("Could not compile the remap shader: " + log);
+        }
+        return shader;
+    }
+
+    private static int createProgram(boolean remap) throws IOException {
+        int vertexShader = compileShader(GLES20.GL_VERTEX_SHADER, VERTEX_SHADER);
+        int fragmentShader;
+        try {
+            fragmentShader = compileShader(GLES20.GL_FRAGMENT_SHADER, createFragmentShader(remap));
+        } catch (IOException e) {
+            GLES20.glDeleteShader(vertexShader);
+            throw e;
+        }
+
+        int program = GLES20.glCreateProgram();
+        GLES20.glAttachShader(program, vertexShader);
+        GLES20.glAttachShader(program, fragmentShader);
+        GLES20.glLinkProgram(program);
+        GLES20.glDeleteShader(vertexShader);
+        GLES20.glDeleteShader(fragmentShader);
+
+        int[] status = new int[1];
+        GLES20.glGetProgramiv(program, GLES20.GL_LINK_STATUS, status, 0);
+        if (status[0] == 0) {
+            String log = GLES20.glGetProgramInfoLog(program);
+            GLES20.glDeleteProgram(program);
+            throw new IOException("Could not link the remap program: " + log);
+        }
+        return program;
+    }
+
+    private void render() {
+        if (!currentOnThread) {
+            if (!EGL14.eglMakeCurrent(eglDisplay, eglSurfaces[0], eglSurfaces[0], eglContext)) {
+                Ln.e("Could not make the remap EGL context current");
+                return;
+            }
+            currentOnThread = true;
+        }
+
+        surfaceTexture.updateTexImage();
+        surfaceTexture.getTransformMatrix(texMatrix);
+        long timestamp = surfaceTexture.getTimestamp();
+
+        for (int i = 0; i < eglSurfaces.length; ++i) {
+            EGLSurface eglSurface = eglSurfaces[i];
+            if (i > 0 && !EGL14.eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext)) {
+                Ln.e("Could not make the remap EGL surface current");
+                return;
+            }
+
+            GLES20.glViewport(0, 0, outputWidth, size.getHeight());
+            GLES20.glUseProgram(program);
+            GLES20.glUniformMatrix4fv(texMatrixLoc, 1, false, texMatrix, 0);
+            GLES20.glUniform1f(xOffsetLoc, i * outputWidth);
+
+            GLES20.glActiveTexture(GLES20.GL_TEXTURE0);
+            GLES20.glBindTexture(GLES11Ext.GL_TEXTURE_EXTERNAL_OES, oesTexture);
+            GLES20.glActiveTexture(GLES20.GL_TEXTURE1);
+            GLES20.glBindTexture(GLES20.GL_TEXTURE_2D, mapTexture);
+
+            GLES20.glEnableVertexAttribArray(positionLoc);
+            GLES20.glVertexAttribPointer(positionLoc, 2, GLES20.GL_FLOAT, false, 0, quad);
+            GLES20.glDrawArrays(GLES20.GL_TRIANGLE_STRIP, 0, 4);
+            GLES20.glDisableVertexAttribArray(positionLoc);
+
+            // Keep the capture timestamp (the PTS, and the capture timestamps sent to the client, are computed from it). With several
+            // outputs, the client matches the eyes by their PTS.
+            EGLExt.eglPresentationTimeANDROID(eglDisplay, eglSurface, timestamp);
+            if (!EGL14.eglSwapBuffers(eglDisplay, eglSurface)) {
+                // Typically, the encoder is being stopped
+                Ln.w("Could not submit the remapped frame to the encoder");
+            }
+        }
+
+        if (eglSurfaces.length > 1) {
+            // The first surface is expected to be current on the next frame
+            EGL14.eglMakeCurrent(eglDisplay, eglSurfaces[0], eglSurfaces[0], eglContext);
+        }
+    }
+
+    // Must be called with the context current (or not created yet)
+    private void releaseGl() {
+        if (inputSurface != null) {
+            inputSurface.release();
+        }
+        if (surfaceTexture != null) {
+            surfaceTexture.release();
+        }
+        if (eglContext != EGL14.EGL_NO_CONTEXT) {
+            if (program != 0) {
+                GLES20.glDeleteProgram(program);
+            }
+            if (oesTexture != 0) {
+                GLES20.glDeleteTextures(2, new int[] {oesTexture, mapTexture}, 0);
+            }
+        }
+        if (eglDisplay != EGL14.EGL_NO_DISPLAY) {
+            EGL14.eglMakeCurrent(eglDisplay, EGL14.EGL_NO_SURFACE, EGL14.EGL_NO_SURFACE, EGL14.EGL_NO_CONTEXT);
+            for (EGLSurface eglSurface : eglSurfaces) {
+                if (eglSurface != EGL14.EGL_NO_SURFACE) {
+                    EGL14.eglDestroySurface(eglDisplay, eglSurface);
+                }
+            }
+            if (eglContext != EGL14.EGL_NO_CONTEXT) {
+                EGL14.eglDestroyContext(eglDisplay, eglContext);
+            }
+            EGL14.eglReleaseThread();
+            EGL14.eglTerminate(eglDisplay);
+        }
+    }
+
+    /**
+     * Release the renderer, once the capture no longer writes into the input surface.
+     */
+    public void release() {
+        handler.post(() -> {
+            if (!currentOnThread) {
+                EGL14.eglMakeCurrent(eglDisplay, eglSurfaces[0], eglSurfaces[0], eglContext);
+            }
+            releaseGl();
+            thread.quit();
+        });
+        try {
+            thread.join();
+        } catch (InterruptedException e) {
+            Thread.currentThread().interrupt();
+        }
+    }
+}
@@ -62,6 +62,42 @@ public abstract class SurfaceCapture {
      */
     public abstract boolean setMaxSize(int maxSize);
 
+    /**
+     * Indicate if the timestamps of the captured frames are in the {@code SystemClock.elapsedRealtimeNanos()} time base (which includes deep
+     * sleep), rather than in the {@code System.nanoTime()} time base.
+     *
+     * @return {@code true} if the timestamps include deep sleep, {@code false} otherwise.
+     */
+    public boolean isBootTimeClock() {
+        return false;
+    }
+
+    /**
+     * Return the exact timestamp of the captured frame having the given PTS, if the capture knows it (for example the sensor timestamp of a
+     * camera frame).
+     * <p>
+     * Called from the encoding thread.
+     *
+     * @param ptsUs the PTS of the encoded frame (its timestamp truncated to microseconds)
+     * @return the timestamp in nanoseconds, in the same time base as the PTS, or 0 if unknown
+     */
+    public long getCaptureTimestampNs(long ptsUs) {
+        return 0;
+    }
+
+    /**
+     * Return the exposure of the captured frame having the given PTS, if the capture knows it (for a camera frame, its exposure time and its
+     * rolling shutter skew, the delay between the start of exposure of the first and the last rows).
+     * <p>
+     * Called from the encoding thread.
+     *
+     * @param ptsUs the PTS of the encoded frame
+     * @return the exposure and readout times in nanoseconds, packed as {@code (exposureNs << 32) | readoutNs}, or 0 if unknown
+     */
+    public long getCaptureExposure(long ptsUs) {
+        return 0;
+    }
+
     /**
      * Indicate if the capture has been closed internally.
      *
@@ -1,6 +1,8 @@
 package com.genymobile.scrcpy.video;
 
 import com.genymobile.scrcpy.AsyncProcessor;
+import com.genymobile.scrcpy.control.DeviceMessage;
+import com.genymobile.scrcpy.control.DeviceMessageSender;
 import com.genymobile.scrcpy.util.Codec;
 import com.genymobile.scrcpy.util.CodecOption;
 import com.genymobile.scrcpy.util.CodecUtils;
@@ -15,6 +17,9 @@ import android.media.MediaCodec;
 import android.media.MediaCodecInfo;
 import android.media.MediaFormat;
 import android.os.Build;
+import android.os.Bundle;
+import android.os.Handler;
+import android.os.HandlerThread;
 import android.os.Looper;
 import android.os.SystemClock;
 import android.view.Surface;
@@ -23,17 +28,28 @@ import java.io.IOException;
 import java.nio.ByteBuffer;
 import java.util.List;
 import java.util.concurrent.atomic.AtomicBoolean;
+import java.util.concurrent.atomic.AtomicLong;
 
 public class SurfaceEncoder implements AsyncProcessor {
 
     private static final int DEFAULT_I_FRAME_INTERVAL = 10; // seconds
-    private static final int REPEAT_FRAME_DELAY_US = 100_000; // repeat after 100ms
     private static final String KEY_MAX_FPS_TO_ENCODER = "max-fps-to-encoder";
 
     // Keep the values in descending order
     private static final int[] MAX_SIZE_FALLBACK = {2560, 1920, 1600, 1280, 1024, 800};
     private static final int MAX_CONSECUTIVE_ERRORS = 3;
 
+    // With the ultra-low latency profile, the picture is refreshed progressively over this number of frames (intra refresh)
+    private static final int INTRA_REFRESH_PERIOD = 60;
+
+    private static final long LATENCY_REPORT_INTERVAL_NS = 1_000_000_000; // 1 second
+    private static final int LATENCY_MAX_SAMPLES = 256; // per report
+
+    // In asynchronous mode, maximum number of encoded frames waiting to be written before dropping the non-reference ones
+    private static final int ASYNC_OUTPUT_QUEUE_SIZE = 4;
+    // In asynchronous mode, interval to check the stop and reset requests while waiting for the encoder output
+    private static final long ASYNC_OUTPUT_POLL_MS = 100;
+
     private final SurfaceCapture capture;
     private final Streamer streamer;
     private final String encoderName;
@@ -42,6 +58,42 @@ public class SurfaceEncoder implements AsyncProcessor {
     private final float maxFps;
     private final boolean downsizeOnError;
 
+    // The encoder currently running, to request key frames from other threads
+    private volatile MediaCodec runningCodec;
+    // Bit rate requested by the client (adaptive bit rate), 0 if none
+    private volatile int requestedBitRate;
+    // Capture size and frame rate requested by the client, applied on the next encoder restart
+    private volatile int requestedMaxSize;
+    private volatile int requestedMaxFps;
+    private final AtomicBoolean reconfigureRequested = new AtomicBoolean();
+
+    // To report the encoder latency to the client, null if disabled
+    private DeviceMessageSender latencySender;
+    private final LatencyHistogram captureToDequeue = new LatencyHistogram(LATENCY_MAX_SAMPLES);
+    private final LatencyHistogram dequeueToWrite = new LatencyHistogram(LATENCY_MAX_SAMPLES);
+    private long lastLatencyReportNs;
+
+    // Path of the stereo remap map, null if the frames are encoded as captured
+    private String remapMapPath;
+
+    private LatencyProfile latencyProfile = LatencyProfile.DEFAULT;
+
+    private boolean async;
+    // Skip the non-reference frames while the video socket is not writable, rather than queuing them behind stale data
+    private boolean skipWhenCongested;
+    private final AtomicLong congestionSkipped = new AtomicLong();
+    private long repeatFrameDelayUs = 100_000; // repeat after 100ms
+    // Delay effectively configured (the codec options take precedence), to detect the repeated frames
+    private long configuredRepeatDelayUs;
+    private long lastFramePts = -1;
+
+    // Streamer of the right eye, null if the frames are encoded as a whole
+    private Streamer rightStreamer;
+    private volatile MediaCodec runningRightCodec;
+    private volatile boolean rightEyeStopped;
+    // Error of the right eye encoding thread, which stops the session
+    private volatile Exception rightEyeError;
+
     private boolean firstFrameSent;
     private int consecutiveErrors;
 
@@ -59,33 +111,207 @@ public class SurfaceEncoder implements AsyncProcessor {
         this.downsizeOnError = downsizeOnError;
     }
 
+    /**
+     * Report the encoder latency periodically to the client.
+     * <p>
+     * Must be called before start().
+     */
+    public void setLatencySender(DeviceMessageSender sender) {
+        latencySender = sender;
+    }
+
+    /**
+     * Rectify the captured frames through the stereo remap map (see {@link RemapRenderer}) before encoding them.
+     * <p>
+     * Must be called before start().
+     */
+    public void setRemapMap(String path) {
+        remapMapPath = path;
+    }
+
+    /**
+     * Configure the encoder for the given latency profile (the codec options take precedence).
+     * <p>
+     * Must be called before start().
+     */
+    public void setLatencyProfile(LatencyProfile profile) {
+        latencyProfile = profile;
+    }
+
+    /**
+     * Receive the encoder output through the asynchronous callbacks (on a separate thread) rather than by polling the encoder, and write it
+     * from a bounded queue (see {@link AsyncEncoderOutput}).
+     * <p>
+     * Must be called before start().
+     */
+    public void setAsync(boolean async) {
+        this.async = async;
+    }
+
+    /**
+     * Skip the frames not referenced by other frames (see {@link NalUnits}) while the video socket is congested (see
+     * {@link Streamer#isCongested()}), instead of queuing them. The referenced frames are always written (the stream would be corrupted until
+     * the next key frame).
+     * <p>
+     * So that there are frames to skip, the encoder is requested to produce two temporal layers (every other frame is not referenced), unless
+     * the codec options set the temporal layering. This is ignored by the encoders which do not support it.
+     * <p>
+     * Must be called before start().
+     */
+    public void setSkipWhenCongested(boolean skipWhenCongested) {
+        this.skipWhenCongested = skipWhenCongested;
+    }
+
+    /**
+     * Set the delay after which the encoder repeats the previous frame if the capture produces no new frame (0 to never repeat it).
+     * <p>
+     * Must be called before start().
+     */
+    public void setRepeatFrameDelay(int delayMs) {
+        repeatFrameDelayUs = delayMs * 1000L;
+    }
+
+    /**
+     * Encode the left and right halves of the frames (the eyes) separately, on two encoder instances (possibly two hardware encoders), so that
+     * each one encodes (and the client decodes) half of the pixels. The left eye is written to the main streamer, the right eye to this one, and
+     * the video bit rate is shared equally between them.
+     * <p>
+     * Must be called before start().
+     */
+    public void setRightEyeStreamer(Streamer streamer) {
+        rightStreamer = streamer;
+    }
+
+    private int getEyeBitRate(int bitRate) {
+        return rightStreamer != null ? bitRate / 2 : bitRate;
+    }
+
+    private Size getEncodedSize(Size videoSize) {
+        if (rightStreamer == null) {
+            return videoSize;
+        }
+        return new Size(videoSize.getWidth() / 2, videoSize.getHeight());
+    }
+
     private void streamCapture() throws IOException, ConfigurationException {
         Codec codec = streamer.getCodec();
         MediaCodec mediaCodec = createMediaCodec(codec, encoderName);
-        MediaFormat format = createFormat(codec.getMimeType(), videoBitRate, maxFps, codecOptions);
+        MediaCodec rightCodec = null;
+        if (rightStreamer != null) {
+            try {
+                rightCodec = createMediaCodec(codec, encoderName);
+            } catch (IOException | ConfigurationException | RuntimeException e) {
+                mediaCodec.release();
+                throw e;
+            }
+        }
+        MediaFormat format = createFormat(mediaCodec, codec.getMimeType(), getEyeBitRate(videoBitRate), maxFps, repeatFrameDelayUs, latencyProfile,
+                codecOptions);
+        configuredRepeatDelayUs = getRepeatFrameDelay(format);
+        if (skipWhenCongested && Build.VERSION.SDK_INT >= Build.VERSION_CODES.Q && !format.containsKey(MediaFormat.KEY_TEMPORAL_LAYERING)) {
+            // Two temporal layers: the frames of the upper layer are not referenced, so they may be skipped
+            format.setString(MediaFormat.KEY_TEMPORAL_LAYERING, "android.generic.2");
+        }
+        RemapMap remapMap = remapMapPath != null ? RemapMap.load(remapMapPath) : null;
+
+        HandlerThread codecThread = null;
+        Handler codecHandler = null;
+        AsyncEncoderOutput asyncOutput = null;
+        if (async) {
+            if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.M) {
+                codecThread = new HandlerThread("video-codec");
+                codecThread.start();
+                codecHandler = new Handler(codecThread.getLooper());
+                asyncOutput = new AsyncEncoderOutput((VideoCodec) codec, ASYNC_OUTPUT_QUEUE_SIZE);
+            } else {
+                Ln.w("Asynchronous encoder output is not supported before Android 6, ignored");
+            }
+        }
 
         capture.init();
+        streamer.setBootTimePts(capture.isBootTimeClock());
+        streamer.setCaptureTimestampSource(capture::getCaptureTimestampNs);
+        streamer.setCaptureExposureSource(capture::getCaptureExposure);
+        if (rightStreamer != null) {
+            rightStreamer.setBootTimePts(capture.isBootTimeClock());
+            rightStreamer.setCaptureTimestampSource(capture::getCaptureTimestampNs);
+            rightStreamer.setCaptureExposureSource(capture::getCaptureExposure);
+        }
 
         try {
-            streamer.writeVideoHeader(capture.getSize());
+            // The remapped frames may be cropped to the valid region of the eyes
+            Size headerSize = getEncodedSize(remapMap != null ? remapMap.getSize() : capture.getSize());
+            streamer.writeVideoHeader(headerSize);
+            if (rightStreamer != null) {
+                rightStreamer.writeVideoHeader(headerSize);
+            }
 
             boolean alive;
 
             do {
+                applyReconfiguration(format, remapMap);
                 Size size = capture.getSize();
-                format.setInteger(MediaFormat.KEY_WIDTH, size.getWidth());
-                format.setInteger(MediaFormat.KEY_HEIGHT, size.getHeight());
+                Size encodedSize = getEncodedSize(remapMap != null ? remapMap.getSize() : size);
+                format.setInteger(MediaFormat.KEY_WIDTH, encodedSize.getWidth());
+                format.setInteger(MediaFormat.KEY_HEIGHT, encodedSize.getHeight());
+                int bitRate = requestedBitRate;
+                if (bitRate != 0) {
+                    // Keep the adapted bit rate when the encoder is restarted
+                    format.setInteger(MediaFormat.KEY_BIT_RATE, getEyeBitRate(bitRate));
+                }
 
                 Surface surface = null;
+                Surface rightSurface = null;
+                RemapRenderer remapRenderer = null;
+                Thread rightThread = null;
                 try {
+                    if (asyncOutput != null) {
+                        // The callback must be set before configure(), and again after reset()
+                        mediaCodec.setCallback(asyncOutput, codecHandler);
+                    }
                     mediaCodec.configure(format, null, null, MediaCodec.CONFIGURE_FLAG_ENCODE);
                     surface = mediaCodec.createInputSurface();
+                    if (rightCodec != null) {
+                        rightCodec.configure(format, null, null, MediaCodec.CONFIGURE_FLAG_ENCODE);
+                        rightSurface = rightCodec.createInputSurface();
+                    }
 
-                    capture.start(surface);
+                    if (remapMap != null && !size.equals(remapMap.getSourceSize())) {
+                        Size mapSize = remapMap.getSourceSize();
+                        Ln.e("The remap map size (" + mapSize.getWidth() + "x" + mapSize.getHeight() + ") does not match the video size ("
+                                + size.getWidth() + "x" + size.getHeight() + ")");
+                        throw new ConfigurationException("Remap map size mismatch");
+                    }
+
+                    if (rightCodec != null) {
+                        // Both eyes are rendered from the same captured frame, with the same timestamp
+                        remapRenderer = new RemapRenderer(remapMap, size, surface, rightSurface);
+                        capture.start(remapRenderer.getInputSurface());
+                    } else if (remapMap != null) {
+                        remapRenderer = new RemapRenderer(remapMap, surface);
+                        capture.start(remapRenderer.getInputSurface());
+                    } else {
+                        capture.start(surface);
+                    }
 
                     mediaCodec.start();
+                    runningCodec = mediaCodec;
+                    lastFramePts = -1;
+                    if (rightCodec != null) {
+                        rightCodec.start();
+                        runningRightCodec = rightCodec;
+                        rightThread = startRightEye(rightCodec);
+                    }
 
-                    alive = encode(mediaCodec, streamer);
+                    alive = asyncOutput != null ? encodeAsync(mediaCodec, asyncOutput) : encode(mediaCodec, streamer);
+                    runningCodec = null;
+                    if (rightThread != null) {
+                        stopRightEye(rightCodec, rightThread);
+                        rightThread = null;
+                        runningRightCodec = null;
+                        throwRightEyeError();
+                        rightCodec.stop();
+                    }
                     // do not call stop() on exception, it would trigger an IllegalStateException
                     mediaCodec.stop();
                 } catch (IllegalStateException | IllegalArgumentException e) {
@@ -96,18 +322,110 @@ public class SurfaceEncoder implements AsyncProcessor {
                     Ln.i("Retrying...");
                     alive = true;
                 } finally {
+                    runningCodec = null;
+                    runningRightCodec = null;
+                    if (rightThread != null) {
+                        stopRightEye(rightCodec, rightThread);
+                    }
                     mediaCodec.reset();
+                    if (asyncOutput != null) {
+                        // The queued buffers are invalidated by the reset
+                        long dropped = asyncOutput.reset();
+                        if (dropped > 0) {
+                            Ln.i("Encoder output: " + dropped + " non-reference frame(s) dropped");
+                        }
+                    }
+                    long skipped = congestionSkipped.getAndSet(0);
+                    if (skipped > 0) {
+                        Ln.i("Video socket congested: " + skipped + " non-reference frame(s) skipped");
+                    }
+                    if (rightCodec != null) {
+                        rightCodec.reset();
+                    }
+                    if (remapRenderer != null) {
+                        remapRenderer.release();
+                    }
                     if (surface != null) {
                         surface.release();
                     }
+                    if (rightSurface != null) {
+                        rightSurface.release();
+                    }
                 }
             } while (alive);
         } finally {
             mediaCodec.release();
+            if (rightCodec != null) {
+                rightCodec.release();
+            }
+            if (codecThread != null) {
+                codecThread.quitSafely();
+            }
             capture.release();
         }
     }
 
+    private Thread startRightEye(MediaCodec codec) {
+        rightEyeStopped = false;
+        rightEyeError = null;
+        Thread thread = new Thread(() -> {
+            try {
+                encodeRightEye(codec);
+            } catch (IOException | IllegalStateException e) {
+                rightEyeError = e;
+            }
+        }, "video-right");
+        thread.start();
+        return thread;
+    }
+
+    private void encodeRightEye(MediaCodec codec) throws IOException {
+        MediaCodec.BufferInfo bufferInfo = new MediaCodec.BufferInfo();
+        boolean eof = false;
+        // The encoder repeats the previous frame periodically, so the flag is checked even if the capture produces no new frames
+        while (!rightEyeStopped && !eof) {
+            int outputBufferId = codec.dequeueOutputBuffer(bufferInfo, -1);
+            try {
+                eof = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_END_OF_STREAM) != 0;
+                if (outputBufferId >= 0) {
+                    ByteBuffer codecBuffer = codec.getOutputBuffer(outputBufferId);
+                    if (!skipCongested(rightStreamer, codecBuffer, bufferInfo.flags)) {
+                        rightStreamer.writePacket(codecBuffer, bufferInfo);
+                    }
+                }
+            } finally {
+                if (outputBufferId >= 0) {
+                    codec.releaseOutputBuffer(outputBufferId, false);
+                }
+            }
+        }
+    }
+
+    private void stopRightEye(MediaCodec codec, Thread thread) {
+        rightEyeStopped = true;
+        try {
+            // Wake up the right eye thread immediately
+            codec.signalEndOfInputStream();
+        } catch (IllegalStateException e) {
+            // The encoder is not running, the thread is terminating anyway
+        }
+        try {
+            thread.join();
+        } catch (InterruptedException e) {
+            Thread.currentThread().interrupt();
+        }
+    }
+
+    private void throwRightEyeError() throws IOException {
+        Exception e = rightEyeError;
+        if (e instanceof IOException) {
+            throw (IOException) e;
+        }
+        if (e instanceof IllegalStateException) {
+            throw (IllegalStateException) e;
+        }
+    }
+
     private boolean prepareRetry(Size currentSize) {
         if (firstFrameSent) {
             ++consecutiveErrors;
@@ -144,6 +462,93 @@ public class SurfaceEncoder implements AsyncProcessor {
         return true;
     }
 
+    public void requestKeyFrame() {
+        // The client does not know which eye needs a key frame (if the eyes are encoded separately)
+        requestKeyFrame(runningCodec);
+        requestKeyFrame(runningRightCodec);
+    }
+
+    private static void requestKeyFrame(MediaCodec codec) {
+        if (codec == null) {
+            // The encoder is (re)starting, it will produce a key frame anyway
+            return;
+        }
+
+        Bundle params = new Bundle();
+        params.putInt(MediaCodec.PARAMETER_KEY_REQUEST_SYNC_FRAME, 0);
+        try {
+            codec.setParameters(params);
+            Ln.d("Key frame requested");
+        } catch (IllegalStateException e) {
+            // The encoder has just been stopped, it will produce a key frame on restart
+        }
+    }
+
+    public void setBitRate(int bitRate) {
+        requestedBitRate = bitRate;
+
+        // The encoders are (re)starting if they are not running, they will be configured with the requested bit rate
+        setBitRate(runningCodec, getEyeBitRate(bitRate));
+        setBitRate(runningRightCodec, getEyeBitRate(bitRate));
+    }
+
+    /**
+     * Restart the encoder with another maximum capture size and frame rate (0 for unlimited), as on a device rotation, so that the session
+     * continues after a new key frame.
+     */
+    public void reconfigure(int maxSize, int maxFps) {
+        requestedMaxSize = maxSize;
+        requestedMaxFps = maxFps;
+        reconfigureRequested.set(true);
+    }
+
+    // Indicate if the encoder must be restarted, on a capture change or on a reconfiguration (consumed on restart)
+    private boolean consumeReset() {
+        boolean reset = capture.consumeReset();
+        return reconfigureRequested.get() || reset;
+    }
+
+    private void applyReconfiguration(MediaFormat format, RemapMap remapMap) {
+        if (!reconfigureRequested.getAndSet(false)) {
+            return;
+        }
+
+        int maxSize = requestedMaxSize & ~7; // multiple of 8
+        int maxFps = requestedMaxFps;
+
+        if (remapMap != null) {
+            // The remap map applies to the current capture size only
+            Ln.w("Video size not changed, the frames are remapped");
+        } else if (!capture.setMaxSize(maxSize)) {
+            Ln.w("Video size not changed, not supported by the capture");
+        }
+
+        if (maxFps > 0) {
+            format.setFloat(KEY_MAX_FPS_TO_ENCODER, maxFps);
+        } else if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.Q) {
+            format.removeKey(KEY_MAX_FPS_TO_ENCODER);
+        } else if (format.containsKey(KEY_MAX_FPS_TO_ENCODER)) {
+            Ln.w("Max fps not removed before Android 10");
+        }
+
+        Ln.i("Video reconfigured: max size " + maxSize + ", max fps " + maxFps);
+    }
+
+    private static void setBitRate(MediaCodec codec, int bitRate) {
+        if (codec == null) {
+            return;
+        }
+
+        Bundle params = new Bundle();
+        params.putInt(MediaCodec.PARAMETER_KEY_VIDEO_BITRATE, bitRate);
+        try {
+            codec.setParameters(params);
+            Ln.d("Video bit rate set to " + bitRate);
+        } catch (IllegalStateException e) {
+            // The encoder has just been stopped, it will be configured with the requested bit rate on restart
+        }
+    }
+
     private static int chooseMaxSizeFallback(Size failedSize) {
         int currentMaxSize = Math.max(failedSize.getWidth(), failedSize.getHeight());
         for (int value : MAX_SIZE_FALLBACK) {
@@ -161,14 +566,19 @@ public class SurfaceEncoder implements AsyncProcessor {
         boolean alive = true;
         MediaCodec.BufferInfo bufferInfo = new MediaCodec.BufferInfo();
 
-        while (!capture.consumeReset() && !eof) {
+        while (!consumeReset() && !eof) {
             if (stopped.get()) {
                 alive = false;
                 break;
             }
+            if (rightEyeError != null) {
+                // Rethrown by the caller
+                break;
+            }
             int outputBufferId = codec.dequeueOutputBuffer(bufferInfo, -1);
+            long dequeueNs = latencySender != null ? System.nanoTime() : 0;
             try {
-                if (capture.consumeReset()) {
+                if (consumeReset()) {
                     // must restart encoding with new size
                     break;
                 }
@@ -184,7 +594,14 @@ public class SurfaceEncoder implements AsyncProcessor {
                         consecutiveErrors = 0;
                     }
 
-                    streamer.writePacket(codecBuffer, bufferInfo);
+                    boolean repeated = !isConfig && isRepeatedFrame(bufferInfo.presentationTimeUs);
+                    if (!skipCongested(streamer, codecBuffer, bufferInfo.flags)) {
+                        streamer.writePacket(codecBuffer, bufferInfo, repeated);
+
+                        if (latencySender != null && !isConfig) {
+                            recordLatency(bufferInfo.presentationTimeUs, dequeueNs);
+                        }
+                    }
                 }
             } finally {
                 if (outputBufferId >= 0) {
@@ -201,6 +618,119 @@ public class SurfaceEncoder implements AsyncProcessor {
         return !eof && alive;
     }
 
+    private boolean encodeAsync(MediaCodec codec, AsyncEncoderOutput output) throws IOException {
+        boolean eof = false;
+        boolean alive = true;
+
+        while (!consumeReset() && !eof) {
+            if (stopped.get()) {
+                alive = false;
+                break;
+            }
+
+            AsyncEncoderOutput.Buffer buffer;
+            try {
+                buffer = output.take(ASYNC_OUTPUT_POLL_MS);
+            } catch (InterruptedException e) {
+                Thread.currentThread().interrupt();
+                alive = false;
+                break;
+            }
+            if (buffer == null) {
+                // Timeout, check the stop and reset requests
+                continue;
+            }
+
+            MediaCodec.BufferInfo bufferInfo = buffer.getInfo();
+            try {
+                eof = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_END_OF_STREAM) != 0;
+                // Written directly from the codec buffer, released once written
+                ByteBuffer codecBuffer = codec.getOutputBuffer(buffer.getIndex());
+
+                boolean isConfig = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_CODEC_CONFIG) != 0;
+                if (!isConfig) {
+                    // If this is not a config packet, then it contains a frame
+                    firstFrameSent = true;
+                    consecutiveErrors = 0;
+                }
+
+                boolean repeated = !isConfig && isRepeatedFrame(bufferInfo.presentationTimeUs);
+                if (skipWhenCongested && buffer.isDroppable() && streamer.isCongested()) {
+                    // Already parsed by the output callback
+                    congestionSkipped.incrementAndGet();
+                } else {
+                    streamer.writePacket(codecBuffer, bufferInfo, repeated);
+
+                    if (latencySender != null && !isConfig) {
+                        recordLatency(bufferInfo.presentationTimeUs, buffer.getReceivedNs());
+                    }
+                }
+            } finally {
+                codec.releaseOutputBuffer(buffer.getIndex(), false);
+            }
+        }
+
+        if (capture.isClosed()) {
+            // The capture might have been closed internally (for example if the camera is disconnected)
+            alive = false;
+        }
+
+        return !eof && alive;
+    }
+
+    // Indicate if the frame is skipped because the socket is congested (see setSkipWhenCongested())
+    private boolean skipCongested(Streamer streamer, ByteBuffer codecBuffer, int flags) {
+        if (!skipWhenCongested) {
+            return false;
+        }
+        int noSkipFlags = MediaCodec.BUFFER_FLAG_CODEC_CONFIG | MediaCodec.BUFFER_FLAG_KEY_FRAME | MediaCodec.BUFFER_FLAG_END_OF_STREAM;
+        if ((flags & noSkipFlags) != 0 || !NalUnits.isNonReference((VideoCodec) streamer.getCodec(), codecBuffer)) {
+            return false;
+        }
+        if (!streamer.isCongested()) {
+            return false;
+        }
+        congestionSkipped.incrementAndGet();
+        return true;
+    }
+
+    private static long getRepeatFrameDelay(MediaFormat format) {
+        if (!format.containsKey(MediaFormat.KEY_REPEAT_PREVIOUS_FRAME_AFTER)) {
+            return 0;
+        }
+        try {
+            return format.getLong(MediaFormat.KEY_REPEAT_PREVIOUS_FRAME_AFTER);
+        } catch (ClassCastException e) {
+            // Set by the codec options with another type than long, ignored by the encoder
+            return 0;
+        }
+    }
+
+    private boolean isRepeatedFrame(long pts) {
+        // When the input surface produces no new frame, the encoder resubmits the latest one with its timestamp incremented by exactly the repeat
+        // delay (and so on for the next repetitions), whereas the timestamps of the captured frames are arbitrary
+        boolean repeated = configuredRepeatDelayUs > 0 && lastFramePts >= 0 && pts - lastFramePts == configuredRepeatDelayUs;
+        lastFramePts = pts;
+        return repeated;
+    }
+
+    private void recordLatency(long pts, long dequeueNs) {
+        long writtenNs = System.nanoTime();
+        captureToDequeue.add((dequeueNs - streamer.getCaptureTimestampNs(pts)) / 1000);
+        dequeueToWrite.add((writtenNs - dequeueNs) / 1000);
+
+        if (lastLatencyReportNs == 0) {
+            lastLatencyReportNs = writtenNs;
+        } else if (writtenNs - lastLatencyReportNs >= LATENCY_REPORT_INTERVAL_NS) {
+            DeviceMessage msg = DeviceMessage.createEncoderLatency(captureToDequeue.getCount(), captureToDequeue.summarize(),
+                    dequeueToWrite.summarize());
+            latencySender.send(msg);
+            captureToDequeue.reset();
+            dequeueToWrite.reset();
+            lastLatencyReportNs = writtenNs;
+        }
+    }
+
     private static MediaCodec createMediaCodec(Codec codec, String encoderName) throws IOException, ConfigurationException {
         if (encoderName != null) {
             Ln.d("Creating encoder by name: '" + encoderName + "'");
@@ -215,6 +745,18 @@ public class SurfaceEncoder implements AsyncProcessor {
             }
         }
 
+        // The fastest encoder measured by --probe-encoders, if any
+        String probedEncoderName = EncoderProbe.findFastestEncoder((VideoCodec) codec);
+        if (probedEncoderName != null) {
+            try {
+                MediaCodec mediaCodec = MediaCodec.createByCodecName(probedEncoderName);
+                Ln.i("Using the fastest probed video encoder: '" + probedEncoderName + "'");
+                return mediaCodec;
+            } catch (IOException | IllegalArgumentException e) {
+                Ln.w("Could not create the probed video encoder '" + probedEncoderName + "', using the default one");
+            }
+        }
+
         try {
             MediaCodec mediaCodec = MediaCodec.createEncoderByType(codec.getMimeType());
             Ln.d("Using video encoder: '" + mediaCodec.getName() + "'");
@@ -225,7 +767,8 @@ public class SurfaceEncoder implements AsyncProcessor {
         }
     }
 
-    private static MediaFormat createFormat(String videoMimeType, int bitRate, float maxFps, List<CodecOption> codecOptions) {
+    static MediaFormat createFormat(MediaCodec mediaCodec, String videoMimeType, int bitRate, float maxFps, long repeatFrameDelayUs,
+            LatencyProfile latencyProfile, List<CodecOption> codecOptions) {
         MediaFormat format = new MediaFormat();
         format.setString(MediaFormat.KEY_MIME, videoMimeType);
         format.setInteger(MediaFormat.KEY_BIT_RATE, bitRate);
@@ -236,8 +779,10 @@ public class SurfaceEncoder implements AsyncProcessor {
             format.setInteger(MediaFormat.KEY_COLOR_RANGE, MediaFormat.COLOR_RANGE_LIMITED);
         }
         format.setInteger(MediaFormat.KEY_I_FRAME_INTERVAL, DEFAULT_I_FRAME_INTERVAL);
-        // display the very first frame, and recover from bad quality when no new frames
-        format.setLong(MediaFormat.KEY_REPEAT_PREVIOUS_FRAME_AFTER, REPEAT_FRAME_DELAY_US); // µs
+        if (repeatFrameDelayUs > 0) {
+            // display the very first frame, and recover from bad quality when no new frames
+            format.setLong(MediaFormat.KEY_REPEAT_PREVIOUS_FRAME_AFTER, repeatFrameDelayUs); // µs
+        }
         if (maxFps > 0) {
             // The key existed privately before Android 10:
             // <https://android.googlesource.com/platform/frameworks/base/+/625f0aad9f7a259b6881006ad8710adce57d1384%5E%21/>
@@ -245,6 +790,10 @@ public class SurfaceEncoder implements AsyncProcessor {
             format.setFloat(KEY_MAX_FPS_TO_ENCODER, maxFps);
         }
 
+        if (latencyProfile == LatencyProfile.ULTRA_LOW) {
+            configureUltraLowLatency(format, mediaCodec, videoMimeType);
+        }
+
         if (codecOptions != null) {
             for (CodecOption option : codecOptions) {
                 String key = option.getKey();
@@ -257,6 +806,34 @@ public class SurfaceEncoder implements AsyncProcessor {
         return format;
     }
 
+    private static void configureUltraLowLatency(MediaFormat format, MediaCodec mediaCodec, String videoMimeType) {
+        if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.M) {
+            // Realtime
+            format.setInteger(MediaFormat.KEY_PRIORITY, 0);
+        }
+        if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.Q) {
+            // B-frames delay the output of the frames they depend on
+            format.setInteger(MediaFormat.KEY_MAX_B_FRAMES, 0);
+        }
+        if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.R) {
+            // Output each frame as soon as it is encoded
+            format.setInteger(MediaFormat.KEY_LATENCY, 1);
+        }
+
+        // A negative I-frame interval (no key frame except the first one and the requested ones) is supported since Android 7.1
+        if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.N_MR1) {
+            MediaCodecInfo.CodecCapabilities capabilities = mediaCodec.getCodecInfo().getCapabilitiesForType(videoMimeType);
+            if (capabilities.isFeatureSupported(MediaCodecInfo.CodecCapabilities.FEATURE_IntraRefresh)) {
+                // Refresh the picture progressively, without the bit rate spikes of the periodic key frames
+                format.setInteger(MediaFormat.KEY_INTRA_REFRESH_PERIOD, INTRA_REFRESH_PERIOD);
+                format.setInteger(MediaFormat.KEY_I_FRAME_INTERVAL, -1);
+                Ln.d("Video encoder intra refresh enabled (period " + INTRA_REFRESH_PERIOD + " frames)");
+            } else {
+                Ln.w("The video encoder does not support intra refresh, periodic key frames are kept");
+            }
+        }
+    }
+
     @Override
     public void start(TerminationListener listener) {
         thread = new Thread(() -> {
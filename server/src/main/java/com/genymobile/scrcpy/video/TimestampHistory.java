@@ -0,0 +1,46 @@
+package com.genymobile.scrcpy.video;
+
+/**
+ * History of the exact (nanosecond) timestamps of the last captured frames, to retrieve them from the PTS of the encoded frames (the timestamps
+ * of the input surface frames, truncated to microseconds by MediaCodec).
+ * <p>
+ * The timestamps are added by the capture thread, and retrieved by the encoding thread.
+ */
+public final class TimestampHistory {
+
+    private final long[] timestamps;
+    private int head; // index of the next timestamp to write
+
+    public TimestampHistory(int capacity) {
+        timestamps = new long[capacity];
+    }
+
+    public synchronized void add(long timestampNs) {
+        timestamps[head] = timestampNs;
+        head = (head + 1) % timestamps.length;
+    }
+
+    /**
+     * Find the timestamp matching the given PTS.
+     *
+     * @param ptsUs the PTS of the encoded frame
+     * @return the timestamp in nanoseconds, or 0 if not found (too old, or not received yet)
+     */
+    public synchronized long find(long ptsUs) {
+        // Most recent first: the encoder is at most a few frames late
+        for (int i = 1; i <= timestamps.length; ++i) {
+            long ns = timestamps[(head - i + timestamps.length) % timestamps.length];
+            if (ns != 0 && ns / 1000 == ptsUs) {
+                return ns;
+            }
+        }
+        return 0;
+    }
+
+    public synchronized void clear() {
+        for (int i = 0; i < timestamps.length; ++i) {
+            timestamps[i] = 0;
+        }
+        head = 0;
+    }
+}
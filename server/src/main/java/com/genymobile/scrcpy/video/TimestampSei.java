@@ -0,0 +1,97 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.util.Codec;
+
+/**
+ * Capture timestamp of a frame, embedded in the H.264 or H.265 bitstream as a "user data unregistered" SEI NAL unit.
+ * <p>
+ * The NAL unit (in Annex B format, with its start code) is inserted before the frame data, so that the timestamp survives in any tool which
+ * only sees the bitstream (recordings, raw streams, third-party decoders). Its payload is:
+ * <pre>
+ *     UUID (16 bytes) | clock domain (1 byte) | capture timestamp in ns (8 bytes) | sequence number (4 bytes)
+ * </pre>
+ * with the integers in big-endian.
+ */
+public final class TimestampSei {
+
+    // "scrcpy-timestamp" in ASCII (no zero byte, so it is never escaped)
+    public static final byte[] UUID = {
+            0x73, 0x63, 0x72, 0x63, 0x70, 0x79, 0x2d, 0x74, 0x69, 0x6d, 0x65, 0x73, 0x74, 0x61, 0x6d, 0x70,
+    };
+
+    private static final int PAYLOAD_TYPE_USER_DATA_UNREGISTERED = 5;
+    private static final int PAYLOAD_SIZE = 29;
+
+    // Start code (4), NAL header (2), payload type and size (2), payload and RBSP trailing bits (30), plus the emulation prevention bytes (at
+    // most 1 per 2 escaped bytes after the UUID)
+    public static final int MAX_SIZE = 64;
+
+    // Payload type and size, payload and RBSP trailing bits
+    private static final int RBSP_SIZE = 2 + PAYLOAD_SIZE + 1;
+    private static final int RBSP_OFFSET = MAX_SIZE - RBSP_SIZE;
+
+    private TimestampSei() {
+        // not instantiable
+    }
+
+    public static boolean isSupported(Codec codec) {
+        return codec == VideoCodec.H264 || codec == VideoCodec.H265;
+    }
+
+    /**
+     * Write the SEI NAL unit.
+     *
+     * @param codec the video codec (H.264 or H.265)
+     * @param clockDomain the clock domain of the capture timestamp
+     * @param captureNs the capture timestamp
+     * @param sequence the sequence number of the frame
+     * @param dst the destination, of at least {@link #MAX_SIZE} bytes
+     * @return the number of bytes written
+     */
+    public static int write(Codec codec, int clockDomain, long captureNs, int sequence, byte[] dst) {
+        assert isSupported(codec);
+        assert dst.length >= MAX_SIZE;
+
+        int i = 0;
+        dst[i++] = 0;
+        dst[i++] = 0;
+        dst[i++] = 0;
+        dst[i++] = 1;
+        if (codec == VideoCodec.H264) {
+            dst[i++] = 0x06; // nal_unit_type 6 (SEI)
+        } else {
+            dst[i++] = 0x4e; // nal_unit_type 39 (PREFIX_SEI_NUT)
+            dst[i++] = 0x01; // nuh_temporal_id_plus1
+        }
+
+        // The RBSP is first written unescaped at the end of dst, then moved forward while escaped (the write position never catches up with the
+        // read position, since at most 1 byte is inserted per 2 bytes read), so that nothing is allocated for each frame
+        int r = RBSP_OFFSET;
+        dst[r++] = PAYLOAD_TYPE_USER_DATA_UNREGISTERED;
+        dst[r++] = PAYLOAD_SIZE;
+        System.arraycopy(UUID, 0, dst, r, UUID.length);
+        r += UUID.length;
+        dst[r++] = (byte) clockDomain;
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            dst[r++] = (byte) (captureNs >> shift);
+        }
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            dst[r++] = (byte) (sequence >> shift);
+        }
+        dst[r++] = (byte) 0x80; // rbsp_trailing_bits
+
+        // Emulation prevention: no 0x000000, 0x000001, 0x000002 or 0x000003 may appear in the NAL unit
+        int zeros = 0;
+        for (int j = RBSP_OFFSET; j < r; ++j) {
+            byte b = dst[j];
+            if (zeros >= 2 && (b & 0xff) <= 3) {
+                dst[i++] = 3;
+                zeros = 0;
+            }
+            dst[i++] = b;
+            zeros = b == 0 ? zeros + 1 : 0;
+        }
+
+        return i;
+    }
+}
@@ -0,0 +1,89 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.util.CodecUtils;
+import com.genymobile.scrcpy.util.Ln;
+
+import android.annotation.TargetApi;
+import android.media.MediaCodecInfo;
+import android.os.Build;
+
+import java.util.List;
+import java.util.Locale;
+
+/**
+ * Selection of the video codec among those the client decodes fast enough (--video-codec=auto), given in its order of preference (the
+ * most efficient first).
+ * <p>
+ * The first codec the device can encode at the requested frame rate is used: according to the results of --probe-encoders if its
+ * encoders were probed, otherwise if it has a hardware encoder. If none does, the first codec having an encoder is used (H.264 if none).
+ */
+public final class VideoCodecSelector {
+
+    // The frame rate to sustain if not limited by --max-fps
+    private static final float DEFAULT_FPS = 60;
+
+    private VideoCodecSelector() {
+        // not instantiable
+    }
+
+    public static VideoCodec select(List<VideoCodec> candidates, float maxFps) {
+        float fps = maxFps > 0 ? maxFps : DEFAULT_FPS;
+        List<CodecUtils.DeviceEncoder> encoders = CodecUtils.listVideoEncoders();
+
+        VideoCodec fallback = null;
+        for (VideoCodec codec : candidates) {
+            boolean hasEncoder = false;
+            boolean hasHardwareEncoder = false;
+            for (CodecUtils.DeviceEncoder encoder : encoders) {
+                if (encoder.getCodec() == codec) {
+                    hasEncoder = true;
+                    hasHardwareEncoder |= isHardwareAccelerated(encoder.getInfo());
+                }
+            }
+
+            if (!hasEncoder) {
+                Ln.d("Video codec " + codec.getName() + ": no encoder");
+                continue;
+            }
+
+            EncoderProbe.Result probed = EncoderProbe.findFastest(codec);
+            if (probed != null) {
+                if (probed.getFps() >= fps) {
+                    Ln.i(String.format(Locale.US, "Video codec selected: %s (probed encoder '%s' at %.1f fps)", codec.getName(),
+                            probed.getEncoderName(), probed.getFps()));
+                    return codec;
+                }
+                Ln.d(String.format(Locale.US, "Video codec %s: probed encoders too slow (%.1f fps)", codec.getName(), probed.getFps()));
+            } else if (hasHardwareEncoder) {
+                Ln.i("Video codec selected: " + codec.getName() + " (hardware encoder)");
+                return codec;
+            } else {
+                Ln.d("Video codec " + codec.getName() + ": software encoders only");
+            }
+
+            if (fallback == null) {
+                fallback = codec;
+            }
+        }
+
+        if (fallback == null) {
+            fallback = VideoCodec.H264;
+        }
+        Ln.i("Video codec selected: " + fallback.getName() + " (fallback)");
+        return fallback;
+    }
+
+    private static boolean isHardwareAccelerated(MediaCodecInfo info) {
+        if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.Q) {
+            return isHardwareAcceleratedQ(info);
+        }
+        // Before Android 10, the software codecs are the ones of the platform
+        String name = info.getName().toLowerCase(Locale.ENGLISH);
+        return !name.startsWith("omx.google.") && !name.startsWith("c2.android.");
+    }
+
+    @TargetApi(Build.VERSION_CODES.Q)
+    private static boolean isHardwareAcceleratedQ(MediaCodecInfo info) {
+        return info.isHardwareAccelerated();
+    }
+}
@@ -0,0 +1,33 @@
+package com.genymobile.scrcpy.audio;
+
+import org.junit.Assert;
+import org.junit.Test;
+
+public class AudioConfigTest {
+
+    private static final int BYTES_PER_FRAME = AudioConfig.CHANNELS * AudioConfig.BYTES_PER_SAMPLE;
+
+    @Test
+    public void testDefaultReadSize() {
+        Assert.assertEquals(960 * BYTES_PER_FRAME, AudioConfig.getReadSize(AudioCodec.OPUS, 0, false));
+        Assert.assertEquals(1024 * BYTES_PER_FRAME, AudioConfig.getReadSize(AudioCodec.AAC, 0, false));
+        Assert.assertEquals(1024 * BYTES_PER_FRAME, AudioConfig.getReadSize(AudioCodec.FLAC, 0, false));
+        Assert.assertEquals(1024 * BYTES_PER_FRAME, AudioConfig.getReadSize(AudioCodec.RAW, 0, false));
+    }
+
+    @Test
+    public void testReadSizeAlignedToEncoderFrame() {
+        Assert.assertEquals(1920 * BYTES_PER_FRAME, AudioConfig.getReadSize(AudioCodec.OPUS, 961, false));
+        Assert.assertEquals(2880 * BYTES_PER_FRAME, AudioConfig.getReadSize(AudioCodec.OPUS, 2048, false));
+        Assert.assertEquals(2048 * BYTES_PER_FRAME, AudioConfig.getReadSize(AudioCodec.AAC, 2048, false));
+        Assert.assertEquals(3072 * BYTES_PER_FRAME, AudioConfig.getReadSize(AudioCodec.AAC, 2049, false));
+        Assert.assertEquals(100 * BYTES_PER_FRAME, AudioConfig.getReadSize(AudioCodec.RAW, 100, false));
+    }
+
+    @Test
+    public void testLowLatencyReadSize() {
+        Assert.assertEquals(480 * BYTES_PER_FRAME, AudioConfig.getReadSize(AudioCodec.RAW, 0, true));
+        Assert.assertEquals(960 * BYTES_PER_FRAME, AudioConfig.getReadSize(AudioCodec.OPUS, 0, true));
+        Assert.assertEquals(1024 * BYTES_PER_FRAME, AudioConfig.getReadSize(AudioCodec.RAW, 1024, true));
+    }
+}
@@ -255,6 +255,48 @@ public class ControlMessageReaderTest {
         Assert.assertEquals(-1, bis.read()); // EOS
     }
 
+    @Test
+    public void testParseChunkedSetClipboardEvent() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+
+        // The chunks split the UTF-8 sequence of 'é' (0xc3 0xa9)
+        byte[] text = "testé!".getBytes(StandardCharsets.UTF_8);
+        dos.writeByte(ControlMessage.TYPE_SET_CLIPBOARD_CHUNK);
+        dos.writeInt(3);
+        dos.write(text, 0, 3);
+        dos.writeByte(ControlMessage.TYPE_SET_CLIPBOARD_CHUNK);
+        dos.writeInt(2);
+        dos.write(text, 3, 2);
+        dos.writeByte(ControlMessage.TYPE_SET_CLIPBOARD);
+        dos.writeLong(0x0102030405060708L); // sequence
+        dos.writeByte(0); // paste
+        dos.writeInt(text.length - 5);
+        dos.write(text, 5, text.length - 5);
+
+        // A following clipboard text must not contain the previous chunks
+        dos.writeByte(ControlMessage.TYPE_SET_CLIPBOARD);
+        dos.writeLong(0); // sequence
+        dos.writeByte(0); // paste
+        dos.writeInt(1);
+        dos.writeByte('x');
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_SET_CLIPBOARD, event.getType());
+        Assert.assertEquals(0x0102030405060708L, event.getSequence());
+        Assert.assertEquals("testé!", event.getText());
+        Assert.assertFalse(event.getPaste());
+
+        event = reader.read();
+        Assert.assertEquals("x", event.getText());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
     @Test
     public void testParseBigSetClipboardEvent() throws IOException {
         ByteArrayOutputStream bos = new ByteArrayOutputStream();
@@ -383,6 +425,42 @@ public class ControlMessageReaderTest {
         Assert.assertEquals(-1, bis.read()); // EOS
     }
 
+    @Test
+    public void testParseClockSync() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_CLOCK_SYNC);
+        dos.writeLong(0x0102030405060708L); // client time
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_CLOCK_SYNC, event.getType());
+        Assert.assertEquals(0x0102030405060708L, event.getClientTime());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseTimePing() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_TIME_PING);
+        dos.writeLong(0x0102030405060708L); // client time
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_TIME_PING, event.getType());
+        Assert.assertEquals(0x0102030405060708L, event.getClientTime());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
     @Test
     public void testParseOpenHardKeyboardSettings() throws IOException {
         ByteArrayOutputStream bos = new ByteArrayOutputStream();
@@ -399,6 +477,60 @@ public class ControlMessageReaderTest {
         Assert.assertEquals(-1, bis.read()); // EOS
     }
 
+    @Test
+    public void testParseRequestKeyFrame() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_REQUEST_KEY_FRAME);
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_REQUEST_KEY_FRAME, event.getType());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseSetVideoBitRate() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_SET_VIDEO_BIT_RATE);
+        dos.writeInt(4_000_000);
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_SET_VIDEO_BIT_RATE, event.getType());
+        Assert.assertEquals(4_000_000, event.getBitRate());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseReconfigureVideo() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_RECONFIGURE_VIDEO);
+        dos.writeShort(1920);
+        dos.writeShort(90);
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_RECONFIGURE_VIDEO, event.getType());
+        Assert.assertEquals(1920, event.getMaxSize());
+        Assert.assertEquals(90, event.getMaxFps());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
     @Test
     public void testMultiEvents() throws IOException {
         ByteArrayOutputStream bos = new ByteArrayOutputStream();
@@ -438,6 +570,37 @@ public class ControlMessageReaderTest {
         Assert.assertEquals(-1, bis.read()); // EOS
     }
 
+    @Test
+    public void testReadBatch() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+
+        for (int i = 0; i < 3; ++i) {
+            dos.writeByte(ControlMessage.TYPE_INJECT_KEYCODE);
+            dos.writeByte(KeyEvent.ACTION_DOWN);
+            dos.writeInt(KeyEvent.KEYCODE_0 + i);
+            dos.writeInt(0); // repeat
+            dos.writeInt(0); // metaState
+        }
+
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage[] batch = new ControlMessage[2];
+        int count = reader.readBatch(batch);
+        Assert.assertEquals(2, count); // limited by the batch size
+        Assert.assertEquals(KeyEvent.KEYCODE_0, batch[0].getKeycode());
+        Assert.assertEquals(KeyEvent.KEYCODE_1, batch[1].getKeycode());
+
+        count = reader.readBatch(batch);
+        Assert.assertEquals(1, count); // no more data available
+        Assert.assertEquals(KeyEvent.KEYCODE_2, batch[0].getKeycode());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
     @Test
     public void testPartialEvents() throws IOException {
         ByteArrayOutputStream bos = new ByteArrayOutputStream();
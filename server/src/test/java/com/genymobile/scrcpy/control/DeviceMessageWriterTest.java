@@ -72,4 +72,106 @@ public class DeviceMessageWriterTest {
 
         Assert.assertArrayEquals(expected, actual);
     }
+
+    @Test
+    public void testSerializeClockSync() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(DeviceMessage.TYPE_CLOCK_SYNC);
+        dos.writeLong(0x0102030405060708L); // client time
+        dos.writeLong(123456); // receive time
+        dos.writeLong(123457); // send time
+        byte[] expected = bos.toByteArray();
+
+        bos = new ByteArrayOutputStream();
+        DeviceMessageWriter writer = new DeviceMessageWriter(bos);
+
+        DeviceMessage msg = DeviceMessage.createClockSync(0x0102030405060708L, 123456, 123457);
+        writer.write(msg);
+
+        byte[] actual = bos.toByteArray();
+
+        Assert.assertArrayEquals(expected, actual);
+    }
+
+    @Test
+    public void testSerializeTimePong() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(DeviceMessage.TYPE_TIME_PONG);
+        dos.writeLong(0x0102030405060708L); // client time
+        dos.writeLong(123456); // receive time
+        dos.writeLong(123457); // send time
+        dos.writeLong(1_700_000_000_000_000L); // receive wall time
+        dos.writeLong(1_700_000_000_001_000L); // send wall time
+        byte[] expected = bos.toByteArray();
+
+        bos = new ByteArrayOutputStream();
+        DeviceMessageWriter writer = new DeviceMessageWriter(bos);
+
+        DeviceMessage msg = DeviceMessage.createTimePong(0x0102030405060708L, 123456, 123457, 1_700_000_000_000_000L, 1_700_000_000_001_000L);
+        writer.write(msg);
+
+        byte[] actual = bos.toByteArray();
+
+        Assert.assertArrayEquals(expected, actual);
+    }
+
+    @Test
+    public void testSerializePose() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(DeviceMessage.TYPE_POSE);
+        dos.writeLong(123456); // pts
+        dos.writeByte(1); // has position
+        dos.writeFloat(0.5f); // rotation x
+        dos.writeFloat(-0.5f); // rotation y
+        dos.writeFloat(0.5f); // rotation z
+        dos.writeFloat(0.5f); // rotation w
+        dos.writeFloat(0.25f); // translation x
+        dos.writeFloat(1.5f); // translation y
+        dos.writeFloat(-2f); // translation z
+        byte[] expected = bos.toByteArray();
+
+        bos = new ByteArrayOutputStream();
+        DeviceMessageWriter writer = new DeviceMessageWriter(bos);
+
+        float[] rotation = {0.5f, -0.5f, 0.5f, 0.5f};
+        float[] translation = {0.25f, 1.5f, -2f};
+        DeviceMessage msg = DeviceMessage.createPose(123456, true, rotation, translation);
+        writer.write(msg);
+
+        byte[] actual = bos.toByteArray();
+
+        Assert.assertArrayEquals(expected, actual);
+    }
+
+    @Test
+    public void testSerializeEncoderLatency() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(DeviceMessage.TYPE_ENCODER_LATENCY);
+        dos.writeInt(60); // frame count
+        dos.writeInt(8000); // capture to dequeue p50
+        dos.writeInt(9000); // capture to dequeue p95
+        dos.writeInt(12000); // capture to dequeue p99
+        dos.writeInt(15000); // capture to dequeue max
+        dos.writeInt(100); // dequeue to write p50
+        dos.writeInt(200); // dequeue to write p95
+        dos.writeInt(300); // dequeue to write p99
+        dos.writeInt(400); // dequeue to write max
+        byte[] expected = bos.toByteArray();
+
+        bos = new ByteArrayOutputStream();
+        DeviceMessageWriter writer = new DeviceMessageWriter(bos);
+
+        int[] captureToDequeue = {8000, 9000, 12000, 15000};
+        int[] dequeueToWrite = {100, 200, 300, 400};
+        DeviceMessage msg = DeviceMessage.createEncoderLatency(60, captureToDequeue, dequeueToWrite);
+        writer.write(msg);
+
+        byte[] actual = bos.toByteArray();
+
+        Assert.assertArrayEquals(expected, actual);
+    }
 }
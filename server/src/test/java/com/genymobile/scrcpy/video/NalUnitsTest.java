@@ -0,0 +1,57 @@
+package com.genymobile.scrcpy.video;
+
+import org.junit.Assert;
+import org.junit.Test;
+
+import java.nio.ByteBuffer;
+
+public class NalUnitsTest {
+
+    private static ByteBuffer wrap(int... bytes) {
+        ByteBuffer buffer = ByteBuffer.allocate(bytes.length);
+        for (int b : bytes) {
+            buffer.put((byte) b);
+        }
+        buffer.flip();
+        return buffer;
+    }
+
+    @Test
+    public void testH264() {
+        // Non-IDR slice, nal_ref_idc = 0
+        Assert.assertTrue(NalUnits.isNonReference(VideoCodec.H264, wrap(0, 0, 0, 1, 0x01, 0x88)));
+        // Non-IDR slice, nal_ref_idc = 2
+        Assert.assertFalse(NalUnits.isNonReference(VideoCodec.H264, wrap(0, 0, 0, 1, 0x41, 0x9a)));
+        // IDR slice
+        Assert.assertFalse(NalUnits.isNonReference(VideoCodec.H264, wrap(0, 0, 0, 1, 0x65, 0x88)));
+        // SEI (3-byte start code) before a non-reference slice
+        Assert.assertTrue(NalUnits.isNonReference(VideoCodec.H264, wrap(0, 0, 1, 0x06, 0x05, 0x01, 0x80, 0, 0, 1, 0x01, 0x88)));
+        // No slice
+        Assert.assertFalse(NalUnits.isNonReference(VideoCodec.H264, wrap(0, 0, 0, 1, 0x06, 0x05)));
+    }
+
+    @Test
+    public void testH264Position() {
+        ByteBuffer buffer = wrap(0, 0, 0, 1, 0x41, 0x9a, 0, 0, 0, 1, 0x01, 0x88);
+        buffer.position(6);
+        Assert.assertTrue(NalUnits.isNonReference(VideoCodec.H264, buffer));
+        Assert.assertEquals(6, buffer.position());
+    }
+
+    @Test
+    public void testH265() {
+        // TRAIL_N
+        Assert.assertTrue(NalUnits.isNonReference(VideoCodec.H265, wrap(0, 0, 0, 1, 0x00, 0x01, 0xaf)));
+        // TRAIL_R
+        Assert.assertFalse(NalUnits.isNonReference(VideoCodec.H265, wrap(0, 0, 0, 1, 0x02, 0x01, 0xaf)));
+        // IDR_W_RADL
+        Assert.assertFalse(NalUnits.isNonReference(VideoCodec.H265, wrap(0, 0, 0, 1, 0x26, 0x01, 0xaf)));
+        // Prefix SEI before a TSA_N
+        Assert.assertTrue(NalUnits.isNonReference(VideoCodec.H265, wrap(0, 0, 0, 1, 0x4e, 0x01, 0x05, 0, 0, 1, 0x04, 0x01, 0xaf)));
+    }
+
+    @Test
+    public void testOtherCodec() {
+        Assert.assertFalse(NalUnits.isNonReference(VideoCodec.AV1, wrap(0, 0, 0, 1, 0x01, 0x88)));
+    }
+}
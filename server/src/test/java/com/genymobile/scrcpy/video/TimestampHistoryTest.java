@@ -0,0 +1,40 @@
+package com.genymobile.scrcpy.video;
+
+import org.junit.Assert;
+import org.junit.Test;
+
+public class TimestampHistoryTest {
+
+    @Test
+    public void testFind() {
+        TimestampHistory history = new TimestampHistory(4);
+        history.add(1_000_123_456L);
+        history.add(1_011_234_567L);
+
+        Assert.assertEquals(1_000_123_456L, history.find(1_000_123));
+        Assert.assertEquals(1_011_234_567L, history.find(1_011_234));
+        Assert.assertEquals(0, history.find(1_022_345));
+    }
+
+    @Test
+    public void testOverwrite() {
+        TimestampHistory history = new TimestampHistory(2);
+        history.add(1_000_000_001L);
+        history.add(2_000_000_002L);
+        history.add(3_000_000_003L);
+
+        // The oldest timestamp has been overwritten
+        Assert.assertEquals(0, history.find(1_000_000));
+        Assert.assertEquals(2_000_000_002L, history.find(2_000_000));
+        Assert.assertEquals(3_000_000_003L, history.find(3_000_000));
+    }
+
+    @Test
+    public void testClear() {
+        TimestampHistory history = new TimestampHistory(2);
+        history.add(1_000_000_001L);
+        history.clear();
+
+        Assert.assertEquals(0, history.find(1_000_000));
+    }
+}
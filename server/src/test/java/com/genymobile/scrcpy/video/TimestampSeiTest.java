@@ -0,0 +1,54 @@
+package com.genymobile.scrcpy.video;
+
+import org.junit.Assert;
+import org.junit.Test;
+
+import java.util.Arrays;
+
+public class TimestampSeiTest {
+
+    @Test
+    public void testH264() {
+        byte[] sei = new byte[TimestampSei.MAX_SIZE];
+        int size = TimestampSei.write(VideoCodec.H264, 0, 0x0102030405060708L, 0x0a0b0c0d, sei);
+
+        byte[] expected = {
+                0, 0, 0, 1, 0x06, 5, 29,
+                0x73, 0x63, 0x72, 0x63, 0x70, 0x79, 0x2d, 0x74, 0x69, 0x6d, 0x65, 0x73, 0x74, 0x61, 0x6d, 0x70,
+                0, 1, 2, 3, 4, 5, 6, 7, 8, 0x0a, 0x0b, 0x0c, 0x0d, (byte) 0x80,
+        };
+        Assert.assertArrayEquals(expected, Arrays.copyOf(sei, size));
+    }
+
+    @Test
+    public void testH265() {
+        byte[] sei = new byte[TimestampSei.MAX_SIZE];
+        int size = TimestampSei.write(VideoCodec.H265, 0, 0x0102030405060708L, 0x0a0b0c0d, sei);
+
+        Assert.assertEquals(38, size);
+        Assert.assertArrayEquals(new byte[] {0, 0, 0, 1, 0x4e, 0x01, 5, 29}, Arrays.copyOf(sei, 8));
+    }
+
+    @Test
+    public void testEmulationPrevention() {
+        byte[] sei = new byte[TimestampSei.MAX_SIZE];
+        int size = TimestampSei.write(VideoCodec.H264, 0, 0x0000000100000000L, 0, sei);
+
+        byte[] expected = {
+                0, 0, 0, 1, 0x06, 5, 29,
+                0x73, 0x63, 0x72, 0x63, 0x70, 0x79, 0x2d, 0x74, 0x69, 0x6d, 0x65, 0x73, 0x74, 0x61, 0x6d, 0x70,
+                // clock domain and timestamp
+                0, 0, 3, 0, 0, 3, 1, 0, 0, 3, 0, 0,
+                // sequence number
+                3, 0, 0, 3, 0, 0, (byte) 0x80,
+        };
+        Assert.assertArrayEquals(expected, Arrays.copyOf(sei, size));
+    }
+
+    @Test
+    public void testMaxSize() {
+        byte[] sei = new byte[TimestampSei.MAX_SIZE];
+        int size = TimestampSei.write(VideoCodec.H265, 0, 0, 0, sei);
+        Assert.assertTrue(size <= TimestampSei.MAX_SIZE);
+    }
+}
@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+"""Print the timestamps of the frames published by scrcpy --shm-output=<name>,
+or saved in an archive by --save-frames-archive=<file>
+
+Syntax: example.py <name>
+        example.py --archive <file>
+"""
+
+import sys
+
+from scrcpy_frames import FrameArchive, ShmConsumer
+
+
+def consume_shm(name):
+    # scrcpy creates the shared memory on the first frame
+    with ShmConsumer.wait(name) as consumer:
+        last = None
+        for frame in consumer.frames():
+            if last is not None and frame.frame_number - last > 1:
+                print("Skipped %d frames" % (frame.frame_number - last - 1),
+                      file=sys.stderr)
+            last = frame.frame_number
+
+            # Process frame.y, frame.u and frame.v here
+            mean_luma = frame.y.mean()
+
+            if frame.valid():
+                print("frame %d: %dx%d, timestamp %d, mean Y=%.1f"
+                      % (frame.frame_number, frame.width, frame.height,
+                         frame.timestamp_ms, mean_luma))
+
+
+def consume_archive(path):
+    with FrameArchive(path) as archive:
+        for frame in archive.frames():
+            print("frame %d: %dx%d, timestamp %d, %s"
+                  % (frame.frame_number, frame.width, frame.height,
+                     frame.timestamp_ms, frame.format))
+        if archive.recovered:
+            print("Index missing, recovered by scanning", file=sys.stderr)
+
+
+def main(argv):
+    if len(argv) == 2:
+        consume_shm(argv[1])
+    elif len(argv) == 3 and argv[1] == "--archive":
+        consume_archive(argv[2])
+    else:
+        print(__doc__.strip(), file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,13 @@
+"""Zero-copy readers of the frames produced by scrcpy
+
+ - ShmConsumer reads the shared memory ring (--shm-output);
+ - FrameArchive reads the frame archives (--save-frames-archive).
+
+Both expose the Y, U and V planes as numpy views of the mapped memory, without
+parsing a pipe nor copying the frames.
+"""
+
+from .archive import ArchiveFrame, FrameArchive
+from .shm import ShmConsumer, ShmFrame
+
+__all__ = ["ArchiveFrame", "FrameArchive", "ShmConsumer", "ShmFrame"]
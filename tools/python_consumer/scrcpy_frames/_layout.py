@@ -0,0 +1,152 @@
+"""Binary layouts shared with the C side
+
+Mirrors app/src/frame_header.h, app/src/shm_ring.h and app/src/frame_archive.h.
+All the fields are in host byte order ("=" in the struct formats), without
+padding.
+"""
+
+import struct
+
+import numpy as np
+
+# struct frame_header
+FRAME_HEADER = struct.Struct("=8sqiiII")
+FRAME_DELIMITER = b"\xff" * 8
+
+# struct sc_shm_ring_header
+SHM_RING_MAGIC = b"SCSHMRNG"
+SHM_RING_VERSION = 1
+SHM_RING_HEADER = struct.Struct("=8sIIQQQ")
+SHM_RING_WRITE_COUNT_OFFSET = 32
+
+# struct sc_shm_ring_slot: sequence, frame_number, then the frame header, the
+# planes starting at SHM_RING_SLOT_SIZE
+SHM_RING_SLOT_SIZE = 64
+SHM_RING_SLOT_FRAME_NUMBER_OFFSET = 8
+SHM_RING_SLOT_FRAME_OFFSET = 16
+SHM_RING_SLOT_PYRAMID_LEVELS_OFFSET = 48
+
+U32 = struct.Struct("=I")
+
+U64 = struct.Struct("=Q")
+
+# struct sc_frame_archive_footer (and the pose, timestamps, zstd and deltas
+# footers, which have the same layout)
+ARCHIVE_FOOTER = struct.Struct("=8sQQ")
+ARCHIVE_INDEX_MAGIC = b"SCFAIDX\0"
+ARCHIVE_POSE_MAGIC = b"SCFAPOS\0"
+ARCHIVE_TIMESTAMP_MAGIC = b"SCFATSF\0"
+ARCHIVE_ZSTD_MAGIC = b"SCFAZST\0"
+ARCHIVE_DELTA_MAGIC = b"SCFADLT\0"
+
+# struct sc_frame_archive_tiles_header, at the start of the image data of the
+# delta frames (--save-frames-tile-delta)
+ARCHIVE_TILES_HEADER = struct.Struct("=8sQQII")
+ARCHIVE_TILES_MAGIC = b"SCFATIL\0"
+
+# Start of the image data of the frames compressed by --save-frames-zstd
+ZSTD_FRAME_MAGIC = b"\x28\xb5\x2f\xfd"
+
+ARCHIVE_DROPPED = 0xFFFFFFFFFFFFFFFF
+ARCHIVE_REPEATED = 0xFFFFFFFFFFFFFFFE
+ARCHIVE_GAP = 0xFFFFFFFFFFFFFFFD
+
+# struct timestamp_index_header and its entries (--record-timestamps), in
+# little-endian
+TIMESTAMP_INDEX_MAGIC = b"SCTI"
+TIMESTAMP_INDEX_VERSION = 1
+TIMESTAMP_INDEX_HEADER = struct.Struct("<4sI")
+TIMESTAMP_INDEX_DTYPE = np.dtype([
+    ("pts_us", "<i8"),
+    ("timestamp_ms", "<i8"),
+])
+
+# struct sc_frame_archive_entry
+ARCHIVE_ENTRY_DTYPE = np.dtype([
+    ("frame_number", "=u8"),
+    ("timestamp_ms", "=i8"),
+    ("offset", "=u8"),
+])
+
+# struct sc_frame_archive_timestamp
+ARCHIVE_TIMESTAMP_DTYPE = np.dtype([
+    ("frame_number", "=u8"),
+    ("raw_timestamp_us", "=i8"),
+    ("filtered_timestamp_us", "=i8"),
+    ("flags", "=u4"),
+])
+
+# struct sc_frame_archive_delta
+ARCHIVE_DELTA_DTYPE = np.dtype([
+    ("frame_number", "=u8"),
+    ("base_frame_number", "=u8"),
+    ("key_frame_number", "=u8"),
+])
+
+# struct pose_sample_record
+POSE_SAMPLE_DTYPE = np.dtype([
+    ("magic", "S4"),
+    ("flags", "=u4"),
+    ("timestamp_us", "=i8"),
+    ("rotation", "=f4", (4,)),
+    ("translation", "=f4", (3,)),
+])
+
+assert FRAME_HEADER.size == 32
+assert SHM_RING_HEADER.size == 40
+assert ARCHIVE_FOOTER.size == 24
+assert ARCHIVE_ENTRY_DTYPE.itemsize == 24
+assert ARCHIVE_TIMESTAMP_DTYPE.itemsize == 28
+assert ARCHIVE_TILES_HEADER.size == 32
+assert ARCHIVE_DELTA_DTYPE.itemsize == 24
+assert POSE_SAMPLE_DTYPE.itemsize == 44
+assert TIMESTAMP_INDEX_HEADER.size == 8
+assert TIMESTAMP_INDEX_DTYPE.itemsize == 16
+
+
+def frame_header_checksum(header):
+    """calculate_header_checksum() of the 32-byte frame header"""
+    checksum = 0
+    for b in header[:FRAME_HEADER.size - 4]:
+        checksum = ((checksum << 8) ^ b) & 0xFFFFFFFF
+    return checksum
+
+
+def yuv_planes(buf, offset, width, height, size):
+    """Views of the packed Y, U and V planes (U and V are None for GRAY8)
+
+    Return None if `size` matches neither YUV420P nor GRAY8.
+    """
+    area = width * height
+    chroma = (width // 2) * (height // 2)
+    if size == area:
+        y = np.frombuffer(buf, np.uint8, area, offset)
+        return y.reshape(height, width), None, None
+    if size == area + 2 * chroma:
+        y = np.frombuffer(buf, np.uint8, area, offset)
+        u = np.frombuffer(buf, np.uint8, chroma, offset + area)
+        v = np.frombuffer(buf, np.uint8, chroma, offset + area + chroma)
+        shape = (height // 2, width // 2)
+        return y.reshape(height, width), u.reshape(shape), v.reshape(shape)
+    return None
+
+
+def pyramid_levels(buf, offset, width, height, levels):
+    """Views of the pyramid levels present in a slot (--output-pyramid)
+
+    `levels` is the bitmask of the levels, and `offset` the end of the frame
+    data. Return a dict {level: plane}.
+    """
+    planes = {}
+    eye_width = width // 2
+    for level in range(1, 32):
+        if not levels >> level:
+            break
+        eye_width //= 2
+        height //= 2
+        if levels & (1 << level):
+            size = 2 * eye_width * height
+            plane = np.frombuffer(buf, np.uint8, size, offset)
+            planes[level] = plane.reshape(height, 2 * eye_width)
+            offset += size
+    return planes
@@ -0,0 +1,285 @@
+"""Central aggregator of the streams forwarded by capture nodes (--aggregator)
+
+Each node connects over TCP and multiplexes on its connection the encoded
+packets of its streams (video, right eye, camera, audio), with their capture
+timestamps, and its pose samples (see struct uplink_hello in
+app/src/frame_header.h). The aggregator acknowledges the consumed bytes, so
+that a node never sends more than the window beyond what was consumed: a slow
+consumer makes the nodes drop data (the video until the next key frame), it
+never blocks their capture.
+
+By default, the streams of each node are written to <directory>/<node>/:
+ - <stream>.<codec>: the elementary stream, as encoded by the device (the
+   H.264 and H.265 streams, in Annex B format, are playable by ffmpeg);
+ - <stream>.<codec>.ts.idx: the timestamp index of its frames, in the format
+   of --record-timestamps (see RecordingIndex);
+ - audio.<codec>.pkt: the audio packets, each one preceded by its 32-bit size
+   and 64-bit PTS (little-endian), with its timestamp index;
+ - poses.bin: the pose samples, 44-byte records (POSE_SAMPLE_DTYPE, but in
+   little-endian).
+
+To decode on the aggregator (e.g. on the GPU), subclass Aggregator and
+override on_record(), called from the thread of the connection for each
+record, in the order of the node.
+
+Syntax: python -m scrcpy_frames.aggregator [--listen=[ip:]port] <directory>
+"""
+
+import argparse
+import os
+import socket
+import struct
+import sys
+import threading
+
+from ._layout import TIMESTAMP_INDEX_HEADER, TIMESTAMP_INDEX_MAGIC, \
+        TIMESTAMP_INDEX_VERSION
+
+# struct uplink_hello, struct uplink_record_header and struct
+# uplink_stream_info, in little-endian
+UPLINK_MAGIC = b"SCUL"
+UPLINK_VERSION = 1
+UPLINK_WINDOW = 16 * 1024 * 1024
+UPLINK_HELLO = struct.Struct("<4sI32s")
+UPLINK_RECORD_HEADER = struct.Struct("<BBHIqq")
+UPLINK_STREAM_INFO = struct.Struct("<IIIII")
+UPLINK_ACK = struct.Struct("<Q")
+
+RECORD_STREAM = 0
+RECORD_PACKET = 1
+RECORD_POSE = 2
+RECORD_END = 3
+
+FLAG_CONFIG = 0x1
+FLAG_KEY_FRAME = 0x2
+FLAG_DISCONTINUITY = 0x4
+
+STREAM_NAMES = ["video", "video-right", "camera", "audio", "pose"]
+STREAM_AUDIO = 3
+
+CODEC_NAMES = {
+    0x68323634: "h264",
+    0x68323635: "h265",
+    0x00617631: "av1",
+    0x6f707573: "opus",
+    0x00616163: "aac",
+    0x666c6163: "flac",
+    0x00726177: "raw",
+}
+
+TIMESTAMP_INDEX_ENTRY = struct.Struct("<qq")
+AUDIO_PACKET_HEADER = struct.Struct("<Iq")
+
+assert UPLINK_HELLO.size == 40
+assert UPLINK_RECORD_HEADER.size == 24
+assert UPLINK_STREAM_INFO.size == 20
+
+
+class Record:
+    """A record received from a node"""
+
+    __slots__ = ("type", "stream", "flags", "pts_us", "timestamp_us", "data")
+
+    def __init__(self, type, stream, flags, pts_us, timestamp_us, data):
+        self.type = type
+        self.stream = stream
+        self.flags = flags
+        self.pts_us = pts_us
+        self.timestamp_us = timestamp_us
+        self.data = data
+
+
+def _recv_exact(sock, size):
+    buf = bytearray(size)
+    view = memoryview(buf)
+    pos = 0
+    while pos < size:
+        n = sock.recv_into(view[pos:])
+        if not n:
+            return None
+        pos += n
+    return buf
+
+
+class _NodeWriter:
+    """Write the streams of a node to its directory"""
+
+    def __init__(self, directory):
+        os.makedirs(directory, exist_ok=True)
+        self.directory = directory
+        self.streams = {}  # stream id -> (data file, index file)
+        self.poses = None
+
+    def _open_stream(self, stream, info):
+        self._close_stream(stream)
+        codec_id, width, height, sample_rate, channels = \
+            UPLINK_STREAM_INFO.unpack(info)
+        codec = CODEC_NAMES.get(codec_id, "%08x" % codec_id)
+        name = "%s.%s" % (STREAM_NAMES[stream], codec)
+        if stream == STREAM_AUDIO:
+            name += ".pkt"
+        path = os.path.join(self.directory, name)
+        # A stream restarted (after a reconnection of the node) is appended
+        data = open(path, "ab")
+        index = open(path + ".ts.idx", "ab")
+        if not index.tell():
+            index.write(TIMESTAMP_INDEX_HEADER.pack(TIMESTAMP_INDEX_MAGIC,
+                                                    TIMESTAMP_INDEX_VERSION))
+        self.streams[stream] = (data, index)
+
+    def _close_stream(self, stream):
+        files = self.streams.pop(stream, None)
+        if files:
+            for f in files:
+                f.close()
+
+    def write(self, record):
+        if record.type == RECORD_STREAM:
+            self._open_stream(record.stream, record.data)
+        elif record.type == RECORD_PACKET:
+            files = self.streams.get(record.stream)
+            if not files:
+                return
+            data, index = files
+            if record.stream == STREAM_AUDIO:
+                data.write(AUDIO_PACKET_HEADER.pack(len(record.data),
+                                                    record.pts_us))
+            data.write(record.data)
+            if not record.flags & FLAG_CONFIG:
+                # One entry per frame, as in the recordings
+                timestamp_ms = record.timestamp_us // 1000 \
+                    if record.timestamp_us >= 0 else -1
+                index.write(TIMESTAMP_INDEX_ENTRY.pack(record.pts_us,
+                                                       timestamp_ms))
+        elif record.type == RECORD_POSE:
+            if not self.poses:
+                path = os.path.join(self.directory, "poses.bin")
+                self.poses = open(path, "ab")
+            self.poses.write(record.data)
+
+    def close(self):
+        for stream in list(self.streams):
+            self._close_stream(stream)
+        if self.poses:
+            self.poses.close()
+
+
+class Aggregator:
+    """Accept the connections of the capture nodes, a thread per node"""
+
+    def __init__(self, directory=None, host="0.0.0.0", port=27200):
+        self.directory = directory
+        self.host = host
+        self.port = port
+        self._writers = {}
+        self._lock = threading.Lock()
+
+    def on_node(self, node):
+        """Called when a node connects"""
+        print("Node connected: %s" % node, file=sys.stderr)
+
+    def on_record(self, node, record):
+        """Called for each record of a node (from the thread of its
+        connection); writes the streams to the directory by default"""
+        if self.directory is None:
+            return
+        writer = self._writers.get(node)
+        if not writer:
+            writer = _NodeWriter(os.path.join(self.directory, node))
+            with self._lock:
+                self._writers[node] = writer
+        writer.write(record)
+
+    def on_node_ended(self, node, complete):
+        """Called when the connection of a node ends (complete if the node
+        ended its session cleanly)"""
+        with self._lock:
+            writer = self._writers.pop(node, None)
+        if writer:
+            writer.close()
+        print("Node %s: %s" % (node, "ended" if complete else "lost"),
+              file=sys.stderr)
+
+    def serve_forever(self):
+        server = socket.create_server((self.host, self.port))
+        with server:
+            while True:
+                sock, _ = server.accept()
+                thread = threading.Thread(target=self._serve_node,
+                                          args=(sock,), daemon=True)
+                thread.start()
+
+    def _serve_node(self, sock):
+        with sock:
+            sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            hello = _recv_exact(sock, UPLINK_HELLO.size)
+            if not hello:
+                return
+            magic, version, node = UPLINK_HELLO.unpack(hello)
+            if magic != UPLINK_MAGIC or version != UPLINK_VERSION:
+                print("Invalid node hello", file=sys.stderr)
+                return
+            node = node.rstrip(b"\0").decode("utf-8", "replace")
+            # The node name is used as a directory name
+            node = node.replace("/", "_").replace("\\", "_") or "node"
+            self.on_node(node)
+
+            consumed = 0
+            acked = 0
+            complete = False
+            while True:
+                header = _recv_exact(sock, UPLINK_RECORD_HEADER.size)
+                if not header:
+                    break
+                type, stream, flags, size, pts_us, timestamp_us = \
+                    UPLINK_RECORD_HEADER.unpack(header)
+                data = _recv_exact(sock, size) if size else bytearray()
+                if data is None:
+                    break
+
+                if type != RECORD_END:
+                    self.on_record(node, Record(type, stream, flags, pts_us,
+                                                timestamp_us, data))
+                consumed += UPLINK_RECORD_HEADER.size + size
+
+                # Acknowledge regularly, so that the node never waits for
+                # the window
+                end = type == RECORD_END
+                if end or consumed - acked >= UPLINK_WINDOW // 2:
+                    sock.sendall(UPLINK_ACK.pack(consumed))
+                    acked = consumed
+
+                if end:
+                    complete = True
+                    break
+
+            self.on_node_ended(node, complete)
+
+
+def parse_listen(value):
+    host, sep, port = value.rpartition(":")
+    return (host if sep else "0.0.0.0"), int(port)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Gather the streams forwarded by scrcpy capture nodes "
+                    "(--aggregator)")
+    parser.add_argument("directory",
+                        help="output directory (a subdirectory per node)")
+    parser.add_argument("--listen", default="27200",
+                        help="[ip:]port to listen on (default: 27200, on all "
+                             "interfaces)")
+    args = parser.parse_args()
+
+    host, port = parse_listen(args.listen)
+    aggregator = Aggregator(args.directory, host, port)
+    try:
+        aggregator.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,385 @@
+"""Reader of the frame archives (--save-frames-archive)
+
+The archive is mapped read-only, and its index, timestamps, pose samples and
+frames are exposed as numpy views of the mapping, without copy. The format is
+described in app/src/frame_archive.h.
+
+The frames compressed by --save-frames-zstd are decompressed on access (this
+requires the zstandard package), into new buffers. Each frame is compressed
+independently, so frames(threads=N) decompresses them in parallel.
+
+The delta frames of --save-frames-tile-delta are reconstructed on access, by
+applying their tiles to the frames they depend on, back to their key frame.
+"""
+
+import collections
+import concurrent.futures
+import mmap
+import threading
+
+import numpy as np
+
+from . import _layout as L
+
+
+class ArchiveFrame:
+    """A frame saved in the archive
+
+    `data` is the image data, in the --save-frames-format format. For the
+    uncompressed formats, the image is also exposed as numpy views:
+     - yuv: `y`, `u` and `v` (`u` and `v` are None with --output-planes=y);
+     - ppm: `rgb` (height x width x 3), or `y` for PGM (--output-planes=y).
+    For png and qoi, only `data` is set (decode it with an image library).
+    The frames of a compressed archive are exposed decompressed, and the delta
+    frames reconstructed.
+    """
+
+    __slots__ = ("frame_number", "timestamp_ms", "width", "height", "format",
+                 "data", "y", "u", "v", "rgb")
+
+    def __init__(self, frame_number, timestamp_ms, width, height, data):
+        self.frame_number = frame_number
+        self.timestamp_ms = timestamp_ms
+        self.width = width
+        self.height = height
+        self.data = data
+        self.y = self.u = self.v = self.rgb = None
+        self.format = self._parse()
+
+    def _parse(self):
+        data = self.data
+        w = self.width
+        h = self.height
+        head = bytes(data[:16])
+        if head.startswith(b"\x89PNG"):
+            return "png"
+        if head.startswith(b"qoif"):
+            return "qoi"
+        if head.startswith((b"P5\n", b"P6\n")):
+            gray = head.startswith(b"P5")
+            header = ("%s\n%d %d\n255\n" % ("P5" if gray else "P6", w, h)) \
+                .encode()
+            if gray:
+                self.y = data[len(header):].reshape(h, w)
+                return "pgm"
+            self.rgb = data[len(header):].reshape(h, w, 3)
+            return "ppm"
+        planes = L.yuv_planes(data, 0, w, h, len(data))
+        if planes is None:
+            return "unknown"
+        self.y, self.u, self.v = planes
+        return "gray" if self.u is None else "yuv420p"
+
+
+class FrameArchive:
+    """Frame archive written by scrcpy --save-frames-archive
+
+    `index` is a numpy structured array of the index entries (frame_number,
+    timestamp_ms, offset), including the dropped and repeated frames and the
+    interruptions of the stream (see is_saved()). `timestamps` (the raw and
+    filtered capture timestamps) and `poses` (the headset pose samples) are
+    structured arrays too, or None if the archive has none. `deltas` lists the
+    delta frames (frame_number, base_frame_number, key_frame_number) of
+    --save-frames-tile-delta, or is None.
+
+    If the capture was interrupted before the index was written, the index is
+    rebuilt by scanning the frame headers (the timestamps and poses are then
+    lost). The dictionary of a compressed archive is then lost too: pass the
+    --save-frames-zstd-dict file as `zstd_dict`. The delta frames of a
+    recovered archive cannot be reconstructed (their base frames are unknown).
+
+    The numpy views keep the mapping alive: close() unmaps the file only once
+    they are all released.
+    """
+
+    def __init__(self, path, zstd_dict=None):
+        with open(path, "rb") as f:
+            self._mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        self.path = path
+        self.timestamps = None
+        self.poses = None
+        self.deltas = None
+        self.recovered = False
+        # True if the frames are compressed (--save-frames-zstd)
+        self.compressed = False
+        self._zstd_dict = None
+        self._local = threading.local()
+
+        index = self._read_index()
+        if index is None:
+            index = self._scan()
+            self.recovered = True
+            self.compressed = self._sniff_zstd(index)
+        self.index = index
+
+        if zstd_dict is not None:
+            with open(zstd_dict, "rb") as f:
+                self._zstd_dict = f.read()
+
+        # To find the frames by timestamp
+        saved = np.flatnonzero(self.index["offset"] < L.ARCHIVE_GAP)
+        order = np.argsort(self.index["timestamp_ms"][saved], kind="stable")
+        self._by_time = saved[order]
+        self._times = self.index["timestamp_ms"][self._by_time]
+
+        # To find the base frames of the delta frames
+        self._positions = None
+        if self.deltas is not None:
+            numbers = self.index["frame_number"][saved].tolist()
+            self._positions = dict(zip(numbers, saved.tolist()))
+
+    def close(self):
+        try:
+            self._mm.close()
+        except BufferError:
+            # Some views are still alive, the mapping will be released with
+            # them
+            pass
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def _read_footer(self, end, magic):
+        if end < L.ARCHIVE_FOOTER.size:
+            return None
+        start = end - L.ARCHIVE_FOOTER.size
+        m, count, offset = L.ARCHIVE_FOOTER.unpack_from(self._mm, start)
+        if m != magic or offset > start:
+            return None
+        return count, offset, start
+
+    def _read_records(self, footer, dtype):
+        count, offset, start = footer
+        if offset + count * dtype.itemsize != start:
+            return None
+        return np.frombuffer(self._mm, dtype, count, offset)
+
+    def _read_index(self):
+        footer = self._read_footer(len(self._mm), L.ARCHIVE_INDEX_MAGIC)
+        if footer is None:
+            return None
+        index = self._read_records(footer, L.ARCHIVE_ENTRY_DTYPE)
+        if index is None:
+            return None
+
+        # The optional sections immediately precede the index:
+        # [deltas][deltas footer][dictionary][zstd footer][timestamps]
+        # [timestamps footer][poses][pose footer][index]
+        end = footer[1]
+        pose_footer = self._read_footer(end, L.ARCHIVE_POSE_MAGIC)
+        if pose_footer is not None:
+            self.poses = self._read_records(pose_footer,
+                                            L.POSE_SAMPLE_DTYPE)
+            end = pose_footer[1]
+        ts_footer = self._read_footer(end, L.ARCHIVE_TIMESTAMP_MAGIC)
+        if ts_footer is not None:
+            self.timestamps = self._read_records(ts_footer,
+                                                 L.ARCHIVE_TIMESTAMP_DTYPE)
+            end = ts_footer[1]
+        zstd_footer = self._read_footer(end, L.ARCHIVE_ZSTD_MAGIC)
+        if zstd_footer is not None:
+            size, offset, _ = zstd_footer
+            self.compressed = True
+            if size:
+                self._zstd_dict = self._mm[offset:offset + size]
+            end = offset
+        delta_footer = self._read_footer(end, L.ARCHIVE_DELTA_MAGIC)
+        if delta_footer is not None:
+            self.deltas = self._read_records(delta_footer,
+                                             L.ARCHIVE_DELTA_DTYPE)
+        return index
+
+    def _sniff_zstd(self, index):
+        if not len(index):
+            return False
+        offset = int(index["offset"][0]) + L.FRAME_HEADER.size
+        return self._mm[offset:offset + 4] == L.ZSTD_FRAME_MAGIC
+
+    def _decompressor(self):
+        # A decompression context is not thread-safe, one per thread
+        dctx = getattr(self._local, "dctx", None)
+        if dctx is None:
+            import zstandard
+            dict_data = None
+            if self._zstd_dict:
+                dict_data = zstandard.ZstdCompressionDict(self._zstd_dict)
+            dctx = zstandard.ZstdDecompressor(dict_data=dict_data)
+            self._local.dctx = dctx
+        return dctx
+
+    def _scan(self):
+        # Frame numbers are unknown without index: number the frames found
+        mm = self._mm
+        entries = []
+        offset = 0
+        size = len(mm)
+        while offset + L.FRAME_HEADER.size <= size:
+            header = mm[offset:offset + L.FRAME_HEADER.size]
+            delimiter, timestamp_ms, width, height, frame_size, checksum = \
+                L.FRAME_HEADER.unpack(header)
+            end = offset + L.FRAME_HEADER.size + frame_size
+            if delimiter != L.FRAME_DELIMITER \
+                    or checksum != L.frame_header_checksum(header) \
+                    or width <= 0 or height <= 0 or end > size:
+                # Resynchronize on the next delimiter
+                offset = mm.find(L.FRAME_DELIMITER, offset + 1)
+                if offset == -1:
+                    break
+                continue
+            entries.append((len(entries), timestamp_ms, offset))
+            offset = end
+        return np.array(entries, dtype=L.ARCHIVE_ENTRY_DTYPE)
+
+    def __len__(self):
+        return len(self.index)
+
+    def is_saved(self, i):
+        """Indicate if the entry `i` is a saved frame (not a dropped or
+        repeated frame, nor an interruption of the stream)"""
+        return int(self.index[i]["offset"]) < L.ARCHIVE_GAP
+
+    def _record(self, offset):
+        """The timestamp, size and image data (decompressed) of a record"""
+        _, timestamp_ms, width, height, frame_size, _ = \
+            L.FRAME_HEADER.unpack_from(self._mm, offset)
+        data = np.frombuffer(self._mm, np.uint8, frame_size,
+                             offset + L.FRAME_HEADER.size)
+        if self.compressed:
+            # The GIL is released while decompressing
+            data = np.frombuffer(self._decompressor().decompress(data),
+                                 np.uint8)
+        return timestamp_ms, width, height, data
+
+    @staticmethod
+    def _is_delta(data):
+        return bytes(data[:8]) == L.ARCHIVE_TILES_MAGIC
+
+    @staticmethod
+    def _apply_tiles(image, width, height, data):
+        """Copy the tiles of a delta frame into a packed YUV420P (or GRAY8)
+        image"""
+        _, _, _, tile_size, count = L.ARCHIVE_TILES_HEADER.unpack_from(data)
+        offset = L.ARCHIVE_TILES_HEADER.size
+        tiles = np.frombuffer(data, "=u4", count, offset)
+        offset += 4 * count
+
+        area = width * height
+        planes = [(image[:area].reshape(height, width), tile_size)]
+        if len(image) > area:
+            chroma = (width // 2) * (height // 2)
+            shape = (height // 2, width // 2)
+            planes.append((image[area:area + chroma].reshape(shape),
+                           tile_size // 2))
+            planes.append((image[area + chroma:].reshape(shape),
+                           tile_size // 2))
+
+        per_row = -(-width // tile_size)
+        for tile in tiles.tolist():
+            for plane, size in planes:
+                x = tile % per_row * size
+                y = tile // per_row * size
+                h = max(0, min(size, plane.shape[0] - y))
+                w = max(0, min(size, plane.shape[1] - x))
+                plane[y:y + h, x:x + w] = \
+                    data[offset:offset + w * h].reshape(h, w)
+                offset += w * h
+
+    def _reconstruct(self, frame_number, width, height, data):
+        if self._positions is None:
+            raise ValueError("delta frame %d cannot be reconstructed without "
+                             "the index" % frame_number)
+
+        # Walk back the chain of the delta frames, to the key frame or to the
+        # last frame reconstructed by this thread
+        chain = [data]
+        last = getattr(self._local, "last", None)
+        _, base, _, _, _ = L.ARCHIVE_TILES_HEADER.unpack_from(data)
+        while True:
+            if last is not None and last[0] == base:
+                image = last[1].copy()
+                break
+            pos = self._positions.get(base)
+            if pos is None:
+                raise ValueError("delta frame %d cannot be reconstructed: "
+                                 "frame %d not saved" % (frame_number, base))
+            _, w, h, base_data = self._record(int(self.index[pos]["offset"]))
+            if (w, h) != (width, height):
+                raise ValueError("delta frame %d: size of the frame %d "
+                                 "mismatch" % (frame_number, base))
+            if not self._is_delta(base_data):
+                image = base_data.copy()
+                break
+            chain.append(base_data)
+            _, base, _, _, _ = L.ARCHIVE_TILES_HEADER.unpack_from(base_data)
+
+        for delta in reversed(chain):
+            self._apply_tiles(image, width, height, delta)
+        return image
+
+    def __getitem__(self, i):
+        """The frame of the index entry `i`, or None if it was not saved
+
+        A delta frame is reconstructed from its key frame (ValueError if one
+        of the frames it depends on was not saved).
+        """
+        entry = self.index[i]
+        offset = int(entry["offset"])
+        if offset >= L.ARCHIVE_GAP:
+            return None
+        frame_number = int(entry["frame_number"])
+        timestamp_ms, width, height, data = self._record(offset)
+        if self._is_delta(data):
+            data = self._reconstruct(frame_number, width, height, data)
+        if self._positions is not None:
+            # The next delta frame is likely based on this one
+            self._local.last = (frame_number, data)
+        return ArchiveFrame(frame_number, timestamp_ms, width, height, data)
+
+    def frames(self, threads=1):
+        """Iterate over the saved frames, in the order of the index
+
+        With threads > 1, the next frames are read (decompressed) in
+        parallel, ahead of the iteration.
+        """
+        saved = (i for i in range(len(self.index)) if self.is_saved(i))
+        if threads <= 1:
+            for i in saved:
+                yield self[i]
+            return
+
+        with concurrent.futures.ThreadPoolExecutor(threads) as executor:
+            # Bound the frames read ahead
+            pending = collections.deque()
+            for i in saved:
+                pending.append(executor.submit(self.__getitem__, i))
+                if len(pending) >= 2 * threads:
+                    yield pending.popleft().result()
+            while pending:
+                yield pending.popleft().result()
+
+    def indices_between(self, start_ms=None, end_ms=None):
+        """The index entries of the saved frames whose timestamp is in
+        [start_ms, end_ms) (unbounded if None), in the order of the index
+
+        The range is found by binary search on the timestamps.
+        """
+        times = self._times
+        lo = 0 if start_ms is None else int(np.searchsorted(times, start_ms))
+        hi = len(times) if end_ms is None \
+            else int(np.searchsorted(times, end_ms))
+        return np.sort(self._by_time[lo:hi])
+
+    def frame_at(self, timestamp_ms):
+        """The saved frame whose timestamp is the closest to `timestamp_ms`,
+        or None if there is no saved frame"""
+        times = self._times
+        if not len(times):
+            return None
+        pos = int(np.searchsorted(times, timestamp_ms))
+        if pos == len(times) or (pos and timestamp_ms - times[pos - 1]
+                                 <= times[pos] - timestamp_ms):
+            pos -= 1
+        return self[int(self._by_time[pos])]
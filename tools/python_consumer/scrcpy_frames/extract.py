@@ -0,0 +1,275 @@
+"""Extract the frames of a capture to image files, in parallel
+
+The input is a frame archive (--save-frames-archive), or a recording with its
+timestamp index (--record-timestamps). For a segmented recording
+(--record-segment), pass the name given to --record: all its segments are
+extracted.
+
+The frames captured in a time range are found by binary search on the
+timestamps, then extracted by several processes, each one reading (and
+decompressing, or decoding) its own chunks of frames. The recordings are
+decoded by ffmpeg (which must be in the PATH), a process per chunk.
+
+The files are named frame_<number>_<timestamp>.<ext>, like the frames saved
+by --save-frames.
+
+Syntax: python -m scrcpy_frames.extract [options] <input> <directory>
+"""
+
+import argparse
+import concurrent.futures
+import os
+import struct
+import subprocess
+import sys
+import zlib
+
+import numpy as np
+
+from .archive import FrameArchive
+from .recording import RecordingIndex, recording_segments
+
+# Frames per task: enough to amortize the dispatch (and the seek of the
+# decoder for the recordings), few enough to balance the load
+ARCHIVE_CHUNK_FRAMES = 16
+RECORDING_CHUNK_FRAMES = 256
+
+# Fast compression: the extraction should be limited by the disk, not by zlib
+PNG_LEVEL = 1
+
+# The extensions of the --save-frames-format formats
+RAW_EXTENSIONS = {
+    "yuv420p": "yuv",
+    "gray": "gray",
+    "ppm": "ppm",
+    "pgm": "pgm",
+    "png": "png",
+    "qoi": "qoi",
+}
+
+# The archive opened by each worker process
+_archive = None
+
+
+def yuv420p_to_rgb(y, u, v):
+    """Convert the planes of a frame to RGB24 (height x width x 3), as the
+    client does (BT.601 limited range, see app/src/util/yuv_rgb.c)"""
+    h, w = y.shape
+    u = u.astype(np.int32).repeat(2, 0).repeat(2, 1)[:h, :w] - 128
+    v = v.astype(np.int32).repeat(2, 0).repeat(2, 1)[:h, :w] - 128
+    luma = (y.astype(np.int32) - 16) * 19077 + (1 << 13)
+    rgb = np.empty((h, w, 3), np.uint8)
+    channels = (luma + 26149 * v, luma - 6419 * u - 13320 * v,
+                luma + 33050 * u)
+    for c, value in enumerate(channels):
+        rgb[..., c] = np.clip(value >> 14, 0, 255)
+    return rgb
+
+
+def frame_image(frame):
+    """The pixels of an archive frame (RGB, or gray), None for the encoded
+    formats (png and qoi)"""
+    if frame.rgb is not None:
+        return frame.rgb
+    if frame.u is not None:
+        return yuv420p_to_rgb(frame.y, frame.u, frame.v)
+    return frame.y
+
+
+def _png_chunk(tag, data):
+    return struct.pack(">I", len(data)) + tag + data \
+        + struct.pack(">I", zlib.crc32(tag + data))
+
+
+def write_png(path, image):
+    """Write an RGB (height x width x 3) or gray (height x width) image"""
+    h, w = image.shape[:2]
+    color_type = 2 if image.ndim == 3 else 0
+    # Each row is preceded by its filter type (0: none)
+    rows = np.zeros((h, 1 + image[0].size), np.uint8)
+    rows[:, 1:] = image.reshape(h, -1)
+    header = struct.pack(">IIBBBBB", w, h, 8, color_type, 0, 0, 0)
+    with open(path, "wb") as f:
+        f.write(b"\x89PNG\r\n\x1a\n")
+        f.write(_png_chunk(b"IHDR", header))
+        f.write(_png_chunk(b"IDAT", zlib.compress(rows, PNG_LEVEL)))
+        f.write(_png_chunk(b"IEND", b""))
+
+
+def frame_name(frame_number, timestamp_ms):
+    if timestamp_ms < 0:
+        return "frame_%06d" % frame_number
+    return "frame_%06d_%d" % (frame_number, timestamp_ms)
+
+
+def _write_image(path, image, fmt):
+    if fmt == "png":
+        write_png(path + ".png", image)
+    else:
+        assert fmt == "npy"
+        np.save(path + ".npy", image)
+
+
+def _open_archive(path, zstd_dict):
+    global _archive
+    _archive = FrameArchive(path, zstd_dict)
+
+
+def _extract_archive_frames(indices, directory, fmt):
+    for i in indices:
+        frame = _archive[i]
+        path = os.path.join(directory, frame_name(frame.frame_number,
+                                                  frame.timestamp_ms))
+        if fmt == "raw" or (fmt == "png" and frame.format == "png"):
+            ext = RAW_EXTENSIONS.get(frame.format, "bin")
+            frame.data.tofile(path + "." + ext)
+            continue
+        image = frame_image(frame)
+        if image is None:
+            raise ValueError("Cannot convert the %s frames, use --format=raw"
+                             % frame.format)
+        _write_image(path, image, fmt)
+    return len(indices)
+
+
+def _read_ppm(stream):
+    # The header written by ffmpeg: "P6\n<width> <height>\n255\n"
+    if stream.readline() != b"P6\n":
+        return None
+    w, h = map(int, stream.readline().split())
+    stream.readline()
+    data = stream.read(w * h * 3)
+    if len(data) != w * h * 3:
+        return None
+    return np.frombuffer(data, np.uint8).reshape(h, w, 3)
+
+
+def _extract_recording_frames(path, pts_us, names, directory, fmt):
+    # Accurate seek to the first frame of the chunk (slightly before its PTS,
+    # against the rounding): the frames before it are decoded and discarded
+    start = max(pts_us - 500, 0) / 1e6
+    cmd = ["ffmpeg", "-v", "error", "-nostdin", "-ss", "%.6f" % start,
+           "-i", path, "-frames:v", str(len(names)), "-f", "image2pipe",
+           "-c:v", "ppm", "-"]
+    count = 0
+    with subprocess.Popen(cmd, stdout=subprocess.PIPE) as proc:
+        for name in names:
+            image = _read_ppm(proc.stdout)
+            if image is None:
+                break
+            path_name = os.path.join(directory, name)
+            if fmt == "raw":
+                h, w = image.shape[:2]
+                with open(path_name + ".ppm", "wb") as f:
+                    f.write(b"P6\n%d %d\n255\n" % (w, h))
+                    f.write(image.data)
+            else:
+                _write_image(path_name, image, fmt)
+            count += 1
+        proc.stdout.close()
+    if count != len(names):
+        raise RuntimeError("ffmpeg decoded %d frames out of %d from %s"
+                           % (count, len(names), path))
+    return count
+
+
+def _consecutive_chunks(indices, size):
+    # Split into chunks of consecutive indices (decoded in sequence), at most
+    # `size` each
+    start = 0
+    for i in range(1, len(indices) + 1):
+        if i == len(indices) or indices[i] != indices[i - 1] + 1 \
+                or i - start == size:
+            yield indices[start:i]
+            start = i
+
+
+def _submit_archive(args):
+    with FrameArchive(args.input, args.zstd_dict) as archive:
+        indices = archive.indices_between(args.start, args.end).tolist()
+    executor = concurrent.futures.ProcessPoolExecutor(
+        args.jobs, initializer=_open_archive,
+        initargs=(args.input, args.zstd_dict))
+    # The frames are read in any order, the chunks need not be consecutive
+    futures = [executor.submit(_extract_archive_frames,
+                               indices[i:i + ARCHIVE_CHUNK_FRAMES],
+                               args.output, args.format)
+               for i in range(0, len(indices), ARCHIVE_CHUNK_FRAMES)]
+    return executor, futures
+
+
+def _submit_recording(args):
+    segments = recording_segments(args.input)
+    if not segments:
+        raise FileNotFoundError("No recording found: " + args.input)
+    executor = concurrent.futures.ProcessPoolExecutor(args.jobs)
+    futures = []
+    first_frame = 0  # the frames are numbered across the segments
+    for segment in segments:
+        index = RecordingIndex(segment)
+        entries = index.entries
+        indices = index.indices_between(args.start, args.end)
+        chunks = _consecutive_chunks(indices.tolist(), RECORDING_CHUNK_FRAMES)
+        for chunk in chunks:
+            names = [frame_name(first_frame + i,
+                                int(entries[i]["timestamp_ms"]))
+                     for i in chunk]
+            pts_us = int(entries[chunk[0]]["pts_us"])
+            futures.append(executor.submit(_extract_recording_frames,
+                                           segment, pts_us, names,
+                                           args.output, args.format))
+        first_frame += len(entries)
+    return executor, futures
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(
+        prog="scrcpy-frames-extract",
+        description="Extract the frames of a frame archive, or of a "
+                    "recording with its timestamp index, in parallel.")
+    parser.add_argument("input",
+                        help="the archive, or the recording (the name "
+                             "given to --record if segmented)")
+    parser.add_argument("output", help="the output directory")
+    parser.add_argument("--start", type=int,
+                        help="the first capture time to extract (in ms "
+                             "since the Unix epoch)")
+    parser.add_argument("--end", type=int,
+                        help="the capture time to stop at (excluded)")
+    parser.add_argument("--format", choices=("png", "npy", "raw"),
+                        default="png",
+                        help="png (default), npy (RGB or gray arrays), or "
+                             "raw (the image data as saved, PPM for a "
+                             "recording)")
+    parser.add_argument("--jobs", type=int, default=os.cpu_count() or 1,
+                        help="the number of processes (default: the number "
+                             "of CPUs)")
+    parser.add_argument("--zstd-dict",
+                        help="the dictionary of a compressed archive "
+                             "without index")
+    args = parser.parse_args(argv)
+
+    os.makedirs(args.output, exist_ok=True)
+
+    # The recordings are identified by their timestamp index
+    is_archive = os.path.exists(args.input) \
+        and not os.path.exists(args.input + ".ts.idx")
+    try:
+        if is_archive:
+            executor, futures = _submit_archive(args)
+        else:
+            executor, futures = _submit_recording(args)
+        with executor:
+            count = 0
+            for future in concurrent.futures.as_completed(futures):
+                count += future.result()
+    except (OSError, ValueError, RuntimeError) as e:
+        print("ERROR: %s" % e, file=sys.stderr)
+        return 1
+
+    print("Extracted %d frames to %s" % (count, args.output))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
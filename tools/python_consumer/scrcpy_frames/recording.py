@@ -0,0 +1,76 @@
+"""Reader of the timestamp indexes of the recordings (--record-timestamps)
+
+The index of a recording `<file>` is `<file>.ts.idx`: the PTS and the capture
+timestamp of each video frame, in the order of the frames in the recording.
+With --record-segment, each segment `<stem>-NNN<ext>` has its own index.
+"""
+
+import glob
+import os
+
+import numpy as np
+
+from . import _layout as L
+
+
+class RecordingIndex:
+    """Timestamp index of a recording file (or segment)
+
+    `entries` is a numpy structured array (pts_us, timestamp_ms) of its
+    frames: the PTS relative to the start of the file, and the capture time
+    in milliseconds since the Unix epoch (-1 if unknown).
+    """
+
+    def __init__(self, path):
+        self.path = path
+        with open(path + ".ts.idx", "rb") as f:
+            data = f.read()
+        if len(data) < L.TIMESTAMP_INDEX_HEADER.size:
+            raise ValueError("Truncated timestamp index: " + path)
+        magic, version = L.TIMESTAMP_INDEX_HEADER.unpack_from(data)
+        if magic != L.TIMESTAMP_INDEX_MAGIC \
+                or version != L.TIMESTAMP_INDEX_VERSION:
+            raise ValueError("Invalid timestamp index: " + path)
+        # An interrupted recording may end with a partial entry
+        count = (len(data) - L.TIMESTAMP_INDEX_HEADER.size) \
+            // L.TIMESTAMP_INDEX_DTYPE.itemsize
+        self.entries = np.frombuffer(data, L.TIMESTAMP_INDEX_DTYPE, count,
+                                     L.TIMESTAMP_INDEX_HEADER.size)
+
+    def __len__(self):
+        return len(self.entries)
+
+    def indices_between(self, start_ms=None, end_ms=None):
+        """The frames whose capture time is in [start_ms, end_ms) (unbounded
+        if None), in the order of the recording
+
+        The range is found by binary search if the timestamps are sorted (as
+        normally recorded).
+        """
+        times = self.entries["timestamp_ms"]
+        if np.all(times[1:] >= times[:-1]):
+            lo = 0 if start_ms is None \
+                else int(np.searchsorted(times, start_ms))
+            hi = len(times) if end_ms is None \
+                else int(np.searchsorted(times, end_ms))
+            return np.arange(lo, hi)
+        mask = np.ones(len(times), bool)
+        if start_ms is not None:
+            mask &= times >= start_ms
+        if end_ms is not None:
+            mask &= times < end_ms
+        return np.flatnonzero(mask)
+
+
+def recording_segments(path):
+    """The files of a recording: `path` itself if it exists, otherwise its
+    segments (--record-segment), in order"""
+    if os.path.exists(path):
+        return [path]
+    stem, ext = os.path.splitext(path)
+    segments = []
+    for f in glob.glob(glob.escape(stem) + "-[0-9][0-9][0-9]*" + ext):
+        number = f[len(stem) + 1:len(f) - len(ext)]
+        if number.isdigit():
+            segments.append((int(number), f))
+    return [f for _, f in sorted(segments)]
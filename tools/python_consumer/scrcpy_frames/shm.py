@@ -0,0 +1,222 @@
+"""Reader of the shared memory ring of frames (--shm-output)
+
+The frames are exposed as numpy views of the shared memory, without copy. The
+layout and the synchronization protocol are described in app/src/shm_ring.h:
+each slot is protected by a sequence lock, so a frame must be validated
+(ShmFrame.valid()) once it has been processed, and discarded if the slot has
+been overwritten meanwhile.
+
+Python has no memory fences: the sequence lock relies on the loads from the
+mapping not being reordered, which holds on x86-64. On weakly ordered CPUs
+(e.g. ARM64), copy the planes (numpy.copy()) before validating them.
+"""
+
+import mmap
+import os
+import sys
+import time
+
+from . import _layout as L
+
+
+def _map_posix(name):
+    if sys.platform.startswith("linux"):
+        fd = os.open("/dev/shm/" + name, os.O_RDONLY)
+    else:
+        import ctypes
+        import ctypes.util
+        libc = ctypes.CDLL(ctypes.util.find_library("c"), use_errno=True)
+        libc.shm_open.argtypes = [ctypes.c_char_p, ctypes.c_int, ctypes.c_int]
+        fd = libc.shm_open(("/" + name).encode(), os.O_RDONLY, 0)
+        if fd == -1:
+            err = ctypes.get_errno()
+            raise OSError(err, os.strerror(err), name)
+    try:
+        return mmap.mmap(fd, 0, access=mmap.ACCESS_READ)
+    finally:
+        os.close(fd)
+
+
+def _map_windows(name):
+    tagname = "Local\\" + name
+    # The size of the whole mapping is known once its header is read
+    with mmap.mmap(-1, L.SHM_RING_HEADER.size, tagname=tagname,
+                   access=mmap.ACCESS_READ) as mm:
+        _, _, slot_count, slot_size, slot_offset, _ = \
+            L.SHM_RING_HEADER.unpack_from(mm)
+    size = slot_offset + slot_count * slot_size
+    return mmap.mmap(-1, max(size, L.SHM_RING_HEADER.size), tagname=tagname,
+                     access=mmap.ACCESS_READ)
+
+
+class ShmFrame:
+    """A frame acquired from the ring
+
+    The planes (`y`, `u` and `v`, the latter being None with
+    --output-planes=y) and the levels of the pyramid (`pyramid`, a dict
+    {level: plane}, empty without --output-pyramid) are read-only numpy views
+    of the slot: they are only meaningful as long as valid() returns True.
+    """
+
+    __slots__ = ("frame_number", "timestamp_ms", "width", "height", "y", "u",
+                 "v", "pyramid", "_mm", "_slot_offset", "_sequence")
+
+    def __init__(self, mm, slot_offset, sequence, frame_number, timestamp_ms,
+                 width, height, planes, pyramid):
+        self._mm = mm
+        self._slot_offset = slot_offset
+        self._sequence = sequence
+        self.frame_number = frame_number
+        self.timestamp_ms = timestamp_ms
+        self.width = width
+        self.height = height
+        self.y, self.u, self.v = planes
+        self.pyramid = pyramid
+
+    def valid(self):
+        """Indicate if the slot has not been overwritten since the frame was
+        acquired
+
+        It must be called after reading the planes: if it returns False, the
+        data read may be corrupted and must be discarded.
+        """
+        seq, = L.U64.unpack_from(self._mm, self._slot_offset)
+        return seq == self._sequence
+
+
+class ShmConsumer:
+    """Consumer of the frames published by scrcpy --shm-output=<name>
+
+    Raise FileNotFoundError if the shared memory does not exist (scrcpy
+    creates it on the first frame), and ValueError if it is not initialized
+    yet or incompatible.
+
+    The numpy views of the frames keep the mapping alive: close() unmaps it
+    only once they are all released.
+    """
+
+    def __init__(self, name):
+        if sys.platform == "win32":
+            mm = _map_windows(name)
+        else:
+            mm = _map_posix(name)
+
+        if len(mm) < L.SHM_RING_HEADER.size:
+            mm.close()
+            raise ValueError("invalid shared memory: " + name)
+
+        magic, version, slot_count, slot_size, slot_offset, _ = \
+            L.SHM_RING_HEADER.unpack_from(mm)
+        if magic != L.SHM_RING_MAGIC or version != L.SHM_RING_VERSION \
+                or not slot_count \
+                or slot_offset + slot_count * slot_size > len(mm):
+            # Not initialized yet, or incompatible
+            mm.close()
+            raise ValueError("shared memory not ready or incompatible: "
+                             + name)
+
+        self.name = name
+        self.slot_count = slot_count
+        self._mm = mm
+        self._slot_size = slot_size
+        self._slot_offset = slot_offset
+
+    def close(self):
+        try:
+            self._mm.close()
+        except BufferError:
+            # Some views of the frames are still alive, the mapping will be
+            # released with them
+            pass
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    @property
+    def write_count(self):
+        """Number of frames published so far"""
+        count, = L.U64.unpack_from(self._mm, L.SHM_RING_WRITE_COUNT_OFFSET)
+        return count
+
+    def acquire(self, frame_number):
+        """Acquire the frame `frame_number` if it is still available
+
+        Return None if it has not been written yet, if it is being written, or
+        if it has already been overwritten.
+        """
+        mm = self._mm
+        slot_offset = self._slot_offset \
+            + (frame_number % self.slot_count) * self._slot_size
+
+        seq, = L.U64.unpack_from(mm, slot_offset)
+        if seq & 1 or not seq:
+            # Being written, or never written
+            return None
+
+        n, = L.U64.unpack_from(mm, slot_offset
+                               + L.SHM_RING_SLOT_FRAME_NUMBER_OFFSET)
+        if n != frame_number:
+            return None
+
+        _, timestamp_ms, width, height, frame_size, _ = \
+            L.FRAME_HEADER.unpack_from(mm, slot_offset
+                                       + L.SHM_RING_SLOT_FRAME_OFFSET)
+        data_offset = slot_offset + L.SHM_RING_SLOT_SIZE
+        if width <= 0 or height <= 0 \
+                or L.SHM_RING_SLOT_SIZE + frame_size > self._slot_size:
+            # Overwritten while reading the header
+            return None
+        planes = L.yuv_planes(mm, data_offset, width, height, frame_size)
+        if planes is None:
+            return None
+
+        levels, = L.U32.unpack_from(mm, slot_offset
+                                    + L.SHM_RING_SLOT_PYRAMID_LEVELS_OFFSET)
+        try:
+            pyramid = L.pyramid_levels(mm, data_offset + frame_size, width,
+                                       height, levels)
+        except ValueError:
+            # Overwritten while reading the header
+            return None
+
+        frame = ShmFrame(mm, slot_offset, seq, frame_number, timestamp_ms,
+                         width, height, planes, pyramid)
+        # The fields read so far may be inconsistent if the slot is overwritten
+        return frame if frame.valid() else None
+
+    def acquire_latest(self):
+        """Acquire the last frame published, if any"""
+        count = self.write_count
+        if not count:
+            return None
+        return self.acquire(count - 1)
+
+    def frames(self, poll_interval=0.001):
+        """Iterate over the new frames, as they are published
+
+        Like the C example, only the latest frame is acquired on each poll:
+        if the consumer is slower than the capture, the frames published
+        meanwhile are skipped (the gaps are visible in the frame numbers).
+        """
+        next_count = self.write_count
+        while True:
+            count = self.write_count
+            if count == next_count:
+                time.sleep(poll_interval)
+                continue
+            next_count = count
+            frame = self.acquire(count - 1)
+            if frame is not None:
+                yield frame
+
+    @classmethod
+    def wait(cls, name, poll_interval=0.1):
+        """Open the shared memory, waiting for scrcpy to create it"""
+        while True:
+            try:
+                return cls(name)
+            except (FileNotFoundError, ValueError):
+                time.sleep(poll_interval)
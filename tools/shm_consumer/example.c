@@ -0,0 +1,68 @@
+// Print the timestamps of the frames published by scrcpy --shm-output=<name>
+//
+// Build: cc -std=c11 -O2 example.c -o shm_consumer (add -lrt on old glibc)
+
+#include <stdio.h>
+
+#ifdef _WIN32
+# include <windows.h>
+# define sleep_ms(ms) Sleep(ms)
+#else
+# include <time.h>
+static void
+sleep_ms(long ms) {
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000};
+    nanosleep(&ts, NULL);
+}
+#endif
+
+#include "scrcpy_shm_consumer.h"
+
+int
+main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Syntax: %s <name>\n", argv[0]);
+        return 1;
+    }
+
+    struct sc_shm_consumer consumer;
+    while (!sc_shm_consumer_open(&consumer, argv[1])) {
+        // scrcpy creates the shared memory on the first frame
+        sleep_ms(100);
+    }
+
+    uint64_t next = 0;
+    for (;;) {
+        uint64_t count = sc_shm_consumer_write_count(&consumer);
+        if (count == next) {
+            sleep_ms(1);
+            continue;
+        }
+
+        if (count - next > 1) {
+            fprintf(stderr, "Skipped %llu frames\n",
+                    (unsigned long long) (count - next - 1));
+        }
+
+        struct sc_shm_frame frame;
+        if (sc_shm_consumer_acquire(&consumer, count - 1, &frame)) {
+            int64_t timestamp = frame.header->timestamp_ms;
+            int width = frame.header->width;
+            int height = frame.header->height;
+            // Process frame.y, frame.u and frame.v here
+            unsigned char first_luma = frame.y[0];
+
+            if (sc_shm_consumer_validate(&frame)) {
+                printf("frame %llu: %dx%d, timestamp %lld, Y[0]=%u\n",
+                       (unsigned long long) frame.frame_number, width, height,
+                       (long long) timestamp, first_luma);
+            }
+        }
+
+        next = count;
+    }
+
+    // unreachable
+    sc_shm_consumer_close(&consumer);
+    return 0;
+}
@@ -0,0 +1,272 @@
+#ifndef SCRCPY_SHM_CONSUMER_H
+#define SCRCPY_SHM_CONSUMER_H
+
+/**
+ * Header-only library to read the frames published by scrcpy with
+ * --shm-output=<name>, without copy.
+ *
+ * Usage:
+ *
+ *     struct sc_shm_consumer consumer;
+ *     if (!sc_shm_consumer_open(&consumer, "name")) { ... }
+ *
+ *     struct sc_shm_frame frame;
+ *     if (sc_shm_consumer_acquire_latest(&consumer, &frame)) {
+ *         // use frame.y, frame.u, frame.v, frame.header->timestamp_ms...
+ *         if (!sc_shm_consumer_validate(&frame)) {
+ *             // the slot has been overwritten while reading, discard
+ *         }
+ *     }
+ *
+ *     sc_shm_consumer_close(&consumer);
+ *
+ * The layout and the synchronization protocol are described in
+ * app/src/shm_ring.h.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <stdio.h>
+# include <stdlib.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+#include "../../app/src/shm_ring.h"
+
+struct sc_shm_consumer {
+    const uint8_t *data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE handle;
+#endif
+};
+
+struct sc_shm_frame {
+    const struct sc_shm_ring_slot *slot;
+    uint64_t sequence; // sequence of the slot when the frame was acquired
+    uint64_t frame_number;
+    const struct frame_header *header;
+    const uint8_t *y;
+    const uint8_t *u;
+    const uint8_t *v;
+};
+
+static inline atomic_uint_least64_t *
+sc_shm_consumer_counter_(const uint64_t *counter) {
+    return (atomic_uint_least64_t *) counter;
+}
+
+static inline const struct sc_shm_ring_header *
+sc_shm_consumer_header_(const struct sc_shm_consumer *consumer) {
+    return (const struct sc_shm_ring_header *) consumer->data;
+}
+
+static inline void
+sc_shm_consumer_close(struct sc_shm_consumer *consumer) {
+#ifdef _WIN32
+    UnmapViewOfFile(consumer->data);
+    CloseHandle(consumer->handle);
+#else
+    munmap((void *) consumer->data, consumer->size);
+#endif
+}
+
+static inline bool
+sc_shm_consumer_open(struct sc_shm_consumer *consumer, const char *name) {
+#ifdef _WIN32
+    char path[256];
+    int len = snprintf(path, sizeof(path), "Local\\%s", name);
+    if (len < 0 || (size_t) len >= sizeof(path)) {
+        return false;
+    }
+
+    HANDLE handle = OpenFileMappingA(FILE_MAP_READ, FALSE, path);
+    if (!handle) {
+        return false;
+    }
+
+    void *data = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        CloseHandle(handle);
+        return false;
+    }
+
+    MEMORY_BASIC_INFORMATION info;
+    if (!VirtualQuery(data, &info, sizeof(info))) {
+        UnmapViewOfFile(data);
+        CloseHandle(handle);
+        return false;
+    }
+
+    consumer->data = data;
+    consumer->size = info.RegionSize;
+    consumer->handle = handle;
+#else
+    char path[256];
+    int len = snprintf(path, sizeof(path), "/%s", name);
+    if (len < 0 || (size_t) len >= sizeof(path)) {
+        return false;
+    }
+
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) || (size_t) sb.st_size
+                            < sizeof(struct sc_shm_ring_header)) {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    consumer->data = data;
+    consumer->size = sb.st_size;
+#endif
+
+    const struct sc_shm_ring_header *header =
+        sc_shm_consumer_header_(consumer);
+    bool ok = !memcmp(header->magic, SC_SHM_RING_MAGIC, sizeof(header->magic))
+           && header->version == SC_SHM_RING_VERSION
+           && header->slot_offset + header->slot_count * header->slot_size
+                <= consumer->size;
+    atomic_thread_fence(memory_order_acquire);
+    if (!ok) {
+        // Not initialized yet, or incompatible
+        sc_shm_consumer_close(consumer);
+        return false;
+    }
+
+    return true;
+}
+
+// Number of frames published so far
+static inline uint64_t
+sc_shm_consumer_write_count(const struct sc_shm_consumer *consumer) {
+    const struct sc_shm_ring_header *header =
+        sc_shm_consumer_header_(consumer);
+    return atomic_load_explicit(
+            sc_shm_consumer_counter_(&header->write_count),
+            memory_order_acquire);
+}
+
+/**
+ * Indicate if the frame has not been overwritten since it was acquired
+ *
+ * It must be called after reading the frame data: if it returns false, the
+ * data read may be corrupted and must be discarded.
+ */
+static inline bool
+sc_shm_consumer_validate(const struct sc_shm_frame *frame) {
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t seq = atomic_load_explicit(
+            sc_shm_consumer_counter_(&frame->slot->sequence),
+            memory_order_relaxed);
+    return seq == frame->sequence;
+}
+
+/**
+ * Acquire the frame `frame_number` if it is still available
+ *
+ * Return false if it has not been written yet, if it is being written, or if
+ * it has already been overwritten.
+ */
+static inline bool
+sc_shm_consumer_acquire(const struct sc_shm_consumer *consumer,
+                        uint64_t frame_number, struct sc_shm_frame *frame) {
+    const struct sc_shm_ring_header *header =
+        sc_shm_consumer_header_(consumer);
+    const uint8_t *base = consumer->data + header->slot_offset;
+    uint64_t index = frame_number % header->slot_count;
+    const struct sc_shm_ring_slot *slot = (const struct sc_shm_ring_slot *)
+        (base + index * header->slot_size);
+
+    uint64_t seq = atomic_load_explicit(
+            sc_shm_consumer_counter_(&slot->sequence), memory_order_acquire);
+    if (seq & 1) {
+        // Being written
+        return false;
+    }
+
+    if (slot->frame_number != frame_number || !seq) {
+        return false;
+    }
+
+    const struct frame_header *fh = &slot->frame;
+    size_t area = (size_t) fh->width * fh->height;
+
+    frame->slot = slot;
+    frame->sequence = seq;
+    frame->frame_number = frame_number;
+    frame->header = fh;
+    frame->y = (const uint8_t *) (slot + 1);
+    frame->u = frame->y + area;
+    frame->v = frame->u + (size_t) (fh->width / 2) * (fh->height / 2);
+
+    // The fields read so far may be inconsistent if the slot is overwritten
+    return sc_shm_consumer_validate(frame);
+}
+
+/**
+ * Return the level of the pyramid of the frame (--output-pyramid), and its
+ * size (the two eyes side by side), or NULL if the slot does not contain it
+ *
+ * As the planes, the level is only meaningful if the frame is validated
+ * after it has been read.
+ */
+static inline const uint8_t *
+sc_shm_consumer_pyramid_level(const struct sc_shm_frame *frame,
+                              unsigned level, int *width, int *height) {
+    uint32_t levels = frame->slot->pyramid_levels;
+    if (level < 1 || level > 31 || !(levels & (1u << level))) {
+        return NULL;
+    }
+
+    // The selected levels follow the frame data, in increasing order
+    const uint8_t *data = frame->y + frame->header->frame_size;
+    int eye_width = frame->header->width / 2;
+    int h = frame->header->height;
+    for (unsigned i = 1; ; ++i) {
+        eye_width /= 2;
+        h /= 2;
+        if (i == level) {
+            *width = 2 * eye_width;
+            *height = h;
+            return data;
+        }
+        if (levels & (1u << i)) {
+            data += (size_t) 2 * eye_width * h;
+        }
+    }
+}
+
+/**
+ * Acquire the last frame published
+ */
+static inline bool
+sc_shm_consumer_acquire_latest(const struct sc_shm_consumer *consumer,
+                               struct sc_shm_frame *frame) {
+    uint64_t count = sc_shm_consumer_write_count(consumer);
+    if (!count) {
+        return false;
+    }
+    return sc_shm_consumer_acquire(consumer, count - 1, frame);
+}
+
+#endif